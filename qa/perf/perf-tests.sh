@@ -0,0 +1,35 @@
+#!/bin/bash
+# Run the load scenarios of qa/perf against the zend of the build, the arguments are passed on to each
+# of them (e.g. --scale=4, --updatebaseline, --baseline=<file>)
+set -e -o pipefail
+
+CURDIR=$(cd $(dirname "$0"); pwd)
+# Get BUILDDIR and REAL_BITCOIND
+. "${CURDIR}/../pull-tester/tests-config.sh"
+
+export BITCOINCLI="${BUILDDIR}/qa/pull-tester/run-bitcoin-cli"
+export BITCOIND="${REAL_BITCOIND}"
+export ZENDOOMC="${REAL_ZENDOO_MC_TEST}"
+
+testScripts=(
+    'perf_sc_certificates.py'
+    'perf_ft_flood.py'
+    'perf_csw_storm.py'
+    'perf_mempool_saturation.py'
+    'perf_gbt_longpoll.py'
+    'perf_reorg.py'
+);
+
+failures=()
+for script in "${testScripts[@]}"; do
+    echo "Running $script"
+    if ! "${CURDIR}/${script}" --srcdir "${BUILDDIR}/src" "$@"; then
+        failures+=("$script")
+    fi
+done
+
+if [ ${#failures[@]} -ne 0 ]; then
+    echo "Regressions or failures in: ${failures[*]}"
+    exit 1
+fi
+echo "All the scenarios are within their baselines"
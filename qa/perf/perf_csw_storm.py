@@ -0,0 +1,94 @@
+#!/usr/bin/env python3
+# Copyright (c) 2018 The Zencash developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#
+# Load scenario: a storm of ceased sidechain withdrawals once a sidechain ceased. Reports the rate
+# they enter the mempool at, their proofs verified on the way, and the time to mine and connect them.
+#
+
+from perf_framework import PerfTestFramework, create_sidechain
+from test_framework.test_framework import ForkHeights
+from test_framework.util import initialize_chain_clean, start_nodes, connect_nodes_bi, \
+    sync_blocks, sync_mempools, advance_epoch, swap_bytes
+from test_framework.mc_test.mc_test import CertTestUtils, CSWTestUtils, generate_random_field_element_hex
+
+from decimal import Decimal
+
+EPOCH_LENGTH = 6
+SC_AMOUNT = Decimal("20")
+
+
+class PerfCswStorm(PerfTestFramework):
+
+    def add_options(self, parser):
+        super().add_options(parser)
+        parser.add_option("--csws", dest="csws", default=50, type="int",
+                          help="Number of ceased sidechain withdrawals (default: %default)")
+
+    def setup_chain(self):
+        initialize_chain_clean(self.options.tmpdir, 2)
+
+    def setup_network(self):
+        self.nodes = start_nodes(2, self.options.tmpdir, extra_args=[["-scproofqueuesize=0", "-logtimemicros=1"]] * 2)
+        connect_nodes_bi(self.nodes, 0, 1)
+        self.is_network_split = False
+        self.sync_all()
+
+    def run_scenario(self):
+        node = self.nodes[0]
+        num_csws = self.options.csws * self.options.scale
+        node.generate(ForkHeights['MINIMAL_SC'])
+        self.sync_all()
+
+        certMcTest = CertTestUtils(self.options.tmpdir, self.options.srcdir)
+        cswMcTest = CSWTestUtils(self.options.tmpdir, self.options.srcdir)
+        vk = certMcTest.generate_params("sc")
+        csw_vk = cswMcTest.generate_params("sc")
+        constant = generate_random_field_element_hex()
+        scid = create_sidechain(node, vk, constant, EPOCH_LENGTH, SC_AMOUNT, csw_vk)
+        node.generate(1)
+        self.sync_all()
+
+        # one certificate, then no more until the sidechain ceases
+        advance_epoch(certMcTest, node, self.sync_all, scid, "sc", constant, EPOCH_LENGTH)
+        node.generate(1)
+        node.generate(int(EPOCH_LENGTH * 1.5))
+        self.sync_all()
+        assert node.getscinfo(scid, False, False)['items'][0]['state'] == "CEASED"
+
+        act_cert_data = node.getactivecertdatahash(scid)['certDataHash']
+        ceasing_cum_tree = node.getceasingcumsccommtreehash(scid)['ceasingCumScTxCommTree']
+        csw_amount = (SC_AMOUNT / (num_csws + 1)).quantize(Decimal("0.00000001"))
+        to_address = self.nodes[1].getnewaddress()
+
+        # the withdrawals are made and signed before the clock starts
+        signed = []
+        for _ in range(num_csws):
+            sender = node.getnewaddress()
+            nullifier = generate_random_field_element_hex()
+            proof = cswMcTest.create_test_proof("sc", csw_amount, str(swap_bytes(scid)), nullifier, sender,
+                                                ceasing_cum_tree, cert_data_hash=act_cert_data, constant=constant)
+            csw = [{"amount": csw_amount, "senderAddress": sender, "scId": scid, "epoch": 0,
+                    "nullifier": nullifier, "activeCertData": act_cert_data,
+                    "ceasingCumScTxCommTree": ceasing_cum_tree, "scProof": proof}]
+            rawtx = node.createrawtransaction([], {to_address: csw_amount}, csw)
+            funded_tx = node.fundrawtransaction(rawtx)
+            signed.append(node.signrawtransaction(funded_tx['hex'], None, None, "NONE")['hex'])
+
+        with self.measure("csw_admission", count=len(signed)):
+            for hex_tx in signed:
+                node.sendrawtransaction(hex_tx)
+
+        with self.measure("csw_relay"):
+            sync_mempools(self.nodes, wait=0.05)
+
+        with self.measure("block_of_csws_mine_and_propagate"):
+            node.generate(1)
+            sync_blocks(self.nodes, wait=0.05)
+        assert node.getmempoolinfo()["size"] == 0
+
+
+if __name__ == '__main__':
+    PerfCswStorm().main()
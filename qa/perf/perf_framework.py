@@ -0,0 +1,151 @@
+#!/usr/bin/env python3
+# Copyright (c) 2018 The Zencash developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#
+# Base class of the regtest load scenarios of qa/perf. A scenario runs like any test of qa/rpc-tests,
+# records its metrics with record(), and once it is done they are printed, written as json with
+# --results, and compared against the stored baseline: a metric worse than its baseline by more
+# than --tolerance fails the scenario.
+#
+
+import json
+import os
+import sys
+import time
+from contextlib import contextmanager
+
+sys.path.insert(0, os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "rpc-tests"))
+
+from decimal import Decimal
+
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.util import bitcoind_processes
+
+DEFAULT_BASELINE = os.path.join(os.path.dirname(os.path.abspath(__file__)), "baseline.json")
+
+# The stages of getblockvalidationstats reported by every scenario
+REPORTED_STAGES = ["check_block", "connect_inputs", "script_checks", "commitment", "proof_verify",
+                   "connect_block", "flush", "connect_tip"]
+
+
+def create_sidechain(node, vk, constant, epoch_length, amount=Decimal("10"), csw_vk=None):
+    '''Create a ceasing sidechain from the funds of node, return its id once the creation is in the mempool'''
+    sc_cr = {
+        "version": 0,
+        "epoch_length": epoch_length,
+        "amount": amount,
+        "address": "dada",
+        "wCertVk": vk,
+        "constant": constant
+    }
+    if csw_vk is not None:
+        sc_cr["wCeasedVk"] = csw_vk
+    rawtx = node.createrawtransaction([], {}, [], [sc_cr])
+    funded_tx = node.fundrawtransaction(rawtx)
+    signed_tx = node.signrawtransaction(funded_tx['hex'])
+    txid = node.sendrawtransaction(signed_tx['hex'])
+    return node.getrawtransaction(txid, 1)['vsc_ccout'][0]['scid']
+
+
+class PerfTestFramework(BitcoinTestFramework):
+
+    def __init__(self):
+        super().__init__()
+        self.metrics = {}
+
+    # Overridden by the scenarios
+    def run_scenario(self):
+        raise NotImplementedError
+
+    def scenario_name(self):
+        return os.path.splitext(os.path.basename(sys.argv[0]))[0]
+
+    def add_options(self, parser):
+        parser.add_option("--scale", dest="scale", default=1, type="int",
+                          help="Multiply the size of the workload (default: %default)")
+        parser.add_option("--baseline", dest="baseline", default=DEFAULT_BASELINE,
+                          help="The baseline the metrics are compared against (default: %default)")
+        parser.add_option("--updatebaseline", dest="updatebaseline", default=False, action="store_true",
+                          help="Store the metrics of this run as the baseline of the scenario")
+        parser.add_option("--tolerance", dest="tolerance", default=0.25, type="float",
+                          help="The fraction a metric may be worse than its baseline by (default: %default)")
+        parser.add_option("--results", dest="results", default=None,
+                          help="Write the metrics of this run to this json file")
+
+    def run_test(self):
+        for node in self.nodes:
+            node.getblockvalidationstats(True)
+        self.run_scenario()
+        for i, node in enumerate(self.nodes):
+            self.record_validation_stats(node, "node%d" % i)
+            self.record("node%d_rss_mib" % i, self.rss_mib(i), higher_is_better=False)
+        self.report()
+
+    def record(self, name, value, higher_is_better=True):
+        self.metrics[name] = {"value": value, "higher_is_better": higher_is_better}
+        print("  {:<45} {:>14.3f}".format(name, value))
+
+    @contextmanager
+    def measure(self, name, count=None, unit="s"):
+        '''Record the wall time of the block as name_<unit>, and as a rate name_per_s if count is given'''
+        start = time.time()
+        yield
+        elapsed = time.time() - start
+        self.record("{}_{}".format(name, unit), elapsed if unit == "s" else elapsed * 1000, higher_is_better=False)
+        if count is not None and elapsed > 0:
+            self.record("{}_per_s".format(name), count / elapsed)
+
+    def record_validation_stats(self, node, prefix):
+        stats = node.getblockvalidationstats()
+        for stage in REPORTED_STAGES:
+            if stage in stats and stats[stage]["count"] > 0:
+                self.record("{}_{}_mean_us".format(prefix, stage), stats[stage]["mean_us"], higher_is_better=False)
+                self.record("{}_{}_p99_us".format(prefix, stage), stats[stage]["p99_us"], higher_is_better=False)
+
+    def rss_mib(self, i):
+        '''The resident set size of node i, from /proc, 0 where there is none'''
+        try:
+            with open("/proc/{}/status".format(bitcoind_processes[i].pid)) as status:
+                for line in status:
+                    if line.startswith("VmRSS:"):
+                        return int(line.split()[1]) / 1024.0
+        except (IOError, KeyError):
+            pass
+        return 0
+
+    def report(self):
+        name = self.scenario_name()
+        if self.options.results:
+            with open(self.options.results, "w") as f:
+                json.dump({name: self.metrics}, f, indent=2, sort_keys=True)
+
+        baselines = {}
+        if os.path.isfile(self.options.baseline):
+            with open(self.options.baseline) as f:
+                baselines = json.load(f)
+
+        if self.options.updatebaseline:
+            baselines[name] = {metric: entry["value"] for metric, entry in self.metrics.items()}
+            with open(self.options.baseline, "w") as f:
+                json.dump(baselines, f, indent=2, sort_keys=True)
+            print("Baseline of {} updated in {}".format(name, self.options.baseline))
+            return
+
+        baseline = baselines.get(name)
+        if baseline is None:
+            print("No baseline for {} in {}, run with --updatebaseline to store one".format(name, self.options.baseline))
+            return
+
+        regressions = []
+        for metric, entry in sorted(self.metrics.items()):
+            if metric not in baseline or baseline[metric] == 0:
+                continue
+            change = (entry["value"] - baseline[metric]) / baseline[metric]
+            worse = -change if entry["higher_is_better"] else change
+            flag = " <== regression" if worse > self.options.tolerance else ""
+            print("  {:<45} {:>+8.1f}% vs baseline{}".format(metric, change * 100, flag))
+            if flag:
+                regressions.append(metric)
+        assert not regressions, "{} metrics regressed: {}".format(len(regressions), ", ".join(regressions))
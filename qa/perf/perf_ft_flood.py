@@ -0,0 +1,73 @@
+#!/usr/bin/env python3
+# Copyright (c) 2018 The Zencash developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#
+# Load scenario: a flood of forward transfers to a few sidechains. Reports the rate they enter the
+# mempool at, the time they take to reach the other node, and the time to mine and connect them.
+#
+
+from perf_framework import PerfTestFramework, create_sidechain
+from test_framework.test_framework import ForkHeights
+from test_framework.util import initialize_chain_clean, start_nodes, connect_nodes_bi, \
+    sync_blocks, sync_mempools
+from test_framework.mc_test.mc_test import CertTestUtils, generate_random_field_element_hex
+
+from decimal import Decimal
+
+EPOCH_LENGTH = 100
+FT_AMOUNT = Decimal("0.01")
+
+
+class PerfFtFlood(PerfTestFramework):
+
+    def add_options(self, parser):
+        super().add_options(parser)
+        parser.add_option("--transfers", dest="transfers", default=500, type="int",
+                          help="Number of forward transfers (default: %default)")
+        parser.add_option("--sidechains", dest="sidechains", default=4, type="int",
+                          help="Number of sidechains they are spread over (default: %default)")
+
+    def setup_chain(self):
+        initialize_chain_clean(self.options.tmpdir, 2)
+
+    def setup_network(self):
+        self.nodes = start_nodes(2, self.options.tmpdir, extra_args=[["-logtimemicros=1"]] * 2)
+        connect_nodes_bi(self.nodes, 0, 1)
+        self.is_network_split = False
+        self.sync_all()
+
+    def run_scenario(self):
+        node = self.nodes[0]
+        num_transfers = self.options.transfers * self.options.scale
+        node.generate(ForkHeights['MINIMAL_SC'])
+        self.sync_all()
+
+        mcTest = CertTestUtils(self.options.tmpdir, self.options.srcdir)
+        vk = mcTest.generate_params("sc")
+        constant = generate_random_field_element_hex()
+        scids = [create_sidechain(node, vk, constant, EPOCH_LENGTH) for _ in range(self.options.sidechains)]
+        node.generate(1)
+        self.sync_all()
+
+        mc_return_address = node.getnewaddress()
+        with self.measure("ft_admission", count=num_transfers):
+            for i in range(num_transfers):
+                node.sc_send([{"toaddress": "abcd", "amount": FT_AMOUNT, "scid": scids[i % len(scids)],
+                               "mcReturnAddress": mc_return_address}])
+
+        with self.measure("ft_relay"):
+            sync_mempools(self.nodes, wait=0.05)
+
+        with self.measure("getblocktemplate", unit="ms"):
+            node.getblocktemplate()
+
+        with self.measure("block_of_transfers_mine_and_propagate"):
+            node.generate(1)
+            sync_blocks(self.nodes, wait=0.05)
+        self.record("mempool_left", node.getmempoolinfo()["size"], higher_is_better=False)
+
+
+if __name__ == '__main__':
+    PerfFtFlood().main()
@@ -0,0 +1,83 @@
+#!/usr/bin/env python3
+# Copyright (c) 2018 The Zencash developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#
+# Load scenario: long-polling getblocktemplate calls while transactions keep arriving. Reports the
+# latency from a new block on another node to the long poll returning, and the time of a fresh template.
+#
+
+from perf_framework import PerfTestFramework
+from test_framework.authproxy import AuthServiceProxy
+from test_framework.util import initialize_chain_clean, start_nodes, connect_nodes_bi, sync_blocks
+
+from decimal import Decimal
+import threading
+import time
+
+
+class LongpollThread(threading.Thread):
+    def __init__(self, node):
+        threading.Thread.__init__(self)
+        self.longpollid = node.getblocktemplate()['longpollid']
+        # the connection of the node can't be shared between two threads
+        self.node = AuthServiceProxy(node.url, timeout=600)
+        self.returned = None
+
+    def run(self):
+        self.node.getblocktemplate({'longpollid': self.longpollid})
+        self.returned = time.time()
+
+
+class PerfGbtLongpoll(PerfTestFramework):
+
+    def add_options(self, parser):
+        super().add_options(parser)
+        parser.add_option("--rounds", dest="rounds", default=10, type="int",
+                          help="Blocks the long polls wait for (default: %default)")
+        parser.add_option("--load", dest="load", default=50, type="int",
+                          help="Transactions sent to the polled node each round (default: %default)")
+
+    def setup_chain(self):
+        initialize_chain_clean(self.options.tmpdir, 2)
+
+    def setup_network(self):
+        self.nodes = start_nodes(2, self.options.tmpdir, extra_args=[["-logtimemicros=1"]] * 2)
+        connect_nodes_bi(self.nodes, 0, 1)
+        self.is_network_split = False
+        self.sync_all()
+
+    def run_scenario(self):
+        node = self.nodes[0]
+        node.generate(200)
+        self.nodes[1].generate(101)
+        self.sync_all()
+        address = self.nodes[1].getnewaddress()
+
+        latencies = []
+        for _ in range(self.options.rounds * self.options.scale):
+            thread = LongpollThread(node)
+            thread.start()
+            # the node under load keeps building the template of its mempool
+            for _ in range(self.options.load):
+                node.sendtoaddress(address, Decimal("0.01"))
+            start = time.time()
+            self.nodes[1].generate(1)
+            thread.join(60)
+            assert not thread.is_alive()
+            latencies.append((thread.returned - start) * 1000)
+            sync_blocks(self.nodes, wait=0.05)
+
+        latencies.sort()
+        self.record("longpoll_latency_mean_ms", sum(latencies) / len(latencies), higher_is_better=False)
+        self.record("longpoll_latency_max_ms", latencies[-1], higher_is_better=False)
+
+        for _ in range(self.options.load):
+            node.sendtoaddress(address, Decimal("0.01"))
+        with self.measure("getblocktemplate_under_load", unit="ms"):
+            node.getblocktemplate()
+
+
+if __name__ == '__main__':
+    PerfGbtLongpoll().main()
@@ -0,0 +1,82 @@
+#!/usr/bin/env python3
+# Copyright (c) 2018 The Zencash developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#
+# Load scenario: a mempool filled to its -maxmempool limit with large transactions. Reports the
+# admission rate before and once at the limit, the memory the mempool uses and the node's RSS.
+#
+
+from perf_framework import PerfTestFramework
+from test_framework.authproxy import JSONRPCException
+from test_framework.util import initialize_chain_clean, start_nodes, connect_nodes_bi, sync_mempools
+
+from decimal import Decimal
+import time
+
+MAX_MEMPOOL_MB = 4
+NUM_OUTPUTS = 250
+OUTPUT_AMOUNT = Decimal("0.0001")
+
+
+class PerfMempoolSaturation(PerfTestFramework):
+
+    def add_options(self, parser):
+        super().add_options(parser)
+        parser.add_option("--overfill", dest="overfill", default=100, type="int",
+                          help="Transactions sent once the mempool is at its limit (default: %default)")
+
+    def setup_chain(self):
+        initialize_chain_clean(self.options.tmpdir, 2)
+
+    def setup_network(self):
+        args = ["-maxmempool=%d" % MAX_MEMPOOL_MB, "-logtimemicros=1"]
+        self.nodes = start_nodes(2, self.options.tmpdir, extra_args=[args] * 2)
+        connect_nodes_bi(self.nodes, 0, 1)
+        self.is_network_split = False
+        self.sync_all()
+
+    def send_large_tx(self, node, outputs):
+        '''Whether a transaction of NUM_OUTPUTS outputs got into the mempool'''
+        try:
+            node.sendmany("", outputs)
+            return True
+        except JSONRPCException:
+            return False
+
+    def run_scenario(self):
+        node = self.nodes[0]
+        node.generate(200 + 10 * self.options.scale)
+        self.sync_all()
+        outputs = {self.nodes[1].getnewaddress(): OUTPUT_AMOUNT for _ in range(NUM_OUTPUTS)}
+        limit = MAX_MEMPOOL_MB * 1000000
+
+        # fill the mempool up to 90% of its limit, where no entry is evicted yet
+        sent = 0
+        start = time.time()
+        while node.getmempoolinfo()["usage"] < 0.9 * limit:
+            if not self.send_large_tx(node, outputs):
+                break
+            sent += 1
+        self.record("admission_below_limit_per_s", sent / (time.time() - start))
+        self.record("admitted_below_limit", sent)
+
+        admitted = 0
+        with self.measure("admission_at_limit", count=self.options.overfill * self.options.scale):
+            for _ in range(self.options.overfill * self.options.scale):
+                admitted += self.send_large_tx(node, outputs)
+        self.record("admitted_at_limit", admitted)
+
+        info = node.getmempoolinfo()
+        assert info["usage"] <= limit
+        self.record("mempool_size", info["size"])
+        self.record("mempool_bytes", info["bytes"], higher_is_better=False)
+        self.record("mempool_usage_mib", info["usage"] / (1024.0 * 1024.0), higher_is_better=False)
+
+        with self.measure("mempool_relay"):
+            sync_mempools(self.nodes, wait=0.1)
+
+
+if __name__ == '__main__':
+    PerfMempoolSaturation().main()
@@ -0,0 +1,60 @@
+#!/usr/bin/env python3
+# Copyright (c) 2018 The Zencash developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#
+# Load scenario: a reorg of 100 blocks, from a longer chain mined while the network was split. Reports
+# the time it takes to disconnect the blocks of the shorter chain and connect the others, and the
+# time the transactions of the blocks disconnected take to go back to the mempool.
+#
+
+from perf_framework import PerfTestFramework
+from test_framework.util import initialize_chain_clean, start_nodes, connect_nodes_bi, sync_blocks
+
+from decimal import Decimal
+
+REORG_DEPTH = 100
+TXS_PER_BLOCK = 5
+
+
+class PerfReorg(PerfTestFramework):
+
+    def setup_chain(self):
+        initialize_chain_clean(self.options.tmpdir, 2)
+
+    def setup_network(self):
+        self.nodes = start_nodes(2, self.options.tmpdir, extra_args=[["-logtimemicros=1"]] * 2)
+        connect_nodes_bi(self.nodes, 0, 1)
+        self.is_network_split = False
+        self.sync_all()
+
+    def mine_with_txs(self, node, blocks):
+        address = node.getnewaddress()
+        for _ in range(blocks):
+            for _ in range(TXS_PER_BLOCK):
+                node.sendtoaddress(address, Decimal("0.01"))
+            node.generate(1)
+
+    def run_scenario(self):
+        depth = REORG_DEPTH * self.options.scale
+        self.nodes[0].generate(150)
+        self.sync_all()
+        self.nodes[1].generate(150)
+        self.sync_all()
+
+        self.split_network(0)
+        self.mine_with_txs(self.nodes[0], depth)
+        self.mine_with_txs(self.nodes[1], depth + 1)
+        tip = self.nodes[1].getbestblockhash()
+
+        with self.measure("reorg_{}_blocks".format(depth), count=2 * depth + 1):
+            connect_nodes_bi(self.nodes, 0, 1)
+            sync_blocks(self.nodes, wait=0.05)
+        self.is_network_split = False
+        assert self.nodes[0].getbestblockhash() == tip
+        self.record("txs_back_to_the_mempool", self.nodes[0].getmempoolinfo()["size"])
+
+
+if __name__ == '__main__':
+    PerfReorg().main()
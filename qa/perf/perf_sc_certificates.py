@@ -0,0 +1,88 @@
+#!/usr/bin/env python3
+# Copyright (c) 2018 The Zencash developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#
+# Load scenario: --sidechains sidechains each get a certificate every epoch, for --epochs epochs.
+# Reports the admission rate of the certificates, the time to mine and propagate the blocks
+# carrying them, and the stages of their connection.
+#
+
+from perf_framework import PerfTestFramework, create_sidechain
+from test_framework.test_framework import ForkHeights
+from test_framework.util import initialize_chain_clean, start_nodes, connect_nodes_bi, \
+    sync_blocks, get_epoch_data, swap_bytes
+from test_framework.mc_test.mc_test import CertTestUtils, generate_random_field_element_hex
+
+from decimal import Decimal
+
+EPOCH_LENGTH = 10
+CERT_FEE = Decimal("0.0001")
+
+
+class PerfScCertificates(PerfTestFramework):
+
+    def add_options(self, parser):
+        super().add_options(parser)
+        parser.add_option("--sidechains", dest="sidechains", default=10, type="int",
+                          help="Number of sidechains (default: %default)")
+        parser.add_option("--epochs", dest="epochs", default=3, type="int",
+                          help="Number of epochs with certificates (default: %default)")
+
+    def setup_chain(self):
+        initialize_chain_clean(self.options.tmpdir, 2)
+
+    def setup_network(self):
+        self.nodes = start_nodes(2, self.options.tmpdir, extra_args=[["-scproofqueuesize=0", "-logtimemicros=1"]] * 2)
+        connect_nodes_bi(self.nodes, 0, 1)
+        self.is_network_split = False
+        self.sync_all()
+
+    def run_scenario(self):
+        node = self.nodes[0]
+        num_sidechains = self.options.sidechains * self.options.scale
+        node.generate(ForkHeights['MINIMAL_SC'])
+        self.sync_all()
+
+        mcTest = CertTestUtils(self.options.tmpdir, self.options.srcdir)
+        vk = mcTest.generate_params("sc")
+        constant = generate_random_field_element_hex()
+        scids = [create_sidechain(node, vk, constant, EPOCH_LENGTH) for _ in range(num_sidechains)]
+        node.generate(1)
+        self.sync_all()
+
+        num_certs = 0
+        for epoch in range(self.options.epochs):
+            # to the start of the next epoch, the block of the certificates included
+            node.generate(EPOCH_LENGTH if epoch == 0 else EPOCH_LENGTH - 1)
+            self.sync_all()
+
+            # the proofs are made before the clock starts, only the admission is measured
+            certs = []
+            for scid in scids:
+                epoch_number, epoch_cum_tree_hash, _ = get_epoch_data(scid, node, EPOCH_LENGTH)
+                proof = mcTest.create_test_proof("sc", str(swap_bytes(scid)), epoch_number, 1, Decimal(0), Decimal(0),
+                                                 epoch_cum_tree_hash, prev_cert_hash=None, constant=constant,
+                                                 pks=[], amounts=[])
+                certs.append((scid, epoch_number, epoch_cum_tree_hash, proof))
+
+            with self.measure("epoch_certificates_admission", count=len(certs)):
+                for scid, epoch_number, epoch_cum_tree_hash, proof in certs:
+                    node.sc_send_certificate(scid, epoch_number, 1, epoch_cum_tree_hash, proof, [],
+                                             Decimal(0), Decimal(0), CERT_FEE)
+            num_certs += len(certs)
+
+            with self.measure("block_of_certificates_mine_and_propagate"):
+                node.generate(1)
+                sync_blocks(self.nodes, wait=0.05)
+            assert len(node.getblock(node.getbestblockhash())['cert']) == len(certs)
+
+        with self.measure("blocks", count=10 * EPOCH_LENGTH):
+            node.generate(10 * EPOCH_LENGTH)
+            sync_blocks(self.nodes, wait=0.05)
+        self.record("certificates", num_certs)
+
+
+if __name__ == '__main__':
+    PerfScCertificates().main()
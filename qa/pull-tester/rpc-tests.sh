@@ -69,6 +69,13 @@ testScripts=(
   'mempool_coinbase_spends.py',14,34
   'mempool_tx_input_limit.py',91,308
   'httpbasics.py',21,63
+  'rpcworklanes.py',8,20
+  'txoutsetsnapshot.py',16,40
+  'txoutsetmuhash.py',12,30
+  'chaindata.py',10,25
+  'getdbstats.py',5,15
+  'zencli_batch.py',5,15
+  'txtrace.py',8,20
   'zapwallettxes.py',35,86
   'proxy_test.py',22,142
   'merkle_blocks.py',69,163
@@ -76,6 +83,7 @@ testScripts=(
   'signrawtransactions.py',6,15
   'walletbackup.py',432,1478
   'key_import_export.py',41,86
+  'wallet_importmulti.py',38,80
   'nodehandling.py',428,666
   'reindex.py',13,33
   'decodescript.py',6,16
@@ -116,6 +124,7 @@ testScripts=(
   'sc_cert_quality_wallet.py',101,250
   'ws_messages.py',71,173
   'ws_getsidechainversions.py',47,138
+  'ws_ipc.py',20,40
   'sc_cert_ceasing_split.py',66,161
   'sc_async_proof_verifier.py',97,227
   'sc_quality_blockchain.py',86,254
@@ -137,6 +146,7 @@ testScripts=(
   'getblockmerkleroots.py',67,156
   'sc_block_partitions.py',60,153
   'sc_cert_bwt_amount_rounding.py',30,73
+  'sc_cert_fee_pool.py',40,90
   'sc_csw_eviction_from_mempool.py',124,377
   'sc_csw_memcleanup_split.py',70,188
   'sc_csw_balance_exceeding.py',57,162
@@ -151,6 +161,7 @@ testScripts=(
   'addressindex.py',34,95
   'spentindex.py',18,74
   'timestampindex.py',21,75
+  'asyncindexes.py',25,70
   'sc_cert_addressindex.py',128,508
   'sc_cert_addrmempool.py',46,168
   'getblockexpanded.py',191,478
@@ -162,6 +173,9 @@ testScripts=(
   'sc_big_commitment_tree.py',63,110
   'sc_big_commitment_tree_getblockmerkleroot.py',11,25
   'p2p_ignore_spent_tx.py',215,455
+  'p2p_fastrelay.py',20,45
+  'socketevents.py',22,60
+  'msghandlerthreads.py',25,70
   'shieldedpooldeprecation_rpc.py',558,1794
   'mempool_size_limit.py',121,203
   'mempool_size_limit_more.py',103,160
@@ -12,7 +12,7 @@ import pprint
 import time
 from decimal import Decimal
 from test_framework.test_framework import BitcoinTestFramework
-from test_framework.util import assert_equal, connect_nodes, initialize_chain_clean, start_node, to_satoshis
+from test_framework.util import assert_equal, assert_raises, connect_nodes, initialize_chain_clean, start_node, to_satoshis
 from test_framework.mininode import COutPoint, CTransaction, CTxIn, CTxOut
 from test_framework.authproxy import JSONRPCException
 
@@ -139,10 +139,30 @@ class AddressIndexTest(BitcoinTestFramework):
         assert_equal(len(txidsmany), 4)
         assert_equal(txidsmany[3], sent_txid)
 
+        # Check that paging through the txids, in both directions, returns the same txids
+        print("Testing paginated txids...")
+        for reverse in [False, True]:
+            paged = []
+            query = {"addresses": [addr1], "limit": 1, "reverse": reverse}
+            while True:
+                page = self.nodes[1].getaddresstxids(query)
+                assert(len(page["txids"]) <= 1)
+                paged += page["txids"]
+                if "cursor" not in page:
+                    break
+                query["cursor"] = page["cursor"]
+            assert_equal(paged, txidsmany[::-1] if reverse else txidsmany)
+
+        page = self.nodes[1].getaddressdeltas({"addresses": [addr1], "limit": 2})
+        assert_equal(len(set(delta["txid"] for delta in page["deltas"])), 2)
+        assert("cursor" in page)
+        assert_raises(JSONRPCException, self.nodes[1].getaddresstxids, {"addresses": [addr1, addr2], "limit": 1})
+
         # Check that balances are correct
         print("Testing balances...")
         balance0 = self.nodes[1].getaddressbalance(addr1)
         assert_equal(balance0["balance"], to_satoshis(45) + 21)
+        assert_equal(balance0["txcount"], 4)
 
         # Check that balances are correct after spending
         print("Testing balances after spending...")
@@ -0,0 +1,79 @@
+#!/usr/bin/env python3
+# Copyright (c) 2014 The Bitcoin Core developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#
+# Test that the indexes written by the background index writer match the synchronously written ones
+#
+
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.util import assert_equal, connect_nodes, initialize_chain_clean, \
+    start_node, stop_node
+
+INDEX_ARGS = ["-txindex", "-addressindex", "-spentindex", "-timestampindex", "-maturityheightindex"]
+
+
+class AsyncIndexesTest(BitcoinTestFramework):
+
+    def setup_chain(self):
+        print("Initializing test directory "+self.options.tmpdir)
+        initialize_chain_clean(self.options.tmpdir, 2)
+
+    def start_async_node(self):
+        return start_node(0, self.options.tmpdir, INDEX_ARGS + ["-asyncindexes=1", "-indexwriterqueue=1"])
+
+    def setup_network(self):
+        self.nodes = []
+        self.nodes.append(self.start_async_node())
+        self.nodes.append(start_node(1, self.options.tmpdir, INDEX_ARGS + ["-asyncindexes=0"]))
+        connect_nodes(self.nodes, 0, 1)
+        self.is_network_split = False
+        self.sync_all()
+
+    def check_indexes(self, address, txid, blockhashes):
+        for node in self.nodes:
+            assert_equal(node.getdbstats()["indexes"]["bestblock"], node.getbestblockhash())
+            assert_equal(node.getdbstats()["indexes"]["pending"], 0)
+
+        async_node, sync_node = self.nodes
+        assert_equal(async_node.getaddressbalance(address), sync_node.getaddressbalance(address))
+        assert_equal(async_node.getaddresstxids(address), sync_node.getaddresstxids(address))
+        assert_equal(async_node.getaddressutxos(address), sync_node.getaddressutxos(address))
+        assert_equal(async_node.getrawtransaction(txid, 1), sync_node.getrawtransaction(txid, 1))
+        spent = async_node.getrawtransaction(txid, 1)["vin"][0]
+        assert_equal(async_node.getspentinfo({"txid": spent["txid"], "index": spent["vout"]}),
+                     sync_node.getspentinfo({"txid": spent["txid"], "index": spent["vout"]}))
+        low = async_node.getblock(blockhashes[0])["time"]
+        high = async_node.getblock(blockhashes[-1])["time"] + 1
+        assert_equal(async_node.getblockhashes(high, low), sync_node.getblockhashes(high, low))
+
+    def run_test(self):
+        print("Mining blocks...")
+        blockhashes = self.nodes[0].generate(105)
+        self.sync_all()
+
+        address = self.nodes[1].getnewaddress()
+        txid = self.nodes[0].sendtoaddress(address, 1)
+        self.sync_all()
+        blockhashes.extend(self.nodes[0].generate(10))
+        self.sync_all()
+        self.check_indexes(address, txid, blockhashes)
+
+        print("Disconnecting blocks...")
+        for node in self.nodes:
+            node.invalidateblock(blockhashes[-10])
+        self.check_indexes(address, txid, blockhashes[:-10])
+        for node in self.nodes:
+            node.reconsiderblock(blockhashes[-10])
+        self.check_indexes(address, txid, blockhashes)
+
+        print("Restarting the node...")
+        stop_node(self.nodes[0], 0)
+        self.nodes[0] = self.start_async_node()
+        connect_nodes(self.nodes, 0, 1)
+        self.check_indexes(address, txid, blockhashes)
+
+
+if __name__ == '__main__':
+    AsyncIndexesTest().main()
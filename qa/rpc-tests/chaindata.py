@@ -0,0 +1,126 @@
+#!/usr/bin/env python3
+# Copyright (c) 2014 The Bitcoin Core developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#
+# Test dumpchaindata and the column files it writes
+#
+
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.authproxy import JSONRPCException
+from test_framework.util import assert_equal, initialize_chain_clean, start_node
+
+import os
+import struct
+
+INT64, HASH, BYTES = 1, 2, 3
+
+
+def read_compact_size(f):
+    n = f.read(1)[0]
+    if n == 253:
+        return struct.unpack("<H", f.read(2))[0]
+    if n == 254:
+        return struct.unpack("<I", f.read(4))[0]
+    if n == 255:
+        return struct.unpack("<Q", f.read(8))[0]
+    return n
+
+
+def read_values(type, data, rows):
+    values = []
+    pos = 0
+    for _ in range(rows):
+        if type == INT64:
+            values.append(struct.unpack_from("<q", data, pos)[0])
+            pos += 8
+        elif type == HASH:
+            values.append(data[pos:pos + 32][::-1].hex())
+            pos += 32
+        else:
+            n = data[pos]
+            pos += 1
+            assert n < 253
+            values.append(data[pos:pos + n])
+            pos += n
+    assert_equal(pos, len(data))
+    return values
+
+
+def read_table(path):
+    '''The columns of a file written without compression, by name'''
+    with open(path, "rb") as f:
+        magic, version = struct.unpack("<II", f.read(8))
+        assert_equal(magic, 0x7a636f6c)
+        assert_equal(version, 1)
+        name = f.read(read_compact_size(f)).decode()
+        first, last, rows, ncolumns = struct.unpack("<iiQI", f.read(20))
+        columns = {}
+        for _ in range(ncolumns):
+            column = f.read(read_compact_size(f)).decode()
+            type, compressed, raw_size, stored_size = struct.unpack("<BBQQ", f.read(18))
+            assert_equal(compressed, 0)
+            assert_equal(raw_size, stored_size)
+            columns[column] = read_values(type, f.read(stored_size), rows)
+        # the hash of the file
+        assert_equal(len(f.read()), 32)
+    return name, first, last, columns
+
+
+class ChainDataTest(BitcoinTestFramework):
+
+    def setup_chain(self):
+        print("Initializing test directory "+self.options.tmpdir)
+        initialize_chain_clean(self.options.tmpdir, 1)
+
+    def setup_network(self):
+        self.nodes = []
+        self.is_network_split = False
+        self.nodes.append(start_node(0, self.options.tmpdir))
+
+    def run_test(self):
+        node0 = self.nodes[0]
+        node0.generate(110)
+        txid = node0.sendtoaddress(node0.getnewaddress(), 1.5)
+        node0.generate(1)
+
+        dump = node0.dumpchaindata("chaindata", 0, 100, 0)
+        assert_equal(dump["from_height"], 0)
+        assert_equal(dump["to_height"], 100)
+        assert_equal(dump["transactions"], 101)
+        assert_equal(dump["certificates"], 0)
+        chaindir = dump["dir"]
+        tables = sorted(os.listdir(chaindir))
+        assert_equal(dump["files"], len(tables))
+        assert("blocks" in tables and "sc_events" in tables)
+
+        name, first, last, blocks = read_table(os.path.join(chaindir, "blocks", "00000000-00000100.zcol"))
+        assert_equal((name, first, last), ("blocks", 0, 100))
+        assert_equal(blocks["height"], list(range(101)))
+        assert_equal(blocks["hash"][100], node0.getblockhash(100))
+        assert_equal(blocks["prev_hash"][100], node0.getblockhash(99))
+
+        # the export goes on with the following blocks, the spent outputs coming from the undo data
+        dump = node0.dumpchaindata("chaindata", 101, -1, 0)
+        assert_equal(dump["to_height"], 111)
+        _, _, _, txs = read_table(os.path.join(chaindir, "transactions", "00000101-00000111.zcol"))
+        assert(txid in txs["txid"])
+        _, _, _, inputs = read_table(os.path.join(chaindir, "inputs", "00000101-00000111.zcol"))
+        rows = [i for i, h in enumerate(inputs["txid"]) if h == txid]
+        assert(len(rows) > 0)
+        spent = node0.getrawtransaction(txid, 1)["vin"]
+        for row in rows:
+            assert_equal(inputs["prev_txid"][row], spent[inputs["input"][row]]["txid"])
+            assert(inputs["value"][row] > 0)
+
+        # blocks not in the chain
+        try:
+            node0.dumpchaindata("chaindata", 200)
+            raise AssertionError("dumpchaindata exported missing blocks")
+        except JSONRPCException as e:
+            assert("invalid height range" in e.error["message"])
+
+
+if __name__ == '__main__':
+    ChainDataTest().main()
@@ -41,9 +41,10 @@ class LongpollThread(threading.Thread):
         # create a new connection to the node, we can't use the same
         # connection from two threads
         self.node = AuthServiceProxy(node.url, timeout=600)
+        self.result = None
 
     def run(self):
-        self.node.getblocktemplate({'longpollid':self.longpollid})
+        self.result = self.node.getblocktemplate({'longpollid':self.longpollid})
 
 class GetBlockTemplateLPTest(BitcoinTestFramework):
     '''
@@ -88,6 +89,17 @@ class GetBlockTemplateLPTest(BitcoinTestFramework):
         thr.join(60 + 20)
         assert(not thr.is_alive())
 
+        # all the waiters are handed the same new template
+        thrs = [LongpollThread(self.nodes[0]) for _ in range(3)]
+        for t in thrs:
+            t.start()
+        self.nodes[1].generate(1)
+        for t in thrs:
+            t.join(5)
+            assert(not t.is_alive())
+        assert(len(set(t.result['longpollid'] for t in thrs)) == 1)
+        assert(thrs[0].result['longpollid'] != thrs[0].longpollid)
+
 if __name__ == '__main__':
     GetBlockTemplateLPTest().main()
 
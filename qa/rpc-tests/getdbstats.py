@@ -0,0 +1,49 @@
+#!/usr/bin/env python3
+# Copyright (c) 2014 The Bitcoin Core developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#
+# Test the per database leveldb options and their getdbstats report
+#
+
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.util import assert_equal, initialize_chain_clean, start_node
+
+
+class GetDBStatsTest(BitcoinTestFramework):
+
+    def setup_chain(self):
+        print("Initializing test directory "+self.options.tmpdir)
+        initialize_chain_clean(self.options.tmpdir, 1)
+
+    def setup_network(self):
+        self.nodes = []
+        self.is_network_split = False
+        self.nodes.append(start_node(0, self.options.tmpdir, [
+            "-coinsviewdbbloombits=0", "-coinsviewdbblocksize=16",
+            "-blocktreedbcompression=1", "-blocktreedbblockcache=3", "-blocktreedbwritebuffer=2"]))
+
+    def run_test(self):
+        node = self.nodes[0]
+        node.generate(20)
+
+        stats = node.getdbstats()
+        chainstate = stats["chainstate"]["options"]
+        assert_equal(chainstate["bloom_bits"], 0)
+        assert_equal(chainstate["block_size"], 16 * 1024)
+        assert_equal(chainstate["compression"], False)
+
+        blockindex = stats["blockindex"]["options"]
+        assert_equal(blockindex["bloom_bits"], 10)
+        assert_equal(blockindex["compression"], True)
+        assert_equal(blockindex["block_cache"], 3 * 1024 * 1024)
+        assert_equal(blockindex["write_buffer"], 2 * 1024 * 1024)
+
+        for db in (stats["chainstate"], stats["blockindex"]):
+            assert(0 <= db["cache_hit_rate"] <= 1)
+            assert_equal(db["size_mib"], sum(level["size_mib"] for level in db["levels"]))
+
+
+if __name__ == '__main__':
+    GetDBStatsTest().main()
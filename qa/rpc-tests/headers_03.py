@@ -113,6 +113,9 @@ class headers(BitcoinTestFramework):
         print("\nChecking finality of block[", block_hash, "]")
         print("  Node0 has: %d" % self.nodes[0].getblockfinalityindex(block_hash))
         print("  Node1 has: %d" % self.nodes[1].getblockfinalityindex(block_hash))
+        batch = self.nodes[1].getblocksfinalityindex([block_hash, self.nodes[1].getblockhash(0)])
+        assert_equal(batch[0]['finalityindex'], self.nodes[1].getblockfinalityindex(block_hash))
+        assert_equal(batch[1]['error'], "Finality does not apply to genesis block")
 #        raw_input("press enter to go on..")
 
         print("\nNode2 generating 1 mal block")
@@ -23,7 +23,7 @@ except ImportError:
 
 class HTTPBasicsTest (BitcoinTestFramework):
     def setup_nodes(self):
-        self.nodes = start_nodes(4, self.options.tmpdir)
+        self.nodes = start_nodes(4, self.options.tmpdir, extra_args=[[], ['-rpceventthreads=3', '-rpcmaxkeepaliverequests=2'], [], []])
 
     def run_test(self):
 
@@ -86,6 +86,22 @@ class HTTPBasicsTest (BitcoinTestFramework):
         out1 = conn.getresponse().read()
         assert_equal(b'"error":null' in out1, True)
 
+        # node1 closes a connection after its second request
+        assert_equal(conn.sock!=None, True)
+        conn.request('POST', '/', '{"method": "getchaintips"}', headers)
+        out2 = conn.getresponse().read()
+        assert_equal(b'"error":null' in out2, True)
+        assert_equal(conn.sock!=None, False)
+
+        # the connections open at the same time are served by the event loops of node1
+        conns = [httplib.HTTPConnection(urlNode1.hostname, urlNode1.port) for i in range(8)]
+        for c in conns:
+            c.connect()
+            c.request('POST', '/', '{"method": "getblockcount"}', headers)
+        for c in conns:
+            assert_equal(b'"error":null' in c.getresponse().read(), True)
+            c.close()
+
         # node2 (third node) is running with standard keep-alive parameters which means keep-alive is on
         urlNode2 = urlparse.urlparse(self.nodes[2].url)
         authpair = urlNode2.username + ':' + urlNode2.password
@@ -326,6 +326,19 @@ class ListTransactionsTest(BitcoinTestFramework):
                                {"txid": txes[i - 2]},
                                {"amount": Decimal("-"+str(i))})
 
+        # verify paging with a cursor lists all the transactions once, in the same order as without it
+        all_node0 = self.nodes[0].listtransactions("*", 10000, 0, True)
+        paged_node0 = []
+        cursor = -1
+        while True:
+            page = self.nodes[0].listtransactions("*", 7, 0, True, "*", False, cursor)
+            if len(page) == 0:
+                break
+            paged_node0 = page + paged_node0
+            cursor = min(entry["orderpos"] for entry in page)
+        assert_equal([(e["txid"] if "txid" in e else "", e["category"], e["amount"]) for e in paged_node0],
+                     [(e["txid"] if "txid" in e else "", e["category"], e["amount"]) for e in all_node0])
+
         chain_height = self.nodes[0].getblockcount()
         if chain_height < ForkHeights['MINIMAL_SC']:
             self.nodes[0].generate(ForkHeights['MINIMAL_SC'] - chain_height)
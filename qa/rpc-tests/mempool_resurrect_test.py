@@ -73,6 +73,7 @@ class MempoolCoinbaseTest(BitcoinTestFramework):
             assert(tx["confirmations"] == 0)
 
         # Generate another block, they should all get mined
+        sequence = self.nodes[0].getmempoolinfo()["sequence"]
         self.nodes[0].generate(1)
         # mempool should be empty, all txns confirmed
         assert_equal(set(self.nodes[0].getrawmempool()), set())
@@ -80,6 +81,17 @@ class MempoolCoinbaseTest(BitcoinTestFramework):
             tx = self.nodes[0].gettransaction(txid)
             assert(tx["confirmations"] > 0)
 
+        # the delta since before the block gives them as removed for it
+        delta = self.nodes[0].getmempooldelta(sequence)
+        assert_equal(delta["sequence"], sequence + len(spends1_id+spends2_id))
+        assert_equal(set(e["hash"] for e in delta["events"]), set(spends1_id+spends2_id))
+        for e in delta["events"]:
+            assert_equal(e["event"], "removed")
+            assert_equal(e["reason"], "block")
+            assert_equal(e["isCert"], False)
+        delta = self.nodes[0].getmempooldelta(delta["sequence"])
+        assert_equal(delta["events"], [])
+
 
 if __name__ == '__main__':
     MempoolCoinbaseTest().main()
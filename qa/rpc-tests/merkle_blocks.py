@@ -168,6 +168,19 @@ class MerkleBlockTest(BitcoinTestFramework):
         assert_equal(self.nodes[2].verifytxoutproof(proof1), [cert])
         assert_equal(self.nodes[2].verifytxoutproof(proof2), [tx, cert])
 
+        # the batch gives the proofs of gettxoutproof, one per txid, and the errors of those not in a block
+        unknown = "00" * 32
+        proofs = self.nodes[2].gettxoutproofs([tx, cert, unknown])
+        assert_equal(len(proofs), 3)
+        assert_equal(proofs[0]['txid'], tx)
+        assert_equal(proofs[0]['blockhash'], bl_hash)
+        assert_equal(proofs[0]['proof'], self.nodes[2].gettxoutproof([tx]))
+        assert_equal(proofs[1]['txid'], cert)
+        assert_equal(proofs[1]['proof'], proof1)
+        assert_equal(self.nodes[2].verifytxoutproof(proofs[0]['proof']), [tx])
+        assert_equal(proofs[2]['txid'], unknown)
+        assert('error' in proofs[2] and 'proof' not in proofs[2])
+
         # spend cert change: since there are no bwts in the cert, it will be fully spent
         tx = self.nodes[2].sendtoaddress(t_addr1, 0.1)
         self.sync_all()
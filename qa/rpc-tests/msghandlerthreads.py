@@ -0,0 +1,69 @@
+#!/usr/bin/env python3
+# Copyright (c) 2014 The Bitcoin Core developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#
+# Test that a node processing the messages of its peers with several threads relays blocks and
+# transactions between them, and answers their pings
+#
+
+import time
+
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.util import assert_equal, connect_nodes_bi, initialize_chain_clean, \
+    start_node, sync_blocks, sync_mempools
+
+
+class MsgHandlerThreadsTest(BitcoinTestFramework):
+
+    def setup_chain(self):
+        print("Initializing test directory "+self.options.tmpdir)
+        initialize_chain_clean(self.options.tmpdir, 4)
+
+    def setup_network(self):
+        self.nodes = []
+        self.nodes.append(start_node(0, self.options.tmpdir))
+        self.nodes.append(start_node(1, self.options.tmpdir, ["-msghandlerthreads=3"]))
+        self.nodes.append(start_node(2, self.options.tmpdir))
+        self.nodes.append(start_node(3, self.options.tmpdir))
+        # the peers of the hub are spread over its handler threads
+        for i in (0, 2, 3):
+            connect_nodes_bi(self.nodes, 1, i)
+        self.is_network_split = False
+        self.sync_all()
+
+    def run_test(self):
+        hub = self.nodes[1]
+        assert_equal(hub.getconnectioncount(), 6)
+
+        print("Mining blocks on a leaf node...")
+        self.nodes[0].generate(105)
+        sync_blocks(self.nodes)
+
+        print("Relaying transactions through the hub...")
+        address = self.nodes[3].getnewaddress()
+        txids = [self.nodes[0].sendtoaddress(address, 0.1) for _ in range(30)]
+        sync_mempools(self.nodes)
+        for txid in txids:
+            assert(txid in self.nodes[3].getrawmempool())
+            assert(txid in self.nodes[2].getrawmempool())
+
+        print("Mining on the other leaf nodes...")
+        self.nodes[2].generate(3)
+        sync_blocks(self.nodes)
+        self.nodes[3].generate(3)
+        sync_blocks(self.nodes)
+        for node in self.nodes:
+            assert_equal(node.getbestblockhash(), hub.getbestblockhash())
+        assert_equal(self.nodes[3].getbalance(), 3)
+
+        print("Pinging the peers of the hub...")
+        hub.ping()
+        time.sleep(2)
+        for peer in hub.getpeerinfo():
+            assert("pingtime" in peer)
+
+
+if __name__ == '__main__':
+    MsgHandlerThreadsTest().main()
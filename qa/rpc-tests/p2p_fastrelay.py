@@ -0,0 +1,234 @@
+#!/usr/bin/env python3
+#
+# Distributed under the MIT/X11 software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+#
+
+from test_framework.mininode import CTxOut, NodeConn, NodeConnCB, NetworkThread, HeaderAndShortIDs, \
+    msg_block, msg_cmpctblock, msg_sendfastrelay, msg_ping, msg_pong, mininode_lock
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.util import assert_equal, initialize_chain_clean, start_node, p2p_port
+from test_framework.blocktools import create_block, create_coinbase_h
+from test_framework.script import CScript, OP_CHECKMULTISIG
+
+import time
+
+'''
+FastRelayTest -- test the relay of the blocks extending the tip before their full
+validation (-fastblockrelay) between whitelisted peers.
+
+Setup: one node, with -fastblockrelay, whitelisting localhost. Two NodeConn
+connections to it: fast_node sends "sendfastrelay", slow_node does not.
+
+The test:
+1. A block extending the tip is pushed as a compact block to fast_node only.
+
+2. An unrequested compact block is ignored unless it extends the tip and comes
+   from fast_node.
+
+3. A compact block from fast_node failing CheckBlock with CorruptionPossible()
+   (too many sigops) leaves it its fast relay.
+
+4. A compact block from fast_node which proves invalid when connected (the
+   coinbase pays too much) makes it lose its fast relay, both ways.
+'''
+
+class TestNode(NodeConnCB):
+    def __init__(self):
+        NodeConnCB.__init__(self)
+        self.create_callback_map()
+        self.connection = None
+        self.ping_counter = 1
+        self.last_pong = msg_pong()
+        self.cmpctblocks = []
+        self.sendfastrelay_received = False
+
+    def add_connection(self, conn):
+        self.connection = conn
+
+    def on_cmpctblock(self, conn, message):
+        self.cmpctblocks.append(message.header_and_shortids)
+
+    def on_sendfastrelay(self, conn, message):
+        self.sendfastrelay_received = True
+
+    def wait_for_verack(self):
+        while True:
+            with mininode_lock:
+                if self.verack_received:
+                    return
+            time.sleep(0.05)
+
+    def send_message(self, message):
+        self.connection.send_message(message)
+
+    def send_cmpctblock(self, block):
+        self.connection.send_message(msg_cmpctblock(HeaderAndShortIDs(block)))
+
+    def received_cmpctblock(self, blockhash):
+        with mininode_lock:
+            return any(c.header.hash == blockhash for c in self.cmpctblocks)
+
+    def on_pong(self, conn, message):
+        self.last_pong = message
+
+    # Sync up with the node after delivery of a message
+    def sync_with_ping(self, timeout=30):
+        self.connection.send_message(msg_ping(nonce=self.ping_counter))
+        received_pong = False
+        sleep_time = 0.05
+        while not received_pong and timeout > 0:
+            time.sleep(sleep_time)
+            timeout -= sleep_time
+            with mininode_lock:
+                if self.last_pong.nonce == self.ping_counter:
+                    received_pong = True
+        self.ping_counter += 1
+        return received_pong
+
+
+class FastRelayTest(BitcoinTestFramework):
+
+    def setup_chain(self):
+        initialize_chain_clean(self.options.tmpdir, 1)
+
+    def setup_network(self):
+        self.nodes = []
+        self.nodes.append(start_node(0, self.options.tmpdir,
+                                     ["-debug=cmpctblock", "-whitelist=127.0.0.1", "-fastblockrelay=1"]))
+        self.is_network_split = False
+
+    def chaintip_status(self, blockhash):
+        for tip in self.nodes[0].getchaintips():
+            if tip['hash'] == blockhash:
+                return tip['status']
+        return None
+
+    # A block at height on top of the block hash_prev, by default paying its coinbase to anyone
+    def next_block(self, hash_prev, height, coinbase=None):
+        self.block_time += 1
+        if coinbase is None:
+            coinbase = create_coinbase_h(height)
+        block = create_block(hash_prev, coinbase, self.block_time)
+        block.solve()
+        return block
+
+    def run_test(self):
+        node = self.nodes[0]
+        fast_node = TestNode()
+        slow_node = TestNode()
+        connections = []
+        connections.append(NodeConn('127.0.0.1', p2p_port(0), node, fast_node))
+        connections.append(NodeConn('127.0.0.1', p2p_port(0), node, slow_node))
+        fast_node.add_connection(connections[0])
+        slow_node.add_connection(connections[1])
+
+        NetworkThread().start()
+        fast_node.wait_for_verack()
+        slow_node.wait_for_verack()
+
+        fast_node.send_message(msg_sendfastrelay())
+        [x.sync_with_ping() for x in [fast_node, slow_node]]
+        # the node offers fast relay to any whitelisted peer, only the ones answering get it
+        with mininode_lock:
+            assert(fast_node.sendfastrelay_received)
+            assert(slow_node.sendfastrelay_received)
+
+        # leave IBD, during which nothing is fast relayed
+        node.generate(1)
+        [x.sync_with_ping() for x in [fast_node, slow_node]]
+        self.block_time = node.getblock(node.getbestblockhash())['time']
+
+        # 1. a block extending the tip is pushed to the peers with fast relay only, as a compact block
+        # made of its coinbase, before its connection
+        blockhash = node.generate(1)[0]
+        [x.sync_with_ping() for x in [fast_node, slow_node]]
+        assert(fast_node.received_cmpctblock(blockhash))
+        assert(not slow_node.received_cmpctblock(blockhash))
+        with mininode_lock:
+            cmpctblock = [c for c in fast_node.cmpctblocks if c.header.hash == blockhash][0]
+            assert_equal(len(cmpctblock.prefilled_txn), 1)
+            assert_equal(cmpctblock.prefilled_txn[0].index, 0)
+            assert_equal(cmpctblock.shortids, [])
+        print("Block fast relayed to the peer with fast relay only")
+
+        # 2. an unrequested compact block not extending the tip is ignored, even from fast_node
+        height = node.getblockcount()
+        tip = node.getbestblockhash()
+        fork = self.next_block(int(node.getblockhash(height - 1), 16), height)
+        fast_node.send_cmpctblock(fork)
+        fast_node.sync_with_ping()
+        assert_equal(node.getbestblockhash(), tip)
+        assert_equal(self.chaintip_status(fork.hash), "headers-only")
+
+        # one extending the tip is ignored from slow_node, which has no fast relay
+        block = self.next_block(int(tip, 16), height + 1)
+        slow_node.send_cmpctblock(block)
+        slow_node.sync_with_ping()
+        assert_equal(node.getbestblockhash(), tip)
+        assert_equal(self.chaintip_status(block.hash), "headers-only")
+        # the block itself is processed
+        slow_node.send_message(msg_block(block))
+        slow_node.sync_with_ping()
+        assert_equal(node.getbestblockhash(), block.hash)
+
+        # and it is processed from fast_node
+        block = self.next_block(block.sha256, height + 2)
+        fast_node.send_cmpctblock(block)
+        fast_node.sync_with_ping()
+        assert_equal(node.getbestblockhash(), block.hash)
+        print("Unrequested compact blocks only processed when extending the tip, from the peer with fast relay")
+
+        # 3. a block which may be corrupted rather than invalid, too many sigops of its coinbase, from
+        # fast_node: the peer keeps its fast relay
+        height = node.getblockcount()
+        tip = block
+        coinbase = create_coinbase_h(height + 1)
+        coinbase.vout.append(CTxOut(0, CScript([OP_CHECKMULTISIG] * 1001)))
+        coinbase.rehash()
+        corrupted = self.next_block(tip.sha256, height + 1, coinbase)
+        fast_node.send_cmpctblock(corrupted)
+        fast_node.sync_with_ping()
+        assert_equal(node.getbestblockhash(), tip.hash)
+        assert(self.chaintip_status(corrupted.hash) != "invalid")
+
+        block = self.next_block(tip.sha256, height + 1)
+        fast_node.send_cmpctblock(block)
+        fast_node.sync_with_ping()
+        assert_equal(node.getbestblockhash(), block.hash)
+        print("Fast relay kept after a possibly corrupted block")
+
+        # 4. an invalid block, whose coinbase pays too much, from fast_node: the peer loses its fast relay
+        height = node.getblockcount()
+        tip = block
+        coinbase = create_coinbase_h(height + 1)
+        coinbase.vout[0].nValue += 1
+        coinbase.rehash()
+        invalid = self.next_block(tip.sha256, height + 1, coinbase)
+        fast_node.send_cmpctblock(invalid)
+        fast_node.sync_with_ping()
+        assert_equal(node.getbestblockhash(), tip.hash)
+        assert_equal(self.chaintip_status(invalid.hash), "invalid")
+
+        # its next compact blocks are ignored
+        block = self.next_block(tip.sha256, height + 1)
+        fast_node.send_cmpctblock(block)
+        fast_node.sync_with_ping()
+        assert_equal(node.getbestblockhash(), tip.hash)
+        assert_equal(self.chaintip_status(block.hash), "headers-only")
+        # whitelisted, it is not disconnected and its blocks are still processed
+        fast_node.send_message(msg_block(block))
+        fast_node.sync_with_ping()
+        assert_equal(node.getbestblockhash(), block.hash)
+
+        # and no block is fast relayed to it any longer
+        blockhash = node.generate(1)[0]
+        fast_node.sync_with_ping()
+        assert(not fast_node.received_cmpctblock(blockhash))
+        print("Fast relay lost after an invalid block")
+
+        [c.disconnect_node() for c in connections]
+
+
+if __name__ == '__main__':
+    FastRelayTest().main()
@@ -329,10 +329,29 @@ class RESTTest (BitcoinTestFramework):
         for tx in txs:
             assert_equal(tx in json_obj, True)
 
+        # the changes since the sequence of the whole mempool: nothing was added since
+        response = http_get_call(url.hostname, url.port, '/rest/mempool/contents'+self.FORMAT_SEPARATOR+'json', True)
+        assert_equal(response.status, 200)
+        sequence = response.getheader('X-Mempool-Sequence')
+        response.read()
+        json_string = http_get_call(url.hostname, url.port, '/rest/mempool/contents/since/'+sequence+self.FORMAT_SEPARATOR+'json')
+        json_obj = json.loads(json_string)
+        assert_equal(json_obj['sequence'], int(sequence))
+        assert_equal(json_obj['full'], False)
+        assert_equal(len(json_obj['added']), 0)
+        assert_equal(len(json_obj['removed']), 0)
+
         # now mine the transactions
         newblockhash = self.nodes[1].generate(1)
         self.sync_all()
 
+        # they are given as removed since that sequence
+        json_string = http_get_call(url.hostname, url.port, '/rest/mempool/contents/since/'+sequence+self.FORMAT_SEPARATOR+'json')
+        json_obj = json.loads(json_string)
+        assert_equal(json_obj['full'], False)
+        for tx in txs:
+            assert_equal(tx in json_obj['removed'], True)
+
         # check if the 3 tx show up in the new block
         json_string = http_get_call(url.hostname, url.port, '/rest/block/'+newblockhash[0]+self.FORMAT_SEPARATOR+'json')
         json_obj = json.loads(json_string)
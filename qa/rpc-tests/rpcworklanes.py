@@ -0,0 +1,97 @@
+#!/usr/bin/env python3
+# Copyright (c) 2014 The Bitcoin Core developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#
+# Test the RPC work queue lanes (-rpcworklane) and getrpcinfo
+#
+
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.util import assert_equal, initialize_chain_clean, start_node
+
+import time
+
+
+class RPCWorkLanesTest(BitcoinTestFramework):
+
+    def setup_chain(self):
+        print("Initializing test directory "+self.options.tmpdir)
+        initialize_chain_clean(self.options.tmpdir, 1)
+
+    def setup_network(self):
+        self.nodes = []
+        self.is_network_split = False
+        self.nodes.append(start_node(0, self.options.tmpdir, [
+            "-rpcworklane=mining:1:8:getmininginfo,getblocktemplate",
+            "-rpcworklane=chain:2:16:getblockhash,getblockcount"]))
+
+    def lanes(self):
+        return {lane["name"]: lane for lane in self.nodes[0].getrpcinfo()["lanes"]}
+
+    def wait_processed(self, name, count):
+        # the counters are updated right after the reply is sent
+        for _ in range(50):
+            if self.lanes()[name]["processed"] >= count:
+                return
+            time.sleep(0.1)
+        assert_equal(self.lanes()[name]["processed"], count)
+
+    def run_test(self):
+        lanes = self.lanes()
+        assert_equal(sorted(lanes.keys()), ["chain", "default", "mining"])
+        assert_equal(self.nodes[0].getrpcinfo()["lanes"][0]["name"], "default")
+        assert_equal(lanes["default"]["methods"], [])
+        assert_equal(sorted(lanes["mining"]["methods"]), ["getblocktemplate", "getmininginfo"])
+        assert_equal(lanes["mining"]["threads"], 1)
+        assert_equal(lanes["mining"]["maxdepth"], 8)
+        assert_equal(lanes["chain"]["threads"], 2)
+        assert_equal(lanes["chain"]["maxdepth"], 16)
+        assert_equal(lanes["mining"]["processed"], 0)
+        assert_equal(lanes["chain"]["processed"], 0)
+
+        self.nodes[0].generate(2)
+        self.nodes[0].getmininginfo()
+        self.wait_processed("mining", 1)
+        assert_equal(self.lanes()["chain"]["processed"], 0)
+
+        # a batch goes to a lane only if all of its methods do
+        self.nodes[0]._batch([
+            {"method": "getblockcount", "params": [], "id": 1},
+            {"method": "getblockhash", "params": [1], "id": 2}])
+        self.wait_processed("chain", 1)
+        before = self.lanes()
+        self.nodes[0]._batch([
+            {"method": "getblockcount", "params": [], "id": 1},
+            {"method": "getmininginfo", "params": [], "id": 2}])
+        time.sleep(0.5)
+        after = self.lanes()
+        assert_equal(after["chain"]["processed"], before["chain"]["processed"])
+        assert_equal(after["mining"]["processed"], before["mining"]["processed"])
+        assert(after["default"]["processed"] > before["default"]["processed"])
+
+        # a "method" key nested in the params does not count
+        self.nodes[0]._batch([{"method": "getblockhash", "params": [{"method": "getmininginfo"}], "id": 1}])
+        self.wait_processed("chain", 2)
+        assert_equal(self.lanes()["mining"]["processed"], 1)
+
+        # read-only batch entries run concurrently, the replies keep the order of the requests
+        self.nodes[0].generate(20)
+        hashes = [self.nodes[0].getblockhash(h) for h in range(23)]
+        replies = self.nodes[0]._batch(
+            [{"method": "getblockhash", "params": [h], "id": h} for h in range(23)] +
+            [{"method": "generate", "params": [1], "id": 23}] +
+            [{"method": "getblockcount", "params": [], "id": 24}, {"method": "getbestblockhash", "params": [], "id": 25}])
+        assert_equal([r["id"] for r in replies], list(range(26)))
+        assert_equal([r["result"] for r in replies[:23]], hashes)
+        assert_equal(replies[24]["result"], 23)
+        assert_equal(replies[25]["result"], replies[23]["result"][0])
+
+        for lane in self.lanes().values():
+            assert_equal(lane["rejected"], 0)
+            assert(lane["maxwait_us"] >= 0 and lane["maxrun_us"] >= 0)
+
+        print("Success")
+
+if __name__ == '__main__':
+    RPCWorkLanesTest().main()
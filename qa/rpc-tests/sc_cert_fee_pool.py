@@ -0,0 +1,106 @@
+#!/usr/bin/env python3
+# Copyright (c) 2014 The Bitcoin Core developers
+# Copyright (c) 2018 The Zencash developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.test_framework import ForkHeights
+from test_framework.util import assert_true, assert_equal, initialize_chain_clean, \
+    start_nodes, connect_nodes_bi, mark_logs, get_epoch_data, swap_bytes, wait_until
+from test_framework.mc_test.mc_test import CertTestUtils, generate_random_field_element_hex
+from decimal import Decimal
+
+NUMB_OF_NODES = 2
+DEBUG_MODE = 1
+EPOCH_LENGTH = 10
+FT_SC_FEE = Decimal('0')
+MBTR_SC_FEE = Decimal('0')
+CERT_FEE_POOL_SIZE = 3
+CERT_FEE_POOL_VALUE = Decimal('0.01')
+# the pool is refreshed every 10 seconds
+POOL_TIMEOUT = 60
+
+
+class sc_cert_fee_pool(BitcoinTestFramework):
+
+    def setup_chain(self, split=False):
+        print("Initializing test directory " + self.options.tmpdir)
+        initialize_chain_clean(self.options.tmpdir, NUMB_OF_NODES)
+
+    def setup_network(self, split=False):
+        common_args = ['-logtimemicros=1', '-debug=py', '-debug=sc', '-debug=cert', '-debug=wallet']
+        self.nodes = start_nodes(NUMB_OF_NODES, self.options.tmpdir, extra_args=[
+            common_args + ['-certfeepool={}'.format(CERT_FEE_POOL_SIZE), '-certfeepoolvalue={}'.format(CERT_FEE_POOL_VALUE)],
+            common_args])
+
+        connect_nodes_bi(self.nodes, 0, 1)
+        self.is_network_split = split
+        self.sync_all()
+
+    def run_test(self):
+        '''
+        Node 0 keeps a pool of coins for the fees of its certificates: sc_send_certificate without a fromAddress
+        funds the certificate with one of them, and the pool is refilled in the background.
+        '''
+        # network topology: (0)--(1)
+        mark_logs("Node 0 generates {} blocks".format(ForkHeights['MINIMAL_SC']), self.nodes, DEBUG_MODE)
+        self.nodes[0].generate(ForkHeights['MINIMAL_SC'])
+        self.sync_all()
+
+        certMcTest = CertTestUtils(self.options.tmpdir, self.options.srcdir)
+        certVk = certMcTest.generate_params('scs')
+        constant = generate_random_field_element_hex()
+        cmdInput = {
+            'version': 0,
+            'withdrawalEpochLength': EPOCH_LENGTH,
+            'amount': 10,
+            'constant': constant,
+            'wCertVk': certVk,
+            'toaddress': "cdcd"
+        }
+        scid = self.nodes[0].sc_create(cmdInput)['scid']
+        mark_logs("Node 0 created SC {}".format(scid), self.nodes, DEBUG_MODE)
+
+        mark_logs("Node 0 splits the coins of its certificate fee pool", self.nodes, DEBUG_MODE)
+        assert_true(wait_until(lambda: len(self.nodes[0].listlockunspent()) == CERT_FEE_POOL_SIZE, timeout=POOL_TIMEOUT))
+        pool_coins = self.nodes[0].listlockunspent()
+        self.sync_all()
+
+        # the coins are locked, no other transaction spends them
+        self.nodes[0].sendtoaddress(self.nodes[1].getnewaddress(), self.nodes[0].getbalance() - Decimal('1'))
+        self.sync_all()
+
+        self.nodes[0].generate(EPOCH_LENGTH)
+        self.sync_all()
+        for coin in pool_coins:
+            assert_equal(CERT_FEE_POOL_VALUE, self.nodes[0].gettxout(coin['txid'], coin['vout'])['value'])
+
+        mark_logs("Node 0 picks the coins up once confirmed", self.nodes, DEBUG_MODE)
+        assert_true(wait_until(lambda: self.nodes[0].getwalletinfo()['certfeepoolsize'] == CERT_FEE_POOL_SIZE, timeout=POOL_TIMEOUT))
+
+        epoch_number, epoch_cum_tree_hash, _ = get_epoch_data(scid, self.nodes[0], EPOCH_LENGTH)
+        quality = 10
+        proof = certMcTest.create_test_proof("scs", swap_bytes(scid), epoch_number, quality, MBTR_SC_FEE, FT_SC_FEE,
+                                             epoch_cum_tree_hash, constant = constant, pks = [], amounts = [])
+
+        mark_logs("Node 0 sends a certificate, funded by a coin of the pool", self.nodes, DEBUG_MODE)
+        cert = self.nodes[0].sc_send_certificate(scid, epoch_number, quality, epoch_cum_tree_hash, proof, [],
+                                                 FT_SC_FEE, MBTR_SC_FEE)
+        self.sync_all()
+        assert_true(cert in self.nodes[1].getrawmempool())
+
+        vin = self.nodes[0].getrawtransaction(cert, 1)['vin']
+        assert_equal(1, len(vin))
+        assert_true({'txid': vin[0]['txid'], 'vout': vin[0]['vout']} in pool_coins)
+        assert_equal(CERT_FEE_POOL_SIZE - 1, self.nodes[0].getwalletinfo()['certfeepoolsize'])
+
+        mark_logs("Node 0 refills the pool", self.nodes, DEBUG_MODE)
+        assert_true(wait_until(lambda: len(self.nodes[0].listlockunspent()) == CERT_FEE_POOL_SIZE, timeout=POOL_TIMEOUT))
+        self.sync_all()
+        self.nodes[0].generate(1)
+        self.sync_all()
+        assert_true(wait_until(lambda: self.nodes[0].getwalletinfo()['certfeepoolsize'] == CERT_FEE_POOL_SIZE, timeout=POOL_TIMEOUT))
+
+
+if __name__ == '__main__':
+    sc_cert_fee_pool().main()
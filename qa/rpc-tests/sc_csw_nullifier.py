@@ -511,6 +511,11 @@ class CswNullifierTest(BitcoinTestFramework):
         assert_equal(self.nodes[0].checkcswnullifier(scid, null_n0)['data'], 'false')
         assert_equal(self.nodes[0].checkcswnullifier(scid, null_n2)['data'], 'true')
 
+        # the same checks in a single call, answered in order
+        res = self.nodes[0].checkcswnullifiers([{"scid": scid, "nullifier": n} for n in [null1, null2, null_n0, null_n2]])
+        assert_equal([r['data'] for r in res], [True, True, False, True])
+        assert_equal(res[2]['nullifier'], null_n0)
+
         mark_logs("\nVerify we need a valid active cert data hash  for a CSW to be legal...", self.nodes, DEBUG_MODE)
         
         prev_epoch_hash = self.nodes[0].getbestblockhash()
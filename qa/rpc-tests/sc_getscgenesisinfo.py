@@ -6,11 +6,14 @@
 from test_framework.test_framework import BitcoinTestFramework
 from test_framework.test_framework import ForkHeights
 from test_framework.util import assert_equal, initialize_chain_clean, \
-    start_nodes, sync_blocks, sync_mempools, connect_nodes_bi, mark_logs
+    start_nodes, sync_blocks, sync_mempools, connect_nodes_bi, mark_logs, \
+    start_node, stop_node, assert_true
+from test_framework.authproxy import JSONRPCException
 from test_framework.blockchainhelper import BlockchainHelper, SidechainParameters
 
 DEBUG_MODE = 1
 NUMB_OF_NODES = 2
+EXTRA_ARGS = ['-debug=py', '-debug=sc', '-debug=mempool', '-debug=net', '-debug=cert', '-scproofqueuesize=0', '-logtimemicros=1']
 
 
 class sc_getscgenesisinfo(BitcoinTestFramework):
@@ -20,8 +23,7 @@ class sc_getscgenesisinfo(BitcoinTestFramework):
         initialize_chain_clean(self.options.tmpdir, NUMB_OF_NODES)
 
     def setup_network(self, split=False):
-        self.nodes = start_nodes(NUMB_OF_NODES, self.options.tmpdir, extra_args=
-            [['-debug=py', '-debug=sc', '-debug=mempool', '-debug=net', '-debug=cert', '-scproofqueuesize=0', '-logtimemicros=1']] * NUMB_OF_NODES)
+        self.nodes = start_nodes(NUMB_OF_NODES, self.options.tmpdir, extra_args=[EXTRA_ARGS] * NUMB_OF_NODES)
 
         for k in range(0, NUMB_OF_NODES-1):
             connect_nodes_bi(self.nodes, k, k+1)
@@ -180,6 +182,30 @@ class sc_getscgenesisinfo(BitcoinTestFramework):
         print(f"ID sidechain 5: { test_helper.sidechain_map[v1_sc5_name]['sc_id'] }")
         print(f"ID sidechain 6: { test_helper.sidechain_map[v2_sc6_name]['sc_id'] }")
 
+        # The genesis info is built on the first request and then cached, also across restarts
+        sc5_id = test_helper.sidechain_map[v1_sc5_name]["sc_id"]
+        genesis_info = self.nodes[0].getscgenesisinfo(sc5_id)
+
+        mark_logs("Restart Node 0 and check that the genesis info of sc5 is the same", self.nodes, DEBUG_MODE)
+        stop_node(self.nodes[0], 0)
+        self.nodes[0] = start_node(0, self.options.tmpdir, extra_args=EXTRA_ARGS)
+        assert_equal(self.nodes[0].getscgenesisinfo(sc5_id), genesis_info)
+
+        mark_logs("Node 0 reverts the creation block of sc5", self.nodes, DEBUG_MODE)
+        self.nodes[0].invalidateblock(last_block_hash)
+        try:
+            self.nodes[0].getscgenesisinfo(sc5_id)
+            assert_true(False)
+        except JSONRPCException as e:
+            mark_logs(e.error['message'], self.nodes, DEBUG_MODE)
+
+        mark_logs("Node 0 creates sc5 again in another block and check that the genesis info follows it", self.nodes, DEBUG_MODE)
+        new_block_hash = self.nodes[0].generate(1)[0]
+        assert_true(new_block_hash != last_block_hash)
+        new_genesis_info = self.nodes[0].getscgenesisinfo(sc5_id)
+        assert_true(new_genesis_info != genesis_info)
+        assert_true(self.nodes[0].getblock(new_block_hash, 0) in new_genesis_info)
+
 
 if __name__ == '__main__':
     sc_getscgenesisinfo().main()
@@ -0,0 +1,56 @@
+#!/usr/bin/env python3
+# Copyright (c) 2014 The Bitcoin Core developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#
+# Test that nodes waiting for socket events with the default poller and with select() relay to each other
+#
+
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.util import assert_equal, connect_nodes_bi, initialize_chain_clean, \
+    start_node, sync_blocks, sync_mempools
+
+
+class SocketEventsTest(BitcoinTestFramework):
+
+    def setup_chain(self):
+        print("Initializing test directory "+self.options.tmpdir)
+        initialize_chain_clean(self.options.tmpdir, 3)
+
+    def setup_network(self):
+        self.nodes = []
+        self.nodes.append(start_node(0, self.options.tmpdir))
+        self.nodes.append(start_node(1, self.options.tmpdir, ["-socketevents=select"]))
+        self.nodes.append(start_node(2, self.options.tmpdir))
+        connect_nodes_bi(self.nodes, 0, 1)
+        connect_nodes_bi(self.nodes, 1, 2)
+        self.is_network_split = False
+        self.sync_all()
+
+    def run_test(self):
+        for node in self.nodes:
+            assert_equal(node.getconnectioncount(), 2 if node is self.nodes[1] else 1)
+
+        print("Mining blocks on the default poller node...")
+        self.nodes[0].generate(105)
+        sync_blocks(self.nodes)
+
+        # a lot of messages queued at once, to drain through partial writes
+        print("Relaying transactions through the select() node...")
+        address = self.nodes[2].getnewaddress()
+        txids = [self.nodes[0].sendtoaddress(address, 0.1) for _ in range(50)]
+        sync_mempools(self.nodes)
+        for txid in txids:
+            assert(txid in self.nodes[2].getrawmempool())
+
+        print("Mining blocks on the select() node...")
+        self.nodes[1].generate(5)
+        sync_blocks(self.nodes)
+        assert_equal(self.nodes[2].getbalance(), 5)
+        for node in self.nodes:
+            assert_equal(node.getbestblockhash(), self.nodes[1].getbestblockhash())
+
+
+if __name__ == '__main__':
+    SocketEventsTest().main()
@@ -69,6 +69,27 @@ def hash256(s):
     return sha256(sha256(s))
 
 
+def deser_compact_size(f):
+    nit = struct.unpack("<B", f.read(1))[0]
+    if nit == 253:
+        nit = struct.unpack("<H", f.read(2))[0]
+    elif nit == 254:
+        nit = struct.unpack("<I", f.read(4))[0]
+    elif nit == 255:
+        nit = struct.unpack("<Q", f.read(8))[0]
+    return nit
+
+
+def ser_compact_size(l):
+    if l < 253:
+        return struct.pack("B", l)
+    elif l < 0x10000:
+        return struct.pack("<BH", 253, l)
+    elif l < 0x100000000:
+        return struct.pack("<BI", 254, l)
+    return struct.pack("<BQ", 255, l)
+
+
 def deser_string(f):
     nit = struct.unpack("<B", f.read(1))[0]
     if nit == 253:
@@ -975,6 +996,114 @@ class msg_block(object):
         return "msg_block(block=%s)" % (repr(self.block))
 
 
+# A transaction sent in full in a compact block, with its position in the block
+class PrefilledTransaction(object):
+    def __init__(self, index=0, tx=None):
+        self.index = index
+        self.tx = tx
+
+    def __repr__(self):
+        return "PrefilledTransaction(index=%d, tx=%s)" % (self.index, repr(self.tx))
+
+
+# The block header, the prefilled coinbase and the 6-byte short ids of the other
+# transactions, then of the certificates, of a block (CBlockHeaderAndShortTxIDs).
+# The short ids are not computed here, only blocks made of their coinbase can be
+# turned into one.
+class HeaderAndShortIDs(object):
+    def __init__(self, block=None):
+        self.header = CBlockHeader()
+        self.nonce = 0
+        self.shortids = []
+        self.prefilled_txn = []
+        self.ncertificates = 0
+        if block is not None:
+            assert(len(block.vtx) == 1)
+            self.header = CBlockHeader(block)
+            self.nonce = random.getrandbits(64)
+            self.prefilled_txn = [PrefilledTransaction(0, block.vtx[0])]
+
+    def deserialize(self, f):
+        self.header.deserialize(f)
+        self.header.calc_sha256()
+        self.nonce = struct.unpack("<Q", f.read(8))[0]
+        self.shortids = []
+        for i in range(deser_compact_size(f)):
+            lsb, msb = struct.unpack("<IH", f.read(6))
+            self.shortids.append((msb << 32) | lsb)
+        # the positions, differentially encoded, come before the transactions
+        indexes = []
+        next_index = 0
+        for i in range(deser_compact_size(f)):
+            next_index += deser_compact_size(f)
+            indexes.append(next_index)
+            next_index += 1
+        self.prefilled_txn = []
+        for index in indexes:
+            tx = CTransaction()
+            tx.deserialize(f)
+            self.prefilled_txn.append(PrefilledTransaction(index, tx))
+        self.ncertificates = deser_compact_size(f)
+
+    def serialize(self):
+        r = b""
+        r += self.header.serialize()
+        r += struct.pack("<Q", self.nonce)
+        r += ser_compact_size(len(self.shortids))
+        for shortid in self.shortids:
+            r += struct.pack("<IH", shortid & 0xffffffff, (shortid >> 32) & 0xffff)
+        r += ser_compact_size(len(self.prefilled_txn))
+        next_index = 0
+        for prefilled in self.prefilled_txn:
+            r += ser_compact_size(prefilled.index - next_index)
+            next_index = prefilled.index + 1
+        for prefilled in self.prefilled_txn:
+            r += prefilled.tx.serialize()
+        r += ser_compact_size(self.ncertificates)
+        return r
+
+    def __repr__(self):
+        return "HeaderAndShortIDs(header=%s, nonce=%d, shortids=%s, prefilled_txn=%s, ncertificates=%d)" \
+            % (repr(self.header), self.nonce, repr(self.shortids), repr(self.prefilled_txn), self.ncertificates)
+
+
+class msg_cmpctblock(object):
+    command = b"cmpctblock"
+
+    def __init__(self, header_and_shortids=None):
+        if header_and_shortids is None:
+            self.header_and_shortids = HeaderAndShortIDs()
+        else:
+            self.header_and_shortids = header_and_shortids
+
+    def deserialize(self, f):
+        self.header_and_shortids.deserialize(f)
+
+    def serialize(self):
+        return self.header_and_shortids.serialize()
+
+    def __repr__(self):
+        return "msg_cmpctblock(header_and_shortids=%s)" % repr(self.header_and_shortids)
+
+
+# Sent both ways between whitelisted peers with -fastblockrelay, to push each other
+# the blocks extending the tip before their full validation
+class msg_sendfastrelay(object):
+    command = b"sendfastrelay"
+
+    def __init__(self):
+        pass
+
+    def deserialize(self, f):
+        pass
+
+    def serialize(self):
+        return b""
+
+    def __repr__(self):
+        return "msg_sendfastrelay()"
+
+
 class msg_getaddr(object):
     command = b"getaddr"
 
@@ -1161,7 +1290,9 @@ class NodeConnCB(object):
             b"headers": self.on_headers,
             b"getheaders": self.on_getheaders,
             b"reject": self.on_reject,
-            b"mempool": self.on_mempool
+            b"mempool": self.on_mempool,
+            b"cmpctblock": self.on_cmpctblock,
+            b"sendfastrelay": self.on_sendfastrelay
         }
 
     def deliver(self, conn, message):
@@ -1205,6 +1336,8 @@ class NodeConnCB(object):
     def on_close(self, conn): pass
     def on_mempool(self, conn): pass
     def on_pong(self, conn, message): pass
+    def on_cmpctblock(self, conn, message): pass
+    def on_sendfastrelay(self, conn, message): pass
 
 
 # The actual NodeConn class
@@ -1225,7 +1358,9 @@ class NodeConn(asyncore.dispatcher):
         b"headers": msg_headers,
         b"getheaders": msg_getheaders,
         b"reject": msg_reject,
-        b"mempool": msg_mempool
+        b"mempool": msg_mempool,
+        b"cmpctblock": msg_cmpctblock,
+        b"sendfastrelay": msg_sendfastrelay
     }
     MAGIC_BYTES = {
         "mainnet": b"\x63\x61\x73\x68",  # mainnet
@@ -7,6 +7,7 @@ from websocket import create_connection
 import time
 import decimal
 import sys
+import struct
 
 class JSONWSException(Exception):
     def __init__(self, ws_error):
@@ -24,6 +25,8 @@ def __func():
 log = logging.getLogger("HorizenWebsocket")
 
 EVT_UPDATE_TIP = 0
+EVT_MEMPOOL_DELTA = 1
+EVT_CERTIFICATE_RESULT = 2
 EVT_UNDEFINED = 0xff
 
 REQ_GET_SINGLE_BLOCK = 0
@@ -33,6 +36,9 @@ REQ_SEND_CERTIFICATE = 3
 REQ_GET_BLOCK_HEADERS = 4
 REQ_GET_TOP_QUALITY_CERTIFICATES = 5
 REQ_GET_SIDECHAIN_VERSIONS = 6
+REQ_GET_BINARY_BLOCKS = 7
+REQ_SUBSCRIBE_MEMPOOL_DELTA = 8
+REQ_SUBMIT_RAW_CERTIFICATE = 9
 REQ_UNDEFINED = 0xff
 
 MSG_EVENT = 0
@@ -202,6 +208,45 @@ def fill_ws_get_sidechain_versions_output(jrsp):
     print("Json Received '%s'" % jrsp)
     return jrsp['responsePayload']['sidechainVersions']
 
+#----------------------------------------------------------------
+# args: start height, max number of blocks, optional headersOnly flag
+def fill_ws_get_binary_blocks_input(args):
+    if len(args) < 2:
+        raise JSONWSException("{}(): wrong number of args {}".format(__func(), len(args)))
+
+    msg = {}
+    msg['msgType']     = MSG_REQUEST
+    msg['requestId']   = "req_" + str(time.time())
+    msg['requestType'] = REQ_GET_BINARY_BLOCKS
+
+    msg['requestPayload'] = {}
+    msg['requestPayload']['height'] = args[0]
+    msg['requestPayload']['limit'] = args[1]
+    if len(args) > 2:
+        msg['requestPayload']['headersOnly'] = args[2]
+    return json.dumps(msg, default=EncodeDecimal)
+
+# each binary frame is: height (int32 LE) | block hash (32 bytes) | serialized block or header
+def parse_ws_binary_block_frame(frame):
+    height = struct.unpack('<i', frame[0:4])[0]
+    block_hash = frame[4:36][::-1].hex()
+    return height, block_hash, frame[36:].hex()
+
+#----------------------------------------------------------------
+# args: hex of the signed certificate
+def fill_ws_submit_raw_certificate_input(args):
+    if len(args) != 1:
+        raise JSONWSException("{}(): wrong number of args {}".format(__func(), len(args)))
+
+    msg = {}
+    msg['msgType']     = MSG_REQUEST
+    msg['requestId']   = "req_" + str(time.time())
+    msg['requestType'] = REQ_SUBMIT_RAW_CERTIFICATE
+
+    msg['requestPayload'] = {}
+    msg['requestPayload']['certificate'] = args[0]
+    return json.dumps(msg, default=EncodeDecimal)
+
 # for negative tests
 #----------------------------------------------------------------
 def fill_ws_test_input(args):
@@ -232,6 +277,8 @@ def fill_ws_cmd_input(method, args):
     if method == "ws_get_block_headers": return fill_ws_get_block_headers_input(args)
     if method == "ws_get_top_quality_certificates": return fill_ws_get_top_quality_certificates_input(args)
     if method == "ws_get_sidechain_versions": return fill_ws_get_sidechain_versions_input(args)
+    if method == "ws_get_binary_blocks": return fill_ws_get_binary_blocks_input(args)
+    if method == "ws_submit_raw_certificate": return fill_ws_submit_raw_certificate_input(args)
 
     if method == "ws_test": return fill_ws_test_input(args)
     # add specific method calls here
@@ -275,6 +322,19 @@ class WsServiceProxy(object):
 
         self._trap_ws_errors(method, jrsp)
 
+        if method == "ws_get_binary_blocks":
+            # the json response announces how many binary frames follow
+            return [parse_ws_binary_block_frame(ws.recv()) for _ in range(jrsp['responsePayload']['count'])]
+
+        if method == "ws_submit_raw_certificate":
+            # the response carries the certificate hash, the result follows as an event with the same requestId
+            while True:
+                jevt = json.loads(ws.recv())
+                print("Received '%s'"%(jevt))
+                if jevt['msgType'] == MSG_EVENT and jevt['eventType'] == EVT_CERTIFICATE_RESULT and \
+                        jevt['requestId'] == jrsp['requestId']:
+                    return jrsp['responsePayload']['certificateHash'], jevt['eventPayload']
+
         return fill_ws_cmd_output(method, jrsp)
 
     def get_wsurl(self):
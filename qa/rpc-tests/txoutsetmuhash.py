@@ -0,0 +1,67 @@
+#!/usr/bin/env python3
+# Copyright (c) 2014 The Bitcoin Core developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#
+# Test that the rolling muhash of gettxoutsetinfo follows connected and
+# disconnected blocks, and matches the one of a full rescan of the set
+#
+
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.authproxy import JSONRPCException
+from test_framework.util import assert_equal, initialize_chain_clean, start_node, stop_node
+
+
+class TxOutSetMuHashTest(BitcoinTestFramework):
+
+    def setup_chain(self):
+        print("Initializing test directory "+self.options.tmpdir)
+        initialize_chain_clean(self.options.tmpdir, 1)
+
+    def setup_network(self):
+        self.nodes = []
+        self.is_network_split = False
+        self.nodes.append(start_node(0, self.options.tmpdir))
+
+    def check_muhash(self):
+        node = self.nodes[0]
+        rolling = node.gettxoutsetinfo("muhash")
+        assert_equal(rolling, node.gettxoutsetinfo("muhash", True))
+        legacy = node.gettxoutsetinfo()
+        for key in ["height", "bestblock", "transactions", "txouts", "total_amount"]:
+            assert_equal(rolling[key], legacy[key])
+        return rolling
+
+    def run_test(self):
+        node = self.nodes[0]
+        empty = self.check_muhash()
+
+        node.generate(101)
+        self.check_muhash()
+        node.sendtoaddress(node.getnewaddress(), 2.5)
+        node.sendtoaddress(node.getnewaddress(), 1.25)
+        node.generate(1)
+        tip = self.check_muhash()
+
+        # disconnecting a block restores the hash of its parent
+        node.generate(1)
+        assert(self.check_muhash()["muhash"] != tip["muhash"])
+        node.invalidateblock(node.getbestblockhash())
+        assert_equal(self.check_muhash(), tip)
+        assert(tip["muhash"] != empty["muhash"])
+
+        # the rolling statistics are kept on disk
+        stop_node(node, 0)
+        self.nodes[0] = start_node(0, self.options.tmpdir)
+        assert_equal(self.check_muhash(), tip)
+
+        try:
+            self.nodes[0].gettxoutsetinfo("sha512")
+            raise AssertionError("gettxoutsetinfo accepted an unknown hash_type")
+        except JSONRPCException as e:
+            assert("Unknown hash_type" in e.error["message"])
+
+
+if __name__ == '__main__':
+    TxOutSetMuHashTest().main()
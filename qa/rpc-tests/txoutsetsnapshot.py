@@ -0,0 +1,73 @@
+#!/usr/bin/env python3
+# Copyright (c) 2014 The Bitcoin Core developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#
+# Test dumptxoutset and the import of its snapshot with -loadtxoutset
+#
+
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.authproxy import JSONRPCException
+from test_framework.util import assert_equal, initialize_chain_clean, start_node, \
+    stop_node, connect_nodes_bi, sync_blocks
+
+import os
+
+
+class TxOutSetSnapshotTest(BitcoinTestFramework):
+
+    def setup_chain(self):
+        print("Initializing test directory "+self.options.tmpdir)
+        initialize_chain_clean(self.options.tmpdir, 2)
+
+    def setup_network(self):
+        self.nodes = []
+        self.is_network_split = False
+        self.nodes.append(start_node(0, self.options.tmpdir))
+
+    def run_test(self):
+        node0 = self.nodes[0]
+        node0.generate(110)
+        node0.sendtoaddress(node0.getnewaddress(), 1.5)
+        node0.generate(1)
+
+        dump = node0.dumptxoutset("utxo.dat")
+        info = node0.gettxoutsetinfo()
+        assert_equal(dump["base_height"], 111)
+        assert_equal(dump["base_hash"], node0.getbestblockhash())
+        assert_equal(dump["hash_serialized"], info["hash_serialized"])
+        assert_equal(dump["txouts"], info["txouts"])
+        assert_equal(dump["total_amount"], info["total_amount"])
+        assert_equal(os.path.getsize(dump["path"]), dump["bytes"])
+
+        # an existing file is never overwritten
+        try:
+            node0.dumptxoutset(dump["path"])
+            raise AssertionError("dumptxoutset overwrote an existing file")
+        except JSONRPCException as e:
+            assert("already exists" in e.error["message"])
+
+        # a new node starts from the snapshot base block
+        self.nodes.append(start_node(1, self.options.tmpdir, [
+            "-loadtxoutset=" + dump["path"], "-loadtxoutsethash=" + dump["snapshot_hash"]]))
+        node1 = self.nodes[1]
+        assert_equal(node1.getblockcount(), 111)
+        assert_equal(node1.getbestblockhash(), dump["base_hash"])
+        assert_equal(node1.gettxoutsetinfo(), info)
+
+        # and follows the chain from there
+        connect_nodes_bi(self.nodes, 0, 1)
+        node0.generate(5)
+        sync_blocks(self.nodes)
+        assert_equal(node1.gettxoutsetinfo(), node0.gettxoutsetinfo())
+
+        # the snapshot is only imported once, a restart keeps the synced chainstate
+        stop_node(node1, 1)
+        self.nodes[1] = start_node(1, self.options.tmpdir, ["-loadtxoutset=" + dump["path"]])
+        assert_equal(self.nodes[1].getblockcount(), 116)
+        assert_equal(self.nodes[1].gettxoutsetinfo(), node0.gettxoutsetinfo())
+
+
+if __name__ == '__main__':
+    TxOutSetSnapshotTest().main()
@@ -0,0 +1,74 @@
+#!/usr/bin/env python3
+# Copyright (c) 2014 The Bitcoin Core developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#
+# Test the latency traces of the transactions received from peers, from gettxtrace and gettxtracestats
+#
+
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.authproxy import JSONRPCException
+from test_framework.util import assert_equal, initialize_chain, start_nodes, connect_nodes_bi, \
+    sync_blocks, sync_mempools
+
+
+class TxTraceTest(BitcoinTestFramework):
+
+    def setup_chain(self):
+        print("Initializing test directory "+self.options.tmpdir)
+        initialize_chain(self.options.tmpdir)
+
+    def setup_network(self, split=False):
+        self.nodes = start_nodes(3, self.options.tmpdir, [[], [], ["-txtracesize=0"]])
+        connect_nodes_bi(self.nodes, 0, 1)
+        connect_nodes_bi(self.nodes, 1, 2)
+        self.is_network_split = False
+        self.sync_all()
+
+    def run_test(self):
+        txid = self.nodes[0].sendtoaddress(self.nodes[1].getnewaddress(), 1)
+        sync_mempools(self.nodes)
+
+        # created by the wallet, not received
+        try:
+            self.nodes[0].gettxtrace(txid)
+            assert(False)
+        except JSONRPCException as e:
+            assert("No trace" in e.error['message'])
+
+        trace = self.nodes[1].gettxtrace(txid)
+        assert_equal(trace["hash"], txid)
+        assert_equal(trace["type"], "transaction")
+        stages = trace["stages"]
+        assert_equal(sorted(stages.keys()), ["accepted", "received", "relayed"])
+        assert_equal(stages["received"]["elapsed_us"], 0)
+        assert(stages["relayed"]["time_us"] >= stages["accepted"]["time_us"] >= stages["received"]["time_us"])
+
+        self.nodes[1].generate(1)
+        sync_blocks(self.nodes)
+        stages = self.nodes[1].gettxtrace(txid)["stages"]
+        assert("block_template" in stages)
+        assert_equal(stages["block_template"]["elapsed_us"] - stages["relayed"]["elapsed_us"], stages["block_template"]["latency_us"])
+
+        stats = self.nodes[1].gettxtracestats()
+        assert_equal(stats["traced"], 1)
+        assert_equal(stats["transaction"]["accepted"]["count"], 1)
+        assert_equal(stats["transaction"]["block_template"]["count"], 1)
+        assert_equal(stats["transaction"]["proof_queued"]["count"], 0)
+        assert_equal(stats["certificate"]["accepted"]["count"], 0)
+
+        self.nodes[1].gettxtracestats(True)
+        assert_equal(self.nodes[1].gettxtracestats()["transaction"]["accepted"]["count"], 0)
+
+        # tracing disabled
+        assert_equal(self.nodes[2].gettxtracestats()["traced"], 0)
+        try:
+            self.nodes[2].gettxtrace(txid)
+            assert(False)
+        except JSONRPCException as e:
+            assert("No trace" in e.error['message'])
+
+
+if __name__ == '__main__':
+    TxTraceTest().main()
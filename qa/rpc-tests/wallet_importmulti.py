@@ -0,0 +1,72 @@
+#!/usr/bin/env python3
+# Copyright (c) 2014-2016 The Bitcoin Core developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+from decimal import Decimal
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.util import assert_equal, start_nodes, initialize_chain_clean, connect_nodes_bi
+
+
+class ImportMultiTest (BitcoinTestFramework):
+
+    def setup_chain(self):
+        print("Initializing test directory "+self.options.tmpdir)
+        initialize_chain_clean(self.options.tmpdir, 3)
+
+    def setup_network(self, split=False):
+        self.nodes = start_nodes(3, self.options.tmpdir)
+        connect_nodes_bi(self.nodes,0,1)
+        connect_nodes_bi(self.nodes,1,2)
+        connect_nodes_bi(self.nodes,0,2)
+        self.is_network_split=False
+        self.sync_all()
+
+    def run_test(self):
+        [miner, owner, importer] = self.nodes
+
+        miner.generate(110)
+        self.sync_all()
+
+        # funds received by two keys and a watched address of owner, in blocks far apart
+        addr_1 = owner.getnewaddress()
+        addr_2 = owner.getnewaddress()
+        addr_watch = owner.getnewaddress()
+        miner.sendtoaddress(addr_1, Decimal('1.5'))
+        miner.generate(1)
+        self.sync_all()
+        start_time = miner.getblock(miner.getbestblockhash())['time']
+        miner.generate(20)
+        miner.sendtoaddress(addr_2, Decimal('2.5'))
+        miner.sendtoaddress(addr_watch, Decimal('3.0'))
+        miner.generate(1)
+        self.sync_all()
+
+        print("Importing two keys, a watched address and an invalid key with a single rescan...")
+        result = importer.importmulti([
+            {"keys": [owner.dumpprivkey(addr_1), owner.dumpprivkey(addr_2)], "timestamp": start_time - 1, "label": "deposits"},
+            {"scriptPubKey": addr_watch, "timestamp": start_time},
+            {"keys": ["notakey"], "timestamp": "now"},
+            {"scriptPubKey": addr_watch, "keys": [], "timestamp": "now"},
+        ])
+        assert_equal([r['success'] for r in result], [True, True, False, False])
+        assert_equal(result[2]['error']['code'], -5)
+        assert_equal(result[3]['error']['code'], -8)
+
+        # the rescan from the earliest timestamp found the funds of all the entries
+        assert_equal(importer.getbalance(), Decimal('4.0'))
+        assert_equal(importer.getbalance("*", 1, True), Decimal('7.0'))
+        assert_equal(importer.getaccount(addr_1), "deposits")
+
+        print("Importing a key used only after the import...")
+        addr_new = owner.getnewaddress()
+        result = importer.importmulti([{"keys": [owner.dumpprivkey(addr_new)], "timestamp": "now"}], {"rescan": False})
+        assert_equal(result[0]['success'], True)
+        miner.sendtoaddress(addr_new, Decimal('0.5'))
+        miner.generate(1)
+        self.sync_all()
+        assert_equal(importer.getbalance(), Decimal('4.5'))
+
+
+if __name__ == '__main__':
+    ImportMultiTest().main()
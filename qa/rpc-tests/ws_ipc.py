@@ -0,0 +1,122 @@
+#!/usr/bin/env python3
+# Copyright (c) 2018 The Zencash developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+# Exercise the websocket requests of the unix control socket, and the ring of the new tips
+
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.util import assert_equal, assert_true, initialize_chain_clean, start_nodes
+from test_framework.wsproxy import fill_ws_get_single_block_input
+import json
+import mmap
+import os
+import socket
+import struct
+
+RING_HEADER_SIZE = 40
+RECORD_HEADER_SIZE = 16
+RECORD_TIP = 1
+RECORD_HEADER = 2
+RECORD_BLOCK = 3
+
+
+def send_frame(sock, msg):
+    data = msg.encode()
+    sock.sendall(struct.pack('<IB', len(data), 0) + data)
+
+
+def recv_exact(sock, size):
+    data = b''
+    while len(data) < size:
+        chunk = sock.recv(size - len(data))
+        assert_true(len(chunk) > 0)
+        data += chunk
+    return data
+
+
+def recv_frame(sock):
+    size, binary = struct.unpack('<IB', recv_exact(sock, 5))
+    return binary, recv_exact(sock, size)
+
+
+def read_record(ring, offset):
+    capacity = struct.unpack_from('<Q', ring, 8)[0]
+    pos = RING_HEADER_SIZE + offset % capacity
+    rtype, size, seq = struct.unpack_from('<IIQ', ring, pos)
+    payload = ring[pos + RECORD_HEADER_SIZE:pos + RECORD_HEADER_SIZE + size]
+    height = struct.unpack_from('<i', payload, 0)[0]
+    blockhash = payload[4:36][::-1].hex()
+    return rtype, seq, height, blockhash, payload[36:], offset + (RECORD_HEADER_SIZE + size + 7) // 8 * 8
+
+
+class ws_ipc(BitcoinTestFramework):
+
+    def setup_chain(self, split=False):
+        print("Initializing test directory " + self.options.tmpdir)
+        initialize_chain_clean(self.options.tmpdir, 1)
+
+    def setup_network(self, split=False):
+        self.ipcdir = os.path.join(self.options.tmpdir, "ipc")
+        self.nodes = start_nodes(1, self.options.tmpdir, extra_args=[['-websocket=1', '-debug=ws',
+                                                                      '-wsipcdir=' + self.ipcdir, '-wsipcringsize=1']])
+        self.is_network_split = split
+
+    def run_test(self):
+        node = self.nodes[0]
+        node.generate(5)
+
+        sock = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+        sock.connect(os.path.join(self.ipcdir, "ws.sock"))
+
+        print("Requests of the websocket are served through the control socket...")
+        send_frame(sock, fill_ws_get_single_block_input([2]))
+        binary, data = recv_frame(sock)
+        assert_equal(binary, 0)
+        rsp = json.loads(data)
+        assert_equal(rsp['responsePayload']['height'], 2)
+        assert_equal(rsp['responsePayload']['block'], node.getblock(node.getblockhash(2), False))
+
+        print("The tip events point to the blocks in the ring...")
+        with open(os.path.join(self.ipcdir, "ws.ring"), "rb") as f:
+            ring = mmap.mmap(f.fileno(), 0, access=mmap.ACCESS_READ)
+        assert_equal(struct.unpack_from('<II', ring, 0), (0x474e525a, 1))
+        assert_equal(struct.unpack_from('<Q', ring, 8)[0], 1 << 20)
+
+        tip = node.generate(1)[0]
+        while True:
+            binary, data = recv_frame(sock)
+            evt = json.loads(data)
+            if evt['msgType'] == 0 and evt['eventType'] == 0:
+                break
+        payload = evt['eventPayload']
+        assert_equal(payload['hash'], tip)
+        assert_equal(payload['height'], 6)
+        assert_true('block' not in payload)
+
+        block_offset = payload['ringOffset']
+        rtype, seq, height, blockhash, block, next_offset = read_record(ring, block_offset)
+        assert_equal((rtype, height, blockhash), (RECORD_BLOCK, 6, tip))
+        assert_equal(block.hex(), node.getblock(tip, False))
+        # the header comes first, the tip event last
+        rtype, header_seq, height, blockhash, header, _ = read_record(ring, self.find_header(ring, block_offset))
+        assert_equal((rtype, height, blockhash, header_seq), (RECORD_HEADER, 6, tip, seq - 1))
+        assert_equal(header.hex(), node.getblockheader(tip, False))
+        rtype, tip_seq, height, blockhash, rest, _ = read_record(ring, next_offset)
+        assert_equal((rtype, height, blockhash, tip_seq, len(rest)), (RECORD_TIP, 6, tip, seq + 1, 0))
+
+        sock.close()
+        ring.close()
+
+    def find_header(self, ring, block_offset):
+        # walk the records from the oldest one to the one before the block
+        offset = struct.unpack_from('<Q', ring, 16)[0]
+        while True:
+            next_offset = read_record(ring, offset)[5]
+            if next_offset == block_offset:
+                return offset
+            offset = next_offset
+
+
+if __name__ == '__main__':
+    ws_ipc().main()
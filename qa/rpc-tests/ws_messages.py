@@ -8,7 +8,7 @@ import time
 from test_framework.test_framework import BitcoinTestFramework
 from test_framework.util import assert_equal, initialize_chain_clean, \
     start_nodes, sync_blocks, sync_mempools, connect_nodes_bi, mark_logs,\
-    get_epoch_data, assert_false, assert_true, swap_bytes
+    get_epoch_data, assert_false, assert_true, swap_bytes, get_spendable
 
 from test_framework.test_framework import ForkHeights, MINER_REWARD_POST_H200
 
@@ -402,6 +402,22 @@ class ws_messages(BitcoinTestFramework):
         except JSONWSException as e:
             print("Exception:", e.error)
 
+        mark_logs("Test for streaming 20 binary blocks", self.nodes, DEBUG_MODE)
+        start_height = self.nodes[0].getblockcount() - 19
+        blocks_ = self.nodes[0].ws_get_binary_blocks(start_height, 20)
+        assert_equal(len(blocks_), 20)
+        for n, (height_, hash_, block_) in enumerate(blocks_):
+            assert_equal(height_, start_height + n)
+            assert_equal(hash_, self.nodes[0].getblockhash(height_))
+            assert_equal(block_, self.nodes[0].getblock(str(height_), False))
+
+        mark_logs("Test for streaming binary headers past the tip", self.nodes, DEBUG_MODE)
+        start_height = self.nodes[0].getblockcount() - 4
+        headers_ = self.nodes[0].ws_get_binary_blocks(start_height, 10, True)
+        assert_equal(len(headers_), 5)
+        for height_, hash_, header_ in headers_:
+            assert_equal(header_, self.nodes[0].getblock(str(height_), False)[0:354])
+
         t.do_run = False
 
 
@@ -533,6 +549,59 @@ class ws_messages(BitcoinTestFramework):
         assert_equal(cert_2_epoch_0, chain_cert_['certHash'])
         assert_equal({}, mempool_cert_)
 
+        # ----------------------------------------------------------------"
+        # Test the submission of a certificate built and signed by the client
+        mark_logs("Node0 submits via websocket a raw certificate for epoch {}".format(epoch_number), self.nodes, DEBUG_MODE)
+        cert_3_quality = 5
+        proof3 = mcTest.create_test_proof("sc2",
+                                         swap_bytes(scid2),
+                                         epoch_number,
+                                         cert_3_quality,
+                                         MBTR_SC_FEE,
+                                         FT_SC_FEE,
+                                         cum_tree_hash,
+                                         constant = sc2_constant,
+                                         pks      = [],
+                                         amounts  = [])
+
+        utx, change = get_spendable(self.nodes[0], CERT_FEE)
+        raw_inputs   = [{'txid' : utx['txid'], 'vout' : utx['vout']}]
+        raw_outs     = {self.nodes[0].getnewaddress() : change}
+        raw_bwt_outs = []
+        raw_params = {
+            "scid": scid2,
+            "quality": cert_3_quality,
+            "endEpochCumScTxCommTreeRoot": cum_tree_hash,
+            "scProof": proof3,
+            "withdrawalEpochNumber": epoch_number,
+            "ftScFee": FT_SC_FEE,
+            "mbtrScFee": MBTR_SC_FEE
+        }
+        raw_cert = self.nodes[0].createrawcertificate(raw_inputs, raw_outs, raw_bwt_outs, raw_params)
+        signed_cert = self.nodes[0].signrawtransaction(raw_cert)
+
+        cert_3_epoch_1, result = self.nodes[0].ws_submit_raw_certificate(signed_cert['hex'])
+        assert_true(result['accepted'])
+        assert_equal(cert_3_epoch_1, result['certificateHash'])
+        self.sync_all()
+        assert_true(cert_3_epoch_1 in self.nodes[1].getrawmempool())
+
+        mark_logs("Node0 submits via websocket the same certificate again", self.nodes, DEBUG_MODE)
+        _, result = self.nodes[0].ws_submit_raw_certificate(signed_cert['hex'])
+        assert_true(result['accepted'])
+
+        mark_logs("Node0 submits via websocket an unsigned certificate", self.nodes, DEBUG_MODE)
+        _, result = self.nodes[0].ws_submit_raw_certificate(raw_cert)
+        assert_false(result['accepted'])
+        print("Reject reason:", result['rejectReason'])
+
+        try:
+            mark_logs("Node0 submits via websocket a certificate which can not be decoded", self.nodes, DEBUG_MODE)
+            self.nodes[0].ws_submit_raw_certificate("deadbeef")
+            raise RuntimeError("A certificate which can not be decoded was accepted")
+        except JSONWSException as e:
+            print("Exception:", e.error)
+
 
 if __name__ == '__main__':
     ws_messages().main()
@@ -0,0 +1,63 @@
+#!/usr/bin/env python3
+# Copyright (c) 2014 The Bitcoin Core developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#
+# Test the zen-cli -batch mode, sending the commands read from stdin over one connection
+#
+
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.util import assert_equal, initialize_chain_clean, start_node
+import os
+import subprocess
+
+
+class ZenCliBatchTest(BitcoinTestFramework):
+
+    def setup_chain(self):
+        print("Initializing test directory "+self.options.tmpdir)
+        initialize_chain_clean(self.options.tmpdir, 1)
+
+    def setup_network(self):
+        self.nodes = []
+        self.is_network_split = False
+        self.nodes.append(start_node(0, self.options.tmpdir))
+
+    def run_cli_batch(self, commands, batchsize):
+        datadir = os.path.join(self.options.tmpdir, "node0")
+        proc = subprocess.Popen([os.getenv("BITCOINCLI", "zen-cli"), "-datadir=" + datadir, "-batch",
+                                 "-batchsize=%d" % batchsize],
+                                stdin=subprocess.PIPE, stdout=subprocess.PIPE, stderr=subprocess.PIPE,
+                                universal_newlines=True)
+        out, err = proc.communicate("\n".join(commands) + "\n")
+        return proc.returncode, out.splitlines(), err
+
+    def run_test(self):
+        node = self.nodes[0]
+        node.generate(30)
+
+        # the replies come in the order of the commands, whatever the batch size
+        commands = ["getblockhash %d" % h for h in range(31)]
+        expected = [node.getblockhash(h) for h in range(31)]
+        for batchsize in (1, 7, 100):
+            ret, lines, err = self.run_cli_batch(commands, batchsize)
+            assert_equal(ret, 0)
+            assert_equal(lines, expected)
+            assert_equal(err, "")
+
+        # blank lines and comments are skipped, quoted params are kept whole
+        tip = node.getbestblockhash()
+        ret, lines, err = self.run_cli_batch(["", "# the tip", "getblockheader '%s' false" % tip, "getblockcount"], 10)
+        assert_equal(ret, 0)
+        assert_equal(lines, [node.getblockheader(tip, False), "30"])
+
+        # a failed command is reported, the others run and the exit code is that of the first failure
+        ret, lines, err = self.run_cli_batch(["getblockhash 1", "getblockhash 100", "getblockcount"], 2)
+        assert_equal(ret, 8)
+        assert_equal(lines, [expected[1], "30"])
+        assert("Block height out of range" in err)
+
+
+if __name__ == '__main__':
+    ZenCliBatchTest().main()
@@ -134,6 +134,7 @@ def util_test():
 STAGES = [
     'btest',
     'gtest',
+    'gtest-perf',
     'b-gtest_with_coverage',
     'sec-hard',
     'no-dot-so',
@@ -148,6 +149,7 @@ STAGES = [
 STAGE_COMMANDS = {
     'btest': [repofile('src/test/test_bitcoin'), '-p'],
     'gtest': [repofile('src/zen-gtest')],
+    'gtest-perf': [repofile('src/zen-gtest-perf')],
     'b-gtest_with_coverage': ['make','cov_ci'],
     'sec-hard': check_security_hardening,
     'no-dot-so': ensure_no_dot_so_in_depends,
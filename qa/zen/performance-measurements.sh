@@ -180,6 +180,9 @@ case "$1" in
             listunspent)
                 zcash_rpc zcbenchmark listunspent 10
                 ;;
+            selectcoins)
+                zcash_rpc zcbenchmark selectcoins 10 "${@:4}"
+                ;;
             *)
                 zcashd_stop
                 echo "Bad arguments to time."
@@ -230,6 +233,9 @@ case "$1" in
             listunspent)
                 zcash_rpc zcbenchmark listunspent 1
                 ;;
+            selectcoins)
+                zcash_rpc zcbenchmark selectcoins 1 "${@:4}"
+                ;;
             *)
                 zcashd_massif_stop
                 echo "Bad arguments to memory."
@@ -10,6 +10,8 @@
 #include "amount.h"
 #include "script/script.h"
 
+#include <map>
+
 enum class AddressType {
     UNKNOWN = 0,
     PUBKEY = 1,
@@ -267,6 +269,81 @@ struct CAddressIndexIteratorHeightKey {
     }
 };
 
+/**
+ * Totals over the address index entries of one address, kept up to date as blocks are connected
+ * and disconnected so that balance queries don't have to read the whole history of the address.
+ * Superseded entries (negative maturity height) are left out, as in getaddressbalance. Entries
+ * with a positive maturity height (backward transfers) are also summed by maturity height, since
+ * whether they count as immature depends on the current tip.
+ */
+struct CAddressAggregateValue {
+    CAmount balance;
+    CAmount received;
+    int64_t txCount;
+    std::map<int, CAmount> maturing;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
+        READWRITE(balance);
+        READWRITE(received);
+        READWRITE(txCount);
+        READWRITE(maturing);
+    }
+
+    CAddressAggregateValue() {
+        SetNull();
+    }
+
+    void SetNull() {
+        balance = 0;
+        received = 0;
+        txCount = 0;
+        maturing.clear();
+    }
+
+    bool IsNull() const {
+        return balance == 0 && received == 0 && txCount == 0 && maturing.empty();
+    }
+
+    //! Add (sign = 1) or remove (sign = -1) the contribution of an address index entry
+    void ApplyEntry(const CAddressIndexValue& value, int sign) {
+        if (value.IsNull() || value.maturityHeight < 0)
+            return;
+        balance += sign * value.satoshis;
+        if (value.satoshis > 0)
+            received += sign * value.satoshis;
+        if (value.maturityHeight > 0) {
+            CAmount& amount = maturing[value.maturityHeight];
+            amount += sign * value.satoshis;
+            if (amount == 0)
+                maturing.erase(value.maturityHeight);
+        }
+    }
+
+    //! Add the changes collected in another aggregate
+    void Add(const CAddressAggregateValue& delta) {
+        balance += delta.balance;
+        received += delta.received;
+        txCount += delta.txCount;
+        for (const auto& [maturityHeight, amount] : delta.maturing) {
+            CAmount& total = maturing[maturityHeight];
+            total += amount;
+            if (total == 0)
+                maturing.erase(maturityHeight);
+        }
+    }
+
+    //! The amount still immature with the given tip
+    CAmount GetImmature(int tipHeight) const {
+        CAmount immature = 0;
+        for (auto it = maturing.upper_bound(tipHeight); it != maturing.end(); ++it)
+            immature += it->second;
+        return immature;
+    }
+};
+
 struct CMempoolAddressDelta
 {
     enum OutputStatus
@@ -348,6 +425,11 @@ struct CMempoolAddressDeltaKey
         index = 0;
         spending = 0;
     }
+
+    friend bool operator==(const CMempoolAddressDeltaKey& a, const CMempoolAddressDeltaKey& b) {
+        return a.type == b.type && a.addressBytes == b.addressBytes && a.txhash == b.txhash &&
+               a.index == b.index && a.spending == b.spending;
+    }
 };
 
 struct CMempoolAddressDeltaKeyCompare
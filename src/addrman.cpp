@@ -67,12 +67,12 @@ double CAddrInfo::GetChance(int64_t nNow) const
 
 CAddrInfo* CAddrMan::Find(const CNetAddr& addr, int* pnId)
 {
-    std::map<CNetAddr, int>::iterator it = mapAddr.find(addr);
+    std::unordered_map<CNetAddr, int, CNetAddrHasher>::iterator it = mapAddr.find(addr);
     if (it == mapAddr.end())
         return NULL;
     if (pnId)
         *pnId = (*it).second;
-    std::map<int, CAddrInfo>::iterator it2 = mapInfo.find((*it).second);
+    std::unordered_map<int, CAddrInfo>::iterator it2 = mapInfo.find((*it).second);
     if (it2 != mapInfo.end())
         return &(*it2).second;
     return NULL;
@@ -396,7 +396,7 @@ int CAddrMan::Check_()
     if (vRandom.size() != nTried + nNew)
         return -7;
 
-    for (std::map<int, CAddrInfo>::iterator it = mapInfo.begin(); it != mapInfo.end(); ++it) {
+    for (std::unordered_map<int, CAddrInfo>::iterator it = mapInfo.begin(); it != mapInfo.end(); ++it) {
         int n = (*it).first;
         const CAddrInfo& info = (*it).second;
         if (info.fInTried) {
@@ -471,16 +471,19 @@ void CAddrMan::GetAddr_(std::vector<CAddress>& vAddr)
     if (nNodes > ADDRMAN_GETADDR_MAX)
         nNodes = ADDRMAN_GETADDR_MAX;
 
-    // gather a list of random nodes, skipping those of low quality
+    // gather a list of random nodes, skipping those of low quality: a partial shuffle of vRandom,
+    // which only touches the entries drawn
+    vAddr.reserve(vAddr.size() + nNodes);
     for (unsigned int n = 0; n < vRandom.size(); n++) {
         if (vAddr.size() >= nNodes)
             break;
 
         int nRndPos = RandomInt(vRandom.size() - n) + n;
         SwapRandom(n, nRndPos);
-        assert(mapInfo.count(vRandom[n]) == 1);
+        std::unordered_map<int, CAddrInfo>::const_iterator it = mapInfo.find(vRandom[n]);
+        assert(it != mapInfo.end());
 
-        const CAddrInfo& ai = mapInfo[vRandom[n]];
+        const CAddrInfo& ai = it->second;
         if (!ai.IsTerrible())
             vAddr.push_back(ai);
     }
@@ -507,5 +510,5 @@ void CAddrMan::Connected_(const CService& addr, int64_t nTime)
 }
 
 int CAddrMan::RandomInt(int nMax){
-    return GetRandInt(nMax);
+    return GetFastRandInt(nMax);
 }
@@ -5,6 +5,7 @@
 #ifndef BITCOIN_ADDRMAN_H
 #define BITCOIN_ADDRMAN_H
 
+#include "hash.h"
 #include "netbase.h"
 #include "protocol.h"
 #include "random.h"
@@ -15,6 +16,7 @@
 #include <map>
 #include <set>
 #include <stdint.h>
+#include <unordered_map>
 #include <vector>
 
 /**
@@ -166,6 +168,24 @@ public:
 //! the maximum number of nodes to return in a getaddr call
 #define ADDRMAN_GETADDR_MAX 2500
 
+/** Salted SipHash of a network address, so that peers cannot choose addresses colliding in mapAddr */
+class CNetAddrHasher
+{
+private:
+    uint64_t k0, k1;
+
+public:
+    CNetAddrHasher() : k0(GetRand(std::numeric_limits<uint64_t>::max())), k1(GetRand(std::numeric_limits<uint64_t>::max())) {}
+
+    size_t operator()(const CNetAddr& addr) const
+    {
+        unsigned char vch[16];
+        for (int n = 0; n < 16; n++)
+            vch[n] = addr.GetByte(15 - n);
+        return CSipHasher(k0, k1).Write(vch, sizeof(vch)).Finalize();
+    }
+};
+
 /** 
  * Stochastical (IP) address manager 
  */
@@ -178,11 +198,11 @@ private:
     //! last used nId
     int nIdCount;
 
-    //! table with information about all nIds
-    std::map<int, CAddrInfo> mapInfo;
+    //! table with information about all nIds; the entries do not move when others are added or removed
+    std::unordered_map<int, CAddrInfo> mapInfo;
 
     //! find an nId based on its network address
-    std::map<CNetAddr, int> mapAddr;
+    std::unordered_map<CNetAddr, int, CNetAddrHasher> mapAddr;
 
     //! randomly-ordered vector of all nIds
     std::vector<int> vRandom;
@@ -199,6 +219,9 @@ private:
     //! list of "new" buckets
     int vvNew[ADDRMAN_NEW_BUCKET_COUNT][ADDRMAN_BUCKET_SIZE];
 
+    //! number of changes made to the tables, to tell whether they need to be written again
+    uint64_t nModifications;
+
 protected:
     //! secret key to randomize bucket select with
     uint256 nKey;
@@ -292,9 +315,10 @@ public:
 
         int nUBuckets = ADDRMAN_NEW_BUCKET_COUNT ^ (1 << 30);
         s << nUBuckets;
-        std::map<int, int> mapUnkIds;
+        std::unordered_map<int, int> mapUnkIds;
+        mapUnkIds.reserve(mapInfo.size());
         int nIds = 0;
-        for (std::map<int, CAddrInfo>::const_iterator it = mapInfo.begin(); it != mapInfo.end(); it++) {
+        for (std::unordered_map<int, CAddrInfo>::const_iterator it = mapInfo.begin(); it != mapInfo.end(); it++) {
             mapUnkIds[(*it).first] = nIds;
             const CAddrInfo &info = (*it).second;
             if (info.nRefCount) {
@@ -304,7 +328,7 @@ public:
             }
         }
         nIds = 0;
-        for (std::map<int, CAddrInfo>::const_iterator it = mapInfo.begin(); it != mapInfo.end(); it++) {
+        for (std::unordered_map<int, CAddrInfo>::const_iterator it = mapInfo.begin(); it != mapInfo.end(); it++) {
             const CAddrInfo &info = (*it).second;
             if (info.fInTried) {
                 assert(nIds != nTried); // this means nTried was wrong, oh ow
@@ -418,9 +442,9 @@ public:
 
         // Prune new entries with refcount 0 (as a result of collisions).
         int nLostUnk = 0;
-        for (std::map<int, CAddrInfo>::const_iterator it = mapInfo.begin(); it != mapInfo.end(); ) {
+        for (std::unordered_map<int, CAddrInfo>::const_iterator it = mapInfo.begin(); it != mapInfo.end(); ) {
             if (it->second.fInTried == false && it->second.nRefCount == 0) {
-                std::map<int, CAddrInfo>::const_iterator itCopy = it++;
+                std::unordered_map<int, CAddrInfo>::const_iterator itCopy = it++;
                 Delete(itCopy->first);
                 nLostUnk++;
             } else {
@@ -430,6 +454,8 @@ public:
         if (nLost + nLostUnk > 0) {
             LogPrint("addrman", "addrman lost %i new and %i tried addresses due to collisions\n", nLostUnk, nLost);
         }
+        // the tables are as on disk, but for the entries lost
+        nModifications = nLost + nLostUnk;
 
         Check();
     }
@@ -441,6 +467,8 @@ public:
 
     void Clear()
     {
+        mapInfo.clear();
+        mapAddr.clear();
         std::vector<int>().swap(vRandom);
         nKey = GetRandHash();
         for (size_t bucket = 0; bucket < ADDRMAN_NEW_BUCKET_COUNT; bucket++) {
@@ -457,6 +485,7 @@ public:
         nIdCount = 0;
         nTried = 0;
         nNew = 0;
+        nModifications = 0;
     }
 
     CAddrMan()
@@ -475,6 +504,13 @@ public:
         return vRandom.size();
     }
 
+    //! Return the number of changes made since the tables were created, cleared or read
+    uint64_t GetModifications() const
+    {
+        LOCK(cs);
+        return nModifications;
+    }
+
     //! Consistency check
     void Check()
     {
@@ -496,6 +532,7 @@ public:
             LOCK(cs);
             Check();
             fRet |= Add_(addr, source, nTimePenalty);
+            nModifications++;
             Check();
         }
         if (fRet)
@@ -512,6 +549,7 @@ public:
             Check();
             for (std::vector<CAddress>::const_iterator it = vAddr.begin(); it != vAddr.end(); it++)
                 nAdd += Add_(*it, source, nTimePenalty) ? 1 : 0;
+            nModifications++;
             Check();
         }
         if (nAdd)
@@ -526,6 +564,7 @@ public:
             LOCK(cs);
             Check();
             Good_(addr, nTime);
+            nModifications++;
             Check();
         }
     }
@@ -537,6 +576,7 @@ public:
             LOCK(cs);
             Check();
             Attempt_(addr, nTime);
+            nModifications++;
             Check();
         }
     }
@@ -576,6 +616,7 @@ public:
             LOCK(cs);
             Check();
             Connected_(addr, nTime);
+            nModifications++;
             Check();
         }
     }
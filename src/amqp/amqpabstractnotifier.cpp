@@ -10,12 +10,12 @@ AMQPAbstractNotifier::~AMQPAbstractNotifier()
 {
 }
 
-bool AMQPAbstractNotifier::NotifyBlock(const CBlockIndex * /*CBlockIndex*/)
+bool AMQPAbstractNotifier::NotifyBlock(const CNotification &/*notification*/)
 {
     return true;
 }
 
-bool AMQPAbstractNotifier::NotifyTransaction(const CTransaction &/*transaction*/)
+bool AMQPAbstractNotifier::NotifyTransaction(const CNotification &/*notification*/)
 {
     return true;
 }
@@ -7,7 +7,7 @@
 
 #include "amqpconfig.h"
 
-class CBlockIndex;
+class CNotification;
 class AMQPAbstractNotifier;
 
 typedef AMQPAbstractNotifier* (*AMQPNotifierFactory)();
@@ -32,8 +32,8 @@ public:
     virtual bool Initialize() = 0;
     virtual void Shutdown() = 0;
 
-    virtual bool NotifyBlock(const CBlockIndex *pindex);
-    virtual bool NotifyTransaction(const CTransaction &transaction);
+    virtual bool NotifyBlock(const CNotification &notification);
+    virtual bool NotifyTransaction(const CNotification &notification);
 
 protected:
     std::string type;
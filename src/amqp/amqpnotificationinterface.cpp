@@ -12,21 +12,14 @@
 
 // AMQP 1.0 Support
 //
-// The boost::signals2 signals and slot system is thread safe, so CValidationInterface listeners
-// can be invoked from any thread.
-//
-// Currently signals are fired from main.cpp so the callbacks should be invoked on the same thread.
-// It should be safe to share objects responsible for sending, as they should not be run concurrently
-// across different threads.
-//
-// Developers should be mindful of where notifications are fired to avoid potential race conditions.
-// For example, different signals targeting the same address could be fired from different threads
-// in different parts of the system around the same time.
+// The notifications are queued by the notification dispatcher, which calls this sink from a thread of
+// its own, so that a slow broker does not delay block connection. As all the notifications go through
+// that thread, it is safe to share the objects responsible for sending between the notifiers.
 //
 // Like the ZMQ notification interface, if a notifier fails to send a message, the notifier is shut down.
 //
 
-AMQPNotificationInterface::AMQPNotificationInterface()
+AMQPNotificationInterface::AMQPNotificationInterface() : fRawTransactions(false)
 {
 }
 
@@ -65,6 +58,7 @@ AMQPNotificationInterface* AMQPNotificationInterface::CreateWithArguments(const
     if (!notifiers.empty()) {
         notificationInterface = new AMQPNotificationInterface();
         notificationInterface->notifiers = notifiers;
+        notificationInterface->fRawTransactions = args.count("-amqppubrawtx") != 0;
 
         if (!notificationInterface->Initialize()) {
             delete notificationInterface;
@@ -109,11 +103,11 @@ void AMQPNotificationInterface::Shutdown()
     }
 }
 
-void AMQPNotificationInterface::UpdatedBlockTip(const CBlockIndex *pindex)
+void AMQPNotificationInterface::NotifyBlock(const CNotification &notification)
 {
     for (std::list<AMQPAbstractNotifier*>::iterator i = notifiers.begin(); i != notifiers.end(); ) {
         AMQPAbstractNotifier *notifier = *i;
-        if (notifier->NotifyBlock(pindex)) {
+        if (notifier->NotifyBlock(notification)) {
             i++;
         } else {
             notifier->Shutdown();
@@ -122,11 +116,11 @@ void AMQPNotificationInterface::UpdatedBlockTip(const CBlockIndex *pindex)
     }
 }
 
-void AMQPNotificationInterface::SyncTransaction(const CTransaction &tx, const CBlock *pblock)
+void AMQPNotificationInterface::NotifyTransaction(const CNotification &notification)
 {
     for (std::list<AMQPAbstractNotifier*>::iterator i = notifiers.begin(); i != notifiers.end(); ) {
         AMQPAbstractNotifier *notifier = *i;
-        if (notifier->NotifyTransaction(tx)) {
+        if (notifier->NotifyTransaction(notification)) {
             i++;
         } else {
             notifier->Shutdown();
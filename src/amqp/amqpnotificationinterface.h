@@ -5,14 +5,15 @@
 #ifndef ZCASH_AMQP_AMQPNOTIFICATIONINTERFACE_H
 #define ZCASH_AMQP_AMQPNOTIFICATIONINTERFACE_H
 
-#include "validationinterface.h"
+#include "notificationdispatcher.h"
+
+#include <list>
 #include <string>
 #include <map>
 
-class CBlockIndex;
 class AMQPAbstractNotifier;
 
-class AMQPNotificationInterface : public CValidationInterface
+class AMQPNotificationInterface : public CNotificationSink
 {
 public:
     virtual ~AMQPNotificationInterface();
@@ -23,14 +24,18 @@ protected:
     bool Initialize();
     void Shutdown();
 
-    // CValidationInterface
-    void SyncTransaction(const CTransaction &tx, const CBlock *pblock);
-    void UpdatedBlockTip(const CBlockIndex *pindex);
+    // CNotificationSink
+    std::string GetNotificationSinkName() const override { return "amqp"; }
+    bool WantsRawTransactions() const override { return fRawTransactions; }
+    void NotifyTransaction(const CNotification &notification) override;
+    void NotifyBlock(const CNotification &notification) override;
 
 private:
     AMQPNotificationInterface();
 
     std::list<AMQPAbstractNotifier*> notifiers;
+    //! Set once at creation, as the notifiers are dropped by the publishing thread when they fail
+    bool fRawTransactions;
 };
 
 #endif // ZCASH_AMQP_AMQPNOTIFICATIONINTERFACE_H
@@ -3,7 +3,7 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "amqppublishnotifier.h"
-#include "main.h"
+#include "notificationdispatcher.h"
 #include "util.h"
 
 #include "amqpsender.h"
@@ -128,9 +128,9 @@ bool AMQPAbstractPublishNotifier::SendMessage(const char *command, const void* d
     return true;
 }
 
-bool AMQPPublishHashBlockNotifier::NotifyBlock(const CBlockIndex *pindex)
+bool AMQPPublishHashBlockNotifier::NotifyBlock(const CNotification &notification)
 {
-    uint256 hash = pindex->GetBlockHash();
+    const uint256& hash = notification.hash;
     LogPrint("amqp", "amqp: Publish hashblock %s\n", hash.GetHex());
     char data[32];
     for (unsigned int i = 0; i < 32; i++)
@@ -138,9 +138,9 @@ bool AMQPPublishHashBlockNotifier::NotifyBlock(const CBlockIndex *pindex)
     return SendMessage(MSG_HASHBLOCK, data, 32);
 }
 
-bool AMQPPublishHashTransactionNotifier::NotifyTransaction(const CTransaction &transaction)
+bool AMQPPublishHashTransactionNotifier::NotifyTransaction(const CNotification &notification)
 {
-    uint256 hash = transaction.GetHash();
+    const uint256& hash = notification.hash;
     LogPrint("amqp", "amqp: Publish hashtx %s\n", hash.GetHex());
     char data[32];
     for (unsigned int i = 0; i < 32; i++)
@@ -148,30 +148,25 @@ bool AMQPPublishHashTransactionNotifier::NotifyTransaction(const CTransaction &t
     return SendMessage(MSG_HASHTX, data, 32);
 }
 
-bool AMQPPublishRawBlockNotifier::NotifyBlock(const CBlockIndex *pindex)
+bool AMQPPublishRawBlockNotifier::NotifyBlock(const CNotification &notification)
 {
-    LogPrint("amqp", "amqp: Publish rawblock %s\n", pindex->GetBlockHash().GetHex());
-
-    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
-    {
-        LOCK(cs_main);
-        CBlock block;
-        if(!ReadBlockFromDisk(block, pindex)) {
-            LogPrint("amqp", "amqp: Can't read block from disk\n");
-            return false;
-        }
+    LogPrint("amqp", "amqp: Publish rawblock %s\n", notification.hash.GetHex());
 
-        ss << block;
+    const std::vector<unsigned char>* raw = notification.GetRaw();
+    if (!raw) {
+        LogPrint("amqp", "amqp: Can't read block from disk\n");
+        return false;
     }
 
-    return SendMessage(MSG_RAWBLOCK, &(*ss.begin()), ss.size());
+    return SendMessage(MSG_RAWBLOCK, raw->data(), raw->size());
 }
 
-bool AMQPPublishRawTransactionNotifier::NotifyTransaction(const CTransaction &transaction)
+bool AMQPPublishRawTransactionNotifier::NotifyTransaction(const CNotification &notification)
 {
-    uint256 hash = transaction.GetHash();
-    LogPrint("amqp", "amqp: Publish rawtx %s\n", hash.GetHex());
-    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
-    ss << transaction;
-    return SendMessage(MSG_RAWTX, &(*ss.begin()), ss.size());
+    LogPrint("amqp", "amqp: Publish rawtx %s\n", notification.hash.GetHex());
+
+    // serialized by the dispatcher, as this notifier wants raw transactions
+    const std::vector<unsigned char>* raw = notification.GetRaw();
+    assert(raw);
+    return SendMessage(MSG_RAWTX, raw->data(), raw->size());
 }
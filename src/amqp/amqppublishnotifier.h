@@ -12,7 +12,6 @@
 #include <memory>
 #include <thread>
 
-class CBlockIndex;
 
 class AMQPAbstractPublishNotifier : public AMQPAbstractNotifier
 {
@@ -32,25 +31,25 @@ public:
 class AMQPPublishHashBlockNotifier : public AMQPAbstractPublishNotifier
 {
 public:
-    bool NotifyBlock(const CBlockIndex *pindex);
+    bool NotifyBlock(const CNotification &notification);
 };
 
 class AMQPPublishHashTransactionNotifier : public AMQPAbstractPublishNotifier
 {
 public:
-    bool NotifyTransaction(const CTransaction &transaction);
+    bool NotifyTransaction(const CNotification &notification);
 };
 
 class AMQPPublishRawBlockNotifier : public AMQPAbstractPublishNotifier
 {
 public:
-    bool NotifyBlock(const CBlockIndex *pindex);
+    bool NotifyBlock(const CNotification &notification);
 };
 
 class AMQPPublishRawTransactionNotifier : public AMQPAbstractPublishNotifier
 {
 public:
-    bool NotifyTransaction(const CTransaction &transaction);
+    bool NotifyTransaction(const CNotification &notification);
 };
 
 #endif // ZCASH_AMQP_AMQPPUBLISHNOTIFIER_H
@@ -24,6 +24,12 @@ std::map<OperationStatus, std::string> OperationStatusMap = {
     {OperationStatus::SUCCESS, "success"}
 };
 
+std::map<OperationPriority, std::string> OperationPriorityMap = {
+    {OperationPriority::HIGH, "high"},
+    {OperationPriority::NORMAL, "normal"},
+    {OperationPriority::LOW, "low"}
+};
+
 /**
  * Every operation instance should have a globally unique id
  */
@@ -32,11 +38,14 @@ AsyncRPCOperation::AsyncRPCOperation() : error_code_(0), error_message_() {
     boost::uuids::uuid uuid = uuidgen();
     id_ = "opid-" + boost::uuids::to_string(uuid);
     creation_time_ = (int64_t)time(NULL);
+    queued_time_ = std::chrono::system_clock::now();
     set_state(OperationStatus::READY);
+    set_priority(OperationPriority::NORMAL);
 }
 
 AsyncRPCOperation::AsyncRPCOperation(const AsyncRPCOperation& o) :
         id_(o.id_), creation_time_(o.creation_time_), state_(o.state_.load()),
+        priority_(o.priority_.load()), queued_time_(o.queued_time_),
         start_time_(o.start_time_), end_time_(o.end_time_),
         error_code_(o.error_code_), error_message_(o.error_message_),
         result_(o.result_)
@@ -47,6 +56,8 @@ AsyncRPCOperation& AsyncRPCOperation::operator=( const AsyncRPCOperation& other
     this->id_ = other.id_;
     this->creation_time_ = other.creation_time_;
     this->state_.store(other.state_.load());
+    this->priority_.store(other.priority_.load());
+    this->queued_time_ = other.queued_time_;
     this->start_time_ = other.start_time_;
     this->end_time_ = other.end_time_;
     this->error_code_ = other.error_code_;
@@ -154,6 +165,7 @@ UniValue AsyncRPCOperation::getStatus() const {
     UniValue obj(UniValue::VOBJ);
     obj.pushKV("id", this->id_);
     obj.pushKV("status", OperationStatusMap[status]);
+    obj.pushKV("priority", getPriorityAsString());
     obj.pushKV("creation_time", this->creation_time_);
     // TODO: Issue #1354: There may be other useful metadata to return to the user.
     UniValue err = this->getError();
@@ -163,11 +175,22 @@ UniValue AsyncRPCOperation::getStatus() const {
     UniValue result = this->getResult();
     if (!result.isNull()) {
         obj.pushKV("result", result);
+    }
 
-        // Include execution time for successful operation
-        std::chrono::duration<double> elapsed_seconds = end_time_ - start_time_;
-        obj.pushKV("execution_secs", elapsed_seconds.count());
-
+    // Include the time spent waiting in the queue and, once started, the execution time so far
+    std::chrono::time_point<std::chrono::system_clock> now = std::chrono::system_clock::now();
+    {
+        std::lock_guard<std::mutex> guard(lock_);
+        const bool started = start_time_.time_since_epoch().count() != 0;
+        const bool stopped = end_time_.time_since_epoch().count() != 0;
+        std::chrono::duration<double> queued_seconds = (started ? start_time_ : now) - queued_time_;
+        if (status != OperationStatus::CANCELLED || started) {
+            obj.pushKV("queued_secs", queued_seconds.count());
+        }
+        if (started) {
+            std::chrono::duration<double> elapsed_seconds = (stopped ? end_time_ : now) - start_time_;
+            obj.pushKV("execution_secs", elapsed_seconds.count());
+        }
     }
     return obj;
 }
@@ -179,3 +202,11 @@ std::string AsyncRPCOperation::getStateAsString() const {
     OperationStatus status = this->getState();
     return OperationStatusMap[status];
 }
+
+/**
+ * Return the priority class in human readable form.
+ */
+std::string AsyncRPCOperation::getPriorityAsString() const {
+    OperationPriority priority = this->getPriority();
+    return OperationPriorityMap[priority];
+}
@@ -37,6 +37,13 @@ typedef enum class operationStateEnum {
     SUCCESS
 } OperationStatus;
 
+// The queue runs the operations of a higher priority class first, in the order they were added
+typedef enum class operationPriorityEnum {
+    HIGH = 0,
+    NORMAL,
+    LOW
+} OperationPriority;
+
 class AsyncRPCOperation {
 public:
     AsyncRPCOperation();
@@ -62,6 +69,15 @@ public:
         return creation_time_;
     }
 
+    OperationPriority getPriority() const {
+        return priority_.load();
+    }
+
+    // Set by the creator of the operation before it is added to the queue
+    void set_priority(OperationPriority priority) {
+        this->priority_.store(priority);
+    }
+
     // Override this method to add data to the default status object.
     virtual UniValue getStatus() const;
 
@@ -70,6 +86,8 @@ public:
     UniValue getResult() const;
 
     std::string getStateAsString() const;
+
+    std::string getPriorityAsString() const;
     
     int getErrorCode() const {
         std::lock_guard<std::mutex> guard(lock_);
@@ -114,7 +132,8 @@ protected:
     int error_code_;
     std::string error_message_;
     std::atomic<OperationStatus> state_;
-    std::chrono::time_point<std::chrono::system_clock> start_time_, end_time_;  
+    std::atomic<OperationPriority> priority_;
+    std::chrono::time_point<std::chrono::system_clock> queued_time_, start_time_, end_time_;
 
     void start_execution_clock();
     void stop_execution_clock();
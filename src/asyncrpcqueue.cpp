@@ -15,7 +15,7 @@ shared_ptr<AsyncRPCQueue> AsyncRPCQueue::sharedInstance() {
     return q;
 }
 
-AsyncRPCQueue::AsyncRPCQueue() : closed_(false), finish_(false) {
+AsyncRPCQueue::AsyncRPCQueue() : closed_(false), finish_(false), sequence_(0), idle_workers_(0), max_workers_(0) {
 }
 
 AsyncRPCQueue::~AsyncRPCQueue() {
@@ -32,9 +32,11 @@ void AsyncRPCQueue::run(size_t workerId) {
         std::shared_ptr<AsyncRPCOperation> operation;
         {
             std::unique_lock<std::mutex> guard(lock_);
+            ++idle_workers_;
             while (operation_id_queue_.empty() && !isClosed() && !isFinishing()) {
                 this->condition_.wait(guard);
             }
+            --idle_workers_;
 
             // Exit if the queue is empty and we are finishing up
             if (isFinishing() && operation_id_queue_.empty()) {
@@ -49,8 +51,8 @@ void AsyncRPCQueue::run(size_t workerId) {
                 break;
             }
 
-            // Get operation id
-            key = operation_id_queue_.front();
+            // Get the id of the oldest operation of the highest priority
+            key = operation_id_queue_.top().id;
             operation_id_queue_.pop();
 
             // Search operation map
@@ -91,7 +93,12 @@ void AsyncRPCQueue::addOperation(const std::shared_ptr<AsyncRPCOperation> &ptrOp
 
     AsyncRPCOperationId id = ptrOperation->getId();
     operation_map_.emplace(id, ptrOperation);
-    operation_id_queue_.push(id);
+    operation_id_queue_.push({ptrOperation->getPriority(), sequence_++, id});
+
+    // Spawn another worker if the operations waiting outnumber the idle workers
+    if (operation_id_queue_.size() > idle_workers_ && workers_.size() < max_workers_) {
+        add_worker_locked();
+    }
     this->condition_.notify_one();
 }
 
@@ -176,9 +183,27 @@ size_t AsyncRPCQueue::getOperationCount() const {
  */
 void AsyncRPCQueue::addWorker() {
     std::lock_guard<std::mutex> guard(lock_);
+    add_worker_locked();
+}
+
+void AsyncRPCQueue::add_worker_locked() {
     workers_.emplace_back( std::thread(&AsyncRPCQueue::run, this, ++workerCounter) );
 }
 
+/**
+ * Set the number of workers the queue may grow to when operations are waiting.
+ * Workers spawned are kept until the queue is closed.
+ */
+void AsyncRPCQueue::setMaxWorkers(size_t n) {
+    std::lock_guard<std::mutex> guard(lock_);
+    max_workers_ = n;
+}
+
+size_t AsyncRPCQueue::getMaxWorkers() const {
+    std::lock_guard<std::mutex> guard(lock_);
+    return max_workers_;
+}
+
 /**
  * Return the number of worker threads spawned by the queue
  */
@@ -219,7 +244,8 @@ void AsyncRPCQueue::finishAndWait() {
  * Block current thread until all operations are finished or the queue has closed.
  */
 void AsyncRPCQueue::wait_for_worker_threads() {
-    // Notify any workers who are waiting, so they see the updated queue state
+    // Notify any workers who are waiting, so they see the updated queue state.
+    // Once the queue is closed or finishing, addOperation() no longer spawns workers.
     {
         std::lock_guard<std::mutex> guard(lock_);
         this->condition_.notify_all();
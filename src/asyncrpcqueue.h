@@ -21,6 +21,21 @@
 
 typedef std::unordered_map<AsyncRPCOperationId, std::shared_ptr<AsyncRPCOperation> > AsyncRPCOperationMap; 
 
+// An operation id waiting in the queue, with the priority of the operation and the order it was added in
+struct AsyncRPCQueueEntry {
+    OperationPriority priority;
+    uint64_t sequence;
+    AsyncRPCOperationId id;
+
+    // std::priority_queue pops the greatest entry: the highest priority, then the oldest
+    bool operator<(const AsyncRPCQueueEntry& other) const {
+        if (priority != other.priority) {
+            return priority > other.priority;
+        }
+        return sequence > other.sequence;
+    }
+};
+
 
 class AsyncRPCQueue {
 public:
@@ -37,6 +52,8 @@ public:
 
     void addWorker();
     size_t getNumberOfWorkers() const;
+    void setMaxWorkers(size_t n); // addOperation() spawns workers up to this number while operations wait
+    size_t getMaxWorkers() const;
     bool isClosed() const;
     bool isFinishing() const;
     void close(); // close queue and cancel all operations
@@ -61,8 +78,13 @@ private:
     std::atomic<bool> closed_;
     std::atomic<bool> finish_;
     AsyncRPCOperationMap operation_map_;
-    std::queue <AsyncRPCOperationId> operation_id_queue_;
+    std::priority_queue <AsyncRPCQueueEntry> operation_id_queue_;
+    uint64_t sequence_;
     std::vector<std::thread> workers_;
+    size_t idle_workers_;
+    size_t max_workers_;
+
+    void add_worker_locked();
 };
 
 #endif
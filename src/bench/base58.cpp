@@ -0,0 +1,40 @@
+// Copyright (c) 2016 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "base58.h"
+
+static const std::vector<unsigned char> BASE58_INPUT = {
+    0x20, 0x89, 0x50, 0xba, 0x2a, 0x05, 0x96, 0x7b, 0x4e, 0x1e, 0x02, 0xe0, 0x93, 0x50, 0x7e, 0x57,
+    0x12, 0xb9, 0x18, 0x99, 0x40, 0x1d, 0x33, 0xc6, 0x4a, 0xd6, 0x14, 0xd3, 0x2b, 0x28, 0x37, 0x5a
+};
+
+static void Base58Encode(benchmark::State& state)
+{
+    while (state.KeepRunning()) {
+        EncodeBase58(BASE58_INPUT);
+    }
+}
+
+static void Base58CheckEncode(benchmark::State& state)
+{
+    while (state.KeepRunning()) {
+        EncodeBase58Check(BASE58_INPUT);
+    }
+}
+
+static void Base58Decode(benchmark::State& state)
+{
+    const std::string encoded = EncodeBase58(BASE58_INPUT);
+    std::vector<unsigned char> vch;
+    while (state.KeepRunning()) {
+        bool fDecoded = DecodeBase58(encoded, vch);
+        assert(fDecoded);
+    }
+}
+
+BENCHMARK(Base58Encode);
+BENCHMARK(Base58CheckEncode);
+BENCHMARK(Base58Decode);
@@ -0,0 +1,136 @@
+// Copyright (c) 2015-2016 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "tinyformat.h"
+#include "utilstrencodings.h"
+
+#include <algorithm>
+#include <iostream>
+#include <regex>
+#include <stdexcept>
+
+namespace benchmark {
+
+namespace {
+
+double Median(std::vector<double> values)
+{
+    std::sort(values.begin(), values.end());
+    const size_t n = values.size();
+    return n % 2 ? values[n / 2] : (values[n / 2 - 1] + values[n / 2]) / 2;
+}
+
+//! An epoch never runs more than this many iterations, however fast the benchmark is
+const uint64_t MAX_ITERATIONS_PER_EPOCH = 1ULL << 32;
+
+Result Run(const std::string& name, const BenchFunction& func, const Options& options)
+{
+    const double epochTimeNs = options.epochTimeMs * 1e6;
+
+    // Warm up and calibrate: double the iterations until an epoch is long enough, then scale
+    uint64_t nIterations = 1;
+    for (;;) {
+        State state(nIterations);
+        func(state);
+        const double elapsed = state.ElapsedNanoseconds();
+        if (elapsed >= epochTimeNs || nIterations >= MAX_ITERATIONS_PER_EPOCH)
+            break;
+        if (elapsed * 10 >= epochTimeNs) {
+            nIterations = std::max<uint64_t>(nIterations + 1, nIterations * epochTimeNs / elapsed);
+            break;
+        }
+        nIterations *= 2;
+    }
+
+    std::vector<double> perIteration;
+    for (int i = 0; i < options.nEpochs; ++i) {
+        State state(nIterations);
+        func(state);
+        perIteration.push_back(state.ElapsedNanoseconds() / nIterations);
+    }
+
+    Result result;
+    result.name = name;
+    result.nIterationsPerEpoch = nIterations;
+    result.median = Median(perIteration);
+    result.min = *std::min_element(perIteration.begin(), perIteration.end());
+    result.max = *std::max_element(perIteration.begin(), perIteration.end());
+    std::vector<double> deviations;
+    for (double value : perIteration)
+        deviations.push_back(std::abs(value - result.median));
+    result.err = result.median > 0 ? Median(deviations) / result.median : 0;
+    return result;
+}
+
+std::string CsvField(const std::string& str)
+{
+    return str.find_first_of(",\"") == std::string::npos ? str : "\"" + str + "\"";
+}
+
+}
+
+BenchRunner::BenchmarkMap& BenchRunner::benchmarks()
+{
+    static BenchmarkMap benchmarks_map;
+    return benchmarks_map;
+}
+
+BenchRunner::BenchRunner(const std::string& name, BenchFunction func)
+{
+    benchmarks().insert(std::make_pair(name, func));
+}
+
+bool BenchRunner::RunAll(const Options& options)
+{
+    std::regex reFilter(options.filter.empty() ? ".*" : options.filter);
+
+    std::vector<Result> results;
+    bool fSuccess = true;
+    for (const auto& p : benchmarks()) {
+        if (!std::regex_search(p.first, reFilter))
+            continue;
+        if (options.fList) {
+            std::cout << p.first << std::endl;
+            continue;
+        }
+        try {
+            results.push_back(Run(p.first, p.second, options));
+        } catch (const std::exception& e) {
+            std::cerr << strprintf("%s: %s", p.first, e.what()) << std::endl;
+            fSuccess = false;
+        }
+    }
+
+    if (!options.fList)
+        PrintResults(results, options.printer);
+    return fSuccess;
+}
+
+void PrintResults(const std::vector<Result>& results, const std::string& printer)
+{
+    if (printer == "json") {
+        std::cout << "{\"benchmarks\":[";
+        for (size_t i = 0; i < results.size(); ++i) {
+            const Result& r = results[i];
+            std::cout << (i ? "," : "") << strprintf(
+                "\n {\"name\":\"%s\",\"iterations\":%u,\"median_ns\":%.3f,\"min_ns\":%.3f,\"max_ns\":%.3f,\"err\":%.5f}",
+                r.name, r.nIterationsPerEpoch, r.median, r.min, r.max, r.err);
+        }
+        std::cout << "\n]}" << std::endl;
+    } else if (printer == "csv") {
+        std::cout << "name,iterations,median_ns,min_ns,max_ns,err" << std::endl;
+        for (const Result& r : results)
+            std::cout << strprintf("%s,%u,%.3f,%.3f,%.3f,%.5f", CsvField(r.name), r.nIterationsPerEpoch,
+                                   r.median, r.min, r.max, r.err) << std::endl;
+    } else {
+        std::cout << strprintf("%15s | %15s | %7s | %12s | %s", "ns/op", "op/s", "err%", "iterations", "benchmark") << std::endl;
+        for (const Result& r : results)
+            std::cout << strprintf("%15.2f | %15.2f | %6.2f%% | %12u | %s", r.median,
+                                   r.median > 0 ? 1e9 / r.median : 0, r.err * 100, r.nIterationsPerEpoch, r.name) << std::endl;
+    }
+}
+
+}
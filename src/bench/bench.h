@@ -0,0 +1,109 @@
+// Copyright (c) 2015-2016 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_BENCH_BENCH_H
+#define BITCOIN_BENCH_BENCH_H
+
+#include <chrono>
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <boost/preprocessor/cat.hpp>
+#include <boost/preprocessor/stringize.hpp>
+
+/*
+ * Usage:
+
+static void CODE_TO_TIME(benchmark::State& state)
+{
+    ... do any setup needed...
+    while (state.KeepRunning()) {
+       ... do stuff you want to time...
+    }
+    ... do any cleanup needed...
+}
+
+BENCHMARK(CODE_TO_TIME);
+
+ * The setup and the cleanup are not timed: the clock starts with the first call to KeepRunning and
+ * stops with the last one. The runner first finds how many iterations make an epoch last at least
+ * -epochtime milliseconds, then runs -epochs epochs of that many iterations and reports the median
+ * time per iteration, together with its spread.
+ */
+
+namespace benchmark {
+
+typedef std::chrono::steady_clock clock;
+
+class State
+{
+    uint64_t nIterations;
+    uint64_t nCount;
+    clock::time_point beginTime;
+    clock::time_point endTime;
+
+public:
+    explicit State(uint64_t nIterationsIn) : nIterations(nIterationsIn), nCount(0) {}
+
+    bool KeepRunning()
+    {
+        if (nCount == 0)
+            beginTime = clock::now();
+        if (nCount++ < nIterations)
+            return true;
+        endTime = clock::now();
+        return false;
+    }
+
+    uint64_t Iterations() const { return nIterations; }
+    //! Elapsed time of the whole run, valid once KeepRunning returned false
+    double ElapsedNanoseconds() const { return std::chrono::duration<double, std::nano>(endTime - beginTime).count(); }
+};
+
+typedef std::function<void(State&)> BenchFunction;
+
+/** What a benchmark measured over its epochs, in nanoseconds per iteration */
+struct Result
+{
+    std::string name;
+    uint64_t nIterationsPerEpoch = 0;
+    double median = 0;
+    double min = 0;
+    double max = 0;
+    //! Median absolute deviation of the epochs from the median, as a fraction of the median
+    double err = 0;
+};
+
+struct Options
+{
+    std::string filter;
+    std::string printer = "text";
+    int nEpochs = 11;
+    double epochTimeMs = 10;
+    bool fList = false;
+};
+
+class BenchRunner
+{
+    typedef std::map<std::string, BenchFunction> BenchmarkMap;
+    static BenchmarkMap& benchmarks();
+
+public:
+    BenchRunner(const std::string& name, BenchFunction func);
+
+    //! Run the benchmarks whose name matches the filter regex and print them. Returns whether all of them ran.
+    static bool RunAll(const Options& options);
+};
+
+void PrintResults(const std::vector<Result>& results, const std::string& printer);
+
+}
+
+// BENCHMARK(foo) expands to: benchmark::BenchRunner bench_11foo("foo", foo);
+#define BENCHMARK(n) \
+    benchmark::BenchRunner BOOST_PP_CAT(bench_, BOOST_PP_CAT(__LINE__, n))(BOOST_PP_STRINGIZE(n), n);
+
+#endif // BITCOIN_BENCH_BENCH_H
@@ -0,0 +1,57 @@
+// Copyright (c) 2015-2016 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "chainparams.h"
+#include "crypto/sha256.h"
+#include "key.h"
+#include "pubkey.h"
+#include "util.h"
+
+#include <iostream>
+
+static void PrintUsage()
+{
+    std::cout << "Usage: bench_zen [options]\n\n"
+              << "Options:\n"
+              << HelpMessageOpt("-?", "Print this help message and exit")
+              << HelpMessageOpt("-list", "List the benchmarks matching -filter without running them")
+              << HelpMessageOpt("-filter=<regex>", "Run only the benchmarks whose name matches the regular expression")
+              << HelpMessageOpt("-printer=<text|json|csv>", "Output format of the results (default: text)")
+              << HelpMessageOpt("-epochs=<n>", "Number of measured epochs of each benchmark (default: 11)")
+              << HelpMessageOpt("-epochtime=<ms>", "Minimum duration of an epoch, in milliseconds (default: 10)");
+}
+
+int main(int argc, char** argv)
+{
+    ParseParameters(argc, argv);
+    if (mapArgs.count("-?") || mapArgs.count("-h") || mapArgs.count("-help")) {
+        PrintUsage();
+        return 0;
+    }
+
+    benchmark::Options options;
+    options.filter = GetArg("-filter", "");
+    options.printer = GetArg("-printer", "text");
+    options.nEpochs = std::max(1, (int)GetArg("-epochs", options.nEpochs));
+    options.epochTimeMs = std::max<int64_t>(1, GetArg("-epochtime", (int64_t)options.epochTimeMs));
+    options.fList = GetBoolArg("-list", false);
+    if (options.printer != "text" && options.printer != "json" && options.printer != "csv") {
+        std::cerr << "Unknown -printer: " << options.printer << std::endl;
+        return 1;
+    }
+
+    SetupEnvironment();
+    fPrintToDebugLog = false;
+    SHA256AutoDetect();
+    ECC_Start();
+    ECCVerifyHandle verifyHandle;
+    SelectParams(CBaseChainParams::MAIN);
+
+    bool fSuccess = benchmark::BenchRunner::RunAll(options);
+
+    ECC_Stop();
+    return fSuccess ? 0 : 1;
+}
@@ -0,0 +1,31 @@
+// Copyright (c) 2016 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "bloom.h"
+#include "random.h"
+
+// Inserts and lookups of outpoint sized elements, as done when a filtered block is relayed
+static void BloomFilterInsertContains(benchmark::State& state)
+{
+    std::vector<std::vector<unsigned char>> elements;
+    for (int i = 0; i < 1000; ++i) {
+        const uint256 hash = GetRandHash();
+        elements.push_back(std::vector<unsigned char>(hash.begin(), hash.end()));
+        elements.back().push_back(i & 0xff);
+    }
+
+    while (state.KeepRunning()) {
+        CBloomFilter filter(elements.size(), 0.0001, 0, BLOOM_UPDATE_ALL);
+        for (const auto& element : elements)
+            filter.insert(element);
+        for (const auto& element : elements) {
+            bool fContains = filter.contains(element);
+            assert(fContains);
+        }
+    }
+}
+
+BENCHMARK(BloomFilterInsertContains);
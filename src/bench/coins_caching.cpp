@@ -0,0 +1,64 @@
+// Copyright (c) 2016 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "coins.h"
+#include "random.h"
+
+static const int N_COINS = 10000;
+
+static CMutableTransaction MakeTransaction(int i)
+{
+    CMutableTransaction mtx;
+    mtx.vin.resize(1);
+    mtx.vin[0].prevout = COutPoint(GetRandHash(), i);
+    mtx.addOut(CTxOut(i + 1, CScript() << OP_TRUE));
+    mtx.addOut(CTxOut(i + 2, CScript() << OP_TRUE));
+    return mtx;
+}
+
+static void FillCache(CCoinsViewCache& cache, std::vector<uint256>& hashes)
+{
+    for (int i = 0; i < N_COINS; ++i) {
+        const CTransaction tx(MakeTransaction(i));
+        *cache.ModifyCoins(tx.GetHash()) = CCoins(tx, 100);
+        hashes.push_back(tx.GetHash());
+    }
+}
+
+// Lookups of coins held by the cache, as done by the input checks of a block
+static void CCoinsCaching_AccessCoins(benchmark::State& state)
+{
+    CCoinsView base;
+    CCoinsViewCache cache(&base);
+    std::vector<uint256> hashes;
+    FillCache(cache, hashes);
+
+    size_t i = 0;
+    while (state.KeepRunning()) {
+        const CCoins* coins = cache.AccessCoins(hashes[i++ % hashes.size()]);
+        assert(coins != nullptr);
+    }
+}
+
+// Updates of a block worth of coins in a child cache, flushed into its parent
+static void CCoinsCaching_Flush(benchmark::State& state)
+{
+    CCoinsView base;
+    CCoinsViewCache parent(&base);
+    std::vector<uint256> hashes;
+    FillCache(parent, hashes);
+
+    size_t i = 0;
+    while (state.KeepRunning()) {
+        CCoinsViewCache child(&parent);
+        for (int n = 0; n < 1000; ++n)
+            child.ModifyCoins(hashes[i++ % hashes.size()])->nHeight++;
+        child.Flush();
+    }
+}
+
+BENCHMARK(CCoinsCaching_AccessCoins);
+BENCHMARK(CCoinsCaching_Flush);
@@ -0,0 +1,103 @@
+// Copyright (c) 2016 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "crypto/sha256.h"
+#include "hash.h"
+#include "primitives/block.h"
+#include "random.h"
+#include "saltedhasher.h"
+
+#include <boost/unordered_map.hpp>
+
+static const uint64_t BUFFER_SIZE = 1000 * 1000;
+
+static void SHA256_1MB(benchmark::State& state)
+{
+    uint8_t hash[CSHA256::OUTPUT_SIZE];
+    std::vector<uint8_t> in(BUFFER_SIZE, 0);
+    while (state.KeepRunning())
+        CSHA256().Write(in.data(), in.size()).Finalize(hash);
+}
+
+static void SHA256_32b(benchmark::State& state)
+{
+    std::vector<uint8_t> in(32, 0);
+    while (state.KeepRunning())
+        CSHA256().Write(in.data(), in.size()).Finalize(in.data());
+}
+
+static void DoubleSHA256_64b(benchmark::State& state)
+{
+    const uint256 left = GetRandHash();
+    const uint256 right = GetRandHash();
+    while (state.KeepRunning())
+        Hash(BEGIN(left), END(left), BEGIN(right), END(right));
+}
+
+static std::vector<uint256> MakeLeaves(size_t nLeaves)
+{
+    std::vector<uint256> leaves;
+    for (size_t i = 0; i < nLeaves; ++i)
+        leaves.push_back(GetRandHash());
+    return leaves;
+}
+
+// Merkle root of the transactions and certificates of a block of 4000 entries
+static void MerkleRoot(benchmark::State& state)
+{
+    const std::vector<uint256> leaves = MakeLeaves(4000);
+    while (state.KeepRunning()) {
+        std::vector<uint256> tree = leaves;
+        CBlock::BuildMerkleTree(tree, leaves.size());
+    }
+}
+
+static void MerkleRootThreaded(benchmark::State& state)
+{
+    const std::vector<uint256> leaves = MakeLeaves(4000);
+    while (state.KeepRunning()) {
+        std::vector<uint256> tree = leaves;
+        CBlock::BuildMerkleTree(tree, leaves.size(), nullptr, 4);
+    }
+}
+
+static void SipHash_32b(benchmark::State& state)
+{
+    uint256 x;
+    uint64_t k1 = 0;
+    while (state.KeepRunning())
+        *((uint64_t*)x.begin()) = SipHashUint256(0, ++k1, x);
+}
+
+static void SipHash13_32b(benchmark::State& state)
+{
+    uint256 x;
+    uint64_t k1 = 0;
+    while (state.KeepRunning())
+        *((uint64_t*)x.begin()) = SipHash13Uint256(0, ++k1, x);
+}
+
+// Inserts and lookups in a map keyed by hashes, as the coins and block index maps are
+static void SaltedHasherMap(benchmark::State& state)
+{
+    const std::vector<uint256> keys = MakeLeaves(10000);
+    while (state.KeepRunning()) {
+        boost::unordered_map<uint256, int, CSaltedUint256Hasher> map;
+        for (size_t i = 0; i < keys.size(); ++i)
+            map.emplace(keys[i], i);
+        for (const uint256& key : keys)
+            assert(map.count(key));
+    }
+}
+
+BENCHMARK(SHA256_1MB);
+BENCHMARK(SHA256_32b);
+BENCHMARK(DoubleSHA256_64b);
+BENCHMARK(MerkleRoot);
+BENCHMARK(MerkleRootThreaded);
+BENCHMARK(SipHash_32b);
+BENCHMARK(SipHash13_32b);
+BENCHMARK(SaltedHasherMap);
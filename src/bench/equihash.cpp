@@ -0,0 +1,21 @@
+// Copyright (c) 2016 The Zcash developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "chainparams.h"
+#include "pow.h"
+
+// Check of the solution of the mainnet genesis block
+static void EquihashCheckSolution(benchmark::State& state)
+{
+    const CChainParams& chainparams = Params(CBaseChainParams::MAIN);
+    const CBlockHeader header = chainparams.GenesisBlock().GetBlockHeader();
+    while (state.KeepRunning()) {
+        bool fValid = CheckEquihashSolution(&header, chainparams);
+        assert(fValid);
+    }
+}
+
+BENCHMARK(EquihashCheckSolution);
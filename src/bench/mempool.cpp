@@ -0,0 +1,64 @@
+// Copyright (c) 2011-2016 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "main.h"
+#include "random.h"
+#include "txmempool.h"
+
+static const int N_TXS = 1000;
+
+static std::vector<CTransaction> MakeTransactions()
+{
+    std::vector<CTransaction> txs;
+    for (int i = 0; i < N_TXS; ++i) {
+        CMutableTransaction mtx;
+        mtx.vin.resize(2);
+        mtx.vin[0].prevout = COutPoint(GetRandHash(), 0);
+        mtx.vin[1].prevout = COutPoint(GetRandHash(), 1);
+        mtx.addOut(CTxOut(10 * COIN, CScript() << OP_TRUE));
+        mtx.addOut(CTxOut(5 * COIN, CScript() << OP_TRUE));
+        txs.push_back(mtx);
+    }
+    return txs;
+}
+
+static void AddTransactions(CTxMemPool& pool, const std::vector<CTransaction>& txs)
+{
+    for (size_t i = 0; i < txs.size(); ++i)
+        pool.addUnchecked(txs[i].GetHash(), CTxMemPoolEntry(txs[i], 1000 + i, GetTime(), 0.0, 1));
+}
+
+// Fills the mempool with unrelated transactions and empties it again
+static void MempoolAddRemove(benchmark::State& state)
+{
+    const std::vector<CTransaction> txs = MakeTransactions();
+    CTxMemPool pool(::minRelayTxFee, DEFAULT_MAX_MEMPOOL_SIZE_MB * 1000000);
+
+    while (state.KeepRunning()) {
+        AddTransactions(pool, txs);
+        std::list<CTransaction> removedTxs;
+        std::list<CScCertificate> removedCerts;
+        for (const CTransaction& tx : txs)
+            pool.remove(tx, removedTxs, removedCerts);
+    }
+}
+
+// Selection of the transactions to evict to halve a full mempool, without evicting them
+static void MempoolTrimToSize(benchmark::State& state)
+{
+    const std::vector<CTransaction> txs = MakeTransactions();
+    CTxMemPool pool(::minRelayTxFee, DEFAULT_MAX_MEMPOOL_SIZE_MB * 1000000);
+    AddTransactions(pool, txs);
+    const size_t nHalfSize = pool.GetTotalSize() / 2;
+
+    while (state.KeepRunning()) {
+        bool fFits = pool.trimToSize(nullptr, nHalfSize, true);
+        assert(fFits);
+    }
+}
+
+BENCHMARK(MempoolAddRemove);
+BENCHMARK(MempoolTrimToSize);
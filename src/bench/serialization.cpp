@@ -0,0 +1,178 @@
+// Copyright (c) 2016 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "clientversion.h"
+#include "primitives/block.h"
+#include "primitives/certificate.h"
+#include "random.h"
+#include "sc/sidechain.h"
+#include "sc/sidechaintypes.h"
+#include "streams.h"
+
+static CBlock MakeBlock()
+{
+    CBlock block;
+    block.nVersion = BLOCK_VERSION_SC_SUPPORT;
+    for (int i = 0; i < 1000; ++i) {
+        CMutableTransaction mtx;
+        mtx.vin.resize(2);
+        mtx.vin[0].prevout = COutPoint(GetRandHash(), 0);
+        mtx.vin[0].scriptSig = CScript() << std::vector<unsigned char>(72, 1) << std::vector<unsigned char>(33, 2);
+        mtx.vin[1].prevout = COutPoint(GetRandHash(), 1);
+        mtx.vin[1].scriptSig = mtx.vin[0].scriptSig;
+        mtx.addOut(CTxOut(10 * COIN, CScript() << OP_DUP << OP_HASH160 << std::vector<unsigned char>(20, 3) << OP_EQUALVERIFY << OP_CHECKSIG));
+        mtx.addOut(CTxOut(5 * COIN, CScript() << OP_DUP << OP_HASH160 << std::vector<unsigned char>(20, 4) << OP_EQUALVERIFY << OP_CHECKSIG));
+        block.vtx.push_back(mtx);
+    }
+    return block;
+}
+
+static CScCertificate MakeCertificate()
+{
+    CMutableScCertificate mcert;
+    mcert.scId = GetRandHash();
+    mcert.epochNumber = 12;
+    mcert.quality = 3;
+    mcert.endEpochCumScTxCommTreeRoot = CFieldElement(std::vector<unsigned char>(CFieldElement::ByteSize(), 0));
+    mcert.scProof = CScProof(std::vector<unsigned char>(9000, 0xab));
+    mcert.vin.resize(1);
+    mcert.vin[0].prevout = COutPoint(GetRandHash(), 0);
+    const CScript script = CScript() << OP_DUP << OP_HASH160 << std::vector<unsigned char>(20, 3) << OP_EQUALVERIFY << OP_CHECKSIG;
+    mcert.addOut(CTxOut(COIN, script));
+    for (int i = 0; i < 100; ++i)
+        mcert.addBwt(CTxOut(COIN / 100, script));
+    return mcert;
+}
+
+static void SerializeBlock(benchmark::State& state)
+{
+    const CBlock block = MakeBlock();
+    CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+    stream.reserve(::GetSerializeSize(block, SER_NETWORK, PROTOCOL_VERSION));
+
+    while (state.KeepRunning()) {
+        stream << block;
+        stream.clear();
+    }
+}
+
+static void DeserializeBlock(benchmark::State& state)
+{
+    CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+    stream << MakeBlock();
+    const std::string data = stream.str();
+
+    while (state.KeepRunning()) {
+        CDataStream ss(data.data(), data.data() + data.size(), SER_NETWORK, PROTOCOL_VERSION);
+        CBlock block;
+        ss >> block;
+    }
+}
+
+static void SerializeCertificate(benchmark::State& state)
+{
+    const CScCertificate cert = MakeCertificate();
+    CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+
+    while (state.KeepRunning()) {
+        stream << cert;
+        stream.clear();
+    }
+}
+
+// Includes the hash computation done when a certificate is built
+static void DeserializeCertificate(benchmark::State& state)
+{
+    CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+    stream << MakeCertificate();
+    const std::string data = stream.str();
+
+    while (state.KeepRunning()) {
+        CDataStream ss(data.data(), data.data() + data.size(), SER_NETWORK, PROTOCOL_VERSION);
+        CScCertificate cert;
+        ss >> cert;
+    }
+}
+
+// Reading of a field element up to its conversion to the representation used by the cryptolib
+static void DeserializeFieldElement(benchmark::State& state)
+{
+    std::vector<unsigned char> bytes(CFieldElement::ByteSize(), 0);
+    bytes[0] = 0x7b;
+    CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+    stream << CFieldElement(bytes);
+    const std::string data = stream.str();
+
+    while (state.KeepRunning()) {
+        CDataStream ss(data.data(), data.data() + data.size(), SER_NETWORK, PROTOCOL_VERSION);
+        CFieldElement fe;
+        ss >> fe;
+        bool fValid = fe.GetFieldElement() != nullptr;
+        assert(fValid);
+    }
+}
+
+static CSidechain MakeSidechain()
+{
+    CSidechain sidechain;
+    sidechain.creationBlockHeight = 100;
+    sidechain.creationTxHash = GetRandHash();
+    sidechain.lastTopQualityCertHash = GetRandHash();
+    sidechain.fixedParams.version = 0;
+    sidechain.fixedParams.withdrawalEpochLength = 100;
+    for (int i = 0; i < 1000; ++i)
+        sidechain.mImmatureAmounts[200 + i] = (i + 1) * COIN;
+    return sidechain;
+}
+
+// The blocks and sidechains both ways, as they are written to and read back from the databases
+static void RoundTripBlock(benchmark::State& state)
+{
+    const CBlock block = MakeBlock();
+    CDataStream stream(SER_DISK, CLIENT_VERSION);
+
+    while (state.KeepRunning()) {
+        stream << block;
+        CBlock read;
+        stream >> read;
+    }
+}
+
+static void RoundTripSidechain(benchmark::State& state)
+{
+    const CSidechain sidechain = MakeSidechain();
+    CDataStream stream(SER_DISK, CLIENT_VERSION);
+
+    while (state.KeepRunning()) {
+        stream << sidechain;
+        CSidechain read;
+        stream >> read;
+    }
+}
+
+// A vector of hashes, read and written with a single copy
+static void RoundTripHashVector(benchmark::State& state)
+{
+    std::vector<uint256> vHashes;
+    for (int i = 0; i < 10000; ++i)
+        vHashes.push_back(GetRandHash());
+    CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+
+    while (state.KeepRunning()) {
+        stream << vHashes;
+        std::vector<uint256> read;
+        stream >> read;
+    }
+}
+
+BENCHMARK(SerializeBlock);
+BENCHMARK(DeserializeBlock);
+BENCHMARK(SerializeCertificate);
+BENCHMARK(DeserializeCertificate);
+BENCHMARK(DeserializeFieldElement);
+BENCHMARK(RoundTripBlock);
+BENCHMARK(RoundTripSidechain);
+BENCHMARK(RoundTripHashVector);
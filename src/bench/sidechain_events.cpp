@@ -0,0 +1,106 @@
+#include "bench.h"
+
+#include "arith_uint256.h"
+#include "coins.h"
+#include "primitives/certificate.h"
+#include "undo.h"
+
+#include <map>
+
+static const int N_SIDECHAINS = 500;
+static const int N_BWTS_PER_CERT = 100;
+static const int EVENTS_HEIGHT = 1000;
+
+// A coins db holding N_SIDECHAINS sidechains all maturing, or all ceasing with a certificate, at EVENTS_HEIGHT
+class CSidechainEventsView : public CCoinsView
+{
+    std::map<uint256, CSidechain> sidechains;
+    std::map<uint256, CCoins> certCoins;
+    CSidechainEvents scEvents;
+
+public:
+    explicit CSidechainEventsView(bool fCeasing)
+    {
+        for (int i = 0; i < N_SIDECHAINS; ++i) {
+            const uint256 scId = ArithToUint256(arith_uint256(i + 1));
+            CSidechain& sidechain = sidechains[scId];
+            sidechain.fixedParams.version = 0;
+            sidechain.fixedParams.withdrawalEpochLength = 100;
+            sidechain.mImmatureAmounts[EVENTS_HEIGHT] = (i + 1) * COIN;
+
+            if (!fCeasing) {
+                scEvents.maturingScs.insert(scId);
+                continue;
+            }
+
+            scEvents.ceasingScs.insert(scId);
+            sidechain.lastTopQualityCertHash = ArithToUint256(arith_uint256(N_SIDECHAINS + i + 1));
+            sidechain.lastTopQualityCertReferencedEpoch = 8;
+            CCoins& coins = certCoins[sidechain.lastTopQualityCertHash];
+            coins.nVersion = SC_CERT_VERSION;
+            coins.nHeight = EVENTS_HEIGHT - 50;
+            coins.nFirstBwtPos = 1;
+            coins.nBwtMaturityHeight = EVENTS_HEIGHT + 10;
+            coins.vout.push_back(CTxOut(COIN, CScript() << OP_TRUE));
+            for (int n = 0; n < N_BWTS_PER_CERT; ++n)
+                coins.vout.push_back(CTxOut(n + 1, CScript() << OP_TRUE));
+        }
+    }
+
+    bool GetCoins(const uint256& txid, CCoins& coins) const override
+    {
+        auto it = certCoins.find(txid);
+        if (it == certCoins.end())
+            return false;
+        coins = it->second;
+        return true;
+    }
+    bool HaveCoins(const uint256& txid) const override { return certCoins.count(txid); }
+    bool GetSidechain(const uint256& scId, CSidechain& info) const override
+    {
+        auto it = sidechains.find(scId);
+        if (it == sidechains.end())
+            return false;
+        info = it->second;
+        return true;
+    }
+    bool HaveSidechain(const uint256& scId) const override { return sidechains.count(scId); }
+    bool GetSidechainEvents(int height, CSidechainEvents& events) const override
+    {
+        if (height != EVENTS_HEIGHT)
+            return false;
+        events = scEvents;
+        return true;
+    }
+    bool HaveSidechainEvents(int height) const override { return height == EVENTS_HEIGHT; }
+};
+
+// The events of a block at an epoch boundary, handled by ConnectBlock in a view over the warmed up tip cache
+static void HandleSidechainEvents(benchmark::State& state, bool fCeasing, unsigned int nThreads)
+{
+    CSidechainEventsView db(fCeasing);
+    CCoinsViewCache tip(&db);
+    {
+        CCoinsViewCache warmup(&tip);
+        CBlockUndo blockUndo(IncludeScAttributes::ON);
+        warmup.HandleSidechainEvents(EVENTS_HEIGHT, blockUndo, nullptr);
+    }
+
+    while (state.KeepRunning()) {
+        CCoinsViewCache view(&tip);
+        CBlockUndo blockUndo(IncludeScAttributes::ON);
+        std::vector<CScCertificateStatusUpdateInfo> certsStateInfo;
+        view.HandleSidechainEvents(EVENTS_HEIGHT, blockUndo, &certsStateInfo, nThreads);
+        assert(blockUndo.scUndoDatabyScId.size() == N_SIDECHAINS);
+    }
+}
+
+static void SidechainEvents_Maturing500(benchmark::State& state) { HandleSidechainEvents(state, false, 1); }
+static void SidechainEvents_Maturing500_4Threads(benchmark::State& state) { HandleSidechainEvents(state, false, 4); }
+static void SidechainEvents_Ceasing500(benchmark::State& state) { HandleSidechainEvents(state, true, 1); }
+static void SidechainEvents_Ceasing500_4Threads(benchmark::State& state) { HandleSidechainEvents(state, true, 4); }
+
+BENCHMARK(SidechainEvents_Maturing500);
+BENCHMARK(SidechainEvents_Maturing500_4Threads);
+BENCHMARK(SidechainEvents_Ceasing500);
+BENCHMARK(SidechainEvents_Ceasing500_4Threads);
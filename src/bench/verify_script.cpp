@@ -0,0 +1,44 @@
+// Copyright (c) 2016 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "key.h"
+#include "keystore.h"
+#include "script/interpreter.h"
+#include "script/sign.h"
+#include "script/standard.h"
+
+// Verification of a P2PKH input, which is dominated by the ecdsa check of its signature
+static void VerifyScriptP2PKH(benchmark::State& state)
+{
+    CBasicKeyStore keystore;
+    CKey key;
+    key.MakeNewKey(true);
+    keystore.AddKey(key);
+
+    CMutableTransaction txCredit;
+    txCredit.vin.resize(1);
+    txCredit.vin[0].scriptSig = CScript() << OP_0 << OP_0;
+    txCredit.addOut(CTxOut(COIN, GetScriptForDestination(key.GetPubKey().GetID(), /*withCheckBlockAtHeight*/false)));
+    const CTransaction creditTx(txCredit);
+
+    CMutableTransaction txSpend;
+    txSpend.vin.resize(1);
+    txSpend.vin[0].prevout = COutPoint(creditTx.GetHash(), 0);
+    txSpend.addOut(CTxOut(COIN, CScript() << OP_TRUE));
+    bool fSigned = SignSignature(keystore, creditTx, txSpend, 0);
+    assert(fSigned);
+
+    const MutableTransactionSignatureChecker checker(&txSpend, 0);
+    while (state.KeepRunning()) {
+        ScriptError err;
+        bool fSuccess = VerifyScript(txSpend.vin[0].scriptSig, creditTx.GetVout()[0].scriptPubKey,
+                                     SCRIPT_VERIFY_P2SH | SCRIPT_VERIFY_STRICTENC, checker, &err);
+        assert(err == SCRIPT_ERR_OK);
+        assert(fSuccess);
+    }
+}
+
+BENCHMARK(VerifyScriptP2PKH);
@@ -11,6 +11,7 @@
 #include "utilstrencodings.h"
 
 #include <boost/filesystem/operations.hpp>
+#include <iostream>
 #include <stdio.h>
 
 #include <event2/buffer.h>
@@ -22,6 +23,7 @@
 using namespace std;
 
 static const int DEFAULT_HTTP_CLIENT_TIMEOUT=900;
+static const int DEFAULT_BATCH_SIZE=100;
 
 std::string HelpMessageCli()
 {
@@ -39,6 +41,9 @@ std::string HelpMessageCli()
     strUsage += HelpMessageOpt("-rpcuser=<user>", _("Username for JSON-RPC connections"));
     strUsage += HelpMessageOpt("-rpcpassword=<pw>", _("Password for JSON-RPC connections"));
     strUsage += HelpMessageOpt("-rpcclienttimeout=<n>", strprintf(_("Timeout in seconds during HTTP requests, or 0 for no timeout. (default: %d)"), DEFAULT_HTTP_CLIENT_TIMEOUT));
+    strUsage += HelpMessageOpt("-batch", _("Read the commands from standard input, one per line with its params, and send them over one connection "
+                                           "as JSON-RPC batches, printing the replies in order. Params with blanks are quoted with ' or \""));
+    strUsage += HelpMessageOpt("-batchsize=<n>", strprintf(_("Commands sent per batch with -batch, which the server may run in parallel (default: %d)"), DEFAULT_BATCH_SIZE));
 
     return strUsage;
 }
@@ -68,13 +73,14 @@ static bool AppInitRPC(int argc, char* argv[])
     // Parameters
     //
     ParseParameters(argc, argv);
-    if (argc<2 || mapArgs.count("-?") || mapArgs.count("-h") || mapArgs.count("-help") || mapArgs.count("-version")) {
+    if ((argc<2 && !mapArgs.count("-batch")) || mapArgs.count("-?") || mapArgs.count("-h") || mapArgs.count("-help") || mapArgs.count("-version")) {
         std::string strUsage = _("Horizen RPC client version") + " " + FormatFullVersion() + "\n";
         if (!mapArgs.count("-version")) {
             strUsage += "\n" + _("Usage:") + "\n" +
                   "  zen-cli [options] <command> [params]  " + _("Send command to horizen") + "\n" +
                   "  zen-cli [options] help                " + _("List commands") + "\n" +
-                  "  zen-cli [options] help <command>      " + _("Get help for a command") + "\n";
+                  "  zen-cli [options] help <command>      " + _("Get help for a command") + "\n" +
+                  "  zen-cli [options] -batch < <file>     " + _("Send the commands read from standard input") + "\n";
 
             strUsage += "\n" + HelpMessageCli();
         } else {
@@ -111,11 +117,13 @@ static bool AppInitRPC(int argc, char* argv[])
 /** Reply structure for request_done to fill in */
 struct HTTPReply
 {
-    HTTPReply(): status(0), error(-1) {}
+    HTTPReply(): status(0), error(-1), base(NULL) {}
 
     int status;
     int error;
     std::string body;
+    //! The loop to break when done, as an idle kept alive connection does not let it end by itself
+    struct event_base* base;
 };
 
 const char *http_errorstring(int code)
@@ -149,6 +157,8 @@ static void http_request_done(struct evhttp_request *req, void *ctx)
          * error code will have been passed to http_error_cb.
          */
         reply->status = 0;
+        if (reply->base)
+            event_base_loopbreak(reply->base);
         return;
     }
 
@@ -163,6 +173,8 @@ static void http_request_done(struct evhttp_request *req, void *ctx)
             reply->body = std::string(data, size);
         evbuffer_drain(buf, size);
     }
+    if (reply->base)
+        event_base_loopbreak(reply->base);
 }
 
 #if LIBEVENT_VERSION_NUMBER >= 0x02010300
@@ -173,28 +185,40 @@ static void http_error_cb(enum evhttp_request_error err, void *ctx)
 }
 #endif
 
-UniValue CallRPC(const string& strMethod, const UniValue& params)
+/**
+ * A connection to the RPC server. With fKeepAlive it stays open across the requests posted on it,
+ * as the -batch mode sends all its commands on one.
+ */
+class CRPCConnection
+{
+public:
+    explicit CRPCConnection(bool fKeepAliveIn);
+
+    /** Post a JSON-RPC request, or a batch of them, and return the parsed reply */
+    UniValue Post(const std::string& strRequest);
+
+private:
+    const std::string host;
+    const bool fKeepAlive;
+    std::string strRPCUserColonPass;
+    // the connection is freed before its event base
+    raii_event_base base;
+    raii_evhttp_connection evcon;
+};
+
+CRPCConnection::CRPCConnection(bool fKeepAliveIn):
+    host(GetArg("-rpcconnect", "127.0.0.1")), fKeepAlive(fKeepAliveIn)
 {
-    std::string host = GetArg("-rpcconnect", "127.0.0.1");
     int port = GetArg("-rpcport", BaseParams().RPCPort());
 
     // Obtain event base
-    raii_event_base base = obtain_event_base();
+    base = obtain_event_base();
 
     // Synchronously look up hostname
-    raii_evhttp_connection evcon = obtain_evhttp_connection_base(base.get(), host, port);
+    evcon = obtain_evhttp_connection_base(base.get(), host, port);
     evhttp_connection_set_timeout(evcon.get(), GetArg("-rpcclienttimeout", DEFAULT_HTTP_CLIENT_TIMEOUT));
 
-    HTTPReply response;
-    raii_evhttp_request req = obtain_evhttp_request(http_request_done, (void*)&response);
-    if (req == NULL)
-        throw runtime_error("create http request failed");
-#if LIBEVENT_VERSION_NUMBER >= 0x02010300
-    evhttp_request_set_error_cb(req.get(), http_error_cb);
-#endif
-
     // Get credentials
-    std::string strRPCUserColonPass;
     if (mapArgs.count("-rpcpassword") == 0 || mapArgs["-rpcpassword"] == "") {
         // Try fall back to cookie-based authentication if no password is provided
         if (!GetAuthCookie(&strRPCUserColonPass)) {
@@ -207,15 +231,27 @@ UniValue CallRPC(const string& strMethod, const UniValue& params)
     } else {
         strRPCUserColonPass = mapArgs["-rpcuser"] + ":" + mapArgs["-rpcpassword"];
     }
+}
+
+UniValue CRPCConnection::Post(const std::string& strRequest)
+{
+    HTTPReply response;
+    response.base = base.get();
+    raii_evhttp_request req = obtain_evhttp_request(http_request_done, (void*)&response);
+    if (req == NULL)
+        throw runtime_error("create http request failed");
+#if LIBEVENT_VERSION_NUMBER >= 0x02010300
+    evhttp_request_set_error_cb(req.get(), http_error_cb);
+#endif
 
     struct evkeyvalq* output_headers = evhttp_request_get_output_headers(req.get());
     assert(output_headers);
     evhttp_add_header(output_headers, "Host", host.c_str());
-    evhttp_add_header(output_headers, "Connection", "close");
+    if (!fKeepAlive)
+        evhttp_add_header(output_headers, "Connection", "close");
     evhttp_add_header(output_headers, "Authorization", (std::string("Basic ") + EncodeBase64(strRPCUserColonPass)).c_str());
 
     // Attach request data
-    std::string strRequest = JSONRPCRequest(strMethod, params, 1);
     struct evbuffer* output_buffer = evhttp_request_get_output_buffer(req.get());
     assert(output_buffer);
     evbuffer_add(output_buffer, strRequest.data(), strRequest.size());
@@ -241,6 +277,13 @@ UniValue CallRPC(const string& strMethod, const UniValue& params)
     UniValue valReply(UniValue::VSTR);
     if (!valReply.read(response.body))
         throw runtime_error("couldn't parse reply from server");
+    return valReply;
+}
+
+UniValue CallRPC(const string& strMethod, const UniValue& params)
+{
+    CRPCConnection connection(false);
+    const UniValue valReply = connection.Post(JSONRPCRequest(strMethod, params, 1));
     const UniValue& reply = valReply.get_obj();
     if (reply.empty())
         throw runtime_error("expected reply to have result, error and id properties");
@@ -248,6 +291,174 @@ UniValue CallRPC(const string& strMethod, const UniValue& params)
     return reply;
 }
 
+/**
+ * The text to print for a reply, and the exit code it gives. With fWait a server in warmup is
+ * reported as a connection failure, to be retried.
+ */
+static int FormatReply(const UniValue& reply, bool fWait, std::string& strPrint)
+{
+    const UniValue& result = find_value(reply, "result");
+    const UniValue& error  = find_value(reply, "error");
+
+    if (!error.isNull()) {
+        // Error
+        int code = error["code"].get_int();
+        if (fWait && code == RPC_IN_WARMUP)
+            throw CConnectionFailed("server in warmup");
+        strPrint = "error: " + error.write();
+        if (error.isObject())
+        {
+            UniValue errCode = find_value(error, "code");
+            UniValue errMsg  = find_value(error, "message");
+            strPrint = errCode.isNull() ? "" : "error code: "+errCode.getValStr()+"\n";
+
+            if (errMsg.isStr())
+                strPrint += "error message:\n"+errMsg.get_str();
+        }
+        return abs(code);
+    }
+
+    // Result
+    if (result.isNull())
+        strPrint = "";
+    else if (result.isStr())
+        strPrint = result.get_str();
+    else
+        strPrint = result.write(2);
+    return 0;
+}
+
+/** Split a -batch line into the command and its params, at the blanks out of single or double quotes */
+static std::vector<std::string> SplitCommandLine(const std::string& strLine)
+{
+    std::vector<std::string> vArgs;
+    std::string strArg;
+    bool fInArg = false;
+    char chQuote = 0;
+    for (const char ch : strLine) {
+        if (chQuote) {
+            if (ch == chQuote)
+                chQuote = 0;
+            else
+                strArg += ch;
+        } else if (ch == '\'' || ch == '"') {
+            chQuote = ch;
+            fInArg = true;
+        } else if (isspace(static_cast<unsigned char>(ch))) {
+            if (fInArg)
+                vArgs.push_back(strArg);
+            strArg.clear();
+            fInArg = false;
+        } else {
+            strArg += ch;
+            fInArg = true;
+        }
+    }
+    if (chQuote)
+        throw runtime_error("unterminated quote");
+    if (fInArg)
+        vArgs.push_back(strArg);
+    return vArgs;
+}
+
+/** A -batch command, and what to print for it */
+struct CBatchCommand
+{
+    CBatchCommand(): fSent(false), nRet(0) {}
+
+    bool fSent;
+    int nRet;
+    std::string strPrint;
+};
+
+/**
+ * The -batch mode: the commands of stdin are sent -batchsize at a time, as JSON-RPC batches over
+ * one kept alive connection, and the replies of each batch are printed in the order of the commands
+ * before the next batch is read. The exit code is that of the first command failed.
+ */
+static int BatchCommandLineRPC()
+{
+    const bool fWait = GetBoolArg("-rpcwait", false);
+    const size_t nBatchSize = std::max<int64_t>(1, GetArg("-batchsize", DEFAULT_BATCH_SIZE));
+    CRPCConnection connection(true);
+
+    int nRet = 0;
+    int64_t nId = 0;
+    std::string strLine;
+    bool fEnd = false;
+    while (!fEnd) {
+        std::vector<CBatchCommand> vCommands;
+        UniValue requests(UniValue::VARR);
+        while (requests.size() < nBatchSize) {
+            if (!std::getline(std::cin, strLine)) {
+                fEnd = true;
+                break;
+            }
+            CBatchCommand command;
+            try {
+                const std::vector<std::string> vArgs = SplitCommandLine(strLine);
+                // Blank lines and comments
+                if (vArgs.empty() || vArgs[0][0] == '#')
+                    continue;
+                const std::vector<std::string> strParams(vArgs.begin() + 1, vArgs.end());
+                const UniValue params = RPCConvertValues(vArgs[0], strParams);
+                UniValue request(UniValue::VSTR);
+                if (!request.read(JSONRPCRequest(vArgs[0], params, nId + (int64_t)vCommands.size())))
+                    throw runtime_error("couldn't encode the request");
+                requests.push_back(request);
+                command.fSent = true;
+            }
+            catch (const std::exception& e) {
+                command.strPrint = string("error: ") + e.what();
+                command.nRet = EXIT_FAILURE;
+            }
+            vCommands.push_back(command);
+        }
+
+        if (!requests.empty()) {
+            // Execute and handle connection failures with -rpcwait, before anything of the batch is printed
+            do {
+                try {
+                    const UniValue replies = connection.Post(requests.write());
+                    if (!replies.isArray())
+                        throw runtime_error(strprintf("expected a batch reply from server, got %s", replies.write()));
+                    std::vector<bool> vReplied(vCommands.size(), false);
+                    for (size_t i = 0; i < replies.size(); i++) {
+                        const UniValue& reply = replies[i];
+                        const UniValue& id = find_value(reply, "id");
+                        if (!id.isNum() || id.get_int64() < nId || id.get_int64() >= nId + (int64_t)vCommands.size())
+                            throw runtime_error(strprintf("unexpected reply from server: %s", reply.write()));
+                        CBatchCommand& command = vCommands[id.get_int64() - nId];
+                        command.nRet = FormatReply(reply, fWait, command.strPrint);
+                        vReplied[id.get_int64() - nId] = true;
+                    }
+                    for (size_t i = 0; i < vCommands.size(); i++)
+                        if (vCommands[i].fSent && !vReplied[i])
+                            throw runtime_error("missing replies from server");
+                    // Connection succeeded, no need to retry.
+                    break;
+                }
+                catch (const CConnectionFailed&) {
+                    if (fWait)
+                        MilliSleep(1000);
+                    else
+                        throw;
+                }
+            } while (fWait);
+        }
+        nId += vCommands.size();
+
+        for (const CBatchCommand& command : vCommands) {
+            if (nRet == 0)
+                nRet = command.nRet;
+            if (command.strPrint != "")
+                fprintf((command.nRet == 0 ? stdout : stderr), "%s\n", command.strPrint.c_str());
+        }
+        fflush(stdout);
+    }
+    return nRet;
+}
+
 int CommandLineRPC(int argc, char *argv[])
 {
     string strPrint;
@@ -259,6 +470,12 @@ int CommandLineRPC(int argc, char *argv[])
             argv++;
         }
 
+        if (mapArgs.count("-batch")) {
+            if (argc > 1)
+                throw runtime_error("-batch reads the commands from standard input, no command is expected");
+            return BatchCommandLineRPC();
+        }
+
         // Method
         if (argc < 2)
             throw runtime_error("too few parameters");
@@ -275,34 +492,7 @@ int CommandLineRPC(int argc, char *argv[])
                 const UniValue reply = CallRPC(strMethod, params);
 
                 // Parse reply
-                const UniValue& result = find_value(reply, "result");
-                const UniValue& error  = find_value(reply, "error");
-
-                if (!error.isNull()) {
-                    // Error
-                    int code = error["code"].get_int();
-                    if (fWait && code == RPC_IN_WARMUP)
-                        throw CConnectionFailed("server in warmup");
-                    strPrint = "error: " + error.write();
-                    nRet = abs(code);
-                    if (error.isObject())
-                    {
-                        UniValue errCode = find_value(error, "code");
-                        UniValue errMsg  = find_value(error, "message");
-                        strPrint = errCode.isNull() ? "" : "error code: "+errCode.getValStr()+"\n";
-
-                        if (errMsg.isStr())
-                            strPrint += "error message:\n"+errMsg.get_str();
-                    }
-                } else {
-                    // Result
-                    if (result.isNull())
-                        strPrint = "";
-                    else if (result.isStr())
-                        strPrint = result.get_str();
-                    else
-                        strPrint = result.write(2);
-                }
+                nRet = FormatReply(reply, fWait, strPrint);
                 // Connection succeeded, no need to retry.
                 break;
             }
@@ -0,0 +1,110 @@
+#include "blockcache.h"
+
+#include "core_memusage.h"
+#include "net.h"
+#include "primitives/block.h"
+
+CBlockCache blockCache(DEFAULT_BLOCK_CACHE_SIZE << 20);
+
+CBlockCache::CBlockCache(size_t nMaxUsageIn) : nMaxUsage(nMaxUsageIn), nUsage(0)
+{
+}
+
+CBlockCache::EntryList::iterator CBlockCache::Find(const uint256& hash)
+{
+    auto it = mapEntries.find(hash);
+    if (it == mapEntries.end())
+        return entries.end();
+    entries.splice(entries.begin(), entries, it->second);
+    return it->second;
+}
+
+void CBlockCache::Trim()
+{
+    while (nUsage > nMaxUsage && !entries.empty()) {
+        const CEntry& entry = entries.back();
+        nUsage -= entry.nBlockUsage;
+        for (const auto& message : entry.vMessages)
+            nUsage -= message.second->size();
+        mapEntries.erase(entry.hash);
+        entries.pop_back();
+    }
+}
+
+std::shared_ptr<const CBlock> CBlockCache::Get(const uint256& hash)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = Find(hash);
+    return it != entries.end() ? it->block : nullptr;
+}
+
+void CBlockCache::Insert(const std::shared_ptr<const CBlock>& block)
+{
+    const uint256 hash = block->GetHash();
+    const size_t nBlockUsage = sizeof(CBlock) + RecursiveDynamicUsage(*block);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    if (Find(hash) != entries.end() || nBlockUsage > nMaxUsage)
+        return;
+    entries.push_front(CEntry{hash, block, nBlockUsage, {}});
+    mapEntries[hash] = entries.begin();
+    nUsage += nBlockUsage;
+    Trim();
+}
+
+std::shared_ptr<const CSerializeData> CBlockCache::GetMessage(const uint256& hash, int nVersion)
+{
+    std::shared_ptr<const CBlock> block;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = Find(hash);
+        if (it == entries.end())
+            return nullptr;
+        for (const auto& message : it->vMessages)
+            if (message.first == nVersion)
+                return message.second;
+        block = it->block;
+    }
+
+    // serialized without holding the lock, the message of a concurrent caller is kept if any
+    std::shared_ptr<const CSerializeData> msg = CNode::SerializeMessage(nVersion, NetMsgType::BLOCK, *block);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = Find(hash);
+    if (it == entries.end())
+        return msg;
+    for (const auto& message : it->vMessages)
+        if (message.first == nVersion)
+            return message.second;
+    it->vMessages.emplace_back(nVersion, msg);
+    nUsage += msg->size();
+    Trim();
+    return msg;
+}
+
+void CBlockCache::SetMaxUsage(size_t nMaxUsageIn)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    nMaxUsage = nMaxUsageIn;
+    Trim();
+}
+
+void CBlockCache::Clear()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    entries.clear();
+    mapEntries.clear();
+    nUsage = 0;
+}
+
+size_t CBlockCache::Size() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return entries.size();
+}
+
+size_t CBlockCache::DynamicUsage() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return nUsage;
+}
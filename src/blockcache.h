@@ -0,0 +1,72 @@
+#ifndef BITCOIN_BLOCKCACHE_H
+#define BITCOIN_BLOCKCACHE_H
+
+#include "support/allocators/pooled.h"
+#include "uint256.h"
+
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdint.h>
+#include <utility>
+#include <vector>
+
+class CBlock;
+
+//! -blockcachesize default, in MiB
+static const int64_t DEFAULT_BLOCK_CACHE_SIZE = 32;
+
+/**
+ * The blocks last connected to the tip or read from disk, shared by the RPC, REST and websocket
+ * servers and by the peers asking for them, most of which do so at once when a new block lands.
+ * Along with each block the cache keeps its block message for the send versions of the peers it
+ * was sent to, serialized once for all of them. The memory used by the blocks and the messages is
+ * bounded, the least recently used blocks being dropped first.
+ */
+class CBlockCache
+{
+public:
+    explicit CBlockCache(size_t nMaxUsageIn);
+
+    //! The cached block with this hash, nullptr if it is not cached
+    std::shared_ptr<const CBlock> Get(const uint256& hash);
+    void Insert(const std::shared_ptr<const CBlock>& block);
+
+    /**
+     * The block message of a cached block for peers with send version nVersion, serialized the
+     * first time it is asked for; nullptr if the block is not cached.
+     */
+    std::shared_ptr<const CSerializeData> GetMessage(const uint256& hash, int nVersion);
+
+    void SetMaxUsage(size_t nMaxUsageIn);
+    void Clear();
+
+    size_t Size() const;
+    //! The memory used by the cached blocks and messages
+    size_t DynamicUsage() const;
+
+private:
+    struct CEntry
+    {
+        uint256 hash;
+        std::shared_ptr<const CBlock> block;
+        size_t nBlockUsage;
+        std::vector<std::pair<int, std::shared_ptr<const CSerializeData>>> vMessages;
+    };
+    typedef std::list<CEntry> EntryList;
+
+    mutable std::mutex mutex;
+    size_t nMaxUsage;
+    size_t nUsage;
+    //! Most recently used first
+    EntryList entries;
+    std::map<uint256, EntryList::iterator> mapEntries;
+
+    EntryList::iterator Find(const uint256& hash);
+    void Trim();
+};
+
+extern CBlockCache blockCache;
+
+#endif // BITCOIN_BLOCKCACHE_H
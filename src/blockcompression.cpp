@@ -0,0 +1,65 @@
+#if defined(HAVE_CONFIG_H)
+#include "config/bitcoin-config.h"
+#endif
+
+#include "blockcompression.h"
+
+#include "streams.h"
+
+#if ENABLE_ZSTD
+#include <zstd.h>
+#endif
+
+int nBlockCompressionLevel = DEFAULT_BLOCK_COMPRESSION_LEVEL;
+bool fCompressRelay = DEFAULT_COMPRESS_RELAY;
+
+bool IsCompressionSupported()
+{
+#if ENABLE_ZSTD
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool CompressData(const char* pbegin, const char* pend, int nLevel, CSerializeData& vOut)
+{
+#if ENABLE_ZSTD
+    vOut.resize(ZSTD_compressBound(pend - pbegin));
+    const size_t nSize = ZSTD_compress(vOut.data(), vOut.size(), pbegin, pend - pbegin, nLevel);
+    if (ZSTD_isError(nSize))
+        return false;
+    vOut.resize(nSize);
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool DecompressData(const char* pbegin, const char* pend, size_t nMaxSize, CSerializeData& vOut)
+{
+#if ENABLE_ZSTD
+    // the frames written by CompressData carry their decompressed size
+    const unsigned long long nContentSize = ZSTD_getFrameContentSize(pbegin, pend - pbegin);
+    if (nContentSize == ZSTD_CONTENTSIZE_UNKNOWN || nContentSize == ZSTD_CONTENTSIZE_ERROR || nContentSize > nMaxSize)
+        return false;
+    if (ZSTD_findFrameCompressedSize(pbegin, pend - pbegin) != (size_t)(pend - pbegin))
+        return false;
+    vOut.resize(nContentSize);
+    const size_t nSize = ZSTD_decompress(vOut.data(), vOut.size(), pbegin, pend - pbegin);
+    return !ZSTD_isError(nSize) && nSize == nContentSize;
+#else
+    return false;
+#endif
+}
+
+void ReadCompressedRecord(CAutoFile& file, unsigned int nSize, size_t nMaxSize, CSerializeData& vOut)
+{
+    // the records are only stored compressed when it makes them smaller
+    if (nSize > nMaxSize)
+        throw std::ios_base::failure("compressed record too large");
+    CSerializeData vFrame(nSize);
+    file.read(vFrame.data(), nSize);
+    if (!DecompressData(vFrame.data(), vFrame.data() + vFrame.size(), nMaxSize, vOut))
+        throw std::ios_base::failure(IsCompressionSupported() ? "invalid compressed record" : "compressed record, but not built with zstd");
+}
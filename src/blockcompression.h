@@ -0,0 +1,44 @@
+#ifndef BITCOIN_BLOCKCOMPRESSION_H
+#define BITCOIN_BLOCKCOMPRESSION_H
+
+#include "support/allocators/pooled.h"
+
+#include <stddef.h>
+
+class CAutoFile;
+
+//! -blockcompression default, the zstd level of the block and undo records written, 0 to store them raw
+static const int DEFAULT_BLOCK_COMPRESSION_LEVEL = 0;
+static const int MAX_BLOCK_COMPRESSION_LEVEL = 19;
+//! -compressrelay default
+static const bool DEFAULT_COMPRESS_RELAY = false;
+//! The zstd level of the blocks relayed to the peers which asked for them compressed, low for the latency
+static const int RELAY_COMPRESSION_LEVEL = 3;
+/**
+ * The bit of the size in the header of a block or undo record which tells that the record is a
+ * single zstd frame of the size in the other bits. The positions of the block index point to the
+ * frames as they point to the raw records, while the offsets of the txindex stay offsets in the
+ * decompressed block, so that the records of a file can be stored either way.
+ */
+static const unsigned int BLOCK_RECORD_COMPRESSED = 0x80000000;
+
+//! The level the records of the block and undo files are written at, 0 if raw
+extern int nBlockCompressionLevel;
+//! Whether blocks are relayed compressed to the whitelisted peers which ask for it
+extern bool fCompressRelay;
+
+//! Whether the node was built with zstd (--enable-zstd)
+bool IsCompressionSupported();
+
+//! Compresses the data as a single zstd frame. false if not built with zstd.
+bool CompressData(const char* pbegin, const char* pend, int nLevel, CSerializeData& vOut);
+//! false if the data are not a single zstd frame of at most nMaxSize bytes once decompressed
+bool DecompressData(const char* pbegin, const char* pend, size_t nMaxSize, CSerializeData& vOut);
+
+/**
+ * Reads the frame of a compressed record, whose size is nSize, from the position of file and
+ * decompresses it. Throws on I/O errors and on invalid frames.
+ */
+void ReadCompressedRecord(CAutoFile& file, unsigned int nSize, size_t nMaxSize, CSerializeData& vOut);
+
+#endif // BITCOIN_BLOCKCOMPRESSION_H
@@ -0,0 +1,187 @@
+// Copyright (c) 2016 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockencodings.h"
+#include "consensus/consensus.h"
+#include "crypto/sha256.h"
+#include "hash.h"
+#include "random.h"
+#include "streams.h"
+#include "txmempool.h"
+#include "util.h"
+
+#include <unordered_map>
+
+bool fFastBlockRelay = DEFAULT_FAST_BLOCK_RELAY;
+
+CBlockHeaderAndShortTxIDs::CBlockHeaderAndShortTxIDs(const CBlock& block) :
+        nonce(GetFastRandomContext().rand64()),
+        shorttxids(block.vtx.size() + block.vcert.size() - 1), prefilledtxn(1),
+        nCertificates(block.vcert.size()), header(block.GetBlockHeader())
+{
+    FillShortTxIDSelector();
+    //TODO: Use our mempool prior to block acceptance to predictively fill more than just the coinbase
+    prefilledtxn[0] = {0, block.vtx[0]};
+    for (size_t i = 1; i < block.vtx.size(); i++)
+        shorttxids[i - 1] = GetShortID(block.vtx[i].GetHash());
+    for (size_t i = 0; i < block.vcert.size(); i++)
+        shorttxids[block.vtx.size() - 1 + i] = GetShortID(block.vcert[i].GetHash());
+}
+
+void CBlockHeaderAndShortTxIDs::FillShortTxIDSelector() const
+{
+    CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+    stream << header << nonce;
+    CSHA256 hasher;
+    hasher.Write((unsigned char*)&(*stream.begin()), stream.end() - stream.begin());
+    uint256 shorttxidhash;
+    hasher.Finalize(shorttxidhash.begin());
+    shorttxidk0 = shorttxidhash.GetUint64(0);
+    shorttxidk1 = shorttxidhash.GetUint64(1);
+}
+
+uint64_t CBlockHeaderAndShortTxIDs::GetShortID(const uint256& hash) const
+{
+    static_assert(SHORTTXIDS_LENGTH == 6, "shorttxids calculation assumes 6-byte shorttxids");
+    return SipHashUint256(shorttxidk0, shorttxidk1, hash) & 0xffffffffffffL;
+}
+
+ReadStatus PartiallyDownloadedBlock::InitData(const CBlockHeaderAndShortTxIDs& cmpctblock)
+{
+    if (cmpctblock.header.IsNull() || (cmpctblock.shorttxids.empty() && cmpctblock.prefilledtxn.empty()))
+        return READ_STATUS_INVALID;
+    if (cmpctblock.shorttxids.size() + cmpctblock.prefilledtxn.size() > MAX_BLOCK_SIZE / MIN_TX_SIZE)
+        return READ_STATUS_INVALID;
+    // the coinbase is always prefilled, so there is at least one transaction
+    if (cmpctblock.prefilledtxn.empty() || cmpctblock.BlockTxCount() == 0)
+        return READ_STATUS_INVALID;
+
+    assert(header.IsNull() && txn_available.empty() && cert_available.empty());
+    header = cmpctblock.header;
+    const size_t nTx = cmpctblock.BlockTxCount();
+    const size_t nTotal = nTx + cmpctblock.BlockCertCount();
+    txn_available.resize(nTx);
+    cert_available.resize(cmpctblock.BlockCertCount());
+
+    for (const PrefilledTransaction& prefilled : cmpctblock.prefilledtxn) {
+        // prefilled positions are strictly increasing once decoded
+        if (prefilled.index >= nTx || prefilled.tx.IsNull())
+            return READ_STATUS_INVALID;
+        txn_available[prefilled.index] = std::make_shared<const CTransaction>(prefilled.tx);
+    }
+    prefilled_count = cmpctblock.prefilledtxn.size();
+
+    // Calculate map of short ids to the positions they stand for. The short ids fill, in order,
+    // the transaction slots not taken by prefilled transactions and then the certificate slots.
+    std::unordered_map<uint64_t, uint32_t> shorttxids(cmpctblock.shorttxids.size());
+    size_t index_offset = 0;
+    for (size_t i = 0; i < cmpctblock.shorttxids.size(); i++) {
+        while (i + index_offset < nTx && txn_available[i + index_offset])
+            index_offset++;
+        shorttxids[cmpctblock.shorttxids[i]] = i + index_offset;
+        // To avoid excessive lookup costs on a crafted set of short ids, give up on long buckets
+        // and fall back to downloading the full block.
+        if (shorttxids.bucket_size(shorttxids.bucket(cmpctblock.shorttxids[i])) > 12)
+            return READ_STATUS_FAILED;
+    }
+    if (shorttxids.size() != cmpctblock.shorttxids.size())
+        return READ_STATUS_FAILED; // Short ID collision
+
+    // A position matched by more than one mempool entry is left to the blocktxn round trip
+    std::vector<bool> have_txn(nTotal);
+    {
+        LOCK(pool->cs);
+        for (const auto& entry : pool->mapTx) {
+            auto idit = shorttxids.find(cmpctblock.GetShortID(entry.first));
+            if (idit == shorttxids.end() || idit->second >= nTx)
+                continue;
+            std::shared_ptr<const CTransaction>& slot = txn_available[idit->second];
+            if (!have_txn[idit->second]) {
+                slot = std::make_shared<const CTransaction>(entry.second.GetTx());
+                have_txn[idit->second] = true;
+                mempool_count++;
+            } else if (slot) {
+                slot.reset();
+                mempool_count--;
+            }
+        }
+        for (const auto& entry : pool->mapCertificate) {
+            auto idit = shorttxids.find(cmpctblock.GetShortID(entry.first));
+            if (idit == shorttxids.end() || idit->second < nTx)
+                continue;
+            std::shared_ptr<const CScCertificate>& slot = cert_available[idit->second - nTx];
+            if (!have_txn[idit->second]) {
+                slot = std::make_shared<const CScCertificate>(entry.second.GetCertificate());
+                have_txn[idit->second] = true;
+                mempool_count++;
+            } else if (slot) {
+                slot.reset();
+                mempool_count--;
+            }
+        }
+    }
+
+    LogPrint("cmpctblock", "Initialized PartiallyDownloadedBlock for block %s using a cmpctblock of size %lu\n",
+        cmpctblock.header.GetHash().ToString(), GetSerializeSize(cmpctblock, SER_NETWORK, PROTOCOL_VERSION));
+
+    return READ_STATUS_OK;
+}
+
+bool PartiallyDownloadedBlock::IsTxAvailable(size_t index) const
+{
+    assert(!header.IsNull());
+    assert(index < BlockTxCount());
+    if (index < txn_available.size())
+        return txn_available[index] != nullptr;
+    return cert_available[index - txn_available.size()] != nullptr;
+}
+
+ReadStatus PartiallyDownloadedBlock::FillBlock(CBlock& block, const std::vector<CTransaction>& vtx_missing,
+                                               const std::vector<CScCertificate>& vcert_missing)
+{
+    assert(!header.IsNull());
+    uint256 hash = header.GetHash();
+    block.SetNull();
+    block.SetBlockHeader(header);
+    block.vtx.resize(txn_available.size());
+    block.vcert.resize(cert_available.size());
+
+    size_t tx_missing_offset = 0;
+    for (size_t i = 0; i < txn_available.size(); i++) {
+        if (!txn_available[i]) {
+            if (vtx_missing.size() <= tx_missing_offset)
+                return READ_STATUS_INVALID;
+            block.vtx[i] = vtx_missing[tx_missing_offset++];
+        } else
+            block.vtx[i] = *txn_available[i];
+    }
+    size_t cert_missing_offset = 0;
+    for (size_t i = 0; i < cert_available.size(); i++) {
+        if (!cert_available[i]) {
+            if (vcert_missing.size() <= cert_missing_offset)
+                return READ_STATUS_INVALID;
+            block.vcert[i] = vcert_missing[cert_missing_offset++];
+        } else
+            block.vcert[i] = *cert_available[i];
+    }
+
+    // Make sure we can't call FillBlock again.
+    header.SetNull();
+    txn_available.clear();
+    cert_available.clear();
+
+    if (vtx_missing.size() != tx_missing_offset || vcert_missing.size() != cert_missing_offset)
+        return READ_STATUS_INVALID;
+
+    // A short id collision with a mempool entry yields a block with the wrong contents, which
+    // must not be handed to validation: the caller falls back to downloading the full block.
+    bool mutated = false;
+    if (block.BuildMerkleTree(&mutated) != block.hashMerkleRoot || mutated)
+        return READ_STATUS_FAILED;
+
+    LogPrint("cmpctblock", "Successfully reconstructed block %s with %lu entries prefilled, %lu from mempool and %lu requested\n",
+        hash.ToString(), prefilled_count, mempool_count, vtx_missing.size() + vcert_missing.size());
+
+    return READ_STATUS_OK;
+}
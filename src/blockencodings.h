@@ -0,0 +1,235 @@
+// Copyright (c) 2016 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_BLOCKENCODINGS_H
+#define BITCOIN_BLOCKENCODINGS_H
+
+#include "primitives/block.h"
+#include "consensus/consensus.h"
+
+#include <ios>
+#include <limits>
+#include <memory>
+
+class CTxMemPool;
+
+/** Default for -compactblocks, whether compact block relay is advertised and used */
+static const bool DEFAULT_COMPACT_BLOCKS = true;
+/** Blocks deeper than this below the tip are served in full even if requested as compact blocks */
+static const int MAX_CMPCTBLOCK_DEPTH = 5;
+/** Blocks deeper than this below the tip are served in full instead of answering getblocktxn */
+static const int MAX_BLOCKTXN_DEPTH = 10;
+/** Default for -fastblockrelay, whether the blocks extending the tip are pushed to the whitelisted peers before their full validation */
+static const bool DEFAULT_FAST_BLOCK_RELAY = false;
+
+extern bool fFastBlockRelay;
+
+/** Read or write a CompactSize-encoded integer, depending on the serialization direction */
+template<typename Stream>
+void SerializeCompactSize(Stream& s, CSerActionSerialize, uint64_t& n)
+{
+    WriteCompactSize(s, n);
+}
+
+template<typename Stream>
+void SerializeCompactSize(Stream& s, CSerActionUnserialize, uint64_t& n)
+{
+    n = ReadCompactSize(s);
+}
+
+/**
+ * Positions in a compact block address a single list made of the block transactions followed
+ * by the block certificates. Lists of positions are sent differentially encoded, as in BIP152:
+ * each one is stored as the distance from the previous one, minus one.
+ */
+template<typename Stream>
+void SerializeDiffIndexes(Stream& s, CSerActionSerialize, std::vector<uint32_t>& indexes)
+{
+    WriteCompactSize(s, indexes.size());
+    uint64_t nNext = 0;
+    for (uint32_t index : indexes) {
+        WriteCompactSize(s, index - nNext);
+        nNext = (uint64_t)index + 1;
+    }
+}
+
+template<typename Stream>
+void SerializeDiffIndexes(Stream& s, CSerActionUnserialize, std::vector<uint32_t>& indexes)
+{
+    uint64_t nCount = ReadCompactSize(s);
+    indexes.clear();
+    indexes.reserve(std::min<uint64_t>(nCount, 1000));
+    uint64_t nNext = 0;
+    for (uint64_t i = 0; i < nCount; i++) {
+        nNext += ReadCompactSize(s);
+        if (nNext > std::numeric_limits<uint32_t>::max())
+            throw std::ios_base::failure("differential index overflowed 32 bits");
+        indexes.push_back(nNext++);
+    }
+}
+
+/** Short transaction ids are sent as 6-byte little-endian integers */
+template<typename Stream>
+void SerializeShortTxIDs(Stream& s, CSerActionSerialize, std::vector<uint64_t>& shorttxids)
+{
+    WriteCompactSize(s, shorttxids.size());
+    for (uint64_t shorttxid : shorttxids) {
+        uint32_t lsb = shorttxid & 0xffffffff;
+        uint16_t msb = (shorttxid >> 32) & 0xffff;
+        ::Serialize(s, lsb, 0, 0);
+        ::Serialize(s, msb, 0, 0);
+    }
+}
+
+template<typename Stream>
+void SerializeShortTxIDs(Stream& s, CSerActionUnserialize, std::vector<uint64_t>& shorttxids)
+{
+    uint64_t nShortIds = ReadCompactSize(s);
+    shorttxids.clear();
+    shorttxids.reserve(std::min<uint64_t>(nShortIds, MAX_BLOCK_SIZE / MIN_TX_SIZE));
+    for (uint64_t i = 0; i < nShortIds; i++) {
+        uint32_t lsb = 0;
+        uint16_t msb = 0;
+        ::Unserialize(s, lsb, 0, 0);
+        ::Unserialize(s, msb, 0, 0);
+        shorttxids.push_back((uint64_t(msb) << 32) | uint64_t(lsb));
+    }
+}
+
+/** A getblocktxn message: the positions of the block transactions and certificates a peer is missing */
+class BlockTransactionsRequest {
+public:
+    // A BlockTransactionsRequest message
+    uint256 blockhash;
+    std::vector<uint32_t> indexes;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
+        READWRITE(blockhash);
+        SerializeDiffIndexes(s, ser_action, indexes);
+    }
+};
+
+/** A blocktxn message: the transactions and certificates requested by a getblocktxn, in block order */
+class BlockTransactions {
+public:
+    // A BlockTransactions message
+    uint256 blockhash;
+    std::vector<CTransaction> txn;
+    std::vector<CScCertificate> certs;
+
+    BlockTransactions() {}
+    explicit BlockTransactions(const BlockTransactionsRequest& req) :
+        blockhash(req.blockhash) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
+        READWRITE(blockhash);
+        READWRITE(txn);
+        READWRITE(certs);
+    }
+};
+
+// Transactions sent along with the compact block, at the given position of the block
+struct PrefilledTransaction {
+    uint32_t index;
+    CTransaction tx;
+};
+
+typedef enum ReadStatus_t
+{
+    READ_STATUS_OK,
+    READ_STATUS_INVALID, // Invalid object, peer is sending bogus crap
+    READ_STATUS_FAILED, // Failed to process object
+} ReadStatus;
+
+/**
+ * A cmpctblock message: the block header, the prefilled coinbase and 6-byte short ids for all
+ * the other transactions and then for all the certificates of the block.
+ */
+class CBlockHeaderAndShortTxIDs {
+private:
+    mutable uint64_t shorttxidk0, shorttxidk1;
+    uint64_t nonce;
+
+    void FillShortTxIDSelector() const;
+
+    friend class PartiallyDownloadedBlock;
+
+    static const int SHORTTXIDS_LENGTH = 6;
+protected:
+    std::vector<uint64_t> shorttxids;
+    std::vector<PrefilledTransaction> prefilledtxn;
+    // the last nCertificates short ids belong to certificates
+    uint64_t nCertificates;
+
+public:
+    CBlockHeader header;
+
+    // Dummy for deserialization
+    CBlockHeaderAndShortTxIDs() : nCertificates(0) {}
+
+    explicit CBlockHeaderAndShortTxIDs(const CBlock& block);
+
+    uint64_t GetShortID(const uint256& hash) const;
+
+    size_t BlockTxCount() const { return shorttxids.size() + prefilledtxn.size() - nCertificates; }
+    size_t BlockCertCount() const { return nCertificates; }
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
+        READWRITE(header);
+        READWRITE(nonce);
+
+        static_assert(SHORTTXIDS_LENGTH == 6, "shorttxids serialization assumes 6-byte shorttxids");
+        SerializeShortTxIDs(s, ser_action, shorttxids);
+
+        std::vector<uint32_t> indexes;
+        if (!ser_action.ForRead()) {
+            for (const PrefilledTransaction& prefilled : prefilledtxn)
+                indexes.push_back(prefilled.index);
+        }
+        SerializeDiffIndexes(s, ser_action, indexes);
+        if (ser_action.ForRead())
+            prefilledtxn.resize(indexes.size());
+        for (size_t i = 0; i < prefilledtxn.size(); i++) {
+            prefilledtxn[i].index = indexes[i];
+            READWRITE(prefilledtxn[i].tx);
+        }
+
+        SerializeCompactSize(s, ser_action, nCertificates);
+        if (ser_action.ForRead()) {
+            if (nCertificates > shorttxids.size())
+                throw std::ios_base::failure("more compact block certificates than short ids");
+            FillShortTxIDSelector();
+        }
+    }
+};
+
+/** A block being rebuilt from a compact block, the local mempool and a blocktxn round trip */
+class PartiallyDownloadedBlock {
+protected:
+    std::vector<std::shared_ptr<const CTransaction>> txn_available;
+    std::vector<std::shared_ptr<const CScCertificate>> cert_available;
+    size_t prefilled_count = 0, mempool_count = 0;
+    const CTxMemPool* pool;
+public:
+    CBlockHeader header;
+    explicit PartiallyDownloadedBlock(const CTxMemPool* poolIn) : pool(poolIn) {}
+
+    ReadStatus InitData(const CBlockHeaderAndShortTxIDs& cmpctblock);
+    // index is a position in the block transactions followed by the block certificates
+    bool IsTxAvailable(size_t index) const;
+    size_t BlockTxCount() const { return txn_available.size() + cert_available.size(); }
+    ReadStatus FillBlock(CBlock& block, const std::vector<CTransaction>& vtx_missing,
+                         const std::vector<CScCertificate>& vcert_missing);
+};
+
+#endif // BITCOIN_BLOCKENCODINGS_H
@@ -0,0 +1,309 @@
+#include "blockfilter.h"
+
+#include "hash.h"
+#include "primitives/block.h"
+#include "script/script.h"
+#include "streams.h"
+#include "version.h"
+
+#include <algorithm>
+#include <ios>
+
+namespace {
+
+//! Writes bits most significant first, the last byte being zero padded
+class CBitWriter
+{
+public:
+    explicit CBitWriter(std::vector<unsigned char>& vDataIn) : vData(vDataIn), nBits(0), nByte(0) {}
+
+    //! Write the nCount low bits of value
+    void Write(uint64_t value, int nCount)
+    {
+        while (nCount > 0)
+        {
+            const int nTake = std::min(8 - nBits, nCount);
+            const uint8_t bits = (value >> (nCount - nTake)) & ((1 << nTake) - 1);
+            nByte |= bits << (8 - nBits - nTake);
+            nBits += nTake;
+            nCount -= nTake;
+            if (nBits == 8)
+                Flush();
+        }
+    }
+
+    void Flush()
+    {
+        if (nBits == 0)
+            return;
+        vData.push_back(nByte);
+        nBits = 0;
+        nByte = 0;
+    }
+
+private:
+    std::vector<unsigned char>& vData;
+    //! The bits of nByte written so far
+    int nBits;
+    uint8_t nByte;
+};
+
+class CBitReader
+{
+public:
+    CBitReader(const unsigned char* pbeginIn, const unsigned char* pendIn) : p(pbeginIn), pend(pendIn), nBits(0), nByte(0) {}
+
+    uint64_t Read(int nCount)
+    {
+        uint64_t value = 0;
+        while (nCount > 0)
+        {
+            if (nBits == 0)
+            {
+                if (p == pend)
+                    throw std::ios_base::failure("GCSFilter: end of data");
+                nByte = *p++;
+                nBits = 8;
+            }
+            const int nTake = std::min(nBits, nCount);
+            value = (value << nTake) | ((nByte >> (nBits - nTake)) & ((1 << nTake) - 1));
+            nBits -= nTake;
+            nCount -= nTake;
+        }
+        return value;
+    }
+
+    //! The quotient is coded in unary, as that many 1 bits followed by a 0 bit
+    uint64_t ReadGolombRice(uint8_t nP)
+    {
+        uint64_t q = 0;
+        while (Read(1) == 1)
+            q++;
+        return (q << nP) + Read(nP);
+    }
+
+private:
+    const unsigned char* p;
+    const unsigned char* pend;
+    int nBits;
+    uint8_t nByte;
+};
+
+void WriteGolombRice(CBitWriter& writer, uint8_t nP, uint64_t x)
+{
+    for (uint64_t q = x >> nP; q > 0; q--)
+        writer.Write(1, 1);
+    writer.Write(0, 1);
+    writer.Write(x, nP);
+}
+
+//! (x * n) >> 64, which maps a uniform 64-bit hash to a uniform value in [0, n)
+uint64_t MapIntoRange(uint64_t x, uint64_t n)
+{
+#ifdef __SIZEOF_INT128__
+    return (static_cast<unsigned __int128>(x) * static_cast<unsigned __int128>(n)) >> 64;
+#else
+    const uint64_t x_hi = x >> 32, x_lo = x & 0xFFFFFFFF;
+    const uint64_t n_hi = n >> 32, n_lo = n & 0xFFFFFFFF;
+    const uint64_t ac = x_hi * n_hi;
+    const uint64_t ad = x_hi * n_lo;
+    const uint64_t bc = x_lo * n_hi;
+    const uint64_t bd = x_lo * n_lo;
+    const uint64_t mid34 = (bd >> 32) + (bc & 0xFFFFFFFF) + (ad & 0xFFFFFFFF);
+    return ac + (bc >> 32) + (ad >> 32) + (mid34 >> 32);
+#endif
+}
+
+} // anon namespace
+
+GCSFilter::GCSFilter(uint64_t k0In, uint64_t k1In) : k0(k0In), k1(k1In), nElements(0), nRange(0)
+{
+    vEncoded.push_back(0);
+}
+
+GCSFilter::GCSFilter(uint64_t k0In, uint64_t k1In, std::vector<unsigned char> vEncodedIn) :
+    k0(k0In), k1(k1In), vEncoded(std::move(vEncodedIn))
+{
+    CSpanReader reader(reinterpret_cast<const char*>(vEncoded.data()), reinterpret_cast<const char*>(vEncoded.data() + vEncoded.size()),
+                       SER_NETWORK, PROTOCOL_VERSION);
+    nElements = ReadCompactSize(reader);
+    // each element takes at least P + 1 bits
+    if (nElements > reader.size() * 8 / (P + 1))
+        throw std::ios_base::failure("GCSFilter: element count larger than the encoding");
+    nRange = nElements * M;
+
+    // all the values must be decoded for the encoding to be well formed
+    const unsigned char* pbegin = reinterpret_cast<const unsigned char*>(reader.data());
+    CBitReader bits(pbegin, vEncoded.data() + vEncoded.size());
+    for (uint64_t i = 0; i < nElements; i++)
+        bits.ReadGolombRice(P);
+}
+
+GCSFilter::GCSFilter(uint64_t k0In, uint64_t k1In, ElementSet elements) : k0(k0In), k1(k1In)
+{
+    std::sort(elements.begin(), elements.end());
+    elements.erase(std::unique(elements.begin(), elements.end()), elements.end());
+    nElements = elements.size();
+    nRange = nElements * M;
+
+    std::vector<uint64_t> vHashes;
+    vHashes.reserve(elements.size());
+    for (const Element& element : elements)
+        vHashes.push_back(HashToRange(element));
+    std::sort(vHashes.begin(), vHashes.end());
+
+    CDataStream ssCount(SER_NETWORK, PROTOCOL_VERSION);
+    WriteCompactSize(ssCount, nElements);
+    vEncoded.assign(ssCount.begin(), ssCount.end());
+    CBitWriter writer(vEncoded);
+    uint64_t last = 0;
+    for (uint64_t hash : vHashes)
+    {
+        WriteGolombRice(writer, P, hash - last);
+        last = hash;
+    }
+    writer.Flush();
+}
+
+uint64_t GCSFilter::HashToRange(const Element& element) const
+{
+    const uint64_t hash = CSipHasher(k0, k1).Write(element.data(), element.size()).Finalize();
+    return MapIntoRange(hash, nRange);
+}
+
+bool GCSFilter::MatchSorted(const std::vector<uint64_t>& vHashes) const
+{
+    if (nElements == 0 || vHashes.empty())
+        return false;
+
+    CSpanReader reader(reinterpret_cast<const char*>(vEncoded.data()), reinterpret_cast<const char*>(vEncoded.data() + vEncoded.size()),
+                       SER_NETWORK, PROTOCOL_VERSION);
+    ReadCompactSize(reader);
+    CBitReader bits(reinterpret_cast<const unsigned char*>(reader.data()), vEncoded.data() + vEncoded.size());
+
+    // merge the two sorted lists
+    uint64_t value = 0;
+    std::vector<uint64_t>::const_iterator it = vHashes.begin();
+    for (uint64_t i = 0; i < nElements; i++)
+    {
+        value += bits.ReadGolombRice(P);
+        while (*it < value)
+        {
+            if (++it == vHashes.end())
+                return false;
+        }
+        if (*it == value)
+            return true;
+    }
+    return false;
+}
+
+bool GCSFilter::Match(const Element& element) const
+{
+    if (nElements == 0)
+        return false;
+    return MatchSorted(std::vector<uint64_t>(1, HashToRange(element)));
+}
+
+bool GCSFilter::MatchAny(const ElementSet& elements) const
+{
+    if (nElements == 0)
+        return false;
+    std::vector<uint64_t> vHashes;
+    vHashes.reserve(elements.size());
+    for (const Element& element : elements)
+        vHashes.push_back(HashToRange(element));
+    std::sort(vHashes.begin(), vHashes.end());
+    return MatchSorted(vHashes);
+}
+
+const std::string& BlockFilterTypeName(BlockFilterType filterType)
+{
+    static const std::string strBasic = "basic";
+    static const std::string strUnknown = "";
+    return filterType == BlockFilterType::BASIC ? strBasic : strUnknown;
+}
+
+bool BlockFilterTypeByName(const std::string& name, BlockFilterType& filterType)
+{
+    if (name != BlockFilterTypeName(BlockFilterType::BASIC))
+        return false;
+    filterType = BlockFilterType::BASIC;
+    return true;
+}
+
+namespace {
+
+void AddOutputScripts(const std::vector<CTxOut>& vout, GCSFilter::ElementSet& elements)
+{
+    for (const CTxOut& out : vout)
+    {
+        const CScript& script = out.scriptPubKey;
+        if (script.empty() || script[0] == OP_RETURN)
+            continue;
+        elements.emplace_back(script.begin(), script.end());
+    }
+}
+
+void AddScId(const uint256& scId, GCSFilter::ElementSet& elements)
+{
+    elements.emplace_back(scId.begin(), scId.end());
+}
+
+} // anon namespace
+
+GCSFilter::ElementSet CBlockFilter::BasicFilterElements(const CBlock& block)
+{
+    GCSFilter::ElementSet elements;
+    for (const CTransaction& tx : block.vtx)
+    {
+        AddOutputScripts(tx.GetVout(), elements);
+        if (!tx.IsCoinBase())
+        {
+            for (const CTxIn& in : tx.GetVin())
+            {
+                CDataStream ssOutPoint(SER_NETWORK, PROTOCOL_VERSION);
+                ssOutPoint << in.prevout;
+                elements.emplace_back(ssOutPoint.begin(), ssOutPoint.end());
+            }
+        }
+        for (const CTxScCreationOut& out : tx.GetVscCcOut())
+            AddScId(out.GetScId(), elements);
+        for (const CTxForwardTransferOut& out : tx.GetVftCcOut())
+            AddScId(out.GetScId(), elements);
+        for (const CBwtRequestOut& out : tx.GetVBwtRequestOut())
+            AddScId(out.GetScId(), elements);
+        for (const CTxCeasedSidechainWithdrawalInput& in : tx.GetVcswCcIn())
+            AddScId(in.scId, elements);
+    }
+    for (const CScCertificate& cert : block.vcert)
+    {
+        AddOutputScripts(cert.GetVout(), elements);
+        AddScId(cert.GetScId(), elements);
+    }
+    return elements;
+}
+
+CBlockFilter::CBlockFilter(BlockFilterType filterTypeIn, const CBlock& block) :
+    filterType(filterTypeIn), blockHash(block.GetHash()),
+    filter(blockHash.GetUint64(0), blockHash.GetUint64(1), BasicFilterElements(block))
+{
+}
+
+CBlockFilter::CBlockFilter(BlockFilterType filterTypeIn, const uint256& blockHashIn, std::vector<unsigned char> vEncoded) :
+    filterType(filterTypeIn), blockHash(blockHashIn),
+    filter(blockHash.GetUint64(0), blockHash.GetUint64(1), std::move(vEncoded))
+{
+}
+
+uint256 CBlockFilter::GetHash() const
+{
+    const std::vector<unsigned char>& vEncoded = filter.GetEncoded();
+    return Hash(vEncoded.begin(), vEncoded.end());
+}
+
+uint256 CBlockFilter::ComputeHeader(const uint256& prevHeader) const
+{
+    const uint256 filterHash = GetHash();
+    return Hash(filterHash.begin(), filterHash.end(), prevHeader.begin(), prevHeader.end());
+}
@@ -0,0 +1,127 @@
+#ifndef BITCOIN_BLOCKFILTER_H
+#define BITCOIN_BLOCKFILTER_H
+
+#include "serialize.h"
+#include "uint256.h"
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+class CBlock;
+
+/**
+ * A Golomb-coded set: a compact probabilistic encoding of a set of byte strings, which never gives a
+ * false negative and gives a false positive with probability 1/M. Each element is hashed with SipHash
+ * under the key (k0, k1) and mapped to [0, N * M); the sorted hashes are coded as the Golomb-Rice
+ * coded differences between consecutive ones, with the P low bits of each written as they are. The
+ * encoding is the element count as a CompactSize followed by the bit stream, zero padded to a byte.
+ * See BIP 158 for the design this follows.
+ */
+class GCSFilter
+{
+public:
+    typedef std::vector<unsigned char> Element;
+    typedef std::vector<Element> ElementSet;
+
+    //! The Golomb-Rice parameter, and the inverse false positive rate, of the basic block filters
+    static const uint8_t P = 19;
+    static const uint32_t M = 784931;
+
+    //! The empty filter
+    GCSFilter(uint64_t k0 = 0, uint64_t k1 = 0);
+    //! The filter of an encoding received from a peer; throws std::ios_base::failure if it is malformed
+    GCSFilter(uint64_t k0, uint64_t k1, std::vector<unsigned char> vEncodedIn);
+    //! The filter of a set of elements, duplicates are coded once
+    GCSFilter(uint64_t k0, uint64_t k1, ElementSet elements);
+
+    uint64_t GetN() const { return nElements; }
+    const std::vector<unsigned char>& GetEncoded() const { return vEncoded; }
+
+    bool Match(const Element& element) const;
+    //! Whether any of the elements may be in the set, with a single pass over the encoding
+    bool MatchAny(const ElementSet& elements) const;
+
+private:
+    uint64_t k0;
+    uint64_t k1;
+    uint64_t nElements;
+    //! The range the element hashes are mapped to, nElements * M
+    uint64_t nRange;
+    std::vector<unsigned char> vEncoded;
+
+    uint64_t HashToRange(const Element& element) const;
+    //! Whether one of the sorted hashes is in the set
+    bool MatchSorted(const std::vector<uint64_t>& vHashes) const;
+};
+
+enum class BlockFilterType : uint8_t
+{
+    BASIC = 0,
+    INVALID = 255,
+};
+
+//! The name of a filter type as used in the RPC and REST interfaces, "basic"
+const std::string& BlockFilterTypeName(BlockFilterType filterType);
+//! The filter type of a name, false if there is none
+bool BlockFilterTypeByName(const std::string& name, BlockFilterType& filterType);
+
+/**
+ * The compact filter of a block, with which light clients and sidechain nodes find out whether a
+ * block is of interest to them without downloading it. The basic filter holds, for the transactions
+ * and the certificates of the block:
+ *  - the scriptPubKey of each output, backward transfers included, other than the OP_RETURN ones
+ *  - each outpoint spent, serialized: unlike BIP 158, which holds the scripts of the spent outputs,
+ *    it is built from the block alone, without its undo data, and a wallet looks up its spends by
+ *    the outpoints of the coins it knows of
+ *  - the id of each sidechain created, sent forward transfers or backward transfer requests, or
+ *    whose ceased sidechain withdrawals the block holds, and that of each certificate
+ * The filter is keyed by the first 16 bytes of the block hash.
+ */
+class CBlockFilter
+{
+public:
+    CBlockFilter() : filterType(BlockFilterType::INVALID) {}
+    CBlockFilter(BlockFilterType filterTypeIn, const CBlock& block);
+    //! A filter received from a peer; throws std::ios_base::failure if the encoding is malformed
+    CBlockFilter(BlockFilterType filterTypeIn, const uint256& blockHashIn, std::vector<unsigned char> vEncoded);
+
+    BlockFilterType GetFilterType() const { return filterType; }
+    const uint256& GetBlockHash() const { return blockHash; }
+    const GCSFilter& GetFilter() const { return filter; }
+    const std::vector<unsigned char>& GetEncodedFilter() const { return filter.GetEncoded(); }
+
+    //! The double SHA256 of the encoded filter
+    uint256 GetHash() const;
+    //! The header of the filter, which commits to the filters of all the blocks up to this one: the
+    //! double SHA256 of the filter hash followed by the header of the filter of the previous block
+    uint256 ComputeHeader(const uint256& prevHeader) const;
+
+    //! The elements of the basic filter of a block
+    static GCSFilter::ElementSet BasicFilterElements(const CBlock& block);
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
+        uint8_t nFilterType = static_cast<uint8_t>(filterType);
+        READWRITE(nFilterType);
+        READWRITE(blockHash);
+        std::vector<unsigned char> vEncoded;
+        if (!ser_action.ForRead())
+            vEncoded = filter.GetEncoded();
+        READWRITE(vEncoded);
+        if (ser_action.ForRead())
+        {
+            filterType = static_cast<BlockFilterType>(nFilterType);
+            filter = GCSFilter(blockHash.GetUint64(0), blockHash.GetUint64(1), std::move(vEncoded));
+        }
+    }
+
+private:
+    BlockFilterType filterType;
+    uint256 blockHash;
+    GCSFilter filter;
+};
+
+#endif // BITCOIN_BLOCKFILTER_H
@@ -0,0 +1,206 @@
+#include "blockfilterindex.h"
+
+#include "chain.h"
+#include "main.h"
+#include "util.h"
+
+#include <chrono>
+
+static const char DB_FILTER = 'f';
+static const char DB_BEST_BLOCK = 'B';
+
+CBlockFilterIndex* pblockfilterindex = NULL;
+
+CBlockFilterIndex::CBlockFilterIndex(BlockFilterType filterTypeIn, size_t nCacheSize, bool fMemory, bool fWipe) :
+    filterType(filterTypeIn),
+    db(GetDataDir() / "blockfilters",
+       CLevelDBOptions(nCacheSize, DEFAULT_DB_MAX_OPEN_FILES).ApplyArgs("blockfilterdb"), fMemory, fWipe)
+{
+    if (!db.Read(DB_BEST_BLOCK, hashBest))
+        hashBest.SetNull();
+}
+
+CBlockFilterIndex::~CBlockFilterIndex()
+{
+    Stop();
+}
+
+void CBlockFilterIndex::Start()
+{
+    if (syncThread.joinable())
+        return;
+    fStopSync = false;
+    syncThread = std::thread(&CBlockFilterIndex::ThreadSync, this);
+}
+
+void CBlockFilterIndex::Stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(csSync);
+        if (!syncThread.joinable())
+            return;
+        fStopSync = true;
+    }
+    condTipChanged.notify_all();
+    syncThread.join();
+}
+
+void CBlockFilterIndex::UpdatedBlockTip(const CBlockIndex* pindex)
+{
+    {
+        std::lock_guard<std::mutex> lock(csSync);
+        fTipChanged = true;
+    }
+    condTipChanged.notify_all();
+}
+
+void CBlockFilterIndex::ThreadSync()
+{
+    RenameThread("horizen-blkfilter");
+    while (true)
+    {
+        {
+            std::lock_guard<std::mutex> lock(csSync);
+            if (fStopSync)
+                return;
+            fTipChanged = false;
+        }
+
+        const CBlockIndex* pindexNext = NULL;
+        {
+            LOCK(cs_main);
+            BlockMap::const_iterator it = hashBest.IsNull() ? mapBlockIndex.end() : mapBlockIndex.find(hashBest);
+            if (it == mapBlockIndex.end())
+            {
+                pindexNext = chainActive.Genesis();
+            }
+            else
+            {
+                // after a reorg the blocks from the fork point on are indexed again
+                const CBlockIndex* pindexFork = chainActive.FindFork(it->second);
+                pindexNext = pindexFork ? chainActive.Next(pindexFork) : chainActive.Genesis();
+            }
+            if (pindexNext && !(pindexNext->nStatus & BLOCK_HAVE_DATA))
+            {
+                LogPrintf("%s: the data of block %s is not available, the block filter index stops at height %d\n",
+                          __func__, pindexNext->GetBlockHash().ToString(), pindexNext->nHeight - 1);
+                return;
+            }
+        }
+
+        if (pindexNext == NULL)
+        {
+            if (!fSynced)
+            {
+                LogPrintf("%s: the %s block filter index is synced with the active chain\n", __func__, BlockFilterTypeName(filterType));
+                fSynced = true;
+            }
+            std::unique_lock<std::mutex> lock(csSync);
+            condTipChanged.wait_for(lock, std::chrono::seconds(1), [this] { return fStopSync || fTipChanged; });
+            continue;
+        }
+
+        if (!IndexBlock(pindexNext))
+        {
+            LogPrintf("%s: failed to index the filter of block %s, the block filter index stops\n",
+                      __func__, pindexNext->GetBlockHash().ToString());
+            return;
+        }
+    }
+}
+
+bool CBlockFilterIndex::IndexBlock(const CBlockIndex* pindex)
+{
+    CBlock block;
+    if (!ReadBlockFromDisk(block, pindex))
+        return false;
+
+    uint256 prevHeader;
+    if (pindex->pprev)
+    {
+        CFilterEntry prevEntry;
+        if (!ReadEntry(pindex->pprev->GetBlockHash(), prevEntry))
+            return error("%s: the filter of block %s is not indexed", __func__, pindex->pprev->GetBlockHash().ToString());
+        prevHeader = prevEntry.header;
+    }
+
+    const CBlockFilter filter(filterType, block);
+    CFilterEntry entry;
+    entry.filterHash = filter.GetHash();
+    entry.header = filter.ComputeHeader(prevHeader);
+    entry.vFilter = filter.GetEncodedFilter();
+
+    CLevelDBBatch batch;
+    batch.Write(std::make_pair(DB_FILTER, pindex->GetBlockHash()), entry);
+    batch.Write(DB_BEST_BLOCK, pindex->GetBlockHash());
+    if (!db.WriteBatch(batch))
+        return false;
+    hashBest = pindex->GetBlockHash();
+    return true;
+}
+
+bool CBlockFilterIndex::ReadEntry(const uint256& hash, CFilterEntry& entry) const
+{
+    return db.Read(std::make_pair(DB_FILTER, hash), entry);
+}
+
+bool CBlockFilterIndex::LookupFilter(const CBlockIndex* pindex, CBlockFilter& filter) const
+{
+    CFilterEntry entry;
+    if (!ReadEntry(pindex->GetBlockHash(), entry))
+        return false;
+    try {
+        filter = CBlockFilter(filterType, pindex->GetBlockHash(), std::move(entry.vFilter));
+    } catch (const std::exception& e) {
+        return error("%s: the filter of block %s is corrupted - %s", __func__, pindex->GetBlockHash().ToString(), e.what());
+    }
+    return true;
+}
+
+bool CBlockFilterIndex::LookupFilterHeader(const CBlockIndex* pindex, uint256& header) const
+{
+    CFilterEntry entry;
+    if (!ReadEntry(pindex->GetBlockHash(), entry))
+        return false;
+    header = entry.header;
+    return true;
+}
+
+bool CBlockFilterIndex::LookupFilterRange(int nStartHeight, const CBlockIndex* pindexStop, std::vector<CBlockFilter>& vFilters) const
+{
+    vFilters.clear();
+    if (nStartHeight < 0 || nStartHeight > pindexStop->nHeight)
+        return false;
+    vFilters.resize(pindexStop->nHeight - nStartHeight + 1);
+    // the ancestors are walked from the stop block back
+    const CBlockIndex* pindex = pindexStop;
+    for (int i = vFilters.size() - 1; i >= 0; i--, pindex = pindex->pprev)
+    {
+        if (!LookupFilter(pindex, vFilters[i]))
+        {
+            vFilters.clear();
+            return false;
+        }
+    }
+    return true;
+}
+
+bool CBlockFilterIndex::LookupFilterHashRange(int nStartHeight, const CBlockIndex* pindexStop, std::vector<uint256>& vHashes) const
+{
+    vHashes.clear();
+    if (nStartHeight < 0 || nStartHeight > pindexStop->nHeight)
+        return false;
+    vHashes.resize(pindexStop->nHeight - nStartHeight + 1);
+    const CBlockIndex* pindex = pindexStop;
+    for (int i = vHashes.size() - 1; i >= 0; i--, pindex = pindex->pprev)
+    {
+        CFilterEntry entry;
+        if (!ReadEntry(pindex->GetBlockHash(), entry))
+        {
+            vHashes.clear();
+            return false;
+        }
+        vHashes[i] = entry.filterHash;
+    }
+    return true;
+}
@@ -0,0 +1,98 @@
+#ifndef BITCOIN_BLOCKFILTERINDEX_H
+#define BITCOIN_BLOCKFILTERINDEX_H
+
+#include "blockfilter.h"
+#include "leveldbwrapper.h"
+#include "uint256.h"
+#include "validationinterface.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class CBlockIndex;
+
+static const bool DEFAULT_BLOCKFILTERINDEX = false;
+static const bool DEFAULT_PEERBLOCKFILTERS = false;
+//! The cache of the filter database, its block cache and write buffers are set with -blockfilterdb<option>
+static const size_t BLOCKFILTERDB_CACHE_SIZE = 8 << 20;
+//! The most filters a getcfilters message may ask for
+static const unsigned int MAX_GETCFILTERS_SIZE = 1000;
+//! The most filter hashes a getcfheaders message may ask for
+static const unsigned int MAX_GETCFHEADERS_SIZE = 2000;
+//! The spacing of the filter headers sent in a cfcheckpt message
+static const int CFCHECKPT_INTERVAL = 1000;
+
+/**
+ * The index of the compact filters of the blocks, with their headers, in blockfilters/. It is built
+ * by a thread of its own, which catches up with the active chain from the last block indexed and is
+ * woken up at each new tip, so that connecting a block never waits for its filter. After a reorg it
+ * continues from the fork point; the filters of the blocks disconnected are kept, as they are keyed
+ * by block hash. Lookups of blocks not indexed yet fail.
+ */
+class CBlockFilterIndex : public CValidationInterface
+{
+public:
+    CBlockFilterIndex(BlockFilterType filterTypeIn, size_t nCacheSize, bool fMemory = false, bool fWipe = false);
+    ~CBlockFilterIndex();
+
+    CBlockFilterIndex(const CBlockFilterIndex&) = delete;
+    CBlockFilterIndex& operator=(const CBlockFilterIndex&) = delete;
+
+    void Start();
+    void Stop();
+
+    BlockFilterType GetFilterType() const { return filterType; }
+    //! Whether the index caught up with the active chain once since it was started
+    bool IsSynced() const { return fSynced; }
+
+    bool LookupFilter(const CBlockIndex* pindex, CBlockFilter& filter) const;
+    bool LookupFilterHeader(const CBlockIndex* pindex, uint256& header) const;
+    //! The filters, or the filter hashes, of the ancestors of pindexStop from nStartHeight, false if one
+    //! of them is not indexed
+    bool LookupFilterRange(int nStartHeight, const CBlockIndex* pindexStop, std::vector<CBlockFilter>& vFilters) const;
+    bool LookupFilterHashRange(int nStartHeight, const CBlockIndex* pindexStop, std::vector<uint256>& vHashes) const;
+
+protected:
+    void UpdatedBlockTip(const CBlockIndex* pindex) override;
+
+private:
+    struct CFilterEntry
+    {
+        uint256 filterHash;
+        uint256 header;
+        std::vector<unsigned char> vFilter;
+
+        ADD_SERIALIZE_METHODS;
+
+        template <typename Stream, typename Operation>
+        inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
+            READWRITE(filterHash);
+            READWRITE(header);
+            READWRITE(vFilter);
+        }
+    };
+
+    const BlockFilterType filterType;
+    CLevelDBWrapper db;
+
+    std::mutex csSync;
+    std::condition_variable condTipChanged;
+    bool fTipChanged = false;
+    bool fStopSync = false;
+    std::atomic<bool> fSynced{false};
+    std::thread syncThread;
+    //! The last block indexed, only used by the sync thread
+    uint256 hashBest;
+
+    void ThreadSync();
+    bool IndexBlock(const CBlockIndex* pindex);
+    bool ReadEntry(const uint256& hash, CFilterEntry& entry) const;
+};
+
+/** The index of the basic filters, when -blockfilterindex is set */
+extern CBlockFilterIndex* pblockfilterindex;
+
+#endif // BITCOIN_BLOCKFILTERINDEX_H
@@ -0,0 +1,195 @@
+#include "blockview.h"
+
+#include "blockcompression.h"
+#include "chain.h"
+#include "clientversion.h"
+#include "consensus/consensus.h"
+#include "main.h"
+#include "streams.h"
+#include "util.h"
+
+#ifndef WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+CBlockView::~CBlockView()
+{
+    Close();
+}
+
+void CBlockView::Close()
+{
+#ifndef WIN32
+    if (pMap)
+        munmap(pMap, nMapSize);
+#endif
+    pMap = nullptr;
+    nMapSize = 0;
+    vData.clear();
+    pBlock = nullptr;
+    nSize = 0;
+}
+
+bool CBlockView::Open(const CDiskBlockPos& pos)
+{
+    Close();
+
+    // The block size is written before the block
+    if (pos.nPos < sizeof(unsigned int))
+        return error("%s: invalid position %s", __func__, pos.ToString());
+    CAutoFile filein(OpenBlockFile(CDiskBlockPos(pos.nFile, pos.nPos - sizeof(unsigned int)), true), SER_DISK, CLIENT_VERSION);
+    if (filein.IsNull())
+        return error("%s: OpenBlockFile failed for %s", __func__, pos.ToString());
+
+    try {
+        unsigned int nBlockSize;
+        filein >> nBlockSize;
+        if (nBlockSize & BLOCK_RECORD_COMPRESSED)
+        {
+            // not mapped, the block being decompressed to vData
+            ReadCompressedRecord(filein, nBlockSize & ~BLOCK_RECORD_COMPRESSED, MAX_BLOCK_SIZE, vData);
+            pBlock = vData.data();
+            nSize = vData.size();
+        }
+        else
+        {
+            if (nBlockSize == 0 || nBlockSize > MAX_BLOCK_SIZE)
+                return error("%s: invalid block size %u at %s", __func__, nBlockSize, pos.ToString());
+
+#ifndef WIN32
+            // a mapping past the end of the file would fault when read
+            struct stat st;
+            if (fstat(fileno(filein.Get()), &st) != 0 || (uint64_t)st.st_size < (uint64_t)pos.nPos + nBlockSize)
+                return error("%s: block at %s is past the end of the file", __func__, pos.ToString());
+#endif
+            nSize = nBlockSize;
+
+#ifndef WIN32
+
+            // the mapping starts at the page boundary before the block
+            const size_t nPageSize = sysconf(_SC_PAGESIZE);
+            const size_t nMapOffset = pos.nPos - pos.nPos % nPageSize;
+            const size_t nMapLength = pos.nPos - nMapOffset + nSize;
+            void* p = mmap(nullptr, nMapLength, PROT_READ, MAP_PRIVATE, fileno(filein.Get()), nMapOffset);
+            if (p != MAP_FAILED)
+            {
+                pMap = p;
+                nMapSize = nMapLength;
+                pBlock = static_cast<const char*>(pMap) + (pos.nPos - nMapOffset);
+            }
+#endif
+            if (!pBlock)
+            {
+                vData.resize(nSize);
+                filein.read(vData.data(), nSize);
+                pBlock = vData.data();
+            }
+        }
+
+        CSpanReader reader(pBlock, pBlock + nSize, SER_DISK, CLIENT_VERSION);
+        reader >> header;
+        nTxOffset = reader.data() - pBlock;
+    }
+    catch (const std::exception& e) {
+        Close();
+        return error("%s: Deserialize or I/O error - %s at %s", __func__, e.what(), pos.ToString());
+    }
+    return true;
+}
+
+bool CBlockView::FindTransaction(const uint256& hash, CTransaction& txOut) const
+{
+    if (!pBlock)
+        return false;
+    try {
+        CSpanReader reader(pBlock + nTxOffset, pBlock + nSize, SER_DISK, CLIENT_VERSION);
+        CTransaction tx;
+        for (uint64_t nCount = ReadCompactSize(reader); nCount > 0; nCount--)
+        {
+            reader >> tx;
+            if (tx.GetHash() == hash)
+            {
+                txOut = tx;
+                return true;
+            }
+        }
+    }
+    catch (const std::exception& e) {
+        return error("%s: Deserialize error - %s", __func__, e.what());
+    }
+    return false;
+}
+
+bool CBlockView::FindCertificate(const uint256& hash, CScCertificate& certOut) const
+{
+    if (!pBlock || header.nVersion != BLOCK_VERSION_SC_SUPPORT)
+        return false;
+    try {
+        CSpanReader reader(pBlock + nTxOffset, pBlock + nSize, SER_DISK, CLIENT_VERSION);
+        // the certificates follow the transactions
+        CTransaction tx;
+        for (uint64_t nCount = ReadCompactSize(reader); nCount > 0; nCount--)
+            reader >> tx;
+        CScCertificate cert;
+        for (uint64_t nCount = ReadCompactSize(reader); nCount > 0; nCount--)
+        {
+            reader >> cert;
+            if (cert.GetHash() == hash)
+            {
+                certOut = cert;
+                return true;
+            }
+        }
+    }
+    catch (const std::exception& e) {
+        return error("%s: Deserialize error - %s", __func__, e.what());
+    }
+    return false;
+}
+
+bool CBlockView::GetHashes(std::vector<uint256>& vHashes) const
+{
+    vHashes.clear();
+    if (!pBlock)
+        return false;
+    try {
+        CSpanReader reader(pBlock + nTxOffset, pBlock + nSize, SER_DISK, CLIENT_VERSION);
+        CTransaction tx;
+        for (uint64_t nCount = ReadCompactSize(reader); nCount > 0; nCount--)
+        {
+            reader >> tx;
+            vHashes.push_back(tx.GetHash());
+        }
+        if (header.nVersion == BLOCK_VERSION_SC_SUPPORT)
+        {
+            CScCertificate cert;
+            for (uint64_t nCount = ReadCompactSize(reader); nCount > 0; nCount--)
+            {
+                reader >> cert;
+                vHashes.push_back(cert.GetHash());
+            }
+        }
+    }
+    catch (const std::exception& e) {
+        vHashes.clear();
+        return error("%s: Deserialize error - %s", __func__, e.what());
+    }
+    return true;
+}
+
+bool CBlockView::ReadBlock(CBlock& block) const
+{
+    block.SetNull();
+    if (!pBlock)
+        return false;
+    try {
+        CSpanReader reader(pBlock, pBlock + nSize, SER_DISK, CLIENT_VERSION);
+        reader >> block;
+    }
+    catch (const std::exception& e) {
+        return error("%s: Deserialize error - %s", __func__, e.what());
+    }
+    return true;
+}
@@ -0,0 +1,60 @@
+#ifndef BITCOIN_BLOCKVIEW_H
+#define BITCOIN_BLOCKVIEW_H
+
+#include "primitives/block.h"
+#include "support/allocators/pooled.h"
+#include "uint256.h"
+
+#include <stddef.h>
+#include <vector>
+
+struct CDiskBlockPos;
+
+/**
+ * A read-only view of a block stored in a blk file, mapped in memory instead of deserialized into a
+ * CBlock. Only the header is parsed when the view is opened: the transactions and certificates are
+ * deserialized in place from the mapped bytes, one at a time and only as far as a lookup needs, so
+ * that finding one of them or listing their hashes does not build the whole block. Where the file
+ * cannot be mapped the block is read into a pooled buffer instead.
+ */
+class CBlockView
+{
+public:
+    CBlockView() {}
+    ~CBlockView();
+
+    CBlockView(const CBlockView&) = delete;
+    CBlockView& operator=(const CBlockView&) = delete;
+
+    //! Map the block stored at pos and parse its header, false if it cannot be read
+    bool Open(const CDiskBlockPos& pos);
+
+    const CBlockHeader& GetHeader() const { return header; }
+    //! The serialized size of the block
+    size_t GetSerializeSize() const { return nSize; }
+
+    //! Deserialize the transactions up to the one with this hash, false if the block does not have it
+    bool FindTransaction(const uint256& hash, CTransaction& txOut) const;
+    bool FindCertificate(const uint256& hash, CScCertificate& certOut) const;
+    //! The hashes of the transactions, then those of the certificates, in block order
+    bool GetHashes(std::vector<uint256>& vHashes) const;
+    //! Deserialize the whole block from the mapped bytes
+    bool ReadBlock(CBlock& block) const;
+
+private:
+    //! The mapping, from the page boundary before the block
+    void* pMap = nullptr;
+    size_t nMapSize = 0;
+    //! The block read in here when it is not mapped
+    CSerializeData vData;
+
+    const char* pBlock = nullptr;
+    size_t nSize = 0;
+    CBlockHeader header;
+    //! The offset of the transaction count, after the header
+    size_t nTxOffset = 0;
+
+    void Close();
+};
+
+#endif // BITCOIN_BLOCKVIEW_H
@@ -0,0 +1,182 @@
+#include "blockwriter.h"
+
+#include "main.h"
+#include "util.h"
+
+#include <stdio.h>
+
+CBlockFileWriter blockFileWriter;
+
+CBlockFileWriter::~CBlockFileWriter()
+{
+    Stop();
+}
+
+void CBlockFileWriter::Start()
+{
+    std::lock_guard<std::mutex> lock(cs);
+    if (thread.joinable())
+        return;
+    fStop = false;
+    thread = std::thread(&CBlockFileWriter::ThreadWrite, this);
+}
+
+void CBlockFileWriter::Stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(cs);
+        if (!thread.joinable())
+            return;
+        fStop = true;
+    }
+    condQueue.notify_all();
+    thread.join();
+}
+
+void CBlockFileWriter::Queue(CJob&& job)
+{
+    std::unique_lock<std::mutex> lock(cs);
+    if (!thread.joinable())
+    {
+        // carried out by the caller, which the callers serialize with cs_LastBlockFile
+        lock.unlock();
+        const bool fOk = Run(job);
+        lock.lock();
+        fFailed |= !fOk;
+        return;
+    }
+
+    condDone.wait(lock, [this]() { return nPendingSize <= MAX_BLOCK_WRITER_PENDING_SIZE || queue.empty(); });
+    if (job.type == JobType::WRITE)
+    {
+        mapPending[RecordKey(job.fUndo, job.pos.nFile, job.pos.nPos + BLOCK_RECORD_HEADER_SIZE)] = job.record;
+        nPendingSize += job.record->size();
+    }
+    queue.push_back(std::move(job));
+    condQueue.notify_one();
+}
+
+bool CBlockFileWriter::Write(bool fUndo, const CDiskBlockPos& pos, std::shared_ptr<const CSerializeData> record)
+{
+    {
+        std::lock_guard<std::mutex> lock(cs);
+        if (fFailed)
+            return false;
+    }
+    CJob job{JobType::WRITE, fUndo, pos, std::move(record), 0, 0, false};
+    Queue(std::move(job));
+    std::lock_guard<std::mutex> lock(cs);
+    return !fFailed;
+}
+
+void CBlockFileWriter::Allocate(bool fUndo, const CDiskBlockPos& pos, unsigned int nLength)
+{
+    Queue(CJob{JobType::ALLOCATE, fUndo, pos, nullptr, nLength, 0, false});
+}
+
+void CBlockFileWriter::Commit(int nFile, unsigned int nBlockSize, unsigned int nUndoSize, bool fFinalize)
+{
+    Queue(CJob{JobType::COMMIT, false, CDiskBlockPos(nFile, 0), nullptr, nBlockSize, nUndoSize, fFinalize});
+}
+
+bool CBlockFileWriter::Sync()
+{
+    std::unique_lock<std::mutex> lock(cs);
+    condDone.wait(lock, [this]() { return queue.empty() && !fBusy; });
+    const bool fOk = !fFailed;
+    fFailed = false;
+    return fOk;
+}
+
+std::shared_ptr<const CSerializeData> CBlockFileWriter::GetPending(bool fUndo, const CDiskBlockPos& pos) const
+{
+    std::lock_guard<std::mutex> lock(cs);
+    auto it = mapPending.find(RecordKey(fUndo, pos.nFile, pos.nPos));
+    return it != mapPending.end() ? it->second : nullptr;
+}
+
+void CBlockFileWriter::WaitForFile(bool fUndo, const CDiskBlockPos& pos) const
+{
+    std::unique_lock<std::mutex> lock(cs);
+    condDone.wait(lock, [this, fUndo, &pos]() {
+        // the records of a file are queued in the order of their positions
+        auto it = mapPending.lower_bound(RecordKey(fUndo, pos.nFile, 0));
+        for (; it != mapPending.end() && std::get<0>(it->first) == fUndo && std::get<1>(it->first) == pos.nFile; ++it)
+            if (std::get<2>(it->first) - BLOCK_RECORD_HEADER_SIZE + it->second->size() > pos.nPos)
+                return false;
+        return true;
+    });
+}
+
+bool CBlockFileWriter::Run(const CJob& job)
+{
+    switch (job.type)
+    {
+    case JobType::WRITE:
+    {
+        FILE* file = job.fUndo ? OpenUndoFile(job.pos) : OpenBlockFile(job.pos);
+        if (!file)
+            return error("%s: failed to open the file of %s", __func__, job.pos.ToString());
+        const bool fWritten = fwrite(job.record->data(), 1, job.record->size(), file) == job.record->size();
+        if (fclose(file) != 0 || !fWritten)
+            return error("%s: failed to write the record at %s", __func__, job.pos.ToString());
+        return true;
+    }
+    case JobType::ALLOCATE:
+    {
+        FILE* file = job.fUndo ? OpenUndoFile(job.pos) : OpenBlockFile(job.pos);
+        if (file) {
+            LogPrintf("Pre-allocating up to position 0x%x in %s%05u.dat\n", job.pos.nPos + job.nLength, job.fUndo ? "rev" : "blk", job.pos.nFile);
+            AllocateFileRange(file, job.pos.nPos, job.nLength);
+            fclose(file);
+        }
+        return true;
+    }
+    case JobType::COMMIT:
+    {
+        FILE* file = OpenBlockFile(job.pos);
+        if (file) {
+            if (job.fFinalize)
+                TruncateFile(file, job.nLength);
+            FileCommit(file);
+            fclose(file);
+        }
+        file = OpenUndoFile(job.pos);
+        if (file) {
+            if (job.fFinalize)
+                TruncateFile(file, job.nUndoSize);
+            FileCommit(file);
+            fclose(file);
+        }
+        return true;
+    }
+    }
+    return false;
+}
+
+void CBlockFileWriter::ThreadWrite()
+{
+    RenameThread("horizen-blkwrite");
+    std::unique_lock<std::mutex> lock(cs);
+    while (true)
+    {
+        condQueue.wait(lock, [this]() { return fStop || !queue.empty(); });
+        if (queue.empty())
+            return;
+
+        CJob job = std::move(queue.front());
+        queue.pop_front();
+        fBusy = true;
+        lock.unlock();
+        const bool fOk = Run(job);
+        lock.lock();
+        fBusy = false;
+        fFailed |= !fOk;
+        if (job.type == JobType::WRITE)
+        {
+            mapPending.erase(RecordKey(job.fUndo, job.pos.nFile, job.pos.nPos + BLOCK_RECORD_HEADER_SIZE));
+            nPendingSize -= job.record->size();
+        }
+        condDone.notify_all();
+    }
+}
@@ -0,0 +1,97 @@
+#ifndef BITCOIN_BLOCKWRITER_H
+#define BITCOIN_BLOCKWRITER_H
+
+#include "chain.h"
+#include "support/allocators/pooled.h"
+
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdint.h>
+#include <thread>
+#include <tuple>
+
+static const bool DEFAULT_ASYNC_BLOCK_WRITES = true;
+//! The records queued and not written yet, past which a write waits for the writer thread
+static const size_t MAX_BLOCK_WRITER_PENDING_SIZE = 64 << 20;
+//! The message start and the size written before each block and undo record
+static const unsigned int BLOCK_RECORD_HEADER_SIZE = 8;
+
+/**
+ * The writer of the blk?????.dat and rev?????.dat files. The block and undo records, the
+ * pre-allocations and the commits of the files are queued in order and carried out by a thread of
+ * its own, so that neither the writes nor the fsyncs of the files hold cs_main. The positions of the
+ * records are assigned by FindBlockPos and FindUndoPos as before, hence they are known when a write
+ * is queued. Until a record is written, ReadBlockFromDisk and UndoReadFromDisk get it from memory,
+ * and the other readers of the files wait for the writes queued to the file they open.
+ * Sync is the durability barrier, which FlushStateToDisk goes through before writing the block
+ * index. Before Start, or with -asyncblockwrites=0, the jobs are carried out by the caller.
+ */
+class CBlockFileWriter
+{
+public:
+    CBlockFileWriter() {}
+    ~CBlockFileWriter();
+
+    CBlockFileWriter(const CBlockFileWriter&) = delete;
+    CBlockFileWriter& operator=(const CBlockFileWriter&) = delete;
+
+    void Start();
+    //! Carries out the jobs queued, and stops the thread
+    void Stop();
+
+    /**
+     * Queues the record, header included, which starts at pos in the block (or undo) file. false if
+     * a write failed since the last Sync.
+     */
+    bool Write(bool fUndo, const CDiskBlockPos& pos, std::shared_ptr<const CSerializeData> record);
+    void Allocate(bool fUndo, const CDiskBlockPos& pos, unsigned int nLength);
+    //! Commits the block and undo files nFile, truncated first to their sizes if fFinalize
+    void Commit(int nFile, unsigned int nBlockSize, unsigned int nUndoSize, bool fFinalize);
+
+    //! Waits for all the jobs queued to be carried out. false if a job failed since the last Sync.
+    bool Sync();
+
+    //! The record, header included, whose data start at pos, if it is not written yet
+    std::shared_ptr<const CSerializeData> GetPending(bool fUndo, const CDiskBlockPos& pos) const;
+    //! Waits for the records queued at or past pos in its file to be written
+    void WaitForFile(bool fUndo, const CDiskBlockPos& pos) const;
+
+private:
+    enum class JobType { WRITE, ALLOCATE, COMMIT };
+
+    struct CJob
+    {
+        JobType type;
+        bool fUndo;
+        CDiskBlockPos pos;
+        std::shared_ptr<const CSerializeData> record;
+        unsigned int nLength;
+        unsigned int nUndoSize;
+        bool fFinalize;
+    };
+
+    //! The records queued, by file type, file and start of their data
+    typedef std::tuple<bool, int, unsigned int> RecordKey;
+
+    mutable std::mutex cs;
+    mutable std::condition_variable condQueue;
+    mutable std::condition_variable condDone;
+    std::deque<CJob> queue;
+    std::map<RecordKey, std::shared_ptr<const CSerializeData>> mapPending;
+    size_t nPendingSize = 0;
+    bool fBusy = false;
+    bool fStop = false;
+    bool fFailed = false;
+    std::thread thread;
+
+    void Queue(CJob&& job);
+    bool Run(const CJob& job);
+    void ThreadWrite();
+};
+
+extern CBlockFileWriter blockFileWriter;
+
+#endif // BITCOIN_BLOCKWRITER_H
@@ -5,6 +5,7 @@
 
 #include "chain.h"
 
+#include <algorithm>
 #include <stdexcept>
 
 using namespace std;
@@ -100,6 +101,45 @@ void CBlockIndex::BuildSkip()
         pskip = pprev->GetAncestor(GetSkipHeight(nHeight));
 }
 
+void CBlockIndex::BuildAggregates()
+{
+    if (pprev && !pprev->fHaveAggregates)
+        return;
+    arith_uint256 bnTarget;
+    bnTarget.SetCompact(nBits);
+    nChainTargetSum = (pprev ? pprev->nChainTargetSum : arith_uint256(0)) + bnTarget;
+    nMedianTimePast = ComputeMedianTimePast();
+    fHaveAggregates = true;
+}
+
+void CChainLogicalTimes::Sync(const CChain& chain)
+{
+    if (pindexLast && !chain.Contains(pindexLast)) {
+        const CBlockIndex* pindexFork = chain.FindFork(pindexLast);
+        vTimes.resize(pindexFork ? pindexFork->nHeight + 1 : 0);
+    }
+    for (int nHeight = vTimes.size(); nHeight <= chain.Height(); nHeight++) {
+        if (nHeight == 0) {
+            vTimes.push_back(0);
+            continue;
+        }
+        const unsigned int nPrevTime = vTimes.back();
+        vTimes.push_back(std::max<unsigned int>(chain[nHeight]->nTime, nPrevTime + 1));
+    }
+    pindexLast = chain.Tip();
+}
+
+void CChainLogicalTimes::FindRange(const CChain& chain, unsigned int nLow, unsigned int nHigh,
+                                   std::vector<std::pair<uint256, unsigned int> >& vHashes) const
+{
+    if (vTimes.size() < 2 || nLow >= nHigh)
+        return;
+    std::vector<unsigned int>::const_iterator itBegin = std::lower_bound(vTimes.begin() + 1, vTimes.end(), nLow);
+    std::vector<unsigned int>::const_iterator itEnd = std::lower_bound(itBegin, vTimes.end(), nHigh);
+    for (std::vector<unsigned int>::const_iterator it = itBegin; it != itEnd; ++it)
+        vHashes.push_back(std::make_pair(chain[it - vTimes.begin()]->GetBlockHash(), *it));
+}
+
 void CHistoricalChain::SetHeight(const int nHeight)
 {
     if (nHeight > chain.Height()) {
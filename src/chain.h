@@ -117,6 +117,8 @@ enum BlockStatus: uint32_t {
     BLOCK_FAILED_VALID       =   32, //! stage after last reached validness failed
     BLOCK_FAILED_CHILD       =   64, //! descends from failed block
     BLOCK_FAILED_MASK        =   BLOCK_FAILED_VALID | BLOCK_FAILED_CHILD,
+
+    BLOCK_ASSUMED_VALID      =  128, //! connected without its scripts and proofs checked (checkpoint or -assumevalid)
 };
 
 /** The block chain is a tree shaped structure starting with the
@@ -136,9 +138,33 @@ public:
     //! pointer to the index of some further predecessor of this block
     CBlockIndex* pskip;
 
+    // the fields walked along pprev when looking for the best chain come first, to share cache lines
+
     //! height of the entry in the chain. The genesis block has height 0
     int nHeight;
 
+    //! Verification status of this block. See enum BlockStatus
+    unsigned int nStatus;
+
+    //! (memory only) Number of transactions in the chain up to and including this block.
+    //! This value will be non-zero only if and only if transactions for this block and all its parents are available.
+    //! Change to 64-bit type when necessary; won't happen before 2030
+    unsigned int nChainTx;
+
+    //! (memory only) Sequential id assigned to distinguish order in which blocks are received.
+    uint32_t nSequenceId;
+
+    //! (memory only) Total amount of work (expected number of hashes) in the chain up to and including this block
+    arith_uint256 nChainWork;
+
+    int64_t nChainDelay;
+
+    //! (memory only) Aggregates of the chain up to and including this block, set by BuildAggregates when the
+    //! entry is inserted: the sum of the targets of the blocks, modulo 2^256, and the median time past
+    arith_uint256 nChainTargetSum;
+    int64_t nMedianTimePast;
+    bool fHaveAggregates;
+
     //! Which # file this block is stored in (blk?????.dat)
     int nFile;
 
@@ -148,11 +174,6 @@ public:
     //! Byte offset within rev?????.dat where this block's undo data is stored
     unsigned int nUndoPos;
 
-    //! (memory only) Total amount of work (expected number of hashes) in the chain up to and including this block
-    arith_uint256 nChainWork;
-
-    int64_t nChainDelay;
-
     //! Cumulative Hash Block Sidechain Transaction Commitment Tree
     CFieldElement scCumTreeHash;
 
@@ -160,14 +181,6 @@ public:
     //! Note: in a potential headers-first mode, this number cannot be relied upon
     unsigned int nTx;
 
-    //! (memory only) Number of transactions in the chain up to and including this block.
-    //! This value will be non-zero only if and only if transactions for this block and all its parents are available.
-    //! Change to 64-bit type when necessary; won't happen before 2030
-    unsigned int nChainTx;
-
-    //! Verification status of this block. See enum BlockStatus
-    unsigned int nStatus;
-
     //! The anchor for the tree state up to the start of this block
     uint256 hashAnchor;
 
@@ -192,9 +205,6 @@ public:
     uint256 nNonce;
     std::vector<unsigned char> nSolution;
 
-    //! (memory only) Sequential id assigned to distinguish order in which blocks are received.
-    uint32_t nSequenceId;
-
     void SetNull()
     {
         phashBlock = NULL;
@@ -206,6 +216,9 @@ public:
         nUndoPos = 0;
         nChainWork = arith_uint256();
         nChainDelay = 0;
+        nChainTargetSum = arith_uint256();
+        nMedianTimePast = 0;
+        fHaveAggregates = false;
         nTx = 0;
         nChainTx = 0;
         nStatus = 0;
@@ -290,6 +303,11 @@ public:
     enum { nMedianTimeSpan=11 };
 
     int64_t GetMedianTimePast() const
+    {
+        return fHaveAggregates ? nMedianTimePast : ComputeMedianTimePast();
+    }
+
+    int64_t ComputeMedianTimePast() const
     {
         int64_t pmedian[nMedianTimeSpan];
         int64_t* pbegin = &pmedian[nMedianTimeSpan];
@@ -337,6 +355,10 @@ public:
     //! Build the skiplist pointer for this entry.
     void BuildSkip();
 
+    //! Build the aggregates of the chain for this entry, from those of pprev. Entries whose pprev has
+    //! none are left without, and GetMedianTimePast and GetNextWorkRequired walk their ancestors.
+    void BuildAggregates();
+
     //! Efficiently find an ancestor of this block.
     CBlockIndex* GetAncestor(int height);
     const CBlockIndex* GetAncestor(int height) const;
@@ -489,6 +511,30 @@ public:
     const CBlockIndex *FindFork(const CBlockIndex *pindex) const;
 };
 
+/**
+ * The logical timestamps of the blocks of a chain by height, as the timestamp index writes them: the
+ * block time, raised to one more than the logical timestamp of the parent when not above it, so that
+ * they strictly increase along the chain even where blocks are timestamped before their parents, and
+ * a range of them is found with a binary search. The genesis block, not connected, has none and is
+ * kept as 0. Sync() catches up with the chain from its fork point with the tip it last synced to.
+ */
+class CChainLogicalTimes {
+private:
+    std::vector<unsigned int> vTimes;
+    const CBlockIndex* pindexLast = NULL;
+
+public:
+    void Sync(const CChain& chain);
+
+    void Clear() {
+        vTimes.clear();
+        pindexLast = NULL;
+    }
+
+    /** The hashes of the blocks of the chain synced to with a logical timestamp in [nLow, nHigh), from the oldest. */
+    void FindRange(const CChain& chain, unsigned int nLow, unsigned int nHigh, std::vector<std::pair<uint256, unsigned int> >& vHashes) const;
+};
+
 class CHistoricalChain : public CChain {
 private:
     const CChain& chain;
@@ -0,0 +1,454 @@
+#include "chaindata.h"
+
+#include "blockcompression.h"
+#include "chain.h"
+#include "clientversion.h"
+#include "hash.h"
+#include "init.h"
+#include "main.h"
+#include "undo.h"
+#include "util.h"
+
+#include <atomic>
+#include <mutex>
+#include <thread>
+
+#include <boost/filesystem.hpp>
+
+namespace {
+
+//! Sanity limit of the size of a column read back
+const uint64_t MAX_CHAIN_DATA_COLUMN_SIZE = 1ULL << 32;
+
+} // anon namespace
+
+CChainDataTable::CChainDataTable(const std::string& strNameIn,
+                                 const std::vector<std::pair<std::string, ChainDataType>>& vColumnsIn)
+    : strName(strNameIn)
+{
+    vColumns.reserve(vColumnsIn.size());
+    for (const auto& column : vColumnsIn)
+        vColumns.push_back(Column{column.first, column.second, CDataStream(SER_DISK, CLIENT_VERSION)});
+}
+
+void CChainDataTable::Put(size_t nColumn, int64_t nValue)
+{
+    assert(vColumns[nColumn].type == ChainDataType::INT64);
+    vColumns[nColumn].data << nValue;
+}
+
+void CChainDataTable::Put(size_t nColumn, const uint256& hash)
+{
+    assert(vColumns[nColumn].type == ChainDataType::HASH);
+    vColumns[nColumn].data << hash;
+}
+
+void CChainDataTable::Put(size_t nColumn, const uint160& hash)
+{
+    Put(nColumn, std::vector<unsigned char>(hash.begin(), hash.end()));
+}
+
+void CChainDataTable::Put(size_t nColumn, const std::vector<unsigned char>& vch)
+{
+    assert(vColumns[nColumn].type == ChainDataType::BYTES);
+    vColumns[nColumn].data << vch;
+}
+
+void CChainDataTable::Write(CAutoFile& file, int nFirstHeight, int nLastHeight, int nCompressionLevel) const
+{
+    CHashWriter hasher(SER_GETHASH, PROTOCOL_VERSION);
+    auto write = [&file, &hasher](const char* pch, size_t nSize) {
+        file.write(pch, nSize);
+        hasher.write(pch, nSize);
+    };
+    auto writeStream = [&write](const CDataStream& ss) {
+        if (!ss.empty())
+            write(&ss[0], ss.size());
+    };
+    CDataStream ssHeader(SER_DISK, CLIENT_VERSION);
+    ssHeader << CHAIN_DATA_MAGIC << CHAIN_DATA_VERSION << strName << nFirstHeight << nLastHeight << nRows
+             << (uint32_t)vColumns.size();
+    writeStream(ssHeader);
+
+    for (const Column& column : vColumns) {
+        CSerializeData vCompressed;
+        const bool fCompressed = nCompressionLevel > 0 && !column.data.empty() &&
+                                 CompressData(&column.data[0], &column.data[0] + column.data.size(), nCompressionLevel, vCompressed) &&
+                                 vCompressed.size() < column.data.size();
+
+        CDataStream ssColumn(SER_DISK, CLIENT_VERSION);
+        ssColumn << column.strName << (uint8_t)column.type << (uint8_t)fCompressed << (uint64_t)column.data.size()
+                 << (uint64_t)(fCompressed ? vCompressed.size() : column.data.size());
+        writeStream(ssColumn);
+        if (fCompressed)
+            write(vCompressed.data(), vCompressed.size());
+        else
+            writeStream(column.data);
+    }
+    file << hasher.GetHash();
+}
+
+CChainDataTable CChainDataTable::Read(CAutoFile& file, int& nFirstHeight, int& nLastHeight)
+{
+    CHashWriter hasher(SER_GETHASH, PROTOCOL_VERSION);
+    auto read = [&file, &hasher](auto& obj) {
+        file >> obj;
+        hasher << obj;
+    };
+    uint32_t nMagic, nVersion, nColumns;
+    std::string strName;
+    uint64_t nRows;
+    read(nMagic);
+    read(nVersion);
+    if (nMagic != CHAIN_DATA_MAGIC || nVersion != CHAIN_DATA_VERSION)
+        throw std::runtime_error("not a chain data file of a known version");
+    read(strName);
+    read(nFirstHeight);
+    read(nLastHeight);
+    read(nRows);
+    read(nColumns);
+
+    CChainDataTable table(strName, {});
+    table.nRows = nRows;
+    for (uint32_t i = 0; i < nColumns; i++) {
+        std::string strColumn;
+        uint8_t nType, fCompressed;
+        uint64_t nRawSize, nStoredSize;
+        read(strColumn);
+        read(nType);
+        read(fCompressed);
+        read(nRawSize);
+        read(nStoredSize);
+        if (nRawSize > MAX_CHAIN_DATA_COLUMN_SIZE || nStoredSize > MAX_CHAIN_DATA_COLUMN_SIZE)
+            throw std::runtime_error("column " + strColumn + " too large");
+        const ChainDataType type = (ChainDataType)nType;
+        if (type != ChainDataType::INT64 && type != ChainDataType::HASH && type != ChainDataType::BYTES)
+            throw std::runtime_error("unknown type of column " + strColumn);
+
+        CSerializeData vStored(nStoredSize);
+        file.read(vStored.data(), nStoredSize);
+        hasher.write(vStored.data(), nStoredSize);
+        CDataStream data(SER_DISK, CLIENT_VERSION);
+        if (fCompressed) {
+            CSerializeData vRaw;
+            if (!DecompressData(vStored.data(), vStored.data() + vStored.size(), nRawSize, vRaw) || vRaw.size() != nRawSize)
+                throw std::runtime_error("invalid compressed column " + strColumn);
+            data.write(vRaw.data(), vRaw.size());
+        } else {
+            if (nStoredSize != nRawSize)
+                throw std::runtime_error("invalid size of column " + strColumn);
+            data.write(vStored.data(), vStored.size());
+        }
+        if ((type == ChainDataType::INT64 && nRawSize != nRows * 8) || (type == ChainDataType::HASH && nRawSize != nRows * 32))
+            throw std::runtime_error("invalid size of column " + strColumn);
+        table.vColumns.push_back(Column{strColumn, type, std::move(data)});
+    }
+
+    uint256 hash;
+    file >> hash;
+    if (hash != hasher.GetHash())
+        throw std::runtime_error("the hash of the file does not match its data");
+    return table;
+}
+
+namespace {
+
+enum ChainDataTableId {
+    TABLE_BLOCKS,
+    TABLE_TRANSACTIONS,
+    TABLE_CERTIFICATES,
+    TABLE_INPUTS,
+    TABLE_OUTPUTS,
+    TABLE_BACKWARD_TRANSFERS,
+    TABLE_SC_CREATIONS,
+    TABLE_FORWARD_TRANSFERS,
+    TABLE_BWT_REQUESTS,
+    TABLE_CSW_INPUTS,
+    TABLE_SC_EVENTS,
+};
+
+std::vector<CChainDataTable> NewChainDataTables()
+{
+    const ChainDataType INT64 = ChainDataType::INT64, HASH = ChainDataType::HASH, BYTES = ChainDataType::BYTES;
+    std::vector<CChainDataTable> tables;
+    tables.emplace_back("blocks", std::vector<std::pair<std::string, ChainDataType>>{
+        {"height", INT64}, {"hash", HASH}, {"prev_hash", HASH}, {"version", INT64}, {"time", INT64},
+        {"bits", INT64}, {"nonce", HASH}, {"merkle_root", HASH}, {"sc_txs_commitment", HASH},
+        {"size", INT64}, {"transactions", INT64}, {"certificates", INT64}});
+    tables.emplace_back("transactions", std::vector<std::pair<std::string, ChainDataType>>{
+        {"height", INT64}, {"position", INT64}, {"txid", HASH}, {"version", INT64}, {"size", INT64},
+        {"lock_time", INT64}, {"inputs", INT64}, {"outputs", INT64}, {"joinsplits", INT64},
+        {"sc_creations", INT64}, {"forward_transfers", INT64}, {"bwt_requests", INT64}, {"csw_inputs", INT64}});
+    tables.emplace_back("certificates", std::vector<std::pair<std::string, ChainDataType>>{
+        {"height", INT64}, {"position", INT64}, {"hash", HASH}, {"scid", HASH}, {"epoch", INT64},
+        {"quality", INT64}, {"version", INT64}, {"size", INT64}, {"inputs", INT64}, {"outputs", INT64},
+        {"backward_transfers", INT64}, {"bt_amount", INT64}, {"ft_sc_fee", INT64}, {"mbtr_sc_fee", INT64},
+        {"end_epoch_cum_sc_tx_comm_tree_root", BYTES}});
+    tables.emplace_back("inputs", std::vector<std::pair<std::string, ChainDataType>>{
+        {"height", INT64}, {"txid", HASH}, {"input", INT64}, {"prev_txid", HASH}, {"prev_output", INT64},
+        {"sequence", INT64}, {"script_sig", BYTES}, {"value", INT64}, {"script_pubkey", BYTES}});
+    tables.emplace_back("outputs", std::vector<std::pair<std::string, ChainDataType>>{
+        {"height", INT64}, {"txid", HASH}, {"output", INT64}, {"value", INT64}, {"script_pubkey", BYTES},
+        {"backward_transfer", INT64}});
+    tables.emplace_back("backward_transfers", std::vector<std::pair<std::string, ChainDataType>>{
+        {"height", INT64}, {"cert_hash", HASH}, {"scid", HASH}, {"output", INT64}, {"value", INT64},
+        {"script_pubkey", BYTES}});
+    tables.emplace_back("sc_creations", std::vector<std::pair<std::string, ChainDataType>>{
+        {"height", INT64}, {"txid", HASH}, {"output", INT64}, {"scid", HASH}, {"value", INT64},
+        {"address", HASH}, {"version", INT64}, {"withdrawal_epoch_length", INT64}, {"ft_sc_fee", INT64},
+        {"mbtr_sc_fee", INT64}, {"mbtr_data_length", INT64}, {"custom_data", BYTES}});
+    tables.emplace_back("forward_transfers", std::vector<std::pair<std::string, ChainDataType>>{
+        {"height", INT64}, {"txid", HASH}, {"output", INT64}, {"scid", HASH}, {"value", INT64},
+        {"address", HASH}, {"mc_return_address", BYTES}});
+    tables.emplace_back("bwt_requests", std::vector<std::pair<std::string, ChainDataType>>{
+        {"height", INT64}, {"txid", HASH}, {"output", INT64}, {"scid", HASH}, {"sc_fee", INT64},
+        {"mc_destination_address", BYTES}, {"request_data_fields", INT64}});
+    tables.emplace_back("csw_inputs", std::vector<std::pair<std::string, ChainDataType>>{
+        {"height", INT64}, {"txid", HASH}, {"input", INT64}, {"scid", HASH}, {"value", INT64},
+        {"nullifier", BYTES}, {"pubkey_hash", BYTES}});
+    tables.emplace_back("sc_events", std::vector<std::pair<std::string, ChainDataType>>{
+        {"height", INT64}, {"scid", HASH}, {"sections", INT64}, {"matured_amount", INT64},
+        {"prev_top_cert_hash", HASH}, {"superseded_bts", INT64}, {"ceased_bts", INT64}});
+    return tables;
+}
+
+/** A block of the range, as listed under cs_main */
+struct CChainDataBlock {
+    int nHeight;
+    uint256 hash;
+    uint256 hashPrev;
+    CDiskBlockPos pos;
+    CDiskBlockPos undoPos;
+};
+
+void AddInputs(std::vector<CChainDataTable>& tables, int nHeight, const CTransactionBase& tx, const CTxUndo* pundo)
+{
+    for (size_t i = 0; i < tx.GetVin().size(); i++) {
+        const CTxIn& in = tx.GetVin()[i];
+        const CTxOut* pspent = pundo && i < pundo->vprevout.size() ? &pundo->vprevout[i].txout : nullptr;
+        tables[TABLE_INPUTS].AddRow(nHeight, tx.GetHash(), (int64_t)i, in.prevout.hash, (int64_t)in.prevout.n,
+                                    (int64_t)in.nSequence, std::vector<unsigned char>(in.scriptSig.begin(), in.scriptSig.end()),
+                                    pspent ? pspent->nValue : 0,
+                                    pspent ? std::vector<unsigned char>(pspent->scriptPubKey.begin(), pspent->scriptPubKey.end())
+                                           : std::vector<unsigned char>());
+    }
+}
+
+void AddOutputs(std::vector<CChainDataTable>& tables, int nHeight, const CTransactionBase& tx)
+{
+    for (size_t i = 0; i < tx.GetVout().size(); i++) {
+        const CTxOut& out = tx.GetVout()[i];
+        tables[TABLE_OUTPUTS].AddRow(nHeight, tx.GetHash(), (int64_t)i, out.nValue,
+                                     std::vector<unsigned char>(out.scriptPubKey.begin(), out.scriptPubKey.end()),
+                                     (int64_t)tx.IsBackwardTransfer(i));
+    }
+}
+
+void AddBlock(std::vector<CChainDataTable>& tables, int nHeight, const CBlock& block, const CBlockUndo* pundo)
+{
+    tables[TABLE_BLOCKS].AddRow(nHeight, block.GetHash(), block.hashPrevBlock, (int64_t)block.nVersion, (int64_t)block.nTime,
+                                (int64_t)block.nBits, block.nNonce, block.hashMerkleRoot, block.hashScTxsCommitment,
+                                (int64_t)::GetSerializeSize(block, SER_NETWORK, PROTOCOL_VERSION),
+                                (int64_t)block.vtx.size(), (int64_t)block.vcert.size());
+
+    for (size_t nTx = 0; nTx < block.vtx.size(); nTx++) {
+        const CTransaction& tx = block.vtx[nTx];
+        const uint256& txid = tx.GetHash();
+        tables[TABLE_TRANSACTIONS].AddRow(nHeight, (int64_t)nTx, txid, (int64_t)tx.nVersion, (int64_t)tx.GetSerializeSize(SER_NETWORK, PROTOCOL_VERSION),
+                                          (int64_t)tx.GetLockTime(), (int64_t)tx.GetVin().size(), (int64_t)tx.GetVout().size(),
+                                          (int64_t)tx.GetVjoinsplit().size(), (int64_t)tx.GetVscCcOut().size(),
+                                          (int64_t)tx.GetVftCcOut().size(), (int64_t)tx.GetVBwtRequestOut().size(),
+                                          (int64_t)tx.GetVcswCcIn().size());
+        // the undo data hold the spent outputs of all the transactions but the coinbase
+        const CTxUndo* ptxundo = pundo && nTx > 0 && nTx - 1 < pundo->vtxundo.size() ? &pundo->vtxundo[nTx - 1] : nullptr;
+        AddInputs(tables, nHeight, tx, ptxundo);
+        AddOutputs(tables, nHeight, tx);
+
+        for (size_t i = 0; i < tx.GetVscCcOut().size(); i++) {
+            const CTxScCreationOut& out = tx.GetVscCcOut()[i];
+            tables[TABLE_SC_CREATIONS].AddRow(nHeight, txid, (int64_t)i, out.GetScId(), out.nValue, out.address,
+                                              (int64_t)out.version, (int64_t)out.withdrawalEpochLength, out.forwardTransferScFee,
+                                              out.mainchainBackwardTransferRequestScFee, (int64_t)out.mainchainBackwardTransferRequestDataLength,
+                                              out.customData);
+        }
+        for (size_t i = 0; i < tx.GetVftCcOut().size(); i++) {
+            const CTxForwardTransferOut& out = tx.GetVftCcOut()[i];
+            tables[TABLE_FORWARD_TRANSFERS].AddRow(nHeight, txid, (int64_t)i, out.GetScId(), out.nValue, out.address, out.mcReturnAddress);
+        }
+        for (size_t i = 0; i < tx.GetVBwtRequestOut().size(); i++) {
+            const CBwtRequestOut& out = tx.GetVBwtRequestOut()[i];
+            tables[TABLE_BWT_REQUESTS].AddRow(nHeight, txid, (int64_t)i, out.GetScId(), out.scFee, out.mcDestinationAddress,
+                                              (int64_t)out.vScRequestData.size());
+        }
+        for (size_t i = 0; i < tx.GetVcswCcIn().size(); i++) {
+            const CTxCeasedSidechainWithdrawalInput& in = tx.GetVcswCcIn()[i];
+            tables[TABLE_CSW_INPUTS].AddRow(nHeight, txid, (int64_t)i, in.scId, in.nValue, in.nullifier.GetByteArray(), in.pubKeyHash);
+        }
+    }
+
+    for (size_t nCert = 0; nCert < block.vcert.size(); nCert++) {
+        const CScCertificate& cert = block.vcert[nCert];
+        const uint256& hash = cert.GetHash();
+        int64_t nBackwardTransfers = 0;
+        for (size_t i = 0; i < cert.GetVout().size(); i++) {
+            if (!cert.IsBackwardTransfer(i))
+                continue;
+            const CTxOut& out = cert.GetVout()[i];
+            tables[TABLE_BACKWARD_TRANSFERS].AddRow(nHeight, hash, cert.GetScId(), (int64_t)i, out.nValue,
+                                                    std::vector<unsigned char>(out.scriptPubKey.begin(), out.scriptPubKey.end()));
+            nBackwardTransfers++;
+        }
+        tables[TABLE_CERTIFICATES].AddRow(nHeight, (int64_t)nCert, hash, cert.GetScId(), (int64_t)cert.epochNumber, cert.quality,
+                                          (int64_t)cert.nVersion, (int64_t)cert.GetSerializeSize(SER_NETWORK, PROTOCOL_VERSION),
+                                          (int64_t)cert.GetVin().size(), (int64_t)cert.GetVout().size(), nBackwardTransfers,
+                                          cert.GetValueOfBackwardTransfers(), cert.forwardTransferScFee,
+                                          cert.mainchainBackwardTransferRequestScFee, cert.endEpochCumScTxCommTreeRoot.GetByteArray());
+        const size_t nUndo = block.vtx.size() - 1 + nCert;
+        AddInputs(tables, nHeight, cert, pundo && nUndo < pundo->vtxundo.size() ? &pundo->vtxundo[nUndo] : nullptr);
+        AddOutputs(tables, nHeight, cert);
+    }
+
+    if (pundo) {
+        for (const auto& entry : pundo->scUndoDatabyScId) {
+            const CSidechainUndoData& data = entry.second;
+            tables[TABLE_SC_EVENTS].AddRow(nHeight, entry.first, (int64_t)data.contentBitMask,
+                                           data.contentBitMask & CSidechainUndoData::AvailableSections::MATURED_AMOUNTS ? data.appliedMaturedAmount : 0,
+                                           data.contentBitMask & CSidechainUndoData::AvailableSections::ANY_EPOCH_CERT_DATA ? data.prevTopCommittedCertHash : uint256(),
+                                           (int64_t)data.lowQualityBwts.size(), (int64_t)data.ceasedBwts.size());
+        }
+    }
+}
+
+} // anon namespace
+
+bool ExportChainData(const boost::filesystem::path& dir, int nFromHeight, int nToHeight, int nThreads,
+                     int nCompressionLevel, CChainDataExportInfo& info, std::string& strError)
+{
+    std::vector<CChainDataBlock> vBlocks;
+    {
+        LOCK(cs_main);
+        if (nToHeight < 0 || nToHeight > chainActive.Height())
+            nToHeight = chainActive.Height();
+        if (nFromHeight < 0 || nFromHeight > nToHeight) {
+            strError = strprintf("invalid height range %d-%d", nFromHeight, nToHeight);
+            return false;
+        }
+        vBlocks.reserve(nToHeight - nFromHeight + 1);
+        for (int nHeight = nFromHeight; nHeight <= nToHeight; nHeight++) {
+            const CBlockIndex* pindex = chainActive[nHeight];
+            if (!(pindex->nStatus & BLOCK_HAVE_DATA)) {
+                strError = strprintf("block %d is not stored, it was pruned", nHeight);
+                return false;
+            }
+            vBlocks.push_back(CChainDataBlock{nHeight, pindex->GetBlockHash(),
+                                              pindex->pprev ? pindex->pprev->GetBlockHash() : uint256(),
+                                              pindex->GetBlockPos(), pindex->GetUndoPos()});
+        }
+    }
+    info.nFromHeight = nFromHeight;
+    info.nToHeight = nToHeight;
+
+    // the chunks, as their ranges in vBlocks
+    std::vector<std::pair<size_t, size_t>> vChunks;
+    for (size_t nBegin = 0; nBegin < vBlocks.size(); ) {
+        const int nChunkEnd = (vBlocks[nBegin].nHeight / CHAIN_DATA_CHUNK_BLOCKS + 1) * CHAIN_DATA_CHUNK_BLOCKS;
+        const size_t nEnd = std::min(vBlocks.size(), nBegin + (nChunkEnd - vBlocks[nBegin].nHeight));
+        vChunks.emplace_back(nBegin, nEnd);
+        nBegin = nEnd;
+    }
+
+    try {
+        for (const CChainDataTable& table : NewChainDataTables())
+            boost::filesystem::create_directories(dir / table.GetName());
+    } catch (const boost::filesystem::filesystem_error& e) {
+        strError = e.what();
+        return false;
+    }
+
+    std::mutex cs;
+    std::atomic<size_t> nNextChunk(0);
+    std::atomic<bool> fFailed(false);
+    auto worker = [&]() {
+        while (!fFailed) {
+            const size_t nChunk = nNextChunk++;
+            if (nChunk >= vChunks.size())
+                return;
+            std::string strChunkError;
+            std::vector<CChainDataTable> tables = NewChainDataTables();
+            uint64_t nTransactions = 0, nCertificates = 0, nFiles = 0, nBytes = 0;
+            for (size_t i = vChunks[nChunk].first; i < vChunks[nChunk].second && strChunkError.empty(); i++) {
+                if (ShutdownRequested()) {
+                    strChunkError = "shutdown requested";
+                    break;
+                }
+                const CChainDataBlock& entry = vBlocks[i];
+                CBlock block;
+                // the blocks of the active chain had their proof of work checked when they were accepted
+                if (!ReadBlockFromDisk(block, entry.pos, false) || block.GetHash() != entry.hash) {
+                    strChunkError = strprintf("failed to read block %d", entry.nHeight);
+                    break;
+                }
+                CBlockUndo blockundo(block.nVersion == BLOCK_VERSION_SC_SUPPORT ? IncludeScAttributes::ON : IncludeScAttributes::OFF);
+                const bool fUndo = !entry.undoPos.IsNull();
+                if (fUndo && !UndoReadFromDisk(blockundo, entry.undoPos, entry.hashPrev)) {
+                    strChunkError = strprintf("failed to read the undo data of block %d", entry.nHeight);
+                    break;
+                }
+                AddBlock(tables, entry.nHeight, block, fUndo ? &blockundo : nullptr);
+                nTransactions += block.vtx.size();
+                nCertificates += block.vcert.size();
+            }
+
+            const int nFirst = vBlocks[vChunks[nChunk].first].nHeight;
+            const int nLast = vBlocks[vChunks[nChunk].second - 1].nHeight;
+            const std::string strFile = strprintf("%08d-%08d.zcol", nFirst, nLast);
+            for (size_t t = 0; t < tables.size() && strChunkError.empty(); t++) {
+                const boost::filesystem::path path = dir / tables[t].GetName() / strFile;
+                const boost::filesystem::path pathTmp = path.string() + ".incomplete";
+                try {
+                    {
+                        CAutoFile file(fopen(pathTmp.string().c_str(), "wb"), SER_DISK, CLIENT_VERSION);
+                        if (file.IsNull()) {
+                            strChunkError = strprintf("cannot open %s for writing", pathTmp.string());
+                            break;
+                        }
+                        tables[t].Write(file, nFirst, nLast, nCompressionLevel);
+                        if (fflush(file.Get()) != 0)
+                            throw std::runtime_error("failed to flush " + pathTmp.string());
+                        FileCommit(file.Get());
+                    }
+                    nBytes += boost::filesystem::file_size(pathTmp);
+                    boost::filesystem::rename(pathTmp, path);
+                    nFiles++;
+                } catch (const std::exception& e) {
+                    strChunkError = strprintf("failed to write %s: %s", path.string(), e.what());
+                    boost::system::error_code ec;
+                    boost::filesystem::remove(pathTmp, ec);
+                }
+            }
+
+            std::lock_guard<std::mutex> lock(cs);
+            if (!strChunkError.empty()) {
+                if (!fFailed)
+                    strError = strChunkError;
+                fFailed = true;
+                return;
+            }
+            info.nTransactions += nTransactions;
+            info.nCertificates += nCertificates;
+            info.nFiles += nFiles;
+            info.nBytes += nBytes;
+        }
+    };
+
+    std::vector<std::thread> vThreads;
+    const size_t nWorkers = std::max<size_t>(1, std::min<size_t>(nThreads, vChunks.size()));
+    for (size_t i = 1; i < nWorkers; i++)
+        vThreads.emplace_back([&worker] { RenameThread("zen-chaindata"); worker(); });
+    worker();
+    for (std::thread& thread : vThreads)
+        thread.join();
+
+    LogPrintf("%s: exported the blocks %d to %d, %u files of %u bytes\n", __func__, nFromHeight, nToHeight, info.nFiles, info.nBytes);
+    return !fFailed;
+}
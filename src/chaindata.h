@@ -0,0 +1,111 @@
+#ifndef BITCOIN_CHAINDATA_H
+#define BITCOIN_CHAINDATA_H
+
+#include "serialize.h"
+#include "streams.h"
+#include "uint256.h"
+
+#include <assert.h>
+#include <stdint.h>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <boost/filesystem/path.hpp>
+
+class CAutoFile;
+
+/**
+ * The chain data export writes the blocks of a height range of the active chain as tables of rows,
+ * for analytics: the blocks, their transactions, certificates, inputs and outputs, the backward
+ * transfers of the certificates, the sidechain creations, forward transfers, backward transfer
+ * requests and ceased sidechain withdrawals of the transactions, and the sidechain state transitions
+ * recorded in the undo data. Each table of each chunk of CHAIN_DATA_CHUNK_BLOCKS heights is a file
+ * of its own, <dir>/<table>/<first height>-<last height>.zcol, so that chunks are written in
+ * parallel and an export is extended by exporting the heights after it to the same directory.
+ *
+ * The data of a file are stored by column: after a header naming the table, its height range, its
+ * rows and its columns, each column is the sequence of its values, as a single zstd frame when the
+ * node is built with zstd. The file ends with the hash of everything before it.
+ */
+static const uint32_t CHAIN_DATA_MAGIC = 0x7a636f6c; // "zcol"
+static const uint32_t CHAIN_DATA_VERSION = 1;
+//! The heights of a chunk, aligned on multiples of it
+static const int CHAIN_DATA_CHUNK_BLOCKS = 2000;
+//! dumpchaindata default, the zstd level of the columns
+static const int DEFAULT_CHAIN_DATA_COMPRESSION_LEVEL = 3;
+
+/** How the values of a column are serialized one after the other */
+enum class ChainDataType : uint8_t {
+    //! 8 bytes, little endian
+    INT64 = 1,
+    //! 32 bytes, in the serialization order of uint256
+    HASH = 2,
+    //! The compact size of the length, then the bytes
+    BYTES = 3,
+};
+
+/** A table of a chunk, built row after row and written column by column */
+class CChainDataTable
+{
+public:
+    struct Column {
+        std::string strName;
+        ChainDataType type;
+        CDataStream data;
+    };
+
+    CChainDataTable(const std::string& strNameIn, const std::vector<std::pair<std::string, ChainDataType>>& vColumnsIn);
+
+    const std::string& GetName() const { return strName; }
+    const std::vector<Column>& GetColumns() const { return vColumns; }
+    uint64_t GetRows() const { return nRows; }
+
+    //! Append a row, with a value for each column in order
+    template <typename... Args>
+    void AddRow(const Args&... args)
+    {
+        static_assert(sizeof...(Args) > 0, "a row has values");
+        assert(sizeof...(Args) == vColumns.size());
+        size_t nColumn = 0;
+        (Put(nColumn++, args), ...);
+        nRows++;
+    }
+
+    //! Write the table of the heights from nFirstHeight to nLastHeight, throws on I/O errors
+    void Write(CAutoFile& file, int nFirstHeight, int nLastHeight, int nCompressionLevel) const;
+    //! Read a table written by Write, throws on I/O errors and on corrupted files
+    static CChainDataTable Read(CAutoFile& file, int& nFirstHeight, int& nLastHeight);
+
+private:
+    std::string strName;
+    std::vector<Column> vColumns;
+    uint64_t nRows = 0;
+
+    void Put(size_t nColumn, int64_t nValue);
+    void Put(size_t nColumn, const uint256& hash);
+    void Put(size_t nColumn, const uint160& hash);
+    void Put(size_t nColumn, const std::vector<unsigned char>& vch);
+};
+
+/** What an export went through */
+struct CChainDataExportInfo
+{
+    int nFromHeight = -1;
+    int nToHeight = -1;
+    uint64_t nFiles = 0;
+    uint64_t nBytes = 0;
+    uint64_t nTransactions = 0;
+    uint64_t nCertificates = 0;
+};
+
+/**
+ * Export the blocks of the active chain from nFromHeight to nToHeight into dir, the chunks being
+ * read from the block and undo files by nThreads workers. cs_main is only taken to list the blocks
+ * to export. The files are written under a temporary name and renamed once complete, replacing
+ * those of the same name.
+ */
+bool ExportChainData(const boost::filesystem::path& dir, int nFromHeight, int nToHeight, int nThreads,
+                     int nCompressionLevel, CChainDataExportInfo& info, std::string& strError);
+
+#endif // BITCOIN_CHAINDATA_H
@@ -6,9 +6,12 @@
 #define BITCOIN_CHECKQUEUE_H
 
 #include <algorithm>
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <utility>
 #include <vector>
 
-#include <boost/foreach.hpp>
 #include <boost/thread/condition_variable.hpp>
 #include <boost/thread/locks.hpp>
 #include <boost/thread/mutex.hpp>
@@ -18,117 +21,157 @@ class CCheckQueueControl;
 
 /** 
  * Queue for verifications that have to be performed.
-  * The verifications are represented by a type T, which must provide an
-  * operator(), returning a bool.
+  * The verifications are represented by a type T, which must be default
+  * constructible and provide an operator(), returning a bool. They are
+  * moved around with T::swap when there is one, as for CScriptCheck, or
+  * else with std::swap.
   *
   * One thread (the master) is assumed to push batches of verifications
   * onto the queue, where they are processed by N-1 worker threads. When
   * the master is done adding work, it temporarily joins the worker pool
   * as an N'th worker, until all jobs are done.
+  *
+  * Each worker owns a deque of batches, the master too. The master deals
+  * its batches over the deques in turn, without any lock shared by all the
+  * workers; a worker runs the newest batches of its own deque first and,
+  * when it runs dry, steals the oldest batch of the others. Only the idle
+  * workers and the waiting master take the common mutex, to sleep.
   */
 template <typename T>
 class CCheckQueue
 {
 private:
-    //! Mutex to protect the inner state
-    boost::mutex mutex;
-
-    //! Worker threads block on this when out of work
-    boost::condition_variable condWorker;
+    typedef std::vector<T> Batch;
 
-    //! Master thread blocks on this when out of work
-    boost::condition_variable condMaster;
+    //! The batches dealt to one worker
+    struct WorkerQueue
+    {
+        boost::mutex mutex;
+        std::deque<Batch> batches;
+    };
 
-    //! The queue of elements to be processed.
-    //! As the order of booleans doesn't matter, it is used as a LIFO (stack)
-    std::vector<T> queue;
+    //! The queues of the workers, the first one being the master's. Workers beyond them share them.
+    const unsigned int nWorkerQueues;
+    std::unique_ptr<WorkerQueue[]> vWorkerQueues;
 
-    //! The number of workers (including the master) that are idle.
-    int nIdle;
+    //! The number of worker threads which joined, without the master
+    std::atomic<unsigned int> nWorkers;
 
-    //! The total number of workers (including the master).
-    int nTotal;
-
-    //! The temporary evaluation result.
-    bool fAllOk;
+    //! The number of batches in the worker queues
+    std::atomic<unsigned int> nQueued;
 
     /**
      * Number of verifications that haven't completed yet.
      * This includes elements that are no longer queued, but still in the
      * worker's own batches.
      */
-    unsigned int nTodo;
+    std::atomic<unsigned int> nTodo;
+
+    //! The temporary evaluation result.
+    std::atomic<bool> fAllOk;
+
+    //! The number of workers sleeping on condWorker
+    std::atomic<int> nIdle;
+
+    //! Mutex to sleep and wake up on: the queues have their own
+    boost::mutex mutex;
+
+    //! Worker threads block on this when out of work
+    boost::condition_variable condWorker;
+
+    //! Master thread blocks on this when out of work
+    boost::condition_variable condMaster;
 
-    //! Whether we're shutting down.
-    bool fQuit;
+    //! The maximum number of elements to be processed in one batch: the cheaper the checks, the larger it pays to make it
+    const unsigned int nBatchSize;
 
-    //! The maximum number of elements to be processed in one batch
-    unsigned int nBatchSize;
+    //! The worker queue the next batch is dealt to, only used by the master
+    unsigned int nNextQueue;
+
+    template <typename U>
+    static auto SwapCheck(U& a, U& b, int) -> decltype(a.swap(b), void()) { a.swap(b); }
+    template <typename U>
+    static void SwapCheck(U& a, U& b, long) { using std::swap; swap(a, b); }
+
+    //! The queues in use: the master's one and one per worker, as long as there are enough of them
+    unsigned int ActiveQueues() const
+    {
+        return std::min(nWorkerQueues, nWorkers.load() + 1);
+    }
+
+    //! Take the newest batch of queue nOwn or else steal the oldest one of another queue
+    bool Pop(unsigned int nOwn, Batch& batch)
+    {
+        const unsigned int nActive = ActiveQueues();
+        for (unsigned int i = 0; i < nActive && nQueued != 0; i++) {
+            WorkerQueue& queue = vWorkerQueues[(nOwn + i) % nActive];
+            boost::unique_lock<boost::mutex> lock(queue.mutex);
+            if (queue.batches.empty())
+                continue;
+            if (i == 0) {
+                batch.swap(queue.batches.back());
+                queue.batches.pop_back();
+            } else {
+                batch.swap(queue.batches.front());
+                queue.batches.pop_front();
+            }
+            nQueued--;
+            return true;
+        }
+        return false;
+    }
 
     /** Internal function that does bulk of the verification work. */
     bool Loop(bool fMaster = false)
     {
-        boost::condition_variable& cond = fMaster ? condMaster : condWorker;
-        std::vector<T> vChecks;
-        vChecks.reserve(nBatchSize);
-        unsigned int nNow = 0;
-        bool fOk = true;
+        const unsigned int nOwn = fMaster ? 0 : 1 + nWorkers++ % (nWorkerQueues - 1);
+        Batch batch;
         do {
-            {
-                boost::unique_lock<boost::mutex> lock(mutex);
-                // first do the clean-up of the previous loop run (allowing us to do it in the same critsect)
-                if (nNow) {
-                    fAllOk &= fOk;
-                    nTodo -= nNow;
-                    if (nTodo == 0 && !fMaster)
-                        // We processed the last element; inform the master it can exit and return the result
-                        condMaster.notify_one();
-                } else {
-                    // first iteration
-                    nTotal++;
+            if (Pop(nOwn, batch)) {
+                const unsigned int nNow = batch.size();
+                // once a check failed, the remaining ones are only accounted for
+                for (T& check : batch) {
+                    if (!fAllOk)
+                        break;
+                    if (!check())
+                        fAllOk = false;
                 }
-                // logically, the do loop starts here
-                while (queue.empty()) {
-                    if ((fMaster || fQuit) && nTodo == 0) {
-                        nTotal--;
-                        bool fRet = fAllOk;
-                        // reset the status for new work later
-                        if (fMaster)
-                            fAllOk = true;
-                        // return the current status
-                        return fRet;
-                    }
-                    nIdle++;
-                    cond.wait(lock); // wait
-                    nIdle--;
+                batch.clear();
+                if (nTodo.fetch_sub(nNow) == nNow && !fMaster) {
+                    // We processed the last element; inform the master it can exit and return the result
+                    boost::unique_lock<boost::mutex> lock(mutex);
+                    condMaster.notify_one();
                 }
-                // Decide how many work units to process now.
-                // * Do not try to do everything at once, but aim for increasingly smaller batches so
-                //   all workers finish approximately simultaneously.
-                // * Try to account for idle jobs which will instantly start helping.
-                // * Don't do batches smaller than 1 (duh), or larger than nBatchSize.
-                nNow = std::max(1U, std::min(nBatchSize, (unsigned int)queue.size() / (nTotal + nIdle + 1)));
-                vChecks.resize(nNow);
-                for (unsigned int i = 0; i < nNow; i++) {
-                    // We want the lock on the mutex to be as short as possible, so swap jobs from the global
-                    // queue to the local batch vector instead of copying.
-                    vChecks[i].swap(queue.back());
-                    queue.pop_back();
+                continue;
+            }
+
+            boost::unique_lock<boost::mutex> lock(mutex);
+            if (fMaster) {
+                // the batches being run by the workers are left, unless some are still queued
+                while (nTodo != 0 && nQueued == 0)
+                    condMaster.wait(lock);
+                if (nTodo == 0) {
+                    bool fRet = fAllOk;
+                    // reset the status for new work later
+                    fAllOk = true;
+                    // return the current status
+                    return fRet;
                 }
-                // Check whether we need to do work at all
-                fOk = fAllOk;
+            } else {
+                // Add reads nIdle after queueing its batches, hence it either notifies us or we see them
+                nIdle++;
+                while (nQueued == 0)
+                    condWorker.wait(lock); // wait
+                nIdle--;
             }
-            // execute work
-            BOOST_FOREACH (T& check, vChecks)
-                if (fOk)
-                    fOk = check();
-            vChecks.clear();
         } while (true);
     }
 
 public:
     //! Create a new check queue
-    CCheckQueue(unsigned int nBatchSizeIn) : nIdle(0), nTotal(0), fAllOk(true), nTodo(0), fQuit(false), nBatchSize(nBatchSizeIn) {}
+    CCheckQueue(unsigned int nBatchSizeIn, unsigned int nWorkerQueuesIn = 64) :
+        nWorkerQueues(std::max(2U, nWorkerQueuesIn)), vWorkerQueues(new WorkerQueue[nWorkerQueues]),
+        nWorkers(0), nQueued(0), nTodo(0), fAllOk(true), nIdle(0), nBatchSize(std::max(1U, nBatchSizeIn)), nNextQueue(0) {}
 
     //! Worker thread
     void Thread()
@@ -142,19 +185,38 @@ public:
         return Loop(true);
     }
 
-    //! Add a batch of checks to the queue
+    /**
+     * Add a batch of checks to the queue. They are split in about four batches per queue in use, so
+     * that stealing can still even out checks of different costs, capped at nBatchSize checks.
+     */
     void Add(std::vector<T>& vChecks)
     {
-        boost::unique_lock<boost::mutex> lock(mutex);
-        BOOST_FOREACH (T& check, vChecks) {
-            queue.push_back(T());
-            check.swap(queue.back());
-        }
+        if (vChecks.empty())
+            return;
+
+        const unsigned int nActive = ActiveQueues();
+        const unsigned int nBatch = std::max(1U, std::min(nBatchSize, (unsigned int)vChecks.size() / (4 * nActive)));
+        // the checks are accounted for before a worker can complete them
         nTodo += vChecks.size();
-        if (vChecks.size() == 1)
-            condWorker.notify_one();
-        else if (vChecks.size() > 1)
-            condWorker.notify_all();
+        unsigned int nBatches = 0;
+        for (size_t i = 0; i < vChecks.size(); i += nBatch, nBatches++) {
+            Batch batch(std::min<size_t>(nBatch, vChecks.size() - i));
+            for (size_t j = 0; j < batch.size(); j++)
+                SwapCheck(batch[j], vChecks[i + j], 0);
+
+            WorkerQueue& queue = vWorkerQueues[nNextQueue++ % nActive];
+            boost::unique_lock<boost::mutex> lock(queue.mutex);
+            queue.batches.push_back(std::move(batch));
+            nQueued++;
+        }
+
+        if (nIdle != 0) {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            if (nBatches == 1)
+                condWorker.notify_one();
+            else
+                condWorker.notify_all();
+        }
     }
 
     ~CCheckQueue()
@@ -163,8 +225,7 @@ public:
 
     bool IsIdle()
     {
-        boost::unique_lock<boost::mutex> lock(mutex);
-        return (nTotal == nIdle && nTodo == 0 && fAllOk == true);
+        return nTodo == 0 && nQueued == 0 && fAllOk;
     }
 
 };
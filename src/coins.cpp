@@ -9,6 +9,8 @@
 #include "policy/fees.h"
 
 #include <assert.h>
+#include <algorithm>
+#include <future>
 #include "utilmoneystr.h"
 #include <undo.h>
 #include <chainparams.h>
@@ -87,6 +89,8 @@ void CCoins::Cleanup() {
 
     if (vout.empty())
         std::vector<CTxOut>().swap(vout);
+    else if (vout.capacity() > 2 * vout.size())
+        vout.shrink_to_fit();
 }
 
 void CCoins::ClearUnspendable() {
@@ -154,6 +158,8 @@ bool CCoins::Spend(uint32_t nPos)
         return false;
 
     vout[nPos].SetNull();
+    // clear() keeps the script buffer, a partially spent record would hold on to the scripts of its spent outputs
+    CScript().swap(vout[nPos].scriptPubKey);
     Cleanup();
     return true;
 }
@@ -210,6 +216,13 @@ uint256 CCoinsView::GetBestAnchor()
 bool CCoinsView::HaveCswNullifier(const uint256& scId,
                                   const CFieldElement &nullifier)               const { return false; }
 
+void CCoinsView::HaveCswNullifiers(const std::vector<std::pair<uint256, CFieldElement>>& keys, std::vector<bool>& vHave) const
+{
+    vHave.resize(keys.size());
+    for (size_t i = 0; i < keys.size(); i++)
+        vHave[i] = HaveCswNullifier(keys[i].first, keys[i].second);
+}
+
 bool CCoinsView::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock,
                             const uint256 &hashAnchor, CAnchorsMap &mapAnchors,
                             CNullifiersMap &mapNullifiers, CSidechainsMap& mapSidechains,
@@ -235,6 +248,8 @@ uint256 CCoinsViewBacked::GetBestAnchor()
 
 bool CCoinsViewBacked::HaveCswNullifier(const uint256& scId,
                                         const CFieldElement &nullifier)                const { return base->HaveCswNullifier(scId, nullifier); }
+void CCoinsViewBacked::HaveCswNullifiers(const std::vector<std::pair<uint256, CFieldElement>>& keys,
+                                         std::vector<bool>& vHave)                     const { base->HaveCswNullifiers(keys, vHave); }
 
 void CCoinsViewBacked::SetBackend(CCoinsView &viewIn) { base = &viewIn; }
 bool CCoinsViewBacked::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock,
@@ -246,19 +261,15 @@ bool CCoinsViewBacked::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock,
                                                                                               mapSidechainEvents, cswNullifiers); }
 bool CCoinsViewBacked::GetStats(CCoinsStats &stats)                                  const { return base->GetStats(stats); }
 
-CCoinsKeyHasher::CCoinsKeyHasher() : salt(GetRandHash()) {}
-CCswNullifiersKeyHasher::CCswNullifiersKeyHasher() : salt() {GetRandBytes(reinterpret_cast<unsigned char*>(salt), BUF_LEN);}
+CCswNullifiersKeyHasher::CCswNullifiersKeyHasher() : k0(GetFastRandomContext().rand64()), k1(GetFastRandomContext().rand64()) {}
 
 size_t CCswNullifiersKeyHasher::operator()(const std::pair<uint256, CFieldElement>& key) const {
-    uint32_t buf[BUF_LEN];
+    static_assert(CFieldElement::ByteSize() == 32, "the nullifier is hashed as 32 bytes");
 
     // nullifiers are already checked by the caller, but let's assert it too
     assert(!key.second.IsNull());
 
-    // note: we may consider buf as a raw data, so bytes size of buf is (BUF_LEN * 4)
-    memcpy(buf, key.first.begin(), sizeof(uint256));
-    memcpy((buf + sizeof(uint256)/sizeof(uint32_t)), &(key.second.GetByteArray()[0]), CFieldElement::ByteSize());
-    return CalculateHash(buf, BUF_LEN, salt);
+    return SipHash13Uint256Extra32(k0, k1, key.first, key.second.GetDataBuffer());
 }
 
 CCoinsViewCache::CCoinsViewCache(CCoinsView *baseIn) : CCoinsViewBacked(baseIn), hasModifier(false), cachedCoinsUsage(0) { }
@@ -269,13 +280,26 @@ CCoinsViewCache::~CCoinsViewCache()
 }
 
 size_t CCoinsViewCache::DynamicMemoryUsage() const {
-    return memusage::DynamicUsage(cacheCoins) +
-           memusage::DynamicUsage(cacheAnchors) +
-           memusage::DynamicUsage(cacheNullifiers) +
-           memusage::DynamicUsage(cacheSidechains) +
-           memusage::DynamicUsage(cacheSidechainEvents) +
-           memusage::DynamicUsage(cacheCswNullifiers) +
-           cachedCoinsUsage;
+    return DynamicMemoryUsageByFamily().Total();
+}
+
+CCoinsCacheUsage CCoinsViewCache::DynamicMemoryUsageByFamily() const {
+    CCoinsCacheUsage usage;
+    usage.nCoins = memusage::DynamicUsage(cacheCoins) +
+                   memusage::DynamicUsage(cacheAnchors) +
+                   memusage::DynamicUsage(cacheNullifiers) +
+                   cachedCoinsUsage;
+
+    usage.nSidechains = memusage::DynamicUsage(cacheSidechains) +
+                        memusage::DynamicUsage(cacheSidechainEvents) +
+                        memusage::DynamicUsage(cacheCswNullifiers);
+    for (const auto& entry : cacheSidechains)
+        usage.nSidechains += entry.second.sidechain.DynamicMemoryUsage();
+    for (const auto& entry : cacheSidechainEvents)
+        usage.nSidechains += entry.second.scEvents.DynamicMemoryUsage();
+    for (const auto& entry : cacheCswNullifiers)
+        usage.nSidechains += entry.first.second.DynamicMemoryUsage();
+    return usage;
 }
 
 CCoinsMap::const_iterator CCoinsViewCache::FetchCoins(const uint256 &txid) const {
@@ -296,6 +320,70 @@ CCoinsMap::const_iterator CCoinsViewCache::FetchCoins(const uint256 &txid) const
     return ret;
 }
 
+size_t CCoinsViewCache::Prefetch(const std::vector<uint256>& txids, const std::vector<uint256>& scIds, unsigned int nThreads)
+{
+    std::vector<uint256> missingCoins;
+    for (const uint256& txid : txids)
+        if (cacheCoins.count(txid) == 0)
+            missingCoins.push_back(txid);
+    std::sort(missingCoins.begin(), missingCoins.end());
+    missingCoins.erase(std::unique(missingCoins.begin(), missingCoins.end()), missingCoins.end());
+
+    std::vector<uint256> missingSidechains;
+    for (const uint256& scId : scIds)
+        if (cacheSidechains.count(scId) == 0)
+            missingSidechains.push_back(scId);
+    std::sort(missingSidechains.begin(), missingSidechains.end());
+    missingSidechains.erase(std::unique(missingSidechains.begin(), missingSidechains.end()), missingSidechains.end());
+
+    const size_t nLookups = missingCoins.size() + missingSidechains.size();
+    if (nLookups == 0)
+        return 0;
+    nThreads = std::max<unsigned int>(1, std::min<size_t>(nThreads, nLookups));
+
+    // Each worker only reads the base view and writes its own slots of the results vectors
+    std::vector<std::pair<bool, CCoins>> fetchedCoins(missingCoins.size());
+    std::vector<std::pair<bool, CSidechain>> fetchedSidechains(missingSidechains.size());
+    auto worker = [&](unsigned int nWorker) {
+        for (size_t i = nWorker; i < missingCoins.size(); i += nThreads)
+            fetchedCoins[i].first = base->GetCoins(missingCoins[i], fetchedCoins[i].second);
+        for (size_t i = nWorker; i < missingSidechains.size(); i += nThreads)
+            fetchedSidechains[i].first = base->GetSidechain(missingSidechains[i], fetchedSidechains[i].second);
+    };
+
+    std::vector<std::future<void>> workers;
+    for (unsigned int n = 1; n < nThreads; ++n)
+        workers.push_back(std::async(std::launch::async, worker, n));
+    worker(0);
+    for (auto& w : workers)
+        w.get();
+
+    // Fill the cache the same way FetchCoins/FetchSidechains do
+    size_t nFetched = 0;
+    for (size_t i = 0; i < missingCoins.size(); ++i)
+    {
+        if (!fetchedCoins[i].first)
+            continue;
+        CCoinsMap::iterator ret = cacheCoins.insert(std::make_pair(missingCoins[i], CCoinsCacheEntry())).first;
+        fetchedCoins[i].second.swap(ret->second.coins);
+        if (ret->second.coins.IsPruned())
+            ret->second.flags = CCoinsCacheEntry::FRESH;
+        cachedCoinsUsage += ret->second.coins.DynamicMemoryUsage();
+        ++nFetched;
+    }
+
+    for (size_t i = 0; i < missingSidechains.size(); ++i)
+    {
+        if (!fetchedSidechains[i].first)
+            continue;
+        CSidechainsMap::iterator ret = cacheSidechains.insert(std::make_pair(missingSidechains[i],
+                CSidechainsCacheEntry(fetchedSidechains[i].second, CSidechainsCacheEntry::Flags::DEFAULT))).first;
+            ++nFetched;
+    }
+
+    return nFetched;
+}
+
 CSidechainsMap::const_iterator CCoinsViewCache::FetchSidechains(const uint256& scId) const {
     CSidechainsMap::iterator candidateIt = cacheSidechains.find(scId);
     if (candidateIt != cacheSidechains.end())
@@ -310,7 +398,6 @@ CSidechainsMap::const_iterator CCoinsViewCache::FetchSidechains(const uint256& s
     CSidechainsMap::iterator ret =
             cacheSidechains.insert(std::make_pair(scId, CSidechainsCacheEntry(tmp, CSidechainsCacheEntry::Flags::DEFAULT ))).first;
 
-    cachedCoinsUsage += ret->second.sidechain.DynamicMemoryUsage();
     return ret;
 }
 
@@ -326,13 +413,12 @@ CSidechainsMap::iterator CCoinsViewCache::ModifySidechain(const uint256& scId) {
     else
         ret = cacheSidechains.insert(std::make_pair(scId, CSidechainsCacheEntry(tmp, CSidechainsCacheEntry::Flags::FRESH ))).first;
 
-    cachedCoinsUsage += ret->second.sidechain.DynamicMemoryUsage();
     return ret;
 }
 
 const CSidechain* const CCoinsViewCache::AccessSidechain(const uint256& scId) const {
     CSidechainsMap::const_iterator it = FetchSidechains(scId);
-    if (it == cacheSidechains.end())
+    if (it == cacheSidechains.end() || it->second.flag == CSidechainsCacheEntry::Flags::ERASED)
         return nullptr;
     else
         return &it->second.sidechain;
@@ -352,7 +438,6 @@ CSidechainEventsMap::const_iterator CCoinsViewCache::FetchSidechainEvents(int he
     CSidechainEventsMap::iterator ret =
             cacheSidechainEvents.insert(std::make_pair(height, CSidechainEventsCacheEntry(tmp, CSidechainEventsCacheEntry::Flags::DEFAULT ))).first;
 
-    cachedCoinsUsage += ret->second.scEvents.DynamicMemoryUsage();
     return ret;
 }
 
@@ -369,7 +454,6 @@ CSidechainEventsMap::iterator CCoinsViewCache::ModifySidechainEvents(int height)
     else
         ret = cacheSidechainEvents.insert(std::make_pair(height, CSidechainEventsCacheEntry(tmp, CSidechainEventsCacheEntry::Flags::DEFAULT ))).first;
 
-    cachedCoinsUsage += ret->second.scEvents.DynamicMemoryUsage();
     return ret;
 }
 
@@ -547,6 +631,33 @@ bool CCoinsViewCache::HaveCswNullifier(const uint256& scId, const CFieldElement
     return true;
 }
 
+void CCoinsViewCache::HaveCswNullifiers(const std::vector<std::pair<uint256, CFieldElement>>& keys, std::vector<bool>& vHave) const
+{
+    vHave.assign(keys.size(), false);
+    std::vector<std::pair<uint256, CFieldElement>> missing;
+    std::vector<size_t> missingPos;
+    for (size_t i = 0; i < keys.size(); i++) {
+        CCswNullifiersMap::const_iterator it = cacheCswNullifiers.find(keys[i]);
+        if (it != cacheCswNullifiers.end()) {
+            vHave[i] = it->second.flag != CCswNullifiersCacheEntry::Flags::ERASED;
+        } else {
+            missing.push_back(keys[i]);
+            missingPos.push_back(i);
+        }
+    }
+    if (missing.empty())
+        return;
+
+    std::vector<bool> vBaseHave;
+    base->HaveCswNullifiers(missing, vBaseHave);
+    for (size_t i = 0; i < missing.size(); i++) {
+        if (!vBaseHave[i])
+            continue;
+        vHave[missingPos[i]] = true;
+        cacheCswNullifiers.insert(std::make_pair(missing[i], CCswNullifiersCacheEntry{CCswNullifiersCacheEntry::Flags::DEFAULT}));
+    }
+}
+
 bool CCoinsViewCache::AddCswNullifier(const uint256& scId, const CFieldElement &nullifier) {
     if (HaveCswNullifier(scId, nullifier))
         return false;
@@ -615,8 +726,41 @@ bool CCoinsViewCache::BatchWrite(CCoinsMap &mapCoins,
                                  CSidechainEventsMap& mapSidechainEvents,
                                  CCswNullifiersMap& cswNullifiers) {
     assert(!hasModifier);
-    for (CCoinsMap::iterator it = mapCoins.begin(); it != mapCoins.end(); ++it)
-        cachedCoinsUsage += WriteCoins(it->first, it->second);
+    // The nodes of the child are moved in rather than copied: swapped in whole when this cache is empty,
+    // as after a flush, else spliced one by one for the coins new to this cache
+    const bool fSplice = mapCoins.get_allocator() == cacheCoins.get_allocator();
+    if (fSplice && cacheCoins.empty())
+    {
+        for (CCoinsMap::iterator it = mapCoins.begin(); it != mapCoins.end();)
+        {
+            // what WriteCoins would leave out, not being in this cache
+            if (!(it->second.flags & CCoinsCacheEntry::DIRTY) || it->second.coins.IsPruned())
+            {
+                it = mapCoins.erase(it);
+                continue;
+            }
+            assert(it->second.flags & CCoinsCacheEntry::FRESH);
+            cachedCoinsUsage += it->second.coins.DynamicMemoryUsage();
+            ++it;
+        }
+        cacheCoins.swap(mapCoins);
+    }
+    else
+    {
+        for (CCoinsMap::iterator it = mapCoins.begin(); it != mapCoins.end();)
+        {
+            if (fSplice && (it->second.flags & CCoinsCacheEntry::DIRTY) && !it->second.coins.IsPruned() &&
+                cacheCoins.find(it->first) == cacheCoins.end())
+            {
+                assert(it->second.flags & CCoinsCacheEntry::FRESH);
+                cachedCoinsUsage += it->second.coins.DynamicMemoryUsage();
+                cacheCoins.insert(mapCoins.extract(it++));
+                continue;
+            }
+            cachedCoinsUsage += WriteCoins(it->first, it->second);
+            ++it;
+        }
+    }
 
     mapCoins.clear();
 
@@ -666,11 +810,14 @@ bool CCoinsViewCache::BatchWrite(CCoinsMap &mapCoins,
     }
 
     // Sidechain related section
+    if (scDirectory)
+        scDirectory->Update(mapSidechains);
+    // the sidechains and their creation parameters are moved, the maps being cleared right after
     for (auto& entryToWrite : mapSidechains)
-        WriteMutableEntry(entryToWrite.first, entryToWrite.second, cacheSidechains);
+        WriteMutableEntry(entryToWrite.first, std::move(entryToWrite.second), cacheSidechains);
 
     for (auto& entryToWrite : mapSidechainEvents)
-        WriteMutableEntry(entryToWrite.first, entryToWrite.second, cacheSidechainEvents);
+        WriteMutableEntry(entryToWrite.first, std::move(entryToWrite.second), cacheSidechainEvents);
 
     for (auto& entryToWrite : cswNullifiers)
         WriteImmutableEntry(entryToWrite.first, entryToWrite.second, cacheCswNullifiers);
@@ -706,6 +853,98 @@ bool CCoinsViewCache::GetSidechain(const uint256 & scId, CSidechain& targetSidec
     return false;
 }
 
+CSidechain::State CSidechainDirectory::Entry::GetState(int height) const
+{
+    if (!fCreationConfirmed)
+        return CSidechain::State::UNCONFIRMED;
+
+    if (height >= scheduledCeasingHeight)
+        return CSidechain::State::CEASED;
+
+    return CSidechain::State::ALIVE;
+}
+
+void CSidechainDirectory::Update(const uint256& scId, const CSidechain& sidechain)
+{
+    Entry& entry = entries[scId];
+    entry.fCreationConfirmed = sidechain.isCreationConfirmed();
+    entry.scheduledCeasingHeight = sidechain.GetScheduledCeasingHeight();
+}
+
+void CSidechainDirectory::Erase(const uint256& scId)
+{
+    entries.erase(scId);
+}
+
+void CSidechainDirectory::Update(const CSidechainsMap& mapSidechains)
+{
+    for (const auto& entry : mapSidechains)
+    {
+        if (entry.second.flag == CSidechainsCacheEntry::Flags::ERASED)
+            Erase(entry.first);
+        else if (entry.second.flag != CSidechainsCacheEntry::Flags::DEFAULT)
+            Update(entry.first, entry.second.sidechain);
+    }
+}
+
+size_t CSidechainDirectory::GetPage(int height, bool bOnlyAlive, const std::set<uint256>& unconfirmedScIds, size_t from, size_t to,
+                                    std::vector<uint256>& vPage) const
+{
+    vPage.clear();
+    size_t nCount = 0;
+    auto add = [&](const uint256& scId, CSidechain::State state) {
+        if (bOnlyAlive && state != CSidechain::State::ALIVE)
+            return;
+        if (nCount >= from && nCount < to)
+            vPage.push_back(scId);
+        ++nCount;
+    };
+
+    // both are sorted, they are merged by id
+    auto it = entries.begin();
+    auto itUnconfirmed = unconfirmedScIds.begin();
+    while (it != entries.end() || itUnconfirmed != unconfirmedScIds.end())
+    {
+        if (itUnconfirmed == unconfirmedScIds.end() || (it != entries.end() && it->first < *itUnconfirmed))
+        {
+            add(it->first, it->second.GetState(height));
+            ++it;
+        }
+        else
+        {
+            if (it != entries.end() && it->first == *itUnconfirmed)
+            {
+                add(it->first, it->second.GetState(height));
+                ++it;
+            }
+            else
+                add(*itUnconfirmed, CSidechain::State::UNCONFIRMED);
+            ++itUnconfirmed;
+        }
+    }
+    return nCount;
+}
+
+const CSidechainDirectory& CCoinsViewCache::GetScDirectory() const
+{
+    if (!scDirectory)
+    {
+        scDirectory.reset(new CSidechainDirectory());
+        std::set<uint256> scIds;
+        base->GetScIds(scIds);
+        // the sidechains of the base are read without filling the cache with them
+        CSidechain sidechain;
+        for (const uint256& scId : scIds)
+        {
+            if (base->GetSidechain(scId, sidechain))
+                scDirectory->Update(scId, sidechain);
+        }
+    }
+    // the sidechains modified in this cache itself rather than written to it
+    scDirectory->Update(cacheSidechains);
+    return *scDirectory;
+}
+
 void CCoinsViewCache::GetScIds(std::set<uint256>& scIdsList) const
 {
     base->GetScIds(scIdsList);
@@ -726,10 +965,10 @@ void CCoinsViewCache::GetScIds(std::set<uint256>& scIdsList) const
 bool CCoinsViewCache::CheckQuality(const CScCertificate& cert) const
 {
     // check in blockchain if a better cert is already there for this epoch
-    CSidechain info;
-    if (GetSidechain(cert.GetScId(), info))
+    const CSidechain* const pSidechain = AccessSidechain(cert.GetScId());
+    if (pSidechain != nullptr)
     {
-        return info.CheckQuality(cert);
+        return pSidechain->CheckQuality(cert);
     }
     else
     {
@@ -1174,13 +1413,14 @@ CValidationState::Code CCoinsViewCache::IsCertApplicableToState(const CScCertifi
     LogPrint("cert", "%s():%d - called: cert[%s], scId[%s]\n",
         __func__, __LINE__, certHash.ToString(), cert.GetScId().ToString());
 
-    CSidechain sidechain;
-    if (!GetSidechain(cert.GetScId(), sidechain))
+    const CSidechain* const pSidechain = AccessSidechain(cert.GetScId());
+    if (pSidechain == nullptr)
     {
         LogPrintf("%s():%d - ERROR: cert[%s] refers to scId[%s] not yet created\n",
             __func__, __LINE__, certHash.ToString(), cert.GetScId().ToString());
         return CValidationState::Code::SCID_NOT_FOUND;
     }
+    const CSidechain& sidechain = *pSidechain;
 
     if (!Sidechain::checkCertCustomFields(sidechain, cert))
     {
@@ -1228,7 +1468,7 @@ CValidationState::Code CCoinsViewCache::IsCertApplicableToState(const CScCertifi
         return CValidationState::Code::INSUFFICIENT_SCID_FUNDS;
     }
 
-    size_t proof_plus_vk_size = sidechain.fixedParams.wCertVk.GetByteArray().size() + cert.scProof.GetByteArray().size();
+    size_t proof_plus_vk_size = sidechain.fixedParams.wCertVk.GetDataSize() + cert.scProof.GetDataSize();
     if (proof_plus_vk_size > Sidechain::MAX_PROOF_PLUS_VK_SIZE)
     {
         LogPrintf("%s():%d - ERROR: Cert [%s]\n proof plus vk size (%d) exceeded the limit %d\n",
@@ -1450,17 +1690,17 @@ CValidationState::Code CCoinsViewCache::IsScTxApplicableToState(const CTransacti
             return CValidationState::Code::INVALID;
         }
 
-        CSidechain sidechain;
-
         /**
          * Check that the sidechain exists.
          */
-        if (!GetSidechain(scId, sidechain))
+        const CSidechain* const pSidechain = AccessSidechain(scId);
+        if (pSidechain == nullptr)
         {
             LogPrintf("%s():%d - ERROR: tx[%s] MBTR output [%s] refers to unknown scId[%s]\n",
                 __func__, __LINE__, tx.ToString(), mbtr.ToString(), scId.ToString());
             return CValidationState::Code::INVALID;
         }
+        const CSidechain& sidechain = *pSidechain;
 
         /**
          * Check that the size of the Request Data field element is the same specified
@@ -1519,15 +1759,25 @@ CValidationState::Code CCoinsViewCache::IsScTxApplicableToState(const CTransacti
     // Check CSW inputs
     // Key is Sc id, value - total amount of coins to be withdrawn by Tx CSWs for given sidechain
     std::map<uint256, CAmount> cswTotalBalances;
+    if (tx.GetVcswCcIn().size() > 1)
+    {
+        // the nullifiers are fetched in one batch, the checks below then find them in the cache
+        std::vector<std::pair<uint256, CFieldElement>> cswNullifiers;
+        for(const CTxCeasedSidechainWithdrawalInput& csw: tx.GetVcswCcIn())
+            cswNullifiers.push_back(std::make_pair(csw.scId, csw.nullifier));
+        std::vector<bool> vHave;
+        HaveCswNullifiers(cswNullifiers, vHave);
+    }
     for(const CTxCeasedSidechainWithdrawalInput& csw: tx.GetVcswCcIn())
     {
-        CSidechain sidechain;
-        if (!GetSidechain(csw.scId, sidechain))
+        const CSidechain* const pSidechain = AccessSidechain(csw.scId);
+        if (pSidechain == nullptr)
         {
             LogPrintf("%s():%d - ERROR: tx[%s] CSW input [%s]\n refers to unknown scId\n",
                 __func__, __LINE__, tx.ToString(), csw.ToString());
             return CValidationState::Code::SCID_NOT_FOUND;
         }
+        const CSidechain& sidechain = *pSidechain;
 
         auto s = sidechain.GetState(*this);
         if (s != CSidechain::State::CEASED)
@@ -1544,7 +1794,7 @@ CValidationState::Code CCoinsViewCache::IsScTxApplicableToState(const CTransacti
             return CValidationState::Code::INVALID_AND_BAN;
         }
 
-        size_t proof_plus_vk_size = sidechain.fixedParams.wCeasedVk.value().GetByteArray().size() + csw.scProof.GetByteArray().size();
+        size_t proof_plus_vk_size = sidechain.fixedParams.wCeasedVk.value().GetDataSize() + csw.scProof.GetDataSize();
         if(proof_plus_vk_size > Sidechain::MAX_PROOF_PLUS_VK_SIZE)
         {
             LogPrintf("%s():%d - ERROR: Tx[%s] CSW input [%s]\n proof plus vk size (%d) exceeded the limit %d\n",
@@ -1602,8 +1852,9 @@ void CCoinsViewCache::HandleTxIndexSidechainEvents(int height, CBlockTreeDB* pbl
     //Handle Ceasing Sidechain
     for (const uint256& ceasingScId : scEvents.ceasingScs)
     {
-        CSidechain sidechain;
-        assert(GetSidechain(ceasingScId, sidechain));
+        const CSidechain* const pSidechain = AccessSidechain(ceasingScId);
+        assert(pSidechain != nullptr);
+        const CSidechain& sidechain = *pSidechain;
 
         // Temporary assert: for SC version 2 we should never be here
         assert(!sidechain.isNonCeasing());
@@ -1664,8 +1915,9 @@ void CCoinsViewCache::HandleMaturityHeightIndexSidechainEvents(int height, CBloc
     //Handle Ceasing Sidechain
     for (const uint256& ceasingScId : scEvents.ceasingScs)
     {
-        CSidechain sidechain;
-        assert(GetSidechain(ceasingScId, sidechain));
+        const CSidechain* const pSidechain = AccessSidechain(ceasingScId);
+        assert(pSidechain != nullptr);
+        const CSidechain& sidechain = *pSidechain;
 
         // Temporary assert: for SC version 2 we should never be here
         assert(!sidechain.isNonCeasing());
@@ -1721,8 +1973,9 @@ void CCoinsViewCache::HandleIndexesSidechainEvents(int height, CBlockTreeDB* pbl
     //Handle Ceasing Sidechain
     for (const uint256& ceasingScId : scEvents.ceasingScs)
     {
-        CSidechain sidechain;
-        assert(GetSidechain(ceasingScId, sidechain));
+        const CSidechain* const pSidechain = AccessSidechain(ceasingScId);
+        assert(pSidechain != nullptr);
+        const CSidechain& sidechain = *pSidechain;
 
         // Temporary assert: for SC version 2 we should never be here
         assert(!sidechain.isNonCeasing());
@@ -1895,6 +2148,35 @@ bool CCoinsViewCache::UpdateSidechain(const CScCertificate& cert, CBlockUndo& bl
     return true;
 }
 
+namespace {
+
+//! Spend the backward transfers of the coins of a certificate, appending them to nullifiedOuts
+void NullifyCertBackwardTransfers(CCoins& coins, const uint256& certHash, std::vector<CTxInUndo>& nullifiedOuts)
+{
+    // sidechains v2 have maturity == 0, so this assert is expected to fail as intended
+    assert(coins.nBwtMaturityHeight != 0);
+
+    //null all bwt outputs and add related txundo in block
+    for(int pos = coins.nFirstBwtPos; pos < coins.vout.size(); ++pos)
+    {
+        nullifiedOuts.push_back(CTxInUndo(coins.vout.at(pos)));
+        LogPrint("cert", "%s():%d - nullifying %s amount, pos=%d, cert %s\n", __func__, __LINE__,
+            FormatMoney(coins.vout.at(pos).nValue), pos, certHash.ToString());
+        coins.Spend(pos);
+        if (coins.vout.size() == 0)
+        {
+            CTxInUndo& undo         = nullifiedOuts.back();
+            undo.nHeight            = coins.nHeight;
+            undo.fCoinBase          = coins.fCoinBase;
+            undo.nVersion           = coins.nVersion;
+            undo.nFirstBwtPos       = coins.nFirstBwtPos;
+            undo.nBwtMaturityHeight = coins.nBwtMaturityHeight;
+        }
+    }
+}
+
+} // anon namespace
+
 void CCoinsViewCache::NullifyBackwardTransfers(const uint256& certHash, std::vector<CTxInUndo>& nullifiedOuts)
 {
     LogPrint("cert", "%s():%d - called for cert %s\n", __func__, __LINE__, certHash.ToString());
@@ -1909,26 +2191,7 @@ void CCoinsViewCache::NullifyBackwardTransfers(const uint256& certHash, std::vec
     }
 
     CCoinsModifier coins = this->ModifyCoins(certHash);
-    // sidechains v2 have maturity == 0, so this assert is expected to fail as intended
-    assert(coins->nBwtMaturityHeight != 0);
-
-    //null all bwt outputs and add related txundo in block
-    for(int pos = coins->nFirstBwtPos; pos < coins->vout.size(); ++pos)
-    {
-        nullifiedOuts.push_back(CTxInUndo(coins->vout.at(pos)));
-        LogPrint("cert", "%s():%d - nullifying %s amount, pos=%d, cert %s\n", __func__, __LINE__,
-            FormatMoney(coins->vout.at(pos).nValue), pos, certHash.ToString());
-        coins->Spend(pos);
-        if (coins->vout.size() == 0)
-        {
-            CTxInUndo& undo         = nullifiedOuts.back();
-            undo.nHeight            = coins->nHeight;
-            undo.fCoinBase          = coins->fCoinBase;
-            undo.nVersion           = coins->nVersion;
-            undo.nFirstBwtPos       = coins->nFirstBwtPos;
-            undo.nBwtMaturityHeight = coins->nBwtMaturityHeight;
-        }
-    }
+    NullifyCertBackwardTransfers(*coins, certHash, nullifiedOuts);
 }
 
 bool CCoinsViewCache::RestoreBackwardTransfers(const uint256& certHash, const std::vector<CTxInUndo>& outsToRestore)
@@ -2048,6 +2311,7 @@ bool CCoinsViewCache::RestoreSidechain(const CScCertificate& certToRevert, const
     {
         assert(sidechainUndo.contentBitMask & CSidechainUndoData::AvailableSections::CROSS_EPOCH_CERT_DATA);
         currentSc.scFees                      = sidechainUndo.scFees;
+        currentSc.UpdateMinScFees();
         currentSc.pastEpochTopQualityCertView = sidechainUndo.pastEpochTopQualityCertView;
     }
     else if (!currentSc.isNonCeasing() && certToRevert.epochNumber == sidechainUndo.prevTopCommittedCertReferencedEpoch)
@@ -2133,7 +2397,8 @@ bool CCoinsViewCache::GetSidechainEvents(int height, CSidechainEvents& scEvents)
 }
 
 
-bool CCoinsViewCache::HandleSidechainEvents(int height, CBlockUndo& blockUndo, std::vector<CScCertificateStatusUpdateInfo>* pCertsStateInfo)
+bool CCoinsViewCache::HandleSidechainEvents(int height, CBlockUndo& blockUndo, std::vector<CScCertificateStatusUpdateInfo>* pCertsStateInfo,
+                                            unsigned int nThreads)
 {
     if (!HaveSidechainEvents(height))
         return true;
@@ -2141,7 +2406,9 @@ bool CCoinsViewCache::HandleSidechainEvents(int height, CBlockUndo& blockUndo, s
     CSidechainEvents scEvents;
     GetSidechainEvents(height, scEvents);
 
-    //Handle Maturing amounts
+    // Bring in the cache all the entries touched by the events first: the changes of each sidechain are then
+    // computed concurrently, with the workers only reading those entries, and merged back in the events order
+    std::vector<std::pair<uint256, CSidechainsCacheEntry*>> maturing;
     for (const uint256& maturingScId : scEvents.maturingScs)
     {
         LogPrint("sc", "%s():%d - SIDECHAIN-EVENT: about to mature scId[%s] amount at height [%d]\n",
@@ -2153,28 +2420,19 @@ bool CCoinsViewCache::HandleSidechainEvents(int height, CBlockUndo& blockUndo, s
 
         // Temporary assert: for SC version 2 we should never be here
         assert(!scMaturingIt->second.sidechain.isNonCeasing());
-
-        scMaturingIt->second.sidechain.balance += scMaturingIt->second.sidechain.mImmatureAmounts.at(height);
-        LogPrint("sc", "%s():%d - SIDECHAIN-EVENT: scId=%s balance updated to: %s\n",
-            __func__, __LINE__, maturingScId.ToString(), FormatMoney(scMaturingIt->second.sidechain.balance));
-
-        blockUndo.scUndoDatabyScId[maturingScId].appliedMaturedAmount = scMaturingIt->second.sidechain.mImmatureAmounts[height];
-        blockUndo.scUndoDatabyScId[maturingScId].contentBitMask |= CSidechainUndoData::AvailableSections::MATURED_AMOUNTS;
-        LogPrint("sc", "%s():%d - SIDECHAIN-EVENT: adding immature amount %s for scId=%s in blockundo\n",
-            __func__, __LINE__, FormatMoney(scMaturingIt->second.sidechain.mImmatureAmounts[height]), maturingScId.ToString());
-
-        scMaturingIt->second.sidechain.mImmatureAmounts.erase(height);
-        scMaturingIt->second.flag = CSidechainsCacheEntry::Flags::DIRTY;
+        maturing.push_back(std::make_pair(maturingScId, &scMaturingIt->second));
     }
 
-    //Handle Ceasing Sidechain
+    std::vector<std::pair<uint256, const CSidechain*>> ceasing;
+    std::vector<const CCoins*> ceasingCertCoins;
     for (const uint256& ceasingScId : scEvents.ceasingScs)
     {
         LogPrint("sc", "%s():%d - SIDECHAIN-EVENT: about to handle scId[%s] and ceasingHeight [%d]\n",
                 __func__, __LINE__, ceasingScId.ToString(), height);
 
-        CSidechain sidechain;
-        assert(GetSidechain(ceasingScId, sidechain));
+        CSidechainsMap::const_iterator scCeasingIt = FetchSidechains(ceasingScId);
+        assert(scCeasingIt != cacheSidechains.end() && scCeasingIt->second.flag != CSidechainsCacheEntry::Flags::ERASED);
+        const CSidechain& sidechain = scCeasingIt->second.sidechain;
 
         // Temporary assert: for SC version 2 we should never be here
         assert(!sidechain.isNonCeasing());
@@ -2182,17 +2440,87 @@ bool CCoinsViewCache::HandleSidechainEvents(int height, CBlockUndo& blockUndo, s
         LogPrint("sc", "%s():%d - SIDECHAIN-EVENT: lastCertEpoch [%d], lastCertHash [%s]\n",
                 __func__, __LINE__, sidechain.lastTopQualityCertReferencedEpoch, sidechain.lastTopQualityCertHash.ToString());
 
+        // in case the cert had not bwt nor change, there won't be any coin generated by cert. Nothing to nullify
+        const CCoins* certCoins = nullptr;
+        if (sidechain.lastTopQualityCertReferencedEpoch != CScCertificate::EPOCH_NULL && !sidechain.lastTopQualityCertHash.IsNull())
+        {
+            certCoins = AccessCoins(sidechain.lastTopQualityCertHash);
+            if (certCoins != nullptr && certCoins->vout.empty())
+                certCoins = nullptr;
+        }
+        ceasing.push_back(std::make_pair(ceasingScId, &sidechain));
+        ceasingCertCoins.push_back(certCoins);
+    }
+
+    // Each worker only reads the cache entries above and writes its own slots of the deltas vectors
+    std::vector<CAmount> maturedAmounts(maturing.size());
+    std::vector<std::pair<CCoins, std::vector<CTxInUndo>>> nullifiedCertCoins(ceasing.size());
+    auto worker = [&](unsigned int nWorker) {
+        for (size_t i = nWorker; i < maturing.size(); i += nThreads)
+            maturedAmounts[i] = maturing[i].second->sidechain.mImmatureAmounts.at(height);
+        for (size_t i = nWorker; i < ceasing.size(); i += nThreads)
+        {
+            if (ceasingCertCoins[i] == nullptr)
+                continue;
+            nullifiedCertCoins[i].first = *ceasingCertCoins[i];
+            NullifyCertBackwardTransfers(nullifiedCertCoins[i].first, ceasing[i].second->lastTopQualityCertHash,
+                                         nullifiedCertCoins[i].second);
+        }
+    };
+
+    const size_t nEvents = maturing.size() + ceasing.size();
+    nThreads = std::max<unsigned int>(1, std::min<size_t>(nThreads, nEvents / MIN_SIDECHAIN_EVENTS_PER_THREAD));
+    std::vector<std::future<void>> workers;
+    for (unsigned int n = 1; n < nThreads; ++n)
+        workers.push_back(std::async(std::launch::async, worker, n));
+    worker(0);
+    for (auto& w : workers)
+        w.get();
+
+    //Handle Maturing amounts
+    for (size_t i = 0; i < maturing.size(); ++i)
+    {
+        const uint256& maturingScId = maturing[i].first;
+        CSidechainsCacheEntry& scMaturingEntry = *maturing[i].second;
+
+        scMaturingEntry.sidechain.balance += maturedAmounts[i];
+        LogPrint("sc", "%s():%d - SIDECHAIN-EVENT: scId=%s balance updated to: %s\n",
+            __func__, __LINE__, maturingScId.ToString(), FormatMoney(scMaturingEntry.sidechain.balance));
+
+        blockUndo.scUndoDatabyScId[maturingScId].appliedMaturedAmount = maturedAmounts[i];
+        blockUndo.scUndoDatabyScId[maturingScId].contentBitMask |= CSidechainUndoData::AvailableSections::MATURED_AMOUNTS;
+        LogPrint("sc", "%s():%d - SIDECHAIN-EVENT: adding immature amount %s for scId=%s in blockundo\n",
+            __func__, __LINE__, FormatMoney(maturedAmounts[i]), maturingScId.ToString());
+
+        scMaturingEntry.sidechain.mImmatureAmounts.erase(height);
+        scMaturingEntry.flag = CSidechainsCacheEntry::Flags::DIRTY;
+    }
+
+    //Handle Ceasing Sidechain
+    for (size_t i = 0; i < ceasing.size(); ++i)
+    {
+        const uint256& ceasingScId = ceasing[i].first;
+        const CSidechain& sidechain = *ceasing[i].second;
+
         LogPrint("sc", "%s():%d - set voidedCertHash[%s], ceasingScId = %s\n",
             __func__, __LINE__, sidechain.lastTopQualityCertHash.ToString(), ceasingScId.ToString());
 
-        blockUndo.scUndoDatabyScId[ceasingScId].contentBitMask |= CSidechainUndoData::AvailableSections::CEASED_CERT_DATA;
+        CSidechainUndoData& scUndoData = blockUndo.scUndoDatabyScId[ceasingScId];
+        scUndoData.contentBitMask |= CSidechainUndoData::AvailableSections::CEASED_CERT_DATA;
 
         if (sidechain.lastTopQualityCertReferencedEpoch == CScCertificate::EPOCH_NULL) {
             assert(sidechain.lastTopQualityCertHash.IsNull());
             continue;
         }
 
-        NullifyBackwardTransfers(sidechain.lastTopQualityCertHash, blockUndo.scUndoDatabyScId[ceasingScId].ceasedBwts);
+        if (ceasingCertCoins[i] != nullptr)
+        {
+            CCoinsModifier coins = ModifyCoins(sidechain.lastTopQualityCertHash);
+            coins->swap(nullifiedCertCoins[i].first);
+            scUndoData.ceasedBwts.insert(scUndoData.ceasedBwts.end(),
+                                         nullifiedCertCoins[i].second.begin(), nullifiedCertCoins[i].second.end());
+        }
+
         if (pCertsStateInfo != nullptr)
             pCertsStateInfo->push_back(CScCertificateStatusUpdateInfo(ceasingScId, sidechain.lastTopQualityCertHash,
                                        sidechain.lastTopQualityCertReferencedEpoch,
@@ -2300,11 +2628,11 @@ bool CCoinsViewCache::RevertSidechainEvents(const CBlockUndo& blockUndo, int hei
 
 CSidechain::State CCoinsViewCache::GetSidechainState(const uint256& scId) const
 {
-    CSidechain sidechain;
-    if (!GetSidechain(scId, sidechain))
+    const CSidechain* const pSidechain = AccessSidechain(scId);
+    if (pSidechain == nullptr)
         return CSidechain::State::NOT_APPLICABLE;
 
-    return sidechain.GetState(*this);
+    return pSidechain->GetState(*this);
 }
 
 
@@ -2335,6 +2663,8 @@ CFieldElement CCoinsViewCache::GetCeasingCumTreeHash(const uint256& scId) const
 }
 
 bool CCoinsViewCache::Flush() {
+    if (scDirectory)
+        scDirectory->Update(cacheSidechains);
     bool fOk = base->BatchWrite(cacheCoins, hashBlock, hashAnchor, cacheAnchors, cacheNullifiers, cacheSidechains, cacheSidechainEvents, cacheCswNullifiers);
     cacheCoins.clear();
     cacheSidechains.clear();
@@ -9,11 +9,18 @@
 #include "compressor.h"
 #include "core_memusage.h"
 #include "memusage.h"
+#include "saltedhasher.h"
 #include "serialize.h"
+#include "support/allocators/nodepool.h"
 #include "uint256.h"
 
 #include <assert.h>
+#include <map>
+#include <memory>
+#include <set>
 #include <stdint.h>
+#include <utility>
+#include <vector>
 
 #include <boost/unordered_map.hpp>
 #include "zcash/IncrementalMerkleTree.hpp"
@@ -37,9 +44,16 @@ struct CAddressUnspentValue;
 
 static const int BWT_POS_UNSET = -1;
 
+//! The fewest sidechain events handled by each thread of CCoinsViewCache::HandleSidechainEvents
+static const size_t MIN_SIDECHAIN_EVENTS_PER_THREAD = 32;
+
 /**
  * Pruned version of CTransaction: only retains metadata and unspent transaction outputs
  *
+ * The coins of a transaction or certificate are a single record keyed by its hash, in the caches
+ * as in DB_COINS: spending one of its outputs writes again the record with the outputs left. A spent
+ * output only keeps the memory of an empty CTxOut, and the trailing ones are dropped by Cleanup().
+ *
  * Serialized format:
  * - VARINT(nVersion)
  * - VARINT(nCode)
@@ -276,29 +290,12 @@ private:
     void CalcMaskSize(unsigned int &nBytes, unsigned int &nNonzeroBytes) const;
 };
 
-class CCoinsKeyHasher
-{
-private:
-    uint256 salt;
-
-public:
-    CCoinsKeyHasher();
-
-    /**
-     * This *must* return size_t. With Boost 1.46 on 32-bit systems the
-     * unordered_map will behave unpredictably if the custom hasher returns a
-     * uint64_t, resulting in failures when syncing the chain (#4634).
-     */
-    size_t operator()(const uint256& key) const {
-        return key.GetHash(salt);
-    }
-};
+typedef CSaltedUint256Hasher CCoinsKeyHasher;
 
 class CCswNullifiersKeyHasher
 {
 private:
-    static const size_t BUF_LEN = (sizeof(uint256) + CFieldElement::ByteSize())/sizeof(uint32_t);
-    uint32_t salt[BUF_LEN];
+    uint64_t k0, k1;
 public:
     CCswNullifiersKeyHasher();
 
@@ -390,6 +387,29 @@ void WriteMutableEntry(const KeyType& key, const ValueType& value, MapType<KeyTy
     }
 }
 
+//! As above, taking over the content of value rather than copying it, for the caches being flushed
+template<typename KeyType, typename ValueType, template<typename...> class MapType, typename ... TOthers >
+void WriteMutableEntry(const KeyType& key, ValueType&& value, MapType<KeyType, ValueType, TOthers...>& destinationMap)
+{
+    if (value.flag != CMutableSidechainCacheEntry::Flags::FRESH && value.flag != CMutableSidechainCacheEntry::Flags::DIRTY)
+    {
+        WriteMutableEntry(key, static_cast<const ValueType&>(value), destinationMap);
+        return;
+    }
+
+    typename MapType<KeyType, ValueType, TOthers...>::iterator itLocalCacheEntry = destinationMap.find(key);
+    if (itLocalCacheEntry == destinationMap.end())
+    {
+        destinationMap.emplace(key, std::move(value));
+        return;
+    }
+    assert(
+        value.flag == CMutableSidechainCacheEntry::Flags::DIRTY ||
+        itLocalCacheEntry->second.flag == CMutableSidechainCacheEntry::Flags::ERASED
+    ); //A fresh entry should not exist in localCache or be already erased
+    itLocalCacheEntry->second = std::move(value);
+}
+
 struct CImmutableSidechainCacheEntry
 {
     enum class Flags {
@@ -456,7 +476,9 @@ struct CCswNullifiersCacheEntry: public CImmutableSidechainCacheEntry
     CCswNullifiersCacheEntry(Flags _flag = Flags::DEFAULT): CImmutableSidechainCacheEntry(_flag) {}
 };
 
-typedef boost::unordered_map<uint256, CCoinsCacheEntry, CCoinsKeyHasher>      CCoinsMap;
+//! The nodes come from the huge page pool with -hugepages
+typedef boost::unordered_map<uint256, CCoinsCacheEntry, CCoinsKeyHasher, std::equal_to<uint256>,
+                             node_pool_allocator<std::pair<const uint256, CCoinsCacheEntry>>> CCoinsMap;
 typedef boost::unordered_map<uint256, CAnchorsCacheEntry, CCoinsKeyHasher>    CAnchorsMap;
 typedef boost::unordered_map<uint256, CNullifiersCacheEntry, CCoinsKeyHasher> CNullifiersMap;
 
@@ -523,6 +545,10 @@ public:
     virtual bool HaveCswNullifier(const uint256& scId,
                                   const CFieldElement& nullifier) const;
 
+    //! HaveCswNullifier for many (scId, nullifier) pairs at once: vHave[i] is set for the ith pair
+    virtual void HaveCswNullifiers(const std::vector<std::pair<uint256, CFieldElement>>& keys,
+                                   std::vector<bool>& vHave) const;
+
     //! Do a bulk modification (multiple CCoins changes + BestBlock change).
     //! The passed mapCoins can be modified.
     virtual bool BatchWrite(CCoinsMap &mapCoins,
@@ -564,6 +590,8 @@ public:
     uint256 GetBestAnchor()                                            const override;
     bool HaveCswNullifier(const uint256& scId,
                           const CFieldElement &nullifier)              const override;
+    void HaveCswNullifiers(const std::vector<std::pair<uint256, CFieldElement>>& keys,
+                           std::vector<bool>& vHave)                   const override;
     void SetBackend(CCoinsView &viewIn);
     bool BatchWrite(CCoinsMap &mapCoins,
                     const uint256 &hashBlock,
@@ -599,6 +627,50 @@ public:
     friend class CCoinsViewCache;
 };
 
+/**
+ * The sidechains of a view sorted by id, with only what is needed to tell their state at a given height,
+ * so that listing a page of them, possibly of the alive ones only, does not load every sidechain.
+ */
+class CSidechainDirectory
+{
+public:
+    struct Entry
+    {
+        bool fCreationConfirmed;
+        int scheduledCeasingHeight;
+
+        //! The state of the sidechain in a view of this height, as CSidechain::GetState
+        CSidechain::State GetState(int height) const;
+    };
+
+    void Update(const uint256& scId, const CSidechain& sidechain);
+    void Erase(const uint256& scId);
+    //! Apply the modified and erased sidechains of a cache
+    void Update(const CSidechainsMap& mapSidechains);
+
+    size_t size() const { return entries.size(); }
+
+    /**
+     * Put in vPage the ids from the from-th (included) to the to-th (excluded) of the sorted sidechains of
+     * the directory and of unconfirmedScIds, the ones not created yet, skipping those which are not alive
+     * at height when bOnlyAlive. Returns the number of sidechains of the whole listing.
+     */
+    size_t GetPage(int height, bool bOnlyAlive, const std::set<uint256>& unconfirmedScIds, size_t from, size_t to,
+                   std::vector<uint256>& vPage) const;
+
+private:
+    std::map<uint256, Entry> entries;
+};
+
+/** The memory of a CCoinsViewCache, by the family of its entries, each of which is flushed at a budget of its own */
+struct CCoinsCacheUsage
+{
+    size_t nCoins = 0;      //!< the coins, with the anchors and the nullifiers of the shielded pool
+    size_t nSidechains = 0; //!< the sidechains, their events and the csw nullifiers
+
+    size_t Total() const { return nCoins + nSidechains; }
+};
+
 /** CCoinsView that adds a memory cache for transactions to another CCoinsView */
 class CCoinsViewCache : public CCoinsViewBacked
 {
@@ -623,6 +695,9 @@ protected:
     /* Cached dynamic memory usage for the inner CCoins objects. */
     mutable size_t cachedCoinsUsage;
 
+    /* The directory of all the sidechains of the view, null until first used. */
+    mutable std::unique_ptr<CSidechainDirectory> scDirectory;
+
 public:
     CCoinsViewCache(CCoinsView *baseIn);
     CCoinsViewCache(const CCoinsViewCache &) = delete; //we prevent accidentally using it when one intends to create a cache on top of a base cache.
@@ -673,6 +748,13 @@ public:
      */
     CCoinsModifier ModifyCoins(const uint256 &txid);
 
+    /**
+     * Load into the cache the coins of txids and the sidechains of scIds which are not cached yet.
+     * Lookups in the base view are spread over nThreads threads, hence the base view must support
+     * concurrent reads, as CCoinsViewDB does. Returns the number of entries added to the cache.
+     */
+    size_t Prefetch(const std::vector<uint256>& txids, const std::vector<uint256>& scIds, unsigned int nThreads);
+
     /**
      * Push the modifications applied to this cache to its base.
      * Failure to call this method before destruction will cause the changes to be forgotten.
@@ -682,6 +764,12 @@ public:
     //SIDECHAIN RELATED PUBLIC MEMBERS
     bool HaveSidechain(const uint256& scId)                           const override;
     bool GetSidechain(const uint256 & scId, CSidechain& targetSidechain) const override;
+    /**
+     * Return a pointer to the cached sidechain, or nullptr if it does not exist. Unlike GetSidechain, which
+     * copies the whole sidechain and its creation parameters, this only fetches it into the cache once; the
+     * pointer is valid until the sidechain is modified or the cache is flushed.
+     */
+    const CSidechain* const AccessSidechain(const uint256& scId) const;
     void GetScIds(std::set<uint256>& scIdsList)                       const override;
 
     CValidationState::Code IsScTxApplicableToState(const CTransaction& tx, Sidechain::ScFeeCheckFlag scCheckTypeconst, const CCoinsViewCache* pcoinsView = nullptr) const;
@@ -730,7 +818,13 @@ public:
     bool HaveSidechainEvents(int height)                            const override;
     bool GetSidechainEvents(int height, CSidechainEvents& scEvents) const override;
 
-    bool HandleSidechainEvents(int height, CBlockUndo& blockUndo, std::vector<CScCertificateStatusUpdateInfo>* pCertsStateInfo);
+    /**
+     * Apply the maturing amounts and the ceasings scheduled at height, recording them in blockUndo. The changes of the
+     * sidechains are computed on up to nThreads threads, each one handling at least MIN_SIDECHAIN_EVENTS_PER_THREAD
+     * of them, and applied in the order of the events, hence the outcome does not depend on nThreads.
+     */
+    bool HandleSidechainEvents(int height, CBlockUndo& blockUndo, std::vector<CScCertificateStatusUpdateInfo>* pCertsStateInfo,
+                               unsigned int nThreads = 1);
     bool RevertSidechainEvents(const CBlockUndo& blockUndo, int height, std::vector<CScCertificateStatusUpdateInfo>* pCertsStateInfo);
 
     void HandleTxIndexSidechainEvents(int height, CBlockTreeDB* pblocktree,
@@ -753,6 +847,9 @@ public:
 
     //CSW NULLIFIER PUBLIC MEMBERS
     bool HaveCswNullifier(const uint256& scId, const CFieldElement &nullifier) const override;
+    //! The pairs not cached are looked up in one batch in the base view, those found are cached
+    void HaveCswNullifiers(const std::vector<std::pair<uint256, CFieldElement>>& keys,
+                           std::vector<bool>& vHave) const override;
     bool AddCswNullifier(const uint256& scId, const CFieldElement &nullifier);
     bool RemoveCswNullifier(const uint256& scId, const CFieldElement &nullifier);
 
@@ -760,6 +857,12 @@ public:
     const CScCertificateView& GetActiveCertView(const uint256& scId) const;
     CSidechain::State GetSidechainState(const uint256& scId) const;
 
+    /**
+     * The directory of the sidechains of this view. It is built from the base view on first use, then
+     * kept up to date with the sidechains written to the view, hence it is cheap on pcoinsTip.
+     */
+    const CSidechainDirectory& GetScDirectory() const;
+
     bool Flush();
 
     //! Calculate the size of the cache (in number of transactions)
@@ -767,6 +870,8 @@ public:
 
     //! Calculate the size of the cache (in bytes)
     size_t DynamicMemoryUsage() const;
+    //! The same, by family of entries; the sidechains are changed in place, hence they are counted each time
+    CCoinsCacheUsage DynamicMemoryUsageByFamily() const;
 
     /** 
      * Amount of bitcoins coming in to a transaction
@@ -796,7 +901,6 @@ private:
     CCoinsMap::iterator                 FetchCoins(const uint256 &txid);
     CSidechainsMap::const_iterator      FetchSidechains(const uint256& scId)  const;
     CSidechainsMap::iterator            ModifySidechain(const uint256& scId);
-    const CSidechain* const             AccessSidechain(const uint256& scId)  const;
     CSidechainEventsMap::const_iterator FetchSidechainEvents(int height)      const;
     CSidechainEventsMap::iterator       ModifySidechainEvents(int height);
 
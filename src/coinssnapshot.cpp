@@ -0,0 +1,366 @@
+#include "coinssnapshot.h"
+
+#include "chainparams.h"
+#include "hash.h"
+#include "init.h"
+#include "main.h"
+#include "streams.h"
+#include "txdb.h"
+#include "util.h"
+
+#include <memory>
+
+#include <boost/filesystem.hpp>
+
+namespace {
+
+typedef std::vector<std::pair<std::vector<unsigned char>, std::vector<unsigned char> > > CChainstateEntries;
+
+template <typename T>
+void WriteSnapshotChunk(CAutoFile& file, CHashWriter& hashSnapshot, unsigned char chSection, const T& contents)
+{
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << chSection << contents;
+    std::vector<unsigned char> payload(ss.begin(), ss.end());
+    uint256 hashChunk = Hash(payload.begin(), payload.end());
+    file << payload << hashChunk;
+    hashSnapshot << hashChunk;
+}
+
+//! Read the next chunk, checking its payload against its hash
+std::vector<unsigned char> ReadSnapshotChunk(CAutoFile& file, CHashWriter& hashSnapshot)
+{
+    std::vector<unsigned char> payload;
+    uint256 hashChunk;
+    file >> payload >> hashChunk;
+    if (payload.empty() || Hash(payload.begin(), payload.end()) != hashChunk)
+        throw std::runtime_error("snapshot chunk does not match its hash, the file is corrupted");
+    hashSnapshot << hashChunk;
+    return payload;
+}
+
+bool ReadSnapshotHeader(CAutoFile& file, CTxOutSetSnapshotHeader& header, std::string& strError)
+{
+    file >> header;
+    if (header.nMagic != TXOUTSET_SNAPSHOT_MAGIC) {
+        strError = "not a txoutset snapshot";
+        return false;
+    }
+    if (header.nVersion != TXOUTSET_SNAPSHOT_VERSION) {
+        strError = strprintf("unsupported snapshot version %u", header.nVersion);
+        return false;
+    }
+    const CMessageHeader::MessageStartChars& pchMessageStart = Params().MessageStart();
+    if (header.vMessageStart != std::vector<unsigned char>(pchMessageStart, pchMessageStart + MESSAGE_START_SIZE)) {
+        strError = "the snapshot was taken on a different network";
+        return false;
+    }
+    if (header.nHeight < 0) {
+        strError = "invalid snapshot base height";
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Compute the snapshot hash from the chunk hashes alone, skipping the payloads, so that a file
+ * pinned with -loadtxoutsethash is checked before anything is written to the dbs. The payloads
+ * are then checked against these same hashes while being imported.
+ */
+bool ReadSnapshotHash(const boost::filesystem::path& path, uint256& hashSnapshot, std::string& strError)
+{
+    CAutoFile file(fopen(path.string().c_str(), "rb"), SER_DISK, CLIENT_VERSION);
+    if (file.IsNull()) {
+        strError = strprintf("cannot open %s", path.string());
+        return false;
+    }
+    CTxOutSetSnapshotHeader header;
+    if (!ReadSnapshotHeader(file, header, strError))
+        return false;
+    CHashWriter hasher(SER_GETHASH, PROTOCOL_VERSION);
+    hasher << header;
+    while (true) {
+        uint64_t nSize = ReadCompactSize(file);
+        if (nSize == 0) {
+            strError = "empty snapshot chunk";
+            return false;
+        }
+        unsigned char chSection;
+        file >> chSection;
+        file.ignore(nSize - 1);
+        uint256 hashChunk;
+        file >> hashChunk;
+        hasher << hashChunk;
+        if (chSection == SNAPSHOT_SECTION_END)
+            break;
+    }
+    hashSnapshot = hasher.GetHash();
+    return true;
+}
+
+} // anon namespace
+
+bool DumpTxOutSetSnapshot(const boost::filesystem::path& path, CTxOutSetSnapshotInfo& info, std::string& strError)
+{
+    CCoinsViewDB* coinsdb = pcoinsFlusher->GetDB();
+    std::unique_ptr<CDBIterator> pcursor;
+    std::vector<CBlockIndex*> vChain;
+    {
+        // With the background write completed and cs_main held nothing is written to the chainstate
+        // db, so the iterator sees exactly the state at the tip for as long as it lives.
+        LOCK(cs_main);
+        FlushStateToDisk();
+        if (!pcoinsFlusher->Sync()) {
+            strError = "failed to write the chainstate to disk";
+            return false;
+        }
+        CBlockIndex* pindexBase = chainActive.Tip();
+        if (pindexBase == NULL || coinsdb->GetBestBlock() != pindexBase->GetBlockHash()) {
+            strError = "the chainstate on disk is not at the active chain tip";
+            return false;
+        }
+        pcursor.reset(coinsdb->NewIterator());
+        vChain.reserve(pindexBase->nHeight + 1);
+        for (int nHeight = 0; nHeight <= pindexBase->nHeight; nHeight++)
+            vChain.push_back(chainActive[nHeight]);
+        const CMessageHeader::MessageStartChars& pchMessageStart = Params().MessageStart();
+        info.header.vMessageStart.assign(pchMessageStart, pchMessageStart + MESSAGE_START_SIZE);
+        info.header.hashBlock = pindexBase->GetBlockHash();
+        info.header.nHeight = pindexBase->nHeight;
+    }
+
+    const boost::filesystem::path pathTmp = path.string() + ".incomplete";
+    try {
+        CAutoFile file(fopen(pathTmp.string().c_str(), "wb"), SER_DISK, CLIENT_VERSION);
+        if (file.IsNull()) {
+            strError = strprintf("cannot open %s for writing", pathTmp.string());
+            return false;
+        }
+        CHashWriter hasher(SER_GETHASH, PROTOCOL_VERSION);
+        file << info.header;
+        hasher << info.header;
+
+        for (size_t i = 0; i < vChain.size(); ) {
+            std::vector<CDiskBlockIndex> entries;
+            size_t nChunkBytes = 0;
+            {
+                LOCK(cs_main);
+                for (; i < vChain.size() && nChunkBytes < TXOUTSET_SNAPSHOT_CHUNK_BYTES
+                       && entries.size() < TXOUTSET_SNAPSHOT_CHUNK_ENTRIES; i++) {
+                    entries.push_back(CDiskBlockIndex(vChain[i]));
+                    nChunkBytes += ::GetSerializeSize(entries.back(), SER_DISK, CLIENT_VERSION);
+                }
+            }
+            WriteSnapshotChunk(file, hasher, SNAPSHOT_SECTION_BLOCK_INDEX, entries);
+            info.trailer.nBlockIndexEntries += entries.size();
+        }
+
+        CHashWriter ssStats(SER_GETHASH, PROTOCOL_VERSION);
+        CCoinsStats stats;
+        ssStats << info.header.hashBlock;
+        CChainstateEntries entries;
+        size_t nChunkBytes = 0;
+        for (pcursor->SeekToFirst(); pcursor->Valid(); pcursor->Next()) {
+            CDBSlice slKey = pcursor->key();
+            // the records the importing node derives by itself are left out
+            if (!CCoinsViewDB::IsSnapshotRecord(slKey))
+                continue;
+            CDBSlice slValue = pcursor->value();
+            CCoinsViewDB::AddEntryToStats(ssStats, stats, slKey, slValue);
+            entries.emplace_back(std::vector<unsigned char>(slKey.data(), slKey.data() + slKey.size()),
+                                 std::vector<unsigned char>(slValue.data(), slValue.data() + slValue.size()));
+            nChunkBytes += slKey.size() + slValue.size();
+            if (nChunkBytes >= TXOUTSET_SNAPSHOT_CHUNK_BYTES || entries.size() >= TXOUTSET_SNAPSHOT_CHUNK_ENTRIES) {
+                WriteSnapshotChunk(file, hasher, SNAPSHOT_SECTION_CHAINSTATE, entries);
+                info.trailer.nChainstateEntries += entries.size();
+                entries.clear();
+                nChunkBytes = 0;
+            }
+        }
+        if (!pcursor->status().ok())
+            throw std::runtime_error(pcursor->status().ToString());
+        if (!entries.empty()) {
+            WriteSnapshotChunk(file, hasher, SNAPSHOT_SECTION_CHAINSTATE, entries);
+            info.trailer.nChainstateEntries += entries.size();
+        }
+
+        info.trailer.hashSerialized = ssStats.GetHash();
+        info.trailer.nTransactions = stats.nTransactions;
+        info.trailer.nTransactionOutputs = stats.nTransactionOutputs;
+        info.trailer.nTotalAmount = stats.nTotalAmount;
+        WriteSnapshotChunk(file, hasher, SNAPSHOT_SECTION_END, info.trailer);
+        info.hashSnapshot = hasher.GetHash();
+
+        FileCommit(file.Get());
+        file.fclose();
+        if (!RenameOver(pathTmp, path)) {
+            strError = strprintf("cannot rename %s to %s", pathTmp.string(), path.string());
+            return false;
+        }
+        info.nBytes = boost::filesystem::file_size(path);
+    } catch (const std::exception& e) {
+        boost::system::error_code ec;
+        boost::filesystem::remove(pathTmp, ec);
+        strError = strprintf("error writing the snapshot: %s", e.what());
+        return false;
+    }
+
+    LogPrintf("%s: wrote snapshot %s of block %s (height %d, %u chainstate records) to %s\n", __func__,
+        info.hashSnapshot.ToString(), info.header.hashBlock.ToString(), info.header.nHeight,
+        info.trailer.nChainstateEntries, path.string());
+    return true;
+}
+
+bool LoadTxOutSetSnapshot(const boost::filesystem::path& path, const uint256& hashExpected,
+                          CCoinsViewDB* coinsdb, CBlockTreeDB* blocktree,
+                          CTxOutSetSnapshotInfo& info, std::string& strError)
+{
+    try {
+        if (!hashExpected.IsNull()) {
+            uint256 hashSnapshot;
+            if (!ReadSnapshotHash(path, hashSnapshot, strError))
+                return false;
+            if (hashSnapshot != hashExpected) {
+                strError = strprintf("snapshot hash %s does not match the expected %s", hashSnapshot.ToString(), hashExpected.ToString());
+                return false;
+            }
+        }
+
+        CAutoFile file(fopen(path.string().c_str(), "rb"), SER_DISK, CLIENT_VERSION);
+        if (file.IsNull()) {
+            strError = strprintf("cannot open %s", path.string());
+            return false;
+        }
+        if (!ReadSnapshotHeader(file, info.header, strError))
+            return false;
+        CHashWriter hasher(SER_GETHASH, PROTOCOL_VERSION);
+        hasher << info.header;
+
+        const uint256& hashGenesis = Params().GetConsensus().hashGenesisBlock;
+        uint256 hashPrev;
+        int nNextHeight = 0;
+        CHashWriter ssStats(SER_GETHASH, PROTOCOL_VERSION);
+        CCoinsStats stats;
+        ssStats << info.header.hashBlock;
+        // The best block record is written last, so that an interrupted import never looks like a
+        // usable chainstate
+        std::pair<std::vector<unsigned char>, std::vector<unsigned char> > bestBlockEntry;
+        unsigned char chLastSection = SNAPSHOT_SECTION_BLOCK_INDEX;
+        CTxOutSetSnapshotTrailer trailer;
+        while (true) {
+            if (ShutdownRequested()) {
+                strError = "shutdown requested";
+                return false;
+            }
+            std::vector<unsigned char> payload = ReadSnapshotChunk(file, hasher);
+            CDataStream ss(payload, SER_DISK, CLIENT_VERSION);
+            unsigned char chSection;
+            ss >> chSection;
+            if (chSection != SNAPSHOT_SECTION_END && chSection < chLastSection) {
+                strError = "snapshot sections out of order";
+                return false;
+            }
+            chLastSection = chSection;
+
+            if (chSection == SNAPSHOT_SECTION_BLOCK_INDEX) {
+                std::vector<CDiskBlockIndex> entries;
+                ss >> entries;
+                for (CDiskBlockIndex& diskindex : entries) {
+                    if (diskindex.nHeight != nNextHeight || diskindex.hashPrev != hashPrev
+                        || (nNextHeight == 0 && diskindex.GetBlockHash() != hashGenesis)
+                        || nNextHeight > info.header.nHeight) {
+                        strError = strprintf("snapshot block index is not a chain from the genesis, at height %d", nNextHeight);
+                        return false;
+                    }
+                    // none of the blocks below the base is on disk
+                    diskindex.nStatus &= ~(BLOCK_HAVE_DATA | BLOCK_HAVE_UNDO);
+                    diskindex.nFile = 0;
+                    diskindex.nDataPos = 0;
+                    diskindex.nUndoPos = 0;
+                    hashPrev = diskindex.GetBlockHash();
+                    nNextHeight++;
+                }
+                if (!blocktree->WriteBlockIndexEntries(entries)) {
+                    strError = "failed to write the block index";
+                    return false;
+                }
+                info.trailer.nBlockIndexEntries += entries.size();
+            } else if (chSection == SNAPSHOT_SECTION_CHAINSTATE) {
+                if (nNextHeight != info.header.nHeight + 1 || hashPrev != info.header.hashBlock) {
+                    strError = "snapshot block index does not end at the base block";
+                    return false;
+                }
+                CChainstateEntries entries;
+                ss >> entries;
+                info.trailer.nChainstateEntries += entries.size();
+                for (auto it = entries.begin(); it != entries.end(); ) {
+                    CDBSlice slKey((const char*)it->first.data(), it->first.size());
+                    CDBSlice slValue((const char*)it->second.data(), it->second.size());
+                    CCoinsViewDB::AddEntryToStats(ssStats, stats, slKey, slValue);
+                    // the best block record, keyed by its type alone
+                    if (it->first.size() == 1 && it->first[0] == 'B') {
+                        bestBlockEntry = std::move(*it);
+                        it = entries.erase(it);
+                    } else
+                        ++it;
+                }
+                if (!coinsdb->WriteSnapshotEntries(entries)) {
+                    strError = "failed to write the chainstate";
+                    return false;
+                }
+            } else if (chSection == SNAPSHOT_SECTION_END) {
+                ss >> trailer;
+                break;
+            } else {
+                strError = strprintf("unknown snapshot section %d", chSection);
+                return false;
+            }
+        }
+
+        info.hashSnapshot = hasher.GetHash();
+        if (!hashExpected.IsNull() && info.hashSnapshot != hashExpected) {
+            strError = "the snapshot changed while being imported";
+            return false;
+        }
+
+        uint256 hashBestBlock;
+        if (!bestBlockEntry.first.empty())
+            CDataStream(bestBlockEntry.second, SER_DISK, CLIENT_VERSION) >> hashBestBlock;
+        if (hashBestBlock != info.header.hashBlock) {
+            strError = "the snapshot chainstate is not at the base block";
+            return false;
+        }
+        stats.hashSerialized = ssStats.GetHash();
+        if (stats.hashSerialized != trailer.hashSerialized || stats.nTransactions != trailer.nTransactions
+            || stats.nTransactionOutputs != trailer.nTransactionOutputs || stats.nTotalAmount != trailer.nTotalAmount
+            || info.trailer.nBlockIndexEntries != trailer.nBlockIndexEntries
+            || info.trailer.nChainstateEntries != trailer.nChainstateEntries) {
+            strError = strprintf("the snapshot chainstate hashes to %s, while %s was expected",
+                stats.hashSerialized.ToString(), trailer.hashSerialized.ToString());
+            return false;
+        }
+        info.trailer = trailer;
+
+        // Blocks below the base are never downloaded, as if they had been pruned. No optional index
+        // covers them, hence the index flags are reset.
+        if (!blocktree->WriteFlag("prunedblockfiles", true) || !blocktree->WriteFlag("txoutsetsnapshot", true)
+            || !blocktree->WriteFlag("txindex", false) || !blocktree->WriteFlag("maturityheightindex", false)
+            || !blocktree->WriteFlag("addressindex", false) || !blocktree->WriteFlag("addressaggregates", false)
+            || !blocktree->WriteFlag("timestampindex", false) || !blocktree->WriteFlag("spentindex", false)) {
+            strError = "failed to write the block index flags";
+            return false;
+        }
+        if (!coinsdb->WriteSnapshotEntries(CChainstateEntries(1, bestBlockEntry))) {
+            strError = "failed to write the chainstate";
+            return false;
+        }
+    } catch (const std::exception& e) {
+        strError = strprintf("error reading the snapshot: %s", e.what());
+        return false;
+    }
+
+    LogPrintf("%s: imported snapshot %s of block %s (height %d, %u chainstate records) from %s\n", __func__,
+        info.hashSnapshot.ToString(), info.header.hashBlock.ToString(), info.header.nHeight,
+        info.trailer.nChainstateEntries, path.string());
+    return true;
+}
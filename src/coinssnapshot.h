@@ -0,0 +1,116 @@
+#ifndef BITCOIN_COINSSNAPSHOT_H
+#define BITCOIN_COINSSNAPSHOT_H
+
+#include "amount.h"
+#include "serialize.h"
+#include "uint256.h"
+
+#include <string>
+#include <vector>
+
+#include <boost/filesystem/path.hpp>
+
+class CBlockTreeDB;
+class CCoinsViewDB;
+
+/**
+ * A txoutset snapshot is a file holding the chainstate db of a node together with the block index
+ * of its active chain, so that a new node can start from the snapshot base block instead of
+ * connecting the whole chain. The file is made of a header followed by chunks, each one carrying
+ * the hash of its payload, so that a corrupted file is detected while being read:
+ * - the block index chunks list the entries of the active chain from the genesis up to the base block;
+ * - the chainstate chunks list the raw records of the chainstate db, as they are stored on disk;
+ * - the last chunk holds the trailer, with the statistics returned by gettxoutsetinfo for the base
+ *   block, which the importing node checks against the ones of the records it read.
+ * The snapshot hash covers the header and the hashes of all the chunks, and is what a snapshot is
+ * pinned to with -loadtxoutsethash.
+ */
+static const uint32_t TXOUTSET_SNAPSHOT_MAGIC = 0x7a6e7378; // "zsnx"
+static const uint32_t TXOUTSET_SNAPSHOT_VERSION = 1;
+//! A chunk is closed as soon as its payload grows over these limits
+static const size_t TXOUTSET_SNAPSHOT_CHUNK_BYTES = 8 * 1024 * 1024;
+static const size_t TXOUTSET_SNAPSHOT_CHUNK_ENTRIES = 50000;
+
+enum TxOutSetSnapshotSection : unsigned char
+{
+    SNAPSHOT_SECTION_END = 0,
+    SNAPSHOT_SECTION_BLOCK_INDEX = 1,
+    SNAPSHOT_SECTION_CHAINSTATE = 2,
+};
+
+class CTxOutSetSnapshotHeader
+{
+public:
+    uint32_t nMagic;
+    uint32_t nVersion;
+    std::vector<unsigned char> vMessageStart;
+    //! The base block, whose chainstate the snapshot holds
+    uint256 hashBlock;
+    int nHeight;
+
+    CTxOutSetSnapshotHeader() : nMagic(TXOUTSET_SNAPSHOT_MAGIC), nVersion(TXOUTSET_SNAPSHOT_VERSION), nHeight(-1) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersionIn) {
+        READWRITE(nMagic);
+        READWRITE(nVersion);
+        READWRITE(vMessageStart);
+        READWRITE(hashBlock);
+        READWRITE(nHeight);
+    }
+};
+
+class CTxOutSetSnapshotTrailer
+{
+public:
+    uint256 hashSerialized;
+    uint64_t nTransactions;
+    uint64_t nTransactionOutputs;
+    CAmount nTotalAmount;
+    uint64_t nBlockIndexEntries;
+    uint64_t nChainstateEntries;
+
+    CTxOutSetSnapshotTrailer() : nTransactions(0), nTransactionOutputs(0), nTotalAmount(0),
+                                 nBlockIndexEntries(0), nChainstateEntries(0) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
+        READWRITE(hashSerialized);
+        READWRITE(nTransactions);
+        READWRITE(nTransactionOutputs);
+        READWRITE(nTotalAmount);
+        READWRITE(nBlockIndexEntries);
+        READWRITE(nChainstateEntries);
+    }
+};
+
+/** What a dump or a load of a snapshot went through */
+struct CTxOutSetSnapshotInfo
+{
+    CTxOutSetSnapshotHeader header;
+    CTxOutSetSnapshotTrailer trailer;
+    uint256 hashSnapshot;
+    uint64_t nBytes = 0;
+};
+
+/**
+ * Write a snapshot of the flushed chainstate db, based at the active chain tip, to path.
+ * The file is written under a temporary name and renamed once complete. Takes cs_main only while
+ * taking the db snapshot and while reading the block index, so that the node keeps running.
+ */
+bool DumpTxOutSetSnapshot(const boost::filesystem::path& path, CTxOutSetSnapshotInfo& info, std::string& strError);
+
+/**
+ * Import a snapshot into empty block tree and chainstate dbs, before the block index is loaded.
+ * If hashExpected is not null, the snapshot hash must match it. The imported blocks are only
+ * known by their headers: their data is never downloaded again, as for a pruned node.
+ */
+bool LoadTxOutSetSnapshot(const boost::filesystem::path& path, const uint256& hashExpected,
+                          CCoinsViewDB* coinsdb, CBlockTreeDB* blocktree,
+                          CTxOutSetSnapshotInfo& info, std::string& strError);
+
+#endif // BITCOIN_COINSSNAPSHOT_H
@@ -25,21 +25,43 @@ static inline size_t RecursiveDynamicUsage(const CTxOut& out) {
     return RecursiveDynamicUsage(out.scriptPubKey);
 }
 
+// the cctp objects count the objects the zendoo library deserializes them to, see CFieldElement
 static inline size_t RecursiveDynamicUsage(const CTxCeasedSidechainWithdrawalInput& cswIn)
 {
-    return memusage::DynamicUsage(cswIn.redeemScript);
+    return memusage::DynamicUsage(cswIn.redeemScript) +
+           cswIn.nullifier.DynamicMemoryUsage() +
+           cswIn.scProof.DynamicMemoryUsage() +
+           cswIn.actCertDataHash.DynamicMemoryUsage() +
+           cswIn.ceasingCumScTxCommTree.DynamicMemoryUsage();
 }
 
 static inline size_t RecursiveDynamicUsage(const CTxScCreationOut& ccout)
 {
     return memusage::DynamicUsage(ccout.customData) +
+           (ccout.constant ? ccout.constant->DynamicMemoryUsage() : 0) +
+           ccout.wCertVk.DynamicMemoryUsage() +
+           (ccout.wCeasedVk ? ccout.wCeasedVk->DynamicMemoryUsage() : 0) +
            memusage::DynamicUsage(ccout.vFieldElementCertificateFieldConfig) +
            memusage::DynamicUsage(ccout.vBitVectorCertificateFieldConfig);
 }
 
 // no dynamic fields
 static inline size_t RecursiveDynamicUsage(const CTxForwardTransferOut& ccout) { return 0; }
-static inline size_t RecursiveDynamicUsage(const CBwtRequestOut& ccout) { return 0; }
+
+static inline size_t RecursiveDynamicUsage(const CBwtRequestOut& ccout)
+{
+    size_t mem = memusage::DynamicUsage(ccout.vScRequestData);
+    for (const CFieldElement& fe : ccout.vScRequestData)
+        mem += fe.DynamicMemoryUsage();
+    return mem;
+}
+
+// the field element a custom field is checked as is built lazily, and counted as for the cctp objects
+template <typename T>
+static inline size_t RecursiveDynamicUsage(const CustomCertificateField<T>& field)
+{
+    return memusage::DynamicUsage(field.getVRawData()) + memusage::MallocUsage(Sidechain::FFI_FIELD_ELEMENT_USAGE);
+}
 
 static inline size_t RecursiveDynamicUsage(const CTransaction& tx) {
     size_t mem = 0;
@@ -62,9 +84,12 @@ static inline size_t RecursiveDynamicUsage(const CTransaction& tx) {
         mem += RecursiveDynamicUsage(*it);
     }
 
-    // no dynamic fields for ft and bt
+    // no dynamic fields for ft
     mem += memusage::DynamicUsage(tx.GetVftCcOut());
     mem += memusage::DynamicUsage(tx.GetVBwtRequestOut());
+    for (std::vector<CBwtRequestOut>::const_iterator it = tx.GetVBwtRequestOut().begin(); it != tx.GetVBwtRequestOut().end(); it++) {
+        mem += RecursiveDynamicUsage(*it);
+    }
     return mem;
 }
 
@@ -78,6 +103,14 @@ static inline size_t RecursiveDynamicUsage(const CScCertificate& cert) {
     for (std::vector<CTxOut>::const_iterator it = cert.GetVout().begin(); it != cert.GetVout().end(); it++) {
         mem += RecursiveDynamicUsage(*it);
     }
+    mem += cert.endEpochCumScTxCommTreeRoot.DynamicMemoryUsage();
+    mem += cert.scProof.DynamicMemoryUsage();
+    mem += memusage::DynamicUsage(cert.vFieldElementCertificateField);
+    for (const FieldElementCertificateField& field : cert.vFieldElementCertificateField)
+        mem += RecursiveDynamicUsage(field);
+    mem += memusage::DynamicUsage(cert.vBitVectorCertificateField);
+    for (const BitVectorCertificateField& field : cert.vBitVectorCertificateField)
+        mem += RecursiveDynamicUsage(field);
     return mem;
 }
 
@@ -27,6 +27,12 @@
 
 #include <boost/thread.hpp>
 
+#ifdef __linux__
+#include <errno.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
 EhSolverCancelledException solver_cancelled;
 
 template<unsigned int N, unsigned int K>
@@ -497,10 +503,30 @@ void CollideBranches(std::vector<FullStepRow<WIDTH>>& X, const size_t hlen, cons
     }
 }
 
+template<size_t WIDTH>
+struct TruncatedStepLists
+{
+    std::vector<TruncatedStepRow<WIDTH>> Xt;
+    std::vector<TruncatedStepRow<WIDTH>> Xc;
+};
+
+// Ask for the whole pages in [p, p + size) to be backed by transparent huge pages
+static void AdviseHugePages(void* p, size_t size)
+{
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+    const uintptr_t nPage = sysconf(_SC_PAGESIZE);
+    const uintptr_t nBegin = ((uintptr_t)p + nPage - 1) / nPage * nPage;
+    const uintptr_t nEnd = ((uintptr_t)p + size) / nPage * nPage;
+    if (nEnd > nBegin && madvise((void*)nBegin, nEnd - nBegin, MADV_HUGEPAGE) != 0)
+        LogPrint("pow", "Huge pages not available for the Equihash lists: %s\n", strerror(errno));
+#endif
+}
+
 template<unsigned int N, unsigned int K>
 bool Equihash<N,K>::OptimisedSolve(const eh_HashState& base_state,
                                    const std::function<bool(std::vector<unsigned char>)> validBlock,
-                                   const std::function<bool(EhSolverCancelCheck)> cancelled)
+                                   const std::function<bool(EhSolverCancelCheck)> cancelled,
+                                   EhSolverWorkspace* workspace)
 {
     eh_index init_size { 1 << (CollisionBitLength + 1) };
     eh_index recreate_size { UntruncateIndex(1, 0, CollisionBitLength + 1) };
@@ -516,8 +542,18 @@ bool Equihash<N,K>::OptimisedSolve(const eh_HashState& base_state,
         LogPrint("pow", "Generating first list\n");
         size_t hashLen = HashLength;
         size_t lenIndices = sizeof(eh_trunc);
-        std::vector<TruncatedStepRow<TruncatedWidth>> Xt;
-        Xt.reserve(init_size);
+        // The lists of a workspace keep their capacity from the previous run
+        TruncatedStepLists<TruncatedWidth> localLists;
+        TruncatedStepLists<TruncatedWidth>& lists = workspace ?
+            workspace->Get<TruncatedStepLists<TruncatedWidth>>(N, K) : localLists;
+        std::vector<TruncatedStepRow<TruncatedWidth>>& Xt = lists.Xt;
+        std::vector<TruncatedStepRow<TruncatedWidth>>& Xc = lists.Xc;
+        Xt.clear();
+        if (Xt.capacity() < init_size) {
+            Xt.reserve(init_size);
+            if (workspace && workspace->UseHugePages())
+                AdviseHugePages(Xt.data(), Xt.capacity() * sizeof(Xt[0]));
+        }
         unsigned char tmpHash[HashOutput];
         for (eh_index g = 0; Xt.size() < init_size; g++) {
             GenerateHash(base_state, g, tmpHash, HashOutput);
@@ -540,7 +576,7 @@ bool Equihash<N,K>::OptimisedSolve(const eh_HashState& base_state,
             LogPrint("pow", "- Finding collisions\n");
             int i = 0;
             int posFree = 0;
-            std::vector<TruncatedStepRow<TruncatedWidth>> Xc;
+            Xc.clear();
             while (i < Xt.size() - 1) {
                 // 2b) Find next set of unordered pairs with collisions on the next n/(k+1) bits
                 int j = 1;
@@ -587,7 +623,8 @@ bool Equihash<N,K>::OptimisedSolve(const eh_HashState& base_state,
             } else if (posFree < Xt.size()) {
                 // 2g) Remove empty space at the end
                 Xt.erase(Xt.begin()+posFree, Xt.end());
-                Xt.shrink_to_fit();
+                if (!workspace)
+                    Xt.shrink_to_fit();
             }
 
             hashLen -= CollisionByteLength;
@@ -630,7 +667,7 @@ bool Equihash<N,K>::OptimisedSolve(const eh_HashState& base_state,
         } else
             LogPrint("pow", "- List is empty\n");
 
-    } // Ensure Xt goes out of scope and is destroyed
+    } // Ensure Xt goes out of scope and is destroyed, unless kept by the workspace
 
     LogPrint("pow", "Found %d partial solutions\n", partialSolns.size());
 
@@ -781,7 +818,8 @@ template bool Equihash<96,3>::BasicSolve(const eh_HashState& base_state,
                                          const std::function<bool(EhSolverCancelCheck)> cancelled);
 template bool Equihash<96,3>::OptimisedSolve(const eh_HashState& base_state,
                                              const std::function<bool(std::vector<unsigned char>)> validBlock,
-                                             const std::function<bool(EhSolverCancelCheck)> cancelled);
+                                             const std::function<bool(EhSolverCancelCheck)> cancelled,
+                                             EhSolverWorkspace* workspace);
 #endif
 template bool Equihash<96,3>::IsValidSolution(const eh_HashState& base_state, std::vector<unsigned char> soln);
 
@@ -793,7 +831,8 @@ template bool Equihash<200,9>::BasicSolve(const eh_HashState& base_state,
                                           const std::function<bool(EhSolverCancelCheck)> cancelled);
 template bool Equihash<200,9>::OptimisedSolve(const eh_HashState& base_state,
                                               const std::function<bool(std::vector<unsigned char>)> validBlock,
-                                              const std::function<bool(EhSolverCancelCheck)> cancelled);
+                                              const std::function<bool(EhSolverCancelCheck)> cancelled,
+                                              EhSolverWorkspace* workspace);
 #endif
 template bool Equihash<200,9>::IsValidSolution(const eh_HashState& base_state, std::vector<unsigned char> soln);
 
@@ -805,7 +844,8 @@ template bool Equihash<96,5>::BasicSolve(const eh_HashState& base_state,
                                          const std::function<bool(EhSolverCancelCheck)> cancelled);
 template bool Equihash<96,5>::OptimisedSolve(const eh_HashState& base_state,
                                              const std::function<bool(std::vector<unsigned char>)> validBlock,
-                                             const std::function<bool(EhSolverCancelCheck)> cancelled);
+                                             const std::function<bool(EhSolverCancelCheck)> cancelled,
+                                             EhSolverWorkspace* workspace);
 #endif
 template bool Equihash<96,5>::IsValidSolution(const eh_HashState& base_state, std::vector<unsigned char> soln);
 
@@ -817,6 +857,7 @@ template bool Equihash<48,5>::BasicSolve(const eh_HashState& base_state,
                                          const std::function<bool(EhSolverCancelCheck)> cancelled);
 template bool Equihash<48,5>::OptimisedSolve(const eh_HashState& base_state,
                                              const std::function<bool(std::vector<unsigned char>)> validBlock,
-                                             const std::function<bool(EhSolverCancelCheck)> cancelled);
+                                             const std::function<bool(EhSolverCancelCheck)> cancelled,
+                                             EhSolverWorkspace* workspace);
 #endif
 template bool Equihash<48,5>::IsValidSolution(const eh_HashState& base_state, std::vector<unsigned char> soln);
@@ -159,6 +159,44 @@ inline constexpr size_t equihash_solution_size(unsigned int N, unsigned int K) {
     return (1 << K)*(N/(K+1)+1)/8;
 }
 
+#ifdef ENABLE_MINING
+/**
+ * The lists of OptimisedSolve kept by a mining thread between its runs: they are allocated, and
+ * faulted in, by the first run, and only cleared by the next ones. A workspace is used by one thread
+ * at a time, and holds the lists of the last Equihash parameters it was used with.
+ */
+class EhSolverWorkspace
+{
+public:
+    //! Back the lists with transparent huge pages, where supported
+    explicit EhSolverWorkspace(bool fHugePagesIn = false) : fHugePages(fHugePagesIn) {}
+
+    EhSolverWorkspace(const EhSolverWorkspace&) = delete;
+    EhSolverWorkspace& operator=(const EhSolverWorkspace&) = delete;
+    EhSolverWorkspace(EhSolverWorkspace&&) = default;
+    EhSolverWorkspace& operator=(EhSolverWorkspace&&) = default;
+
+    template<typename T>
+    T& Get(unsigned int n, unsigned int k)
+    {
+        if (!pLists || n != nN || k != nK) {
+            pLists = std::make_shared<T>();
+            nN = n;
+            nK = k;
+        }
+        return *static_cast<T*>(pLists.get());
+    }
+
+    bool UseHugePages() const { return fHugePages; }
+
+private:
+    std::shared_ptr<void> pLists;
+    unsigned int nN = 0;
+    unsigned int nK = 0;
+    bool fHugePages;
+};
+#endif // ENABLE_MINING
+
 template<unsigned int N, unsigned int K>
 class Equihash
 {
@@ -188,7 +226,8 @@ public:
                     const std::function<bool(EhSolverCancelCheck)> cancelled);
     bool OptimisedSolve(const eh_HashState& base_state,
                         const std::function<bool(std::vector<unsigned char>)> validBlock,
-                        const std::function<bool(EhSolverCancelCheck)> cancelled);
+                        const std::function<bool(EhSolverCancelCheck)> cancelled,
+                        EhSolverWorkspace* workspace = nullptr);
 #endif
     bool IsValidSolution(const eh_HashState& base_state, std::vector<unsigned char> soln);
 };
@@ -240,26 +279,28 @@ inline bool EhBasicSolveUncancellable(unsigned int n, unsigned int k, const eh_H
 
 inline bool EhOptimisedSolve(unsigned int n, unsigned int k, const eh_HashState& base_state,
                     const std::function<bool(std::vector<unsigned char>)> validBlock,
-                    const std::function<bool(EhSolverCancelCheck)> cancelled)
+                    const std::function<bool(EhSolverCancelCheck)> cancelled,
+                    EhSolverWorkspace* workspace = nullptr)
 {
     if (n == 96 && k == 3) {
-        return Eh96_3.OptimisedSolve(base_state, validBlock, cancelled);
+        return Eh96_3.OptimisedSolve(base_state, validBlock, cancelled, workspace);
     } else if (n == 200 && k == 9) {
-        return Eh200_9.OptimisedSolve(base_state, validBlock, cancelled);
+        return Eh200_9.OptimisedSolve(base_state, validBlock, cancelled, workspace);
     } else if (n == 96 && k == 5) {
-        return Eh96_5.OptimisedSolve(base_state, validBlock, cancelled);
+        return Eh96_5.OptimisedSolve(base_state, validBlock, cancelled, workspace);
     } else if (n == 48 && k == 5) {
-        return Eh48_5.OptimisedSolve(base_state, validBlock, cancelled);
+        return Eh48_5.OptimisedSolve(base_state, validBlock, cancelled, workspace);
     } else {
         throw std::invalid_argument("Unsupported Equihash parameters");
     }
 }
 
 inline bool EhOptimisedSolveUncancellable(unsigned int n, unsigned int k, const eh_HashState& base_state,
-                    const std::function<bool(std::vector<unsigned char>)> validBlock)
+                    const std::function<bool(std::vector<unsigned char>)> validBlock,
+                    EhSolverWorkspace* workspace = nullptr)
 {
     return EhOptimisedSolve(n, k, base_state, validBlock,
-                            [](EhSolverCancelCheck pos) { return false; });
+                            [](EhSolverCancelCheck pos) { return false; }, workspace);
 }
 #endif // ENABLE_MINING
 
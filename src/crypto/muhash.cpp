@@ -0,0 +1,167 @@
+// Copyright (c) 2017-2020 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "crypto/muhash.h"
+
+#include "crypto/common.h"
+#include "crypto/sha256.h"
+
+#include <string.h>
+
+namespace {
+
+typedef unsigned __int128 uint128_t;
+
+/** 2^3072 - p */
+const uint64_t MAX_PRIME_DIFF = 1103717;
+
+} // anon namespace
+
+Num3072::Num3072(const unsigned char data[BYTE_SIZE])
+{
+    for (int i = 0; i < LIMBS; ++i)
+        limbs[i] = ReadLE64(data + 8 * i);
+}
+
+void Num3072::SetToOne()
+{
+    limbs[0] = 1;
+    for (int i = 1; i < LIMBS; ++i)
+        limbs[i] = 0;
+}
+
+bool Num3072::IsOverflow() const
+{
+    if (limbs[0] < ~(uint64_t)0 - MAX_PRIME_DIFF + 1)
+        return false;
+    for (int i = 1; i < LIMBS; ++i) {
+        if (limbs[i] != ~(uint64_t)0)
+            return false;
+    }
+    return true;
+}
+
+void Num3072::FullReduce()
+{
+    // a value in [p, 2^3072) minus p is the value plus 2^3072 - p, dropping the 2^3072 bit
+    uint128_t carry = MAX_PRIME_DIFF;
+    for (int i = 0; i < LIMBS; ++i) {
+        carry += limbs[i];
+        limbs[i] = (uint64_t)carry;
+        carry >>= 64;
+    }
+}
+
+void Num3072::Multiply(const Num3072& a)
+{
+    // the full product is computed first, hence a may be *this
+    uint64_t t[LIMBS * 2] = {0};
+    for (int i = 0; i < LIMBS; ++i) {
+        uint128_t carry = 0;
+        for (int j = 0; j < LIMBS; ++j) {
+            carry += (uint128_t)limbs[i] * a.limbs[j] + t[i + j];
+            t[i + j] = (uint64_t)carry;
+            carry >>= 64;
+        }
+        t[i + LIMBS] = (uint64_t)carry;
+    }
+
+    // reduce using 2^3072 = MAX_PRIME_DIFF (mod p), until the result fits 3072 bits
+    uint128_t carry = 0;
+    for (int i = 0; i < LIMBS; ++i) {
+        carry += (uint128_t)t[LIMBS + i] * MAX_PRIME_DIFF + t[i];
+        limbs[i] = (uint64_t)carry;
+        carry >>= 64;
+    }
+    while (carry) {
+        carry *= MAX_PRIME_DIFF;
+        for (int i = 0; i < LIMBS; ++i) {
+            carry += limbs[i];
+            limbs[i] = (uint64_t)carry;
+            carry >>= 64;
+        }
+    }
+    if (IsOverflow())
+        FullReduce();
+}
+
+Num3072 Num3072::GetInverse() const
+{
+    // Fermat: a^(p-2) is the inverse of a. The limbs of p - 2 are all ones but the lowest one.
+    static const uint64_t nLowLimb = ~(uint64_t)0 - MAX_PRIME_DIFF - 1;
+    Num3072 r;
+    for (int i = LIMBS - 1; i >= 0; --i) {
+        const uint64_t e = i == 0 ? nLowLimb : ~(uint64_t)0;
+        for (int bit = 63; bit >= 0; --bit) {
+            r.Multiply(r);
+            if ((e >> bit) & 1)
+                r.Multiply(*this);
+        }
+    }
+    return r;
+}
+
+void Num3072::Divide(const Num3072& a)
+{
+    Multiply(a.GetInverse());
+}
+
+void Num3072::ToBytes(unsigned char out[BYTE_SIZE]) const
+{
+    Num3072 r = *this;
+    if (r.IsOverflow())
+        r.FullReduce();
+    for (int i = 0; i < LIMBS; ++i)
+        WriteLE64(out + 8 * i, r.limbs[i]);
+}
+
+Num3072 MuHash3072::ToNum3072(const unsigned char* data, size_t len)
+{
+    // the 3072 bits are the SHA256 of the element hash followed by a counter, for 12 counter values
+    unsigned char hash[CSHA256::OUTPUT_SIZE];
+    CSHA256().Write(data, len).Finalize(hash);
+    unsigned char bytes[Num3072::BYTE_SIZE];
+    for (unsigned int i = 0; i < Num3072::BYTE_SIZE / CSHA256::OUTPUT_SIZE; ++i) {
+        unsigned char counter[4];
+        WriteLE32(counter, i);
+        CSHA256().Write(hash, sizeof(hash)).Write(counter, sizeof(counter)).Finalize(bytes + i * CSHA256::OUTPUT_SIZE);
+    }
+    return Num3072(bytes);
+}
+
+MuHash3072& MuHash3072::Insert(const unsigned char* data, size_t len)
+{
+    numerator.Multiply(ToNum3072(data, len));
+    return *this;
+}
+
+MuHash3072& MuHash3072::Remove(const unsigned char* data, size_t len)
+{
+    denominator.Multiply(ToNum3072(data, len));
+    return *this;
+}
+
+MuHash3072& MuHash3072::operator*=(const MuHash3072& mul)
+{
+    numerator.Multiply(mul.numerator);
+    denominator.Multiply(mul.denominator);
+    return *this;
+}
+
+MuHash3072& MuHash3072::operator/=(const MuHash3072& div)
+{
+    numerator.Multiply(div.denominator);
+    denominator.Multiply(div.numerator);
+    return *this;
+}
+
+void MuHash3072::Finalize(unsigned char out[OUTPUT_SIZE])
+{
+    numerator.Divide(denominator);
+    denominator.SetToOne();
+
+    unsigned char bytes[Num3072::BYTE_SIZE];
+    numerator.ToBytes(bytes);
+    CSHA256().Write(bytes, sizeof(bytes)).Finalize(out);
+}
@@ -0,0 +1,84 @@
+// Copyright (c) 2017-2020 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_CRYPTO_MUHASH_H
+#define BITCOIN_CRYPTO_MUHASH_H
+
+#include "serialize.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+
+/** An integer modulo the prime 2^3072 - 1103717, stored in little-endian 64-bit limbs */
+class Num3072
+{
+public:
+    static const size_t BYTE_SIZE = 384;
+    static const int LIMBS = 48;
+    uint64_t limbs[LIMBS];
+
+    Num3072() { SetToOne(); }
+    explicit Num3072(const unsigned char data[BYTE_SIZE]);
+
+    void SetToOne();
+    void Multiply(const Num3072& a);
+    void Divide(const Num3072& a);
+    Num3072 GetInverse() const;
+    //! The canonical little-endian encoding, in [0, p)
+    void ToBytes(unsigned char out[BYTE_SIZE]) const;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
+        for (int i = 0; i < LIMBS; i++)
+            READWRITE(limbs[i]);
+    }
+
+private:
+    bool IsOverflow() const;
+    void FullReduce();
+};
+
+/**
+ * A hash of a set of byte strings, which can be updated as strings are added to and removed from
+ * the set, in any order. Each string is mapped to a pseudorandom number modulo a 3072-bit prime
+ * and the set hash is the product of the numbers of its elements. Removals are tracked as a
+ * separate product, so that the (expensive) modular inverse is only computed by Finalize.
+ * Two MuHash3072 objects of disjoint sets can be combined with *=, which allows several threads
+ * to hash parts of one set.
+ */
+class MuHash3072
+{
+private:
+    Num3072 numerator;
+    Num3072 denominator;
+
+    static Num3072 ToNum3072(const unsigned char* data, size_t len);
+
+public:
+    static const size_t OUTPUT_SIZE = 32;
+
+    //! The hash of an empty set
+    MuHash3072() {}
+
+    MuHash3072& Insert(const unsigned char* data, size_t len);
+    MuHash3072& Remove(const unsigned char* data, size_t len);
+
+    MuHash3072& operator*=(const MuHash3072& mul);
+    MuHash3072& operator/=(const MuHash3072& div);
+
+    //! 32-byte digest of the set
+    void Finalize(unsigned char out[OUTPUT_SIZE]);
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
+        READWRITE(numerator);
+        READWRITE(denominator);
+    }
+};
+
+#endif // BITCOIN_CRYPTO_MUHASH_H
@@ -0,0 +1,193 @@
+#ifndef BITCOIN_CUCKOOCACHE_H
+#define BITCOIN_CUCKOOCACHE_H
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <memory>
+#include <stdint.h>
+#include <vector>
+
+/** A vector of bits which are set and cleared atomically, with relaxed ordering */
+class CAtomicBitFlags
+{
+    std::unique_ptr<std::atomic<uint8_t>[]> vBytes;
+
+public:
+    //! All the nBits flags start set
+    explicit CAtomicBitFlags(uint32_t nBits) { Setup(nBits); }
+
+    //! Not thread safe: resize to nBits flags, all set
+    void Setup(uint32_t nBits)
+    {
+        const uint32_t nBytes = (nBits + 7) / 8;
+        vBytes.reset(new std::atomic<uint8_t>[nBytes]);
+        for (uint32_t i = 0; i < nBytes; ++i)
+            vBytes[i].store(0xFF, std::memory_order_relaxed);
+    }
+
+    void Set(uint32_t n) { vBytes[n >> 3].fetch_or(1 << (n & 7), std::memory_order_relaxed); }
+    void Unset(uint32_t n) { vBytes[n >> 3].fetch_and(~(1 << (n & 7)), std::memory_order_relaxed); }
+    bool IsSet(uint32_t n) const { return (1 << (n & 7)) & vBytes[n >> 3].load(std::memory_order_relaxed); }
+};
+
+/**
+ * A fixed size set of elements, made for caches of hashes which many threads look up at once
+ * while only one at a time inserts.
+ *
+ * Each element may live in 8 slots, picked by the 8 hashes of Hash. Lookups only read the table
+ * and flag the slots of the elements they erase as collectable, with relaxed atomics, so that they
+ * can run concurrently with each other. Inserts must be serialized against everything else: they
+ * take the first collectable slot of the new element or else evict one of its occupants, which
+ * moves to another of its own slots, up to log2(size) times before the last evicted one is dropped.
+ *
+ * Slots become collectable either explicitly or by generations: once about 45% of the table has
+ * been filled since the last generation started, a new one starts and every slot filled in the one
+ * before it becomes collectable. Therefore the recently inserted elements survive and the oldest
+ * ones are reclaimed first, without keeping any per element counter.
+ *
+ * Element must be default constructible, comparable and cheap to swap. Hash must provide
+ * template <uint8_t n> uint32_t operator()(const Element&) const for n in [0, 8), giving
+ * independent uniformly distributed values.
+ */
+template <typename Element, typename Hash>
+class CCuckooCache
+{
+    std::vector<Element> vTable;
+    uint32_t nSize;
+    //! Which slots may be overwritten, shared with the lookups
+    mutable CAtomicBitFlags collectionFlags;
+    //! Which slots were filled in the current generation, only touched by inserts
+    std::vector<bool> vEpochFlags;
+    //! Inserts left before the generation is checked again
+    uint32_t nEpochHeuristicCounter;
+    //! The number of live slots filled in a generation before a new one starts
+    uint32_t nEpochSize;
+    //! How many times an insert may move an element
+    uint8_t nDepthLimit;
+    const Hash hasher;
+
+    //! Map the hashes over [0, nSize) with a multiply and shift rather than a modulo
+    template <uint8_t n>
+    uint32_t Slot(const Element& e) const
+    {
+        return ((uint64_t)hasher.template operator()<n>(e) * (uint64_t)nSize) >> 32;
+    }
+
+    std::array<uint32_t, 8> ComputeSlots(const Element& e) const
+    {
+        return {{Slot<0>(e), Slot<1>(e), Slot<2>(e), Slot<3>(e), Slot<4>(e), Slot<5>(e), Slot<6>(e), Slot<7>(e)}};
+    }
+
+    /**
+     * Start a new generation when the current one has filled nEpochSize live slots. As counting them walks
+     * the whole table, it is only done again after as many inserts as could possibly end the generation.
+     */
+    void CheckEpoch()
+    {
+        if (nEpochHeuristicCounter != 0) {
+            --nEpochHeuristicCounter;
+            return;
+        }
+
+        uint32_t nEpochLive = 0;
+        for (uint32_t i = 0; i < nSize; ++i)
+            nEpochLive += vEpochFlags[i] && !collectionFlags.IsSet(i);
+
+        if (nEpochLive >= nEpochSize) {
+            for (uint32_t i = 0; i < nSize; ++i) {
+                if (vEpochFlags[i])
+                    vEpochFlags[i] = false;
+                else
+                    collectionFlags.Set(i);
+            }
+            nEpochHeuristicCounter = nEpochSize;
+        } else {
+            nEpochHeuristicCounter = std::max<uint32_t>(1, std::max(nEpochSize / 16, nEpochSize - nEpochLive));
+        }
+    }
+
+public:
+    //! An empty cache, which must be set up before use
+    CCuckooCache() : nSize(0), collectionFlags(0), nEpochHeuristicCounter(0), nEpochSize(0), nDepthLimit(0), hasher() {}
+
+    //! Not thread safe: drop the content and make room for nNewSize elements. Returns the number of slots.
+    uint32_t Setup(uint32_t nNewSize)
+    {
+        nSize = std::max<uint32_t>(2, nNewSize);
+        nDepthLimit = static_cast<uint8_t>(std::log2(static_cast<float>(nSize)));
+        vTable.assign(nSize, Element());
+        collectionFlags.Setup(nSize);
+        vEpochFlags.assign(nSize, false);
+        nEpochSize = std::max<uint32_t>(1, (45 * (uint64_t)nSize) / 100);
+        nEpochHeuristicCounter = nEpochSize;
+        return nSize;
+    }
+
+    //! Not thread safe: as Setup, with as many slots as fit in nBytes
+    uint32_t SetupBytes(size_t nBytes)
+    {
+        return Setup(std::min<size_t>(nBytes / sizeof(Element), UINT32_MAX));
+    }
+
+    bool IsSetup() const { return nSize != 0; }
+    uint32_t Size() const { return nSize; }
+
+    //! Not thread safe: insert e, possibly evicting collectable or old elements
+    void Insert(Element e)
+    {
+        CheckEpoch();
+        std::array<uint32_t, 8> slots = ComputeSlots(e);
+
+        // Refresh e if it is already there
+        for (uint32_t slot : slots) {
+            if (vTable[slot] == e) {
+                collectionFlags.Unset(slot);
+                vEpochFlags[slot] = true;
+                return;
+            }
+        }
+
+        uint32_t nLastSlot = UINT32_MAX;
+        bool fLastEpoch = true;
+        for (uint8_t depth = 0; depth < nDepthLimit; ++depth) {
+            for (uint32_t slot : slots) {
+                if (!collectionFlags.IsSet(slot))
+                    continue;
+                vTable[slot] = std::move(e);
+                collectionFlags.Unset(slot);
+                vEpochFlags[slot] = fLastEpoch;
+                return;
+            }
+
+            // Evict from the slot following the one the evicted element was taken from, so that
+            // the chain does not bounce between two slots
+            nLastSlot = slots[(1 + (std::find(slots.begin(), slots.end(), nLastSlot) - slots.begin())) & 7];
+            std::swap(vTable[nLastSlot], e);
+            const bool fEpoch = fLastEpoch;
+            fLastEpoch = vEpochFlags[nLastSlot];
+            vEpochFlags[nLastSlot] = fEpoch;
+
+            slots = ComputeSlots(e);
+        }
+    }
+
+    /**
+     * Thread safe with other lookups: whether e is in the cache. With fErase its slot is made
+     * collectable, although e stays there until it is overwritten.
+     */
+    bool Contains(const Element& e, bool fErase) const
+    {
+        for (uint32_t slot : ComputeSlots(e)) {
+            if (vTable[slot] == e) {
+                if (fErase)
+                    collectionFlags.Set(slot);
+                return true;
+            }
+        }
+        return false;
+    }
+};
+
+#endif // BITCOIN_CUCKOOCACHE_H
@@ -0,0 +1,116 @@
+#include "cuckoofilter.h"
+
+#include "memusage.h"
+
+#include <utility>
+
+CCuckooFilter::CCuckooFilter(size_t nElementsIn) : nElements(0), fOverflowed(false), nKickState(0x9e3779b97f4a7c15ULL)
+{
+    uint64_t nBuckets = 1;
+    while (nBuckets * BUCKET_SLOTS * MAX_LOAD_PERCENT < (uint64_t)nElementsIn * 100)
+        nBuckets <<= 1;
+    vSlots.assign(nBuckets * BUCKET_SLOTS, 0);
+    nBucketMask = nBuckets - 1;
+}
+
+uint16_t CCuckooFilter::Fingerprint(uint64_t hash)
+{
+    // 0 marks an empty slot
+    uint16_t fp = hash >> 48;
+    return fp ? fp : 1;
+}
+
+uint64_t CCuckooFilter::AltBucket(uint64_t nBucket, uint16_t fp) const
+{
+    // an involution: the alternate bucket of the alternate bucket is the first one
+    return (nBucket ^ (fp * 0xc6a4a7935bd1e995ULL)) & nBucketMask;
+}
+
+bool CCuckooFilter::InsertInBucket(uint64_t nBucket, uint16_t fp)
+{
+    uint16_t* slots = &vSlots[nBucket * BUCKET_SLOTS];
+    for (unsigned int i = 0; i < BUCKET_SLOTS; i++) {
+        if (slots[i] == 0) {
+            slots[i] = fp;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool CCuckooFilter::EraseFromBucket(uint64_t nBucket, uint16_t fp)
+{
+    uint16_t* slots = &vSlots[nBucket * BUCKET_SLOTS];
+    for (unsigned int i = 0; i < BUCKET_SLOTS; i++) {
+        if (slots[i] == fp) {
+            slots[i] = 0;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool CCuckooFilter::BucketContains(uint64_t nBucket, uint16_t fp) const
+{
+    const uint16_t* slots = &vSlots[nBucket * BUCKET_SLOTS];
+    for (unsigned int i = 0; i < BUCKET_SLOTS; i++) {
+        if (slots[i] == fp)
+            return true;
+    }
+    return false;
+}
+
+bool CCuckooFilter::Insert(uint64_t hash)
+{
+    if (fOverflowed)
+        return false;
+
+    uint16_t fp = Fingerprint(hash);
+    uint64_t nBucket = hash & nBucketMask;
+    nElements++;
+    if (InsertInBucket(nBucket, fp))
+        return true;
+    nBucket = AltBucket(nBucket, fp);
+    if (InsertInBucket(nBucket, fp))
+        return true;
+
+    for (unsigned int n = 0; n < MAX_KICKS; n++) {
+        nKickState ^= nKickState << 13;
+        nKickState ^= nKickState >> 7;
+        nKickState ^= nKickState << 17;
+        uint16_t& slot = vSlots[nBucket * BUCKET_SLOTS + (nKickState % BUCKET_SLOTS)];
+        std::swap(fp, slot);
+        nBucket = AltBucket(nBucket, fp);
+        if (InsertInBucket(nBucket, fp))
+            return true;
+    }
+    // the fingerprint left in hand belongs to some element of the set, which can't be told apart any more
+    fOverflowed = true;
+    return false;
+}
+
+void CCuckooFilter::Erase(uint64_t hash)
+{
+    if (fOverflowed)
+        return;
+
+    uint16_t fp = Fingerprint(hash);
+    uint64_t nBucket = hash & nBucketMask;
+    if (EraseFromBucket(nBucket, fp) || EraseFromBucket(AltBucket(nBucket, fp), fp))
+        nElements--;
+}
+
+bool CCuckooFilter::MayContain(uint64_t hash) const
+{
+    if (fOverflowed)
+        return true;
+
+    uint16_t fp = Fingerprint(hash);
+    uint64_t nBucket = hash & nBucketMask;
+    return BucketContains(nBucket, fp) || BucketContains(AltBucket(nBucket, fp), fp);
+}
+
+size_t CCuckooFilter::DynamicMemoryUsage() const
+{
+    return memusage::DynamicUsage(vSlots);
+}
@@ -0,0 +1,60 @@
+#ifndef BITCOIN_CUCKOOFILTER_H
+#define BITCOIN_CUCKOOFILTER_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <vector>
+
+/**
+ * Approximate set membership over 64-bit element hashes, which never gives a false negative and
+ * which, unlike a bloom filter, supports removals. Each element is stored as a 16-bit fingerprint
+ * in one of two buckets of 4 slots, the second bucket being derived from the first one and from
+ * the fingerprint alone, so that fingerprints can be moved around to make room for new ones.
+ * With both buckets of a lookup scanned, the false positive rate is about 8 in 65536.
+ *
+ * The filter has a fixed capacity. Once an element cannot be placed (the table is close to full)
+ * the filter is marked as overflowed and reports every element as possibly present, as one of the
+ * fingerprints moved around may have been dropped.
+ *
+ * Erase must only be called for elements which were inserted, and only once per Insert: erasing
+ * an element which is not in the set may remove the fingerprint of another one.
+ */
+class CCuckooFilter
+{
+public:
+    static const unsigned int BUCKET_SLOTS = 4;
+
+    //! A filter with room for at least nElements at a load factor below MAX_LOAD_PERCENT
+    explicit CCuckooFilter(size_t nElements);
+
+    //! Add an element; false if the filter overflowed
+    bool Insert(uint64_t hash);
+    void Erase(uint64_t hash);
+    bool MayContain(uint64_t hash) const;
+
+    size_t Size() const { return nElements; }
+    size_t Capacity() const { return vSlots.size(); }
+    bool IsOverflowed() const { return fOverflowed; }
+    //! Whether the load factor went over MAX_LOAD_PERCENT, so that the filter should be rebuilt larger
+    bool NeedsResize() const { return fOverflowed || nElements * 100 > vSlots.size() * MAX_LOAD_PERCENT; }
+    size_t DynamicMemoryUsage() const;
+
+private:
+    static const unsigned int MAX_LOAD_PERCENT = 90;
+    static const unsigned int MAX_KICKS = 500;
+
+    std::vector<uint16_t> vSlots;
+    uint64_t nBucketMask;
+    size_t nElements;
+    bool fOverflowed;
+    //! Picks the slot to evict, it needs no quality
+    uint64_t nKickState;
+
+    static uint16_t Fingerprint(uint64_t hash);
+    uint64_t AltBucket(uint64_t nBucket, uint16_t fp) const;
+    bool InsertInBucket(uint64_t nBucket, uint16_t fp);
+    bool EraseFromBucket(uint64_t nBucket, uint16_t fp);
+    bool BucketContains(uint64_t nBucket, uint16_t fp) const;
+};
+
+#endif // BITCOIN_CUCKOOFILTER_H
@@ -0,0 +1,261 @@
+#ifndef BITCOIN_DBENGINE_H
+#define BITCOIN_DBENGINE_H
+
+#include <atomic>
+#include <memory>
+#include <stdexcept>
+#include <stdint.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#include <boost/filesystem/path.hpp>
+
+/**
+ * A range of bytes of a key or a value, which does not own them: the slices an iterator returns
+ * are valid until it moves.
+ */
+class CDBSlice
+{
+private:
+    const char* pdata;
+    size_t nSize;
+
+public:
+    CDBSlice() : pdata(""), nSize(0) {}
+    CDBSlice(const char* pdataIn, size_t nSizeIn) : pdata(pdataIn), nSize(nSizeIn) {}
+    CDBSlice(const std::string& str) : pdata(str.data()), nSize(str.size()) {}
+    CDBSlice(const char* str) : pdata(str), nSize(strlen(str)) {}
+
+    const char* data() const { return pdata; }
+    size_t size() const { return nSize; }
+    bool empty() const { return nSize == 0; }
+    char operator[](size_t n) const { return pdata[n]; }
+    std::string ToString() const { return std::string(pdata, nSize); }
+
+    //! Bytewise, as the keys are ordered
+    int compare(const CDBSlice& other) const
+    {
+        const size_t nMinSize = nSize < other.nSize ? nSize : other.nSize;
+        int r = memcmp(pdata, other.pdata, nMinSize);
+        if (r == 0)
+            r = nSize < other.nSize ? -1 : nSize > other.nSize ? 1 : 0;
+        return r;
+    }
+
+    bool starts_with(const CDBSlice& prefix) const
+    {
+        return nSize >= prefix.nSize && memcmp(pdata, prefix.pdata, prefix.nSize) == 0;
+    }
+
+    friend bool operator==(const CDBSlice& a, const CDBSlice& b)
+    {
+        return a.nSize == b.nSize && memcmp(a.pdata, b.pdata, a.nSize) == 0;
+    }
+    friend bool operator!=(const CDBSlice& a, const CDBSlice& b) { return !(a == b); }
+};
+
+/** The outcome of an operation of a storage engine */
+class CDBStatus
+{
+public:
+    enum Code { OK, NOT_FOUND, CORRUPTION, IO_ERROR, OTHER };
+
+    CDBStatus() : code(OK) {}
+    CDBStatus(Code codeIn, const std::string& strMessageIn) : code(codeIn), strMessage(strMessageIn) {}
+
+    bool ok() const { return code == OK; }
+    bool IsNotFound() const { return code == NOT_FOUND; }
+    bool IsCorruption() const { return code == CORRUPTION; }
+    bool IsIOError() const { return code == IO_ERROR; }
+    std::string ToString() const { return ok() ? "OK" : strMessage; }
+
+private:
+    Code code;
+    std::string strMessage;
+};
+
+class leveldb_error : public std::runtime_error
+{
+public:
+    leveldb_error(const std::string& msg) : std::runtime_error(msg) {}
+};
+
+//! Throws leveldb_error unless status is ok
+void HandleError(const CDBStatus& status);
+
+//! -<db>engine default
+static const char* const DEFAULT_DB_ENGINE = "leveldb";
+
+/**
+ * Tuning of a database. The databases of the node start from the split of their share of
+ * -dbcache, and let each option be overridden with -<prefix><option>, the prefix naming the
+ * database (coinsviewdb, blocktreedb) as for -<prefix>maxopenfiles. The engines map the options
+ * to their own, ignoring those they have no equivalent of.
+ */
+struct CLevelDBOptions
+{
+    //! The storage engine the database is opened with, by the name CreateDBEngine knows it by
+    std::string strEngine;
+    size_t nBlockCacheSize;
+    //! Up to two write buffers may be held in memory simultaneously
+    size_t nWriteBufferSize;
+    int nMaxOpenFiles;
+    //! Snappy compression of the table blocks; blocks are stored as they are if leveldb is built without it
+    bool fCompression;
+    //! Bits per key of the bloom filter of the tables, 0 for none
+    int nBloomBits;
+    size_t nBlockSize;
+
+    //! Half of nCacheSize to the block cache, and a quarter to each write buffer
+    CLevelDBOptions(size_t nCacheSize, int maxOpenFiles);
+
+    //! Apply -<strPrefix>engine=<name>, -<strPrefix>blockcache=<MiB>, -<strPrefix>writebuffer=<MiB>,
+    //! -<strPrefix>compression, -<strPrefix>bloombits=<n> and -<strPrefix>blocksize=<KiB>
+    CLevelDBOptions& ApplyArgs(const std::string& strPrefix);
+
+    std::string ToString() const;
+};
+
+/** The compaction statistics of a level, as reported by the engine */
+struct CLevelDBLevelStats
+{
+    int nLevel;
+    int nFiles;
+    double dSizeMiB;
+    double dCompactionSeconds;
+    double dCompactionReadMiB;
+    double dCompactionWriteMiB;
+};
+
+struct CLevelDBStats
+{
+    std::vector<CLevelDBLevelStats> vLevels;
+    uint64_t nCacheHits = 0;
+    uint64_t nCacheMisses = 0;
+};
+
+/**
+ * The puts and deletes of a batch, in the order they were queued, which an engine applies
+ * atomically. Engine independent, so that batches are built before knowing the database.
+ */
+class CDBWriteBatch
+{
+public:
+    enum class OpType : char { PUT, DELETE };
+
+    void Put(const CDBSlice& key, const CDBSlice& value)
+    {
+        Append(OpType::PUT, key);
+        AppendSlice(value);
+    }
+
+    void Delete(const CDBSlice& key) { Append(OpType::DELETE, key); }
+
+    void Clear() { vData.clear(); nOps = 0; }
+    size_t Count() const { return nOps; }
+    //! The bytes held, about the size of the keys and values queued
+    size_t SizeEstimate() const { return vData.size(); }
+
+    //! Calls put(key, value) and erase(key) for the operations, in order
+    template <typename Put, typename Erase>
+    void Iterate(Put put, Erase erase) const
+    {
+        const char* p = vData.data();
+        const char* pend = p + vData.size();
+        while (p < pend) {
+            const OpType type = static_cast<OpType>(*p++);
+            const CDBSlice key = ReadSlice(p);
+            if (type == OpType::PUT)
+                put(key, ReadSlice(p));
+            else
+                erase(key);
+        }
+    }
+
+private:
+    std::vector<char> vData;
+    size_t nOps = 0;
+
+    void Append(OpType type, const CDBSlice& key)
+    {
+        vData.push_back(static_cast<char>(type));
+        AppendSlice(key);
+        nOps++;
+    }
+
+    void AppendSlice(const CDBSlice& slice)
+    {
+        const uint32_t nSize = slice.size();
+        const char* pSize = reinterpret_cast<const char*>(&nSize);
+        vData.insert(vData.end(), pSize, pSize + sizeof(nSize));
+        vData.insert(vData.end(), slice.data(), slice.data() + slice.size());
+    }
+
+    static CDBSlice ReadSlice(const char*& p)
+    {
+        uint32_t nSize;
+        memcpy(&nSize, p, sizeof(nSize));
+        p += sizeof(nSize);
+        const CDBSlice slice(p, nSize);
+        p += nSize;
+        return slice;
+    }
+};
+
+/** A consistent view of a database, which its iterators may share */
+class CDBSnapshot
+{
+public:
+    virtual ~CDBSnapshot() {}
+};
+
+/** An iterator over the keys of a database, in bytewise order */
+class CDBIterator
+{
+public:
+    virtual ~CDBIterator() {}
+
+    virtual bool Valid() const = 0;
+    virtual void SeekToFirst() = 0;
+    virtual void SeekToLast() = 0;
+    //! To the first key at or past key
+    virtual void Seek(const CDBSlice& key) = 0;
+    virtual void Next() = 0;
+    virtual void Prev() = 0;
+    virtual CDBSlice key() const = 0;
+    virtual CDBSlice value() const = 0;
+    //! Not ok if the iteration stopped on an error rather than at the end of the keys
+    virtual CDBStatus status() const = 0;
+};
+
+/**
+ * A storage engine, which CLevelDBWrapper and the databases built on it go through. Engines are
+ * created by CreateDBEngine from the name in the options, so that each database can be given its
+ * own with -<db>engine.
+ */
+class CDBEngine
+{
+public:
+    virtual ~CDBEngine() {}
+
+    //! NOT_FOUND status if there is no value for key
+    virtual CDBStatus Get(const CDBSlice& key, std::string& strValue) const = 0;
+    virtual CDBStatus Write(const CDBWriteBatch& batch, bool fSync) = 0;
+    //! The iterator reads from snapshot if given, else from an implicit snapshot taken now
+    virtual CDBIterator* NewIterator(const CDBSnapshot* snapshot = nullptr) = 0;
+    virtual const CDBSnapshot* GetSnapshot() = 0;
+    virtual void ReleaseSnapshot(const CDBSnapshot* snapshot) = 0;
+    virtual void GetStats(CLevelDBStats& stats) const = 0;
+};
+
+//! The engines CreateDBEngine knows, by name
+std::vector<std::string> GetDBEngines();
+
+/**
+ * Opens, or creates, the database at path with the engine of dbOptions, in memory if fMemory.
+ * Throws leveldb_error if the engine is unknown or the database cannot be opened.
+ */
+std::unique_ptr<CDBEngine> CreateDBEngine(const boost::filesystem::path& path, const CLevelDBOptions& dbOptions, bool fMemory, bool fWipe);
+
+#endif // BITCOIN_DBENGINE_H
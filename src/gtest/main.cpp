@@ -1,7 +1,10 @@
 #include "gmock/gmock.h"
 #include "crypto/common.h"
+#include "crypto/sha256.h"
 #include "key.h"
+#include "main.h"
 #include "pubkey.h"
+#include "script/sigcache.h"
 #include "zcash/JoinSplit.hpp"
 #include "util.h"
 
@@ -21,7 +24,10 @@ ZCJoinSplit* params;
 
 int main(int argc, char **argv) {
   assert(init_and_check_sodium() != -1);
+  SHA256AutoDetect();
   ECC_Start();
+  InitSignatureCache();
+  InitScriptExecutionCache();
 
   libsnark::default_r1cs_ppzksnark_pp::init_public_params();
   libsnark::inhibit_profiling_info = true;
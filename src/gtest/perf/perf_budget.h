@@ -0,0 +1,41 @@
+#ifndef ZEN_GTEST_PERF_BUDGET_H
+#define ZEN_GTEST_PERF_BUDGET_H
+
+#include "utiltime.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+
+/**
+ * The scenarios of zen-gtest-perf fail when they take longer than their time budget. The budgets are
+ * meant to catch gross algorithmic regressions, as an accidental quadratic loop, not to measure: they
+ * are several times what the scenarios take on a slow machine, and are all multiplied by the
+ * ZEN_GTEST_PERF_BUDGET_SCALE environment variable (1 by default) on slower ones, or under valgrind.
+ */
+inline double PerfBudgetScale()
+{
+    const char* pszScale = getenv("ZEN_GTEST_PERF_BUDGET_SCALE");
+    const double scale = pszScale ? atof(pszScale) : 1.0;
+    return scale > 0 ? scale : 1.0;
+}
+
+inline int64_t PerfBudgetMillis(int64_t nBudgetMillis)
+{
+    return static_cast<int64_t>(nBudgetMillis * PerfBudgetScale());
+}
+
+//! The wall time since it was built, the scenarios time only what follows their fixtures
+class CPerfTimer
+{
+public:
+    CPerfTimer() : nStart(GetTimeMicros()) {}
+    int64_t ElapsedMillis() const { return (GetTimeMicros() - nStart) / 1000; }
+
+private:
+    const int64_t nStart;
+};
+
+#define EXPECT_WITHIN_BUDGET(timer, nBudgetMillis) \
+    EXPECT_LE((timer).ElapsedMillis(), PerfBudgetMillis(nBudgetMillis)) << "over a time budget of " << PerfBudgetMillis(nBudgetMillis) << "ms"
+
+#endif // ZEN_GTEST_PERF_BUDGET_H
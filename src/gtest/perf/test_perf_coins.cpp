@@ -0,0 +1,52 @@
+#include <gtest/gtest.h>
+
+#include "perf_budget.h"
+
+#include "arith_uint256.h"
+#include "coins.h"
+#include "random.h"
+#include "txdb.h"
+#include "util.h"
+
+#include <boost/filesystem.hpp>
+
+static const int COINS_TO_FLUSH = 1000 * 1000;
+static const int64_t COINS_FLUSH_BUDGET_MS = 120 * 1000;
+
+TEST(PerfCoinsViewCache, FlushOfAMillionCoins)
+{
+    boost::filesystem::path dataDir = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+    boost::filesystem::create_directories(dataDir);
+    mapArgs["-datadir"] = dataDir.string();
+    ClearDatadirCache();
+
+    {
+        // an in-memory database, not to time the disk of the machine
+        CCoinsViewDB db(1 << 23, DEFAULT_DB_MAX_OPEN_FILES, true, true);
+        CCoinsViewCache cache(&db);
+        for (int i = 0; i < COINS_TO_FLUSH; i++)
+        {
+            CCoinsModifier coins = cache.ModifyCoins(ArithToUint256(arith_uint256(i + 1)));
+            coins->nHeight = 1 + i % 1000;
+            coins->vout.resize(1 + i % 3);
+            for (CTxOut& out : coins->vout)
+            {
+                out.nValue = 1 + i;
+                out.scriptPubKey = CScript() << OP_TRUE;
+            }
+        }
+        ASSERT_EQ(cache.GetCacheSize(), static_cast<unsigned int>(COINS_TO_FLUSH));
+
+        const CPerfTimer timer;
+        ASSERT_TRUE(cache.Flush());
+        EXPECT_WITHIN_BUDGET(timer, COINS_FLUSH_BUDGET_MS);
+
+        EXPECT_EQ(cache.GetCacheSize(), 0U);
+        EXPECT_TRUE(db.HaveCoins(ArithToUint256(arith_uint256(COINS_TO_FLUSH))));
+    }
+
+    mapArgs.erase("-datadir");
+    ClearDatadirCache();
+    boost::system::error_code ec;
+    boost::filesystem::remove_all(dataDir, ec);
+}
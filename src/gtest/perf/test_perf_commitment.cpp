@@ -0,0 +1,34 @@
+#include <gtest/gtest.h>
+#include <gtest/tx_creation_utils.h>
+
+#include "perf_budget.h"
+
+#include "chainparams.h"
+#include "primitives/transaction.h"
+#include "sc/sidechainTxsCommitmentBuilder.h"
+
+static const int SIDECHAINS_IN_TREE = 1000;
+static const int64_t COMMITMENT_TREE_BUDGET_MS = 30 * 1000;
+
+TEST(PerfCommitmentTree, ThousandSidechains)
+{
+    SelectParams(CBaseChainParams::REGTEST);
+
+    // a creation and a forward transfer for each sidechain, all of them made before the clock starts
+    std::vector<CTransaction> vTxs;
+    for (int i = 0; i < SIDECHAINS_IN_TREE; i++)
+    {
+        const CTransaction scCreation = txCreationUtils::createNewSidechainTxWith(CAmount(1000 + i));
+        vTxs.push_back(scCreation);
+        vTxs.push_back(txCreationUtils::createFwdTransferTxWith(scCreation.GetScIdFromScCcOut(0), CAmount(10 + i)));
+    }
+
+    const CPerfTimer timer;
+    SidechainTxsCommitmentBuilder builder;
+    for (const CTransaction& tx : vTxs)
+        ASSERT_TRUE(builder.add(tx));
+    const uint256 commitment = builder.getCommitment();
+    EXPECT_WITHIN_BUDGET(timer, COMMITMENT_TREE_BUDGET_MS);
+
+    EXPECT_NE(commitment, SidechainTxsCommitmentBuilder::getEmptyCommitment());
+}
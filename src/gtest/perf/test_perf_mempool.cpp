@@ -0,0 +1,78 @@
+#include <gtest/gtest.h>
+
+#include "perf_budget.h"
+
+#include "chainparams.h"
+#include "coins.h"
+#include "main.h"
+#include "random.h"
+#include "txmempool.h"
+
+static const int MEMPOOL_ENTRIES = 100 * 1000;
+//! The entries come in chains, each one spending the previous one
+static const int MEMPOOL_CHAIN_LENGTH = 10;
+static const int64_t MEMPOOL_FILL_BUDGET_MS = 60 * 1000;
+static const int64_t MEMPOOL_TRIM_BUDGET_MS = 30 * 1000;
+static const int64_t MEMPOOL_STALE_BUDGET_MS = 30 * 1000;
+
+class PerfMempoolTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        SelectParams(CBaseChainParams::REGTEST);
+
+        uint256 prevHash;
+        for (int i = 0; i < MEMPOOL_ENTRIES; i++)
+        {
+            CMutableTransaction mtx;
+            mtx.vin.resize(2);
+            mtx.vin[0].prevout = i % MEMPOOL_CHAIN_LENGTH == 0 ? COutPoint(GetRandHash(), 0) : COutPoint(prevHash, 0);
+            mtx.vin[1].prevout = COutPoint(GetRandHash(), 1);
+            mtx.addOut(CTxOut(10 * COIN, CScript() << OP_TRUE));
+            mtx.addOut(CTxOut(5 * COIN, CScript() << OP_TRUE));
+            vTxs.push_back(mtx);
+            prevHash = vTxs.back().GetHash();
+        }
+    }
+
+    void FillPool(CTxMemPool& pool) const {
+        for (size_t i = 0; i < vTxs.size(); i++)
+            pool.addUnchecked(vTxs[i].GetHash(), CTxMemPoolEntry(vTxs[i], 1000 + i, GetTime(), 0.0, 1));
+    }
+
+    std::vector<CTransaction> vTxs;
+};
+
+TEST_F(PerfMempoolTest, FillAndTrimToHalf)
+{
+    CTxMemPool pool(::minRelayTxFee, DEFAULT_MAX_MEMPOOL_SIZE_MB * 1000000);
+    {
+        const CPerfTimer timer;
+        FillPool(pool);
+        EXPECT_WITHIN_BUDGET(timer, MEMPOOL_FILL_BUDGET_MS);
+    }
+    ASSERT_EQ(pool.size(), static_cast<unsigned long>(MEMPOOL_ENTRIES));
+
+    const size_t nHalfSize = pool.GetTotalSize() / 2;
+    const CPerfTimer timer;
+    EXPECT_TRUE(pool.trimToSize(nullptr, nHalfSize, false));
+    EXPECT_WITHIN_BUDGET(timer, MEMPOOL_TRIM_BUDGET_MS);
+    EXPECT_LE(pool.GetTotalSize(), nHalfSize);
+}
+
+TEST_F(PerfMempoolTest, RemoveStaleTransactions)
+{
+    CTxMemPool pool(::minRelayTxFee, DEFAULT_MAX_MEMPOOL_SIZE_MB * 1000000);
+    FillPool(pool);
+
+    // the first entries of the chains spend coins the view does not have, so that all the entries are stale
+    CCoinsView coinsDummy;
+    CCoinsViewCache view(&coinsDummy);
+    std::list<CTransaction> outdatedTxs;
+    std::list<CScCertificate> outdatedCerts;
+
+    const CPerfTimer timer;
+    pool.removeStaleTransactions(&view, outdatedTxs, outdatedCerts);
+    EXPECT_WITHIN_BUDGET(timer, MEMPOOL_STALE_BUDGET_MS);
+    EXPECT_EQ(outdatedTxs.size(), static_cast<size_t>(MEMPOOL_ENTRIES));
+    EXPECT_EQ(pool.size(), 0U);
+}
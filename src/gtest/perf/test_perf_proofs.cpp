@@ -0,0 +1,50 @@
+#include <gtest/gtest.h>
+#include <gtest/libzendoo_test_files.h>
+#include <gtest/tx_creation_utils.h>
+
+#include "perf_budget.h"
+
+#include "main.h"
+#include "primitives/certificate.h"
+#include "sc/proofverifier.h"
+
+using namespace blockchain_test_utils;
+
+static const ProvingSystem testProvingSystem = ProvingSystem::Darlin;
+static const int CERT_PROOFS_IN_BATCH = 256;
+static const int64_t CERT_BATCH_BUDGET_MS = 60 * 1000;
+
+TEST(PerfProofVerifier, BatchOfCertificateProofs)
+{
+    SelectParams(CBaseChainParams::REGTEST);
+    UnloadBlockIndex();
+
+    BlockchainTestManager& blockchain = BlockchainTestManager::GetInstance();
+    blockchain.Reset();
+    blockchain.GenerateSidechainTestParameters(testProvingSystem, TestCircuitType::Certificate, false);
+
+    const uint256 scId = uint256S("aaaa");
+    CSidechain sidechain;
+    sidechain.creationBlockHeight = 100;
+    sidechain.fixedParams.withdrawalEpochLength = 20;
+    sidechain.fixedParams.constant = CFieldElement{SAMPLE_FIELD};
+    sidechain.fixedParams.version = 0;
+    sidechain.fixedParams.wCertVk = blockchain.GetTestVerificationKey(testProvingSystem, TestCircuitType::Certificate);
+    sidechain.lastTopQualityCertReferencedEpoch = -1;
+    sidechain.balance = CAmount(100);
+    blockchain.StoreSidechainWithCurrentHeight(scId, sidechain, sidechain.creationBlockHeight + sidechain.fixedParams.withdrawalEpochLength);
+
+    // the proofs are created before the clock starts, each certificate of its own quality
+    CScProofVerifier verifier(CScProofVerifier::Verification::Strict, CScProofVerifier::Priority::High);
+    for (int i = 0; i < CERT_PROOFS_IN_BATCH; i++)
+    {
+        const CScCertificate cert = blockchain.GenerateCertificate(scId, /*epochNumber*/0, /*quality*/i + 1, testProvingSystem);
+        verifier.LoadDataForCertVerification(*blockchain.CoinsViewCache(), cert);
+    }
+
+    const CPerfTimer timer;
+    EXPECT_TRUE(verifier.BatchVerify());
+    EXPECT_WITHIN_BUDGET(timer, CERT_BATCH_BUDGET_MS);
+
+    UnloadBlockIndex();
+}
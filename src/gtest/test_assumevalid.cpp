@@ -0,0 +1,67 @@
+#include <gtest/gtest.h>
+
+#include "chain.h"
+#include "chainparams.h"
+#include "main.h"
+#include "pow.h"
+
+namespace {
+
+//! Extend blocks with n blocks of the same difficulty, evenly spaced, on top of pprev
+void ExtendChain(std::vector<CBlockIndex>& blocks, CBlockIndex* pprev, size_t n, const Consensus::Params& params)
+{
+    for (size_t i = 0; i < n; i++) {
+        blocks.emplace_back();
+        CBlockIndex& index = blocks.back();
+        index.pprev = pprev;
+        index.nHeight = pprev ? pprev->nHeight + 1 : 0;
+        index.nTime = 1269211443 + index.nHeight * params.nPowTargetSpacing;
+        index.nBits = 0x1e7fffff;
+        index.nChainWork = pprev ? pprev->nChainWork + GetBlockProof(*pprev) : arith_uint256(0);
+        index.BuildSkip();
+        pprev = &index;
+    }
+}
+
+} // anon namespace
+
+TEST(AssumeValid, OnlyTheBuriedAncestorsInTheBestHeaderChainAreAssumedValid)
+{
+    SelectParams(CBaseChainParams::MAIN);
+    const Consensus::Params& params = Params().GetConsensus();
+    // the blocks whose work is the minimum burial of the block assumed valid
+    const int nBuried = ASSUME_VALID_MIN_BURIED_TIME / params.nPowTargetSpacing;
+
+    std::vector<CBlockIndex> chain;
+    chain.reserve(nBuried + 201);
+    ExtendChain(chain, nullptr, nBuried + 201, params);
+    std::vector<CBlockIndex> fork;
+    fork.reserve(10);
+    ExtendChain(fork, &chain[100], 10, params);
+
+    CBlockIndex* pindexBest = &chain.back();
+    CBlockIndex* pindexAssumeValid = &chain[150];
+    ASSERT_GT(GetBlockProofEquivalentTime(*pindexBest, *pindexAssumeValid, *pindexBest, params), ASSUME_VALID_MIN_BURIED_TIME);
+
+    // the ancestors of the block assumed valid, and itself
+    EXPECT_TRUE(IsAssumedValid(&chain[0], pindexAssumeValid, pindexBest, params));
+    EXPECT_TRUE(IsAssumedValid(&chain[100], pindexAssumeValid, pindexBest, params));
+    EXPECT_TRUE(IsAssumedValid(pindexAssumeValid, pindexAssumeValid, pindexBest, params));
+
+    // the block assumed valid is unknown, or there are no headers
+    EXPECT_FALSE(IsAssumedValid(&chain[100], nullptr, pindexBest, params));
+    EXPECT_FALSE(IsAssumedValid(&chain[100], pindexAssumeValid, nullptr, params));
+
+    // the connected block is not one of its ancestors: a descendant, or a block of another branch
+    EXPECT_FALSE(IsAssumedValid(&chain[151], pindexAssumeValid, pindexBest, params));
+    EXPECT_FALSE(IsAssumedValid(&fork[0], pindexAssumeValid, pindexBest, params));
+
+    // the block assumed valid is not in the best header chain, even with its ancestors in it
+    EXPECT_FALSE(IsAssumedValid(&chain[50], &fork.back(), pindexBest, params));
+    EXPECT_FALSE(IsAssumedValid(&fork[0], &fork.back(), pindexBest, params));
+
+    // the block assumed valid is buried under less than two weeks of work
+    EXPECT_FALSE(IsAssumedValid(&chain[100], &chain[chain.size() - 1 - nBuried], pindexBest, params));
+    EXPECT_FALSE(IsAssumedValid(&chain[100], pindexAssumeValid, &chain[150 + nBuried], params));
+    EXPECT_TRUE(IsAssumedValid(&chain[100], pindexAssumeValid, &chain[151 + nBuried], params));
+}
@@ -6,6 +6,7 @@
 #include "sc/asyncproofverifier.h"
 #include "coins.h"
 #include "main.h"
+#include "random.h"
 #include "uint256.h"
 
 #include "tx_creation_utils.h"
@@ -82,7 +83,8 @@ protected:
             MilliSleep(delay);
             timeout -= delay;
             stats = blockchain.GetAsyncProofVerifierStatistics();
-            processed = stats.failedCertCounter + stats.okCertCounter + stats.failedCswCounter + stats.okCswCounter;
+            processed = stats.failedCertCounter + stats.okCertCounter + stats.failedCswCounter + stats.okCswCounter +
+                        stats.cancelledCertCounter;
         } while (timeout > 0 && (blockchain.PendingAsyncCertProofs() > 0 || processed < to_be_processed));
     }
 };
@@ -173,6 +175,41 @@ TEST_F(AsyncProofVerifierTestSuite, Check_Valid_Certificate_Proof_Processing)
     ASSERT_EQ(stats.okCswCounter, 0);
 }
 
+/**
+ * @brief Test that only the best quality certificate of an epoch is verified when
+ * several ones are queued, the others being cancelled once it passes.
+ */
+TEST_F(AsyncProofVerifierTestSuite, Superseded_Certificate_Proofs_Are_Cancelled)
+{
+    BlockchainTestManager& blockchain = BlockchainTestManager::GetInstance();
+    blockchain.Reset();
+
+    // Store the test sidechain and extend the blockchain to complete at least one epoch.
+    blockchain.StoreSidechainWithCurrentHeight(sidechainId, sidechain, sidechain.creationBlockHeight + sidechain.fixedParams.withdrawalEpochLength);
+
+    int epochNumber = 0;
+
+    CMutableScCertificate lowQualityCert = blockchain.GenerateCertificate(sidechainId, epochNumber, 1, testProvingSystem);
+    CMutableScCertificate highQualityCert = blockchain.GenerateCertificate(sidechainId, epochNumber, 2, testProvingSystem);
+
+    AsyncProofVerifierStatistics stats = blockchain.GetAsyncProofVerifierStatistics();
+    ASSERT_EQ(stats.okCertCounter, 0);
+    ASSERT_EQ(stats.cancelledCertCounter, 0);
+
+    CScAsyncProofVerifier::GetInstance().LoadDataForCertVerification(*blockchain.CoinsViewCache(), lowQualityCert, dummyNode.get());
+    CScAsyncProofVerifier::GetInstance().LoadDataForCertVerification(*blockchain.CoinsViewCache(), highQualityCert, dummyNode.get());
+    ASSERT_EQ(blockchain.PendingAsyncCertProofs(), 2);
+
+    waitForAsyncProcessing(blockchain, stats, 2);
+
+    ASSERT_EQ(blockchain.PendingAsyncCertProofs(), 0);
+
+    // Check that the best quality certificate has been verified and the other one cancelled.
+    ASSERT_EQ(stats.failedCertCounter, 0);
+    ASSERT_EQ(stats.okCertCounter, 1);
+    ASSERT_EQ(stats.cancelledCertCounter, 1);
+}
+
 /**
  * @brief Test async proof verifier batch verification pause on CZendooLowPrioThreadGuard.
  */
@@ -585,3 +622,250 @@ TEST_F(AsyncProofVerifierTestSuite, Csw_Queue_Move)
         ASSERT_EQ(tempElement.at(i).scId, inputs.at(i).scId);
     }
 }
+
+/**
+ * @brief Test that the sub-batches keep together the proofs of the same verification key.
+ */
+TEST_F(AsyncProofVerifierTestSuite, Proofs_Are_Partitioned_By_Verification_Key)
+{
+    const CScVKey certVk = sidechain.fixedParams.wCertVk;
+    const CScVKey cswVk = sidechain.fixedParams.wCeasedVk.value();
+
+    std::map</* Tx hash */ uint256, CProofVerifierItem> proofs;
+    for (int i = 0; i < 9; i++)
+    {
+        CProofVerifierItem item;
+        item.txHash = GetRandHash();
+        item.node = nullptr;
+        item.result = ProofVerificationResult::Unknown;
+        if (i < 6)
+        {
+            CCertProofVerifierInput certInput;
+            certInput.verificationKey = certVk;
+            item.proofInput = certInput;
+        }
+        else
+        {
+            CCswProofVerifierInput cswInput;
+            cswInput.verificationKey = cswVk;
+            item.proofInput = std::vector<CCswProofVerifierInput>{cswInput};
+        }
+        proofs[item.txHash] = item;
+    }
+
+    std::vector<std::map</* Tx hash */ uint256, CProofVerifierItem>> subBatches =
+        TEST_FRIEND_CScAsyncProofVerifier::GetInstance().PartitionProofs(proofs, 3);
+    ASSERT_TRUE(proofs.empty());
+    ASSERT_EQ(subBatches.size(), 3);
+
+    int nCertSubBatches = 0;
+    for (const auto& subBatch : subBatches)
+    {
+        // the 6 certificates go in two sub-batches, the 3 CSW transactions in the third one
+        ASSERT_EQ(subBatch.size(), 3);
+        const bool fCert = subBatch.begin()->second.proofInput.type() == typeid(CCertProofVerifierInput);
+        nCertSubBatches += fCert;
+        for (const auto& entry : subBatch)
+            EXPECT_EQ(entry.second.proofInput.type() == typeid(CCertProofVerifierInput), fCert);
+    }
+    EXPECT_EQ(nCertSubBatches, 2);
+
+    // more sub-batches than proofs
+    std::map</* Tx hash */ uint256, CProofVerifierItem> fewProofs;
+    fewProofs.insert(std::move(*subBatches[0].begin()));
+    subBatches = TEST_FRIEND_CScAsyncProofVerifier::GetInstance().PartitionProofs(fewProofs, 4);
+    ASSERT_EQ(subBatches.size(), 4);
+    EXPECT_EQ(subBatches[0].size() + subBatches[1].size() + subBatches[2].size() + subBatches[3].size(), 1);
+}
+
+/**
+ * @brief Test that a peer flooding the queue does not hold back the proofs of the other peers.
+ */
+TEST_F(AsyncProofVerifierTestSuite, Round_Proofs_Are_Shared_Among_Peers)
+{
+    CNode otherNode(INVALID_SOCKET, CAddress(), "", true);
+    otherNode.id = 8;
+
+    std::map</* Tx hash */ uint256, CProofVerifierItem> queue;
+    for (int i = 0; i < 22; i++)
+    {
+        CProofVerifierItem item;
+        item.txHash = GetRandHash();
+        item.node = i < 20 ? dummyNode.get() : &otherNode;
+        item.result = ProofVerificationResult::Unknown;
+        item.proofInput = CCertProofVerifierInput();
+        queue[item.txHash] = item;
+    }
+
+    std::map</* Tx hash */ uint256, CProofVerifierItem> roundProofs;
+    TEST_FRIEND_CScAsyncProofVerifier::GetInstance().TakeRoundProofs(queue, roundProofs, 6);
+    ASSERT_EQ(roundProofs.size(), 6);
+    ASSERT_EQ(queue.size(), 16);
+
+    // the flooding peer gives its weight, the other one all its proofs
+    for (const auto& entry : queue)
+        EXPECT_EQ(entry.second.node, dummyNode.get());
+    int nOtherProofs = 0;
+    for (const auto& entry : roundProofs)
+        nOtherProofs += entry.second.node == &otherNode;
+    EXPECT_EQ(nOtherProofs, 2);
+
+    // the proofs of a single peer are all taken
+    roundProofs.clear();
+    TEST_FRIEND_CScAsyncProofVerifier::GetInstance().TakeRoundProofs(queue, roundProofs, 6);
+    EXPECT_EQ(roundProofs.size(), 16);
+    EXPECT_TRUE(queue.empty());
+}
+
+/**
+ * @brief Test that the weight of a peer in the round composition is lowered by its verification cost.
+ */
+TEST_F(AsyncProofVerifierTestSuite, Verification_Cost_Lowers_Peer_Weight)
+{
+    CNode costlyNode(INVALID_SOCKET, CAddress(), "", true);
+    costlyNode.id = 9;
+    costlyNode.AddProofVerificationCost(10 * CScAsyncProofVerifier::PEER_WEIGHT_COST_UNIT);
+    EXPECT_GE(costlyNode.GetProofVerificationCost(), 9 * CScAsyncProofVerifier::PEER_WEIGHT_COST_UNIT);
+
+    std::map</* Tx hash */ uint256, CProofVerifierItem> queue;
+    for (int i = 0; i < 20; i++)
+    {
+        CProofVerifierItem item;
+        item.txHash = GetRandHash();
+        item.node = i % 2 ? dummyNode.get() : &costlyNode;
+        item.result = ProofVerificationResult::Unknown;
+        item.proofInput = CCertProofVerifierInput();
+        queue[item.txHash] = item;
+    }
+
+    // a turn of the peers, the costly one giving a single proof
+    std::map</* Tx hash */ uint256, CProofVerifierItem> roundProofs;
+    TEST_FRIEND_CScAsyncProofVerifier::GetInstance().TakeRoundProofs(queue, roundProofs, CScAsyncProofVerifier::MAX_PEER_WEIGHT + 1);
+    ASSERT_EQ(roundProofs.size(), CScAsyncProofVerifier::MAX_PEER_WEIGHT + 1);
+    int nCostlyProofs = 0;
+    for (const auto& entry : roundProofs)
+        nCostlyProofs += entry.second.node == &costlyNode;
+    EXPECT_EQ(nCostlyProofs, 1);
+}
+
+TEST(AsyncProofVerifierBatchController, StaticThresholdsWhenNotAdaptive)
+{
+    CAsyncProofVerifierBatchController controller(false, 5000, 10, 4);
+
+    controller.AddArrivalSample(50, 100);
+    controller.AddVerificationSample(10, 1, 1000000);
+
+    ASSERT_EQ(controller.GetBatchDelay(), 5000);
+    ASSERT_EQ(controller.GetBatchSize(), 10);
+    ASSERT_EQ(controller.GetSubBatches(100), 1);
+}
+
+TEST(AsyncProofVerifierBatchController, NoDelayWhenQuiet)
+{
+    CAsyncProofVerifierBatchController controller(true, 5000, 10, 4);
+
+    // No proof has been queued so far, waiting for other proofs is pointless
+    controller.AddArrivalSample(0, 100);
+    ASSERT_EQ(controller.GetBatchDelay(), 0);
+    ASSERT_EQ(controller.GetSubBatches(1), 1);
+}
+
+TEST(AsyncProofVerifierBatchController, SmallerSubBatchesUnderBurst)
+{
+    CAsyncProofVerifierBatchController controller(true, 5000, 10, 4);
+
+    // 1000 ms per proof: a sub-batch should not contain more than 5 proofs to respect the max delay
+    controller.AddVerificationSample(10, 1, 10 * 1000 * 1000);
+    ASSERT_EQ(controller.GetSubBatchSize(), 5);
+    ASSERT_EQ(controller.GetBatchSize(), 20);
+    ASSERT_EQ(controller.GetSubBatches(12), 3);
+    ASSERT_EQ(controller.GetSubBatches(100), 4);
+
+    // A sustained arrival rate shortens the delay to the time needed to fill a batch
+    for (int i = 0; i < 100; i++)
+        controller.AddArrivalSample(10, 100);
+
+    ASSERT_LT(controller.GetBatchDelay(), 5000);
+    ASSERT_GT(controller.GetBatchDelay(), 0);
+
+    AsyncProofVerifierBatchingInfo info = controller.GetInfo();
+    ASSERT_TRUE(info.adaptive);
+    ASSERT_EQ(info.lastSubBatches, 1);
+    ASSERT_EQ(info.maxSubBatches, 4);
+}
+
+TEST(VerifiedProofCache, EntriesDependOnPublicInputs)
+{
+    CVerifiedProofCache& cache = CVerifiedProofCache::GetInstance();
+    cache.Clear();
+
+    CCertProofVerifierInput certInput;
+    certInput.scId = uint256S("aaaa");
+    certInput.epochNumber = 5;
+    certInput.quality = 10;
+    certInput.mainchainBackwardTransferRequestScFee = 0;
+    certInput.forwardTransferScFee = 0;
+
+    uint256 entry = cache.ComputeEntry(certInput);
+    ASSERT_EQ(entry, cache.ComputeEntry(certInput));
+    ASSERT_FALSE(cache.Contains(entry));
+
+    cache.Insert(entry);
+    ASSERT_TRUE(cache.Contains(entry));
+    ASSERT_EQ(cache.Size(), 1);
+
+    // The same proof for a different statement must not be considered verified
+    CCertProofVerifierInput otherQuality = certInput;
+    otherQuality.quality = 11;
+    ASSERT_FALSE(cache.Contains(cache.ComputeEntry(otherQuality)));
+
+    CCertProofVerifierInput otherBt = certInput;
+    otherBt.bt_list.push_back(backward_transfer_t{});
+    otherBt.bt_list.back().amount = 1;
+    ASSERT_FALSE(cache.Contains(cache.ComputeEntry(otherBt)));
+
+    CCswProofVerifierInput cswInput;
+    cswInput.scId = uint256S("aaaa");
+    cswInput.nValue = 1;
+    uint256 cswEntry = cache.ComputeEntry(cswInput);
+    ASSERT_FALSE(cache.Contains(cswEntry));
+
+    cswInput.nValue = 2;
+    ASSERT_NE(cswEntry, cache.ComputeEntry(cswInput));
+
+    cache.Clear();
+    ASSERT_EQ(cache.Size(), 0);
+}
+
+TEST(VerifiedProofCache, BoundedSize)
+{
+    CVerifiedProofCache& cache = CVerifiedProofCache::GetInstance();
+    cache.Clear();
+
+    mapArgs["-maxscproofcachesize"] = "10";
+
+    for (int i = 0; i < 100; i++)
+        cache.Insert(GetRandHash());
+
+    ASSERT_EQ(cache.Size(), 10);
+
+    mapArgs.erase("-maxscproofcachesize");
+    cache.Clear();
+}
+
+TEST(ProofVerifierThreads, ParseCpuList)
+{
+    std::vector<int> cpus;
+    EXPECT_TRUE(CScProofVerifier::ParseCpuList("0-3,6", cpus));
+    EXPECT_EQ(cpus, std::vector<int>({0, 1, 2, 3, 6}));
+
+    // ranges may overlap, each cpu is listed once
+    EXPECT_TRUE(CScProofVerifier::ParseCpuList("5,2-5", cpus));
+    EXPECT_EQ(cpus, std::vector<int>({2, 3, 4, 5}));
+
+    EXPECT_FALSE(CScProofVerifier::ParseCpuList("", cpus));
+    EXPECT_FALSE(CScProofVerifier::ParseCpuList("3-1", cpus));
+    EXPECT_FALSE(CScProofVerifier::ParseCpuList("-1", cpus));
+    EXPECT_FALSE(CScProofVerifier::ParseCpuList("0,a", cpus));
+    EXPECT_FALSE(CScProofVerifier::ParseCpuList("0-100000", cpus));
+}
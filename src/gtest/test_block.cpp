@@ -1,6 +1,7 @@
 #include <gtest/gtest.h>
 
 #include "primitives/block.h"
+#include "random.h"
 
 
 TEST(block_tests, header_size_is_expected) {
@@ -11,3 +12,34 @@ TEST(block_tests, header_size_is_expected) {
 
     ASSERT_EQ(ss.size(), CBlockHeader::HEADER_SIZE);
 }
+
+TEST(block_tests, parallel_merkle_tree_matches_serial) {
+    for (size_t nLeaves : {0, 1, 2, 3, 2047, 2048, 4097, 10001}) {
+        std::vector<uint256> vLeaves;
+        for (size_t i = 0; i < nLeaves; i++)
+            vLeaves.push_back(GetRandHash());
+
+        std::vector<uint256> vSerial(vLeaves), vParallel(vLeaves);
+        bool fMutatedSerial = true, fMutatedParallel = true;
+        uint256 rootSerial = CBlock::BuildMerkleTree(vSerial, nLeaves, &fMutatedSerial);
+        uint256 rootParallel = CBlock::BuildMerkleTree(vParallel, nLeaves, &fMutatedParallel, 4);
+
+        EXPECT_EQ(rootSerial, rootParallel);
+        EXPECT_EQ(vSerial, vParallel);
+        EXPECT_FALSE(fMutatedSerial);
+        EXPECT_FALSE(fMutatedParallel);
+    }
+}
+
+TEST(block_tests, parallel_merkle_tree_detects_duplicates) {
+    // Repeating the last leaf of an even-sized wide level must be flagged as mutated
+    std::vector<uint256> vLeaves;
+    for (size_t i = 0; i < 4095; i++)
+        vLeaves.push_back(GetRandHash());
+    vLeaves.push_back(vLeaves.back());
+
+    bool fMutated = false;
+    std::vector<uint256> vTree(vLeaves);
+    CBlock::BuildMerkleTree(vTree, vLeaves.size(), &fMutated, 4);
+    EXPECT_TRUE(fMutated);
+}
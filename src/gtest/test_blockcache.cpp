@@ -0,0 +1,92 @@
+#include <gtest/gtest.h>
+
+#include "blockcache.h"
+#include "primitives/block.h"
+#include "protocol.h"
+#include "streams.h"
+#include "version.h"
+
+namespace {
+
+std::shared_ptr<const CBlock> MakeBlock(uint32_t nNonce, size_t nTx)
+{
+    std::shared_ptr<CBlock> block = std::make_shared<CBlock>();
+    block->nTime = nNonce;
+    for (size_t i = 0; i < nTx; i++) {
+        CMutableTransaction mtx;
+        mtx.nLockTime = i;
+        mtx.vout.resize(1);
+        mtx.vout[0].scriptPubKey = CScript() << std::vector<unsigned char>(100, 0x51);
+        block->vtx.push_back(mtx);
+    }
+    return block;
+}
+
+} // anon namespace
+
+TEST(BlockCache, GetReturnsTheInsertedBlock)
+{
+    CBlockCache cache(1 << 20);
+    std::shared_ptr<const CBlock> block = MakeBlock(1, 2);
+    EXPECT_FALSE(cache.Get(block->GetHash()));
+
+    cache.Insert(block);
+    EXPECT_EQ(cache.Get(block->GetHash()), block);
+    EXPECT_EQ(cache.Size(), 1U);
+    EXPECT_GT(cache.DynamicUsage(), 0U);
+
+    cache.Clear();
+    EXPECT_FALSE(cache.Get(block->GetHash()));
+    EXPECT_EQ(cache.DynamicUsage(), 0U);
+}
+
+TEST(BlockCache, LeastRecentlyUsedBlocksAreDropped)
+{
+    std::shared_ptr<const CBlock> block1 = MakeBlock(1, 10);
+    std::shared_ptr<const CBlock> block2 = MakeBlock(2, 10);
+    std::shared_ptr<const CBlock> block3 = MakeBlock(3, 10);
+
+    // room for two of the blocks
+    CBlockCache sizing(1 << 20);
+    sizing.Insert(block1);
+    CBlockCache cache(sizing.DynamicUsage() * 2 + 1);
+
+    cache.Insert(block1);
+    cache.Insert(block2);
+    ASSERT_EQ(cache.Get(block1->GetHash()), block1);
+    cache.Insert(block3);
+
+    EXPECT_EQ(cache.Size(), 2U);
+    EXPECT_EQ(cache.Get(block1->GetHash()), block1);
+    EXPECT_FALSE(cache.Get(block2->GetHash()));
+    EXPECT_EQ(cache.Get(block3->GetHash()), block3);
+
+    cache.SetMaxUsage(0);
+    EXPECT_EQ(cache.Size(), 0U);
+    cache.Insert(block1);
+    EXPECT_FALSE(cache.Get(block1->GetHash()));
+}
+
+TEST(BlockCache, BlockMessagesAreSerializedOncePerVersion)
+{
+    CBlockCache cache(1 << 20);
+    std::shared_ptr<const CBlock> block = MakeBlock(1, 3);
+    EXPECT_FALSE(cache.GetMessage(block->GetHash(), PROTOCOL_VERSION));
+
+    cache.Insert(block);
+    const size_t nBlockUsage = cache.DynamicUsage();
+    std::shared_ptr<const CSerializeData> msg = cache.GetMessage(block->GetHash(), PROTOCOL_VERSION);
+    ASSERT_TRUE(msg);
+    EXPECT_EQ(cache.GetMessage(block->GetHash(), PROTOCOL_VERSION), msg);
+    EXPECT_EQ(cache.DynamicUsage(), nBlockUsage + msg->size());
+
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << *block;
+    ASSERT_EQ(msg->size(), CMessageHeader::HEADER_SIZE + ss.size());
+    EXPECT_TRUE(std::equal(ss.begin(), ss.end(), msg->begin() + CMessageHeader::HEADER_SIZE));
+
+    std::shared_ptr<const CSerializeData> otherMsg = cache.GetMessage(block->GetHash(), PROTOCOL_VERSION - 1);
+    ASSERT_TRUE(otherMsg);
+    EXPECT_NE(otherMsg, msg);
+    EXPECT_EQ(cache.DynamicUsage(), nBlockUsage + msg->size() + otherMsg->size());
+}
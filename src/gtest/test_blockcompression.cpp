@@ -0,0 +1,34 @@
+#include <gtest/gtest.h>
+
+#include "blockcompression.h"
+
+#include <string>
+
+TEST(BlockCompression, RoundTrip)
+{
+    if (!IsCompressionSupported())
+        return;
+
+    std::string str;
+    for (int i = 0; i < 1000; i++)
+        str += "block " + std::to_string(i % 10) + " ";
+    CSerializeData vFrame, vData;
+    ASSERT_TRUE(CompressData(str.data(), str.data() + str.size(), 3, vFrame));
+    EXPECT_LT(vFrame.size(), str.size());
+    ASSERT_TRUE(DecompressData(vFrame.data(), vFrame.data() + vFrame.size(), str.size(), vData));
+    EXPECT_EQ(std::string(vData.begin(), vData.end()), str);
+
+    // larger than allowed once decompressed
+    EXPECT_FALSE(DecompressData(vFrame.data(), vFrame.data() + vFrame.size(), str.size() - 1, vData));
+    // truncated, or followed by other data
+    EXPECT_FALSE(DecompressData(vFrame.data(), vFrame.data() + vFrame.size() - 1, str.size(), vData));
+    vFrame.push_back(0);
+    EXPECT_FALSE(DecompressData(vFrame.data(), vFrame.data() + vFrame.size(), str.size(), vData));
+}
+
+TEST(BlockCompression, NotAFrame)
+{
+    const std::string str = "not a zstd frame";
+    CSerializeData vData;
+    EXPECT_FALSE(DecompressData(str.data(), str.data() + str.size(), 1000, vData));
+}
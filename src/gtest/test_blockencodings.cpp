@@ -0,0 +1,151 @@
+#include <gtest/gtest.h>
+
+#include "blockencodings.h"
+#include "chainparams.h"
+#include "main.h"
+#include "streams.h"
+#include "txmempool.h"
+#include "version.h"
+#include <gtest/tx_creation_utils.h>
+
+class BlockEncodingsTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        SelectParams(CBaseChainParams::REGTEST);
+        pool.reset(new CTxMemPool(::minRelayTxFee, DEFAULT_MAX_MEMPOOL_SIZE_MB * 1000000));
+
+        // the coinbase, three more transactions and two certificates
+        for (int i = 0; i < 4; i++)
+            block.vtx.push_back(txCreationUtils::createCoinBase(CAmount(1000 + i)));
+        for (int i = 0; i < 2; i++)
+            block.vcert.push_back(txCreationUtils::createCertificate(uint256S("aaa"), /*epochNum*/i,
+                CFieldElement{}, /*changeTotalAmount*/0, /*numChangeOut*/0, /*bwtTotalAmount*/0,
+                /*numBwt*/1, /*ftScFee*/0, /*mbtrScFee*/0));
+        block.nVersion = 4;
+        block.hashPrevBlock = uint256S("abcd");
+        block.hashMerkleRoot = block.BuildMerkleTree();
+        block.nBits = 0x207fffff;
+    }
+
+    void AddToPool(const CTransaction& tx) {
+        pool->addUnchecked(tx.GetHash(), CTxMemPoolEntry(tx, /*fee*/CAmount(1), /*time*/1000, /*priority*/1.0, /*height*/1));
+    }
+
+    void AddToPool(const CScCertificate& cert) {
+        pool->addUnchecked(cert.GetHash(), CCertificateMemPoolEntry(cert, /*fee*/CAmount(1), /*time*/1000, /*priority*/1.0, /*height*/1));
+    }
+
+    // what the peer receives from the wire
+    CBlockHeaderAndShortTxIDs RoundTrip(const CBlockHeaderAndShortTxIDs& cmpctblock) {
+        CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+        stream << cmpctblock;
+        CBlockHeaderAndShortTxIDs received;
+        stream >> received;
+        return received;
+    }
+
+    std::unique_ptr<CTxMemPool> pool;
+    CBlock block;
+};
+
+TEST_F(BlockEncodingsTest, EmptyMempoolNeedsEverythingButTheCoinbase)
+{
+    CBlockHeaderAndShortTxIDs cmpctblock = RoundTrip(CBlockHeaderAndShortTxIDs(block));
+    EXPECT_EQ(cmpctblock.BlockTxCount(), block.vtx.size());
+    EXPECT_EQ(cmpctblock.BlockCertCount(), block.vcert.size());
+
+    PartiallyDownloadedBlock partialBlock(pool.get());
+    ASSERT_EQ(partialBlock.InitData(cmpctblock), READ_STATUS_OK);
+    ASSERT_EQ(partialBlock.BlockTxCount(), block.vtx.size() + block.vcert.size());
+    EXPECT_TRUE(partialBlock.IsTxAvailable(0));
+    for (size_t i = 1; i < partialBlock.BlockTxCount(); i++)
+        EXPECT_FALSE(partialBlock.IsTxAvailable(i)) << i;
+
+    std::vector<CTransaction> vtx_missing(block.vtx.begin() + 1, block.vtx.end());
+    CBlock rebuilt;
+    EXPECT_EQ(partialBlock.FillBlock(rebuilt, vtx_missing, block.vcert), READ_STATUS_OK);
+    EXPECT_EQ(rebuilt.GetHash(), block.GetHash());
+    EXPECT_EQ(rebuilt.BuildMerkleTree(), block.hashMerkleRoot);
+}
+
+TEST_F(BlockEncodingsTest, MempoolFillsTransactionsAndCertificates)
+{
+    AddToPool(block.vtx[2]);
+    AddToPool(block.vcert[1]);
+
+    CBlockHeaderAndShortTxIDs cmpctblock = RoundTrip(CBlockHeaderAndShortTxIDs(block));
+    PartiallyDownloadedBlock partialBlock(pool.get());
+    ASSERT_EQ(partialBlock.InitData(cmpctblock), READ_STATUS_OK);
+
+    // positions are the transactions followed by the certificates
+    std::vector<uint32_t> missing;
+    for (size_t i = 0; i < partialBlock.BlockTxCount(); i++)
+        if (!partialBlock.IsTxAvailable(i))
+            missing.push_back(i);
+    EXPECT_EQ(missing, std::vector<uint32_t>({1, 3, 4}));
+
+    std::vector<CTransaction> vtx_missing = {block.vtx[1], block.vtx[3]};
+    std::vector<CScCertificate> vcert_missing = {block.vcert[0]};
+    CBlock rebuilt;
+    EXPECT_EQ(partialBlock.FillBlock(rebuilt, vtx_missing, vcert_missing), READ_STATUS_OK);
+    EXPECT_EQ(rebuilt.GetHash(), block.GetHash());
+    EXPECT_EQ(rebuilt.BuildMerkleTree(), block.hashMerkleRoot);
+}
+
+TEST_F(BlockEncodingsTest, FullMempoolNeedsNoRoundTrip)
+{
+    for (size_t i = 1; i < block.vtx.size(); i++)
+        AddToPool(block.vtx[i]);
+    for (const CScCertificate& cert : block.vcert)
+        AddToPool(cert);
+
+    CBlockHeaderAndShortTxIDs cmpctblock = RoundTrip(CBlockHeaderAndShortTxIDs(block));
+    PartiallyDownloadedBlock partialBlock(pool.get());
+    ASSERT_EQ(partialBlock.InitData(cmpctblock), READ_STATUS_OK);
+    for (size_t i = 0; i < partialBlock.BlockTxCount(); i++)
+        EXPECT_TRUE(partialBlock.IsTxAvailable(i)) << i;
+
+    CBlock rebuilt;
+    EXPECT_EQ(partialBlock.FillBlock(rebuilt, {}, {}), READ_STATUS_OK);
+    EXPECT_EQ(rebuilt.GetHash(), block.GetHash());
+    EXPECT_EQ(rebuilt.vcert.size(), block.vcert.size());
+}
+
+TEST_F(BlockEncodingsTest, WrongOrMissingEntriesAreRejected)
+{
+    CBlockHeaderAndShortTxIDs cmpctblock = RoundTrip(CBlockHeaderAndShortTxIDs(block));
+    std::vector<CTransaction> vtx_missing(block.vtx.begin() + 1, block.vtx.end());
+
+    // too few entries
+    {
+        PartiallyDownloadedBlock partialBlock(pool.get());
+        ASSERT_EQ(partialBlock.InitData(cmpctblock), READ_STATUS_OK);
+        CBlock rebuilt;
+        EXPECT_EQ(partialBlock.FillBlock(rebuilt, vtx_missing, {}), READ_STATUS_INVALID);
+    }
+
+    // the right number of entries, with the wrong contents
+    {
+        PartiallyDownloadedBlock partialBlock(pool.get());
+        ASSERT_EQ(partialBlock.InitData(cmpctblock), READ_STATUS_OK);
+        std::vector<CTransaction> vtx_wrong = vtx_missing;
+        vtx_wrong[0] = txCreationUtils::createCoinBase(CAmount(1));
+        CBlock rebuilt;
+        EXPECT_EQ(partialBlock.FillBlock(rebuilt, vtx_wrong, block.vcert), READ_STATUS_FAILED);
+    }
+}
+
+TEST(BlockTransactionsRequest, IndexesRoundTrip)
+{
+    BlockTransactionsRequest req;
+    req.blockhash = uint256S("1234");
+    req.indexes = {0, 1, 3, 4, 1000, std::numeric_limits<uint32_t>::max()};
+
+    CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+    stream << req;
+    BlockTransactionsRequest received;
+    stream >> received;
+
+    EXPECT_EQ(received.blockhash, req.blockhash);
+    EXPECT_EQ(received.indexes, req.indexes);
+}
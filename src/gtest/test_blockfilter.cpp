@@ -0,0 +1,182 @@
+#include <gtest/gtest.h>
+
+#include "blockfilter.h"
+#include "chainparams.h"
+#include "hash.h"
+#include "primitives/block.h"
+#include "random.h"
+#include "streams.h"
+#include "version.h"
+#include <gtest/tx_creation_utils.h>
+
+#include <ios>
+
+static GCSFilter::Element RandomElement()
+{
+    const uint256 hash = GetRandHash();
+    return GCSFilter::Element(hash.begin(), hash.end());
+}
+
+TEST(GCSFilter, NoFalseNegatives)
+{
+    GCSFilter::ElementSet included, excluded;
+    for (int i = 0; i < 1000; i++)
+        included.push_back(RandomElement());
+    for (int i = 0; i < 10000; i++)
+        excluded.push_back(RandomElement());
+
+    GCSFilter filter(0, 0, included);
+    EXPECT_EQ(filter.GetN(), 1000U);
+    for (const GCSFilter::Element& element : included)
+        EXPECT_TRUE(filter.Match(element));
+
+    // the false positive rate is 1/M
+    int nFalsePositives = 0;
+    for (const GCSFilter::Element& element : excluded)
+        nFalsePositives += filter.Match(element);
+    EXPECT_LT(nFalsePositives, 5);
+
+    EXPECT_TRUE(filter.MatchAny({excluded[0], included[10], excluded[1]}));
+    EXPECT_FALSE(filter.MatchAny({excluded[0], excluded[1]}));
+}
+
+TEST(GCSFilter, DuplicatesAreCodedOnce)
+{
+    const GCSFilter::Element element = RandomElement();
+    GCSFilter filter(1, 2, {element, element, RandomElement()});
+    EXPECT_EQ(filter.GetN(), 2U);
+    EXPECT_TRUE(filter.Match(element));
+}
+
+TEST(GCSFilter, EncodingRoundTrip)
+{
+    GCSFilter::ElementSet elements;
+    for (int i = 0; i < 100; i++)
+        elements.push_back(RandomElement());
+    GCSFilter filter(3, 4, elements);
+
+    GCSFilter decoded(3, 4, filter.GetEncoded());
+    EXPECT_EQ(decoded.GetN(), 100U);
+    for (const GCSFilter::Element& element : elements)
+        EXPECT_TRUE(decoded.Match(element));
+
+    // the filters are keyed
+    GCSFilter rekeyed(4, 3, filter.GetEncoded());
+    int nMatches = 0;
+    for (const GCSFilter::Element& element : elements)
+        nMatches += rekeyed.Match(element);
+    EXPECT_LT(nMatches, 5);
+}
+
+TEST(GCSFilter, MalformedEncodingThrows)
+{
+    GCSFilter::ElementSet elements;
+    for (int i = 0; i < 100; i++)
+        elements.push_back(RandomElement());
+    std::vector<unsigned char> vEncoded = GCSFilter(0, 0, elements).GetEncoded();
+    vEncoded.resize(vEncoded.size() - 20);
+    EXPECT_THROW(GCSFilter(0, 0, vEncoded), std::ios_base::failure);
+    EXPECT_THROW(GCSFilter(0, 0, std::vector<unsigned char>()), std::ios_base::failure);
+}
+
+TEST(GCSFilter, EmptyFilter)
+{
+    GCSFilter filter(0, 0, GCSFilter::ElementSet());
+    EXPECT_EQ(filter.GetN(), 0U);
+    EXPECT_EQ(filter.GetEncoded(), std::vector<unsigned char>(1, 0));
+    EXPECT_FALSE(filter.Match(RandomElement()));
+    EXPECT_EQ(GCSFilter().GetEncoded(), filter.GetEncoded());
+}
+
+class BlockFilterTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        SelectParams(CBaseChainParams::REGTEST);
+
+        block.vtx.push_back(txCreationUtils::createCoinBase(CAmount(1000)));
+        block.vtx.push_back(txCreationUtils::createTransparentTx());
+        block.vtx.push_back(txCreationUtils::createNewSidechainTxWith(CAmount(10)));
+        block.vtx.push_back(txCreationUtils::createFwdTransferTxWith(uint256S("bbb"), CAmount(10)));
+        block.vcert.push_back(txCreationUtils::createCertificate(uint256S("aaa"), /*epochNum*/0,
+            CFieldElement{}, /*changeTotalAmount*/0, /*numChangeOut*/0, /*bwtTotalAmount*/1,
+            /*numBwt*/1, /*ftScFee*/0, /*mbtrScFee*/0));
+        block.nVersion = BLOCK_VERSION_SC_SUPPORT;
+        block.hashPrevBlock = uint256S("abcd");
+        block.hashMerkleRoot = block.BuildMerkleTree();
+        block.nBits = 0x207fffff;
+    }
+
+    static GCSFilter::Element ScIdElement(const uint256& scId) {
+        return GCSFilter::Element(scId.begin(), scId.end());
+    }
+
+    CBlock block;
+};
+
+TEST_F(BlockFilterTest, BasicFilterHoldsScriptsOutpointsAndSidechains)
+{
+    const CBlockFilter filter(BlockFilterType::BASIC, block);
+    EXPECT_EQ(filter.GetBlockHash(), block.GetHash());
+    const GCSFilter& gcs = filter.GetFilter();
+
+    for (const CTransaction& tx : block.vtx)
+    {
+        for (const CTxOut& out : tx.GetVout())
+            if (!out.scriptPubKey.empty() && out.scriptPubKey[0] != OP_RETURN)
+                EXPECT_TRUE(gcs.Match(GCSFilter::Element(out.scriptPubKey.begin(), out.scriptPubKey.end())));
+        if (tx.IsCoinBase())
+            continue;
+        for (const CTxIn& in : tx.GetVin())
+        {
+            CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+            ss << in.prevout;
+            EXPECT_TRUE(gcs.Match(GCSFilter::Element(ss.begin(), ss.end())));
+        }
+    }
+
+    // the ids of the sidechain created, of the one sent a forward transfer and of the certificate
+    EXPECT_TRUE(gcs.Match(ScIdElement(block.vtx[2].GetScIdFromScCcOut(0))));
+    EXPECT_TRUE(gcs.Match(ScIdElement(uint256S("bbb"))));
+    EXPECT_TRUE(gcs.Match(ScIdElement(uint256S("aaa"))));
+    // and the backward transfer
+    for (const CTxOut& out : block.vcert[0].GetVout())
+        EXPECT_TRUE(gcs.Match(GCSFilter::Element(out.scriptPubKey.begin(), out.scriptPubKey.end())));
+
+    EXPECT_FALSE(gcs.Match(ScIdElement(uint256S("ccc"))));
+}
+
+TEST_F(BlockFilterTest, SerializationRoundTrip)
+{
+    const CBlockFilter filter(BlockFilterType::BASIC, block);
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << filter;
+
+    CBlockFilter received;
+    ss >> received;
+    EXPECT_EQ(received.GetFilterType(), BlockFilterType::BASIC);
+    EXPECT_EQ(received.GetBlockHash(), filter.GetBlockHash());
+    EXPECT_EQ(received.GetEncodedFilter(), filter.GetEncodedFilter());
+    EXPECT_EQ(received.GetHash(), filter.GetHash());
+    EXPECT_TRUE(received.GetFilter().Match(ScIdElement(uint256S("aaa"))));
+}
+
+TEST_F(BlockFilterTest, HeaderChainsFromThePreviousOne)
+{
+    const CBlockFilter filter(BlockFilterType::BASIC, block);
+    const std::vector<unsigned char>& vEncoded = filter.GetEncodedFilter();
+    EXPECT_EQ(filter.GetHash(), Hash(vEncoded.begin(), vEncoded.end()));
+
+    const uint256 prevHeader = uint256S("1234");
+    const uint256 filterHash = filter.GetHash();
+    EXPECT_EQ(filter.ComputeHeader(prevHeader), Hash(filterHash.begin(), filterHash.end(), prevHeader.begin(), prevHeader.end()));
+    EXPECT_NE(filter.ComputeHeader(prevHeader), filter.ComputeHeader(uint256()));
+}
+
+TEST(BlockFilterType, Names)
+{
+    BlockFilterType filterType = BlockFilterType::INVALID;
+    EXPECT_TRUE(BlockFilterTypeByName("basic", filterType));
+    EXPECT_EQ(filterType, BlockFilterType::BASIC);
+    EXPECT_EQ(BlockFilterTypeName(BlockFilterType::BASIC), "basic");
+    EXPECT_FALSE(BlockFilterTypeByName("extended", filterType));
+}
@@ -0,0 +1,113 @@
+#include <gtest/gtest.h>
+
+#include "blockwriter.h"
+#include "chainparams.h"
+#include "main.h"
+#include "util.h"
+
+#include <boost/filesystem.hpp>
+
+class BlockFileWriterTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        SelectParams(CBaseChainParams::REGTEST);
+        dataDir = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+        boost::filesystem::create_directories(dataDir);
+        mapArgs["-datadir"] = dataDir.string();
+        ClearDatadirCache();
+    }
+
+    void TearDown() override {
+        ClearDatadirCache();
+        boost::system::error_code ec;
+        boost::filesystem::remove_all(dataDir, ec);
+    }
+
+    static std::shared_ptr<const CSerializeData> Record(size_t nSize, char c) {
+        return std::make_shared<CSerializeData>(nSize, c);
+    }
+
+    static std::vector<char> ReadFile(bool fUndo, int nFile) {
+        FILE* file = fUndo ? OpenUndoFile(CDiskBlockPos(nFile, 0), true) : OpenBlockFile(CDiskBlockPos(nFile, 0), true);
+        std::vector<char> vData;
+        if (!file)
+            return vData;
+        char buf[4096];
+        size_t nRead;
+        while ((nRead = fread(buf, 1, sizeof(buf), file)) > 0)
+            vData.insert(vData.end(), buf, buf + nRead);
+        fclose(file);
+        return vData;
+    }
+
+    boost::filesystem::path dataDir;
+};
+
+TEST_F(BlockFileWriterTest, WritesWithoutThreadAreSynchronous)
+{
+    CBlockFileWriter writer;
+    EXPECT_TRUE(writer.Write(false, CDiskBlockPos(0, 0), Record(100, 'a')));
+    EXPECT_EQ(writer.GetPending(false, CDiskBlockPos(0, BLOCK_RECORD_HEADER_SIZE)), nullptr);
+    EXPECT_EQ(ReadFile(false, 0), std::vector<char>(100, 'a'));
+    EXPECT_TRUE(writer.Sync());
+}
+
+TEST_F(BlockFileWriterTest, RecordsAreWrittenInOrder)
+{
+    CBlockFileWriter writer;
+    writer.Start();
+
+    std::vector<char> vExpected, vExpectedUndo;
+    unsigned int nPos = 0, nUndoPos = 0;
+    for (int i = 0; i < 50; i++) {
+        std::shared_ptr<const CSerializeData> record = Record(1000 + i, 'a' + i % 26);
+        EXPECT_TRUE(writer.Write(false, CDiskBlockPos(0, nPos), record));
+        // a record is either still queued, or on disk
+        std::shared_ptr<const CSerializeData> pending = writer.GetPending(false, CDiskBlockPos(0, nPos + BLOCK_RECORD_HEADER_SIZE));
+        if (pending)
+            EXPECT_EQ(*pending, *record);
+        vExpected.insert(vExpected.end(), record->begin(), record->end());
+        nPos += record->size();
+
+        std::shared_ptr<const CSerializeData> undo = Record(100 + i, 'z' - i % 26);
+        EXPECT_TRUE(writer.Write(true, CDiskBlockPos(0, nUndoPos), undo));
+        vExpectedUndo.insert(vExpectedUndo.end(), undo->begin(), undo->end());
+        nUndoPos += undo->size();
+    }
+
+    // the readers of a file wait for the records queued to it
+    writer.WaitForFile(false, CDiskBlockPos(0, 0));
+    writer.WaitForFile(true, CDiskBlockPos(0, 0));
+    EXPECT_EQ(writer.GetPending(false, CDiskBlockPos(0, BLOCK_RECORD_HEADER_SIZE)), nullptr);
+    EXPECT_TRUE(writer.Sync());
+    EXPECT_EQ(ReadFile(false, 0), vExpected);
+    EXPECT_EQ(ReadFile(true, 0), vExpectedUndo);
+
+    writer.Stop();
+}
+
+TEST_F(BlockFileWriterTest, FinalizingCommitTruncatesThePreallocation)
+{
+    CBlockFileWriter writer;
+    writer.Start();
+    writer.Allocate(false, CDiskBlockPos(0, 0), BLOCKFILE_CHUNK_SIZE);
+    writer.Allocate(true, CDiskBlockPos(0, 0), UNDOFILE_CHUNK_SIZE);
+    EXPECT_TRUE(writer.Write(false, CDiskBlockPos(0, 0), Record(300, 'b')));
+    EXPECT_TRUE(writer.Write(true, CDiskBlockPos(0, 0), Record(30, 'u')));
+    writer.Commit(0, 300, 30, /*fFinalize*/true);
+    EXPECT_TRUE(writer.Sync());
+    writer.Stop();
+
+    EXPECT_EQ(ReadFile(false, 0), std::vector<char>(300, 'b'));
+    EXPECT_EQ(ReadFile(true, 0), std::vector<char>(30, 'u'));
+}
+
+TEST_F(BlockFileWriterTest, StopWritesTheQueuedRecords)
+{
+    CBlockFileWriter writer;
+    writer.Start();
+    for (int i = 0; i < 20; i++)
+        EXPECT_TRUE(writer.Write(false, CDiskBlockPos(1, i * 500), Record(500, 'c')));
+    writer.Stop();
+    EXPECT_EQ(ReadFile(false, 1), std::vector<char>(20 * 500, 'c'));
+}
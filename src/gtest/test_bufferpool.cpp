@@ -0,0 +1,51 @@
+#include <gtest/gtest.h>
+
+#include "streams.h"
+#include "support/bufferpool.h"
+#include "version.h"
+
+TEST(BufferPool, SizesAreRoundedToPowersOfTwo)
+{
+    EXPECT_EQ(BufferPoolRoundSize(100), 100U);
+    EXPECT_EQ(BufferPoolRoundSize(BUFFER_POOL_MIN_SIZE), BUFFER_POOL_MIN_SIZE);
+    EXPECT_EQ(BufferPoolRoundSize(BUFFER_POOL_MIN_SIZE + 1), 2 * BUFFER_POOL_MIN_SIZE);
+    EXPECT_EQ(BufferPoolRoundSize(BUFFER_POOL_MAX_SIZE + 1), BUFFER_POOL_MAX_SIZE + 1);
+}
+
+TEST(BufferPool, FreedBuffersAreReused)
+{
+    const size_t nBytes = BufferPoolThreadBytes();
+    void* p = BufferPoolAllocate(10000);
+    BufferPoolDeallocate(p, 10000);
+    EXPECT_EQ(BufferPoolThreadBytes(), nBytes + 16384);
+
+    // any size of the same class gets the same buffer back
+    void* q = BufferPoolAllocate(9000);
+    EXPECT_EQ(q, p);
+    EXPECT_EQ(BufferPoolThreadBytes(), nBytes);
+    BufferPoolDeallocate(q, 9000);
+
+    // the small and the huge buffers are left to the heap
+    BufferPoolDeallocate(BufferPoolAllocate(100), 100);
+    BufferPoolDeallocate(BufferPoolAllocate(BUFFER_POOL_MAX_SIZE + 1), BUFFER_POOL_MAX_SIZE + 1);
+    EXPECT_EQ(BufferPoolThreadBytes(), nBytes + 16384);
+}
+
+TEST(BufferPool, PublicDataStreamRoundTrip)
+{
+    const std::vector<int> v(5000, 7);
+    CPublicDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss.ReserveFor(v);
+    ss << v;
+
+    CDataStream ssSecret(SER_NETWORK, PROTOCOL_VERSION);
+    ssSecret << v;
+    EXPECT_EQ(ss.str(), ssSecret.str());
+
+    CSerializeData d;
+    ss.MoveTo(d);
+    EXPECT_TRUE(ss.empty());
+    std::vector<int> w;
+    CPublicDataStream(d, SER_NETWORK, PROTOCOL_VERSION) >> w;
+    EXPECT_EQ(w, v);
+}
@@ -0,0 +1,117 @@
+#include <gtest/gtest.h>
+
+#include "blockcompression.h"
+#include "chaindata.h"
+#include "clientversion.h"
+#include "streams.h"
+
+#include <boost/filesystem.hpp>
+
+namespace {
+
+class ChainDataTest : public ::testing::Test
+{
+protected:
+    boost::filesystem::path path;
+
+    void SetUp() override
+    {
+        path = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+    }
+
+    void TearDown() override
+    {
+        boost::system::error_code ec;
+        boost::filesystem::remove(path, ec);
+    }
+
+    CChainDataTable NewTable() const
+    {
+        CChainDataTable table("outputs", {{"height", ChainDataType::INT64}, {"txid", ChainDataType::HASH},
+                                          {"script_pubkey", ChainDataType::BYTES}});
+        for (int i = 0; i < 500; i++) {
+            uint256 txid;
+            *txid.begin() = i % 7;
+            table.AddRow((int64_t)(1000 + i / 10), txid, std::vector<unsigned char>(i % 30, 0x76));
+        }
+        return table;
+    }
+
+    void Write(const CChainDataTable& table, int nCompressionLevel)
+    {
+        CAutoFile file(fopen(path.string().c_str(), "wb"), SER_DISK, CLIENT_VERSION);
+        ASSERT_FALSE(file.IsNull());
+        table.Write(file, 1000, 1049, nCompressionLevel);
+    }
+
+    CChainDataTable Read(int& nFirst, int& nLast)
+    {
+        CAutoFile file(fopen(path.string().c_str(), "rb"), SER_DISK, CLIENT_VERSION);
+        return CChainDataTable::Read(file, nFirst, nLast);
+    }
+};
+
+} // anon namespace
+
+TEST_F(ChainDataTest, RoundTrip)
+{
+    const CChainDataTable table = NewTable();
+    for (int nLevel : {0, DEFAULT_CHAIN_DATA_COMPRESSION_LEVEL}) {
+        Write(table, nLevel);
+        int nFirst, nLast;
+        const CChainDataTable read = Read(nFirst, nLast);
+        EXPECT_EQ(nFirst, 1000);
+        EXPECT_EQ(nLast, 1049);
+        EXPECT_EQ(read.GetName(), "outputs");
+        EXPECT_EQ(read.GetRows(), 500U);
+        ASSERT_EQ(read.GetColumns().size(), 3U);
+        for (size_t i = 0; i < 3; i++) {
+            const CChainDataTable::Column& column = read.GetColumns()[i];
+            EXPECT_EQ(column.strName, table.GetColumns()[i].strName);
+            EXPECT_EQ(column.type, table.GetColumns()[i].type);
+            EXPECT_EQ(column.data.str(), table.GetColumns()[i].data.str());
+        }
+
+        // the values of a column follow each other
+        CDataStream ss = read.GetColumns()[2].data;
+        std::vector<unsigned char> vch;
+        for (int i = 0; i < 500; i++) {
+            ss >> vch;
+            EXPECT_EQ(vch.size(), (size_t)(i % 30));
+        }
+        EXPECT_TRUE(ss.empty());
+    }
+
+    if (IsCompressionSupported()) {
+        // the columns are compressed
+        Write(table, DEFAULT_CHAIN_DATA_COMPRESSION_LEVEL);
+        const uintmax_t nCompressed = boost::filesystem::file_size(path);
+        Write(table, 0);
+        EXPECT_LT(nCompressed, boost::filesystem::file_size(path));
+    }
+}
+
+TEST_F(ChainDataTest, CorruptedFileIsRejected)
+{
+    Write(NewTable(), DEFAULT_CHAIN_DATA_COMPRESSION_LEVEL);
+    {
+        FILE* file = fopen(path.string().c_str(), "r+b");
+        ASSERT_NE(file, nullptr);
+        fseek(file, 60, SEEK_SET);
+        const int c = fgetc(file);
+        fseek(file, 60, SEEK_SET);
+        fputc(c ^ 1, file);
+        fclose(file);
+    }
+    int nFirst, nLast;
+    EXPECT_THROW(Read(nFirst, nLast), std::exception);
+}
+
+TEST(ChainData, RowsAreAppendedToTheColumns)
+{
+    CChainDataTable table("sc_events", {{"height", ChainDataType::INT64}});
+    EXPECT_EQ(table.GetRows(), 0U);
+    table.AddRow((int64_t)1);
+    EXPECT_EQ(table.GetRows(), 1U);
+    EXPECT_EQ(table.GetColumns()[0].data.size(), 8U);
+}
@@ -0,0 +1,94 @@
+#include <gtest/gtest.h>
+
+#include "arith_uint256.h"
+#include "chain.h"
+
+#include <deque>
+
+namespace {
+
+class ChainLogicalTimesTest : public ::testing::Test {
+protected:
+    CBlockIndex* Extend(CBlockIndex* pprev, const std::vector<uint32_t>& vTimes)
+    {
+        for (uint32_t nTime : vTimes)
+        {
+            vHashes.push_back(ArithToUint256(arith_uint256(vHashes.size() + 1)));
+            vIndex.emplace_back();
+            CBlockIndex& index = vIndex.back();
+            index.phashBlock = &vHashes.back();
+            index.pprev = pprev;
+            index.nHeight = pprev ? pprev->nHeight + 1 : 0;
+            index.nTime = nTime;
+            pprev = &index;
+        }
+        return pprev;
+    }
+
+    std::vector<std::pair<uint256, unsigned int> > Find(unsigned int nLow, unsigned int nHigh)
+    {
+        std::vector<std::pair<uint256, unsigned int> > vHashes;
+        times.Sync(chain);
+        times.FindRange(chain, nLow, nHigh, vHashes);
+        return vHashes;
+    }
+
+    CChain chain;
+    CChainLogicalTimes times;
+
+private:
+    std::deque<uint256> vHashes;
+    std::deque<CBlockIndex> vIndex;
+};
+
+} // anon namespace
+
+TEST_F(ChainLogicalTimesTest, RangeOfTheChain)
+{
+    chain.SetTip(Extend(nullptr, {5, 100, 110, 120, 130}));
+
+    std::vector<std::pair<uint256, unsigned int> > vHashes = Find(105, 130);
+    ASSERT_EQ(vHashes.size(), 2U);
+    EXPECT_EQ(vHashes[0], std::make_pair(chain[2]->GetBlockHash(), 110U));
+    EXPECT_EQ(vHashes[1], std::make_pair(chain[3]->GetBlockHash(), 120U));
+
+    // the genesis block is not in the timestamp index
+    EXPECT_EQ(Find(0, 1000).size(), 4U);
+    EXPECT_TRUE(Find(131, 1000).empty());
+    EXPECT_TRUE(Find(120, 120).empty());
+}
+
+TEST_F(ChainLogicalTimesTest, TimesBeforeTheParentAreRaised)
+{
+    chain.SetTip(Extend(nullptr, {0, 100, 90, 100, 150}));
+
+    std::vector<std::pair<uint256, unsigned int> > vHashes = Find(0, 1000);
+    ASSERT_EQ(vHashes.size(), 4U);
+    EXPECT_EQ(vHashes[0].second, 100U);
+    EXPECT_EQ(vHashes[1].second, 101U);
+    EXPECT_EQ(vHashes[2].second, 102U);
+    EXPECT_EQ(vHashes[3].second, 150U);
+
+    vHashes = Find(101, 102);
+    ASSERT_EQ(vHashes.size(), 1U);
+    EXPECT_EQ(vHashes[0].first, chain[2]->GetBlockHash());
+}
+
+TEST_F(ChainLogicalTimesTest, SyncsFromTheForkPoint)
+{
+    CBlockIndex* pfork = Extend(nullptr, {0, 100, 110});
+    chain.SetTip(Extend(pfork, {120, 130, 140}));
+    EXPECT_EQ(Find(0, 1000).size(), 5U);
+
+    // a reorg to a shorter chain, with blocks timestamped differently
+    chain.SetTip(Extend(pfork, {125}));
+    std::vector<std::pair<uint256, unsigned int> > vHashes = Find(115, 1000);
+    ASSERT_EQ(vHashes.size(), 1U);
+    EXPECT_EQ(vHashes[0], std::make_pair(chain[3]->GetBlockHash(), 125U));
+
+    chain.SetTip(Extend(chain.Tip(), {126, 200}));
+    EXPECT_EQ(Find(126, 1000).size(), 2U);
+
+    chain.SetTip(NULL);
+    EXPECT_TRUE(Find(0, 1000).empty());
+}
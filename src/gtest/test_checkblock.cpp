@@ -928,3 +928,98 @@ TEST(ContextualCheckBlock, SidechainCreationVersion)
     // Create a block after the sidechain version fork point; SC version 0 and 1 must be accepted
     TestSidechainCreationVersion(sidechainVersionForkHeight + 1, {mtx_v1, mtx_v0}, true);
 }
+
+TEST(CheckBlock, ParallelCheckReportsTheFirstFailingTransaction) {
+    SelectParams(CBaseChainParams::REGTEST);
+    auto verifier = libzcash::ProofVerifier::Disabled();
+
+    CBlock block;
+    block.nVersion = BLOCK_VERSION_SC_SUPPORT;
+    block.vtx.push_back(txCreationUtils::createCoinBase(CAmount(1000)));
+    const CTransaction tx = txCreationUtils::createTransparentTx();
+    for (int i = 0; i < 300; i++)
+        block.vtx.push_back(tx);
+
+    int nSavedThreads = nScriptCheckThreads;
+    nScriptCheckThreads = 4;
+
+    CValidationState validState;
+    EXPECT_TRUE(CheckBlock(block, validState, verifier, flagCheckPow::OFF, flagCheckMerkleRoot::OFF));
+
+    CMutableTransaction negativeOut(tx);
+    negativeOut.getOut(0).nValue = -1;
+    CMutableTransaction emptyVin(tx);
+    emptyVin.vin.clear();
+    block.vtx[100] = negativeOut;
+    block.vtx[200] = emptyVin;
+
+    // the state of the lowest failing transaction, whichever thread found its failure first
+    for (int n = 0; n < 10; n++) {
+        CValidationState state;
+        EXPECT_FALSE(CheckBlock(block, state, verifier, flagCheckPow::OFF, flagCheckMerkleRoot::OFF));
+        EXPECT_EQ(state.GetRejectReason(), std::string("bad-txns-vout-negative"));
+    }
+
+    nScriptCheckThreads = 1;
+    CValidationState sequentialState;
+    EXPECT_FALSE(CheckBlock(block, sequentialState, verifier, flagCheckPow::OFF, flagCheckMerkleRoot::OFF));
+    EXPECT_EQ(sequentialState.GetRejectReason(), std::string("bad-txns-vout-negative"));
+    nScriptCheckThreads = nSavedThreads;
+}
+
+TEST(CheckBlockHeaders, BatchMatchesSingleHeaderChecks) {
+    SelectParams(CBaseChainParams::REGTEST);
+
+    std::vector<CBlockHeader> headers(9);
+    std::vector<char> vSkip(headers.size(), 0);
+    for (size_t i = 0; i < headers.size(); i++) {
+        // alternate between a too low version and a well-formed header carrying a bogus solution
+        headers[i].nVersion = (i % 2) ? 1 : BLOCK_VERSION_SC_SUPPORT;
+        headers[i].nTime = i;
+        headers[i].nSolution.assign(100, (unsigned char)i);
+        vSkip[i] = (i % 3 == 0);
+    }
+
+    int nSavedThreads = nScriptCheckThreads;
+    nScriptCheckThreads = 4;
+    std::vector<CValidationState> vStates;
+    std::vector<char> vChecked;
+    CheckBlockHeaders(headers, vSkip, vStates, vChecked);
+    nScriptCheckThreads = nSavedThreads;
+
+    ASSERT_EQ(headers.size(), vStates.size());
+    ASSERT_EQ(headers.size(), vChecked.size());
+    for (size_t i = 0; i < headers.size(); i++) {
+        if (vSkip[i]) {
+            EXPECT_FALSE(vChecked[i]);
+            EXPECT_TRUE(vStates[i].IsValid());
+            continue;
+        }
+        CValidationState state;
+        EXPECT_FALSE(CheckBlockHeader(headers[i], state));
+        EXPECT_TRUE(vChecked[i]);
+        EXPECT_FALSE(vStates[i].IsValid());
+        EXPECT_EQ(state.GetDoS(), vStates[i].GetDoS());
+        EXPECT_EQ(state.GetRejectReason(), vStates[i].GetRejectReason());
+    }
+}
+
+TEST(CheckBlockHeader, KnownHeadersAreNotCheckedAgain) {
+    SelectParams(CBaseChainParams::REGTEST);
+
+    CBlockHeader header;
+    header.nVersion = BLOCK_VERSION_SC_SUPPORT;
+    header.nSolution.assign(100, 1);
+
+    CValidationState state;
+    EXPECT_FALSE(CheckBlockHeader(header, state));
+    EXPECT_EQ(state.GetRejectReason(), std::string("invalid-solution"));
+
+    // as if it had been accepted
+    const uint256 hash = header.GetHash();
+    CBlockIndex index(header);
+    index.phashBlock = &mapBlockIndex.insert(std::make_pair(hash, &index)).first->first;
+    CValidationState stateKnown;
+    EXPECT_TRUE(CheckBlockHeader(header, stateKnown));
+    mapBlockIndex.erase(hash);
+}
@@ -0,0 +1,94 @@
+#include <gtest/gtest.h>
+
+#include "arith_uint256.h"
+#include "chain.h"
+#include "script/interpreter.h"
+
+#include <deque>
+
+namespace {
+
+class CheckBlockAtHeightViewTest : public ::testing::Test {
+protected:
+    CBlockIndex* Extend(CBlockIndex* pprev, int nCount)
+    {
+        for (int i = 0; i < nCount; i++)
+        {
+            vHashes.push_back(ArithToUint256(arith_uint256(vHashes.size() + 1)));
+            vIndex.emplace_back();
+            CBlockIndex& index = vIndex.back();
+            index.phashBlock = &vHashes.back();
+            index.pprev = pprev;
+            index.nHeight = pprev ? pprev->nHeight + 1 : 0;
+            index.BuildSkip();
+            pprev = &index;
+        }
+        return pprev;
+    }
+
+    std::vector<unsigned char> HashAt(int nHeight) const
+    {
+        const uint256 hash = chain[nHeight]->GetBlockHash();
+        return std::vector<unsigned char>(hash.begin(), hash.end());
+    }
+
+    CChain chain;
+
+private:
+    std::deque<uint256> vHashes;
+    std::deque<CBlockIndex> vIndex;
+};
+
+} // anon namespace
+
+TEST_F(CheckBlockAtHeightViewTest, RecentAndOlderBlocks)
+{
+    chain.SetTip(Extend(nullptr, 1500));
+    const CCheckBlockAtHeightView view(chain, /*nSafeDepth*/1200, /*nRecentBlocks*/100);
+    const std::vector<unsigned char> vchWrong(32, 0xab);
+
+    // among the recent blocks
+    EXPECT_TRUE(view.CheckBlockHash(1450, HashAt(1450)));
+    EXPECT_TRUE(view.CheckBlockHash(1499, HashAt(1499)));
+    EXPECT_FALSE(view.CheckBlockHash(1450, vchWrong));
+    EXPECT_FALSE(view.CheckBlockHash(1450, HashAt(1449)));
+    std::vector<unsigned char> vchShort = HashAt(1450);
+    vchShort.pop_back();
+    EXPECT_FALSE(view.CheckBlockHash(1450, vchShort));
+    EXPECT_FALSE(view.CheckBlockHash(1450, std::vector<unsigned char>()));
+
+    // looked up from the tip
+    EXPECT_TRUE(view.CheckBlockHash(400, HashAt(400)));
+    EXPECT_FALSE(view.CheckBlockHash(400, vchWrong));
+
+    // at the safe depth and below any hash passes, above the tip none
+    EXPECT_TRUE(view.CheckBlockHash(299, vchWrong));
+    EXPECT_TRUE(view.CheckBlockHash(0, std::vector<unsigned char>()));
+    EXPECT_FALSE(view.CheckBlockHash(1500, vchWrong));
+}
+
+TEST_F(CheckBlockAtHeightViewTest, IsOfTheChainAsItWas)
+{
+    CBlockIndex* pfork = Extend(nullptr, 50);
+    chain.SetTip(Extend(pfork, 10));
+    const CCheckBlockAtHeightView view(chain, 100);
+    EXPECT_TRUE(view.IsOf(chain));
+    const std::vector<unsigned char> vchOld = HashAt(55);
+    EXPECT_TRUE(view.CheckBlockHash(55, vchOld));
+
+    chain.SetTip(Extend(pfork, 10));
+    EXPECT_FALSE(view.IsOf(chain));
+    // the view still answers for the chain it was taken from
+    EXPECT_TRUE(view.CheckBlockHash(55, vchOld));
+    EXPECT_FALSE(CCheckBlockAtHeightView(chain, 100).CheckBlockHash(55, vchOld));
+}
+
+TEST_F(CheckBlockAtHeightViewTest, EmptyChain)
+{
+    const CCheckBlockAtHeightView view(chain, 100);
+    EXPECT_TRUE(view.IsOf(chain));
+    EXPECT_FALSE(view.CheckBlockHash(0, std::vector<unsigned char>(32, 0)));
+
+    // the checkers without a view fail the opcode
+    EXPECT_FALSE(TransactionSignatureChecker(nullptr).CheckBlockHash(0, std::vector<unsigned char>(32, 0)));
+}
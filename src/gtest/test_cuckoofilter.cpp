@@ -0,0 +1,151 @@
+#include <gtest/gtest.h>
+
+#include "cuckoofilter.h"
+#include "random.h"
+#include "txdb.h"
+#include "util.h"
+
+#include <boost/filesystem.hpp>
+
+TEST(CuckooFilter, NoFalseNegatives)
+{
+    CCuckooFilter filter(10000);
+    std::vector<uint64_t> vHashes;
+    for (int i = 0; i < 10000; i++) {
+        vHashes.push_back(GetRand(std::numeric_limits<uint64_t>::max()));
+        ASSERT_TRUE(filter.Insert(vHashes.back()));
+    }
+    EXPECT_EQ(filter.Size(), 10000U);
+    EXPECT_FALSE(filter.NeedsResize());
+    for (uint64_t hash : vHashes)
+        EXPECT_TRUE(filter.MayContain(hash));
+
+    int nFalsePositives = 0;
+    for (int i = 0; i < 100000; i++)
+        nFalsePositives += filter.MayContain(GetRand(std::numeric_limits<uint64_t>::max()));
+    EXPECT_LT(nFalsePositives, 100);
+}
+
+TEST(CuckooFilter, EraseKeepsOtherElements)
+{
+    CCuckooFilter filter(1000);
+    std::vector<uint64_t> vHashes;
+    for (int i = 0; i < 1000; i++) {
+        vHashes.push_back(GetRand(std::numeric_limits<uint64_t>::max()));
+        ASSERT_TRUE(filter.Insert(vHashes.back()));
+    }
+    // an element inserted twice stays until erased twice
+    ASSERT_TRUE(filter.Insert(vHashes[0]));
+    for (size_t i = 0; i < vHashes.size(); i += 2)
+        filter.Erase(vHashes[i]);
+    EXPECT_TRUE(filter.MayContain(vHashes[0]));
+    filter.Erase(vHashes[0]);
+    EXPECT_EQ(filter.Size(), 500U);
+    for (size_t i = 1; i < vHashes.size(); i += 2)
+        EXPECT_TRUE(filter.MayContain(vHashes[i]));
+}
+
+TEST(CuckooFilter, OverflowLetsEverythingThrough)
+{
+    CCuckooFilter filter(100);
+    bool fInserted = true;
+    for (size_t i = 0; fInserted && i < 10 * filter.Capacity(); i++)
+        fInserted = filter.Insert(GetRand(std::numeric_limits<uint64_t>::max()));
+    EXPECT_FALSE(fInserted);
+    EXPECT_TRUE(filter.IsOverflowed());
+    EXPECT_TRUE(filter.NeedsResize());
+    EXPECT_TRUE(filter.MayContain(GetRand(std::numeric_limits<uint64_t>::max())));
+}
+
+TEST(CuckooFilter, CoinsViewDB)
+{
+    boost::filesystem::path dataDir = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+    boost::filesystem::create_directories(dataDir);
+    mapArgs["-datadir"] = dataDir.string();
+    ClearDatadirCache();
+
+    uint256 txid = GetRandHash();
+    uint256 txidMissing = GetRandHash();
+    {
+        CCoinsViewDB db(1 << 20, DEFAULT_DB_MAX_OPEN_FILES, false, true);
+        EXPECT_FALSE(db.HaveCoins(txid));
+
+        CCoinsViewCache cache(&db);
+        {
+            CCoinsModifier coins = cache.ModifyCoins(txid);
+            coins->vout.resize(1);
+            coins->vout[0].nValue = 1;
+            coins->vout[0].scriptPubKey = CScript() << OP_TRUE;
+        }
+        ASSERT_TRUE(cache.Flush());
+        EXPECT_TRUE(db.HaveCoins(txid));
+        EXPECT_FALSE(db.HaveCoins(txidMissing));
+    }
+    {
+        // the filter is rebuilt from the db
+        CCoinsViewDB db(1 << 20, DEFAULT_DB_MAX_OPEN_FILES, false, false);
+        EXPECT_TRUE(db.HaveCoins(txid));
+
+        CCoinsViewCache cache(&db);
+        cache.ModifyCoins(txid)->Clear();
+        ASSERT_TRUE(cache.Flush());
+        EXPECT_FALSE(db.HaveCoins(txid));
+    }
+
+    mapArgs.erase("-datadir");
+    ClearDatadirCache();
+    boost::system::error_code ec;
+    boost::filesystem::remove_all(dataDir, ec);
+}
+
+TEST(CuckooFilter, CswNullifiersBatch)
+{
+    boost::filesystem::path dataDir = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+    boost::filesystem::create_directories(dataDir);
+    mapArgs["-datadir"] = dataDir.string();
+    ClearDatadirCache();
+
+    const uint256 scId = GetRandHash();
+    const uint256 otherScId = GetRandHash();
+    std::vector<std::pair<uint256, CFieldElement>> keys;
+    for (int i = 0; i < 200; i++) {
+        std::vector<unsigned char> vNullifier(CFieldElement::ByteSize(), 0);
+        vNullifier[0] = i;
+        vNullifier[1] = i >> 8;
+        keys.push_back(std::make_pair(i % 2 ? otherScId : scId, CFieldElement{vNullifier}));
+    }
+    {
+        CCoinsViewDB db(1 << 20, DEFAULT_DB_MAX_OPEN_FILES, false, true);
+        CCoinsViewCache cache(&db);
+        // one in three of the nullifiers is spent
+        for (size_t i = 0; i < keys.size(); i += 3)
+            ASSERT_TRUE(cache.AddCswNullifier(keys[i].first, keys[i].second));
+        ASSERT_TRUE(cache.Flush());
+
+        // the lookups of the db, the ones of a cache, and one at a time give the same answers
+        std::vector<bool> vHave, vCacheHave;
+        db.HaveCswNullifiers(keys, vHave);
+        CCoinsViewCache cache2(&db);
+        ASSERT_TRUE(cache2.RemoveCswNullifier(keys[0].first, keys[0].second));
+        cache2.HaveCswNullifiers(keys, vCacheHave);
+        ASSERT_EQ(vHave.size(), keys.size());
+        ASSERT_EQ(vCacheHave.size(), keys.size());
+        for (size_t i = 0; i < keys.size(); i++) {
+            EXPECT_EQ(vHave[i], i % 3 == 0) << i;
+            EXPECT_EQ(vHave[i], db.HaveCswNullifier(keys[i].first, keys[i].second)) << i;
+            EXPECT_EQ(vCacheHave[i], i % 3 == 0 && i != 0) << i;
+        }
+
+        // the same pair may be asked twice, and an empty batch answers nothing
+        std::vector<std::pair<uint256, CFieldElement>> twice{keys[3], keys[4], keys[3]};
+        db.HaveCswNullifiers(twice, vHave);
+        EXPECT_EQ(vHave, std::vector<bool>({true, false, true}));
+        db.HaveCswNullifiers({}, vHave);
+        EXPECT_TRUE(vHave.empty());
+    }
+
+    mapArgs.erase("-datadir");
+    ClearDatadirCache();
+    boost::system::error_code ec;
+    boost::filesystem::remove_all(dataDir, ec);
+}
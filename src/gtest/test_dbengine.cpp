@@ -0,0 +1,60 @@
+#include <gtest/gtest.h>
+
+#include "leveldbwrapper.h"
+
+#include <memory>
+
+TEST(DBEngine, BatchesApplyTheirOperationsInOrder)
+{
+    CDBWriteBatch batch;
+    batch.Put("a", "1");
+    batch.Delete("a");
+    batch.Put("b", std::string("2\0", 2));
+    EXPECT_EQ(batch.Count(), 3U);
+
+    std::vector<std::string> vOps;
+    batch.Iterate([&vOps](const CDBSlice& key, const CDBSlice& value) { vOps.push_back("put " + key.ToString() + "=" + value.ToString()); },
+                  [&vOps](const CDBSlice& key) { vOps.push_back("delete " + key.ToString()); });
+    EXPECT_EQ(vOps, std::vector<std::string>({"put a=1", "delete a", "put b=" + std::string("2\0", 2)}));
+}
+
+TEST(DBEngine, MemoryLevelDB)
+{
+    CLevelDBWrapper db("dbengine", CLevelDBOptions(1 << 20, DEFAULT_DB_MAX_OPEN_FILES), /*fMemory*/true);
+
+    CLevelDBBatch batch;
+    for (int i = 0; i < 10; i++)
+        batch.Write(std::make_pair('k', i), i * i);
+    batch.Erase(std::make_pair('k', 3));
+    EXPECT_TRUE(db.WriteBatch(batch));
+
+    int nValue;
+    EXPECT_TRUE(db.Read(std::make_pair('k', 4), nValue));
+    EXPECT_EQ(nValue, 16);
+    EXPECT_FALSE(db.Exists(std::make_pair('k', 3)));
+
+    // the iterators of a snapshot do not see the writes which follow it
+    const CDBSnapshot* snapshot = db.GetSnapshot();
+    EXPECT_TRUE(db.Erase(std::make_pair('k', 0)));
+    std::unique_ptr<CDBIterator> pcursor(db.NewIterator(snapshot));
+    int nKeys = 0;
+    for (pcursor->Seek(CDBSlice("k", 1)); pcursor->Valid() && pcursor->key().starts_with(CDBSlice("k", 1)); pcursor->Next())
+        nKeys++;
+    EXPECT_TRUE(pcursor->status().ok());
+    EXPECT_EQ(nKeys, 9);
+    pcursor.reset();
+    db.ReleaseSnapshot(snapshot);
+
+    pcursor.reset(db.NewIterator());
+    nKeys = 0;
+    for (pcursor->SeekToFirst(); pcursor->Valid(); pcursor->Next())
+        nKeys++;
+    EXPECT_EQ(nKeys, 8);
+}
+
+TEST(DBEngine, UnknownEngine)
+{
+    CLevelDBOptions dbOptions(1 << 20, DEFAULT_DB_MAX_OPEN_FILES);
+    dbOptions.strEngine = "nosuchengine";
+    EXPECT_THROW(CLevelDBWrapper("dbengine", dbOptions, /*fMemory*/true), leveldb_error);
+}
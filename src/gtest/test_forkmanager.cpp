@@ -561,3 +561,13 @@ TEST(ForkManager, HighestFork) {
     const Fork* highestFork = ForkManager::getInstance().getHighestFork();
     EXPECT_EQ(typeid(*highestFork), typeid(ShieldedPoolDeprecationFork));
 }
+
+TEST(ForkManager, ScheduleFollowsSelectedNetwork) {
+    for (CBaseChainParams::Network network : {CBaseChainParams::MAIN, CBaseChainParams::TESTNET, CBaseChainParams::REGTEST}) {
+        SelectParams(network);
+        int forkHeight = ForkManager::getInstance().getHighestFork()->getHeight(network);
+        EXPECT_TRUE(ForkManager::getInstance().isCrossHardFork(forkHeight - 1, forkHeight));
+        EXPECT_FALSE(ForkManager::getInstance().isCrossHardFork(forkHeight, forkHeight + 1));
+    }
+    SelectParams(CBaseChainParams::MAIN);
+}
@@ -0,0 +1,201 @@
+#include <gtest/gtest.h>
+
+#include "headerranges.h"
+#include "primitives/block.h"
+
+#include <set>
+#include <vector>
+
+namespace {
+
+/** A chain of headers from a genesis, checkpointed every nSpacing headers */
+class FakeHeaders
+{
+public:
+    std::vector<CBlockHeader> headers;
+    std::vector<uint256> hashes;
+
+    explicit FakeHeaders(int nCount, uint32_t nSeed = 0)
+    {
+        uint256 hashPrev;
+        for (int i = 0; i <= nCount; i++) {
+            CBlockHeader header;
+            header.hashPrevBlock = hashPrev;
+            header.nTime = 1000 + i;
+            header.nBits = i == 0 ? 0 : nSeed;
+            headers.push_back(header);
+            hashes.push_back(header.GetHash());
+            hashPrev = hashes.back();
+        }
+    }
+
+    Checkpoints::MapCheckpoints Checkpoints(int nSpacing) const
+    {
+        Checkpoints::MapCheckpoints checkpoints;
+        for (int h = 0; h < (int)hashes.size(); h += nSpacing)
+            checkpoints[h] = hashes[h];
+        return checkpoints;
+    }
+
+    //! The headers after nFrom, as a peer answers a getheaders
+    std::vector<CBlockHeader> From(int nFrom, unsigned int nCount) const
+    {
+        std::vector<CBlockHeader> vReply;
+        for (int h = nFrom + 1; h < (int)headers.size() && vReply.size() < nCount; h++)
+            vReply.push_back(headers[h]);
+        return vReply;
+    }
+};
+
+/** The block index the ranges are stitched into */
+struct FakeIndex {
+    std::set<uint256> setKnown;
+    std::vector<uint256> vAccepted;
+
+    void Stitch(CHeaderRanges& ranges, std::vector<NodeId>& vFailed)
+    {
+        ranges.Stitch(
+            [this](const uint256& hash) { return setKnown.count(hash) != 0; },
+            [this](const CBlockHeader& header, NodeId) {
+                if (!setKnown.count(header.hashPrevBlock))
+                    return false;
+                setKnown.insert(header.GetHash());
+                vAccepted.push_back(header.GetHash());
+                return true;
+            },
+            vFailed);
+    }
+};
+
+} // anon namespace
+
+TEST(HeaderRanges, RangesAreFetchedInParallelAndStitchedInOrder)
+{
+    const unsigned int nMaxCount = 8;
+    FakeHeaders chain(60);
+    CHeaderRanges ranges;
+    // the sync is at 5: the ranges are 20-40 and 40-60
+    ranges.Init(chain.Checkpoints(20), 5);
+    ASSERT_TRUE(ranges.IsInitialized());
+
+    // a peer not having the headers of a range gets none
+    EXPECT_FALSE(ranges.Assign(1, 30, 2));
+    ASSERT_TRUE(ranges.Assign(2, 60, 2));
+    ASSERT_TRUE(ranges.Assign(3, 60, 2));
+    EXPECT_FALSE(ranges.Assign(4, 60, 2));
+    EXPECT_TRUE(ranges.IsFetched(20));
+    EXPECT_TRUE(ranges.IsFetched(59));
+    EXPECT_FALSE(ranges.IsFetched(19));
+
+    FakeIndex index;
+    std::vector<NodeId> vFailed;
+    std::vector<int> vNext = {20, 40};
+    for (int nRound = 0; nRound < 3; nRound++) {
+        for (NodeId nodeid : {2, 3}) {
+            uint256 hashFrom, hashStop;
+            if (!ranges.NextRequest(nodeid, 100, hashFrom, hashStop))
+                continue;
+            // a single getheaders at a time
+            uint256 hashFrom2, hashStop2;
+            EXPECT_FALSE(ranges.NextRequest(nodeid, 100, hashFrom2, hashStop2));
+            int& nFrom = vNext[nodeid - 2];
+            EXPECT_EQ(hashFrom, chain.hashes[nFrom]);
+            EXPECT_EQ(hashStop, chain.hashes[nFrom + 20 - nFrom % 20]);
+            std::vector<CBlockHeader> vReply = chain.From(nFrom, nMaxCount);
+            // the peer stops at the checkpoint
+            while (nFrom + (int)vReply.size() > nodeid * 20)
+                vReply.pop_back();
+            ASSERT_TRUE(ranges.IsReply(nodeid, vReply[0].hashPrevBlock));
+            EXPECT_FALSE(ranges.IsReply(nodeid == 2 ? 3 : 2, vReply[0].hashPrevBlock));
+            EXPECT_EQ(ranges.AddHeaders(nodeid, vReply, nMaxCount), CHeaderRanges::AddResult::OK);
+            nFrom += vReply.size();
+        }
+        // nothing connects to the block index yet
+        index.Stitch(ranges, vFailed);
+        EXPECT_TRUE(index.vAccepted.empty());
+    }
+    EXPECT_EQ(ranges.BufferedHeaders(), 40U);
+    // the peers are done
+    EXPECT_FALSE(ranges.IsAssigned(2));
+    EXPECT_FALSE(ranges.IsFetched(30));
+
+    // the sync reaches the first checkpoint: both ranges go in, in order
+    for (int h = 0; h <= 20; h++)
+        index.setKnown.insert(chain.hashes[h]);
+    ranges.SyncedTo(20);
+    index.Stitch(ranges, vFailed);
+    EXPECT_TRUE(vFailed.empty());
+    ASSERT_EQ(index.vAccepted.size(), 40U);
+    for (int h = 21; h <= 60; h++)
+        EXPECT_EQ(index.vAccepted[h - 21], chain.hashes[h]);
+    EXPECT_TRUE(ranges.Empty());
+}
+
+TEST(HeaderRanges, PeersOffTheCheckpointsAreLetGo)
+{
+    const unsigned int nMaxCount = 8;
+    FakeHeaders chain(40), fork(40, 1);
+    CHeaderRanges ranges;
+    ranges.Init(chain.Checkpoints(20), 0);
+
+    // a peer on a chain not ending on the checkpoint
+    ASSERT_TRUE(ranges.Assign(1, 40, 4));
+    uint256 hashFrom, hashStop;
+    ASSERT_TRUE(ranges.NextRequest(1, 100, hashFrom, hashStop));
+    ASSERT_EQ(fork.hashes[0], chain.hashes[0]);
+    EXPECT_EQ(ranges.AddHeaders(1, fork.From(0, 20), 20), CHeaderRanges::AddResult::MISMATCH);
+    EXPECT_FALSE(ranges.IsAssigned(1));
+    EXPECT_FALSE(ranges.Assign(1, 40, 4));
+    EXPECT_EQ(ranges.BufferedHeaders(), 0U);
+
+    // a peer sending a short reply has no more headers, those it sent are kept
+    ASSERT_TRUE(ranges.Assign(2, 40, 4));
+    ASSERT_TRUE(ranges.NextRequest(2, 100, hashFrom, hashStop));
+    EXPECT_EQ(ranges.AddHeaders(2, chain.From(0, 5), nMaxCount), CHeaderRanges::AddResult::SHORT);
+    EXPECT_FALSE(ranges.IsAssigned(2));
+    EXPECT_EQ(ranges.BufferedHeaders(), 5U);
+
+    // a peer not answering in time; the next one goes on from the headers kept
+    ASSERT_TRUE(ranges.Assign(3, 40, 4));
+    ASSERT_TRUE(ranges.NextRequest(3, 100, hashFrom, hashStop));
+    EXPECT_FALSE(ranges.IsTimedOut(3, 100 + HEADERS_RANGE_TIMEOUT));
+    EXPECT_TRUE(ranges.IsTimedOut(3, 101 + HEADERS_RANGE_TIMEOUT));
+    ranges.Release(3, false, true);
+    ASSERT_TRUE(ranges.Assign(4, 40, 4));
+    ASSERT_TRUE(ranges.NextRequest(4, 200, hashFrom, hashStop));
+    EXPECT_EQ(hashFrom, chain.hashes[5]);
+
+    // headers not following each other
+    std::vector<CBlockHeader> vGap = chain.From(6, nMaxCount);
+    EXPECT_FALSE(ranges.IsReply(4, vGap[0].hashPrevBlock));
+    EXPECT_EQ(ranges.AddHeaders(4, vGap, nMaxCount), CHeaderRanges::AddResult::MISMATCH);
+    EXPECT_EQ(ranges.BufferedHeaders(), 5U);
+}
+
+TEST(HeaderRanges, RangeFailingInTheIndexIsFetchedAgain)
+{
+    FakeHeaders chain(40);
+    CHeaderRanges ranges;
+    ranges.Init(chain.Checkpoints(20), 0);
+    ASSERT_TRUE(ranges.Assign(1, 40, 4));
+    uint256 hashFrom, hashStop;
+    ASSERT_TRUE(ranges.NextRequest(1, 100, hashFrom, hashStop));
+    ASSERT_EQ(ranges.AddHeaders(1, chain.From(0, 20), 20), CHeaderRanges::AddResult::OK);
+
+    // the block index takes 10 headers only
+    EXPECT_FALSE(ranges.IsAssigned(1));
+    std::vector<NodeId> vFailed;
+    int nAccepted = 0;
+    std::function<bool(const uint256&)> fKnown = [](const uint256&) { return true; };
+    ranges.Stitch(fKnown, [&nAccepted](const CBlockHeader&, NodeId) { return ++nAccepted <= 10; }, vFailed);
+    ASSERT_EQ(vFailed.size(), 1U);
+    EXPECT_EQ(vFailed[0], 1);
+    EXPECT_EQ(ranges.BufferedHeaders(), 0U);
+
+    // the range goes on after the last header inserted, from another peer
+    EXPECT_FALSE(ranges.Assign(1, 40, 4));
+    ASSERT_TRUE(ranges.Assign(2, 40, 4));
+    ASSERT_TRUE(ranges.NextRequest(2, 100, hashFrom, hashStop));
+    EXPECT_EQ(hashFrom, chain.hashes[10]);
+    EXPECT_FALSE(ranges.Empty());
+}
@@ -0,0 +1,112 @@
+#include <gtest/gtest.h>
+
+#include "arith_uint256.h"
+#include "chain.h"
+#include "headerscache.h"
+#include "primitives/block.h"
+#include "streams.h"
+#include "version.h"
+
+#include <deque>
+
+namespace {
+
+/** A chain of index entries, with hashes of their own */
+class FakeChain
+{
+public:
+    CChain chain;
+
+    CBlockIndex* Extend(CBlockIndex* pprev, int nCount, uint32_t nTime)
+    {
+        for (int i = 0; i < nCount; i++)
+        {
+            vHashes.push_back(ArithToUint256(arith_uint256(vHashes.size() + 1)));
+            vIndex.emplace_back();
+            CBlockIndex& index = vIndex.back();
+            index.phashBlock = &vHashes.back();
+            index.pprev = pprev;
+            index.nHeight = pprev ? pprev->nHeight + 1 : 0;
+            index.nTime = nTime;
+            index.nSolution.assign(1344, (unsigned char)index.nHeight);
+            pprev = &index;
+        }
+        return pprev;
+    }
+
+private:
+    std::deque<uint256> vHashes;
+    std::deque<CBlockIndex> vIndex;
+};
+
+std::string Serialized(const CChain& chain, int nFirst, int nLast)
+{
+    std::vector<CBlockHeaderForNetwork> vHeaders;
+    for (int h = nFirst; h <= nLast; h++)
+        vHeaders.push_back(CBlockHeaderForNetwork(chain[h]->GetBlockHeader()));
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << vHeaders;
+    return ss.str();
+}
+
+std::string Cached(CHeadersCache& cache, const CChain& chain, int nFirst, int nLast)
+{
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << CHeadersRange(cache, chain, nFirst, nLast);
+    return ss.str();
+}
+
+} // anon namespace
+
+TEST(HeadersCache, RangesMatchTheSerializedHeaders)
+{
+    FakeChain fake;
+    fake.chain.SetTip(fake.Extend(nullptr, HEADERS_CACHE_CHUNK_SIZE + 100, 1));
+    CHeadersCache cache(64 << 20);
+
+    EXPECT_EQ(Cached(cache, fake.chain, 0, 10), Serialized(fake.chain, 0, 10));
+    // across two chunks
+    const int nFirst = HEADERS_CACHE_CHUNK_SIZE - 80;
+    EXPECT_EQ(Cached(cache, fake.chain, nFirst, nFirst + 159), Serialized(fake.chain, nFirst, nFirst + 159));
+    EXPECT_EQ(Cached(cache, fake.chain, 5, 4), Serialized(fake.chain, 5, 4));
+
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << fake.chain[7]->GetBlockHeader();
+    const std::vector<char> header = cache.GetHeader(fake.chain, 7);
+    EXPECT_EQ(std::string(header.begin(), header.end()), ss.str());
+    EXPECT_GT(cache.DynamicUsage(), 0U);
+}
+
+TEST(HeadersCache, ReorgedHeadersAreReplaced)
+{
+    FakeChain fake;
+    CBlockIndex* pfork = fake.Extend(nullptr, 50, 1);
+    fake.chain.SetTip(fake.Extend(pfork, 20, 1));
+    CHeadersCache cache(64 << 20);
+    ASSERT_EQ(Cached(cache, fake.chain, 40, 69), Serialized(fake.chain, 40, 69));
+
+    // a shorter chain with other headers after the fork point
+    fake.chain.SetTip(fake.Extend(pfork, 10, 2));
+    EXPECT_EQ(Cached(cache, fake.chain, 40, 59), Serialized(fake.chain, 40, 59));
+}
+
+TEST(HeadersCache, LeastRecentlyUsedChunksAreDropped)
+{
+    FakeChain fake;
+    fake.chain.SetTip(fake.Extend(nullptr, 3 * HEADERS_CACHE_CHUNK_SIZE, 1));
+
+    CHeadersCache sizing(64 << 20);
+    Cached(sizing, fake.chain, 0, HEADERS_CACHE_CHUNK_SIZE - 1);
+    CHeadersCache cache(sizing.DynamicUsage() * 2);
+
+    Cached(cache, fake.chain, 0, HEADERS_CACHE_CHUNK_SIZE - 1);
+    Cached(cache, fake.chain, HEADERS_CACHE_CHUNK_SIZE, 2 * HEADERS_CACHE_CHUNK_SIZE - 1);
+    Cached(cache, fake.chain, 2 * HEADERS_CACHE_CHUNK_SIZE, 3 * HEADERS_CACHE_CHUNK_SIZE - 1);
+    EXPECT_LE(cache.DynamicUsage(), sizing.DynamicUsage() * 2);
+
+    // the chunk in use is kept even above the limit
+    cache.SetMaxUsage(0);
+    EXPECT_EQ(Cached(cache, fake.chain, 0, 10), Serialized(fake.chain, 0, 10));
+    cache.Clear();
+    EXPECT_EQ(cache.DynamicUsage(), 0U);
+}
@@ -0,0 +1,91 @@
+#include <gtest/gtest.h>
+#include "support/allocators/nodepool.h"
+#include "support/hugepages.h"
+#include "support/nodepool.h"
+
+#include <stdint.h>
+
+#include <map>
+#include <set>
+#include <vector>
+
+TEST(HugePages, MappingsAreAlignedAndZeroed)
+{
+    unsigned char* p = static_cast<unsigned char*>(HugePageMap(HUGE_PAGE_SIZE + 1));
+    ASSERT_NE(p, nullptr);
+    EXPECT_EQ(reinterpret_cast<uintptr_t>(p) % HUGE_PAGE_SIZE, 0U);
+    // rounded up to two huge pages
+    EXPECT_EQ(p[0], 0);
+    EXPECT_EQ(p[2 * HUGE_PAGE_SIZE - 1], 0);
+    p[2 * HUGE_PAGE_SIZE - 1] = 1;
+    HugePageUnmap(p, HUGE_PAGE_SIZE + 1);
+}
+
+TEST(HugePages, ParseMode)
+{
+    HugePageMode mode;
+    ASSERT_TRUE(ParseHugePageMode("transparent", mode));
+    EXPECT_EQ(mode, HugePageMode::TRANSPARENT);
+    ASSERT_TRUE(ParseHugePageMode("explicit", mode));
+    EXPECT_EQ(mode, HugePageMode::EXPLICIT);
+    ASSERT_TRUE(ParseHugePageMode("off", mode));
+    EXPECT_EQ(mode, HugePageMode::OFF);
+    EXPECT_FALSE(ParseHugePageMode("always", mode));
+}
+
+TEST(NodePool, NodesAreReusedAndChunksReleased)
+{
+    CNodePool pool(40);
+    const size_t nPerChunk = pool.NodesPerChunk();
+    ASSERT_GT(nPerChunk, 1000U);
+
+    std::vector<void*> vNodes;
+    std::set<void*> setNodes;
+    for (size_t i = 0; i < 3 * nPerChunk; i++) {
+        void* p = pool.Allocate();
+        EXPECT_EQ(reinterpret_cast<uintptr_t>(p) % 16, 0U);
+        EXPECT_TRUE(setNodes.insert(p).second);
+        vNodes.push_back(p);
+    }
+    EXPECT_EQ(pool.ChunkCount(), 3U);
+
+    // a freed node is the next one given
+    pool.Deallocate(vNodes[5]);
+    EXPECT_EQ(pool.Allocate(), vNodes[5]);
+
+    // the emptied chunks are unmapped, but for one
+    for (void* p : vNodes)
+        pool.Deallocate(p);
+    EXPECT_EQ(pool.ChunkCount(), 1U);
+
+    // which serves the next nodes
+    void* p = pool.Allocate();
+    EXPECT_EQ(pool.ChunkCount(), 1U);
+    pool.Deallocate(p);
+}
+
+TEST(NodePool, AllocatorPoolsOnlyWithHugePages)
+{
+    ASSERT_EQ(GetHugePageMode(), HugePageMode::OFF);
+    node_pool_allocator<std::pair<const int, int>> heap;
+    EXPECT_FALSE(heap.fPooled);
+
+    ASSERT_TRUE(SetHugePageMode(HugePageMode::TRANSPARENT, false));
+    typedef std::map<int, int, std::less<int>, node_pool_allocator<std::pair<const int, int>>> PooledMap;
+    {
+        PooledMap m;
+        EXPECT_TRUE(m.get_allocator().fPooled);
+        for (int i = 0; i < 10000; i++)
+            m[i] = i;
+
+        // a map created with the mode off allocates from the heap, and the allocators follow the swapped nodes
+        SetHugePageMode(HugePageMode::OFF, false);
+        PooledMap other;
+        EXPECT_FALSE(other.get_allocator().fPooled);
+        other[1] = 1;
+        other.swap(m);
+        EXPECT_TRUE(other.get_allocator().fPooled);
+        EXPECT_EQ(other.size(), 10000U);
+    }
+    SetHugePageMode(HugePageMode::OFF, false);
+}
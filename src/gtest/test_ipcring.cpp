@@ -0,0 +1,141 @@
+#include <gtest/gtest.h>
+#include "zen/ipcring.h"
+
+#include <boost/filesystem.hpp>
+
+#include <string>
+#include <thread>
+#include <vector>
+
+class IpcRingTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        path = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+    }
+
+    void TearDown() override {
+        boost::system::error_code ec;
+        boost::filesystem::remove(path, ec);
+    }
+
+    static int64_t Append(CIpcRingWriter& writer, CIpcRingRecord::Type type, const std::vector<unsigned char>& vData) {
+        return writer.Append(type, {{vData.data(), vData.size()}});
+    }
+
+    static std::vector<unsigned char> Data(size_t nSize, unsigned char c) {
+        return std::vector<unsigned char>(nSize, c);
+    }
+
+    boost::filesystem::path path;
+};
+
+TEST_F(IpcRingTest, RecordsAreReadInOrder)
+{
+    std::string strError;
+    CIpcRingWriter writer;
+    ASSERT_TRUE(writer.Open(path.string(), 4096, strError)) << strError;
+    CIpcRingReader reader;
+    ASSERT_TRUE(reader.Open(path.string(), strError)) << strError;
+
+    CIpcRingRecord record;
+    std::vector<unsigned char> vPayload;
+    EXPECT_EQ(reader.Next(record, vPayload), CIpcRingReader::EMPTY);
+
+    // the parts of a record are concatenated
+    const std::vector<unsigned char> vHead = Data(3, 'h'), vBody = Data(50, 'b');
+    EXPECT_EQ(writer.Append(CIpcRingRecord::RECORD_BLOCK, {{vHead.data(), vHead.size()}, {vBody.data(), vBody.size()}}), 0);
+    EXPECT_EQ(Append(writer, CIpcRingRecord::RECORD_TIP, Data(36, 't')), 72);
+
+    ASSERT_EQ(reader.Next(record, vPayload), CIpcRingReader::OK);
+    EXPECT_EQ(record.nType, CIpcRingRecord::RECORD_BLOCK);
+    EXPECT_EQ(record.nSequence, 0U);
+    std::vector<unsigned char> vExpected = vHead;
+    vExpected.insert(vExpected.end(), vBody.begin(), vBody.end());
+    EXPECT_EQ(vPayload, vExpected);
+
+    ASSERT_EQ(reader.Next(record, vPayload), CIpcRingReader::OK);
+    EXPECT_EQ(record.nType, CIpcRingRecord::RECORD_TIP);
+    EXPECT_EQ(record.nSequence, 1U);
+    EXPECT_EQ(vPayload, Data(36, 't'));
+    EXPECT_EQ(reader.Next(record, vPayload), CIpcRingReader::EMPTY);
+
+    // too large for the ring
+    EXPECT_EQ(Append(writer, CIpcRingRecord::RECORD_BLOCK, Data(4096, 'x')), -1);
+}
+
+TEST_F(IpcRingTest, RecordsDoNotWrap)
+{
+    std::string strError;
+    CIpcRingWriter writer;
+    ASSERT_TRUE(writer.Open(path.string(), 1024, strError)) << strError;
+    CIpcRingReader reader;
+    ASSERT_TRUE(reader.Open(path.string(), strError)) << strError;
+
+    CIpcRingRecord record;
+    std::vector<unsigned char> vPayload;
+    // records of 312 bytes: the fourth one does not fit in the 88 bytes left, and goes at the start
+    for (int i = 0; i < 20; i++) {
+        const int64_t nOffset = Append(writer, CIpcRingRecord::RECORD_HEADER, Data(296, 'a' + i));
+        ASSERT_GE(nOffset, 0);
+        EXPECT_LE(nOffset % 1024 + 312, 1024);
+        ASSERT_EQ(reader.Next(record, vPayload), CIpcRingReader::OK);
+        EXPECT_EQ(vPayload, Data(296, 'a' + i));
+        EXPECT_EQ(record.nSequence, (uint64_t)i);
+    }
+    EXPECT_EQ(reader.Next(record, vPayload), CIpcRingReader::EMPTY);
+}
+
+TEST_F(IpcRingTest, LaggingReaderLosesTheOverwrittenRecords)
+{
+    std::string strError;
+    CIpcRingWriter writer;
+    ASSERT_TRUE(writer.Open(path.string(), 1024, strError)) << strError;
+    CIpcRingReader reader;
+    ASSERT_TRUE(reader.Open(path.string(), strError)) << strError;
+
+    for (int i = 0; i < 10; i++)
+        ASSERT_GE(Append(writer, CIpcRingRecord::RECORD_BLOCK, Data(100, 'a' + i)), 0);
+
+    // the reader continues from the oldest record still in the ring
+    CIpcRingRecord record;
+    std::vector<unsigned char> vPayload;
+    EXPECT_EQ(reader.Next(record, vPayload), CIpcRingReader::LOST);
+    uint64_t nExpected = 0;
+    while (reader.Next(record, vPayload) == CIpcRingReader::OK) {
+        EXPECT_GT(record.nSequence, nExpected);
+        nExpected = record.nSequence;
+        EXPECT_EQ(vPayload, Data(100, 'a' + record.nSequence));
+    }
+    EXPECT_EQ(nExpected, 9U);
+}
+
+TEST_F(IpcRingTest, ConcurrentReaderSeesWholeRecords)
+{
+    std::string strError;
+    CIpcRingWriter writer;
+    ASSERT_TRUE(writer.Open(path.string(), 8192, strError)) << strError;
+    CIpcRingReader reader;
+    ASSERT_TRUE(reader.Open(path.string(), strError)) << strError;
+
+    const int nRecords = 20000;
+    std::thread producer([&writer]() {
+        for (int i = 0; i < nRecords; i++) {
+            std::vector<unsigned char> vData = Data(1 + i % 700, (unsigned char)i);
+            writer.Append(CIpcRingRecord::RECORD_BLOCK, {{vData.data(), vData.size()}});
+        }
+    });
+
+    CIpcRingRecord record;
+    std::vector<unsigned char> vPayload;
+    int64_t nLast = -1;
+    while (nLast < nRecords - 1) {
+        const CIpcRingReader::Result result = reader.Next(record, vPayload);
+        if (result != CIpcRingReader::OK)
+            continue;
+        // records may be lost, but those returned are whole
+        ASSERT_GT((int64_t)record.nSequence, nLast);
+        nLast = record.nSequence;
+        ASSERT_EQ(vPayload, Data(1 + nLast % 700, (unsigned char)nLast));
+    }
+    producer.join();
+}
@@ -613,3 +613,15 @@ TEST(joinsplit, note_class)
     ASSERT_EQ(note.r, clone.r);
     ASSERT_EQ(note.a_pk, clone.a_pk);
 }
+
+TEST(joinsplit, proving_threads)
+{
+    SetProvingThreads(3);
+    EXPECT_EQ(GetProvingThreads(), 3);
+
+    // 0, and below, is for all the cores
+    SetProvingThreads(-2);
+    EXPECT_GE(GetProvingThreads(), 1);
+    SetProvingThreads(DEFAULT_PROVER_THREADS);
+    EXPECT_GE(GetProvingThreads(), 1);
+}
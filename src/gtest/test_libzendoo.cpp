@@ -21,6 +21,7 @@
 #include <boost/dll/runtime_symbol_info.hpp>
 #include <boost/dynamic_bitset.hpp>
 #include <fstream>
+#include <thread>
 
 extern unsigned char ReverseBitsInByte(unsigned char input);
 
@@ -386,6 +387,28 @@ TEST(SidechainsField, CtorWithWrappedPtr)
     EXPECT_EQ(fe_C.getUseCount(), 0);
 }
 
+TEST(SidechainsField, ConcurrentDeserialization)
+{
+    CFieldElement fe {SAMPLE_FIELD};
+    std::vector<wrappedFieldPtr> ptrs(8);
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < ptrs.size(); i++)
+        threads.emplace_back([&fe, &ptrs, i]() { ptrs[i] = fe.GetFieldElement(); });
+    for (std::thread& t : threads)
+        t.join();
+
+    // a single deserialized element is published and shared by all the callers
+    for (const wrappedFieldPtr& ptr : ptrs)
+        EXPECT_EQ(ptr, ptrs[0]);
+    ASSERT_TRUE(ptrs[0] != nullptr);
+    EXPECT_EQ(fe.getUseCount(), (long)ptrs.size() + 1);
+
+    fe.SetNull();
+    EXPECT_TRUE(fe.IsNull());
+    EXPECT_EQ(fe.getUseCount(), 0);
+    EXPECT_EQ(fe.GetFieldElement(), nullptr);
+}
+
 TEST(SidechainsField, ComputeHash_EmptyField)
 {
     std::vector<unsigned char> lhs {
@@ -2004,6 +2027,63 @@ TEST(CctpLibrary, TestVectorsValidity)
     EXPECT_TRUE(p4.IsValid());
 }
 
+TEST(CctpLibrary, VKeyCacheSharesDeserializedKeys)
+{
+    CScVKeyCache::GetInstance().Clear();
+
+    // Two keys with the same bytes, as the ones of a sidechain read twice from the coins db
+    CScVKey vk1{SAMPLE_CERT_DARLIN_VK};
+    CScVKey vk2{SAMPLE_CERT_DARLIN_VK};
+
+    wrappedScVkeyPtr ptr1 = vk1.GetVKeyPtr();
+    ASSERT_TRUE(ptr1 != nullptr);
+    EXPECT_EQ(CScVKeyCache::GetInstance().Size(), 1);
+
+    // The second one is not deserialized again
+    EXPECT_EQ(vk2.GetVKeyPtr().get(), ptr1.get());
+    EXPECT_EQ(CScVKeyCache::GetInstance().Size(), 1);
+
+    CScVKey vk3{SAMPLE_CSW_DARLIN_VK};
+    EXPECT_NE(vk3.GetVKeyPtr().get(), ptr1.get());
+    EXPECT_EQ(CScVKeyCache::GetInstance().Size(), 2);
+
+    // Invalid keys are not cached
+    std::vector<unsigned char> INVALID_CERT_DARLIN_VK = SAMPLE_CERT_DARLIN_VK;
+    INVALID_CERT_DARLIN_VK.push_back(0xAB);
+    EXPECT_FALSE(CScVKey{INVALID_CERT_DARLIN_VK}.IsValid());
+    EXPECT_EQ(CScVKeyCache::GetInstance().Size(), 2);
+
+    CScVKeyCache::GetInstance().Clear();
+}
+
+TEST(CctpLibrary, CctpObjectsCountTheirDeserializedForm)
+{
+    EXPECT_EQ(CFieldElement{}.DynamicMemoryUsage(), 0U);
+    EXPECT_EQ(CScVKey{}.DynamicMemoryUsage(), 0U);
+
+    // the usage does not change once the objects are deserialized, as they are counted as such already
+    CScVKey vk{SAMPLE_CERT_DARLIN_VK};
+    const size_t nVkUsage = vk.DynamicMemoryUsage();
+    EXPECT_GT(nVkUsage, SAMPLE_CERT_DARLIN_VK.size() * (1 + Sidechain::FFI_POINTS_EXPANSION));
+    ASSERT_TRUE(vk.IsValid());
+    EXPECT_EQ(vk.DynamicMemoryUsage(), nVkUsage);
+
+    CFieldElement fe{SAMPLE_FIELD};
+    const size_t nFeUsage = fe.DynamicMemoryUsage();
+    EXPECT_GE(nFeUsage, Sidechain::FFI_FIELD_ELEMENT_USAGE);
+    ASSERT_TRUE(fe.IsValid());
+    EXPECT_EQ(fe.DynamicMemoryUsage(), nFeUsage);
+
+    // the keys held by the cache of the deserialized keys are counted with it
+    CScVKeyCache::GetInstance().Clear();
+    EXPECT_EQ(CScVKeyCache::GetInstance().DynamicMemoryUsage(), 0U);
+    CScVKey vk2{SAMPLE_CSW_DARLIN_VK};
+    ASSERT_TRUE(vk2.IsValid());
+    EXPECT_GT(CScVKeyCache::GetInstance().DynamicMemoryUsage(), SAMPLE_CSW_DARLIN_VK.size() * Sidechain::FFI_POINTS_EXPANSION);
+    CScVKeyCache::GetInstance().Clear();
+    EXPECT_EQ(CScVKeyCache::GetInstance().DynamicMemoryUsage(), 0U);
+}
+
 //TODO: Maybe it's not the correct place for this test
 TEST(CctpLibrary, TestInvalidProofVkWhenOversized)
 {
@@ -2601,6 +2681,54 @@ TEST(CctpLibrary, CommitmentBuilder_toomanyFT)
     ASSERT_EQ(cbsRef.cbsaMap[sidechainId].cert, 0);
 }
 
+TEST(CctpLibrary, CommitmentBuilder_rollback)
+{
+    SidechainTxsCommitmentBuilder cmtObj;
+    SidechainTxsCommitmentBuilder refObj;
+
+    uint256 sidechainId = uint256S("abc");
+    uint256 sidechainId2 = uint256S("abcba");
+    CMutableTransaction mtx;
+    mtx.nVersion = SC_TX_VERSION;
+
+    // forward transfers: one less than the limit
+    for (int i = 0; i < CCTP_COMMITMENT_BUILDER_FT_LIMIT - 1; i++)
+        mtx.vft_ccout.push_back(CTxForwardTransferOut(sidechainId, CAmount(43), uint256S("abba101"), uint160S("abba101")));
+
+    CTransaction tx(mtx);
+    ASSERT_TRUE(cmtObj.add(tx));
+    ASSERT_TRUE(refObj.add(tx));
+
+    // The first FT reaches the limit and gets into the tree, the second one fails
+    CMutableTransaction mtx2;
+    mtx2.nVersion = SC_TX_VERSION;
+    for (int i = 0; i < 2; i++)
+        mtx2.vft_ccout.push_back(CTxForwardTransferOut(sidechainId, CAmount(43), uint256S("abba101"), uint160S("abba101")));
+
+    CTransaction tx2(mtx2);
+    size_t nCheckpoint = cmtObj.checkpoint();
+    ASSERT_FALSE(cmtObj.add(tx2));
+    cmtObj.rollback(nCheckpoint);
+    EXPECT_EQ(cmtObj.getCommitment(), refObj.getCommitment());
+
+    // A tx added after the checkpoint is dropped as well
+    CMutableTransaction mtx3;
+    mtx3.nVersion = SC_TX_VERSION;
+    mtx3.vft_ccout.push_back(CTxForwardTransferOut(sidechainId2, CAmount(43), uint256S("abba101"), uint160S("abba101")));
+
+    CTransaction tx3(mtx3);
+    nCheckpoint = cmtObj.checkpoint();
+    ASSERT_TRUE(cmtObj.add(tx3));
+    EXPECT_NE(cmtObj.getCommitment(), refObj.getCommitment());
+    cmtObj.rollback(nCheckpoint);
+    EXPECT_EQ(cmtObj.getCommitment(), refObj.getCommitment());
+
+    // And the builder keeps working after the rollback
+    ASSERT_TRUE(cmtObj.add(tx3));
+    ASSERT_TRUE(refObj.add(tx3));
+    EXPECT_EQ(cmtObj.getCommitment(), refObj.getCommitment());
+}
+
 TEST(CctpLibrary, CommitmentBuilder_toomanyBWTR)
 {
     SidechainTxsCommitmentBuilder cmtObj;
@@ -0,0 +1,77 @@
+#include <gtest/gtest.h>
+
+#include "sync.h"
+#include "utiltime.h"
+
+#include <thread>
+
+namespace {
+
+const CLockSiteStats* FindSite(const std::vector<CLockSiteStats>& vStats, const std::string& strName)
+{
+    for (const CLockSiteStats& stats : vStats)
+        if (stats.strName == strName)
+            return &stats;
+    return nullptr;
+}
+
+}
+
+TEST(LockStats, NothingIsGatheredWhenDisabled)
+{
+    ResetLockStats();
+    CCriticalSection csDisabled;
+    {
+        LOCK(csDisabled);
+    }
+    EXPECT_EQ(FindSite(GetLockStats(), "csDisabled"), nullptr);
+}
+
+TEST(LockStats, CountsAcquisitionsAndContentions)
+{
+    ResetLockStats();
+    fLockStats = true;
+
+    CCriticalSection csTracked;
+    for (int i = 0; i < 3; ++i) {
+        LOCK(csTracked);
+    }
+    {
+        TRY_LOCK(csTracked, lockTracked);
+        bool fLocked = lockTracked;
+        EXPECT_TRUE(fLocked);
+    }
+
+    // another thread holds the lock for a while, the one of the test has to wait for it
+    std::atomic<bool> fHeld(false);
+    std::thread holder([&] {
+        LOCK(csTracked);
+        fHeld = true;
+        MilliSleep(50);
+    });
+    while (!fHeld)
+        MilliSleep(1);
+    {
+        LOCK(csTracked);
+    }
+    holder.join();
+
+    fLockStats = false;
+    uint64_t nAcquisitions = 0, nContentions = 0, nWaitNanos = 0, nMaxHoldNanos = 0;
+    for (const CLockSiteStats& stats : GetLockStats()) {
+        if (stats.strName != "csTracked")
+            continue;
+        nAcquisitions += stats.nAcquisitions;
+        nContentions += stats.nContentions;
+        nWaitNanos += stats.nWaitNanos;
+        nMaxHoldNanos = std::max(nMaxHoldNanos, stats.nMaxHoldNanos);
+    }
+    // the stats of the exited holder thread are kept
+    EXPECT_EQ(nAcquisitions, 6U);
+    EXPECT_EQ(nContentions, 1U);
+    EXPECT_GT(nWaitNanos, 0U);
+    EXPECT_GE(nMaxHoldNanos, 50U * 1000 * 1000);
+
+    ResetLockStats();
+    EXPECT_EQ(FindSite(GetLockStats(), "csTracked"), nullptr);
+}
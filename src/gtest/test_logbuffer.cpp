@@ -0,0 +1,68 @@
+#include <gtest/gtest.h>
+#include "logbuffer.h"
+
+#include <string>
+#include <thread>
+#include <vector>
+
+TEST(LogRingBuffer, FirstInFirstOut) {
+    CLogRingBuffer buffer(3);
+    ASSERT_EQ(buffer.Capacity(), 4U);
+
+    std::string str;
+    EXPECT_FALSE(buffer.Pop(str));
+    for (int i = 0; i < 4; i++) {
+        str = std::to_string(i);
+        ASSERT_TRUE(buffer.Push(str));
+    }
+    // a full buffer leaves the line to the caller
+    str = "4";
+    EXPECT_FALSE(buffer.Push(str));
+    EXPECT_EQ(str, "4");
+
+    for (int i = 0; i < 4; i++) {
+        ASSERT_TRUE(buffer.Pop(str));
+        EXPECT_EQ(str, std::to_string(i));
+    }
+    EXPECT_FALSE(buffer.Pop(str));
+
+    // the cells are taken again once popped
+    str = "5";
+    EXPECT_TRUE(buffer.Push(str));
+    ASSERT_TRUE(buffer.Pop(str));
+    EXPECT_EQ(str, "5");
+}
+
+TEST(LogRingBuffer, ConcurrentPushesKeepTheOrderOfEachThread) {
+    CLogRingBuffer buffer(64);
+    const int nThreads = 4;
+    const int nLines = 10000;
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < nThreads; t++) {
+        threads.emplace_back([&buffer, t] {
+            for (int i = 0; i < nLines; i++) {
+                std::string str = std::to_string(t) + " " + std::to_string(i);
+                while (!buffer.Push(str))
+                    std::this_thread::yield();
+            }
+        });
+    }
+
+    std::vector<int> vNext(nThreads, 0);
+    std::string str;
+    for (int nPopped = 0; nPopped < nThreads * nLines;) {
+        if (!buffer.Pop(str)) {
+            std::this_thread::yield();
+            continue;
+        }
+        const size_t nSpace = str.find(' ');
+        const int t = std::stoi(str.substr(0, nSpace));
+        EXPECT_EQ(std::stoi(str.substr(nSpace + 1)), vNext[t]);
+        vNext[t]++;
+        nPopped++;
+    }
+    for (std::thread& thread : threads)
+        thread.join();
+    EXPECT_FALSE(buffer.Pop(str));
+}
@@ -0,0 +1,55 @@
+#include <gtest/gtest.h>
+
+#include "maturityschedule.h"
+
+namespace {
+
+CMaturityHeightKey Key(int height, int n)
+{
+    uint256 certId;
+    *certId.begin() = n;
+    return CMaturityHeightKey(height, certId);
+}
+
+std::vector<uint256> CertIds(const std::vector<CMaturityHeightKey>& vKeys)
+{
+    std::vector<uint256> vCertIds;
+    for (const CMaturityHeightKey& key : vKeys)
+        vCertIds.push_back(key.certId);
+    return vCertIds;
+}
+
+} // anon namespace
+
+TEST(MaturitySchedule, UpdatesAreAppliedOnceLoaded)
+{
+    CMaturitySchedule schedule;
+    schedule.Update({{Key(100, 1), CMaturityHeightValue(static_cast<char>(1))}});
+    EXPECT_FALSE(schedule.IsLoaded());
+    EXPECT_EQ(schedule.Size(), 0U);
+
+    schedule.Load({Key(100, 2), Key(100, 1), Key(120, 3)});
+    EXPECT_TRUE(schedule.IsLoaded());
+    EXPECT_EQ(schedule.Size(), 3U);
+    // sorted as the db keys
+    EXPECT_EQ(CertIds(schedule.Get(100)), std::vector<uint256>({Key(0, 1).certId, Key(0, 2).certId}));
+    EXPECT_TRUE(schedule.Get(110).empty());
+
+    // a block connected then disconnected
+    schedule.Update({{Key(110, 4), CMaturityHeightValue(static_cast<char>(1))}, {Key(120, 3), CMaturityHeightValue()}});
+    EXPECT_EQ(CertIds(schedule.Get(110)), std::vector<uint256>({Key(0, 4).certId}));
+    EXPECT_TRUE(schedule.Get(120).empty());
+    schedule.Update({{Key(110, 4), CMaturityHeightValue()}, {Key(120, 3), CMaturityHeightValue(static_cast<char>(1))}});
+    EXPECT_TRUE(schedule.Get(110).empty());
+    EXPECT_EQ(schedule.Get(120).size(), 1U);
+    EXPECT_EQ(schedule.Get(120)[0].blockHeight, 120);
+    EXPECT_EQ(schedule.Size(), 3U);
+
+    // erasing a missing key, or adding one twice, is harmless
+    schedule.Update({{Key(130, 5), CMaturityHeightValue()}, {Key(100, 1), CMaturityHeightValue(static_cast<char>(1))}});
+    EXPECT_EQ(schedule.Size(), 3U);
+
+    schedule.Clear();
+    EXPECT_FALSE(schedule.IsLoaded());
+    EXPECT_TRUE(schedule.Get(100).empty());
+}
@@ -477,3 +477,119 @@ TEST(ProcessMempoolMsgTest, TxesInMempoolAreRelayed)
     EXPECT_TRUE(theNode.pushedInvList.count(CInv{MSG_TX, cert.GetHash()}));
 }
 
+
+TEST_F(MempoolTest, EventLogFollowsAddsAndRemovals)
+{
+    std::unique_ptr<CTxMemPool> aMempool(new CTxMemPool(::minRelayTxFee, DEFAULT_MAX_MEMPOOL_SIZE_MB * 1000000));
+    const uint64_t nStart = aMempool->GetSequence();
+
+    CTransaction scTx = txCreationUtils::createNewSidechainTxWith(CAmount(0), /*epochLength*/0);
+    CTxMemPoolEntry scTxPoolEntry(scTx, /*fee*/CAmount(1), /*time*/ 1000, /*priority*/1.0, /*height*/1987);
+    aMempool->addUnchecked(scTx.GetHash(), scTxPoolEntry);
+    const uint64_t nAdded = aMempool->GetSequence();
+    EXPECT_EQ(nAdded, nStart + 1);
+
+    std::list<CTransaction> removedTxs;
+    std::list<CScCertificate> removedCerts;
+    aMempool->remove(scTx, removedTxs, removedCerts, false, MemPoolRemovalReason::BLOCK);
+
+    std::vector<CMemPoolEvent> vEvents;
+    ASSERT_TRUE(aMempool->GetEventsSince(nStart, vEvents));
+    ASSERT_EQ(vEvents.size(), 2);
+    EXPECT_TRUE(vEvents[0].type == CMemPoolEvent::Type::ADDED);
+    EXPECT_EQ(vEvents[0].hash, scTx.GetHash());
+    EXPECT_TRUE(vEvents[1].type == CMemPoolEvent::Type::REMOVED);
+    EXPECT_TRUE(vEvents[1].reason == MemPoolRemovalReason::BLOCK);
+    EXPECT_FALSE(vEvents[1].fCertificate);
+
+    // only the removal follows the addition
+    ASSERT_TRUE(aMempool->GetEventsSince(nAdded, vEvents));
+    ASSERT_EQ(vEvents.size(), 1);
+    EXPECT_EQ(vEvents[0].nSequence, nAdded + 1);
+
+    ASSERT_TRUE(aMempool->GetEventsSince(aMempool->GetSequence(), vEvents));
+    EXPECT_TRUE(vEvents.empty());
+    EXPECT_FALSE(aMempool->GetEventsSince(aMempool->GetSequence() + 1, vEvents));
+
+    // the entries dropped by clear are not logged, the older events are not given any more
+    aMempool->addUnchecked(scTx.GetHash(), scTxPoolEntry);
+    aMempool->clear();
+    EXPECT_FALSE(aMempool->GetEventsSince(nAdded, vEvents));
+    EXPECT_TRUE(aMempool->GetEventsSince(aMempool->GetSequence(), vEvents));
+}
+
+TEST_F(MempoolTest, TrimEvictsTheLowestFeeRatePackagesWhole)
+{
+    CTxMemPool pool(::minRelayTxFee, DEFAULT_MAX_MEMPOOL_SIZE_MB * 1000000);
+    auto makeTx = [](const COutPoint& prevout) {
+        CMutableTransaction mtx;
+        mtx.vin.resize(1);
+        mtx.vin[0].prevout = prevout;
+        mtx.addOut(CTxOut(10 * COIN, CScript() << OP_TRUE));
+        return CTransaction(mtx);
+    };
+
+    const CTransaction highFeeTx = makeTx(COutPoint(GetRandHash(), 0));
+    pool.addUnchecked(highFeeTx.GetHash(), CTxMemPoolEntry(highFeeTx, /*fee*/100000, /*time*/1000, /*priority*/1.0, /*height*/1));
+    const size_t nHighFeeSize = pool.GetTotalSize();
+
+    // the package of the parent has the lowest fee rate, its child is evicted with it
+    const CTransaction parentTx = makeTx(COutPoint(GetRandHash(), 0));
+    const CTransaction childTx = makeTx(COutPoint(parentTx.GetHash(), 0));
+    pool.addUnchecked(parentTx.GetHash(), CTxMemPoolEntry(parentTx, /*fee*/50, /*time*/1000, /*priority*/1.0, /*height*/1));
+    pool.addUnchecked(childTx.GetHash(), CTxMemPoolEntry(childTx, /*fee*/500, /*time*/1000, /*priority*/1.0, /*height*/1));
+    ASSERT_EQ(pool.size(), 3U);
+
+    // an incoming tx paying less than the package would evict is turned down
+    const CTransaction lowFeeTx = makeTx(COutPoint(GetRandHash(), 0));
+    const CTxMemPoolEntry lowFeeEntry(lowFeeTx, /*fee*/1, /*time*/1000, /*priority*/1.0, /*height*/1);
+    EXPECT_FALSE(pool.trimToSize(&lowFeeEntry, pool.GetTotalSize(), true));
+
+    // a dry run leaves the mempool as it is
+    EXPECT_TRUE(pool.trimToSize(nullptr, nHighFeeSize, true));
+    EXPECT_EQ(pool.size(), 3U);
+
+    EXPECT_TRUE(pool.trimToSize(nullptr, nHighFeeSize, false));
+    EXPECT_EQ(pool.size(), 1U);
+    EXPECT_TRUE(pool.existsTx(highFeeTx.GetHash()));
+    EXPECT_FALSE(pool.existsTx(parentTx.GetHash()));
+    EXPECT_FALSE(pool.existsTx(childTx.GetHash()));
+}
+
+TEST_F(MempoolTest, EntriesShareTheirTransaction)
+{
+    CTxMemPool pool(::minRelayTxFee, DEFAULT_MAX_MEMPOOL_SIZE_MB * 1000000);
+    CMutableTransaction mtx;
+    mtx.vin.resize(1);
+    mtx.vin[0].prevout = COutPoint(GetRandHash(), 0);
+    mtx.addOut(CTxOut(10 * COIN, CScript() << OP_TRUE));
+    const CTransaction tx(mtx);
+
+    const CTxMemPoolEntry entry(tx, /*fee*/1000, /*time*/1000, /*priority*/1.0, /*height*/1);
+    ASSERT_TRUE(pool.addUnchecked(tx.GetHash(), entry));
+
+    // the mempool keeps the object of the entry it was given, not a copy of it
+    EXPECT_EQ(pool.mapTx[tx.GetHash()].GetSharedTx().get(), entry.GetSharedTx().get());
+    EXPECT_EQ(pool.mapTx[tx.GetHash()].GetTx().GetHash(), tx.GetHash());
+
+    // the default entries are still valid
+    EXPECT_TRUE(CTxMemPoolEntry().GetTx().IsNull());
+}
+
+TEST_F(MempoolTest, EntriesEncodeTheirHexOnce)
+{
+    CTxMemPool pool(::minRelayTxFee, DEFAULT_MAX_MEMPOOL_SIZE_MB * 1000000);
+    CMutableTransaction mtx;
+    mtx.vin.resize(1);
+    mtx.vin[0].prevout = COutPoint(GetRandHash(), 0);
+    mtx.addOut(CTxOut(10 * COIN, CScript() << OP_TRUE));
+    const CTransaction tx(mtx);
+    ASSERT_TRUE(pool.addUnchecked(tx.GetHash(), CTxMemPoolEntry(tx, /*fee*/1000, /*time*/1000, /*priority*/1.0, /*height*/1)));
+
+    LOCK(pool.cs);
+    const std::shared_ptr<const std::string> pHex = pool.mapTx[tx.GetHash()].GetHex();
+    ASSERT_TRUE(pHex);
+    EXPECT_EQ(*pHex, EncodeHexTx(tx));
+    // the templates share the string encoded the first time
+    EXPECT_EQ(pool.mapTx[tx.GetHash()].GetHex().get(), pHex.get());
+}
@@ -11,6 +11,7 @@
 
 #include <stdexcept>
 
+#include "arith_uint256.h"
 #include "utilstrencodings.h"
 #include "version.h"
 #include "serialize.h"
@@ -299,3 +300,82 @@ TEST(merkletree, testZeroElements) {
         ASSERT_TRUE(newTree.root() == oldroot);
     }
 }
+
+static std::vector<uint256> make_leaves(size_t n) {
+    std::vector<uint256> leaves;
+    for (size_t i = 0; i < n; i++) {
+        leaves.push_back(ArithToUint256(arith_uint256(i + 1) * 2654435761U));
+    }
+    return leaves;
+}
+
+template<typename Tree>
+void expect_batch_same(const std::vector<uint256>& leaves, size_t split) {
+    Tree sequential;
+    for (const uint256& leaf : leaves) {
+        sequential.append(leaf);
+    }
+
+    Tree batched;
+    batched.append(leaves.begin(), leaves.begin() + split);
+    batched.append(leaves.begin() + split, leaves.end());
+
+    ASSERT_TRUE(batched == sequential);
+    ASSERT_EQ(batched.size(), sequential.size());
+    ASSERT_EQ(batched.root(), sequential.root());
+
+    CDataStream ssSequential(SER_NETWORK, PROTOCOL_VERSION), ssBatched(SER_NETWORK, PROTOCOL_VERSION);
+    ssSequential << sequential;
+    ssBatched << batched;
+    ASSERT_EQ(ssBatched.str(), ssSequential.str());
+}
+
+TEST(merkletree, batchAppend) {
+    for (size_t n = 0; n <= 16; n++) {
+        std::vector<uint256> leaves = make_leaves(n);
+        for (size_t split = 0; split <= n; split++) {
+            expect_batch_same<ZCTestingIncrementalMerkleTree>(leaves, split);
+            expect_batch_same<ZCIncrementalMerkleTree>(leaves, split);
+        }
+    }
+
+    // Long enough for the levels to be combined over several threads
+    std::vector<uint256> leaves = make_leaves(5000);
+    expect_batch_same<ZCIncrementalMerkleTree>(leaves, 0);
+    expect_batch_same<ZCIncrementalMerkleTree>(leaves, 1);
+    expect_batch_same<ZCIncrementalMerkleTree>(leaves, 1531);
+}
+
+TEST(merkletree, batchAppendFull) {
+    ZCTestingIncrementalMerkleTree tree;
+    std::vector<uint256> leaves = make_leaves(17);
+    tree.append(leaves.begin(), leaves.begin() + 15);
+    ZCTestingIncrementalMerkleTree before = tree;
+
+    ASSERT_THROW(tree.append(leaves.begin() + 15, leaves.end()), std::runtime_error);
+    ASSERT_TRUE(tree == before);
+
+    tree.append(leaves.begin() + 15, leaves.begin() + 16);
+    ASSERT_EQ(tree.size(), 16U);
+    ASSERT_THROW(tree.append(leaves.begin() + 16, leaves.end()), std::runtime_error);
+}
+
+TEST(merkletree, batchAppendWitness) {
+    std::vector<uint256> leaves = make_leaves(16);
+    for (size_t start = 1; start <= leaves.size(); start++) {
+        ZCTestingIncrementalMerkleTree tree;
+        tree.append(leaves.begin(), leaves.begin() + start);
+
+        ZCTestingIncrementalWitness sequential = tree.witness();
+        ZCTestingIncrementalWitness batched = tree.witness();
+        for (size_t i = start; i < leaves.size(); i++) {
+            sequential.append(leaves[i]);
+        }
+        batched.append(leaves.begin() + start, leaves.end());
+        tree.append(leaves.begin() + start, leaves.end());
+
+        ASSERT_TRUE(batched == sequential);
+        ASSERT_EQ(batched.root(), tree.root());
+        ASSERT_EQ(batched.element(), leaves[start - 1]);
+    }
+}
@@ -3,6 +3,9 @@
 #include "metrics.h"
 #include "utiltime.h"
 
+#include <thread>
+#include <vector>
+
 
 TEST(Metrics, AtomicTimer) {
     AtomicTimer t;
@@ -53,6 +56,43 @@ TEST(Metrics, AtomicTimer) {
     SetMockTime(0);
 }
 
+TEST(Metrics, AtomicCounterSumsTheThreadSlots) {
+    AtomicCounter c;
+    std::vector<std::thread> threads;
+    for (int i = 0; i < 2 * AtomicCounter::SLOTS; ++i) {
+        threads.emplace_back([&c] {
+            for (int n = 0; n < 1000; ++n)
+                c.increment();
+            c.decrement();
+        });
+    }
+    for (std::thread& t : threads)
+        t.join();
+    EXPECT_EQ(2 * AtomicCounter::SLOTS * 999, c.get());
+}
+
+TEST(Metrics, AtomicTimerFromSeveralThreads) {
+    AtomicTimer t;
+    SetMockTime(100);
+    std::vector<std::thread> threads;
+    for (int i = 0; i < 8; ++i) {
+        threads.emplace_back([&t] {
+            for (int n = 0; n < 1000; ++n) {
+                t.start();
+                t.stop();
+            }
+            t.start();
+        });
+    }
+    for (std::thread& th : threads)
+        th.join();
+    EXPECT_EQ(8U, t.threadCount());
+    for (int i = 0; i < 8; ++i)
+        t.stop();
+    EXPECT_FALSE(t.running());
+    SetMockTime(0);
+}
+
 TEST(Metrics, GetLocalSolPS) {
     SetMockTime(100);
     miningTimer.start();
@@ -0,0 +1,86 @@
+#include <gtest/gtest.h>
+
+#include "clientversion.h"
+#include "crypto/muhash.h"
+#include "streams.h"
+#include "uint256.h"
+
+namespace {
+
+uint256 FinalizedHash(MuHash3072 muhash)
+{
+    uint256 hash;
+    muhash.Finalize(hash.begin());
+    return hash;
+}
+
+MuHash3072 FromElements(std::initializer_list<unsigned char> elements)
+{
+    MuHash3072 muhash;
+    for (unsigned char element : elements)
+        muhash.Insert(&element, 1);
+    return muhash;
+}
+
+}
+
+TEST(MuHash, OrderIndependent)
+{
+    EXPECT_EQ(FinalizedHash(FromElements({1, 2, 3})), FinalizedHash(FromElements({3, 1, 2})));
+    EXPECT_NE(FinalizedHash(FromElements({1, 2, 3})), FinalizedHash(FromElements({1, 2})));
+    EXPECT_NE(FinalizedHash(FromElements({1, 2})), FinalizedHash(FromElements({1, 3})));
+}
+
+TEST(MuHash, RemoveUndoesInsert)
+{
+    MuHash3072 muhash = FromElements({1, 2, 3});
+    unsigned char element = 2;
+    muhash.Remove(&element, 1);
+    EXPECT_EQ(FinalizedHash(muhash), FinalizedHash(FromElements({3, 1})));
+
+    muhash.Insert(&element, 1);
+    EXPECT_EQ(FinalizedHash(muhash), FinalizedHash(FromElements({1, 2, 3})));
+
+    MuHash3072 empty = FromElements({7});
+    element = 7;
+    empty.Remove(&element, 1);
+    EXPECT_EQ(FinalizedHash(empty), FinalizedHash(MuHash3072()));
+}
+
+TEST(MuHash, CombinesDisjointParts)
+{
+    MuHash3072 muhash = FromElements({1, 2});
+    muhash *= FromElements({3, 4});
+    EXPECT_EQ(FinalizedHash(muhash), FinalizedHash(FromElements({4, 3, 2, 1})));
+
+    muhash /= FromElements({2, 4});
+    EXPECT_EQ(FinalizedHash(muhash), FinalizedHash(FromElements({1, 3})));
+}
+
+TEST(MuHash, InverseOfLargeNumber)
+{
+    unsigned char data[Num3072::BYTE_SIZE];
+    for (size_t i = 0; i < sizeof(data); i++)
+        data[i] = 0xff - i;
+    Num3072 num(data);
+    num.Multiply(num.GetInverse());
+
+    unsigned char bytes[Num3072::BYTE_SIZE];
+    num.ToBytes(bytes);
+    unsigned char one[Num3072::BYTE_SIZE] = {1};
+    EXPECT_EQ(std::vector<unsigned char>(bytes, bytes + sizeof(bytes)), std::vector<unsigned char>(one, one + sizeof(one)));
+}
+
+TEST(MuHash, SerializationRoundTrip)
+{
+    MuHash3072 muhash = FromElements({5, 6});
+    unsigned char element = 6;
+    muhash.Remove(&element, 1);
+
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << muhash;
+    EXPECT_EQ(ss.size(), 2 * Num3072::BYTE_SIZE);
+    MuHash3072 read;
+    ss >> read;
+    EXPECT_EQ(FinalizedHash(read), FinalizedHash(FromElements({5})));
+}
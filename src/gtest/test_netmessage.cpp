@@ -0,0 +1,82 @@
+#include <gtest/gtest.h>
+
+#include "chainparams.h"
+#include "hash.h"
+#include "net.h"
+#include "random.h"
+#include "streams.h"
+#include "version.h"
+
+#include <vector>
+
+class NetMessageTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        SelectParams(CBaseChainParams::REGTEST);
+
+        vPayload.resize(1000 * 1000);
+        GetRandBytes(vPayload.data(), vPayload.size());
+
+        CMessageHeader hdr(Params().MessageStart(), "block", vPayload.size());
+        uint256 hash = Hash(vPayload.begin(), vPayload.end());
+        memcpy(&hdr.nChecksum, hash.begin(), sizeof(hdr.nChecksum));
+
+        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+        ss << hdr;
+        vWire.assign(ss.begin(), ss.end());
+        vWire.insert(vWire.end(), vPayload.begin(), vPayload.end());
+    }
+
+    //! Feeds the message in chunks of nChunkSize bytes, as the socket handler does
+    void Receive(CNetMessage& msg, size_t nChunkSize) {
+        const char* pch = reinterpret_cast<const char*>(vWire.data());
+        size_t nLeft = vWire.size();
+        while (nLeft > 0) {
+            unsigned int nBytes = std::min(nLeft, nChunkSize);
+            int handled = msg.in_data ? msg.readData(pch, nBytes) : msg.readHeader(pch, nBytes);
+            ASSERT_GT(handled, 0);
+            pch += handled;
+            nLeft -= handled;
+        }
+    }
+
+    std::vector<unsigned char> vPayload;
+    std::vector<unsigned char> vWire;
+};
+
+TEST_F(NetMessageTest, ChecksumIsComputedAsTheDataArrives)
+{
+    for (size_t nChunkSize : {1000, 65536, 1 << 20}) {
+        CNetMessage msg(Params().MessageStart(), SER_NETWORK, PROTOCOL_VERSION);
+        Receive(msg, nChunkSize);
+        ASSERT_TRUE(msg.complete());
+        EXPECT_EQ(msg.ComputeMessageChecksum(), msg.hdr.nChecksum);
+        ASSERT_EQ(msg.vRecv.size(), vPayload.size());
+        EXPECT_TRUE(std::equal(vPayload.begin(), vPayload.end(), msg.vRecv.begin()));
+    }
+}
+
+TEST_F(NetMessageTest, CorruptedDataFailsTheChecksum)
+{
+    vWire.back() ^= 1;
+    CNetMessage msg(Params().MessageStart(), SER_NETWORK, PROTOCOL_VERSION);
+    Receive(msg, 4096);
+    ASSERT_TRUE(msg.complete());
+    EXPECT_NE(msg.ComputeMessageChecksum(), msg.hdr.nChecksum);
+}
+
+TEST_F(NetMessageTest, EmptyMessage)
+{
+    vPayload.clear();
+    CMessageHeader hdr(Params().MessageStart(), "verack", 0);
+    uint256 hash = Hash(vPayload.begin(), vPayload.end());
+    memcpy(&hdr.nChecksum, hash.begin(), sizeof(hdr.nChecksum));
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << hdr;
+    vWire.assign(ss.begin(), ss.end());
+
+    CNetMessage msg(Params().MessageStart(), SER_NETWORK, PROTOCOL_VERSION);
+    Receive(msg, 4096);
+    ASSERT_TRUE(msg.complete());
+    EXPECT_EQ(msg.ComputeMessageChecksum(), hdr.nChecksum);
+}
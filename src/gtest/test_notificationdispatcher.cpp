@@ -0,0 +1,163 @@
+#include <gtest/gtest.h>
+
+#include "chain.h"
+#include "notificationdispatcher.h"
+#include "primitives/transaction.h"
+#include "streams.h"
+#include "util.h"
+#include "validationinterface.h"
+#include "version.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <future>
+
+namespace {
+
+class CRecordingSink : public CNotificationSink
+{
+public:
+    CRecordingSink(bool fRawIn, bool fBlockFirstIn = false) : fRaw(fRawIn), fBlockFirst(fBlockFirstIn), release(gate.get_future()) {}
+
+    std::string GetNotificationSinkName() const override { return fRaw ? "raw" : "hash"; }
+    bool WantsRawTransactions() const override { return fRaw; }
+
+    void NotifyBlock(const CNotification& notification) override { Record(notification, {}); }
+    void NotifyTransaction(const CNotification& notification) override
+    {
+        const std::vector<unsigned char>* raw = notification.GetRaw();
+        Record(notification, raw ? *raw : std::vector<unsigned char>());
+    }
+
+    //! Wait until n notifications are being or have been published
+    bool WaitFor(size_t n)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        return cond.wait_for(lock, std::chrono::seconds(10), [this, n] { return vHashes.size() >= n; });
+    }
+
+    void Release() { gate.set_value(); }
+
+    std::vector<uint256> GetHashes()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return vHashes;
+    }
+
+    std::vector<std::vector<unsigned char>> GetRaws()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return vRaws;
+    }
+
+private:
+    const bool fRaw;
+    const bool fBlockFirst;
+    std::promise<void> gate;
+    std::shared_future<void> release;
+    std::mutex mutex;
+    std::condition_variable cond;
+    std::vector<uint256> vHashes;
+    std::vector<std::vector<unsigned char>> vRaws;
+
+    void Record(const CNotification& notification, std::vector<unsigned char> raw)
+    {
+        bool fFirst;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            fFirst = vHashes.empty();
+            vHashes.push_back(notification.hash);
+            vRaws.push_back(std::move(raw));
+        }
+        cond.notify_all();
+        if (fFirst && fBlockFirst)
+            release.wait();
+    }
+};
+
+CTransaction MakeTransaction(uint32_t n)
+{
+    CMutableTransaction mtx;
+    mtx.nLockTime = n;
+    return mtx;
+}
+
+std::vector<unsigned char> Serialize(const CTransaction& tx)
+{
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << tx;
+    return std::vector<unsigned char>(ss.begin(), ss.end());
+}
+
+} // anon namespace
+
+TEST(NotificationDispatcher, TransactionsAreSerializedOnceForTheSinksWantingThem)
+{
+    CRecordingSink hashSink(false);
+    RegisterNotificationSink(&hashSink);
+    const CTransaction tx1 = MakeTransaction(1);
+    GetMainSignals().SyncTransaction(tx1, nullptr);
+    ASSERT_TRUE(hashSink.WaitFor(1));
+    EXPECT_TRUE(hashSink.GetRaws()[0].empty());
+
+    CRecordingSink rawSink(true);
+    RegisterNotificationSink(&rawSink);
+    const CTransaction tx2 = MakeTransaction(2);
+    const CTransaction tx3 = MakeTransaction(3);
+    GetMainSignals().SyncTransaction(tx2, nullptr);
+    GetMainSignals().SyncTransaction(tx3, nullptr);
+    ASSERT_TRUE(hashSink.WaitFor(3));
+    ASSERT_TRUE(rawSink.WaitFor(2));
+
+    UnregisterNotificationSink(&rawSink);
+    UnregisterNotificationSink(&hashSink);
+
+    EXPECT_EQ(hashSink.GetHashes(), std::vector<uint256>({tx1.GetHash(), tx2.GetHash(), tx3.GetHash()}));
+    EXPECT_EQ(rawSink.GetHashes(), std::vector<uint256>({tx2.GetHash(), tx3.GetHash()}));
+    // the payload serialized for the raw sink is shared with the other one
+    EXPECT_EQ(hashSink.GetRaws()[1], Serialize(tx2));
+    EXPECT_EQ(rawSink.GetRaws()[0], Serialize(tx2));
+    EXPECT_EQ(rawSink.GetRaws()[1], Serialize(tx3));
+    EXPECT_TRUE(GetNotificationSinkStats().empty());
+}
+
+TEST(NotificationDispatcher, FullQueueDropsTransactionsBeforeTips)
+{
+    mapArgs["-notificationqueuesize"] = "2";
+    CRecordingSink fastSink(false);
+    CRecordingSink slowSink(false, true);
+    RegisterNotificationSink(&fastSink);
+    RegisterNotificationSink(&slowSink);
+    mapArgs.erase("-notificationqueuesize");
+
+    // the slow sink is stuck publishing tx0, with room for two more notifications
+    std::vector<CTransaction> vTx;
+    for (uint32_t n = 0; n < 4; n++)
+        vTx.push_back(MakeTransaction(n));
+    GetMainSignals().SyncTransaction(vTx[0], nullptr);
+    ASSERT_TRUE(slowSink.WaitFor(1));
+    for (size_t n = 1; n < vTx.size(); n++)
+        GetMainSignals().SyncTransaction(vTx[n], nullptr);
+
+    // a tip takes the place of the oldest transaction
+    CBlockIndex index;
+    const uint256 hashBlock = uint256S("0x1234");
+    index.phashBlock = &hashBlock;
+    GetMainSignals().UpdatedBlockTip(&index);
+
+    ASSERT_TRUE(fastSink.WaitFor(5));
+    slowSink.Release();
+    ASSERT_TRUE(slowSink.WaitFor(3));
+
+    std::vector<CNotificationSinkStats> vStats = GetNotificationSinkStats();
+    ASSERT_EQ(vStats.size(), 2U);
+    EXPECT_EQ(vStats[0].nDropped, 0U);
+    EXPECT_EQ(vStats[1].nDropped, 2U);
+    EXPECT_EQ(vStats[1].nMaxQueued, 2U);
+
+    UnregisterNotificationSink(&slowSink);
+    UnregisterNotificationSink(&fastSink);
+
+    EXPECT_EQ(fastSink.GetHashes().size(), 5U);
+    EXPECT_EQ(slowSink.GetHashes(), std::vector<uint256>({vTx[0].GetHash(), vTx[2].GetHash(), hashBlock}));
+}
@@ -68,3 +68,38 @@ TEST(PoW, DifficultyAveraging) {
                                         params),
               GetNextWorkRequired(&blocks[lastBlk], nullptr, params));
 }
+
+TEST(PoW, AggregatesMatchTheWalkOfTheAncestors) {
+    SelectParams(CBaseChainParams::MAIN);
+    const Consensus::Params& params = Params().GetConsensus();
+
+    std::vector<CBlockIndex> blocks(10 * params.nPowAveragingWindow);
+    std::vector<CBlockIndex> walked(blocks.size());
+    for (int i = 0; i < blocks.size(); i++) {
+        blocks[i].pprev = i ? &blocks[i - 1] : nullptr;
+        blocks[i].nHeight = i;
+        // out of order times, as the median has to sort them
+        blocks[i].nTime = 1269211443 + i * params.nPowTargetSpacing + GetRand(10 * params.nPowTargetSpacing);
+        blocks[i].nBits = 0x1e0fffff + GetRand(0x700000);
+        blocks[i].BuildSkip();
+        blocks[i].BuildAggregates();
+        EXPECT_TRUE(blocks[i].fHaveAggregates);
+
+        walked[i] = blocks[i];
+        walked[i].pprev = i ? &walked[i - 1] : nullptr;
+        walked[i].pskip = nullptr;
+        walked[i].fHaveAggregates = false;
+    }
+
+    for (int i = 0; i < blocks.size(); i++) {
+        EXPECT_EQ(blocks[i].GetMedianTimePast(), walked[i].GetMedianTimePast());
+        EXPECT_EQ(GetNextWorkRequired(&blocks[i], nullptr, params), GetNextWorkRequired(&walked[i], nullptr, params));
+    }
+
+    // no aggregates are built on a parent without them
+    CBlockIndex next;
+    next.pprev = &walked.back();
+    next.nHeight = walked.size();
+    next.BuildAggregates();
+    EXPECT_FALSE(next.fHaveAggregates);
+}
@@ -1,6 +1,7 @@
 #include <gtest/gtest.h>
 
 #include "random.h"
+#include "utilstrencodings.h"
 
 extern int GenZero(int n);
 extern int GenMax(int n);
@@ -33,3 +34,43 @@ TEST(Random, MappedShuffle) {
     EXPECT_EQ(ea3, a3);
     EXPECT_EQ(em3, m3);
 }
+
+TEST(Random, FastRandomContextIsTheChaCha20Keystream) {
+    // the keystream of the zero key and nonce, from the ChaCha20 test vectors
+    FastRandomContext ctx(true);
+    uint256 hash = ctx.rand256();
+    std::vector<unsigned char> vch(hash.begin(), hash.end());
+    EXPECT_EQ(HexStr(vch), "76b8e0ada0f13d90405d6ae55386bd28bdd219b8a08ded1aa836efcc8b770dc7");
+
+    // the next nonce starts a fresh keystream block once the buffer is used up
+    FastRandomContext ctx1(true), ctx2(true);
+    std::vector<unsigned char> vch1(2000), vch2(2000);
+    ctx1.randbytes(vch1.data(), vch1.size());
+    for (size_t i = 0; i < vch2.size(); i += 100)
+        ctx2.randbytes(&vch2[i], 100);
+    EXPECT_EQ(vch1, vch2);
+}
+
+TEST(Random, FastRandomContextRanges) {
+    FastRandomContext ctx;
+    EXPECT_EQ(ctx.randrange(0), 0U);
+    EXPECT_EQ(ctx.randrange(1), 0U);
+    EXPECT_EQ(ctx.randbits(0), 0U);
+
+    std::vector<int> vCounts(7, 0);
+    for (int i = 0; i < 7000; i++) {
+        uint64_t r = ctx.randrange(7);
+        ASSERT_LT(r, 7U);
+        vCounts[r]++;
+    }
+    for (int nCount : vCounts)
+        EXPECT_GT(nCount, 800);
+
+    for (int nBits = 1; nBits <= 64; nBits++)
+        EXPECT_EQ(ctx.randbits(nBits) >> 1 >> (nBits - 1), 0U);
+
+    // two contexts are seeded apart
+    FastRandomContext other;
+    EXPECT_NE(ctx.rand256(), other.rand256());
+    EXPECT_NE(GetFastRandHash(), GetFastRandHash());
+}
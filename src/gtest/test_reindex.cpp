@@ -13,6 +13,7 @@
 
 //includes for sut
 #include <main.h>
+#include <blockview.h>
 
 //NOTES: LoadBlocksFromExternalFile invoke fclose on file via CBufferedFile dtor
 
@@ -548,6 +549,42 @@ TEST_F(ReindexTestSuite, CreateNewBlockFile)
 ///////////////////////////////////////////////////////////////////////////////
 ///////////////////////////////////////////////////////////////////////////////
 ///////////////////////////////////////////////////////////////////////////////
+TEST_F(ReindexTestSuite, BlockViewReadsTheStoredBlock)
+{
+    CDiskBlockPos diskPos(12345, 0);
+    CBlock genesisCpy = Params().GenesisBlock();
+    ASSERT_TRUE(storeToFile(genesisCpy, diskPos));
+    CBlock aBlock = createCoinBaseOnlyBlock(genesisCpy.GetHash(), /*height*/1);
+    ASSERT_TRUE(storeToFile(aBlock, diskPos));
+    const CDiskBlockPos blockPos(12345, diskPos.nPos - ::GetSerializeSize(aBlock, SER_DISK, CLIENT_VERSION));
+
+    CBlockView blockView;
+    ASSERT_TRUE(blockView.Open(blockPos));
+    EXPECT_EQ(blockView.GetHeader().GetHash(), aBlock.GetHash());
+    EXPECT_EQ(blockView.GetSerializeSize(), ::GetSerializeSize(aBlock, SER_DISK, CLIENT_VERSION));
+
+    std::vector<uint256> vHashes;
+    ASSERT_TRUE(blockView.GetHashes(vHashes));
+    ASSERT_EQ(vHashes.size(), 1U);
+    EXPECT_EQ(vHashes[0], aBlock.vtx[0].GetHash());
+
+    CTransaction tx;
+    EXPECT_TRUE(blockView.FindTransaction(aBlock.vtx[0].GetHash(), tx));
+    EXPECT_EQ(tx.GetHash(), aBlock.vtx[0].GetHash());
+    EXPECT_FALSE(blockView.FindTransaction(genesisCpy.vtx[0].GetHash(), tx));
+    CScCertificate cert;
+    EXPECT_FALSE(blockView.FindCertificate(aBlock.vtx[0].GetHash(), cert));
+
+    CBlock readBlock;
+    ASSERT_TRUE(blockView.ReadBlock(readBlock));
+    EXPECT_EQ(readBlock.GetHash(), aBlock.GetHash());
+    ASSERT_TRUE(ReadBlockFromDisk(readBlock, blockPos));
+    EXPECT_EQ(readBlock.vtx.size(), aBlock.vtx.size());
+
+    // the size before the block must be there
+    EXPECT_FALSE(blockView.Open(CDiskBlockPos(12345, 2)));
+}
+
 CBlockHeader ReindexTestSuite::createCoinBaseOnlyBlockHeader(const uint256& prevBlockHash)
 {
     CBlockHeader res;
@@ -9,6 +9,7 @@
 #include "txmempool.h"
 #include <undo.h>
 #include <main.h>
+#include <miner.h>
 
 class SidechainsTestSuite: public ::testing::Test {
 
@@ -1799,6 +1800,60 @@ TEST_F(SidechainsTestSuite, CSidechainBlockUndoVersioning) {
     boost::filesystem::remove_all(pathTemp.string(), ec);
 }
 
+TEST_F(SidechainsTestSuite, CSidechainUndoDataCompactEncoding) {
+    CSidechainUndoData data;
+    EXPECT_EQ(data.sidechainUndoDataVersion, CSidechainUndoData::COMPACT_VERSION);
+    data.contentBitMask = CSidechainUndoData::AvailableSections::MATURED_AMOUNTS |
+                          CSidechainUndoData::AvailableSections::CROSS_EPOCH_CERT_DATA |
+                          CSidechainUndoData::AvailableSections::ANY_EPOCH_CERT_DATA |
+                          CSidechainUndoData::AvailableSections::SUPERSEDED_CERT_DATA |
+                          CSidechainUndoData::AvailableSections::CEASED_CERT_DATA |
+                          CSidechainUndoData::AvailableSections::NONCEASING_CERT_DATA;
+    data.appliedMaturedAmount = 7 * COIN;
+    data.pastEpochTopQualityCertView = CScCertificateView(uint256S("aa"), 10, CScCertificate::INT_NULL);
+    data.scFees.emplace_back(new Sidechain::ScFeeData_v2(10, 20, 100));
+    data.scFees.emplace_back(new Sidechain::ScFeeData_v2(10, 20, 110));
+    data.scFees.emplace_back(new Sidechain::ScFeeData_v2(5, 25, 125));
+    data.prevTopCommittedCertHash = uint256S("bb");
+    data.prevTopCommittedCertReferencedEpoch = CScCertificate::EPOCH_NULL;
+    data.prevTopCommittedCertQuality = 12;
+    data.prevTopCommittedCertBwtAmount = 3 * COIN;
+    data.lastTopQualityCertView = CScCertificateView(uint256S("cc"), 15, 2);
+    data.lowQualityBwts.push_back(CTxInUndo(CTxOut(COIN, CScript() << OP_TRUE), false, 200, SC_CERT_VERSION, 0, 300));
+    data.ceasedBwts.push_back(CTxInUndo(CTxOut(2 * COIN, CScript() << OP_TRUE), false, 201, SC_CERT_VERSION, BWT_POS_UNSET, 301));
+    data.prevInclusionHeight = 250;
+
+    CSidechainUndoData legacyData = data;
+    legacyData.sidechainUndoDataVersion = CSidechainUndoData::LEGACY_VERSION;
+    EXPECT_LT(data.GetSerializeSize(SER_DISK, CLIENT_VERSION), legacyData.GetSerializeSize(SER_DISK, CLIENT_VERSION));
+
+    // both encodings decode to the same data
+    std::vector<std::string> vRead;
+    for (const CSidechainUndoData& written : {data, legacyData})
+    {
+        CDataStream ss(SER_DISK, CLIENT_VERSION);
+        ss << written;
+        EXPECT_EQ(ss.size(), written.GetSerializeSize(SER_DISK, CLIENT_VERSION));
+        const std::string strWritten = ss.str();
+
+        CSidechainUndoData read;
+        ss >> read;
+        EXPECT_TRUE(ss.empty());
+        EXPECT_EQ(read.sidechainUndoDataVersion, written.sidechainUndoDataVersion);
+        vRead.push_back(read.ToString());
+        EXPECT_EQ(read.scFees.back()->ToString(), Sidechain::ScFeeData_v2(5, 25, 125).ToString());
+        EXPECT_TRUE(read.prevTopCommittedCertReferencedEpoch == CScCertificate::EPOCH_NULL);
+        EXPECT_EQ(read.lowQualityBwts[0].nBwtMaturityHeight, 300);
+        EXPECT_EQ(read.ceasedBwts[0].nFirstBwtPos, BWT_POS_UNSET);
+
+        // the record is written back as read, as its checksum requires
+        CDataStream ssRewritten(SER_DISK, CLIENT_VERSION);
+        ssRewritten << read;
+        EXPECT_EQ(ssRewritten.str(), strWritten);
+    }
+    EXPECT_EQ(vRead[0], vRead[1]);
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 ////////////////////////// Test Fixture definitions ///////////////////////////
 ///////////////////////////////////////////////////////////////////////////////
@@ -1951,6 +2006,32 @@ TEST_F(SidechainsTestSuite, CertificateHashComputation)
     EXPECT_FALSE(originalCert.GetDataHash(fixedParams) == newCert.GetDataHash(fixedParams));
 }
 
+TEST_F(SidechainsTestSuite, CertificateDataHashIsStoredForTheSidechainParameters)
+{
+    CScCertificate cert = txCreationUtils::createCertificate(
+        uint256S("aaa"),
+        /*epochNum*/0, CFieldElement{SAMPLE_FIELD},
+        /*changeTotalAmount*/CAmount(4),/*numChangeOut*/2,
+        /*bwtAmount*/CAmount(2), /*numBwt*/2,
+        /*ftScFee*/0, /*mbtrScFee*/0);
+
+    Sidechain::ScFixedParameters fixedParams;
+    const CFieldElement dataHash = cert.GetDataHash(fixedParams);
+    EXPECT_EQ(cert.GetDataHash(fixedParams), dataHash);
+
+    // the copies share it
+    const CScCertificate copiedCert(cert);
+    EXPECT_EQ(copiedCert.GetDataHash(fixedParams), dataHash);
+
+    // with other parameters it is computed again, as for a certificate which never computed it
+    Sidechain::ScFixedParameters otherParams;
+    otherParams.version = 1;
+    otherParams.vFieldElementCertificateFieldConfig.push_back(FieldElementCertificateFieldConfig{255});
+    const CScCertificate freshCert = CMutableScCertificate(cert);
+    EXPECT_EQ(cert.GetDataHash(otherParams), freshCert.GetDataHash(otherParams));
+    EXPECT_EQ(cert.GetDataHash(fixedParams), dataHash);
+}
+
 
 //////////////////////////////////////////////////////////
 /////////////////// Tx Creation Output ///////////////////
@@ -2089,6 +2170,49 @@ TEST_F(SidechainsTestSuite, NewCertificateUpdatesFeesAndDataLength)
 }
 
 
+TEST_F(SidechainsTestSuite, MinScFeesFollowTheFeesWindow)
+{
+    CSidechain sc;
+    sc.fixedParams.version = 0;
+    // with the 10 blocks of the regtest fee check the window holds the fees of 2 epochs
+    sc.fixedParams.withdrawalEpochLength = 5;
+    sc.lastTopQualityCertView.forwardTransferScFee = CAmount(3);
+    sc.lastTopQualityCertView.mainchainBackwardTransferRequestScFee = CAmount(4);
+    sc.InitScFees();
+    ASSERT_EQ(sc.getMaxSizeOfScFeesContainers(), 2);
+    EXPECT_EQ(sc.GetMinFtScFee(), CAmount(3));
+    EXPECT_EQ(sc.GetMinMbtrScFee(), CAmount(4));
+
+    CScCertificateView certView;
+    certView.forwardTransferScFee = CAmount(1);
+    certView.mainchainBackwardTransferRequestScFee = CAmount(9);
+    sc.UpdateScFees(certView, /*blockHeight*/10);
+    EXPECT_EQ(sc.GetMinFtScFee(), CAmount(1));
+    EXPECT_EQ(sc.GetMinMbtrScFee(), CAmount(4));
+
+    certView.forwardTransferScFee = CAmount(6);
+    certView.mainchainBackwardTransferRequestScFee = CAmount(2);
+    sc.UpdateScFees(certView, /*blockHeight*/15);
+    EXPECT_EQ(sc.GetMinFtScFee(), CAmount(1));
+    EXPECT_EQ(sc.GetMinMbtrScFee(), CAmount(2));
+
+    // the fees of the first certificate leave the window
+    certView.forwardTransferScFee = CAmount(7);
+    certView.mainchainBackwardTransferRequestScFee = CAmount(8);
+    sc.UpdateScFees(certView, /*blockHeight*/20);
+    EXPECT_EQ(sc.scFees.size(), 2U);
+    EXPECT_EQ(sc.GetMinFtScFee(), CAmount(6));
+    EXPECT_EQ(sc.GetMinMbtrScFee(), CAmount(2));
+
+    // and the minimums are restored with the fees when the sidechain is read back
+    CDataStream ss(SER_DISK, PROTOCOL_VERSION);
+    ss << sc;
+    CSidechain scRead;
+    ss >> scRead;
+    EXPECT_EQ(scRead.GetMinFtScFee(), CAmount(6));
+    EXPECT_EQ(scRead.GetMinMbtrScFee(), CAmount(2));
+}
+
 //////////////////////////////////////////////////////////
 ///////////////// Cert semantic validity /////////////////
 //////////////////////////////////////////////////////////
@@ -2212,3 +2336,99 @@ TEST_F(SidechainsTestSuite, CertificateViewInitialization)
     CScCertificateView certView;
     ASSERT_TRUE(certView.IsNull());
 }
+
+//////////////////////////////////////////////////////////
+///////////////////// Sc Directory ///////////////////////
+//////////////////////////////////////////////////////////
+TEST_F(SidechainsTestSuite, ScDirectoryFollowsTheSidechainsWrittenToTheView)
+{
+    ASSERT_EQ(sidechainsView->GetScDirectory().size(), 0);
+
+    CSidechain aliveSc;
+    aliveSc.creationBlockHeight = 1;
+    aliveSc.fixedParams.version = 2;
+    aliveSc.fixedParams.withdrawalEpochLength = 0;
+
+    CSidechain ceasingSc;
+    ceasingSc.creationBlockHeight = 1;
+    ceasingSc.fixedParams.version = 0;
+    ceasingSc.fixedParams.withdrawalEpochLength = 10;
+    const int ceasingHeight = ceasingSc.GetScheduledCeasingHeight();
+
+    const uint256 aliveScId = uint256S("1");
+    const uint256 ceasingScId = uint256S("3");
+    const uint256 unconfirmedScId = uint256S("2");
+
+    txCreationUtils::CNakedCCoinsViewCache childView(sidechainsView);
+    childView.getSidechainMap()[aliveScId] = CSidechainsCacheEntry(aliveSc, CSidechainsCacheEntry::Flags::FRESH);
+    childView.getSidechainMap()[ceasingScId] = CSidechainsCacheEntry(ceasingSc, CSidechainsCacheEntry::Flags::FRESH);
+    ASSERT_TRUE(childView.Flush());
+
+    const CSidechainDirectory& scDirectory = sidechainsView->GetScDirectory();
+    EXPECT_EQ(scDirectory.size(), 2);
+
+    std::vector<uint256> vPage;
+    std::set<uint256> unconfirmedScIds{unconfirmedScId};
+    EXPECT_EQ(scDirectory.GetPage(ceasingHeight - 1, false, unconfirmedScIds, 0, 10, vPage), 3);
+    EXPECT_EQ(vPage, std::vector<uint256>({aliveScId, unconfirmedScId, ceasingScId}));
+
+    EXPECT_EQ(scDirectory.GetPage(ceasingHeight - 1, false, unconfirmedScIds, 1, 2, vPage), 3);
+    EXPECT_EQ(vPage, std::vector<uint256>({unconfirmedScId}));
+
+    EXPECT_EQ(scDirectory.GetPage(ceasingHeight - 1, true, unconfirmedScIds, 0, 10, vPage), 2);
+    EXPECT_EQ(vPage, std::vector<uint256>({aliveScId, ceasingScId}));
+
+    EXPECT_EQ(scDirectory.GetPage(ceasingHeight, true, unconfirmedScIds, 0, 10, vPage), 1);
+    EXPECT_EQ(vPage, std::vector<uint256>({aliveScId}));
+
+    txCreationUtils::CNakedCCoinsViewCache otherChildView(sidechainsView);
+    otherChildView.getSidechainMap()[aliveScId] = CSidechainsCacheEntry(aliveSc, CSidechainsCacheEntry::Flags::ERASED);
+    ASSERT_TRUE(otherChildView.Flush());
+
+    EXPECT_EQ(sidechainsView->GetScDirectory().GetPage(ceasingHeight - 1, false, {}, 0, 10, vPage), 1);
+    EXPECT_EQ(vPage, std::vector<uint256>({ceasingScId}));
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/////////////////////// CheckBlockSidechainsApplicability /////////////////////
+///////////////////////////////////////////////////////////////////////////////
+TEST_F(SidechainsTestSuite, BlockTemplateWithNonApplicableCertIsRejected) {
+    CFieldElement dummyCumTree{SAMPLE_FIELD};
+    uint256 unknownScId = uint256S("aaa");
+    ASSERT_FALSE(sidechainsView->HaveSidechain(unknownScId));
+
+    CBlock block;
+    block.vtx.push_back(txCreationUtils::createCoinBase(CAmount(10)));
+    block.vcert.push_back(txCreationUtils::createCertificate(unknownScId, /*epochNum*/0, dummyCumTree,
+        /*changeTotalAmount*/CAmount(4), /*numChangeOut*/2, /*bwtAmount*/CAmount(2), /*numBwt*/2, /*ftScFee*/0, /*mbtrScFee*/0));
+
+    //test
+    CValidationState state;
+    bool res = CheckBlockSidechainsApplicability(block, *sidechainsView, sidechainsView->GetHeight() + 1, state);
+
+    //checks
+    EXPECT_FALSE(res);
+    EXPECT_TRUE(state.GetRejectReason() == "bad-sc-cert-not-applicable");
+    EXPECT_TRUE(state.GetRejectCode() == CValidationState::Code::SCID_NOT_FOUND)
+        <<"wrong reject code. Value returned: "<<CValidationState::CodeToChar(state.GetRejectCode());
+}
+
+TEST_F(SidechainsTestSuite, BlockTemplateTxsAreCheckedAgainstTheEarlierOnes) {
+    CTransaction scCreationTx = txCreationUtils::createNewSidechainTxWith(CAmount(1953));
+    const uint256& scId = scCreationTx.GetScIdFromScCcOut(0);
+
+    CBlock block;
+    block.vtx.push_back(txCreationUtils::createCoinBase(CAmount(10)));
+    block.vtx.push_back(scCreationTx);
+
+    CValidationState state;
+    EXPECT_TRUE(CheckBlockSidechainsApplicability(block, *sidechainsView, 1987, state));
+    // the view was updated as ConnectBlock does
+    EXPECT_TRUE(sidechainsView->HaveSidechain(scId));
+
+    // the sidechain created by the first one can not be created again
+    CCoinsViewCache otherView(fakeChainStateDb);
+    block.vtx.push_back(scCreationTx);
+    EXPECT_FALSE(CheckBlockSidechainsApplicability(block, otherView, 1987, state));
+    EXPECT_TRUE(state.GetRejectReason() == "bad-sc-tx-not-applicable");
+}
@@ -859,6 +859,105 @@ TEST_F(SidechainsBlockFormationTestSuite, Unconfirmed_Mbtr_scCreation_DulyOrdere
     EXPECT_TRUE(orphanList.front().ptx->GetHash() == CTransaction(mbtrTx).GetHash());
 }
 
+TEST_F(SidechainsBlockFormationTestSuite, PriorityDataCache_ReusedUntilEntriesChange)
+{
+    LOCK(mempool->cs); //needed when compiled with --enable-debug, which activates ASSERT_HELD
+    uint256 inputCoinHash_1 = txCreationUtils::CreateSpendableCoinAtHeight(*blockchainView, dummyHeight);
+
+    CMutableTransaction tx_parent;
+    tx_parent.vin.push_back(CTxIn(inputCoinHash_1, 0, dummyScript));
+    tx_parent.addOut(dummyOut);
+    CTxMemPoolEntry tx_parent_entry(tx_parent, /*fee*/CAmount(1), /*time*/ 1000, /*priority*/1.0, /*height*/dummyHeight);
+    ASSERT_TRUE(mempool->addUnchecked(tx_parent.GetHash(), tx_parent_entry));
+
+    CMutableTransaction tx_child;
+    tx_child.vin.push_back(CTxIn(tx_parent.GetHash(), 0, dummyScript));
+    tx_child.addOut(dummyOut);
+    CTxMemPoolEntry tx_child_entry(tx_child, /*fee*/CAmount(1), /*time*/ 1000, /*priority*/1.0, /*height*/dummyHeight);
+    ASSERT_TRUE(mempool->addUnchecked(tx_child.GetHash(), tx_child_entry));
+
+    CBlockPriorityDataCache cache;
+    cache.Refresh(blockchainView->GetBestBlock());
+    GetBlockTxPriorityData(*blockchainView, dummyHeight, dummyLockTimeCutoff, vecPriority, orphanList, mapDependers, &cache);
+    EXPECT_TRUE(cache.Size() == 2);
+
+    std::vector<TxPriority> vecPriorityFromCache;
+    std::list<COrphan> orphanListFromCache;
+    std::map<uint256, std::vector<COrphan*> > mapDependersFromCache;
+    cache.Refresh(blockchainView->GetBestBlock());
+    GetBlockTxPriorityData(*blockchainView, dummyHeight, dummyLockTimeCutoff, vecPriorityFromCache, orphanListFromCache, mapDependersFromCache, &cache);
+
+    ASSERT_TRUE(vecPriorityFromCache.size() == 1);
+    EXPECT_TRUE(vecPriorityFromCache.back().get<2>()->GetHash() == tx_parent.GetHash());
+    EXPECT_TRUE(vecPriorityFromCache.back().get<0>() == vecPriority.back().get<0>());
+    EXPECT_TRUE(vecPriorityFromCache.back().get<1>() == vecPriority.back().get<1>());
+    ASSERT_TRUE(orphanListFromCache.size() == 1);
+    EXPECT_TRUE(orphanListFromCache.front().ptx->GetHash() == tx_child.GetHash());
+    EXPECT_TRUE(orphanListFromCache.front().setDependsOn == orphanList.front().setDependsOn);
+    EXPECT_TRUE(mapDependersFromCache.at(tx_parent.GetHash()).size() == 1);
+
+    // a prioritisation delta makes the cached entry stale
+    mempool->PrioritiseTransaction(tx_parent.GetHash(), tx_parent.GetHash().ToString(), /*dPriorityDelta*/0, /*nFeeDelta*/1000);
+    vecPriorityFromCache.clear();
+    orphanListFromCache.clear();
+    mapDependersFromCache.clear();
+    GetBlockTxPriorityData(*blockchainView, dummyHeight, dummyLockTimeCutoff, vecPriorityFromCache, orphanListFromCache, mapDependersFromCache, &cache);
+    ASSERT_TRUE(vecPriorityFromCache.size() == 1);
+    EXPECT_TRUE(vecPriority.back().get<1>() < vecPriorityFromCache.back().get<1>());
+    mempool->ClearPrioritisation(tx_parent.GetHash());
+
+    // entries no longer in mempool are dropped
+    std::list<CTransaction> removedTxs;
+    std::list<CScCertificate> removedCerts;
+    mempool->remove(tx_parent, removedTxs, removedCerts, /*fRecursive*/true);
+    cache.Refresh(blockchainView->GetBestBlock());
+    EXPECT_TRUE(cache.Size() == 0);
+}
+
+TEST_F(SidechainsBlockFormationTestSuite, PackageFeeRates_ChildPaysForParent)
+{
+    LOCK(mempool->cs); //needed when compiled with --enable-debug, which activates ASSERT_HELD
+    uint256 inputCoinHash_1 = txCreationUtils::CreateSpendableCoinAtHeight(*blockchainView, dummyHeight);
+    uint256 inputCoinHash_2 = txCreationUtils::CreateSpendableCoinAtHeight(*blockchainView, dummyHeight-1);
+
+    CMutableTransaction tx_parent;
+    tx_parent.vin.push_back(CTxIn(inputCoinHash_1, 0, dummyScript));
+    tx_parent.addOut(dummyOut);
+    CTxMemPoolEntry tx_parent_entry(tx_parent, /*fee*/CAmount(1), /*time*/ 1000, /*priority*/1.0, /*height*/dummyHeight);
+    ASSERT_TRUE(mempool->addUnchecked(tx_parent.GetHash(), tx_parent_entry));
+
+    CMutableTransaction tx_child;
+    tx_child.vin.push_back(CTxIn(tx_parent.GetHash(), 0, dummyScript));
+    tx_child.addOut(dummyOut);
+    CTxMemPoolEntry tx_child_entry(tx_child, /*fee*/CAmount(1000), /*time*/ 1000, /*priority*/1.0, /*height*/dummyHeight);
+    ASSERT_TRUE(mempool->addUnchecked(tx_child.GetHash(), tx_child_entry));
+
+    CMutableTransaction tx_other;
+    tx_other.vin.push_back(CTxIn(inputCoinHash_2, 0, dummyScript));
+    tx_other.addOut(dummyOut);
+    CTxMemPoolEntry tx_other_entry(tx_other, /*fee*/CAmount(100), /*time*/ 1000, /*priority*/1.0, /*height*/dummyHeight);
+    ASSERT_TRUE(mempool->addUnchecked(tx_other.GetHash(), tx_other_entry));
+
+    GetBlockTxPriorityData(*blockchainView, dummyHeight, dummyLockTimeCutoff, vecPriority, orphanList, mapDependers);
+    ASSERT_TRUE(vecPriority.size() == 2);
+    ASSERT_TRUE(orphanList.size() == 1);
+    const CFeeRate childFeeRate = orphanList.front().feeRate;
+
+    TxPriorityCompare sortByFee(/*sort-by-fee*/true);
+    std::make_heap(vecPriority.begin(), vecPriority.end(), sortByFee);
+    EXPECT_TRUE(vecPriority.front().get<2>()->GetHash() == tx_other.GetHash());
+
+    ApplyPackageFeeRates(vecPriority, orphanList, mapDependers);
+    std::make_heap(vecPriority.begin(), vecPriority.end(), sortByFee);
+    EXPECT_TRUE(vecPriority.front().get<2>()->GetHash() == tx_parent.GetHash());
+    const size_t nPackageSize = CTransaction(tx_parent).GetSerializeSize(SER_NETWORK, PROTOCOL_VERSION) +
+                                CTransaction(tx_child).GetSerializeSize(SER_NETWORK, PROTOCOL_VERSION);
+    EXPECT_TRUE(vecPriority.front().get<1>() == CFeeRate(CAmount(1001), nPackageSize));
+    // the child has no descendants, nor does the other tx
+    EXPECT_TRUE(orphanList.front().feeRate == childFeeRate);
+    EXPECT_TRUE(vecPriority.back().get<1>() == CFeeRate(CAmount(100), CTransaction(tx_other).GetSerializeSize(SER_NETWORK, PROTOCOL_VERSION)));
+}
+
 TEST_F(SidechainsConnectCertsBlockTestSuite, SizeCheck)
 {
     srand(time(NULL));
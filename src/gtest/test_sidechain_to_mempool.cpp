@@ -17,6 +17,7 @@
 
 #include <sc/sidechain.h>
 #include "txmempool.h"
+#include <mempoolpersist.h>
 #include <init.h>
 #include <undo.h>
 #include <gtest/libzendoo_test_files.h>
@@ -169,6 +170,46 @@ TEST_F(SidechainsInMempoolTestSuite, FwdTransfersToUnconfirmedSidechainsAreAllow
     EXPECT_TRUE(res == MempoolReturnValue::VALID);
 }
 
+TEST_F(SidechainsInMempoolTestSuite, PersistedMempoolIsLoadedBack) {
+    CTransaction scTx = GenerateScTx(CAmount(1));
+    CValidationState scTxState;
+    ASSERT_TRUE(AcceptTxToMemoryPool(*mempool, scTxState, scTx, LimitFreeFlag::OFF, RejectAbsurdFeeFlag::OFF,
+                                     MempoolProofVerificationFlag::SYNC, nullptr, ResurrectionFlag::OFF, /*nAcceptTime*/1000) == MempoolReturnValue::VALID);
+
+    // the forward transfer depends on the sidechain created by the transaction before
+    CTransaction fwdTx = GenerateFwdTransferTx(scTx.GetScIdFromScCcOut(0), CAmount(10));
+    CValidationState fwdTxState;
+    ASSERT_TRUE(AcceptTxToMemoryPool(*mempool, fwdTxState, fwdTx, LimitFreeFlag::OFF, RejectAbsurdFeeFlag::OFF,
+                                     MempoolProofVerificationFlag::SYNC) == MempoolReturnValue::VALID);
+    mempool->PrioritiseTransaction(fwdTx.GetHash(), fwdTx.GetHash().ToString(), 1.0, CAmount(5));
+    mempool->PrioritiseTransaction(uint256S("aaaa"), "aaaa", 0.0, CAmount(7));
+
+    ASSERT_TRUE(DumpMempool(*mempool));
+    mempool->clear();
+    ASSERT_EQ(mempool->size(), 0U);
+
+    ASSERT_TRUE(LoadMempool(*mempool, /*fTrustProofs*/false));
+    EXPECT_TRUE(IsMempoolLoaded());
+    EXPECT_EQ(mempool->size(), 2U);
+    EXPECT_TRUE(mempool->existsTx(fwdTx.GetHash()));
+    ASSERT_TRUE(mempool->existsTx(scTx.GetHash()));
+    EXPECT_EQ(mempool->mapTx.at(scTx.GetHash()).GetTime(), 1000);
+
+    double dPriorityDelta = 0;
+    CAmount nFeeDelta = 0;
+    mempool->ApplyDeltas(fwdTx.GetHash(), dPriorityDelta, nFeeDelta);
+    EXPECT_EQ(dPriorityDelta, 1.0);
+    EXPECT_EQ(nFeeDelta, CAmount(5));
+    // the prioritisations of transactions not in the mempool are kept too
+    nFeeDelta = 0;
+    mempool->ApplyDeltas(uint256S("aaaa"), dPriorityDelta, nFeeDelta);
+    EXPECT_EQ(nFeeDelta, CAmount(7));
+
+    // the entries already in the mempool are left as they are
+    ASSERT_TRUE(LoadMempool(*mempool, /*fTrustProofs*/true));
+    EXPECT_EQ(mempool->size(), 2U);
+}
+
 TEST_F(SidechainsInMempoolTestSuite, FwdTransfersToConfirmedSidechainsAreAllowed) {
     int creationHeight = 1789;
     chainSettingUtils::ExtendChainActiveToHeight(creationHeight);
@@ -523,6 +564,44 @@ TEST_F(SidechainsInMempoolTestSuite, ConflictingCertRemovalFromMempool) {
     EXPECT_FALSE(mempool->existsCert(cert1.GetHash()));
 }
 
+TEST_F(SidechainsInMempoolTestSuite, SameQualityCertIsReplacedInMempool) {
+    //Create and persist sidechain
+    CTransaction scTx = GenerateScTx(CAmount(10));
+    const uint256& scId = scTx.GetScIdFromScCcOut(0);
+    CBlock aBlock;
+    CCoinsViewCache sidechainsView(pcoinsTip);
+    sidechainsView.UpdateSidechain(scTx, aBlock, /*height*/int(1789));
+    sidechainsView.Flush();
+
+    //load a lower and a top quality certificate in mempool
+    CScCertificate lowCert = txCreationUtils::createCertificate(scId, /*epochNum*/0,
+        CFieldElement{SAMPLE_FIELD}, /*changeTotalAmount*/CAmount(4),/*numChangeOut*/2, /*bwtAmount*/CAmount(6), /*numBwt*/2,
+        /*ftScFee*/0, /*mbtrScFee*/0, /*quality*/2);
+    CCertificateMemPoolEntry lowCertEntry(lowCert, /*fee*/CAmount(5), /*time*/ 1000, /*priority*/1.0, /*height*/1987);
+    ASSERT_TRUE(mempool->addUnchecked(lowCert.GetHash(), lowCertEntry));
+    CScCertificate cert1 = txCreationUtils::createCertificate(scId, /*epochNum*/0,
+        CFieldElement{SAMPLE_FIELD}, /*changeTotalAmount*/CAmount(4),/*numChangeOut*/2, /*bwtAmount*/CAmount(6), /*numBwt*/2,
+        /*ftScFee*/0, /*mbtrScFee*/0, /*quality*/3);
+    CCertificateMemPoolEntry certEntry1(cert1, /*fee*/CAmount(5), /*time*/ 1000, /*priority*/1.0, /*height*/1987);
+    ASSERT_TRUE(mempool->addUnchecked(cert1.GetHash(), certEntry1));
+
+    //Replace the top quality one with a better paying one of the same quality
+    CScCertificate cert2 = txCreationUtils::createCertificate(scId, /*epochNum*/0,
+        CFieldElement{SAMPLE_FIELD}, /*changeTotalAmount*/CAmount(3),/*numChangeOut*/2, /*bwtAmount*/CAmount(6), /*numBwt*/2,
+        /*ftScFee*/0, /*mbtrScFee*/0, /*quality*/3);
+    CCertificateMemPoolEntry certEntry2(cert2, /*fee*/CAmount(6), /*time*/ 1001, /*priority*/1.0, /*height*/1987);
+    ASSERT_EQ(mempool->FindCertWithQuality(scId, 3), std::make_pair(cert1.GetHash(), CAmount(5)));
+    EXPECT_TRUE(mempool->ReplaceCertWithQuality(cert1.GetHash(), cert2.GetHash(), certEntry2));
+
+    EXPECT_FALSE(mempool->existsCert(cert1.GetHash()));
+    EXPECT_TRUE(mempool->existsCert(cert2.GetHash()));
+    EXPECT_TRUE(mempool->existsCert(lowCert.GetHash()));
+    EXPECT_EQ(mempool->FindCertWithQuality(scId, 3), std::make_pair(cert2.GetHash(), CAmount(6)));
+    EXPECT_EQ(mempool->FindCertWithQuality(scId, 2), std::make_pair(lowCert.GetHash(), CAmount(5)));
+    EXPECT_EQ(mempool->mapSidechains.at(scId).GetTopQualityCert()->second, cert2.GetHash());
+    EXPECT_EQ(mempool->mapSidechains.at(scId).mBackwardCertificates.size(), 2U);
+}
+
 TEST_F(SidechainsInMempoolTestSuite, FwdsAndCertInMempool_CertRemovalDoesNotAffectFwt) {
     //Create and persist sidechain
     CTransaction scTx = GenerateScTx(CAmount(10));
@@ -858,6 +937,48 @@ TEST_F(SidechainsInMempoolTestSuite, UnconfirmedCsw_LargerThanSidechainBalanceAr
     EXPECT_TRUE(removedCerts.size() == 0);
 }
 
+TEST_F(SidechainsInMempoolTestSuite, UnconfirmedCsw_LargerThanSidechainBalanceAreRemovedOnlyForSidechainsTouchedByBlock) {
+    CNakedCCoinsViewCache sidechainsView(pcoinsTip);
+
+    // setup sidechain initial state
+    CSidechain initialScState;
+    uint256 scId = uint256S("aaaa");
+    initialScState.creationBlockHeight = 1492;
+    initialScState.fixedParams.withdrawalEpochLength = 14;
+    initialScState.balance = CAmount{1000};
+    initialScState.InitScFees();
+    int heightWhereCeased = initialScState.GetScheduledCeasingHeight();
+
+    storeSidechainWithCurrentHeight(sidechainsView, scId, initialScState, heightWhereCeased);
+    sidechainsView.Flush();
+    ASSERT_TRUE(sidechainsView.GetSidechainState(scId) == CSidechain::State::CEASED);
+
+    // Add without checks two CSW txs withdrawing more than the sidechain balance
+    CTransaction cswTx = GenerateCSWTx(GenerateCSWInput(scId, "aabb", "ccdd", "eeff", initialScState.balance));
+    CTxMemPoolEntry cswEntry(cswTx, /*fee*/CAmount(5), /*time*/ 1000, /*priority*/1.0, /*height*/1987);
+    EXPECT_TRUE(mempool->addUnchecked(cswTx.GetHash(), cswEntry));
+    CTransaction cswTx2 = GenerateCSWTx(GenerateCSWInput(scId, "ddcc", "aabb", "eeff", 1));
+    CTxMemPoolEntry cswEntry2(cswTx2, /*fee*/CAmount(5), /*time*/ 1000, /*priority*/1.0, /*height*/1987);
+    EXPECT_TRUE(mempool->addUnchecked(cswTx2.GetHash(), cswEntry2));
+
+    // A block not touching the sidechain cannot have lowered its balance, hence its csws are not checked
+    std::list<CTransaction> removedTxs;
+    std::list<CScCertificate> removedCerts;
+    std::vector<CTransaction> blockTxs(1, CTransaction());
+    mempool->removeForBlock(blockTxs, heightWhereCeased + 1, removedTxs, removedCerts);
+    EXPECT_TRUE(removedTxs.size() == 0);
+    EXPECT_TRUE(mempool->existsTx(cswTx.GetHash()));
+    EXPECT_TRUE(mempool->existsTx(cswTx2.GetHash()));
+
+    // A block with a csw for the sidechain has all its mempool csws checked against the balance
+    blockTxs.push_back(GenerateCSWTx(GenerateCSWInput(scId, "eeff", "aabb", "ccdd", 1)));
+    mempool->removeForBlock(blockTxs, heightWhereCeased + 2, removedTxs, removedCerts);
+    EXPECT_TRUE(removedTxs.size() == 2);
+    EXPECT_TRUE(std::find(removedTxs.begin(), removedTxs.end(), cswTx) != removedTxs.end());
+    EXPECT_TRUE(std::find(removedTxs.begin(), removedTxs.end(), cswTx2) != removedTxs.end());
+    EXPECT_TRUE(removedCerts.size() == 0);
+}
+
 TEST_F(SidechainsInMempoolTestSuite, UnconfirmedCswForAliveSidechainsAreRemovedFromMempool) {
     //This can happen upon reverting end-of-epoch block
 
@@ -1331,6 +1452,89 @@ TEST_F(SidechainsInMempoolTestSuite,UnconfirmedCertTowardCeasedSidechainIsDroppe
     EXPECT_TRUE(std::find(outdatedCerts.begin(), outdatedCerts.end(), cert) != outdatedCerts.end());
 }
 
+TEST_F(SidechainsInMempoolTestSuite,UnconfirmedFwdsAreOnlyCheckedForTheSidechainsChangedByTheBlock)
+{
+    CNakedCCoinsViewCache sidechainsView(pcoinsTip);
+
+    // setup sidechain initial state
+    CSidechain initialScState;
+    uint256 scId = uint256S("aaaa");
+    initialScState.creationBlockHeight = 1492;
+    initialScState.fixedParams.withdrawalEpochLength = 14;
+    initialScState.InitScFees();
+    int heightWhereCeased = initialScState.GetScheduledCeasingHeight();
+
+    storeSidechainWithCurrentHeight(sidechainsView, scId, initialScState, heightWhereCeased);
+    sidechainsView.Flush();
+    ASSERT_TRUE(sidechainsView.GetSidechainState(scId) == CSidechain::State::CEASED);
+
+    // create coinbase to finance fwt
+    int fwtHeight = heightWhereCeased + 2;
+    uint256 inputTxHash = txCreationUtils::CreateSpendableCoinAtHeight(sidechainsView, fwtHeight-COINBASE_MATURITY);
+
+    //Add fwt to mempool
+    CMutableTransaction mutFwdTx = txCreationUtils::createFwdTransferTxWith(scId, /*fwdTxAmount*/CAmount(10));
+    mutFwdTx.vin.clear();
+    mutFwdTx.vin.push_back(CTxIn(inputTxHash, 0, CScript()));
+    CTransaction fwdTx(mutFwdTx);
+    CTxMemPoolEntry mempoolEntry(fwdTx, /*fee*/CAmount(1), /*time*/ 1000, /*priority*/1.0, /*height*/fwtHeight);
+    mempool->addUnchecked(fwdTx.GetHash(), mempoolEntry);
+
+    //test: a block not changing the sidechain leaves the fwt alone
+    std::list<CTransaction> outdatedTxs;
+    std::list<CScCertificate> outdatedCerts;
+    mempool->removeStaleTransactions(&sidechainsView, {uint256S("bbbb")}, outdatedTxs, outdatedCerts);
+    EXPECT_TRUE(mempool->exists(fwdTx.GetHash()));
+    EXPECT_TRUE(outdatedTxs.empty());
+
+    mempool->removeStaleTransactions(&sidechainsView, {scId}, outdatedTxs, outdatedCerts);
+
+    //checks
+    EXPECT_FALSE(mempool->exists(fwdTx.GetHash()));
+    EXPECT_TRUE(std::find(outdatedTxs.begin(), outdatedTxs.end(), fwdTx) != outdatedTxs.end());
+}
+
+TEST_F(SidechainsInMempoolTestSuite,UnconfirmedCertOutOfItsWindowIsDroppedWithTheSidechainUnchanged)
+{
+    CNakedCCoinsViewCache sidechainsView(pcoinsTip);
+
+    // setup sidechain initial state, with the top quality cert of its last epoch already received
+    CSidechain initialScState;
+    uint256 scId = uint256S("aaaa");
+    initialScState.creationBlockHeight = 201;
+    initialScState.fixedParams.withdrawalEpochLength = 9;
+    initialScState.lastTopQualityCertReferencedEpoch = 19;
+    initialScState.lastTopQualityCertQuality = 1;
+    initialScState.InitScFees();
+    int epochReferredByCert = initialScState.lastTopQualityCertReferencedEpoch;
+    int heightPastTheWindow = initialScState.GetCertSubmissionWindowEnd(epochReferredByCert);
+    storeSidechainWithCurrentHeight(sidechainsView, scId, initialScState, heightPastTheWindow);
+    sidechainsView.Flush();
+    ASSERT_TRUE(sidechainsView.GetSidechainState(scId) == CSidechain::State::ALIVE);
+
+    // create coinbase to finance cert
+    int certHeight = initialScState.GetCertSubmissionWindowEnd(epochReferredByCert);
+    uint256 inputTxHash = txCreationUtils::CreateSpendableCoinAtHeight(sidechainsView, certHeight-COINBASE_MATURITY);
+
+    //Add a higher quality cert of the same epoch to mempool
+    CMutableScCertificate mutCert = txCreationUtils::createCertificate(scId, epochReferredByCert,
+        CFieldElement{SAMPLE_FIELD}, /*changeTotalAmount*/CAmount(4),/*numChangeOut*/2, /*bwtAmount*/CAmount(0), /*numBwt*/2,
+        /*ftScFee*/0, /*mbtrScFee*/0, /*quality*/2);
+    mutCert.vin.clear();
+    mutCert.vin.push_back(CTxIn(inputTxHash, 0, CScript()));
+    CScCertificate cert(mutCert);
+    CCertificateMemPoolEntry mempoolEntry(cert, /*fee*/CAmount(1), /*time*/ 1000, /*priority*/1.0, /*height*/certHeight);
+    mempool->addUnchecked(cert.GetHash(), mempoolEntry);
+
+    //test: the window of its epoch ended with a block not changing the sidechain
+    std::list<CScCertificate> outdatedCerts;
+    mempool->removeStaleCertificates(&sidechainsView, std::set<uint256>(), outdatedCerts);
+
+    //checks
+    EXPECT_FALSE(mempool->exists(cert.GetHash()));
+    EXPECT_TRUE(std::find(outdatedCerts.begin(), outdatedCerts.end(), cert) != outdatedCerts.end());
+}
+
 TEST_F(SidechainsInMempoolTestSuite, DependenciesInEmptyMempool) {
     // prerequisites
     CAmount dummyAmount(10);
@@ -1497,6 +1701,130 @@ TEST_F(SidechainsInMempoolTestSuite, DependenciesOfTDAG) {
     EXPECT_TRUE(aMempool->mempoolDependenciesOf(tx_grandchild_1).empty());
 }
 
+TEST_F(SidechainsInMempoolTestSuite, PackageInfoOfTDAG) {
+    // prerequisites
+    CAmount dummyAmount(10);
+    CScript dummyScript;
+    CTxOut dummyOut_1(dummyAmount, dummyScript);
+    CTxOut dummyOut_2(dummyAmount, dummyScript);
+
+    CMutableTransaction tx_root;
+    tx_root.vin.push_back(CTxIn(uint256(), 0, dummyScript));
+    tx_root.addOut(dummyOut_1);
+    tx_root.addOut(dummyOut_2);
+    CTxMemPoolEntry tx_root_entry(tx_root, /*fee*/CAmount(1), /*time*/ 1000, /*priority*/1.0, /*height*/1987);
+
+    CMutableTransaction tx_child_1;
+    tx_child_1.vin.push_back(CTxIn(tx_root.GetHash(), 0, dummyScript));
+    tx_child_1.addOut(dummyOut_1);
+    CTxMemPoolEntry tx_child_1_entry(tx_child_1, /*fee*/CAmount(2), /*time*/ 1000, /*priority*/1.0, /*height*/1987);
+
+    CMutableTransaction tx_grandchild_1;
+    tx_grandchild_1.vin.push_back(CTxIn(tx_root.GetHash(), 1, dummyScript));
+    tx_grandchild_1.vin.push_back(CTxIn(tx_child_1.GetHash(), 0, dummyScript));
+    CTxMemPoolEntry tx_grandchild_1_entry(tx_grandchild_1, /*fee*/CAmount(4), /*time*/ 1000, /*priority*/1.0, /*height*/1987);
+
+    // root is added last, as it happens when a block is disconnected and its txes are put back into mempool
+    ASSERT_TRUE(aMempool->addUnchecked(tx_child_1.GetHash(), tx_child_1_entry));
+    ASSERT_TRUE(aMempool->addUnchecked(tx_grandchild_1.GetHash(), tx_grandchild_1_entry));
+    ASSERT_TRUE(aMempool->addUnchecked(tx_root.GetHash(), tx_root_entry));
+
+    //checks
+    const size_t rootSize = tx_root_entry.GetTxSize();
+    const size_t childSize = tx_child_1_entry.GetTxSize();
+    const size_t grandchildSize = tx_grandchild_1_entry.GetTxSize();
+
+    CMemPoolPackageInfo info;
+    ASSERT_TRUE(aMempool->getPackageInfo(tx_root.GetHash(), info));
+    EXPECT_TRUE(info.parents.empty());
+    EXPECT_TRUE(info.children == std::set<uint256>({tx_child_1.GetHash(), tx_grandchild_1.GetHash()}));
+    EXPECT_EQ(info.nCountWithAncestors, 1);
+    EXPECT_EQ(info.nCountWithDescendants, 3);
+    EXPECT_EQ(info.nSizeWithDescendants, rootSize + childSize + grandchildSize);
+    EXPECT_EQ(info.nFeesWithDescendants, 7);
+
+    ASSERT_TRUE(aMempool->getPackageInfo(tx_child_1.GetHash(), info));
+    EXPECT_EQ(info.nCountWithAncestors, 2);
+    EXPECT_EQ(info.nFeesWithAncestors, 3);
+    EXPECT_EQ(info.nCountWithDescendants, 2);
+    EXPECT_EQ(info.nFeesWithDescendants, 6);
+
+    // tx_root is reachable from tx_grandchild_1 along two paths, but it is accounted for only once
+    ASSERT_TRUE(aMempool->getPackageInfo(tx_grandchild_1.GetHash(), info));
+    EXPECT_EQ(info.nCountWithAncestors, 3);
+    EXPECT_EQ(info.nSizeWithAncestors, rootSize + childSize + grandchildSize);
+    EXPECT_EQ(info.nFeesWithAncestors, 7);
+    EXPECT_EQ(info.nCountWithDescendants, 1);
+    // the dependencies keep the vin order, even if the parent of the first input came last
+    EXPECT_TRUE(info.vDepends == std::vector<uint256>({tx_root.GetHash(), tx_child_1.GetHash()}));
+
+    {
+        LOCK(aMempool->cs);
+        std::vector<CMemPoolEntryInfo> vInfos;
+        aMempool->getEntryInfos(/*nChainHeight*/1987, /*nAddedAfter*/0, /*fDeltasOnly*/true, vInfos);
+        ASSERT_EQ(vInfos.size(), 3);
+        for (const CMemPoolEntryInfo& entryInfo : vInfos) {
+            EXPECT_TRUE(entryInfo.vDepends == aMempool->mempoolDirectDependenciesFrom(aMempool->mapTx.at(entryInfo.hash).GetTx()));
+            EXPECT_TRUE(entryInfo.fPackage);
+            EXPECT_FALSE(entryInfo.fDelta);
+        }
+    }
+
+    // removing an entry in the middle of the package keeps the other links in place
+    std::list<CTransaction> removedTxs;
+    std::list<CScCertificate> removedCerts;
+    aMempool->remove(tx_child_1, removedTxs, removedCerts, /*fRecursive*/false);
+    EXPECT_FALSE(aMempool->getPackageInfo(tx_child_1.GetHash(), info));
+
+    ASSERT_TRUE(aMempool->getPackageInfo(tx_root.GetHash(), info));
+    EXPECT_EQ(info.nCountWithDescendants, 2);
+    EXPECT_EQ(info.nSizeWithDescendants, rootSize + grandchildSize);
+    EXPECT_EQ(info.nFeesWithDescendants, 5);
+
+    ASSERT_TRUE(aMempool->getPackageInfo(tx_grandchild_1.GetHash(), info));
+    EXPECT_TRUE(info.parents == std::set<uint256>({tx_root.GetHash()}));
+    EXPECT_TRUE(info.vDepends == std::vector<uint256>({tx_root.GetHash()}));
+    EXPECT_EQ(info.nCountWithAncestors, 2);
+    EXPECT_EQ(info.nFeesWithAncestors, 5);
+
+    aMempool->remove(tx_root, removedTxs, removedCerts, /*fRecursive*/true);
+    EXPECT_FALSE(aMempool->getPackageInfo(tx_root.GetHash(), info));
+    EXPECT_FALSE(aMempool->getPackageInfo(tx_grandchild_1.GetHash(), info));
+}
+
+TEST_F(SidechainsInMempoolTestSuite, SortForRelayPutsParentsAndBestFeeRatesFirst) {
+    CAmount dummyAmount(10);
+    CScript dummyScript;
+    CTxOut dummyOut(dummyAmount, dummyScript);
+
+    CMutableTransaction tx_cheap;
+    tx_cheap.vin.push_back(CTxIn(uint256S("aa"), 0, dummyScript));
+    tx_cheap.addOut(dummyOut);
+    CTxMemPoolEntry tx_cheap_entry(tx_cheap, /*fee*/CAmount(1), /*time*/ 1000, /*priority*/1.0, /*height*/1987);
+
+    CMutableTransaction tx_rich;
+    tx_rich.vin.push_back(CTxIn(uint256S("bb"), 0, dummyScript));
+    tx_rich.addOut(dummyOut);
+    CTxMemPoolEntry tx_rich_entry(tx_rich, /*fee*/CAmount(1000), /*time*/ 1000, /*priority*/1.0, /*height*/1987);
+
+    // pays more than its parent, but is announced after it
+    CMutableTransaction tx_child;
+    tx_child.vin.push_back(CTxIn(tx_cheap.GetHash(), 0, dummyScript));
+    tx_child.addOut(dummyOut);
+    CTxMemPoolEntry tx_child_entry(tx_child, /*fee*/CAmount(100000), /*time*/ 1000, /*priority*/1.0, /*height*/1987);
+
+    ASSERT_TRUE(aMempool->addUnchecked(tx_cheap.GetHash(), tx_cheap_entry));
+    ASSERT_TRUE(aMempool->addUnchecked(tx_rich.GetHash(), tx_rich_entry));
+    ASSERT_TRUE(aMempool->addUnchecked(tx_child.GetHash(), tx_child_entry));
+
+    const uint256 notInMempool = uint256S("cc");
+    std::vector<uint256> vHashes = {notInMempool, tx_child.GetHash(), tx_cheap.GetHash(), tx_rich.GetHash()};
+    aMempool->sortForRelay(vHashes);
+
+    std::vector<uint256> expected = {tx_rich.GetHash(), tx_cheap.GetHash(), tx_child.GetHash(), notInMempool};
+    EXPECT_TRUE(vHashes == expected);
+}
+
 
 //////////////////////////////////////////////////////////
 //////////////////// Fee validations /////////////////////
@@ -1,6 +1,10 @@
 #include <gtest/gtest.h>
 
 #include "chainparams.h"
+#include "clientversion.h"
+#include "sc/sidechaintypes.h"
+#include "streams.h"
+#include "version.h"
 
 class SidechainTypesTestSuite: public ::testing::Test
 {
@@ -39,4 +43,78 @@ TEST_F(SidechainTypesTestSuite, CZendooBatchProofVerifierResultDestructor)
     }
 
     // Check with a memory profiler (e.g. Valgrind) that there are no memory leaks.
-}
\ No newline at end of file
+}
+///////////////////////////////////////////////////////////////////////////////
+/////////////////////////////// CCctpByteArray ////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+TEST_F(SidechainTypesTestSuite, CCctpByteArraySerializesAsVector)
+{
+    for (size_t size : {0, 1, 31, 32, 33, 1000})
+    {
+        std::vector<unsigned char> bytes(size);
+        for (size_t i = 0; i < size; i++)
+            bytes[i] = i * 7;
+
+        CDataStream vectorStream(SER_NETWORK, PROTOCOL_VERSION);
+        vectorStream << bytes;
+
+        CCctpByteArray<32> byteArray(bytes.data(), bytes.size());
+        CDataStream arrayStream(SER_NETWORK, PROTOCOL_VERSION);
+        arrayStream << byteArray;
+        EXPECT_EQ(arrayStream.str(), vectorStream.str());
+        EXPECT_EQ(GetSerializeSize(byteArray, SER_NETWORK, PROTOCOL_VERSION), vectorStream.size());
+
+        CCctpByteArray<32> readArray(bytes.data(), 2); // overwritten by the read
+        vectorStream >> readArray;
+        EXPECT_EQ(std::vector<unsigned char>(readArray.begin(), readArray.end()), bytes);
+        EXPECT_TRUE(readArray == byteArray);
+    }
+}
+
+TEST_F(SidechainTypesTestSuite, CCctpByteArrayCopiesAndOrdersAsVector)
+{
+    const std::vector<unsigned char> shortBytes(20, 0x01);
+    const std::vector<unsigned char> longBytes(40, 0x01);
+    const std::vector<unsigned char> greaterBytes(32, 0x02);
+
+    CCctpByteArray<32> shortArray(shortBytes.data(), shortBytes.size());
+    CCctpByteArray<32> longArray(longBytes.data(), longBytes.size());
+    CCctpByteArray<32> greaterArray(greaterBytes.data(), greaterBytes.size());
+
+    EXPECT_EQ(shortArray < longArray, shortBytes < longBytes);
+    EXPECT_EQ(longArray < greaterArray, longBytes < greaterBytes);
+    EXPECT_EQ(greaterArray < shortArray, greaterBytes < shortBytes);
+    EXPECT_FALSE(shortArray < shortArray);
+
+    // switching between inline and heap storage
+    CCctpByteArray<32> copy(longArray);
+    EXPECT_TRUE(copy == longArray);
+    copy = shortArray;
+    EXPECT_TRUE(copy == shortArray);
+    copy = longArray;
+    EXPECT_TRUE(copy == longArray);
+
+    CCctpByteArray<32> moved(std::move(copy));
+    EXPECT_TRUE(moved == longArray);
+    EXPECT_TRUE(copy.empty());
+
+    moved.clear();
+    EXPECT_TRUE(moved.empty());
+    EXPECT_TRUE(moved != longArray);
+}
+
+TEST_F(SidechainTypesTestSuite, CCctpByteArrayCopiesShareTheHeapBufferUntilWritten)
+{
+    const std::vector<unsigned char> longBytes(40, 0x01);
+    const std::vector<unsigned char> otherBytes(40, 0x03);
+
+    CCctpByteArray<32> longArray(longBytes.data(), longBytes.size());
+    CCctpByteArray<32> copy(longArray);
+    EXPECT_EQ(copy.data(), longArray.data());
+
+    // a write of the same size must not reach the bytes of the other copy
+    copy.assign(otherBytes.data(), otherBytes.size());
+    EXPECT_NE(copy.data(), longArray.data());
+    EXPECT_EQ(std::vector<unsigned char>(longArray.begin(), longArray.end()), longBytes);
+    EXPECT_EQ(std::vector<unsigned char>(copy.begin(), copy.end()), otherBytes);
+}
@@ -0,0 +1,114 @@
+#include <gtest/gtest.h>
+
+#include "arith_uint256.h"
+#include "txrequest.h"
+
+namespace {
+
+CInv TxInv(int n)
+{
+    return CInv(MSG_TX, ArithToUint256(arith_uint256(n + 1)));
+}
+
+//! CInv has no operator==
+std::vector<uint256> Hashes(const std::vector<CInv>& vInv)
+{
+    std::vector<uint256> vHashes;
+    for (const CInv& inv : vInv)
+        vHashes.push_back(inv.hash);
+    return vHashes;
+}
+
+} // anon namespace
+
+TEST(TxRequestTracker, FirstAnnouncerIsAskedFirst)
+{
+    CTxRequestTracker tracker;
+    const CInv inv = TxInv(0);
+    EXPECT_TRUE(tracker.ReceivedInv(1, inv));
+    EXPECT_TRUE(tracker.ReceivedInv(2, inv));
+    EXPECT_FALSE(tracker.ReceivedInv(2, inv));
+    EXPECT_EQ(tracker.Size(), 1U);
+
+    int64_t nNow = 1000;
+    EXPECT_TRUE(tracker.GetRequestable(2, nNow).empty());
+    EXPECT_EQ(Hashes(tracker.GetRequestable(1, nNow)), Hashes(std::vector<CInv>({inv})));
+    EXPECT_EQ(tracker.CountInFlight(1), 1U);
+    // asked once only
+    EXPECT_TRUE(tracker.GetRequestable(1, nNow).empty());
+    EXPECT_TRUE(tracker.GetRequestable(2, nNow + TX_REQUEST_TIMEOUT - 1).empty());
+
+    // the next announcer is asked once the request times out
+    nNow += TX_REQUEST_TIMEOUT;
+    EXPECT_EQ(Hashes(tracker.GetRequestable(2, nNow)), Hashes(std::vector<CInv>({inv})));
+    EXPECT_EQ(tracker.CountInFlight(1), 0U);
+    EXPECT_EQ(tracker.CountAnnounced(1), 0U);
+    EXPECT_EQ(tracker.CountInFlight(2), 1U);
+
+    // nobody is left to ask
+    nNow += TX_REQUEST_TIMEOUT;
+    EXPECT_TRUE(tracker.GetRequestable(1, nNow).empty());
+    EXPECT_EQ(tracker.Size(), 0U);
+}
+
+TEST(TxRequestTracker, ReceivedInvIsForgotten)
+{
+    CTxRequestTracker tracker;
+    for (int i = 0; i < 10; i++) {
+        tracker.ReceivedInv(1, TxInv(i));
+        tracker.ReceivedInv(2, TxInv(i));
+    }
+    EXPECT_EQ(tracker.GetRequestable(1, 0).size(), 10U);
+    for (int i = 0; i < 10; i += 2)
+        tracker.Forget(TxInv(i));
+    EXPECT_EQ(tracker.Size(), 5U);
+    EXPECT_EQ(tracker.CountInFlight(1), 5U);
+    EXPECT_EQ(tracker.CountAnnounced(2), 5U);
+
+    std::vector<CInv> vExpected;
+    for (int i = 1; i < 10; i += 2)
+        vExpected.push_back(TxInv(i));
+    EXPECT_EQ(Hashes(tracker.GetRequestable(2, TX_REQUEST_TIMEOUT)), Hashes(vExpected));
+
+    // an inv received may be announced and asked for again
+    tracker.Forget(TxInv(1));
+    EXPECT_TRUE(tracker.ReceivedInv(1, TxInv(1)));
+    EXPECT_EQ(Hashes(tracker.GetRequestable(1, TX_REQUEST_TIMEOUT)), Hashes(std::vector<CInv>({TxInv(1)})));
+}
+
+TEST(TxRequestTracker, DisconnectedPeerRequestsGoToTheNextAnnouncer)
+{
+    CTxRequestTracker tracker;
+    tracker.ReceivedInv(1, TxInv(0));
+    tracker.ReceivedInv(1, TxInv(1));
+    tracker.ReceivedInv(2, TxInv(0));
+    tracker.ReceivedInv(2, TxInv(1));
+    tracker.ReceivedInv(3, TxInv(1));
+    EXPECT_EQ(tracker.GetRequestable(1, 0).size(), 2U);
+
+    tracker.DisconnectedPeer(1);
+    EXPECT_EQ(tracker.CountAnnounced(1), 0U);
+    EXPECT_EQ(Hashes(tracker.GetRequestable(2, 1)), Hashes(std::vector<CInv>({TxInv(0), TxInv(1)})));
+    EXPECT_TRUE(tracker.GetRequestable(3, 1).empty());
+
+    // peer 3 is asked at once when peer 2 goes, before the request times out
+    tracker.DisconnectedPeer(2);
+    EXPECT_EQ(Hashes(tracker.GetRequestable(3, 2)), Hashes(std::vector<CInv>({TxInv(1)})));
+    tracker.DisconnectedPeer(3);
+    EXPECT_EQ(tracker.Size(), 0U);
+}
+
+TEST(TxRequestTracker, AnnouncementsOfAPeerAreLimited)
+{
+    CTxRequestTracker tracker;
+    for (size_t i = 0; i < MAX_PEER_TX_ANNOUNCEMENTS; i++)
+        ASSERT_TRUE(tracker.ReceivedInv(1, TxInv(i)));
+    EXPECT_FALSE(tracker.ReceivedInv(1, TxInv(MAX_PEER_TX_ANNOUNCEMENTS)));
+    EXPECT_TRUE(tracker.ReceivedInv(2, TxInv(MAX_PEER_TX_ANNOUNCEMENTS)));
+
+    // the requests in flight count until answered or timed out
+    EXPECT_EQ(tracker.GetRequestable(1, 0).size(), MAX_PEER_TX_ANNOUNCEMENTS);
+    EXPECT_FALSE(tracker.ReceivedInv(1, TxInv(MAX_PEER_TX_ANNOUNCEMENTS)));
+    tracker.Forget(TxInv(0));
+    EXPECT_TRUE(tracker.ReceivedInv(1, TxInv(MAX_PEER_TX_ANNOUNCEMENTS)));
+}
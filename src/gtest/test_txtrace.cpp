@@ -0,0 +1,79 @@
+#include <gtest/gtest.h>
+
+#include "txtrace.h"
+
+namespace {
+
+uint256 Hash(int n)
+{
+    uint256 hash;
+    *hash.begin() = n;
+    return hash;
+}
+
+} // anon namespace
+
+TEST(TxTracer, StagesAreRecordedOnceForTracedObjects)
+{
+    CTxTracer tracer;
+    tracer.Start(Hash(1), true, 1000);
+    tracer.Record(Hash(1), TxTraceStage::PROOF_QUEUED, 1010);
+    tracer.Record(Hash(1), TxTraceStage::PROOF_VERIFY, 1500);
+    tracer.Record(Hash(1), TxTraceStage::PROOF_VERIFIED, 1600);
+    tracer.Record(Hash(1), TxTraceStage::ACCEPTED, 1700);
+    // a later block template does not move the first one
+    tracer.Record(Hash(1), TxTraceStage::BLOCK_TEMPLATE, 3000);
+    tracer.Record(Hash(1), TxTraceStage::BLOCK_TEMPLATE, 4000);
+    // not traced
+    tracer.Record(Hash(2), TxTraceStage::ACCEPTED, 1200);
+
+    CTxTrace trace;
+    EXPECT_FALSE(tracer.Get(Hash(2), trace));
+    ASSERT_TRUE(tracer.Get(Hash(1), trace));
+    EXPECT_TRUE(trace.fCertificate);
+    EXPECT_EQ(trace.vTimeMicros[(int)TxTraceStage::RECEIVED], 1000);
+    EXPECT_EQ(trace.vTimeMicros[(int)TxTraceStage::RELAYED], 0);
+    EXPECT_EQ(trace.vTimeMicros[(int)TxTraceStage::BLOCK_TEMPLATE], 3000);
+    EXPECT_EQ(trace.GetLatency(TxTraceStage::RECEIVED), 0);
+    EXPECT_EQ(trace.GetLatency(TxTraceStage::PROOF_VERIFY), 490);
+    // the stages not reached are skipped
+    EXPECT_EQ(trace.GetLatency(TxTraceStage::BLOCK_TEMPLATE), 1300);
+
+    EXPECT_EQ(tracer.GetSnapshot(true, TxTraceStage::PROOF_VERIFY).nSumMicros, 490U);
+    EXPECT_EQ(tracer.GetSnapshot(true, TxTraceStage::BLOCK_TEMPLATE).nCount, 1U);
+    EXPECT_EQ(tracer.GetSnapshot(false, TxTraceStage::ACCEPTED).nCount, 0U);
+
+    // a transaction received again is not started again
+    tracer.Start(Hash(1), false, 5000);
+    ASSERT_TRUE(tracer.Get(Hash(1), trace));
+    EXPECT_TRUE(trace.fCertificate);
+    EXPECT_EQ(trace.vTimeMicros[(int)TxTraceStage::RECEIVED], 1000);
+
+    tracer.ResetStats();
+    EXPECT_EQ(tracer.GetSnapshot(true, TxTraceStage::PROOF_VERIFY).nCount, 0U);
+    EXPECT_TRUE(tracer.Get(Hash(1), trace));
+}
+
+TEST(TxTracer, OldestTracesAreEvicted)
+{
+    CTxTracer tracer(3);
+    for (int n = 1; n <= 5; ++n)
+        tracer.Start(Hash(n), false, n);
+    EXPECT_EQ(tracer.Size(), 3U);
+
+    CTxTrace trace;
+    EXPECT_FALSE(tracer.Get(Hash(2), trace));
+    EXPECT_TRUE(tracer.Get(Hash(3), trace));
+    EXPECT_TRUE(tracer.Get(Hash(5), trace));
+
+    tracer.SetMaxSize(1);
+    EXPECT_EQ(tracer.Size(), 1U);
+    EXPECT_TRUE(tracer.Get(Hash(5), trace));
+
+    // disabled, the traces kept are dropped and no new one is started
+    tracer.SetMaxSize(0);
+    tracer.Start(Hash(6), false, 6);
+    tracer.Record(Hash(5), TxTraceStage::ACCEPTED, 7);
+    EXPECT_EQ(tracer.Size(), 0U);
+    EXPECT_EQ(tracer.GetSnapshot(false, TxTraceStage::ACCEPTED).nCount, 0U);
+}
@@ -80,6 +80,49 @@ TEST(Validation, ContextualCheckInputsPassesWithCoinbase) {
     EXPECT_TRUE(ContextualCheckTxInputs(tx, state, view, false, chainActive, 0, false, Params(CBaseChainParams::MAIN).GetConsensus()));
 }
 
+TEST(Validation, ContextualCheckInputsSkipsCachedScriptExecutions) {
+    SelectParams(CBaseChainParams::REGTEST);
+    FakeCoinsViewDB fakeDB;
+    CCoinsViewCache view(&fakeDB);
+
+    // A coin nobody can spend
+    const uint256 prevHash = uint256S("aa");
+    {
+        CCoinsModifier coins = view.ModifyCoins(prevHash);
+        coins->nVersion = TRANSPARENT_TX_VERSION;
+        coins->nHeight = 1;
+        coins->vout.push_back(CTxOut(10 * COIN, CScript() << OP_FALSE));
+    }
+
+    CMutableTransaction mtx;
+    mtx.nVersion = TRANSPARENT_TX_VERSION;
+    mtx.vin.push_back(CTxIn(COutPoint(prevHash, 0)));
+    mtx.addOut(CTxOut(9 * COIN, CScript() << OP_TRUE));
+    CTransaction tx(mtx);
+
+    const Consensus::Params& consensus = Params().GetConsensus();
+    CValidationState state;
+    EXPECT_FALSE(ContextualCheckTxInputs(tx, state, view, true, chainActive, BLOCK_SCRIPT_VERIFY_FLAGS, true, consensus));
+
+    // Pretend the scripts passed when the transaction entered the mempool
+    AddToScriptExecutionCache(tx.GetHash(), BLOCK_SCRIPT_VERIFY_FLAGS);
+
+    // Entries are per flags and only stand for chainActive
+    EXPECT_FALSE(ContextualCheckTxInputs(tx, state, view, true, chainActive, STANDARD_CONTEXTUAL_SCRIPT_VERIFY_FLAGS, true, consensus));
+    CChain otherChain;
+    EXPECT_FALSE(ContextualCheckTxInputs(tx, state, view, true, otherChain, BLOCK_SCRIPT_VERIFY_FLAGS, true, consensus));
+
+    // A check storing its results keeps the entry, the one of a block being connected releases it
+    EXPECT_TRUE(ContextualCheckTxInputs(tx, state, view, true, chainActive, BLOCK_SCRIPT_VERIFY_FLAGS, true, consensus));
+    EXPECT_TRUE(ContextualCheckTxInputs(tx, state, view, true, chainActive, BLOCK_SCRIPT_VERIFY_FLAGS, false, consensus));
+    EXPECT_FALSE(ContextualCheckTxInputs(tx, state, view, true, chainActive, BLOCK_SCRIPT_VERIFY_FLAGS, false, consensus));
+
+    // Disconnecting a block forgets all the entries
+    AddToScriptExecutionCache(tx.GetHash(), BLOCK_SCRIPT_VERIFY_FLAGS);
+    ClearScriptExecutionCache();
+    EXPECT_FALSE(ContextualCheckTxInputs(tx, state, view, true, chainActive, BLOCK_SCRIPT_VERIFY_FLAGS, true, consensus));
+}
+
 TEST(Validation, ReceivedBlockTransactions) {
     auto sk = libzcash::SpendingKey::random();
 
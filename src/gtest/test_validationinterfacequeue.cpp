@@ -0,0 +1,123 @@
+#include <gtest/gtest.h>
+
+#include "primitives/transaction.h"
+#include "validationinterface.h"
+
+#include <atomic>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace {
+
+class CRecordingInterface : public CValidationInterface
+{
+public:
+    std::mutex mutex;
+    std::vector<uint256> vHashes;
+    std::vector<std::thread::id> vThreads;
+
+protected:
+    void SyncTransaction(const CTransaction& tx, const CBlock* pblock) override
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        vHashes.push_back(tx.GetHash());
+        vThreads.push_back(std::this_thread::get_id());
+    }
+};
+
+CTransaction MakeTransaction(uint32_t n)
+{
+    CMutableTransaction mtx;
+    mtx.nLockTime = n;
+    return mtx;
+}
+
+} // anon namespace
+
+TEST(ValidationInterfaceQueue, CallbacksRunInlineWhenNotStarted)
+{
+    CRecordingInterface recorder;
+    RegisterValidationInterface(&recorder);
+    const CTransaction tx = MakeTransaction(1);
+    SyncWithWallets(tx);
+    UnregisterValidationInterface(&recorder);
+
+    ASSERT_EQ(recorder.vHashes, std::vector<uint256>({tx.GetHash()}));
+    EXPECT_EQ(recorder.vThreads[0], std::this_thread::get_id());
+}
+
+TEST(ValidationInterfaceQueue, CallbacksRunInOrderOnTheQueueThread)
+{
+    CRecordingInterface recorder;
+    RegisterValidationInterface(&recorder);
+    StartValidationInterfaceQueue();
+
+    // the queue is held by the first callback until all the others are queued
+    std::promise<void> gate;
+    std::shared_future<void> release = gate.get_future();
+    CallFunctionInValidationInterfaceQueue([release] { release.wait(); });
+
+    std::vector<uint256> vExpected;
+    for (uint32_t n = 0; n < 50; n++) {
+        // the transaction goes out of scope once queued
+        const CTransaction tx = MakeTransaction(n);
+        vExpected.push_back(tx.GetHash());
+        SyncWithWallets(tx);
+    }
+    EXPECT_GE(GetValidationInterfaceQueueSize(), 50U);
+    {
+        std::lock_guard<std::mutex> lock(recorder.mutex);
+        EXPECT_TRUE(recorder.vHashes.empty());
+    }
+
+    gate.set_value();
+    SyncWithValidationInterfaceQueue();
+    EXPECT_EQ(GetValidationInterfaceQueueSize(), 0U);
+    {
+        std::lock_guard<std::mutex> lock(recorder.mutex);
+        EXPECT_EQ(recorder.vHashes, vExpected);
+        for (const std::thread::id& id : recorder.vThreads)
+            EXPECT_NE(id, std::this_thread::get_id());
+    }
+
+    StopValidationInterfaceQueue();
+    UnregisterValidationInterface(&recorder);
+}
+
+TEST(ValidationInterfaceQueue, LimitWaitsForTheQueueToShrink)
+{
+    StartValidationInterfaceQueue();
+    std::promise<void> gate;
+    std::shared_future<void> release = gate.get_future();
+    std::atomic<int> nRun(0);
+    CallFunctionInValidationInterfaceQueue([release] { release.wait(); });
+    for (int n = 0; n < 20; n++)
+        CallFunctionInValidationInterfaceQueue([&nRun] { nRun++; });
+
+    std::future<void> limited = std::async(std::launch::async, [] { LimitValidationInterfaceQueue(5); });
+    EXPECT_EQ(limited.wait_for(std::chrono::milliseconds(100)), std::future_status::timeout);
+
+    gate.set_value();
+    limited.wait();
+    EXPECT_LE(GetValidationInterfaceQueueSize(), 5U);
+    SyncWithValidationInterfaceQueue();
+    EXPECT_EQ(nRun, 20);
+    StopValidationInterfaceQueue();
+}
+
+TEST(ValidationInterfaceQueue, StopRunsTheQueuedCallbacks)
+{
+    StartValidationInterfaceQueue();
+    std::atomic<int> nRun(0);
+    for (int n = 0; n < 10; n++)
+        CallFunctionInValidationInterfaceQueue([&nRun] { nRun++; });
+    StopValidationInterfaceQueue();
+    EXPECT_EQ(nRun, 10);
+    EXPECT_EQ(GetValidationInterfaceQueueSize(), 0U);
+
+    // the callbacks queued once it is stopped run right away
+    CallFunctionInValidationInterfaceQueue([&nRun] { nRun++; });
+    EXPECT_EQ(nRun, 11);
+}
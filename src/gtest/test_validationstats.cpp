@@ -0,0 +1,72 @@
+#include <gtest/gtest.h>
+
+#include "validationstats.h"
+
+TEST(LatencyHistogram, EmptySnapshot)
+{
+    CLatencyHistogram histogram;
+    CLatencyHistogram::Snapshot snapshot = histogram.GetSnapshot();
+    EXPECT_EQ(snapshot.nCount, 0U);
+    EXPECT_EQ(snapshot.Quantile(0.99), 0);
+    EXPECT_EQ(snapshot.Mean(), 0);
+}
+
+TEST(LatencyHistogram, SamplesFallInPowerOfTwoBuckets)
+{
+    CLatencyHistogram histogram;
+    histogram.Add(0);
+    histogram.Add(1);
+    histogram.Add(3);
+    histogram.Add(4);
+    histogram.Add(-5);
+    histogram.Add(int64_t(1) << 40);
+
+    CLatencyHistogram::Snapshot snapshot = histogram.GetSnapshot();
+    EXPECT_EQ(snapshot.nCount, 6U);
+    EXPECT_EQ(snapshot.vBuckets[0], 2U); // 0 and the negative sample
+    EXPECT_EQ(snapshot.vBuckets[1], 1U); // [1, 2)
+    EXPECT_EQ(snapshot.vBuckets[2], 1U); // [2, 4)
+    EXPECT_EQ(snapshot.vBuckets[3], 1U); // [4, 8)
+    EXPECT_EQ(snapshot.vBuckets[CLatencyHistogram::BUCKETS - 1], 1U);
+    EXPECT_EQ(snapshot.nMaxMicros, uint64_t(1) << 40);
+    EXPECT_EQ(snapshot.nSumMicros, 8 + (uint64_t(1) << 40));
+}
+
+TEST(LatencyHistogram, QuantilesStayWithinTheirBucket)
+{
+    CLatencyHistogram histogram;
+    for (int i = 0; i < 99; ++i)
+        histogram.Add(1000);
+    histogram.Add(100000);
+
+    CLatencyHistogram::Snapshot snapshot = histogram.GetSnapshot();
+    // 1000 is in [512, 1024), 100000 in [65536, 131072)
+    EXPECT_GE(snapshot.Quantile(0.5), 512);
+    EXPECT_LT(snapshot.Quantile(0.5), 1024);
+    EXPECT_GE(snapshot.Quantile(0.99), 512);
+    EXPECT_LE(snapshot.Quantile(0.99), 1024);
+    EXPECT_GE(snapshot.Quantile(1), 65536);
+    EXPECT_LE(snapshot.Quantile(1), 100000);
+    EXPECT_DOUBLE_EQ(snapshot.Mean(), (99 * 1000 + 100000) / 100.0);
+
+    histogram.Reset();
+    EXPECT_EQ(histogram.GetSnapshot().nCount, 0U);
+}
+
+TEST(BlockValidationStats, PrometheusExposition)
+{
+    ResetBlockValidationStats();
+    RecordBlockValidationStage(BlockValidationStage::FLUSH, 3000);
+    RecordBlockValidationStage(BlockValidationStage::FLUSH, 5000);
+
+    EXPECT_EQ(GetBlockValidationStageSnapshot(BlockValidationStage::FLUSH).nCount, 2U);
+    EXPECT_EQ(GetBlockValidationStageSnapshot(BlockValidationStage::CONNECT_TIP).nCount, 0U);
+
+    const std::string text = BlockValidationStatsToPrometheus();
+    EXPECT_NE(text.find("# TYPE zen_block_validation_stage_seconds histogram\n"), std::string::npos);
+    EXPECT_NE(text.find("zen_block_validation_stage_seconds_bucket{stage=\"flush\",le=\"+Inf\"} 2\n"), std::string::npos);
+    EXPECT_NE(text.find("zen_block_validation_stage_seconds_bucket{stage=\"flush\",le=\"0.004096\"} 1\n"), std::string::npos);
+    EXPECT_NE(text.find("zen_block_validation_stage_seconds_sum{stage=\"flush\"} 0.008000\n"), std::string::npos);
+    EXPECT_NE(text.find("zen_block_validation_stage_seconds_count{stage=\"connect_tip\"} 0\n"), std::string::npos);
+    ResetBlockValidationStats();
+}
@@ -166,9 +166,46 @@ unsigned int MurmurHash3(unsigned int nHashSeed, const std::vector<unsigned char
 
 void BIP32Hash(const ChainCode &chainCode, unsigned int nChild, unsigned char header, const unsigned char data[32], unsigned char output[64]);
 
-struct ObjectHasher
+/** SipHash-2-4, can only be used for 64-bit keyed hashing of data that an adversary cannot fully control. */
+class CSipHasher
 {
-    size_t operator()(const uint256& hash) const { return hash.GetCheapHash(); }
+private:
+    uint64_t v[4];
+    uint64_t tmp;
+    int count;
+
+public:
+    /** Construct a SipHash calculator initialized with 128-bit key (k0, k1) */
+    CSipHasher(uint64_t k0, uint64_t k1);
+    /** Hash a 64-bit integer worth of data
+     *  It is treated as if this was the little-endian interpretation of 8 bytes.
+     *  This function can only be used when a multiple of 8 bytes have been written so far.
+     */
+    CSipHasher& Write(uint64_t data);
+    /** Hash arbitrary bytes. */
+    CSipHasher& Write(const unsigned char* data, size_t size);
+    /** Compute the 64-bit SipHash-2-4 of the data written so far. The object remains untouched. */
+    uint64_t Finalize() const;
 };
 
+/** Optimized SipHash-2-4 implementation for uint256.
+ *
+ *  It is identical to:
+ *    CSipHasher(k0, k1)
+ *      .Write(val.GetUint64(0))
+ *      .Write(val.GetUint64(1))
+ *      .Write(val.GetUint64(2))
+ *      .Write(val.GetUint64(3))
+ *      .Finalize()
+ */
+uint64_t SipHashUint256(uint64_t k0, uint64_t k1, const uint256& val);
+
+/** SipHash-1-3 of a uint256, and of a uint256 followed by 32 more bytes, as the keys of the in-memory
+ *  hash tables. One compression round and three finalization rounds are enough for a table to
+ *  keep the bucket of a key unpredictable, at twice the speed of SipHash-2-4; they are identical to
+ *  the SipHash-1-3 of the 32 or 64 bytes, the words read as little endian.
+ */
+uint64_t SipHash13Uint256(uint64_t k0, uint64_t k1, const uint256& val);
+uint64_t SipHash13Uint256Extra32(uint64_t k0, uint64_t k1, const uint256& val, const unsigned char* extra);
+
 #endif // BITCOIN_HASH_H
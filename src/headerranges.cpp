@@ -0,0 +1,209 @@
+#include "headerranges.h"
+
+void CHeaderRanges::Init(const Checkpoints::MapCheckpoints& checkpoints, int nBestHeight)
+{
+    fInitialized = true;
+    ranges.clear();
+    for (auto it = checkpoints.lower_bound(nBestHeight); it != checkpoints.end(); ++it) {
+        auto itNext = std::next(it);
+        if (itNext == checkpoints.end())
+            break;
+        CHeaderRange range;
+        range.nStartHeight = range.nStitchedHeight = it->first;
+        range.hashStart = range.hashStitched = range.hashTip = it->second;
+        range.nEndHeight = itNext->first;
+        range.hashEnd = itNext->second;
+        range.nodeid = range.nodeidSource = -1;
+        range.nRequestTime = 0;
+        ranges.push_back(range);
+    }
+}
+
+CHeaderRange* CHeaderRanges::Find(NodeId nodeid)
+{
+    for (CHeaderRange& range : ranges)
+        if (range.nodeid == nodeid)
+            return &range;
+    return nullptr;
+}
+
+const CHeaderRange* CHeaderRanges::Find(NodeId nodeid) const
+{
+    for (const CHeaderRange& range : ranges)
+        if (range.nodeid == nodeid)
+            return &range;
+    return nullptr;
+}
+
+bool CHeaderRanges::Assign(NodeId nodeid, int nPeerHeight, int nMaxAssigned)
+{
+    if (nodeid < 0)
+        return false;
+    if (Find(nodeid))
+        return true;
+    if (setExcluded.count(nodeid))
+        return false;
+
+    int nAssigned = 0;
+    for (const CHeaderRange& range : ranges)
+        nAssigned += range.nodeid != -1;
+    if (nAssigned >= nMaxAssigned)
+        return false;
+
+    for (CHeaderRange& range : ranges) {
+        if (range.nodeid == -1 && !range.IsComplete() && nPeerHeight >= range.nEndHeight) {
+            range.nodeid = nodeid;
+            range.nRequestTime = 0;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool CHeaderRanges::NextRequest(NodeId nodeid, int64_t nNow, uint256& hashFrom, uint256& hashStop)
+{
+    CHeaderRange* range = nodeid < 0 ? nullptr : Find(nodeid);
+    if (!range || range->nRequestTime != 0 || range->IsComplete() ||
+        range->vHeaders.size() >= MAX_RANGE_BUFFERED_HEADERS)
+        return false;
+    hashFrom = range->hashTip;
+    hashStop = range->hashEnd;
+    range->nRequestTime = nNow;
+    return true;
+}
+
+bool CHeaderRanges::IsTimedOut(NodeId nodeid, int64_t nNow) const
+{
+    const CHeaderRange* range = nodeid < 0 ? nullptr : Find(nodeid);
+    return range && range->nRequestTime != 0 && nNow - range->nRequestTime > HEADERS_RANGE_TIMEOUT;
+}
+
+bool CHeaderRanges::IsReply(NodeId nodeid, const uint256& hashPrev) const
+{
+    const CHeaderRange* range = nodeid < 0 ? nullptr : Find(nodeid);
+    if (!range || range->nRequestTime == 0)
+        return false;
+    return hashPrev.IsNull() || hashPrev == range->hashTip;
+}
+
+CHeaderRanges::AddResult CHeaderRanges::AddHeaders(NodeId nodeid, const std::vector<CBlockHeader>& headers,
+                                                   unsigned int nMaxCount)
+{
+    CHeaderRange* range = nodeid < 0 ? nullptr : Find(nodeid);
+    if (!range)
+        return AddResult::MISMATCH;
+    range->nRequestTime = 0;
+
+    // the whole message is checked before any header is kept
+    uint256 hashPrev = range->hashTip;
+    int nHeight = range->TipHeight();
+    size_t nAdded = 0;
+    for (const CBlockHeader& header : headers) {
+        if (nHeight == range->nEndHeight)
+            break;
+        if (header.hashPrevBlock != hashPrev) {
+            Release(nodeid, false, true);
+            return AddResult::MISMATCH;
+        }
+        hashPrev = header.GetHash();
+        nHeight++;
+        nAdded++;
+    }
+    if (nHeight == range->nEndHeight && hashPrev != range->hashEnd) {
+        // the peer is on a chain leaving the checkpoints: what it sent of the range is of no use
+        Release(nodeid, true, true);
+        return AddResult::MISMATCH;
+    }
+
+    range->vHeaders.insert(range->vHeaders.end(), headers.begin(), headers.begin() + nAdded);
+    range->hashTip = hashPrev;
+    if (nAdded > 0)
+        range->nodeidSource = nodeid;
+    if (range->IsComplete()) {
+        // the peer can fetch another range
+        range->nodeid = -1;
+    } else if (headers.size() < nMaxCount) {
+        Release(nodeid, false, true);
+        return AddResult::SHORT;
+    }
+    return AddResult::OK;
+}
+
+void CHeaderRanges::Stitch(const std::function<bool(const uint256&)>& fKnown,
+                           const std::function<bool(const CBlockHeader&, NodeId)>& fAccept,
+                           std::vector<NodeId>& vFailed)
+{
+    for (auto it = ranges.begin(); it != ranges.end();) {
+        CHeaderRange& range = *it;
+        if (!range.vHeaders.empty() && fKnown(range.hashStitched)) {
+            size_t nAccepted = 0;
+            while (nAccepted < range.vHeaders.size() && fAccept(range.vHeaders[nAccepted], range.nodeidSource))
+                nAccepted++;
+            if (nAccepted > 0) {
+                range.nStitchedHeight += nAccepted;
+                range.hashStitched = range.vHeaders[nAccepted - 1].GetHash();
+            }
+            if (nAccepted < range.vHeaders.size()) {
+                vFailed.push_back(range.nodeidSource);
+                if (range.nodeidSource != -1)
+                    setExcluded.insert(range.nodeidSource);
+                if (range.nodeid == range.nodeidSource) {
+                    range.nodeid = -1;
+                    range.nRequestTime = 0;
+                }
+                range.vHeaders.clear();
+                range.hashTip = range.hashStitched;
+                range.nodeidSource = -1;
+            } else {
+                range.vHeaders.clear();
+            }
+        }
+        if (range.nStitchedHeight == range.nEndHeight)
+            it = ranges.erase(it);
+        else
+            ++it;
+    }
+}
+
+void CHeaderRanges::SyncedTo(int nHeight)
+{
+    for (auto it = ranges.begin(); it != ranges.end();) {
+        if (it->nodeid == -1 && it->nStartHeight < nHeight && (it->vHeaders.empty() || it->nEndHeight <= nHeight))
+            it = ranges.erase(it);
+        else
+            ++it;
+    }
+}
+
+bool CHeaderRanges::IsFetched(int nHeight) const
+{
+    for (const CHeaderRange& range : ranges)
+        if (range.nodeid != -1 && range.nStartHeight <= nHeight && nHeight < range.nEndHeight)
+            return true;
+    return false;
+}
+
+void CHeaderRanges::Release(NodeId nodeid, bool fDrop, bool fExclude)
+{
+    if (nodeid < 0)
+        return;
+    if (fExclude)
+        setExcluded.insert(nodeid);
+    CHeaderRange* range = Find(nodeid);
+    if (!range)
+        return;
+    if (fDrop) {
+        range->vHeaders.clear();
+        range->hashTip = range->hashStitched;
+    }
+    range->nodeid = -1;
+    range->nRequestTime = 0;
+}
+
+size_t CHeaderRanges::BufferedHeaders() const
+{
+    size_t nHeaders = 0;
+    for (const CHeaderRange& range : ranges)
+        nHeaders += range.vHeaders.size();
+    return nHeaders;
+}
@@ -0,0 +1,125 @@
+#ifndef BITCOIN_HEADERRANGES_H
+#define BITCOIN_HEADERRANGES_H
+
+#include "checkpoints.h"
+#include "net.h"
+#include "primitives/block.h"
+#include "uint256.h"
+
+#include <functional>
+#include <list>
+#include <set>
+#include <stdint.h>
+#include <vector>
+
+//! -parallelheaders default: the peers fetching the headers between the checkpoints at once
+static const int DEFAULT_PARALLEL_HEADERS = 4;
+static const int MAX_PARALLEL_HEADERS = 16;
+//! The headers a range keeps while they do not connect to the block index yet, about 30 MB
+static const unsigned int MAX_RANGE_BUFFERED_HEADERS = 20000;
+//! Seconds a peer has to answer the getheaders of its range
+static const int64_t HEADERS_RANGE_TIMEOUT = 60;
+
+/**
+ * The headers between two consecutive checkpoints, fetched from a single peer with getheaders
+ * messages starting from its last header and stopping at the closing checkpoint. They are kept
+ * aside until the range connects to the block index, being inserted then in order.
+ */
+struct CHeaderRange {
+    //! The checkpoint before the first header of the range
+    int nStartHeight;
+    uint256 hashStart;
+    //! The checkpoint closing the range
+    int nEndHeight;
+    uint256 hashEnd;
+    //! The last header of the range inserted in the block index, the starting checkpoint at first
+    int nStitchedHeight;
+    uint256 hashStitched;
+    //! The headers received after hashStitched, PoW checked
+    std::vector<CBlockHeader> vHeaders;
+    uint256 hashTip;
+    //! The peer fetching the range, -1 if none, and when its getheaders was sent, 0 if none is pending
+    NodeId nodeid;
+    int64_t nRequestTime;
+    //! The peer the last headers held were received from, -1 if none
+    NodeId nodeidSource;
+
+    int TipHeight() const { return nStitchedHeight + (int)vHeaders.size(); }
+    bool IsComplete() const { return TipHeight() == nEndHeight; }
+};
+
+/**
+ * The ranges between the checkpoints above the best header at startup, fetched in parallel from
+ * several peers while the headers sync reaches them. Requires cs_main.
+ */
+class CHeaderRanges
+{
+public:
+    enum class AddResult {
+        OK,
+        //! The peer sent less than a full message before the end of its range: it has no more
+        SHORT,
+        //! The headers do not follow each other or do not end on the checkpoint
+        MISMATCH,
+    };
+
+    //! Create the ranges once, between the checkpoints above nBestHeight
+    void Init(const Checkpoints::MapCheckpoints& checkpoints, int nBestHeight);
+    bool IsInitialized() const { return fInitialized; }
+    bool Empty() const { return ranges.empty(); }
+
+    /**
+     * Give the lowest range still needing headers and fetched by nobody to a peer not fetching any,
+     * whose starting height covers it, unless nMaxAssigned peers already are. Returns whether the
+     * peer fetches a range.
+     */
+    bool Assign(NodeId nodeid, int nPeerHeight, int nMaxAssigned);
+
+    /**
+     * The getheaders to send to the peer of a range, if none is pending and its range needs more
+     * headers and has room for them: from hashFrom, stopping at hashStop.
+     */
+    bool NextRequest(NodeId nodeid, int64_t nNow, uint256& hashFrom, uint256& hashStop);
+    bool IsTimedOut(NodeId nodeid, int64_t nNow) const;
+    bool IsAssigned(NodeId nodeid) const { return nodeid >= 0 && Find(nodeid) != nullptr; }
+
+    //! Whether headers following hashPrev, none for an empty message, answer the getheaders of the peer
+    bool IsReply(NodeId nodeid, const uint256& hashPrev) const;
+    //! Append the reply of the peer to its range, which is let go but in the OK case
+    AddResult AddHeaders(NodeId nodeid, const std::vector<CBlockHeader>& headers, unsigned int nMaxCount);
+
+    /**
+     * Insert with fAccept, given the peer they came from, the headers of the ranges that connect to the
+     * block index as fKnown says, dropping the ranges completed. On a header failing, the rest of its
+     * range is dropped and its peer, returned in vFailed, is not given any range again.
+     */
+    void Stitch(const std::function<bool(const uint256&)>& fKnown,
+                const std::function<bool(const CBlockHeader&, NodeId)>& fAccept,
+                std::vector<NodeId>& vFailed);
+
+    /**
+     * The headers sync got to nHeight: it goes on through the ranges it entered nobody fetches and
+     * holds nothing, which are dropped.
+     */
+    void SyncedTo(int nHeight);
+    //! Whether a peer is fetching the range holding the header after nHeight
+    bool IsFetched(int nHeight) const;
+
+    /**
+     * Let the range of a peer, disconnected or not answering, to be fetched by another one. The
+     * headers it holds are kept unless fDrop. With fExclude the peer is not given any range again.
+     */
+    void Release(NodeId nodeid, bool fDrop, bool fExclude);
+
+    size_t BufferedHeaders() const;
+
+private:
+    std::list<CHeaderRange> ranges;
+    std::set<NodeId> setExcluded;
+    bool fInitialized = false;
+
+    CHeaderRange* Find(NodeId nodeid);
+    const CHeaderRange* Find(NodeId nodeid) const;
+};
+
+#endif // BITCOIN_HEADERRANGES_H
@@ -0,0 +1,90 @@
+#include "headerscache.h"
+
+#include "chain.h"
+#include "memusage.h"
+#include "primitives/block.h"
+#include "streams.h"
+#include "version.h"
+
+#include <assert.h>
+
+CHeadersCache headersCache(DEFAULT_HEADERS_CACHE_SIZE << 20);
+
+CHeadersCache::CHeadersCache(size_t nMaxUsageIn) : nMaxUsage(nMaxUsageIn), nUsage(0), nUseSequence(0)
+{
+}
+
+size_t CHeadersCache::ChunkUsage(const CChunk& chunk)
+{
+    return memusage::DynamicUsage(chunk.vIndex) + memusage::DynamicUsage(chunk.vOffsets) + memusage::DynamicUsage(chunk.vData);
+}
+
+const CHeadersCache::CChunk& CHeadersCache::Fetch(const CChain& chain, int nFirst, int nLast)
+{
+    const int nBase = nFirst - nFirst % HEADERS_CACHE_CHUNK_SIZE;
+    CChunk& chunk = mapChunks[nBase];
+    chunk.nLastUsed = ++nUseSequence;
+    const size_t nUsageBefore = ChunkUsage(chunk);
+    if (chunk.vOffsets.empty())
+        chunk.vOffsets.push_back(0);
+
+    // Cut the headers disconnected by a reorg: if the last one is in the chain, so are the others
+    while (!chunk.vIndex.empty() && !chain.Contains(chunk.vIndex.back()))
+    {
+        chunk.vIndex.pop_back();
+        chunk.vOffsets.pop_back();
+        chunk.vData.resize(chunk.vOffsets.back());
+    }
+
+    const int nTarget = std::min(nLast, nBase + HEADERS_CACHE_CHUNK_SIZE - 1);
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    for (int nHeight = nBase + chunk.vIndex.size(); nHeight <= nTarget; nHeight++)
+    {
+        const CBlockIndex* pindex = chain[nHeight];
+        assert(pindex);
+        ss.clear();
+        ss << CBlockHeaderForNetwork(pindex->GetBlockHeader());
+        chunk.vData.insert(chunk.vData.end(), ss.begin(), ss.end());
+        chunk.vIndex.push_back(pindex);
+        chunk.vOffsets.push_back(chunk.vData.size());
+    }
+
+    nUsage = nUsage - nUsageBefore + ChunkUsage(chunk);
+    Trim(nBase);
+    return chunk;
+}
+
+void CHeadersCache::Trim(int nKeep)
+{
+    while (nUsage > nMaxUsage && mapChunks.size() > 1)
+    {
+        std::map<int, CChunk>::iterator itOldest = mapChunks.end();
+        for (std::map<int, CChunk>::iterator it = mapChunks.begin(); it != mapChunks.end(); ++it)
+        {
+            if (it->first != nKeep && (itOldest == mapChunks.end() || it->second.nLastUsed < itOldest->second.nLastUsed))
+                itOldest = it;
+        }
+        nUsage -= ChunkUsage(itOldest->second);
+        mapChunks.erase(itOldest);
+    }
+}
+
+std::vector<char> CHeadersCache::GetHeader(const CChain& chain, int nHeight)
+{
+    const CChunk& chunk = Fetch(chain, nHeight, nHeight);
+    const int nIndex = nHeight % HEADERS_CACHE_CHUNK_SIZE;
+    // the empty transaction vector is serialized as a zero count, in the last byte
+    return std::vector<char>(chunk.vData.begin() + chunk.vOffsets[nIndex], chunk.vData.begin() + chunk.vOffsets[nIndex + 1] - 1);
+}
+
+void CHeadersCache::SetMaxUsage(size_t nMaxUsageIn)
+{
+    nMaxUsage = nMaxUsageIn;
+    Trim(-1);
+}
+
+void CHeadersCache::Clear()
+{
+    mapChunks.clear();
+    nUsage = 0;
+}
@@ -0,0 +1,107 @@
+#ifndef BITCOIN_HEADERSCACHE_H
+#define BITCOIN_HEADERSCACHE_H
+
+#include "serialize.h"
+
+#include <algorithm>
+#include <map>
+#include <stdint.h>
+#include <vector>
+
+class CBlockIndex;
+class CChain;
+
+//! -headerscachesize default, in MiB
+static const int64_t DEFAULT_HEADERS_CACHE_SIZE = 16;
+//! The number of consecutive headers serialized together
+static const int HEADERS_CACHE_CHUNK_SIZE = 2000;
+
+/**
+ * The headers of the active chain serialized as CBlockHeaderForNetwork, in chunks of
+ * HEADERS_CACHE_CHUNK_SIZE consecutive heights, so that the headers replies and the websocket
+ * header requests copy the bytes instead of serializing every header and its Equihash solution again.
+ * A chunk is filled up as the chain grows and cut back to the fork point when a chunk entry is no
+ * longer in the active chain, which is checked at every access. The memory used by the chunks is
+ * bounded, the least recently used ones being dropped first. Guarded by cs_main.
+ */
+class CHeadersCache
+{
+public:
+    explicit CHeadersCache(size_t nMaxUsageIn);
+
+    /**
+     * Append to s the serialized headers of the chain from height nFirst to nLast, both in the
+     * chain, with no count prefix.
+     */
+    template<typename Stream>
+    void Write(Stream& s, const CChain& chain, int nFirst, int nLast)
+    {
+        while (nFirst <= nLast)
+        {
+            const CChunk& chunk = Fetch(chain, nFirst, nLast);
+            const int nBase = nFirst - nFirst % HEADERS_CACHE_CHUNK_SIZE;
+            const int nChunkLast = std::min(nLast, nBase + HEADERS_CACHE_CHUNK_SIZE - 1);
+            const size_t nBegin = chunk.vOffsets[nFirst - nBase];
+            const size_t nEnd = chunk.vOffsets[nChunkLast - nBase + 1];
+            s.write(&chunk.vData[nBegin], nEnd - nBegin);
+            nFirst = nChunkLast + 1;
+        }
+    }
+
+    //! The serialized CBlockHeader of the chain at height nHeight, without the empty transaction vector of CBlockHeaderForNetwork
+    std::vector<char> GetHeader(const CChain& chain, int nHeight);
+
+    void SetMaxUsage(size_t nMaxUsageIn);
+    void Clear();
+
+    size_t DynamicUsage() const { return nUsage; }
+
+private:
+    struct CChunk
+    {
+        std::vector<const CBlockIndex*> vIndex;
+        //! The offsets in vData of the headers, and the end of the last one
+        std::vector<size_t> vOffsets;
+        std::vector<char> vData;
+        uint64_t nLastUsed = 0;
+    };
+
+    size_t nMaxUsage;
+    size_t nUsage;
+    uint64_t nUseSequence;
+    //! By the height of their first header
+    std::map<int, CChunk> mapChunks;
+
+    //! The chunk holding nFirst, synced with the chain and filled up to nLast or its end
+    const CChunk& Fetch(const CChain& chain, int nFirst, int nLast);
+    static size_t ChunkUsage(const CChunk& chunk);
+    void Trim(int nKeep);
+};
+
+/** A range of headers of the chain, serialized from the headers cache like a vector<CBlockHeaderForNetwork> */
+class CHeadersRange
+{
+public:
+    CHeadersRange(CHeadersCache& cacheIn, const CChain& chainIn, int nFirstIn, int nLastIn) :
+        cache(cacheIn), chain(chainIn), nFirst(nFirstIn), nLast(nLastIn) {}
+
+    size_t size() const { return nLast >= nFirst ? nLast - nFirst + 1 : 0; }
+
+    template<typename Stream>
+    void Serialize(Stream& s, int nType, int nVersion) const
+    {
+        WriteCompactSize(s, size());
+        if (size() > 0)
+            cache.Write(s, chain, nFirst, nLast);
+    }
+
+private:
+    CHeadersCache& cache;
+    const CChain& chain;
+    int nFirst;
+    int nLast;
+};
+
+extern CHeadersCache headersCache;
+
+#endif // BITCOIN_HEADERSCACHE_H
@@ -87,6 +87,71 @@ static bool RPCAuthorized(const std::string& strAuth)
     return TimingResistantEqual(strUserPass, strRPCUserColonPass);
 }
 
+/** Classify a JSON-RPC request by its methods, found without parsing the whole body. Only the
+ * "method" keys of the top level object, or of the objects in the top level array, are looked at:
+ * a method we can't make sense of is returned empty, sending the request to the default lane.
+ */
+static std::vector<std::string> JSONRPCRequestMethods(HTTPRequest* req, const std::string &)
+{
+    std::vector<std::string> methods;
+    const std::string body = req->PeekBody();
+    std::vector<char> nesting;
+    bool fKey = false;
+    std::string strKey;
+    for (size_t i = 0; i < body.size(); i++) {
+        switch (body[i]) {
+        case '"': {
+            std::string str;
+            bool fEscaped = false;
+            size_t j = i + 1;
+            for (; j < body.size() && body[j] != '"'; j++) {
+                if (body[j] == '\\') {
+                    fEscaped = true;
+                    j++;
+                } else
+                    str += body[j];
+            }
+            if (j >= body.size())
+                return methods;
+            bool fRequestLevel = !nesting.empty() && nesting.back() == '{' &&
+                                 (nesting.size() == 1 || (nesting.size() == 2 && nesting[0] == '['));
+            if (fRequestLevel) {
+                if (fKey)
+                    strKey = fEscaped ? "" : str;
+                else if (strKey == "method")
+                    methods.push_back(fEscaped ? "" : str);
+            }
+            fKey = false;
+            i = j;
+            break;
+        }
+        case '{':
+            nesting.push_back('{');
+            fKey = true;
+            strKey.clear();
+            break;
+        case '[':
+            nesting.push_back('[');
+            fKey = false;
+            break;
+        case '}':
+        case ']':
+            if (nesting.empty())
+                return methods;
+            nesting.pop_back();
+            fKey = false;
+            break;
+        case ',':
+            fKey = !nesting.empty() && nesting.back() == '{';
+            break;
+        case ':':
+            fKey = false;
+            break;
+        }
+    }
+    return methods;
+}
+
 static bool HTTPReq_JSONRPC(HTTPRequest* req, const std::string &)
 {
     // JSONRPC handles only POST
@@ -134,7 +199,7 @@ static bool HTTPReq_JSONRPC(HTTPRequest* req, const std::string &)
 
         // array of requests
         } else if (valRequest.isArray())
-            strReply = JSONRPCExecBatch(valRequest.get_array());
+            strReply = JSONRPCExecBatch(valRequest.get_array(), HTTPRunParallel);
         else
             throw JSONRPCError(RPC_PARSE_ERROR, "Top-level object parse error");
 
@@ -173,7 +238,7 @@ bool StartHTTPRPC()
     if (!InitRPCAuthentication())
         return false;
 
-    RegisterHTTPHandler("/", true, HTTPReq_JSONRPC);
+    RegisterHTTPHandler("/", true, HTTPReq_JSONRPC, JSONRPCRequestMethods);
 
     assert(EventBase());
     httpRPCTimerInterface = new HTTPRPCTimerInterface(EventBase());
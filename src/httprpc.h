@@ -32,4 +32,12 @@ void InterruptREST();
  */
 void StopREST();
 
+/** Start serving the node metrics, in the Prometheus text format, at /metrics.
+ * Precondition; HTTP and RPC has been started.
+ */
+bool StartMetrics();
+/** Stop serving the node metrics.
+ */
+void StopMetrics();
+
 #endif
@@ -11,11 +11,19 @@
 #include "rpc/protocol.h" // For HTTP status codes
 #include "sync.h"
 #include "ui_interface.h"
+#include "utilstrencodings.h"
+#include "utiltime.h"
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
 #include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
 
 #include <sys/types.h>
 #include <sys/stat.h>
@@ -70,10 +78,26 @@ private:
     CWaitableCriticalSection cs;
     CConditionVariable cond;
     /* XXX in C++11 we can use std::unique_ptr here and avoid manual cleanup */
-    std::deque<std::unique_ptr<WorkItem>> queue;
+    struct Entry
+    {
+        //! time the item was enqueued at, in microseconds
+        int64_t nTime;
+        //! whether this is a request, rather than a task helping one, and counts in the stats
+        bool fRequest;
+        std::unique_ptr<WorkItem> item;
+    };
+    std::deque<Entry> queue;
     bool running;
     size_t maxDepth;
     int numThreads;
+    //! worker threads waiting for an item
+    size_t numIdle = 0;
+
+    uint64_t nProcessed = 0;
+    uint64_t nRejected = 0;
+    size_t nPeakDepth = 0;
+    int64_t nTotalWaitMicros = 0, nMaxWaitMicros = 0;
+    int64_t nTotalRunMicros = 0, nMaxRunMicros = 0;
 
     /** RAII object to keep track of number of running worker threads */
     class ThreadCounter
@@ -110,9 +134,22 @@ public:
     {
         boost::unique_lock<boost::mutex> lock(cs);
         if (queue.size() >= maxDepth) {
+            nRejected++;
+            return false;
+        }
+        queue.push_back(Entry{GetTimeMicros(), true, std::unique_ptr<WorkItem>(item)});
+        nPeakDepth = std::max(nPeakDepth, queue.size());
+        cond.notify_one();
+        return true;
+    }
+    /** Enqueue a work item only if a worker thread is waiting to pick it up right away */
+    bool EnqueueIfIdle(WorkItem* item)
+    {
+        boost::unique_lock<boost::mutex> lock(cs);
+        if (!running || queue.size() >= numIdle) {
             return false;
         }
-        queue.emplace_back(item);
+        queue.push_back(Entry{GetTimeMicros(), false, std::unique_ptr<WorkItem>(item)});
         cond.notify_one();
         return true;
     }
@@ -122,16 +159,34 @@ public:
         ThreadCounter count(*this);
         while (running) {
             std::unique_ptr<WorkItem> i;
+            int64_t nStart;
+            bool fRequest;
             {
                 boost::unique_lock<boost::mutex> lock(cs);
+                numIdle++;
                 while (running && queue.empty())
                     cond.wait(lock);
+                numIdle--;
                 if (!running)
                     break;
-                i = std::move(queue.front());
+                nStart = GetTimeMicros();
+                fRequest = queue.front().fRequest;
+                if (fRequest) {
+                    int64_t nWait = nStart - queue.front().nTime;
+                    nTotalWaitMicros += nWait;
+                    nMaxWaitMicros = std::max(nMaxWaitMicros, nWait);
+                }
+                i = std::move(queue.front().item);
                 queue.pop_front();
             }
             (*i)();
+            if (fRequest) {
+                boost::unique_lock<boost::mutex> lock(cs);
+                int64_t nRun = GetTimeMicros() - nStart;
+                nTotalRunMicros += nRun;
+                nMaxRunMicros = std::max(nMaxRunMicros, nRun);
+                nProcessed++;
+            }
         }
     }
     /** Interrupt and exit loops */
@@ -155,34 +210,105 @@ public:
         boost::unique_lock<boost::mutex> lock(cs);
         return queue.size();
     }
+
+    /** Fill in the depth and latency counters of the queue */
+    void GetStats(HTTPWorkQueueStats& stats)
+    {
+        boost::unique_lock<boost::mutex> lock(cs);
+        stats.maxDepth = maxDepth;
+        stats.depth = queue.size();
+        stats.peakDepth = nPeakDepth;
+        stats.processed = nProcessed;
+        stats.rejected = nRejected;
+        stats.totalWaitMicros = nTotalWaitMicros;
+        stats.maxWaitMicros = nMaxWaitMicros;
+        stats.totalRunMicros = nTotalRunMicros;
+        stats.maxRunMicros = nMaxRunMicros;
+    }
 };
 
 struct HTTPPathHandler
 {
     HTTPPathHandler() {}
-    HTTPPathHandler(const std::string& prefix, bool exactMatch, HTTPRequestHandler handler):
-        prefix(prefix), exactMatch(exactMatch), handler(handler)
+    HTTPPathHandler(const std::string& prefix, bool exactMatch, HTTPRequestHandler handler,
+                    HTTPRequestClassifier classifier):
+        prefix(prefix), exactMatch(exactMatch), handler(handler), classifier(classifier)
     {
     }
     std::string prefix;
     bool exactMatch;
     HTTPRequestHandler handler;
+    HTTPRequestClassifier classifier;
+};
+
+/** A work queue with its own worker threads, serving the request classes mapped to it */
+struct HTTPWorkLane
+{
+    HTTPWorkLane(const std::string& name, int numThreads, size_t maxDepth):
+        name(name), numThreads(numThreads), queue(new WorkQueue<HTTPClosure>(maxDepth))
+    {
+    }
+    std::string name;
+    int numThreads;
+    std::unique_ptr<WorkQueue<HTTPClosure>> queue;
+};
+
+/** What a reply being streamed in chunks has queued on its connection and not yet flushed, shared by the
+ * worker thread writing the chunks and the event loop sending them
+ */
+struct HTTPReplyBuffer
+{
+    std::mutex cs;
+    std::condition_variable cond;
+    size_t nPending = 0;
+    //! the connection went away, the chunks left are dropped
+    bool fClosed = false;
+};
+
+/** An event loop with its own evhttp, serving the connections it accepts on the listening sockets */
+struct HTTPEventLoop
+{
+    struct ConnectionState
+    {
+        int nRequests = 0;
+        std::shared_ptr<HTTPReplyBuffer> reply;
+    };
+
+    struct event_base* base = 0;
+    struct evhttp* http = 0;
+    boost::thread thread;
+    std::vector<evhttp_bound_socket *> boundSockets;
+    //! only used on the thread of the loop
+    std::map<struct evhttp_connection*, ConnectionState> mapConnections;
+
+    ~HTTPEventLoop()
+    {
+        if (http)
+            evhttp_free(http);
+        if (base)
+            event_base_free(base);
+    }
 };
 
 /** HTTP module state */
 
-//! libevent event loop
+//! libevent event loops, the first one binds the listening sockets and serves the timers of EventBase()
+static std::vector<std::unique_ptr<HTTPEventLoop>> eventLoops;
+//! libevent event loop of the timers and of the requests not tied to a loop
 static struct event_base* eventBase = 0;
-//! HTTP server
-struct evhttp* eventHTTP = 0;
+//! Requests served on a connection before it is closed, 0 for no limit
+static int nMaxKeepAliveRequests = DEFAULT_HTTP_MAX_KEEPALIVE_REQUESTS;
+//! Bytes of a chunked reply queued on a connection past which the worker writing it waits
+static size_t nMaxReplyBuffer = DEFAULT_HTTP_MAX_REPLY_BUFFER << 20;
+static std::atomic<bool> fHTTPInterrupted(false);
 //! List of subnets to allow RPC connections from
 static std::vector<CSubNet> rpc_allow_subnets;
-//! Work queue for handling longer requests off the event loop thread
-static WorkQueue<HTTPClosure>* workQueue = 0;
+//! Work queues for handling longer requests off the event loop thread, the first one is the default lane
+static std::vector<std::unique_ptr<HTTPWorkLane>> workLanes;
+//! Lane serving each request class configured with -rpcworklane
+static std::map<std::string, size_t> mapLaneByClass;
 //! Handlers for (sub)paths
 std::vector<HTTPPathHandler> pathHandlers;
-//! Bound listening sockets
-std::vector<evhttp_bound_socket *> boundSockets;
 
 /** Check if a network address is allowed to access the HTTP server */
 static bool ClientAllowed(const CNetAddr& netaddr)
@@ -242,10 +368,78 @@ static std::string RequestMethodString(HTTPRequest::RequestMethod m)
     }
 }
 
+/** Pick the lane of a request: the one its classes are mapped to, if they all agree, or else the default lane.
+ * Requests of handlers without a classifier are classified by the handler prefix.
+ */
+static HTTPWorkLane& SelectWorkLane(const HTTPPathHandler& handler, HTTPRequest* req, const std::string& path)
+{
+    if (mapLaneByClass.empty())
+        return *workLanes[0];
+
+    std::vector<std::string> classes;
+    if (handler.classifier)
+        classes = handler.classifier(req, path);
+    else
+        classes.push_back(handler.prefix);
+    if (classes.empty())
+        return *workLanes[0];
+
+    std::map<std::string, size_t>::const_iterator it = mapLaneByClass.find(classes[0]);
+    size_t nLane = it != mapLaneByClass.end() ? it->second : 0;
+    for (size_t i = 1; i < classes.size() && nLane != 0; i++) {
+        it = mapLaneByClass.find(classes[i]);
+        if (it == mapLaneByClass.end() || it->second != nLane)
+            nLane = 0;
+    }
+    return *workLanes[nLane];
+}
+
+/** Connection close callback: the state of the connection is dropped, and a reply streamed on it stops */
+static void http_connection_close_cb(struct evhttp_connection* evcon, void* arg)
+{
+    HTTPEventLoop* loop = static_cast<HTTPEventLoop*>(arg);
+    std::map<struct evhttp_connection*, HTTPEventLoop::ConnectionState>::iterator it = loop->mapConnections.find(evcon);
+    if (it == loop->mapConnections.end())
+        return;
+    if (it->second.reply) {
+        std::lock_guard<std::mutex> lock(it->second.reply->cs);
+        it->second.reply->fClosed = true;
+        it->second.reply->cond.notify_all();
+    }
+    loop->mapConnections.erase(it);
+}
+
+/** Callback of a chunk written out: all that was queued on the connection is flushed */
+static void http_reply_flushed_cb(struct evhttp_connection* evcon, void* arg)
+{
+    HTTPEventLoop* loop = static_cast<HTTPEventLoop*>(arg);
+    std::map<struct evhttp_connection*, HTTPEventLoop::ConnectionState>::iterator it = loop->mapConnections.find(evcon);
+    if (it == loop->mapConnections.end() || !it->second.reply)
+        return;
+    std::lock_guard<std::mutex> lock(it->second.reply->cs);
+    it->second.reply->nPending = 0;
+    it->second.reply->cond.notify_all();
+}
+
 /** HTTP request callback */
 static void http_request_cb(struct evhttp_request* req, void* arg)
 {
-    std::unique_ptr<HTTPRequest> hreq(new HTTPRequest(req));
+    HTTPEventLoop* loop = static_cast<HTTPEventLoop*>(arg);
+    std::unique_ptr<HTTPRequest> hreq(new HTTPRequest(req, loop->base));
+
+    // Requests of a connection are served one at a time: the state of the connection is this request's
+    struct evhttp_connection* evcon = evhttp_request_get_connection(req);
+    if (evcon) {
+        std::map<struct evhttp_connection*, HTTPEventLoop::ConnectionState>::iterator it = loop->mapConnections.find(evcon);
+        if (it == loop->mapConnections.end()) {
+            it = loop->mapConnections.insert(std::make_pair(evcon, HTTPEventLoop::ConnectionState())).first;
+            evhttp_connection_set_closecb(evcon, http_connection_close_cb, loop);
+        }
+        it->second.reply = std::make_shared<HTTPReplyBuffer>();
+        hreq->SetReplyBuffer(it->second.reply, &http_reply_flushed_cb, loop);
+        if (nMaxKeepAliveRequests > 0 && ++it->second.nRequests >= nMaxKeepAliveRequests)
+            evhttp_add_header(evhttp_request_get_output_headers(req), "Connection", "close");
+    }
 
     LogPrint("http", "Received a %s request for %s from %s\n",
              RequestMethodString(hreq->GetRequestMethod()), hreq->GetURI(), hreq->GetPeer().ToString());
@@ -281,12 +475,15 @@ static void http_request_cb(struct evhttp_request* req, void* arg)
 
     // Dispatch to worker thread
     if (i != iend) {
+        assert(!workLanes.empty());
+        HTTPWorkLane& lane = SelectWorkLane(*i, hreq.get(), path);
         std::unique_ptr<HTTPWorkItem> item(new HTTPWorkItem(hreq.release(), path, i->handler));
-        assert(workQueue);
-        if (workQueue->Enqueue(item.get()))
+        if (lane.queue->Enqueue(item.get()))
             item.release(); /* if true, queue took ownership */
-        else
+        else {
+            LogPrint("http", "Work queue depth of lane %s exceeded, rejecting request\n", lane.name);
             item->req->WriteReply(HTTP_INTERNAL, "Work queue depth exceeded");
+        }
     } else {
         hreq->WriteReply(HTTP_NOTFOUND);
     }
@@ -311,7 +508,7 @@ static void ThreadHTTP(struct event_base* base, struct evhttp* http)
 }
 
 /** Bind HTTP server to specified addresses */
-static bool HTTPBindAddresses(struct evhttp* http)
+static bool HTTPBindAddresses(HTTPEventLoop& loop)
 {
     int defaultPort = GetArg("-rpcport", BaseParams().RPCPort());
     std::vector<std::pair<std::string, uint16_t> > endpoints;
@@ -339,23 +536,182 @@ static bool HTTPBindAddresses(struct evhttp* http)
     // Bind addresses
     for (std::vector<std::pair<std::string, uint16_t> >::iterator i = endpoints.begin(); i != endpoints.end(); ++i) {
         LogPrint("http", "Binding RPC on address %s port %i\n", i->first, i->second);
-        evhttp_bound_socket *bind_handle = evhttp_bind_socket_with_handle(http, i->first.empty() ? NULL : i->first.c_str(), i->second);
+        evhttp_bound_socket *bind_handle = evhttp_bind_socket_with_handle(loop.http, i->first.empty() ? NULL : i->first.c_str(), i->second);
         if (bind_handle) {
-            boundSockets.push_back(bind_handle);
+            loop.boundSockets.push_back(bind_handle);
         } else {
             LogPrintf("Binding RPC on address %s port %i failed.\n", i->first, i->second);
         }
     }
-    return !boundSockets.empty();
+    return !loop.boundSockets.empty();
+}
+
+/** Accept on the sockets bound by the first loop as well: the kernel hands each new connection to one of
+ * the loops waiting on them. Each loop listens on its own duplicate, closed when its evhttp is freed.
+ */
+static bool HTTPShareBoundSockets(const HTTPEventLoop& first, HTTPEventLoop& loop)
+{
+#ifdef WIN32
+    return false;
+#else
+    for (evhttp_bound_socket *socket : first.boundSockets) {
+        evutil_socket_t fd = dup(evhttp_bound_socket_get_fd(socket));
+        if (fd < 0)
+            return false;
+        evhttp_bound_socket *bind_handle = evhttp_accept_socket_with_handle(loop.http, fd);
+        if (!bind_handle) {
+            evutil_closesocket(fd);
+            return false;
+        }
+        loop.boundSockets.push_back(bind_handle);
+    }
+    return true;
+#endif
+}
+
+/** Create an event loop and its evhttp */
+static std::unique_ptr<HTTPEventLoop> NewHTTPEventLoop()
+{
+    std::unique_ptr<HTTPEventLoop> loop(new HTTPEventLoop());
+    loop->base = event_base_new();
+    if (!loop->base) {
+        LogPrintf("Couldn't create an event_base: exiting\n");
+        return nullptr;
+    }
+
+    /* Create a new evhttp object to handle requests. */
+    loop->http = evhttp_new(loop->base);
+    if (!loop->http) {
+        LogPrintf("couldn't create evhttp. Exiting.\n");
+        return nullptr;
+    }
+
+    evhttp_set_timeout(loop->http, GetArg("-rpcservertimeout", DEFAULT_HTTP_SERVER_TIMEOUT));
+    evhttp_set_max_body_size(loop->http, MAX_SERIALIZED_COMPACT_SIZE);
+    evhttp_set_gencb(loop->http, http_request_cb, loop.get());
+    return loop;
 }
 
+//! Work queue the current thread is a worker of, if any
+static thread_local WorkQueue<HTTPClosure>* currentWorkQueue = nullptr;
+
 /** Simple wrapper to set thread name and run work queue */
 static void HTTPWorkQueueRun(WorkQueue<HTTPClosure>* queue)
 {
     RenameThread("horizen-httpworker");
+    currentWorkQueue = queue;
     queue->Run();
 }
 
+/** Tasks shared by the threads running them in HTTPRunParallel, each one taking the next task not yet started */
+class HTTPParallelTasks
+{
+public:
+    explicit HTTPParallelTasks(const std::vector<boost::function<void()>>& tasks) : tasks(tasks), nTasks(tasks.size()) {}
+
+    void RunPending()
+    {
+        size_t i;
+        // tasks belongs to the caller and is only valid until the last task is done
+        while ((i = nNext++) < nTasks) {
+            tasks[i]();
+            boost::lock_guard<boost::mutex> lock(cs);
+            if (++nDone == nTasks)
+                cond.notify_all();
+        }
+    }
+
+    void WaitDone()
+    {
+        boost::unique_lock<boost::mutex> lock(cs);
+        while (nDone < nTasks)
+            cond.wait(lock);
+    }
+
+private:
+    const std::vector<boost::function<void()>>& tasks;
+    const size_t nTasks;
+    std::atomic<size_t> nNext{0};
+    CWaitableCriticalSection cs;
+    CConditionVariable cond;
+    size_t nDone = 0;
+};
+
+/** Work item helping a HTTPRunParallel call, it may find all the tasks already started */
+class HTTPParallelWorkItem : public HTTPClosure
+{
+public:
+    explicit HTTPParallelWorkItem(const std::shared_ptr<HTTPParallelTasks>& tasks) : tasks(tasks) {}
+    void operator()() { tasks->RunPending(); }
+
+private:
+    std::shared_ptr<HTTPParallelTasks> tasks;
+};
+
+void HTTPRunParallel(const std::vector<boost::function<void()>>& tasks)
+{
+    std::shared_ptr<HTTPParallelTasks> shared = std::make_shared<HTTPParallelTasks>(tasks);
+    if (currentWorkQueue) {
+        for (size_t i = 1; i < tasks.size(); i++) {
+            std::unique_ptr<HTTPParallelWorkItem> item(new HTTPParallelWorkItem(shared));
+            if (!currentWorkQueue->EnqueueIfIdle(item.get()))
+                break;
+            item.release();
+        }
+    }
+    // The calling thread never waits for a task nobody has started: whatever the helpers
+    // did not pick up is run here, and only the ones in progress elsewhere are waited for.
+    shared->RunPending();
+    shared->WaitDone();
+}
+
+/** Parse the -rpcworklane options, <name>:<threads>:<depth>:<class>[,<class>...], into lanes after the default one */
+static bool InitHTTPWorkLanes()
+{
+    int workQueueDepth = std::max((long)GetArg("-rpcworkqueue", DEFAULT_HTTP_WORKQUEUE), 1L);
+    int rpcThreads = std::max((long)GetArg("-rpcthreads", DEFAULT_HTTP_THREADS), 1L);
+    LogPrintf("HTTP: creating work queue of depth %d\n", workQueueDepth);
+    workLanes.emplace_back(new HTTPWorkLane("default", rpcThreads, workQueueDepth));
+
+    BOOST_FOREACH(const std::string& strLane, mapMultiArgs["-rpcworklane"]) {
+        std::vector<std::string> fields;
+        size_t nStart = 0, nSep;
+        while (fields.size() < 3 && (nSep = strLane.find(':', nStart)) != std::string::npos) {
+            fields.push_back(strLane.substr(nStart, nSep - nStart));
+            nStart = nSep + 1;
+        }
+        fields.push_back(strLane.substr(nStart));
+
+        int32_t nThreads = 0, nDepth = 0;
+        if (fields.size() != 4 || fields[0].empty() || fields[0] == workLanes[0]->name ||
+            !ParseInt32(fields[1], &nThreads) || nThreads < 1 ||
+            !ParseInt32(fields[2], &nDepth) || nDepth < 1 || fields[3].empty()) {
+            uiInterface.ThreadSafeMessageBox(
+                strprintf("Invalid -rpcworklane=%s, expected <name>:<threads>:<depth>:<method>[,<method>...]", strLane),
+                "", CClientUIInterface::MSG_ERROR);
+            return false;
+        }
+
+        size_t nLane = workLanes.size();
+        workLanes.emplace_back(new HTTPWorkLane(fields[0], nThreads, nDepth));
+        nStart = 0;
+        do {
+            nSep = fields[3].find(',', nStart);
+            std::string strClass = fields[3].substr(nStart, nSep == std::string::npos ? std::string::npos : nSep - nStart);
+            if (!strClass.empty() && !mapLaneByClass.emplace(strClass, nLane).second) {
+                uiInterface.ThreadSafeMessageBox(
+                    strprintf("Invalid -rpcworklane=%s, %s is already served by another lane", strLane, strClass),
+                    "", CClientUIInterface::MSG_ERROR);
+                return false;
+            }
+            nStart = nSep + 1;
+        } while (nSep != std::string::npos);
+        LogPrintf("HTTP: creating work queue lane %s of depth %d with %d threads for %s\n",
+                  fields[0], nDepth, nThreads, fields[3]);
+    }
+    return true;
+}
+
 /** libevent event log callback */
 static void libevent_log_cb(int severity, const char *msg)
 {
@@ -371,9 +727,6 @@ static void libevent_log_cb(int severity, const char *msg)
 
 bool InitHTTPServer()
 {
-    struct evhttp* http = 0;
-    struct event_base* base = 0;
-
     if (!InitHTTPAllowList())
         return false;
 
@@ -400,53 +753,59 @@ bool InitHTTPServer()
     evthread_use_pthreads();
 #endif
 
-    base = event_base_new(); // XXX RAII
-    if (!base) {
-        LogPrintf("Couldn't create an event_base: exiting\n");
-        return false;
+    nMaxKeepAliveRequests = std::max((int)GetArg("-rpcmaxkeepaliverequests", DEFAULT_HTTP_MAX_KEEPALIVE_REQUESTS), 0);
+    nMaxReplyBuffer = std::max((int64_t)GetArg("-rpcmaxreplybuffer", DEFAULT_HTTP_MAX_REPLY_BUFFER), (int64_t)1) << 20;
+    int nEventThreads = std::max((int)GetArg("-rpceventthreads", DEFAULT_HTTP_EVENT_THREADS), 1);
+#ifdef WIN32
+    if (nEventThreads > 1) {
+        LogPrintf("HTTP: a single event loop is supported on this platform, -rpceventthreads ignored\n");
+        nEventThreads = 1;
     }
+#endif
 
-    /* Create a new evhttp object to handle requests. */
-    http = evhttp_new(base); // XXX RAII
-    if (!http) {
-        LogPrintf("couldn't create evhttp. Exiting.\n");
-        event_base_free(base);
+    std::unique_ptr<HTTPEventLoop> first = NewHTTPEventLoop();
+    if (!first)
         return false;
-    }
-
-    evhttp_set_timeout(http, GetArg("-rpcservertimeout", DEFAULT_HTTP_SERVER_TIMEOUT));
-    evhttp_set_max_body_size(http, MAX_SERIALIZED_COMPACT_SIZE);
-    evhttp_set_gencb(http, http_request_cb, NULL);
-
-    if (!HTTPBindAddresses(http)) {
+    if (!HTTPBindAddresses(*first)) {
         LogPrintf("Unable to bind any endpoint for RPC server\n");
-        evhttp_free(http);
-        event_base_free(base);
         return false;
     }
+    eventLoops.push_back(std::move(first));
+    for (int i = 1; i < nEventThreads; i++) {
+        std::unique_ptr<HTTPEventLoop> loop = NewHTTPEventLoop();
+        if (!loop || !HTTPShareBoundSockets(*eventLoops[0], *loop)) {
+            LogPrintf("Unable to share the RPC endpoints with HTTP event loop %d\n", i);
+            eventLoops.clear();
+            return false;
+        }
+        eventLoops.push_back(std::move(loop));
+    }
 
-    LogPrint("http", "Initialized HTTP server\n");
-    int workQueueDepth = std::max((long)GetArg("-rpcworkqueue", DEFAULT_HTTP_WORKQUEUE), 1L);
-    LogPrintf("HTTP: creating work queue of depth %d\n", workQueueDepth);
+    if (!InitHTTPWorkLanes()) {
+        workLanes.clear();
+        mapLaneByClass.clear();
+        eventLoops.clear();
+        return false;
+    }
 
-    workQueue = new WorkQueue<HTTPClosure>(workQueueDepth);
-    eventBase = base;
-    eventHTTP = http;
+    LogPrint("http", "Initialized HTTP server with %d event loops\n", eventLoops.size());
+    eventBase = eventLoops[0]->base;
+    fHTTPInterrupted = false;
     return true;
 }
 
-boost::thread threadHTTP;
-
 bool StartHTTPServer()
 {
     LogPrint("http", "Starting HTTP server\n");
-    int rpcThreads = std::max((long)GetArg("-rpcthreads", DEFAULT_HTTP_THREADS), 1L);
-    LogPrintf("HTTP: starting %d worker threads\n", rpcThreads);
-    threadHTTP = boost::thread(boost::bind(&ThreadHTTP, eventBase, eventHTTP));
+    for (const std::unique_ptr<HTTPEventLoop>& loop : eventLoops)
+        loop->thread = boost::thread(boost::bind(&ThreadHTTP, loop->base, loop->http));
 
-    for (int i = 0; i < rpcThreads; i++) {
-        boost::thread rpc_worker(HTTPWorkQueueRun, workQueue);
-        rpc_worker.detach();
+    for (const std::unique_ptr<HTTPWorkLane>& lane : workLanes) {
+        LogPrintf("HTTP: starting %d worker threads for lane %s\n", lane->numThreads, lane->name);
+        for (int i = 0; i < lane->numThreads; i++) {
+            boost::thread rpc_worker(HTTPWorkQueueRun, lane->queue.get());
+            rpc_worker.detach();
+        }
     }
     return true;
 }
@@ -454,50 +813,48 @@ bool StartHTTPServer()
 void InterruptHTTPServer()
 {
     LogPrint("http", "Interrupting HTTP server\n");
-    if (eventHTTP) {
+    fHTTPInterrupted = true;
+    for (const std::unique_ptr<HTTPEventLoop>& loop : eventLoops) {
         // Unlisten sockets
-        BOOST_FOREACH (evhttp_bound_socket *socket, boundSockets) {
-            evhttp_del_accept_socket(eventHTTP, socket);
+        BOOST_FOREACH (evhttp_bound_socket *socket, loop->boundSockets) {
+            evhttp_del_accept_socket(loop->http, socket);
         }
+        loop->boundSockets.clear();
         // Reject requests on current connections
-        evhttp_set_gencb(eventHTTP, http_reject_request_cb, NULL);
+        evhttp_set_gencb(loop->http, http_reject_request_cb, NULL);
     }
-    if (workQueue)
-        workQueue->Interrupt();
+    for (const std::unique_ptr<HTTPWorkLane>& lane : workLanes)
+        lane->queue->Interrupt();
 }
 
 void StopHTTPServer()
 {
     LogPrint("http", "Stopping HTTP server\n");
-    if (workQueue) {
+    if (!workLanes.empty()) {
         LogPrint("http", "Waiting for HTTP worker threads to exit\n");
-        workQueue->WaitExit();
-        delete workQueue;
+        for (const std::unique_ptr<HTTPWorkLane>& lane : workLanes)
+            lane->queue->WaitExit();
+        workLanes.clear();
+        mapLaneByClass.clear();
     }
-    if (eventBase) {
+    for (const std::unique_ptr<HTTPEventLoop>& loop : eventLoops) {
         LogPrint("http", "Waiting for HTTP event thread to exit\n");
         // Exit the event loop as soon as there are no active events.
-        event_base_loopexit(eventBase, nullptr);
+        event_base_loopexit(loop->base, nullptr);
         // Give event loop a few seconds to exit (to send back last RPC responses), then break it
         // Before this was solved with event_base_loopexit, but that didn't work as expected in
         // at least libevent 2.0.21 and always introduced a delay. In libevent
         // master that appears to be solved, so in the future that solution
         // could be used again (if desirable).
         // (see discussion in https://github.com/bitcoin/bitcoin/pull/6990)
-        if (!threadHTTP.try_join_for(boost::chrono::milliseconds(2000))) {
+        if (!loop->thread.try_join_for(boost::chrono::milliseconds(2000))) {
             LogPrintf("HTTP event loop did not exit within allotted time, sending loopbreak\n");
-            event_base_loopbreak(eventBase);
-            threadHTTP.join();
+            event_base_loopbreak(loop->base);
+            loop->thread.join();
         }
     }
-    if (eventHTTP) {
-        evhttp_free(eventHTTP);
-        eventHTTP = 0;
-    }
-    if (eventBase) {
-        event_base_free(eventBase);
-        eventBase = 0;
-    }
+    eventLoops.clear();
+    eventBase = 0;
     LogPrint("http", "Stopped HTTP server\n");
 }
 
@@ -532,9 +889,18 @@ void HTTPEvent::trigger(struct timeval* tv)
     else
         evtimer_add(ev, tv); // trigger after timeval passed
 }
-HTTPRequest::HTTPRequest(struct evhttp_request* req) : req(req),
-                                                       replySent(false)
+HTTPRequest::HTTPRequest(struct evhttp_request* req, struct event_base* base) : req(req),
+                                                                                base(base ? base : eventBase),
+                                                                                replySent(false)
+{
+}
+
+void HTTPRequest::SetReplyBuffer(const std::shared_ptr<HTTPReplyBuffer>& buffer,
+                                 void (*flushed)(struct evhttp_connection*, void*), void* flushedArg)
 {
+    replyBuffer = buffer;
+    replyFlushed = flushed;
+    replyFlushedArg = flushedArg;
 }
 HTTPRequest::~HTTPRequest()
 {
@@ -542,6 +908,9 @@ HTTPRequest::~HTTPRequest()
         // Keep track of whether reply was sent to avoid request leaks
         LogPrintf("%s: Unhandled request\n", __func__);
         WriteReply(HTTP_INTERNAL, "Unhandled request");
+    } else if (req) {
+        // a chunked reply that was not ended
+        EndReply();
     }
     // evhttpd cleans up the request, as long as a reply was sent.
 }
@@ -557,6 +926,18 @@ std::pair<bool, std::string> HTTPRequest::GetHeader(const std::string& hdr)
         return std::make_pair(false, "");
 }
 
+std::string HTTPRequest::PeekBody()
+{
+    struct evbuffer* buf = evhttp_request_get_input_buffer(req);
+    if (!buf)
+        return "";
+    size_t size = evbuffer_get_length(buf);
+    std::string rv(size, '\0');
+    if (size > 0 && evbuffer_copyout(buf, &rv[0], size) != (ev_ssize_t)size)
+        return "";
+    return rv;
+}
+
 std::string HTTPRequest::ReadBody()
 {
     struct evbuffer* buf = evhttp_request_get_input_buffer(req);
@@ -596,13 +977,60 @@ void HTTPRequest::WriteReply(int nStatus, const std::string& strReply)
     struct evbuffer* evb = evhttp_request_get_output_buffer(req);
     assert(evb);
     evbuffer_add(evb, strReply.data(), strReply.size());
-    HTTPEvent* ev = new HTTPEvent(eventBase, true,
+    HTTPEvent* ev = new HTTPEvent(base, true,
         boost::bind(evhttp_send_reply, req, nStatus, (const char*)NULL, (struct evbuffer *)NULL));
     ev->trigger(0);
     replySent = true;
     req = 0; // transferred back to main thread
 }
 
+void HTTPRequest::StartReply(int nStatus)
+{
+    assert(!replySent && req);
+    // The events run on the main http thread in the order they are triggered
+    HTTPEvent* ev = new HTTPEvent(base, true,
+        boost::bind(evhttp_send_reply_start, req, nStatus, (const char*)NULL));
+    ev->trigger(0);
+    replySent = true;
+}
+
+void HTTPRequest::WriteReplyChunk(const std::string& strChunk)
+{
+    assert(replySent && req);
+    std::shared_ptr<HTTPReplyBuffer> buffer = replyBuffer;
+    if (buffer) {
+        // A client reading slowly holds back the worker writing the reply, rather than the memory of the node
+        std::unique_lock<std::mutex> lock(buffer->cs);
+        while (!buffer->fClosed && buffer->nPending >= nMaxReplyBuffer && !fHTTPInterrupted)
+            buffer->cond.wait_for(lock, std::chrono::milliseconds(100));
+        if (buffer->fClosed)
+            return;
+        buffer->nPending += strChunk.size();
+    }
+    struct evbuffer* evb = evbuffer_new();
+    assert(evb);
+    evbuffer_add(evb, strChunk.data(), strChunk.size());
+    struct evhttp_request* chunkReq = req;
+    void (*flushed)(struct evhttp_connection*, void*) = replyFlushed;
+    void* flushedArg = replyFlushedArg;
+    HTTPEvent* ev = new HTTPEvent(base, true, [chunkReq, evb, buffer, flushed, flushedArg]() {
+        if (buffer && flushed)
+            evhttp_send_reply_chunk_with_cb(chunkReq, evb, flushed, flushedArg);
+        else
+            evhttp_send_reply_chunk(chunkReq, evb);
+        evbuffer_free(evb);
+    });
+    ev->trigger(0);
+}
+
+void HTTPRequest::EndReply()
+{
+    assert(replySent && req);
+    HTTPEvent* ev = new HTTPEvent(base, true, boost::bind(evhttp_send_reply_end, req));
+    ev->trigger(0);
+    req = 0; // transferred back to main thread
+}
+
 CService HTTPRequest::GetPeer()
 {
     evhttp_connection* con = evhttp_request_get_connection(req);
@@ -643,10 +1071,11 @@ HTTPRequest::RequestMethod HTTPRequest::GetRequestMethod()
     }
 }
 
-void RegisterHTTPHandler(const std::string &prefix, bool exactMatch, const HTTPRequestHandler &handler)
+void RegisterHTTPHandler(const std::string &prefix, bool exactMatch, const HTTPRequestHandler &handler,
+                         const HTTPRequestClassifier &classifier)
 {
     LogPrint("http", "Registering HTTP handler for %s (exactmatch %d)\n", prefix, exactMatch);
-    pathHandlers.push_back(HTTPPathHandler(prefix, exactMatch, handler));
+    pathHandlers.push_back(HTTPPathHandler(prefix, exactMatch, handler, classifier));
 }
 
 void UnregisterHTTPHandler(const std::string &prefix, bool exactMatch)
@@ -663,3 +1092,18 @@ void UnregisterHTTPHandler(const std::string &prefix, bool exactMatch)
     }
 }
 
+std::vector<HTTPWorkQueueStats> GetHTTPWorkQueueStats()
+{
+    std::vector<HTTPWorkQueueStats> vStats;
+    for (const std::unique_ptr<HTTPWorkLane>& lane : workLanes) {
+        HTTPWorkQueueStats stats;
+        stats.name = lane->name;
+        stats.numThreads = lane->numThreads;
+        for (const auto& entry : mapLaneByClass)
+            if (workLanes[entry.second] == lane)
+                stats.classes.push_back(entry.first);
+        lane->queue->GetStats(stats);
+        vStats.push_back(stats);
+    }
+    return vStats;
+}
@@ -5,8 +5,10 @@
 #ifndef BITCOIN_HTTPSERVER_H
 #define BITCOIN_HTTPSERVER_H
 
+#include <memory>
 #include <string>
 #include <stdint.h>
+#include <vector>
 #include <boost/thread.hpp>
 #include <boost/scoped_ptr.hpp>
 #include <boost/function.hpp>
@@ -14,11 +16,18 @@
 static const int DEFAULT_HTTP_THREADS=4;
 static const int DEFAULT_HTTP_WORKQUEUE=16;
 static const int DEFAULT_HTTP_SERVER_TIMEOUT=30;
+static const int DEFAULT_HTTP_EVENT_THREADS=1;
+//! 0 for no limit
+static const int DEFAULT_HTTP_MAX_KEEPALIVE_REQUESTS=0;
+//! in MiB
+static const int DEFAULT_HTTP_MAX_REPLY_BUFFER=16;
 
 struct evhttp_request;
+struct evhttp_connection;
 struct event_base;
 class CService;
 class HTTPRequest;
+struct HTTPReplyBuffer;
 
 /** Initialize HTTP server.
  * Call this before RegisterHTTPHandler or EventBase().
@@ -36,19 +45,56 @@ void StopHTTPServer();
 
 /** Handler for requests to a certain HTTP path */
 typedef boost::function<void(HTTPRequest* req, const std::string &)> HTTPRequestHandler;
+/** Classes of a request to a certain HTTP path, e.g. the methods of a JSON-RPC call.
+ * They select the work queue lane the request is served by, see -rpcworklane.
+ * This runs on the event loop thread, so it must be cheap and must not consume the request body.
+ */
+typedef boost::function<std::vector<std::string>(HTTPRequest* req, const std::string &)> HTTPRequestClassifier;
+
 /** Register handler for prefix.
  * If multiple handlers match a prefix, the first-registered one will
  * be invoked.
+ * Without a classifier, requests are classified by the prefix itself.
  */
-void RegisterHTTPHandler(const std::string &prefix, bool exactMatch, const HTTPRequestHandler &handler);
+void RegisterHTTPHandler(const std::string &prefix, bool exactMatch, const HTTPRequestHandler &handler,
+                         const HTTPRequestClassifier &classifier = HTTPRequestClassifier());
 /** Unregister handler for prefix */
 void UnregisterHTTPHandler(const std::string &prefix, bool exactMatch);
 
 /** Return evhttp event base. This can be used by submodules to
  * queue timers or custom events.
+ * With -rpceventthreads the requests are served by several event bases, this is the first one.
  */
 struct event_base* EventBase();
 
+/** Depth and latency counters of a work queue lane */
+struct HTTPWorkQueueStats
+{
+    std::string name;
+    int numThreads;
+    //! the request classes served, empty for the default lane that serves all the others
+    std::vector<std::string> classes;
+    size_t maxDepth;
+    size_t depth;
+    size_t peakDepth;
+    uint64_t processed;
+    uint64_t rejected;
+    //! time spent by requests waiting in the queue and being served, in microseconds
+    int64_t totalWaitMicros;
+    int64_t maxWaitMicros;
+    int64_t totalRunMicros;
+    int64_t maxRunMicros;
+};
+
+/** Return the counters of all the work queue lanes, the default one first */
+std::vector<HTTPWorkQueueStats> GetHTTPWorkQueueStats();
+
+/** Run the tasks on the calling thread and on the idle worker threads of its work queue lane,
+ * returning once all of them are done. The tasks must not throw.
+ * Off a worker thread, or with no idle worker, they just run one after another on the calling thread.
+ */
+void HTTPRunParallel(const std::vector<boost::function<void()>>& tasks);
+
 /** In-flight HTTP request.
  * Thin C++ wrapper around evhttp_request.
  */
@@ -56,15 +102,26 @@ class HTTPRequest
 {
 private:
     struct evhttp_request* req;
+    //! event loop of the connection of the request, the replies are sent on it
+    struct event_base* base;
+    std::shared_ptr<HTTPReplyBuffer> replyBuffer;
+    void (*replyFlushed)(struct evhttp_connection*, void*) = nullptr;
+    void* replyFlushedArg = nullptr;
 
     // For test access
 protected:
     bool replySent;
 
 public:
-    HTTPRequest(struct evhttp_request* req);
+    HTTPRequest(struct evhttp_request* req, struct event_base* base = nullptr);
     virtual ~HTTPRequest();
 
+    /** Track what a chunked reply has queued on the connection: once past -rpcmaxreplybuffer,
+     * WriteReplyChunk waits for flushed to be called back by the event loop.
+     */
+    void SetReplyBuffer(const std::shared_ptr<HTTPReplyBuffer>& buffer,
+                        void (*flushed)(struct evhttp_connection*, void*), void* flushedArg);
+
     enum RequestMethod {
         UNKNOWN,
         GET,
@@ -99,6 +156,11 @@ public:
      */
     std::string ReadBody();
 
+    /**
+     * Copy the request body, leaving it in place for ReadBody.
+     */
+    std::string PeekBody();
+
     /**
      * Write output header.
      *
@@ -115,6 +177,18 @@ public:
      * main thread, do not call any other HTTPRequest methods after calling this.
      */
     virtual void WriteReply(int nStatus, const std::string& strReply = "");
+
+    /**
+     * Start a chunked HTTP reply, for a large body sent in pieces as it is produced.
+     * The pieces are sent with WriteReplyChunk and the reply is ended with EndReply.
+     *
+     * @note Call this instead of WriteReply, after the headers. If the client goes away the
+     * pieces are dropped, EndReply is still needed to release the request. WriteReplyChunk blocks
+     * while more than -rpcmaxreplybuffer is waiting to be sent to the client.
+     */
+    virtual void StartReply(int nStatus);
+    virtual void WriteReplyChunk(const std::string& strChunk);
+    virtual void EndReply();
 };
 
 /** Event handler closure.
@@ -9,25 +9,39 @@
 
 #include "init.h"
 #include "crypto/common.h"
+#include "crypto/sha256.h"
 #include "addrman.h"
+#include "blockcache.h"
+#include "blockcompression.h"
+#include "blockwriter.h"
+#include "blockfilterindex.h"
+#include "blockencodings.h"
+#include "headerscache.h"
+#include "headerranges.h"
 #include "amount.h"
 #ifdef ENABLE_MINING
 #include "base58.h"
 #endif
 #include "checkpoints.h"
+#include "coinssnapshot.h"
 #include "compat/sanity.h"
 #include "consensus/validation.h"
 #include "httpserver.h"
 #include "httprpc.h"
 #include "key.h"
 #include "main.h"
+#include "mempoolpersist.h"
 #include "metrics.h"
 #include "miner.h"
 #include "net.h"
+#include "notificationdispatcher.h"
 #include "rpc/server.h"
+#include "script/sigcache.h"
 #include "script/standard.h"
+#include "support/hugepages.h"
 #include "scheduler.h"
 #include "txdb.h"
+#include "txtrace.h"
 #include "torcontrol.h"
 #include "ui_interface.h"
 #include "util.h"
@@ -39,12 +53,14 @@
 #endif
 #include <stdint.h>
 #include <stdio.h>
+#include <future>
 #include <thread>
 
 #ifndef WIN32
 #include <signal.h>
 #endif
 
+#include <boost/algorithm/string/join.hpp>
 #include <boost/algorithm/string/predicate.hpp>
 #include <boost/algorithm/string/replace.hpp>
 #include <boost/bind.hpp>
@@ -65,6 +81,8 @@
 #endif
 
 #include "librustzcash.h"
+#include "zcash/JoinSplit.hpp"
+#include "zen/ipcring.h"
 #include "zen/websocket_server.h"
 #include <zen/forks/fork2_replayprotectionfork.h>
 
@@ -188,8 +206,13 @@ void Shutdown()
     StopWsServer();
     StopHTTPRPC();
     StopREST();
+    StopMetrics();
     StopRPC();
     StopHTTPServer();
+    // the wallets get the updates still queued before they are flushed
+    StopValidationInterfaceQueue();
+    if (pblockfilterindex)
+        pblockfilterindex->Stop();
 #ifdef ENABLE_WALLET
     if (pwalletMain)
         pwalletMain->Flush(false);
@@ -203,6 +226,8 @@ void Shutdown()
 #endif
     StopTorControl();
     UnregisterNodeSignals(GetNodeSignals());
+    if (IsMempoolLoaded())
+        DumpMempool(*mempool);
 
     if (fFeeEstimatesInitialized)
     {
@@ -220,10 +245,13 @@ void Shutdown()
         if (pcoinsTip != NULL) {
             FlushStateToDisk();
         }
+        blockFileWriter.Stop();
         delete pcoinsTip;
         pcoinsTip = NULL;
         delete pcoinscatcher;
         pcoinscatcher = NULL;
+        delete pcoinsFlusher;
+        pcoinsFlusher = NULL;
         delete pcoinsdbview;
         pcoinsdbview = NULL;
         delete pblocktree;
@@ -236,7 +264,7 @@ void Shutdown()
 
 #if ENABLE_ZMQ
     if (pzmqNotificationInterface) {
-        UnregisterValidationInterface(pzmqNotificationInterface);
+        UnregisterNotificationSink(pzmqNotificationInterface);
         delete pzmqNotificationInterface;
         pzmqNotificationInterface = NULL;
     }
@@ -244,7 +272,7 @@ void Shutdown()
 
 #if ENABLE_PROTON
     if (pAMQPNotificationInterface) {
-        UnregisterValidationInterface(pAMQPNotificationInterface);
+        UnregisterNotificationSink(pAMQPNotificationInterface);
         delete pAMQPNotificationInterface;
         pAMQPNotificationInterface = NULL;
     }
@@ -267,7 +295,11 @@ void Shutdown()
     globalVerifyHandle.reset();
     ECC_Stop();
     connman.reset();
+    // deleted once the peers it serves filters to are gone
+    delete pblockfilterindex;
+    pblockfilterindex = NULL;
     LogPrintf("%s: done\n", __func__);
+    StopAsyncLogging();
 }
 
 /**
@@ -320,6 +352,7 @@ std::string HelpMessage(HelpMessageMode mode)
     string strUsage = HelpMessageGroup(_("Options:"));
     strUsage += HelpMessageOpt("-?", _("This help message"));
     strUsage += HelpMessageOpt("-alertnotify=<cmd>", _("Execute command when a relevant internal alert is risen or we see a really long fork (%s in cmd is replaced by message)"));
+    strUsage += HelpMessageOpt("-assumevalid=<hex>", _("If this block is in the chain, assume that it and its ancestors are valid and skip the verification of their scripts, JoinSplit and sidechain proofs, once headers show it buried under two weeks of work (default: none)"));
     strUsage += HelpMessageOpt("-blocknotify=<cmd>", _("Execute command when the best block changes (%s in cmd is replaced by block hash)"));
     strUsage += HelpMessageOpt("-checkblocks=<n>", strprintf(_("How many blocks to check at startup (default: %u, 0 = all)"), 288));
     strUsage += HelpMessageOpt("-checklevel=<n>", strprintf(_("How thorough the block verification of -checkblocks is (0-4, default: %u)"), 3));
@@ -335,19 +368,42 @@ std::string HelpMessage(HelpMessageMode mode)
         FormatVersion(CLIENT_VERSION)));
     strUsage += HelpMessageOpt("-enable_mc_crypto_logger", strprintf(_("Enable libzendoo logging to file. It creates a new configuration file in the current datadir, if it does not already exist.")));
     strUsage += HelpMessageOpt("-exportdir=<dir>", _("Specify directory to be used when exporting data"));
+    strUsage += HelpMessageOpt("-blockcachesize=<n>", strprintf(_("Size in megabytes of the cache of recent blocks served to peers and clients, 0 to disable it (default: %u)"), DEFAULT_BLOCK_CACHE_SIZE));
+    strUsage += HelpMessageOpt("-sccachesize=<n>", strprintf(_("Size in megabytes of the sidechains, their events and ceased sidechain withdrawal nullifiers kept in the in-memory coins cache, besides -dbcache (default: %u)"), DEFAULT_SC_CACHE_SIZE));
+    strUsage += HelpMessageOpt("-headerscachesize=<n>", strprintf(_("Size in megabytes of the cache of serialized active chain headers served to peers and clients (default: %u)"), DEFAULT_HEADERS_CACHE_SIZE));
     strUsage += HelpMessageOpt("-dbcache=<n>", strprintf(_("Set database cache size in megabytes (%d to %d, default: %d)"), nMinDbCache, nMaxDbCache, nDefaultDbCache));
     strUsage += HelpMessageOpt("-loadblock=<file>", _("Imports blocks from external blk000??.dat file") + " " + _("on startup"));
+    strUsage += HelpMessageOpt("-loadtxoutset=<file>", _("Imports the chainstate from a txoutset snapshot made by dumptxoutset, when starting with an empty data directory. "
+            "Blocks below the snapshot base are never downloaded, as in prune mode, and the optional indexes are not available"));
+    strUsage += HelpMessageOpt("-loadtxoutsethash=<hash>", _("Only import a txoutset snapshot with the given hash, as returned by dumptxoutset"));
     strUsage += HelpMessageOpt("-maxorphantx=<n>", strprintf(_("Keep at most <n> unconnectable transactions in memory (default: %u)"), DEFAULT_MAX_ORPHAN_TRANSACTIONS));
     strUsage += HelpMessageOpt("-mempooltxinputlimit=<n>", _("Set the maximum number of transparent inputs in a transaction that the mempool will accept (default: 0 = no limit applied)"));
     strUsage += HelpMessageOpt("-maxmempool=<n>", strprintf(_("Keep the transaction memory pool below <n> megabytes (default: %u)"), DEFAULT_MAX_MEMPOOL_SIZE_MB));
+    strUsage += HelpMessageOpt("-persistmempool", strprintf(_("Save the mempool to mempool.dat on shutdown and load it again on the next startup (default: %u)"), DEFAULT_PERSIST_MEMPOOL));
+    strUsage += HelpMessageOpt("-mempooldumpinterval=<n>", strprintf(_("With -persistmempool, also save the mempool every <n> seconds (0 = only on shutdown, default: %d)"), DEFAULT_MEMPOOL_DUMP_INTERVAL));
+    strUsage += HelpMessageOpt("-mempooltrustproofs", strprintf(_("With -persistmempool, do not verify again the proofs of the certificates and transactions loaded "
+            "from mempool.dat whose proofs were verified before they were saved (default: %u)"), DEFAULT_MEMPOOL_TRUST_PROOFS));
+    strUsage += HelpMessageOpt("-blockcompression=<n>", strprintf(_("Write the new block and undo records zstd compressed at level <n> (0 to %d, 0 = raw, default: %d). "
+            "Versions without it cannot read the block files once compressed records are written"), MAX_BLOCK_COMPRESSION_LEVEL, DEFAULT_BLOCK_COMPRESSION_LEVEL));
+    strUsage += HelpMessageOpt("-asyncblockwrites", strprintf(_("Write the block and undo files, and commit them to disk, on a background thread (default: %u)"), DEFAULT_ASYNC_BLOCK_WRITES));
+    strUsage += HelpMessageOpt("-backgroundcoinsflush", strprintf(_("Write the chainstate to disk on a background thread, except on shutdown and pruning (default: %u)"), DEFAULT_BACKGROUND_COINS_FLUSH));
+    strUsage += HelpMessageOpt("-coinsprefetchthreads=<n>", strprintf(_("Set the number of threads reading the coins of a block ahead of connecting it (0 to %d, 0 = disabled, default: %d)"),
+        MAX_COINS_PREFETCH_THREADS, DEFAULT_COINS_PREFETCH_THREADS));
+    strUsage += HelpMessageOpt("-hugepages=<mode>", _("Allocate the coins cache entries and the block index in chunks of 2 MiB backed by huge pages: "
+            "off, transparent (madvise), or explicit (the reserved huge pages, then transparent ones) (default: off)"));
+    strUsage += HelpMessageOpt("-numainterleave", strprintf(_("With -hugepages, interleave these chunks over the NUMA nodes (default: %u)"), DEFAULT_NUMA_INTERLEAVE));
     strUsage += HelpMessageOpt("-par=<n>", strprintf(_("Set the number of script verification threads (%u to %d, 0 = auto, <0 = leave that many cores free, default: %d)"),
         -GetNumCores(), MAX_SCRIPTCHECK_THREADS, DEFAULT_SCRIPTCHECK_THREADS));
 #ifndef WIN32
     strUsage += HelpMessageOpt("-pid=<file>", strprintf(_("Specify pid file (default: %s)"), "zend.pid"));
 #endif
+    strUsage += HelpMessageOpt("-proverthreads=<n>", strprintf(_("Set the number of threads the JoinSplit proofs computed at the same time share, each taking an equal part of them (0 = all the cores, default: %d)"),
+        libzcash::DEFAULT_PROVER_THREADS));
     strUsage += HelpMessageOpt("-prune=<n>", strprintf(_("Reduce storage requirements by pruning (deleting) old blocks. This mode disables wallet support and is incompatible with -txindex. "
             "Warning: Reverting this setting requires re-downloading the entire blockchain. "
             "(default: 0 = disable pruning blocks, >%u = target size in MiB to use for block files)"), MIN_DISK_SPACE_FOR_BLOCK_FILES / 1024 / 1024));
+    strUsage += HelpMessageOpt("-blocksarchivedir=<dir>", _("With -prune, move the old block files to <dir> instead of deleting them. Their blocks keep being served, "
+            "which makes pruning compatible with -txindex and the wallet"));
     strUsage += HelpMessageOpt("-reindex", _("Rebuild block chain index from current blk000??.dat files on startup"));
     strUsage += HelpMessageOpt("-reindexfast", _("Rebuild block chain index from current blk000??.dat files on startup, skipping expensive checks for blocks below checkpoints. It is incompatible with reindex"));
     #if !defined(WIN32)
@@ -359,28 +415,50 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-addressindex", strprintf(_("Maintain a full address index, used to query for the balance, txids and unspent outputs for addresses (default: %u)"), DEFAULT_ADDRESSINDEX));
     strUsage += HelpMessageOpt("-timestampindex", strprintf(_("Maintain a timestamp index for block hashes, used to query blocks hashes by a range of timestamps (default: %u)"), DEFAULT_TIMESTAMPINDEX));
     strUsage += HelpMessageOpt("-spentindex", strprintf(_("Maintain a full spent index, used to query the spending txid and input index for an outpoint (default: %u)"), DEFAULT_SPENTINDEX));
+    strUsage += HelpMessageOpt("-blockfilterindex", strprintf(_("Maintain an index of compact block filters, served to light clients and sidechain nodes by the getblockfilter rpc call, the REST interface and with -peerblockfilters to peers (default: %u)"), DEFAULT_BLOCKFILTERINDEX));
+    strUsage += HelpMessageOpt("-asyncindexes", strprintf(_("Write the optional indexes on a background thread, while the next blocks are connected (default: %u)"), DEFAULT_ASYNC_INDEXES));
+    strUsage += HelpMessageOpt("-indexwriterqueue=<n>", strprintf(_("Set the number of connected blocks whose indexes may wait to be written (default: %u)"), DEFAULT_INDEX_WRITER_QUEUE));
 
     strUsage += HelpMessageOpt("-blocktreedbmaxopenfiles", strprintf(_("Maximum number of open files for the Block Tree LevelDB (default: %u)"), DEFAULT_DB_MAX_OPEN_FILES));
+    strUsage += HelpMessageOpt("-coinsdbfilter", strprintf(_("Keep an in-memory filter of the chainstate entries, so that lookups of missing coins skip the database (default: %u)"), DEFAULT_COINSDB_FILTER));
     strUsage += HelpMessageOpt("-coinsviewdbmaxopenfiles", strprintf(_("Maximum number of open files for the Coins View LevelDB (default: %u)"), DEFAULT_DB_MAX_OPEN_FILES));
+    strUsage += HelpMessageOpt("-<db>engine=<name>", strprintf(_("Storage engine of a database, where <db> is blocktreedb, coinsviewdb or blockfilterdb (%s, default: %s)"),
+        boost::algorithm::join(GetDBEngines(), ", "), DEFAULT_DB_ENGINE));
+    strUsage += HelpMessageOpt("-<db>blockcache=<n>", _("Size in megabytes of the block cache of a LevelDB, where <db> is blocktreedb, coinsviewdb or blockfilterdb (default: half of its share of -dbcache)"));
+    strUsage += HelpMessageOpt("-<db>writebuffer=<n>", _("Size in megabytes of each of the two write buffers of a LevelDB (default: a quarter of its share of -dbcache)"));
+    strUsage += HelpMessageOpt("-<db>compression", _("Compress the table blocks of a LevelDB with Snappy, when LevelDB is built with it (default: 0)"));
+    strUsage += HelpMessageOpt("-<db>bloombits=<n>", _("Bits per key of the bloom filters of a LevelDB, 0 to disable them (default: 10)"));
+    strUsage += HelpMessageOpt("-<db>blocksize=<n>", _("Size in kilobytes of the table blocks of a LevelDB (default: 4)"));
 
     strUsage += HelpMessageGroup(_("Connection options:"));
     strUsage += HelpMessageOpt("-addnode=<ip>", _("Add a node to connect to and attempt to keep the connection open"));
     strUsage += HelpMessageOpt("-banscore=<n>", strprintf(_("Threshold for disconnecting misbehaving peers (default: %u)"), 100));
     strUsage += HelpMessageOpt("-bantime=<n>", strprintf(_("Number of seconds to keep misbehaving peers from reconnecting (default: %u)"), 86400));
     strUsage += HelpMessageOpt("-bind=<addr>", _("Bind to given address and always listen on it. Use [host]:port notation for IPv6"));
+    strUsage += HelpMessageOpt("-certannounce", strprintf(_("Announce certificates with their sidechain, epoch and quality, so that peers only fetch the best ones (default: %u)"), DEFAULT_CERT_ANNOUNCE));
+    strUsage += HelpMessageOpt("-compactblocks", strprintf(_("Relay blocks near the tip as compact blocks, rebuilt from the mempool (default: %u)"), DEFAULT_COMPACT_BLOCKS));
+    strUsage += HelpMessageOpt("-compressrelay", strprintf(_("Send and receive the requested blocks zstd compressed with the whitelisted peers which also set it (default: %u)"), DEFAULT_COMPRESS_RELAY));
     strUsage += HelpMessageOpt("-connect=<ip>", _("Connect only to the specified node(s)"));
     strUsage += HelpMessageOpt("-discover", _("Discover own IP addresses (default: 1 when listening and no -externalip or -proxy)"));
     strUsage += HelpMessageOpt("-dns", _("Allow DNS lookups for -addnode, -seednode and -connect") + " " + _("(default: 1)"));
     strUsage += HelpMessageOpt("-dnsseed", _("Query for peer addresses via DNS lookup, if low on addresses (default: 1 unless -connect)"));
     strUsage += HelpMessageOpt("-externalip=<ip>", _("Specify your own public address"));
+    strUsage += HelpMessageOpt("-fastblockrelay", strprintf(_("Push the blocks extending the tip as compact blocks to the whitelisted peers which also set it, once their header and merkle root are checked and before their full validation (default: %u)"), DEFAULT_FAST_BLOCK_RELAY));
     strUsage += HelpMessageOpt("-forcednsseed", strprintf(_("Always query for peer addresses via DNS lookup (default: %u)"), 0));
     strUsage += HelpMessageOpt("-listen", _("Accept connections from outside (default: 1 if no -proxy or -connect)"));
     strUsage += HelpMessageOpt("-listenonion", strprintf(_("Automatically create Tor hidden service (default: %d)"), DEFAULT_LISTEN_ONION));
     strUsage += HelpMessageOpt("-maxconnections=<n>", strprintf(_("Maintain at most <n> connections to peers (default: %u)"), DEFAULT_MAX_PEER_CONNECTIONS));
+    strUsage += HelpMessageOpt("-socketevents=<mode>", strprintf(_("Socket events mode, one of: %s (default: %s). select limits the connections to %u"),
+        boost::algorithm::join(GetSocketEventsModes(), ", "), GetSocketEventsModes().front(), FD_SETSIZE));
     strUsage += HelpMessageOpt("-maxreceivebuffer=<n>", strprintf(_("Maximum per-connection receive buffer, <n>*1000 bytes (default: %u)"), DEFAULT_MAX_RECEIVE_BUFFER));
     strUsage += HelpMessageOpt("-maxsendbuffer=<n>", strprintf(_("Maximum per-connection send buffer, <n>*1000 bytes (default: %u)"), DEFAULT_MAX_SEND_BUFFER));
+    strUsage += HelpMessageOpt("-msghandlerthreads=<n>", strprintf(_("Number of threads processing the messages of peers, each peer being served by a single thread (1 to %d, default: %d)"),
+        MAX_MSG_HANDLER_THREADS, DEFAULT_MSG_HANDLER_THREADS));
     strUsage += HelpMessageOpt("-onion=<ip:port>", strprintf(_("Use separate SOCKS5 proxy to reach peers via Tor hidden services (default: %s)"), "-proxy"));
     strUsage += HelpMessageOpt("-onlynet=<net>", _("Only connect to nodes in network <net> (ipv4, ipv6 or onion)"));
+    strUsage += HelpMessageOpt("-parallelheaders=<n>", strprintf(_("Fetch the headers between the checkpoints from up to <n> peers at once, 0 to fetch them in order from one (0 to %d, default: %d)"),
+        MAX_PARALLEL_HEADERS, DEFAULT_PARALLEL_HEADERS));
+    strUsage += HelpMessageOpt("-peerblockfilters", strprintf(_("Serve the compact block filters to peers, it requires -blockfilterindex (default: %u)"), DEFAULT_PEERBLOCKFILTERS));
     strUsage += HelpMessageOpt("-permitbaremultisig", strprintf(_("Relay non-P2SH multisig (default: %u)"), 1));
     strUsage += HelpMessageOpt("-port=<port>", strprintf(_("Listen for connections on <port> (default: %u or testnet: %u)"), 9033, 19033));
     strUsage += HelpMessageOpt("-proxy=<ip:port>", _("Connect through SOCKS5 proxy"));
@@ -390,6 +468,8 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-torcontrol=<ip>:<port>", strprintf(_("Tor control port to use if onion listening enabled (default: %s)"), DEFAULT_TOR_CONTROL));
     strUsage += HelpMessageOpt("-torpassword=<pass>", _("Tor control port password (default: empty)"));
     strUsage += HelpMessageOpt("-tlsfallbacknontls=<0 or 1>", _("If a TLS connection fails, the next connection attempt of the same peer (based on IP address) takes place without TLS (default: 1)"));
+    strUsage += HelpMessageOpt("-tlshandshakethreads=<n>", strprintf(_("Number of threads doing the TLS handshakes of the inbound connections (1 to %d, default: %d)"),
+        MAX_TLS_HANDSHAKE_THREADS, DEFAULT_TLS_HANDSHAKE_THREADS));
     strUsage += HelpMessageOpt("-tlsvalidate=<0 or 1>", _("Connect to peers only with valid certificates (default: 0)"));
     strUsage += HelpMessageOpt("-tlskeypath=<path>", _("Full path to a private key"));
     strUsage += HelpMessageOpt("-tlskeypwd=<password>", _("Password for a private key encryption (default: not set, i.e. private key will be stored unencrypted)"));
@@ -398,6 +478,11 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-websocket=<0 or 1>", _("If set to 1 opens a websocket channel listening for client connections (default: 0)"));
     strUsage += HelpMessageOpt("-wsaddress=<ip address>", _("If websocket=1, listen for ws connections at this ip address (default: 127.0.0.1)"));
     strUsage += HelpMessageOpt("-wsport=<port>", _("If websocket=1, listen for ws connections at <wsaddress>:<wsport> (default: 8888)"));
+    strUsage += HelpMessageOpt("-wsipcdir=<dir>", _("If websocket=1, also serve the clients of this host through the unix socket <dir>/ws.sock, "
+        "and publish the new tips, their headers and blocks to the memory mapped ring <dir>/ws.ring"));
+    strUsage += HelpMessageOpt("-wsipcringsize=<n>", strprintf(_("Size of the ring of -wsipcdir in MiB (default: %u)"), DEFAULT_IPC_RING_SIZE));
+    strUsage += HelpMessageOpt("-notificationqueuesize=<n>", strprintf(_("Keep at most <n> notifications waiting for each of the websocket, ZeroMQ and AMQP publishers, "
+        "dropping transactions first when a publisher lags behind (default: %u)"), DEFAULT_NOTIFICATION_QUEUE_SIZE));
 #ifdef USE_UPNP
 #if USE_UPNP
     strUsage += HelpMessageOpt("-upnp", _("Use UPnP to map the listening port (default: 1 when listening and no -proxy)"));
@@ -412,7 +497,13 @@ std::string HelpMessage(HelpMessageMode mode)
 #ifdef ENABLE_WALLET
     strUsage += HelpMessageGroup(_("Wallet options:"));
     strUsage += HelpMessageOpt("-disablewallet", _("Do not load the wallet and disable wallet RPC calls"));
-    strUsage += HelpMessageOpt("-keypool=<n>", strprintf(_("Set key pool size to <n> (default: %u)"), 100));
+    strUsage += HelpMessageOpt("-certfeepool=<n>", strprintf(_("Keep <n> coins split and locked to fund the fees of the certificates sent with sc_send_certificate "
+        "without a fromAddress, refilled in the background (default: %u)"), DEFAULT_CERT_FEE_POOL_SIZE));
+    strUsage += HelpMessageOpt("-certfeepoolvalue=<amt>", strprintf(_("Value (in %s) of each coin of -certfeepool (default: %s)"),
+        CURRENCY_UNIT, FormatMoney(DEFAULT_CERT_FEE_POOL_COIN_VALUE)));
+    strUsage += HelpMessageOpt("-keypool=<n>", strprintf(_("Set key pool size to <n> (default: %u)"), DEFAULT_KEYPOOL_SIZE));
+    strUsage += HelpMessageOpt("-keypoolmin=<n>", _("Top the key pool up in the background once fewer than <n> keys are left in it while the wallet is unlocked, "
+        "0 to top it up as the keys are drawn (default: half of -keypool)"));
     if (showDebug)
         strUsage += HelpMessageOpt("-mintxfee=<amt>", strprintf("Fees (in %s/kB) smaller than this are considered zero fee for transaction creation (default: %s)",
             CURRENCY_UNIT, FormatMoney(CWallet::minTxFee.GetFeePerK())));
@@ -452,6 +543,9 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageGroup(_("Debugging/Testing options:"));
     if (showDebug)
     {
+        strUsage += HelpMessageOpt("-checkblockindexfull=<n>", strprintf("With -checkblockindex, check the whole block index every <n> checks, the others only check the entries changed since the previous one (default: %u, 1 to always check it whole)", DEFAULT_CHECKBLOCKINDEX_FULL_INTERVAL));
+        strUsage += HelpMessageOpt("-checkblocktemplate", strprintf("Run the full TestBlockValidity on the block templates, connecting them on a view of their own, "
+            "rather than only the checks their assembly does not cover (default: %u)", DEFAULT_CHECK_BLOCK_TEMPLATE));
         strUsage += HelpMessageOpt("-checkpoints", strprintf("Disable expensive verification for known chain history (default: %u)", 1));
         strUsage += HelpMessageOpt("-dblogsize=<n>", strprintf("Flush database activity from memory pool to disk log every <n> megabytes (default: %u)", 100));
         strUsage += HelpMessageOpt("-disablesafemode", strprintf("Disable safemode, override a real safe mode event (default: %u)", 0));
@@ -467,14 +561,18 @@ std::string HelpMessage(HelpMessageMode mode)
         _("If <category> is not supplied or if <category> = 1, output all debugging information.") + " " + _("<category> can be:") + " " + debugCategories + ".");
     strUsage += HelpMessageOpt("-experimentalfeatures", _("Enable use of experimental features"));
     strUsage += HelpMessageOpt("-help-debug", _("Show all debugging options (usage: --help -help-debug)"));
+    strUsage += HelpMessageOpt("-logasync", strprintf(_("Write debug.log on a thread of its own, dropping the lines logged while its buffer of %u lines is full (default: %u)"), LOG_BUFFER_LINES, DEFAULT_LOGASYNC));
     strUsage += HelpMessageOpt("-logips", strprintf(_("Include IP addresses in debug output (default: %u)"), 0));
     strUsage += HelpMessageOpt("-logtimestamps", strprintf(_("Prepend debug output with timestamp (default: %u)"), 1));
     strUsage += HelpMessageOpt("-logtimemicros", strprintf(_("Meaningful if -logtimestamps=1. In debug output timestamp reports microseconds (default: %u)"), 0));
+    strUsage += HelpMessageOpt("-lockstats", strprintf(_("Gather the wait and hold times of each lock site, returned by getlockstats (default: %u)"), 0));
     if (showDebug)
     {
         strUsage += HelpMessageOpt("-limitfreerelay=<n>", strprintf("Continuously rate-limit free transactions to <n>*1000 bytes per minute (default: %u)", 15));
         strUsage += HelpMessageOpt("-relaypriority", strprintf("Require high priority for relaying free or low-fee transactions (default: %u)", 0));
-        strUsage += HelpMessageOpt("-maxsigcachesize=<n>", strprintf("Limit size of signature cache to <n> entries (default: %u)", 50000));
+        strUsage += HelpMessageOpt("-maxsigcachesize=<n>", strprintf("Limit sum of signature cache and script execution cache sizes to <n> MiB (default: %u)", DEFAULT_MAX_SIG_CACHE_SIZE));
+        strUsage += HelpMessageOpt("-maxscproofcachesize=<n>", strprintf("Limit size of the verified sc proof cache to <n> entries (default: %u)", CVerifiedProofCache::DEFAULT_MAX_SIZE));
+        strUsage += HelpMessageOpt("-maxscvkcachesize=<n>", strprintf("Limit size of the deserialized sc verification key cache to <n> entries (default: %u)", CScVKeyCache::DEFAULT_MAX_SIZE));
     }
     strUsage += HelpMessageOpt("-minrelaytxfee=<amt>", strprintf(_("Fees (in %s/kB) smaller than this are considered zero fee for relaying (default: %s)"),
         CURRENCY_UNIT, FormatMoney(::minRelayTxFee.GetFeePerK())));
@@ -509,6 +607,8 @@ std::string HelpMessage(HelpMessageMode mode)
         ), DEFAULT_BLOCK_MAX_COMPLEXITY_SIZE)
     );
     strUsage += HelpMessageOpt("-deprecatedgetblocktemplate", (_("Disable block complexity calculation and use the previous GetBlockTemplate implementation")));
+    strUsage += HelpMessageOpt("-blocktemplatefeedelta=<amt>", strprintf(_("Fees (in %s) newly added to the mempool after which getblocktemplate long poll requests are answered with a new template, "
+        "instead of waiting for the current one to be a minute old (default: %s)"), CURRENCY_UNIT, FormatMoney(DEFAULT_BLOCK_TEMPLATE_FEE_DELTA)));
 
     strUsage += HelpMessageOpt("-scproofverificationdelay=<time>",
         strprintf(_("The maximum delay in milliseconds between sc proof batch verification requests. (default: %d)"), CScAsyncProofVerifier::BATCH_VERIFICATION_MAX_DELAY));
@@ -516,6 +616,27 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-scproofqueuesize=<size>",
         strprintf(_("The threshold size of the sc proof queue that triggers a call to the batch verification. (default: %d)"), CScAsyncProofVerifier::BATCH_VERIFICATION_MAX_SIZE));
 
+    strUsage += HelpMessageOpt("-scproofadaptivebatching",
+        _("Adapt the sc proof batch verification delay and queue size to the observed load, using -scproofverificationdelay and -scproofqueuesize as upper bounds (default: 1, 0 on regtest)"));
+
+    strUsage += HelpMessageOpt("-scproofmaxsubbatches=<n>",
+        _("The maximum number of sc proof sub-batches verified concurrently when adaptive batching is enabled (default: half of the cores, at most 4)"));
+
+    strUsage += HelpMessageOpt("-scproofmaxpendingperpeer=<n>",
+        strprintf(_("The maximum number of sc proofs of a peer waiting for the verification, the certificates and transactions beyond it are dropped (default: %d)"), CScAsyncProofVerifier::MAX_PENDING_PROOFS_PER_PEER));
+
+    strUsage += HelpMessageOpt("-scproofverifierthreads=<n>",
+        _("The number of threads of the pool verifying the sc proofs (default: 0, one per core)"));
+
+    strUsage += HelpMessageOpt("-scproofverifiercpus=<cpus>",
+        _("Pin the threads verifying the sc proofs of the mempool to these cpus, as 0-3,6 (default: none)"));
+
+    strUsage += HelpMessageOpt("-scproofverifierblockcpus=<cpus>",
+        _("Pin the threads verifying the sc proofs of the blocks to these cpus, as 0-3,6 (default: none)"));
+
+    strUsage += HelpMessageOpt("-scproofverifierlowpriority",
+        _("Run the threads verifying the sc proofs of the mempool below the normal scheduling priority (default: 0)"));
+
     strUsage += HelpMessageOpt("-cbhsafedepth=<n>",
         "regtest only - Set safe depth for skipping checkblockatheight in txout scripts (default depends on regtest/testnet params)");
         
@@ -550,7 +671,9 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-gen", strprintf(_("Generate coins (default: %u)"), 0));
     strUsage += HelpMessageOpt("-genproclimit=<n>", strprintf(_("Set the number of threads for coin generation if enabled (-1 = all cores, default: %d)"), 1));
     strUsage += HelpMessageOpt("-equihashsolver=<name>", _("Specify the Equihash solver to be used if enabled (default: \"default\")"));
+    strUsage += HelpMessageOpt("-minerhugepages", strprintf(_("Back the Equihash solver memory of each coin generation thread with transparent huge pages, where supported (default: %u)"), DEFAULT_MINER_HUGE_PAGES));
     strUsage += HelpMessageOpt("-mineraddress=<addr>", _("Send mined coins to a specific single address"));
+    strUsage += HelpMessageOpt("-minerpinthreads", strprintf(_("Pin each coin generation thread to its own cpu, spreading the threads over the NUMA nodes (default: %u)"), DEFAULT_MINER_PIN_THREADS));
     strUsage += HelpMessageOpt("-minetolocalwallet", strprintf(
             _("Require that mined blocks use a coinbase address in the local wallet (default: %u)"),
  #ifdef ENABLE_WALLET
@@ -564,6 +687,9 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageGroup(_("RPC server options:"));
     strUsage += HelpMessageOpt("-server", _("Accept command line and JSON-RPC commands"));
     strUsage += HelpMessageOpt("-rest", strprintf(_("Accept public REST requests (default: %u)"), 0));
+    strUsage += HelpMessageOpt("-metrics", strprintf(_("Serve the block validation statistics in the Prometheus text format at /metrics, without authentication (default: %u)"), 0));
+    strUsage += HelpMessageOpt("-txtracesize=<n>", strprintf(_("Keep the latency traces, from their receipt to their inclusion in a block template, of the last <n> transactions "
+        "and certificates received from peers, as returned by gettxtrace, 0 to disable the tracing (default: %u)"), DEFAULT_TX_TRACE_SIZE));
     strUsage += HelpMessageOpt("-rpcbind=<addr>", _("Bind to given address to listen for JSON-RPC connections. Use [host]:port notation for IPv6. This option can be specified multiple times (default: bind to all interfaces)"));
     strUsage += HelpMessageOpt("-rpcuser=<user>", _("Username for JSON-RPC connections"));
     strUsage += HelpMessageOpt("-rpcpassword=<pw>", _("Password for JSON-RPC connections"));
@@ -572,11 +698,17 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-rpcthreads=<n>", strprintf(_("Set the number of threads to service RPC calls (default: %d)"), DEFAULT_HTTP_THREADS));
     if (showDebug) {
         strUsage += HelpMessageOpt("-rpcworkqueue=<n>", strprintf("Set the depth of the work queue to service RPC calls (default: %d)", DEFAULT_HTTP_WORKQUEUE));
+        strUsage += HelpMessageOpt("-rpcworklane=<name>:<threads>:<depth>:<methods>", "Serve the comma separated RPC methods (or REST prefixes, e.g. /rest/block/) "
+            "on their own work queue, with the given number of threads and depth. A batch goes to a lane only if all of its methods do. This option can be specified multiple times");
         strUsage += HelpMessageOpt("-rpcservertimeout=<n>", strprintf("Timeout during HTTP requests (default: %d)", DEFAULT_HTTP_SERVER_TIMEOUT));
+        strUsage += HelpMessageOpt("-rpceventthreads=<n>", strprintf("Set the number of event loops accepting the RPC connections and sending the replies (default: %d)", DEFAULT_HTTP_EVENT_THREADS));
+        strUsage += HelpMessageOpt("-rpcmaxkeepaliverequests=<n>", strprintf("Close an RPC connection after serving <n> requests on it, 0 for no limit (default: %d)", DEFAULT_HTTP_MAX_KEEPALIVE_REQUESTS));
+        strUsage += HelpMessageOpt("-rpcmaxreplybuffer=<n>", strprintf("Maximum MiB of a streamed reply waiting to be sent to an RPC client before the reply is held back (default: %d)", DEFAULT_HTTP_MAX_REPLY_BUFFER));
     }
 
-    // Disabled until we can lock notes and also tune performance of libsnark which by default uses multiple threads
-    //strUsage += HelpMessageOpt("-rpcasyncthreads=<n>", strprintf(_("Set the number of threads to service Async RPC calls (default: %d)"), 1));
+    // Operations running at the same time may select the same inputs, as notes and utxos are not locked
+    strUsage += HelpMessageOpt("-rpcasyncthreads=<n>", strprintf(_("Set the maximum number of threads to service Async RPC calls, spawned while operations are waiting (%d to %d, default: %d)"),
+        1, MAX_RPC_ASYNC_THREADS, DEFAULT_RPC_ASYNC_THREADS));
 
     if (mode == HMM_BITCOIND) {
         strUsage += HelpMessageGroup(_("Metrics Options (only if -daemon and -printtoconsole are not set):"));
@@ -736,6 +868,9 @@ void ThreadImport(std::vector<boost::filesystem::path> vImportFiles)
         }
     }
 
+    if (GetBoolArg("-persistmempool", DEFAULT_PERSIST_MEMPOOL))
+        LoadMempool(*mempool, GetBoolArg("-mempooltrustproofs", DEFAULT_MEMPOOL_TRUST_PROOFS));
+
     if (GetBoolArg("-stopafterblockimport", false)) {
         LogPrintf("Stopping after block import\n");
         StartShutdown();
@@ -835,6 +970,28 @@ static void ZC_LoadParams()
     LogPrintf("Loaded Sapling parameters in %fs seconds.\n", elapsed);
 }
 
+//! The zk parameters loaded in the background, alongside the block index
+static std::future<void> zcParamsLoaded;
+static std::future<bool> dlogKeysLoaded;
+
+/**
+ * Waits for the zk parameters loaded in the background, to be called before anything can verify a proof.
+ * The sprout proving key is never loaded here: it is streamed from its file by each JoinSplit proof.
+ */
+static bool WaitForZKParams()
+{
+    if (zcParamsLoaded.valid()) {
+        try {
+            zcParamsLoaded.get();
+        } catch (const std::exception& e) {
+            return InitError(strprintf(_("Cannot load the Horizen network parameters: %s"), e.what()));
+        }
+    }
+    if (dlogKeysLoaded.valid() && !dlogKeysLoaded.get())
+        return InitError(strprintf(_("Cannot initialize DLog keys in sidechains folder.")));
+    return true;
+}
+
 bool AppInitServers()
 {
     RPCServer::OnStopped(&OnRPCStopped);
@@ -847,6 +1004,8 @@ bool AppInitServers()
         return false;
     if (GetBoolArg("-rest", false) && !StartREST())
         return false;
+    if (GetBoolArg("-metrics", false) && !StartMetrics())
+        return false;
     if (!StartHTTPServer())
         return false;
     if (GetBoolArg("-websocket", false) && !StartWsServer())
@@ -945,6 +1104,7 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
     fLogTimestamps = GetBoolArg("-logtimestamps", true);
     fLogTimeMicros = GetBoolArg("-logtimemicros", false);
     fLogIPs = GetBoolArg("-logips", false);
+    fLockStats = GetBoolArg("-lockstats", false);
 
     // when specifying an explicit binding address, you want to listen on it
     // even when -connect or -proxy is specified
@@ -1000,19 +1160,37 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
             LogPrintf("%s: parameter interaction: -zapwallettxes=<mode> -> setting -rescan=1\n", __func__);
     }
 
+    const std::vector<std::string> vSocketEventsModes = GetSocketEventsModes();
+    const std::string strSocketEventsMode = GetArg("-socketevents", vSocketEventsModes.front());
+    if (std::find(vSocketEventsModes.begin(), vSocketEventsModes.end(), strSocketEventsMode) == vSocketEventsModes.end())
+        return InitError(strprintf(_("Unsupported -socketevents mode '%s'"), strSocketEventsMode));
+
     // Make sure enough file descriptors are available
     int nBind = std::max((int)mapArgs.count("-bind") + (int)mapArgs.count("-whitebind"), 1);
     nMaxConnections = GetArg("-maxconnections", DEFAULT_MAX_PEER_CONNECTIONS);
-    nMaxConnections = std::max(std::min(nMaxConnections, (int)(FD_SETSIZE - nBind - MIN_CORE_FILEDESCRIPTORS)), 0);
+    // only select() cannot handle sockets beyond FD_SETSIZE
+    if (strSocketEventsMode == "select")
+        nMaxConnections = std::min(nMaxConnections, (int)(FD_SETSIZE - nBind - MIN_CORE_FILEDESCRIPTORS));
+    nMaxConnections = std::max(nMaxConnections, 0);
     int nFD = RaiseFileDescriptorLimit(nMaxConnections + MIN_CORE_FILEDESCRIPTORS);
     if (nFD < MIN_CORE_FILEDESCRIPTORS)
         return InitError(_("Not enough file descriptors available."));
     if (nFD - MIN_CORE_FILEDESCRIPTORS < nMaxConnections)
         nMaxConnections = nFD - MIN_CORE_FILEDESCRIPTORS;
 
+    if (GetBoolArg("-compactblocks", DEFAULT_COMPACT_BLOCKS))
+        nLocalServices |= NODE_COMPACT_BLOCKS;
+    if (GetBoolArg("-certannounce", DEFAULT_CERT_ANNOUNCE))
+        nLocalServices |= NODE_CERT_ANNOUNCE;
+    if (GetBoolArg("-peerblockfilters", DEFAULT_PEERBLOCKFILTERS)) {
+        if (!GetBoolArg("-blockfilterindex", DEFAULT_BLOCKFILTERINDEX))
+            return InitError(_("-peerblockfilters requires -blockfilterindex."));
+        nLocalServices |= NODE_COMPACT_FILTERS;
+    }
+
     // if using block pruning, then disable txindex
     // also disable the wallet (for now, until SPV support is implemented in wallet)
-    if (GetArg("-prune", 0)) {
+    if (GetArg("-prune", 0) && !mapArgs.count("-blocksarchivedir")) {
         if (GetBoolArg("-txindex", DEFAULT_TXINDEX))
             return InitError(_("Prune mode is incompatible with -txindex."));
 #ifdef ENABLE_WALLET
@@ -1095,6 +1273,15 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
             return InitError(strprintf(_("Invalid amount for -minrelaytxfee=<amount>: '%s'"), mapArgs["-minrelaytxfee"]));
     }
 
+    if (mapArgs.count("-blocktemplatefeedelta"))
+    {
+        CAmount n = 0;
+        if (ParseMoney(mapArgs["-blocktemplatefeedelta"], n) && n >= 0)
+            nBlockTemplateFeeDelta = n;
+        else
+            return InitError(strprintf(_("Invalid amount for -blocktemplatefeedelta=<amount>: '%s'"), mapArgs["-blocktemplatefeedelta"]));
+    }
+
     // -mempoollimit limits
     int64_t nMempoolSizeLimit = GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE_MB) * 1000000;
     if (nMempoolSizeLimit < 4 * 1000000) {
@@ -1105,8 +1292,21 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
     // Checkmempool and checkblockindex default to true in regtest mode
     mempool->setSanityCheck(GetBoolArg("-checkmempool", chainparams.DefaultConsistencyChecks()));
     fCheckBlockIndex = GetBoolArg("-checkblockindex", chainparams.DefaultConsistencyChecks());
+    nCheckBlockIndexFullInterval = std::max<int64_t>(1, GetArg("-checkblockindexfull", DEFAULT_CHECKBLOCKINDEX_FULL_INTERVAL));
     fCheckpointsEnabled = GetBoolArg("-checkpoints", true);
 
+    hashAssumeValid = uint256S(GetArg("-assumevalid", ""));
+    if (!hashAssumeValid.IsNull())
+        LogPrintf("Assuming the ancestors of block %s have valid scripts and proofs\n", hashAssumeValid.GetHex());
+
+    HugePageMode hugePageMode = DEFAULT_HUGE_PAGE_MODE;
+    if (!ParseHugePageMode(GetArg("-hugepages", "off"), hugePageMode))
+        return InitError(strprintf(_("Unknown -hugepages mode: '%s'"), GetArg("-hugepages", "")));
+    if (!SetHugePageMode(hugePageMode, GetBoolArg("-numainterleave", DEFAULT_NUMA_INTERLEAVE)))
+        InitWarning(_("Warning: Huge pages are not supported on this platform, -hugepages is ignored"));
+    else if (hugePageMode != HugePageMode::OFF)
+        LogPrintf("Allocating the coins cache and the block index in huge pages (-hugepages=%s)\n", GetArg("-hugepages", ""));
+
     // -par=0 means autodetect, but nScriptCheckThreads==0 means no concurrency
     nScriptCheckThreads = GetArg("-par", DEFAULT_SCRIPTCHECK_THREADS);
     if (nScriptCheckThreads <= 0)
@@ -1116,6 +1316,32 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
     else if (nScriptCheckThreads > MAX_SCRIPTCHECK_THREADS)
         nScriptCheckThreads = MAX_SCRIPTCHECK_THREADS;
 
+    nParallelHeaders = static_cast<int>(GetArgWithinLimits("-parallelheaders", DEFAULT_PARALLEL_HEADERS, {0, MAX_PARALLEL_HEADERS}));
+
+    for (const std::string& strDB : {"blocktreedb", "coinsviewdb", "blockfilterdb"}) {
+        const std::vector<std::string> vEngines = GetDBEngines();
+        const std::string strEngine = GetArg("-" + strDB + "engine", DEFAULT_DB_ENGINE);
+        if (std::find(vEngines.begin(), vEngines.end(), strEngine) == vEngines.end())
+            return InitError(strprintf(_("Unknown storage engine for -%sengine: '%s'"), strDB, strEngine));
+    }
+
+    nBlockCompressionLevel = std::min<int64_t>(std::max<int64_t>(0, GetArg("-blockcompression", DEFAULT_BLOCK_COMPRESSION_LEVEL)), MAX_BLOCK_COMPRESSION_LEVEL);
+    fCompressRelay = GetBoolArg("-compressrelay", DEFAULT_COMPRESS_RELAY);
+    if ((nBlockCompressionLevel > 0 || fCompressRelay) && !IsCompressionSupported())
+        return InitError(_("-blockcompression and -compressrelay are not available, as this build does not have zstd (--enable-zstd)"));
+    fFastBlockRelay = GetBoolArg("-fastblockrelay", DEFAULT_FAST_BLOCK_RELAY);
+
+    libzcash::SetProvingThreads(GetArg("-proverthreads", libzcash::DEFAULT_PROVER_THREADS));
+
+    ProofVerifierThreadConfig proofVerifierThreads;
+    proofVerifierThreads.poolThreads = std::max<int64_t>(0, GetArg("-scproofverifierthreads", 0));
+    if (mapArgs.count("-scproofverifiercpus") && !CScProofVerifier::ParseCpuList(mapArgs["-scproofverifiercpus"], proofVerifierThreads.lowCpus))
+        return InitError(strprintf(_("Invalid cpu list for -scproofverifiercpus=<cpus>: '%s'"), mapArgs["-scproofverifiercpus"]));
+    if (mapArgs.count("-scproofverifierblockcpus") && !CScProofVerifier::ParseCpuList(mapArgs["-scproofverifierblockcpus"], proofVerifierThreads.highCpus))
+        return InitError(strprintf(_("Invalid cpu list for -scproofverifierblockcpus=<cpus>: '%s'"), mapArgs["-scproofverifierblockcpus"]));
+    proofVerifierThreads.lowBelowNormal = GetBoolArg("-scproofverifierlowpriority", false);
+    CScProofVerifier::SetThreadConfig(proofVerifierThreads);
+
     fServer = GetBoolArg("-server", false);
 
     // block pruning; get the amount of disk space (in MB) to allot for block & undo files
@@ -1131,6 +1357,12 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
         LogPrintf("Prune configured to target %uMiB on disk for block and undo files.\n", nPruneTarget / 1024 / 1024);
         fPruneMode = true;
     }
+    if (mapArgs.count("-blocksarchivedir")) {
+        if (!fPruneMode)
+            return InitError(_("-blocksarchivedir requires -prune."));
+        if (!InitBlocksArchive(boost::filesystem::system_complete(mapArgs["-blocksarchivedir"])))
+            return InitError(strprintf(_("Cannot use the blocks archive directory %s."), mapArgs["-blocksarchivedir"]));
+    }
 
 
 #ifdef ENABLE_WALLET
@@ -1182,11 +1414,20 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
     bSpendZeroConfChange = GetBoolArg("-spendzeroconfchange", true);
     fSendFreeTransactions = GetBoolArg("-sendfreetransactions", false);
 
+    const unsigned int nCertFeePoolSize = std::max<int64_t>(GetArg("-certfeepool", DEFAULT_CERT_FEE_POOL_SIZE), 0);
+    CAmount nCertFeePoolCoinValue = DEFAULT_CERT_FEE_POOL_COIN_VALUE;
+    if (mapArgs.count("-certfeepoolvalue"))
+    {
+        if (!ParseMoney(mapArgs["-certfeepoolvalue"], nCertFeePoolCoinValue) || nCertFeePoolCoinValue <= 0)
+            return InitError(strprintf(_("Invalid amount for -certfeepoolvalue=<amount>: '%s'"), mapArgs["-certfeepoolvalue"]));
+    }
+
     std::string strWalletFile = GetArg("-wallet", "wallet.dat");
 #endif // ENABLE_WALLET
 
     fIsBareMultisigStd = GetBoolArg("-permitbaremultisig", true);
     nMaxDatacarrierBytes = GetArg("-datacarriersize", nMaxDatacarrierBytes);
+    SetTxTraceSize(std::max<int64_t>(0, GetArg("-txtracesize", DEFAULT_TX_TRACE_SIZE)));
 
     // Option to startup with mocktime set (used for regression testing):
     SetMockTime(GetArg("-mocktime", 0)); // SetMockTime(0) is a no-op
@@ -1219,9 +1460,14 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
         return false;
     }
 
+    // Select the fastest SHA256 implementation supported by this CPU
+    std::string sha256_algo = SHA256AutoDetect();
+
     // Initialize elliptic curve code
     ECC_Start();
     globalVerifyHandle.reset(new ECCVerifyHandle());
+    InitSignatureCache();
+    InitScriptExecutionCache();
 
     // Sanity check
     if (!InitSanityCheck())
@@ -1254,9 +1500,8 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
     if(!Sidechain::InitZendoo())
         return InitError(strprintf(_("Cannot initialize Zendoo.")));
 
-    // Initialize DLog keys
-    if(!Sidechain::InitDLogKeys())
-        return InitError(strprintf(_("Cannot initialize DLog keys in sidechains folder.")));
+    // Initialize DLog keys in the background, see WaitForZKParams()
+    dlogKeysLoaded = std::async(std::launch::async, &Sidechain::InitDLogKeys);
 
 #ifndef WIN32
     CreatePidFile(GetPidFile(), getpid());
@@ -1269,9 +1514,14 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
     LogPrintf("Zen version %s (%s)\n", FormatFullVersion(), CLIENT_DATE);
 
     if (fPrintToDebugLog)
+    {
         OpenDebugLog();
+        if (GetBoolArg("-logasync", DEFAULT_LOGASYNC))
+            StartAsyncLogging();
+    }
 
     LogPrintf("Using OpenSSL version %s\n", SSLeay_version(SSLEAY_VERSION));
+    LogPrintf("Using the '%s' SHA256 implementation\n", sha256_algo);
 #ifdef ENABLE_WALLET
     LogPrintf("Using BerkeleyDB version %s\n", DbEnv::version(0, 0, 0));
 #endif
@@ -1289,11 +1539,19 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
     if (nScriptCheckThreads) {
         for (int i=0; i<nScriptCheckThreads-1; i++)
             threadGroup.create_thread(&ThreadScriptCheck);
+        // they only wake up for the blocks with JoinSplits, to verify the proofs alongside the scripts
+        for (int i=0; i<nScriptCheckThreads-1; i++)
+            threadGroup.create_thread(&ThreadJoinSplitCheck);
     }
 
-    // Start the lightweight task scheduler thread
-    CScheduler::Function serviceLoop = boost::bind(&CScheduler::serviceQueue, &scheduler);
+    // Start the lightweight task scheduler thread, and the one of its tasks writing to disk
+    CScheduler::Function serviceLoop = boost::bind(&CScheduler::serviceQueue, &scheduler, CScheduler::TaskClass::LATENCY_SENSITIVE);
     threadGroup.create_thread(boost::bind(&TraceThread<CScheduler::Function>, "scheduler", serviceLoop));
+    CScheduler::Function serviceIoLoop = boost::bind(&CScheduler::serviceQueue, &scheduler, CScheduler::TaskClass::IO_BOUND);
+    threadGroup.create_thread(boost::bind(&TraceThread<CScheduler::Function>, "schedulerio", serviceIoLoop));
+
+    // Start the thread delivering the wallet updates
+    StartValidationInterfaceQueue();
 
     // Count uptime
     MarkStartTime();
@@ -1311,8 +1569,8 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
     libsnark::inhibit_profiling_info = true;
     libsnark::inhibit_profiling_counters = true;
 
-    // Initialize Zcash circuit parameters
-    ZC_LoadParams();
+    // Initialize Zcash circuit parameters in the background, see WaitForZKParams()
+    zcParamsLoaded = std::async(std::launch::async, &ZC_LoadParams);
 
     // check type sizes in crypto lib are as expected and assert() in case of failure
     CZendooCctpLibraryChecker::CheckTypeSizes();
@@ -1483,7 +1741,7 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
     pzmqNotificationInterface = CZMQNotificationInterface::CreateWithArguments(mapArgs);
 
     if (pzmqNotificationInterface) {
-        RegisterValidationInterface(pzmqNotificationInterface);
+        RegisterNotificationSink(pzmqNotificationInterface);
     }
 #endif
 
@@ -1498,7 +1756,7 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
             return InitError(_("AMQP support requires -experimentalfeatures."));
         }
 
-        RegisterValidationInterface(pAMQPNotificationInterface);
+        RegisterNotificationSink(pAMQPNotificationInterface);
     }
 #endif
 
@@ -1566,6 +1824,19 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
     LogPrintf("* Using %.1fMiB for block index database\n", nBlockTreeDBCache * (1.0 / 1024 / 1024));
     LogPrintf("* Using %.1fMiB for chain state database\n", nCoinDBCache * (1.0 / 1024 / 1024));
     LogPrintf("* Using %.1fMiB for in-memory UTXO set\n", nCoinCacheUsage * (1.0 / 1024 / 1024));
+    nScCacheUsage = std::max<int64_t>(1, GetArg("-sccachesize", DEFAULT_SC_CACHE_SIZE)) << 20;
+    LogPrintf("* Using %.1fMiB for in-memory sidechains\n", nScCacheUsage * (1.0 / 1024 / 1024));
+    const int64_t nBlockCache = std::max<int64_t>(0, GetArg("-blockcachesize", DEFAULT_BLOCK_CACHE_SIZE)) << 20;
+    blockCache.SetMaxUsage(nBlockCache);
+    LogPrintf("* Using %.1fMiB for recent blocks\n", nBlockCache * (1.0 / 1024 / 1024));
+    if (GetBoolArg("-asyncblockwrites", DEFAULT_ASYNC_BLOCK_WRITES))
+        blockFileWriter.Start();
+    const int64_t nHeadersCache = std::max<int64_t>(0, GetArg("-headerscachesize", DEFAULT_HEADERS_CACHE_SIZE)) << 20;
+    {
+        LOCK(cs_main);
+        headersCache.SetMaxUsage(nHeadersCache);
+    }
+    LogPrintf("* Using %.1fMiB for serialized headers\n", nHeadersCache * (1.0 / 1024 / 1024));
 
     bool fLoaded = false;
     while (!fLoaded) {
@@ -1579,13 +1850,17 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
             try {
                 UnloadBlockIndex();
                 delete pcoinsTip;
-                delete pcoinsdbview;
                 delete pcoinscatcher;
+                delete pcoinsFlusher;
+                delete pcoinsdbview;
                 delete pblocktree;
 
                 pblocktree = new CBlockTreeDB(nBlockTreeDBCache, blocktreedbMaxOpenFiles, false, fReindex || fReindexFast);
+                if (GetBoolArg("-asyncindexes", DEFAULT_ASYNC_INDEXES))
+                    pblocktree->StartIndexWriter(std::max<int64_t>(1, GetArg("-indexwriterqueue", DEFAULT_INDEX_WRITER_QUEUE)));
                 pcoinsdbview = new CCoinsViewDB(nCoinDBCache, coinsviewdbMaxOpenFiles, false, fReindex || fReindexFast);
-                pcoinscatcher = new CCoinsViewErrorCatcher(pcoinsdbview);
+                pcoinsFlusher = new CCoinsViewBackgroundFlush(pcoinsdbview);
+                pcoinscatcher = new CCoinsViewErrorCatcher(pcoinsFlusher);
                 pcoinsTip = new CCoinsViewCache(pcoinscatcher);
 
                 if (fReindex || fReindexFast) {
@@ -1593,12 +1868,41 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
                     if (fReindexFast) pblocktree->WriteFastReindexing(true);
 
                     //If we're reindexing in prune mode, wipe away unusable block files and all undo data files
-                    if (fPruneMode)
+                    //(an archive keeps all of them, the reindex reads the archived ones too)
+                    if (fPruneMode && !fPruneToArchive)
                         CleanupBlockRevFiles();
 
                     Sidechain::ClearSidechainsFolder();
                 }
 
+                // A txoutset snapshot is only imported into empty dbs, and only once: if the load is
+                // retried the dbs already hold it.
+                static bool fTxOutSetLoaded = false;
+                if (mapArgs.count("-loadtxoutset") && !fTxOutSetLoaded) {
+                    fTxOutSetLoaded = true;
+                    if (fReset)
+                        return InitError(_("-loadtxoutset is incompatible with -reindex and -reindexfast"));
+                    if (!pcoinsdbview->GetBestBlock().IsNull()) {
+                        LogPrintf("%s: chainstate is not empty, -loadtxoutset ignored\n", __func__);
+                    } else {
+                        if (GetBoolArg("-txindex", DEFAULT_TXINDEX) || GetBoolArg("-maturityheightindex", DEFAULT_MATURITYHEIGHTINDEX)
+                            || GetBoolArg("-addressindex", DEFAULT_ADDRESSINDEX) || GetBoolArg("-timestampindex", DEFAULT_TIMESTAMPINDEX)
+                            || GetBoolArg("-spentindex", DEFAULT_SPENTINDEX))
+                            return InitError(_("-loadtxoutset is incompatible with the optional indexes, which need the blocks below the snapshot base"));
+                        uint256 hashExpected;
+                        if (mapArgs.count("-loadtxoutsethash")) {
+                            if (!IsHex(mapArgs["-loadtxoutsethash"]) || mapArgs["-loadtxoutsethash"].size() != 64)
+                                return InitError(strprintf(_("Invalid -loadtxoutsethash: '%s'"), mapArgs["-loadtxoutsethash"]));
+                            hashExpected = uint256S(mapArgs["-loadtxoutsethash"]);
+                        }
+                        uiInterface.InitMessage(_("Importing txoutset snapshot..."));
+                        CTxOutSetSnapshotInfo info;
+                        std::string strError;
+                        if (!LoadTxOutSetSnapshot(GetArg("-loadtxoutset", ""), hashExpected, pcoinsdbview, pblocktree, info, strError))
+                            return InitError(strprintf(_("Failed to import the txoutset snapshot: %s. Restart with -reindex to clear the partially imported data"), strError));
+                    }
+                }
+
                 if (!LoadBlockIndex()) {
                     strLoadError = _("Error loading block database");
                     break;
@@ -1679,11 +1983,15 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
 
                 // Check for changed -prune state.  What we are concerned about is a user who has pruned blocks
                 // in the past, but is now trying to run unpruned.
-                if (fHavePruned && !fPruneMode) {
+                if (fHavePruned && !fPruneMode && !fTxOutSetSnapshot) {
                     strLoadError = _("You need to rebuild the database using -reindex or -reindexfast to go back to unpruned mode.  This will redownload the entire blockchain");
                     break;
                 }
 
+                // the blocks verified at the highest check levels are connected again, proofs included
+                if (!WaitForZKParams())
+                    return false;
+
                 uiInterface.InitMessage(_("Verifying blocks..."));
                 if (fHavePruned && GetArg("-checkblocks", 288) > MIN_BLOCKS_TO_KEEP) {
                     LogPrintf("Prune: pruned datadir may not have more than %d blocks; -checkblocks=%d may fail\n",
@@ -1694,6 +2002,16 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
                     strLoadError = _("Corrupted block database detected");
                     break;
                 }
+
+                // the rolling UTXO set statistics are missing on a db written by an older version
+                CCoinsSetStats setStats;
+                if (!pcoinsdbview->GetSetStats(setStats)) {
+                    uiInterface.InitMessage(_("Computing the UTXO set statistics..."));
+                    if (!pcoinsdbview->RebuildSetStats(std::max(1, nScriptCheckThreads))) {
+                        strLoadError = _("Error computing the UTXO set statistics");
+                        break;
+                    }
+                }
             } catch (const std::exception& e) {
                 if (fDebug) LogPrintf("%s\n", e.what());
                 strLoadError = _("Error opening block database");
@@ -1733,6 +2051,17 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
     }
     LogPrintf(" block index %15dms\n", GetTimeMillis() - nStart);
 
+    // no-op unless the block index load ended before verifying the blocks
+    if (!WaitForZKParams())
+        return false;
+
+    {
+        int64_t nVKeyStart = GetTimeMillis();
+        LOCK(cs_main);
+        Sidechain::WarmUpVKeyCache(*pcoinsTip);
+        LogPrintf(" sidechain vkeys %12dms\n", GetTimeMillis() - nVKeyStart);
+    }
+
     boost::filesystem::path est_path = GetDataDir() / FEE_ESTIMATES_FILENAME;
     CAutoFile est_filein(fopen(est_path.string().c_str(), "rb"), SER_DISK, CLIENT_VERSION);
     // Allowed to fail as this file IS missing on first startup.
@@ -1849,6 +2178,10 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
             else
                 pindexRescan = chainActive.Genesis();
         }
+        // the last block seen by the wallet was scanned already, the rescan needs the data of the following ones
+        CBlockIndex *pindexRescanNext = pindexRescan ? chainActive.Next(pindexRescan) : NULL;
+        if (fTxOutSetSnapshot && pindexRescanNext && !(pindexRescanNext->nStatus & BLOCK_HAVE_DATA))
+            return InitError(_("The wallet needs a rescan of blocks below the txoutset snapshot base, which are not on disk"));
         if (chainActive.Tip() && chainActive.Tip() != pindexRescan)
         {
             uiInterface.InitMessage(_("Rescanning..."));
@@ -1922,12 +2255,17 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
     // if pruning, unset the service bit and perform the initial blockstore prune
     // after any wallet rescanning has taken place.
     if (fPruneMode) {
-        LogPrintf("Unsetting NODE_NETWORK on prune mode\n");
-        nLocalServices &= ~NODE_NETWORK;
+        if (!fPruneToArchive) {
+            LogPrintf("Unsetting NODE_NETWORK on prune mode\n");
+            nLocalServices &= ~NODE_NETWORK;
+        }
         if (!(fReindex || fReindexFast)) {
             uiInterface.InitMessage(_("Pruning blockstore..."));
             PruneAndFlush();
         }
+    } else if (fTxOutSetSnapshot) {
+        LogPrintf("Unsetting NODE_NETWORK, blocks below the txoutset snapshot base are not on disk\n");
+        nLocalServices &= ~NODE_NETWORK;
     }
 
     // ********************************************************* Step 10: import blocks
@@ -1971,6 +2309,12 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
     LogPrintf("mapAddressBook.size() = %u\n",  pwalletMain ? pwalletMain->mapAddressBook.size() : 0);
 #endif
 
+    if (GetBoolArg("-blockfilterindex", DEFAULT_BLOCKFILTERINDEX)) {
+        pblockfilterindex = new CBlockFilterIndex(BlockFilterType::BASIC, BLOCKFILTERDB_CACHE_SIZE, false, fReindex || fReindexFast);
+        RegisterValidationInterface(pblockfilterindex);
+        pblockfilterindex->Start();
+    }
+
     // Start the thread that notifies listeners of transactions that have been
     // recently added to the mempool.
     threadGroup.create_thread(boost::bind(&TraceThread<void (*)()>, "txnotify", &ThreadNotifyRecentlyAdded));
@@ -1985,6 +2329,8 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
     const std::pair<int64_t, int64_t> bufferMinMax = {1, std::numeric_limits<unsigned int>::max() / fromKBtoBfactor};
     connOptions.nSendBufferMaxSize = fromKBtoBfactor * static_cast<unsigned int>(GetArgWithinLimits("-maxsendbuffer", DEFAULT_MAX_SEND_BUFFER, bufferMinMax));
     connOptions.nReceiveFloodSize = fromKBtoBfactor * static_cast<unsigned int>(GetArgWithinLimits("-maxreceivebuffer", DEFAULT_MAX_RECEIVE_BUFFER, bufferMinMax));
+    connOptions.nMessageHandlerThreads = static_cast<int>(GetArgWithinLimits("-msghandlerthreads", DEFAULT_MSG_HANDLER_THREADS, {1, MAX_MSG_HANDLER_THREADS}));
+    connOptions.nTLSHandshakeThreads = static_cast<int>(GetArgWithinLimits("-tlshandshakethreads", DEFAULT_TLS_HANDSHAKE_THREADS, {1, MAX_TLS_HANDSHAKE_THREADS}));
     
     connman->StartNode(scheduler, connOptions);
 
@@ -1992,7 +2338,16 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
     int64_t nPowTargetSpacing = Params().GetConsensus().nPowTargetSpacing;
     CScheduler::Function f = boost::bind(&PartitionCheck, &IsInitialBlockDownload,
                                          boost::ref(cs_main), boost::cref(pindexBestHeader), nPowTargetSpacing);
-    scheduler.scheduleEvery(f, nPowTargetSpacing);
+    scheduler.scheduleEvery(f, nPowTargetSpacing, CScheduler::TaskClass::LATENCY_SENSITIVE, "partitioncheck");
+
+    // Publish the stats of the peers for getpeerinfo, which reads them without locking the nodes
+    scheduler.scheduleEvery([] { PublishPeerStats(false); }, PEER_STATS_INTERVAL,
+                            CScheduler::TaskClass::LATENCY_SENSITIVE, "peerstats");
+
+    const int64_t nMempoolDumpInterval = GetArg("-mempooldumpinterval", DEFAULT_MEMPOOL_DUMP_INTERVAL);
+    if (GetBoolArg("-persistmempool", DEFAULT_PERSIST_MEMPOOL) && nMempoolDumpInterval > 0)
+        scheduler.scheduleEvery([] { if (IsMempoolLoaded()) DumpMempool(*mempool); }, nMempoolDumpInterval,
+                                CScheduler::TaskClass::IO_BOUND, "dumpmempool");
 
 #ifdef ENABLE_MINING
     // Generate coins in the background
@@ -2021,6 +2376,18 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
 
         // Run a thread to flush wallet periodically
         threadGroup.create_thread(boost::bind(&ThreadFlushWalletDB, boost::ref(pwalletMain->strWalletFile)));
+
+        // and one to top up the keypool
+        if (GetArg("-keypoolmin", 1) > 0)
+            threadGroup.create_thread(boost::bind(&CWallet::ThreadTopUpKeyPool, pwalletMain));
+
+        // and the coins for the fees of the certificates refreshed
+        if (nCertFeePoolSize > 0)
+        {
+            pwalletMain->SetCertFeePool(nCertFeePoolSize, nCertFeePoolCoinValue);
+            scheduler.scheduleEvery([] { pwalletMain->RefreshCertFeePool(); }, CERT_FEE_POOL_REFRESH_INTERVAL,
+                                    CScheduler::TaskClass::IO_BOUND, "certfeepool");
+        }
     }
 #endif
 
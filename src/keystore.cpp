@@ -27,6 +27,7 @@ bool CBasicKeyStore::AddKeyPubKey(const CKey& key, const CPubKey &pubkey)
 {
     LOCK(cs_KeyStore);
     mapKeys[pubkey.GetID()] = key;
+    nKeyStoreGeneration++;
     return true;
 }
 
@@ -37,6 +38,7 @@ bool CBasicKeyStore::AddCScript(const CScript& redeemScript)
 
     LOCK(cs_KeyStore);
     mapScripts[CScriptID(redeemScript)] = redeemScript;
+    nKeyStoreGeneration++;
     return true;
 }
 
@@ -62,6 +64,7 @@ bool CBasicKeyStore::AddWatchOnly(const CScript &dest)
 {
     LOCK(cs_KeyStore);
     setWatchOnly.insert(dest);
+    nKeyStoreGeneration++;
     return true;
 }
 
@@ -69,6 +72,7 @@ bool CBasicKeyStore::RemoveWatchOnly(const CScript &dest)
 {
     LOCK(cs_KeyStore);
     setWatchOnly.erase(dest);
+    nKeyStoreGeneration++;
     return true;
 }
 
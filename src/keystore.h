@@ -80,6 +80,8 @@ protected:
     SpendingKeyMap mapSpendingKeys;
     ViewingKeyMap mapViewingKeys;
     NoteDecryptorMap mapNoteDecryptors;
+    //! Bumped, under cs_KeyStore, on every change of the keys, the scripts or the watch-only scripts
+    uint64_t nKeyStoreGeneration = 0;
 
 public:
     bool AddKeyPubKey(const CKey& key, const CPubKey &pubkey);
@@ -4,95 +4,32 @@
 
 #include "leveldbwrapper.h"
 
+#include "tinyformat.h"
 #include "util.h"
 
-#include <boost/filesystem.hpp>
-
-#include <leveldb/cache.h>
-#include <leveldb/env.h>
-#include <leveldb/filter_policy.h>
-#include <memenv.h>
-
-void HandleError(const leveldb::Status& status)
+CLevelDBWrapper::CLevelDBWrapper(const boost::filesystem::path& path, size_t nCacheSize, int maxOpenFiles, bool fMemory, bool fWipe) :
+    CLevelDBWrapper(path, CLevelDBOptions(nCacheSize, maxOpenFiles), fMemory, fWipe)
 {
-    if (status.ok())
-        return;
-    LogPrintf("%s\n", status.ToString());
-    if (status.IsCorruption())
-        throw leveldb_error("Database corrupted");
-    if (status.IsIOError())
-        throw leveldb_error("Database I/O error");
-    if (status.IsNotFound())
-        throw leveldb_error("Database entry missing");
-    throw leveldb_error("Unknown database error");
 }
 
-static leveldb::Options GetOptions(size_t nCacheSize, int maxOpenFiles)
+CLevelDBWrapper::CLevelDBWrapper(const boost::filesystem::path& path, const CLevelDBOptions& dbOptionsIn, bool fMemory, bool fWipe) :
+    dbOptions(dbOptionsIn),
+    pdb(CreateDBEngine(path, dbOptions, fMemory, fWipe))
 {
-    leveldb::Options options;
-    options.block_cache = leveldb::NewLRUCache(nCacheSize / 2);
-    options.write_buffer_size = nCacheSize / 4; // up to two write buffers may be held in memory simultaneously
-    options.filter_policy = leveldb::NewBloomFilterPolicy(10);
-
-    // compression is purposely set to leveldb::kNoCompression because stored data is
-    // not compressible, being mainly criptographic data like hashes, keys, signatures
-    // moreover, compression library (Snappy) used by LevelDB is made not available for
-    // zend (identifier SNAPPY being always undefined); hence, even enabling compression
-    // at this point would be useless (unless Snappy is downloaded, compiled and linked
-    // as external dependency; that's not the case)
-    options.compression  = leveldb::kNoCompression;
-
-    options.max_open_files = maxOpenFiles;
-
-    if (leveldb::kMajorVersion > 1 || (leveldb::kMajorVersion == 1 && leveldb::kMinorVersion >= 16)) {
-        // LevelDB versions before 1.16 consider short writes to be corruption. Only trigger error
-        // on corruption in later versions.
-        options.paranoid_checks = true;
-    }
-    return options;
 }
 
-CLevelDBWrapper::CLevelDBWrapper(const boost::filesystem::path& path, size_t nCacheSize, int maxOpenFiles, bool fMemory, bool fWipe) :
-    options{GetOptions(nCacheSize, maxOpenFiles)}
+CLevelDBWrapper::~CLevelDBWrapper()
 {
-    penv = nullptr;
-    readoptions.verify_checksums = true;
-    iteroptions.verify_checksums = true;
-    iteroptions.fill_cache = false;
-    syncoptions.sync = true;
-    options.create_if_missing = true;
-    if (fMemory) {
-        penv = leveldb::NewMemEnv(leveldb::Env::Default());
-        options.env = penv;
-    } else {
-        if (fWipe) {
-            LogPrintf("Wiping LevelDB in %s\n", path.string());
-            leveldb::Status result = leveldb::DestroyDB(path.string(), options);
-            HandleError(result);
-        }
-        TryCreateDirectory(path);
-        LogPrintf("Opening LevelDB in %s\n", path.string());
-    }
-    leveldb::Status status = leveldb::DB::Open(options, path.string(), &pdb);
-    HandleError(status);
-    LogPrintf("Opened LevelDB successfully\n");
 }
 
-CLevelDBWrapper::~CLevelDBWrapper()
+void CLevelDBWrapper::GetDBStats(CLevelDBStats& stats) const
 {
-    delete pdb;
-    pdb = nullptr;
-    delete options.filter_policy;
-    options.filter_policy = nullptr;
-    delete options.block_cache;
-    options.block_cache = nullptr;
-    delete penv;
-    options.env = nullptr;
+    pdb->GetStats(stats);
 }
 
 bool CLevelDBWrapper::WriteBatch(CLevelDBBatch& batch, bool fSync)
 {
-    leveldb::Status status = pdb->Write(fSync ? syncoptions : writeoptions, &batch.batch);
+    CDBStatus status = pdb->Write(batch.batch, fSync);
     HandleError(status);
     return true;
 }
@@ -6,15 +6,17 @@
 #define BITCOIN_LEVELDBWRAPPER_H
 
 #include "clientversion.h"
+#include "dbengine.h"
 #include "serialize.h"
 #include "streams.h"
 #include "util.h"
 #include "version.h"
 
-#include <boost/filesystem/path.hpp>
+#include <memory>
+#include <string>
+#include <vector>
 
-#include <leveldb/db.h>
-#include <leveldb/write_batch.h>
+#include <boost/filesystem/path.hpp>
 
 // https://github.com/bitcoin/bitcoin/pull/12495
 // On most platforms the default setting of max_open_files (which is 1000)
@@ -34,35 +36,27 @@
 // 4. zend uses LevelDB version 1.18 which does not check for FD exhaustion
 constexpr unsigned int DEFAULT_DB_MAX_OPEN_FILES = 400;
 
-class leveldb_error : public std::runtime_error
-{
-public:
-    leveldb_error(const std::string& msg) : std::runtime_error(msg) {}
-};
-
-void HandleError(const leveldb::Status& status);
-
 /** Batch of changes queued to be written to a CLevelDBWrapper */
 class CLevelDBBatch
 {
     friend class CLevelDBWrapper;
 
 private:
-    leveldb::WriteBatch batch;
+    CDBWriteBatch batch;
 
 public:
     template <typename K, typename V>
     void Write(const K& key, const V& value)
     {
-        CDataStream ssKey(SER_DISK, CLIENT_VERSION);
+        CPublicDataStream ssKey(SER_DISK, CLIENT_VERSION);
         ssKey.reserve(ssKey.GetSerializeSize(key));
         ssKey << key;
-        leveldb::Slice slKey(&ssKey[0], ssKey.size());
+        CDBSlice slKey(&ssKey[0], ssKey.size());
 
-        CDataStream ssValue(SER_DISK, CLIENT_VERSION);
+        CPublicDataStream ssValue(SER_DISK, CLIENT_VERSION);
         ssValue.reserve(ssValue.GetSerializeSize(value));
         ssValue << value;
-        leveldb::Slice slValue(&ssValue[0], ssValue.size());
+        CDBSlice slValue(&ssValue[0], ssValue.size());
 
         batch.Put(slKey, slValue);
     }
@@ -70,53 +64,47 @@ public:
     template <typename K>
     void Erase(const K& key)
     {
-        CDataStream ssKey(SER_DISK, CLIENT_VERSION);
+        CPublicDataStream ssKey(SER_DISK, CLIENT_VERSION);
         ssKey.reserve(ssKey.GetSerializeSize(key));
         ssKey << key;
-        leveldb::Slice slKey(&ssKey[0], ssKey.size());
+        CDBSlice slKey(&ssKey[0], ssKey.size());
 
         batch.Delete(slKey);
     }
 };
 
+/**
+ * A database of serialized keys and values, stored by the engine its options name (leveldb unless
+ * -<db>engine says otherwise).
+ */
 class CLevelDBWrapper
 {
 private:
-    //! custom environment this database is using (may be NULL in case of default environment)
-    leveldb::Env* penv;
-
-    //! database options used
-    leveldb::Options options;
-
-    //! options used when reading from the database
-    leveldb::ReadOptions readoptions;
-
-    //! options used when iterating over values of the database
-    leveldb::ReadOptions iteroptions;
-
-    //! options used when writing to the database
-    leveldb::WriteOptions writeoptions;
-
-    //! options used when sync writing to the database
-    leveldb::WriteOptions syncoptions;
+    //! the tuning the database was opened with
+    CLevelDBOptions dbOptions;
 
     //! the database itself
-    leveldb::DB* pdb;
+    std::unique_ptr<CDBEngine> pdb;
 
 public:
     CLevelDBWrapper(const boost::filesystem::path& path, size_t nCacheSize, int maxOpenFiles, bool fMemory = false, bool fWipe = false);
+    CLevelDBWrapper(const boost::filesystem::path& path, const CLevelDBOptions& dbOptionsIn, bool fMemory = false, bool fWipe = false);
     ~CLevelDBWrapper();
 
+    const CLevelDBOptions& GetDBOptions() const { return dbOptions; }
+    //! The level sizes and compaction times reported by the engine, and the block cache hits
+    void GetDBStats(CLevelDBStats& stats) const;
+
     template <typename K, typename V>
     bool Read(const K& key, V& value) const
     {
-        CDataStream ssKey(SER_DISK, CLIENT_VERSION);
+        CPublicDataStream ssKey(SER_DISK, CLIENT_VERSION);
         ssKey.reserve(ssKey.GetSerializeSize(key));
         ssKey << key;
-        leveldb::Slice slKey(&ssKey[0], ssKey.size());
+        CDBSlice slKey(&ssKey[0], ssKey.size());
 
         std::string strValue;
-        leveldb::Status status = pdb->Get(readoptions, slKey, &strValue);
+        CDBStatus status = pdb->Get(slKey, strValue);
         if (!status.ok()) {
             if (status.IsNotFound())
                 return false;
@@ -124,7 +112,7 @@ public:
             HandleError(status);
         }
         try {
-            CDataStream ssValue(strValue.data(), strValue.data() + strValue.size(), SER_DISK, CLIENT_VERSION);
+            CPublicDataStream ssValue(strValue.data(), strValue.data() + strValue.size(), SER_DISK, CLIENT_VERSION);
             ssValue >> value;
         } catch (const std::exception&) {
             return false;
@@ -143,13 +131,13 @@ public:
     template <typename K>
     bool Exists(const K& key) const
     {
-        CDataStream ssKey(SER_DISK, CLIENT_VERSION);
+        CPublicDataStream ssKey(SER_DISK, CLIENT_VERSION);
         ssKey.reserve(ssKey.GetSerializeSize(key));
         ssKey << key;
-        leveldb::Slice slKey(&ssKey[0], ssKey.size());
+        CDBSlice slKey(&ssKey[0], ssKey.size());
 
         std::string strValue;
-        leveldb::Status status = pdb->Get(readoptions, slKey, &strValue);
+        CDBStatus status = pdb->Get(slKey, strValue);
         if (!status.ok()) {
             if (status.IsNotFound())
                 return false;
@@ -182,9 +170,25 @@ public:
     }
 
     // not exactly clean encapsulation, but it's easiest for now
-    leveldb::Iterator* NewIterator()
+    CDBIterator* NewIterator()
+    {
+        return pdb->NewIterator();
+    }
+
+    //! Iterator reading from an explicit snapshot, which several iterators can share
+    CDBIterator* NewIterator(const CDBSnapshot* snapshot)
+    {
+        return pdb->NewIterator(snapshot);
+    }
+
+    const CDBSnapshot* GetSnapshot()
+    {
+        return pdb->GetSnapshot();
+    }
+
+    void ReleaseSnapshot(const CDBSnapshot* snapshot)
     {
-        return pdb->NewIterator(iteroptions);
+        pdb->ReleaseSnapshot(snapshot);
     }
 };
 
@@ -0,0 +1,110 @@
+#ifndef BITCOIN_LOGBUFFER_H
+#define BITCOIN_LOGBUFFER_H
+
+#include <atomic>
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+/**
+ * A bounded lock-free queue of log lines, which the logging threads push to and the log writer thread
+ * pops from. Each cell carries the sequence number of the push or pop that may take it next, so that
+ * the threads only contend on the two positions, with a compare and swap (see D. Vyukov's bounded
+ * MPMC queue). A push to a full queue fails instead of waiting for the writer.
+ */
+class CLogRingBuffer
+{
+public:
+    //! nCapacity is rounded up to a power of two
+    explicit CLogRingBuffer(size_t nCapacity) : nPushPos(0), nPopPos(0)
+    {
+        size_t nCells = 2;
+        while (nCells < nCapacity)
+            nCells <<= 1;
+        nMask = nCells - 1;
+        vCells = std::vector<Cell>(nCells);
+        for (size_t i = 0; i < nCells; i++)
+            vCells[i].nSequence.store(i, std::memory_order_relaxed);
+    }
+
+    CLogRingBuffer(const CLogRingBuffer&) = delete;
+    CLogRingBuffer& operator=(const CLogRingBuffer&) = delete;
+
+    size_t Capacity() const { return nMask + 1; }
+
+    //! false if the queue is full, the line is then left as it is
+    bool Push(std::string& str)
+    {
+        size_t nPos = nPushPos.load(std::memory_order_relaxed);
+        Cell* cell;
+        while (true)
+        {
+            cell = &vCells[nPos & nMask];
+            const size_t nSequence = cell->nSequence.load(std::memory_order_acquire);
+            const ptrdiff_t nDiff = static_cast<ptrdiff_t>(nSequence) - static_cast<ptrdiff_t>(nPos);
+            if (nDiff == 0)
+            {
+                if (nPushPos.compare_exchange_weak(nPos, nPos + 1, std::memory_order_relaxed))
+                    break;
+            }
+            else if (nDiff < 0)
+                return false;
+            else
+                nPos = nPushPos.load(std::memory_order_relaxed);
+        }
+        cell->str.swap(str);
+        cell->nSequence.store(nPos + 1, std::memory_order_release);
+        return true;
+    }
+
+    //! false if the queue is empty
+    bool Pop(std::string& str)
+    {
+        size_t nPos = nPopPos.load(std::memory_order_relaxed);
+        Cell* cell;
+        while (true)
+        {
+            cell = &vCells[nPos & nMask];
+            const size_t nSequence = cell->nSequence.load(std::memory_order_acquire);
+            const ptrdiff_t nDiff = static_cast<ptrdiff_t>(nSequence) - static_cast<ptrdiff_t>(nPos + 1);
+            if (nDiff == 0)
+            {
+                if (nPopPos.compare_exchange_weak(nPos, nPos + 1, std::memory_order_relaxed))
+                    break;
+            }
+            else if (nDiff < 0)
+                return false;
+            else
+                nPos = nPopPos.load(std::memory_order_relaxed);
+        }
+        str.clear();
+        str.swap(cell->str);
+        cell->nSequence.store(nPos + nMask + 1, std::memory_order_release);
+        return true;
+    }
+
+private:
+    struct Cell
+    {
+        std::atomic<size_t> nSequence;
+        std::string str;
+
+        Cell() : nSequence(0) {}
+        // only moved while the queue is built
+        Cell(Cell&& other) : nSequence(other.nSequence.load(std::memory_order_relaxed)), str(std::move(other.str)) {}
+        Cell& operator=(Cell&& other)
+        {
+            nSequence.store(other.nSequence.load(std::memory_order_relaxed), std::memory_order_relaxed);
+            str = std::move(other.str);
+            return *this;
+        }
+    };
+
+    std::vector<Cell> vCells;
+    size_t nMask;
+    // apart, not to share a cache line between the pushing and the popping threads
+    alignas(64) std::atomic<size_t> nPushPos;
+    alignas(64) std::atomic<size_t> nPopPos;
+};
+
+#endif // BITCOIN_LOGBUFFER_H
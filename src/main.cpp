@@ -9,17 +9,32 @@
 
 #include "addrman.h"
 #include "arith_uint256.h"
+#include "blockcache.h"
+#include "blockcompression.h"
+#include "blockwriter.h"
+#include "blockfilterindex.h"
 #include "checkpoints.h"
+#include "headerranges.h"
 #include "checkqueue.h"
 #include "consensus/validation.h"
+#include "crypto/sha256.h"
+#include "cuckoocache.h"
 #include "deprecation.h"
 #include "init.h"
+#include "blockencodings.h"
+#include "blockview.h"
 #include "merkleblock.h"
+#include "headerscache.h"
 #include "metrics.h"
+#include "orphanpool.h"
 #include "pow.h"
 #include "txdb.h"
+#include "txrequest.h"
+#include "txtrace.h"
 #include "ui_interface.h"
 #include "undo.h"
+#include "support/hugepages.h"
+#include "validationstats.h"
 #include "util.h"
 #include "utilmoneystr.h"
 #include "validationinterface.h"
@@ -32,6 +47,14 @@
 #include <random>
 #include <regex>
 #include <atomic>
+#include <functional>
+#include <future>
+#include <list>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <optional>
+#include <thread>
 
 #include <boost/algorithm/string/replace.hpp>
 #include <boost/filesystem.hpp>
@@ -73,11 +96,179 @@ BlockTimeMap mGlobalForkTips;
 BlockMap mapBlockIndex;
 ScCumTreeRootMap mapCumtreeHeight;
 CChain chainActive;
+//! Taken exclusively, besides cs_main, to add an entry to mapBlockIndex; shared by LookupBlockIndex
+static boost::shared_mutex csBlockIndexMap;
+//! chainActive.Tip() as of the last tip change, for the readers not holding cs_main
+static std::atomic<CBlockIndex*> pindexPublishedTip{nullptr};
+
+namespace {
+
+/**
+ * The storage of the entries of mapBlockIndex. These are only freed all at once, by UnloadBlockIndex,
+ * so that they are laid out next to each other in large chunks, in the order they are added, instead
+ * of being spread over the heap: as headers mostly arrive in height order, the walks along pprev
+ * touch neighbouring memory, and the allocator bookkeeping of 1M+ small objects is saved.
+ * Entries allocated elsewhere and put in mapBlockIndex (by the tests) are freed with delete.
+ * A chunk fills a huge page, and is mapped by HugePageMap with -hugepages. Guarded by cs_main.
+ */
+class CBlockIndexArena
+{
+public:
+    static const size_t CHUNK_ENTRIES = HUGE_PAGE_SIZE / sizeof(CBlockIndex);
+
+    template <typename... Args>
+    CBlockIndex* New(Args&&... args)
+    {
+        if (pchunk == nullptr || nUsed == CHUNK_ENTRIES)
+        {
+            const bool fMapped = GetHugePageMode() != HugePageMode::OFF;
+            void* p = fMapped ? HugePageMap(HUGE_PAGE_SIZE) : ::operator new(CHUNK_ENTRIES * sizeof(CBlockIndex));
+            if (p == nullptr)
+                throw std::bad_alloc();
+            pchunk = static_cast<CBlockIndex*>(p);
+            mapChunks.emplace(pchunk, ChunkPtr(pchunk, ChunkDeleter{fMapped}));
+            nUsed = 0;
+        }
+        CBlockIndex* pindex = new (pchunk + nUsed) CBlockIndex(std::forward<Args>(args)...);
+        nUsed++;
+        return pindex;
+    }
+
+    void Delete(CBlockIndex* pindex)
+    {
+        if (Owns(pindex))
+            pindex->~CBlockIndex();
+        else
+            delete pindex;
+    }
+
+    //! Release the chunks, once all of their entries are deleted
+    void Clear()
+    {
+        mapChunks.clear();
+        pchunk = nullptr;
+        nUsed = 0;
+    }
+
+private:
+    struct ChunkDeleter
+    {
+        bool fMapped;
+        void operator()(CBlockIndex* p) const
+        {
+            if (fMapped)
+                HugePageUnmap(p, HUGE_PAGE_SIZE);
+            else
+                ::operator delete(p);
+        }
+    };
+    typedef std::unique_ptr<CBlockIndex, ChunkDeleter> ChunkPtr;
+
+    //! by address, to tell the chunk an entry belongs to
+    std::map<const CBlockIndex*, ChunkPtr> mapChunks;
+    CBlockIndex* pchunk = nullptr;
+    size_t nUsed = 0;
+
+    bool Owns(const CBlockIndex* pindex) const
+    {
+        auto it = mapChunks.upper_bound(pindex);
+        if (it == mapChunks.begin())
+            return false;
+        --it;
+        return pindex < it->first + CHUNK_ENTRIES;
+    }
+} blockIndexArena;
+
+/**
+ * The finality index of the blocks of the active chain younger than MAX_BLOCK_AGE_FOR_FINALITY.
+ * A fork tip only competes with the blocks above its fork base, and its gap does not depend on the
+ * block: the finality index of the block at height h is the minimum of the main chain gap of h and
+ * of the gaps of the tips forking below h, which is kept as a minimum over fork base heights.
+ * The fork base of each tip is kept until the active chain loses a block, and the table is rebuilt
+ * by the first query after the global fork tips or the active tip change. Guarded by cs_main.
+ */
+class CFinalityIndex
+{
+public:
+    void SetForkTipsChanged() { fStale = true; }
+
+    void SetChainTipChanged(const CBlockIndex* pindexOldTip, const CBlockIndex* pindexNewTip)
+    {
+        fStale = true;
+        if (pindexOldTip == NULL || pindexNewTip == NULL || pindexNewTip->pprev != pindexOldTip) {
+            mapForkBase.clear();
+            return;
+        }
+        // extending the chain only moves up the fork base of the tips built on the old tip
+        for (auto it = mapForkBase.begin(); it != mapForkBase.end(); ) {
+            if (it->second == pindexOldTip->nHeight)
+                it = mapForkBase.erase(it);
+            else
+                ++it;
+        }
+    }
+
+    void Clear()
+    {
+        mapForkBase.clear();
+        vMinForkGap.clear();
+        fStale = true;
+    }
+
+    //! pindex must be on the active chain, younger than MAX_BLOCK_AGE_FOR_FINALITY
+    int64_t Get(const CBlockIndex* pindex)
+    {
+        if (fStale || nTableHeight != chainActive.Height())
+            Rebuild();
+        return std::min(MainChainOvertakeGap(pindex->nHeight, nTableHeight), vMinForkGap[pindex->nHeight - nTableLowHeight]);
+    }
+
+private:
+    bool fStale = true;
+    int nTableHeight = -1;
+    //! the lowest height of a block finality can be told for
+    int nTableLowHeight = 0;
+    //! vMinForkGap[i]: the minimum gap of the fork tips forking below height nTableLowHeight + i
+    std::vector<int64_t> vMinForkGap;
+    std::map<const CBlockIndex*, int> mapForkBase;
+
+    void Rebuild()
+    {
+        const int nHeight = chainActive.Height();
+        nTableHeight = nHeight;
+        nTableLowHeight = std::max(nHeight - MAX_BLOCK_AGE_FOR_FINALITY + 2, 0);
+        vMinForkGap.assign(nHeight - nTableLowHeight + 2, std::numeric_limits<int64_t>::max());
+
+        std::map<const CBlockIndex*, int> mapForkBaseNew;
+        for (const auto& mapPair: mGlobalForkTips) {
+            const CBlockIndex* forkTip = mapPair.first;
+            // the most recent tips only, blocks are ordered by height
+            if (nHeight - forkTip->nHeight >= MAX_BLOCK_AGE_FOR_FINALITY)
+                break;
+            auto it = mapForkBase.find(forkTip);
+            const int nForkBase = (it != mapForkBase.end()) ? it->second : chainActive.FindFork(forkTip)->nHeight;
+            mapForkBaseNew.emplace(forkTip, nForkBase);
+
+            // the tip competes with the blocks above its fork base
+            const int nIndex = std::max(nForkBase + 1 - nTableLowHeight, 0);
+            if (nIndex < (int)vMinForkGap.size())
+                vMinForkGap[nIndex] = std::min(vMinForkGap[nIndex], ForkTipOvertakeGap(forkTip, nHeight));
+        }
+        mapForkBase.swap(mapForkBaseNew);
+
+        for (size_t i = 1; i < vMinForkGap.size(); i++)
+            vMinForkGap[i] = std::min(vMinForkGap[i], vMinForkGap[i - 1]);
+        fStale = false;
+    }
+} finalityIndex;
+
+} // anon namespace
 CBlockIndex *pindexBestHeader = NULL;
 int64_t nTimeBestReceived = 0;
 CWaitableCriticalSection csBestBlock;
 CConditionVariable cvBlockChange;
 int nScriptCheckThreads = 0;
+int nParallelHeaders = DEFAULT_PARALLEL_HEADERS;
 bool fExperimentalMode = false;
 bool fImporting = false;
 std::atomic<bool> fReindex = false;
@@ -90,14 +281,19 @@ bool fTimestampIndex = false;
 bool fSpentIndex = false;
 
 bool fHavePruned = false;
+bool fTxOutSetSnapshot = false;
 bool fPruneMode = false;
+bool fPruneToArchive = false;
 bool fIsBareMultisigStd = true;
 bool fCheckBlockIndex = false;
+unsigned int nCheckBlockIndexFullInterval = DEFAULT_CHECKBLOCKINDEX_FULL_INTERVAL;
 bool fCheckpointsEnabled = true;
+uint256 hashAssumeValid;
 bool fRegtestAllowDustOutput = true;
 //true in case we still have not reached the highest known block from server startup
 bool fIsStartupSyncing = true;
 size_t nCoinCacheUsage = 5000 * 300;
+size_t nScCacheUsage = DEFAULT_SC_CACHE_SIZE << 20;
 uint64_t nPruneTarget = 0;
 
 
@@ -109,10 +305,9 @@ std::unique_ptr<CTxMemPool> mempool;
 
 std::unique_ptr<CConnman> connman;
 
-map<uint256, COrphanTx> mapOrphanTransactions GUARDED_BY(cs_main);;
-map<uint256, set<uint256> > mapOrphanTransactionsByPrev GUARDED_BY(cs_main);;
+COrphanPool orphanPool GUARDED_BY(cs_main);
 
-void EraseOrphansFor(NodeId peer) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
+CTxRequestTracker txRequestTracker GUARDED_BY(cs_main);
 
 static void CheckBlockIndex();
 
@@ -181,6 +376,8 @@ namespace {
     set<CBlockIndex*, CBlockIndexWorkComparator> setBlockIndexCandidates;
     /** Number of nodes with fSyncStarted. */
     int nSyncStarted = 0;
+    /** The headers between the checkpoints, fetched from several peers at once. */
+    CHeaderRanges headerRanges;
     /** All pairs A->B, where A (or one if its ancestors) misses transactions, but B has transactions.
       * Pruned nodes may have entries where B is missing data.
       */
@@ -210,6 +407,13 @@ namespace {
      */
     map<uint256, NodeId> mapBlockSource;
 
+    /**
+     * The blocks received unrequested from a peer with fast relay, before
+     * their full validation by that peer, and the peer which sent them: it
+     * loses fast relay if one of them proves invalid. Protected by cs_main.
+     */
+    map<uint256, NodeId> mapFastRelayedBlocks;
+
     /**
      * Filter for transactions that were recently rejected by
      * AcceptToMemoryPool. These are not rerequested until the chain tip
@@ -252,8 +456,21 @@ namespace {
     /** Dirty block index entries. */
     set<CBlockIndex*> setDirtyBlockIndex;
 
+    /**
+     * Block index entries changed since the last CheckBlockIndex, with the dirty ones already written, which
+     * are the ones the checks between two full ones are run on. Only filled with -checkblockindex.
+     */
+    set<CBlockIndex*> setBlockIndexToCheck;
+    /** The tip at the last CheckBlockIndex. */
+    CBlockIndex* pindexLastCheckedTip = NULL;
+    /** The number of CheckBlockIndex calls, every nCheckBlockIndexFullInterval-th of which checks the whole tree. */
+    unsigned int nCheckBlockIndexCalls = 0;
+
     /** Dirty block file entries. */
     set<int> setDirtyFileInfo;
+
+    /** The logical timestamps of chainActive, for the queries of the timestamp index on it. */
+    CChainLogicalTimes chainActiveLogicalTimes;
 } // anon namespace
 
 //////////////////////////////////////////////////////////////////////////////
@@ -303,6 +520,22 @@ struct CNodeState {
     int nBlocksInFlightValidHeaders;
     //! Whether we consider this a preferred download peer.
     bool fPreferredDownload;
+    //! Block download throughput from this peer, moving average in bytes per second.
+    double dBlockBytesPerSec;
+    //! Average size of the blocks received from this peer.
+    double dAvgBlockBytes;
+    //! Time between a block request and its reception, moving average in microseconds.
+    int64_t nBlockLatency;
+    //! Number of requested blocks received from this peer, and the time the last one arrived.
+    int nBlocksDownloaded;
+    int64_t nLastBlockReceived;
+    //! The block being rebuilt from the last compact block received from this peer, if any.
+    std::shared_ptr<PartiallyDownloadedBlock> partialBlock;
+    uint256 hashPartialBlock;
+    //! Whether the blocks this peer requests are sent compressed, as it sent "sendcmpr".
+    bool fCompressedBlocks;
+    //! Whether the blocks extending our tip are pushed to and accepted from this peer before their full validation, as it sent "sendfastrelay".
+    bool fFastRelay;
 
     CNodeState() {
         fCurrentlyConnected = false;
@@ -316,6 +549,13 @@ struct CNodeState {
         nBlocksInFlight = 0;
         nBlocksInFlightValidHeaders = 0;
         fPreferredDownload = false;
+        dBlockBytesPerSec = 0;
+        dAvgBlockBytes = 0;
+        nBlockLatency = 0;
+        nBlocksDownloaded = 0;
+        nLastBlockReceived = 0;
+        fCompressedBlocks = false;
+        fFastRelay = false;
     }
 };
 
@@ -372,7 +612,9 @@ void FinalizeNode(NodeId nodeid) {
 
     BOOST_FOREACH(const QueuedBlock& entry, state->vBlocksInFlight)
         mapBlocksInFlight.erase(entry.hash);
-    EraseOrphansFor(nodeid);
+    orphanPool.EraseForPeer(nodeid);
+    txRequestTracker.DisconnectedPeer(nodeid);
+    headerRanges.Release(nodeid, false, false);
     nPreferredDownload -= state->fPreferredDownload;
 
     mapNodeState.erase(nodeid);
@@ -388,6 +630,10 @@ bool MarkBlockAsReceived(const uint256& hash) {
         state->nBlocksInFlightValidHeaders -= itInFlight->second.second->fValidatedHeaders;
         state->vBlocksInFlight.erase(itInFlight->second.second);
         state->nBlocksInFlight--;
+        if (state->hashPartialBlock == hash) {
+            state->partialBlock.reset();
+            state->hashPartialBlock.SetNull();
+        }
         state->nStallingSince = 0;
         mapBlocksInFlight.erase(itInFlight);
         return true;
@@ -412,6 +658,61 @@ void MarkBlockAsInFlight(NodeId nodeid, const uint256& hash, const Consensus::Pa
     mapBlocksInFlight[hash] = std::make_pair(nodeid, it);
 }
 
+// Requires cs_main.
+// Update the download statistics of the peer a requested block of nBytes has been received from.
+void RecordBlockDownload(NodeId nodeid, const uint256& hash, unsigned int nBytes) {
+    map<uint256, pair<NodeId, list<QueuedBlock>::iterator> >::iterator itInFlight = mapBlocksInFlight.find(hash);
+    if (itInFlight == mapBlocksInFlight.end() || itInFlight->second.first != nodeid)
+        return;
+    CNodeState *state = State(nodeid);
+    assert(state != NULL);
+
+    // With several blocks in flight the transfers are pipelined: the time spent on this block is
+    // the time since it was requested or since the previous block arrived, whichever is later.
+    int64_t nNow = GetTimeMicros();
+    int64_t nRequested = itInFlight->second.second->nTime;
+    int64_t nLatency = std::max<int64_t>(nNow - nRequested, 1);
+    int64_t nTransfer = std::max<int64_t>(nNow - std::max(nRequested, state->nLastBlockReceived), 1);
+    double dBytesPerSec = nBytes * 1e6 / nTransfer;
+
+    // exponential moving averages, seeded with the first sample
+    static const double alpha = 0.25;
+    if (state->nBlocksDownloaded == 0) {
+        state->dBlockBytesPerSec = dBytesPerSec;
+        state->dAvgBlockBytes = nBytes;
+        state->nBlockLatency = nLatency;
+    } else {
+        state->dBlockBytesPerSec += alpha * (dBytesPerSec - state->dBlockBytesPerSec);
+        state->dAvgBlockBytes += alpha * (nBytes - state->dAvgBlockBytes);
+        state->nBlockLatency += (int64_t)(alpha * (nLatency - state->nBlockLatency));
+    }
+    state->nBlocksDownloaded++;
+    state->nLastBlockReceived = nNow;
+}
+
+// Requires cs_main.
+// Returns how many blocks may be in flight from this peer: enough to keep it busy for
+// BLOCK_DOWNLOAD_TARGET_SECONDS at its measured throughput.
+int GetBlockDownloadWindow(const CNodeState* state) {
+    if (state->nBlocksDownloaded < MIN_BLOCK_DOWNLOAD_SAMPLES || state->dAvgBlockBytes <= 0)
+        return MAX_BLOCKS_IN_TRANSIT_PER_PEER;
+    double dWindow = state->dBlockBytesPerSec * BLOCK_DOWNLOAD_TARGET_SECONDS / state->dAvgBlockBytes;
+    if (dWindow < MIN_BLOCKS_IN_TRANSIT_PER_PEER)
+        return MIN_BLOCKS_IN_TRANSIT_PER_PEER;
+    if (dWindow > MAX_BLOCKS_IN_TRANSIT_PER_FAST_PEER)
+        return MAX_BLOCKS_IN_TRANSIT_PER_FAST_PEER;
+    return (int)dWindow;
+}
+
+// Requires cs_main.
+// Returns the inventory type to use when asking this peer for a block near the tip.
+int GetBlockFetchType(const CNode* pnode) {
+    if ((connman->GetLocalServices() & NODE_COMPACT_BLOCKS) && (pnode->nServices & NODE_COMPACT_BLOCKS) &&
+        !IsInitialBlockDownload())
+        return MSG_CMPCT_BLOCK;
+    return MSG_BLOCK;
+}
+
 /** Check whether the last unknown block a peer advertized is not yet known. */
 void ProcessBlockAvailability(NodeId nodeid) {
     CNodeState *state = State(nodeid);
@@ -465,8 +766,10 @@ CBlockIndex* LastCommonAncestor(CBlockIndex* pa, CBlockIndex* pb) {
 }
 
 /** Update pindexLastCommonBlock and add not-in-flight missing successors to vBlocks, until it has
- *  at most count entries. */
-void FindNextBlocksToDownload(NodeId nodeid, unsigned int count, std::vector<CBlockIndex*>& vBlocks, NodeId& nodeStaller) {
+ *  at most count entries. When the window is held back by another peer, nodeStaller is set to that
+ *  peer and pindexStalled to the block it has not delivered yet. */
+void FindNextBlocksToDownload(NodeId nodeid, unsigned int count, std::vector<CBlockIndex*>& vBlocks, NodeId& nodeStaller,
+                              CBlockIndex** pindexStalled = NULL) {
     if (count == 0)
     {
         LogPrint("forks", "%s():%d - peer has too many blocks in fligth\n", __func__, __LINE__);
@@ -505,6 +808,7 @@ void FindNextBlocksToDownload(NodeId nodeid, unsigned int count, std::vector<CBl
     int nWindowEnd = state->pindexLastCommonBlock->nHeight + BLOCK_DOWNLOAD_WINDOW;
     int nMaxHeight = std::min<int>(state->pindexBestKnownBlock->nHeight, nWindowEnd + 1);
     NodeId waitingfor = -1;
+    CBlockIndex* pindexWaitingFor = NULL;
     while (pindexWalk->nHeight < nMaxHeight) {
         // Read up to 128 (or more, if more blocks than that are needed) successors of pindexWalk (towards
         // pindexBestKnownBlock) into vToFetch. We fetch 128, because CBlockIndex::GetAncestor may be as expensive
@@ -536,6 +840,8 @@ void FindNextBlocksToDownload(NodeId nodeid, unsigned int count, std::vector<CBl
                     if (vBlocks.size() == 0 && waitingfor != nodeid) {
                         // We aren't able to fetch anything, but we would be if the download window was one larger.
                         nodeStaller = waitingfor;
+                        if (pindexStalled)
+                            *pindexStalled = pindexWaitingFor;
                     }
                     LogPrint("forks", "%s():%d - could not fetch [%s]\n", __func__, __LINE__, pindex->GetBlockHash().ToString() );
                     return;
@@ -547,6 +853,7 @@ void FindNextBlocksToDownload(NodeId nodeid, unsigned int count, std::vector<CBl
             } else if (waitingfor == -1) {
                 // This is the first already-in-flight block.
                 waitingfor = mapBlocksInFlight[pindex->GetBlockHash()].first;
+                pindexWaitingFor = pindex;
             }
         }
     }
@@ -566,9 +873,67 @@ bool GetNodeStateStats(NodeId nodeid, CNodeStateStats &stats) {
         if (queue.pindex)
             stats.vHeightInFlight.push_back(queue.pindex->nHeight);
     }
+    stats.dBlockBytesPerSec = state->dBlockBytesPerSec;
+    stats.nBlockLatency = state->nBlockLatency;
+    stats.nBlockWindow = GetBlockDownloadWindow(state);
     return true;
 }
 
+//! Only accessed through std::atomic_load and std::atomic_store
+static std::shared_ptr<const CPeerStatsSnapshot> peerStatsSnapshot;
+//! One snapshot is taken at a time
+static std::mutex csPublishPeerStats;
+
+std::shared_ptr<const CPeerStatsSnapshot> PublishPeerStats(bool fWaitForState)
+{
+    std::lock_guard<std::mutex> lock(csPublishPeerStats);
+    std::shared_ptr<CPeerStatsSnapshot> snapshot = std::make_shared<CPeerStatsSnapshot>();
+    snapshot->nTime = GetTime();
+    std::vector<CNodeStats> vstats;
+    connman->CopyNodeStats(vstats, snapshot->nNodesGeneration);
+    snapshot->vPeers.resize(vstats.size());
+    for (size_t i = 0; i < vstats.size(); i++)
+        snapshot->vPeers[i].stats = std::move(vstats[i]);
+
+    auto fillStateStats = [&snapshot] {
+        for (CPeerStats& peer : snapshot->vPeers)
+            peer.fStateStats = GetNodeStateStats(peer.stats.nodeid, peer.statestats);
+    };
+    if (fWaitForState) {
+        LOCK(cs_main);
+        fillStateStats();
+    } else {
+        TRY_LOCK(cs_main, lockMain);
+        if (lockMain) {
+            fillStateStats();
+        } else if (std::shared_ptr<const CPeerStatsSnapshot> previous = std::atomic_load(&peerStatsSnapshot)) {
+            // cs_main is held, as while a block is connected: the state stats are not waited for
+            std::map<NodeId, const CPeerStats*> mapPrevious;
+            for (const CPeerStats& peer : previous->vPeers)
+                mapPrevious[peer.stats.nodeid] = &peer;
+            for (CPeerStats& peer : snapshot->vPeers) {
+                auto it = mapPrevious.find(peer.stats.nodeid);
+                if (it != mapPrevious.end()) {
+                    peer.fStateStats = it->second->fStateStats;
+                    peer.statestats = it->second->statestats;
+                }
+            }
+        }
+    }
+
+    std::shared_ptr<const CPeerStatsSnapshot> published = snapshot;
+    std::atomic_store(&peerStatsSnapshot, published);
+    return published;
+}
+
+std::shared_ptr<const CPeerStatsSnapshot> GetPeerStatsSnapshot()
+{
+    std::shared_ptr<const CPeerStatsSnapshot> snapshot = std::atomic_load(&peerStatsSnapshot);
+    if (!snapshot || snapshot->nNodesGeneration != connman->GetNodesGeneration())
+        return PublishPeerStats(true);
+    return snapshot;
+}
+
 void RegisterNodeSignals(CNodeSignals& nodeSignals)
 {
     nodeSignals.GetHeight.connect(&GetHeight);
@@ -587,6 +952,23 @@ void UnregisterNodeSignals(CNodeSignals& nodeSignals)
     nodeSignals.FinalizeNode.disconnect(&FinalizeNode);
 }
 
+CBlockIndex* GetPublishedChainTip()
+{
+    return pindexPublishedTip;
+}
+
+CBlockIndex* LookupBlockIndex(const uint256& hash)
+{
+    boost::shared_lock<boost::shared_mutex> lockMap(csBlockIndexMap);
+    BlockMap::const_iterator mi = mapBlockIndex.find(hash);
+    return mi == mapBlockIndex.end() ? NULL : mi->second;
+}
+
+bool IsInPublishedChain(const CBlockIndex* pindex, const CBlockIndex* pindexTip)
+{
+    return pindex && pindexTip && pindexTip->GetAncestor(pindex->nHeight) == pindex;
+}
+
 CBlockIndex* FindForkInGlobalIndex(const CChain& chain, const CBlockLocator& locator)
 {
     // Find the first block the caller has in the main chain
@@ -603,93 +985,9 @@ CBlockIndex* FindForkInGlobalIndex(const CChain& chain, const CBlockLocator& loc
 }
 
 CCoinsViewCache *pcoinsTip = NULL;
+CCoinsViewBackgroundFlush *pcoinsFlusher = NULL;
 CBlockTreeDB *pblocktree = NULL;
 
-//////////////////////////////////////////////////////////////////////////////
-//
-// mapOrphanTransactions
-//
-
-bool AddOrphanTx(const CTransactionBase& txObj, NodeId peer) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
-{
-    uint256 hash = txObj.GetHash();
-    if (mapOrphanTransactions.count(hash))
-        return false;
-
-    // Ignore big transactions, to avoid a
-    // send-big-orphans memory exhaustion attack. If a peer has a legitimate
-    // large transaction with a missing parent then we assume
-    // it will rebroadcast it later, after the parent transaction(s)
-    // have been mined or received.
-    // 10,000 orphans, each of which is at most 5,000 bytes big is
-    // at most 500 megabytes of orphans:
-    unsigned int sz = txObj.GetSerializeSize(SER_NETWORK, PROTOCOL_VERSION);
-    if (sz > 5000)
-    {
-        LogPrint("mempool", "ignoring large orphan tx (size: %u, hash: %s)\n", sz, hash.ToString());
-        return false;
-    }
-
-    mapOrphanTransactions[hash].tx = txObj.MakeShared();
-    mapOrphanTransactions[hash].fromPeer = peer;
-    BOOST_FOREACH(const CTxIn& txin, txObj.GetVin())
-        mapOrphanTransactionsByPrev[txin.prevout.hash].insert(hash);
-
-    LogPrint("mempool", "stored orphan tx %s (mapsz %u prevsz %u)\n", hash.ToString(),
-             mapOrphanTransactions.size(), mapOrphanTransactionsByPrev.size());
-    return true;
-}
-
-void static EraseOrphanTx(uint256 hash) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
-{
-    map<uint256, COrphanTx>::iterator it = mapOrphanTransactions.find(hash);
-    if (it == mapOrphanTransactions.end())
-        return;
-    BOOST_FOREACH(const CTxIn& txin, it->second.tx->GetVin())
-    {
-        map<uint256, set<uint256> >::iterator itPrev = mapOrphanTransactionsByPrev.find(txin.prevout.hash);
-        if (itPrev == mapOrphanTransactionsByPrev.end())
-            continue;
-        itPrev->second.erase(hash);
-        if (itPrev->second.empty())
-            mapOrphanTransactionsByPrev.erase(itPrev);
-    }
-    mapOrphanTransactions.erase(it);
-}
-
-void EraseOrphansFor(NodeId peer)
-{
-    int nErased = 0;
-    map<uint256, COrphanTx>::iterator iter = mapOrphanTransactions.begin();
-    while (iter != mapOrphanTransactions.end())
-    {
-        map<uint256, COrphanTx>::iterator maybeErase = iter++; // increment to avoid iterator becoming invalid
-        if (maybeErase->second.fromPeer == peer)
-        {
-            EraseOrphanTx(maybeErase->second.tx->GetHash());
-            ++nErased;
-        }
-    }
-    if (nErased > 0) LogPrint("mempool", "Erased %d orphan tx from peer %d\n", nErased, peer);
-}
-
-
-unsigned int LimitOrphanTxSize(unsigned int nMaxOrphans) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
-{
-    unsigned int nEvicted = 0;
-    while (mapOrphanTransactions.size() > nMaxOrphans)
-    {
-        // Evict a random orphan:
-        uint256 randomhash = GetRandHash();
-        map<uint256, COrphanTx>::iterator it = mapOrphanTransactions.lower_bound(randomhash);
-        if (it == mapOrphanTransactions.end())
-            it = mapOrphanTransactions.begin();
-        EraseOrphanTx(it->first);
-        ++nEvicted;
-    }
-    return nEvicted;
-}
-
 
 bool IsStandardTx(const CTransactionBase& txBase, string& reason, const int nHeight)
 {
@@ -987,9 +1285,10 @@ std::map<uint256, uint256> HighQualityCertData(const CBlock& blockToConnect, con
         if (visitedScIds.count(itCert->GetScId()) != 0)
             continue;
 
-        CSidechain sidechain;
-        if(!view.GetSidechain(itCert->GetScId(), sidechain))
+        const CSidechain* const pSidechain = view.AccessSidechain(itCert->GetScId());
+        if (pSidechain == nullptr)
             continue;
+        const CSidechain& sidechain = *pSidechain;
 
         if (itCert->epochNumber == sidechain.lastTopQualityCertReferencedEpoch)
         {
@@ -1191,8 +1490,38 @@ void RejectMemoryPoolTxBase(const CValidationState& state, const CTransactionBas
         Misbehaving(pfrom->GetId(), state.GetDoS());
 }
 
+static CCheckQueue<CScriptCheck> scriptcheckqueue(128);
+// one proof takes milliseconds to verify, so each is a batch of its own
+static CCheckQueue<CJoinSplitCheck> joinsplitcheckqueue(1);
+
+/**
+ * Run the script checks of a tx/cert entering the mempool. If it has enough inputs, they are spread over the
+ * script check threads, which are otherwise only used by ConnectBlock; both callers hold cs_main, hence the queue
+ * is never shared. On a script failure the checks are run serially again, so that state gets the detailed reason.
+ */
+static bool CheckMempoolInputs(unsigned int nInputs, const std::function<bool(std::vector<CScriptCheck>*)>& checkInputs)
+{
+    AssertLockHeld(cs_main);
+    if (nScriptCheckThreads == 0 || nInputs < MIN_INPUTS_FOR_PARALLEL_MEMPOOL_CHECKS)
+        return checkInputs(nullptr);
+
+    {
+        std::vector<CScriptCheck> vChecks;
+        CCheckQueueControl<CScriptCheck> control(&scriptcheckqueue);
+        if (!checkInputs(&vChecks))
+            return false;
+
+        control.Add(vChecks);
+        if (control.Wait())
+            return true;
+    }
+
+    return checkInputs(nullptr);
+}
+
 MempoolReturnValue AcceptCertificateToMemoryPool(CTxMemPool& pool, CValidationState &state, const CScCertificate &cert,
-    LimitFreeFlag fLimitFree, RejectAbsurdFeeFlag fRejectAbsurdFee, MempoolProofVerificationFlag fProofVerification, CNode* pfrom)
+    LimitFreeFlag fLimitFree, RejectAbsurdFeeFlag fRejectAbsurdFee, MempoolProofVerificationFlag fProofVerification, CNode* pfrom,
+    ResurrectionFlag fResurrection, int64_t nAcceptTime)
 {
     AssertLockHeld(cs_main);
 
@@ -1309,12 +1638,13 @@ MempoolReturnValue AcceptCertificateToMemoryPool(CTxMemPool& pool, CValidationSt
 
             nFees = cert.GetFeeAmount(view.GetValueIn(cert));
 
-            CSidechain sc;
-            if (!view.GetSidechain(cert.GetScId(), sc))
+            const CSidechain* const pSidechain = view.AccessSidechain(cert.GetScId());
+            if (pSidechain == nullptr)
             {
                 LogPrint("mempool", "%s():%d - ERROR: cert[%s] refers to a non existing sidechain[%s]\n", __func__, __LINE__, certHash.ToString(), cert.GetScId().ToString());
                 return MempoolReturnValue::INVALID;
             }
+            const CSidechain& sc = *pSidechain;
 
             if (sc.isNonCeasing() && pool.certificateExists(cert.GetScId()))
             {
@@ -1362,7 +1692,7 @@ MempoolReturnValue AcceptCertificateToMemoryPool(CTxMemPool& pool, CValidationSt
         double dPriority = view.GetPriority(cert, chainActive.Height());
         LogPrint("mempool", "%s():%d - Computed fee=%lld, prio[%22.8f]\n", __func__, __LINE__, nFees, dPriority);
 
-        CCertificateMemPoolEntry entry(cert, nFees, GetTime(), dPriority, chainActive.Height());
+        CCertificateMemPoolEntry entry(cert, nFees, nAcceptTime ? nAcceptTime : GetTime(), dPriority, chainActive.Height());
         unsigned int nSize = entry.GetCertificateSize();
 
         // Don't accept it if it can't get into a block
@@ -1422,7 +1752,9 @@ MempoolReturnValue AcceptCertificateToMemoryPool(CTxMemPool& pool, CValidationSt
 
         // Check against previous transactions
         // This is done last to help prevent CPU exhaustion denial-of-service attacks.
-        if (!ContextualCheckCertInputs(cert, state, view, true, chainActive, STANDARD_CONTEXTUAL_SCRIPT_VERIFY_FLAGS, true, Params().GetConsensus()))
+        if (!CheckMempoolInputs(cert.GetVin().size(), [&](std::vector<CScriptCheck>* pvChecks) {
+                return ContextualCheckCertInputs(cert, state, view, true, chainActive, STANDARD_CONTEXTUAL_SCRIPT_VERIFY_FLAGS, true, Params().GetConsensus(), pvChecks);
+            }))
         {
             LogPrintf("%s():%d - ERROR: ConnectInputs failed, cert[%s]\n", __func__, __LINE__, certHash.ToString());
             return MempoolReturnValue::INVALID;
@@ -1437,13 +1769,23 @@ MempoolReturnValue AcceptCertificateToMemoryPool(CTxMemPool& pool, CValidationSt
         // There is a similar check in CreateNewBlock() to prevent creating
         // invalid blocks, however allowing such transactions into the mempool
         // can be exploited as a DoS attack.
-        if (!ContextualCheckCertInputs(cert, state, view, true, chainActive, MANDATORY_SCRIPT_VERIFY_FLAGS, true, Params().GetConsensus()))
+        //
+        // A resurrected certificate passed the block flags when its block was connected, and the
+        // mandatory flags are a subset of them which does not depend on the chain.
+        if (fResurrection == ResurrectionFlag::OFF &&
+            !ContextualCheckCertInputs(cert, state, view, true, chainActive, MANDATORY_SCRIPT_VERIFY_FLAGS, true, Params().GetConsensus()))
         {
             LogPrintf("%s():%d - BUG! PLEASE REPORT THIS! ConnectInputs failed against MANDATORY but not STANDARD flags, cert[%s]\n",
                                 __func__, __LINE__, certHash.ToString());
             return MempoolReturnValue::INVALID;
         }
 
+        // The standard flags include the block ones and each flag only rejects more scripts,
+        // hence the scripts pass in the blocks to come too
+        static_assert((STANDARD_CONTEXTUAL_SCRIPT_VERIFY_FLAGS & BLOCK_SCRIPT_VERIFY_FLAGS) == BLOCK_SCRIPT_VERIFY_FLAGS,
+                      "the block script flags must be standard");
+        AddToScriptExecutionCache(certHash, BLOCK_SCRIPT_VERIFY_FLAGS);
+
         if (fProofVerification != MempoolProofVerificationFlag::DISABLED) {
             // Check size limitations before proof verification
             if (!pool.trimToSize(&entry, pool.m_max_size, true)) {
@@ -1472,17 +1814,11 @@ MempoolReturnValue AcceptCertificateToMemoryPool(CTxMemPool& pool, CValidationSt
             }
         }
 
-        if (!pool.RemoveCertAndSync(conflictingCertData.first))
-        {
-            state.Invalid(
-                error("%s():%d - Dropping cert %s : depends on some conflicting quality certs\n",
-                    __func__, __LINE__, certHash.ToString()),
-                CValidationState::Code::INVALID, "bad-sc-cert-quality");
-            return MempoolReturnValue::INVALID;
-        }
-
-        // Store transaction in memory
-        if (!pool.addUnchecked(certHash, entry, !IsInitialBlockDownload())) {
+        // Store certificate in memory, in place of the one of the same quality it outbids if any
+        const bool fAdded = conflictingCertData.first.IsNull() ?
+            pool.addUnchecked(certHash, entry, !IsInitialBlockDownload()) :
+            pool.ReplaceCertWithQuality(conflictingCertData.first, certHash, entry, !IsInitialBlockDownload());
+        if (!fAdded) {
             state.DoS(0, false, CValidationState::Code::INSUFFICIENT_FEE, "mempool is full");
             LogPrint("mempool", "Not adding cert %s because mempool is full!\n", certHash.ToString());
             return MempoolReturnValue::MEMPOOL_FULL;
@@ -1503,7 +1839,8 @@ MempoolReturnValue AcceptCertificateToMemoryPool(CTxMemPool& pool, CValidationSt
 }
 
 MempoolReturnValue AcceptTxToMemoryPool(CTxMemPool& pool, CValidationState &state, const CTransaction &tx, LimitFreeFlag fLimitFree,
-                        RejectAbsurdFeeFlag fRejectAbsurdFee, MempoolProofVerificationFlag fProofVerification, CNode* pfrom)
+                        RejectAbsurdFeeFlag fRejectAbsurdFee, MempoolProofVerificationFlag fProofVerification, CNode* pfrom,
+                        ResurrectionFlag fResurrection, int64_t nAcceptTime)
 {
     AssertLockHeld(cs_main);
 
@@ -1517,7 +1854,8 @@ MempoolReturnValue AcceptTxToMemoryPool(CTxMemPool& pool, CValidationState &stat
         return MempoolReturnValue::INVALID;
     }
 
-    auto verifier = libzcash::ProofVerifier::Strict();
+    // The JoinSplit proofs of a resurrected transaction were verified when its block was connected
+    auto verifier = fResurrection == ResurrectionFlag::ON ? libzcash::ProofVerifier::Disabled() : libzcash::ProofVerifier::Strict();
     if (!CheckTransaction(tx, state, verifier))
     {
         error("%s(): CheckTransaction failed", __func__);
@@ -1699,7 +2037,7 @@ MempoolReturnValue AcceptTxToMemoryPool(CTxMemPool& pool, CValidationState &stat
         double dPriority = view.GetPriority(tx, chainActive.Height());
         LogPrint("mempool", "%s():%d - tx[%s], Computed fee=%lld, prio[%22.8f]\n", __func__, __LINE__, hash.ToString(), nFees, dPriority);
 
-        CTxMemPoolEntry entry(tx, nFees, GetTime(), dPriority, chainActive.Height(), pool.HasNoInputsOf(tx));
+        CTxMemPoolEntry entry(tx, nFees, nAcceptTime ? nAcceptTime : GetTime(), dPriority, chainActive.Height(), pool.HasNoInputsOf(tx));
         unsigned int nSize = entry.GetTxSize();
 
         // Accept a tx if it contains joinsplits and has at least the default fee specified by z_sendmany.
@@ -1768,7 +2106,9 @@ MempoolReturnValue AcceptTxToMemoryPool(CTxMemPool& pool, CValidationState &stat
 
         // Check against previous transactions
         // This is done last to help prevent CPU exhaustion denial-of-service attacks.
-        if (!ContextualCheckTxInputs(tx, state, view, true, chainActive, STANDARD_CONTEXTUAL_SCRIPT_VERIFY_FLAGS, true, Params().GetConsensus()))
+        if (!CheckMempoolInputs(tx.GetVin().size() + tx.GetVcswCcIn().size(), [&](std::vector<CScriptCheck>* pvChecks) {
+                return ContextualCheckTxInputs(tx, state, view, true, chainActive, STANDARD_CONTEXTUAL_SCRIPT_VERIFY_FLAGS, true, Params().GetConsensus(), pvChecks);
+            }))
         {
             error("%s(): ConnectInputs failed %s", __func__, hash.ToString());
             return MempoolReturnValue::INVALID;
@@ -1783,12 +2123,21 @@ MempoolReturnValue AcceptTxToMemoryPool(CTxMemPool& pool, CValidationState &stat
         // There is a similar check in CreateNewBlock() to prevent creating
         // invalid blocks, however allowing such transactions into the mempool
         // can be exploited as a DoS attack.
-        if (!ContextualCheckTxInputs(tx, state, view, true, chainActive, MANDATORY_SCRIPT_VERIFY_FLAGS, true, Params().GetConsensus()))
+        //
+        // A resurrected transaction passed the block flags when its block was connected, and the
+        // mandatory flags are a subset of them which does not depend on the chain.
+        static_assert((BLOCK_SCRIPT_VERIFY_FLAGS & MANDATORY_SCRIPT_VERIFY_FLAGS) == MANDATORY_SCRIPT_VERIFY_FLAGS &&
+                      !(MANDATORY_SCRIPT_VERIFY_FLAGS & CONTEXTUAL_SCRIPT_VERIFY_FLAGS), "the mandatory script flags must be block and non contextual ones");
+        if (fResurrection == ResurrectionFlag::OFF &&
+            !ContextualCheckTxInputs(tx, state, view, true, chainActive, MANDATORY_SCRIPT_VERIFY_FLAGS, true, Params().GetConsensus()))
         {
             error("%s(): BUG! PLEASE REPORT THIS! ConnectInputs failed against MANDATORY but not STANDARD flags %s", __func__,  hash.ToString());
             return MempoolReturnValue::INVALID;
         }
 
+        // As for certificates, the scripts pass in the blocks to come too
+        AddToScriptExecutionCache(hash, BLOCK_SCRIPT_VERIFY_FLAGS);
+
         // Run the proof verification only if there is at least one CSW input.
         if (tx.GetVcswCcIn().size() > 0)
         {
@@ -1873,6 +2222,14 @@ bool GetTimestampIndex(const unsigned int &high, const unsigned int &low, const
     if (!fTimestampIndex)
         return error("Timestamp index not enabled");
 
+    if (fActiveOnly) {
+        // the logical timestamps only depend on the blocks of the chain, the active one is kept in memory
+        LOCK(cs_main);
+        chainActiveLogicalTimes.Sync(chainActive);
+        chainActiveLogicalTimes.FindRange(chainActive, low, high, hashes);
+        return true;
+    }
+
     if (!pblocktree->ReadTimestampIndex(high, low, fActiveOnly, hashes))
         return error("Unable to get hashes for timestamps");
 
@@ -1893,6 +2250,14 @@ bool GetSpentIndex(CSpentIndexKey &key, CSpentIndexValue &value)
     return true;
 }
 
+bool GetBlockInputDeltas(const uint256 &hash, CBlockInputDeltas &deltas)
+{
+    if (!fSpentIndex)
+        return false;
+
+    return pblocktree->ReadBlockInputDeltas(hash, deltas);
+}
+
 bool GetAddressIndex(uint160 addressHash, AddressType type,
                      std::vector<std::pair<CAddressIndexKey, CAddressIndexValue> > &addressIndex, int start, int end)
 {
@@ -1905,6 +2270,30 @@ bool GetAddressIndex(uint160 addressHash, AddressType type,
     return true;
 }
 
+bool GetAddressIndexPage(uint160 addressHash, AddressType type, const CAddressIndexKey* pCursor, bool fReverse,
+                         size_t nMaxTxs, int start, int end,
+                         std::vector<std::pair<CAddressIndexKey, CAddressIndexValue> > &addressIndex, bool &fMore)
+{
+    if (!fAddressIndex)
+        return error("address index not enabled");
+
+    if (!pblocktree->ReadAddressIndexPage(addressHash, type, pCursor, fReverse, nMaxTxs, start, end, addressIndex, fMore))
+        return error("unable to get txids for address");
+
+    return true;
+}
+
+bool GetAddressAggregate(uint160 addressHash, AddressType type, CAddressAggregateValue &aggregate)
+{
+    if (!fAddressIndex || !pblocktree->fAddressAggregates)
+        return false;
+
+    if (!pblocktree->ReadAddressAggregate(addressHash, type, aggregate))
+        return error("unable to get aggregate for address");
+
+    return true;
+}
+
 bool GetAddressUnspent(uint160 addressHash, AddressType type,
                        std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &unspentOutputs)
 {
@@ -1917,108 +2306,298 @@ bool GetAddressUnspent(uint160 addressHash, AddressType type,
     return true;
 }
 
-/** Return transaction in tx, and if it was found inside a block, its hash is placed in hashBlock */
-bool GetTransaction(const uint256 &hash, CTransaction &txOut, uint256 &hashBlock, bool fAllowSlow)
+namespace {
+
+/**
+ * Read-only handles of the block files, shared by the txindex lookups so that these neither reopen
+ * the file on each call nor need cs_main. A handle serves one reader at a time, and the least
+ * recently used one is closed once more than MAX_BLOCK_FILE_READ_HANDLES are open.
+ */
+class CBlockFileReadHandles
 {
-    LOCK(cs_main);
+public:
+    struct Handle
+    {
+        std::mutex cs;
+        FILE* file;
 
-    if (mempool->lookup(hash, txOut))
-        return true;
+        explicit Handle(FILE* fileIn) : file(fileIn) {}
+        ~Handle() { fclose(file); }
+    };
 
-    if (fTxIndex)
+    std::shared_ptr<Handle> Get(int nFile)
     {
-        CTxIndexValue txIndexValue;
-        if (pblocktree->ReadTxIndex(hash, txIndexValue))
-        {
-            CAutoFile file(OpenBlockFile(txIndexValue.txPosition, true), SER_DISK, CLIENT_VERSION);
-            if (file.IsNull())
-                return error("%s: OpenBlockFile failed", __func__);
-            CBlockHeader header;
-            try
-            {
-                file >> header;
-                fseek(file.Get(), txIndexValue.txPosition.nTxOffset, SEEK_CUR);
-                file >> txOut;
-            } catch (const std::exception& e)
-            {
-                return error("%s: Attempt to deserialize tx from disk failed or I/O error - %s", __func__, e.what());
-            }
-            hashBlock = header.GetHash();
-            if (txOut.GetHash() != hash)
-                return error("%s: txid mismatch", __func__);
-            return true;
+        std::lock_guard<std::mutex> lock(cs);
+        auto it = mapHandles.find(nFile);
+        if (it != mapHandles.end()) {
+            lruFiles.splice(lruFiles.begin(), lruFiles, it->second.second);
+            return it->second.first;
         }
-    }
 
-    if (fAllowSlow) // use coin database to locate block that contains transaction, and scan it
-    {
-        CBlockIndex *pindexSlow = nullptr;
-        int nHeight = -1;
-        {
-            CCoinsViewCache &view = *pcoinsTip;
-            const CCoins* coins = view.AccessCoins(hash);
-            if (coins)
-                nHeight = coins->nHeight;
+        boost::filesystem::path path = GetBlockPosFilename(CDiskBlockPos(nFile, 0), "blk");
+        FILE* file = fopen(path.string().c_str(), "rb");
+        if (!file) {
+            LogPrintf("Unable to open file %s\n", path.string());
+            return nullptr;
         }
-        if (nHeight > 0)
-            pindexSlow = chainActive[nHeight];
+        std::shared_ptr<Handle> handle = std::make_shared<Handle>(file);
+        lruFiles.push_front(nFile);
+        mapHandles.emplace(nFile, std::make_pair(handle, lruFiles.begin()));
+        if (mapHandles.size() > MAX_BLOCK_FILE_READ_HANDLES) {
+            // a reader still using it keeps the handle open until it is done
+            mapHandles.erase(lruFiles.back());
+            lruFiles.pop_back();
+        }
+        return handle;
+    }
 
-        if (pindexSlow)
-        {
-            CBlock block;
-            if (ReadBlockFromDisk(block, pindexSlow))
-            {
-                for(const CTransaction &tx: block.vtx)
-                {
-                    if (tx.GetHash() == hash)
-                    {
-                        txOut = tx;
-                        hashBlock = pindexSlow->GetBlockHash();
-                        return true;
-                    }
-                }
+    //! Close the handles of the files, e.g. as they were pruned
+    void Drop(const std::set<int>& setFiles)
+    {
+        std::lock_guard<std::mutex> lock(cs);
+        for (int nFile : setFiles) {
+            auto it = mapHandles.find(nFile);
+            if (it != mapHandles.end()) {
+                lruFiles.erase(it->second.second);
+                mapHandles.erase(it);
             }
         }
     }
 
-    return false;
-}
+private:
+    std::mutex cs;
+    std::list<int> lruFiles;
+    std::map<int, std::pair<std::shared_ptr<Handle>, std::list<int>::iterator>> mapHandles;
+};
 
-/** Return certificate in certOut, and if it was found inside a block, its hash is placed in hashBlock */
-bool GetCertificate(const uint256 &hash, CScCertificate &certOut, uint256 &hashBlock, bool fAllowSlow)
+CBlockFileReadHandles blockFileReadHandles;
+
+/** The block last read from a block file, whose header need not be read again for its other transactions */
+struct CBlockFileCursor
 {
-    LOCK(cs_main);
+    unsigned int nBlockPos = std::numeric_limits<unsigned int>::max();
+    uint256 hashBlock;
+    long nTxsStart = 0;
+    //! The block, if its record is compressed, the transactions then being read from it at nTxsStart
+    CSerializeData vBlock;
 
-    if (mempool->lookup(hash, certOut))
-        return true;
+    //! Whether the transactions are read from vBlock rather than from the file
+    bool InMemory() const { return !vBlock.empty(); }
 
-    if (fTxIndex)
+    CSpanReader Reader(const CDiskTxPos& pos) const
     {
-        CTxIndexValue txIndexValue;
-        if (pblocktree->ReadTxIndex(hash, txIndexValue))
-        {
-            CAutoFile file(OpenBlockFile(txIndexValue.txPosition, true), SER_DISK, CLIENT_VERSION);
-            if (file.IsNull())
-                return error("%s: OpenBlockFile failed", __func__);
-            CBlockHeader header;
-            try
-            {
-                file >> header;
-                fseek(file.Get(), txIndexValue.txPosition.nTxOffset, SEEK_CUR);
-                file >> certOut;
-            } catch (const std::exception& e)
+        if ((size_t)nTxsStart + pos.nTxOffset > vBlock.size())
+            throw std::ios_base::failure(strprintf("offset %u past the end of block %u", pos.nTxOffset, pos.nPos));
+        return CSpanReader(vBlock.data() + nTxsStart + pos.nTxOffset, vBlock.data() + vBlock.size(), SER_DISK, CLIENT_VERSION);
+    }
+};
+
+/**
+ * Position file, on a handle locked by the caller, at the transaction or certificate at pos,
+ * reading the header of its block unless cursor is already in it. For a compressed record, the
+ * block is decompressed in cursor, to be read with its Reader. Throws on I/O errors.
+ */
+void SeekToTxBase(CAutoFile& file, const CDiskTxPos& pos, CBlockFileCursor& cursor)
+{
+    // the handles are kept open, so they do not wait in OpenBlockFile for the block to be written
+    blockFileWriter.WaitForFile(false, pos);
+    clearerr(file.Get());
+    if (cursor.nBlockPos != pos.nPos) {
+        cursor = CBlockFileCursor();
+        // from the size of the record, which tells whether it is compressed
+        if (pos.nPos < sizeof(unsigned int) || fseek(file.Get(), pos.nPos - sizeof(unsigned int), SEEK_SET))
+            throw std::ios_base::failure(strprintf("unable to seek to position %u", pos.nPos));
+        unsigned int nSize;
+        file >> nSize;
+        CBlockHeader header;
+        if (nSize & BLOCK_RECORD_COMPRESSED) {
+            ReadCompressedRecord(file, nSize & ~BLOCK_RECORD_COMPRESSED, MAX_BLOCK_SIZE, cursor.vBlock);
+            CSpanReader reader(cursor.vBlock.data(), cursor.vBlock.data() + cursor.vBlock.size(), SER_DISK, CLIENT_VERSION);
+            reader >> header;
+            cursor.nTxsStart = reader.data() - cursor.vBlock.data();
+        } else {
+            file >> header;
+            cursor.nTxsStart = ftell(file.Get());
+        }
+        cursor.hashBlock = header.GetHash();
+        cursor.nBlockPos = pos.nPos;
+    }
+    if (!cursor.InMemory() && fseek(file.Get(), cursor.nTxsStart + pos.nTxOffset, SEEK_SET))
+        throw std::ios_base::failure(strprintf("unable to seek to offset %u of block %u", pos.nTxOffset, pos.nPos));
+}
+
+/** Read a transaction or certificate at the position given by the txindex, without cs_main */
+template <typename T>
+bool ReadFromTxIndex(const uint256& hash, T& objOut, uint256& hashBlock, bool& fIndexed)
+{
+    fIndexed = false;
+    CTxIndexValue txIndexValue;
+    if (!pblocktree->ReadTxIndex(hash, txIndexValue))
+        return false;
+    fIndexed = true;
+
+    std::shared_ptr<CBlockFileReadHandles::Handle> handle = blockFileReadHandles.Get(txIndexValue.txPosition.nFile);
+    if (!handle)
+        return error("%s: OpenBlockFile failed", __func__);
+    std::lock_guard<std::mutex> lock(handle->cs);
+
+    // the handle stays open after the read, so it is released from the CAutoFile in all cases
+    CAutoFile file(handle->file, SER_DISK, CLIENT_VERSION);
+    CBlockFileCursor cursor;
+    try
+    {
+        SeekToTxBase(file, txIndexValue.txPosition, cursor);
+        if (cursor.InMemory())
+            cursor.Reader(txIndexValue.txPosition) >> objOut;
+        else
+            file >> objOut;
+    } catch (const std::exception& e)
+    {
+        file.release();
+        return error("%s: Attempt to deserialize %s from disk failed or I/O error - %s", __func__, hash.ToString(), e.what());
+    }
+    file.release();
+    hashBlock = cursor.hashBlock;
+    if (objOut.GetHash() != hash)
+        return error("%s: txid mismatch", __func__);
+    return true;
+}
+
+/**
+ * Read the transactions or certificates at the txindex positions vRead, which are in the same block
+ * file and sorted by position, telling them apart by their version.
+ */
+void ReadTxBasesFromBlockFile(const std::vector<std::pair<CDiskTxPos, size_t>>& vRead, const std::vector<uint256>& vHash,
+                              std::vector<std::unique_ptr<CTransactionBase>>& vTxBase, std::vector<uint256>& vHashBlock)
+{
+    std::shared_ptr<CBlockFileReadHandles::Handle> handle = blockFileReadHandles.Get(vRead.front().first.nFile);
+    if (!handle)
+        return;
+    std::lock_guard<std::mutex> lock(handle->cs);
+    CAutoFile file(handle->file, SER_DISK, CLIENT_VERSION);
+    CBlockFileCursor cursor;
+    for (const auto& read : vRead) {
+        const size_t i = read.second;
+        try {
+            SeekToTxBase(file, read.first, cursor);
+            int32_t nVersion;
+            if (cursor.InMemory())
+                cursor.Reader(read.first) >> nVersion;
+            else {
+                file >> nVersion;
+                if (fseek(file.Get(), -(long)sizeof(nVersion), SEEK_CUR))
+                    throw std::ios_base::failure("unable to seek back to the version");
+            }
+            if (nVersion == SC_CERT_VERSION) {
+                std::unique_ptr<CScCertificate> pcert(new CScCertificate());
+                if (cursor.InMemory())
+                    cursor.Reader(read.first) >> *pcert;
+                else
+                    file >> *pcert;
+                vTxBase[i] = std::move(pcert);
+            } else {
+                std::unique_ptr<CTransaction> ptx(new CTransaction());
+                if (cursor.InMemory())
+                    cursor.Reader(read.first) >> *ptx;
+                else
+                    file >> *ptx;
+                vTxBase[i] = std::move(ptx);
+            }
+        } catch (const std::exception& e) {
+            error("%s: Attempt to deserialize %s from disk failed or I/O error - %s", __func__, vHash[i].ToString(), e.what());
+            vTxBase[i].reset();
+            cursor = CBlockFileCursor();
+            continue;
+        }
+        if (vTxBase[i]->GetHash() != vHash[i]) {
+            error("%s: txid mismatch", __func__);
+            vTxBase[i].reset();
+            continue;
+        }
+        vHashBlock[i] = cursor.hashBlock;
+    }
+    file.release();
+}
+
+} // anon namespace
+
+/** Return transaction in tx, and if it was found inside a block, its hash is placed in hashBlock */
+bool GetTransaction(const uint256 &hash, CTransaction &txOut, uint256 &hashBlock, bool fAllowSlow)
+{
+    if (mempool->lookup(hash, txOut))
+        return true;
+
+    if (fTxIndex)
+    {
+        bool fIndexed;
+        bool fRead = ReadFromTxIndex(hash, txOut, hashBlock, fIndexed);
+        if (fIndexed)
+            return fRead;
+    }
+
+    if (fAllowSlow) // use coin database to locate block that contains transaction, and scan it
+    {
+        LOCK(cs_main);
+        CBlockIndex *pindexSlow = nullptr;
+        int nHeight = -1;
+        {
+            CCoinsViewCache &view = *pcoinsTip;
+            const CCoins* coins = view.AccessCoins(hash);
+            if (coins)
+                nHeight = coins->nHeight;
+        }
+        if (nHeight > 0)
+            pindexSlow = chainActive[nHeight];
+
+        if (pindexSlow)
+        {
+            std::shared_ptr<const CBlock> block = blockCache.Get(pindexSlow->GetBlockHash());
+            if (block)
             {
-                return error("%s: Attempt to deserialize cert from disk failed or I/O error - %s", __func__, e.what());
+                for(const CTransaction &tx: block->vtx)
+                {
+                    if (tx.GetHash() == hash)
+                    {
+                        txOut = tx;
+                        hashBlock = pindexSlow->GetBlockHash();
+                        return true;
+                    }
+                }
+            }
+            else
+            {
+                // only the transactions up to the one looked for are deserialized
+                CBlockView blockView;
+                if (blockView.Open(pindexSlow->GetBlockPos()) && blockView.GetHeader().GetHash() == pindexSlow->GetBlockHash() &&
+                    blockView.FindTransaction(hash, txOut))
+                {
+                    hashBlock = pindexSlow->GetBlockHash();
+                    return true;
+                }
             }
-            hashBlock = header.GetHash();
-            if (certOut.GetHash() != hash)
-                return error("%s: txid mismatch", __func__);
-            return true;
         }
     }
 
+    return false;
+}
+
+/** Return certificate in certOut, and if it was found inside a block, its hash is placed in hashBlock */
+bool GetCertificate(const uint256 &hash, CScCertificate &certOut, uint256 &hashBlock, bool fAllowSlow)
+{
+    if (mempool->lookup(hash, certOut))
+        return true;
+
+    if (fTxIndex)
+    {
+        bool fIndexed;
+        bool fRead = ReadFromTxIndex(hash, certOut, hashBlock, fIndexed);
+        if (fIndexed)
+            return fRead;
+    }
+
     if (fAllowSlow) // use coin database to locate block that contains cert, and scan it
     {
+        LOCK(cs_main);
         int nHeight = -1;
         CBlockIndex *pindexSlow = nullptr;
         {
@@ -2032,10 +2611,10 @@ bool GetCertificate(const uint256 &hash, CScCertificate &certOut, uint256 &hashB
 
         if (pindexSlow)
         {
-            CBlock block;
-            if (ReadBlockFromDisk(block, pindexSlow))
+            std::shared_ptr<const CBlock> block = blockCache.Get(pindexSlow->GetBlockHash());
+            if (block)
             {
-                for(const CScCertificate &cert: block.vcert)
+                for(const CScCertificate &cert: block->vcert)
                 {
                     if (cert.GetHash() == hash)
                     {
@@ -2045,6 +2624,16 @@ bool GetCertificate(const uint256 &hash, CScCertificate &certOut, uint256 &hashB
                     }
                 }
             }
+            else
+            {
+                CBlockView blockView;
+                if (blockView.Open(pindexSlow->GetBlockPos()) && blockView.GetHeader().GetHash() == pindexSlow->GetBlockHash() &&
+                    blockView.FindCertificate(hash, certOut))
+                {
+                    hashBlock = pindexSlow->GetBlockHash();
+                    return true;
+                }
+            }
         }
     }
 
@@ -2070,60 +2659,206 @@ bool GetTxBaseObj(const uint256 &hash, std::unique_ptr<CTransactionBase>& pTxBas
     return false;
 }
 
+void GetTxBaseObjs(const std::vector<uint256>& vHash, std::vector<std::unique_ptr<CTransactionBase>>& vTxBase,
+                   std::vector<uint256>& vHashBlock, bool fAllowSlow)
+{
+    vTxBase.clear();
+    vTxBase.resize(vHash.size());
+    vHashBlock.assign(vHash.size(), uint256());
+
+    // the txindex positions of the ones not in the mempool, grouped by block file and in file order
+    std::map<int, std::vector<std::pair<CDiskTxPos, size_t>>> mapReads;
+    std::vector<size_t> vMissing;
+    for (size_t i = 0; i < vHash.size(); i++) {
+        CTransaction tx;
+        CScCertificate cert;
+        CTxIndexValue txIndexValue;
+        if (mempool->lookup(vHash[i], tx))
+            vTxBase[i].reset(new CTransaction(tx));
+        else if (mempool->lookup(vHash[i], cert))
+            vTxBase[i].reset(new CScCertificate(cert));
+        else if (fTxIndex && pblocktree->ReadTxIndex(vHash[i], txIndexValue))
+            mapReads[txIndexValue.txPosition.nFile].emplace_back(txIndexValue.txPosition, i);
+        else
+            vMissing.push_back(i);
+    }
+
+    std::vector<const std::vector<std::pair<CDiskTxPos, size_t>>*> vFiles;
+    for (auto& entry : mapReads) {
+        std::sort(entry.second.begin(), entry.second.end(),
+                  [](const std::pair<CDiskTxPos, size_t>& a, const std::pair<CDiskTxPos, size_t>& b) {
+            return std::make_pair(a.first.nPos, a.first.nTxOffset) < std::make_pair(b.first.nPos, b.first.nTxOffset);
+        });
+        vFiles.push_back(&entry.second);
+    }
+
+    // each file is read by a single thread, from start to end, the files being spread over the threads
+    const size_t nThreads = std::min<size_t>(vFiles.size(), MAX_TXINDEX_READ_THREADS);
+    std::atomic<size_t> nNextFile(0);
+    auto readFiles = [&]() {
+        for (size_t n = nNextFile++; n < vFiles.size(); n = nNextFile++)
+            ReadTxBasesFromBlockFile(*vFiles[n], vHash, vTxBase, vHashBlock);
+    };
+    std::vector<std::thread> vThreads;
+    for (size_t n = 1; n < nThreads; n++)
+        vThreads.emplace_back(readFiles);
+    readFiles();
+    for (std::thread& thread : vThreads)
+        thread.join();
+
+    if (fAllowSlow) {
+        for (size_t i : vMissing)
+            GetTxBaseObj(vHash[i], vTxBase[i], vHashBlock[i], true);
+    }
+}
+
 //////////////////////////////////////////////////////////////////////////////
 //
 // CBlock and CBlockIndex
 //
 
-bool WriteBlockToDisk(CBlock& block, CDiskBlockPos& pos, const CMessageHeader::MessageStartChars& messageStart)
+/**
+ * The record of obj in the block or undo files: the message start, the size and obj, followed by
+ * the checksum of undo records. With nLevel, all but the message start and the size is compressed
+ * when it gets smaller, the size being then the one of the zstd frame, flagged BLOCK_RECORD_COMPRESSED.
+ */
+template <typename T>
+static std::shared_ptr<CSerializeData> SerializeDiskRecord(const T& obj, const uint256* pChecksum,
+                                                           const CMessageHeader::MessageStartChars& messageStart, int nLevel)
 {
-    // Open history file to append
-    CAutoFile fileout(OpenBlockFile(pos), SER_DISK, CLIENT_VERSION);
-    if (fileout.IsNull())
-        return error("WriteBlockToDisk: OpenBlockFile failed");
+    const unsigned int nSize = ::GetSerializeSize(obj, SER_DISK, CLIENT_VERSION);
+    CPublicDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss.reserve(BLOCK_RECORD_HEADER_SIZE + nSize + (pChecksum ? sizeof(uint256) : 0));
+    ss << FLATDATA(messageStart) << nSize << obj;
+    if (pChecksum)
+        ss << *pChecksum;
 
-    // Write index header
-    unsigned int nSize = fileout.GetSerializeSize(block);
-    fileout << FLATDATA(messageStart) << nSize;
+    CSerializeData vFrame;
+    if (nLevel > 0 && CompressData(&ss[0] + BLOCK_RECORD_HEADER_SIZE, &ss[0] + ss.size(), nLevel, vFrame) &&
+        vFrame.size() < ss.size() - BLOCK_RECORD_HEADER_SIZE)
+    {
+        ss.clear();
+        ss << FLATDATA(messageStart) << (unsigned int)(vFrame.size() | BLOCK_RECORD_COMPRESSED);
+        ss.write(vFrame.data(), vFrame.size());
+    }
+
+    std::shared_ptr<CSerializeData> record = std::make_shared<CSerializeData>();
+    ss.MoveTo(*record);
+    return record;
+}
 
-    // Write block
-    long fileOutPos = ftell(fileout.Get());
-    if (fileOutPos < 0)
-        return error("WriteBlockToDisk: ftell failed");
-    pos.nPos = (unsigned int)fileOutPos;
-    fileout << block;
+std::shared_ptr<const CSerializeData> SerializeBlockRecord(const CBlock& block, const CMessageHeader::MessageStartChars& messageStart)
+{
+    return SerializeDiskRecord(block, nullptr, messageStart, nBlockCompressionLevel);
+}
+
+bool WriteBlockToDisk(std::shared_ptr<const CSerializeData> record, CDiskBlockPos& pos)
+{
+    // The record, index header included, is queued to the block file writer at the position
+    // FindBlockPos found for it
+    const CDiskBlockPos recordPos = pos;
+    pos.nPos += BLOCK_RECORD_HEADER_SIZE;
+    if (!blockFileWriter.Write(false, recordPos, std::move(record)))
+        return error("WriteBlockToDisk: failed to write to the block files");
 
     return true;
 }
 
-bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos)
+bool WriteBlockToDisk(CBlock& block, CDiskBlockPos& pos, const CMessageHeader::MessageStartChars& messageStart)
 {
-    block.SetNull();
+    // raw, as the caller found the position for the size of the block
+    return WriteBlockToDisk(SerializeDiskRecord(block, nullptr, messageStart, 0), pos);
+}
+
+/**
+ * The data of a record queued to the block file writer, which are decompressed to vData if the record
+ * is compressed. Throws on invalid frames.
+ */
+static void PendingRecordData(const CSerializeData& record, size_t nMaxSize, CSerializeData& vData, const char*& pbegin, const char*& pend)
+{
+    unsigned int nSize;
+    memcpy(&nSize, record.data() + MESSAGE_START_SIZE, sizeof(nSize));
+    pbegin = record.data() + BLOCK_RECORD_HEADER_SIZE;
+    pend = record.data() + record.size();
+    if (nSize & BLOCK_RECORD_COMPRESSED)
+    {
+        if (!DecompressData(pbegin, pend, nMaxSize, vData))
+            throw std::ios_base::failure("invalid compressed record");
+        pbegin = vData.data();
+        pend = vData.data() + vData.size();
+    }
+}
 
-    // Open history file to read
-    CAutoFile filein(OpenBlockFile(pos, true), SER_DISK, CLIENT_VERSION);
-    if (filein.IsNull())
-        return error("ReadBlockFromDisk: OpenBlockFile failed for %s", pos.ToString());
+//! The block at pos, with the Equihash solution and the proof of work of its header checked if fCheckPow
+bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos, bool fCheckPow)
+{
+    block.SetNull();
 
-    // Read block
-    try {
-        filein >> block;
+    // A block not written yet is read from the record queued to the block file writer
+    if (std::shared_ptr<const CSerializeData> record = blockFileWriter.GetPending(false, pos)) {
+        try {
+            CSerializeData vBlock;
+            const char* pbegin;
+            const char* pend;
+            PendingRecordData(*record, MAX_BLOCK_SIZE, vBlock, pbegin, pend);
+            CSpanReader(pbegin, pend, SER_DISK, CLIENT_VERSION) >> block;
+        }
+        catch (const std::exception& e) {
+            return error("%s: Deserialize error - %s at %s", __func__, e.what(), pos.ToString());
+        }
     }
-    catch (const std::exception& e) {
-        return error("%s: Deserialize or I/O error - %s at %s", __func__, e.what(), pos.ToString());
+    else {
+        // Open history file to read, from the block size written before the block
+        if (pos.nPos < sizeof(unsigned int))
+            return error("ReadBlockFromDisk: invalid position %s", pos.ToString());
+        CAutoFile filein(OpenBlockFile(CDiskBlockPos(pos.nFile, pos.nPos - sizeof(unsigned int)), true), SER_DISK, CLIENT_VERSION);
+        if (filein.IsNull())
+            return error("ReadBlockFromDisk: OpenBlockFile failed for %s", pos.ToString());
+
+        // Read block, in one read into a pooled buffer
+        try {
+            unsigned int nSize;
+            filein >> nSize;
+            if (nSize & BLOCK_RECORD_COMPRESSED)
+            {
+                CSerializeData vBlock;
+                ReadCompressedRecord(filein, nSize & ~BLOCK_RECORD_COMPRESSED, MAX_BLOCK_SIZE, vBlock);
+                CSpanReader(vBlock.data(), vBlock.data() + vBlock.size(), SER_DISK, CLIENT_VERSION) >> block;
+            }
+            else if (nSize > 0 && nSize <= MAX_BLOCK_SIZE)
+            {
+                CPublicDataStream ss(SER_DISK, CLIENT_VERSION);
+                ss.resize(nSize);
+                filein.read(&ss[0], nSize);
+                ss >> block;
+            }
+            else
+                filein >> block;
+        }
+        catch (const std::exception& e) {
+            return error("%s: Deserialize or I/O error - %s at %s", __func__, e.what(), pos.ToString());
+        }
     }
 
     // Check the header
-    if (!(CheckEquihashSolution(&block, Params()) &&
-          CheckProofOfWork(block.GetHash(), block.nBits, Params().GetConsensus())))
+    if (fCheckPow && !(CheckEquihashSolution(&block, Params()) &&
+                       CheckProofOfWork(block.GetHash(), block.nBits, Params().GetConsensus())))
         return error("ReadBlockFromDisk: Errors in block header at %s", pos.ToString());
 
     return true;
 }
 
+bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos)
+{
+    return ReadBlockFromDisk(block, pos, /*fCheckPow*/true);
+}
+
 bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex)
 {
-    if (!ReadBlockFromDisk(block, pindex->GetBlockPos()))
+    // the header of an entry of mapBlockIndex was checked when it was accepted, and it is the one
+    // read back if the hashes match
+    const bool fHeaderChecked = LookupBlockIndex(pindex->GetBlockHash()) == pindex;
+    if (!ReadBlockFromDisk(block, pindex->GetBlockPos(), !fHeaderChecked))
         return false;
     if (block.GetHash() != pindex->GetBlockHash())
         return error("ReadBlockFromDisk(CBlock&, CBlockIndex*): GetHash() doesn't match index for %s at %s",
@@ -2131,6 +2866,29 @@ bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex)
     return true;
 }
 
+std::shared_ptr<const CBlock> ReadBlockFromDiskCached(const CBlockIndex* pindex)
+{
+    std::shared_ptr<const CBlock> cached = blockCache.Get(pindex->GetBlockHash());
+    if (cached)
+        return cached;
+
+    std::shared_ptr<CBlock> block = std::make_shared<CBlock>();
+    if (!ReadBlockFromDisk(*block, pindex))
+        return nullptr;
+    blockCache.Insert(block);
+    return block;
+}
+
+std::shared_ptr<const CSerializeData> ReadBlockMessageCached(const CBlockIndex* pindex, int nVersion)
+{
+    std::shared_ptr<const CBlock> block = ReadBlockFromDiskCached(pindex);
+    if (!block)
+        return nullptr;
+    std::shared_ptr<const CSerializeData> msg = blockCache.GetMessage(pindex->GetBlockHash(), nVersion);
+    // the block may have been dropped in the meantime, or be too large for the cache
+    return msg ? msg : CNode::SerializeMessage(nVersion, NetMsgType::BLOCK, *block);
+}
+
 CAmount GetBlockSubsidy(int nHeight, const Consensus::Params& consensusParams)
 {
     CAmount nSubsidy = 12.5 * COIN;
@@ -2288,12 +3046,13 @@ void CheckForkWarningConditionsOnNewFork(CBlockIndex* pindexNewForkTip)
     CheckForkWarningConditions();
 }
 
-// Requires cs_main.
 void Misbehaving(NodeId pnode, int howmuch)
 {
     if (howmuch == 0)
         return;
 
+    // some of the messages punishing their peer are processed without cs_main
+    LOCK(cs_main);
     CNodeState *state = State(pnode);
     if (state == NULL)
         return;
@@ -2325,10 +3084,29 @@ void static InvalidChainFound(CBlockIndex* pindexNew)
     CheckForkWarningConditions();
 }
 
+/** A block fast relayed to us proved invalid: the peer which sent it loses fast relay, as a whitelisted peer is never banned */
+void static FastRelayedBlockInvalid(const uint256& hash, const CValidationState &state)
+{
+    if (state.CorruptionPossible())
+        return;
+    std::map<uint256, NodeId>::iterator it = mapFastRelayedBlocks.find(hash);
+    if (it == mapFastRelayedBlocks.end())
+        return;
+    CNodeState *nodestate = State(it->second);
+    if (nodestate && nodestate->fFastRelay)
+    {
+        LogPrintf("%s: peer=%d fast relayed the invalid block %s, no longer accepting fast relayed blocks from it\n",
+            __func__, it->second, hash.ToString());
+        nodestate->fFastRelay = false;
+    }
+    mapFastRelayedBlocks.erase(it);
+}
+
 void static InvalidBlockFound(CBlockIndex *pindex, const CValidationState &state)
 {
     if (state.IsInvalid())
     {
+        FastRelayedBlockInvalid(pindex->GetBlockHash(), state);
         std::map<uint256, NodeId>::iterator it = mapBlockSource.find(pindex->GetBlockHash());
         if (it != mapBlockSource.end() && State(it->second))
         {
@@ -2446,38 +3224,38 @@ void UpdateCoins(const CScCertificate& cert, CCoinsViewCache &inputs, CTxUndo &t
     }
 
     // add outputs
-    CSidechain sidechain;
-    assert(inputs.GetSidechain(cert.GetScId(), sidechain));
-    int bwtMaturityHeight = sidechain.GetCertMaturityHeight(cert.epochNumber, nHeight);
+    const CSidechain* const pSidechain = inputs.AccessSidechain(cert.GetScId());
+    assert(pSidechain != nullptr);
+    int bwtMaturityHeight = pSidechain->GetCertMaturityHeight(cert.epochNumber, nHeight);
     inputs.ModifyCoins(cert.GetHash())->From(cert, nHeight, bwtMaturityHeight, isBlockTopQualityCert);
     return;
 }
 
-CScriptCheck::CScriptCheck(): ptxTo(0), nIn(0), chain(nullptr),
+CScriptCheck::CScriptCheck(): ptxTo(0), nIn(0),
                               nFlags(0), cacheStore(false),
                               error(SCRIPT_ERR_UNKNOWN_ERROR) {}
 CScriptCheck::CScriptCheck(const CCoins& txFromIn, const CTransactionBase& txToIn,
-                           unsigned int nInIn, const CChain* chainIn,
+                           unsigned int nInIn, std::shared_ptr<const CCheckBlockAtHeightView> cbhViewIn,
                            unsigned int nFlagsIn, bool cacheIn):
                             scriptPubKey(txFromIn.vout[txToIn.GetVin()[nInIn].prevout.n].scriptPubKey),
-                            ptxTo(&txToIn), nIn(nInIn), chain(chainIn), nFlags(nFlagsIn),
+                            ptxTo(&txToIn), nIn(nInIn), cbhView(std::move(cbhViewIn)), nFlags(nFlagsIn),
                             cacheStore(cacheIn), error(SCRIPT_ERR_UNKNOWN_ERROR) { }
 
 CScriptCheck::CScriptCheck(const CScript& scriptPubKeyIn, const CTransactionBase& txToIn,
-                           unsigned int nInIn, const CChain* chainIn,
+                           unsigned int nInIn, std::shared_ptr<const CCheckBlockAtHeightView> cbhViewIn,
                            unsigned int nFlagsIn, bool cacheIn):
-                            scriptPubKey(scriptPubKeyIn), ptxTo(&txToIn), nIn(nInIn), chain(chainIn),
+                            scriptPubKey(scriptPubKeyIn), ptxTo(&txToIn), nIn(nInIn), cbhView(std::move(cbhViewIn)),
                             nFlags(nFlagsIn), cacheStore(cacheIn), error(SCRIPT_ERR_UNKNOWN_ERROR) { }
 
 bool CScriptCheck::operator()() {
-    return ptxTo->VerifyScript(scriptPubKey, nFlags, nIn, chain, cacheStore, &error);
+    return ptxTo->VerifyScript(scriptPubKey, nFlags, nIn, cbhView.get(), cacheStore, &error);
 }
 
 void CScriptCheck::swap(CScriptCheck &check) {
     scriptPubKey.swap(check.scriptPubKey);
     std::swap(ptxTo, check.ptxTo);
     std::swap(nIn, check.nIn);
-    std::swap(chain, check.chain);
+    cbhView.swap(check.cbhView);
     std::swap(nFlags, check.nFlags);
     std::swap(cacheStore, check.cacheStore);
     std::swap(error, check.error);
@@ -2485,6 +3263,16 @@ void CScriptCheck::swap(CScriptCheck &check) {
 
 ScriptError CScriptCheck::GetScriptError() const { return error; }
 
+bool CJoinSplitCheck::operator()() {
+    auto verifier = libzcash::ProofVerifier::Strict();
+    return pjoinsplit->Verify(*pzcashParams, verifier, *pjoinSplitPubKey);
+}
+
+void CJoinSplitCheck::swap(CJoinSplitCheck &check) {
+    std::swap(pjoinsplit, check.pjoinsplit);
+    std::swap(pjoinSplitPubKey, check.pjoinSplitPubKey);
+}
+
 bool IsCommunityFund(const CCoins *coins, int nIn)
 {
     if(coins != NULL &&
@@ -2614,10 +3402,11 @@ bool CheckTxInputs(const CTransactionBase& txBase, CValidationState& state, cons
 }// namespace Consensus
 
 bool InputScriptCheck(const CScript& scriptPubKey, const CTransactionBase& tx, unsigned int nIn,
-                      const CChain& chain, unsigned int flags, bool cacheStore,  CValidationState &state, std::vector<CScriptCheck> *pvChecks)
+                      const std::shared_ptr<const CCheckBlockAtHeightView>& cbhView, unsigned int flags, bool cacheStore,
+                      CValidationState &state, std::vector<CScriptCheck> *pvChecks)
 {
     // Verify signature
-    CScriptCheck check(scriptPubKey, tx, nIn, &chain, flags, cacheStore);
+    CScriptCheck check(scriptPubKey, tx, nIn, cbhView, flags, cacheStore);
     if (pvChecks) {
         pvChecks->push_back(CScriptCheck());
         check.swap(pvChecks->back());
@@ -2632,7 +3421,7 @@ bool InputScriptCheck(const CScript& scriptPubKey, const CTransactionBase& tx, u
             // arguments; if so, don't trigger DoS protection to
             // avoid splitting the network between upgraded and
             // non-upgraded nodes.
-            CScriptCheck check(scriptPubKey, tx, nIn, &chain,
+            CScriptCheck check(scriptPubKey, tx, nIn, cbhView,
                     flags & ~STANDARD_CONTEXTUAL_NOT_MANDATORY_VERIFY_FLAGS, cacheStore);
             if (check())
                 return state.Invalid(false, CValidationState::Code::NONSTANDARD, strprintf("non-mandatory-script-verify-flag (%s)", ScriptErrorString(check.GetScriptError())));
@@ -2650,6 +3439,68 @@ bool InputScriptCheck(const CScript& scriptPubKey, const CTransactionBase& tx, u
     return true;
 }
 
+namespace {
+
+/**
+ * The transactions and certificates whose input scripts all passed, as SHA256(nonce || hash || flags),
+ * so that a block does not run again the scripts of those which were checked when relayed to us.
+ * The entries rely on the replay protection checks against chainActive, which only get looser as the
+ * chain grows: a new nonce invalidates them all when a block is disconnected. Guarded by cs_main.
+ */
+CCuckooCache<uint256, CSignatureCacheHasher> scriptExecutionCache;
+uint256 scriptExecutionCacheNonce(GetFastRandHash());
+
+uint256 ScriptExecutionCacheEntry(const uint256& hash, unsigned int flags)
+{
+    uint256 entry;
+    CSHA256().Write(scriptExecutionCacheNonce.begin(), 32).Write(hash.begin(), 32)
+             .Write((const unsigned char*)&flags, sizeof(flags)).Finalize(entry.begin());
+    return entry;
+}
+
+//! Whether the scripts of hash passed under flags against chain. Unless cacheStore, as for the blocks being connected, the hit is the last one expected for the entry, which is erased
+bool IsScriptExecutionCached(const uint256& hash, unsigned int flags, const CChain& chain, bool cacheStore)
+{
+    if (&chain != &chainActive || !scriptExecutionCache.IsSetup())
+        return false;
+    return scriptExecutionCache.Contains(ScriptExecutionCacheEntry(hash, flags), !cacheStore);
+}
+
+} // anon namespace
+
+void InitScriptExecutionCache()
+{
+    const size_t nMaxCacheSize = GetSignatureCacheShareBytes();
+    if (nMaxCacheSize == 0) {
+        LogPrintf("Script execution cache disabled\n");
+        return;
+    }
+    const size_t nEntries = scriptExecutionCache.SetupBytes(nMaxCacheSize);
+    LogPrintf("Using %zu MiB out of %zu requested for script execution cache, able to store %zu elements\n",
+              (nEntries * sizeof(uint256)) >> 20, nMaxCacheSize >> 20, nEntries);
+}
+
+void AddToScriptExecutionCache(const uint256& hash, unsigned int flags)
+{
+    if (scriptExecutionCache.IsSetup())
+        scriptExecutionCache.Insert(ScriptExecutionCacheEntry(hash, flags));
+}
+
+void ClearScriptExecutionCache()
+{
+    scriptExecutionCacheNonce = GetFastRandHash();
+}
+
+std::shared_ptr<const CCheckBlockAtHeightView> GetCheckBlockAtHeightView(const CChain& chain)
+{
+    static std::mutex csView;
+    static std::shared_ptr<const CCheckBlockAtHeightView> cbhView;
+    std::lock_guard<std::mutex> lock(csView);
+    if (!cbhView || !cbhView->IsOf(chain))
+        cbhView = std::make_shared<const CCheckBlockAtHeightView>(chain, getCheckBlockAtHeightSafeDepth());
+    return cbhView;
+}
+
 bool ContextualCheckTxInputs(const CTransaction& tx, CValidationState &state, const CCoinsViewCache &inputs, bool fScriptChecks, const CChain& chain, unsigned int flags, bool cacheStore, const Consensus::Params& consensusParams, std::vector<CScriptCheck> *pvChecks)
 {
     if (!tx.IsCoinBase())
@@ -2671,14 +3522,15 @@ bool ContextualCheckTxInputs(const CTransaction& tx, CValidationState &state, co
         // Skip ECDSA signature verification when connecting blocks
         // before the last block chain checkpoint. This is safe because block merkle hashes are
         // still computed and checked, and any change will be caught at the next checkpoint.
-        if (fScriptChecks) {
+        if (fScriptChecks && !IsScriptExecutionCached(tx.GetHash(), flags, chain, cacheStore)) {
+            const std::shared_ptr<const CCheckBlockAtHeightView> cbhView = GetCheckBlockAtHeightView(chain);
             for (unsigned int i = 0; i < tx.GetVin().size(); i++) {
                 const COutPoint &prevout = tx.GetVin()[i].prevout;
                 const CCoins* coins = inputs.AccessCoins(prevout.hash);
                 assert(coins);
 
                 const CScript& scriptPubKey = coins->vout[tx.GetVin()[i].prevout.n].scriptPubKey;
-                if(!InputScriptCheck(scriptPubKey, tx, i, chain, flags, cacheStore, state, pvChecks)) {
+                if(!InputScriptCheck(scriptPubKey, tx, i, cbhView, flags, cacheStore, state, pvChecks)) {
                     return false;
                 }
             }
@@ -2686,7 +3538,7 @@ bool ContextualCheckTxInputs(const CTransaction& tx, CValidationState &state, co
             unsigned int vinSize = tx.GetVin().size();
             for (unsigned int i = 0; i < tx.GetVcswCcIn().size(); i++) {
                 const CScript& scriptPubKey = tx.GetVcswCcIn()[i].scriptPubKey();
-                if(!InputScriptCheck(scriptPubKey, tx, i + vinSize, chain, flags, cacheStore, state, pvChecks)) {
+                if(!InputScriptCheck(scriptPubKey, tx, i + vinSize, cbhView, flags, cacheStore, state, pvChecks)) {
                     return false;
                 }
             }
@@ -2715,14 +3567,15 @@ bool ContextualCheckCertInputs(const CScCertificate& cert, CValidationState &sta
     // Skip ECDSA signature verification when connecting blocks
     // before the last block chain checkpoint. This is safe because block merkle hashes are
     // still computed and checked, and any change will be caught at the next checkpoint.
-    if (fScriptChecks) {
+    if (fScriptChecks && !IsScriptExecutionCached(cert.GetHash(), flags, chain, cacheStore)) {
+        const std::shared_ptr<const CCheckBlockAtHeightView> cbhView = GetCheckBlockAtHeightView(chain);
         for (unsigned int i = 0; i < cert.GetVin().size(); i++) {
             const COutPoint &prevout = cert.GetVin()[i].prevout;
             const CCoins* coins = inputs.AccessCoins(prevout.hash);
             assert(coins);
 
             const CScript& scriptPubKey = coins->vout[cert.GetVin()[i].prevout.n].scriptPubKey;
-            if(!InputScriptCheck(scriptPubKey, cert, i, chain, flags, cacheStore, state, pvChecks)) {
+            if(!InputScriptCheck(scriptPubKey, cert, i, cbhView, flags, cacheStore, state, pvChecks)) {
                 return false;
             }
         }
@@ -2733,48 +3586,74 @@ bool ContextualCheckCertInputs(const CScCertificate& cert, CValidationState &sta
 
 namespace {
 
-bool UndoWriteToDisk(const CBlockUndo& blockundo, CDiskBlockPos& pos, const uint256& hashBlock, const CMessageHeader::MessageStartChars& messageStart)
+//! The record of the undo data of the block with parent hashBlock, compressed at -blockcompression
+std::shared_ptr<CSerializeData> SerializeUndoRecord(const CBlockUndo& blockundo, const uint256& hashBlock, const CMessageHeader::MessageStartChars& messageStart)
 {
-    // Open history file to append
-    CAutoFile fileout(OpenUndoFile(pos), SER_DISK, CLIENT_VERSION);
-    if (fileout.IsNull())
-        return error("%s: OpenUndoFile failed", __func__);
-
-    // Write index header
-    unsigned int nSize = fileout.GetSerializeSize(blockundo);
-    fileout << FLATDATA(messageStart) << nSize;
-
-    // Write undo data
-    long fileOutPos = ftell(fileout.Get());
-    if (fileOutPos < 0)
-        return error("%s: ftell failed", __func__);
-    pos.nPos = (unsigned int)fileOutPos;
-    fileout << blockundo;
-
-    // calculate & write checksum
+    // calculate checksum
     CHashWriter hasher(SER_GETHASH, PROTOCOL_VERSION);
     hasher << hashBlock;
     hasher << blockundo;
-    fileout << hasher.GetHash();
+    const uint256 checksum = hasher.GetHash();
+    return SerializeDiskRecord(blockundo, &checksum, messageStart, nBlockCompressionLevel);
+}
+
+bool UndoWriteToDisk(std::shared_ptr<CSerializeData> record, CDiskBlockPos& pos)
+{
+    // The record, index header included, is queued to the block file writer at the position
+    // FindUndoPos found for it
+    const CDiskBlockPos recordPos = pos;
+    pos.nPos += BLOCK_RECORD_HEADER_SIZE;
+    if (!blockFileWriter.Write(true, recordPos, std::move(record)))
+        return error("%s: failed to write to the undo files", __func__);
 
     return true;
 }
 
+} // anon namespace
+
 bool UndoReadFromDisk(CBlockUndo& blockundo, const CDiskBlockPos& pos, const uint256& hashBlock)
 {
-    // Open history file to read
-    CAutoFile filein(OpenUndoFile(pos, true), SER_DISK, CLIENT_VERSION);
-    if (filein.IsNull())
-        return error("%s: OpenBlockFile failed", __func__);
-
-    // Read block
     uint256 hashChecksum;
-    try {
-        filein >> blockundo;
-        filein >> hashChecksum;
+    // Undo data not written yet are read from the record queued to the block file writer
+    if (std::shared_ptr<const CSerializeData> record = blockFileWriter.GetPending(true, pos)) {
+        try {
+            CSerializeData vData;
+            const char* pbegin;
+            const char* pend;
+            PendingRecordData(*record, MAX_SERIALIZED_COMPACT_SIZE, vData, pbegin, pend);
+            CSpanReader(pbegin, pend, SER_DISK, CLIENT_VERSION) >> blockundo >> hashChecksum;
+        }
+        catch (const std::exception& e) {
+            return error("%s: Deserialize error - %s", __func__, e.what());
+        }
     }
-    catch (const std::exception& e) {
-        return error("%s: Deserialize or I/O error - %s", __func__, e.what());
+    else {
+        // Open history file to read, from the size written before the undo data
+        if (pos.nPos < sizeof(unsigned int))
+            return error("%s: invalid position %s", __func__, pos.ToString());
+        CAutoFile filein(OpenUndoFile(CDiskBlockPos(pos.nFile, pos.nPos - sizeof(unsigned int)), true), SER_DISK, CLIENT_VERSION);
+        if (filein.IsNull())
+            return error("%s: OpenBlockFile failed", __func__);
+
+        // Read block
+        try {
+            unsigned int nSize;
+            filein >> nSize;
+            if (nSize & BLOCK_RECORD_COMPRESSED)
+            {
+                CSerializeData vData;
+                ReadCompressedRecord(filein, nSize & ~BLOCK_RECORD_COMPRESSED, MAX_SERIALIZED_COMPACT_SIZE, vData);
+                CSpanReader(vData.data(), vData.data() + vData.size(), SER_DISK, CLIENT_VERSION) >> blockundo >> hashChecksum;
+            }
+            else
+            {
+                filein >> blockundo;
+                filein >> hashChecksum;
+            }
+        }
+        catch (const std::exception& e) {
+            return error("%s: Deserialize or I/O error - %s", __func__, e.what());
+        }
     }
 
     // Verify checksum
@@ -2790,6 +3669,8 @@ bool UndoReadFromDisk(CBlockUndo& blockundo, const CDiskBlockPos& pos, const uin
     return true;
 }
 
+namespace {
+
 /** Abort with a message */
 bool AbortNode(const std::string& strMessage, const std::string& userMessage="")
 {
@@ -2811,7 +3692,7 @@ bool AbortNode(CValidationState& state, const std::string& strMessage, const std
 } // anon namespace
 
 bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex, CCoinsViewCache& view, flagLevelDBIndexesWrite explorerIndexesWrite,
-                     bool* pfClean, std::vector<CScCertificateStatusUpdateInfo>* pCertsStateInfo)
+                     bool* pfClean, std::vector<CScCertificateStatusUpdateInfo>* pCertsStateInfo, CBlockUndo* pBlockUndo)
 {
     std::vector<std::pair<CAddressIndexKey, CAddressIndexValue>> addressIndex;
     std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue>> addressUnspentIndex;
@@ -2832,13 +3713,17 @@ bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex
     if (block.nVersion != BLOCK_VERSION_SC_SUPPORT)
         includeSc = IncludeScAttributes::OFF;
 
-    CBlockUndo blockUndo(includeSc);
-
-    CDiskBlockPos pos = pindex->GetUndoPos();
-    if (pos.IsNull())
-        return error("DisconnectBlock(): no undo data available");
-    if (!UndoReadFromDisk(blockUndo, pos, pindex->pprev->GetBlockHash()))
-        return error("DisconnectBlock(): failure reading undo data");
+    CBlockUndo blockUndoRead(includeSc);
+    if (!pBlockUndo)
+    {
+        CDiskBlockPos pos = pindex->GetUndoPos();
+        if (pos.IsNull())
+            return error("DisconnectBlock(): no undo data available");
+        if (!UndoReadFromDisk(blockUndoRead, pos, pindex->pprev->GetBlockHash()))
+            return error("DisconnectBlock(): failure reading undo data");
+        pBlockUndo = &blockUndoRead;
+    }
+    CBlockUndo& blockUndo = *pBlockUndo;
 
     if (blockUndo.vtxundo.size() != (block.vtx.size() - 1 + block.vcert.size()))
         return error("DisconnectBlock(): block and undo data inconsistent");
@@ -3188,72 +4073,42 @@ bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex
 
     if (explorerIndexesWrite == flagLevelDBIndexesWrite::ON)
     {
-        if (fTxIndex) {
-            if (!pblocktree->WriteTxIndex(vTxIndexValues))
-                return AbortNode(state, "Failed to write transaction index");
-        }
-        if (fMaturityHeightIndex) {
-            if (!pblocktree->UpdateMaturityHeightIndex(maturityHeightValues)) {
-                return AbortNode(state, "Failed to write maturity height index");
-            }
-        }
+        // the entries are only filled for the enabled indexes
+        std::unique_ptr<CBlockIndexesUpdate> update(new CBlockIndexesUpdate());
+        update->hashBestBlock = pindex->pprev->GetBlockHash();
+        update->vTxIndex = std::move(vTxIndexValues);
+        update->vMaturityHeight = std::move(maturityHeightValues);
+        update->vAddressIndex = std::move(addressIndex);
+        update->fEraseNullAddressEntries = true;
+        update->vAddressUnspent = std::move(addressUnspentIndex);
+        update->vSpent = std::move(spentIndex);
+        if (!pblocktree->QueueIndexesUpdate(std::move(update)))
+            return AbortNode(state, "Failed to write indexes");
+    }
 
-        if (fAddressIndex)
-        {
-            if (!pblocktree->UpdateAddressIndex(addressIndex))
-            {
-                return AbortNode(state, "Failed to update address index");
-            }
-            if (!pblocktree->UpdateAddressUnspentIndex(addressUnspentIndex))
-            {
-                return AbortNode(state, "Failed to update address unspent index");
-            }
-        }
-
-        if (fSpentIndex)
-        {
-            if (!pblocktree->UpdateSpentIndex(spentIndex))
-            {
-                return AbortNode(state, "Failed to update address spent index");
-            }
-        }
-    }
-
-    return fClean;
-}
+    return fClean;
+}
 
 void static FlushBlockFile(bool fFinalize = false)
 {
     LOCK(cs_LastBlockFile);
 
-    CDiskBlockPos posOld(nLastBlockFile, 0);
-
-    FILE *fileOld = OpenBlockFile(posOld);
-    if (fileOld) {
-        if (fFinalize)
-            TruncateFile(fileOld, vinfoBlockFile[nLastBlockFile].nSize);
-        FileCommit(fileOld);
-        fclose(fileOld);
-    }
-
-    fileOld = OpenUndoFile(posOld);
-    if (fileOld) {
-        if (fFinalize)
-            TruncateFile(fileOld, vinfoBlockFile[nLastBlockFile].nUndoSize);
-        FileCommit(fileOld);
-        fclose(fileOld);
-    }
+    // queued after the writes to the file, and waited for by the next Sync of the writer
+    blockFileWriter.Commit(nLastBlockFile, vinfoBlockFile[nLastBlockFile].nSize, vinfoBlockFile[nLastBlockFile].nUndoSize, fFinalize);
 }
 
 bool FindUndoPos(CValidationState &state, int nFile, CDiskBlockPos &pos, unsigned int nAddSize);
 
-static CCheckQueue<CScriptCheck> scriptcheckqueue(128);
-
 void ThreadScriptCheck() {
     RenameThread("horizen-scriptch");
     scriptcheckqueue.Thread();
 }
 
+void ThreadJoinSplitCheck() {
+    RenameThread("horizen-jsplitch");
+    joinsplitcheckqueue.Thread();
+}
+
 //
 // Called periodically asynchronously; alerts if it smells like
 // we're being fed a bad chain (blocks being generated much
@@ -3323,6 +4178,15 @@ static int64_t nTimeIndex = 0;
 static int64_t nTimeCallbacks = 0;
 static int64_t nTimeTotal = 0;
 
+bool IsAssumedValid(const CBlockIndex* pindex, const CBlockIndex* pindexAssumeValid, const CBlockIndex* pindexBestHeaderIn,
+                    const Consensus::Params& consensusParams)
+{
+    return pindexAssumeValid != nullptr && pindexBestHeaderIn != nullptr &&
+           pindexAssumeValid->GetAncestor(pindex->nHeight) == pindex &&
+           pindexBestHeaderIn->GetAncestor(pindexAssumeValid->nHeight) == pindexAssumeValid &&
+           GetBlockProofEquivalentTime(*pindexBestHeaderIn, *pindexAssumeValid, *pindexBestHeaderIn, consensusParams) > ASSUME_VALID_MIN_BURIED_TIME;
+}
+
 bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pindex, CCoinsViewCache& view,
     const CChain& chain, flagBlockProcessingType processingType, flagScRelatedChecks fScRelatedChecks,
     flagScProofVerification fScProofVerification, flagLevelDBIndexesWrite explorerIndexesWrite,
@@ -3356,6 +4220,12 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
             fExpensiveChecks = false;
         }
     }
+    if (fExpensiveChecks && !hashAssumeValid.IsNull()) {
+        // disable the script and proof checks, not the state checks
+        BlockMap::const_iterator it = mapBlockIndex.find(hashAssumeValid);
+        if (IsAssumedValid(pindex, it != mapBlockIndex.end() ? it->second : nullptr, pindexBestHeader, chainparams.GetConsensus()))
+            fExpensiveChecks = false;
+    }
 
     bool pauseLowPrioZendooThread = (
         fExpensiveChecks &&
@@ -3371,8 +4241,11 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
     auto verifier = libzcash::ProofVerifier::Strict();
     auto disabledVerifier = libzcash::ProofVerifier::Disabled();
 
+    // With check threads, the JoinSplit proofs are queued to them below rather than verified one after another
+    const bool fQueueJoinSplitChecks = fExpensiveChecks && nScriptCheckThreads;
+
     // Check it again to verify JoinSplit proofs, and in case a previous version let a bad block in
-    if (!CheckBlock(block, state, fExpensiveChecks ? verifier : disabledVerifier,
+    if (!CheckBlock(block, state, fExpensiveChecks && !fQueueJoinSplitChecks ? verifier : disabledVerifier,
                     processingType == flagBlockProcessingType::COMPLETE ? flagCheckPow::ON : flagCheckPow::OFF,
                     processingType == flagBlockProcessingType::COMPLETE ? flagCheckMerkleRoot::ON: flagCheckMerkleRoot::OFF))
         return false;
@@ -3415,10 +4288,14 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
 
 
     // Started enforcing CHECKBLOCKATHEIGHT from block.nVersion=4, that means for all the blocks
-    unsigned int flags = SCRIPT_VERIFY_P2SH | SCRIPT_VERIFY_CHECKLOCKTIMEVERIFY | SCRIPT_VERIFY_CHECKBLOCKATHEIGHT;
+    unsigned int flags = BLOCK_SCRIPT_VERIFY_FLAGS;
 
     // DERSIG (BIP66) is also always enforced, but does not have a flag.
 
+    // The block templates being checked are expected to be mined and connected later on, hence the
+    // signatures and scripts they check are kept in the caches rather than released
+    const bool fCacheResults = processingType == flagBlockProcessingType::CHECK_ONLY;
+
     IncludeScAttributes includeSc = IncludeScAttributes::ON;
 
     if (block.nVersion != BLOCK_VERSION_SC_SUPPORT)
@@ -3428,8 +4305,23 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
 
     CCheckQueueControl<CScriptCheck> control(fExpensiveChecks && nScriptCheckThreads ? &scriptcheckqueue : NULL);
 
+    // The proofs are verified while the transactions are connected and their scripts checked
+    CCheckQueueControl<CJoinSplitCheck> joinSplitControl(fQueueJoinSplitChecks ? &joinsplitcheckqueue : NULL);
+    if (fQueueJoinSplitChecks) {
+        std::vector<CJoinSplitCheck> vJoinSplitChecks;
+        for (const CTransaction& tx : block.vtx)
+            for (const JSDescription& joinsplit : tx.GetVjoinsplit())
+                vJoinSplitChecks.push_back(CJoinSplitCheck(joinsplit, tx.joinSplitPubKey));
+        joinSplitControl.Add(vJoinSplitChecks);
+    }
+
+    // the stage histograms only track the blocks connected to the active chain, not the templates checks
+    const bool fRecordStats = processingType == flagBlockProcessingType::COMPLETE;
+
     int64_t deltaPreProcTime = GetTimeMicros() - nTime0;
     LogPrint("bench", "    - block preproc: %.2fms\n", 0.001 * deltaPreProcTime);
+    if (fRecordStats)
+        RecordBlockValidationStage(BlockValidationStage::CHECK_BLOCK, deltaPreProcTime);
 
     int64_t nTimeStart = GetTimeMicros();
     CAmount nFees = 0;
@@ -3444,6 +4336,9 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
     std::vector<std::pair<CAddressIndexKey, CAddressIndexValue>> addressIndex;
     std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue>> addressUnspentIndex;
     std::vector<std::pair<CSpentIndexKey, CSpentIndexValue>> spentIndex;
+    CBlockInputDeltas blockInputDeltas;
+    if (fSpentIndex)
+        blockInputDeltas.vTxInputs.resize(block.vtx.size());
 
     // Construct the incremental merkle tree at the current
     // block position,
@@ -3463,6 +4358,7 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
         // match what we asked for.
         assert(tree.root() == old_tree_root);
     }
+    std::vector<uint256> vNoteCommitments;
 
     // Check sidechain txs commitment tree limits now. This is less expensive than populating a txsCommitmentBuilder
     if (ForkManager::getInstance().isNonCeasingSidechainActive(pindex->nHeight)) {
@@ -3489,7 +4385,12 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
     // having a total number of sc or ft / bwt / csw / cert per sidechain greater than currently
     // supported by CCTPlib.
     // We also check that the on-the-fly calculated scTxsCommitment is equal to that included in the block.
+    // A block assembled by this node has already been checked against its commitment by CreateNewBlock.
     SidechainTxsCommitmentBuilder scCommitmentBuilder;
+    uint256 cachedScTxsCommitment;
+    const bool fCachedScTxsCommitment = fScRelatedChecks == flagScRelatedChecks::ON &&
+        SidechainTxsCommitmentBuilder::lookupBlockCommitment(block, cachedScTxsCommitment) &&
+        cachedScTxsCommitment == block.hashScTxsCommitment;
 
     for (unsigned int txIdx = 0; txIdx < block.vtx.size(); ++txIdx) // Processing transactions loop
     {
@@ -3559,6 +4460,7 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
                         spentIndex.push_back(make_pair(
                             CSpentIndexKey(input.prevout.hash, input.prevout.n),
                             CSpentIndexValue(tx.GetHash(), j, pindex->nHeight, prevout.nValue, addressType, addrHash)));
+                        blockInputDeltas.vTxInputs[txIdx].push_back(CInputDelta(prevout.nValue, addressType, addrHash));
                     }
                 }
             }
@@ -3574,7 +4476,7 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
             nFees += tx.GetFeeAmount(view.GetValueIn(tx));
 
             std::vector<CScriptCheck> vChecks;
-            if (!ContextualCheckTxInputs(tx, state, view, fExpensiveChecks, chain, flags, false, chainparams.GetConsensus(), nScriptCheckThreads ? &vChecks : NULL))
+            if (!ContextualCheckTxInputs(tx, state, view, fExpensiveChecks, chain, flags, fCacheResults, chainparams.GetConsensus(), nScriptCheckThreads ? &vChecks : NULL))
                 return false;
 
             control.Add(vChecks);
@@ -3627,16 +4529,14 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
         }
 
         BOOST_FOREACH(const JSDescription &joinsplit, tx.GetVjoinsplit()) {
-            BOOST_FOREACH(const uint256 &note_commitment, joinsplit.commitments) {
-                // Insert the note commitments into our temporary tree.
-                tree.append(note_commitment);
-            }
+            // The note commitments are inserted into our temporary tree at once after the loop
+            vNoteCommitments.insert(vNoteCommitments.end(), joinsplit.commitments.begin(), joinsplit.commitments.end());
         }
 
         vTxIndexValues.push_back(std::make_pair(tx.GetHash(), CTxIndexValue(pos, txIdx, 0)));
         pos.nTxOffset += ::GetSerializeSize(tx, SER_DISK, CLIENT_VERSION);
 
-        if (fScRelatedChecks == flagScRelatedChecks::ON) {
+        if (fScRelatedChecks == flagScRelatedChecks::ON && !fCachedScTxsCommitment) {
             bool retBuilder = scCommitmentBuilder.add(tx);
             if (!retBuilder && ForkManager::getInstance().isNonCeasingSidechainActive(pindex->nHeight))
                 return state.DoS(100, error("%s():%d: cannot add tx to scTxsCommitmentBuilder", __func__, __LINE__),
@@ -3644,6 +4544,8 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
         }
     }  //end of Processing transactions loop
 
+    tree.append(vNoteCommitments.begin(), vNoteCommitments.end());
+
 
     std::map<uint256, uint256> highQualityCertData = HighQualityCertData(block, view);
     // key: current block top quality cert for given sc --> value: prev block superseeded cert hash (possibly null)
@@ -3709,7 +4611,7 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
         nFees += cert.GetFeeAmount(view.GetValueIn(cert));
 
         std::vector<CScriptCheck> vChecks;
-        if (!ContextualCheckCertInputs(cert, state, view, fExpensiveChecks, chain, flags, false, chainparams.GetConsensus(), nScriptCheckThreads ? &vChecks : NULL))
+        if (!ContextualCheckCertInputs(cert, state, view, fExpensiveChecks, chain, flags, fCacheResults, chainparams.GetConsensus(), nScriptCheckThreads ? &vChecks : NULL))
             return false;
 
         control.Add(vChecks);
@@ -3844,7 +4746,7 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
         vTxIndexValues.push_back(std::make_pair(cert.GetHash(), CTxIndexValue(pos, certIdx, certMaturityHeight)));
         pos.nTxOffset += cert.GetSerializeSize(SER_NETWORK, PROTOCOL_VERSION);
 
-        if (fScRelatedChecks == flagScRelatedChecks::ON)
+        if (fScRelatedChecks == flagScRelatedChecks::ON && !fCachedScTxsCommitment)
         {
             bool retBuilder = scCommitmentBuilder.add(cert, view);
             if (!retBuilder && ForkManager::getInstance().isNonCeasingSidechainActive(pindex->nHeight))
@@ -3879,6 +4781,14 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
         LogPrint("cert", "%s():%d - nTxOffset=%d\n", __func__, __LINE__, pos.nTxOffset );
     } //end of Processing certificates loop
 
+    // All the sc proofs have been loaded: start verifying them right away, so that the SNARK batch
+    // runs alongside the script checks still pending in the check queue. The join is below.
+    if (fScProofVerification == flagScProofVerification::ON)
+    {
+        LogPrint("sc", "%s():%d - calling scVerifier.StartBatchVerification()\n", __func__, __LINE__);
+        scVerifier.StartBatchVerification();
+    }
+
     if (explorerIndexesWrite == flagLevelDBIndexesWrite::ON)
     {
 
@@ -3898,7 +4808,7 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
         }
     }
 
-    if (!view.HandleSidechainEvents(pindex->nHeight, blockundo, pCertsStateInfo))
+    if (!view.HandleSidechainEvents(pindex->nHeight, blockundo, pCertsStateInfo, std::max(1, nScriptCheckThreads)))
     {
         return state.DoS(100, error("%s():%d - SIDECHAIN-EVENT: could not handle scheduled event",__func__, __LINE__),
                                  CValidationState::Code::INVALID, "bad-sc-events-handling");
@@ -3922,6 +4832,8 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
         (unsigned)block.vtx.size(), (unsigned)block.vcert.size(),
          0.001 * deltaConnectTime, 0.001 * deltaConnectTime / (block.vtx.size() + block.vcert.size()),
          nInputs <= 1 ? 0 : 0.001 * deltaConnectTime / (nInputs-1), nTimeConnect * 0.000001);
+    if (fRecordStats)
+        RecordBlockValidationStage(BlockValidationStage::CONNECT_INPUTS, deltaConnectTime);
 
     CAmount blockReward = nFees + GetBlockSubsidy(pindex->nHeight, chainparams.GetConsensus());
     if (block.vtx[0].GetValueOut() > blockReward)
@@ -3933,18 +4845,26 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
     if (!control.Wait())
         return state.DoS(100, false);
 
+    if (!joinSplitControl.Wait())
+        return state.DoS(100, error("%s(): joinsplit does not verify", __func__),
+                         CValidationState::Code::INVALID, "bad-txns-joinsplit-verification-failed");
+
     int64_t nTime2 = GetTimeMicros();
     int64_t deltaVerifyTime = nTime2 - nTimeStart;
 
     nTimeVerify += deltaVerifyTime;
     LogPrint("bench", "    - Verify %u txins: %.2fms (%.3fms/txin) [%.2fs] (nScriptCheckThreads=%d)\n", nInputs - 1, 0.001 * deltaVerifyTime, nInputs <= 1 ? 0 : 0.001 * deltaVerifyTime / (nInputs-1), nTimeVerify * 0.000001, nScriptCheckThreads);
+    if (fRecordStats)
+        RecordBlockValidationStage(BlockValidationStage::SCRIPT_CHECKS, nTime2 - nTime1);
 
     if (fScRelatedChecks == flagScRelatedChecks::ON)
     {
         int64_t nCommTreeStartTime = GetTimeMicros();
-        const uint256& scTxsCommitment = scCommitmentBuilder.getCommitment();
+        const uint256& scTxsCommitment = fCachedScTxsCommitment ? cachedScTxsCommitment : scCommitmentBuilder.getCommitment();
         int64_t deltaCommTreeTime = GetTimeMicros() - nCommTreeStartTime;
         LogPrint("bench", "    - txsCommTree: %.2fms\n", deltaCommTreeTime * 0.001);
+        if (fRecordStats)
+            RecordBlockValidationStage(BlockValidationStage::COMMITMENT, deltaCommTreeTime);
 
         if (block.hashScTxsCommitment != scTxsCommitment)
         {
@@ -3961,15 +4881,17 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
 
     if (fScProofVerification == flagScProofVerification::ON)
     {
-        LogPrint("sc", "%s():%d - calling scVerifier.BatchVerify()\n", __func__, __LINE__);
+        LogPrint("sc", "%s():%d - calling scVerifier.WaitForBatchVerification()\n", __func__, __LINE__);
         int64_t nBatchVerifyStartTime = GetTimeMicros();
-        if (!scVerifier.BatchVerify())
+        if (!scVerifier.WaitForBatchVerification())
         {
             return state.DoS(100, error("%s():%d - ERROR: sc-related batch proof verification failed", __func__, __LINE__),
                             CValidationState::Code::INVALID_PROOF, "bad-sc-proof");
         }
         int64_t deltaBatchVerifyTime = GetTimeMicros() - nBatchVerifyStartTime;
-        LogPrint("bench", "    - scBatchVerify: %.2fms\n", deltaBatchVerifyTime * 0.001);
+        LogPrint("bench", "    - scBatchVerify (wait): %.2fms\n", deltaBatchVerifyTime * 0.001);
+        if (fRecordStats)
+            RecordBlockValidationStage(BlockValidationStage::PROOF_VERIFY, deltaBatchVerifyTime);
     }
 
     int64_t nTime2b = GetTimeMicros();
@@ -3985,9 +4907,10 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
     {
         if (pindex->GetUndoPos().IsNull()) {
             CDiskBlockPos pos;
-            if (!FindUndoPos(state, pindex->nFile, pos, ::GetSerializeSize(blockundo, SER_DISK, CLIENT_VERSION) + 40))
+            std::shared_ptr<CSerializeData> record = SerializeUndoRecord(blockundo, pindex->pprev->GetBlockHash(), chainparams.MessageStart());
+            if (!FindUndoPos(state, pindex->nFile, pos, record->size()))
                 return error("%s():%d: FindUndoPos failed",__func__, __LINE__);
-            if (!UndoWriteToDisk(blockundo, pos, pindex->pprev->GetBlockHash(), chainparams.MessageStart()))
+            if (!UndoWriteToDisk(std::move(record), pos))
                 return AbortNode(state, "Failed to write undo data");
 
             LogPrint("sc", "%s():%d - undo info written on disk\n", __func__, __LINE__);
@@ -4000,55 +4923,33 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
         setDirtyBlockIndex.insert(pindex);
     }
 
-    if (explorerIndexesWrite == flagLevelDBIndexesWrite::ON) {
-        if (fTxIndex) {
-            if (!pblocktree->WriteTxIndex(vTxIndexValues))
-                return AbortNode(state, "Failed to write transaction index");
-        }
-        if (fMaturityHeightIndex) {
-            if (!pblocktree->UpdateMaturityHeightIndex(maturityHeightValues))
-                return AbortNode(state, "Failed to write maturity height index");
-        }
-
-        if (fAddressIndex) {
-            if (!pblocktree->WriteAddressIndex(addressIndex)) {
-                return AbortNode(state, "Failed to write address index");
-            }
-
-            if (!pblocktree->UpdateAddressUnspentIndex(addressUnspentIndex))
-            {
-                return AbortNode(state, "Failed to update address unspent index");
-            }
-        }
+    // its transactions and certificates are not trusted when resurrected to the mempool after a reorg
+    const unsigned int nStatusAssumed = fExpensiveChecks ? pindex->nStatus & ~BLOCK_ASSUMED_VALID : pindex->nStatus | BLOCK_ASSUMED_VALID;
+    if (nStatusAssumed != pindex->nStatus) {
+        pindex->nStatus = nStatusAssumed;
+        setDirtyBlockIndex.insert(pindex);
+    }
 
+    if (explorerIndexesWrite == flagLevelDBIndexesWrite::ON) {
+        // the entries are only filled for the enabled indexes; with -asyncindexes they are
+        // written by the index writer thread, in block order, while the next block is connected
+        std::unique_ptr<CBlockIndexesUpdate> update(new CBlockIndexesUpdate());
+        update->hashBestBlock = pindex->GetBlockHash();
+        update->vTxIndex = std::move(vTxIndexValues);
+        update->vMaturityHeight = std::move(maturityHeightValues);
+        update->vAddressIndex = std::move(addressIndex);
+        update->vAddressUnspent = std::move(addressUnspentIndex);
+        update->vSpent = std::move(spentIndex);
         if (fSpentIndex)
-        {
-            if (!pblocktree->UpdateSpentIndex(spentIndex))
-            {
-                return AbortNode(state, "Failed to update address spent index");
-            }
-        }
-
+            update->vBlockInputDeltas.push_back(std::make_pair(pindex->GetBlockHash(), std::move(blockInputDeltas)));
         if (fTimestampIndex) {
-            unsigned int logicalTS = pindex->nTime;
-            unsigned int prevLogicalTS = 0;
-
-            // retrieve logical timestamp of the previous block
+            update->fTimestamp = true;
+            update->nTime = pindex->nTime;
             if (pindex->pprev)
-                if (!pblocktree->ReadTimestampBlockIndex(pindex->pprev->GetBlockHash(), prevLogicalTS))
-                    LogPrintf("%s: Failed to read previous block's logical timestamp\n", __func__);
-
-            if (logicalTS <= prevLogicalTS) {
-                logicalTS = prevLogicalTS + 1;
-                LogPrintf("%s: Previous logical timestamp is newer Actual[%d] prevLogical[%d] Logical[%d]\n", __func__, pindex->nTime, prevLogicalTS, logicalTS);
-            }
-
-            if (!pblocktree->WriteTimestampIndex(CTimestampIndexKey(logicalTS, pindex->GetBlockHash())))
-                return AbortNode(state, "Failed to write timestamp index");
-
-            if (!pblocktree->WriteTimestampBlockIndex(CTimestampBlockIndexKey(pindex->GetBlockHash()), CTimestampBlockIndexValue(logicalTS)))
-                return AbortNode(state, "Failed to write blockhash index");
+                update->hashPrevBlock = pindex->pprev->GetBlockHash();
         }
+        if (!pblocktree->QueueIndexesUpdate(std::move(update)))
+            return AbortNode(state, "Failed to write indexes");
     }
 
     // add this block to the view's block chain
@@ -4056,10 +4957,12 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
 
     int64_t nTime3 = GetTimeMicros(); nTimeIndex += nTime3 - nTime2b;
     LogPrint("bench", "    - Index writing: %.2fms [%.2fs]\n", 0.001 * (nTime3 - nTime2b), nTimeIndex * 0.000001);
+    RecordBlockValidationStage(BlockValidationStage::INDEX_WRITES, nTime3 - nTime2b);
 
     // Watch for changes to the previous coinbase transaction.
     static uint256 hashPrevBestCoinBase;
-    GetMainSignals().UpdatedTransaction(hashPrevBestCoinBase);
+    const uint256 hashUpdated = hashPrevBestCoinBase;
+    CallFunctionInValidationInterfaceQueue([hashUpdated] { GetMainSignals().UpdatedTransaction(hashUpdated); });
     hashPrevBestCoinBase = block.vtx[0].GetHash();
 
     int64_t nTime4 = GetTimeMicros(); nTimeCallbacks += nTime4 - nTime3;
@@ -4096,7 +4999,7 @@ bool static FlushStateToDisk(CValidationState &state, FlushStateMode mode) {
         fCheckForPruning = false;
         if (!setFilesToPrune.empty()) {
             fFlushForPrune = true;
-            if (!fHavePruned) {
+            if (!fHavePruned && !fPruneToArchive) {
                 pblocktree->WriteFlag("prunedblockfiles", true);
                 fHavePruned = true;
             }
@@ -4113,11 +5016,14 @@ bool static FlushStateToDisk(CValidationState &state, FlushStateMode mode) {
     if (nLastSetChain == 0) {
         nLastSetChain = nNow;
     }
-    size_t cacheSize = pcoinsTip->DynamicMemoryUsage();
-    // The cache is large and close to the limit, but we have time now (not in the middle of a block processing).
-    bool fCacheLarge = mode == FLUSH_STATE_PERIODIC && cacheSize * (10.0/9) > nCoinCacheUsage;
-    // The cache is over the limit, we have to write now.
-    bool fCacheCritical = mode == FLUSH_STATE_IF_NEEDED && cacheSize > nCoinCacheUsage;
+    // The coins and the sidechains of the cache have a limit each.
+    const CCoinsCacheUsage cacheUsage = pcoinsTip->DynamicMemoryUsageByFamily();
+    // The cache is large and close to a limit, but we have time now (not in the middle of a block processing).
+    bool fCacheLarge = mode == FLUSH_STATE_PERIODIC &&
+            (cacheUsage.nCoins * (10.0/9) > nCoinCacheUsage || cacheUsage.nSidechains * (10.0/9) > nScCacheUsage);
+    // The cache is over a limit, we have to write now.
+    bool fCacheCritical = mode == FLUSH_STATE_IF_NEEDED &&
+            (cacheUsage.nCoins > nCoinCacheUsage || cacheUsage.nSidechains > nScCacheUsage);
     // It's been a while since we wrote the block index to disk. Do this frequently, so we don't need to redownload after a crash.
     bool fPeriodicWrite = mode == FLUSH_STATE_PERIODIC && nNow > nLastWrite + (int64_t)DATABASE_WRITE_INTERVAL * 1000000;
     // It's been very long since we flushed the cache. Do this infrequently, to optimize cache usage.
@@ -4131,6 +5037,8 @@ bool static FlushStateToDisk(CValidationState &state, FlushStateMode mode) {
             return state.Error("out of disk space");
         // First make sure all block and undo data is flushed to disk.
         FlushBlockFile();
+        if (!blockFileWriter.Sync())
+            return AbortNode(state, "Failed to write to block files");
         // Then update all block file information (which may refer to block and undo files).
         {
             std::vector<std::pair<int, const CBlockFileInfo*> > vFiles;
@@ -4143,6 +5051,8 @@ bool static FlushStateToDisk(CValidationState &state, FlushStateMode mode) {
             vBlocks.reserve(setDirtyBlockIndex.size());
             for (set<CBlockIndex*>::iterator it = setDirtyBlockIndex.begin(); it != setDirtyBlockIndex.end(); ) {
                 vBlocks.push_back(*it);
+                if (fCheckBlockIndex)
+                    setBlockIndexToCheck.insert(*it);
                 setDirtyBlockIndex.erase(it++);
             }
             if (!pblocktree->WriteBatchSync(vFiles, nLastBlockFile, vBlocks)) {
@@ -4150,8 +5060,12 @@ bool static FlushStateToDisk(CValidationState &state, FlushStateMode mode) {
             }
         }
         // Finally remove any pruned files
-        if (fFlushForPrune)
-            UnlinkPrunedFiles(setFilesToPrune);
+        if (fFlushForPrune) {
+            if (fPruneToArchive)
+                ArchivePrunedFiles(setFilesToPrune);
+            else
+                UnlinkPrunedFiles(setFilesToPrune);
+        }
         nLastWrite = nNow;
     }
     // Flush best chain related state. This can only be done if the blocks / block index write was also done.
@@ -4163,14 +5077,24 @@ bool static FlushStateToDisk(CValidationState &state, FlushStateMode mode) {
         // overwrite one. Still, use a conservative safety factor of 2.
         if (!CheckDiskSpace(128 * 2 * 2 * pcoinsTip->GetCacheSize()))
             return state.Error("out of disk space");
+        // The indexes must not lag behind the flushed chainstate, or the blocks they miss would not be connected again after a crash
+        if (!pblocktree->SyncIndexes())
+            return AbortNode(state, "Failed to write indexes");
         // Flush the chainstate (which may refer to block index entries).
         if (!pcoinsTip->Flush())
             return AbortNode(state, "Failed to write to coin database");
+        // The coins db write may go on in background, unless the chainstate is required to be on disk now
+        bool fSyncFlush = mode == FLUSH_STATE_ALWAYS || fFlushForPrune || !GetBoolArg("-backgroundcoinsflush", DEFAULT_BACKGROUND_COINS_FLUSH);
+        if (fSyncFlush && pcoinsFlusher != NULL && !pcoinsFlusher->Sync())
+            return AbortNode(state, "Failed to write to coin database");
+        // The emptied cache leaves free chunks in the heap, which malloc would keep
+        ReleaseFreeHeapMemory();
         nLastFlush = nNow;
     }
     if ((mode == FLUSH_STATE_ALWAYS || mode == FLUSH_STATE_PERIODIC) && nNow > nLastSetChain + (int64_t)DATABASE_WRITE_INTERVAL * 1000000) {
-        // Update best block in wallet (so we can detect restored wallets).
-        GetMainSignals().SetBestChain(chainActive.GetLocator());
+        // Update best block in wallet (so we can detect restored wallets), once it has the blocks before it
+        const CBlockLocator locator = chainActive.GetLocator();
+        CallFunctionInValidationInterfaceQueue([locator] { GetMainSignals().SetBestChain(locator); });
         nLastSetChain = nNow;
     }
     } catch (const std::runtime_error& e) {
@@ -4193,7 +5117,9 @@ void PruneAndFlush() {
 /** Update chainActive and related internal data structures. */
 void static UpdateTip(CBlockIndex *pindexNew) {
     const CChainParams& chainParams = Params();
+    finalityIndex.SetChainTipChanged(chainActive.Tip(), pindexNew);
     chainActive.SetTip(pindexNew);
+    pindexPublishedTip = pindexNew;
 
     // New best block
     nTimeBestReceived = GetTime();
@@ -4213,22 +5139,153 @@ void static UpdateTip(CBlockIndex *pindexNew) {
     cvBlockChange.notify_all();
 }
 
-/** Disconnect chainActive's tip. */
-bool static DisconnectTip(CValidationState &state) {
+/** A block of the active chain to disconnect, read from disk ahead of DisconnectTip together with its undo data */
+struct CBlockToDisconnect
+{
+    CBlockIndex* pindex = nullptr;
+    // copied under cs_main, the readers do not touch the block index
+    uint256 hash;
+    uint256 hashPrev;
+    CDiskBlockPos blockPos;
+    CDiskBlockPos undoPos;
+
+    bool fRead = false;
+    CBlock block;
+    //! null when the undo data could not be read, DisconnectBlock then reads it and reports the error
+    std::unique_ptr<CBlockUndo> undo;
+};
+
+static void ReadBlockToDisconnect(CBlockToDisconnect& entry)
+{
+    if (!ReadBlockFromDisk(entry.block, entry.blockPos) || entry.block.GetHash() != entry.hash)
+        return;
+    entry.fRead = true;
+    if (entry.undoPos.IsNull())
+        return;
+    const IncludeScAttributes includeSc = entry.block.nVersion == BLOCK_VERSION_SC_SUPPORT ? IncludeScAttributes::ON : IncludeScAttributes::OFF;
+    entry.undo.reset(new CBlockUndo(includeSc));
+    if (!UndoReadFromDisk(*entry.undo, entry.undoPos, entry.hashPrev))
+        entry.undo.reset();
+}
+
+/**
+ * The blocks disconnected by a reorg, whose transactions and certificates are resurrected to the mempool
+ * at once after the last one is disconnected, lowest block first, rather than block by block.
+ */
+struct CDisconnectedBlocks
+{
+    //! In disconnection order, the highest block first, with whether their entries were checked when connected
+    std::deque<std::pair<std::shared_ptr<const CBlock>, ResurrectionFlag>> vBlocks;
+    size_t nBytes = 0;
+    //! The anchors of the disconnected blocks which are no longer the best anchor
+    std::set<uint256> setAnchors;
+    bool fCumtreeErased = false;
+
+    void Add(const std::shared_ptr<const CBlock>& block, ResurrectionFlag fResurrection)
+    {
+        vBlocks.emplace_back(block, fResurrection);
+        nBytes += ::GetSerializeSize(*block, SER_NETWORK, PROTOCOL_VERSION);
+        // past the limit the highest blocks are dropped, their transactions only depend on the lower ones
+        while (nBytes > MAX_DISCONNECTED_BLOCKS_BYTES && vBlocks.size() > 1)
+        {
+            nBytes -= ::GetSerializeSize(*vBlocks.front().first, SER_NETWORK, PROTOCOL_VERSION);
+            vBlocks.pop_front();
+        }
+    }
+};
+
+/**
+ * Resurrect to the mempool the transactions and certificates of the disconnected blocks, given lowest
+ * first. The block order is a dependency order for the whole batch, each entry following the ones it
+ * spends. The proofs and consensus scripts of the blocks given ResurrectionFlag::ON are not checked again,
+ * only the contextual checks are; those of the blocks connected without them being checked are.
+ */
+static void ResurrectBlocksToMempool(const std::vector<std::pair<const CBlock*, ResurrectionFlag>>& vBlocks)
+{
+    std::list<CTransaction> dummyTxs;
+    std::list<CScCertificate> dummyCerts;
+    for (const auto& entry : vBlocks) {
+        const CBlock* pblock = entry.first;
+        const MempoolProofVerificationFlag fProofVerification = entry.second == ResurrectionFlag::ON ?
+                                                                MempoolProofVerificationFlag::DISABLED : MempoolProofVerificationFlag::SYNC;
+        for(const CTransaction &tx: pblock->vtx) {
+            // ignore validation errors in resurrected transactions
+            CValidationState stateDummy;
+            if (tx.IsScVersion()) {
+                LogPrint("sc", "%s():%d - resurrecting tx [%s] to mempool\n", __func__, __LINE__, tx.GetHash().ToString());
+            }
+
+            if (tx.IsCoinBase() ||
+                MempoolReturnValue::VALID != AcceptTxToMemoryPool(*mempool, stateDummy, tx,
+                        LimitFreeFlag::OFF, RejectAbsurdFeeFlag::OFF, fProofVerification, nullptr, entry.second))
+            {
+                LogPrint("sc", "%s():%d - removing tx [%s] from mempool\n[%s]\n",
+                    __func__, __LINE__, tx.GetHash().ToString(), tx.ToString());
+                mempool->remove(tx, dummyTxs, dummyCerts, true, MemPoolRemovalReason::REORG);
+            }
+        }
+
+        dummyTxs.clear();
+        dummyCerts.clear();
+        for (const CScCertificate& cert : pblock->vcert) {
+            // ignore validation errors in resurrected certificates
+            LogPrint("sc", "%s():%d - resurrecting certificate [%s] to mempool\n", __func__, __LINE__, cert.GetHash().ToString());
+            CValidationState stateDummy;
+            if (MempoolReturnValue::VALID != AcceptCertificateToMemoryPool(*mempool, stateDummy, cert,
+                    LimitFreeFlag::OFF, RejectAbsurdFeeFlag::OFF, fProofVerification, nullptr, entry.second))
+            {
+                LogPrint("sc", "%s():%d - removing certificate [%s] from mempool\n[%s]\n",
+                    __func__, __LINE__, cert.GetHash().ToString(), cert.ToString());
+
+                mempool->remove(cert, dummyTxs, dummyCerts, true, MemPoolRemovalReason::REORG);
+            }
+        }
+    }
+}
+
+/** Evict from the mempool what the disconnection of blocks made invalid */
+static void RemoveStaleAfterDisconnect(const std::set<uint256>& setAnchors)
+{
+    for (const uint256& anchor : setAnchors)
+        mempool->removeWithAnchor(anchor);
+
+    std::list<CTransaction> dummyTxs;
+    std::list<CScCertificate> dummyCerts;
+    bool fHardForkCheckEnabled = ForkManager::getInstance().isCrossHardFork(pcoinsTip->GetHeight() + 1, pcoinsTip->GetHeight() + 2);
+    mempool->removeStaleTransactions(pcoinsTip, dummyTxs, dummyCerts, fHardForkCheckEnabled);
+    mempool->removeStaleCertificates(pcoinsTip, dummyCerts);
+}
+
+/**
+ * Disconnect the tip of chainActive. The block and its undo data are taken from pPrefetched when it was
+ * read ahead for the tip. With pDisconnected the mempool is left alone, the transactions of the block
+ * being resurrected later by UpdateMempoolForReorg.
+ */
+bool static DisconnectTip(CValidationState &state, CBlockToDisconnect* pPrefetched = nullptr, CDisconnectedBlocks* pDisconnected = nullptr) {
     CBlockIndex *pindexDelete = chainActive.Tip();
     assert(pindexDelete);
-    mempool->check(pcoinsTip);
-    // Read block from disk.
+    // while a reorg is under way the mempool misses the transactions of the blocks disconnected so far
+    if (!pDisconnected)
+        mempool->check(pcoinsTip);
+    // Read block from disk, unless it was read ahead
     CBlock block;
-    if (!ReadBlockFromDisk(block, pindexDelete))
+    CBlockUndo* pBlockUndo = nullptr;
+    if (pPrefetched && pPrefetched->pindex == pindexDelete && pPrefetched->fRead)
+    {
+        block = std::move(pPrefetched->block);
+        pBlockUndo = pPrefetched->undo.get();
+    }
+    else if (!ReadBlockFromDisk(block, pindexDelete))
         return AbortNode(state, "Failed to read block");
+    // the entries of a block connected without its scripts and proofs checked are checked in full when resurrected
+    const ResurrectionFlag fResurrection = (pindexDelete->nStatus & BLOCK_ASSUMED_VALID) ? ResurrectionFlag::OFF : ResurrectionFlag::ON;
     // Apply the block atomically to the chain state.
     uint256 anchorBeforeDisconnect = pcoinsTip->GetBestAnchor();
     int64_t nStart = GetTimeMicros();
     std::vector<CScCertificateStatusUpdateInfo> certsStateInfo;
     {
         CCoinsViewCache view(pcoinsTip);
-        if (!DisconnectBlock(block, state, pindexDelete, view, flagLevelDBIndexesWrite::ON, nullptr, &certsStateInfo))
+        if (!DisconnectBlock(block, state, pindexDelete, view, flagLevelDBIndexesWrite::ON, nullptr, &certsStateInfo, pBlockUndo))
             return error("DisconnectTip(): DisconnectBlock %s failed", pindexDelete->GetBlockHash().ToString());
         assert(view.Flush());
     }
@@ -4240,7 +5297,10 @@ bool static DisconnectTip(CValidationState &state) {
     size_t erased = mapCumtreeHeight.erase(pindexDelete->scCumTreeHash.GetLegacyHash());
     if (erased) {
         LogPrint("sc", "- Removed %zu entries from mapCumtreeHeight\n", erased);
-        mempool->removeCertificatesWithoutRef(pcoinsTip, dummyCerts);
+        if (pDisconnected)
+            pDisconnected->fCumtreeErased = true;
+        else
+            mempool->removeCertificatesWithoutRef(pcoinsTip, dummyCerts);
     }
     dummyTxs.clear();
     dummyCerts.clear();
@@ -4250,76 +5310,159 @@ bool static DisconnectTip(CValidationState &state) {
     if (!FlushStateToDisk(state, FLUSH_STATE_IF_NEEDED))
         return false;
 
-    // Resurrect mempool transactions and certificates from the disconnected block.
-    for(const CTransaction &tx: block.vtx) {
-        // ignore validation errors in resurrected transactions
-        CValidationState stateDummy;
-        if (tx.IsScVersion()) {
-            LogPrint("sc", "%s():%d - resurrecting tx [%s] to mempool\n", __func__, __LINE__, tx.GetHash().ToString());
-        }
-
-        if (tx.IsCoinBase() ||
-            MempoolReturnValue::VALID != AcceptTxToMemoryPool(*mempool, stateDummy, tx,
-                    LimitFreeFlag::OFF, RejectAbsurdFeeFlag::OFF, MempoolProofVerificationFlag::DISABLED))
-        {
-            LogPrint("sc", "%s():%d - removing tx [%s] from mempool\n[%s]\n",
-                __func__, __LINE__, tx.GetHash().ToString(), tx.ToString());
-            mempool->remove(tx, dummyTxs, dummyCerts, true);
-        }
-    }
-
-    dummyTxs.clear();
-    dummyCerts.clear();
-    for (const CScCertificate& cert : block.vcert) {
-        // ignore validation errors in resurrected certificates
-        LogPrint("sc", "%s():%d - resurrecting certificate [%s] to mempool\n", __func__, __LINE__, cert.GetHash().ToString());
-        CValidationState stateDummy;
-        if (MempoolReturnValue::VALID != AcceptCertificateToMemoryPool(*mempool, stateDummy, cert,
-                LimitFreeFlag::OFF, RejectAbsurdFeeFlag::OFF, MempoolProofVerificationFlag::DISABLED, nullptr))
-        {
-            LogPrint("sc", "%s():%d - removing certificate [%s] from mempool\n[%s]\n",
-                __func__, __LINE__, cert.GetHash().ToString(), cert.ToString());
+    if (!pDisconnected)
+    {
+        // Resurrect mempool transactions and certificates from the disconnected block.
+        ResurrectBlocksToMempool({{&block, fResurrection}});
 
-            mempool->remove(cert, dummyTxs, dummyCerts, true);
+        std::set<uint256> setAnchors;
+        if (anchorBeforeDisconnect != anchorAfterDisconnect) {
+            // The anchor may not change between block disconnects,
+            // in which case we don't want to evict from the mempool yet!
+            setAnchors.insert(anchorBeforeDisconnect);
         }
-    }
+        RemoveStaleAfterDisconnect(setAnchors);
 
-    if (anchorBeforeDisconnect != anchorAfterDisconnect) {
-        // The anchor may not change between block disconnects,
-        // in which case we don't want to evict from the mempool yet!
-        mempool->removeWithAnchor(anchorBeforeDisconnect);
+        mempool->check(pcoinsTip);
     }
+    else if (anchorBeforeDisconnect != anchorAfterDisconnect)
+        pDisconnected->setAnchors.insert(anchorBeforeDisconnect);
 
-    bool fHardForkCheckEnabled = ForkManager::getInstance().isCrossHardFork(pcoinsTip->GetHeight() + 1, pcoinsTip->GetHeight() + 2);
-    mempool->removeStaleTransactions(pcoinsTip, dummyTxs, dummyCerts, fHardForkCheckEnabled);
-    mempool->removeStaleCertificates(pcoinsTip, dummyCerts);
-
-    mempool->check(pcoinsTip);
     // Update chainActive and related variables.
     UpdateTip(pindexDelete->pprev);
+    // The scripts passed against the chain with the disconnected block, including those of the
+    // transactions resurrected above, which may reference it for replay protection
+    ClearScriptExecutionCache();
     // Get the current commitment tree
     ZCIncrementalMerkleTree newTree;
     assert(pcoinsTip->GetAnchorAt(pcoinsTip->GetBestAnchor(), newTree));
 
-    // Let wallets know transactions went from 1-confirmed to
-    // 0-confirmed or conflicted:
-    for(const CTransaction &tx: block.vtx) {
-        SyncWithWallets(tx, nullptr);
-    }
+    std::shared_ptr<const CBlock> sharedBlock = std::make_shared<const CBlock>(std::move(block));
+    if (pDisconnected)
+        pDisconnected->Add(sharedBlock, fResurrection);
+    CallFunctionInValidationInterfaceQueue([pindexDelete, sharedBlock, newTree, certsStateInfo = std::move(certsStateInfo)] {
+        LOCK(cs_main);
+        CMainSignals& signals = GetMainSignals();
+        signals.BeginBlockSync();
+
+        // Let wallets know transactions went from 1-confirmed to
+        // 0-confirmed or conflicted:
+        for(const CTransaction &tx: sharedBlock->vtx) {
+            signals.SyncTransaction(tx, nullptr);
+        }
+
+        for(const CScCertificate &cert: sharedBlock->vcert) {
+            LogPrint("cert", "%s():%d - sync with wallet from block to unconfirmed cert[%s]\n", "DisconnectTip", __LINE__, cert.GetHash().ToString());
+            signals.SyncCertificate(cert, nullptr, -1);
+        }
+
+        for(const auto& item : certsStateInfo) {
+            LogPrint("cert", "%s():%d - updating cert state in wallet:\n[%s]\n", "DisconnectTip", __LINE__, item.ToString());
+            signals.SyncCertStatus(item);
+        }
+
+        // Update cached incremental witnesses
+        signals.ChainTip(pindexDelete, sharedBlock.get(), newTree, false);
+        signals.EndBlockSync();
+    });
+    return true;
+}
 
-    for(const CScCertificate &cert: block.vcert) {
-        LogPrint("cert", "%s():%d - sync with wallet from block to unconfirmed cert[%s]\n", __func__, __LINE__, cert.GetHash().ToString());
-        SyncWithWallets(cert, nullptr);
+/**
+ * Resurrect to the mempool the transactions and certificates of the blocks disconnected by a reorg, once
+ * all of them are disconnected, and evict what their disconnection made invalid.
+ */
+static void UpdateMempoolForReorg(CDisconnectedBlocks& disconnected)
+{
+    if (disconnected.vBlocks.empty())
+        return;
+
+    int64_t nStart = GetTimeMicros();
+    std::list<CScCertificate> dummyCerts;
+    if (disconnected.fCumtreeErased)
+        mempool->removeCertificatesWithoutRef(pcoinsTip, dummyCerts);
+
+    // lowest block first, so that the parents enter the mempool before their children
+    std::vector<std::pair<const CBlock*, ResurrectionFlag>> vBlocks;
+    vBlocks.reserve(disconnected.vBlocks.size());
+    for (auto it = disconnected.vBlocks.rbegin(); it != disconnected.vBlocks.rend(); ++it)
+        vBlocks.emplace_back(it->first.get(), it->second);
+    ResurrectBlocksToMempool(vBlocks);
+    RemoveStaleAfterDisconnect(disconnected.setAnchors);
+
+    mempool->check(pcoinsTip);
+    LogPrint("bench", "- Resurrect %u disconnected blocks to mempool: %.2fms\n", disconnected.vBlocks.size(), (GetTimeMicros() - nStart) * 0.001);
+    disconnected.vBlocks.clear();
+}
+
+/**
+ * Disconnect the blocks of chainActive above pindexFork. For a reorg deeper than one block, the blocks
+ * and their undo data are read DISCONNECT_PREFETCH_BLOCKS at a time on up to -par threads, the next ones
+ * while the previous ones are disconnected, and the mempool is updated once at the end.
+ */
+static bool DisconnectTipsTo(CValidationState& state, const CBlockIndex* pindexFork)
+{
+    AssertLockHeld(cs_main);
+    if (chainActive.Height() - (pindexFork ? pindexFork->nHeight : -1) <= 1)
+    {
+        while (chainActive.Tip() && chainActive.Tip() != pindexFork)
+            if (!DisconnectTip(state))
+                return false;
+        return true;
     }
 
-    for(const auto& item : certsStateInfo) {
-        LogPrint("cert", "%s():%d - updating cert state in wallet:\n[%s]\n", __func__, __LINE__, item.ToString());
-        SyncCertStatusUpdate(item);
+    const unsigned int nThreads = std::max(1, std::min<int>(nScriptCheckThreads, DISCONNECT_PREFETCH_BLOCKS));
+    auto makeWindow = [pindexFork](const CBlockIndex* pindexStart) {
+        std::vector<CBlockToDisconnect> vWindow;
+        for (const CBlockIndex* pindex = pindexStart; pindex && pindex != pindexFork && vWindow.size() < DISCONNECT_PREFETCH_BLOCKS; pindex = pindex->pprev)
+        {
+            vWindow.emplace_back();
+            CBlockToDisconnect& entry = vWindow.back();
+            entry.pindex = const_cast<CBlockIndex*>(pindex);
+            entry.hash = pindex->GetBlockHash();
+            entry.hashPrev = pindex->pprev ? pindex->pprev->GetBlockHash() : uint256();
+            entry.blockPos = pindex->GetBlockPos();
+            entry.undoPos = pindex->GetUndoPos();
+        }
+        return vWindow;
+    };
+    auto readWindow = [nThreads](std::vector<CBlockToDisconnect>* pWindow) {
+        std::vector<CBlockToDisconnect>& vWindow = *pWindow;
+        auto worker = [&vWindow, nThreads](unsigned int nWorker) {
+            for (size_t i = nWorker; i < vWindow.size(); i += nThreads)
+                ReadBlockToDisconnect(vWindow[i]);
+        };
+        std::vector<std::future<void>> workers;
+        for (unsigned int n = 1; n < std::min<size_t>(nThreads, vWindow.size()); ++n)
+            workers.push_back(std::async(std::launch::async, worker, n));
+        worker(0);
+        for (auto& w : workers)
+            w.get();
+    };
+
+    CDisconnectedBlocks disconnected;
+    std::vector<CBlockToDisconnect> vWindow = makeWindow(chainActive.Tip());
+    readWindow(&vWindow);
+    bool fDisconnected = true;
+    while (fDisconnected && !vWindow.empty())
+    {
+        std::vector<CBlockToDisconnect> vNext = makeWindow(vWindow.back().pindex->pprev);
+        std::future<void> nextRead = std::async(std::launch::async, readWindow, &vNext);
+        for (CBlockToDisconnect& entry : vWindow)
+        {
+            if (!DisconnectTip(state, &entry, &disconnected))
+            {
+                fDisconnected = false;
+                break;
+            }
+        }
+        nextRead.get();
+        vWindow.swap(vNext);
     }
 
-    // Update cached incremental witnesses
-    GetMainSignals().ChainTip(pindexDelete, &block, newTree, false);
-    return true;
+    // the blocks disconnected before a failure go back to the mempool as well
+    UpdateMempoolForReorg(disconnected);
+    return fDisconnected;
 }
 
 static int64_t nTimeReadFromDisk = 0;
@@ -4332,6 +5475,86 @@ static int64_t nTimePostConnect = 0;
  * Connect a new block to chainActive. pblock is either NULL or a pointer to a CBlock
  * corresponding to pindexNew, to bypass loading it again from disk.
  */
+/**
+ * Warm up the tip coins cache with the coins spent by block and the sidechains it touches, reading them
+ * from the coins db on -coinsprefetchthreads threads, so that ConnectBlock does not wait on them one at a time.
+ * The sidechains with events at nHeight and the coins of the certificates voided by their ceasing are fetched too.
+ */
+static void PrefetchBlockInputs(const CBlock& block, int nHeight)
+{
+    int nThreads = GetArg("-coinsprefetchthreads", DEFAULT_COINS_PREFETCH_THREADS);
+    if (nThreads <= 0)
+        return;
+
+    int64_t nTimeStart = GetTimeMicros();
+    std::set<uint256> createdInBlock;
+    std::vector<uint256> txids;
+    std::vector<uint256> scIds;
+
+    for (const CTransaction& tx : block.vtx)
+    {
+        createdInBlock.insert(tx.GetHash());
+        for (const CTxIn& txin : tx.GetVin())
+            if (!tx.IsCoinBase() && !createdInBlock.count(txin.prevout.hash))
+                txids.push_back(txin.prevout.hash);
+        for (const auto& ft : tx.GetVftCcOut())
+            scIds.push_back(ft.scId);
+        for (const auto& btr : tx.GetVBwtRequestOut())
+            scIds.push_back(btr.scId);
+        for (const auto& csw : tx.GetVcswCcIn())
+            scIds.push_back(csw.scId);
+    }
+
+    for (const CScCertificate& cert : block.vcert)
+    {
+        createdInBlock.insert(cert.GetHash());
+        for (const CTxIn& txin : cert.GetVin())
+            if (!createdInBlock.count(txin.prevout.hash))
+                txids.push_back(txin.prevout.hash);
+        scIds.push_back(cert.GetScId());
+    }
+
+    CSidechainEvents scEvents;
+    if (pcoinsTip->GetSidechainEvents(nHeight, scEvents))
+    {
+        scIds.insert(scIds.end(), scEvents.maturingScs.begin(), scEvents.maturingScs.end());
+        scIds.insert(scIds.end(), scEvents.ceasingScs.begin(), scEvents.ceasingScs.end());
+    }
+
+    nThreads = std::min(nThreads, MAX_COINS_PREFETCH_THREADS);
+    size_t nFetched = pcoinsTip->Prefetch(txids, scIds, nThreads);
+
+    // the certificates voided by the ceasings are only known once their sidechains are in the cache
+    std::vector<uint256> voidedCerts;
+    for (const uint256& ceasingScId : scEvents.ceasingScs)
+    {
+        CSidechain sidechain;
+        if (pcoinsTip->GetSidechain(ceasingScId, sidechain) && !sidechain.lastTopQualityCertHash.IsNull())
+            voidedCerts.push_back(sidechain.lastTopQualityCertHash);
+    }
+    nFetched += pcoinsTip->Prefetch(voidedCerts, std::vector<uint256>(), nThreads);
+    LogPrint("bench", "    - Prefetch %u coins entries: %.2fms\n", nFetched, (GetTimeMicros() - nTimeStart) * 0.001);
+}
+
+/**
+ * The sidechains a block changes the state, the epoch or the fees of: those it creates or has certificates
+ * for, and those ceasing at its height. Called before the block is connected, which consumes its events.
+ */
+static std::set<uint256> GetSidechainsChangedByBlock(const CBlock& block, int nHeight)
+{
+    std::set<uint256> scIds;
+    for (const CTransaction& tx : block.vtx)
+        for (size_t i = 0; i < tx.GetVscCcOut().size(); i++)
+            scIds.insert(tx.GetScIdFromScCcOut(i));
+    for (const CScCertificate& cert : block.vcert)
+        scIds.insert(cert.GetScId());
+
+    CSidechainEvents scEvents;
+    if (pcoinsTip->GetSidechainEvents(nHeight, scEvents))
+        scIds.insert(scEvents.ceasingScs.begin(), scEvents.ceasingScs.end());
+    return scIds;
+}
+
 bool static ConnectTip(CValidationState &state, CBlockIndex *pindexNew, CBlock *pblock) {
     assert(pindexNew->pprev == chainActive.Tip());
     mempool->check(pcoinsTip);
@@ -4350,7 +5573,11 @@ bool static ConnectTip(CValidationState &state, CBlockIndex *pindexNew, CBlock *
     int64_t nTime2 = GetTimeMicros(); nTimeReadFromDisk += nTime2 - nTime1;
     int64_t nTime3;
     LogPrint("bench", "  - Load block from disk: %.2fms [%.2fs]\n", (nTime2 - nTime1) * 0.001, nTimeReadFromDisk * 0.000001);
+    if (pblock == &block)
+        RecordBlockValidationStage(BlockValidationStage::READ_BLOCK, nTime2 - nTime1);
     std::vector<CScCertificateStatusUpdateInfo> certsStateInfo;
+    PrefetchBlockInputs(*pblock, pindexNew->nHeight);
+    const std::set<uint256> changedScIds = GetSidechainsChangedByBlock(*pblock, pindexNew->nHeight);
     {
         CCoinsViewCache view(pcoinsTip);
         bool rv = ConnectBlock(*pblock, state, pindexNew, view, chainActive, flagBlockProcessingType::COMPLETE,
@@ -4362,18 +5589,22 @@ bool static ConnectTip(CValidationState &state, CBlockIndex *pindexNew, CBlock *
             return error("ConnectTip(): ConnectBlock %s failed", pindexNew->GetBlockHash().ToString());
         }
         mapBlockSource.erase(pindexNew->GetBlockHash());
+        mapFastRelayedBlocks.erase(pindexNew->GetBlockHash());
         nTime3 = GetTimeMicros(); nTimeConnectTotal += nTime3 - nTime2;
         LogPrint("bench", "  - Connect total: %.2fms [%.2fs]\n", (nTime3 - nTime2) * 0.001, nTimeConnectTotal * 0.000001);
+        RecordBlockValidationStage(BlockValidationStage::CONNECT_BLOCK, nTime3 - nTime2);
         assert(view.Flush());
     }
     mapCumtreeHeight.insert(std::make_pair(pindexNew->scCumTreeHash.GetLegacyHash(), pindexNew->nHeight));
     int64_t nTime4 = GetTimeMicros(); nTimeFlush += nTime4 - nTime3;
     LogPrint("bench", "  - Flush: %.2fms [%.2fs]\n", (nTime4 - nTime3) * 0.001, nTimeFlush * 0.000001);
+    RecordBlockValidationStage(BlockValidationStage::FLUSH, nTime4 - nTime3);
     // Write the chain state to disk, if necessary.
     if (!FlushStateToDisk(state, FLUSH_STATE_IF_NEEDED))
         return false;
     int64_t nTime5 = GetTimeMicros(); nTimeChainState += nTime5 - nTime4;
     LogPrint("bench", "  - Writing chainstate: %.2fms [%.2fs]\n", (nTime5 - nTime4) * 0.001, nTimeChainState * 0.000001);
+    RecordBlockValidationStage(BlockValidationStage::CHAINSTATE_WRITE, nTime5 - nTime4);
 
     // Remove conflicting transactions from the mempool.
     std::list<CTransaction> removedTxs;
@@ -4381,51 +5612,95 @@ bool static ConnectTip(CValidationState &state, CBlockIndex *pindexNew, CBlock *
     mempool->removeForBlock(pblock->vtx, pindexNew->nHeight, removedTxs,  removedCerts, !IsInitialBlockDownload());
     mempool->removeForBlock(pblock->vcert, pindexNew->nHeight, removedTxs, removedCerts);
 
+    // Drop the orphans the block includes or conflicts with, and reprocess those spending its outputs
+    orphanPool.EraseForBlock(*pblock);
+    for (const CTransaction& tx : pblock->vtx)
+        orphanPool.AddChildrenToWorkSet(tx.GetHash());
+    for (const CScCertificate& cert : pblock->vcert)
+        orphanPool.AddChildrenToWorkSet(cert.GetHash());
+
+    // only the entries of the sidechains the block changed can have gone stale, but at a hard fork
     bool fHardForkCheckEnabled = ForkManager::getInstance().isCrossHardFork(pcoinsTip->GetHeight(), pcoinsTip->GetHeight() + 1);
-    mempool->removeStaleTransactions(pcoinsTip, removedTxs, removedCerts, fHardForkCheckEnabled);
-    mempool->removeStaleCertificates(pcoinsTip, removedCerts);
+    if (fHardForkCheckEnabled)
+    {
+        mempool->removeStaleTransactions(pcoinsTip, removedTxs, removedCerts, fHardForkCheckEnabled);
+        mempool->removeStaleCertificates(pcoinsTip, removedCerts);
+    }
+    else
+    {
+        mempool->removeStaleTransactions(pcoinsTip, changedScIds, removedTxs, removedCerts);
+        mempool->removeStaleCertificates(pcoinsTip, changedScIds, removedCerts);
+    }
 
     mempool->check(pcoinsTip);
 
     UpdateTip(pindexNew); // Update chainActive & related variables.
+    int64_t nTimeUpdateTip = GetTimeMicros();
+    RecordBlockValidationStage(BlockValidationStage::UPDATE_TIP, nTimeUpdateTip - nTime5);
 
-    // Tell wallet about transactions and certificates that went from mempool to conflicted:
-    for(const CTransaction &tx: removedTxs) {
-        SyncWithWallets(tx, nullptr);
-    }
-    for(const CScCertificate &cert: removedCerts) {
-        LogPrint("cert", "%s():%d - sync with wallet removed cert[%s]\n", __func__, __LINE__, cert.GetHash().ToString());
-        SyncWithWallets(cert, nullptr);
-    }
+    // The maturity depths of the certificates depend on the sidechains as of this block
+    std::vector<int> vBwtMaturityDepth;
+    for(const CScCertificate &cert: pblock->vcert) {
+        const CSidechain* const pSidechain = pcoinsTip->AccessSidechain(cert.GetScId());
+        assert(pSidechain != nullptr);
+        vBwtMaturityDepth.push_back(pSidechain->GetCertMaturityHeight(cert.epochNumber, pindexNew->nHeight) - chainActive.Height());
+    }
+
+    // The wallets are told about the block by the validation interface queue, in order with the other updates
+    std::shared_ptr<const CBlock> sharedBlock = pblock == &block ? std::make_shared<const CBlock>(std::move(block))
+                                                                 : std::make_shared<const CBlock>(*pblock);
+    // most peers and clients ask for a new tip right away
+    if (!IsInitialBlockDownload())
+        blockCache.Insert(sharedBlock);
+    CallFunctionInValidationInterfaceQueue([pindexNew, sharedBlock, oldTree, removedTxs = std::move(removedTxs),
+                                            removedCerts = std::move(removedCerts), vBwtMaturityDepth = std::move(vBwtMaturityDepth),
+                                            certsStateInfo = std::move(certsStateInfo)] {
+        LOCK(cs_main);
+        int64_t nTimeStart = GetTimeMicros();
+        CMainSignals& signals = GetMainSignals();
+        signals.BeginBlockSync();
 
-    // ... and about ones that got confirmed:
-    for(const CTransaction &tx: pblock->vtx) {
-        LogPrint("cert", "%s():%d - sync with wallet tx[%s]\n", __func__, __LINE__, tx.GetHash().ToString());
-        SyncWithWallets(tx, pblock);
-    }
+        // Tell wallet about transactions and certificates that went from mempool to conflicted:
+        for(const CTransaction &tx: removedTxs) {
+            signals.SyncTransaction(tx, nullptr);
+        }
+        for(const CScCertificate &cert: removedCerts) {
+            LogPrint("cert", "%s():%d - sync with wallet removed cert[%s]\n", "ConnectTip", __LINE__, cert.GetHash().ToString());
+            signals.SyncCertificate(cert, nullptr, -1);
+        }
 
-    for(const CScCertificate &cert: pblock->vcert) {
-        CSidechain sidechain;
-        assert(pcoinsTip->GetSidechain(cert.GetScId(), sidechain));
-        int bwtMaturityDepth = sidechain.GetCertMaturityHeight(cert.epochNumber, pindexNew->nHeight) - chainActive.Height();
-        LogPrint("cert", "%s():%d - sync with wallet confirmed cert[%s], bwtMaturityDepth[%d]\n",
-            __func__, __LINE__, cert.GetHash().ToString(), bwtMaturityDepth);
-        SyncWithWallets(cert, pblock, bwtMaturityDepth);
-    }
+        // ... and about ones that got confirmed:
+        for(const CTransaction &tx: sharedBlock->vtx) {
+            LogPrint("cert", "%s():%d - sync with wallet tx[%s]\n", "ConnectTip", __LINE__, tx.GetHash().ToString());
+            signals.SyncTransaction(tx, sharedBlock.get());
+        }
 
-    for(const auto& item : certsStateInfo) {
-        LogPrint("cert", "%s():%d - updating cert state in wallet:\n[%s]\n", __func__, __LINE__, item.ToString());
-        SyncCertStatusUpdate(item);
-    }
+        for(size_t i = 0; i < sharedBlock->vcert.size(); i++) {
+            const CScCertificate &cert = sharedBlock->vcert[i];
+            LogPrint("cert", "%s():%d - sync with wallet confirmed cert[%s], bwtMaturityDepth[%d]\n",
+                "ConnectTip", __LINE__, cert.GetHash().ToString(), vBwtMaturityDepth[i]);
+            signals.SyncCertificate(cert, sharedBlock.get(), vBwtMaturityDepth[i]);
+        }
+
+        for(const auto& item : certsStateInfo) {
+            LogPrint("cert", "%s():%d - updating cert state in wallet:\n[%s]\n", "ConnectTip", __LINE__, item.ToString());
+            signals.SyncCertStatus(item);
+        }
+        int64_t nTimeWalletSync = GetTimeMicros();
+        RecordBlockValidationStage(BlockValidationStage::WALLET_SYNC, nTimeWalletSync - nTimeStart);
 
-    // Update cached incremental witnesses
-    GetMainSignals().ChainTip(pindexNew, pblock, oldTree, true);
+        // Update cached incremental witnesses
+        signals.ChainTip(pindexNew, sharedBlock.get(), oldTree, true);
+        signals.EndBlockSync();
+        RecordBlockValidationStage(BlockValidationStage::SIGNALS, GetTimeMicros() - nTimeWalletSync);
+    });
 
     EnforceNodeDeprecation(pindexNew->nHeight);
 
     int64_t nTime6 = GetTimeMicros(); nTimePostConnect += nTime6 - nTime5; nTimeTotal += nTime6 - nTime1;
     LogPrint("bench", "  - Connect postprocess: %.2fms [%.2fs]\n", (nTime6 - nTime5) * 0.001, nTimePostConnect * 0.000001);
     LogPrint("bench", "- Connect block: %.2fms [%.2fs]\n", (nTime6 - nTime1) * 0.001, nTimeTotal * 0.000001);
+    RecordBlockValidationStage(BlockValidationStage::CONNECT_TIP, nTime6 - nTime1);
     return true;
 }
 
@@ -4469,6 +5744,8 @@ static CBlockIndex* FindMostWorkChain() {
                         LogPrint("forks", "%s():%d - marking FAILED candidate idx [%s]\n", __func__, __LINE__,
                             pindexFailed->GetBlockHash().ToString());
                         pindexFailed->nStatus |= BLOCK_FAILED_CHILD;
+                        if (fCheckBlockIndex)
+                            setBlockIndexToCheck.insert(pindexFailed);
                     } else if (fMissingData) {
                         // If we're missing data, then add back to mapBlocksUnlinked,
                         // so that if the block arrives in the future we can try adding
@@ -4514,13 +5791,8 @@ static bool ActivateBestChainStep(CValidationState &state, CBlockIndex *pindexMo
     const CBlockIndex *pindexFork = chainActive.FindFork(pindexMostWork);
 
     // Disconnect active blocks which are no longer in the best chain.
-    while (chainActive.Tip() && chainActive.Tip() != pindexFork)
-    {
-        if (!DisconnectTip(state))
-        {
-            return false;
-        }
-    }
+    if (!DisconnectTipsTo(state, pindexFork))
+        return false;
 
     // Build list of new blocks to connect.
     std::vector<CBlockIndex*> vpindexToConnect;
@@ -4589,6 +5861,9 @@ bool ActivateBestChain(CValidationState &state, CBlock *pblock, bool &postponeRe
     do {
         boost::this_thread::interruption_point();
 
+        // Don't get too far ahead of the wallets, which would otherwise hold many blocks in memory
+        LimitValidationInterfaceQueue();
+
         bool fInitialDownload;
         {
             LOCK(cs_main);
@@ -4641,8 +5916,8 @@ bool ActivateBestChain(CValidationState &state, CBlock *pblock, bool &postponeRe
                     hashNewTip.ToString());
             }
 
-            // Notify external listeners about the new tip.
-            GetMainSignals().UpdatedBlockTip(pindexNewTip);
+            // Notify external listeners about the new tip, after the transactions of its block
+            CallFunctionInValidationInterfaceQueue([pindexNewTip] { GetMainSignals().UpdatedBlockTip(pindexNewTip); });
             uiInterface.NotifyBlockTip(hashNewTip);
         }
         else
@@ -4728,11 +6003,41 @@ bool ReconsiderBlock(CValidationState& state, CBlockIndex *pindex) {
     return true;
 }
 
+int64_t ForkTipOvertakeGap(const CBlockIndex* forkTip, int nChainHeight)
+{
+    // the gap also depends on the current penalty ongoing on the fork
+    int64_t forkDelay = forkTip->nChainDelay;
+    if (forkTip->nHeight >= nChainHeight) {
+        // if forkDelay is null one has to mine 1 block only
+        return forkDelay ? forkDelay : 1;
+    }
+    int64_t dt = nChainHeight - forkTip->nHeight + 1;
+    dt = dt * (dt + 1) / 2;
+    return dt + forkDelay + 1;
+}
+
+int64_t MainChainOvertakeGap(int nTargetHeight, int nChainHeight)
+{
+    int64_t targetToTipDelta = nChainHeight - nTargetHeight + 1;
+    // an attacker can mine from previous block up to tip + 1, unless the penalty applies
+    if (targetToTipDelta < PENALTY_THRESHOLD + 1)
+        return targetToTipDelta + 1;
+    return targetToTipDelta * (targetToTipDelta + 1) / 2;
+}
+
+int64_t GetBlockFinalityIndex(const CBlockIndex* pindex)
+{
+    AssertLockHeld(cs_main);
+    return finalityIndex.Get(pindex);
+}
+
 bool addToGlobalForkTips(const CBlockIndex* pindex)
 {
     if (!pindex)
         return false;
 
+    finalityIndex.SetForkTipsChanged();
+
     unsigned int erased = 0;
     if (pindex->pprev)
     {
@@ -4855,22 +6160,37 @@ CBlockIndex* AddToBlockIndex(const CBlockHeader& block)
         return it->second;
 
     // Construct new block index object
-    CBlockIndex* pindexNew = new CBlockIndex(block);
-    assert(pindexNew);
+    CBlockIndex* pindexNew = blockIndexArena.New(block);
     // We assign the sequence id to blocks only when the full data is available,
     // to avoid miners withholding blocks but broadcasting headers, to get a
     // competitive advantage.
     pindexNew->nSequenceId = 0;
+
+    // the map only changes under cs_main, the parent found here is the one linked below. The
+    // cumulative commitment is hashed before the readers of the map are locked out, as it goes
+    // through a Poseidon hash of the cryptolib.
+    BlockMap::iterator miPrev = mapBlockIndex.find(block.hashPrevBlock);
+    CBlockIndex* pindexPrev = (miPrev != mapBlockIndex.end()) ? miPrev->second : nullptr;
+    if (pindexPrev && pindexNew->nVersion == BLOCK_VERSION_SC_SUPPORT)
+    {
+        const CFieldElement& prevScCumTreeHash =
+                (pindexPrev->nVersion == BLOCK_VERSION_SC_SUPPORT) ?
+                        pindexPrev->scCumTreeHash : CFieldElement::GetZeroHash();
+        pindexNew->scCumTreeHash = CFieldElement::ComputeHash(prevScCumTreeHash, CFieldElement{block.hashScTxsCommitment});
+    }
+
+    // the entry is only shown to LookupBlockIndex once all the header fields are set
+    boost::unique_lock<boost::shared_mutex> lockMap(csBlockIndexMap);
     BlockMap::iterator mi = mapBlockIndex.insert(make_pair(hash, pindexNew)).first;
     pindexNew->phashBlock = &((*mi).first);
-    BlockMap::iterator miPrev = mapBlockIndex.find(block.hashPrevBlock);
-    if (miPrev != mapBlockIndex.end())
+    if (pindexPrev)
     {
-        pindexNew->pprev = (*miPrev).second;
+        pindexNew->pprev = pindexPrev;
         pindexNew->nHeight = pindexNew->pprev->nHeight + 1;
         pindexNew->BuildSkip();
     }
     pindexNew->nChainWork = (pindexNew->pprev ? pindexNew->pprev->nChainWork : 0) + GetBlockProof(*pindexNew);
+    pindexNew->BuildAggregates();
     if (pindexNew->pprev){
         pindexNew->nChainDelay = pindexNew->pprev->nChainDelay + GetBlockDelay(*pindexNew,*(pindexNew->pprev), chainActive.Height(), fIsStartupSyncing);
     } else {
@@ -4881,13 +6201,8 @@ CBlockIndex* AddToBlockIndex(const CBlockHeader& block)
     }
 
     if (pindexNew->pprev && pindexNew->nVersion == BLOCK_VERSION_SC_SUPPORT)
-    {
-        const CFieldElement& prevScCumTreeHash =
-                (pindexNew->pprev->nVersion == BLOCK_VERSION_SC_SUPPORT) ?
-                        pindexNew->pprev->scCumTreeHash : CFieldElement::GetZeroHash();
-        pindexNew->scCumTreeHash = CFieldElement::ComputeHash(prevScCumTreeHash, CFieldElement{block.hashScTxsCommitment});
         mapCumtreeHeight.insert(std::make_pair(pindexNew->scCumTreeHash.GetLegacyHash(), pindexNew->nHeight));
-    }
+    lockMap.unlock();
 
     pindexNew->RaiseValidity(BLOCK_VALID_TREE);
     if (pindexBestHeader == NULL || (pindexBestHeader->nChainWork < pindexNew->nChainWork && pindexNew->nChainDelay==0))
@@ -4931,6 +6246,8 @@ bool ReceivedBlockTransactions(const CBlock &block, CValidationState& state, CBl
             CBlockIndex *pindex = queue.front();
             queue.pop_front();
             pindex->nChainTx = (pindex->pprev ? pindex->pprev->nChainTx : 0) + pindex->nTx;
+            if (fCheckBlockIndex)
+                setBlockIndexToCheck.insert(pindex);
             if (pindex->pprev) {
                 if (pindex->pprev->nChainSproutValue && pindex->nSproutValue) {
                     pindex->nChainSproutValue = *pindex->pprev->nChainSproutValue + *pindex->nSproutValue;
@@ -5018,14 +6335,8 @@ bool FindBlockPos(CValidationState &state, CDiskBlockPos &pos, unsigned int nAdd
         if (nNewChunks > nOldChunks) {
             if (fPruneMode)
                 fCheckForPruning = true;
-            if (CheckDiskSpace(nNewChunks * BLOCKFILE_CHUNK_SIZE - pos.nPos)) {
-                FILE *file = OpenBlockFile(pos);
-                if (file) {
-                    LogPrintf("Pre-allocating up to position 0x%x in blk%05u.dat\n", nNewChunks * BLOCKFILE_CHUNK_SIZE, pos.nFile);
-                    AllocateFileRange(file, pos.nPos, nNewChunks * BLOCKFILE_CHUNK_SIZE - pos.nPos);
-                    fclose(file);
-                }
-            }
+            if (CheckDiskSpace(nNewChunks * BLOCKFILE_CHUNK_SIZE - pos.nPos))
+                blockFileWriter.Allocate(false, pos, nNewChunks * BLOCKFILE_CHUNK_SIZE - pos.nPos);
             else
                 return state.Error("out of disk space");
         }
@@ -5051,14 +6362,8 @@ bool FindUndoPos(CValidationState &state, int nFile, CDiskBlockPos &pos, unsigne
     if (nNewChunks > nOldChunks) {
         if (fPruneMode)
             fCheckForPruning = true;
-        if (CheckDiskSpace(nNewChunks * UNDOFILE_CHUNK_SIZE - pos.nPos)) {
-            FILE *file = OpenUndoFile(pos);
-            if (file) {
-                LogPrintf("Pre-allocating up to position 0x%x in rev%05u.dat\n", nNewChunks * UNDOFILE_CHUNK_SIZE, pos.nFile);
-                AllocateFileRange(file, pos.nPos, nNewChunks * UNDOFILE_CHUNK_SIZE - pos.nPos);
-                fclose(file);
-            }
-        }
+        if (CheckDiskSpace(nNewChunks * UNDOFILE_CHUNK_SIZE - pos.nPos))
+            blockFileWriter.Allocate(true, pos, nNewChunks * UNDOFILE_CHUNK_SIZE - pos.nPos);
         else
             return state.Error("out of disk space");
     }
@@ -5073,6 +6378,11 @@ bool CheckBlockHeader(const CBlockHeader& block, CValidationState& state, flagCh
         return state.DoS(100, error("CheckBlockHeader(): block version not valid"),
                          CValidationState::Code::INVALID, "version-invalid");
 
+    // The Equihash solution and the proof of work of a header in mapBlockIndex were checked when it was
+    // accepted, so a block received after its header, or checked again on the way to be connected, is not
+    if (fCheckPOW == flagCheckPow::ON && LookupBlockIndex(block.GetHash()) != NULL)
+        fCheckPOW = flagCheckPow::OFF;
+
     // Check Equihash solution is valid
     if (fCheckPOW == flagCheckPow::ON && !CheckEquihashSolution(&block, Params()))
         return state.DoS(100, error("CheckBlockHeader(): Equihash solution invalid"),
@@ -5086,6 +6396,62 @@ bool CheckBlockHeader(const CBlockHeader& block, CValidationState& state, flagCh
     return true;
 }
 
+/**
+ * Runs the stateless check of each of the items of a block on up to nScriptCheckThreads threads. The
+ * threads take chunks of items in order, and none is started past the first failure found so far, so
+ * that the state returned is the one of the lowest failing item, as in a sequential check.
+ */
+template <typename T, typename Check>
+static bool CheckBlockItems(const std::vector<T>& vItems, CValidationState& state, Check check)
+{
+    const size_t nWorkers = std::min<size_t>(std::max(1, nScriptCheckThreads), vItems.size() / BLOCK_CHECK_PARALLEL_MIN_ITEMS);
+    if (nWorkers <= 1)
+    {
+        for (const T& item : vItems)
+            if (!check(item, state))
+                return false;
+        return true;
+    }
+
+    std::atomic<size_t> nNextChunk{0};
+    std::atomic<size_t> nFirstFailure{vItems.size()};
+    std::mutex csFailure;
+    CValidationState failureState;
+    auto worker = [&]() {
+        while (true)
+        {
+            const size_t nBegin = nNextChunk.fetch_add(BLOCK_CHECK_PARALLEL_CHUNK_SIZE);
+            const size_t nEnd = std::min(nBegin + BLOCK_CHECK_PARALLEL_CHUNK_SIZE, vItems.size());
+            if (nBegin >= nFirstFailure.load())
+                return;
+            for (size_t i = nBegin; i < nEnd && i < nFirstFailure.load(); i++)
+            {
+                CValidationState itemState;
+                if (check(vItems[i], itemState))
+                    continue;
+                std::lock_guard<std::mutex> lock(csFailure);
+                if (i < nFirstFailure.load())
+                {
+                    nFirstFailure = i;
+                    failureState = itemState;
+                }
+                return;
+            }
+        }
+    };
+    std::vector<std::future<void>> vWorkers;
+    for (size_t n = 1; n < nWorkers; n++)
+        vWorkers.push_back(std::async(std::launch::async, worker));
+    worker();
+    for (auto& f: vWorkers)
+        f.get();
+
+    if (nFirstFailure.load() == vItems.size())
+        return true;
+    state = failureState;
+    return false;
+}
+
 bool CheckBlock(const CBlock& block, CValidationState& state,
                 libzcash::ProofVerifier& verifier,
                 flagCheckPow fCheckPOW, flagCheckMerkleRoot fCheckMerkleRoot)
@@ -5100,7 +6466,7 @@ bool CheckBlock(const CBlock& block, CValidationState& state,
     // Check the merkle root.
     if (fCheckMerkleRoot == flagCheckMerkleRoot::ON) {
         bool mutated;
-        uint256 hashMerkleRoot2 = block.BuildMerkleTree(&mutated);
+        uint256 hashMerkleRoot2 = block.BuildMerkleTree(&mutated, std::max(1, nScriptCheckThreads));
         if (block.hashMerkleRoot != hashMerkleRoot2)
             return state.DoS(100, error("CheckBlock(): hashMerkleRoot mismatch"),
                              CValidationState::Code::INVALID, "bad-txnmrklroot", true);
@@ -5149,22 +6515,17 @@ bool CheckBlock(const CBlock& block, CValidationState& state,
             return state.DoS(100, error("CheckBlock(): more than one coinbase"),
                              CValidationState::Code::INVALID, "bad-cb-multiple");
 
-    // Check transactions and certificates
-    for(const CTransaction& tx: block.vtx) {
-        if (!CheckTransaction(tx, state, verifier)) {
-            return error("CheckBlock(): CheckTransaction failed");
-        }
-    }
+    // Check transactions and certificates, which does not depend on the chain
+    if (!CheckBlockItems(block.vtx, state,
+                         [&verifier](const CTransaction& tx, CValidationState& txState) { return CheckTransaction(tx, txState, verifier); }))
+        return error("CheckBlock(): CheckTransaction failed");
 
     if(!CheckCertificatesOrdering(block.vcert, state))
         return error("CheckBlock(): Certificate quality ordering check failed");
 
-    for(const CScCertificate& cert: block.vcert)
-    {
-        if (!CheckCertificate(cert, state)) {
-            return error("CheckBlock(): Certificate check failed");
-        }
-    }
+    if (!CheckBlockItems(block.vcert, state,
+                         [](const CScCertificate& cert, CValidationState& certState) { return CheckCertificate(cert, certState); }))
+        return error("CheckBlock(): Certificate check failed");
 
     unsigned int nSigOps = 0;
     for(const CTransaction& tx: block.vtx) {
@@ -5328,7 +6689,8 @@ bool ContextualCheckBlock(const CBlock& block, CValidationState& state, CBlockIn
     return true;
 }
 
-bool AcceptBlockHeader(const CBlockHeader& block, CValidationState& state, CBlockIndex** ppindex, bool lookForwardTips)
+bool AcceptBlockHeader(const CBlockHeader& block, CValidationState& state, CBlockIndex** ppindex, bool lookForwardTips,
+                       flagCheckPow fCheckPOW)
 {
     dump_global_tips(10);
 
@@ -5352,7 +6714,7 @@ bool AcceptBlockHeader(const CBlockHeader& block, CValidationState& state, CBloc
         return true;
     }
 
-    if (!CheckBlockHeader(block, state))
+    if (!CheckBlockHeader(block, state, fCheckPOW))
         return false;
 
     // Get prev block index
@@ -5382,6 +6744,31 @@ bool AcceptBlockHeader(const CBlockHeader& block, CValidationState& state, CBloc
     return true;
 }
 
+void CheckBlockHeaders(const std::vector<CBlockHeader>& headers, const std::vector<char>& vSkip,
+                       std::vector<CValidationState>& vStates, std::vector<char>& vChecked)
+{
+    assert(vSkip.size() == headers.size());
+    vStates.assign(headers.size(), CValidationState());
+    vChecked.assign(headers.size(), 0);
+
+    const unsigned int nThreads = std::max(1, nScriptCheckThreads);
+    auto worker = [&headers, &vSkip, &vStates, &vChecked, nThreads](unsigned int nWorker) {
+        for (size_t i = nWorker; i < headers.size(); i += nThreads)
+        {
+            if (vSkip[i])
+                continue;
+            CheckBlockHeader(headers[i], vStates[i]);
+            vChecked[i] = 1;
+        }
+    };
+    std::vector<std::future<void>> workers;
+    for (unsigned int n = 1; n < std::min<size_t>(nThreads, headers.size()); ++n)
+        workers.push_back(std::async(std::launch::async, worker, n));
+    worker(0);
+    for (auto& w : workers)
+        w.get();
+}
+
 bool AcceptBlock(CBlock& block, CValidationState& state, CBlockIndex** ppindex, bool fRequested, CDiskBlockPos* dbp, BlockSet* sForkTips)
 {
     const CChainParams& chainparams = Params();
@@ -5429,12 +6816,15 @@ bool AcceptBlock(CBlock& block, CValidationState& state, CBlockIndex** ppindex,
     try {
         unsigned int nBlockSize = ::GetSerializeSize(block, SER_DISK, CLIENT_VERSION);
         CDiskBlockPos blockPos;
+        std::shared_ptr<const CSerializeData> record;
         if (dbp != NULL)
             blockPos = *dbp;
-        if (!FindBlockPos(state, blockPos, nBlockSize+8, nHeight, block.GetBlockTime(), dbp != NULL))
+        else
+            record = SerializeBlockRecord(block, chainparams.MessageStart());
+        if (!FindBlockPos(state, blockPos, record ? record->size() : nBlockSize+8, nHeight, block.GetBlockTime(), dbp != NULL))
             return error("AcceptBlock(): FindBlockPos failed");
         if (dbp == NULL)
-            if (!WriteBlockToDisk(block, blockPos, chainparams.MessageStart()))
+            if (!WriteBlockToDisk(std::move(record), blockPos))
                 AbortNode(state, "Failed to write block");
         if (!ReceivedBlockTransactions(block, state, pindex, blockPos, sForkTips))
             return error("AcceptBlock(): ReceivedBlockTransactions failed");
@@ -5448,11 +6838,38 @@ bool AcceptBlock(CBlock& block, CValidationState& state, CBlockIndex** ppindex,
     return true;
 }
 
-bool ProcessNewBlock(CValidationState &state, CNode* pfrom, CBlock* pblock, bool fForceProcessing, CDiskBlockPos *dbp)
+/**
+ * Push a block which extends our tip, and passed CheckBlock, as a compact block to the peers with fast
+ * relay other than the one it came from, without waiting for its connection. Requires cs_main.
+ */
+static void FastRelayBlock(const CBlock& block, const CBlockIndex* pindex, const CNode* pfrom)
+{
+    AssertLockHeld(cs_main);
+    if (!fFastBlockRelay || pindex->pprev != chainActive.Tip() || IsInitialBlockDownload())
+        return;
+
+    std::unique_ptr<CBlockHeaderAndShortTxIDs> pcmpctblock;
+    const CInv inv(MSG_BLOCK, pindex->GetBlockHash());
+    LOCK(connman->cs_vNodes);
+    BOOST_FOREACH(CNode* pnode, connman->vNodes)
+    {
+        if (pnode == pfrom || pnode->fDisconnect || !State(pnode->GetId()) || !State(pnode->GetId())->fFastRelay)
+            continue;
+        if (pnode->IsInventoryKnown(inv.hash))
+            continue;
+        if (!pcmpctblock)
+            pcmpctblock.reset(new CBlockHeaderAndShortTxIDs(block));
+        LogPrint("cmpctblock", "%s():%d - fast relaying block %s to peer=%d\n", __func__, __LINE__, inv.hash.ToString(), pnode->GetId());
+        pnode->AddInventoryKnown(inv);
+        pnode->PushMessage(NetMsgType::CMPCTBLOCK, *pcmpctblock);
+    }
+}
+
+bool ProcessNewBlock(CValidationState &state, CNode* pfrom, CBlock* pblock, bool fForceProcessing, CDiskBlockPos *dbp, bool fChecked)
 {
     // Preliminary checks
     auto verifier = libzcash::ProofVerifier::Disabled();
-    bool checked = CheckBlock(*pblock, state, verifier);
+    bool checked = fChecked || CheckBlock(*pblock, state, verifier);
 
     BlockSet sForkTips;
 
@@ -5483,6 +6900,9 @@ bool ProcessNewBlock(CValidationState &state, CNode* pfrom, CBlock* pblock, bool
         {
             return error("%s: AcceptBlock FAILED", __func__);
         }
+
+        if (pindex && dbp == NULL)
+            FastRelayBlock(*pblock, pindex, pfrom);
     }
 
     bool postponeRelay = false;
@@ -5540,12 +6960,31 @@ bool TestBlockValidity(CValidationState &state, const CBlock& block, CBlockIndex
  * BLOCK PRUNING CODE
  */
 
+namespace {
+//! The directory the pruned block files are moved to, with -blocksarchivedir
+boost::filesystem::path pathBlocksArchive;
+//! The block files moved to the archive directory, where GetBlockPosFilename finds them
+std::mutex cs_archivedFiles;
+std::set<int> setArchivedFiles;
+
+bool IsBlockFileArchived(int nFile)
+{
+    if (!fPruneToArchive)
+        return false;
+    std::lock_guard<std::mutex> lock(cs_archivedFiles);
+    return setArchivedFiles.count(nFile) != 0;
+}
+} // anon namespace
+
 /* Calculate the amount of disk space the block & undo files currently use */
 uint64_t CalculateCurrentUsage()
 {
     uint64_t retval = 0;
-    BOOST_FOREACH(const CBlockFileInfo &file, vinfoBlockFile) {
-        retval += file.nSize + file.nUndoSize;
+    for (int nFile = 0; nFile < (int)vinfoBlockFile.size(); nFile++) {
+        // the archived files are not on the blocks directory disk anymore
+        if (IsBlockFileArchived(nFile))
+            continue;
+        retval += vinfoBlockFile[nFile].nSize + vinfoBlockFile[nFile].nUndoSize;
     }
     return retval;
 }
@@ -5591,6 +7030,65 @@ void UnlinkPrunedFiles(std::set<int>& setFilesToPrune)
         boost::filesystem::remove(GetBlockPosFilename(pos, "rev"));
         LogPrintf("Prune: %s deleted blk/rev (%05u)\n", __func__, *it);
     }
+    blockFileReadHandles.Drop(setFilesToPrune);
+}
+
+void ArchivePrunedFiles(std::set<int>& setFilesToPrune)
+{
+    std::set<int> setArchived;
+    for (int nFile : setFilesToPrune) {
+        CDiskBlockPos pos(nFile, 0);
+        try {
+            // copied first: until the file is marked archived the reads keep going to the blocks directory
+            for (const char* prefix : {"blk", "rev"}) {
+                boost::filesystem::path path = GetBlockPosFilename(pos, prefix);
+                if (boost::filesystem::exists(path))
+                    boost::filesystem::copy_file(path, pathBlocksArchive / path.filename(), boost::filesystem::copy_option::overwrite_if_exists);
+            }
+        } catch (const boost::filesystem::filesystem_error& e) {
+            LogPrintf("Prune: %s cannot archive blk/rev (%05u): %s\n", __func__, nFile, e.what());
+            continue;
+        }
+        {
+            std::lock_guard<std::mutex> lock(cs_archivedFiles);
+            setArchivedFiles.insert(nFile);
+        }
+        setArchived.insert(nFile);
+    }
+    blockFileReadHandles.Drop(setArchived);
+
+    for (int nFile : setArchived) {
+        CDiskBlockPos pos(nFile, 0);
+        boost::filesystem::remove(GetDataDir() / "blocks" / GetBlockPosFilename(pos, "blk").filename());
+        boost::filesystem::remove(GetDataDir() / "blocks" / GetBlockPosFilename(pos, "rev").filename());
+        LogPrintf("Prune: %s archived blk/rev (%05u)\n", __func__, nFile);
+    }
+}
+
+bool InitBlocksArchive(const boost::filesystem::path& path)
+{
+    try {
+        boost::filesystem::create_directories(path);
+
+        std::lock_guard<std::mutex> lock(cs_archivedFiles);
+        setArchivedFiles.clear();
+        for (boost::filesystem::directory_iterator it(path); it != boost::filesystem::directory_iterator(); it++) {
+            const std::string strName = it->path().filename().string();
+            if (!boost::filesystem::is_regular_file(*it) || strName.length() != 12 ||
+                strName.substr(0, 3) != "blk" || strName.substr(8, 4) != ".dat")
+                continue;
+            // a file also found in the blocks directory was not removed from there yet, and is archived again
+            if (boost::filesystem::exists(GetDataDir() / "blocks" / strName))
+                continue;
+            setArchivedFiles.insert(atoi(strName.substr(3, 5)));
+        }
+    } catch (const boost::filesystem::filesystem_error& e) {
+        return error("%s: cannot use the blocks archive directory %s: %s", __func__, path.string(), e.what());
+    }
+    pathBlocksArchive = path;
+    fPruneToArchive = true;
+    LogPrintf("Prune: %d block files archived in %s\n", setArchivedFiles.size(), path.string());
+    return true;
 }
 
 /* Calculate the block/rev files that should be deleted to remain under target*/
@@ -5617,7 +7115,7 @@ void FindFilesToPrune(std::set<int>& setFilesToPrune)
         for (int fileNumber = 0; fileNumber < nLastBlockFile; fileNumber++) {
             nBytesToPrune = vinfoBlockFile[fileNumber].nSize + vinfoBlockFile[fileNumber].nUndoSize;
 
-            if (vinfoBlockFile[fileNumber].nSize == 0)
+            if (vinfoBlockFile[fileNumber].nSize == 0 || IsBlockFileArchived(fileNumber))
                 continue;
 
             if (nCurrentUsage + nBuffer < nPruneTarget)  // are we below our target?
@@ -5627,7 +7125,9 @@ void FindFilesToPrune(std::set<int>& setFilesToPrune)
             if (vinfoBlockFile[fileNumber].nHeightLast > nLastBlockWeCanPrune)
                 continue;
 
-            PruneOneBlockFile(fileNumber);
+            // the blocks of an archived file stay available
+            if (!fPruneToArchive)
+                PruneOneBlockFile(fileNumber);
             // Queue up the files for removal
             setFilesToPrune.insert(fileNumber);
             nCurrentUsage -= nBytesToPrune;
@@ -5675,17 +7175,25 @@ FILE* OpenDiskFile(const CDiskBlockPos &pos, const char *prefix, bool fReadOnly)
     return file;
 }
 
+// the readers of the files wait for the records queued to be written
 FILE* OpenBlockFile(const CDiskBlockPos &pos, bool fReadOnly) {
+    if (fReadOnly)
+        blockFileWriter.WaitForFile(false, pos);
     return OpenDiskFile(pos, "blk", fReadOnly);
 }
 
 FILE* OpenUndoFile(const CDiskBlockPos &pos, bool fReadOnly) {
+    if (fReadOnly)
+        blockFileWriter.WaitForFile(true, pos);
     return OpenDiskFile(pos, "rev", fReadOnly);
 }
 
 boost::filesystem::path GetBlockPosFilename(const CDiskBlockPos &pos, const char *prefix)
 {
-    return GetDataDir() / "blocks" / strprintf("%s%05u.dat", prefix, pos.nFile);
+    const std::string strName = strprintf("%s%05u.dat", prefix, pos.nFile);
+    if (IsBlockFileArchived(pos.nFile))
+        return pathBlocksArchive / strName;
+    return GetDataDir() / "blocks" / strName;
 }
 
 CBlockIndex * InsertBlockIndex(uint256 hash)
@@ -5699,10 +7207,11 @@ CBlockIndex * InsertBlockIndex(uint256 hash)
         return (*mi).second;
 
     // Create new
-    CBlockIndex* pindexNew = new CBlockIndex();
-    if (!pindexNew)
-        throw runtime_error("LoadBlockIndex(): new CBlockIndex failed");
-    mi = mapBlockIndex.insert(make_pair(hash, pindexNew)).first;
+    CBlockIndex* pindexNew = blockIndexArena.New();
+    {
+        boost::unique_lock<boost::shared_mutex> lockMap(csBlockIndexMap);
+        mi = mapBlockIndex.insert(make_pair(hash, pindexNew)).first;
+    }
     pindexNew->phashBlock = &((*mi).first);
 
     return pindexNew;
@@ -5711,7 +7220,7 @@ CBlockIndex * InsertBlockIndex(uint256 hash)
 bool static LoadBlockIndexDB()
 {
     const CChainParams& chainparams = Params();
-    if (!pblocktree->LoadBlockIndexGuts())
+    if (!pblocktree->LoadBlockIndexGuts(std::max(1, nScriptCheckThreads)))
         return false;
 
     boost::this_thread::interruption_point();
@@ -5757,6 +7266,7 @@ bool static LoadBlockIndexDB()
             pindexBestInvalid = pindex;
         if (pindex->pprev)
             pindex->BuildSkip();
+        pindex->BuildAggregates();
         if (pindex->IsValid(BLOCK_VALID_TREE) && (pindexBestHeader == NULL || CBlockIndexWorkComparator()(pindexBestHeader, pindex)))
             pindexBestHeader = pindex;
 
@@ -5802,6 +7312,9 @@ bool static LoadBlockIndexDB()
     pblocktree->ReadFlag("prunedblockfiles", fHavePruned);
     if (fHavePruned)
         LogPrintf("LoadBlockIndexDB(): Block files have previously been pruned\n");
+    pblocktree->ReadFlag("txoutsetsnapshot", fTxOutSetSnapshot);
+    if (fTxOutSetSnapshot)
+        LogPrintf("LoadBlockIndexDB(): Chainstate was imported from a txoutset snapshot\n");
 
     // Check whether we need to continue reindexing
     bool fReindexing = false;
@@ -5819,10 +7332,15 @@ bool static LoadBlockIndexDB()
     // Check whether we have a maturityHeight index
     pblocktree->ReadFlag("maturityheightindex", fMaturityHeightIndex);
     LogPrintf("%s: maturityHeight index %s\n", __func__, fMaturityHeightIndex ? "enabled" : "disabled");
+    if (fMaturityHeightIndex && !pblocktree->LoadMaturityHeightIndex())
+        return error("%s: failed to load the maturityHeight index", __func__);
 
     // Check whether we have an address index
     pblocktree->ReadFlag("addressindex", fAddressIndex);
     LogPrintf("%s: address index %s\n", __func__, fAddressIndex ? "enabled" : "disabled");
+    pblocktree->ReadFlag("addressaggregates", pblocktree->fAddressAggregates);
+    if (fAddressIndex)
+        LogPrintf("%s: address aggregates %s\n", __func__, pblocktree->fAddressAggregates ? "enabled" : "disabled (reindex to build them)");
 
     // Check whether we have a timestamp index
     pblocktree->ReadFlag("timestampindex", fTimestampIndex);
@@ -5851,6 +7369,8 @@ bool static LoadBlockIndexDB()
     if (it == mapBlockIndex.end())
         return true;
     chainActive.SetTip(it->second);
+    pindexPublishedTip = it->second;
+    finalityIndex.Clear();
     // Set hashAnchorEnd for the end of best chain
     it->second->hashAnchorEnd = pcoinsTip->GetBestAnchor();
 
@@ -5894,27 +7414,40 @@ bool CVerifyDB::VerifyDB(CCoinsView *coinsview, int nCheckLevel, int nCheckDepth
     CBlockIndex* pindexFailure = NULL;
     int nGoodTransactions = 0;
     CValidationState state;
-    // No need to verify JoinSplits twice
-    auto verifier = libzcash::ProofVerifier::Disabled();
-    for (CBlockIndex* pindex = chainActive.Tip(); pindex && pindex->pprev; pindex = pindex->pprev)
+
+    // Levels 0 to 2 only depend on the block itself, hence they are run for a window of blocks at a time
+    // on up to -par threads; disconnecting the blocks (level 3) is done serially afterwards
+    const unsigned int nThreads = std::max(1, nScriptCheckThreads);
+    const size_t nWindowSize = nThreads * VERIFYDB_BLOCKS_PER_THREAD;
+    struct CVerifiedBlock
     {
-        boost::this_thread::interruption_point();
-        uiInterface.ShowProgress(_("Verifying blocks..."), std::max(1, std::min(99, (int)(((double)(chainActive.Height() - pindex->nHeight)) / (double)nCheckDepth * (nCheckLevel >= 4 ? 50 : 100)))));
-        if (pindex->nHeight < chainActive.Height()-nCheckDepth)
-            break;
+        CBlockIndex* pindex;
         CBlock block;
+        std::string strError;
+    };
+    std::vector<CVerifiedBlock> vWindow;
+
+    auto checkBlock = [nCheckLevel](CVerifiedBlock& entry) {
+        CBlockIndex* pindex = entry.pindex;
         // check level 0: read from disk
-        if (!ReadBlockFromDisk(block, pindex))
-            return error("VerifyDB(): *** ReadBlockFromDisk failed at %d, hash=%s", pindex->nHeight, pindex->GetBlockHash().ToString());
+        if (!ReadBlockFromDisk(entry.block, pindex)) {
+            entry.strError = strprintf("VerifyDB(): *** ReadBlockFromDisk failed at %d, hash=%s", pindex->nHeight, pindex->GetBlockHash().ToString());
+            return;
+        }
         // check level 1: verify block validity
-        if (nCheckLevel >= 1 && !CheckBlock(block, state, verifier))
-            return error("VerifyDB(): *** found bad block at %d, hash=%s\n", pindex->nHeight, pindex->GetBlockHash().ToString());
+        // No need to verify JoinSplits twice
+        CValidationState blockState;
+        auto verifier = libzcash::ProofVerifier::Disabled();
+        if (nCheckLevel >= 1 && !CheckBlock(entry.block, blockState, verifier)) {
+            entry.strError = strprintf("VerifyDB(): *** found bad block at %d, hash=%s\n", pindex->nHeight, pindex->GetBlockHash().ToString());
+            return;
+        }
         // check level 2: verify undo validity
         if (nCheckLevel >= 2 && pindex) {
 
             IncludeScAttributes includeSc = IncludeScAttributes::ON;
 
-            if (block.nVersion != BLOCK_VERSION_SC_SUPPORT)
+            if (entry.block.nVersion != BLOCK_VERSION_SC_SUPPORT)
                 includeSc = IncludeScAttributes::OFF;
 
             CBlockUndo undo(includeSc);
@@ -5922,25 +7455,66 @@ bool CVerifyDB::VerifyDB(CCoinsView *coinsview, int nCheckLevel, int nCheckDepth
             CDiskBlockPos pos = pindex->GetUndoPos();
             if (!pos.IsNull()) {
                 if (!UndoReadFromDisk(undo, pos, pindex->pprev->GetBlockHash()))
-                    return error("VerifyDB(): *** found bad undo data at %d, hash=%s\n", pindex->nHeight, pindex->GetBlockHash().ToString());
+                    entry.strError = strprintf("VerifyDB(): *** found bad undo data at %d, hash=%s\n", pindex->nHeight, pindex->GetBlockHash().ToString());
             }
         }
-        // check level 3: check for inconsistencies during memory-only disconnect of tip blocks
-        if (nCheckLevel >= 3 && pindex == pindexState && (coins.DynamicMemoryUsage() + pcoinsTip->DynamicMemoryUsage()) <= nCoinCacheUsage) {
-            bool fClean = true;
-            if (!DisconnectBlock(block, state, pindex, coins, flagLevelDBIndexesWrite::OFF, &fClean, nullptr))
-                return error("VerifyDB(): *** irrecoverable inconsistency in block data at %d, hash=%s", pindex->nHeight, pindex->GetBlockHash().ToString());
-            pindexState = pindex->pprev;
-            if (!fClean) {
-                nGoodTransactions = 0;
-                pindexFailure = pindex;
-            } else
-                nGoodTransactions += block.vtx.size() + block.vcert.size();
+    };
+
+    for (CBlockIndex* pindexWindow = chainActive.Tip(); pindexWindow && pindexWindow->pprev; )
+    {
+        boost::this_thread::interruption_point();
+        vWindow.clear();
+        for (; pindexWindow && pindexWindow->pprev && vWindow.size() < nWindowSize; pindexWindow = pindexWindow->pprev)
+        {
+            if (pindexWindow->nHeight < chainActive.Height()-nCheckDepth)
+                break;
+            // blocks are only checked as far back as their data is on disk
+            if (fHavePruned && !(pindexWindow->nStatus & BLOCK_HAVE_DATA))
+                break;
+            vWindow.emplace_back();
+            vWindow.back().pindex = pindexWindow;
         }
+        if (vWindow.empty())
+            break;
 
-        if (ShutdownRequested())
-            return true;
+        auto worker = [&vWindow, &checkBlock, nThreads](unsigned int nWorker) {
+            for (size_t i = nWorker; i < vWindow.size(); i += nThreads)
+                checkBlock(vWindow[i]);
+        };
+        std::vector<std::future<void>> workers;
+        for (unsigned int n = 1; n < std::min<size_t>(nThreads, vWindow.size()); ++n)
+            workers.push_back(std::async(std::launch::async, worker, n));
+        worker(0);
+        for (auto& w : workers)
+            w.get();
+
+        for (CVerifiedBlock& entry : vWindow)
+        {
+            CBlockIndex* pindex = entry.pindex;
+            CBlock& block = entry.block;
+            uiInterface.ShowProgress(_("Verifying blocks..."), std::max(1, std::min(99, (int)(((double)(chainActive.Height() - pindex->nHeight)) / (double)nCheckDepth * (nCheckLevel >= 4 ? 50 : 100)))));
+            if (!entry.strError.empty())
+                return error("%s", entry.strError);
+
+            // check level 3: check for inconsistencies during memory-only disconnect of tip blocks
+            if (nCheckLevel >= 3 && pindex == pindexState && (coins.DynamicMemoryUsage() + pcoinsTip->DynamicMemoryUsage()) <= nCoinCacheUsage + nScCacheUsage) {
+                bool fClean = true;
+                if (!DisconnectBlock(block, state, pindex, coins, flagLevelDBIndexesWrite::OFF, &fClean, nullptr))
+                    return error("VerifyDB(): *** irrecoverable inconsistency in block data at %d, hash=%s", pindex->nHeight, pindex->GetBlockHash().ToString());
+                pindexState = pindex->pprev;
+                if (!fClean) {
+                    nGoodTransactions = 0;
+                    pindexFailure = pindex;
+                } else
+                    nGoodTransactions += block.vtx.size() + block.vcert.size();
+            }
+
+            if (ShutdownRequested())
+                return true;
+        }
 
+        if (pindexWindow && pindexWindow->nHeight < chainActive.Height()-nCheckDepth)
+            break;
     }
 
     if (pindexFailure)
@@ -5977,30 +7551,42 @@ void UnloadBlockIndex()
     LOCK(cs_main);
     setBlockIndexCandidates.clear();
     chainActive.SetTip(NULL);
+    pindexPublishedTip = nullptr;
+    finalityIndex.Clear();
     pindexBestInvalid = NULL;
     pindexBestHeader = NULL;
     mempool->clear();
-    mapOrphanTransactions.clear();
-    mapOrphanTransactionsByPrev.clear();
+    orphanPool.Clear();
+    headersCache.Clear();
     nSyncStarted = 0;
+    headerRanges = CHeaderRanges();
     mapBlocksUnlinked.clear();
     vinfoBlockFile.clear();
     nLastBlockFile = 0;
     nBlockSequenceId = 1;
     mapBlockSource.clear();
+    mapFastRelayedBlocks.clear();
     mapBlocksInFlight.clear();
     nQueuedValidatedHeaders = 0;
     nPreferredDownload = 0;
+    mGlobalForkTips.clear();
     setDirtyBlockIndex.clear();
+    setBlockIndexToCheck.clear();
+    pindexLastCheckedTip = NULL;
+    chainActiveLogicalTimes.Clear();
     setDirtyFileInfo.clear();
     mapNodeState.clear();
     recentRejects.reset(NULL);
 
+    boost::unique_lock<boost::shared_mutex> lockMap(csBlockIndexMap);
     BOOST_FOREACH(BlockMap::value_type& entry, mapBlockIndex) {
-        delete entry.second;
+        blockIndexArena.Delete(entry.second);
     }
     mapBlockIndex.clear();
+    blockIndexArena.Clear();
+    lockMap.unlock();
     fHavePruned = false;
+    fTxOutSetSnapshot = false;
 }
 
 bool LoadBlockIndex()
@@ -6037,10 +7623,15 @@ bool InitBlockIndex() {
     // Use the provided setting for -maturityheightindex in the new database
     fMaturityHeightIndex = GetBoolArg("-maturityheightindex", DEFAULT_MATURITYHEIGHTINDEX);
     pblocktree->WriteFlag("maturityheightindex", fMaturityHeightIndex);
+    if (fMaturityHeightIndex)
+        pblocktree->LoadMaturityHeightIndex();
 
     // Use the provided setting for -addressindex in the new database
     fAddressIndex = GetBoolArg("-addressindex", DEFAULT_ADDRESSINDEX);
     pblocktree->WriteFlag("addressindex", fAddressIndex);
+    // a new address index is built together with the per-address aggregates
+    pblocktree->fAddressAggregates = fAddressIndex;
+    pblocktree->WriteFlag("addressaggregates", fAddressIndex);
 
     // Use the provided setting for -timestampindex in the new database
     fTimestampIndex = GetBoolArg("-timestampindex", DEFAULT_TIMESTAMPINDEX);
@@ -6058,12 +7649,12 @@ bool InitBlockIndex() {
     try {
         CBlock &block = const_cast<CBlock&>(Params().GenesisBlock());
         // Start new block file
-        unsigned int nBlockSize = ::GetSerializeSize(block, SER_DISK, CLIENT_VERSION);
+        std::shared_ptr<const CSerializeData> record = SerializeBlockRecord(block, chainparams.MessageStart());
         CDiskBlockPos blockPos;
         CValidationState state;
-        if (!FindBlockPos(state, blockPos, nBlockSize+8, 0, block.GetBlockTime()))
+        if (!FindBlockPos(state, blockPos, record->size(), 0, block.GetBlockTime()))
             return error("LoadBlockIndex(): FindBlockPos failed");
-        if (!WriteBlockToDisk(block, blockPos, chainparams.MessageStart()))
+        if (!WriteBlockToDisk(std::move(record), blockPos))
             return error("LoadBlockIndex(): writing genesis block to disk failed");
         CBlockIndex *pindex = AddToBlockIndex(block);
         if (!ReceivedBlockTransactions(block, state, pindex, blockPos, NULL))
@@ -6079,6 +7670,30 @@ bool InitBlockIndex() {
     return true;
 }
 
+/**
+ * The size of the record whose header gives nSize, that of the zstd frame for compressed records, or 0
+ * if nSize cannot be the one of a block
+ */
+static unsigned int BlockRecordSize(unsigned int nSize)
+{
+    const unsigned int nRecordSize = nSize & ~BLOCK_RECORD_COMPRESSED;
+    return nRecordSize < 80 || nRecordSize > MAX_BLOCK_SIZE ? 0 : nRecordSize;
+}
+
+//! Deserializes block from the record at the position of blkdat, whose header gives nSize
+static void ReadBlockRecord(CBufferedFile& blkdat, unsigned int nSize, CBlock& block)
+{
+    if (!(nSize & BLOCK_RECORD_COMPRESSED)) {
+        blkdat >> block;
+        return;
+    }
+    CSerializeData vFrame(nSize & ~BLOCK_RECORD_COMPRESSED), vBlock;
+    blkdat.read(vFrame.data(), vFrame.size());
+    if (!DecompressData(vFrame.data(), vFrame.data() + vFrame.size(), MAX_BLOCK_SIZE, vBlock))
+        throw std::ios_base::failure("invalid compressed block");
+    CSpanReader(vBlock.data(), vBlock.data() + vBlock.size(), SER_DISK, CLIENT_VERSION) >> block;
+}
+
 CBlock LoadBlockFrom(CBufferedFile& blkdat, CDiskBlockPos* pLastLoadedBlkPos)
 {
     CBlock res{};
@@ -6087,6 +7702,7 @@ CBlock LoadBlockFrom(CBufferedFile& blkdat, CDiskBlockPos* pLastLoadedBlkPos)
         return res;
 
     int blkSize = -1;
+    unsigned int nSize = 0;
 
     //locate Header
     for(uint64_t nRewind = blkdat.GetPos(); !blkdat.eof() && (blkSize == -1);)
@@ -6104,11 +7720,10 @@ CBlock LoadBlockFrom(CBufferedFile& blkdat, CDiskBlockPos* pLastLoadedBlkPos)
             if (memcmp(buf, Params().MessageStart(), MESSAGE_START_SIZE))
                 continue; // just first byte of magic number matches. Keep searching
 
-            blkdat >> blkSize; // read size
-            if (blkSize < 80 || blkSize > MAX_BLOCK_SIZE) {
-                blkSize = -1;
+            blkdat >> nSize; // read size
+            if (BlockRecordSize(nSize) == 0)
                 continue; // while whole magic number matches, it can't be block size. Keep searching
-            }
+            blkSize = BlockRecordSize(nSize);
         } catch (const std::exception&) {
             // no valid block header found; don't complain
             break;
@@ -6124,7 +7739,7 @@ CBlock LoadBlockFrom(CBufferedFile& blkdat, CDiskBlockPos* pLastLoadedBlkPos)
     blkdat.SetLimit(blkStartPos + blkSize);
     blkdat.SetPos(blkStartPos);
     try {
-        blkdat >> res;
+        ReadBlockRecord(blkdat, nSize, res);
     } catch (const std::exception& e) {
         LogPrintf("%s: Deserialize or I/O error - %s\n", __func__, e.what());
     }
@@ -6133,6 +7748,192 @@ CBlock LoadBlockFrom(CBufferedFile& blkdat, CDiskBlockPos* pLastLoadedBlkPos)
     return res;
 }
 
+namespace {
+
+/** A block read from an external file */
+struct CLoadedBlock
+{
+    CBlock block;
+    unsigned int nPos = 0;
+    //! CheckBlock passed, so that ProcessNewBlock does not run it again
+    bool fChecked = false;
+};
+
+/** Consecutive blocks of a file, whose checks run while the previous ones are processed */
+struct CLoadedBlocksWindow
+{
+    std::vector<CLoadedBlock> vBlocks;
+    size_t nBytes = 0;
+    std::future<void> checks;
+};
+
+void CheckLoadedBlocks(std::vector<CLoadedBlock>& vBlocks)
+{
+    const unsigned int nThreads = std::max(1, nScriptCheckThreads);
+    auto worker = [&vBlocks, nThreads](unsigned int nWorker) {
+        auto verifier = libzcash::ProofVerifier::Disabled();
+        for (size_t i = nWorker; i < vBlocks.size(); i += nThreads)
+        {
+            CValidationState state;
+            vBlocks[i].fChecked = CheckBlock(vBlocks[i].block, state, verifier);
+        }
+    };
+    std::vector<std::future<void>> workers;
+    for (unsigned int n = 1; n < std::min<size_t>(nThreads, vBlocks.size()); ++n)
+        workers.push_back(std::async(std::launch::async, worker, n));
+    worker(0);
+    for (auto& w : workers)
+        w.get();
+}
+
+/**
+ * Scans and deserializes the blocks of a file on its own thread, handing them over in file order.
+ * If fCheck, the context free checks of each window of blocks (PoW, merkle root, transactions) are
+ * run in parallel as soon as the window is read, so that reading, checking and processing the
+ * blocks overlap.
+ */
+class CBlockFileReader
+{
+private:
+    FILE* fileIn;
+    const bool fCheck;
+    std::mutex cs;
+    std::condition_variable condWindow;
+    std::deque<std::unique_ptr<CLoadedBlocksWindow>> windows;
+    bool fDone = false;
+    bool fStop = false;
+    std::string strError;
+    std::thread readerThread;
+
+    bool PushWindow(std::unique_ptr<CLoadedBlocksWindow> window)
+    {
+        if (fCheck)
+            window->checks = std::async(std::launch::async, CheckLoadedBlocks, std::ref(window->vBlocks));
+        std::unique_lock<std::mutex> lock(cs);
+        condWindow.wait(lock, [this] { return fStop || windows.size() < LOADBLOCKS_MAX_PENDING_WINDOWS; });
+        if (fStop)
+            return false;
+        windows.push_back(std::move(window));
+        condWindow.notify_all();
+        return true;
+    }
+
+    bool IsStopping()
+    {
+        std::unique_lock<std::mutex> lock(cs);
+        return fStop;
+    }
+
+    void ThreadRead()
+    {
+        RenameThread("horizen-loadread");
+        const unsigned int nWindowBlocks = LOADBLOCKS_BLOCKS_PER_THREAD * std::max(1, nScriptCheckThreads);
+        try
+        {
+            // This takes over fileIn and calls fclose() on it in the CBufferedFile destructor
+            CBufferedFile blkdat(fileIn, 2*MAX_BLOCK_SIZE, MAX_BLOCK_SIZE+8, SER_DISK, CLIENT_VERSION);
+            std::unique_ptr<CLoadedBlocksWindow> window(new CLoadedBlocksWindow());
+            uint64_t nRewind = blkdat.GetPos();
+            while (!blkdat.eof() && !IsStopping())
+            {
+                blkdat.SetPos(nRewind);
+                nRewind++; // start one byte further next time, in case of failure
+                blkdat.SetLimit(); // remove former limit
+                unsigned int nSize = 0;
+                try {
+                    // locate a header
+                    unsigned char buf[MESSAGE_START_SIZE];
+                    blkdat.FindByte(Params().MessageStart()[0]);
+                    nRewind = blkdat.GetPos()+1;
+                    blkdat >> FLATDATA(buf);
+                    if (memcmp(buf, Params().MessageStart(), MESSAGE_START_SIZE))
+                        continue; //only first byte of magic number matches. Keep searching...
+                    // read size
+                    blkdat >> nSize;
+                    if (BlockRecordSize(nSize) == 0)
+                        continue; //magic number matches but size can't be block one. Keep searching...
+                } catch (const std::exception&) {
+                    // no valid block header found; don't complain
+                    break;
+                }
+                try
+                {
+                    // read block
+                    uint64_t nBlockPos = blkdat.GetPos();
+                    blkdat.SetLimit(nBlockPos + BlockRecordSize(nSize));
+                    blkdat.SetPos(nBlockPos);
+                    CLoadedBlock loaded;
+                    loaded.nPos = nBlockPos;
+                    ReadBlockRecord(blkdat, nSize, loaded.block);
+                    nRewind = blkdat.GetPos();
+                    window->vBlocks.push_back(std::move(loaded));
+                    window->nBytes += BlockRecordSize(nSize);
+                } catch (const std::exception& e) {
+                    LogPrintf("%s: Deserialize or I/O error - %s\n", __func__, e.what());
+                }
+
+                if (window->vBlocks.size() >= nWindowBlocks || window->nBytes >= LOADBLOCKS_WINDOW_BYTES)
+                {
+                    if (!PushWindow(std::move(window)))
+                        break;
+                    window.reset(new CLoadedBlocksWindow());
+                }
+            }
+            if (window && !window->vBlocks.empty())
+                PushWindow(std::move(window));
+        } catch (const std::runtime_error& e) {
+            std::unique_lock<std::mutex> lock(cs);
+            strError = e.what();
+        }
+
+        std::unique_lock<std::mutex> lock(cs);
+        fDone = true;
+        condWindow.notify_all();
+    }
+
+public:
+    CBlockFileReader(FILE* fileInIn, bool fCheckIn) : fileIn(fileInIn), fCheck(fCheckIn)
+    {
+        readerThread = std::thread(&CBlockFileReader::ThreadRead, this);
+    }
+
+    ~CBlockFileReader()
+    {
+        {
+            std::unique_lock<std::mutex> lock(cs);
+            fStop = true;
+        }
+        condWindow.notify_all();
+        readerThread.join();
+    }
+
+    //! Take the next window of blocks, once checked; false when the file is over
+    bool NextWindow(std::unique_ptr<CLoadedBlocksWindow>& window)
+    {
+        {
+            std::unique_lock<std::mutex> lock(cs);
+            condWindow.wait(lock, [this] { return fDone || !windows.empty(); });
+            if (windows.empty())
+                return false;
+            window = std::move(windows.front());
+            windows.pop_front();
+            condWindow.notify_all();
+        }
+        if (window->checks.valid())
+            window->checks.get();
+        return true;
+    }
+
+    //! The system error that stopped the reading of the file, if any
+    std::string GetError()
+    {
+        std::unique_lock<std::mutex> lock(cs);
+        return strError;
+    }
+};
+
+} // anon namespace
+
 bool LoadBlocksFromExternalFile(FILE* fileIn, CDiskBlockPos *dbp, bool loadHeadersOnly)
 {
     const CChainParams& chainparams = Params();
@@ -6143,130 +7944,293 @@ bool LoadBlocksFromExternalFile(FILE* fileIn, CDiskBlockPos *dbp, bool loadHeade
     int nLoadedHeaders = 0;
     int nLoadedBlocks = 0;
 
-    try
+    if (!loadHeadersOnly)
+        blockImportTimer.start();
     {
-        // This takes over fileIn and calls fclose() on it in the CBufferedFile destructor
-        CBufferedFile blkdat(fileIn, 2*MAX_BLOCK_SIZE, MAX_BLOCK_SIZE+8, SER_DISK, CLIENT_VERSION);
-        uint64_t nRewind = blkdat.GetPos();
-        while (!blkdat.eof())
+        CBlockFileReader reader(fileIn, /*fCheck*/!loadHeadersOnly);
+        std::unique_ptr<CLoadedBlocksWindow> window;
+        bool fError = false;
+        while (!fError && reader.NextWindow(window))
         {
-            boost::this_thread::interruption_point();
-
-            blkdat.SetPos(nRewind);
-            nRewind++; // start one byte further next time, in case of failure
-            blkdat.SetLimit(); // remove former limit
-            unsigned int nSize = 0;
-            try {
-                // locate a header
-                unsigned char buf[MESSAGE_START_SIZE];
-                blkdat.FindByte(Params().MessageStart()[0]);
-                nRewind = blkdat.GetPos()+1;
-                blkdat >> FLATDATA(buf);
-                if (memcmp(buf, Params().MessageStart(), MESSAGE_START_SIZE))
-                    continue; //only first byte of magic number matches. Keep searching...
-                // read size
-                blkdat >> nSize;
-                if (nSize < 80 || nSize > MAX_BLOCK_SIZE)
-                    continue; //magic number matches but size can't be block one. Keep searching...
-            } catch (const std::exception&) {
-                // no valid block header found; don't complain
-                break;
-            }
-            try
+            for (CLoadedBlock& loaded : window->vBlocks)
             {
-                // read block
-                uint64_t nBlockPos = blkdat.GetPos();
-                if (dbp)
-                    dbp->nPos = nBlockPos;
-                blkdat.SetLimit(nBlockPos + nSize);
-                blkdat.SetPos(nBlockPos);
-                CBlock loadedBlk;
-                blkdat >> loadedBlk;
-                nRewind = blkdat.GetPos();
-                // detect out of order blocks, and store them for later
-                uint256 hash = loadedBlk.GetHash();
-                if (hash != chainparams.GetConsensus().hashGenesisBlock && mapBlockIndex.find(loadedBlk.hashPrevBlock) == mapBlockIndex.end()) {
-                    LogPrint("reindex", "%s: Out of order block %s, parent %s not known\n", __func__, hash.ToString(),
-                            loadedBlk.hashPrevBlock.ToString());
-                    if (dbp)
-                        mapBlocksUnknownParent.insert(std::make_pair(loadedBlk.hashPrevBlock, *dbp));
-                    continue;
-                }
+                boost::this_thread::interruption_point();
 
-                // process in case the block isn't known yet
-                if (mapBlockIndex.count(hash) == 0 || (mapBlockIndex[hash]->nStatus & BLOCK_HAVE_DATA) == 0)
+                try
                 {
-                    CValidationState state;
-                    if (loadHeadersOnly)
-                    {
-                        if (AcceptBlockHeader(loadedBlk, state, /*ppindex*/nullptr, /*lookForwardTips*/false)) //Todo: verify lookForwardTips
-                            ++nLoadedHeaders;
+                    CBlock& loadedBlk = loaded.block;
+                    if (dbp)
+                        dbp->nPos = loaded.nPos;
+                    // detect out of order blocks, and store them for later
+                    uint256 hash = loadedBlk.GetHash();
+                    if (hash != chainparams.GetConsensus().hashGenesisBlock && mapBlockIndex.find(loadedBlk.hashPrevBlock) == mapBlockIndex.end()) {
+                        LogPrint("reindex", "%s: Out of order block %s, parent %s not known\n", __func__, hash.ToString(),
+                                loadedBlk.hashPrevBlock.ToString());
+                        if (dbp)
+                            mapBlocksUnknownParent.insert(std::make_pair(loadedBlk.hashPrevBlock, *dbp));
+                        continue;
+                    }
 
-                        if (state.IsError())
-                            break;
-                    } else
+                    // process in case the block isn't known yet
+                    if (mapBlockIndex.count(hash) == 0 || (mapBlockIndex[hash]->nStatus & BLOCK_HAVE_DATA) == 0)
                     {
-                        if (ProcessNewBlock(state, NULL, &loadedBlk, true, dbp))
-                            nLoadedBlocks++;
+                        CValidationState state;
+                        if (loadHeadersOnly)
+                        {
+                            if (AcceptBlockHeader(loadedBlk, state, /*ppindex*/nullptr, /*lookForwardTips*/false)) //Todo: verify lookForwardTips
+                                ++nLoadedHeaders;
 
-                        if (state.IsError())
+                            if (state.IsError())
+                                fError = true;
+                        } else
+                        {
+                            if (ProcessNewBlock(state, NULL, &loadedBlk, true, dbp, loaded.fChecked))
+                            {
+                                nLoadedBlocks++;
+                                blocksImported.increment();
+                            }
+
+                            if (state.IsError())
+                                fError = true;
+                        }
+                        if (fError)
                             break;
+                    } else if (hash != chainparams.GetConsensus().hashGenesisBlock && mapBlockIndex[hash]->nHeight % 1000 == 0) {
+                        LogPrintf("Block Import: already had block %s at height %d\n", hash.ToString(), mapBlockIndex[hash]->nHeight);
                     }
-                } else if (hash != chainparams.GetConsensus().hashGenesisBlock && mapBlockIndex[hash]->nHeight % 1000 == 0) {
-                    LogPrintf("Block Import: already had block %s at height %d\n", hash.ToString(), mapBlockIndex[hash]->nHeight);
-                }
 
-                // Breath-first process earlier encountered successors of this block
-                deque<uint256> queue{hash};
-                do
-                {
-                    uint256 head = queue.front();
-                    queue.pop_front();
-                    auto range = mapBlocksUnknownParent.equal_range(head);
-                    while (range.first != range.second)
+                    // Breath-first process earlier encountered successors of this block
+                    deque<uint256> queue{hash};
+                    do
                     {
-                        std::multimap<uint256, CDiskBlockPos>::iterator it = range.first;
-                        if (ReadBlockFromDisk(loadedBlk, it->second))
+                        uint256 head = queue.front();
+                        queue.pop_front();
+                        auto range = mapBlocksUnknownParent.equal_range(head);
+                        while (range.first != range.second)
                         {
-                            CValidationState dummy;
-                            if (loadHeadersOnly)
+                            std::multimap<uint256, CDiskBlockPos>::iterator it = range.first;
+                            if (ReadBlockFromDisk(loadedBlk, it->second))
                             {
-                                LogPrintf("%s: Processing out of order header, child %s of %s\n", __func__, loadedBlk.GetHash().ToString(),
-                                        head.ToString());
-                                if (AcceptBlockHeader(loadedBlk, dummy, /*ppindex*/nullptr, /*lookForwardTips*/false))
-                                { //Todo: verify lookForwardTips and correctness of not breaking up
-                                    nLoadedHeaders++;
-                                    queue.push_back(loadedBlk.GetHash());
-                                }
-                            } else {
-                                LogPrintf("%s: Processing out of order block, child %s of %s\n", __func__, loadedBlk.GetHash().ToString(),
-                                        head.ToString());
-
-                                //Todo: verify that issue on Process Block does not cause whole stop as before
-                                if (ProcessNewBlock(dummy, NULL, &loadedBlk, true, &it->second))
+                                CValidationState dummy;
+                                if (loadHeadersOnly)
                                 {
-                                    nLoadedBlocks++;
-                                    queue.push_back(loadedBlk.GetHash());
+                                    LogPrintf("%s: Processing out of order header, child %s of %s\n", __func__, loadedBlk.GetHash().ToString(),
+                                            head.ToString());
+                                    if (AcceptBlockHeader(loadedBlk, dummy, /*ppindex*/nullptr, /*lookForwardTips*/false))
+                                    { //Todo: verify lookForwardTips and correctness of not breaking up
+                                        nLoadedHeaders++;
+                                        queue.push_back(loadedBlk.GetHash());
+                                    }
+                                } else {
+                                    LogPrintf("%s: Processing out of order block, child %s of %s\n", __func__, loadedBlk.GetHash().ToString(),
+                                            head.ToString());
+
+                                    //Todo: verify that issue on Process Block does not cause whole stop as before
+                                    if (ProcessNewBlock(dummy, NULL, &loadedBlk, true, &it->second))
+                                    {
+                                        nLoadedBlocks++;
+                                        blocksImported.increment();
+                                        queue.push_back(loadedBlk.GetHash());
+                                    }
                                 }
                             }
+                            range.first++;
+                            mapBlocksUnknownParent.erase(it);
                         }
-                        range.first++;
-                        mapBlocksUnknownParent.erase(it);
-                    }
-                } while (!queue.empty());
-            } catch (const std::exception& e) {
-                LogPrintf("%s: Deserialize or I/O error - %s\n", __func__, e.what());
+                    } while (!queue.empty());
+                } catch (const std::exception& e) {
+                    LogPrintf("%s: Deserialize or I/O error - %s\n", __func__, e.what());
+                }
             }
         }
-    } catch (const std::runtime_error& e) {
-        AbortNode(std::string("System error: ") + e.what());
+
+        const std::string strError = reader.GetError();
+        if (!strError.empty())
+            AbortNode(std::string("System error: ") + strError);
     }
+    if (!loadHeadersOnly)
+        blockImportTimer.stop();
 
     if (nLoadedBlocks > 0)
         LogPrintf("Loaded %i blocks from external file in %dms\n", nLoadedBlocks, GetTimeMillis() - nStart);
     return (loadHeadersOnly && (nLoadedHeaders > 0)) || (!loadHeadersOnly && (nLoadedBlocks > 0));
 }
 
+namespace {
+
+/**
+ * The oldest ancestors of a block index entry, the entry included, with the properties CheckBlockIndex checks
+ * the entry against.
+ */
+struct CBlockIndexFirstAncestors
+{
+    CBlockIndex* pindexFirstInvalid = NULL; // Oldest ancestor of pindex which is invalid.
+    CBlockIndex* pindexFirstMissing = NULL; // Oldest ancestor of pindex which does not have BLOCK_HAVE_DATA.
+    CBlockIndex* pindexFirstNeverProcessed = NULL; // Oldest ancestor of pindex for which nTx == 0.
+    CBlockIndex* pindexFirstNotTreeValid = NULL; // Oldest ancestor of pindex which does not have BLOCK_VALID_TREE (regardless of being valid or not).
+    CBlockIndex* pindexFirstNotTransactionsValid = NULL; // Oldest ancestor of pindex which does not have BLOCK_VALID_TRANSACTIONS (regardless of being valid or not).
+    CBlockIndex* pindexFirstNotChainValid = NULL; // Oldest ancestor of pindex which does not have BLOCK_VALID_CHAIN (regardless of being valid or not).
+    CBlockIndex* pindexFirstNotScriptsValid = NULL; // Oldest ancestor of pindex which does not have BLOCK_VALID_SCRIPTS (regardless of being valid or not).
+
+    //! Account for pindex, which is older than the ones accounted for so far if fOlder (walking up the tree),
+    //! younger otherwise (walking down)
+    void Add(CBlockIndex* pindex, bool fOlder)
+    {
+        if ((fOlder || pindexFirstInvalid == NULL) && pindex->nStatus & BLOCK_FAILED_VALID) pindexFirstInvalid = pindex;
+        if ((fOlder || pindexFirstMissing == NULL) && !(pindex->nStatus & BLOCK_HAVE_DATA)) pindexFirstMissing = pindex;
+        if ((fOlder || pindexFirstNeverProcessed == NULL) && pindex->nTx == 0) pindexFirstNeverProcessed = pindex;
+        if (pindex->pprev != NULL && (fOlder || pindexFirstNotTreeValid == NULL) && (pindex->nStatus & BLOCK_VALID_MASK) < BLOCK_VALID_TREE) pindexFirstNotTreeValid = pindex;
+        if (pindex->pprev != NULL && (fOlder || pindexFirstNotTransactionsValid == NULL) && (pindex->nStatus & BLOCK_VALID_MASK) < BLOCK_VALID_TRANSACTIONS) pindexFirstNotTransactionsValid = pindex;
+        if (pindex->pprev != NULL && (fOlder || pindexFirstNotChainValid == NULL) && (pindex->nStatus & BLOCK_VALID_MASK) < BLOCK_VALID_CHAIN) pindexFirstNotChainValid = pindex;
+        if (pindex->pprev != NULL && (fOlder || pindexFirstNotScriptsValid == NULL) && (pindex->nStatus & BLOCK_VALID_MASK) < BLOCK_VALID_SCRIPTS) pindexFirstNotScriptsValid = pindex;
+    }
+
+    //! Forget pindex, once the walk down the tree leaves it
+    void Remove(CBlockIndex* pindex)
+    {
+        if (pindex == pindexFirstInvalid) pindexFirstInvalid = NULL;
+        if (pindex == pindexFirstMissing) pindexFirstMissing = NULL;
+        if (pindex == pindexFirstNeverProcessed) pindexFirstNeverProcessed = NULL;
+        if (pindex == pindexFirstNotTreeValid) pindexFirstNotTreeValid = NULL;
+        if (pindex == pindexFirstNotTransactionsValid) pindexFirstNotTransactionsValid = NULL;
+        if (pindex == pindexFirstNotChainValid) pindexFirstNotChainValid = NULL;
+        if (pindex == pindexFirstNotScriptsValid) pindexFirstNotScriptsValid = NULL;
+    }
+};
+
+} // anon namespace
+
+static void CheckBlockIndexEntry(CBlockIndex* pindex, const CBlockIndexFirstAncestors& first, const Consensus::Params& consensusParams)
+{
+    CBlockIndex* pindexFirstInvalid = first.pindexFirstInvalid;
+    CBlockIndex* pindexFirstMissing = first.pindexFirstMissing;
+    CBlockIndex* pindexFirstNeverProcessed = first.pindexFirstNeverProcessed;
+    CBlockIndex* pindexFirstNotTreeValid = first.pindexFirstNotTreeValid;
+    CBlockIndex* pindexFirstNotTransactionsValid = first.pindexFirstNotTransactionsValid;
+    CBlockIndex* pindexFirstNotChainValid = first.pindexFirstNotChainValid;
+    CBlockIndex* pindexFirstNotScriptsValid = first.pindexFirstNotScriptsValid;
+
+    // Begin: actual consistency checks.
+    if (pindex->pprev == NULL) {
+        // Genesis block checks.
+        assert(pindex->GetBlockHash() == consensusParams.hashGenesisBlock); // Genesis block's hash must match.
+        assert(pindex == chainActive.Genesis()); // The current active chain's genesis block must be this block.
+    }
+    if (pindex->nChainTx == 0) assert(pindex->nSequenceId == 0);  // nSequenceId can't be set for blocks that aren't linked
+    // VALID_TRANSACTIONS is equivalent to nTx > 0 for all nodes (whether or not pruning has occurred).
+    // HAVE_DATA is only equivalent to nTx > 0 (or VALID_TRANSACTIONS) if no pruning has occurred.
+    if (!fHavePruned) {
+        // If we've never pruned, then HAVE_DATA should be equivalent to nTx > 0
+        assert(!(pindex->nStatus & BLOCK_HAVE_DATA) == (pindex->nTx == 0));
+        assert(pindexFirstMissing == pindexFirstNeverProcessed);
+    } else {
+        // If we have pruned, then we can only say that HAVE_DATA implies nTx > 0
+        if (pindex->nStatus & BLOCK_HAVE_DATA) assert(pindex->nTx > 0);
+    }
+    if (pindex->nStatus & BLOCK_HAVE_UNDO) assert(pindex->nStatus & BLOCK_HAVE_DATA);
+    assert(((pindex->nStatus & BLOCK_VALID_MASK) >= BLOCK_VALID_TRANSACTIONS) == (pindex->nTx > 0)); // This is pruning-independent.
+    // All parents having had data (at some point) is equivalent to all parents being VALID_TRANSACTIONS, which is equivalent to nChainTx being set.
+    assert((pindexFirstNeverProcessed != NULL) == (pindex->nChainTx == 0)); // nChainTx != 0 is used to signal that all parent blocks have been processed (but may have been pruned).
+    assert((pindexFirstNotTransactionsValid != NULL) == (pindex->nChainTx == 0));
+    assert(pindex->nHeight == (pindex->pprev ? pindex->pprev->nHeight + 1 : 0)); // nHeight must be consistent.
+    assert(pindex->pprev == NULL || pindex->nChainWork >= pindex->pprev->nChainWork); // For every block except the genesis block, the chainwork must be larger than the parent's.
+    assert(pindex->nHeight < 2 || (pindex->pskip && (pindex->pskip->nHeight < pindex->nHeight))); // The pskip pointer must point back for all but the first 2 blocks.
+    assert(pindexFirstNotTreeValid == NULL); // All mapBlockIndex entries must at least be TREE valid
+    if ((pindex->nStatus & BLOCK_VALID_MASK) >= BLOCK_VALID_TREE) assert(pindexFirstNotTreeValid == NULL); // TREE valid implies all parents are TREE valid
+    if ((pindex->nStatus & BLOCK_VALID_MASK) >= BLOCK_VALID_CHAIN) assert(pindexFirstNotChainValid == NULL); // CHAIN valid implies all parents are CHAIN valid
+    if ((pindex->nStatus & BLOCK_VALID_MASK) >= BLOCK_VALID_SCRIPTS) assert(pindexFirstNotScriptsValid == NULL); // SCRIPTS valid implies all parents are SCRIPTS valid
+    if (pindexFirstInvalid == NULL) {
+        // Checks for not-invalid blocks.
+        assert((pindex->nStatus & BLOCK_FAILED_MASK) == 0); // The failed mask cannot be set for blocks without invalid parents.
+    }
+    if (!CBlockIndexWorkComparator()(pindex, chainActive.Tip()) && pindexFirstNeverProcessed == NULL) {
+        if (pindexFirstInvalid == NULL) {
+            // If this block sorts at least as good as the current tip and
+            // is valid and we have all data for its parents, it must be in
+            // setBlockIndexCandidates.  chainActive.Tip() must also be there
+            // even if some data has been pruned.
+            if (pindexFirstMissing == NULL || pindex == chainActive.Tip()) {
+                // LogPrintf("net","ASSERT============>%x  but  %x\n", pindex->phashBlock, chainActive.Tip()->phashBlock);
+                assert(setBlockIndexCandidates.count(pindex));
+            }
+            // If some parent is missing, then it could be that this block was in
+            // setBlockIndexCandidates but had to be removed because of the missing data.
+            // In this case it must be in mapBlocksUnlinked -- see test below.
+        }
+    } else { // If this block sorts worse than the current tip or some ancestor's block has never been seen, it cannot be in setBlockIndexCandidates.
+        assert(setBlockIndexCandidates.count(pindex) == 0);
+    }
+    // Check whether this block is in mapBlocksUnlinked.
+    std::pair<std::multimap<CBlockIndex*,CBlockIndex*>::iterator, std::multimap<CBlockIndex*,CBlockIndex*>::iterator> rangeUnlinked = mapBlocksUnlinked.equal_range(pindex->pprev);
+    bool foundInUnlinked = false;
+    while (rangeUnlinked.first != rangeUnlinked.second) {
+        assert(rangeUnlinked.first->first == pindex->pprev);
+        if (rangeUnlinked.first->second == pindex) {
+            foundInUnlinked = true;
+            break;
+        }
+        rangeUnlinked.first++;
+    }
+    if (pindex->pprev && (pindex->nStatus & BLOCK_HAVE_DATA) && pindexFirstNeverProcessed != NULL && pindexFirstInvalid == NULL) {
+        // If this block has block data available, some parent was never received, and has no invalid parents, it must be in mapBlocksUnlinked.
+        assert(foundInUnlinked);
+    }
+    if (!(pindex->nStatus & BLOCK_HAVE_DATA)) assert(!foundInUnlinked); // Can't be in mapBlocksUnlinked if we don't HAVE_DATA
+    if (pindexFirstMissing == NULL) assert(!foundInUnlinked); // We aren't missing data for any parent -- cannot be in mapBlocksUnlinked.
+    if (pindex->pprev && (pindex->nStatus & BLOCK_HAVE_DATA) && pindexFirstNeverProcessed == NULL && pindexFirstMissing != NULL) {
+        // We HAVE_DATA for this block, have received data for all parents at some point, but we're currently missing data for some parent.
+        assert(fHavePruned); // We must have pruned.
+        // This block may have entered mapBlocksUnlinked if:
+        //  - it has a descendant that at some point had more work than the
+        //    tip, and
+        //  - we tried switching to that descendant but were missing
+        //    data for some intermediate block between chainActive and the
+        //    tip.
+        // So if this block is itself better than chainActive.Tip() and it wasn't in
+        // setBlockIndexCandidates, then it must be in mapBlocksUnlinked.
+        if (!CBlockIndexWorkComparator()(pindex, chainActive.Tip()) && setBlockIndexCandidates.count(pindex) == 0) {
+            if (pindexFirstInvalid == NULL) {
+                assert(foundInUnlinked);
+            }
+        }
+    }
+    // assert(pindex->GetBlockHash() == pindex->GetBlockHeader().GetHash()); // Perhaps too slow
+    // End: actual consistency checks.
+}
+
+/**
+ * Check the entries changed since the last check: the ones made dirty, the candidates for the tip, the entries
+ * of mapBlocksUnlinked and the blocks since the fork with the last tip checked, as whether a block must be a
+ * candidate depends on the tip. The ancestors of an entry are looked at up to the active chain, whose blocks
+ * have none of the properties checked but, once pruned, the missing data; the full checks make sure they do.
+ */
+static void CheckBlockIndexChanges(const Consensus::Params& consensusParams)
+{
+    std::set<CBlockIndex*> setToCheck;
+    setToCheck.swap(setBlockIndexToCheck);
+    setToCheck.insert(setDirtyBlockIndex.begin(), setDirtyBlockIndex.end());
+    setToCheck.insert(setBlockIndexCandidates.begin(), setBlockIndexCandidates.end());
+    for (const auto& entry : mapBlocksUnlinked)
+        setToCheck.insert(entry.second);
+    const CBlockIndex* pindexFork = pindexLastCheckedTip ? chainActive.FindFork(pindexLastCheckedTip) : NULL;
+    for (CBlockIndex* pindex = pindexLastCheckedTip; pindex != pindexFork; pindex = pindex->pprev)
+        setToCheck.insert(pindex);
+    for (CBlockIndex* pindex = chainActive.Tip(); pindex != pindexFork; pindex = pindex->pprev)
+        setToCheck.insert(pindex);
+
+    for (CBlockIndex* pindex : setToCheck) {
+        BlockMap::const_iterator it = mapBlockIndex.find(pindex->GetBlockHash());
+        assert(it != mapBlockIndex.end() && it->second == pindex);
+        CBlockIndexFirstAncestors first;
+        for (CBlockIndex* pindexWalk = pindex; pindexWalk != NULL; pindexWalk = pindexWalk->pprev) {
+            if (pindexWalk != pindex && !fHavePruned && chainActive.Contains(pindexWalk))
+                break;
+            first.Add(pindexWalk, true);
+        }
+        CheckBlockIndexEntry(pindex, first, consensusParams);
+    }
+}
+
 void static CheckBlockIndex()
 {
     const Consensus::Params& consensusParams = Params().GetConsensus();
@@ -6289,6 +8253,16 @@ void static CheckBlockIndex()
     if (fReindexFast && (chainActive.Height() < 0))
         return;
 
+    // The whole tree is only walked every nCheckBlockIndexFullInterval calls, starting with the first one
+    const bool fFullCheck = nCheckBlockIndexFullInterval <= 1 || nCheckBlockIndexCalls++ % nCheckBlockIndexFullInterval == 0;
+    if (!fFullCheck) {
+        CheckBlockIndexChanges(consensusParams);
+        pindexLastCheckedTip = chainActive.Tip();
+        return;
+    }
+    setBlockIndexToCheck.clear();
+    pindexLastCheckedTip = chainActive.Tip();
+
     // Build forward-pointing map of the entire block tree.
     std::multimap<CBlockIndex*,CBlockIndex*> forward;
     for(BlockMap::iterator it = mapBlockIndex.begin(); it != mapBlockIndex.end(); ++it)
@@ -6305,131 +8279,29 @@ void static CheckBlockIndex()
     // Along the way, remember whether there are blocks on the path from genesis
     // block being explored which are the first to have certain properties.
     size_t nNodes = 0;
-    int nHeight = 0;
-    CBlockIndex* pindexFirstInvalid = NULL; // Oldest ancestor of pindex which is invalid.
-    CBlockIndex* pindexFirstMissing = NULL; // Oldest ancestor of pindex which does not have BLOCK_HAVE_DATA.
-    CBlockIndex* pindexFirstNeverProcessed = NULL; // Oldest ancestor of pindex for which nTx == 0.
-    CBlockIndex* pindexFirstNotTreeValid = NULL; // Oldest ancestor of pindex which does not have BLOCK_VALID_TREE (regardless of being valid or not).
-    CBlockIndex* pindexFirstNotTransactionsValid = NULL; // Oldest ancestor of pindex which does not have BLOCK_VALID_TRANSACTIONS (regardless of being valid or not).
-    CBlockIndex* pindexFirstNotChainValid = NULL; // Oldest ancestor of pindex which does not have BLOCK_VALID_CHAIN (regardless of being valid or not).
-    CBlockIndex* pindexFirstNotScriptsValid = NULL; // Oldest ancestor of pindex which does not have BLOCK_VALID_SCRIPTS (regardless of being valid or not).
+    size_t nLeaves = 0;
+    CBlockIndexFirstAncestors first;
     while (pindex != NULL) {
         nNodes++;
-        if (pindexFirstInvalid == NULL && pindex->nStatus & BLOCK_FAILED_VALID) pindexFirstInvalid = pindex;
-        if (pindexFirstMissing == NULL && !(pindex->nStatus & BLOCK_HAVE_DATA)) pindexFirstMissing = pindex;
-        if (pindexFirstNeverProcessed == NULL && pindex->nTx == 0) pindexFirstNeverProcessed = pindex;
-        if (pindex->pprev != NULL && pindexFirstNotTreeValid == NULL && (pindex->nStatus & BLOCK_VALID_MASK) < BLOCK_VALID_TREE) pindexFirstNotTreeValid = pindex;
-        if (pindex->pprev != NULL && pindexFirstNotTransactionsValid == NULL && (pindex->nStatus & BLOCK_VALID_MASK) < BLOCK_VALID_TRANSACTIONS) pindexFirstNotTransactionsValid = pindex;
-        if (pindex->pprev != NULL && pindexFirstNotChainValid == NULL && (pindex->nStatus & BLOCK_VALID_MASK) < BLOCK_VALID_CHAIN) pindexFirstNotChainValid = pindex;
-        if (pindex->pprev != NULL && pindexFirstNotScriptsValid == NULL && (pindex->nStatus & BLOCK_VALID_MASK) < BLOCK_VALID_SCRIPTS) pindexFirstNotScriptsValid = pindex;
-
-        // Begin: actual consistency checks.
-        if (pindex->pprev == NULL) {
-            // Genesis block checks.
-            assert(pindex->GetBlockHash() == consensusParams.hashGenesisBlock); // Genesis block's hash must match.
-            assert(pindex == chainActive.Genesis()); // The current active chain's genesis block must be this block.
-        }
-        if (pindex->nChainTx == 0) assert(pindex->nSequenceId == 0);  // nSequenceId can't be set for blocks that aren't linked
-        // VALID_TRANSACTIONS is equivalent to nTx > 0 for all nodes (whether or not pruning has occurred).
-        // HAVE_DATA is only equivalent to nTx > 0 (or VALID_TRANSACTIONS) if no pruning has occurred.
-        if (!fHavePruned) {
-            // If we've never pruned, then HAVE_DATA should be equivalent to nTx > 0
-            assert(!(pindex->nStatus & BLOCK_HAVE_DATA) == (pindex->nTx == 0));
-            assert(pindexFirstMissing == pindexFirstNeverProcessed);
-        } else {
-            // If we have pruned, then we can only say that HAVE_DATA implies nTx > 0
-            if (pindex->nStatus & BLOCK_HAVE_DATA) assert(pindex->nTx > 0);
-        }
-        if (pindex->nStatus & BLOCK_HAVE_UNDO) assert(pindex->nStatus & BLOCK_HAVE_DATA);
-        assert(((pindex->nStatus & BLOCK_VALID_MASK) >= BLOCK_VALID_TRANSACTIONS) == (pindex->nTx > 0)); // This is pruning-independent.
-        // All parents having had data (at some point) is equivalent to all parents being VALID_TRANSACTIONS, which is equivalent to nChainTx being set.
-        assert((pindexFirstNeverProcessed != NULL) == (pindex->nChainTx == 0)); // nChainTx != 0 is used to signal that all parent blocks have been processed (but may have been pruned).
-        assert((pindexFirstNotTransactionsValid != NULL) == (pindex->nChainTx == 0));
-        assert(pindex->nHeight == nHeight); // nHeight must be consistent.
-        assert(pindex->pprev == NULL || pindex->nChainWork >= pindex->pprev->nChainWork); // For every block except the genesis block, the chainwork must be larger than the parent's.
-        assert(nHeight < 2 || (pindex->pskip && (pindex->pskip->nHeight < nHeight))); // The pskip pointer must point back for all but the first 2 blocks.
-        assert(pindexFirstNotTreeValid == NULL); // All mapBlockIndex entries must at least be TREE valid
-        if ((pindex->nStatus & BLOCK_VALID_MASK) >= BLOCK_VALID_TREE) assert(pindexFirstNotTreeValid == NULL); // TREE valid implies all parents are TREE valid
-        if ((pindex->nStatus & BLOCK_VALID_MASK) >= BLOCK_VALID_CHAIN) assert(pindexFirstNotChainValid == NULL); // CHAIN valid implies all parents are CHAIN valid
-        if ((pindex->nStatus & BLOCK_VALID_MASK) >= BLOCK_VALID_SCRIPTS) assert(pindexFirstNotScriptsValid == NULL); // SCRIPTS valid implies all parents are SCRIPTS valid
-        if (pindexFirstInvalid == NULL) {
-            // Checks for not-invalid blocks.
-            assert((pindex->nStatus & BLOCK_FAILED_MASK) == 0); // The failed mask cannot be set for blocks without invalid parents.
-        }
-        if (!CBlockIndexWorkComparator()(pindex, chainActive.Tip()) && pindexFirstNeverProcessed == NULL) {
-            if (pindexFirstInvalid == NULL) {
-                // If this block sorts at least as good as the current tip and
-                // is valid and we have all data for its parents, it must be in
-                // setBlockIndexCandidates.  chainActive.Tip() must also be there
-                // even if some data has been pruned.
-                if (pindexFirstMissing == NULL || pindex == chainActive.Tip()) {
-                    // LogPrintf("net","ASSERT============>%x  but  %x\n", pindex->phashBlock, chainActive.Tip()->phashBlock);
-                    assert(setBlockIndexCandidates.count(pindex));
-                }
-                // If some parent is missing, then it could be that this block was in
-                // setBlockIndexCandidates but had to be removed because of the missing data.
-                // In this case it must be in mapBlocksUnlinked -- see test below.
-            }
-        } else { // If this block sorts worse than the current tip or some ancestor's block has never been seen, it cannot be in setBlockIndexCandidates.
-            assert(setBlockIndexCandidates.count(pindex) == 0);
-        }
-        // Check whether this block is in mapBlocksUnlinked.
-        std::pair<std::multimap<CBlockIndex*,CBlockIndex*>::iterator, std::multimap<CBlockIndex*,CBlockIndex*>::iterator> rangeUnlinked = mapBlocksUnlinked.equal_range(pindex->pprev);
-        bool foundInUnlinked = false;
-        while (rangeUnlinked.first != rangeUnlinked.second) {
-            assert(rangeUnlinked.first->first == pindex->pprev);
-            if (rangeUnlinked.first->second == pindex) {
-                foundInUnlinked = true;
-                break;
-            }
-            rangeUnlinked.first++;
-        }
-        if (pindex->pprev && (pindex->nStatus & BLOCK_HAVE_DATA) && pindexFirstNeverProcessed != NULL && pindexFirstInvalid == NULL) {
-            // If this block has block data available, some parent was never received, and has no invalid parents, it must be in mapBlocksUnlinked.
-            assert(foundInUnlinked);
-        }
-        if (!(pindex->nStatus & BLOCK_HAVE_DATA)) assert(!foundInUnlinked); // Can't be in mapBlocksUnlinked if we don't HAVE_DATA
-        if (pindexFirstMissing == NULL) assert(!foundInUnlinked); // We aren't missing data for any parent -- cannot be in mapBlocksUnlinked.
-        if (pindex->pprev && (pindex->nStatus & BLOCK_HAVE_DATA) && pindexFirstNeverProcessed == NULL && pindexFirstMissing != NULL) {
-            // We HAVE_DATA for this block, have received data for all parents at some point, but we're currently missing data for some parent.
-            assert(fHavePruned); // We must have pruned.
-            // This block may have entered mapBlocksUnlinked if:
-            //  - it has a descendant that at some point had more work than the
-            //    tip, and
-            //  - we tried switching to that descendant but were missing
-            //    data for some intermediate block between chainActive and the
-            //    tip.
-            // So if this block is itself better than chainActive.Tip() and it wasn't in
-            // setBlockIndexCandidates, then it must be in mapBlocksUnlinked.
-            if (!CBlockIndexWorkComparator()(pindex, chainActive.Tip()) && setBlockIndexCandidates.count(pindex) == 0) {
-                if (pindexFirstInvalid == NULL) {
-                    assert(foundInUnlinked);
-                }
-            }
-        }
-        // assert(pindex->GetBlockHash() == pindex->GetBlockHeader().GetHash()); // Perhaps too slow
-        // End: actual consistency checks.
+        first.Add(pindex, false);
+
+        CheckBlockIndexEntry(pindex, first, consensusParams);
 
         // Try descending into the first subnode.
         std::pair<std::multimap<CBlockIndex*,CBlockIndex*>::iterator, std::multimap<CBlockIndex*,CBlockIndex*>::iterator> range = forward.equal_range(pindex);
         if (range.first != range.second) {
             // A subnode was found.
             pindex = range.first->second;
-            nHeight++;
             continue;
         }
-        // This is a leaf node.
+        // This is a leaf node, getchaintips reports it from mGlobalForkTips.
+        assert(mGlobalForkTips.count(pindex));
+        nLeaves++;
         // Move upwards until we reach a node of which we have not yet visited the last child.
         while (pindex) {
             // We are going to either move to a parent or a sibling of pindex.
             // If pindex was the first with a certain property, unset the corresponding variable.
-            if (pindex == pindexFirstInvalid) pindexFirstInvalid = NULL;
-            if (pindex == pindexFirstMissing) pindexFirstMissing = NULL;
-            if (pindex == pindexFirstNeverProcessed) pindexFirstNeverProcessed = NULL;
-            if (pindex == pindexFirstNotTreeValid) pindexFirstNotTreeValid = NULL;
-            if (pindex == pindexFirstNotTransactionsValid) pindexFirstNotTransactionsValid = NULL;
-            if (pindex == pindexFirstNotChainValid) pindexFirstNotChainValid = NULL;
-            if (pindex == pindexFirstNotScriptsValid) pindexFirstNotScriptsValid = NULL;
+            first.Remove(pindex);
             // Find our parent.
             CBlockIndex* pindexPar = pindex->pprev;
             // Find which child we just visited.
@@ -6447,7 +8319,6 @@ void static CheckBlockIndex()
             } else {
                 // Move up further.
                 pindex = pindexPar;
-                nHeight--;
                 continue;
             }
         }
@@ -6455,6 +8326,7 @@ void static CheckBlockIndex()
 
     // Check that we actually traversed the entire map.
     assert(nNodes == forward.size());
+    assert(nLeaves == mGlobalForkTips.size());
 }
 
 std::string GetWarnings(const std::string& strFor)
@@ -6523,7 +8395,7 @@ bool static AlreadyHave(const CInv& inv) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
 
             return recentRejects->contains(inv.hash) ||
                    mempool->exists(inv.hash) ||
-                   mapOrphanTransactions.count(inv.hash) ||
+                   orphanPool.Have(inv.hash) ||
                    pcoinsTip->HaveCoins(inv.hash);
         }
         case MSG_BLOCK:
@@ -6535,6 +8407,40 @@ bool static AlreadyHave(const CInv& inv) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
     return true;
 }
 
+namespace {
+
+/**
+ * The messages most peers send all the time and which only touch the state of their peer, or state
+ * guarded by its own lock (cs_main included): with several message handler threads, these are
+ * processed concurrently with the messages of the peers served by the other threads. Any other
+ * message, validation included, is processed under cs_msgProcSerial, as by a single thread.
+ */
+const std::set<std::string> setConcurrentMessages = {
+    NetMsgType::ADDR, NetMsgType::GETADDR, NetMsgType::INV, NetMsgType::GETDATA,
+    NetMsgType::GETHEADERS, NetMsgType::PING, NetMsgType::PONG,
+    NetMsgType::GETCFILTERS, NetMsgType::GETCFHEADERS, NetMsgType::GETCFCHECKPT,
+};
+CCriticalSection cs_msgProcSerial;
+
+} // anon namespace
+
+/** Sends the block of pindex to pfrom in a "compressed" message, false if it cannot be compressed */
+static bool PushCompressedBlock(CNode* pfrom, const CBlockIndex* pindex)
+{
+    std::shared_ptr<const CBlock> pblock = ReadBlockFromDiskCached(pindex);
+    if (!pblock)
+        return false;
+    CDataStream ss(SER_NETWORK, pfrom->ssSend.GetVersion());
+    ss << *pblock;
+    CSerializeData vFrame;
+    if (!CompressData(&ss[0], &ss[0] + ss.size(), RELAY_COMPRESSION_LEVEL, vFrame))
+        return false;
+    LogPrint("net", "%s: compressed block %s from %u to %u bytes for peer=%d\n",
+             __func__, pindex->GetBlockHash().ToString(), ss.size(), vFrame.size(), pfrom->id);
+    pfrom->PushMessage(NetMsgType::COMPRESSED, std::string(NetMsgType::BLOCK), vFrame);
+    return true;
+}
+
 void static ProcessGetData(CNode* pfrom, const std::atomic<bool>& interruptMsgProc)
 {
     std::deque<CInv>::iterator it = pfrom->vRecvGetData.begin();
@@ -6554,7 +8460,7 @@ void static ProcessGetData(CNode* pfrom, const std::atomic<bool>& interruptMsgPr
                 return;
             it++;
 
-            if (inv.type == MSG_BLOCK || inv.type == MSG_FILTERED_BLOCK)
+            if (inv.type == MSG_BLOCK || inv.type == MSG_FILTERED_BLOCK || inv.type == MSG_CMPCT_BLOCK)
             {
                 bool send = false;
                 BlockMap::iterator mi = mapBlockIndex.find(inv.hash);
@@ -6598,14 +8504,34 @@ void static ProcessGetData(CNode* pfrom, const std::atomic<bool>& interruptMsgPr
                 // it's available before trying to send.
                 if (send && (mi->second->nStatus & BLOCK_HAVE_DATA))
                 {
-                    // Send block from disk
-                    CBlock block;
-                    if (!ReadBlockFromDisk(block, (*mi).second))
+                    // Send block from the cache of recent blocks: a block message is serialized once for all the peers
+                    std::shared_ptr<const CSerializeData> msg;
+                    std::shared_ptr<const CBlock> pblock;
+                    if (inv.type == MSG_BLOCK)
+                        msg = ReadBlockMessageCached((*mi).second, pfrom->ssSend.GetVersion());
+                    else
+                        pblock = ReadBlockFromDiskCached((*mi).second);
+                    if (!msg && !pblock)
                         assert(!"cannot load block from disk");
                     if (inv.type == MSG_BLOCK)
                     {
-                        LogPrint("forks", "%s():%d - Pushing block [%s]\n", __func__, __LINE__, block.GetHash().ToString() );
-                        pfrom->PushMessage(NetMsgType::BLOCK, block);
+                        LogPrint("forks", "%s():%d - Pushing block [%s]\n", __func__, __LINE__, inv.hash.ToString() );
+                        if (!State(pfrom->GetId())->fCompressedBlocks || !PushCompressedBlock(pfrom, (*mi).second))
+                            pfrom->PushSerializedMessage(NetMsgType::BLOCK, msg);
+                    }
+                    else
+                    if (inv.type == MSG_CMPCT_BLOCK)
+                    {
+                        // Peers only reconstruct blocks near the tip from their mempool: older blocks are
+                        // sent in full, as the missing transactions would cost another round trip.
+                        if (mi->second->nHeight >= chainActive.Height() - MAX_CMPCTBLOCK_DEPTH)
+                        {
+                            LogPrint("cmpctblock", "%s():%d - Pushing compact block [%s]\n", __func__, __LINE__, pblock->GetHash().ToString() );
+                            CBlockHeaderAndShortTxIDs cmpctblock(*pblock);
+                            pfrom->PushMessage(NetMsgType::CMPCTBLOCK, cmpctblock);
+                        }
+                        else
+                            pfrom->PushMessage(NetMsgType::BLOCK, *pblock);
                     }
                     else // MSG_FILTERED_BLOCK)
                     if (inv.type == MSG_FILTERED_BLOCK)
@@ -6613,7 +8539,7 @@ void static ProcessGetData(CNode* pfrom, const std::atomic<bool>& interruptMsgPr
                         LOCK(pfrom->cs_filter);
                         if (pfrom->pfilter)
                         {
-                            CMerkleBlock merkleBlock(block, *pfrom->pfilter);
+                            CMerkleBlock merkleBlock(*pblock, *pfrom->pfilter);
                             pfrom->PushMessage(NetMsgType::MERKLEBLOCK, merkleBlock);
                             // CMerkleBlock just contains hashes, so also push any transactions/certs in the block the client did not see
                             // This avoids hurting performance by pointlessly requiring a round-trip
@@ -6625,18 +8551,18 @@ void static ProcessGetData(CNode* pfrom, const std::atomic<bool>& interruptMsgPr
                             BOOST_FOREACH(PairType& pair, merkleBlock.vMatchedTxn)
                             {
                                 unsigned int pos = pair.first;
-                                if (pos < block.vtx.size() )
+                                if (pos < pblock->vtx.size() )
                                 {
-                                    if (!pfrom->setInventoryKnown.count(CInv(MSG_TX, pair.second)))
-                                        pfrom->PushMessage(NetMsgType::TX, block.vtx[pos]);
+                                    if (!pfrom->IsInventoryKnown(pair.second))
+                                        pfrom->PushMessage(NetMsgType::TX, pblock->vtx[pos]);
                                 }
                                 else
-                                if ( pos < (block.vcert.size() + block.vtx.size()) )
+                                if ( pos < (pblock->vcert.size() + pblock->vtx.size()) )
                                 {
-                                    if (!pfrom->setInventoryKnown.count(CInv(MSG_TX, pair.second)))
+                                    if (!pfrom->IsInventoryKnown(pair.second))
                                     {
-                                        unsigned int offset = pos - block.vtx.size();
-                                        pfrom->PushMessage(NetMsgType::TX, block.vcert[offset]);
+                                        unsigned int offset = pos - pblock->vtx.size();
+                                        pfrom->PushMessage(NetMsgType::TX, pblock->vcert[offset]);
                                     }
                                 }
                                 else
@@ -6676,13 +8602,19 @@ void static ProcessGetData(CNode* pfrom, const std::atomic<bool>& interruptMsgPr
             }
             else if (inv.IsKnownType())
             {
-                // Send stream from relay memory
+                // Send the message from relay memory, shared with the other peers asking for it
                 bool pushed = false;
+                if (inv.type == MSG_TX)
                 {
-                    LOCK(cs_mapRelay);
-                    map<CInv, CDataStream>::iterator mi = mapRelay.find(inv);
-                    if (mi != mapRelay.end()) {
-                        pfrom->PushMessage(inv.GetCommand(), (*mi).second);
+                    std::shared_ptr<const CSerializeData> msg;
+                    {
+                        LOCK(cs_mapRelay);
+                        map<uint256, std::shared_ptr<const CSerializeData> >::iterator mi = mapRelay.find(inv.hash);
+                        if (mi != mapRelay.end())
+                            msg = mi->second;
+                    }
+                    if (msg) {
+                        pfrom->PushSerializedMessage(NetMsgType::TX, msg);
                         pushed = true;
                     }
                 }
@@ -6714,7 +8646,7 @@ void static ProcessGetData(CNode* pfrom, const std::atomic<bool>& interruptMsgPr
                 }
             }
 
-            if (inv.type == MSG_BLOCK || inv.type == MSG_FILTERED_BLOCK)
+            if (inv.type == MSG_BLOCK || inv.type == MSG_FILTERED_BLOCK || inv.type == MSG_CMPCT_BLOCK)
                 break;
         }
     }
@@ -6803,98 +8735,114 @@ void ProcessTxBaseAcceptToMemoryPool(const CTransactionBase& txBase, CNode* pfro
 
     if (res == MempoolReturnValue::VALID)
     {
+        RecordTxTraceStage(txBase.GetHash(), TxTraceStage::ACCEPTED);
         mempool->check(pcoinsTip);
         txBase.Relay();
-        std::vector<uint256> vWorkQueue{txBase.GetHash()};
-        std::vector<uint256> vEraseQueue;
 
         LogPrint("mempool", "%s(): peer=%d %s: accepted %s (poolsz %u)\n", __func__,
             pfrom->id, pfrom->cleanSubVer,
             txBase.GetHash().ToString(),
             mempool->size());
 
-        // Recursively process any orphan transactions that depended on this one
-        set<NodeId> setMisbehaving;
-        for (unsigned int i = 0; i < vWorkQueue.size(); i++)
-        {
-            map<uint256, set<uint256> >::iterator itByPrev = mapOrphanTransactionsByPrev.find(vWorkQueue[i]);
-            if (itByPrev == mapOrphanTransactionsByPrev.end())
-                continue;
-            for (const uint256& orphanHash: itByPrev->second)
-            {
-                const CTransactionBase& orphanTx = *mapOrphanTransactions[orphanHash].tx;
-                NodeId fromPeer = mapOrphanTransactions[orphanHash].fromPeer;
-                bool fMissingInputs2 = false;
-                // Use a dummy CValidationState so someone can't setup nodes to counter-DoS based on orphan
-                // resolution (that is, feeding people an invalid transaction based on LegitTxX in order to get
-                // anyone relaying LegitTxX banned)
-                CValidationState stateDummy;
-
-                if (setMisbehaving.count(fromPeer))
-                    continue;
-
-                MempoolReturnValue resOrphan = AcceptTxBaseToMemoryPool(*mempool, stateDummy, orphanTx,
-                            LimitFreeFlag::ON,RejectAbsurdFeeFlag::OFF, MempoolProofVerificationFlag::ASYNC, pfrom);
-                if (resOrphan == MempoolReturnValue::VALID)
-                {
-                    LogPrint("mempool", "   accepted orphan tx %s\n", orphanHash.ToString());
-                    orphanTx.Relay();
-                    vWorkQueue.push_back(orphanHash);
-                    vEraseQueue.push_back(orphanHash);
-                }
-                else if (resOrphan == MempoolReturnValue::INVALID)
-                {
-                    if (stateDummy.IsInvalid() && stateDummy.GetDoS() > 0)
-                    {
-                        // Punish peer that gave us an invalid orphan tx
-                        Misbehaving(fromPeer, stateDummy.GetDoS());
-                        setMisbehaving.insert(fromPeer);
-                        LogPrint("mempool", "   invalid orphan tx %s\n", orphanHash.ToString());
-                    }
-                    // Has inputs but not accepted to mempool
-                    // Probably non-standard or insufficient fee/priority
-                    LogPrint("mempool", "   removed orphan tx %s\n", orphanHash.ToString());
-                    vEraseQueue.push_back(orphanHash);
-                    assert(recentRejects);
-                    recentRejects->insert(orphanHash);
-                }
-                else if (resOrphan == MempoolReturnValue::PARTIALLY_VALIDATED)
-                {
-                    vEraseQueue.push_back(orphanHash);
-                }
-                mempool->check(pcoinsTip);
-            }
-        }
-
-            for(const uint256& hash: vEraseQueue)
-            EraseOrphanTx(hash);
+        // The orphan transactions that depended on this one are processed by the handlers of their peers
+        orphanPool.AddChildrenToWorkSet(txBase.GetHash());
     }
-    // TODO: currently, prohibit joinsplits from entering mapOrphans
+    // TODO: currently, prohibit joinsplits from entering the orphan pool
     else if (res == MempoolReturnValue::MISSING_INPUT && txBase.GetVjoinsplit().size() == 0)
     {
-        AddOrphanTx(txBase, pfrom->GetId());
+        orphanPool.Add(txBase, pfrom->GetId());
 
-        // DoS prevention: do not allow mapOrphanTransactions to grow unbounded
+        // DoS prevention: do not allow the orphan pool to grow unbounded
         unsigned int nMaxOrphanTx = (unsigned int)std::max((int64_t)0, GetArg("-maxorphantx", DEFAULT_MAX_ORPHAN_TRANSACTIONS));
-        unsigned int nEvicted = LimitOrphanTxSize(nMaxOrphanTx);
+        unsigned int nEvicted = orphanPool.Limit(nMaxOrphanTx);
         if (nEvicted > 0)
             LogPrint("mempool", "mapOrphan overflow, removed %u tx\n", nEvicted);
     }
 }
 
+/**
+ * Reprocess a batch of the orphan transactions sent by pfrom whose parents have shown up, so that
+ * an orphan flood costs the handler of the flooding peer, a batch per ProcessMessages call.
+ */
+void static ProcessOrphanWork(CNode* pfrom) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+{
+    uint256 orphanHash;
+    for (unsigned int n = 0; n < MAX_ORPHAN_WORK_BATCH && orphanPool.GetNextWork(pfrom->GetId(), orphanHash); n++)
+    {
+        NodeId fromPeer;
+        std::shared_ptr<const CTransactionBase> orphanTx = orphanPool.Get(orphanHash, fromPeer);
+        if (!orphanTx)
+            continue;
+
+        // Use a dummy CValidationState so someone can't setup nodes to counter-DoS based on orphan
+        // resolution (that is, feeding people an invalid transaction based on LegitTxX in order to get
+        // anyone relaying LegitTxX banned)
+        CValidationState stateDummy;
+        MempoolReturnValue resOrphan = AcceptTxBaseToMemoryPool(*mempool, stateDummy, *orphanTx,
+                    LimitFreeFlag::ON, RejectAbsurdFeeFlag::OFF, MempoolProofVerificationFlag::ASYNC, pfrom);
+        if (resOrphan == MempoolReturnValue::VALID)
+        {
+            LogPrint("mempool", "   accepted orphan tx %s\n", orphanHash.ToString());
+            RecordTxTraceStage(orphanHash, TxTraceStage::ACCEPTED);
+            orphanTx->Relay();
+            orphanPool.AddChildrenToWorkSet(orphanHash);
+            orphanPool.Erase(orphanHash);
+        }
+        else if (resOrphan == MempoolReturnValue::INVALID)
+        {
+            // Has inputs but not accepted to mempool
+            // Probably non-standard or insufficient fee/priority
+            LogPrint("mempool", "   removed orphan tx %s\n", orphanHash.ToString());
+            orphanPool.Erase(orphanHash);
+            assert(recentRejects);
+            recentRejects->insert(orphanHash);
+            if (stateDummy.IsInvalid() && stateDummy.GetDoS() > 0)
+            {
+                // Punish peer that gave us an invalid orphan tx, and leave its other orphans for later
+                Misbehaving(fromPeer, stateDummy.GetDoS());
+                LogPrint("mempool", "   invalid orphan tx %s\n", orphanHash.ToString());
+                break;
+            }
+        }
+        else if (resOrphan == MempoolReturnValue::PARTIALLY_VALIDATED)
+        {
+            orphanPool.Erase(orphanHash);
+        }
+        mempool->check(pcoinsTip);
+    }
+}
+
+/** Record the announcement of a tx or certificate, which is then requested from the peers from SendMessages. Requires cs_main. */
+static void AskFor(CNode* pfrom, const CInv& inv)
+{
+    AssertLockHeld(cs_main);
+    if (!txRequestTracker.ReceivedInv(pfrom->GetId(), inv))
+        return;
+
+    // If we need to ask for this inv again (after it has already been received)
+    // then pretend we never received it before so that the request is actually performed.
+    // Otherwise, this request would be blocked in SendMessages.
+    if (connman->mapAlreadyReceived.erase(inv)) {
+        LogPrint("net", "%s():%d - askfor %s even though it was received already in the past\n", __func__, __LINE__, inv.ToString());
+    }
+    LogPrint("net", "askfor %s peer=%d\n", inv.ToString(), pfrom->id);
+}
+
 void ProcessTxBaseMsg(const CTransactionBase& txBase, CNode* pfrom)
 {
+    const int64_t nReceivedTime = GetTimeMicros();
     CInv inv(MSG_TX, txBase.GetHash());
     pfrom->AddInventoryKnown(inv);
 
     LOCK(cs_main);
 
-    pfrom->setAskFor.erase(inv.hash);
-    connman->mapAlreadyAskedFor.erase(inv);
+    txRequestTracker.Forget(inv);
     connman->mapAlreadyReceived.insert(std::make_pair(inv, GetTimeMicros()));
 
     if (!AlreadyHave(inv))
     {
+        StartTxTrace(inv.hash, txBase.IsCertificate(), nReceivedTime);
+
         CValidationState state;
         BatchVerificationStateFlag flag = BatchVerificationStateFlag::NOT_VERIFIED_YET;
 
@@ -6924,7 +8872,7 @@ void ProcessTxBaseMsg(const CTransactionBase& txBase, CNode* pfrom)
             // Following conditions are not included:
             // 1) tx in recentRejects: COULD lead to our node ban-score penalization (example orphan tx
             //    being re-processed as INVALID)
-            // 2) tx in mapOrphanTransactions: COULD lead to our node ban-score penalization (example
+            // 2) tx in the orphan pool: COULD lead to our node ban-score penalization (example
             //    orphan tx being re-processed in the future as INVALID)
             // 3) tx utxos already available: this means the tx is already in the blockchain (conf>0)
             //    hence any other peer would be aligned on this (so relaying is useless) or is already
@@ -6941,21 +8889,171 @@ void ProcessTxBaseMsg(const CTransactionBase& txBase, CNode* pfrom)
             }
         }
     }
-}
+}
+
+bool static ValidateStreamSize(CNode* pfrom, CDataStream& vRecv, const char* msgTypeName)
+{
+    auto vRecvStreamSz = ReadCompactSize(vRecv);
+    if (vRecvStreamSz > MAX_INV_SZ)
+    {
+        Misbehaving(pfrom->GetId(), 20);
+        return error("message %s size() = %u", msgTypeName, vRecvStreamSz);
+    }
+    else if(vRecvStreamSz * sizeof(CInv)!= vRecv.in_avail()) {
+        Misbehaving(pfrom->GetId(), 20);
+        return error("invalid message payload for %u", vRecvStreamSz);
+    }    
+    return vRecv.Rewind(GetSizeOfCompactSize(vRecvStreamSz));
+}
+
+// Requires cs_main.
+// Whether a certificate announced by a peer is not worth fetching, as the active chain or the mempool already has
+// a better one for its sidechain and epoch. An equal quality in the mempool does not count, as a certificate of
+// the same quality paying a higher fee replaces it.
+static bool IsCertAnnouncementSuperseded(const CCertAnnouncement& ann)
+{
+    CSidechain sidechain;
+    if (pcoinsTip->GetSidechain(ann.scId, sidechain))
+    {
+        if (ann.epochNumber < sidechain.lastTopQualityCertReferencedEpoch)
+            return true;
+        if (ann.epochNumber == sidechain.lastTopQualityCertReferencedEpoch && ann.quality <= sidechain.lastTopQualityCertQuality)
+            return true;
+    }
+
+    LOCK(mempool->cs);
+    if (!mempool->hasSidechainCertificate(ann.scId))
+        return false;
+    const uint256& topQualCertHash = mempool->mapSidechains.at(ann.scId).GetTopQualityCert()->second;
+    const CScCertificate& topQualCert = mempool->mapCertificate.at(topQualCertHash).GetCertificate();
+    return topQualCert.epochNumber == ann.epochNumber && topQualCert.quality > ann.quality;
+}
+
+// Requires cs_main.
+// Falls back to downloading in full a block that could not be rebuilt from its compact version.
+void static RequestFullBlock(CNode* pfrom, const uint256& hash)
+{
+    std::vector<CInv> vInv(1, CInv(MSG_BLOCK, hash));
+    pfrom->PushMessage(NetMsgType::GETDATA, vInv);
+}
+
+/** Hand a block rebuilt from a compact block to validation, as if it had been received in a block message */
+void static ProcessReconstructedBlock(CNode* pfrom, CBlock& block, const string& strCommand)
+{
+    CInv inv(MSG_BLOCK, block.GetHash());
+    pfrom->AddInventoryKnown(inv);
+
+    CValidationState state;
+    // the compact block was requested from this peer, or fast relayed by it, so it is processed as any requested block
+    ProcessNewBlock(state, pfrom, &block, /*fForceProcessing*/true, NULL);
+    if (state.IsInvalid())
+    {
+        LogPrint("forks", "%s():%d - Pushing reject, DoS[%d]\n", __func__, __LINE__, state.GetDoS());
+        pfrom->PushMessage(NetMsgType::REJECT, strCommand, CValidationState::CodeToChar(state.GetRejectCode()),
+                           state.GetRejectReason().substr(0, MAX_REJECT_MESSAGE_LENGTH), inv.hash);
+        LOCK(cs_main);
+        FastRelayedBlockInvalid(inv.hash, state);
+        if (state.GetDoS() > 0)
+            Misbehaving(pfrom->GetId(), state.GetDoS());
+    }
+}
+
+/**
+ * The stop block of a compact filter request, false if the request is not answered: the peers asking
+ * for filters while they are not served are disconnected, those asking for a range of more than
+ * nMaxRange blocks are punished, and a stop block not known, maybe just reorged away, is ignored.
+ */
+static bool PrepareBlockFilterRequest(CNode* pfrom, uint8_t nFilterType, uint32_t nStartHeight, const uint256& hashStop,
+                                      uint32_t nMaxRange, const CBlockIndex*& pindexStop)
+{
+    if (pblockfilterindex == NULL || !(connman->GetLocalServices() & NODE_COMPACT_FILTERS) ||
+        nFilterType != static_cast<uint8_t>(pblockfilterindex->GetFilterType()))
+    {
+        LogPrint("net", "peer=%d requested compact filters of type %u, which are not served, disconnecting\n", pfrom->id, nFilterType);
+        pfrom->fDisconnect = true;
+        return false;
+    }
+
+    {
+        LOCK(cs_main);
+        BlockMap::const_iterator it = mapBlockIndex.find(hashStop);
+        if (it == mapBlockIndex.end())
+        {
+            LogPrint("net", "peer=%d requested compact filters up to unknown block %s\n", pfrom->id, hashStop.ToString());
+            return false;
+        }
+        pindexStop = it->second;
+    }
 
-bool static ValidateStreamSize(CNode* pfrom, CDataStream& vRecv, const char* msgTypeName)
-{
-    auto vRecvStreamSz = ReadCompactSize(vRecv);
-    if (vRecvStreamSz > MAX_INV_SZ)
+    if (nStartHeight > (uint32_t)pindexStop->nHeight || (uint32_t)pindexStop->nHeight - nStartHeight >= nMaxRange)
     {
         Misbehaving(pfrom->GetId(), 20);
-        return error("message %s size() = %u", msgTypeName, vRecvStreamSz);
+        return error("compact filters requested from height %u to %d", nStartHeight, pindexStop->nHeight);
     }
-    else if(vRecvStreamSz * sizeof(CInv)!= vRecv.in_avail()) {
+    return true;
+}
+
+
+// Requires cs_main.
+// Insert in the block index the headers of the ranges now connecting to it.
+static void StitchHeaderRanges()
+{
+    std::vector<NodeId> vFailed;
+    headerRanges.Stitch(
+        [](const uint256& hash) { return mapBlockIndex.count(hash) != 0; },
+        [](const CBlockHeader& header, NodeId nodeid) {
+            // the PoW of the headers was checked when they were received
+            CValidationState state;
+            CBlockIndex* pindex = NULL;
+            if (AcceptBlockHeader(header, state, &pindex, false, flagCheckPow::OFF)) {
+                if (nodeid != -1)
+                    UpdateBlockAvailability(nodeid, pindex->GetBlockHash());
+                return true;
+            }
+            if (state.IsInvalid() && state.GetDoS() > 0 && nodeid != -1)
+                Misbehaving(nodeid, state.GetDoS());
+            LogPrint("net", "header %s of a range rejected: %s\n", header.GetHash().ToString(), state.GetRejectReason());
+            return false;
+        },
+        vFailed);
+}
+
+// Requires cs_main.
+// Keep the headers of its checkpoint range a peer sent, and insert those connecting to the block index.
+static bool ProcessHeaderRange(CNode* pfrom, const std::vector<CBlockHeader>& headers,
+                               const std::vector<CValidationState>& vStates)
+{
+    for (const CValidationState& state : vStates) {
+        if (state.IsInvalid()) {
+            headerRanges.Release(pfrom->GetId(), false, true);
+            if (state.GetDoS() > 0)
+                Misbehaving(pfrom->GetId(), state.GetDoS());
+            return error("invalid header received");
+        }
+    }
+
+    switch (headerRanges.AddHeaders(pfrom->GetId(), headers, MAX_HEADERS_RESULTS)) {
+    case CHeaderRanges::AddResult::MISMATCH:
         Misbehaving(pfrom->GetId(), 20);
-        return error("invalid message payload for %u", vRecvStreamSz);
-    }    
-    return vRecv.Rewind(GetSizeOfCompactSize(vRecvStreamSz));
+        return error("headers not following their range to its checkpoint, peer=%d", pfrom->id);
+    case CHeaderRanges::AddResult::SHORT:
+        LogPrint("net", "peer=%d lacks the headers of its range\n", pfrom->id);
+        break;
+    case CHeaderRanges::AddResult::OK:
+        break;
+    }
+
+    StitchHeaderRanges();
+    LogPrint("net", "%u headers of a range from peer=%d, %u buffered\n", headers.size(), pfrom->id, headerRanges.BufferedHeaders());
+
+    // once the peer is done with its range, the sync goes on from it unless the next headers are being fetched
+    if (!headerRanges.IsAssigned(pfrom->GetId()) && !headerRanges.IsFetched(pindexBestHeader->nHeight)) {
+        LogPrint("net", "more getheaders (%d) to end to peer=%d after its range\n", pindexBestHeader->nHeight, pfrom->id);
+        pfrom->PushMessage(NetMsgType::GETHEADERS, chainActive.GetLocator(pindexBestHeader), uint256());
+    }
+
+    CheckBlockIndex();
+    return true;
 }
 
 bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv, int64_t nTimeReceived, const std::atomic<bool>& interruptMsgProc)
@@ -7102,6 +9200,49 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
             LOCK(cs_main);
             State(pfrom->GetId())->fCurrentlyConnected = true;
         }
+
+        // Blocks are only relayed compressed between the whitelisted nodes of a same operator
+        if (fCompressRelay && pfrom->fWhitelisted)
+            pfrom->PushMessage(NetMsgType::SENDCMPR);
+        // Blocks are pushed before their full validation only between whitelisted nodes
+        if (fFastBlockRelay && pfrom->fWhitelisted)
+            pfrom->PushMessage(NetMsgType::SENDFASTRELAY);
+    }
+
+
+    else if (strCommand == NetMsgType::SENDCMPR)
+    {
+        if (fCompressRelay && pfrom->fWhitelisted) {
+            LOCK(cs_main);
+            State(pfrom->GetId())->fCompressedBlocks = true;
+        }
+    }
+
+
+    else if (strCommand == NetMsgType::SENDFASTRELAY)
+    {
+        if (fFastBlockRelay && pfrom->fWhitelisted) {
+            LOCK(cs_main);
+            State(pfrom->GetId())->fFastRelay = true;
+        }
+    }
+
+
+    else if (strCommand == NetMsgType::COMPRESSED)
+    {
+        if (!fCompressRelay || !pfrom->fWhitelisted)
+            return true;
+
+        std::string strInnerCommand;
+        CSerializeData vFrame, vPayload;
+        vRecv >> LIMITED_STRING(strInnerCommand, CMessageHeader::COMMAND_SIZE) >> vFrame;
+        if (strInnerCommand != NetMsgType::BLOCK && strInnerCommand != NetMsgType::CMPCTBLOCK)
+            return error("%s: unexpected compressed %s message from peer=%d", __func__, SanitizeString(strInnerCommand), pfrom->id);
+        if (!DecompressData(vFrame.data(), vFrame.data() + vFrame.size(), MAX_BLOCK_SIZE, vPayload))
+            return error("%s: invalid compressed %s message from peer=%d", __func__, strInnerCommand, pfrom->id);
+
+        CDataStream vInner(vPayload.data(), vPayload.data() + vPayload.size(), vRecv.GetType(), vRecv.GetVersion());
+        return ProcessMessage(pfrom, strInnerCommand, vInner, nTimeReceived, interruptMsgProc);
     }
 
 
@@ -7136,7 +9277,7 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
 
         uint64_t num_proc = 0;
         uint64_t num_rate_limit = 0;
-        std::shuffle(vAddr.begin(), vAddr.end(), std::mt19937(std::random_device{}()));
+        std::shuffle(vAddr.begin(), vAddr.end(), GetFastRandomContext());
 
         BOOST_FOREACH(CAddress& addr, vAddr)
         {
@@ -7167,9 +9308,7 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
                     LOCK(connman->cs_vNodes);
                     // Use deterministic randomness to send to the same nodes for 24 hours
                     // at a time so the addrKnowns of the chosen nodes prevent repeats
-                    static uint256 hashSalt;
-                    if (hashSalt.IsNull())
-                        hashSalt = GetRandHash();
+                    static const uint256 hashSalt = GetRandHash();
                     uint64_t hashAddr = addr.GetHash();
                     uint256 hashRand = ArithToUint256(UintToArith256(hashSalt) ^ (hashAddr<<32) ^ ((GetTime()+hashAddr)/(24*60*60)));
                     hashRand = Hash(BEGIN(hashRand), END(hashRand));
@@ -7193,7 +9332,6 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
             if (fReachable)
                 vAddrOk.push_back(addr);
         }
-        CNodeState *nodestate = State(pfrom->GetId());
         pfrom->m_addr_processed += num_proc;
         pfrom->m_addr_rate_limited += num_rate_limit;
         LogPrint("net", "Received addr: %u addresses (%u processed, %u rate-limited) from peer=%d%s\n",
@@ -7238,7 +9376,7 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
                 inv.ToString(), fAlreadyHave ? "have" : "new", pfrom->id, (nInv+1), vInv.size());
 
             if (!fAlreadyHave && !fImporting && !fReindex && !fReindexFast && inv.type != MSG_BLOCK)
-                pfrom->AskFor(inv);
+                AskFor(pfrom, inv);
 
             if (inv.type == MSG_BLOCK) {
                 UpdateBlockAvailability(pfrom->GetId(), inv.hash);
@@ -7270,8 +9408,8 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
                     pfrom->PushMessage(NetMsgType::GETHEADERS, bl, inv.hash);
                     CNodeState *nodestate = State(pfrom->GetId());
                     if (chainActive.Tip()->GetBlockTime() > GetTime() - chainparams.GetConsensus().nPowTargetSpacing * 20 &&
-                        nodestate->nBlocksInFlight < MAX_BLOCKS_IN_TRANSIT_PER_PEER) {
-                        vToFetch.push_back(inv);
+                        nodestate->nBlocksInFlight < GetBlockDownloadWindow(nodestate)) {
+                        vToFetch.push_back(CInv(GetBlockFetchType(pfrom), inv.hash));
                         // Mark block as in flight already, even though the actual "getdata" message only goes out
                         // later (within the same cs_main lock, though).
                         MarkBlockAsInFlight(pfrom->GetId(), inv.hash, chainparams.GetConsensus());
@@ -7301,6 +9439,44 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
             pfrom->PushMessage(NetMsgType::GETDATA, vToFetch);
         }
     }
+    else if (strCommand == NetMsgType::CERTINV)
+    {
+        vector<CCertAnnouncement> vCertAnn;
+        vRecv >> vCertAnn;
+        if (vCertAnn.size() > MAX_INV_SZ)
+        {
+            Misbehaving(pfrom->GetId(), 20);
+            return error("message certinv size() = %u", vCertAnn.size());
+        }
+
+        // only the best certificate of each sidechain epoch in the message is fetched
+        std::map<std::pair<uint256, int32_t>, int64_t> mapBestQuality;
+        for (const CCertAnnouncement& ann : vCertAnn)
+        {
+            auto ret = mapBestQuality.emplace(std::make_pair(ann.scId, ann.epochNumber), ann.quality);
+            if (!ret.second && ret.first->second < ann.quality)
+                ret.first->second = ann.quality;
+        }
+
+        LOCK(cs_main);
+
+        for (const CCertAnnouncement& ann : vCertAnn)
+        {
+            if (interruptMsgProc)
+                return true;
+            const CInv inv(MSG_TX, ann.hash);
+            pfrom->AddInventoryKnown(inv);
+
+            bool fAlreadyHave = AlreadyHave(inv);
+            bool fSuperseded = !fAlreadyHave &&
+                (mapBestQuality[std::make_pair(ann.scId, ann.epochNumber)] > ann.quality || IsCertAnnouncementSuperseded(ann));
+            LogPrint("net", "got certinv: %s epoch=%d quality=%d %s peer=%d\n", ann.hash.ToString(), ann.epochNumber, ann.quality,
+                fAlreadyHave ? "have" : (fSuperseded ? "superseded" : "new"), pfrom->id);
+
+            if (!fAlreadyHave && !fSuperseded && !fImporting && !fReindex && !fReindexFast)
+                AskFor(pfrom, inv);
+        }
+    }
     else if (strCommand == NetMsgType::GETDATA)
     {
         if (!ValidateStreamSize(pfrom, vRecv, NetMsgType::GETDATA))
@@ -7396,20 +9572,30 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
                     pindex = chainActive.Next(pindex);
             }
 
-            // we cannot use CBlockHeaders since it won't include the 0x00 nTx count at the end
-            // we cannot use CBlock, since we added Certificates and its serialization is not backward compatible
-            // We must use CBlockHeaderForNetwork, and ad-hoc class for this task
-            vector<CBlockHeaderForNetwork> vHeaders;
-            int nLimit = MAX_HEADERS_RESULTS;
             LogPrint("net", "getheaders from h(%d) to %s from peer=%d\n", (pindex ? pindex->nHeight : -1), hashStop.ToString(), pfrom->id);
-            for (; pindex; pindex = chainActive.Next(pindex))
+            if (pindex && chainActive.Contains(pindex))
             {
-                vHeaders.push_back(CBlockHeaderForNetwork(pindex->GetBlockHeader()) );
-                if (--nLimit <= 0 || pindex->GetBlockHash() == hashStop)
-                    break;
+                // The headers of the active chain are copied from their cached serialization
+                int nLast = std::min(chainActive.Height(), pindex->nHeight + (int)MAX_HEADERS_RESULTS - 1);
+                BlockMap::iterator miStop = mapBlockIndex.find(hashStop);
+                if (miStop != mapBlockIndex.end() && chainActive.Contains(miStop->second) && miStop->second->nHeight >= pindex->nHeight)
+                    nLast = std::min(nLast, miStop->second->nHeight);
+                CHeadersRange headers(headersCache, chainActive, pindex->nHeight, nLast);
+                LogPrint("forks", "%s():%d - Pushing %d headers to node[%s]\n", __func__, __LINE__, headers.size(), pfrom->addrName);
+                pfrom->PushMessage(NetMsgType::HEADERS, headers);
+            }
+            else
+            {
+                // we cannot use CBlockHeaders since it won't include the 0x00 nTx count at the end
+                // we cannot use CBlock, since we added Certificates and its serialization is not backward compatible
+                // We must use CBlockHeaderForNetwork, and ad-hoc class for this task
+                vector<CBlockHeaderForNetwork> vHeaders;
+                // a block out of the active chain, the hashStop of a null locator, is sent alone
+                if (pindex)
+                    vHeaders.push_back(CBlockHeaderForNetwork(pindex->GetBlockHeader()) );
+                LogPrint("forks", "%s():%d - Pushing %d headers to node[%s]\n", __func__, __LINE__, vHeaders.size(), pfrom->addrName);
+                pfrom->PushMessage(NetMsgType::HEADERS, vHeaders);
             }
-            LogPrint("forks", "%s():%d - Pushing %d headers to node[%s]\n", __func__, __LINE__, vHeaders.size(), pfrom->addrName);
-            pfrom->PushMessage(NetMsgType::HEADERS, vHeaders);
         }
         else
         {
@@ -7562,6 +9748,81 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
     } // end of command getheaders
 
 
+    else if (strCommand == NetMsgType::GETCFILTERS)
+    {
+        uint8_t nFilterType;
+        uint32_t nStartHeight;
+        uint256 hashStop;
+        vRecv >> nFilterType >> nStartHeight >> hashStop;
+
+        const CBlockIndex* pindexStop = NULL;
+        if (!PrepareBlockFilterRequest(pfrom, nFilterType, nStartHeight, hashStop, MAX_GETCFILTERS_SIZE, pindexStop))
+            return true;
+
+        std::vector<CBlockFilter> vFilters;
+        if (!pblockfilterindex->LookupFilterRange(nStartHeight, pindexStop, vFilters))
+        {
+            LogPrint("net", "compact filters up to block %s are not indexed yet, peer=%d\n", hashStop.ToString(), pfrom->id);
+            return true;
+        }
+        for (const CBlockFilter& filter : vFilters)
+            pfrom->PushMessage(NetMsgType::CFILTER, filter);
+    }
+
+
+    else if (strCommand == NetMsgType::GETCFHEADERS)
+    {
+        uint8_t nFilterType;
+        uint32_t nStartHeight;
+        uint256 hashStop;
+        vRecv >> nFilterType >> nStartHeight >> hashStop;
+
+        const CBlockIndex* pindexStop = NULL;
+        if (!PrepareBlockFilterRequest(pfrom, nFilterType, nStartHeight, hashStop, MAX_GETCFHEADERS_SIZE, pindexStop))
+            return true;
+
+        // the header the filter hashes chain from
+        uint256 prevHeader;
+        if (nStartHeight > 0)
+        {
+            const CBlockIndex* pindexPrev = pindexStop->GetAncestor(nStartHeight - 1);
+            if (!pblockfilterindex->LookupFilterHeader(pindexPrev, prevHeader))
+                return true;
+        }
+        std::vector<uint256> vFilterHashes;
+        if (!pblockfilterindex->LookupFilterHashRange(nStartHeight, pindexStop, vFilterHashes))
+        {
+            LogPrint("net", "compact filters up to block %s are not indexed yet, peer=%d\n", hashStop.ToString(), pfrom->id);
+            return true;
+        }
+        pfrom->PushMessage(NetMsgType::CFHEADERS, nFilterType, hashStop, prevHeader, vFilterHashes);
+    }
+
+
+    else if (strCommand == NetMsgType::GETCFCHECKPT)
+    {
+        uint8_t nFilterType;
+        uint256 hashStop;
+        vRecv >> nFilterType >> hashStop;
+
+        const CBlockIndex* pindexStop = NULL;
+        if (!PrepareBlockFilterRequest(pfrom, nFilterType, 0, hashStop, std::numeric_limits<uint32_t>::max(), pindexStop))
+            return true;
+
+        std::vector<uint256> vHeaders(pindexStop->nHeight / CFCHECKPT_INTERVAL);
+        for (size_t i = 0; i < vHeaders.size(); i++)
+        {
+            const CBlockIndex* pindex = pindexStop->GetAncestor((i + 1) * CFCHECKPT_INTERVAL);
+            if (!pblockfilterindex->LookupFilterHeader(pindex, vHeaders[i]))
+            {
+                LogPrint("net", "compact filters up to block %s are not indexed yet, peer=%d\n", hashStop.ToString(), pfrom->id);
+                return true;
+            }
+        }
+        pfrom->PushMessage(NetMsgType::CFCHECKPT, nFilterType, hashStop, vHeaders);
+    }
+
+
     else if (strCommand == NetMsgType::TX)
     {
         int nType = vRecv.nType;
@@ -7600,8 +9861,28 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
             ReadCompactSize(vRecv); // ignore tx count; assume it is 0.
         }
 
+        // The Equihash and PoW checks need no chain state, so they are run for all the unknown
+        // headers in parallel without holding cs_main. Only the insertion into the block index
+        // below is done one header at a time, in order.
+        std::vector<CValidationState> vHeaderStates;
+        std::vector<char> vHeaderChecked;
+        bool fRangeReply = false;
+        {
+            std::vector<char> vKnown(nCount, 0);
+            {
+                LOCK(cs_main);
+                fRangeReply = headerRanges.IsReply(pfrom->GetId(), nCount > 0 ? headers[0].hashPrevBlock : uint256());
+                for (unsigned int n = 0; n < nCount; n++)
+                    vKnown[n] = mapBlockIndex.count(headers[n].GetHash()) != 0;
+            }
+            CheckBlockHeaders(headers, vKnown, vHeaderStates, vHeaderChecked);
+        }
+
         LOCK(cs_main);
 
+        if (fRangeReply)
+            return ProcessHeaderRange(pfrom, headers, vHeaderStates);
+
         if (nCount == 0) {
             // Nothing interesting. Stop asking this peers for more headers.
             return true;
@@ -7609,8 +9890,9 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
 
         CBlockIndex *pindexLast = NULL;
         int cnt = 0;
-        BOOST_FOREACH(const CBlockHeader& header, headers) {
-            CValidationState state;
+        for (unsigned int n = 0; n < nCount; n++) {
+            const CBlockHeader& header = headers[n];
+            CValidationState state = vHeaderStates[n];
             if (pindexLast != NULL && header.hashPrevBlock != pindexLast->GetBlockHash()) {
                 Misbehaving(pfrom->GetId(), 20);
                 LogPrint("forks", "%s():%d - non continuous sequence\n", __func__, __LINE__);
@@ -7619,7 +9901,10 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
 
             bool lookForwardTips = (++cnt == MAX_HEADERS_RESULTS);
 
-            if (!AcceptBlockHeader(header, state, &pindexLast, lookForwardTips))
+            // a header failing the parallel check is rejected exactly as AcceptBlockHeader would have
+            if (!state.IsValid() ||
+                !AcceptBlockHeader(header, state, &pindexLast, lookForwardTips,
+                                   vHeaderChecked[n] ? flagCheckPow::OFF : flagCheckPow::ON))
             {
                 if (state.IsInvalid())
                 {
@@ -7633,10 +9918,23 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
         if (pindexLast)
             UpdateBlockAvailability(pfrom->GetId(), pindexLast->GetBlockHash());
 
+        if (pindexLast && !headerRanges.Empty()) {
+            // the ranges the sync entered are left to it, the headers of those fetched may now connect
+            headerRanges.SyncedTo(pindexLast->nHeight);
+            StitchHeaderRanges();
+        }
+
         if (nCount == MAX_HEADERS_RESULTS && pindexLast) {
             // Headers message had its maximum size; the peer may have more headers.
-            // TODO: optimize: if pindexLast is an ancestor of chainActive.Tip or pindexBestHeader, continue
-            // from there instead.
+            // Continue after the headers already known past pindexLast, as those of the ranges fetched
+            // in parallel, unless a peer is still fetching them.
+            if (pindexBestHeader->nHeight > pindexLast->nHeight && pindexBestHeader->GetAncestor(pindexLast->nHeight) == pindexLast)
+                pindexLast = pindexBestHeader;
+            if (headerRanges.IsFetched(pindexLast->nHeight)) {
+                LogPrint("net", "headers sync (%d) waits for the range fetched in parallel, peer=%d\n", pindexLast->nHeight, pfrom->id);
+                CheckBlockIndex();
+                return true;
+            }
 
             CBlockLocator bl = chainActive.GetLocator(pindexLast);
             std::vector<uint256>::iterator b = bl.vHave.begin();
@@ -7655,12 +9953,18 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
 
     else if (strCommand == NetMsgType::BLOCK && !fImporting && !fReindex && !fReindexFast) // Ignore blocks received while importing
     {
+        unsigned int nBlockBytes = vRecv.size();
         CBlock block;
         vRecv >> block;
 
         CInv inv(MSG_BLOCK, block.GetHash());
         LogPrint("net", "%s():%d - received block %s peer=%d\n", __func__, __LINE__, inv.hash.ToString(), pfrom->id);
 
+        {
+            LOCK(cs_main);
+            RecordBlockDownload(pfrom->GetId(), inv.hash, nBlockBytes);
+        }
+
         pfrom->AddInventoryKnown(inv);
 
         CValidationState state;
@@ -7683,6 +9987,176 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
         }
     }
 
+    else if (strCommand == NetMsgType::CMPCTBLOCK && !fImporting && !fReindex && !fReindexFast) // Ignore blocks received while importing
+    {
+        CBlockHeaderAndShortTxIDs cmpctblock;
+        vRecv >> cmpctblock;
+
+        CBlock block;
+        bool fBlockReconstructed = false;
+        {
+            LOCK(cs_main);
+
+            if (mapBlockIndex.find(cmpctblock.header.hashPrevBlock) == mapBlockIndex.end()) {
+                // The header does not connect to our tree: ask for the missing headers instead of
+                // penalizing the peer, the block will be announced again
+                if (!IsInitialBlockDownload())
+                    pfrom->PushMessage(NetMsgType::GETHEADERS, chainActive.GetLocator(pindexBestHeader), uint256());
+                return true;
+            }
+
+            CBlockIndex *pindex = NULL;
+            CValidationState state;
+            if (!AcceptBlockHeader(cmpctblock.header, state, &pindex)) {
+                if (state.IsInvalid()) {
+                    if (state.GetDoS() > 0)
+                        Misbehaving(pfrom->GetId(), state.GetDoS());
+                    return error("invalid compact block header received from peer=%d", pfrom->id);
+                }
+                return true;
+            }
+            UpdateBlockAvailability(pfrom->GetId(), pindex->GetBlockHash());
+
+            // already have it
+            if (pindex->nStatus & BLOCK_HAVE_DATA)
+                return true;
+
+            // compact blocks are only processed when requested from this very peer, or when fast relayed
+            // by a peer with fast relay for a block extending our tip, then processed as if requested
+            map<uint256, pair<NodeId, list<QueuedBlock>::iterator> >::iterator itInFlight = mapBlocksInFlight.find(pindex->GetBlockHash());
+            if (itInFlight == mapBlocksInFlight.end() && State(pfrom->GetId())->fFastRelay && pindex->pprev == chainActive.Tip()) {
+                LogPrint("cmpctblock", "%s():%d - fast relayed compact block %s from peer=%d\n",
+                    __func__, __LINE__, pindex->GetBlockHash().ToString(), pfrom->id);
+                MarkBlockAsInFlight(pfrom->GetId(), pindex->GetBlockHash(), chainparams.GetConsensus(), pindex);
+                mapFastRelayedBlocks[pindex->GetBlockHash()] = pfrom->GetId();
+                itInFlight = mapBlocksInFlight.find(pindex->GetBlockHash());
+            }
+            if (itInFlight == mapBlocksInFlight.end() || itInFlight->second.first != pfrom->GetId()) {
+                LogPrint("cmpctblock", "%s():%d - ignoring unrequested compact block %s from peer=%d\n",
+                    __func__, __LINE__, pindex->GetBlockHash().ToString(), pfrom->id);
+                return true;
+            }
+
+            std::shared_ptr<PartiallyDownloadedBlock> partialBlock = std::make_shared<PartiallyDownloadedBlock>(mempool.get());
+            ReadStatus status = partialBlock->InitData(cmpctblock);
+            if (status == READ_STATUS_INVALID) {
+                MarkBlockAsReceived(pindex->GetBlockHash());
+                Misbehaving(pfrom->GetId(), 100);
+                return error("invalid compact block received from peer=%d", pfrom->id);
+            } else if (status == READ_STATUS_FAILED) {
+                // short id collisions: the block is still in flight from this peer, get it in full
+                RequestFullBlock(pfrom, pindex->GetBlockHash());
+                return true;
+            }
+
+            BlockTransactionsRequest req;
+            for (size_t i = 0; i < partialBlock->BlockTxCount(); i++) {
+                if (!partialBlock->IsTxAvailable(i))
+                    req.indexes.push_back(i);
+            }
+            if (req.indexes.empty()) {
+                std::vector<CTransaction> vtxDummy;
+                std::vector<CScCertificate> vcertDummy;
+                if (partialBlock->FillBlock(block, vtxDummy, vcertDummy) == READ_STATUS_OK)
+                    fBlockReconstructed = true;
+                else
+                    RequestFullBlock(pfrom, pindex->GetBlockHash());
+            } else {
+                req.blockhash = pindex->GetBlockHash();
+                CNodeState *nodestate = State(pfrom->GetId());
+                nodestate->partialBlock = partialBlock;
+                nodestate->hashPartialBlock = req.blockhash;
+                LogPrint("cmpctblock", "%s():%d - requesting %d missing entries of block %s from peer=%d\n",
+                    __func__, __LINE__, req.indexes.size(), req.blockhash.ToString(), pfrom->id);
+                pfrom->PushMessage(NetMsgType::GETBLOCKTXN, req);
+            }
+        }
+
+        if (fBlockReconstructed)
+            ProcessReconstructedBlock(pfrom, block, strCommand);
+    }
+
+    else if (strCommand == NetMsgType::GETBLOCKTXN)
+    {
+        BlockTransactionsRequest req;
+        vRecv >> req;
+
+        {
+            LOCK(cs_main);
+
+            BlockMap::iterator mi = mapBlockIndex.find(req.blockhash);
+            if (mi == mapBlockIndex.end() || !(mi->second->nStatus & BLOCK_HAVE_DATA)) {
+                LogPrint("net", "%s():%d - peer=%d sent us a getblocktxn for a block we don't have\n",
+                    __func__, __LINE__, pfrom->id);
+                return true;
+            }
+
+            if (mi->second->nHeight >= chainActive.Height() - MAX_BLOCKTXN_DEPTH) {
+                CBlock block;
+                if (!ReadBlockFromDisk(block, mi->second))
+                    assert(!"cannot load block from disk");
+
+                // indexes are strictly increasing, so transactions and certificates come out in block order
+                BlockTransactions resp(req);
+                for (uint32_t index : req.indexes) {
+                    if (index < block.vtx.size()) {
+                        resp.txn.push_back(block.vtx[index]);
+                    } else if (index < block.vtx.size() + block.vcert.size()) {
+                        resp.certs.push_back(block.vcert[index - block.vtx.size()]);
+                    } else {
+                        Misbehaving(pfrom->GetId(), 100);
+                        return error("peer=%d sent us a getblocktxn with out-of-bounds index %u", pfrom->id, index);
+                    }
+                }
+                pfrom->PushMessage(NetMsgType::BLOCKTXN, resp);
+                return true;
+            }
+        }
+
+        // too deep to be worth a partial answer: serve the full block, as for a getdata
+        LogPrint("cmpctblock", "%s():%d - peer=%d asked for transactions of a deep block, sending the full block\n",
+            __func__, __LINE__, pfrom->id);
+        pfrom->vRecvGetData.push_back(CInv(MSG_BLOCK, req.blockhash));
+        ProcessGetData(pfrom, interruptMsgProc);
+    }
+
+    else if (strCommand == NetMsgType::BLOCKTXN && !fImporting && !fReindex && !fReindexFast) // Ignore blocks received while importing
+    {
+        BlockTransactions resp;
+        vRecv >> resp;
+
+        CBlock block;
+        {
+            LOCK(cs_main);
+
+            CNodeState *nodestate = State(pfrom->GetId());
+            map<uint256, pair<NodeId, list<QueuedBlock>::iterator> >::iterator itInFlight = mapBlocksInFlight.find(resp.blockhash);
+            if (itInFlight == mapBlocksInFlight.end() || itInFlight->second.first != pfrom->GetId() ||
+                !nodestate->partialBlock || nodestate->hashPartialBlock != resp.blockhash) {
+                LogPrint("cmpctblock", "%s():%d - peer=%d sent us block transactions for a block we weren't expecting\n",
+                    __func__, __LINE__, pfrom->id);
+                return true;
+            }
+
+            std::shared_ptr<PartiallyDownloadedBlock> partialBlock = nodestate->partialBlock;
+            nodestate->partialBlock.reset();
+            nodestate->hashPartialBlock.SetNull();
+
+            ReadStatus status = partialBlock->FillBlock(block, resp.txn, resp.certs);
+            if (status == READ_STATUS_INVALID) {
+                MarkBlockAsReceived(resp.blockhash);
+                Misbehaving(pfrom->GetId(), 100);
+                return error("invalid blocktxn received from peer=%d", pfrom->id);
+            } else if (status == READ_STATUS_FAILED) {
+                // the mempool filled some position with the wrong entry
+                RequestFullBlock(pfrom, resp.blockhash);
+                return true;
+            }
+        }
+
+        ProcessReconstructedBlock(pfrom, block, strCommand);
+    }
+
 
     // This asymmetric behavior for inbound and outbound connections was introduced
     // to prevent a fingerprinting attack: an attacker can send specific fake addresses
@@ -7699,7 +10173,10 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
         }
         pfrom->fSentAddr = true;
 
-        pfrom->vAddrToSend.clear();
+        {
+            LOCK(pfrom->cs_vAddrToSend);
+            pfrom->vAddrToSend.clear();
+        }
         vector<CAddress> vAddr = addrman.GetAddr();
         BOOST_FOREACH(const CAddress &addr, vAddr)
             pfrom->PushAddress(addr);
@@ -7754,7 +10231,7 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
                     if (pingUsecTime > 0) {
                         // Successful ping time measurement, replace previous
                         pfrom->nPingUsecTime = pingUsecTime;
-                        pfrom->nMinPingUsecTime = std::min(pfrom->nMinPingUsecTime, pingUsecTime);
+                        pfrom->nMinPingUsecTime = std::min(pfrom->nMinPingUsecTime.load(), pingUsecTime);
                     } else {
                         // This should never happen
                         sProblem = "Timing mishap";
@@ -7782,7 +10259,7 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
                 pfrom->id,
                 pfrom->cleanSubVer,
                 sProblem,
-                pfrom->nPingNonceSent,
+                pfrom->nPingNonceSent.load(),
                 nonce,
                 nAvail);
         }
@@ -7901,6 +10378,12 @@ bool ProcessMessages(CNode* pfrom, const std::atomic<bool>& interruptMsgProc)
     // this maintains the order of responses
     if (!pfrom->vRecvGetData.empty()) return fOk;
 
+    if (orphanPool.HaveAnyWork())
+    {
+        LOCK2(cs_msgProcSerial, cs_main);
+        ProcessOrphanWork(pfrom);
+    }
+
     std::deque<CNetMessage>::iterator it = pfrom->vRecvMsg.begin();
     while (!pfrom->fDisconnect && it != pfrom->vRecvMsg.end()) {
         // Don't bother if send buffer is too full to respond anyway
@@ -7927,6 +10410,9 @@ bool ProcessMessages(CNode* pfrom, const std::atomic<bool>& interruptMsgProc)
         bool fRet = false;
         try
         {
+            std::optional<CCriticalBlock> lockSerial;
+            if (!setConcurrentMessages.count(strCommand))
+                lockSerial.emplace(cs_msgProcSerial, "cs_msgProcSerial", __FILE__, __LINE__);
             fRet = ProcessMessage(pfrom, strCommand, msg.vRecv, msg.nTime, interruptMsgProc);
             if (interruptMsgProc)
                 return true;
@@ -8019,7 +10505,10 @@ bool SendMessages(CNode* pto, bool fSendTrickle, const std::atomic<bool>& interr
             {
                 // Periodically clear addrKnown to allow refresh broadcasts
                 if (nLastRebroadcast)
+                {
+                    LOCK(pnode->cs_vAddrToSend);
                     pnode->addrKnown.reset();
+                }
 
                 // Rebroadcast our address
                 AdvertizeLocal(pnode);
@@ -8033,6 +10522,7 @@ bool SendMessages(CNode* pto, bool fSendTrickle, const std::atomic<bool>& interr
         //
         if (fSendTrickle)
         {
+            LOCK(pto->cs_vAddrToSend);
             vector<CAddress> vAddr;
             vAddr.reserve(pto->vAddrToSend.size());
             BOOST_FOREACH(const CAddress& addr, pto->vAddrToSend)
@@ -8114,6 +10604,23 @@ bool SendMessages(CNode* pto, bool fSendTrickle, const std::atomic<bool>& interr
             }
         }
 
+        // Fetch the headers between the checkpoints ahead from several peers at once
+        if (nParallelHeaders > 0 && !pto->fClient && !fImporting && !fReindex && !fReindexFast) {
+            if (!headerRanges.IsInitialized())
+                headerRanges.Init(fCheckpointsEnabled ? Params().Checkpoints().mapCheckpoints : Checkpoints::MapCheckpoints(),
+                                  pindexBestHeader->nHeight);
+            if (headerRanges.IsTimedOut(pto->GetId(), GetTime())) {
+                LogPrint("net", "peer=%d did not send the headers of its range in time\n", pto->id);
+                headerRanges.Release(pto->GetId(), false, true);
+            }
+            uint256 hashFrom, hashStop;
+            if (headerRanges.Assign(pto->GetId(), pto->nStartingHeight, nParallelHeaders) &&
+                headerRanges.NextRequest(pto->GetId(), GetTime(), hashFrom, hashStop)) {
+                LogPrint("net", "getheaders of a range from %s to %s to peer=%d\n", hashFrom.ToString(), hashStop.ToString(), pto->id);
+                pto->PushMessage(NetMsgType::GETHEADERS, CBlockLocator(std::vector<uint256>(1, hashFrom)), hashStop);
+            }
+        }
+
         // Resend wallet transactions that haven't gotten in a block yet
         // Except during reindex, importing and IBD, when old wallet
         // transactions become unconfirmed and spams other nodes.
@@ -8125,57 +10632,93 @@ bool SendMessages(CNode* pto, bool fSendTrickle, const std::atomic<bool>& interr
         //
         // Message: inventory
         //
+        int64_t nNow = GetTimeMicros();
         vector<CInv> vInv;
-        vector<CInv> vInvWait;
+        vector<uint256> vTxToSend;
         {
             LOCK(pto->cs_inventory);
+            // blocks are announced right away
             vInv.reserve(pto->vInventoryToSend.size());
-            vInvWait.reserve(pto->vInventoryToSend.size());
-            BOOST_FOREACH(const CInv& inv, pto->vInventoryToSend)
+            for (const CInv& inv : pto->vInventoryToSend)
             {
-                if (pto->setInventoryKnown.count(inv))
+                if (pto->filterInventoryKnown.contains(inv.hash))
                     continue;
-
-                // trickle out tx inv to protect privacy
-                if (inv.type == MSG_TX && !fSendTrickle)
+                pto->filterInventoryKnown.insert(inv.hash);
+                vInv.push_back(inv);
+                if (vInv.size() >= 1000)
                 {
-                    // 1/4 of tx invs blast to all immediately
-                    static uint256 hashSalt;
-                    if (hashSalt.IsNull())
-                        hashSalt = GetRandHash();
-                    uint256 hashRand = ArithToUint256(UintToArith256(inv.hash) ^ UintToArith256(hashSalt));
-                    hashRand = Hash(BEGIN(hashRand), END(hashRand));
-                    bool fTrickleWait = ((UintToArith256(hashRand) & 3) != 0);
+                    LogPrint("forks", "%s():%d - Pushing inv\n", __func__, __LINE__);
+                    pto->PushMessage(NetMsgType::INV, vInv);
+                    vInv.clear();
+                }
+            }
+            pto->vInventoryToSend.clear();
 
-                    if (fTrickleWait)
+            // trickle out tx inv at random intervals to protect privacy, whitelisted peers get them at once
+            if (pto->fWhitelisted || pto->nNextInvSend < nNow)
+            {
+                if (!pto->fWhitelisted)
+                    pto->nNextInvSend = PoissonNextSend(nNow, pto->fInbound ? INVENTORY_BROADCAST_INTERVAL : INVENTORY_BROADCAST_INTERVAL / 2);
+                vTxToSend.reserve(pto->setInventoryTxToSend.size());
+                for (std::set<uint256>::iterator it = pto->setInventoryTxToSend.begin(); it != pto->setInventoryTxToSend.end(); )
+                {
+                    if (pto->filterInventoryKnown.contains(*it))
                     {
-                        vInvWait.push_back(inv);
+                        it = pto->setInventoryTxToSend.erase(it);
                         continue;
                     }
+                    vTxToSend.push_back(*it);
+                    ++it;
                 }
+            }
+        }
 
-                // returns true if wasn't already contained in the set
-                if (pto->setInventoryKnown.insert(inv).second)
+        vector<CCertAnnouncement> vCertAnn;
+        if (!vTxToSend.empty())
+        {
+            // the mempool lock is not taken under cs_inventory, which Relay takes under cs_vNodes
+            mempool->sortForRelay(vTxToSend);
+            if (vTxToSend.size() > INVENTORY_BROADCAST_MAX)
+                vTxToSend.resize(INVENTORY_BROADCAST_MAX);
+
+            // the certificates go in a certinv to the peers understanding it
+            std::map<uint256, CCertAnnouncement> mapCertAnn;
+            if ((connman->GetLocalServices() & NODE_CERT_ANNOUNCE) && (pto->nServices & NODE_CERT_ANNOUNCE))
+            {
+                LOCK(mempool->cs);
+                for (const uint256& hash : vTxToSend)
                 {
-                    vInv.push_back(inv);
-                    if (vInv.size() >= 1000)
-                    {
-                        LogPrint("forks", "%s():%d - Pushing inv\n", __func__, __LINE__);
-                        pto->PushMessage(NetMsgType::INV, vInv);
-                        vInv.clear();
-                    }
+                    auto it = mempool->mapCertificate.find(hash);
+                    if (it == mempool->mapCertificate.end())
+                        continue;
+                    const CScCertificate& cert = it->second.GetCertificate();
+                    mapCertAnn.emplace(hash, CCertAnnouncement(hash, cert.GetScId(), cert.epochNumber, cert.quality));
                 }
             }
-            pto->vInventoryToSend = vInvWait;
+
+            LOCK(pto->cs_inventory);
+            for (const uint256& hash : vTxToSend)
+            {
+                // the peer may have sent it to us in the meantime
+                if (pto->setInventoryTxToSend.erase(hash) == 0 || pto->filterInventoryKnown.contains(hash))
+                    continue;
+                pto->filterInventoryKnown.insert(hash);
+                auto it = mapCertAnn.find(hash);
+                if (it != mapCertAnn.end())
+                    vCertAnn.push_back(it->second);
+                else
+                    vInv.push_back(CInv(MSG_TX, hash));
+            }
         }
         if (!vInv.empty())
         {
             LogPrint("forks", "%s():%d - Pushing inv\n", __func__, __LINE__);
             pto->PushMessage(NetMsgType::INV, vInv);
         }
+        if (!vCertAnn.empty())
+            pto->PushMessage(NetMsgType::CERTINV, vCertAnn);
 
         // Detect whether we're stalling
-        int64_t nNow = GetTimeMicros();
         if (!pto->fDisconnect && state.nStallingSince && state.nStallingSince < nNow - 1000000 * BLOCK_STALLING_TIMEOUT) {
             // Stalling only triggers when the block download window cannot move. During normal steady state,
             // the download window should be much larger than the to-be-downloaded set of blocks, so disconnection
@@ -8210,16 +10753,35 @@ bool SendMessages(CNode* pto, bool fSendTrickle, const std::atomic<bool>& interr
         // Message: getdata (blocks)
         //
         vector<CInv> vGetData;
-        if (!pto->fDisconnect && !pto->fClient && (fFetch || !IsInitialBlockDownload()) && state.nBlocksInFlight < MAX_BLOCKS_IN_TRANSIT_PER_PEER) {
+        int nBlockWindow = GetBlockDownloadWindow(&state);
+        if (!pto->fDisconnect && !pto->fClient && (fFetch || !IsInitialBlockDownload()) && state.nBlocksInFlight < nBlockWindow) {
             vector<CBlockIndex*> vToDownload;
             NodeId staller = -1;
-            FindNextBlocksToDownload(pto->GetId(), MAX_BLOCKS_IN_TRANSIT_PER_PEER - state.nBlocksInFlight, vToDownload, staller);
+            CBlockIndex *pindexStalled = NULL;
+            FindNextBlocksToDownload(pto->GetId(), nBlockWindow - state.nBlocksInFlight, vToDownload, staller, &pindexStalled);
             BOOST_FOREACH(CBlockIndex *pindex, vToDownload) {
-                vGetData.push_back(CInv(MSG_BLOCK, pindex->GetBlockHash()));
+                // only the block extending our tip is likely to be rebuilt from the mempool
+                int nFetchType = (pindex->pprev == chainActive.Tip()) ? GetBlockFetchType(pto) : MSG_BLOCK;
+                vGetData.push_back(CInv(nFetchType, pindex->GetBlockHash()));
                 MarkBlockAsInFlight(pto->GetId(), pindex->GetBlockHash(), consensusParams, pindex);
                 LogPrint("net", "%s():%d Requesting block %s (%d) peer=%d\n",
                     __func__, __LINE__, pindex->GetBlockHash().ToString(), pindex->nHeight, pto->id);
             }
+            // The window is held back by a block in flight from another peer: if this peer is measurably
+            // faster, and the other one has had the block for longer than this one would need, move the
+            // request here instead of waiting for the stall timeout.
+            if (staller != -1 && pindexStalled != NULL && state.nBlocksDownloaded >= MIN_BLOCK_DOWNLOAD_SAMPLES) {
+                map<uint256, pair<NodeId, list<QueuedBlock>::iterator> >::iterator itInFlight = mapBlocksInFlight.find(pindexStalled->GetBlockHash());
+                if (itInFlight != mapBlocksInFlight.end() && itInFlight->second.first == staller &&
+                    state.dBlockBytesPerSec > BLOCK_REREQUEST_SPEEDUP * State(staller)->dBlockBytesPerSec &&
+                    nNow - itInFlight->second.second->nTime > state.nBlockLatency) {
+                    LogPrint("net", "%s():%d Requesting stalled block %s (%d) from peer=%d instead of peer=%d\n",
+                        __func__, __LINE__, pindexStalled->GetBlockHash().ToString(), pindexStalled->nHeight, pto->id, staller);
+                    vGetData.push_back(CInv(MSG_BLOCK, pindexStalled->GetBlockHash()));
+                    MarkBlockAsInFlight(pto->GetId(), pindexStalled->GetBlockHash(), consensusParams, pindexStalled);
+                    staller = -1;
+                }
+            }
             if (state.nBlocksInFlight == 0 && staller != -1) {
                 if (State(staller)->nStallingSince == 0) {
                     State(staller)->nStallingSince = nNow;
@@ -8231,24 +10793,25 @@ bool SendMessages(CNode* pto, bool fSendTrickle, const std::atomic<bool>& interr
         //
         // Message: getdata (non-blocks)
         //
-        while (!pto->fDisconnect && !pto->mapAskFor.empty() && (*pto->mapAskFor.begin()).first <= nNow)
+        if (!pto->fDisconnect)
         {
-            const CInv& inv = (*pto->mapAskFor.begin()).second;
-            if (!AlreadyHave(inv) && connman->mapAlreadyReceived.find(inv) == connman->mapAlreadyReceived.end())
+            for (const CInv& inv : txRequestTracker.GetRequestable(pto->GetId(), nNow))
             {
-                if (fDebug)
-                    LogPrint("net", "%s():%d - Requesting %s peer=%d\n", __func__, __LINE__, inv.ToString(), pto->id);
-                vGetData.push_back(inv);
-                if (vGetData.size() >= 1000)
+                if (!AlreadyHave(inv) && connman->mapAlreadyReceived.find(inv) == connman->mapAlreadyReceived.end())
                 {
-                    pto->PushMessage(NetMsgType::GETDATA, vGetData);
-                    vGetData.clear();
+                    if (fDebug)
+                        LogPrint("net", "%s():%d - Requesting %s peer=%d\n", __func__, __LINE__, inv.ToString(), pto->id);
+                    vGetData.push_back(inv);
+                    if (vGetData.size() >= 1000)
+                    {
+                        pto->PushMessage(NetMsgType::GETDATA, vGetData);
+                        vGetData.clear();
+                    }
+                } else {
+                    // If we're not going to ask, no peer is to be asked
+                    txRequestTracker.Forget(inv);
                 }
-            } else {
-                //If we're not going to ask, don't expect a response.
-                pto->setAskFor.erase(inv.hash);
             }
-            pto->mapAskFor.erase(pto->mapAskFor.begin());
         }
         if (!vGetData.empty())
             pto->PushMessage(NetMsgType::GETDATA, vGetData);
@@ -8271,12 +10834,12 @@ public:
         // block headers
         BlockMap::iterator it1 = mapBlockIndex.begin();
         for (; it1 != mapBlockIndex.end(); it1++)
-            delete (*it1).second;
+            blockIndexArena.Delete((*it1).second);
         mapBlockIndex.clear();
+        blockIndexArena.Clear();
 
         // orphan transactions
-        mapOrphanTransactions.clear();
-        mapOrphanTransactionsByPrev.clear();
+        orphanPool.Clear();
     }
 } instance_of_cmaincleanup;
 
@@ -17,6 +17,8 @@
 #include "chain.h"
 #include "chainparams.h"
 #include "net.h"
+#include "saltedhasher.h"
+#include "script/interpreter.h"
 #include "script/script.h"
 #include "sync.h"
 #include "tinyformat.h"
@@ -26,6 +28,7 @@
 #include <algorithm>
 #include <exception>
 #include <map>
+#include <memory>
 #include <set>
 #include <stdint.h>
 #include <string>
@@ -41,6 +44,7 @@ class CCoinsView;
 class CBlock;
 class CBlockLocator;
 class CBlockTreeDB;
+class CCoinsViewBackgroundFlush;
 class CScriptCheck;
 class CValidationState;
 class CTxUndo;
@@ -104,12 +108,53 @@ static const unsigned int MAX_BLOCKFILE_SIZE = 0x8000000; // 128 MiB
 static const unsigned int BLOCKFILE_CHUNK_SIZE = 0x1000000; // 16 MiB
 /** The pre-allocation chunk size for rev?????.dat files (since 0.8) */
 static const unsigned int UNDOFILE_CHUNK_SIZE = 0x100000; // 1 MiB
+/** The number of blk?????.dat files kept open for the txindex lookups */
+static const size_t MAX_BLOCK_FILE_READ_HANDLES = 16;
+/** The number of threads reading the block files of a batch of txindex lookups */
+static const size_t MAX_TXINDEX_READ_THREADS = 4;
 /** Maximum number of script-checking threads allowed */
-static const int MAX_SCRIPTCHECK_THREADS = 16;
+static const int MAX_SCRIPTCHECK_THREADS = 32;
 /** -par default (number of script-checking threads, 0 = auto) */
 static const int DEFAULT_SCRIPTCHECK_THREADS = 0;
-/** Number of blocks that can be requested at any given time from a single peer. */
+/** The fewest transactions, or certificates, of a block checked by each thread of CheckBlock */
+static const size_t BLOCK_CHECK_PARALLEL_MIN_ITEMS = 64;
+/** The transactions, or certificates, a thread of CheckBlock takes at a time */
+static const size_t BLOCK_CHECK_PARALLEL_CHUNK_SIZE = 16;
+/** -backgroundcoinsflush default (write the coins db on a background thread on periodic and cache size flushes) */
+static const bool DEFAULT_BACKGROUND_COINS_FLUSH = true;
+/** Number of blocks checked by each thread in a VerifyDB window */
+static const unsigned int VERIFYDB_BLOCKS_PER_THREAD = 4;
+/** Number of blocks read ahead, with their undo data, while the blocks of a reorg are disconnected */
+static const unsigned int DISCONNECT_PREFETCH_BLOCKS = 16;
+/** The disconnected blocks whose transactions are resurrected to the mempool after a reorg are at most this large */
+static const size_t MAX_DISCONNECTED_BLOCKS_BYTES = 20 * 1024 * 1024;
+/** Number of blocks checked by each thread in a window of blocks imported from a file */
+static const unsigned int LOADBLOCKS_BLOCKS_PER_THREAD = 8;
+/** A window of blocks imported from a file is closed once its blocks are this large */
+static const size_t LOADBLOCKS_WINDOW_BYTES = 32 * 1024 * 1024;
+/** Number of windows of blocks imported from a file that may be read ahead of the one being processed */
+static const unsigned int LOADBLOCKS_MAX_PENDING_WINDOWS = 2;
+/** -coinsprefetchthreads default (number of threads reading the coins db ahead of ConnectBlock, 0 = disabled) */
+static const int DEFAULT_COINS_PREFETCH_THREADS = 4;
+/** Maximum number of coins prefetch threads allowed */
+static const int MAX_COINS_PREFETCH_THREADS = 16;
+/** -checkblockindexfull default (with -checkblockindex, the whole block index is checked once every that many checks) */
+static const unsigned int DEFAULT_CHECKBLOCKINDEX_FULL_INTERVAL = 100;
+/** -sccachesize default, in MiB (the budget of the sidechains in the coins cache, besides -dbcache) */
+static const int64_t DEFAULT_SC_CACHE_SIZE = 64;
+/** Minimum number of inputs of a tx/cert entering the mempool for its script checks to be run on the script-checking threads */
+static const unsigned int MIN_INPUTS_FOR_PARALLEL_MEMPOOL_CHECKS = 4;
+/** Number of blocks that can be requested at any given time from a single peer, until its throughput is measured. */
 static const int MAX_BLOCKS_IN_TRANSIT_PER_PEER = 16;
+/** Bounds of the per-peer window of blocks in transit, once it is scaled on the measured throughput. */
+static const int MIN_BLOCKS_IN_TRANSIT_PER_PEER = 2;
+static const int MAX_BLOCKS_IN_TRANSIT_PER_FAST_PEER = 64;
+/** Seconds of download, at the measured throughput of a peer, to keep in transit from it. */
+static const unsigned int BLOCK_DOWNLOAD_TARGET_SECONDS = 4;
+/** Number of blocks received from a peer before its window is scaled on its throughput. */
+static const int MIN_BLOCK_DOWNLOAD_SAMPLES = 4;
+/** A block holding back the download window is requested again from a peer at least this many times faster. */
+static const int BLOCK_REREQUEST_SPEEDUP = 2;
 /** Timeout in seconds during which a peer must stall block download progress before being disconnected. */
 static const unsigned int BLOCK_STALLING_TIMEOUT = 2;
 /** Number of headers sent in one getheaders result. We rely on the assumption that if a peer sends
@@ -152,14 +197,17 @@ BOOST_STATIC_ASSERT(DEFAULT_BLOCK_PRIORITY_SIZE_BEFORE_SC <= DEFAULT_BLOCK_MAX_S
 extern CScript COINBASE_FLAGS;
 extern CCriticalSection cs_main;
 extern std::unique_ptr<CTxMemPool> mempool;
-typedef boost::unordered_map<uint256, CBlockIndex*, ObjectHasher> BlockMap;
+typedef boost::unordered_map<uint256, CBlockIndex*, CSaltedUint256Hasher> BlockMap;
 extern BlockMap mapBlockIndex;
-typedef boost::unordered_map<uint256, int, ObjectHasher> ScCumTreeRootMap;
+typedef boost::unordered_map<uint256, int, CSaltedUint256Hasher> ScCumTreeRootMap;
 extern ScCumTreeRootMap mapCumtreeHeight;
 extern uint64_t nLastBlockTx;
 extern uint64_t nLastBlockCert;
 extern uint64_t nLastBlockSize;
 extern uint64_t nLastBlockTxPartitionSize;
+//! The fees and the time in microseconds of the last block template created
+extern CAmount nLastBlockFees;
+extern int64_t nLastBlockTemplateTime;
 extern const std::string strMessageMagic;
 extern CWaitableCriticalSection csBestBlock;
 extern CConditionVariable cvBlockChange;
@@ -168,6 +216,8 @@ extern bool fImporting;
 extern std::atomic<bool> fReindex;
 extern std::atomic<bool> fReindexFast;
 extern int nScriptCheckThreads;
+//! -parallelheaders: the peers fetching the headers between the checkpoints at once, 0 for none
+extern int nParallelHeaders;
 
 extern bool fAddressIndex;
 extern bool fTimestampIndex;
@@ -176,9 +226,15 @@ extern bool fTxIndex;
 extern bool fMaturityHeightIndex;
 extern bool fIsBareMultisigStd;
 extern bool fCheckBlockIndex;
+extern unsigned int nCheckBlockIndexFullInterval;
 extern bool fCheckpointsEnabled;
+/** The block whose ancestors are assumed to have valid scripts and proofs, null if none (-assumevalid) */
+extern uint256 hashAssumeValid;
+/** How deep under the best header the block assumed valid must be, in seconds of equivalent work */
+static const int64_t ASSUME_VALID_MIN_BURIED_TIME = 60 * 60 * 24 * 7 * 2;
 extern bool fRegtestAllowDustOutput;
 extern size_t nCoinCacheUsage;
+extern size_t nScCacheUsage;
 extern CFeeRate minRelayTxFee;
 
 extern std::unique_ptr<CConnman> connman;
@@ -199,6 +255,7 @@ struct CompareBlocksByHeight
 };
 
 typedef std::map<const CBlockIndex*, int, CompareBlocksByHeight> BlockTimeMap;
+/** The blocks of mapBlockIndex with no children, each with the time it was last extended or touched at */
 extern BlockTimeMap mGlobalForkTips;
 
 typedef std::set<const CBlockIndex*, CompareBlocksByHeight> BlockSet;
@@ -214,8 +271,12 @@ static const uint64_t nMinDiskSpace = 52428800;
 /** Pruning-related variables and constants */
 /** True if any block files have ever been pruned. */
 extern bool fHavePruned;
+/** True if the chainstate was imported from a txoutset snapshot, hence no block data is on disk below its base. */
+extern bool fTxOutSetSnapshot;
 /** True if we're running in -prune mode. */
 extern bool fPruneMode;
+/** True if the pruned block files are moved to the -blocksarchivedir directory instead of being deleted. */
+extern bool fPruneToArchive;
 /** Number of MiB of block files that we're trying to stay below. */
 extern uint64_t nPruneTarget;
 /** Block files containing a block-height within MIN_BLOCKS_TO_KEEP of chainActive.Tip() will not be pruned. */
@@ -246,9 +307,10 @@ void UnregisterNodeSignals(CNodeSignals& nodeSignals);
  * @param[in]   pblock  The block we want to process.
  * @param[in]   fForceProcessing Process this block even if unrequested; used for non-network block sources and whitelisted peers.
  * @param[out]  dbp     If pblock is stored to disk (or already there), this will be set to its location.
+ * @param[in]   fChecked CheckBlock already passed for pblock, e.g. on the block import checking threads.
  * @return True if state.IsValid()
  */
-bool ProcessNewBlock(CValidationState &state, CNode* pfrom, CBlock* pblock, bool fForceProcessing, CDiskBlockPos *dbp);
+bool ProcessNewBlock(CValidationState &state, CNode* pfrom, CBlock* pblock, bool fForceProcessing, CDiskBlockPos *dbp, bool fChecked = false);
 /** Check whether enough disk space is available for an incoming block */
 bool CheckDiskSpace(uint64_t nAdditionalBytes = 0);
 /** Open a block file (blk?????.dat) */
@@ -301,6 +363,8 @@ bool ProcessMessages(CNode* pfrom, const std::atomic<bool>& interruptMsgProc);
 bool SendMessages(CNode* pto, bool fSendTrickle, const std::atomic<bool>& interruptMsgProc);
 /** Run an instance of the script checking thread */
 void ThreadScriptCheck();
+/** Run an instance of the JoinSplit proof checking thread */
+void ThreadJoinSplitCheck();
 /** Try to detect Partition (network isolation) attacks against us */
 void PartitionCheck(bool (*initialDownloadCheck)(), CCriticalSection& cs, const CBlockIndex *const &bestHeader, int64_t nPowTargetSpacing);
 /** Check whether we are doing an initial block download (synchronizing from disk or network) */
@@ -313,6 +377,13 @@ bool GetTransaction(const uint256 &hash, CTransaction &tx, uint256 &hashBlock, b
 bool GetCertificate(const uint256 &hash, CScCertificate &cert, uint256 &hashBlock, bool fAllowSlow = false);
 /** Retrieve a base obj (from memory pool, or from disk, if possible) */
 bool GetTxBaseObj(const uint256 &hash, std::unique_ptr<CTransactionBase>& pTxBase, uint256 &hashBlock, bool fAllowSlow = false);
+/**
+ * Look up several transactions or certificates at once, as GetTxBaseObj does. The confirmed ones are
+ * read in the order of their txindex positions, each block file from start to end by one thread, so
+ * that the disk is read sequentially. vTxBase[i] is null for the vHash[i] not found.
+ */
+void GetTxBaseObjs(const std::vector<uint256>& vHash, std::vector<std::unique_ptr<CTransactionBase>>& vTxBase,
+                   std::vector<uint256>& vHashBlock, bool fAllowSlow = false);
 
 static bool DUMMY_FALSE_VALUE = false;
 /** Find the best known block, and make it the tip of the block chain */
@@ -324,6 +395,16 @@ CBlockIndex* AddToBlockIndex(const CBlockHeader& block);
 bool addToGlobalForkTips(const CBlockIndex* pindex);
 int getMostRecentGlobalForkTips(std::vector<uint256>& output);
 bool updateGlobalForkTips(const CBlockIndex* pindex, bool lookForwardTips);
+/** Blocks to mine on forkTip for it to overtake a block of the active chain above its fork base */
+int64_t ForkTipOvertakeGap(const CBlockIndex* forkTip, int nChainHeight);
+/** Blocks to mine from below a block of the active chain at nTargetHeight for a fork to overtake it */
+int64_t MainChainOvertakeGap(int nTargetHeight, int nChainHeight);
+/**
+ * The minimum number of consecutive blocks a miner would have to mine from now to revert pindex,
+ * over the active tip and the global fork tips. pindex must be on the active chain and younger than
+ * MAX_BLOCK_AGE_FOR_FINALITY. Answered from a table maintained as the tips change. Requires cs_main.
+ */
+int64_t GetBlockFinalityIndex(const CBlockIndex* pindex);
 bool getHeadersIsOnMain(const CBlockLocator& locator, const uint256& hashStop, CBlockIndex** pindexReference);
 
 int getCheckBlockAtHeightSafeDepth();
@@ -356,6 +437,16 @@ void FindFilesToPrune(std::set<int>& setFilesToPrune);
  */
 void UnlinkPrunedFiles(std::set<int>& setFilesToPrune);
 
+/**
+ *  Move the specified files to the blocks archive directory, where their blocks keep being read from
+ */
+void ArchivePrunedFiles(std::set<int>& setFilesToPrune);
+
+/**
+ *  Select the directory pruned block files are archived to, and find the ones already archived there
+ */
+bool InitBlocksArchive(const boost::filesystem::path& path);
+
 /** Create a new block index entry for a given block hash */
 CBlockIndex * InsertBlockIndex(uint256 hash);
 /** Get statistics from node state */
@@ -373,6 +464,8 @@ void alertNotify(const std::string& strMessage, bool fThread);
 // Accept Tx/Cert ToMempool parameters types and signature
 enum class LimitFreeFlag       { ON, OFF };
 enum class RejectAbsurdFeeFlag { ON, OFF };
+/** ON for the entries of a block being disconnected, whose proofs and consensus scripts were checked when the block was connected */
+enum class ResurrectionFlag    { ON, OFF };
 enum class MempoolReturnValue  { INVALID, MISSING_INPUT, MEMPOOL_FULL, VALID, PARTIALLY_VALIDATED };
 
 /**
@@ -402,24 +495,56 @@ void RejectMemoryPoolTxBase(const CValidationState& state, const CTransactionBas
 MempoolReturnValue AcceptTxBaseToMemoryPool(CTxMemPool& pool, CValidationState &state, const CTransactionBase &txBase,
     LimitFreeFlag fLimitFree, RejectAbsurdFeeFlag fRejectAbsurdFee, MempoolProofVerificationFlag fProofVerification, CNode* pfrom = nullptr);
 
+/** nAcceptTime is the local time the entry entered the mempool at, 0 for now, as for the entries of a mempool reloaded at startup */
 MempoolReturnValue AcceptTxToMemoryPool(CTxMemPool& pool, CValidationState &state, const CTransaction &tx,
-    LimitFreeFlag fLimitFree, RejectAbsurdFeeFlag fRejectAbsurdFee, MempoolProofVerificationFlag fProofVerification, CNode* pfrom = nullptr);
+    LimitFreeFlag fLimitFree, RejectAbsurdFeeFlag fRejectAbsurdFee, MempoolProofVerificationFlag fProofVerification, CNode* pfrom = nullptr,
+    ResurrectionFlag fResurrection = ResurrectionFlag::OFF, int64_t nAcceptTime = 0);
 
 MempoolReturnValue AcceptCertificateToMemoryPool(CTxMemPool& pool, CValidationState &state, const CScCertificate &cert,
-    LimitFreeFlag fLimitFree, RejectAbsurdFeeFlag fRejectAbsurdFee, MempoolProofVerificationFlag fProofVerification, CNode* pfrom = nullptr);
+    LimitFreeFlag fLimitFree, RejectAbsurdFeeFlag fRejectAbsurdFee, MempoolProofVerificationFlag fProofVerification, CNode* pfrom = nullptr,
+    ResurrectionFlag fResurrection = ResurrectionFlag::OFF, int64_t nAcceptTime = 0);
 
 struct CNodeStateStats {
     int nMisbehavior;
     int nSyncHeight;
     int nCommonHeight;
     std::vector<int> vHeightInFlight;
+    double dBlockBytesPerSec;
+    int64_t nBlockLatency;
+    int nBlockWindow;
+};
+
+/** The stats of a connected peer, from its CNode and, while it has one, from its CNodeState */
+struct CPeerStats {
+    CNodeStats stats;
+    bool fStateStats = false;
+    CNodeStateStats statestats;
 };
 
-struct COrphanTx {
-    std::shared_ptr<const CTransactionBase> tx;
-    NodeId fromPeer;
+/** How often, in seconds, the stats of the peers are published for getpeerinfo */
+static const int64_t PEER_STATS_INTERVAL = 1;
+
+/** The stats of all the connected peers, immutable once published */
+struct CPeerStatsSnapshot {
+    int64_t nTime;
+    //! CConnman::GetNodesGeneration() as of the snapshot
+    uint64_t nNodesGeneration;
+    std::vector<CPeerStats> vPeers;
 };
 
+/**
+ * Take and publish the stats of the connected peers. The node stats are copied without cs_vNodes
+ * held but to reference the nodes; unless fWaitForState, cs_main is not waited for and the state
+ * stats of the previous snapshot are kept if it is busy.
+ */
+std::shared_ptr<const CPeerStatsSnapshot> PublishPeerStats(bool fWaitForState);
+/**
+ * The last published stats of the peers, read without any lock, at most PEER_STATS_INTERVAL seconds
+ * old. They are taken again first if a node was added or removed since, so that the listed peers are
+ * always the connected ones.
+ */
+std::shared_ptr<const CPeerStatsSnapshot> GetPeerStatsSnapshot();
+
 CAmount GetMinRelayFee(CTxMemPool& pool, const CTransactionBase& tx, unsigned int nBytes, bool fAllowFree, unsigned int block_priority_size);
 
 /**
@@ -464,11 +589,28 @@ unsigned int GetP2SHSigOpCount(const CTransactionBase& tx, const CCoinsViewCache
  * instead of being performed inline.
  */
 bool InputScriptCheck(const CScript& scriptPubKey, const CTransactionBase& tx, unsigned int nIn,
-                      const CChain& chain, unsigned int flags, bool cache,  CValidationState &state, std::vector<CScriptCheck> *pvChecks);
+                      const std::shared_ptr<const CCheckBlockAtHeightView>& cbhView, unsigned int flags, bool cache,
+                      CValidationState &state, std::vector<CScriptCheck> *pvChecks);
+
+/**
+ * The replay protection view of chain the script checks run against, taken again only when its tip changed, so
+ * that all the checks of a block or of a mempool admission share it. Requires the chain not to change meanwhile.
+ */
+std::shared_ptr<const CCheckBlockAtHeightView> GetCheckBlockAtHeightView(const CChain& chain);
+/** The script verification flags of the transactions and certificates in blocks */
+static const unsigned int BLOCK_SCRIPT_VERIFY_FLAGS = SCRIPT_VERIFY_P2SH | SCRIPT_VERIFY_CHECKLOCKTIMEVERIFY | SCRIPT_VERIFY_CHECKBLOCKATHEIGHT;
+
+//! Allocate the script execution cache with half of -maxsigcachesize: until then, no script execution is cached
+void InitScriptExecutionCache();
+//! Record that all the input scripts of the transaction or certificate with this hash passed under flags against chainActive
+void AddToScriptExecutionCache(const uint256& hash, unsigned int flags);
+//! Forget all the recorded script executions, as when chainActive loses its tip
+void ClearScriptExecutionCache();
+
 /**
  * Check whether all inputs (either regular and CSW) of this transaction are valid (no double spends, scripts & sigs, amounts)
  * This does not modify the UTXO set. If pvChecks is not NULL, script checks are pushed onto it
- * instead of being performed inline.
+ * instead of being performed inline. The scripts are skipped when found in the script execution cache.
  */
 bool ContextualCheckTxInputs(const CTransaction& tx, CValidationState &state, const CCoinsViewCache &view, bool fScriptChecks,
                            const CChain& chain, unsigned int flags, bool cacheStore, const Consensus::Params& consensusParams,
@@ -526,33 +668,73 @@ private:
     CScript scriptPubKey;
     const CTransactionBase *ptxTo;
     unsigned int nIn;
-    const CChain *chain;
+    //! Shared with the other checks of the block, kept alive until the check ran
+    std::shared_ptr<const CCheckBlockAtHeightView> cbhView;
     unsigned int nFlags;
     bool cacheStore;
     ScriptError error;
 
 public:
     CScriptCheck();
-    CScriptCheck(const CCoins& txFromIn, const CTransactionBase& txToIn, unsigned int nInIn, const CChain* chainIn, unsigned int nFlagsIn, bool cacheIn);
-    CScriptCheck(const CScript& scriptPubKeyIn, const CTransactionBase& txToIn, unsigned int nInIn, const CChain* chainIn, unsigned int nFlagsIn, bool cacheIn);
+    CScriptCheck(const CCoins& txFromIn, const CTransactionBase& txToIn, unsigned int nInIn,
+                 std::shared_ptr<const CCheckBlockAtHeightView> cbhViewIn, unsigned int nFlagsIn, bool cacheIn);
+    CScriptCheck(const CScript& scriptPubKeyIn, const CTransactionBase& txToIn, unsigned int nInIn,
+                 std::shared_ptr<const CCheckBlockAtHeightView> cbhViewIn, unsigned int nFlagsIn, bool cacheIn);
     bool operator()();
     void swap(CScriptCheck &check);
     ScriptError GetScriptError() const;
 };
 
+/**
+ * Closure representing the verification of one JoinSplit proof, which ConnectBlock queues
+ * so that the proofs of a block are verified alongside its scripts.
+ * Note that this stores references to the JoinSplit and to the public key of its transaction
+ */
+class CJoinSplitCheck
+{
+private:
+    const JSDescription *pjoinsplit;
+    const uint256 *pjoinSplitPubKey;
+
+public:
+    CJoinSplitCheck(): pjoinsplit(nullptr), pjoinSplitPubKey(nullptr) {}
+    CJoinSplitCheck(const JSDescription& joinsplitIn, const uint256& joinSplitPubKeyIn):
+        pjoinsplit(&joinsplitIn), pjoinSplitPubKey(&joinSplitPubKeyIn) {}
+    bool operator()();
+    void swap(CJoinSplitCheck &check);
+};
+
 bool GetTimestampIndex(const unsigned int &high, const unsigned int &low, const bool fActiveOnly, std::vector<std::pair<uint256, unsigned int> > &hashes);
 bool GetSpentIndex(CSpentIndexKey &key, CSpentIndexValue &value);
+bool GetBlockInputDeltas(const uint256 &hash, CBlockInputDeltas &deltas);
 bool GetAddressIndex(uint160 addressHash, AddressType type,
                      std::vector<std::pair<CAddressIndexKey, CAddressIndexValue> > &addressIndex,
                      int start = 0, int end = 0);
+bool GetAddressIndexPage(uint160 addressHash, AddressType type, const CAddressIndexKey* pCursor, bool fReverse,
+                         size_t nMaxTxs, int start, int end,
+                         std::vector<std::pair<CAddressIndexKey, CAddressIndexValue> > &addressIndex, bool &fMore);
+/** Read the totals of an address; returns false if the address index has no aggregates, e.g. it predates them */
+bool GetAddressAggregate(uint160 addressHash, AddressType type, CAddressAggregateValue &aggregate);
 bool GetAddressUnspent(uint160 addressHash, AddressType type,
                        std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &unspentOutputs);
 
 
 /** Functions for disk access for blocks */
 bool WriteBlockToDisk(CBlock& block, CDiskBlockPos& pos, const CMessageHeader::MessageStartChars& messageStart);
+/** The record of block in the block files, compressed at -blockcompression when it gets smaller */
+std::shared_ptr<const CSerializeData> SerializeBlockRecord(const CBlock& block, const CMessageHeader::MessageStartChars& messageStart);
+/** Writes the record at pos, found for its size by FindBlockPos, pos being then the one of the block */
+bool WriteBlockToDisk(std::shared_ptr<const CSerializeData> record, CDiskBlockPos& pos);
 bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos);
+//! The proof of work is only checked with fCheckPow, the blocks of the active chain having had theirs checked
+bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos, bool fCheckPow);
 bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex);
+/** The undo data at pos of the block following hashBlock, with their checksum verified */
+bool UndoReadFromDisk(CBlockUndo& blockundo, const CDiskBlockPos& pos, const uint256& hashBlock);
+/** The block of pindex from the cache of recent blocks, or else read from disk and cached; nullptr if it cannot be read */
+std::shared_ptr<const CBlock> ReadBlockFromDiskCached(const CBlockIndex* pindex);
+/** The block message of pindex for peers with send version nVersion, serialized once for all of them */
+std::shared_ptr<const CSerializeData> ReadBlockMessageCached(const CBlockIndex* pindex, int nVersion);
 CBlock LoadBlockFrom(CBufferedFile& blkdat, CDiskBlockPos* pLastLoadedBlkPos);
 
 /** Functions for validating blocks and updating the block tree */
@@ -570,7 +752,8 @@ enum class flagLevelDBIndexesWrite { ON, OFF };
  *  will be true if no problems were found. Otherwise, the return value will be false in case
  *  of problems. Note that in any case, coins may be modified. */
 bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex, CCoinsViewCache& coins, flagLevelDBIndexesWrite explorerIndexesWrite,
-                     bool* pfClean = NULL, std::vector<CScCertificateStatusUpdateInfo>* pCertsStateInfo = nullptr);
+                     bool* pfClean = NULL, std::vector<CScCertificateStatusUpdateInfo>* pCertsStateInfo = nullptr,
+                     CBlockUndo* pBlockUndo = nullptr);
 
 /** Apply the effects of this block (with given index) on the UTXO set represented by coins */
 enum class flagCheckPow             { ON, OFF };
@@ -589,6 +772,14 @@ enum class flagBlockProcessingType
     CHECK_ONLY      /**< Perofrm only the validity check and do not apply any changes. */
 };
 
+/**
+ * Whether the scripts and proofs of pindex are assumed valid under -assumevalid: pindexAssumeValid, the block
+ * assumed valid if known, is one of its descendants, in the best header chain and buried there under
+ * ASSUME_VALID_MIN_BURIED_TIME of work
+ */
+bool IsAssumedValid(const CBlockIndex* pindex, const CBlockIndex* pindexAssumeValid, const CBlockIndex* pindexBestHeaderIn,
+                    const Consensus::Params& consensusParams);
+
 bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pindex,
     CCoinsViewCache& coins, const CChain& chain, flagBlockProcessingType processingType,
     flagScRelatedChecks fScRelatedChecks, flagScProofVerification fScProofVerification,
@@ -621,7 +812,15 @@ bool TestBlockValidity(CValidationState &state, const CBlock& block, CBlockIndex
  * If dbp is non-NULL, the file is known to already reside on disk
  */
 bool AcceptBlock(CBlock& block, CValidationState& state, CBlockIndex **pindex, bool fRequested, CDiskBlockPos* dbp, BlockSet* sForkTips = NULL);
-bool AcceptBlockHeader(const CBlockHeader& block, CValidationState& state, CBlockIndex **ppindex= NULL, bool lookForwardTips = false);
+bool AcceptBlockHeader(const CBlockHeader& block, CValidationState& state, CBlockIndex **ppindex= NULL, bool lookForwardTips = false,
+                       flagCheckPow fCheckPOW = flagCheckPow::ON);
+/**
+ * Run CheckBlockHeader on a batch of headers across the -par worker threads, skipping the ones
+ * flagged in vSkip. vStates receives the outcome for each header; vChecked flags the headers
+ * that were verified, so that AcceptBlockHeader can be told not to verify their PoW again.
+ */
+void CheckBlockHeaders(const std::vector<CBlockHeader>& headers, const std::vector<char>& vSkip,
+                       std::vector<CValidationState>& vStates, std::vector<char>& vChecked);
 
 
 class CBlockFileInfo
@@ -689,6 +888,21 @@ public:
 /** Find the last common block between the parameter chain and a locator. */
 CBlockIndex* FindForkInGlobalIndex(const CChain& chain, const CBlockLocator& locator);
 
+/**
+ * Read-only queries about the headers of the active chain can be answered without cs_main, so that
+ * they never wait for a block being connected. The header fields, height, chain work and ancestors
+ * of a block index entry never change once it is added to mapBlockIndex, and entries are only freed
+ * by UnloadBlockIndex: a published tip and the entries found by LookupBlockIndex can be read at
+ * leisure, as a consistent snapshot of the chain at that tip. Anything else about a block (status,
+ * transactions, the coins view) still requires cs_main.
+ */
+/** The tip of the active chain as of its last change, or NULL before the block index is loaded */
+CBlockIndex* GetPublishedChainTip();
+/** Find a block index entry without holding cs_main: NULL if the block is unknown */
+CBlockIndex* LookupBlockIndex(const uint256& hash);
+/** Whether pindex is on the chain ending at pindexTip, in O(log(height)) */
+bool IsInPublishedChain(const CBlockIndex* pindex, const CBlockIndex* pindexTip);
+
 /** Mark a block as invalid. */
 bool InvalidateBlock(CValidationState& state, CBlockIndex *pindex);
 
@@ -701,6 +915,9 @@ extern CChain chainActive;
 /** Global variable that points to the active CCoinsView (protected by cs_main) */
 extern CCoinsViewCache *pcoinsTip;
 
+/** Global variable that points to the layer writing the coins db in background, if any (protected by cs_main) */
+extern CCoinsViewBackgroundFlush *pcoinsFlusher;
+
 /** Global variable that points to the active block tree (protected by cs_main) */
 extern CBlockTreeDB *pblocktree;
 
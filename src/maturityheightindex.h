@@ -1,3 +1,7 @@
+#ifndef BITCOIN_MATURITYHEIGHTINDEX_H
+#define BITCOIN_MATURITYHEIGHTINDEX_H
+
+#include "serialize.h"
 #include "uint256.h"
 
 struct CMaturityHeightIteratorKey {
@@ -88,4 +92,6 @@ struct CMaturityHeightValue {
     bool IsNull() const {
         return dummy == static_cast<char>(0);
     }
-};
\ No newline at end of file
+};
+
+#endif // BITCOIN_MATURITYHEIGHTINDEX_H
@@ -0,0 +1,73 @@
+#include "maturityschedule.h"
+
+void CMaturitySchedule::Add(const CMaturityHeightKey& key)
+{
+    nEntries += mapByHeight[key.blockHeight].insert(key.certId).second;
+}
+
+void CMaturitySchedule::Erase(const CMaturityHeightKey& key)
+{
+    std::map<int, std::set<uint256> >::iterator it = mapByHeight.find(key.blockHeight);
+    if (it == mapByHeight.end())
+        return;
+    nEntries -= it->second.erase(key.certId);
+    if (it->second.empty())
+        mapByHeight.erase(it);
+}
+
+void CMaturitySchedule::Load(const std::vector<CMaturityHeightKey>& vKeys)
+{
+    std::lock_guard<std::mutex> lock(cs);
+    mapByHeight.clear();
+    nEntries = 0;
+    for (const CMaturityHeightKey& key : vKeys)
+        Add(key);
+    fLoaded = true;
+}
+
+bool CMaturitySchedule::IsLoaded() const
+{
+    std::lock_guard<std::mutex> lock(cs);
+    return fLoaded;
+}
+
+void CMaturitySchedule::Update(const std::vector<std::pair<CMaturityHeightKey, CMaturityHeightValue> >& vUpdates)
+{
+    std::lock_guard<std::mutex> lock(cs);
+    if (!fLoaded)
+        return;
+    // in order, as the db batch applies them
+    for (const std::pair<CMaturityHeightKey, CMaturityHeightValue>& update : vUpdates) {
+        if (update.second.IsNull())
+            Erase(update.first);
+        else
+            Add(update.first);
+    }
+}
+
+std::vector<CMaturityHeightKey> CMaturitySchedule::Get(int height) const
+{
+    std::lock_guard<std::mutex> lock(cs);
+    std::vector<CMaturityHeightKey> vKeys;
+    std::map<int, std::set<uint256> >::const_iterator it = mapByHeight.find(height);
+    if (it == mapByHeight.end())
+        return vKeys;
+    vKeys.reserve(it->second.size());
+    for (const uint256& certId : it->second)
+        vKeys.push_back(CMaturityHeightKey(height, certId));
+    return vKeys;
+}
+
+void CMaturitySchedule::Clear()
+{
+    std::lock_guard<std::mutex> lock(cs);
+    mapByHeight.clear();
+    nEntries = 0;
+    fLoaded = false;
+}
+
+size_t CMaturitySchedule::Size() const
+{
+    std::lock_guard<std::mutex> lock(cs);
+    return nEntries;
+}
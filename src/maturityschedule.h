@@ -0,0 +1,43 @@
+#ifndef BITCOIN_MATURITYSCHEDULE_H
+#define BITCOIN_MATURITYSCHEDULE_H
+
+#include "maturityheightindex.h"
+#include "uint256.h"
+
+#include <map>
+#include <mutex>
+#include <set>
+#include <utility>
+#include <vector>
+
+/**
+ * The maturity height index held in memory: the certificates whose backward transfers mature at
+ * each height, so that they are found without iterating the block tree db. It is loaded once from
+ * the db, then gets the updates of the index as they are queued for writing, hence it is ahead of
+ * the db while they are written. Until loaded it holds nothing and the db is to be read instead.
+ */
+class CMaturitySchedule
+{
+public:
+    //! Replace the content with the keys read from the db
+    void Load(const std::vector<CMaturityHeightKey>& vKeys);
+    bool IsLoaded() const;
+    //! Apply index updates: null values erase their key, the others add it. No-op until loaded.
+    void Update(const std::vector<std::pair<CMaturityHeightKey, CMaturityHeightValue> >& vUpdates);
+    //! The certificates maturing at height, in the order of the db keys
+    std::vector<CMaturityHeightKey> Get(int height) const;
+    void Clear();
+
+    size_t Size() const;
+
+private:
+    mutable std::mutex cs;
+    bool fLoaded = false;
+    std::map<int, std::set<uint256> > mapByHeight;
+    size_t nEntries = 0;
+
+    void Add(const CMaturityHeightKey& key);
+    void Erase(const CMaturityHeightKey& key);
+};
+
+#endif // BITCOIN_MATURITYSCHEDULE_H
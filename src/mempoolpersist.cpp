@@ -0,0 +1,204 @@
+#include "mempoolpersist.h"
+
+#include "chainparams.h"
+#include "clientversion.h"
+#include "consensus/validation.h"
+#include "init.h"
+#include "main.h"
+#include "streams.h"
+#include "txmempool.h"
+#include "util.h"
+
+#include <algorithm>
+#include <atomic>
+#include <map>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+
+static std::atomic<bool> fMempoolLoaded{false};
+
+namespace {
+
+//! An entry of mempool.dat, with the transaction or the certificate it holds
+struct CMempoolDumpEntry
+{
+    uint64_t nSequence = 0;
+    bool fCertificate = false;
+    CTransaction tx;
+    CScCertificate cert;
+    int64_t nTime = 0;
+    bool fProofsVerified = false;
+};
+
+boost::filesystem::path MempoolDumpPath()
+{
+    return GetDataDir() / "mempool.dat";
+}
+
+//! The entries of a dump are revalidated with the proofs verified, unless trusted, and none of the
+//! checks of the relay policy skipped
+MempoolReturnValue AcceptDumpEntry(CTxMemPool& pool, const CMempoolDumpEntry& entry, bool fTrustProofs)
+{
+    const MempoolProofVerificationFlag flag = fTrustProofs && entry.fProofsVerified ?
+        MempoolProofVerificationFlag::DISABLED : MempoolProofVerificationFlag::SYNC;
+    CValidationState state;
+    if (entry.fCertificate)
+        return AcceptCertificateToMemoryPool(pool, state, entry.cert, LimitFreeFlag::OFF, RejectAbsurdFeeFlag::OFF, flag,
+                                             nullptr, ResurrectionFlag::OFF, entry.nTime);
+    return AcceptTxToMemoryPool(pool, state, entry.tx, LimitFreeFlag::OFF, RejectAbsurdFeeFlag::OFF, flag,
+                                nullptr, ResurrectionFlag::OFF, entry.nTime);
+}
+
+} // anon namespace
+
+bool IsMempoolLoaded()
+{
+    return fMempoolLoaded;
+}
+
+bool DumpMempool(const CTxMemPool& pool)
+{
+    const int64_t nStart = GetTimeMillis();
+
+    // the proofs of all the entries were verified before they entered the mempool, but with -skipscproof
+    const bool fProofsVerified = !(Params().NetworkIDString() == "regtest" && GetBoolArg("-skipscproof", false));
+
+    std::vector<CMempoolDumpEntry> vEntries;
+    std::map<uint256, std::pair<double, CAmount>> mapDeltas;
+    {
+        LOCK(pool.cs);
+        vEntries.reserve(pool.mapTx.size() + pool.mapCertificate.size());
+        for (const auto& item : pool.mapTx)
+        {
+            CMempoolDumpEntry entry;
+            entry.nSequence = item.second.GetSequence();
+            entry.tx = item.second.GetTx();
+            entry.nTime = item.second.GetTime();
+            entry.fProofsVerified = fProofsVerified;
+            vEntries.push_back(std::move(entry));
+        }
+        for (const auto& item : pool.mapCertificate)
+        {
+            CMempoolDumpEntry entry;
+            entry.nSequence = item.second.GetSequence();
+            entry.fCertificate = true;
+            entry.cert = item.second.GetCertificate();
+            entry.nTime = item.second.GetTime();
+            entry.fProofsVerified = fProofsVerified;
+            vEntries.push_back(std::move(entry));
+        }
+        mapDeltas = pool.mapDeltas;
+    }
+    std::sort(vEntries.begin(), vEntries.end(),
+              [](const CMempoolDumpEntry& a, const CMempoolDumpEntry& b) { return a.nSequence < b.nSequence; });
+
+    const boost::filesystem::path path = MempoolDumpPath();
+    const boost::filesystem::path pathNew = path.string() + ".new";
+    try {
+        CAutoFile file(fopen(pathNew.string().c_str(), "wb"), SER_DISK, CLIENT_VERSION);
+        if (file.IsNull())
+            return error("%s: failed to open %s", __func__, pathNew.string());
+
+        file << MEMPOOL_DUMP_VERSION;
+        file << mapDeltas;
+        file << static_cast<uint64_t>(vEntries.size());
+        for (const CMempoolDumpEntry& entry : vEntries)
+        {
+            file << entry.fCertificate;
+            if (entry.fCertificate)
+                file << entry.cert;
+            else
+                file << entry.tx;
+            file << entry.nTime;
+            file << entry.fProofsVerified;
+        }
+        FileCommit(file.Get());
+        file.fclose();
+    } catch (const std::exception& e) {
+        return error("%s: failed to write %s - %s", __func__, pathNew.string(), e.what());
+    }
+    if (!RenameOver(pathNew, path))
+        return error("%s: failed to rename %s to %s", __func__, pathNew.string(), path.string());
+
+    LogPrintf("%s: dumped %u mempool entries and %u prioritisations in %dms\n",
+              __func__, vEntries.size(), mapDeltas.size(), GetTimeMillis() - nStart);
+    return true;
+}
+
+bool LoadMempool(CTxMemPool& pool, bool fTrustProofs)
+{
+    const int64_t nStart = GetTimeMillis();
+    const boost::filesystem::path path = MempoolDumpPath();
+    CAutoFile file(fopen(path.string().c_str(), "rb"), SER_DISK, CLIENT_VERSION);
+    if (file.IsNull())
+    {
+        // missing on the first start with -persistmempool
+        LogPrintf("%s: no %s to load\n", __func__, path.string());
+        fMempoolLoaded = true;
+        return true;
+    }
+
+    unsigned int nAccepted = 0, nFailed = 0, nAlreadyThere = 0;
+    try {
+        uint32_t nVersion;
+        file >> nVersion;
+        if (nVersion != MEMPOOL_DUMP_VERSION)
+            return error("%s: %s has the unknown version %u", __func__, path.string(), nVersion);
+
+        // the prioritisations come first, as they may be what an entry was accepted for
+        std::map<uint256, std::pair<double, CAmount>> mapDeltas;
+        file >> mapDeltas;
+        for (const auto& item : mapDeltas)
+            pool.PrioritiseTransaction(item.first, item.first.ToString(), item.second.first, item.second.second);
+
+        uint64_t nEntries;
+        file >> nEntries;
+        std::vector<CMempoolDumpEntry> vBatch;
+        vBatch.reserve(std::min<uint64_t>(nEntries, MEMPOOL_LOAD_BATCH_SIZE));
+        for (uint64_t i = 0; i < nEntries; i++)
+        {
+            CMempoolDumpEntry entry;
+            file >> entry.fCertificate;
+            if (entry.fCertificate)
+                file >> entry.cert;
+            else
+                file >> entry.tx;
+            file >> entry.nTime;
+            file >> entry.fProofsVerified;
+            vBatch.push_back(std::move(entry));
+
+            if (vBatch.size() < MEMPOOL_LOAD_BATCH_SIZE && i + 1 < nEntries)
+                continue;
+
+            if (ShutdownRequested())
+            {
+                LogPrintf("%s: shutdown requested, %u mempool entries left to load\n", __func__, nEntries - i - 1 + vBatch.size());
+                return false;
+            }
+
+            LOCK(cs_main);
+            for (const CMempoolDumpEntry& batchEntry : vBatch)
+            {
+                const uint256 hash = batchEntry.fCertificate ? batchEntry.cert.GetHash() : batchEntry.tx.GetHash();
+                if (pool.exists(hash))
+                {
+                    nAlreadyThere++;
+                    continue;
+                }
+                if (AcceptDumpEntry(pool, batchEntry, fTrustProofs) == MempoolReturnValue::VALID)
+                    nAccepted++;
+                else
+                    nFailed++;
+            }
+            vBatch.clear();
+        }
+    } catch (const std::exception& e) {
+        LogPrintf("%s: failed to read %s - %s, the mempool is only partially loaded\n", __func__, path.string(), e.what());
+    }
+
+    fMempoolLoaded = true;
+    LogPrintf("%s: %u mempool entries accepted, %u failed, %u already there, loaded in %dms\n",
+              __func__, nAccepted, nFailed, nAlreadyThere, GetTimeMillis() - nStart);
+    return true;
+}
@@ -0,0 +1,31 @@
+#ifndef BITCOIN_MEMPOOLPERSIST_H
+#define BITCOIN_MEMPOOLPERSIST_H
+
+#include <stdint.h>
+
+class CTxMemPool;
+
+static const bool DEFAULT_PERSIST_MEMPOOL = false;
+static const bool DEFAULT_MEMPOOL_TRUST_PROOFS = false;
+//! Seconds between two dumps of the mempool, 0 to only dump it on shutdown
+static const int64_t DEFAULT_MEMPOOL_DUMP_INTERVAL = 15 * 60;
+static const uint32_t MEMPOOL_DUMP_VERSION = 1;
+//! The entries of a dump are accepted again this many at a time, each batch under its own cs_main lock
+static const unsigned int MEMPOOL_LOAD_BATCH_SIZE = 100;
+
+/**
+ * With -persistmempool the mempool is written to mempool.dat on shutdown and every -mempooldumpinterval
+ * seconds, and accepted again from it at startup, once the blocks are imported. The file holds the
+ * prioritisations of mapDeltas followed by the transactions and certificates in the order they
+ * entered the mempool, so that parents come before their children, each with the time it entered the
+ * mempool at and whether its proofs had been verified. The loader goes through the full validation of
+ * the mempool; with -mempooltrustproofs the proofs recorded as verified are not verified again, as
+ * mempool.dat is trusted as much as the rest of the data directory.
+ */
+bool DumpMempool(const CTxMemPool& pool);
+bool LoadMempool(CTxMemPool& pool, bool fTrustProofs);
+
+//! Whether the mempool was loaded, as it is not dumped before, not to overwrite a file not read yet
+bool IsMempoolLoaded();
+
+#endif // BITCOIN_MEMPOOLPERSIST_H
@@ -7,7 +7,9 @@
 
 #include <stdlib.h>
 
+#include <list>
 #include <map>
+#include <memory>
 #include <set>
 #include <vector>
 
@@ -68,6 +70,26 @@ private:
     X x;
 };
 
+template<typename X>
+struct stl_list_node
+{
+private:
+    void* prev;
+    void* next;
+    X x;
+};
+
+// the control block of a shared_ptr, which may hold a deleter and is allocated apart from the object
+// unless made with std::make_shared
+struct stl_shared_counter
+{
+private:
+    void* vptr;
+    void* ptr;
+    int use_count;
+    int weak_count;
+};
+
 template<typename X>
 static inline size_t DynamicUsage(const std::vector<X>& v)
 {
@@ -77,8 +99,14 @@ static inline size_t DynamicUsage(const std::vector<X>& v)
 template<typename X>
 static inline size_t DynamicUsage(const std::list<X>& l)
 {
-    // capacity is equal to list size
-    return MallocUsage(l.size() * sizeof(X));
+    // each element is allocated in a node of its own
+    return MallocUsage(sizeof(stl_list_node<X>)) * l.size();
+}
+
+template<typename X>
+static inline size_t DynamicUsage(const std::shared_ptr<X>& p)
+{
+    return p ? MallocUsage(sizeof(X)) + MallocUsage(sizeof(stl_shared_counter)) : 0;
 }
 
 
@@ -109,8 +137,8 @@ static inline size_t DynamicUsage(const boost::unordered_set<X, Y>& s)
     return MallocUsage(sizeof(boost_unordered_node<X>)) * s.size() + MallocUsage(sizeof(void*) * s.bucket_count());
 }
 
-template<typename X, typename Y, typename Z>
-static inline size_t DynamicUsage(const boost::unordered_map<X, Y, Z>& m)
+template<typename X, typename Y, typename Z, typename P, typename A>
+static inline size_t DynamicUsage(const boost::unordered_map<X, Y, Z, P, A>& m)
 {
     return MallocUsage(sizeof(boost_unordered_node<std::pair<const X, Y> >)) * m.size() + MallocUsage(sizeof(void*) * m.bucket_count());
 }
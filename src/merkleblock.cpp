@@ -7,10 +7,89 @@
 
 #include "hash.h"
 #include "consensus/consensus.h"
+#include "memusage.h"
 #include "utilstrencodings.h"
 
+#include <algorithm>
+
 using namespace std;
 
+CMerkleTreeCache merkleTreeCache(DEFAULT_MERKLE_TREE_CACHE_SIZE);
+
+CBlockMerkleTree::CBlockMerkleTree(std::vector<uint256> vHashes)
+{
+    vSorted.reserve(vHashes.size());
+    for (unsigned int i = 0; i < vHashes.size(); i++)
+        vSorted.emplace_back(vHashes[i], i);
+    std::sort(vSorted.begin(), vSorted.end());
+
+    // as CPartialMerkleTree::CalcHash, the last node of an odd level is paired with itself
+    vLevels.push_back(std::move(vHashes));
+    while (vLevels.back().size() > 1) {
+        const std::vector<uint256>& vBelow = vLevels.back();
+        std::vector<uint256> vLevel((vBelow.size() + 1) / 2);
+        for (unsigned int i = 0; i < vLevel.size(); i++) {
+            const uint256& left = vBelow[2 * i];
+            const uint256& right = 2 * i + 1 < vBelow.size() ? vBelow[2 * i + 1] : left;
+            vLevel[i] = Hash(BEGIN(left), END(left), BEGIN(right), END(right));
+        }
+        vLevels.push_back(std::move(vLevel));
+    }
+}
+
+bool CBlockMerkleTree::Find(const uint256& hash, unsigned int& nPos) const
+{
+    auto it = std::lower_bound(vSorted.begin(), vSorted.end(), std::make_pair(hash, 0U));
+    if (it == vSorted.end() || it->first != hash)
+        return false;
+    nPos = it->second;
+    return true;
+}
+
+size_t CBlockMerkleTree::DynamicMemoryUsage() const
+{
+    size_t nUsage = memusage::DynamicUsage(vLevels) + memusage::DynamicUsage(vSorted);
+    for (const std::vector<uint256>& vLevel : vLevels)
+        nUsage += memusage::DynamicUsage(vLevel);
+    return nUsage;
+}
+
+std::shared_ptr<const CBlockMerkleTree> CMerkleTreeCache::Get(const uint256& hashBlock)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = mapEntries.find(hashBlock);
+    if (it == mapEntries.end())
+        return nullptr;
+    entries.splice(entries.begin(), entries, it->second);
+    return it->second->second;
+}
+
+void CMerkleTreeCache::Insert(const uint256& hashBlock, const std::shared_ptr<const CBlockMerkleTree>& tree)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (nMaxSize == 0 || mapEntries.count(hashBlock))
+        return;
+    entries.emplace_front(hashBlock, tree);
+    mapEntries[hashBlock] = entries.begin();
+    while (entries.size() > nMaxSize) {
+        mapEntries.erase(entries.back().first);
+        entries.pop_back();
+    }
+}
+
+void CMerkleTreeCache::Clear()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    mapEntries.clear();
+    entries.clear();
+}
+
+size_t CMerkleTreeCache::Size() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return entries.size();
+}
+
 CMerkleBlock::CMerkleBlock(const CBlock& block, CBloomFilter& filter)
 :header( block.GetBlockHeader())
 {
@@ -82,6 +161,22 @@ CMerkleBlock::CMerkleBlock(const CBlock& block, const std::set<uint256>& txids)
     txn = CPartialMerkleTree(vHashes, vMatch);
 }
 
+CMerkleBlock::CMerkleBlock(const CBlockHeader& headerIn, const std::vector<uint256>& vHashes, const std::set<uint256>& txids)
+:header(headerIn)
+{
+    vector<bool> vMatch;
+    vMatch.reserve(vHashes.size());
+    for (const uint256& hash : vHashes)
+        vMatch.push_back(txids.count(hash) != 0);
+
+    txn = CPartialMerkleTree(vHashes, vMatch);
+}
+
+CMerkleBlock::CMerkleBlock(const CBlockHeader& headerIn, const CBlockMerkleTree& tree, const std::vector<unsigned int>& vPos)
+:header(headerIn), txn(tree, vPos)
+{
+}
+
 uint256 CPartialMerkleTree::CalcHash(int height, unsigned int pos, const std::vector<uint256> &vTxid) {
     if (height == 0) {
         // hash at height 0 is the txids themself
@@ -117,6 +212,20 @@ void CPartialMerkleTree::TraverseAndBuild(int height, unsigned int pos, const st
     }
 }
 
+void CPartialMerkleTree::TraverseAndBuildFromTree(int height, unsigned int pos, const CBlockMerkleTree& tree, const std::vector<unsigned int>& vPos) {
+    // the first matched position at or after the first leaf below this node
+    auto it = std::lower_bound(vPos.begin(), vPos.end(), pos << height);
+    const bool fParentOfMatch = it != vPos.end() && *it < ((pos+1) << height);
+    vBits.push_back(fParentOfMatch);
+    if (height==0 || !fParentOfMatch) {
+        vHash.push_back(tree.vLevels[height][pos]);
+    } else {
+        TraverseAndBuildFromTree(height-1, pos*2, tree, vPos);
+        if (pos*2+1 < CalcTreeWidth(height-1))
+            TraverseAndBuildFromTree(height-1, pos*2+1, tree, vPos);
+    }
+}
+
 uint256 CPartialMerkleTree::TraverseAndExtract(int height, unsigned int pos, unsigned int &nBitsUsed, unsigned int &nHashUsed, std::vector<uint256> &vMatch) {
     if (nBitsUsed >= vBits.size()) {
         // overflowed the bits array - failure
@@ -167,6 +276,14 @@ CPartialMerkleTree::CPartialMerkleTree(const std::vector<uint256> &vTxid, const
     TraverseAndBuild(nHeight, 0, vTxid, vMatch);
 }
 
+CPartialMerkleTree::CPartialMerkleTree(const CBlockMerkleTree& tree, const std::vector<unsigned int>& vPos) : nTransactions(tree.Size()), fBad(false) {
+    int nHeight = 0;
+    while (CalcTreeWidth(nHeight) > 1)
+        nHeight++;
+
+    TraverseAndBuildFromTree(nHeight, 0, tree, vPos);
+}
+
 CPartialMerkleTree::CPartialMerkleTree() : nTransactions(0), fBad(true) {}
 
 uint256 CPartialMerkleTree::ExtractMatches(std::vector<uint256> &vMatch) {
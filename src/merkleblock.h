@@ -11,8 +11,36 @@
 #include "primitives/block.h"
 #include "bloom.h"
 
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
 #include <vector>
 
+/**
+ * All the levels of the merkle tree of a block, from the hashes of its transactions then certificates
+ * to the root, built once for the proofs cut from it: the partial merkle tree of k transactions only
+ * visits the O(k log n) nodes above them, rather than hashing the whole tree again.
+ */
+class CBlockMerkleTree
+{
+public:
+    explicit CBlockMerkleTree(std::vector<uint256> vHashes);
+
+    unsigned int Size() const { return vLevels[0].size(); }
+    uint256 GetRoot() const { return vLevels.back().empty() ? uint256() : vLevels.back()[0]; }
+    //! Whether the hash is a leaf of the tree, and at which position
+    bool Find(const uint256& hash, unsigned int& nPos) const;
+    size_t DynamicMemoryUsage() const;
+
+    //! The leaves at level 0, the root at the last one
+    std::vector<std::vector<uint256>> vLevels;
+
+private:
+    //! The leaves, sorted by hash
+    std::vector<std::pair<uint256, unsigned int>> vSorted;
+};
+
 /** Data structure that represents a partial merkle tree.
  *
  * It represents a subset of the txid's of a known block, in a way that
@@ -73,6 +101,9 @@ protected:
     /** recursive function that traverses tree nodes, storing the data as bits and hashes */
     void TraverseAndBuild(int height, unsigned int pos, const std::vector<uint256> &vTxid, const std::vector<bool> &vMatch);
 
+    /** as TraverseAndBuild, reading the hashes from the full tree and telling the matches by binary search */
+    void TraverseAndBuildFromTree(int height, unsigned int pos, const CBlockMerkleTree& tree, const std::vector<unsigned int>& vPos);
+
     /**
      * recursive function that traverses tree nodes, consuming the bits and hashes produced by TraverseAndBuild.
      * it returns the hash of the respective node.
@@ -107,6 +138,9 @@ public:
     /** Construct a partial merkle tree from a list of transaction ids, and a mask that selects a subset of them */
     CPartialMerkleTree(const std::vector<uint256> &vTxid, const std::vector<bool> &vMatch);
 
+    /** Construct the partial merkle tree of the leaves at the positions vPos, sorted ascending, from a full tree */
+    CPartialMerkleTree(const CBlockMerkleTree& tree, const std::vector<unsigned int>& vPos);
+
     CPartialMerkleTree();
 
     /**
@@ -142,6 +176,12 @@ public:
     // Create from a CBlock, matching the txids in the set
     CMerkleBlock(const CBlock& block, const std::set<uint256>& txids);
 
+    // Create from a header and the hashes of the block transactions then certificates, matching the txids in the set
+    CMerkleBlock(const CBlockHeader& headerIn, const std::vector<uint256>& vHashes, const std::set<uint256>& txids);
+
+    // Create from a header and the full merkle tree of the block, matching the leaves at the sorted positions
+    CMerkleBlock(const CBlockHeader& headerIn, const CBlockMerkleTree& tree, const std::vector<unsigned int>& vPos);
+
     CMerkleBlock() {}
 
     ADD_SERIALIZE_METHODS;
@@ -153,4 +193,35 @@ public:
     }
 };
 
+//! The number of full merkle trees of the recent blocks kept for gettxoutproof and gettxoutproofs
+static const size_t DEFAULT_MERKLE_TREE_CACHE_SIZE = 16;
+
+/**
+ * The full merkle trees of the blocks proofs were last asked for, the least recently used being dropped
+ * first: the proofs of the transactions of a block then come one after the other, or in batches, without
+ * reading and hashing the block again.
+ */
+class CMerkleTreeCache
+{
+public:
+    explicit CMerkleTreeCache(size_t nMaxSizeIn) : nMaxSize(nMaxSizeIn) {}
+
+    //! The cached tree of the block with this hash, nullptr if it is not cached
+    std::shared_ptr<const CBlockMerkleTree> Get(const uint256& hashBlock);
+    void Insert(const uint256& hashBlock, const std::shared_ptr<const CBlockMerkleTree>& tree);
+    void Clear();
+    size_t Size() const;
+
+private:
+    typedef std::list<std::pair<uint256, std::shared_ptr<const CBlockMerkleTree>>> EntryList;
+
+    mutable std::mutex mutex;
+    const size_t nMaxSize;
+    //! Most recently used first
+    EntryList entries;
+    std::map<uint256, EntryList::iterator> mapEntries;
+};
+
+extern CMerkleTreeCache merkleTreeCache;
+
 #endif // BITCOIN_MERKLEBLOCK_H
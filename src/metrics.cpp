@@ -28,48 +28,64 @@
 
 using namespace zen;
 
+int AtomicCounter::ThreadSlot()
+{
+    static std::atomic<int> nextSlot {0};
+    thread_local int slot = nextSlot.fetch_add(1, std::memory_order_relaxed) % SLOTS;
+    return slot;
+}
+
 void AtomicTimer::start()
 {
-    std::unique_lock<std::mutex> lock(mtx);
-    if (threads < 1) {
-        start_time = GetTime();
-    }
-    ++threads;
+    uint64_t s = state.load();
+    uint64_t next;
+    do {
+        const uint64_t threads = Threads(s);
+        next = threads < 1 ? Pack(1, GetTime()) : Pack(threads + 1, StartTime(s));
+    } while (!state.compare_exchange_weak(s, next));
 }
 
 void AtomicTimer::stop()
 {
-    std::unique_lock<std::mutex> lock(mtx);
-    // Ignore excess calls to stop()
-    if (threads > 0) {
-        --threads;
-        if (threads < 1) {
-            int64_t time_span = GetTime() - start_time;
-            total_time += time_span;
-        }
+    uint64_t s = state.load();
+    uint64_t next;
+    do {
+        // Ignore excess calls to stop()
+        if (Threads(s) < 1)
+            return;
+        next = Threads(s) == 1 ? Pack(0, 0) : Pack(Threads(s) - 1, StartTime(s));
+    } while (!state.compare_exchange_weak(s, next));
+
+    if (Threads(s) == 1) {
+        int64_t time_span = GetTime() - StartTime(s);
+        total_time += time_span;
     }
 }
 
 bool AtomicTimer::running()
 {
-    std::unique_lock<std::mutex> lock(mtx);
-    return threads > 0;
+    return Threads(state.load()) > 0;
 }
 
 uint64_t AtomicTimer::threadCount()
 {
-    std::unique_lock<std::mutex> lock(mtx);
-    return threads;
+    return Threads(state.load());
 }
 
-double AtomicTimer::rate(const AtomicCounter& count)
+int64_t AtomicTimer::duration()
 {
-    std::unique_lock<std::mutex> lock(mtx);
-    int64_t duration = total_time;
-    if (threads > 0) {
+    const uint64_t s = state.load();
+    int64_t duration = total_time.load();
+    if (Threads(s) > 0) {
         // Timer is running, so get the latest count
-        duration += GetTime() - start_time;
+        duration += GetTime() - StartTime(s);
     }
+    return duration;
+}
+
+double AtomicTimer::rate(const AtomicCounter& count)
+{
+    int64_t duration = this->duration();
     return duration > 0 ? (double)count.get() / duration : 0;
 }
 
@@ -82,6 +98,8 @@ AtomicCounter ehSolverRuns;
 AtomicCounter solutionTargetChecks;
 AtomicCounter minedBlocks;
 AtomicTimer miningTimer;
+AtomicCounter blocksImported;
+AtomicTimer blockImportTimer;
 
 boost::synchronized_value<std::list<uint256>> trackedBlocks;
 
@@ -266,6 +284,10 @@ int printStats(bool mining)
     std::cout << std::endl;
 */
     std::cout << "           " << _("Block height") << " | " << height << std::endl;
+    if (blockImportTimer.running()) {
+        std::cout << "      " << _("Block import rate") << " | " << strprintf("%.2f blocks/s", blockImportTimer.rate(blocksImported)) << std::endl;
+        lines++;
+    }
     std::cout << "            " << _("Connections") << " | " << connections << " (TLS: " << tlsConnections << ")" << std::endl;
     std::cout << "  " << _("Network solution rate") << " | " << netsolps << " Sol/s" << std::endl;
     if (mining && miningTimer.running()) {
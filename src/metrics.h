@@ -5,36 +5,61 @@
 #include "uint256.h"
 
 #include <atomic>
-#include <mutex>
 #include <string>
 
+/**
+ * A counter updated by many threads (solver runs, validated transactions...). Each thread updates
+ * one of several slots, each on its own cache line, so that the threads do not bounce a single
+ * cache line between the cores; the slots are summed when the counter is read.
+ */
 struct AtomicCounter {
-    std::atomic<uint64_t> value;
+    static const int SLOTS = 16;
 
-    AtomicCounter() : value {0} { }
+    struct alignas(64) Slot {
+        std::atomic<int64_t> value;
+        Slot() : value {0} { }
+    };
+    Slot slots[SLOTS];
+
+    //! The slot of the calling thread, threads get them in turn
+    static int ThreadSlot();
 
     void increment(){
-        ++value;
+        slots[ThreadSlot()].value.fetch_add(1, std::memory_order_relaxed);
     }
 
     void decrement(){
-        --value;
+        slots[ThreadSlot()].value.fetch_sub(1, std::memory_order_relaxed);
     }
 
     int get() const {
-        return value.load();
+        int64_t sum = 0;
+        for (const Slot& slot : slots)
+            sum += slot.value.load(std::memory_order_relaxed);
+        return sum;
     }
 };
 
+/**
+ * Times the periods when at least one thread is running. The number of running threads and the start
+ * time of the current period are packed in a single atomic word, so that start() and stop() are a
+ * compare and swap; the time of a period is added to the total once the period is closed.
+ */
 class AtomicTimer {
 private:
-    std::mutex mtx;
-    uint64_t threads;
-    int64_t start_time;
-    int64_t total_time;
+    static const int TIME_BITS = 40;
+    static const uint64_t TIME_MASK = ((uint64_t)1 << TIME_BITS) - 1;
+
+    //! running threads in the high bits, start time of the current period in the low ones
+    std::atomic<uint64_t> state;
+    std::atomic<int64_t> total_time;
+
+    static uint64_t Pack(uint64_t threads, int64_t start_time) { return (threads << TIME_BITS) | ((uint64_t)start_time & TIME_MASK); }
+    static uint64_t Threads(uint64_t s) { return s >> TIME_BITS; }
+    static int64_t StartTime(uint64_t s) { return s & TIME_MASK; }
 
 public:
-    AtomicTimer() : threads(0), start_time(0), total_time(0) {}
+    AtomicTimer() : state(0), total_time(0) {}
 
     /**
      * Starts timing on first call, and counts the number of calls.
@@ -51,6 +76,9 @@ public:
 
     uint64_t threadCount();
 
+    //! Total running time, including the current period
+    int64_t duration();
+
     double rate(const AtomicCounter& count);
 };
 
@@ -58,6 +86,8 @@ extern AtomicCounter transactionsValidated;
 extern AtomicCounter ehSolverRuns;
 extern AtomicCounter solutionTargetChecks;
 extern AtomicTimer miningTimer;
+extern AtomicCounter blocksImported;
+extern AtomicTimer blockImportTimer;
 
 void TrackMinedBlock(uint256 hash);
 
@@ -26,6 +26,7 @@
 #include "sc/sidechainTxsCommitmentBuilder.h"
 #include "sc/sidechainTxsCommitmentGuard.h"
 #include "timedata.h"
+#include "txtrace.h"
 #include "ui_interface.h"
 #include "util.h"
 #include "utilmoneystr.h"
@@ -37,10 +38,16 @@
 
 #include "sodium.h"
 
+#include <boost/algorithm/string.hpp>
 #include <boost/thread.hpp>
 #include <boost/tuple/tuple.hpp>
 #ifdef ENABLE_MINING
+#include <fstream>
 #include <functional>
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
 #endif
 #include <mutex>
 
@@ -58,6 +65,9 @@ uint64_t nLastBlockTx = 0;
 uint64_t nLastBlockCert = 0;
 uint64_t nLastBlockSize = 0;
 uint64_t nLastBlockTxPartitionSize = 0;
+CAmount nLastBlockFees = 0;
+int64_t nLastBlockTemplateTime = 0;
+CAmount nBlockTemplateFeeDelta = DEFAULT_BLOCK_TEMPLATE_FEE_DELTA;
 
 bool TxPriorityCompare::operator()(const TxPriority& a, const TxPriority& b)
 {
@@ -318,42 +328,137 @@ bool AddToPriorities(const CTransactionBase& txBase, const CCoinsViewCache& view
     return true;
 }
 
-void GetBlockCertPriorityData(const CCoinsViewCache& view, int nHeight,
-                               vector<TxPriority>& vecPriority, list<COrphan>& vOrphan, map<uint256, vector<COrphan*> >& mapDependers)
+void CBlockPriorityDataCache::Refresh(const uint256& newTipHash)
 {
-    for (auto mi = mempool->mapCertificate.begin(); mi != mempool->mapCertificate.end(); ++mi)
+    AssertLockHeld(mempool->cs);
+    if (newTipHash != tipHash)
     {
-        const CScCertificate& cert = mi->second.GetCertificate();
+        LogPrint("bench", "%s():%d - tip changed, dropping %u cached entries\n", __func__, __LINE__, mapEntries.size());
+        mapEntries.clear();
+        tipHash = newTipHash;
+        return;
+    }
 
-        CAmount nTotalIn = 0;
-        COrphan* porphan = nullptr;
+    for (auto it = mapEntries.begin(); it != mapEntries.end(); )
+    {
+        if (!mempool->exists(it->first))
+            it = mapEntries.erase(it);
+        else
+            ++it;
+    }
+}
+
+void CBlockPriorityDataCache::Clear()
+{
+    mapEntries.clear();
+    tipHash.SetNull();
+}
 
-        if (!GetInputsDependencies(cert, nTotalIn, vOrphan, mapDependers, porphan) )
+bool CBlockPriorityDataCache::Apply(const CTransactionBase& txBase, const CMemPoolEntry& mpEntry, vector<TxPriority>& vecPriority,
+                                    list<COrphan>& vOrphan, map<uint256, vector<COrphan*> >& mapDependers) const
+{
+    const uint256& hash = txBase.GetHash();
+    auto it = mapEntries.find(hash);
+    if (it == mapEntries.end())
+        return false;
+
+    const Entry& entry = it->second;
+    if (entry.nEntryFee != mpEntry.GetFee() || entry.nEntryTime != mpEntry.GetTime())
+        return false;
+
+    double dPriorityDelta = 0;
+    CAmount nFeeDelta = 0;
+    mempool->ApplyDeltas(hash, dPriorityDelta, nFeeDelta);
+    if (dPriorityDelta != entry.dPriorityDelta || nFeeDelta != entry.nFeeDelta)
+        return false;
+
+    if (entry.fSkip)
+        return true;
+
+    for (const uint256& dep : entry.setDependsOn)
+        if (!mempool->exists(dep))
+            return false;
+
+    if (entry.setDependsOn.empty())
+    {
+        vecPriority.push_back(TxPriority(entry.dPriority, entry.feeRate, &txBase));
+        return true;
+    }
+
+    vOrphan.push_back(COrphan(&txBase));
+    COrphan* porphan = &vOrphan.back();
+    porphan->setDependsOn = entry.setDependsOn;
+    porphan->dPriority = entry.dPriority;
+    porphan->feeRate = entry.feeRate;
+    for (const uint256& dep : entry.setDependsOn)
+        mapDependers[dep].push_back(porphan);
+
+    return true;
+}
+
+void CBlockPriorityDataCache::Store(const CTransactionBase& txBase, const CMemPoolEntry& mpEntry, bool fSkip,
+                                    const vector<TxPriority>& vecPriority, const COrphan* porphan)
+{
+    const uint256& hash = txBase.GetHash();
+    Entry entry;
+    entry.nEntryFee = mpEntry.GetFee();
+    entry.nEntryTime = mpEntry.GetTime();
+    mempool->ApplyDeltas(hash, entry.dPriorityDelta, entry.nFeeDelta);
+
+    entry.fSkip = fSkip;
+    if (!fSkip)
+    {
+        if (porphan)
         {
-            if (porphan)
-                vOrphan.pop_back();
-            continue;
+            entry.setDependsOn = porphan->setDependsOn;
+            entry.dPriority = porphan->dPriority;
+            entry.feeRate = porphan->feeRate;
         }
-
-        if (!VerifyCertificatesDependencies(cert) )
+        else
         {
-            if (porphan)
-                vOrphan.pop_back();
-            continue;
+            assert(!vecPriority.empty() && vecPriority.back().get<2>() == &txBase);
+            entry.dPriority = vecPriority.back().get<0>();
+            entry.feeRate = vecPriority.back().get<1>();
         }
+    }
 
+    mapEntries[hash] = entry;
+}
+
+void GetBlockCertPriorityData(const CCoinsViewCache& view, int nHeight,
+                               vector<TxPriority>& vecPriority, list<COrphan>& vOrphan, map<uint256, vector<COrphan*> >& mapDependers,
+                               CBlockPriorityDataCache* pcache)
+{
+    for (auto mi = mempool->mapCertificate.begin(); mi != mempool->mapCertificate.end(); ++mi)
+    {
+        const CScCertificate& cert = mi->second.GetCertificate();
         const CMemPoolEntry& mpEntry = mi->second;
-        if (!AddToPriorities(cert, view, nTotalIn, nHeight, mpEntry, vecPriority, porphan) )
+
+        if (pcache && pcache->Apply(cert, mpEntry, vecPriority, vOrphan, mapDependers))
+            continue;
+
+        CAmount nTotalIn = 0;
+        COrphan* porphan = nullptr;
+
+        if (!GetInputsDependencies(cert, nTotalIn, vOrphan, mapDependers, porphan) ||
+            !VerifyCertificatesDependencies(cert) ||
+            !AddToPriorities(cert, view, nTotalIn, nHeight, mpEntry, vecPriority, porphan) )
         {
             if (porphan)
                 vOrphan.pop_back();
+            if (pcache)
+                pcache->Store(cert, mpEntry, /*fSkip*/true, vecPriority, nullptr);
             continue;
         }
+
+        if (pcache)
+            pcache->Store(cert, mpEntry, /*fSkip*/false, vecPriority, porphan);
     }
 }
 
 void GetBlockTxPriorityData(const CCoinsViewCache& view, int nHeight, int64_t nLockTimeCutoff,
-                               vector<TxPriority>& vecPriority, list<COrphan>& vOrphan, map<uint256, vector<COrphan*> >& mapDependers)
+                               vector<TxPriority>& vecPriority, list<COrphan>& vOrphan, map<uint256, vector<COrphan*> >& mapDependers,
+                               CBlockPriorityDataCache* pcache)
 {
     for (map<uint256, CTxMemPoolEntry>::iterator mi = mempool->mapTx.begin(); mi != mempool->mapTx.end(); ++mi)
     {
@@ -362,30 +467,27 @@ void GetBlockTxPriorityData(const CCoinsViewCache& view, int nHeight, int64_t nL
         if (tx.IsCoinBase() || !IsFinalTx(tx, nHeight, nLockTimeCutoff))
             continue;
 
-        CAmount nTotalIn = 0;
-        COrphan* porphan = nullptr;
+        const CMemPoolEntry& mpEntry = mi->second;
 
-        if (!GetInputsDependencies(tx, nTotalIn, vOrphan, mapDependers, porphan) )
-        {
-            if (porphan)
-                vOrphan.pop_back();
+        if (pcache && pcache->Apply(tx, mpEntry, vecPriority, vOrphan, mapDependers))
             continue;
-        }
 
-        if (!VerifySidechainTxDependencies(tx, view, vOrphan, mapDependers, porphan) )
-        {
-            if (porphan)
-                vOrphan.pop_back();
-            continue;
-        }
+        CAmount nTotalIn = 0;
+        COrphan* porphan = nullptr;
 
-        const CMemPoolEntry& mpEntry = mi->second;
-        if (!AddToPriorities(tx, view, nTotalIn, nHeight, mpEntry, vecPriority, porphan) )
+        if (!GetInputsDependencies(tx, nTotalIn, vOrphan, mapDependers, porphan) ||
+            !VerifySidechainTxDependencies(tx, view, vOrphan, mapDependers, porphan) ||
+            !AddToPriorities(tx, view, nTotalIn, nHeight, mpEntry, vecPriority, porphan) )
         {
             if (porphan)
                 vOrphan.pop_back();
+            if (pcache)
+                pcache->Store(tx, mpEntry, /*fSkip*/true, vecPriority, nullptr);
             continue;
         }
+
+        if (pcache)
+            pcache->Store(tx, mpEntry, /*fSkip*/false, vecPriority, porphan);
     }
 }
 
@@ -478,6 +580,100 @@ void GetBlockTxPriorityDataOld(const CCoinsViewCache& view, int nHeight, int64_t
     }
 }
 
+//! The fee of a mempool entry, with its prioritisation delta
+static CAmount GetModifiedFee(const CTransactionBase& txBase)
+{
+    const uint256& hash = txBase.GetHash();
+    CAmount nFee = 0;
+    if (txBase.IsCertificate())
+    {
+        auto it = mempool->mapCertificate.find(hash);
+        if (it != mempool->mapCertificate.end())
+            nFee = it->second.GetFee();
+    }
+    else
+    {
+        auto it = mempool->mapTx.find(hash);
+        if (it != mempool->mapTx.end())
+            nFee = it->second.GetFee();
+    }
+    double dPriorityDelta = 0;
+    mempool->ApplyDeltas(hash, dPriorityDelta, nFee);
+    return nFee;
+}
+
+//! The hex of a mempool entry, encoded once for all the templates it gets in
+static std::shared_ptr<const std::string> GetMempoolHex(const CTransactionBase& txBase)
+{
+    const uint256& hash = txBase.GetHash();
+    if (txBase.IsCertificate())
+    {
+        auto it = mempool->mapCertificate.find(hash);
+        return it != mempool->mapCertificate.end() ? it->second.GetHex() : nullptr;
+    }
+    auto it = mempool->mapTx.find(hash);
+    return it != mempool->mapTx.end() ? it->second.GetHex() : nullptr;
+}
+
+void ApplyPackageFeeRates(vector<TxPriority>& vecPriority, list<COrphan>& vOrphan,
+                          const map<uint256, vector<COrphan*> >& mapDependers)
+{
+    if (mapDependers.empty())
+        return;
+
+    // the fees and sizes of the descendants, as they are before any fee rate is raised
+    map<const CTransactionBase*, pair<CAmount, size_t> > mapOwn;
+    for (const COrphan& orphan : vOrphan)
+    {
+        const size_t nSize = orphan.ptx->GetSerializeSize(SER_NETWORK, PROTOCOL_VERSION);
+        mapOwn[orphan.ptx] = make_pair(GetModifiedFee(*orphan.ptx), nSize);
+    }
+
+    auto packageFeeRate = [&](const CTransactionBase& txBase, const CFeeRate& feeRate) {
+        if (!mapDependers.count(txBase.GetHash()))
+            return feeRate;
+        size_t nPackageSize = txBase.GetSerializeSize(SER_NETWORK, PROTOCOL_VERSION);
+        CAmount nPackageFee = GetModifiedFee(txBase);
+
+        set<const CTransactionBase*> setDescendants;
+        vector<uint256> vToVisit(1, txBase.GetHash());
+        while (!vToVisit.empty() && setDescendants.size() < MAX_PACKAGE_DESCENDANTS)
+        {
+            auto it = mapDependers.find(vToVisit.back());
+            vToVisit.pop_back();
+            if (it == mapDependers.end())
+                continue;
+            for (const COrphan* porphan : it->second)
+            {
+                if (setDescendants.size() >= MAX_PACKAGE_DESCENDANTS)
+                    break;
+                auto own = mapOwn.find(porphan->ptx);
+                if (own == mapOwn.end() || !setDescendants.insert(porphan->ptx).second)
+                    continue;
+                nPackageFee += own->second.first;
+                nPackageSize += own->second.second;
+                vToVisit.push_back(porphan->ptx->GetHash());
+            }
+        }
+        return std::max(feeRate, CFeeRate(nPackageFee, nPackageSize));
+    };
+
+    vector<CFeeRate> vFeeRates;
+    vFeeRates.reserve(vecPriority.size());
+    for (const TxPriority& item : vecPriority)
+        vFeeRates.push_back(packageFeeRate(*item.get<2>(), item.get<1>()));
+    vector<CFeeRate> vOrphanFeeRates;
+    vOrphanFeeRates.reserve(vOrphan.size());
+    for (const COrphan& orphan : vOrphan)
+        vOrphanFeeRates.push_back(packageFeeRate(*orphan.ptx, orphan.feeRate));
+
+    for (size_t i = 0; i < vecPriority.size(); i++)
+        vecPriority[i].get<1>() = vFeeRates[i];
+    size_t nOrphan = 0;
+    for (COrphan& orphan : vOrphan)
+        orphan.feeRate = vOrphanFeeRates[nOrphan++];
+}
+
 CBlockTemplate* CreateNewBlock(const CScript& scriptPubKeyIn)
 {
     // Block complexity is a sum of block transactions complexity. Transaction complexisty equals to number of inputs squared.
@@ -521,9 +717,106 @@ CMutableTransaction createCoinbase(const CScript &scriptPubKeyIn, CAmount fees,
     return txNew;
 }
 
+bool CheckBlockSidechainsApplicability(const CBlock& block, CCoinsViewCache& view, int nHeight, CValidationState& state)
+{
+    for (unsigned int txIdx = 1; txIdx < block.vtx.size(); ++txIdx)
+    {
+        const CTransaction& tx = block.vtx[txIdx];
+
+        CValidationState::Code ret_code = view.IsScTxApplicableToState(tx, Sidechain::ScFeeCheckFlag::MINIMUM_IN_A_RANGE);
+        if (ret_code != CValidationState::Code::OK)
+            return state.DoS(100, error("%s: invalid tx[%s], ret_code[0x%x]", __func__, tx.GetHash().ToString(), CValidationState::CodeToChar(ret_code)),
+                             ret_code, "bad-sc-tx-not-applicable");
+
+        if (!view.UpdateSidechain(tx, block, nHeight))
+            return state.DoS(100, error("%s: could not add sidechain in view: tx[%s]", __func__, tx.GetHash().ToString()),
+                             CValidationState::Code::INVALID, "bad-sc-tx");
+
+        for (const CTxCeasedSidechainWithdrawalInput& cswIn : tx.GetVcswCcIn())
+        {
+            if (!view.AddCswNullifier(cswIn.scId, cswIn.nullifier))
+                return state.DoS(100, error("%s: try to use existed nullifier Tx [%s]", __func__, tx.GetHash().ToString()),
+                                 CValidationState::Code::INVALID, "bad-txns-csw-input-nullifier");
+        }
+    }
+
+    const std::map<uint256, uint256> highQualityCertData = HighQualityCertData(block, view);
+    CBlockUndo dummyBlockUndo(IncludeScAttributes::ON);
+
+    for (const CScCertificate& cert : block.vcert)
+    {
+        CValidationState::Code ret_code = view.IsCertApplicableToState(cert);
+        if (ret_code != CValidationState::Code::OK)
+            return state.DoS(100, error("%s: invalid sc certificate [%s], ret_code[0x%x]", __func__, cert.GetHash().ToString(), CValidationState::CodeToChar(ret_code)),
+                             ret_code, "bad-sc-cert-not-applicable");
+
+        if (highQualityCertData.count(cert.GetHash()) != 0 && !view.UpdateSidechain(cert, dummyBlockUndo, nHeight))
+            return state.DoS(100, error("%s: could not add in scView: cert[%s]", __func__, cert.GetHash().ToString()),
+                             CValidationState::Code::INVALID, "bad-sc-cert-not-updated");
+    }
+
+    return true;
+}
+
+/**
+ * The checks of TestBlockValidity not covered by the assembly of a template already: its entries were
+ * checked against view one after the other, scripts included, as they were spent in it, and its commitment
+ * against the one built along. The header, the coinbase and the limits of the whole block are left, with
+ * the sidechain state checks in the order ConnectBlock runs them, which spares going again through the
+ * coins and scripts of every entry on a view of their own.
+ */
+static bool TestBlockTemplateValidity(CValidationState& state, const CBlockTemplate& blocktemplate, CBlockIndex* const pindexPrev, CAmount nFees)
+{
+    const CBlock& block = blocktemplate.block;
+
+    if (!ContextualCheckBlockHeader(block, state, pindexPrev))
+        return false;
+    if (!CheckBlockHeader(block, state, flagCheckPow::OFF))
+        return false;
+
+    const unsigned int block_size_limit = block.nVersion == BLOCK_VERSION_SC_SUPPORT ? MAX_BLOCK_SIZE : MAX_BLOCK_SIZE_BEFORE_SC;
+    size_t headerSize = 0;
+    size_t totTxSize = 0;
+    size_t totCertSize = 0;
+    if (block.GetSerializeComponentsSize(headerSize, totTxSize, totCertSize) > block_size_limit ||
+        (block.nVersion == BLOCK_VERSION_SC_SUPPORT && totTxSize > BLOCK_TX_PARTITION_SIZE))
+        return state.DoS(100, error("%s: size limits failed", __func__), CValidationState::Code::INVALID, "bad-blk-length");
+
+    if (!block.vtx[0].IsCoinBase() || !CheckTransactionWithoutProofVerification(block.vtx[0], state))
+        return error("%s: coinbase check failed", __func__);
+    if (!CheckCertificatesOrdering(block.vcert, state))
+        return error("%s: certificate quality ordering check failed", __func__);
+
+    // finality, coinbase height and community funds
+    if (!ContextualCheckBlock(block, state, pindexPrev))
+        return false;
+
+    // the sigops of each entry were counted, P2SH ones included, when it was taken
+    int64_t nSigOps = 0;
+    for (int64_t nTxSigOps : blocktemplate.vTxSigOps)
+        nSigOps += nTxSigOps;
+    for (int64_t nCertSigOps : blocktemplate.vCertSigOps)
+        nSigOps += nCertSigOps;
+    if (nSigOps > MAX_BLOCK_SIGOPS)
+        return state.DoS(100, error("%s: too many sigops", __func__), CValidationState::Code::INVALID, "bad-blk-sigops");
+
+    const CAmount blockReward = nFees + GetBlockSubsidy(pindexPrev->nHeight + 1, Params().GetConsensus());
+    if (block.vtx[0].GetValueOut() > blockReward)
+        return state.DoS(100, error("%s: coinbase pays too much (actual=%d vs limit=%d)", __func__, block.vtx[0].GetValueOut(), blockReward),
+                         CValidationState::Code::INVALID, "bad-cb-amount");
+
+    // the entries were taken in an order of their own, certificates first
+    CCoinsViewCache scView(pcoinsTip);
+    if (!CheckBlockSidechainsApplicability(block, scView, pindexPrev->nHeight + 1, state))
+        return false;
+
+    return true;
+}
+
 CBlockTemplate* CreateNewBlock(const CScript& scriptPubKeyIn,  unsigned int nBlockMaxComplexitySize)
 {
     const CChainParams& chainparams = Params();
+    const int64_t nTimeStart = GetTimeMicros();
     // Create new block
     std::unique_ptr<CBlockTemplate> pblocktemplate(new CBlockTemplate());
     if(!pblocktemplate.get())
@@ -545,13 +838,19 @@ CBlockTemplate* CreateNewBlock(const CScript& scriptPubKeyIn,  unsigned int nBlo
     // All the limits are defined in CommitmentBuilderGuard, and aligned with those defined in CCTPlib.
     // Doing the add on the txsCommitmentGuard is reversible and prevents throwing away and rebuild
     // the commitment tree in case of failure.
-    std::unique_ptr<SidechainTxsCommitmentBuilder> scCommBuilder(new SidechainTxsCommitmentBuilder);
+    // Should the builder fail anyway, or the tx / cert be left out of the block afterwards, the builder
+    // is rolled back to the checkpoint taken before adding it.
+    SidechainTxsCommitmentBuilder scCommBuilder;
     SidechainTxsCommitmentGuard scCommGuard;
 
     // Add dummy coinbase tx as first transaction
     pblock->vtx.push_back(CTransaction());
     pblocktemplate->vTxFees.push_back(-1); // updated at end
     pblocktemplate->vTxSigOps.push_back(-1); // updated at end
+    pblocktemplate->vTxHex.push_back(nullptr);
+    pblocktemplate->vTxDepends.emplace_back();
+    // the index in the block of each of its transactions, for the depends of those spending them
+    map<uint256, int64_t> mapTxIndexes;
 
     int nBlockComplexity = 0;
 
@@ -608,6 +907,9 @@ CBlockTemplate* CreateNewBlock(const CScript& scriptPubKeyIn,  unsigned int nBlo
         nBlockPrioritySize = std::min(nBlockMaxSize, nBlockPrioritySize);
 
         CCoinsViewCache view(pcoinsTip);
+        // ConnectBlock checks the certificates against the sidechains after all the transactions of the block,
+        // so they are checked and applied on a layer of their own, which the transactions taken after them do not see
+        CCoinsViewCache certView(&view);
 
         // Priority order to process transactions
         list<COrphan> vOrphan; // list memory doesn't move
@@ -622,13 +924,20 @@ CBlockTemplate* CreateNewBlock(const CScript& scriptPubKeyIn,  unsigned int nBlo
                 ? nMedianTimePast
                 : pblock->GetBlockTime();
 
+        // Priority data of entries already evaluated for a previous template on the same tip are reused
+        static CBlockPriorityDataCache priorityDataCache;
+        priorityDataCache.Refresh(pindexPrev->GetBlockHash());
+
         bool fDeprecatedGetBlockTemplate = GetBoolArg("-deprecatedgetblocktemplate", false);
         if (fDeprecatedGetBlockTemplate)
             GetBlockTxPriorityDataOld(view, nHeight, nLockTimeCutoff, vecPriority, vOrphan, mapDependers);
         else
-            GetBlockTxPriorityData(view, nHeight, nLockTimeCutoff, vecPriority, vOrphan, mapDependers);
+            GetBlockTxPriorityData(view, nHeight, nLockTimeCutoff, vecPriority, vOrphan, mapDependers, &priorityDataCache);
+
+        GetBlockCertPriorityData(view, nHeight, vecPriority, vOrphan, mapDependers, &priorityDataCache);
 
-        GetBlockCertPriorityData(view, nHeight, vecPriority, vOrphan, mapDependers);
+        // Children paying for their parents, once the entries are taken by fee
+        ApplyPackageFeeRates(vecPriority, vOrphan, mapDependers);
 
         // Collect transactions into block
         uint64_t nBlockSize = 1000;
@@ -649,6 +958,16 @@ CBlockTemplate* CreateNewBlock(const CScript& scriptPubKeyIn,  unsigned int nBlo
         // Used to keep track of the top quality seen so far for any Sidechain ID
         std::unordered_map<uint256, int64_t> topQualityCertMap;
 
+        // Transactions which did not fit one of the limits in a row, while the block is about full
+        unsigned int nConsecutiveFailures = 0;
+        auto failedToFit = [&]() {
+            if (nBlockSize + BLOCK_FULL_MARGIN >= nBlockMaxSize ||
+                nBlockTxPartitionSize + BLOCK_FULL_MARGIN >= nBlockTxPartitionMaxSize ||
+                nBlockSigOps + BLOCK_FULL_MARGIN / 20 >= MAX_BLOCK_SIGOPS ||
+                (nBlockMaxComplexitySize > 0 && nBlockComplexity + BLOCK_FULL_MARGIN >= nBlockMaxComplexitySize))
+                nConsecutiveFailures++;
+        };
+
         // considering certs having a higher priority than any possible tx.
         // An algorithm for managing tx/cert priorities could be devised
         while (!vecPriority.empty())
@@ -680,6 +999,10 @@ CBlockTemplate* CreateNewBlock(const CScript& scriptPubKeyIn,  unsigned int nBlo
                 }
             }
 
+            // Only the certificates are still looked through, past the lookahead of a full block
+            if (!tx.IsCertificate() && nConsecutiveFailures > MAX_CONSECUTIVE_FAILURES)
+                continue;
+
             // Size limits
             unsigned int nTxBaseSize = tx.GetSerializeSize(SER_NETWORK, PROTOCOL_VERSION);
 
@@ -690,6 +1013,7 @@ CBlockTemplate* CreateNewBlock(const CScript& scriptPubKeyIn,  unsigned int nBlo
                 {
                     LogPrint("sc", "%s():%d - Skipping tx[%s] because nBlockTxPartitionMaxSize %d would be exceeded (partSize=%d / txSize=%d)\n",
                         __func__, __LINE__, tx.GetHash().ToString(), nBlockTxPartitionMaxSize, nBlockTxPartitionSize, nTxBaseSize );
+                    failedToFit();
                     continue;
                 }
             }
@@ -698,13 +1022,19 @@ CBlockTemplate* CreateNewBlock(const CScript& scriptPubKeyIn,  unsigned int nBlo
             {
                 LogPrint("sc", "%s():%d - Skipping %s[%s] because nBlockMaxSize %d would be exceeded (blSize=%d / txBaseSize=%d)\n",
                     __func__, __LINE__, tx.IsCertificate()?"cert":"tx", tx.GetHash().ToString(), nBlockMaxSize, nBlockSize, nTxBaseSize );
+                if (!tx.IsCertificate())
+                    failedToFit();
                 continue;
             }
 
             // Legacy limits on sigOps:
             unsigned int nTxSigOps = GetLegacySigOpCount(tx);
             if (nBlockSigOps + nTxSigOps >= MAX_BLOCK_SIGOPS)
+            {
+                if (!tx.IsCertificate())
+                    failedToFit();
                 continue;
+            }
 
             const uint256& hash = tx.GetHash();
 
@@ -732,7 +1062,11 @@ CBlockTemplate* CreateNewBlock(const CScript& scriptPubKeyIn,  unsigned int nBlo
             // Skip transaction if max block complexity reached.
             int nTxComplexity = tx.GetComplexity();
             if (!fDeprecatedGetBlockTemplate && nBlockMaxComplexitySize > 0 && nBlockComplexity + nTxComplexity >= nBlockMaxComplexitySize)
+            {
+                if (!tx.IsCertificate())
+                    failedToFit();
                 continue;
+            }
 
             if (!view.HaveInputs(tx))
             {
@@ -751,6 +1085,7 @@ CBlockTemplate* CreateNewBlock(const CScript& scriptPubKeyIn,  unsigned int nBlo
             }
 
             // Skip transaction if we cannot add it to the sc commitment tree
+            const size_t nScCommCheckpoint = scCommBuilder.checkpoint();
             if (pblock->nVersion == BLOCK_VERSION_SC_SUPPORT) {
                 // Check tx commitment tree limits
                 bool scCommitGuardRes;
@@ -770,23 +1105,17 @@ CBlockTemplate* CreateNewBlock(const CScript& scriptPubKeyIn,  unsigned int nBlo
                 // Try adding to the real commitment tree if previous step was successful
                 bool scCommitmentBuilderResult;
                 if (tx.IsCertificate()) {
-                    scCommitmentBuilderResult = scCommBuilder->add(dynamic_cast<const CScCertificate&>(tx), view);
+                    scCommitmentBuilderResult = scCommBuilder.add(dynamic_cast<const CScCertificate&>(tx), view);
                 }
                 else {
-                    scCommitmentBuilderResult = scCommBuilder->add(dynamic_cast<const CTransaction&>(tx));
+                    scCommitmentBuilderResult = scCommBuilder.add(dynamic_cast<const CTransaction&>(tx));
                 }
                 if (!scCommitmentBuilderResult)
                 {
                     LogPrint("sc", "%s():%d - Skipping [%s] because we cannot add that to the sc commitment tree\n",
                         __func__, __LINE__, tx.GetHash().ToString());
-                    // We cannot undo adding all the FT / BWTR / CERT / CSW contained in the tx that just failed,
-                    // so we have to destroy the scCommBuilder and add all the txs which are currently in the
-                    // block proposal
-                    scCommBuilder.reset(new SidechainTxsCommitmentBuilder);
-                    for (const auto& txInPBlock : pblock->vtx)
-                        scCommBuilder->add(txInPBlock);
-                    for (const auto& certInPBlock : pblock->vcert)
-                        scCommBuilder->add(certInPBlock, view);
+                    // Drop the FT / BWTR / CERT / CSW of the tx that have been added before the failure
+                    scCommBuilder.rollback(nScCommCheckpoint);
 
                     // Also, remove the tx/cert from the commitment guard to keep them aligned
                     if (tx.IsCertificate()) {
@@ -810,23 +1139,72 @@ CBlockTemplate* CreateNewBlock(const CScript& scriptPubKeyIn,  unsigned int nBlo
                 {
                     const CScCertificate& castedCert = dynamic_cast<const CScCertificate&>(tx);
                     if(!ContextualCheckCertInputs(castedCert, dummyState, view, true, chainActive, MANDATORY_SCRIPT_VERIFY_FLAGS | SCRIPT_VERIFY_CHECKBLOCKATHEIGHT, true, Params().GetConsensus()))
+                    {
+                        if (pblock->nVersion == BLOCK_VERSION_SC_SUPPORT) {
+                            scCommBuilder.rollback(nScCommCheckpoint);
+                            scCommGuard.rewind(castedCert);
+                        }
+                        continue;
+                    }
+
+                    CBlockUndo dummyBlockUndo(IncludeScAttributes::ON);
+                    CValidationState::Code scRetCode = certView.IsCertApplicableToState(castedCert);
+                    if (scRetCode != CValidationState::Code::OK || !certView.UpdateSidechain(castedCert, dummyBlockUndo, nHeight))
+                    {
+                        LogPrint("sc", "%s():%d - Skipping cert[%s] because it is not applicable to the sidechain state, ret_code[0x%x]\n",
+                            __func__, __LINE__, castedCert.GetHash().ToString(), CValidationState::CodeToChar(scRetCode));
+                        if (pblock->nVersion == BLOCK_VERSION_SC_SUPPORT) {
+                            scCommBuilder.rollback(nScCommCheckpoint);
+                            scCommGuard.rewind(castedCert);
+                        }
                         continue;
+                    }
 
                     UpdateCoins(castedCert, view, dummyUndo, nHeight, /*isBlockTopQualityCert*/true);
                     pblock->vcert.push_back(castedCert);
                     pblocktemplate.get()->vCertFees.push_back(nTxFees);
                     pblocktemplate.get()->vCertSigOps.push_back(nTxSigOps);
+                    pblocktemplate.get()->vCertHex.push_back(GetMempoolHex(castedCert));
+                    RecordTxTraceStage(castedCert.GetHash(), TxTraceStage::BLOCK_TEMPLATE);
                     ++nBlockCert;
                 } else
                 {
                     const CTransaction& castedTx = dynamic_cast<const CTransaction&>(tx);
                     if (!ContextualCheckTxInputs(castedTx, dummyState, view, true, chainActive, MANDATORY_SCRIPT_VERIFY_FLAGS | SCRIPT_VERIFY_CHECKBLOCKATHEIGHT, true, Params().GetConsensus()))
+                    {
+                        if (pblock->nVersion == BLOCK_VERSION_SC_SUPPORT) {
+                            scCommBuilder.rollback(nScCommCheckpoint);
+                            scCommGuard.rewind(castedTx);
+                        }
+                        continue;
+                    }
+
+                    CValidationState::Code scRetCode = view.IsScTxApplicableToState(castedTx, Sidechain::ScFeeCheckFlag::MINIMUM_IN_A_RANGE);
+                    if (scRetCode != CValidationState::Code::OK || !view.UpdateSidechain(castedTx, *pblock, nHeight))
+                    {
+                        LogPrint("sc", "%s():%d - Skipping tx[%s] because it is not applicable to the sidechain state, ret_code[0x%x]\n",
+                            __func__, __LINE__, castedTx.GetHash().ToString(), CValidationState::CodeToChar(scRetCode));
+                        if (pblock->nVersion == BLOCK_VERSION_SC_SUPPORT) {
+                            scCommBuilder.rollback(nScCommCheckpoint);
+                            scCommGuard.rewind(castedTx);
+                        }
                         continue;
+                    }
 
                     UpdateCoins(castedTx, view, dummyUndo, nHeight);
                     pblock->vtx.push_back(castedTx);
                     pblocktemplate.get()->vTxFees.push_back(nTxFees);
                     pblocktemplate.get()->vTxSigOps.push_back(nTxSigOps);
+                    pblocktemplate.get()->vTxHex.push_back(GetMempoolHex(castedTx));
+                    std::vector<int64_t> vDepends;
+                    for (const CTxIn& txin : castedTx.GetVin()) {
+                        auto itIndex = mapTxIndexes.find(txin.prevout.hash);
+                        if (itIndex != mapTxIndexes.end())
+                            vDepends.push_back(itIndex->second);
+                    }
+                    pblocktemplate.get()->vTxDepends.push_back(std::move(vDepends));
+                    mapTxIndexes[castedTx.GetHash()] = pblock->vtx.size() - 1;
+                    RecordTxTraceStage(castedTx.GetHash(), TxTraceStage::BLOCK_TEMPLATE);
                     ++nBlockTx;
                     nBlockTxPartitionSize += nTxBaseSize;
                 }
@@ -838,6 +1216,7 @@ CBlockTemplate* CreateNewBlock(const CScript& scriptPubKeyIn,  unsigned int nBlo
                 nBlockSigOps += nTxSigOps;
                 nFees += nTxFees;
                 nBlockComplexity += nTxComplexity;
+                nConsecutiveFailures = 0;
 
                 if (fPrintPriority)
                 {
@@ -884,6 +1263,7 @@ CBlockTemplate* CreateNewBlock(const CScript& scriptPubKeyIn,  unsigned int nBlo
 
         nLastBlockSize = nBlockSize;
         nLastBlockTxPartitionSize = nBlockTxPartitionSize;
+        nLastBlockFees = nFees;
 
         LogPrintf("%s():%d - total size %u, tx part size %u, tx[%d]/certs[%d], fee=%d\n",
             __func__, __LINE__, nBlockSize, nBlockTxPartitionSize, nBlockTx, nBlockCert, nFees);
@@ -906,10 +1286,12 @@ CBlockTemplate* CreateNewBlock(const CScript& scriptPubKeyIn,  unsigned int nBlo
             bool retValtxsComm = pblock->UpdateScTxsCommitment(view);
             assert(retValtxsComm);
             // Additional check: this sc commitment must be equal to the one we built on the fly
-            const uint256& scTxsCommitment = scCommBuilder->getCommitment();
+            const uint256& scTxsCommitment = scCommBuilder.getCommitment();
             if (pblock->hashScTxsCommitment != scTxsCommitment) {
                 throw std::runtime_error("CreateNewBlock(): SCTxsCommitment verification failed");
             }
+            // Spare ConnectBlock from building the tree again, when this block gets mined
+            SidechainTxsCommitmentBuilder::storeBlockCommitment(*pblock, scTxsCommitment);
         }
 
         UpdateTime(pblock, Params().GetConsensus(), pindexPrev);
@@ -918,10 +1300,21 @@ CBlockTemplate* CreateNewBlock(const CScript& scriptPubKeyIn,  unsigned int nBlo
         pblocktemplate->vTxSigOps[0] = GetLegacySigOpCount(pblock->vtx[0]);
 
         CValidationState state;
-        if (!TestBlockValidity(state, *pblock, pindexPrev, flagCheckPow::OFF, flagCheckMerkleRoot::OFF, flagScRelatedChecks::OFF))
-            throw std::runtime_error("CreateNewBlock(): TestBlockValidity failed");
+        if (GetBoolArg("-checkblocktemplate", DEFAULT_CHECK_BLOCK_TEMPLATE))
+        {
+            if (!TestBlockValidity(state, *pblock, pindexPrev, flagCheckPow::OFF, flagCheckMerkleRoot::OFF, flagScRelatedChecks::OFF))
+                throw std::runtime_error("CreateNewBlock(): TestBlockValidity failed");
+        }
+        else if (!TestBlockTemplateValidity(state, *pblocktemplate, pindexPrev, nFees))
+        {
+            throw std::runtime_error("CreateNewBlock(): TestBlockTemplateValidity failed");
+        }
     }
 
+    nLastBlockTemplateTime = GetTimeMicros() - nTimeStart;
+    LogPrint("bench", "%s: template with %u txs and %u certs, fees %s, in %.2fms\n", __func__,
+             nLastBlockTx, nLastBlockCert, FormatMoney(nLastBlockFees), nLastBlockTemplateTime * 0.001);
+
     return pblocktemplate.release();
 }
 
@@ -990,7 +1383,7 @@ void IncrementExtraNonce(CBlock* pblock, CBlockIndex* pindexPrev, unsigned int&
     assert(txCoinbase.vin[0].scriptSig.size() <= 100);
 
     pblock->vtx[0] = txCoinbase;
-    pblock->hashMerkleRoot = pblock->BuildMerkleTree();
+    pblock->hashMerkleRoot = pblock->BuildMerkleTree(nullptr, std::max(1, nScriptCheckThreads));
 #ifdef DEBUG_SC_COMMITMENT_HASH
     std::cout << "-------------------------------------------" << std::endl;
     std::cout << "  hashScTxsCommitment: " << pblock->hashScTxsCommitment.ToString() << std::endl;
@@ -1030,25 +1423,218 @@ static bool ProcessBlockFound(CBlock* pblock)
     return true;
 }
 
+namespace {
+
+/** A miner thread, together with the statistics getmininginfo reports about it */
+struct CMinerWorker
+{
+    const int nId;
+    //! The cpu the thread is pinned to and its NUMA node, -1 when not pinned
+    const int nCpu;
+    const int nNode;
+    std::atomic<uint64_t> nSolverRuns {0};
+    std::atomic<uint64_t> nSolutionChecks {0};
+    AtomicTimer timer;
+    //! Set when the block being solved is stale, to stop the default solver
+    std::atomic<bool> fCancel {false};
+
+    CMinerWorker(int nIdIn, int nCpuIn, int nNodeIn) : nId(nIdIn), nCpu(nCpuIn), nNode(nNodeIn) {}
+};
+
+/**
+ * The block template shared by the miner threads. It is built once for all of them, by the first thread
+ * asking for work after it became stale: when the tip changes (the NotifyBlockTip notification also
+ * cancels the running solvers), when the mempool changed and it is older than a minute, or when a
+ * thread used all the nonces of its share. Each thread solves its own copy of the header, with its id
+ * in the top 16 bits of the nonce and a counter in the bottom ones, so that the threads never try
+ * the same nonce.
+ */
+class CSharedMinerTemplate
+{
+private:
+    std::mutex cs;
+    std::shared_ptr<const CBlock> pblock;
+    CBlockIndex* pindexPrev = nullptr;
+    unsigned int nTransactionsUpdated = 0;
+    int64_t nCreated = 0;
+    unsigned int nExtraNonce = 0;
+    uint64_t nGeneration = 0;
+    std::vector<CMinerWorker*> vWorkers;
+
+    bool IsStale() const
+    {
+        return !pblock || pindexPrev != chainActive.Tip() ||
+               (mempool->GetTransactionsUpdated() != nTransactionsUpdated && GetTime() - nCreated > 60);
+    }
+
+public:
 #ifdef ENABLE_WALLET
-void static BitcoinMiner(CWallet *pwallet)
+    //! Guards reservekey, which pays all the templates until a block is found
+    std::mutex csKey;
+    CReserveKey reservekey;
+
+    explicit CSharedMinerTemplate(CWallet* pwallet) : reservekey(pwallet) {}
+#endif
+
+    void AddWorker(CMinerWorker* worker)
+    {
+        std::lock_guard<std::mutex> lock(cs);
+        vWorkers.push_back(worker);
+    }
+
+    //! Drop the template of the given generation, and stop the solvers working on it
+    void Invalidate(uint64_t nGenerationIn)
+    {
+        std::lock_guard<std::mutex> lock(cs);
+        if (nGenerationIn != nGeneration)
+            return;
+        pblock.reset();
+        ++nGeneration;
+        for (CMinerWorker* worker : vWorkers)
+            worker->fCancel = true;
+    }
+
+    void InvalidateCurrent()
+    {
+        std::lock_guard<std::mutex> lock(cs);
+        pblock.reset();
+        ++nGeneration;
+        for (CMinerWorker* worker : vWorkers)
+            worker->fCancel = true;
+    }
+
+    bool IsCurrent(uint64_t nGenerationIn)
+    {
+        std::lock_guard<std::mutex> lock(cs);
+        return nGenerationIn == nGeneration && !IsStale();
+    }
+
+    /** The current template, built if needed; nullptr if it could not be built */
+    std::shared_ptr<const CBlock> Get(uint64_t& nGenerationOut, CBlockIndex*& pindexPrevOut)
+    {
+        std::lock_guard<std::mutex> lock(cs);
+        if (IsStale()) {
+            unsigned int nTransactionsUpdatedLast = mempool->GetTransactionsUpdated();
+            CBlockIndex* pindexTip = chainActive.Tip();
+#ifdef ENABLE_WALLET
+            std::unique_ptr<CBlockTemplate> pblocktemplate;
+            {
+                std::lock_guard<std::mutex> keyLock(csKey);
+                pblocktemplate.reset(CreateNewBlockWithKey(reservekey));
+            }
 #else
-void static BitcoinMiner()
+            std::unique_ptr<CBlockTemplate> pblocktemplate(CreateNewBlockWithKey());
 #endif
+            if (!pblocktemplate)
+                return nullptr;
+
+            IncrementExtraNonce(&pblocktemplate->block, pindexTip, nExtraNonce);
+            LogPrintf("Running HorizenMiner with %u transactions in block (%u bytes)\n", pblocktemplate->block.vtx.size(),
+                ::GetSerializeSize(pblocktemplate->block, SER_NETWORK, PROTOCOL_VERSION));
+
+            pblock = std::make_shared<const CBlock>(std::move(pblocktemplate->block));
+            pindexPrev = pindexTip;
+            nTransactionsUpdated = nTransactionsUpdatedLast;
+            nCreated = GetTime();
+            ++nGeneration;
+        }
+        nGenerationOut = nGeneration;
+        pindexPrevOut = pindexPrev;
+        return pblock;
+    }
+};
+
+std::mutex cs_minerWorkers;
+std::vector<std::unique_ptr<CMinerWorker>> vMinerWorkers;
+std::unique_ptr<CSharedMinerTemplate> pMinerTemplate;
+boost::signals2::connection minerTipConnection;
+
+/**
+ * The cpus of each NUMA node the process may run on, as listed by sysfs. Without NUMA information
+ * all the allowed cpus are reported as a single node; nothing is returned where pinning is not supported.
+ */
+std::vector<std::vector<int>> GetMinerNumaNodes()
 {
-    LogPrintf("HorizenMiner started\n");
-    SetThreadPriority(THREAD_PRIORITY_LOWEST);
-    RenameThread("horizen-miner");
+    std::vector<std::vector<int>> vNodes;
+#ifdef __linux__
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0)
+        return vNodes;
+
+    std::vector<bool> vAssigned(CPU_SETSIZE, false);
+    for (int node = 0; ; ++node) {
+        std::ifstream file(strprintf("/sys/devices/system/node/node%d/cpulist", node));
+        if (!file.is_open())
+            break;
+        std::string strList;
+        std::getline(file, strList);
+        std::vector<int> vCpus;
+        std::vector<std::string> vRanges;
+        boost::split(vRanges, strList, boost::is_any_of(","));
+        for (const std::string& strRange : vRanges) {
+            int nFirst = 0, nLast = 0;
+            const int nFields = sscanf(strRange.c_str(), "%d-%d", &nFirst, &nLast);
+            if (nFields < 1)
+                continue;
+            if (nFields == 1)
+                nLast = nFirst;
+            for (int cpu = nFirst; cpu <= nLast && cpu < CPU_SETSIZE; ++cpu) {
+                if (cpu >= 0 && CPU_ISSET(cpu, &allowed) && !vAssigned[cpu]) {
+                    vCpus.push_back(cpu);
+                    vAssigned[cpu] = true;
+                }
+            }
+        }
+        if (!vCpus.empty())
+            vNodes.push_back(vCpus);
+    }
 
-    const CChainParams& chainparams = Params();
+    if (vNodes.empty()) {
+        std::vector<int> vCpus;
+        for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+            if (CPU_ISSET(cpu, &allowed))
+                vCpus.push_back(cpu);
+        if (!vCpus.empty())
+            vNodes.push_back(vCpus);
+    }
+#endif
+    return vNodes;
+}
+
+bool PinThreadToCpu(int cpu)
+{
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+    return false;
+#endif
+}
+
+} // anon namespace
 
 #ifdef ENABLE_WALLET
-    // Each thread has its own key
-    CReserveKey reservekey(pwallet);
+void static BitcoinMiner(CMinerWorker* worker, CSharedMinerTemplate* shared, CWallet *pwallet)
+#else
+void static BitcoinMiner(CMinerWorker* worker, CSharedMinerTemplate* shared)
 #endif
+{
+    LogPrintf("HorizenMiner started\n");
+    SetThreadPriority(THREAD_PRIORITY_LOWEST);
+    RenameThread("horizen-miner");
 
-    // Each thread has its own counter
-    unsigned int nExtraNonce = 0;
+    // Pin the thread before the solver allocates its memory, so that it is allocated on the local node
+    if (worker->nCpu >= 0) {
+        if (PinThreadToCpu(worker->nCpu))
+            LogPrint("pow", "HorizenMiner %d pinned to cpu %d (node %d)\n", worker->nId, worker->nCpu, worker->nNode);
+        else
+            LogPrintf("HorizenMiner %d could not be pinned to cpu %d\n", worker->nId, worker->nCpu);
+    }
+
+    const CChainParams& chainparams = Params();
 
     unsigned int n = chainparams.EquihashN();
     unsigned int k = chainparams.EquihashK();
@@ -1057,15 +1643,15 @@ void static BitcoinMiner()
     assert(solver == "tromp" || solver == "default");
     LogPrint("pow", "Using Equihash solver \"%s\" with n = %u, k = %u\n", solver, n, k);
 
-    std::mutex m_cs;
-    bool cancelSolver = false;
-    boost::signals2::connection c = uiInterface.NotifyBlockTip.connect(
-        [&m_cs, &cancelSolver](const uint256& hashNewTip) mutable {
-            std::lock_guard<std::mutex> lock{m_cs};
-            cancelSolver = true;
-        }
-    );
+    // The solver memory is allocated once, and only reset for each nonce
+    const bool fHugePages = GetBoolArg("-minerhugepages", DEFAULT_MINER_HUGE_PAGES);
+    std::unique_ptr<equi> eq;
+    if (solver == "tromp")
+        eq.reset(new equi(1, fHugePages));
+    EhSolverWorkspace workspace(fHugePages);
+
     miningTimer.start();
+    worker->timer.start();
 
     try {
         while (true) {
@@ -1073,6 +1659,7 @@ void static BitcoinMiner()
                 // Busy-wait for the network to come online so we don't waste time mining
                 // on an obsolete chain. In regtest mode we expect to fly solo.
                 miningTimer.stop();
+                worker->timer.stop();
                 do {
                     bool fvNodesEmpty;
                     {
@@ -1084,20 +1671,17 @@ void static BitcoinMiner()
                     MilliSleep(1000);
                 } while (true);
                 miningTimer.start();
+                worker->timer.start();
             }
 
             //
-            // Create new block
+            // Get the shared block template
             //
-            unsigned int nTransactionsUpdatedLast = mempool->GetTransactionsUpdated();
-            CBlockIndex* pindexPrev = chainActive.Tip();
-
-#ifdef ENABLE_WALLET
-            unique_ptr<CBlockTemplate> pblocktemplate(CreateNewBlockWithKey(reservekey));
-#else
-            unique_ptr<CBlockTemplate> pblocktemplate(CreateNewBlockWithKey());
-#endif
-            if (!pblocktemplate.get())
+            uint64_t nGeneration = 0;
+            CBlockIndex* pindexPrev = nullptr;
+            worker->fCancel = false;
+            std::shared_ptr<const CBlock> ptemplate = shared->Get(nGeneration, pindexPrev);
+            if (!ptemplate)
             {
                 if (GetArg("-mineraddress", "").empty()) {
                     LogPrintf("Error in HorizenMiner: Keypool ran out, please call keypoolrefill before restarting the mining thread\n");
@@ -1105,17 +1689,17 @@ void static BitcoinMiner()
                     // Should never reach here, because -mineraddress validity is checked in init.cpp
                     LogPrintf("Error in HorizenMiner: Invalid -mineraddress\n");
                 }
-                return;
+                break;
             }
-            CBlock *pblock = &pblocktemplate->block;
-            IncrementExtraNonce(pblock, pindexPrev, nExtraNonce);
-            LogPrintf("Running HorizenMiner with %u transactions in block (%u bytes)\n", pblock->vtx.size(),
-                ::GetSerializeSize(*pblock, SER_NETWORK, PROTOCOL_VERSION));
+            CBlock block = *ptemplate;
+            CBlock *pblock = &block;
+
+            // The top 16 bits of the nonce are left clear by CreateNewBlock for the thread id
+            pblock->nNonce = ArithToUint256(UintToArith256(pblock->nNonce) | (arith_uint256(worker->nId & 0xffff) << 240));
 
             //
             // Search
             //
-            int64_t nStart = GetTime();
             arith_uint256 hashTarget = arith_uint256().SetCompact(pblock->nBits);
 
             while (true) {
@@ -1144,15 +1728,16 @@ void static BitcoinMiner()
 
                 std::function<bool(std::vector<unsigned char>)> validBlock =
 #ifdef ENABLE_WALLET
-                        [&pblock, &hashTarget, pwallet, &reservekey, &m_cs, &cancelSolver, &chainparams]
+                        [&pblock, &hashTarget, pwallet, shared, worker, &chainparams]
 #else
-                        [&pblock, &hashTarget, &m_cs, &cancelSolver, &chainparams]
+                        [&pblock, &hashTarget, worker, &chainparams]
 #endif
                         (std::vector<unsigned char> soln) {
                     // Write the solution to the hash and compute the result.
                     LogPrint("pow", "- Checking solution against target\n");
                     pblock->nSolution = soln;
                     solutionTargetChecks.increment();
+                    worker->nSolutionChecks.fetch_add(1, std::memory_order_relaxed);
 
                     if (UintToArith256(pblock->GetHash()) > hashTarget) {
                         return false;
@@ -1162,14 +1747,18 @@ void static BitcoinMiner()
                     SetThreadPriority(THREAD_PRIORITY_NORMAL);
                     LogPrintf("HorizenMiner:\n");
                     LogPrintf("proof-of-work found  \n  hash: %s  \ntarget: %s\n", pblock->GetHash().GetHex(), hashTarget.GetHex());
+                    bool fProcessed;
 #ifdef ENABLE_WALLET
-                    if (ProcessBlockFound(pblock, pwallet, reservekey)) {
+                    {
+                        std::lock_guard<std::mutex> keyLock(shared->csKey);
+                        fProcessed = ProcessBlockFound(pblock, pwallet, shared->reservekey);
+                    }
 #else
-                    if (ProcessBlockFound(pblock)) {
+                    fProcessed = ProcessBlockFound(pblock);
 #endif
+                    if (fProcessed) {
                         // Ignore chain updates caused by us
-                        std::lock_guard<std::mutex> lock{m_cs};
-                        cancelSolver = false;
+                        worker->fCancel = false;
                     }
                     SetThreadPriority(THREAD_PRIORITY_LOWEST);
 
@@ -1177,40 +1766,40 @@ void static BitcoinMiner()
                     if (chainparams.MineBlocksOnDemand()) {
                         // Increment here because throwing skips the call below
                         ehSolverRuns.increment();
+                        worker->nSolverRuns.fetch_add(1, std::memory_order_relaxed);
                         throw boost::thread_interrupted();
                     }
 
                     return true;
                 };
-                std::function<bool(EhSolverCancelCheck)> cancelled = [&m_cs, &cancelSolver](EhSolverCancelCheck pos) {
-                    std::lock_guard<std::mutex> lock{m_cs};
-                    return cancelSolver;
+                std::function<bool(EhSolverCancelCheck)> cancelled = [worker](EhSolverCancelCheck pos) {
+                    return worker->fCancel.load();
                 };
 
                 // TODO: factor this out into a function with the same API for each solver.
                 if (solver == "tromp") {
-                    // Create solver and initialize it.
-                    equi eq(1);
-                    eq.setstate(&curr_state);
+                    // Initialize the solver.
+                    eq->setstate(&curr_state);
 
                     // Intialization done, start algo driver.
-                    eq.digit0(0);
-                    eq.xfull = eq.bfull = eq.hfull = 0;
-                    eq.showbsizes(0);
+                    eq->digit0(0);
+                    eq->xfull = eq->bfull = eq->hfull = 0;
+                    eq->showbsizes(0);
                     for (u32 r = 1; r < WK; r++) {
-                        (r&1) ? eq.digitodd(r, 0) : eq.digiteven(r, 0);
-                        eq.xfull = eq.bfull = eq.hfull = 0;
-                        eq.showbsizes(r);
+                        (r&1) ? eq->digitodd(r, 0) : eq->digiteven(r, 0);
+                        eq->xfull = eq->bfull = eq->hfull = 0;
+                        eq->showbsizes(r);
                     }
-                    eq.digitK(0);
+                    eq->digitK(0);
                     ehSolverRuns.increment();
+                    worker->nSolverRuns.fetch_add(1, std::memory_order_relaxed);
 
                     // Convert solution indices to byte array (decompress) and pass it to validBlock method.
-                    for (size_t s = 0; s < eq.nsols; s++) {
+                    for (size_t s = 0; s < eq->nsols; s++) {
                         LogPrint("pow", "Checking solution %d\n", s+1);
                         std::vector<eh_index> index_vector(PROOFSIZE);
                         for (size_t i = 0; i < PROOFSIZE; i++) {
-                            index_vector[i] = eq.sols[s][i];
+                            index_vector[i] = eq->sols[s][i];
                         }
                         std::vector<unsigned char> sol_char = GetMinimalFromIndices(index_vector, DIGITBITS);
 
@@ -1223,15 +1812,15 @@ void static BitcoinMiner()
                 } else {
                     try {
                         // If we find a valid block, we rebuild
-                        bool found = EhOptimisedSolve(n, k, curr_state, validBlock, cancelled);
+                        bool found = EhOptimisedSolve(n, k, curr_state, validBlock, cancelled, &workspace);
                         ehSolverRuns.increment();
+                        worker->nSolverRuns.fetch_add(1, std::memory_order_relaxed);
                         if (found) {
                             break;
                         }
                     } catch (EhSolverCancelledException&) {
                         LogPrint("pow", "Equihash solver cancelled\n");
-                        std::lock_guard<std::mutex> lock{m_cs};
-                        cancelSolver = false;
+                        worker->fCancel = false;
                     }
                 }
 
@@ -1240,11 +1829,12 @@ void static BitcoinMiner()
                 // Regtest mode doesn't require peers
                 if (connman->vNodes.empty() && chainparams.MiningRequiresPeers())
                     break;
-                if ((UintToArith256(pblock->nNonce) & 0xffff) == 0xffff)
-                    break;
-                if (mempool->GetTransactionsUpdated() != nTransactionsUpdatedLast && GetTime() - nStart > 60)
+                if ((UintToArith256(pblock->nNonce) & 0xffff) == 0xffff) {
+                    // this thread used all the nonces of its share of the template
+                    shared->Invalidate(nGeneration);
                     break;
-                if (pindexPrev != chainActive.Tip())
+                }
+                if (!shared->IsCurrent(nGeneration))
                     break;
 
                 // Update nNonce and nTime
@@ -1256,19 +1846,19 @@ void static BitcoinMiner()
     catch (const boost::thread_interrupted&)
     {
         miningTimer.stop();
-        c.disconnect();
+        worker->timer.stop();
         LogPrintf("HorizenMiner terminated\n");
         throw;
     }
     catch (const std::runtime_error &e)
     {
         miningTimer.stop();
-        c.disconnect();
+        worker->timer.stop();
         LogPrintf("HorizenMiner runtime error: %s\n", e.what());
         return;
     }
     miningTimer.stop();
-    c.disconnect();
+    worker->timer.stop();
 }
 
 #ifdef ENABLE_WALLET
@@ -1290,17 +1880,66 @@ void GenerateBitcoins(bool fGenerate, int nThreads)
         minerThreads = NULL;
     }
 
+    std::lock_guard<std::mutex> lock(cs_minerWorkers);
+    minerTipConnection.disconnect();
+    vMinerWorkers.clear();
+    pMinerTemplate.reset();
+
     if (nThreads == 0 || !fGenerate)
         return;
 
+#ifdef ENABLE_WALLET
+    pMinerTemplate.reset(new CSharedMinerTemplate(pwallet));
+#else
+    pMinerTemplate.reset(new CSharedMinerTemplate());
+#endif
+    CSharedMinerTemplate* shared = pMinerTemplate.get();
+    minerTipConnection = uiInterface.NotifyBlockTip.connect([shared](const uint256& hashNewTip) {
+        shared->InvalidateCurrent();
+    });
+
+    // The threads are spread over the NUMA nodes in turn, each one pinned to its own cpu
+    std::vector<std::vector<int>> vNodes;
+    if (GetBoolArg("-minerpinthreads", DEFAULT_MINER_PIN_THREADS))
+        vNodes = GetMinerNumaNodes();
+    size_t nCpus = 0;
+    for (const std::vector<int>& vCpus : vNodes)
+        nCpus += vCpus.size();
+
     minerThreads = new boost::thread_group();
     for (int i = 0; i < nThreads; i++) {
+        int nCpu = -1, nNode = -1;
+        if (nCpus > 0) {
+            nNode = i % vNodes.size();
+            nCpu = vNodes[nNode][(i / vNodes.size()) % vNodes[nNode].size()];
+        }
+        vMinerWorkers.emplace_back(new CMinerWorker(i, nCpu, nNode));
+        CMinerWorker* worker = vMinerWorkers.back().get();
+        shared->AddWorker(worker);
 #ifdef ENABLE_WALLET
-        minerThreads->create_thread(boost::bind(&BitcoinMiner, pwallet));
+        minerThreads->create_thread(boost::bind(&BitcoinMiner, worker, shared, pwallet));
 #else
-        minerThreads->create_thread(&BitcoinMiner);
+        minerThreads->create_thread(boost::bind(&BitcoinMiner, worker, shared));
 #endif
     }
 }
 
+std::vector<CMinerWorkerInfo> GetMinerWorkersInfo()
+{
+    std::lock_guard<std::mutex> lock(cs_minerWorkers);
+    std::vector<CMinerWorkerInfo> vInfo;
+    for (const std::unique_ptr<CMinerWorker>& worker : vMinerWorkers) {
+        CMinerWorkerInfo info;
+        info.nId = worker->nId;
+        info.nCpu = worker->nCpu;
+        info.nNode = worker->nNode;
+        info.nSolverRuns = worker->nSolverRuns.load();
+        info.nSolutionChecks = worker->nSolutionChecks.load();
+        const int64_t nDuration = worker->timer.duration();
+        info.dSolPS = nDuration > 0 ? (double)info.nSolutionChecks / nDuration : 0;
+        vInfo.push_back(info);
+    }
+    return vInfo;
+}
+
 #endif // ENABLE_MINING
@@ -10,8 +10,11 @@
 
 #include <boost/tuple/tuple.hpp>
 
+#include <memory>
 #include <optional>
 #include <stdint.h>
+#include <string>
+#include <vector>
 
 class CBlockIndex;
 class CScript;
@@ -21,6 +24,18 @@ class CWallet;
 #endif
 namespace Consensus { struct Params; };
 class CCoinsViewCache;
+class CMemPoolEntry;
+class CValidationState;
+
+/** Default for -checkblocktemplate */
+static const bool DEFAULT_CHECK_BLOCK_TEMPLATE = false;
+/** Default for -blocktemplatefeedelta */
+static const CAmount DEFAULT_BLOCK_TEMPLATE_FEE_DELTA = 100000;
+/**
+ * The fees newly added to the mempool after which getblocktemplate long poll clients are handed
+ * a new template, without waiting for the template to be a minute old
+ */
+extern CAmount nBlockTemplateFeeDelta;
 
 struct CBlockTemplate
 {
@@ -29,6 +44,11 @@ struct CBlockTemplate
     std::vector<int64_t> vTxSigOps;
     std::vector<CAmount> vCertFees;
     std::vector<int64_t> vCertSigOps;
+    //! The hex serializations, shared with the mempool entries they were taken from; null for the coinbase
+    std::vector<std::shared_ptr<const std::string> > vTxHex;
+    std::vector<std::shared_ptr<const std::string> > vCertHex;
+    //! For each transaction, the index in the block of the earlier one each of its inputs spends, if any
+    std::vector<std::vector<int64_t> > vTxDepends;
 };
 
 //
@@ -60,15 +80,77 @@ public:
     bool operator()(const TxPriority& a, const TxPriority& b);
 };
 
+/**
+ * Priority data of mempool txes/certs kept across CreateNewBlock calls, so that a new template only
+ * has to evaluate entries which entered the mempool since the previous one.
+ * Data of an entry only depend on the entry itself, on its in-mempool dependencies and on the chain tip,
+ * hence everything is dropped when the tip changes. Must be accessed while holding mempool->cs.
+ */
+class CBlockPriorityDataCache
+{
+public:
+    struct Entry
+    {
+        bool fSkip = false;              //! entry has inconsistent dependencies and can not be mined
+        std::set<uint256> setDependsOn;  //! in-mempool dependencies, empty if entry can be mined right away
+        double dPriority = 0;
+        CFeeRate feeRate;
+        double dPriorityDelta = 0;       //! prioritisation deltas already applied to dPriority and feeRate
+        CAmount nFeeDelta = 0;
+        CAmount nEntryFee = 0;           //! used to tell apart a different mempool entry with same hash
+        int64_t nEntryTime = 0;
+    };
+
+    /** Drop everything if the tip has changed, otherwise only entries no longer in mempool */
+    void Refresh(const uint256& tipHash);
+    void Clear();
+    size_t Size() const { return mapEntries.size(); }
+
+    /** Fill priority data of txBase from its cached entry, if still valid. Returns false on cache miss */
+    bool Apply(const CTransactionBase& txBase, const CMemPoolEntry& mpEntry, std::vector<TxPriority>& vecPriority,
+               std::list<COrphan>& vOrphan, std::map<uint256, std::vector<COrphan*> >& mapDependers) const;
+    /** Store priority data of txBase as just computed. porphan is null unless it has in-mempool dependencies */
+    void Store(const CTransactionBase& txBase, const CMemPoolEntry& mpEntry, bool fSkip,
+               const std::vector<TxPriority>& vecPriority, const COrphan* porphan);
+
+private:
+    uint256 tipHash;
+    std::map<uint256, Entry> mapEntries;
+};
+
 /** Retrieve mempool transactions priority info */
 void GetBlockTxPriorityData(const CCoinsViewCache& view, int nHeight, int64_t nLockTimeCutoff,
-                               std::vector<TxPriority>& vecPriority, std::list<COrphan>& vOrphan, std::map<uint256, std::vector<COrphan*> >& mapDependers);
+                               std::vector<TxPriority>& vecPriority, std::list<COrphan>& vOrphan, std::map<uint256, std::vector<COrphan*> >& mapDependers,
+                               CBlockPriorityDataCache* pcache = nullptr);
 /** DEPRECATED. Retrieve mempool transactions priority info */
 void GetBlockTxPriorityDataOld(const CCoinsViewCache& view, int nHeight, int64_t nLockTimeCutoff,
                                std::vector<TxPriority>& vecPriority, std::list<COrphan>& vOrphan, std::map<uint256, std::vector<COrphan*> >& mapDependers);
 
 void GetBlockCertPriorityData(const CCoinsViewCache& view, int nHeight,
-                              std::vector<TxPriority>& vecPriority, std::list<COrphan>& vOrphan, std::map<uint256, std::vector<COrphan*> >& mapDependers);
+                              std::vector<TxPriority>& vecPriority, std::list<COrphan>& vOrphan, std::map<uint256, std::vector<COrphan*> >& mapDependers,
+                              CBlockPriorityDataCache* pcache = nullptr);
+
+//! The most in-mempool descendants an entry is ordered by the fee rate of, together with them
+static const unsigned int MAX_PACKAGE_DESCENDANTS = 25;
+/**
+ * Raise the fee rates of the entries to those of the packages they make with their descendants in
+ * mapDependers, when these pay for them, so that a child paying for its parent gets both in the block.
+ * The descendants still wait for their parents to be in the block, at their own package fee rates.
+ * Requires mempool->cs.
+ */
+void ApplyPackageFeeRates(std::vector<TxPriority>& vecPriority, std::list<COrphan>& vOrphan,
+                          const std::map<uint256, std::vector<COrphan*> >& mapDependers);
+
+//! Once the block is this close to one of its limits, the entries are no longer looked through
+//! after MAX_CONSECUTIVE_FAILURES consecutive transactions which did not fit
+static const unsigned int BLOCK_FULL_MARGIN = 4000;
+static const unsigned int MAX_CONSECUTIVE_FAILURES = 1000;
+
+/**
+ * The sidechain state checks ConnectBlock runs on the entries of block, which need no script nor proof: the
+ * transactions, then the certificates, are to be applicable to the sidechains of view, updated as they are connected
+ */
+bool CheckBlockSidechainsApplicability(const CBlock& block, CCoinsViewCache& view, int nHeight, CValidationState& state);
 
 /** Generate a new block, without valid proof-of-work */
 CBlockTemplate* CreateNewBlock(const CScript& scriptPubKeyIn);
@@ -84,6 +166,22 @@ CBlockTemplate* CreateNewBlockWithKey();
 CMutableTransaction createCoinbase(const CScript &scriptPubKeyIn, CAmount fees, const int nHeight);
 
 #ifdef ENABLE_MINING
+static const bool DEFAULT_MINER_PIN_THREADS = true;
+static const bool DEFAULT_MINER_HUGE_PAGES = false;
+
+/** What getmininginfo reports about a miner thread */
+struct CMinerWorkerInfo
+{
+    int nId;
+    //! The cpu the thread is pinned to and its NUMA node, -1 when not pinned
+    int nCpu;
+    int nNode;
+    uint64_t nSolverRuns;
+    uint64_t nSolutionChecks;
+    //! Solutions checked per second of mining
+    double dSolPS;
+};
+
 /** Modify the extranonce in a block */
 void IncrementExtraNonce(CBlock* pblock, CBlockIndex* pindexPrev, unsigned int& nExtraNonce);
 /** Run the miner threads */
@@ -92,6 +190,8 @@ void GenerateBitcoins(bool fGenerate, CWallet* pwallet, int nThreads);
  #else
 void GenerateBitcoins(bool fGenerate, int nThreads);
  #endif
+/** The miner threads started by the last call to GenerateBitcoins */
+std::vector<CMinerWorkerInfo> GetMinerWorkersInfo();
 #endif
 
 void UpdateTime(CBlockHeader* pblock, const Consensus::Params& consensusParams, const CBlockIndex* pindexPrev);
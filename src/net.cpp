@@ -14,6 +14,7 @@
 #include "clientversion.h"
 #include "primitives/transaction.h"
 #include "scheduler.h"
+#include "txtrace.h"
 #include "ui_interface.h"
 #include "crypto/common.h"
 #include "zen/utiltls.h"
@@ -23,8 +24,21 @@
 #include <string.h>
 #else
 #include <fcntl.h>
+#include <sys/uio.h>
 #endif
 
+#if defined(__linux__)
+#define USE_EPOLL
+#include <sys/epoll.h>
+#elif defined(__APPLE__) || defined(__FreeBSD__) || defined(__OpenBSD__)
+#define USE_KQUEUE
+#include <sys/event.h>
+#include <sys/time.h>
+#endif
+
+#include <functional>
+#include <math.h>
+
 #include <openssl/conf.h>
 #include <openssl/ssl.h>
 #include <openssl/err.h>
@@ -66,8 +80,8 @@ static bool vfLimited[NET_MAX] = {};
 uint64_t nLocalHostNonce = 0;  //// This is part of CNode
 CAddrMan addrman;
 TLSManager tlsmanager = TLSManager();
-std::map<CInv, CDataStream> mapRelay;
-std::deque<std::pair<int64_t, CInv> > vRelayExpiration;
+std::map<uint256, std::shared_ptr<const CSerializeData> > mapRelay;
+std::deque<std::pair<int64_t, uint256> > vRelayExpiration;
 CCriticalSection cs_mapRelay;
 
 // Signals for message handling
@@ -94,6 +108,18 @@ unsigned short GetListenPort()
     return (unsigned short)(GetArg("-port", Params().GetDefaultPort()));
 }
 
+std::vector<std::string> GetSocketEventsModes()
+{
+    std::vector<std::string> vModes;
+#if defined(USE_EPOLL)
+    vModes.push_back("epoll");
+#elif defined(USE_KQUEUE)
+    vModes.push_back("kqueue");
+#endif
+    vModes.push_back("select");
+    return vModes;
+}
+
 // find 'best' local address for a particular peer
 bool GetLocal(CService& addr, const CNetAddr *paddrPeer)
 {
@@ -134,7 +160,7 @@ static std::vector<CAddress> convertSeed6(const std::vector<SeedSpec6> &vSeedsIn
         struct in6_addr ip;
         memcpy(&ip, i->addr, sizeof(ip));
         CAddress addr(CService(ip, i->port));
-        addr.nTime = GetTime() - GetRand(nOneWeek) - nOneWeek;
+        addr.nTime = GetTime() - GetFastRand(nOneWeek) - nOneWeek;
         vSeedsOut.push_back(addr);
     }
     return vSeedsOut;
@@ -182,7 +208,7 @@ void AdvertizeLocal(CNode *pnode)
         // tells us that it sees us as in case it has a better idea of our
         // address than we do.
         if (IsPeerAddrLocalGood(pnode) && (!addrLocal.IsRoutable() ||
-             GetRand((GetnScore(addrLocal) > LOCAL_MANUAL) ? 8:2) == 0))
+             GetFastRand((GetnScore(addrLocal) > LOCAL_MANUAL) ? 8:2) == 0))
         {
             addrLocal.SetIP(pnode->addrLocal);
         }
@@ -359,7 +385,7 @@ CNode* CConnman::ConnectNode(CAddress addrConnect, const char *pszDest)
     if (pszDest ? ConnectSocketByName(addrConnect, hSocket, pszDest, Params().GetDefaultPort(), nConnectTimeout, &proxyConnectionFailed) :
                   ConnectSocket(addrConnect, hSocket, nConnectTimeout, &proxyConnectionFailed))
     {
-        if (!IsSelectableSocket(hSocket)) {
+        if (fSelectableSocketsOnly && !IsSelectableSocket(hSocket)) {
             LogPrintf("Cannot create connection: non-selectable socket created (fd >= FD_SETSIZE ?)\n");
             CloseSocket(hSocket);
             return NULL;
@@ -368,6 +394,7 @@ CNode* CConnman::ConnectNode(CAddress addrConnect, const char *pszDest)
         addrman.Attempt(addrConnect);
 
         SSL *ssl = NULL;
+        int64_t nHandshakeTime = 0;
         
 #ifdef USE_TLS
         /* TCP connection is ready. Do client side SSL. */
@@ -386,7 +413,7 @@ CNode* CConnman::ConnectNode(CAddress addrConnect, const char *pszDest)
                 unsigned long err_code = 0;
                 if (bUseTLS)
                 {
-                    ssl = tlsmanager.connect(hSocket, addrConnect, err_code);
+                    ssl = tlsmanager.connect(hSocket, addrConnect, err_code, nHandshakeTime);
                     if (!ssl)
                     {
                         if (err_code == TLSManager::SELECT_TIMEDOUT)
@@ -423,7 +450,7 @@ CNode* CConnman::ConnectNode(CAddress addrConnect, const char *pszDest)
         else
         {
             unsigned long err_code = 0;
-            ssl = tlsmanager.connect(hSocket, addrConnect, err_code);
+            ssl = tlsmanager.connect(hSocket, addrConnect, err_code, nHandshakeTime);
             if(!ssl)
             {
                 LogPrint("tls", "%s():%d - err_code %x, connection to %s failed)\n",
@@ -446,15 +473,19 @@ CNode* CConnman::ConnectNode(CAddress addrConnect, const char *pszDest)
                 return NULL;
             }
         }
+        if (ssl)
+            RecordTLSHandshake(false, nHandshakeTime, SSL_session_reused(ssl));
 #endif  // USE_TLS
 
         // Add node
         CNode* pnode = new CNode(hSocket, addrConnect, pszDest ? pszDest : "", false, ssl);
+        pnode->nTLSHandshakeTime = nHandshakeTime;
         pnode->AddRef();
 
         {
             LOCK(cs_vNodes);
             vNodes.push_back(pnode);
+            nNodesGeneration++;
         }
 
         pnode->nTimeConnected = GetTime();
@@ -612,6 +643,29 @@ bool CConnman::IsWhitelistedRange(const CNetAddr &addr) {
 }
 
 
+void CConnman::CopyNodeStats(std::vector<CNodeStats>& vstats, uint64_t& nGeneration)
+{
+    std::vector<CNode*> vNodesCopy;
+    {
+        LOCK(cs_vNodes);
+        nGeneration = nNodesGeneration;
+        vNodesCopy = vNodes;
+        for (CNode* pnode : vNodesCopy)
+            pnode->AddRef();
+    }
+
+    vstats.clear();
+    vstats.reserve(vNodesCopy.size());
+    for (CNode* pnode : vNodesCopy) {
+        vstats.emplace_back();
+        pnode->copyStats(vstats.back());
+    }
+
+    LOCK(cs_vNodes);
+    for (CNode* pnode : vNodesCopy)
+        pnode->Release();
+}
+
 #undef X
 #define X(name) stats.name = name
 void CNode::copyStats(CNodeStats &stats)
@@ -628,9 +682,13 @@ void CNode::copyStats(CNodeStats &stats)
     X(fInbound);
     X(nStartingHeight);
     X(nSendBytes);
-    X(mapSendBytesPerMsgType);
     X(nRecvBytes);
-    X(mapRecvBytesPerMsgType);
+    for (const auto& entry : mapSendBytesPerMsgType)
+        stats.mapSendBytesPerMsgType[entry.first] = {entry.second.nMessages.load(std::memory_order_relaxed),
+                                                     entry.second.nBytes.load(std::memory_order_relaxed)};
+    for (const auto& entry : mapRecvBytesPerMsgType)
+        stats.mapRecvBytesPerMsgType[entry.first] = {entry.second.nMessages.load(std::memory_order_relaxed),
+                                                     entry.second.nBytes.load(std::memory_order_relaxed)};
     X(fWhitelisted);
     X(m_addr_rate_limited);
     X(m_addr_processed);
@@ -653,15 +711,47 @@ void CNode::copyStats(CNodeStats &stats)
     // Leave string empty if addrLocal invalid (not filled in yet)
     stats.addrLocal = addrLocal.IsValid() ? addrLocal.ToString() : "";
 
-    // If ssl != NULL it means TLS connection was established successfully
+    // If ssl != NULL it means TLS connection was established successfully. The handshake is over
+    // before the node is created, the state is only read once rather than verifying the certificate
+    // chain again at each call
+    if (!fTLSStatsCached.load(std::memory_order_acquire))
     {
         LOCK(cs_hSocket);
-        stats.fTLSEstablished = (ssl != NULL) && (SSL_get_state(ssl) == TLS_ST_OK);
-        stats.fTLSVerified = (ssl != NULL) && ValidatePeerCertificate(ssl);
+        if (!fTLSStatsCached.load(std::memory_order_relaxed))
+        {
+            fTLSEstablishedCached = (ssl != NULL) && (SSL_get_state(ssl) == TLS_ST_OK);
+            fTLSVerifiedCached = (ssl != NULL) && ValidatePeerCertificate(ssl);
+            fTLSResumedCached = (ssl != NULL) && SSL_session_reused(ssl);
+            fTLSStatsCached.store(true, std::memory_order_release);
+        }
     }
+    stats.fTLSEstablished = fTLSEstablishedCached;
+    stats.fTLSVerified = fTLSVerifiedCached;
+    stats.fTLSResumed = fTLSResumedCached;
+    stats.dTLSHandshakeTime = ((double)nTLSHandshakeTime) / 1e6;
+    stats.dProofVerificationCost = ((double)GetProofVerificationCost()) / 1e6;
 }
 #undef X
 
+static double DecayProofCost(double dCost, int64_t nElapsed)
+{
+    return nElapsed > 0 ? dCost * std::exp2(-static_cast<double>(nElapsed) / PROOF_COST_HALF_LIFE) : dCost;
+}
+
+void CNode::AddProofVerificationCost(int64_t nCostMicros)
+{
+    const int64_t nNow = GetTime();
+    LOCK(cs_proofCost);
+    dProofCost = DecayProofCost(dProofCost, nNow - nProofCostTime) + std::max<int64_t>(nCostMicros, 0);
+    nProofCostTime = nNow;
+}
+
+int64_t CNode::GetProofVerificationCost() const
+{
+    LOCK(cs_proofCost);
+    return static_cast<int64_t>(DecayProofCost(dProofCost, GetTime() - nProofCostTime));
+}
+
 // requires LOCK(cs_vRecvMsg)
 bool CNode::ReceiveMsgBytes(const char *pch, unsigned int nBytes)
 {
@@ -670,7 +760,7 @@ bool CNode::ReceiveMsgBytes(const char *pch, unsigned int nBytes)
         // get current incomplete message, or create a new one
         if (vRecvMsg.empty() ||
             vRecvMsg.back().complete())
-            vRecvMsg.push_back(CNetMessage(Params().MessageStart(), SER_NETWORK, nRecvVersion));
+            vRecvMsg.emplace_back(Params().MessageStart(), SER_NETWORK, nRecvVersion);
 
         CNetMessage& msg = vRecvMsg.back();
 
@@ -708,7 +798,8 @@ bool CNode::ReceiveMsgBytes(const char *pch, unsigned int nBytes)
 
             AccountForRecvBytes(msg.hdr.pchCommand, msg.hdr.nMessageSize + CMessageHeader::HEADER_SIZE);
             msg.nTime = GetTimeMicros();
-            connman->condMsgProc.notify_one();
+            // the peer may be served by any of the message handler threads
+            connman->condMsgProc.notify_all();
         }
     }
 
@@ -762,11 +853,14 @@ int CNetMessage::readData(const char *pch, unsigned int nBytes)
     unsigned int nCopy = std::min(nRemaining, nBytes);
 
     if (vRecv.size() < nDataPos + nCopy) {
-        // Allocate up to 256 KiB ahead, but never more than the total message size.
-        vRecv.resize(std::min(hdr.nMessageSize, nDataPos + nCopy + 256 * 1024));
+        // Allocate at least 256 KiB ahead and then as much as received, so that a large message is only
+        // reallocated a few times, but never more than the total message size: the memory a peer makes
+        // us allocate stays within twice what it actually sent.
+        vRecv.resize(std::min<size_t>(hdr.nMessageSize, std::max<size_t>(nDataPos + nCopy + 256 * 1024, 2 * (nDataPos + nCopy))));
     }
 
     memcpy(&vRecv[nDataPos], pch, nCopy);
+    hasher.Write(reinterpret_cast<const unsigned char*>(pch), nCopy);
     nDataPos += nCopy;
 
     // reject messages larger than MAX_PROTOCOL_MESSAGE_LENGTH or MAX_SERIALIZED_COMPACT_SIZE
@@ -782,7 +876,10 @@ int CNetMessage::readData(const char *pch, unsigned int nBytes)
 
 unsigned int CNetMessage::ComputeMessageChecksum()
 {
-    uint256 hash = Hash(vRecv.begin(), vRecv.begin() + hdr.nMessageSize);
+    // the data was hashed as it arrived, on the socket handler thread, so that a large message does not
+    // hold it back at once
+    uint256 hash;
+    hasher.Finalize(hash.begin());
     return ReadLE32((unsigned char*)&hash);
 }
 
@@ -800,8 +897,10 @@ CConnman::CConnman() {
 
 void CConnman::Stop()
 {
-    if (threadMessageHandler.joinable())
-        threadMessageHandler.join();
+    for (std::thread& threadMessageHandler: threadMessageHandlers)
+        if (threadMessageHandler.joinable())
+            threadMessageHandler.join();
+    threadMessageHandlers.clear();
     if (threadOpenConnections.joinable())
         threadOpenConnections.join();
     if (threadOpenAddedConnections.joinable())
@@ -812,6 +911,10 @@ void CConnman::Stop()
         threadSocketHandler.join();
     if (threadNonTLSPoolsCleaner.joinable())
         threadNonTLSPoolsCleaner.join();
+    for (std::thread& threadTLSHandshake: threadTLSHandshakes)
+        if (threadTLSHandshake.joinable())
+            threadTLSHandshake.join();
+    threadTLSHandshakes.clear();
     NetCleanup();
 };
 
@@ -840,6 +943,12 @@ bool CConnman::StopNode()
 
     condMsgProc.notify_all();
 
+    {
+        std::lock_guard<std::mutex> lock(mutexHandshakes);
+        flagInterruptHandshakes = true;
+    }
+    condHandshakes.notify_all();
+
     interruptNet();
     InterruptSocks5(true);
     InterruptLookup(true);
@@ -867,6 +976,14 @@ void CConnman::NetCleanup()
             if (!CloseSocket(hListenSocket.socket))
                 LogPrintf("CloseSocket(hListenSocket) failed with error %s\n", NetworkErrorString(WSAGetLastError()));
 
+    {
+        std::lock_guard<std::mutex> lock(mutexHandshakes);
+        for (PendingHandshake& pending : queueHandshakes)
+            CloseSocket(pending.hSocket);
+        queueHandshakes.clear();
+        nPendingHandshakes = 0;
+    }
+
     // clean up some globals (to help leak detection)
     BOOST_FOREACH(CNode *pnode, vNodes)
         delete pnode;
@@ -884,18 +1001,45 @@ void CConnman::NetCleanup()
 #endif
 }
 
+namespace {
+
+// Replace the small messages at the front of the send queue with a single one holding all of them,
+// so that they are ciphered and framed as one TLS record
+void GatherSmallMessages(CNode* pnode)
+{
+    size_t nMessages = 0, nBytes = 0;
+    for (const auto& msg : pnode->vSendMsg)
+    {
+        if (nBytes + msg->size() > TLS_SEND_BATCH_SIZE)
+            break;
+        nBytes += msg->size();
+        ++nMessages;
+    }
+    if (nMessages < 2)
+        return;
+
+    std::shared_ptr<CSerializeData> batch = std::make_shared<CSerializeData>();
+    batch->reserve(nBytes);
+    for (size_t i = 0; i < nMessages; ++i)
+        batch->insert(batch->end(), pnode->vSendMsg[i]->begin(), pnode->vSendMsg[i]->end());
+
+    pnode->vSendMsg.erase(pnode->vSendMsg.begin(), pnode->vSendMsg.begin() + nMessages);
+    pnode->vSendMsg.push_front(batch);
+}
+
+} // anon namespace
+
 // requires LOCK(cs_vSend)
-void CConnman::SocketSendData(CNode *pnode)
+bool CConnman::SocketSendData(CNode *pnode)
 {
-    std::deque<CSerializeData>::iterator it = pnode->vSendMsg.begin();
+    size_t nSent = 0; // number of vSendMsg entries completely sent
+    bool fWritable = true;
 
-    while (it != pnode->vSendMsg.end())
+    while (nSent < pnode->vSendMsg.size())
     {
-        const CSerializeData &data = *it;
-        assert(data.size() > pnode->nSendOffset);
-
         bool bIsSSL = false;
         int nBytes = 0, nRet = 0;
+        size_t nAttempted = 0;
         {
             LOCK(pnode->cs_hSocket);
             
@@ -909,13 +1053,47 @@ void CConnman::SocketSendData(CNode *pnode)
             
             if (bIsSSL)
             {
+                // until it succeeds, a SSL_write must be retried with the very same buffer
+                if (!pnode->fSSLWriteRetry && pnode->nSendOffset == 0)
+                {
+                    pnode->vSendMsg.erase(pnode->vSendMsg.begin(), pnode->vSendMsg.begin() + nSent);
+                    nSent = 0;
+                    GatherSmallMessages(pnode);
+                }
+                const CSerializeData &data = *pnode->vSendMsg[nSent];
+                assert(data.size() > pnode->nSendOffset);
+                nAttempted = data.size() - pnode->nSendOffset;
+
                 ERR_clear_error(); // clear the error queue, otherwise we may be reading an old error that occurred previously in the current thread
-                nBytes = SSL_write(pnode->ssl, &data[pnode->nSendOffset], data.size() - pnode->nSendOffset);
+                nBytes = SSL_write(pnode->ssl, &data[pnode->nSendOffset], nAttempted);
                 nRet = SSL_get_error(pnode->ssl, nBytes);
+                pnode->fSSLWriteRetry = (nBytes <= 0 && (nRet == SSL_ERROR_WANT_READ || nRet == SSL_ERROR_WANT_WRITE));
             }
             else
             {
-                nBytes = send(pnode->hSocket, &data[pnode->nSendOffset], data.size() - pnode->nSendOffset, MSG_NOSIGNAL | MSG_DONTWAIT);
+#ifdef WIN32
+                const CSerializeData &data = *pnode->vSendMsg[nSent];
+                assert(data.size() > pnode->nSendOffset);
+                nAttempted = data.size() - pnode->nSendOffset;
+                nBytes = send(pnode->hSocket, &data[pnode->nSendOffset], nAttempted, MSG_NOSIGNAL | MSG_DONTWAIT);
+#else
+                // hand as many queued messages as possible to the kernel with a single call
+                struct iovec iov[MAX_SEND_IOV];
+                size_t nIov = 0, nOffset = pnode->nSendOffset;
+                for (size_t i = nSent; i < pnode->vSendMsg.size() && nIov < MAX_SEND_IOV; ++i, ++nIov)
+                {
+                    const CSerializeData &data = *pnode->vSendMsg[i];
+                    assert(data.size() > nOffset);
+                    iov[nIov].iov_base = const_cast<char*>(&data[nOffset]);
+                    iov[nIov].iov_len = data.size() - nOffset;
+                    nAttempted += iov[nIov].iov_len;
+                    nOffset = 0;
+                }
+                struct msghdr msg = {};
+                msg.msg_iov = iov;
+                msg.msg_iovlen = nIov;
+                nBytes = sendmsg(pnode->hSocket, &msg, MSG_NOSIGNAL | MSG_DONTWAIT);
+#endif
                 nRet = WSAGetLastError();
             }
         }
@@ -923,18 +1101,27 @@ void CConnman::SocketSendData(CNode *pnode)
         {
             pnode->nLastSend = GetTime();
             pnode->nSendBytes += nBytes;
-            pnode->nSendOffset += nBytes;
             RecordBytesSent(nBytes);
 
-            if (pnode->nSendOffset == data.size())
+            size_t nLeft = nBytes;
+            while (nLeft > 0)
             {
-                pnode->nSendOffset = 0;
-                pnode->nSendSize -= data.size();
-                ++it;
+                const CSerializeData &data = *pnode->vSendMsg[nSent];
+                size_t nChunk = std::min(nLeft, data.size() - pnode->nSendOffset);
+                pnode->nSendOffset += nChunk;
+                nLeft -= nChunk;
+                if (pnode->nSendOffset == data.size())
+                {
+                    pnode->nSendOffset = 0;
+                    pnode->nSendSize -= data.size();
+                    ++nSent;
+                }
             }
-            else
+
+            if ((size_t)nBytes < nAttempted)
             {
                 // could not send full message; stop sending more
+                fWritable = false;
                 break;
             }
         }
@@ -951,6 +1138,10 @@ void CConnman::SocketSendData(CNode *pnode)
                         LogPrintf("ERROR: SSL_write %s; closing connection\n", ERR_error_string(nRet, NULL));
                         pnode->CloseSocketDisconnect();
                     }
+                    else if (nRet == SSL_ERROR_WANT_WRITE)
+                    {
+                        fWritable = false;
+                    }
                     else
                     {
                         // preventive measure from exhausting CPU usage
@@ -960,7 +1151,11 @@ void CConnman::SocketSendData(CNode *pnode)
                 }
                 else
                 {
-                    if (nRet != WSAEWOULDBLOCK && nRet != WSAEMSGSIZE && nRet != WSAEINTR && nRet != WSAEINPROGRESS)
+                    if (nRet == WSAEWOULDBLOCK)
+                    {
+                        fWritable = false;
+                    }
+                    else if (nRet != WSAEMSGSIZE && nRet != WSAEINTR && nRet != WSAEINPROGRESS)
                     {
                         LogPrintf("ERROR: send %s; closing connection\n", NetworkErrorString(nRet));
                         pnode->CloseSocketDisconnect();
@@ -973,12 +1168,13 @@ void CConnman::SocketSendData(CNode *pnode)
         }
     }
 
-    if (it == pnode->vSendMsg.end())
+    if (nSent == pnode->vSendMsg.size())
     {
         assert(pnode->nSendOffset == 0);
         assert(pnode->nSendSize == 0);
     }
-    pnode->vSendMsg.erase(pnode->vSendMsg.begin(), it);
+    pnode->vSendMsg.erase(pnode->vSendMsg.begin(), pnode->vSendMsg.begin() + nSent);
+    return fWritable;
 }
 
 class CNodeRef {
@@ -1023,6 +1219,11 @@ static bool ReverseCompareNodeMinPingTime(const CNodeRef &a, const CNodeRef &b)
     return a->nMinPingUsecTime > b->nMinPingUsecTime;
 }
 
+static bool CompareNodeProofVerificationCost(const CNodeRef &a, const CNodeRef &b)
+{
+    return a->GetProofVerificationCost() < b->GetProofVerificationCost();
+}
+
 static bool ReverseCompareNodeTimeConnected(const CNodeRef &a, const CNodeRef &b)
 {
     return a->nTimeConnected > b->nTimeConnected;
@@ -1078,6 +1279,17 @@ bool CConnman::AttemptToEvictConnection(bool fPreferNewConnection) {
 
     if (vEvictionCandidates.empty()) return false;
 
+    // A peer whose certificates and CSW transactions keep the proof verifier busy goes first,
+    // before the protections, as an old connection would be protected otherwise
+    std::vector<CNodeRef>::iterator itCostliest = std::max_element(vEvictionCandidates.begin(), vEvictionCandidates.end(),
+                                                                   CompareNodeProofVerificationCost);
+    if ((*itCostliest)->GetProofVerificationCost() > PROOF_COST_EVICTION_THRESHOLD) {
+        LogPrint("net", "evicting peer=%d, its proofs cost %ds of verification\n",
+                 (*itCostliest)->GetId(), (*itCostliest)->GetProofVerificationCost() / 1000000);
+        (*itCostliest)->fDisconnect = true;
+        return true;
+    }
+
     // Protect connections with certain characteristics
 
     // Deterministically select 4 peers to protect by netgroup.
@@ -1155,6 +1367,7 @@ void CConnman::AcceptConnection(const ListenSocket& hListenSocket) {
             if (pnode->fInbound)
                 nInbound++;
     }
+    nInbound += nPendingHandshakes;
 
     if (hSocket == INVALID_SOCKET)
     {
@@ -1164,7 +1377,7 @@ void CConnman::AcceptConnection(const ListenSocket& hListenSocket) {
         return;
     }
 
-    if (!IsSelectableSocket(hSocket))
+    if (fSelectableSocketsOnly && !IsSelectableSocket(hSocket))
     {
         LogPrintf("connection from %s dropped: non-selectable socket\n", addr.ToString());
         CloseSocket(hSocket);
@@ -1198,12 +1411,11 @@ void CConnman::AcceptConnection(const ListenSocket& hListenSocket) {
 #endif
 
 
-    SSL *ssl = NULL;
-    
     SetSocketNonBlocking(hSocket, true);
     
 #ifdef USE_TLS
     /* TCP connection is ready. Do server side SSL. */
+    bool bUseTLS = true;
     if (CNode::GetTlsFallbackNonTls())
     {
         LOCK(cs_vNonTLSNodesInbound);
@@ -1212,33 +1424,10 @@ void CConnman::AcceptConnection(const ListenSocket& hListenSocket) {
 
         NODE_ADDR nodeAddr(addr.ToStringIP());
         
-        bool bUseTLS = (find(vNonTLSNodesInbound.begin(),
-                             vNonTLSNodesInbound.end(),
-                             nodeAddr) == vNonTLSNodesInbound.end());
-        unsigned long err_code = 0;
-        if (bUseTLS)
-        {
-            ssl = tlsmanager.accept( hSocket, addr, err_code);
-            if(!ssl)
-            {
-                if (err_code == TLSManager::SELECT_TIMEDOUT)
-                {
-                    // can fail also for timeout in select on fd, that is not a ssl error and we should not
-                    // consider this node as non TLS
-                    LogPrint("tls", "%s():%d - Connection from %s timedout\n", __func__, __LINE__, addr.ToStringIP());
-                }
-                else
-                {
-                    // Further reconnection will be made in non-TLS (unencrypted) mode
-                    vNonTLSNodesInbound.push_back(NODE_ADDR(addr.ToStringIP(), GetTimeMillis()));
-                    LogPrint("tls", "%s():%d - err_code %x, adding connection from %s vNonTLSNodesInbound list (sz=%d)\n",
-                        __func__, __LINE__, err_code, addr.ToStringIP(), vNonTLSNodesInbound.size());
-                }
-                CloseSocket(hSocket);
-                return;
-            }
-        }
-        else
+        bUseTLS = (find(vNonTLSNodesInbound.begin(),
+                        vNonTLSNodesInbound.end(),
+                        nodeAddr) == vNonTLSNodesInbound.end());
+        if (!bUseTLS)
         {
             LogPrintf ("TLS: Connection from %s will be unencrypted\n", addr.ToStringIP());
             
@@ -1251,23 +1440,84 @@ void CConnman::AcceptConnection(const ListenSocket& hListenSocket) {
                     vNonTLSNodesInbound.end());
         }
     }
-    else
+
+    if (bUseTLS)
     {
-        unsigned long err_code = 0;
-        ssl = tlsmanager.accept( hSocket, addr, err_code);
-        if(!ssl)
+        // the handshake threads run SSL_accept, which waits for the peer
+        if (nPendingHandshakes >= MAX_PENDING_TLS_HANDSHAKES)
         {
-            LogPrint("tls", "%s():%d - err_code %x, failure accepting connection from %s\n",
-                __func__, __LINE__, err_code, addr.ToStringIP());
+            LogPrint("tls", "%s():%d - too many pending TLS handshakes, connection from %s dropped\n",
+                __func__, __LINE__, addr.ToString());
             CloseSocket(hSocket);
             return;
         }
+        ++nPendingHandshakes;
+        {
+            std::lock_guard<std::mutex> lock(mutexHandshakes);
+            queueHandshakes.push_back(PendingHandshake{hSocket, addr, whitelisted});
+        }
+        condHandshakes.notify_one();
+        return;
+    }
+#endif // USE_TLS
+
+    AddInboundNode(hSocket, addr, whitelisted, NULL);
+}
+
+void CConnman::AddInboundNode(SOCKET hSocket, const CAddress& addr, bool fWhitelisted, SSL* ssl, int64_t nTLSHandshakeTime)
+{
+    CNode* pnode = new CNode(hSocket, addr, "", true, ssl);
+    pnode->nTLSHandshakeTime = nTLSHandshakeTime;
+    pnode->AddRef();
+    pnode->fWhitelisted = fWhitelisted;
+
+    {
+        LOCK(cs_vNodes);
+        vNodes.push_back(pnode);
+        nNodesGeneration++;
+    }
+}
+
+#if defined(USE_TLS)
+void CConnman::AcceptTLSConnection(SOCKET hSocket, const CAddress& addr, bool fWhitelisted)
+{
+    SSL *ssl = NULL;
+    unsigned long err_code = 0;
+    int64_t nHandshakeTime = 0;
+
+    ssl = tlsmanager.accept( hSocket, addr, err_code, nHandshakeTime);
+    if(!ssl)
+    {
+        if (CNode::GetTlsFallbackNonTls())
+        {
+            if (err_code == TLSManager::SELECT_TIMEDOUT)
+            {
+                // can fail also for timeout in select on fd, that is not a ssl error and we should not
+                // consider this node as non TLS
+                LogPrint("tls", "%s():%d - Connection from %s timedout\n", __func__, __LINE__, addr.ToStringIP());
+            }
+            else
+            {
+                LOCK(cs_vNonTLSNodesInbound);
+                // Further reconnection will be made in non-TLS (unencrypted) mode
+                vNonTLSNodesInbound.push_back(NODE_ADDR(addr.ToStringIP(), GetTimeMillis()));
+                LogPrint("tls", "%s():%d - err_code %x, adding connection from %s vNonTLSNodesInbound list (sz=%d)\n",
+                    __func__, __LINE__, err_code, addr.ToStringIP(), vNonTLSNodesInbound.size());
+            }
+        }
+        else
+        {
+            LogPrint("tls", "%s():%d - err_code %x, failure accepting connection from %s\n",
+                __func__, __LINE__, err_code, addr.ToStringIP());
+        }
+        CloseSocket(hSocket);
+        return;
     }
     
     // certificate validation is disabled by default    
     if (CNode::GetTlsValidate())
     {
-        if (ssl && !ValidatePeerCertificate(ssl))
+        if (!ValidatePeerCertificate(ssl))
         {
             LogPrintf ("TLS: ERROR: Wrong client certificate from %s. Connection will be closed.\n", addr.ToString());
         
@@ -1277,17 +1527,29 @@ void CConnman::AcceptConnection(const ListenSocket& hListenSocket) {
             return;
         }
     }
-#endif // USE_TLS
+    RecordTLSHandshake(true, nHandshakeTime, SSL_session_reused(ssl));
 
-    CNode* pnode = new CNode(hSocket, addr, "", true, ssl);
-    pnode->AddRef();
-    pnode->fWhitelisted = whitelisted;
+    AddInboundNode(hSocket, addr, fWhitelisted, ssl, nHandshakeTime);
+}
 
+void CConnman::ThreadTLSHandshake()
+{
+    while (true)
     {
-        LOCK(cs_vNodes);
-        vNodes.push_back(pnode);
+        PendingHandshake pending;
+        {
+            std::unique_lock<std::mutex> lock(mutexHandshakes);
+            condHandshakes.wait(lock, [this] { return flagInterruptHandshakes || !queueHandshakes.empty(); });
+            if (flagInterruptHandshakes)
+                return;
+            pending = queueHandshakes.front();
+            queueHandshakes.pop_front();
+        }
+        AcceptTLSConnection(pending.hSocket, pending.addr, pending.fWhitelisted);
+        --nPendingHandshakes;
     }
 }
+#endif // USE_TLS
 
 #if defined(USE_TLS)
 void CConnman::ThreadNonTLSPoolsCleaner()
@@ -1304,8 +1566,292 @@ void CConnman::ThreadNonTLSPoolsCleaner()
 #endif // USE_TLS 
 
 
+namespace {
+
+/**
+ * Readiness of the sockets served by the socket handler thread. With epoll (Linux) and kqueue
+ * (BSD, macOS) the node sockets are registered once, edge triggered: an event sets the fPollRecv or
+ * fPollSend flag of the node, which stays set until a read or a write on the socket would block,
+ * so that a wakeup costs the number of sockets which are ready rather than the number of
+ * connections. The select() backend, the only one on Windows, computes the flags again at each
+ * wait, for the sockets the handler is interested in, and is limited to FD_SETSIZE sockets.
+ */
+class CSocketPoller
+{
+public:
+    typedef std::function<void(CNode*, bool&, bool&)> InterestFunc;
+
+    explicit CSocketPoller(const std::string& strModeIn) : strMode(strModeIn), fdPoll(-1)
+    {
+#if defined(USE_EPOLL)
+        if (strMode == "epoll")
+            fdPoll = epoll_create1(EPOLL_CLOEXEC);
+#elif defined(USE_KQUEUE)
+        if (strMode == "kqueue")
+            fdPoll = kqueue();
+#endif
+        if (strMode != "select" && fdPoll == -1)
+        {
+            LogPrintf("%s: cannot use %s for the socket events, using select\n", __func__, strMode);
+            strMode = "select";
+        }
+    }
+
+    ~CSocketPoller()
+    {
+#if defined(USE_EPOLL) || defined(USE_KQUEUE)
+        if (fdPoll != -1)
+            close(fdPoll);
+#endif
+    }
+
+    const std::string& GetMode() const { return strMode; }
+
+    void AddListenSocket(const ListenSocket& hListenSocket)
+    {
+        if (hListenSocket.socket == INVALID_SOCKET)
+            return;
+        vListenSockets.push_back(&hListenSocket);
+        // the listen sockets are level triggered, as a single connection is accepted per wakeup
+#if defined(USE_EPOLL)
+        if (fdPoll != -1)
+        {
+            struct epoll_event event = {};
+            event.events = EPOLLIN;
+            event.data.ptr = const_cast<ListenSocket*>(&hListenSocket);
+            if (epoll_ctl(fdPoll, EPOLL_CTL_ADD, hListenSocket.socket, &event) != 0)
+                LogPrintf("%s: epoll_ctl failed for listen socket: %s\n", __func__, NetworkErrorString(WSAGetLastError()));
+        }
+#elif defined(USE_KQUEUE)
+        if (fdPoll != -1)
+        {
+            struct kevent change;
+            EV_SET(&change, hListenSocket.socket, EVFILT_READ, EV_ADD, 0, 0, const_cast<ListenSocket*>(&hListenSocket));
+            if (kevent(fdPoll, &change, 1, NULL, 0, NULL) != 0)
+                LogPrintf("%s: kevent failed for listen socket: %s\n", __func__, NetworkErrorString(WSAGetLastError()));
+        }
+#endif
+    }
+
+    void AddNode(CNode* pnode)
+    {
+        LOCK(pnode->cs_hSocket);
+        if (pnode->hSocket == INVALID_SOCKET)
+            return;
+
+        // a closed socket leaves the epoll and kqueue sets by itself
+        pnode->fPollRegistered = true;
+        // until the first read or write tells otherwise
+        pnode->fPollRecv = true;
+        pnode->fPollSend = true;
+#if defined(USE_EPOLL)
+        if (fdPoll != -1)
+        {
+            struct epoll_event event = {};
+            event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+            event.data.ptr = pnode;
+            if (epoll_ctl(fdPoll, EPOLL_CTL_ADD, pnode->hSocket, &event) != 0)
+                LogPrintf("%s: epoll_ctl failed for peer=%d: %s\n", __func__, pnode->id, NetworkErrorString(WSAGetLastError()));
+        }
+#elif defined(USE_KQUEUE)
+        if (fdPoll != -1)
+        {
+            struct kevent changes[2];
+            EV_SET(&changes[0], pnode->hSocket, EVFILT_READ, EV_ADD | EV_CLEAR, 0, 0, pnode);
+            EV_SET(&changes[1], pnode->hSocket, EVFILT_WRITE, EV_ADD | EV_CLEAR, 0, 0, pnode);
+            if (kevent(fdPoll, changes, 2, NULL, 0, NULL) != 0)
+                LogPrintf("%s: kevent failed for peer=%d: %s\n", __func__, pnode->id, NetworkErrorString(WSAGetLastError()));
+        }
+#endif
+    }
+
+    /**
+     * Wait up to nTimeoutMs for any socket to become ready, and set the readiness flags of the nodes.
+     * vNodes are the nodes currently served, which fInterest tells about the readiness they wait for.
+     */
+    void Wait(int nTimeoutMs, const std::vector<CNode*>& vNodes, std::vector<const ListenSocket*>& vListenReady,
+              const InterestFunc& fInterest)
+    {
+#if defined(USE_EPOLL)
+        if (fdPoll != -1)
+        {
+            struct epoll_event events[MAX_EVENTS];
+            int nEvents = epoll_wait(fdPoll, events, MAX_EVENTS, nTimeoutMs);
+            if (nEvents < 0 && errno != EINTR)
+                LogPrintf("socket epoll_wait error %s\n", NetworkErrorString(WSAGetLastError()));
+            for (int i = 0; i < nEvents; ++i)
+            {
+                if (IsListenSocket(events[i].data.ptr))
+                {
+                    vListenReady.push_back(static_cast<const ListenSocket*>(events[i].data.ptr));
+                    continue;
+                }
+                CNode* pnode = static_cast<CNode*>(events[i].data.ptr);
+                if (events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR))
+                    pnode->fPollRecv = true;
+                if (events[i].events & EPOLLOUT)
+                    pnode->fPollSend = true;
+            }
+            return;
+        }
+#elif defined(USE_KQUEUE)
+        if (fdPoll != -1)
+        {
+            struct kevent events[MAX_EVENTS];
+            struct timespec timeout;
+            timeout.tv_sec = nTimeoutMs / 1000;
+            timeout.tv_nsec = (nTimeoutMs % 1000) * 1000000;
+            int nEvents = kevent(fdPoll, NULL, 0, events, MAX_EVENTS, &timeout);
+            if (nEvents < 0 && errno != EINTR)
+                LogPrintf("socket kevent error %s\n", NetworkErrorString(WSAGetLastError()));
+            for (int i = 0; i < nEvents; ++i)
+            {
+                if (IsListenSocket(events[i].udata))
+                {
+                    vListenReady.push_back(static_cast<const ListenSocket*>(events[i].udata));
+                    continue;
+                }
+                CNode* pnode = static_cast<CNode*>(events[i].udata);
+                if (events[i].filter == EVFILT_READ || (events[i].flags & (EV_EOF | EV_ERROR)))
+                    pnode->fPollRecv = true;
+                if (events[i].filter == EVFILT_WRITE)
+                    pnode->fPollSend = true;
+            }
+            return;
+        }
+#endif
+        WaitSelect(nTimeoutMs, vNodes, vListenReady, fInterest);
+    }
+
+private:
+    static const int MAX_EVENTS = 256;
+
+    std::string strMode;
+    int fdPoll;
+    std::vector<const ListenSocket*> vListenSockets;
+
+    bool IsListenSocket(const void* ptr) const
+    {
+        return std::find(vListenSockets.begin(), vListenSockets.end(), ptr) != vListenSockets.end();
+    }
+
+    void WaitSelect(int nTimeoutMs, const std::vector<CNode*>& vNodes, std::vector<const ListenSocket*>& vListenReady,
+                    const InterestFunc& fInterest)
+    {
+        struct timeval timeout;
+        timeout.tv_sec  = nTimeoutMs / 1000;
+        timeout.tv_usec = (nTimeoutMs % 1000) * 1000;
+
+        fd_set fdsetRecv;
+        fd_set fdsetSend;
+        fd_set fdsetError;
+        FD_ZERO(&fdsetRecv);
+        FD_ZERO(&fdsetSend);
+        FD_ZERO(&fdsetError);
+        SOCKET hSocketMax = 0;
+        bool have_fds = false;
+
+        BOOST_FOREACH(const ListenSocket* hListenSocket, vListenSockets) {
+            FD_SET(hListenSocket->socket, &fdsetRecv);
+            hSocketMax = max(hSocketMax, hListenSocket->socket);
+            have_fds = true;
+        }
+
+        BOOST_FOREACH(CNode* pnode, vNodes)
+        {
+            bool fWantRecv = false, fWantSend = false;
+            fInterest(pnode, fWantRecv, fWantSend);
+
+            LOCK(pnode->cs_hSocket);
+            if (pnode->hSocket == INVALID_SOCKET)
+                continue;
+
+            FD_SET(pnode->hSocket, &fdsetError);
+            hSocketMax = max(hSocketMax, pnode->hSocket);
+            have_fds = true;
+            if (fWantSend)
+                FD_SET(pnode->hSocket, &fdsetSend);
+            if (fWantRecv)
+                FD_SET(pnode->hSocket, &fdsetRecv);
+        }
+
+        int nSelect = select(have_fds ? hSocketMax + 1 : 0,
+                             &fdsetRecv, &fdsetSend, &fdsetError, &timeout);
+        if (nSelect == SOCKET_ERROR)
+        {
+            if (have_fds)
+            {
+                int nErr = WSAGetLastError();
+                LogPrintf("socket select error %s\n", NetworkErrorString(nErr));
+            }
+            FD_ZERO(&fdsetRecv);
+            FD_ZERO(&fdsetSend);
+            FD_ZERO(&fdsetError);
+            MilliSleep(nTimeoutMs);
+        }
+
+        BOOST_FOREACH(const ListenSocket* hListenSocket, vListenSockets) {
+            if (FD_ISSET(hListenSocket->socket, &fdsetRecv))
+                vListenReady.push_back(hListenSocket);
+        }
+
+        BOOST_FOREACH(CNode* pnode, vNodes)
+        {
+            LOCK(pnode->cs_hSocket);
+            const bool fValid = pnode->hSocket != INVALID_SOCKET;
+            pnode->fPollRecv = fValid && (FD_ISSET(pnode->hSocket, &fdsetRecv) || FD_ISSET(pnode->hSocket, &fdsetError));
+            pnode->fPollSend = fValid && FD_ISSET(pnode->hSocket, &fdsetSend);
+        }
+    }
+};
+
+} // anon namespace
+
+void CConnman::GetSocketInterest(CNode *pnode, bool& fWantRecv, bool& fWantSend)
+{
+    // Implement the following logic:
+    // * If there is data to send, wait for sending data. As this only
+    //   happens when optimistic write failed, we choose to first drain the
+    //   write buffer in this case before receiving more. This avoids
+    //   needlessly queueing received data, if the remote peer is not themselves
+    //   receiving data. This means properly utilizing TCP flow control signalling.
+    // * Otherwise, if there is no (complete) message in the receive buffer,
+    //   or there is space left in the buffer, wait for receiving data.
+    // * (if neither of the above applies, there is certainly one message
+    //   in the receiver buffer ready to be processed).
+    // Together, that means that at least one of the following is always possible,
+    // so we don't deadlock:
+    // * We send some data.
+    // * We wait for data to be received (and disconnect after timeout).
+    // * We process a message in the buffer (message handler thread).
+    fWantRecv = false;
+    fWantSend = false;
+    {
+        TRY_LOCK(pnode->cs_vSend, lockSend);
+        if (lockSend && !pnode->vSendMsg.empty()) {
+            fWantSend = true;
+            return;
+        }
+    }
+    {
+        TRY_LOCK(pnode->cs_vRecvMsg, lockRecv);
+        if (lockRecv && (
+            pnode->vRecvMsg.empty() || !pnode->vRecvMsg.front().complete() ||
+            pnode->GetTotalRecvSize() <= GetReceiveFloodSize()))
+            fWantRecv = true;
+    }
+}
+
 void CConnman::ThreadSocketHandler()
 {
+    CSocketPoller poller(GetArg("-socketevents", GetSocketEventsModes().front()));
+    LogPrintf("Using %s for the socket events\n", poller.GetMode());
+    fSelectableSocketsOnly = (poller.GetMode() == "select");
+    BOOST_FOREACH(const ListenSocket& hListenSocket, vhListenSocket)
+        poller.AddListenSocket(hListenSocket);
+
+    // a node has been read from without blocking, there may be more to read right away
+    bool fMoreWork = false;
     unsigned int nPrevNodeCount = 0;
     while (!interruptNet)
     {
@@ -1323,6 +1869,7 @@ void CConnman::ThreadSocketHandler()
                 {
                     // remove from vNodes
                     vNodes.erase(remove(vNodes.begin(), vNodes.end(), pnode), vNodes.end());
+                    nNodesGeneration++;
 
                     // release outbound grant (if any)
                     pnode->grantOutbound.Release();
@@ -1364,123 +1911,60 @@ void CConnman::ThreadSocketHandler()
             uiInterface.NotifyNumConnectionsChanged(nPrevNodeCount);
         }
 
-        //
-        // Find which sockets have data to receive
-        //
-        struct timeval timeout;
-        timeout.tv_sec  = 0;
-        timeout.tv_usec = 50000; // frequency to poll pnode->vSend
-
-        fd_set fdsetRecv;
-        fd_set fdsetSend;
-        fd_set fdsetError;
-        FD_ZERO(&fdsetRecv);
-        FD_ZERO(&fdsetSend);
-        FD_ZERO(&fdsetError);
-        SOCKET hSocketMax = 0;
-        bool have_fds = false;
-
-        BOOST_FOREACH(const ListenSocket& hListenSocket, vhListenSocket) {
-            FD_SET(hListenSocket.socket, &fdsetRecv);
-            hSocketMax = max(hSocketMax, hListenSocket.socket);
-            have_fds = true;
-        }
-
+        vector<CNode*> vNodesCopy;
         {
             LOCK(cs_vNodes);
-            BOOST_FOREACH(CNode* pnode, vNodes)
-            {
-                LOCK(pnode->cs_hSocket);
-                
-                if (pnode->hSocket == INVALID_SOCKET)
-                    continue;
-                
-                FD_SET(pnode->hSocket, &fdsetError);
-                hSocketMax = max(hSocketMax, pnode->hSocket);
-                have_fds = true;
-
-                // Implement the following logic:
-                // * If there is data to send, select() for sending data. As this only
-                //   happens when optimistic write failed, we choose to first drain the
-                //   write buffer in this case before receiving more. This avoids
-                //   needlessly queueing received data, if the remote peer is not themselves
-                //   receiving data. This means properly utilizing TCP flow control signalling.
-                // * Otherwise, if there is no (complete) message in the receive buffer,
-                //   or there is space left in the buffer, select() for receiving data.
-                // * (if neither of the above applies, there is certainly one message
-                //   in the receiver buffer ready to be processed).
-                // Together, that means that at least one of the following is always possible,
-                // so we don't deadlock:
-                // * We send some data.
-                // * We wait for data to be received (and disconnect after timeout).
-                // * We process a message in the buffer (message handler thread).
-
-                {
-                    TRY_LOCK(pnode->cs_vSend, lockSend);
-                    if (lockSend && !pnode->vSendMsg.empty()) {
-                        FD_SET(pnode->hSocket, &fdsetSend);
-                        continue;
-                    }
-                }
-                {
-                    TRY_LOCK(pnode->cs_vRecvMsg, lockRecv);
-                    if (lockRecv && (
-                        pnode->vRecvMsg.empty() || !pnode->vRecvMsg.front().complete() ||
-                        pnode->GetTotalRecvSize() <= GetReceiveFloodSize()))
-                        FD_SET(pnode->hSocket, &fdsetRecv);
-                }
-            }
+            vNodesCopy = vNodes;
+            BOOST_FOREACH(CNode* pnode, vNodesCopy)
+                pnode->AddRef();
+        }
+        BOOST_FOREACH(CNode* pnode, vNodesCopy)
+        {
+            if (!pnode->fPollRegistered)
+                poller.AddNode(pnode);
         }
 
-        int nSelect = select(have_fds ? hSocketMax + 1 : 0,
-                             &fdsetRecv, &fdsetSend, &fdsetError, &timeout);
+        //
+        // Find which sockets have data to receive
+        //
+        std::vector<const ListenSocket*> vListenReady;
+        poller.Wait(fMoreWork ? 0 : 50, vNodesCopy, vListenReady,
+                    [this](CNode* pnode, bool& fWantRecv, bool& fWantSend) { GetSocketInterest(pnode, fWantRecv, fWantSend); });
         if (interruptNet)
-            return;
-
-        if (nSelect == SOCKET_ERROR)
         {
-            if (have_fds)
-            {
-                int nErr = WSAGetLastError();
-                LogPrintf("socket select error %s\n", NetworkErrorString(nErr));
-                for (unsigned int i = 0; i <= hSocketMax; i++)
-                    FD_SET(i, &fdsetRecv);
-            }
-            FD_ZERO(&fdsetSend);
-            FD_ZERO(&fdsetError);
-            if (!interruptNet.sleep_for(std::chrono::microseconds(timeout.tv_usec)))
-                return;
+            LOCK(cs_vNodes);
+            BOOST_FOREACH(CNode* pnode, vNodesCopy)
+                pnode->Release();
+            return;
         }
+        fMoreWork = false;
 
         //
         // Accept new connections
         //
-        BOOST_FOREACH(const ListenSocket& hListenSocket, vhListenSocket)
+        BOOST_FOREACH(const ListenSocket* hListenSocket, vListenReady)
         {
-            if (hListenSocket.socket != INVALID_SOCKET && FD_ISSET(hListenSocket.socket, &fdsetRecv))
-            {
-                AcceptConnection(hListenSocket);
-            }
+            AcceptConnection(*hListenSocket);
         }
 
         //
         // Service each socket
         //
-        vector<CNode*> vNodesCopy;
-        {
-            LOCK(cs_vNodes);
-            vNodesCopy = vNodes;
-            BOOST_FOREACH(CNode* pnode, vNodesCopy)
-                pnode->AddRef();
-        }
         BOOST_FOREACH(CNode* pnode, vNodesCopy)
         {
             if (interruptNet)
                 return;
 
-            if (tlsmanager.threadSocketHandler(pnode,fdsetRecv,fdsetSend,fdsetError)==-1){
+            bool fWantRecv = false, fWantSend = false;
+            GetSocketInterest(pnode, fWantRecv, fWantSend);
+            const bool fRecv = fWantRecv && pnode->fPollRecv;
+            const bool fSend = fWantSend && pnode->fPollSend;
+
+            if (tlsmanager.threadSocketHandler(pnode, fRecv, fSend)==-1){
                 continue;
             }
+            if (fRecv && pnode->fPollRecv)
+                fMoreWork = true;
 
             //
             // Inactivity checking
@@ -1559,7 +2043,7 @@ void CConnman::ThreadDNSAddressSeed()
         for(const CNetAddr& ip : vIPs)
         {
             vAdd.emplace_back(CService(ip, Params().GetDefaultPort()));
-            vAdd.back().nTime = GetTime() - nThreeDays - GetRand(nFourDays); // use a random age between 3 and 7 days old
+            vAdd.back().nTime = GetTime() - nThreeDays - GetFastRand(nFourDays); // use a random age between 3 and 7 days old
         }
         
         addrman.Add(vAdd, CNetAddr(seed.name, true));
@@ -1575,10 +2059,18 @@ void CConnman::ThreadDNSAddressSeed()
 /// To be moved to CConnman after boost::thread refactoring
 void CConnman::DumpAddresses()
 {
+    // the tables are only locked while serialized in memory, the file is written without the lock
+    const uint64_t nModifications = addrman.GetModifications();
+    if (nModifications == nAddressesDumped) {
+        LogPrint("net", "No changes to the %d addresses of peers.dat\n", addrman.size());
+        return;
+    }
+
     int64_t nStart = GetTimeMillis();
 
     CAddrDB adb;
-    adb.Write(addrman);
+    if (adb.Write(addrman))
+        nAddressesDumped = nModifications;
 
     LogPrint("net", "Flushed %d addresses to peers.dat  %dms\n",
            addrman.size(), GetTimeMillis() - nStart);
@@ -1835,7 +2327,13 @@ bool CConnman::OpenNetworkConnection(const CAddress& addrConnect, CSemaphoreGran
 }
 
 
-void CConnman::ThreadMessageHandler()
+/**
+ * With several message handler threads, each one serves the peers whose id modulo the number of
+ * threads is its own, so that the messages of a peer are still processed and answered in order.
+ * Whether a message can be processed concurrently with the ones of other peers is up to
+ * ProcessMessages.
+ */
+void CConnman::ThreadMessageHandler(int nThread)
 {
     SetThreadPriority(THREAD_PRIORITY_BELOW_NORMAL);
     while (!flagInterruptMsgProc)
@@ -1843,16 +2341,18 @@ void CConnman::ThreadMessageHandler()
         vector<CNode*> vNodesCopy;
         {
             LOCK(cs_vNodes);
-            vNodesCopy = vNodes;
-            BOOST_FOREACH(CNode* pnode, vNodesCopy) {
+            BOOST_FOREACH(CNode* pnode, vNodes) {
+                if (pnode->GetId() % nMessageHandlerThreads != nThread)
+                    continue;
                 pnode->AddRef();
+                vNodesCopy.push_back(pnode);
             }
         }
 
         // Poll the connected nodes for messages
         CNode* pnodeTrickle = nullptr;
         if (!vNodesCopy.empty())
-            pnodeTrickle = vNodesCopy[GetRand(vNodesCopy.size())];
+            pnodeTrickle = vNodesCopy[GetFastRand(vNodesCopy.size())];
 
         bool fSleep = true;
 
@@ -2085,6 +2585,8 @@ void CConnman::StartNode(CScheduler& scheduler, const Options& connOptions)
         CAddrDB adb;
         if (!adb.Read(addrman))
             LogPrintf("Invalid or missing peers.dat; recreating\n");
+        else
+            nAddressesDumped = addrman.GetModifications();
     }
     LogPrintf("Loaded %i addresses from peers.dat  %dms\n",
            addrman.size(), GetTimeMillis() - nStart);
@@ -2126,6 +2628,7 @@ void CConnman::StartNode(CScheduler& scheduler, const Options& connOptions)
     InterruptLookup(false);
     interruptNet.reset();
     flagInterruptMsgProc = false;
+    flagInterruptHandshakes = false;
 
     if (!GetBoolArg("-dnsseed", true))
         LogPrintf("DNS seeding disabled\n");
@@ -2146,10 +2649,24 @@ void CConnman::StartNode(CScheduler& scheduler, const Options& connOptions)
             std::function<void()>(std::bind(&CConnman::ThreadOpenConnections, this)));
 
     // Process messages
-    threadMessageHandler = std::thread(&TraceThread<std::function<void()> >, "msghand",
-            std::function<void()>(std::bind(&CConnman::ThreadMessageHandler, this)));
+    for (int nThread = 0; nThread < nMessageHandlerThreads; nThread++)
+    {
+        const std::string strName = nThread == 0 ? std::string("msghand") : strprintf("msghand.%d", nThread);
+        threadMessageHandlers.emplace_back([this, nThread, strName]() {
+            TraceThread(strName.c_str(), std::function<void()>(std::bind(&CConnman::ThreadMessageHandler, this, nThread)));
+        });
+    }
 
 #if defined(USE_TLS)
+    // Establish the TLS sessions of the inbound connections
+    for (int nThread = 0; nThread < nTLSHandshakeThreads; nThread++)
+    {
+        const std::string strName = strprintf("tlshand.%d", nThread);
+        threadTLSHandshakes.emplace_back([this, strName]() {
+            TraceThread(strName.c_str(), std::function<void()>(std::bind(&CConnman::ThreadTLSHandshake, this)));
+        });
+    }
+
     if (CNode::GetTlsFallbackNonTls())
     {
         // Clean pools of addresses for non-TLS connections
@@ -2159,12 +2676,20 @@ void CConnman::StartNode(CScheduler& scheduler, const Options& connOptions)
 #endif
     
     // Dump network addresses
-    scheduler.scheduleEvery(std::function<void()>(std::bind(&CConnman::DumpAddresses, this)), DUMP_ADDRESSES_INTERVAL);
+    scheduler.scheduleEvery(std::function<void()>(std::bind(&CConnman::DumpAddresses, this)), DUMP_ADDRESSES_INTERVAL,
+                            CScheduler::TaskClass::IO_BOUND, "dumpaddresses");
+}
+
+int64_t PoissonNextSend(int64_t nNow, int average_interval_seconds)
+{
+    return nNow + (int64_t)(log1p(GetFastRand(1ULL << 48) * -0.0000000000000035527136788 /* -1/2^48 */) * average_interval_seconds * -1000000.0 + 0.5);
 }
 
 void Relay(const CTransactionBase& tx, const CDataStream& ss)
 {
     CInv inv(MSG_TX, tx.GetHash());
+    // The peers asking for it share the same message buffer
+    std::shared_ptr<const CSerializeData> msg = CNode::SerializeMessage(ss.GetVersion(), NetMsgType::TX, ss);
     {
         LOCK(cs_mapRelay);
         // Expire old relay messages
@@ -2175,8 +2700,8 @@ void Relay(const CTransactionBase& tx, const CDataStream& ss)
         }
 
         // Save original serialized message so newer versions are preserved
-        mapRelay.insert(std::make_pair(inv, ss));
-        vRelayExpiration.push_back(std::make_pair(GetTime() + 15 * 60, inv));
+        if (mapRelay.emplace(inv.hash, msg).second)
+            vRelayExpiration.push_back(std::make_pair(GetTime() + 15 * 60, inv.hash));
     }
     LOCK(connman->cs_vNodes);
     BOOST_FOREACH(CNode* pnode, connman->vNodes)
@@ -2191,6 +2716,7 @@ void Relay(const CTransactionBase& tx, const CDataStream& ss)
         } else
             pnode->PushInventory(inv);
     }
+    RecordTxTraceStage(inv.hash, TxTraceStage::RELAYED);
 }
 
 #if 0
@@ -2203,6 +2729,23 @@ void Relay(const CScCertificate& cert)
 }
 #endif
 
+void CConnman::RecordTLSHandshake(bool fInbound, int64_t nTime, bool fResumed)
+{
+    nTLSHandshakes[fInbound].fetch_add(1, std::memory_order_relaxed);
+    if (fResumed)
+        nTLSResumed[fInbound].fetch_add(1, std::memory_order_relaxed);
+    nTLSHandshakeTime[fInbound].fetch_add(nTime, std::memory_order_relaxed);
+}
+
+CConnman::TLSHandshakeStats CConnman::GetTLSHandshakeStats(bool fInbound) const
+{
+    TLSHandshakeStats stats;
+    stats.nCount = nTLSHandshakes[fInbound];
+    stats.nResumed = nTLSResumed[fInbound];
+    stats.nTotalTime = nTLSHandshakeTime[fInbound];
+    return stats;
+}
+
 void CConnman::RecordBytesRecv(uint64_t bytes)
 {
     nTotalBytesRecv.fetch_add(bytes, std::memory_order_relaxed);
@@ -2235,29 +2778,29 @@ uint64_t CConnman::GetLocalServices() const
 void CNode::Fuzz(int nChance)
 {
     if (!fSuccessfullyConnected) return; // Don't fuzz initial handshake
-    if (GetRand(nChance) != 0) return; // Fuzz 1 of every nChance messages
+    if (GetFastRand(nChance) != 0) return; // Fuzz 1 of every nChance messages
 
-    switch (GetRand(3))
+    switch (GetFastRand(3))
     {
     case 0:
         // xor a random byte with a random value:
         if (!ssSend.empty()) {
-            CDataStream::size_type pos = GetRand(ssSend.size());
-            ssSend[pos] ^= (unsigned char)(GetRand(256));
+            CPublicDataStream::size_type pos = GetFastRand(ssSend.size());
+            ssSend[pos] ^= (unsigned char)(GetFastRand(256));
         }
         break;
     case 1:
         // delete a random byte:
         if (!ssSend.empty()) {
-            CDataStream::size_type pos = GetRand(ssSend.size());
+            CPublicDataStream::size_type pos = GetFastRand(ssSend.size());
             ssSend.erase(ssSend.begin()+pos);
         }
         break;
     case 2:
         // insert a random byte at a random position
         {
-            CDataStream::size_type pos = GetRand(ssSend.size());
-            char ch = (char)GetRand(256);
+            CPublicDataStream::size_type pos = GetFastRand(ssSend.size());
+            char ch = (char)GetFastRand(256);
             ssSend.insert(ssSend.begin()+pos, ch);
         }
         break;
@@ -2384,7 +2927,7 @@ NodeId CConnman::GetNewNodeId()
 CNode::CNode(SOCKET hSocketIn, const CAddress& addrIn, const std::string& addrNameIn, bool fInboundIn, SSL *sslIn) :
     ssSend{SER_NETWORK, INIT_PROTO_VERSION},
     addrKnown{5000, 0.001},
-    setInventoryKnown{connman->GetSendBufferSize() / 1000},
+    filterInventoryKnown{INVENTORY_KNOWN_SZ, INVENTORY_KNOWN_FP_RATE},
     hSocket{hSocketIn}
 {
     ssl = sslIn;
@@ -2410,9 +2953,14 @@ CNode::CNode(SOCKET hSocketIn, const CAddress& addrIn, const std::string& addrNa
     nRefCount = 0;
     nSendSize = 0;
     nSendOffset = 0;
+    fSSLWriteRetry = false;
+    fPollRegistered = false;
+    fPollRecv = false;
+    fPollSend = false;
     hashContinue = uint256();
     nStartingHeight = -1;
     fGetAddr = false;
+    nNextInvSend = 0;
     fRelayTxes = false;
     fSentAddr = false;
     pfilter = new CBloomFilter();
@@ -2431,8 +2979,8 @@ CNode::CNode(SOCKET hSocketIn, const CAddress& addrIn, const std::string& addrNa
         LogPrint("net", "Added connection peer=%d\n", id);
 
     for (size_t i = 0; i < allNetMessageTypesSize; i++) {
-        mapSendBytesPerMsgType.insert({allNetMessageTypes[i], {0, 0}});
-        mapRecvBytesPerMsgType.insert({allNetMessageTypes[i], {0, 0}});
+        mapSendBytesPerMsgType[allNetMessageTypes[i]];
+        mapRecvBytesPerMsgType[allNetMessageTypes[i]];
     }
 
     // Be shy and don't send version until we hear
@@ -2508,47 +3056,6 @@ CNode::~CNode()
     GetNodeSignals().FinalizeNode(GetId());
 }
 
-void CNode::AskFor(const CInv& inv)
-{
-    if (mapAskFor.size() > MAPASKFOR_MAX_SZ || setAskFor.size() > SETASKFOR_MAX_SZ)
-        return;
-    // a peer may not have multiple non-responded queue positions for a single inv item
-    if (!setAskFor.insert(inv.hash).second)
-        return;
-
-    // If we need to ask for this inv again (after it has already been received)
-    // then pretend we never received it before so that the request is actually performed.
-    // Otherwise, this request would be blocked in main::SendMessages.
-    if (connman->mapAlreadyReceived.erase(inv)) {
-        LogPrint("net", "%s():%d - askfor %s even though it was received already in the past\n", __func__, __LINE__, inv.ToString());
-    }
-
-    // We're using mapAskFor as a priority queue,
-    // the key is the earliest time the request can be sent
-    int64_t nRequestTime;
-    LimitedMap<CInv, int64_t>::const_iterator it = connman->mapAlreadyAskedFor.find(inv);
-    if (it != connman->mapAlreadyAskedFor.end())
-        nRequestTime = it->second;
-    else
-        nRequestTime = 0;
-    LogPrint("net", "askfor %s  %d (%s) peer=%d\n", inv.ToString(), nRequestTime, DateTimeStrFormat("%H:%M:%S", nRequestTime/1000000), id);
-
-    // Make sure not to reuse time indexes to keep things in the same order
-    int64_t nNow = GetTimeMicros() - 1000000;
-    static int64_t nLastTime;
-    ++nLastTime;
-    nNow = std::max(nNow, nLastTime);
-    nLastTime = nNow;
-
-    // Each retry is 2 minutes after the last
-    nRequestTime = std::max(nRequestTime + 2 * 60 * 1000000, nNow);
-    if (it != connman->mapAlreadyAskedFor.end())
-        connman->mapAlreadyAskedFor.update(it, nRequestTime);
-    else
-        connman->mapAlreadyAskedFor.insert(std::make_pair(inv, nRequestTime));
-    mapAskFor.insert(std::make_pair(nRequestTime, inv));
-}
-
 void CNode::BeginMessage(const char* pszCommand) EXCLUSIVE_LOCK_FUNCTION(cs_vSend)
 {
     ENTER_CRITICAL_SECTION(cs_vSend);
@@ -2571,7 +3078,7 @@ void CNode::EndMessage(const char* pszCommand) UNLOCK_FUNCTION(cs_vSend)
     // The -*messagestest options are intentionally not documented in the help message,
     // since they are only used during development to debug the networking code and are
     // not intended for end-users.
-    if (mapArgs.count("-dropmessagestest") && GetRand(GetArg("-dropmessagestest", 2)) == 0)
+    if (mapArgs.count("-dropmessagestest") && GetFastRand(GetArg("-dropmessagestest", 2)) == 0)
     {
         LogPrint("net", "dropmessages DROPPING SEND MESSAGE\n");
         AbortMessage();
@@ -2585,25 +3092,17 @@ void CNode::EndMessage(const char* pszCommand) UNLOCK_FUNCTION(cs_vSend)
         LEAVE_CRITICAL_SECTION(cs_vSend);
         return;
     }
-    // Set the size
-    unsigned int nSize = ssSend.size() - CMessageHeader::HEADER_SIZE;
-    WriteLE32((uint8_t*)&ssSend[CMessageHeader::MESSAGE_SIZE_OFFSET], nSize);
-
-    // Set the checksum
-    uint256 hash = Hash(ssSend.begin() + CMessageHeader::HEADER_SIZE, ssSend.end());
-    unsigned int nChecksum = 0;
-    memcpy(&nChecksum, &hash, sizeof(nChecksum));
-    assert(ssSend.size () >= CMessageHeader::CHECKSUM_OFFSET + sizeof(nChecksum));
-    memcpy((char*)&ssSend[CMessageHeader::CHECKSUM_OFFSET], &nChecksum, sizeof(nChecksum));
+    unsigned int nSize = FinalizeMessageHeader(ssSend);
 
     LogPrint("net", "(%d bytes) peer=%d\n", nSize, id);
 
-    std::deque<CSerializeData>::iterator it = vSendMsg.insert(vSendMsg.end(), CSerializeData());
-    ssSend.GetAndClear(*it);
-    nSendSize += (*it).size();
+    std::shared_ptr<CSerializeData> msg = std::make_shared<CSerializeData>();
+    ssSend.GetAndClear(*msg);
+    nSendSize += msg->size();
+    vSendMsg.push_back(msg);
 
     // If write queue empty, attempt "optimistic write"
-    if (it == vSendMsg.begin())
+    if (vSendMsg.size() == 1)
         connman->SocketSendData(this);
 
     // Only now save stats on sent bytes
@@ -2613,3 +3112,48 @@ void CNode::EndMessage(const char* pszCommand) UNLOCK_FUNCTION(cs_vSend)
 
     return;
 }
+
+unsigned int CNode::FinalizeMessageHeader(CPublicDataStream& ss)
+{
+    // Set the size
+    unsigned int nSize = ss.size() - CMessageHeader::HEADER_SIZE;
+    WriteLE32((uint8_t*)&ss[CMessageHeader::MESSAGE_SIZE_OFFSET], nSize);
+
+    // Set the checksum
+    uint256 hash = Hash(ss.begin() + CMessageHeader::HEADER_SIZE, ss.end());
+    unsigned int nChecksum = 0;
+    memcpy(&nChecksum, &hash, sizeof(nChecksum));
+    assert(ss.size () >= CMessageHeader::CHECKSUM_OFFSET + sizeof(nChecksum));
+    memcpy((char*)&ss[CMessageHeader::CHECKSUM_OFFSET], &nChecksum, sizeof(nChecksum));
+
+    return nSize;
+}
+
+void CNode::BeginSerializedMessage(CPublicDataStream& ss, const char* pszCommand)
+{
+    ss << CMessageHeader(Params().MessageStart(), pszCommand, 0);
+}
+
+std::shared_ptr<const CSerializeData> CNode::EndSerializedMessage(CPublicDataStream& ss)
+{
+    FinalizeMessageHeader(ss);
+    std::shared_ptr<CSerializeData> msg = std::make_shared<CSerializeData>();
+    ss.MoveTo(*msg);
+    return msg;
+}
+
+void CNode::PushSerializedMessage(const char* pszCommand, const std::shared_ptr<const CSerializeData>& msg)
+{
+    assert(msg->size() >= CMessageHeader::HEADER_SIZE);
+    LOCK(cs_vSend);
+    LogPrint("net", "sending: %s (%d bytes, shared) peer=%d\n", SanitizeString(pszCommand), msg->size() - CMessageHeader::HEADER_SIZE, id);
+
+    nSendSize += msg->size();
+    vSendMsg.push_back(msg);
+
+    // If write queue empty, attempt "optimistic write"
+    if (vSendMsg.size() == 1)
+        connman->SocketSendData(this);
+
+    AccountForSentBytes(pszCommand, msg->size());
+}
@@ -10,7 +10,6 @@
 #include "compat.h"
 #include "hash.h"
 #include "limitedmap.h"
-#include "mruset.h"
 #include "netbase.h"
 #include "protocol.h"
 #include "random.h"
@@ -22,6 +21,8 @@
 
 #include <atomic>
 #include <deque>
+#include <limits>
+#include <memory>
 #include <thread>
 #include <condition_variable>
 #include <stdint.h>
@@ -53,6 +54,13 @@ static const int PING_INTERVAL = 2 * 60;
 static const int TIMEOUT_INTERVAL = 20 * 60;
 /** The maximum number of entries in an 'inv' protocol message */
 static const unsigned int MAX_INV_SZ = 50000;
+/** Average delay between trickled transaction inventory announcements, in seconds; outbound peers get half of it */
+static const unsigned int INVENTORY_BROADCAST_INTERVAL = 5;
+/** The maximum number of transactions and certificates announced to a peer per trickle */
+static const unsigned int INVENTORY_BROADCAST_MAX = 7 * INVENTORY_BROADCAST_INTERVAL;
+/** The number of recent inventory hashes remembered per peer, and their false positive rate */
+static const unsigned int INVENTORY_KNOWN_SZ = 5000;
+static const double INVENTORY_KNOWN_FP_RATE = 0.000001;
 /** The maximum number of new addresses to accumulate before announcing. */
 static const unsigned int MAX_ADDR_TO_SEND = 1000;
 /** The maximum rate of address records we're willing to process on average. Can be bypassed using
@@ -67,12 +75,15 @@ static const unsigned int MAX_PROTOCOL_MESSAGE_LENGTH = 4 * 1024 * 1024;
 static_assert((MAX_PROTOCOL_MESSAGE_LENGTH >= MAX_BLOCK_SIZE),
     "net.h MAX_PROTOCOL_MESSAGE_LENGTH must be greater or equal than max block size!");
 
+/** The half-life in seconds of the proof verification cost charged to a peer */
+static const int64_t PROOF_COST_HALF_LIFE = 10 * 60;
+/** The proof verification cost in microseconds above which an inbound peer is the first to be evicted */
+static const int64_t PROOF_COST_EVICTION_THRESHOLD = 60 * 1000000LL;
+
 /** -listen default */
 static const bool DEFAULT_LISTEN = true;
-/** The maximum number of entries in mapAskFor */
-static const size_t MAPASKFOR_MAX_SZ = MAX_INV_SZ;
-/** The maximum number of entries in setAskFor (larger due to getdata latency) */
-static const size_t SETASKFOR_MAX_SZ = 2 * MAX_INV_SZ;
+/** -certannounce default, whether certificates are announced with certinv messages to the peers supporting them */
+static const bool DEFAULT_CERT_ANNOUNCE = true;
 /** The maximum number of entries in mapAlreadyReceived (8 peers * 2min additional delay each * 100tx/s) */
 static const size_t MAPRECEIVED_MAX_SZ = 8 * 120 * 100;
 /** The maximum number of peer connections to maintain */
@@ -81,11 +92,25 @@ static const unsigned int DEFAULT_MAX_PEER_CONNECTIONS = 125;
 static const unsigned int DEFAULT_MAX_RECEIVE_BUFFER = 5000;
 /** The default size of send buffer (<n>*1000 bytes) */
 static const unsigned int DEFAULT_MAX_SEND_BUFFER = 1000;
+/** The default and maximum number of message handler threads */
+static const int DEFAULT_MSG_HANDLER_THREADS = 1;
+static const int MAX_MSG_HANDLER_THREADS = 16;
+/** The default and maximum number of threads doing the TLS handshakes of the inbound connections */
+static const int DEFAULT_TLS_HANDSHAKE_THREADS = 2;
+static const int MAX_TLS_HANDSHAKE_THREADS = 16;
+/** The maximum number of inbound connections waiting for their TLS handshake, the others are dropped */
+static const int MAX_PENDING_TLS_HANDSHAKES = 64;
+/** The maximum number of queued messages handed to the kernel by a single sendmsg() */
+static const size_t MAX_SEND_IOV = 64;
+/** Queued messages smaller than this are gathered into TLS records of up to this size (the maximum TLS record payload) */
+static const size_t TLS_SEND_BATCH_SIZE = 16 * 1024;
 
 static const int MAX_OUTBOUND_CONNECTIONS = 8;
 
 void AddressCurrentlyConnected(const CService& addr);
 unsigned short GetListenPort();
+/** The -socketevents modes available on this platform, the first one is the default */
+std::vector<std::string> GetSocketEventsModes();
 
 SSL_CTX* create_context(bool server_side);
 EVP_PKEY *generate_key();
@@ -163,8 +188,9 @@ extern uint64_t nLocalHostNonce;
 extern CAddrMan addrman;
 /** Maximum number of connections to simultaneously allow (aka connection slots) */
 
-extern std::map<CInv, CDataStream> mapRelay;
-extern std::deque<std::pair<int64_t, CInv> > vRelayExpiration;
+//! The tx messages of the transactions and certificates relayed in the last 15 minutes, serialized once for all the peers
+extern std::map<uint256, std::shared_ptr<const CSerializeData> > mapRelay;
+extern std::deque<std::pair<int64_t, uint256> > vRelayExpiration;
 extern CCriticalSection cs_mapRelay;
 
 extern SSL_CTX *tls_ctx_server;
@@ -185,6 +211,8 @@ public:
     uint64_t nServices = 0;
     bool fTLSEstablished = false;
     bool fTLSVerified = false;
+    bool fTLSResumed = false;
+    double dTLSHandshakeTime = 0;
     int64_t nLastSend = 0;
     int64_t nLastRecv = 0;
     int64_t nTimeConnected = 0;
@@ -201,6 +229,7 @@ public:
     bool fWhitelisted = false;
     double dPingTime = 0.0;
     double dPingWait = 0.0;
+    double dProofVerificationCost = 0.0;
     std::string addrLocal;
     uint64_t m_addr_rate_limited = 0;
     uint64_t m_addr_processed = 0;
@@ -219,6 +248,7 @@ public:
 
     CDataStream vRecv;              // received message data
     unsigned int nDataPos;
+    CHash256 hasher;                // the checksum of the data received so far
 
     int64_t nTime;                  // time (in microseconds) of message receipt.
 
@@ -246,6 +276,7 @@ public:
     int readHeader(const char *pch, unsigned int nBytes);
     int readData(const char *pch, unsigned int nBytes);
 
+    // Finalizes the checksum, once the message is complete
     unsigned int ComputeMessageChecksum();
 };
 
@@ -259,28 +290,39 @@ class CNode
 public:
     // OpenSSL
     SSL *ssl;
+    //! The time spent in the TLS handshake, in microseconds
+    int64_t nTLSHandshakeTime = 0;
 
     // socket
     uint64_t nServices;
     SOCKET hSocket;
     CCriticalSection cs_hSocket;
-    CDataStream ssSend;
+    CPublicDataStream ssSend;
     size_t nSendSize; // total size of all vSendMsg entries
     size_t nSendOffset; // offset inside the first vSendMsg already sent
-    uint64_t nSendBytes;
-    std::deque<CSerializeData> vSendMsg;
+    std::atomic<uint64_t> nSendBytes;
+    // the entries are shared with the other nodes a message has been queued on by PushSerializedMessage
+    std::deque<std::shared_ptr<const CSerializeData>> vSendMsg;
+    // SSL_write of the first vSendMsg entry must be retried with the same buffer
+    bool fSSLWriteRetry;
+    // Socket readiness, only used by the socket handler thread: the socket is registered with the
+    // socket events poller, it may be read without blocking, it may be written without blocking
+    bool fPollRegistered;
+    bool fPollRecv;
+    bool fPollSend;
     CCriticalSection cs_vSend;
 
     std::deque<CInv> vRecvGetData;
     std::deque<CNetMessage> vRecvMsg;
     CCriticalSection cs_vRecvMsg;
-    uint64_t nRecvBytes;
+    std::atomic<uint64_t> nRecvBytes;
     int nRecvVersion;
 
-    int64_t nLastSend;
-    int64_t nLastRecv;
+    // the counters and times read by copyStats are atomic, so that the stats are taken without the locks of the node
+    std::atomic<int64_t> nLastSend;
+    std::atomic<int64_t> nLastRecv;
     int64_t nTimeConnected;
-    int64_t nTimeOffset;
+    std::atomic<int64_t> nTimeOffset;
     CAddress addr;
     std::string addrName;
     CService addrLocal;
@@ -316,9 +358,17 @@ public:
        /** When m_addr_token_bucket was last updated */
     int64_t m_addr_token_timestamp = 0;
     /** Total number of addresses that were dropped due to rate limiting. */
-    uint64_t m_addr_rate_limited = 0;
+    std::atomic<uint64_t> m_addr_rate_limited{0};
     /** Total number of addresses that were processed (excludes rate limited ones). */
-    uint64_t m_addr_processed = 0;
+    std::atomic<uint64_t> m_addr_processed{0};
+
+private:
+    //! The time in microseconds spent verifying the proofs of the certificates and CSW transactions of this
+    //! peer, decayed by half every PROOF_COST_HALF_LIFE seconds, and when it was last updated
+    mutable CCriticalSection cs_proofCost;
+    double dProofCost = 0.0;
+    int64_t nProofCostTime = 0;
+
 protected:
 
     // Denial-of-service detection/prevention
@@ -329,6 +379,11 @@ protected:
     // Basic fuzz-testing
     void Fuzz(int nChance); // modifies ssSend
 
+    // Fill in the payload size and checksum of the message in ss, returns the payload size
+    static unsigned int FinalizeMessageHeader(CPublicDataStream& ss);
+    static void BeginSerializedMessage(CPublicDataStream& ss, const char* pszCommand);
+    static std::shared_ptr<const CSerializeData> EndSerializedMessage(CPublicDataStream& ss);
+
     enum class eTlsOption {
         FALLBACK_UNSET = 0,
         FALLBACK_FALSE = 1,
@@ -344,25 +399,29 @@ public:
     // flood relay
     std::vector<CAddress> vAddrToSend;
     CRollingBloomFilter addrKnown;
+    //! Guards vAddrToSend and addrKnown, which the handlers of other peers push addresses to
+    CCriticalSection cs_vAddrToSend;
     bool fGetAddr;
     std::set<uint256> setKnown;
 
     // inventory based relay
-    mruset<CInv> setInventoryKnown;
+    CRollingBloomFilter filterInventoryKnown;
+    //! The blocks to announce, sent at the next SendMessages
     std::vector<CInv> vInventoryToSend;
+    //! The transactions and certificates to announce, trickled out at nNextInvSend
+    std::set<uint256> setInventoryTxToSend;
+    int64_t nNextInvSend;
     CCriticalSection cs_inventory;
-    std::set<uint256> setAskFor;
-    std::multimap<int64_t, CInv> mapAskFor;
 
     // Ping time measurement:
     // The pong reply we're expecting, or 0 if no pong expected.
-    uint64_t nPingNonceSent;
+    std::atomic<uint64_t> nPingNonceSent;
     // Time (in usec) the last ping was sent, or 0 if no ping was ever sent.
-    int64_t nPingUsecStart;
+    std::atomic<int64_t> nPingUsecStart;
     // Last measured round-trip time.
-    int64_t nPingUsecTime;
+    std::atomic<int64_t> nPingUsecTime;
     // Best measured round-trip time.
-    int64_t nMinPingUsecTime;
+    std::atomic<int64_t> nMinPingUsecTime;
     // Whether a ping is requested.
     bool fPingQueued;
 
@@ -371,9 +430,30 @@ public:
     CNode(CNode&&) = delete;
 
 private:
-    // messageType : {numberOfMessages, totalAmountOfBytes}
-    std::map<std::string, std::pair<uint64_t, uint64_t>> mapSendBytesPerMsgType;
-    std::map<std::string, std::pair<uint64_t, uint64_t>> mapRecvBytesPerMsgType;
+    struct CMsgTypeCounters
+    {
+        std::atomic<uint64_t> nMessages{0};
+        std::atomic<uint64_t> nBytes{0};
+    };
+    // messageType : {numberOfMessages, totalAmountOfBytes}, with an entry for each of allNetMessageTypes
+    // made by the constructor: the map itself does not change, the counters are read by copyStats
+    std::map<std::string, CMsgTypeCounters> mapSendBytesPerMsgType;
+    std::map<std::string, CMsgTypeCounters> mapRecvBytesPerMsgType;
+    //! The TLS state of the connection, established before the node is created, read once by copyStats
+    std::atomic<bool> fTLSStatsCached{false};
+    bool fTLSEstablishedCached = false;
+    bool fTLSVerifiedCached = false;
+    bool fTLSResumedCached = false;
+
+    static void AccountForBytes(std::map<std::string, CMsgTypeCounters>& mapBytes, const std::string& msg_type, size_t nBytes)
+    {
+        auto msgTypeInMap = mapBytes.find(msg_type);
+        if (msgTypeInMap == mapBytes.end())
+            msgTypeInMap = mapBytes.find(NetMsgType::OTHER);
+        assert(msgTypeInMap != mapBytes.end());
+        msgTypeInMap->second.nMessages.fetch_add(1, std::memory_order_relaxed);
+        msgTypeInMap->second.nBytes.fetch_add(nBytes, std::memory_order_relaxed);
+    }
 
     CNode(const CNode&);
     void operator=(const CNode&);
@@ -421,15 +501,21 @@ public:
         nRefCount--;
     }
 
+    //! Charged by the async proof verifier, once the proofs of this peer are verified
+    void AddProofVerificationCost(int64_t nCostMicros);
+    int64_t GetProofVerificationCost() const;
+
 
 
     void AddAddressKnown(const CAddress& addr)
     {
+        LOCK(cs_vAddrToSend);
         addrKnown.insert(addr.GetKey());
     }
 
     void PushAddress(const CAddress& addr)
     {
+        LOCK(cs_vAddrToSend);
         // Known checking here is only to save space from duplicates.
         // SendMessages will filter it again for knowns that were added
         // after addresses were pushed.
@@ -447,21 +533,29 @@ public:
     {
         {
             LOCK(cs_inventory);
-            setInventoryKnown.insert(inv);
+            filterInventoryKnown.insert(inv.hash);
         }
     }
 
+    bool IsInventoryKnown(const uint256& hash)
+    {
+        LOCK(cs_inventory);
+        return filterInventoryKnown.contains(hash);
+    }
+
     void PushInventory(const CInv& inv)
     {
         {
             LOCK(cs_inventory);
-            if (!setInventoryKnown.count(inv))
+            if (filterInventoryKnown.contains(inv.hash))
+                return;
+            if (inv.type == MSG_TX)
+                setInventoryTxToSend.insert(inv.hash);
+            else
                 vInventoryToSend.push_back(inv);
         }
     }
 
-    void AskFor(const CInv& inv);
-
     // TODO: Document the postcondition of this function.  Is cs_vSend locked?
     void BeginMessage(const char* pszCommand) EXCLUSIVE_LOCK_FUNCTION(cs_vSend);
 
@@ -471,6 +565,23 @@ public:
     // TODO: Document the precondition of this function.  Is cs_vSend locked?
     void EndMessage(const char* pszCommand) UNLOCK_FUNCTION(cs_vSend);
 
+    /**
+     * Serialize a message once, so that it can be queued on any number of nodes with
+     * PushSerializedMessage, which share the same buffer. nVersion is the version of the
+     * send stream of the nodes.
+     */
+    template<typename T1>
+    static std::shared_ptr<const CSerializeData> SerializeMessage(int nVersion, const char* pszCommand, const T1& a1)
+    {
+        CPublicDataStream ss(SER_NETWORK, nVersion);
+        BeginSerializedMessage(ss, pszCommand);
+        ss.ReserveFor(a1);
+        ss << a1;
+        return EndSerializedMessage(ss);
+    }
+
+    void PushSerializedMessage(const char* pszCommand, const std::shared_ptr<const CSerializeData>& msg);
+
     void PushVersion();
 
 
@@ -667,20 +778,13 @@ public:
     void AccountForSentBytes(const std::string& msg_type, size_t sent_bytes)
         EXCLUSIVE_LOCKS_REQUIRED(cs_vSend)
     {
-        std::pair<uint64_t, uint64_t>& messageType = mapSendBytesPerMsgType[msg_type];
-        messageType.first  += 1;            // number of messages
-        messageType.second += sent_bytes;   // amount of data for message type
+        AccountForBytes(mapSendBytesPerMsgType, msg_type, sent_bytes);
     }
 
     void AccountForRecvBytes(const std::string& msg_type, size_t recv_bytes)
         EXCLUSIVE_LOCKS_REQUIRED(cs_vRecvMsg)
     {
-        auto msgTypeInMap = mapRecvBytesPerMsgType.find(msg_type);
-        if (msgTypeInMap == mapRecvBytesPerMsgType.end())
-            msgTypeInMap = mapRecvBytesPerMsgType.find(NetMsgType::OTHER);
-        assert(msgTypeInMap != mapRecvBytesPerMsgType.end());
-        msgTypeInMap->second.first  += 1;           // number of messages
-        msgTypeInMap->second.second += recv_bytes;  // amount of data for message type
+        AccountForBytes(mapRecvBytesPerMsgType, msg_type, recv_bytes);
     }
 
     // returns the value of the tlsfallbacknontls and tlsvalidate flags set at zend startup (see init.cpp)
@@ -696,6 +800,9 @@ void Relay(const CTransaction& tx);
 void Relay(const CScCertificate& cert);
 void Relay(const CTransactionBase& tx, const CDataStream& ss);
 
+/** Return a timestamp in the future (in microseconds) for exponentially distributed events. */
+int64_t PoissonNextSend(int64_t nNow, int average_interval_seconds);
+
 /** Access to the (IP) address database (peers.dat) */
 class CAddrDB
 {
@@ -744,6 +851,8 @@ public:
         int nMaxConnections = 0;
         unsigned int nSendBufferMaxSize = 0;
         unsigned int nReceiveFloodSize = 0;
+        int nMessageHandlerThreads = DEFAULT_MSG_HANDLER_THREADS;
+        int nTLSHandshakeThreads = DEFAULT_TLS_HANDSHAKE_THREADS;
         
         std::vector<CSubNet> vWhitelistedRange;
     };
@@ -754,6 +863,8 @@ public:
         nMaxConnections = connOptions.nMaxConnections;
         nSendBufferMaxSize = connOptions.nSendBufferMaxSize;
         nReceiveFloodSize = connOptions.nReceiveFloodSize;
+        nMessageHandlerThreads = connOptions.nMessageHandlerThreads;
+        nTLSHandshakeThreads = connOptions.nTLSHandshakeThreads;
         {
             LOCK(cs_vWhitelistedRange);
             vWhitelistedRange = connOptions.vWhitelistedRange;
@@ -781,7 +892,9 @@ public:
     bool IsWhitelistedRange(const CNetAddr &ip);
     bool AttemptToEvictConnection(bool fPreferNewConnection);
 
-    void SocketSendData(CNode *pnode);
+    // Returns false if the socket cannot take more data until it becomes writable again
+    bool SocketSendData(CNode *pnode);
+    void GetSocketInterest(CNode *pnode, bool& fWantRecv, bool& fWantSend);
 
     CConnman();
     ~CConnman();
@@ -796,6 +909,8 @@ public:
     CCriticalSection cs_vAddedNodes;
     std::list<CNode*> vNodesDisconnected;
     std::vector<ListenSocket> vhListenSocket;
+    // the socket handler waits with select(), which cannot handle the sockets beyond FD_SETSIZE
+    std::atomic<bool> fSelectableSocketsOnly{true};
     std::unique_ptr<CSemaphore> semOutbound = nullptr;
 
     std::atomic<NodeId> nLastNodeId{0};
@@ -814,7 +929,7 @@ public:
     std::vector<CSubNet> vWhitelistedRange;
     CCriticalSection cs_vWhitelistedRange;
 
-    LimitedMap<CInv, int64_t> mapAlreadyAskedFor{MAX_INV_SZ};
+    // guarded by cs_main
     LimitedMap<CInv, int64_t> mapAlreadyReceived{MAPRECEIVED_MAX_SZ};
 
     // Network stats
@@ -825,6 +940,24 @@ public:
     unsigned int GetReceiveFloodSize();
     unsigned int GetSendBufferSize();
 
+    struct TLSHandshakeStats
+    {
+        uint64_t nCount = 0;
+        uint64_t nResumed = 0;
+        //! The sum of the handshake times, in microseconds
+        int64_t nTotalTime = 0;
+    };
+    void RecordTLSHandshake(bool fInbound, int64_t nTime, bool fResumed);
+    TLSHandshakeStats GetTLSHandshakeStats(bool fInbound) const;
+
+    /**
+     * The stats of the connected nodes, cs_vNodes being only held to take a reference to them; nGeneration
+     * is set to GetNodesGeneration() as of the copy.
+     */
+    void CopyNodeStats(std::vector<CNodeStats>& vstats, uint64_t& nGeneration);
+    //! Changed whenever a node is added to or removed from vNodes
+    uint64_t GetNodesGeneration() const { return nNodesGeneration.load(std::memory_order_acquire); }
+
     // Used to convey which local services we are offering peers during node
     // connection.
     //
@@ -838,31 +971,61 @@ public:
 private:
     std::atomic<uint64_t> nTotalBytesRecv = 0;
     std::atomic<uint64_t> nTotalBytesSent = 0;
+    // indexed by fInbound
+    std::atomic<uint64_t> nTLSHandshakes[2] = {0, 0};
+    std::atomic<uint64_t> nTLSResumed[2] = {0, 0};
+    std::atomic<int64_t> nTLSHandshakeTime[2] = {0, 0};
+    //! incremented under cs_vNodes
+    std::atomic<uint64_t> nNodesGeneration{0};
 
     bool fAddressesInitialized {false};
+    //! addrman.GetModifications() as of the last write of peers.dat, which is skipped while it does not change
+    std::atomic<uint64_t> nAddressesDumped {std::numeric_limits<uint64_t>::max()};
     std::unique_ptr<CNode> pnodeLocalHost = nullptr;
 
     uint64_t nLocalServices;
     int nMaxConnections;
     unsigned int nSendBufferMaxSize;
     unsigned int nReceiveFloodSize;
+    int nMessageHandlerThreads;
+    int nTLSHandshakeThreads;
 
     CThreadInterrupt interruptNet;
     std::mutex mutexMsgProc;
     std::atomic<bool> flagInterruptMsgProc{false};
 
+    // The inbound connections waiting for a handshake thread, which adds them to vNodes once their
+    // TLS session is established, so that the socket handler does not wait for the slow peers
+    struct PendingHandshake
+    {
+        SOCKET hSocket;
+        CAddress addr;
+        bool fWhitelisted;
+    };
+    std::deque<PendingHandshake> queueHandshakes;
+    std::mutex mutexHandshakes;
+    std::condition_variable condHandshakes;
+    std::atomic<bool> flagInterruptHandshakes{false};
+    //! The connections queued or in handshake, counted with the inbound peers
+    std::atomic<int> nPendingHandshakes{0};
+
     std::thread threadDNSAddressSeed;
     std::thread threadSocketHandler;
     std::thread threadOpenAddedConnections;
     std::thread threadOpenConnections;
-    std::thread threadMessageHandler;
+    std::vector<std::thread> threadMessageHandlers;
     std::thread threadNonTLSPoolsCleaner;
+    std::vector<std::thread> threadTLSHandshakes;
     void ThreadOpenConnections();
     void ThreadOpenAddedConnections();
     void ThreadNonTLSPoolsCleaner();
     void ThreadSocketHandler();
     void ThreadDNSAddressSeed();
-    void ThreadMessageHandler();
+    void ThreadMessageHandler(int nThread);
+    void ThreadTLSHandshake();
+
+    void AcceptTLSConnection(SOCKET hSocket, const CAddress& addr, bool fWhitelisted);
+    void AddInboundNode(SOCKET hSocket, const CAddress& addr, bool fWhitelisted, SSL* ssl, int64_t nTLSHandshakeTime = 0);
 
     void DumpAddresses();
 
@@ -207,6 +207,12 @@ bool SetSocketNonBlocking(SOCKET& hSocket, bool fNonBlocking);
  * Convert milliseconds to a struct timeval for e.g. select.
  */
 struct timeval MillisToTimeval(int64_t nTimeout);
+/**
+ * Wait up to nTimeout milliseconds for a socket to become readable, or writable if fWrite.
+ * Returns a positive value if it did, 0 on timeout and SOCKET_ERROR on failure. Unlike
+ * select(), it is not limited to the sockets below FD_SETSIZE, but on Windows.
+ */
+int WaitForSocket(SOCKET hSocket, bool fWrite, int64_t nTimeout);
 void InterruptSocks5(bool interrupt);
 void InterruptLookup(bool interrupt);
 
@@ -0,0 +1,254 @@
+#include "notificationdispatcher.h"
+
+#include "main.h"
+#include "streams.h"
+#include "util.h"
+#include "utiltime.h"
+#include "validationinterface.h"
+#include "version.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <thread>
+
+CNotification::CNotification(const CBlockIndex* pindexIn)
+    : type(Type::BLOCK), hash(pindexIn->GetBlockHash()), pindex(pindexIn), nTimeQueuedMicros(GetTimeMicros()), fRaw(false)
+{
+}
+
+CNotification::CNotification(const CTransaction& tx, bool fSerialize)
+    : type(Type::TRANSACTION), hash(tx.GetHash()), pindex(nullptr), nTimeQueuedMicros(GetTimeMicros()), fRaw(fSerialize)
+{
+    if (fSerialize) {
+        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+        ss << tx;
+        vRaw.assign(ss.begin(), ss.end());
+    }
+}
+
+const std::vector<unsigned char>* CNotification::GetRaw() const
+{
+    if (type == Type::BLOCK) {
+        std::call_once(rawOnce, [this] {
+            // the new tip is in the block cache, along with its serialization once a peer asked for it
+            std::shared_ptr<const CSerializeData> msg;
+            {
+                LOCK(cs_main);
+                msg = ReadBlockMessageCached(pindex, PROTOCOL_VERSION);
+            }
+            if (!msg)
+                return;
+            vRaw.assign(msg->begin() + CMessageHeader::HEADER_SIZE, msg->end());
+            fRaw = true;
+        });
+    }
+    return fRaw ? &vRaw : nullptr;
+}
+
+namespace {
+
+class CSinkQueue
+{
+public:
+    CNotificationSink* const sink;
+    const std::string name;
+    const size_t nMaxSize;
+
+    CSinkQueue(CNotificationSink* sinkIn, size_t nMaxSizeIn)
+        : sink(sinkIn), name(sinkIn->GetNotificationSinkName()), nMaxSize(nMaxSizeIn), thread(&CSinkQueue::Run, this)
+    {
+    }
+
+    ~CSinkQueue()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            fStop = true;
+        }
+        cond.notify_one();
+        thread.join();
+    }
+
+    void Push(const std::shared_ptr<const CNotification>& notification)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (queue.size() >= nMaxSize) {
+                Dropped();
+                if (notification->type == CNotification::Type::TRANSACTION)
+                    return;
+                auto it = std::find_if(queue.begin(), queue.end(), [](const std::shared_ptr<const CNotification>& queued) {
+                    return queued->type == CNotification::Type::TRANSACTION;
+                });
+                queue.erase(it != queue.end() ? it : queue.begin());
+            }
+            queue.push_back(notification);
+            nMaxQueued = std::max(nMaxQueued, queue.size());
+        }
+        cond.notify_one();
+    }
+
+    CNotificationSinkStats GetStats() const
+    {
+        CNotificationSinkStats stats;
+        stats.name = name;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stats.nQueued = queue.size();
+            stats.nMaxQueued = nMaxQueued;
+            stats.nPublished = nPublished;
+            stats.nDropped = nDropped;
+        }
+        stats.lag = lag.GetSnapshot();
+        return stats;
+    }
+
+private:
+    mutable std::mutex mutex;
+    std::condition_variable cond;
+    std::deque<std::shared_ptr<const CNotification>> queue;
+    bool fStop = false;
+    //! Whether notifications were dropped since the queue was last empty, so that a burst is logged once
+    bool fDropping = false;
+    size_t nMaxQueued = 0;
+    uint64_t nPublished = 0;
+    uint64_t nDropped = 0;
+    CLatencyHistogram lag;
+    std::thread thread;
+
+    void Dropped()
+    {
+        ++nDropped;
+        if (!fDropping) {
+            fDropping = true;
+            LogPrintf("%s: notification sink %s is lagging, dropping notifications\n", __func__, name);
+        }
+    }
+
+    void Run()
+    {
+        RenameThread(("zen-notify-" + name).c_str());
+        while (true) {
+            std::shared_ptr<const CNotification> notification;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                cond.wait(lock, [this] { return fStop || !queue.empty(); });
+                if (fStop)
+                    return;
+                notification = queue.front();
+                queue.pop_front();
+                if (queue.empty())
+                    fDropping = false;
+            }
+
+            try {
+                if (notification->type == CNotification::Type::BLOCK)
+                    sink->NotifyBlock(*notification);
+                else
+                    sink->NotifyTransaction(*notification);
+            } catch (const std::exception& e) {
+                LogPrintf("%s: notification sink %s error: %s\n", __func__, name, e.what());
+            }
+            lag.Add(GetTimeMicros() - notification->nTimeQueuedMicros);
+
+            std::lock_guard<std::mutex> lock(mutex);
+            ++nPublished;
+        }
+    }
+};
+
+//! Guards vSinkQueues, held while a notification is queued to all the sinks
+std::mutex csSinkQueues;
+std::vector<std::unique_ptr<CSinkQueue>> vSinkQueues;
+
+class CNotificationDispatcher : public CValidationInterface
+{
+protected:
+    void UpdatedBlockTip(const CBlockIndex* pindex) override
+    {
+        std::lock_guard<std::mutex> lock(csSinkQueues);
+        auto notification = std::make_shared<const CNotification>(pindex);
+        for (const auto& sinkQueue : vSinkQueues)
+            sinkQueue->Push(notification);
+    }
+
+    void SyncTransaction(const CTransaction& tx, const CBlock* pblock) override
+    {
+        std::lock_guard<std::mutex> lock(csSinkQueues);
+        if (vSinkQueues.empty())
+            return;
+        const bool fSerialize = std::any_of(vSinkQueues.begin(), vSinkQueues.end(), [](const std::unique_ptr<CSinkQueue>& sinkQueue) {
+            return sinkQueue->sink->WantsRawTransactions();
+        });
+        auto notification = std::make_shared<const CNotification>(tx, fSerialize);
+        for (const auto& sinkQueue : vSinkQueues)
+            sinkQueue->Push(notification);
+    }
+};
+
+CNotificationDispatcher dispatcher;
+
+} // anon namespace
+
+void RegisterNotificationSink(CNotificationSink* sink)
+{
+    const size_t nMaxSize = std::max<int64_t>(1, GetArg("-notificationqueuesize", DEFAULT_NOTIFICATION_QUEUE_SIZE));
+    std::lock_guard<std::mutex> lock(csSinkQueues);
+    if (vSinkQueues.empty())
+        RegisterValidationInterface(&dispatcher);
+    vSinkQueues.emplace_back(new CSinkQueue(sink, nMaxSize));
+}
+
+void UnregisterNotificationSink(CNotificationSink* sink)
+{
+    std::unique_ptr<CSinkQueue> sinkQueue;
+    {
+        std::lock_guard<std::mutex> lock(csSinkQueues);
+        auto it = std::find_if(vSinkQueues.begin(), vSinkQueues.end(), [sink](const std::unique_ptr<CSinkQueue>& queued) {
+            return queued->sink == sink;
+        });
+        if (it == vSinkQueues.end())
+            return;
+        sinkQueue = std::move(*it);
+        vSinkQueues.erase(it);
+        if (vSinkQueues.empty())
+            UnregisterValidationInterface(&dispatcher);
+    }
+    // joins the thread of the sink, which may be busy publishing
+    sinkQueue.reset();
+}
+
+std::vector<CNotificationSinkStats> GetNotificationSinkStats()
+{
+    std::lock_guard<std::mutex> lock(csSinkQueues);
+    std::vector<CNotificationSinkStats> vStats;
+    for (const auto& sinkQueue : vSinkQueues)
+        vStats.push_back(sinkQueue->GetStats());
+    return vStats;
+}
+
+std::string NotificationStatsToPrometheus()
+{
+    const std::vector<CNotificationSinkStats> vStats = GetNotificationSinkStats();
+
+    static const char* const lagMetric = "zen_notification_publish_lag_seconds";
+    std::string strOut = strprintf("# HELP %s Delay between the queueing of a notification and the end of its publishing.\n", lagMetric);
+    strOut += strprintf("# TYPE %s histogram\n", lagMetric);
+    for (const CNotificationSinkStats& stats : vStats)
+        strOut += LatencyHistogramToPrometheus(lagMetric, strprintf("sink=\"%s\"", stats.name), stats.lag);
+
+    static const char* const queuedMetric = "zen_notification_queued";
+    strOut += strprintf("# HELP %s Notifications waiting to be published.\n", queuedMetric);
+    strOut += strprintf("# TYPE %s gauge\n", queuedMetric);
+    for (const CNotificationSinkStats& stats : vStats)
+        strOut += strprintf("%s{sink=\"%s\"} %u\n", queuedMetric, stats.name, stats.nQueued);
+
+    static const char* const droppedMetric = "zen_notification_dropped_total";
+    strOut += strprintf("# HELP %s Notifications dropped as the queue of the sink was full.\n", droppedMetric);
+    strOut += strprintf("# TYPE %s counter\n", droppedMetric);
+    for (const CNotificationSinkStats& stats : vStats)
+        strOut += strprintf("%s{sink=\"%s\"} %u\n", droppedMetric, stats.name, stats.nDropped);
+    return strOut;
+}
@@ -0,0 +1,89 @@
+#ifndef BITCOIN_NOTIFICATIONDISPATCHER_H
+#define BITCOIN_NOTIFICATIONDISPATCHER_H
+
+#include "uint256.h"
+#include "validationstats.h"
+
+#include <mutex>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+class CBlockIndex;
+class CTransaction;
+
+static const size_t DEFAULT_NOTIFICATION_QUEUE_SIZE = 1000;
+
+/**
+ * A new tip or transaction, handed to every notification sink. The serialized block or transaction
+ * is made once and shared by all the sinks: a transaction is serialized when queued, if any sink
+ * publishes raw transactions, while a block is only read from disk by the first sink asking for it,
+ * on that sink's thread.
+ */
+class CNotification
+{
+public:
+    enum class Type { BLOCK, TRANSACTION };
+
+    const Type type;
+    const uint256 hash;
+    //! The new tip, for blocks only
+    const CBlockIndex* const pindex;
+    const int64_t nTimeQueuedMicros;
+
+    explicit CNotification(const CBlockIndex* pindexIn);
+    CNotification(const CTransaction& tx, bool fSerialize);
+
+    //! The serialized block or transaction, nullptr if it could not be read or was not serialized
+    const std::vector<unsigned char>* GetRaw() const;
+
+private:
+    mutable std::once_flag rawOnce;
+    mutable std::vector<unsigned char> vRaw;
+    mutable bool fRaw;
+};
+
+/**
+ * A publisher of notifications, such as the ZMQ, AMQP and websocket servers. Each sink is fed by its
+ * own thread from a bounded queue, so a slow one neither delays block connection nor the others.
+ * When the queue is full a new transaction is dropped, while a new tip makes room by dropping the
+ * oldest queued transaction, or else the oldest tip.
+ */
+class CNotificationSink
+{
+public:
+    virtual ~CNotificationSink() {}
+
+    //! The name of the sink in the logs and the statistics
+    virtual std::string GetNotificationSinkName() const = 0;
+    virtual bool WantsRawTransactions() const { return false; }
+
+    virtual void NotifyBlock(const CNotification& notification) {}
+    virtual void NotifyTransaction(const CNotification& notification) {}
+};
+
+struct CNotificationSinkStats
+{
+    std::string name;
+    size_t nQueued = 0;
+    size_t nMaxQueued = 0;
+    uint64_t nPublished = 0;
+    uint64_t nDropped = 0;
+    //! Time between the queueing of the notifications and the end of their publishing
+    CLatencyHistogram::Snapshot lag;
+};
+
+/**
+ * Start feeding sink from a new thread, with a queue of -notificationqueuesize notifications.
+ * The sink must be unregistered before it is destroyed.
+ */
+void RegisterNotificationSink(CNotificationSink* sink);
+//! Stop the thread of sink once it has published the notification it is busy with, dropping its queue
+void UnregisterNotificationSink(CNotificationSink* sink);
+
+std::vector<CNotificationSinkStats> GetNotificationSinkStats();
+
+//! The queue depths, drops and publish lags of the sinks, in the Prometheus text exposition format
+std::string NotificationStatsToPrometheus();
+
+#endif // BITCOIN_NOTIFICATIONDISPATCHER_H
@@ -0,0 +1,222 @@
+#include "orphanpool.h"
+
+#include "primitives/block.h"
+#include "util.h"
+#include "utiltime.h"
+#include "version.h"
+
+#include <assert.h>
+#include <vector>
+
+bool COrphanPool::Add(const CTransactionBase& txObj, NodeId peer)
+{
+    const uint256 hash = txObj.GetHash();
+    if (mapOrphans.count(hash))
+        return false;
+
+    // Ignore big transactions, to avoid a
+    // send-big-orphans memory exhaustion attack. If a peer has a legitimate
+    // large transaction with a missing parent then we assume
+    // it will rebroadcast it later, after the parent transaction(s)
+    // have been mined or received.
+    const size_t nSize = txObj.GetSerializeSize(SER_NETWORK, PROTOCOL_VERSION);
+    if (nSize > MAX_ORPHAN_TX_SIZE)
+    {
+        LogPrint("mempool", "ignoring large orphan tx (size: %u, hash: %s)\n", nSize, hash.ToString());
+        return false;
+    }
+
+    const int64_t nTimeExpire = GetTime() + ORPHAN_TX_EXPIRE_TIME;
+    mapOrphans[hash] = COrphanTx{txObj.MakeShared(), peer, nTimeExpire, nSize};
+    for (const CTxIn& txin : txObj.GetVin())
+        mapOrphansByPrev[txin.prevout.hash].insert(hash);
+
+    CPeerOrphans& peerOrphans = mapPeers[peer];
+    peerOrphans.setOrphans.insert(std::make_pair(nTimeExpire, hash));
+    peerOrphans.nBytes += nSize;
+    setByExpiry.insert(std::make_pair(nTimeExpire, hash));
+    nTotalBytes += nSize;
+
+    LogPrint("mempool", "stored orphan tx %s (mapsz %u prevsz %u bytes %u)\n", hash.ToString(),
+             mapOrphans.size(), mapOrphansByPrev.size(), nTotalBytes);
+    return true;
+}
+
+bool COrphanPool::Have(const uint256& hash) const
+{
+    return mapOrphans.count(hash) != 0;
+}
+
+std::shared_ptr<const CTransactionBase> COrphanPool::Get(const uint256& hash, NodeId& fromPeer) const
+{
+    std::map<uint256, COrphanTx>::const_iterator it = mapOrphans.find(hash);
+    if (it == mapOrphans.end())
+        return nullptr;
+    fromPeer = it->second.fromPeer;
+    return it->second.tx;
+}
+
+void COrphanPool::Erase(uint256 hash)
+{
+    std::map<uint256, COrphanTx>::iterator it = mapOrphans.find(hash);
+    if (it == mapOrphans.end())
+        return;
+    const COrphanTx& orphan = it->second;
+
+    for (const CTxIn& txin : orphan.tx->GetVin())
+    {
+        std::map<uint256, std::set<uint256> >::iterator itPrev = mapOrphansByPrev.find(txin.prevout.hash);
+        if (itPrev == mapOrphansByPrev.end())
+            continue;
+        itPrev->second.erase(hash);
+        if (itPrev->second.empty())
+            mapOrphansByPrev.erase(itPrev);
+    }
+
+    std::map<NodeId, CPeerOrphans>::iterator itPeer = mapPeers.find(orphan.fromPeer);
+    if (itPeer != mapPeers.end())
+    {
+        CPeerOrphans& peerOrphans = itPeer->second;
+        peerOrphans.setOrphans.erase(std::make_pair(orphan.nTimeExpire, hash));
+        peerOrphans.nBytes -= orphan.nSize;
+        nWork -= peerOrphans.setWork.erase(hash);
+        if (peerOrphans.setOrphans.empty() && peerOrphans.setWork.empty())
+            mapPeers.erase(itPeer);
+    }
+
+    setByExpiry.erase(std::make_pair(orphan.nTimeExpire, hash));
+    nTotalBytes -= orphan.nSize;
+    mapOrphans.erase(it);
+}
+
+unsigned int COrphanPool::EraseForPeer(NodeId peer)
+{
+    std::map<NodeId, CPeerOrphans>::iterator itPeer = mapPeers.find(peer);
+    if (itPeer == mapPeers.end())
+        return 0;
+
+    // the work set only holds orphans of the peer, which go with it
+    std::vector<uint256> vErase;
+    vErase.reserve(itPeer->second.setOrphans.size());
+    for (const std::pair<int64_t, uint256>& entry : itPeer->second.setOrphans)
+        vErase.push_back(entry.second);
+    for (const uint256& hash : vErase)
+        Erase(hash);
+
+    if (!vErase.empty())
+        LogPrint("mempool", "Erased %d orphan tx from peer %d\n", vErase.size(), peer);
+    return vErase.size();
+}
+
+unsigned int COrphanPool::EraseForBlock(const CBlock& block)
+{
+    if (mapOrphans.empty())
+        return 0;
+
+    std::set<uint256> setErase;
+    auto addConflicts = [this, &setErase](const CTransactionBase& txBase) {
+        if (mapOrphans.count(txBase.GetHash()))
+            setErase.insert(txBase.GetHash());
+        for (const CTxIn& txin : txBase.GetVin())
+        {
+            std::map<uint256, std::set<uint256> >::const_iterator itPrev = mapOrphansByPrev.find(txin.prevout.hash);
+            if (itPrev == mapOrphansByPrev.end())
+                continue;
+            for (const uint256& orphanHash : itPrev->second)
+            {
+                for (const CTxIn& orphanIn : mapOrphans.at(orphanHash).tx->GetVin())
+                {
+                    if (orphanIn.prevout == txin.prevout)
+                    {
+                        setErase.insert(orphanHash);
+                        break;
+                    }
+                }
+            }
+        }
+    };
+    for (const CTransaction& tx : block.vtx)
+        addConflicts(tx);
+    for (const CScCertificate& cert : block.vcert)
+        addConflicts(cert);
+
+    for (const uint256& hash : setErase)
+        Erase(hash);
+
+    if (!setErase.empty())
+        LogPrint("mempool", "Erased %d orphan tx included or conflicted by block\n", setErase.size());
+    return setErase.size();
+}
+
+unsigned int COrphanPool::EraseExpired(int64_t nNow)
+{
+    unsigned int nErased = 0;
+    while (!setByExpiry.empty() && setByExpiry.begin()->first <= nNow)
+    {
+        Erase(setByExpiry.begin()->second);
+        ++nErased;
+    }
+    if (nErased > 0)
+        LogPrint("mempool", "Erased %d expired orphan tx\n", nErased);
+    return nErased;
+}
+
+unsigned int COrphanPool::Limit(unsigned int nMaxOrphans)
+{
+    EraseExpired(GetTime());
+
+    unsigned int nEvicted = 0;
+    while (mapOrphans.size() > nMaxOrphans)
+    {
+        // Evict the oldest orphan of the peer using the most bytes
+        std::map<NodeId, CPeerOrphans>::const_iterator itLargest = mapPeers.end();
+        for (std::map<NodeId, CPeerOrphans>::const_iterator itPeer = mapPeers.begin(); itPeer != mapPeers.end(); ++itPeer)
+        {
+            if (itPeer->second.setOrphans.empty())
+                continue;
+            if (itLargest == mapPeers.end() || itPeer->second.nBytes > itLargest->second.nBytes)
+                itLargest = itPeer;
+        }
+        assert(itLargest != mapPeers.end());
+        Erase(itLargest->second.setOrphans.begin()->second);
+        ++nEvicted;
+    }
+    return nEvicted;
+}
+
+void COrphanPool::AddChildrenToWorkSet(const uint256& hash)
+{
+    std::map<uint256, std::set<uint256> >::const_iterator itPrev = mapOrphansByPrev.find(hash);
+    if (itPrev == mapOrphansByPrev.end())
+        return;
+    for (const uint256& orphanHash : itPrev->second)
+        nWork += mapPeers[mapOrphans.at(orphanHash).fromPeer].setWork.insert(orphanHash).second;
+}
+
+bool COrphanPool::GetNextWork(NodeId peer, uint256& hash)
+{
+    std::map<NodeId, CPeerOrphans>::iterator itPeer = mapPeers.find(peer);
+    if (itPeer == mapPeers.end() || itPeer->second.setWork.empty())
+        return false;
+    std::set<uint256>::iterator itWork = itPeer->second.setWork.begin();
+    hash = *itWork;
+    itPeer->second.setWork.erase(itWork);
+    --nWork;
+    return true;
+}
+
+void COrphanPool::Clear()
+{
+    mapOrphans.clear();
+    mapOrphansByPrev.clear();
+    mapPeers.clear();
+    setByExpiry.clear();
+    nTotalBytes = 0;
+    nWork = 0;
+}
+
+size_t COrphanPool::PeerBytes(NodeId peer) const
+{
+    std::map<NodeId, CPeerOrphans>::const_iterator itPeer = mapPeers.find(peer);
+    return itPeer != mapPeers.end() ? itPeer->second.nBytes : 0;
+}
@@ -0,0 +1,92 @@
+#ifndef BITCOIN_ORPHANPOOL_H
+#define BITCOIN_ORPHANPOOL_H
+
+#include "net.h"
+#include "uint256.h"
+
+#include <atomic>
+#include <map>
+#include <memory>
+#include <set>
+#include <stdint.h>
+#include <utility>
+
+class CBlock;
+class CTransactionBase;
+
+//! Orphans waiting longer than this for their parents are dropped, in seconds
+static const int64_t ORPHAN_TX_EXPIRE_TIME = 20 * 60;
+//! Orphans larger than this are not kept, in bytes
+static const unsigned int MAX_ORPHAN_TX_SIZE = 5000;
+//! The maximum number of orphans of a peer reprocessed per ProcessMessages call
+static const unsigned int MAX_ORPHAN_WORK_BATCH = 10;
+
+struct COrphanTx {
+    std::shared_ptr<const CTransactionBase> tx;
+    NodeId fromPeer;
+    int64_t nTimeExpire;
+    size_t nSize;
+};
+
+/**
+ * The txes and certificates whose inputs are missing, waiting for their parents to enter the mempool
+ * or a block. Orphans are indexed by the txes they spend, by the peer that sent them and by expiry
+ * time, and their size is accounted in bytes. When the pool is full the orphans of the peer using the
+ * most bytes are evicted first, oldest first, so that a peer flooding orphans only evicts its own.
+ *
+ * The orphans whose parents show up are not reprocessed right away: they are queued on the work set
+ * of the peer that sent them, which its message handler goes through in batches of
+ * MAX_ORPHAN_WORK_BATCH. Guarded by cs_main, except HaveAnyWork.
+ */
+class COrphanPool
+{
+public:
+    //! Store an orphan sent by peer, false if it is already stored or too large
+    bool Add(const CTransactionBase& txObj, NodeId peer);
+    bool Have(const uint256& hash) const;
+    //! The orphan with this hash and the peer that sent it, nullptr if it is not stored
+    std::shared_ptr<const CTransactionBase> Get(const uint256& hash, NodeId& fromPeer) const;
+
+    //! By value, the hash may be a key of the indexes it is erased from
+    void Erase(uint256 hash);
+    unsigned int EraseForPeer(NodeId peer);
+    //! Erase the orphans included in the block, and those spending an output it spends, which can never be valid
+    unsigned int EraseForBlock(const CBlock& block);
+    unsigned int EraseExpired(int64_t nNow);
+    //! Erase the expired orphans, then evict orphans until at most nMaxOrphans are left
+    unsigned int Limit(unsigned int nMaxOrphans);
+
+    //! Queue the orphans spending the outputs of hash on the work sets of the peers that sent them
+    void AddChildrenToWorkSet(const uint256& hash);
+    //! Pop an orphan of the work set of peer, false if it is empty
+    bool GetNextWork(NodeId peer, uint256& hash);
+    //! Whether the work set of any peer is not empty, without cs_main
+    bool HaveAnyWork() const { return nWork.load(std::memory_order_relaxed) > 0; }
+
+    void Clear();
+
+    size_t Size() const { return mapOrphans.size(); }
+    size_t PrevSize() const { return mapOrphansByPrev.size(); }
+    //! The serialized size of the orphans stored
+    size_t TotalBytes() const { return nTotalBytes; }
+    size_t PeerBytes(NodeId peer) const;
+
+private:
+    struct CPeerOrphans
+    {
+        //! (expiry time, hash), oldest first
+        std::set<std::pair<int64_t, uint256> > setOrphans;
+        size_t nBytes = 0;
+        std::set<uint256> setWork;
+    };
+
+    std::map<uint256, COrphanTx> mapOrphans;
+    std::map<uint256, std::set<uint256> > mapOrphansByPrev;
+    std::map<NodeId, CPeerOrphans> mapPeers;
+    std::set<std::pair<int64_t, uint256> > setByExpiry;
+    size_t nTotalBytes = 0;
+    //! The number of entries of the work sets
+    std::atomic<size_t> nWork{0};
+};
+
+#endif // BITCOIN_ORPHANPOOL_H
@@ -13,6 +13,17 @@ using namespace std;
 
 static boost::filesystem::path emptyPath;
 
+//! The payment disclosure database is opened with leveldb itself, rather than with a CDBEngine
+static void HandleError(const leveldb::Status& status)
+{
+    if (status.ok())
+        return;
+    const CDBStatus::Code code = status.IsNotFound() ? CDBStatus::NOT_FOUND :
+                                 status.IsCorruption() ? CDBStatus::CORRUPTION :
+                                 status.IsIOError() ? CDBStatus::IO_ERROR : CDBStatus::OTHER;
+    HandleError(CDBStatus(code, status.ToString()));
+}
+
 /**
  * Static method to return the shared/default payment disclosure database.
  */
@@ -11,6 +11,16 @@
 #include "txmempool.h"
 #include "util.h"
 
+#include <cmath>
+
+FeeEstimateType GetFeeEstimateType(const CTransaction& tx)
+{
+    if (!tx.GetVscCcOut().empty() || !tx.GetVftCcOut().empty() ||
+        !tx.GetVBwtRequestOut().empty() || !tx.GetVcswCcIn().empty())
+        return FeeEstimateType::SIDECHAIN_TRANSACTION;
+    return FeeEstimateType::TRANSACTION;
+}
+
 void TxConfirmStats::Initialize(std::vector<double>& defaultBuckets,
                                 unsigned int maxConfirms, double _decay, std::string _dataTypeString)
 {
@@ -25,32 +35,36 @@ void TxConfirmStats::Initialize(std::vector<double>& defaultBuckets,
     }
 
     confAvg.resize(maxConfirms);
-    curBlockConf.resize(maxConfirms);
     unconfTxs.resize(maxConfirms);
     for (unsigned int i = 0; i < maxConfirms; i++) {
         confAvg[i].resize(buckets.size());
-        curBlockConf[i].resize(buckets.size());
         unconfTxs[i].resize(buckets.size());
     }
+    unconfHeight.resize(maxConfirms);
 
     oldUnconfTxs.resize(buckets.size());
-    curBlockTxCt.resize(buckets.size());
     txCtAvg.resize(buckets.size());
-    curBlockVal.resize(buckets.size());
     avg.resize(buckets.size());
+    lastUpdateHeight.resize(buckets.size());
 }
 
-// Zero out the data for the current block
-void TxConfirmStats::ClearCurrent(unsigned int nBlockHeight)
+double TxConfirmStats::DecayFactor(unsigned int bucketIndex, unsigned int nBlockHeight) const
 {
-    for (unsigned int j = 0; j < buckets.size(); j++) {
-        oldUnconfTxs[j] += unconfTxs[nBlockHeight%unconfTxs.size()][j];
-        unconfTxs[nBlockHeight%unconfTxs.size()][j] = 0;
-        for (unsigned int i = 0; i < curBlockConf.size(); i++)
-            curBlockConf[i][j] = 0;
-        curBlockTxCt[j] = 0;
-        curBlockVal[j] = 0;
-    }
+    if (nBlockHeight <= lastUpdateHeight[bucketIndex])
+        return 1;
+    return std::pow(decay, nBlockHeight - lastUpdateHeight[bucketIndex]);
+}
+
+void TxConfirmStats::DecayBucket(unsigned int bucketIndex, unsigned int nBlockHeight)
+{
+    if (nBlockHeight <= lastUpdateHeight[bucketIndex])
+        return;
+    const double factor = DecayFactor(bucketIndex, nBlockHeight);
+    for (unsigned int i = 0; i < confAvg.size(); i++)
+        confAvg[i][bucketIndex] *= factor;
+    avg[bucketIndex] *= factor;
+    txCtAvg[bucketIndex] *= factor;
+    lastUpdateHeight[bucketIndex] = nBlockHeight;
 }
 
 unsigned int TxConfirmStats::FindBucketIndex(double val)
@@ -60,33 +74,24 @@ unsigned int TxConfirmStats::FindBucketIndex(double val)
     return it->second;
 }
 
-void TxConfirmStats::Record(int blocksToConfirm, double val)
+void TxConfirmStats::Record(unsigned int nBlockHeight, int blocksToConfirm, double val)
 {
     // blocksToConfirm is 1-based
     if (blocksToConfirm < 1)
         return;
     unsigned int bucketindex = FindBucketIndex(val);
-    for (size_t i = blocksToConfirm; i <= curBlockConf.size(); i++) {
-        curBlockConf[i - 1][bucketindex]++;
-    }
-    curBlockTxCt[bucketindex]++;
-    curBlockVal[bucketindex] += val;
-}
-
-void TxConfirmStats::UpdateMovingAverages()
-{
-    for (unsigned int j = 0; j < buckets.size(); j++) {
-        for (unsigned int i = 0; i < confAvg.size(); i++)
-            confAvg[i][j] = confAvg[i][j] * decay + curBlockConf[i][j];
-        avg[j] = avg[j] * decay + curBlockVal[j];
-        txCtAvg[j] = txCtAvg[j] * decay + curBlockTxCt[j];
+    DecayBucket(bucketindex, nBlockHeight);
+    for (size_t i = blocksToConfirm; i <= confAvg.size(); i++) {
+        confAvg[i - 1][bucketindex]++;
     }
+    txCtAvg[bucketindex]++;
+    avg[bucketindex] += val;
 }
 
 // returns -1 on error conditions
 double TxConfirmStats::EstimateMedianVal(int confTarget, double sufficientTxVal,
                                          double successBreakPoint, bool requireGreater,
-                                         unsigned int nBlockHeight)
+                                         unsigned int nBlockHeight) const
 {
     // Counters for a bucket (or range of buckets)
     double nConf = 0; // Number of tx's confirmed within the confTarget
@@ -113,15 +118,19 @@ double TxConfirmStats::EstimateMedianVal(int confTarget, double sufficientTxVal,
     unsigned int bestFarBucket = startbucket;
 
     bool foundAnswer = false;
-    unsigned int bins = unconfTxs.size();
 
     // Start counting from highest(default) or lowest fee/pri transactions
     for (int bucket = startbucket; bucket >= 0 && bucket <= maxbucketindex; bucket += step) {
         curFarBucket = bucket;
-        nConf += confAvg[confTarget - 1][bucket];
-        totalNum += txCtAvg[bucket];
-        for (unsigned int confct = confTarget; confct < GetMaxConfirms(); confct++)
-            extraNum += unconfTxs[(nBlockHeight - confct)%bins][bucket];
+        const double factor = DecayFactor(bucket, nBlockHeight);
+        nConf += confAvg[confTarget - 1][bucket] * factor;
+        totalNum += txCtAvg[bucket] * factor;
+        // the transactions outstanding for confTarget blocks or more, the rows that are
+        // MAX_CONFIRMS blocks old being part of the old ones
+        for (unsigned int row = 0; row < unconfTxs.size(); row++) {
+            if (unconfHeight[row] + confTarget <= nBlockHeight)
+                extraNum += unconfTxs[row][bucket];
+        }
         extraNum += oldUnconfTxs[bucket];
         // If we have enough transaction data points in this range of buckets,
         // we can test for success
@@ -160,13 +169,14 @@ double TxConfirmStats::EstimateMedianVal(int confTarget, double sufficientTxVal,
     unsigned int minBucket = bestNearBucket < bestFarBucket ? bestNearBucket : bestFarBucket;
     unsigned int maxBucket = bestNearBucket > bestFarBucket ? bestNearBucket : bestFarBucket;
     for (unsigned int j = minBucket; j <= maxBucket; j++) {
-        txSum += txCtAvg[j];
+        txSum += txCtAvg[j] * DecayFactor(j, nBlockHeight);
     }
     if (foundAnswer && txSum != 0) {
         txSum = txSum / 2;
         for (unsigned int j = minBucket; j <= maxBucket; j++) {
-            if (txCtAvg[j] < txSum)
-                txSum -= txCtAvg[j];
+            const double txCt = txCtAvg[j] * DecayFactor(j, nBlockHeight);
+            if (txCt < txSum)
+                txSum -= txCt;
             else { // we're in the right bucket
                 median = avg[j] / txCtAvg[j];
                 break;
@@ -182,16 +192,27 @@ double TxConfirmStats::EstimateMedianVal(int confTarget, double sufficientTxVal,
     return median;
 }
 
-void TxConfirmStats::Write(CAutoFile& fileout)
+void TxConfirmStats::Write(CAutoFile& fileout, unsigned int nBlockHeight) const
 {
+    std::vector<double> fileAvg(avg);
+    std::vector<double> fileTxCtAvg(txCtAvg);
+    std::vector<std::vector<double> > fileConfAvg(confAvg);
+    for (unsigned int j = 0; j < buckets.size(); j++) {
+        const double factor = DecayFactor(j, nBlockHeight);
+        fileAvg[j] *= factor;
+        fileTxCtAvg[j] *= factor;
+        for (unsigned int i = 0; i < fileConfAvg.size(); i++)
+            fileConfAvg[i][j] *= factor;
+    }
+
     fileout << decay;
     fileout << buckets;
-    fileout << avg;
-    fileout << txCtAvg;
-    fileout << confAvg;
+    fileout << fileAvg;
+    fileout << fileTxCtAvg;
+    fileout << fileConfAvg;
 }
 
-void TxConfirmStats::Read(CAutoFile& filein)
+void TxConfirmStats::Read(CAutoFile& filein, unsigned int nBlockHeight)
 {
     // Read data file into temporary variables and do some very basic sanity checking
     std::vector<double> fileBuckets;
@@ -231,20 +252,15 @@ void TxConfirmStats::Read(CAutoFile& filein)
     confAvg = fileConfAvg;
     txCtAvg = fileTxCtAvg;
     bucketMap.clear();
+    lastUpdateHeight.assign(buckets.size(), nBlockHeight);
 
-    // Resize the current block variables which aren't stored in the data file
+    // Resize the mempool variables which aren't stored in the data file
     // to match the number of confirms and buckets
-    curBlockConf.resize(maxConfirms);
-    for (unsigned int i = 0; i < maxConfirms; i++) {
-        curBlockConf[i].resize(buckets.size());
-    }
-    curBlockTxCt.resize(buckets.size());
-    curBlockVal.resize(buckets.size());
-
     unconfTxs.resize(maxConfirms);
     for (unsigned int i = 0; i < maxConfirms; i++) {
         unconfTxs[i].resize(buckets.size());
     }
+    unconfHeight.resize(maxConfirms);
     oldUnconfTxs.resize(buckets.size());
 
     for (unsigned int i = 0; i < buckets.size(); i++)
@@ -258,23 +274,24 @@ unsigned int TxConfirmStats::NewTx(unsigned int nBlockHeight, double val)
 {
     unsigned int bucketindex = FindBucketIndex(val);
     unsigned int blockIndex = nBlockHeight % unconfTxs.size();
+    if (unconfHeight[blockIndex] != nBlockHeight) {
+        // The row still counts the transactions of MAX_CONFIRMS or more blocks ago: they are old now
+        for (unsigned int j = 0; j < buckets.size(); j++) {
+            oldUnconfTxs[j] += unconfTxs[blockIndex][j];
+            unconfTxs[blockIndex][j] = 0;
+        }
+        unconfHeight[blockIndex] = nBlockHeight;
+    }
     unconfTxs[blockIndex][bucketindex]++;
     LogPrint("estimatefee", "adding to %s\n", dataTypeString);
     return bucketindex;
 }
 
-void TxConfirmStats::removeTx(unsigned int entryHeight, unsigned int nBestSeenHeight, unsigned int bucketindex)
+void TxConfirmStats::removeTx(unsigned int entryHeight, unsigned int bucketindex)
 {
-    //nBestSeenHeight is not updated yet for the new block
-    int blocksAgo = nBestSeenHeight - entryHeight;
-    if (nBestSeenHeight == 0)  // the BlockPolicyEstimator hasn't seen any blocks yet
-        blocksAgo = 0;
-    if (blocksAgo < 0) {
-        LogPrint("estimatefee", "Blockpolicy error, blocks ago is negative for mempool tx\n");
-        return;  //This can't happen because we call this with our best seen height, no entries can have higher
-    }
-
-    if (blocksAgo >= (int)unconfTxs.size()) {
+    unsigned int blockIndex = entryHeight % unconfTxs.size();
+    if (unconfHeight[blockIndex] != entryHeight) {
+        // the row was reused by a later height, so the transaction is counted among the old ones
         if (oldUnconfTxs[bucketindex] > 0)
             oldUnconfTxs[bucketindex]--;
         else
@@ -282,7 +299,6 @@ void TxConfirmStats::removeTx(unsigned int entryHeight, unsigned int nBestSeenHe
                      bucketindex);
     }
     else {
-        unsigned int blockIndex = entryHeight % unconfTxs.size();
         if (unconfTxs[blockIndex][bucketindex] > 0)
             unconfTxs[blockIndex][bucketindex]--;
         else
@@ -304,12 +320,12 @@ void CBlockPolicyEstimator::removeTx(uint256 hash)
     unsigned int bucketIndex = pos->second.bucketIndex;
 
     if (stats != NULL)
-        stats->removeTx(entryHeight, nBestSeenHeight, bucketIndex);
+        stats->removeTx(entryHeight, bucketIndex);
     mapMemPoolTxs.erase(hash);
 }
 
 CBlockPolicyEstimator::CBlockPolicyEstimator(const CFeeRate& _minRelayFee)
-    : nBestSeenHeight(0)
+    : nBestSeenHeight(0), nLastEstimatedHeight(0), fCutoffsStale(true)
 {
     minTrackedFee = _minRelayFee < CFeeRate(MIN_FEERATE) ? CFeeRate(MIN_FEERATE) : _minRelayFee;
     std::vector<double> vfeelist;
@@ -317,6 +333,8 @@ CBlockPolicyEstimator::CBlockPolicyEstimator(const CFeeRate& _minRelayFee)
         vfeelist.push_back(bucketBoundary);
     }
     feeStats.Initialize(vfeelist, MAX_BLOCK_CONFIRMS, DEFAULT_DECAY, "FeeRate");
+    scFeeStats.Initialize(vfeelist, MAX_BLOCK_CONFIRMS, DEFAULT_DECAY, "SidechainFeeRate");
+    certFeeStats.Initialize(vfeelist, MAX_BLOCK_CONFIRMS, DEFAULT_DECAY, "CertificateFeeRate");
 
     minTrackedPriority = AllowFreeThreshold() < MINIMUM_PRIORITY ? MINIMUM_PRIORITY : AllowFreeThreshold();
     std::vector<double> vprilist;
@@ -379,12 +397,22 @@ void CBlockPolicyEstimator::processTransaction(const CTxMemPoolEntry& entry, boo
 
     // Fees are stored and reported as BTC-per-kb:
     CFeeRate feeRate(entry.GetFee(), entry.GetTxSize());
+    mapMemPoolTxs[hash].blockHeight = txHeight;
+
+    if (GetFeeEstimateType(entry.GetTx()) == FeeEstimateType::SIDECHAIN_TRANSACTION) {
+        // Sidechain transactions only count for their own fee estimates
+        if (feeRate >= minTrackedFee) {
+            mapMemPoolTxs[hash].stats = &scFeeStats;
+            mapMemPoolTxs[hash].bucketIndex = scFeeStats.NewTx(txHeight, (double)feeRate.GetFeePerK());
+        }
+        return;
+    }
 
     // Want the priority of the tx at confirmation. However we don't know
     // what that will be and its too hard to continue updating it
     // so use starting priority as a proxy
     double curPri = entry.GetPriority(txHeight);
-    mapMemPoolTxs[hash].blockHeight = txHeight;
+    UpdateCutoffs();
 
     LogPrint("estimatefee", "Blockpolicy mempool tx %s ", hash.ToString().substr(0,10));
     // Record this as a priority estimate
@@ -403,6 +431,29 @@ void CBlockPolicyEstimator::processTransaction(const CTxMemPoolEntry& entry, boo
     LogPrint("estimatefee", "\n");
 }
 
+void CBlockPolicyEstimator::processCertificate(const CCertificateMemPoolEntry& entry, bool fCurrentEstimate)
+{
+    unsigned int certHeight = entry.GetHeight();
+    uint256 hash = entry.GetCertificate().GetHash();
+    if (mapMemPoolTxs[hash].stats != NULL) {
+        LogPrint("estimatefee", "Blockpolicy error mempool cert %s already being tracked\n",
+                 hash.ToString().c_str());
+        return;
+    }
+
+    // Same as for transactions: ignore side chains and re-orgs, and wait for the blockchain to be synced
+    if (certHeight < nBestSeenHeight || !fCurrentEstimate)
+        return;
+
+    CFeeRate feeRate(entry.GetFee(), entry.GetCertificateSize());
+    if (feeRate < minTrackedFee)
+        return;
+
+    mapMemPoolTxs[hash].blockHeight = certHeight;
+    mapMemPoolTxs[hash].stats = &certFeeStats;
+    mapMemPoolTxs[hash].bucketIndex = certFeeStats.NewTx(certHeight, (double)feeRate.GetFeePerK());
+}
+
 void CBlockPolicyEstimator::processBlockTx(unsigned int nBlockHeight, const CTxMemPoolEntry& entry)
 {
     if (!entry.WasClearAtEntry()) {
@@ -426,85 +477,116 @@ void CBlockPolicyEstimator::processBlockTx(unsigned int nBlockHeight, const CTxM
     // Fees are stored and reported as BTC-per-kb:
     CFeeRate feeRate(entry.GetFee(), entry.GetTxSize());
 
+    if (GetFeeEstimateType(entry.GetTx()) == FeeEstimateType::SIDECHAIN_TRANSACTION) {
+        if (feeRate >= minTrackedFee)
+            scFeeStats.Record(nBlockHeight, blocksToConfirm, (double)feeRate.GetFeePerK());
+        return;
+    }
+
     // Want the priority of the tx at confirmation.  The priority when it
     // entered the mempool could easily be very small and change quickly
     double curPri = entry.GetPriority(nBlockHeight);
+    UpdateCutoffs();
 
     // Record this as a priority estimate
     if (entry.GetFee() == 0 || isPriDataPoint(feeRate, curPri)) {
-        priStats.Record(blocksToConfirm, curPri);
+        priStats.Record(nBlockHeight, blocksToConfirm, curPri);
     }
     // Record this as a fee estimate
     else if (isFeeDataPoint(feeRate, curPri)) {
-        feeStats.Record(blocksToConfirm, (double)feeRate.GetFeePerK());
+        feeStats.Record(nBlockHeight, blocksToConfirm, (double)feeRate.GetFeePerK());
     }
 }
 
-void CBlockPolicyEstimator::processBlock(unsigned int nBlockHeight,
-                                         std::vector<CTxMemPoolEntry>& entries, bool fCurrentEstimate)
+void CBlockPolicyEstimator::processBlockCerts(unsigned int nBlockHeight, const std::vector<CCertificateMemPoolEntry>& entries)
 {
-    if (nBlockHeight <= nBestSeenHeight) {
-        // Ignore side chains and re-orgs; assuming they are random
-        // they don't affect the estimate.
-        // And if an attacker can re-org the chain at will, then
-        // you've got much bigger problems than "attacker can influence
-        // transaction fees."
+    // Only the certificates of a block whose transactions were recorded: same rules as processBlock
+    if (nBlockHeight != nLastEstimatedHeight)
         return;
+
+    for (const CCertificateMemPoolEntry& entry : entries) {
+        int blocksToConfirm = nBlockHeight - entry.GetHeight();
+        if (blocksToConfirm <= 0)
+            continue;
+        CFeeRate feeRate(entry.GetFee(), entry.GetCertificateSize());
+        if (feeRate >= minTrackedFee)
+            certFeeStats.Record(nBlockHeight, blocksToConfirm, (double)feeRate.GetFeePerK());
     }
-    nBestSeenHeight = nBlockHeight;
+}
 
-    // Only want to be updating estimates when our blockchain is synced,
-    // otherwise we'll miscalculate how many blocks its taking to get included.
-    if (!fCurrentEstimate)
+void CBlockPolicyEstimator::UpdateCutoffs()
+{
+    if (!fCutoffsStale)
         return;
+    fCutoffsStale = false;
 
     // Update the dynamic cutoffs
     // a fee/priority is "likely" the reason your tx was included in a block if >85% of such tx's
     // were confirmed in 2 blocks and is "unlikely" if <50% were confirmed in 10 blocks
     LogPrint("estimatefee", "Blockpolicy recalculating dynamic cutoffs:\n");
-    priLikely = priStats.EstimateMedianVal(2, SUFFICIENT_PRITXS, MIN_SUCCESS_PCT, true, nBlockHeight);
+    priLikely = priStats.EstimateMedianVal(2, SUFFICIENT_PRITXS, MIN_SUCCESS_PCT, true, nBestSeenHeight);
     if (priLikely == -1)
         priLikely = INF_PRIORITY;
 
-    double feeLikelyEst = feeStats.EstimateMedianVal(2, SUFFICIENT_FEETXS, MIN_SUCCESS_PCT, true, nBlockHeight);
+    double feeLikelyEst = feeStats.EstimateMedianVal(2, SUFFICIENT_FEETXS, MIN_SUCCESS_PCT, true, nBestSeenHeight);
     if (feeLikelyEst == -1)
         feeLikely = CFeeRate(INF_FEERATE);
     else
         feeLikely = CFeeRate(feeLikelyEst);
 
-    priUnlikely = priStats.EstimateMedianVal(10, SUFFICIENT_PRITXS, UNLIKELY_PCT, false, nBlockHeight);
+    priUnlikely = priStats.EstimateMedianVal(10, SUFFICIENT_PRITXS, UNLIKELY_PCT, false, nBestSeenHeight);
     if (priUnlikely == -1)
         priUnlikely = 0;
 
-    double feeUnlikelyEst = feeStats.EstimateMedianVal(10, SUFFICIENT_FEETXS, UNLIKELY_PCT, false, nBlockHeight);
+    double feeUnlikelyEst = feeStats.EstimateMedianVal(10, SUFFICIENT_FEETXS, UNLIKELY_PCT, false, nBestSeenHeight);
     if (feeUnlikelyEst == -1)
         feeUnlikely = CFeeRate(0);
     else
         feeUnlikely = CFeeRate(feeUnlikelyEst);
+}
 
-    // Clear the current block states
-    feeStats.ClearCurrent(nBlockHeight);
-    priStats.ClearCurrent(nBlockHeight);
+void CBlockPolicyEstimator::processBlock(unsigned int nBlockHeight,
+                                         std::vector<CTxMemPoolEntry>& entries, bool fCurrentEstimate)
+{
+    if (nBlockHeight <= nBestSeenHeight) {
+        // Ignore side chains and re-orgs; assuming they are random
+        // they don't affect the estimate.
+        // And if an attacker can re-org the chain at will, then
+        // you've got much bigger problems than "attacker can influence
+        // transaction fees."
+        return;
+    }
+    nBestSeenHeight = nBlockHeight;
+
+    // Only want to be updating estimates when our blockchain is synced,
+    // otherwise we'll miscalculate how many blocks its taking to get included.
+    if (!fCurrentEstimate)
+        return;
+    nLastEstimatedHeight = nBlockHeight;
+
+    // The dynamic cutoffs are computed again, from the stats before this block, only when
+    // a transaction has to be classified: a block without data points costs nothing
+    fCutoffsStale = true;
 
-    // Repopulate the current block states
+    // Record the transactions of the block, the moving averages of their buckets are
+    // decayed on the way
     for (unsigned int i = 0; i < entries.size(); i++)
         processBlockTx(nBlockHeight, entries[i]);
 
-    // Update all exponential averages with the current block states
-    feeStats.UpdateMovingAverages();
-    priStats.UpdateMovingAverages();
-
     LogPrint("estimatefee", "Blockpolicy after updating estimates for %u confirmed entries, new mempool map size %u\n",
              entries.size(), mapMemPoolTxs.size());
 }
 
-CFeeRate CBlockPolicyEstimator::estimateFee(int confTarget)
+CFeeRate CBlockPolicyEstimator::estimateFee(int confTarget, FeeEstimateType type)
 {
+    const TxConfirmStats& stats = type == FeeEstimateType::CERTIFICATE ? certFeeStats :
+                                  type == FeeEstimateType::SIDECHAIN_TRANSACTION ? scFeeStats : feeStats;
+
     // Return failure if trying to analyze a target we're not tracking
-    if (confTarget <= 0 || (unsigned int)confTarget > feeStats.GetMaxConfirms())
+    if (confTarget <= 0 || (unsigned int)confTarget > stats.GetMaxConfirms())
         return CFeeRate(0);
 
-    double median = feeStats.EstimateMedianVal(confTarget, SUFFICIENT_FEETXS, MIN_SUCCESS_PCT, true, nBestSeenHeight);
+    double median = stats.EstimateMedianVal(confTarget, SUFFICIENT_FEETXS, MIN_SUCCESS_PCT, true, nBestSeenHeight);
 
     if (median < 0)
         return CFeeRate(0);
@@ -524,15 +606,30 @@ double CBlockPolicyEstimator::estimatePriority(int confTarget)
 void CBlockPolicyEstimator::Write(CAutoFile& fileout)
 {
     fileout << nBestSeenHeight;
-    feeStats.Write(fileout);
-    priStats.Write(fileout);
+    feeStats.Write(fileout, nBestSeenHeight);
+    priStats.Write(fileout, nBestSeenHeight);
+    // Appended after the stats older versions know about, which they ignore
+    scFeeStats.Write(fileout, nBestSeenHeight);
+    certFeeStats.Write(fileout, nBestSeenHeight);
 }
 
 void CBlockPolicyEstimator::Read(CAutoFile& filein)
 {
     int nFileBestSeenHeight;
     filein >> nFileBestSeenHeight;
-    feeStats.Read(filein);
-    priStats.Read(filein);
+    feeStats.Read(filein, nFileBestSeenHeight);
+    priStats.Read(filein, nFileBestSeenHeight);
+
+    // Files written by older versions end here: the sidechain and certificate stats start empty
+    TxConfirmStats fileScFeeStats(scFeeStats), fileCertFeeStats(certFeeStats);
+    try {
+        fileScFeeStats.Read(filein, nFileBestSeenHeight);
+        fileCertFeeStats.Read(filein, nFileBestSeenHeight);
+        scFeeStats = fileScFeeStats;
+        certFeeStats = fileCertFeeStats;
+    } catch (const std::ios_base::failure&) {
+        LogPrint("estimatefee", "No sidechain and certificate fee estimates in the estimates file\n");
+    }
     nBestSeenHeight = nFileBestSeenHeight;
+    fCutoffsStale = true;
 }
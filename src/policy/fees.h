@@ -13,7 +13,9 @@
 #include <vector>
 
 class CAutoFile;
+class CCertificateMemPoolEntry;
 class CFeeRate;
+class CTransaction;
 class CTxMemPoolEntry;
 
 /** \class CBlockPolicyEstimator
@@ -64,8 +66,28 @@ class CTxMemPoolEntry;
  * the number of transactions we've seen in that fee bucket when calculating
  * an estimate for any number of confirmations below the number of blocks
  * they've been outstanding.
+ *
+ * The moving averages are decayed lazily: each bucket keeps the height its averages
+ * refer to, and they are decayed to the current height only when a transaction is
+ * recorded in the bucket or an estimate is computed. The cost of a block is thus
+ * proportional to the transactions it confirms, not to the number of buckets.
+ *
+ * Certificates and the transactions that interact with sidechains (creations,
+ * forward transfers, backward transfer requests and ceased sidechain withdrawals)
+ * reach blocks by different rules than the plain transactions, so their fee rates
+ * are tracked by separate estimators, see FeeEstimateType.
  */
 
+/** The kinds of mempool entries whose confirmation fee rates are tracked separately */
+enum class FeeEstimateType {
+    TRANSACTION,            //! plain transactions
+    SIDECHAIN_TRANSACTION,  //! transactions with sidechain outputs or ceased sidechain withdrawal inputs
+    CERTIFICATE,
+};
+
+/** The kind of estimate a transaction contributes to */
+FeeEstimateType GetFeeEstimateType(const CTransaction& tx);
+
 /** Decay of .998 is a half-life of 346 blocks or about 2.4 days */
 static const double DEFAULT_DECAY = .998;
 
@@ -91,20 +113,17 @@ private:
     // Count the total # of txs in each bucket
     // Track the historical moving average of this total over blocks
     std::vector<double> txCtAvg;
-    // and calcuate the total for the current block to update the moving average
-    std::vector<int> curBlockTxCt;
 
     // Count the total # of txs confirmed within Y blocks in each bucket
     // Track the historical moving average of theses totals over blocks
     std::vector<std::vector<double> > confAvg; // confAvg[Y][X]
-    // and calcuate the totals for the current block to update the moving averages
-    std::vector<std::vector<int> > curBlockConf; // curBlockConf[Y][X]
 
     // Sum the total priority/fee of all txs in each bucket
     // Track the historical moving average of this total over blocks
     std::vector<double> avg;
-    // and calculate the total for the current block to update the moving average
-    std::vector<double> curBlockVal;
+
+    // The height the moving averages of each bucket are decayed to
+    std::vector<unsigned int> lastUpdateHeight;
 
     // Combine the conf counts with tx counts to calculate the confirmation % for each Y,X
     // Combine the total value with the tx counts to calculate the avg fee/priority per bucket
@@ -116,9 +135,18 @@ private:
     // For each bucket X, track the number of transactions in the mempool
     // that are unconfirmed for each possible confirmation value Y
     std::vector<std::vector<int> > unconfTxs;  //unconfTxs[Y][X]
+    // The entry height of the transactions counted in each row of unconfTxs. A row is
+    // reused by a later height only when a transaction enters at that height, so the
+    // rows MAX_CONFIRMS or more blocks old are counted as part of oldUnconfTxs
+    std::vector<unsigned int> unconfHeight;
     // transactions still unconfirmed after MAX_CONFIRMS for each bucket
     std::vector<int> oldUnconfTxs;
 
+    /** The factor to bring the moving averages of a bucket to the given height */
+    double DecayFactor(unsigned int bucketIndex, unsigned int nBlockHeight) const;
+    /** Decay the moving averages of a bucket to the given height */
+    void DecayBucket(unsigned int bucketIndex, unsigned int nBlockHeight);
+
 public:
     /** Find the bucket index of a given value */
     unsigned int FindBucketIndex(double val);
@@ -135,27 +163,20 @@ public:
      */
     void Initialize(std::vector<double>& defaultBuckets, unsigned int maxConfirms, double decay, std::string dataTypeString);
 
-    /** Clear the state of the curBlock variables to start counting for the new block */
-    void ClearCurrent(unsigned int nBlockHeight);
-
     /**
-     * Record a new transaction data point in the current block stats
+     * Record a new transaction data point in the stats of the block at nBlockHeight
+     * @param nBlockHeight the height of the block confirming the transaction
      * @param blocksToConfirm the number of blocks it took this transaction to confirm
      * @param val either the fee or the priority when entered of the transaction
      * @warning blocksToConfirm is 1-based and has to be >= 1
      */
-    void Record(int blocksToConfirm, double val);
+    void Record(unsigned int nBlockHeight, int blocksToConfirm, double val);
 
     /** Record a new transaction entering the mempool*/
     unsigned int NewTx(unsigned int nBlockHeight, double val);
 
     /** Remove a transaction from mempool tracking stats*/
-    void removeTx(unsigned int entryHeight, unsigned int nBestSeenHeight,
-                  unsigned int bucketIndex);
-
-    /** Update our estimates by decaying our historical moving average and updating
-        with the data gathered from the current block */
-    void UpdateMovingAverages();
+    void removeTx(unsigned int entryHeight, unsigned int bucketIndex);
 
     /**
      * Calculate a fee or priority estimate.  Find the lowest value bucket (or range of buckets
@@ -169,19 +190,19 @@ public:
      * @param nBlockHeight the current block height
      */
     double EstimateMedianVal(int confTarget, double sufficientTxVal,
-                             double minSuccess, bool requireGreater, unsigned int nBlockHeight);
+                             double minSuccess, bool requireGreater, unsigned int nBlockHeight) const;
 
     /** Return the max number of confirms we're tracking */
-    unsigned int GetMaxConfirms() { return confAvg.size(); }
+    unsigned int GetMaxConfirms() const { return confAvg.size(); }
 
-    /** Write state of estimation data to a file*/
-    void Write(CAutoFile& fileout);
+    /** Write state of estimation data to a file, with the moving averages decayed to nBlockHeight */
+    void Write(CAutoFile& fileout, unsigned int nBlockHeight) const;
 
     /**
      * Read saved state of estimation data from a file and replace all internal data structures and
-     * variables with this state.
+     * variables with this state. The moving averages read are the ones at nBlockHeight.
      */
-    void Read(CAutoFile& filein);
+    void Read(CAutoFile& filein, unsigned int nBlockHeight);
 };
 
 
@@ -234,10 +255,16 @@ public:
     /** Process a transaction confirmed in a block*/
     void processBlockTx(unsigned int nBlockHeight, const CTxMemPoolEntry& entry);
 
+    /** Process the certificates included in the block processBlock was last called for */
+    void processBlockCerts(unsigned int nBlockHeight, const std::vector<CCertificateMemPoolEntry>& entries);
+
     /** Process a transaction accepted to the mempool*/
     void processTransaction(const CTxMemPoolEntry& entry, bool fCurrentEstimate);
 
-    /** Remove a transaction from the mempool tracking stats*/
+    /** Process a certificate accepted to the mempool*/
+    void processCertificate(const CCertificateMemPoolEntry& entry, bool fCurrentEstimate);
+
+    /** Remove a transaction or a certificate from the mempool tracking stats*/
     void removeTx(uint256 hash);
 
     /** Is this transaction likely included in a block because of its fee?*/
@@ -246,8 +273,8 @@ public:
     /** Is this transaction likely included in a block because of its priority?*/
     bool isPriDataPoint(const CFeeRate &fee, double pri);
 
-    /** Return a fee estimate */
-    CFeeRate estimateFee(int confTarget);
+    /** Return a fee estimate for the given kind of transactions */
+    CFeeRate estimateFee(int confTarget, FeeEstimateType type = FeeEstimateType::TRANSACTION);
 
     /** Return a priority estimate */
     double estimatePriority(int confTarget);
@@ -262,6 +289,10 @@ private:
     CFeeRate minTrackedFee; //! Passed to constructor to avoid dependency on main
     double minTrackedPriority; //! Set to AllowFreeThreshold
     unsigned int nBestSeenHeight;
+    //! The last block processBlock recorded the confirmations of, 0 if none
+    unsigned int nLastEstimatedHeight;
+    //! Whether the dynamic cutoffs must be computed again before classifying a transaction
+    bool fCutoffsStale;
     struct TxStatsInfo
     {
         TxConfirmStats *stats;
@@ -275,9 +306,14 @@ private:
 
     /** Classes to track historical data on transaction confirmations */
     TxConfirmStats feeStats, priStats;
+    /** The fee rates of the sidechain transactions and of the certificates */
+    TxConfirmStats scFeeStats, certFeeStats;
 
     /** Breakpoints to help determine whether a transaction was confirmed by priority or Fee */
     CFeeRate feeLikely, feeUnlikely;
     double priLikely, priUnlikely;
+
+    /** Compute the dynamic cutoffs again, if stale, from the stats at the best seen height */
+    void UpdateCutoffs();
 };
 #endif /*BITCOIN_POLICYESTIMATOR_H */
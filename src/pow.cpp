@@ -26,6 +26,16 @@ unsigned int GetNextWorkRequired(const CBlockIndex* pindexLast, const CBlockHead
     if (pindexLast == NULL)
         return nProofOfWorkLimit;
 
+    // The sum of the targets of the averaging interval, from those of the chains, when the entries have them
+    if (pindexLast->fHaveAggregates)
+    {
+        const CBlockIndex* pindexFirst = pindexLast->GetAncestor(pindexLast->nHeight - params.nPowAveragingWindow);
+        if (pindexFirst == NULL)
+            return nProofOfWorkLimit;
+        arith_uint256 bnAvg {(pindexLast->nChainTargetSum - pindexFirst->nChainTargetSum) / params.nPowAveragingWindow};
+        return CalculateNextWorkRequired(bnAvg, pindexLast->GetMedianTimePast(), pindexFirst->GetMedianTimePast(), params);
+    }
+
     // Find the first block in the averaging interval
     const CBlockIndex* pindexFirst = pindexLast;
     arith_uint256 bnTot {0};
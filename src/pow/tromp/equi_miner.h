@@ -23,6 +23,9 @@
 #include <stdlib.h>
 #include <pthread.h>
 #include <assert.h>
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
 
 typedef uint16_t u16;
 typedef uint64_t u64;
@@ -161,8 +164,10 @@ struct htalloc {
   bucket0 *trees0[(WK+1)/2];
   bucket1 *trees1[WK/2];
   u32 alloced;
+  bool hugepages;
   htalloc() {
     alloced = 0;
+    hugepages = false;
   }
   void alloctrees() {
 // optimize xenoncat's fixed memory layout, avoiding any waste
@@ -177,8 +182,8 @@ struct htalloc {
 // 7      0 2 4 6 . G G   1 3 5 7 H H
 // 8      0 2 4 6 8 . I   1 3 5 7 H H
     assert(DIGITBITS >= 16); // ensures hashes shorten by 1 unit every 2 digits
-    heap0 = (u32 *)alloc(1, sizeof(digit0));
-    heap1 = (u32 *)alloc(1, sizeof(digit1));
+    heap0 = (u32 *)allocheap(sizeof(digit0));
+    heap1 = (u32 *)allocheap(sizeof(digit1));
     for (int r=0; r<WK; r++)
       if ((r&1) == 0)
         trees0[r/2]  = (bucket0 *)(heap0 + r/2);
@@ -195,6 +200,20 @@ struct htalloc {
     alloced += n * sz;
     return mem;
   }
+  // the heaps are aligned to, and possibly backed by, transparent huge pages if asked to
+  void *allocheap(const u32 sz) {
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+    const size_t hugepage = 2 << 20;
+    void *mem = NULL;
+    if (hugepages && posix_memalign(&mem, hugepage, sz) == 0) {
+      madvise(mem, (sz + hugepage - 1) / hugepage * hugepage, MADV_HUGEPAGE);
+      memset(mem, 0, sz);
+      alloced += sz;
+      return mem;
+    }
+#endif
+    return alloc(1, sz);
+  }
 };
 
 typedef au32 bsizes[NBUCKETS];
@@ -214,9 +233,10 @@ struct equi {
   u32 hfull;
   u32 bfull;
   pthread_barrier_t barry;
-  equi(const u32 n_threads) {
+  equi(const u32 n_threads, const bool hugepages = false) {
     assert(sizeof(hashunit) == 4);
     nthreads = n_threads;
+    hta.hugepages = hugepages;
     const int err = pthread_barrier_init(&barry, NULL, nthreads);
     assert(!err);
     hta.alloctrees();
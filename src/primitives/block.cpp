@@ -9,9 +9,12 @@
 #include "tinyformat.h"
 #include "utilstrencodings.h"
 #include "crypto/common.h"
+#include "crypto/sha256.h"
 #include <sc/sidechainTxsCommitmentBuilder.h>
 #include <sc/sidechainTxsCommitmentGuard.h>
 #include <serialize.h>
+
+#include <future>
 // uncomment for debugging mkl root hash calculations
 //#define DEBUG_MKLTREE_HASH 1
 
@@ -72,7 +75,7 @@ size_t CBlock::GetSerializeComponentsSize(size_t& headerSize, size_t& totalTxSiz
     return totalBlockSize;
 }
 
-uint256 CBlock::BuildMerkleTree(bool* fMutated) const
+uint256 CBlock::BuildMerkleTree(bool* fMutated, unsigned int nThreads) const
 {
     /* WARNING! If you're reading this because you're learning about crypto
        and/or designing a new system that will use merkle trees, keep in mind
@@ -118,31 +121,63 @@ uint256 CBlock::BuildMerkleTree(bool* fMutated) const
     for (auto it(vTxBase.begin()); it != vTxBase.end(); ++it)
         vMerkleTree.push_back((*it)->GetHash());
 
-    return BuildMerkleTree(vMerkleTree, vTxBase.size(), fMutated);
+    return BuildMerkleTree(vMerkleTree, vTxBase.size(), fMutated, nThreads);
 }
 
-uint256 CBlock::BuildMerkleTree(std::vector<uint256>& vMerkleTreeIn, size_t vtxSize, bool* fMutated)
+uint256 CBlock::BuildMerkleTree(std::vector<uint256>& vMerkleTreeIn, size_t vtxSize, bool* fMutated, unsigned int nThreads)
 {
     int j = 0;
     bool mutated = false;
     for (int nSize = vtxSize; nSize > 1; nSize = (nSize + 1) / 2)
     {
+        // Only the last pair of a level can be a duplicate (see above)
+        if (nSize % 2 == 0 && vMerkleTreeIn[j+nSize-2] == vMerkleTreeIn[j+nSize-1])
+            mutated = true;
+
+        // The parent level is appended as a whole. Sibling hashes are adjacent in
+        // the vector, so each run of full pairs is hashed as a batch of 64-byte
+        // blobs; an odd node at the end of the level is paired with itself.
+        const int nPairs = (nSize + 1) / 2;
+        const int nFullPairs = nSize / 2;
+        const size_t base = vMerkleTreeIn.size();
+        vMerkleTreeIn.resize(base + nPairs);
+        auto hashPairs = [&vMerkleTreeIn, j, nSize, nFullPairs, base](int nBegin, int nEnd) {
+            const int nFullEnd = std::min(nEnd, nFullPairs);
+            if (nFullEnd > nBegin)
+                SHA256D64(vMerkleTreeIn[base+nBegin].begin(), vMerkleTreeIn[j+2*nBegin].begin(), nFullEnd - nBegin);
+            if (nEnd > nFullPairs)
+                vMerkleTreeIn[base+nFullPairs] = Hash(BEGIN(vMerkleTreeIn[j+nSize-1]), END(vMerkleTreeIn[j+nSize-1]),
+                                                      BEGIN(vMerkleTreeIn[j+nSize-1]), END(vMerkleTreeIn[j+nSize-1]));
+        };
+
+        if (nThreads > 1 && nPairs >= MERKLE_PARALLEL_MIN_PAIRS)
+        {
+            const int nWorkers = std::min<int>(nThreads, nPairs / (MERKLE_PARALLEL_MIN_PAIRS / 2));
+            auto worker = [&hashPairs, nPairs, nWorkers](int nWorker) {
+                hashPairs((int64_t)nPairs * nWorker / nWorkers, (int64_t)nPairs * (nWorker + 1) / nWorkers);
+            };
+            std::vector<std::future<void>> vWorkers;
+            for (int n = 1; n < nWorkers; n++)
+                vWorkers.push_back(std::async(std::launch::async, worker, n));
+            worker(0);
+            for (auto& f: vWorkers)
+                f.get();
+        }
+        else
+        {
+            hashPairs(0, nPairs);
+        }
+
+#ifdef DEBUG_MKLTREE_HASH
         for (int i = 0; i < nSize; i += 2)
         {
             int i2 = std::min(i+1, nSize-1);
-            if (i2 == i + 1 && i2 + 1 == nSize && vMerkleTreeIn[j+i] == vMerkleTreeIn[j+i2]) {
-                // Two identical hashes at the end of the list at a particular level.
-                mutated = true;
-            }
-            vMerkleTreeIn.push_back(Hash(BEGIN(vMerkleTreeIn[j+i]),  END(vMerkleTreeIn[j+i]),
-                                         BEGIN(vMerkleTreeIn[j+i2]), END(vMerkleTreeIn[j+i2])));
-#ifdef DEBUG_MKLTREE_HASH
             std::cout << " -------------------------------------------" << std::endl;
-            std::cout << i << ") mkl hash: " << vMerkleTreeIn.back().ToString() << std::endl;
+            std::cout << i << ") mkl hash: " << vMerkleTreeIn[base+i/2].ToString() << std::endl;
             std::cout <<      "      hash1: " << vMerkleTreeIn[j+i].ToString() << std::endl;
             std::cout <<      "      hash2: " << vMerkleTreeIn[j+i2].ToString() << std::endl;
-#endif
         }
+#endif
         j += nSize;
     }
     if (fMutated) {
@@ -179,7 +179,8 @@ public:
     // If non-NULL, *mutated is set to whether mutation was detected in the merkle
     // tree (a duplication of transactions in the block leading to an identical
     // merkle root).
-    uint256 BuildMerkleTree(bool* mutated = NULL) const;
+    // The wide levels of the tree are hashed by up to nThreads threads.
+    uint256 BuildMerkleTree(bool* mutated = NULL, unsigned int nThreads = 1) const;
 
     // Build / updates the sc txs commitment tree as described in zendoo paper. It is based on contribution from
     // sidechains-related txes and certificates contained in this block. Returns the status of the opeartion.
@@ -197,7 +198,11 @@ public:
     void GetTxAndCertsVector(std::vector<const CTransactionBase*>& vBase) const;
 
     // build the merkel tree storing it in the vMerkleTreeIn in/out vector and return the merkle root hash
-    static uint256 BuildMerkleTree(std::vector<uint256>& vMerkleTreeIn, size_t vtxSize, bool* mutated = NULL);
+    static uint256 BuildMerkleTree(std::vector<uint256>& vMerkleTreeIn, size_t vtxSize, bool* mutated = NULL,
+                                   unsigned int nThreads = 1);
+
+    // levels with fewer node pairs than this are not worth splitting across threads
+    static const int MERKLE_PARALLEL_MIN_PAIRS = 1024;
 
     static uint256 CheckMerkleBranch(uint256 hash, const std::vector<uint256>& vMerkleBranch, int nIndex);
 };
@@ -43,7 +43,8 @@ CScCertificate::CScCertificate(const CScCertificate &cert): CTransactionBase(cer
     scProof(cert.scProof), vFieldElementCertificateField(cert.vFieldElementCertificateField),
     vBitVectorCertificateField(cert.vBitVectorCertificateField),
     nFirstBwtPos(cert.nFirstBwtPos), forwardTransferScFee(cert.forwardTransferScFee),
-    mainchainBackwardTransferRequestScFee(cert.mainchainBackwardTransferRequestScFee) {}
+    mainchainBackwardTransferRequestScFee(cert.mainchainBackwardTransferRequestScFee),
+    sigHashPrefix(cert.GetSigHashPrefix()), dataHashCache(std::atomic_load(&cert.dataHashCache)) {}
 
 CScCertificate& CScCertificate::operator=(const CScCertificate &cert)
 {
@@ -58,6 +59,8 @@ CScCertificate& CScCertificate::operator=(const CScCertificate &cert)
     *const_cast<int*>(&nFirstBwtPos) = cert.nFirstBwtPos;
     *const_cast<CAmount*>(&forwardTransferScFee) = cert.forwardTransferScFee;
     *const_cast<CAmount*>(&mainchainBackwardTransferRequestScFee) = cert.mainchainBackwardTransferRequestScFee;
+    SetSigHashPrefix(cert.GetSigHashPrefix());
+    std::atomic_store(&dataHashCache, std::atomic_load(&cert.dataHashCache));
     return *this;
 }
 
@@ -75,6 +78,11 @@ CScCertificate::CScCertificate(const CMutableScCertificate &cert): CTransactionB
 void CScCertificate::UpdateHash() const
 {
     *const_cast<uint256*>(&hash) = SerializeHash(*this);
+    CSizeComputer s(SER_NETWORK, PROTOCOL_VERSION);
+    NCONST_PTR(this)->SerializationOp(s, CSerActionSerialize(), SER_NETWORK, PROTOCOL_VERSION);
+    *const_cast<size_t*>(&nSerializedSize) = s.size();
+    SetSigHashPrefix(nullptr);
+    std::atomic_store(&dataHashCache, std::shared_ptr<const CDataHashCache>());
 }
 
 bool CScCertificate::IsBackwardTransfer(int pos) const
@@ -255,7 +263,7 @@ bool CScCertificate::CheckInputsLimit() const {
 #ifdef BITCOIN_TX
 bool CScCertificate::ContextualCheck(CValidationState& state, int nHeight, int dosLevel) const { return false;}
 bool CScCertificate::VerifyScript(
-        const CScript& scriptPubKey, unsigned int nFlags, unsigned int nIn, const CChain* chain,
+        const CScript& scriptPubKey, unsigned int nFlags, unsigned int nIn, const CCheckBlockAtHeightView* cbhView,
         bool cacheStore, ScriptError* serror) const { return true; }
 void CScCertificate::AddJoinSplitToJSON(UniValue& entry) const { return; }
 void CScCertificate::Relay() const {}
@@ -282,7 +290,7 @@ bool CScCertificate::ContextualCheck(CValidationState& state, int nHeight, int d
 }
 
 bool CScCertificate::VerifyScript(
-        const CScript& scriptPubKey, unsigned int nFlags, unsigned int nIn, const CChain* chain,
+        const CScript& scriptPubKey, unsigned int nFlags, unsigned int nIn, const CCheckBlockAtHeightView* cbhView,
         bool cacheStore, ScriptError* serror) const
 {
     if (nIn >= GetVin().size() )
@@ -292,7 +300,7 @@ bool CScCertificate::VerifyScript(
     const CScript &scriptSig = GetVin()[nIn].scriptSig;
 
     if (!::VerifyScript(scriptSig, scriptPubKey, nFlags,
-                      CachingCertificateSignatureChecker(this, nIn, chain, cacheStore),
+                      CachingCertificateSignatureChecker(this, nIn, cbhView, cacheStore),
                       serror))
     {
         return ::error("%s:%d VerifySignature failed: %s", GetHash().ToString(), nIn, ScriptErrorString(*serror));
@@ -321,6 +329,11 @@ CScCertificate::MakeShared() const {
 
 CFieldElement CScCertificate::GetDataHash(const Sidechain::ScFixedParameters& scFixedParams) const
 {
+    // the coins view, the mempool and getscinfo all ask for it, with the same parameters
+    const std::shared_ptr<const CDataHashCache> cache = std::atomic_load(&dataHashCache);
+    if (cache && cache->IsFor(scFixedParams))
+        return cache->dataHash;
+
     CCertProofVerifierInput input = CScProofVerifier::CertificateToVerifierItem(*this, scFixedParams, nullptr, nullptr);
 
     int custom_fields_len = input.vCustomFields.size(); 
@@ -365,9 +378,14 @@ CFieldElement CScCertificate::GetDataHash(const Sidechain::ScFixedParameters& sc
     {
         LogPrintf("%s():%d - could not get cert data hash: error code[0x%x]\n", __func__, __LINE__, errorCode);
         assert(certDataHash == nullptr);
+        return CFieldElement{wrappedFieldPtr{certDataHash, CFieldPtrDeleter{}}};
     }
 
-    return CFieldElement{wrappedFieldPtr{certDataHash, CFieldPtrDeleter{}}};
+    CFieldElement dataHash{wrappedFieldPtr{certDataHash, CFieldPtrDeleter{}}};
+    std::atomic_store(&dataHashCache, std::shared_ptr<const CDataHashCache>(
+        new CDataHashCache{scFixedParams.version, scFixedParams.vFieldElementCertificateFieldConfig,
+                           scFixedParams.vBitVectorCertificateFieldConfig, dataHash}));
+    return dataHash;
 }
 #endif
 
@@ -4,6 +4,9 @@
 #include "transaction.h"
 #include "sc/sidechaintypes.h"
 
+#include <atomic>
+#include <memory>
+
 struct CMutableScCertificate;
 
 class CBackwardTransferOut
@@ -63,6 +66,29 @@ public:
     // memory only
     const int nFirstBwtPos;
 
+private:
+    // memory only, reset by UpdateHash
+    mutable std::shared_ptr<const CHashWriter> sigHashPrefix;
+
+    //! The data hash, with the parameters of the sidechain it depends on, those of the custom fields
+    struct CDataHashCache
+    {
+        uint8_t scVersion;
+        std::vector<FieldElementCertificateFieldConfig> vFieldElementCertificateFieldConfig;
+        std::vector<BitVectorCertificateFieldConfig> vBitVectorCertificateFieldConfig;
+        CFieldElement dataHash;
+
+        bool IsFor(const Sidechain::ScFixedParameters& scFixedParams) const
+        {
+            return scVersion == scFixedParams.version &&
+                   vFieldElementCertificateFieldConfig == scFixedParams.vFieldElementCertificateFieldConfig &&
+                   vBitVectorCertificateFieldConfig == scFixedParams.vBitVectorCertificateFieldConfig;
+        }
+    };
+    // memory only, reset by UpdateHash
+    mutable std::shared_ptr<const CDataHashCache> dataHashCache;
+
+public:
     /** Construct a CScCertificate that qualifies as IsNull() */
     CScCertificate(int versionIn = SC_CERT_VERSION);
     CScCertificate(const CScCertificate& tx);
@@ -85,6 +111,9 @@ public:
     const uint256& GetHash() const { return hash; }
 
     size_t GetSerializeSize(int nType, int nVersion) const override {
+        // the serialization does not depend on nType and nVersion
+        if (nSerializedSize != 0)
+            return nSerializedSize;
         CSizeComputer s(nType, nVersion);
         NCONST_PTR(this)->SerializationOp(s, CSerActionSerialize(), nType, nVersion);
         return s.size();
@@ -94,6 +123,18 @@ public:
     void Serialize(Stream& s, int nType, int nVersion) const {
         NCONST_PTR(this)->SerializationOp(s, CSerActionSerialize(), nType, nVersion);
     }
+    //! Size computations of blocks and vectors use the cached size
+    void Serialize(CSizeComputer& s, int nType, int nVersion) const {
+        s.write(nullptr, GetSerializeSize(nType, nVersion));
+    }
+
+    /**
+     * The signature hash of every input of a certificate starts with the serialization of its
+     * sidechain fields, which are often many KB large because of the proof. The hash writer state
+     * after them is computed once by SignatureHash and stored here, shared by the copies.
+     */
+    std::shared_ptr<const CHashWriter> GetSigHashPrefix() const { return std::atomic_load(&sigHashPrefix); }
+    void SetSigHashPrefix(const std::shared_ptr<const CHashWriter>& prefix) const { std::atomic_store(&sigHashPrefix, prefix); }
     template<typename Stream>
     void Unserialize(Stream& s, int nType, int nVersion) {
         SerializationOp(s, CSerActionUnserialize(), nType, nVersion);
@@ -168,6 +209,7 @@ public:
     const std::vector<JSDescription>&  GetVjoinsplit() const override {static const std::vector<JSDescription> noJs; return noJs;};
     const uint256&                     GetScId()       const          {return scId;};
     const uint32_t&                    GetLockTime()   const override {static const uint32_t noLockTime(0); return noLockTime;};
+    //! Computed once for the parameters of the sidechain and stored, shared by the copies
     CFieldElement                      GetDataHash(const Sidechain::ScFixedParameters& scFixedParams) const;
     //END OF GETTERS
 
@@ -215,7 +257,7 @@ public:
     bool ContextualCheck(CValidationState& state, int nHeight, int dosLevel) const override;
 
     bool VerifyScript(
-            const CScript& scriptPubKey, unsigned int nFlags, unsigned int nIn, const CChain* chain,
+            const CScript& scriptPubKey, unsigned int nFlags, unsigned int nIn, const CCheckBlockAtHeightView* cbhView,
             bool cacheStore, ScriptError* serror) const override;
     void AddJoinSplitToJSON(UniValue& entry) const override;
 };
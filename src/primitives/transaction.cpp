@@ -463,21 +463,23 @@ bool CMutableTransaction::add(const CBwtRequestOut& out)        { vmbtr_out.push
 
 //--------------------------------------------------------------------------------------------------------
 CTransactionBase::CTransactionBase(int nVersionIn):
-    nVersion(nVersionIn), vin(), vout(), hash() {}
+    nVersion(nVersionIn), vin(), vout(), hash(), nSerializedSize(0) {}
 
 CTransactionBase::CTransactionBase(const CTransactionBase &tx):
-    nVersion(tx.nVersion), vin(tx.vin), vout(tx.vout), hash(tx.hash) {}
+    nVersion(tx.nVersion), vin(tx.vin), vout(tx.vout), hash(tx.hash), nSerializedSize(tx.nSerializedSize) {}
 
 CTransactionBase& CTransactionBase::operator=(const CTransactionBase &tx) {
     *const_cast<uint256*>(&hash)             = tx.hash;
+    *const_cast<size_t*>(&nSerializedSize)   = tx.nSerializedSize;
     *const_cast<int*>(&nVersion)             = tx.nVersion;
     *const_cast<std::vector<CTxIn>*>(&vin)   = tx.vin;
     *const_cast<std::vector<CTxOut>*>(&vout) = tx.vout;
     return *this;
 }
 
+// hash and nSerializedSize are set by the UpdateHash of the derived class constructor
 CTransactionBase::CTransactionBase(const CMutableTransactionBase& mutTxBase):
-    nVersion(mutTxBase.nVersion), vin(mutTxBase.vin), vout(mutTxBase.getVout()), hash(mutTxBase.GetHash()) {}
+    nVersion(mutTxBase.nVersion), vin(mutTxBase.vin), vout(mutTxBase.getVout()), hash(), nSerializedSize(0) {}
 
 CAmount CTransactionBase::GetValueOut() const
 {
@@ -740,6 +742,9 @@ CTransaction& CTransaction::operator=(const CTransaction &tx) {
 void CTransaction::UpdateHash() const
 {
     *const_cast<uint256*>(&hash) = SerializeHash(*this);
+    CSizeComputer s(SER_NETWORK, PROTOCOL_VERSION);
+    NCONST_PTR(this)->SerializationOp(s, CSerActionSerialize(), SER_NETWORK, PROTOCOL_VERSION);
+    *const_cast<size_t*>(&nSerializedSize) = s.size();
     // if any sidechain creation is taking place within this transaction, we generate the sidechain id
     for(unsigned int pos = 0; pos < vsc_ccout.size(); pos++)
         vsc_ccout[pos].GenerateScId(hash, pos);
@@ -967,7 +972,7 @@ void CTransaction::AddJoinSplitToJSON(UniValue& entry) const { return; }
 void CTransaction::AddCeasedSidechainWithdrawalInputsToJSON(UniValue& entry) const { return; }
 void CTransaction::AddSidechainOutsToJSON(UniValue& entry) const { return; }
 bool CTransaction::VerifyScript(
-        const CScript& scriptPubKey, unsigned int nFlags, unsigned int nIn, const CChain* chain,
+        const CScript& scriptPubKey, unsigned int nFlags, unsigned int nIn, const CCheckBlockAtHeightView* cbhView,
         bool cacheStore, ScriptError* serror) const { return true; }
 std::string CTransaction::EncodeHex() const { return ""; }
 void CTransaction::Relay() const {}
@@ -1156,7 +1161,7 @@ void CTransaction::AddSidechainOutsToJSON(UniValue& entry) const
 }
 
 bool CTransaction::VerifyScript(
-        const CScript& scriptPubKey, unsigned int nFlags, unsigned int nIn, const CChain* chain,
+        const CScript& scriptPubKey, unsigned int nFlags, unsigned int nIn, const CCheckBlockAtHeightView* cbhView,
         bool cacheStore, ScriptError* serror) const
 {
     // For CTransaction we should consider both regular inputs and CSW inputs
@@ -1169,7 +1174,7 @@ bool CTransaction::VerifyScript(
     const CScript& scriptSig = isRegularInput ? GetVin()[nIn].scriptSig : GetVcswCcIn()[nIn - GetVin().size()].redeemScript;
 
     if (!::VerifyScript(scriptSig, scriptPubKey, nFlags,
-                      CachingTransactionSignatureChecker(this, nIn, chain, cacheStore),
+                      CachingTransactionSignatureChecker(this, nIn, cbhView, cacheStore),
                       serror))
     {
         return ::error("%s:%d VerifySignature failed: %s", GetHash().ToString(), nIn, ScriptErrorString(*serror));
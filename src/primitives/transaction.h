@@ -36,6 +36,7 @@ class UniValue;
 class CBackwardTransferOut;
 class CValidationState;
 class CChain;
+class CCheckBlockAtHeightView;
 class CMutableTransactionBase;
 struct CMutableTransaction;
 
@@ -747,6 +748,8 @@ protected:
 
     /** Memory only. */
     const uint256 hash;
+    //! Serialized size, computed by UpdateHash together with hash, 0 until then
+    const size_t nSerializedSize;
 
     virtual void UpdateHash() const = 0;
 public:
@@ -836,7 +839,7 @@ public:
     virtual std::string ToString() const = 0;
 
     virtual bool VerifyScript(
-        const CScript& scriptPubKey, unsigned int flags, unsigned int nIn, const CChain* chain,
+        const CScript& scriptPubKey, unsigned int flags, unsigned int nIn, const CCheckBlockAtHeightView* cbhView,
         bool cacheStore, ScriptError* serror) const = 0;
 
     //-----------------
@@ -906,6 +909,9 @@ public:
     CTransaction(const CMutableTransaction &tx);
 
     size_t GetSerializeSize(int nType, int nVersion) const override {
+        // the serialization does not depend on nType and nVersion
+        if (nSerializedSize != 0)
+            return nSerializedSize;
         CSizeComputer s(nType, nVersion);
         NCONST_PTR(this)->SerializationOp(s, CSerActionSerialize(), nType, nVersion);
         return s.size();
@@ -915,6 +921,10 @@ public:
     void Serialize(Stream& s, int nType, int nVersion) const {
         NCONST_PTR(this)->SerializationOp(s, CSerActionSerialize(), nType, nVersion);
     }
+    //! Size computations of blocks and vectors use the cached size
+    void Serialize(CSizeComputer& s, int nType, int nVersion) const {
+        s.write(nullptr, GetSerializeSize(nType, nVersion));
+    }
     template<typename Stream>
     void Unserialize(Stream& s, int nType, int nVersion) {
         SerializationOp(s, CSerActionUnserialize(), nType, nVersion);
@@ -1046,7 +1056,7 @@ public:
     void AddSidechainOutsToJSON(UniValue& entry) const override;
 
     bool VerifyScript(
-            const CScript& scriptPubKey, unsigned int flags, unsigned int nIn, const CChain* chain,
+            const CScript& scriptPubKey, unsigned int flags, unsigned int nIn, const CCheckBlockAtHeightView* cbhView,
             bool cacheStore, ScriptError* serror) const override;
 };
 
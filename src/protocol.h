@@ -135,6 +135,77 @@ extern const char* NOTFOUND;
  * reasons, we are rejecting its message.
  */
 extern const char* REJECT;
+/**
+ * Contains a CBlockHeaderAndShortTxIDs object - providing a header and
+ * list of "short txids".
+ * Only available with service bit NODE_COMPACT_BLOCKS.
+ */
+extern const char* CMPCTBLOCK;
+/**
+ * Contains a BlockTransactionsRequest
+ * Peer should respond with "blocktxn" message.
+ * Only available with service bit NODE_COMPACT_BLOCKS.
+ */
+extern const char* GETBLOCKTXN;
+/**
+ * Contains a BlockTransactions.
+ * Sent in response to a "getblocktxn" message.
+ * Only available with service bit NODE_COMPACT_BLOCKS.
+ */
+extern const char* BLOCKTXN;
+/**
+ * Contains a vector of CCertAnnouncement, announcing certificates with their sidechain, epoch and
+ * quality instead of with an inv, so that the receiver only fetches the best one of each epoch.
+ * Only available with service bit NODE_CERT_ANNOUNCE.
+ */
+extern const char* CERTINV;
+/**
+ * Contains a filter type, a start height and a stop hash, and asks for the compact filters of the
+ * blocks from that height to the stop block, answered with one "cfilter" message per block.
+ * Only available with service bit NODE_COMPACT_FILTERS.
+ */
+extern const char* GETCFILTERS;
+/**
+ * Contains the compact filter of a block, sent in response to a "getcfilters" message.
+ */
+extern const char* CFILTER;
+/**
+ * Contains a filter type, a start height and a stop hash, and asks for the hashes of the filters of
+ * the blocks from that height to the stop block, answered with a "cfheaders" message.
+ * Only available with service bit NODE_COMPACT_FILTERS.
+ */
+extern const char* GETCFHEADERS;
+/**
+ * Contains the header of the filter of the block before the start height and the filter hashes of
+ * the blocks up to the stop block, sent in response to a "getcfheaders" message.
+ */
+extern const char* CFHEADERS;
+/**
+ * Contains a filter type and a stop hash, and asks for the filter headers of the ancestors of the
+ * stop block at every CFCHECKPT_INTERVAL heights, answered with a "cfcheckpt" message.
+ * Only available with service bit NODE_COMPACT_FILTERS.
+ */
+extern const char* GETCFCHECKPT;
+/**
+ * Contains the filter headers asked for by a "getcfcheckpt" message.
+ */
+extern const char* CFCHECKPT;
+/**
+ * Tells the receiving node that the sender wants the blocks it requests sent in "compressed"
+ * messages. Only sent to, and honoured from, whitelisted peers with -compressrelay.
+ */
+extern const char* SENDCMPR;
+/**
+ * Tells the receiving node that the sender accepts unrequested "cmpctblock" messages for the
+ * blocks extending its tip, pushed before their full validation. Only sent to, and honoured
+ * from, whitelisted peers with -fastblockrelay.
+ */
+extern const char* SENDFASTRELAY;
+/**
+ * Contains the command of a "block" or "cmpctblock" message and its payload as a zstd frame,
+ * sent instead of the message to the peers which sent "sendcmpr".
+ */
+extern const char* COMPRESSED;
 /**
  * This is not a real category, but it is used by the AccountForSent/RecvBytes
  * functions for counting bytes that do not fall in any of the previous
@@ -203,6 +274,18 @@ enum {
     // Bitcoin Core does not support this but a patch set called Bitcoin XT does.
     // See BIP 64 for details on how this is implemented.
     NODE_GETUTXO = (1 << 1),
+    // NODE_COMPACT_BLOCKS means the node can reconstruct blocks announced as compact blocks
+    // (header, coinbase and short ids of the other transactions and certificates) and serves
+    // blocks that way when they are requested with MSG_CMPCT_BLOCK. See BIP 152 for the
+    // design this follows.
+    NODE_COMPACT_BLOCKS = (1 << 5),
+    // NODE_CERT_ANNOUNCE means the node announces its certificates with certinv messages to the
+    // peers advertising it too, and understands those messages.
+    NODE_CERT_ANNOUNCE = (1 << 6),
+    // NODE_COMPACT_FILTERS means the node serves the compact filters of the blocks, with their
+    // headers, through the getcfilters, getcfheaders and getcfcheckpt messages. See BIP 157 for
+    // the design this follows.
+    NODE_COMPACT_FILTERS = (1 << 7),
 
     // Bits 24-31 are reserved for temporary experiments. Just pick a bit that
     // isn't getting used, or one not being used much, and notify the
@@ -275,12 +358,43 @@ public:
     uint256 hash;
 };
 
+/**
+ * A certificate announced in a certinv message. It is fetched as any transaction, with a MSG_TX getdata,
+ * unless a better certificate of the same sidechain and epoch is known.
+ */
+class CCertAnnouncement
+{
+public:
+    CCertAnnouncement() : epochNumber(0), quality(0) {}
+    CCertAnnouncement(const uint256& hashIn, const uint256& scIdIn, int32_t epochNumberIn, int64_t qualityIn) :
+        hash(hashIn), scId(scIdIn), epochNumber(epochNumberIn), quality(qualityIn) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion)
+    {
+        READWRITE(hash);
+        READWRITE(scId);
+        READWRITE(epochNumber);
+        READWRITE(quality);
+    }
+
+    uint256 hash;
+    uint256 scId;
+    int32_t epochNumber;
+    int64_t quality;
+};
+
 enum {
     MSG_TX = 1,
     MSG_BLOCK,
     // Nodes may always request a MSG_FILTERED_BLOCK in a getdata, however,
     // MSG_FILTERED_BLOCK should not appear in any invs except as a part of getdata.
-    MSG_FILTERED_BLOCK
+    MSG_FILTERED_BLOCK,
+    // MSG_CMPCT_BLOCK is only used in getdata, to peers advertising NODE_COMPACT_BLOCKS, and
+    // is answered with a cmpctblock message instead of a block message.
+    MSG_CMPCT_BLOCK
 };
 
 #endif // BITCOIN_PROTOCOL_H
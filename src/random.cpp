@@ -5,6 +5,7 @@
 
 #include "random.h"
 
+#include "crypto/common.h"
 #include "support/cleanse.h"
 #ifdef WIN32
 #include "compat.h" // for Windows API
@@ -64,6 +65,115 @@ uint256 GetRandHash()
     return hash;
 }
 
+FastRandomContext::FastRandomContext(bool fDeterministic) : nNonce(0), nKeystreamPos(KEYSTREAM_SIZE), nBitBuffer(0), nBitBufferSize(0)
+{
+    if (fDeterministic)
+        memset(key, 0, sizeof(key));
+    else
+        GetRandBytes(key, sizeof(key));
+}
+
+FastRandomContext::~FastRandomContext()
+{
+    memory_cleanse(key, sizeof(key));
+    memory_cleanse(keystream, sizeof(keystream));
+}
+
+void FastRandomContext::FillKeystream()
+{
+    unsigned char nonce[crypto_stream_chacha20_NONCEBYTES];
+    static_assert(sizeof(nonce) == sizeof(nNonce), "the nonce is a 64-bit counter");
+    WriteLE64(nonce, nNonce++);
+    crypto_stream_chacha20(keystream, sizeof(keystream), nonce, key);
+    nKeystreamPos = 0;
+}
+
+void FastRandomContext::randbytes(unsigned char* buf, size_t num)
+{
+    while (num > 0)
+    {
+        if (nKeystreamPos == KEYSTREAM_SIZE)
+            FillKeystream();
+        const size_t nTake = std::min(num, KEYSTREAM_SIZE - nKeystreamPos);
+        memcpy(buf, keystream + nKeystreamPos, nTake);
+        // the keystream is only handed out once
+        memory_cleanse(keystream + nKeystreamPos, nTake);
+        nKeystreamPos += nTake;
+        buf += nTake;
+        num -= nTake;
+    }
+}
+
+uint64_t FastRandomContext::rand64()
+{
+    unsigned char buf[8];
+    randbytes(buf, sizeof(buf));
+    return ReadLE64(buf);
+}
+
+uint64_t FastRandomContext::randbits(int nBits)
+{
+    if (nBits == 0)
+        return 0;
+    if (nBits > 32)
+        return rand64() >> (64 - nBits);
+    if (nBitBufferSize < nBits)
+    {
+        nBitBuffer = rand64();
+        nBitBufferSize = 64;
+    }
+    const uint64_t ret = nBitBuffer & (~uint64_t(0) >> (64 - nBits));
+    nBitBuffer >>= nBits;
+    nBitBufferSize -= nBits;
+    return ret;
+}
+
+uint64_t FastRandomContext::randrange(uint64_t nRange)
+{
+    if (nRange == 0)
+        return 0;
+    // draw as many bits as nRange - 1 has until the value is in range, which takes less than two
+    // draws on average
+    const uint64_t nMax = nRange - 1;
+    int nBits = 0;
+    while (nBits < 64 && (nMax >> nBits) != 0)
+        nBits++;
+    while (true)
+    {
+        const uint64_t ret = randbits(nBits);
+        if (ret <= nMax)
+            return ret;
+    }
+}
+
+uint256 FastRandomContext::rand256()
+{
+    uint256 hash;
+    randbytes(hash.begin(), hash.size());
+    return hash;
+}
+
+FastRandomContext& GetFastRandomContext()
+{
+    static thread_local FastRandomContext context;
+    return context;
+}
+
+uint64_t GetFastRand(uint64_t nMax)
+{
+    return GetFastRandomContext().randrange(nMax);
+}
+
+int GetFastRandInt(int nMax)
+{
+    return GetFastRand(nMax);
+}
+
+uint256 GetFastRandHash()
+{
+    return GetFastRandomContext().rand256();
+}
+
 uint32_t insecure_rand_Rz = 11;
 uint32_t insecure_rand_Rw = 11;
 void seed_insecure_rand(bool fDeterministic)
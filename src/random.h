@@ -20,6 +20,65 @@ uint64_t GetRand(uint64_t nMax);
 int GetRandInt(int nMax);
 uint256 GetRandHash();
 
+/**
+ * A fast random generator for the randomness not used for keys: the salts of the in-memory hash
+ * tables, the random evictions from the caches, the shuffles and samplings of the coin selection and
+ * of the address manager, the timings of the relay. It is the ChaCha20 keystream under a key drawn
+ * with GetRandBytes, each call to the libsodium CSPRNG serving many numbers. Each thread has its
+ * own, see GetFastRandomContext(); a context is not thread safe.
+ * It is a C++ Uniform Random Number Generator, for std::shuffle.
+ */
+class FastRandomContext
+{
+public:
+    typedef uint64_t result_type;
+
+    //! With fDeterministic the key is zero, for the tests
+    explicit FastRandomContext(bool fDeterministic = false);
+    ~FastRandomContext();
+
+    FastRandomContext(const FastRandomContext&) = delete;
+    FastRandomContext& operator=(const FastRandomContext&) = delete;
+
+    uint64_t rand64();
+    uint32_t rand32() { return randbits(32); }
+    bool randbool() { return randbits(1); }
+    //! The nBits low bits, nBits up to 64
+    uint64_t randbits(int nBits);
+    //! Uniform in [0, nRange), 0 if nRange is 0 as GetRand()
+    uint64_t randrange(uint64_t nRange);
+    uint256 rand256();
+    void randbytes(unsigned char* buf, size_t num);
+
+    static constexpr result_type min() {
+        return std::numeric_limits<result_type>::min();
+    }
+    static constexpr result_type max() {
+        return std::numeric_limits<result_type>::max();
+    }
+    result_type operator()() { return rand64(); }
+
+private:
+    static const size_t KEYSTREAM_SIZE = 512;
+
+    unsigned char key[32];
+    //! The nonce of the next keystream block, each one is used once with the key
+    uint64_t nNonce;
+    unsigned char keystream[KEYSTREAM_SIZE];
+    size_t nKeystreamPos;
+    uint64_t nBitBuffer;
+    int nBitBufferSize;
+
+    void FillKeystream();
+};
+
+//! The FastRandomContext of the calling thread
+FastRandomContext& GetFastRandomContext();
+//! As GetRand(), GetRandInt() and GetRandHash(), from the FastRandomContext of the calling thread
+uint64_t GetFastRand(uint64_t nMax);
+int GetFastRandInt(int nMax);
+uint256 GetFastRandHash();
+
 /**
  * Implementation of a C++ Uniform Random Number Generator, backed by GetRandBytes.
  */
@@ -3,15 +3,21 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include "blockfilterindex.h"
 #include "primitives/block.h"
 #include "primitives/transaction.h"
+#include "primitives/certificate.h"
+#include "core_io.h"
 #include "main.h"
 #include "httpserver.h"
+#include "notificationdispatcher.h"
 #include "rpc/server.h"
 #include "streams.h"
 #include "sync.h"
 #include "txmempool.h"
+#include "txtrace.h"
 #include "utilstrencodings.h"
+#include "validationstats.h"
 #include "version.h"
 
 #include <boost/algorithm/string.hpp>
@@ -22,6 +28,8 @@
 using namespace std;
 
 static const size_t MAX_GETUTXOS_OUTPOINTS = 15; //allow a max of 15 outpoints to be queried at once
+static const size_t MAX_REST_TXS = 100; //allow a max of 100 transactions to be queried at once by /rest/txs
+static const size_t REST_REPLY_CHUNK_SIZE = 1 << 20; //replies larger than 1MB are sent in chunks
 
 enum RetFormat {
     RF_UNDEF,
@@ -57,7 +65,9 @@ struct CCoin {
 };
 
 extern void TxToJSON(const CTransaction& tx, const uint256 hashBlock, UniValue& entry);
+extern void CertToJSON(const CScCertificate& cert, const uint256 hashBlock, UniValue& entry);
 extern UniValue blockToJSON(const CBlock& block, const CBlockIndex* blockindex, bool txDetails = false);
+extern void blockToJSONStream(const CBlock& block, const CBlockIndex* blockindex, bool txDetails, std::string& strJSON);
 extern UniValue mempoolInfoToJSON();
 extern UniValue mempoolToJSON(bool fVerbose = false);
 extern void ScriptPubKeyToJSON(const CScript& scriptPubKey, UniValue& out, bool fIncludeHex);
@@ -189,6 +199,156 @@ static bool rest_headers(HTTPRequest* req,
     return true; // continue to process further HTTP reqs on this cxn
 }
 
+static bool rest_blockfilter(HTTPRequest* req, const std::string& strURIPart)
+{
+    if (!CheckWarmup(req))
+        return false;
+    vector<string> params;
+    const RetFormat rf = ParseDataFormat(params, strURIPart);
+    vector<string> path;
+    boost::split(path, params[0], boost::is_any_of("/"));
+
+    if (path.size() != 2)
+        return RESTERR(req, HTTP_BAD_REQUEST, "Invalid URI format. Expected /rest/blockfilter/<filtertype>/<blockhash>.<ext>");
+
+    BlockFilterType filterType;
+    if (!BlockFilterTypeByName(path[0], filterType))
+        return RESTERR(req, HTTP_BAD_REQUEST, "Unknown filtertype " + path[0]);
+    if (pblockfilterindex == NULL || pblockfilterindex->GetFilterType() != filterType)
+        return RESTERR(req, HTTP_BAD_REQUEST, "Index is not enabled for filtertype " + path[0]);
+
+    uint256 hash;
+    if (!ParseHashStr(path[1], hash))
+        return RESTERR(req, HTTP_BAD_REQUEST, "Invalid hash: " + path[1]);
+
+    const CBlockIndex* pindex = NULL;
+    {
+        LOCK(cs_main);
+        BlockMap::const_iterator it = mapBlockIndex.find(hash);
+        if (it == mapBlockIndex.end())
+            return RESTERR(req, HTTP_NOT_FOUND, path[1] + " not found");
+        pindex = it->second;
+    }
+
+    CBlockFilter filter;
+    if (!pblockfilterindex->LookupFilter(pindex, filter))
+        return RESTERR(req, HTTP_NOT_FOUND, "Filter not found. " + string(pblockfilterindex->IsSynced() ? "" : "Block filters are still in the process of being indexed."));
+
+    switch (rf) {
+    case RF_BINARY: {
+        CDataStream ssResp(SER_NETWORK, PROTOCOL_VERSION);
+        ssResp << filter;
+        string binaryResp = ssResp.str();
+        req->WriteHeader("Content-Type", "application/octet-stream");
+        req->WriteReply(HTTP_OK, binaryResp);
+        return true;
+    }
+    case RF_HEX: {
+        CDataStream ssResp(SER_NETWORK, PROTOCOL_VERSION);
+        ssResp << filter;
+        string strHex = HexStr(ssResp.begin(), ssResp.end()) + "\n";
+        req->WriteHeader("Content-Type", "text/plain");
+        req->WriteReply(HTTP_OK, strHex);
+        return true;
+    }
+    case RF_JSON: {
+        UniValue ret(UniValue::VOBJ);
+        ret.pushKV("filter", HexStr(filter.GetEncodedFilter()));
+        string strJSON = ret.write() + "\n";
+        req->WriteHeader("Content-Type", "application/json");
+        req->WriteReply(HTTP_OK, strJSON);
+        return true;
+    }
+    default: {
+        return RESTERR(req, HTTP_NOT_FOUND, "output format not found (available: .bin, .hex, .json)");
+    }
+    }
+}
+
+static bool rest_blockfilterheaders(HTTPRequest* req, const std::string& strURIPart)
+{
+    if (!CheckWarmup(req))
+        return false;
+    vector<string> params;
+    const RetFormat rf = ParseDataFormat(params, strURIPart);
+    vector<string> path;
+    boost::split(path, params[0], boost::is_any_of("/"));
+
+    if (path.size() != 3)
+        return RESTERR(req, HTTP_BAD_REQUEST, "Invalid URI format. Expected /rest/blockfilterheaders/<filtertype>/<count>/<blockhash>.<ext>");
+
+    BlockFilterType filterType;
+    if (!BlockFilterTypeByName(path[0], filterType))
+        return RESTERR(req, HTTP_BAD_REQUEST, "Unknown filtertype " + path[0]);
+    if (pblockfilterindex == NULL || pblockfilterindex->GetFilterType() != filterType)
+        return RESTERR(req, HTTP_BAD_REQUEST, "Index is not enabled for filtertype " + path[0]);
+
+    long count = strtol(path[1].c_str(), NULL, 10);
+    if (count < 1 || count > 2000)
+        return RESTERR(req, HTTP_BAD_REQUEST, "Header count out of range: " + path[1]);
+
+    uint256 hash;
+    if (!ParseHashStr(path[2], hash))
+        return RESTERR(req, HTTP_BAD_REQUEST, "Invalid hash: " + path[2]);
+
+    // the filter headers of the blocks of the active chain from the requested one
+    std::vector<const CBlockIndex*> vIndexes;
+    vIndexes.reserve(count);
+    {
+        LOCK(cs_main);
+        BlockMap::const_iterator it = mapBlockIndex.find(hash);
+        const CBlockIndex* pindex = (it != mapBlockIndex.end()) ? it->second : NULL;
+        while (pindex != NULL && chainActive.Contains(pindex)) {
+            vIndexes.push_back(pindex);
+            if (vIndexes.size() == (unsigned long)count)
+                break;
+            pindex = chainActive.Next(pindex);
+        }
+    }
+
+    std::vector<uint256> vHeaders;
+    vHeaders.reserve(vIndexes.size());
+    for (const CBlockIndex* pindex : vIndexes) {
+        uint256 header;
+        if (!pblockfilterindex->LookupFilterHeader(pindex, header))
+            break;
+        vHeaders.push_back(header);
+    }
+
+    switch (rf) {
+    case RF_BINARY: {
+        CDataStream ssHeader(SER_NETWORK, PROTOCOL_VERSION);
+        for (const uint256& header : vHeaders)
+            ssHeader << header;
+        string binaryHeader = ssHeader.str();
+        req->WriteHeader("Content-Type", "application/octet-stream");
+        req->WriteReply(HTTP_OK, binaryHeader);
+        return true;
+    }
+    case RF_HEX: {
+        CDataStream ssHeader(SER_NETWORK, PROTOCOL_VERSION);
+        for (const uint256& header : vHeaders)
+            ssHeader << header;
+        string strHex = HexStr(ssHeader.begin(), ssHeader.end()) + "\n";
+        req->WriteHeader("Content-Type", "text/plain");
+        req->WriteReply(HTTP_OK, strHex);
+        return true;
+    }
+    case RF_JSON: {
+        UniValue jsonHeaders(UniValue::VARR);
+        for (const uint256& header : vHeaders)
+            jsonHeaders.push_back(header.GetHex());
+        string strJSON = jsonHeaders.write() + "\n";
+        req->WriteHeader("Content-Type", "application/json");
+        req->WriteReply(HTTP_OK, strJSON);
+        return true;
+    }
+    default: {
+        return RESTERR(req, HTTP_NOT_FOUND, "output format not found (available: .bin, .hex, .json)");
+    }
+    }
+}
+
 static bool rest_block(HTTPRequest* req,
                        const std::string& strURIPart,
                        bool showTxDetails)
@@ -203,7 +363,9 @@ static bool rest_block(HTTPRequest* req,
     if (!ParseHashStr(hashStr, hash))
         return RESTERR(req, HTTP_BAD_REQUEST, "Invalid hash: " + hashStr);
 
-    CBlock block;
+    std::shared_ptr<const CBlock> block;
+    // the payload of the block message shared with the peers, for the binary and hex formats
+    std::shared_ptr<const CSerializeData> msg;
     CBlockIndex* pblockindex = NULL;
     {
         LOCK(cs_main);
@@ -214,31 +376,32 @@ static bool rest_block(HTTPRequest* req,
         if (fHavePruned && !(pblockindex->nStatus & BLOCK_HAVE_DATA) && pblockindex->nTx > 0)
             return RESTERR(req, HTTP_NOT_FOUND, hashStr + " not available (pruned data)");
 
-        if (!ReadBlockFromDisk(block, pblockindex))
+        if (rf == RF_BINARY || rf == RF_HEX) {
+            if (!(msg = ReadBlockMessageCached(pblockindex, PROTOCOL_VERSION)))
+                return RESTERR(req, HTTP_NOT_FOUND, hashStr + " not found");
+        } else if (!(block = ReadBlockFromDiskCached(pblockindex)))
             return RESTERR(req, HTTP_NOT_FOUND, hashStr + " not found");
     }
 
-    CDataStream ssBlock(SER_NETWORK, PROTOCOL_VERSION);
-    ssBlock << block;
-
     switch (rf) {
     case RF_BINARY: {
-        string binaryBlock = ssBlock.str();
+        string binaryBlock(msg->begin() + CMessageHeader::HEADER_SIZE, msg->end());
         req->WriteHeader("Content-Type", "application/octet-stream");
         req->WriteReply(HTTP_OK, binaryBlock);
         return true;
     }
 
     case RF_HEX: {
-        string strHex = HexStr(ssBlock.begin(), ssBlock.end()) + "\n";
+        string strHex = HexStr(msg->begin() + CMessageHeader::HEADER_SIZE, msg->end()) + "\n";
         req->WriteHeader("Content-Type", "text/plain");
         req->WriteReply(HTTP_OK, strHex);
         return true;
     }
 
     case RF_JSON: {
-        UniValue objBlock = blockToJSON(block, pblockindex, showTxDetails);
-        string strJSON = objBlock.write() + "\n";
+        string strJSON;
+        blockToJSONStream(*block, pblockindex, showTxDetails, strJSON);
+        strJSON += "\n";
         req->WriteHeader("Content-Type", "application/json");
         req->WriteReply(HTTP_OK, strJSON);
         return true;
@@ -313,6 +476,104 @@ static bool rest_mempool_info(HTTPRequest* req, const std::string& strURIPart)
     return true; // continue to process further HTTP reqs on this cxn
 }
 
+/**
+ * A reply sent as it is serialized: once the body grows past REST_REPLY_CHUNK_SIZE what is written so far
+ * goes out as a chunk of a chunked reply, a smaller body is sent whole when the reply ends.
+ */
+class RESTStreamedReply
+{
+public:
+    RESTStreamedReply(HTTPRequest* _req) : req(_req) {}
+
+    std::string& Body() { return strBody; }
+
+    //! Send the body written so far if it has grown past the chunk size
+    void Flush()
+    {
+        if (strBody.size() < REST_REPLY_CHUNK_SIZE)
+            return;
+        if (!fStarted) {
+            req->StartReply(HTTP_OK);
+            fStarted = true;
+        }
+        req->WriteReplyChunk(strBody);
+        strBody.clear();
+    }
+
+    void End()
+    {
+        if (!fStarted) {
+            req->WriteReply(HTTP_OK, strBody);
+            return;
+        }
+        if (!strBody.empty())
+            req->WriteReplyChunk(strBody);
+        req->EndReply();
+    }
+
+private:
+    HTTPRequest* req;
+    std::string strBody;
+    bool fStarted = false;
+};
+
+//! The same entry as in getrawmempool true
+static void WriteMempoolEntry(UniValueWriter& writer, const CMemPoolEntryInfo& entry)
+{
+    writer.key(entry.hash.ToString());
+    writer.startObject();
+    if (entry.fInMempool) {
+        writer.key("size");
+        writer.valueInt(entry.nSize);
+        writer.key("fee");
+        writer.value(ValueFromAmount(entry.nFee));
+        writer.key("time");
+        writer.valueInt(entry.nTime);
+        writer.key("height");
+        writer.valueInt(entry.nHeight);
+        writer.key("startingpriority");
+        writer.value(UniValue(entry.dStartingPriority));
+        writer.key("currentpriority");
+        writer.value(UniValue(entry.dCurrentPriority));
+        writer.key("isCert");
+        writer.valueBool(entry.fCert);
+        writer.key("version");
+        writer.valueInt(entry.nVersion);
+        writer.key("depends");
+        writer.startArray();
+        for (const uint256& hashDep : entry.vDepends)
+            writer.valueStr(hashDep.ToString());
+        writer.endArray();
+        if (entry.fPackage) {
+            writer.key("descendantcount");
+            writer.value(UniValue(entry.nCountWithDescendants));
+            writer.key("descendantsize");
+            writer.valueInt(entry.nSizeWithDescendants);
+            writer.key("descendantfees");
+            writer.value(ValueFromAmount(entry.nFeesWithDescendants));
+            writer.key("ancestorcount");
+            writer.value(UniValue(entry.nCountWithAncestors));
+            writer.key("ancestorsize");
+            writer.valueInt(entry.nSizeWithAncestors);
+            writer.key("ancestorfees");
+            writer.value(ValueFromAmount(entry.nFeesWithAncestors));
+        }
+    }
+    if (entry.fDelta) {
+        writer.key("fee_delta");
+        writer.value(ValueFromAmount(entry.nFeeDelta));
+        writer.key("priority_delta");
+        writer.value(UniValue(entry.dPriorityDelta));
+    }
+    writer.endObject();
+}
+
+/**
+ * /rest/mempool/contents gives the whole mempool, /rest/mempool/contents/since/<sequence> only the entries
+ * added and the hashes of those removed after a sequence returned by a previous call (in the
+ * X-Mempool-Sequence header of a whole mempool, or in the reply of a delta). The entries are copied under
+ * the mempool lock and serialized after it is released, a large reply is sent in chunks.
+ */
 static bool rest_mempool_contents(HTTPRequest* req, const std::string& strURIPart)
 {
     if (!CheckWarmup(req))
@@ -320,17 +581,94 @@ static bool rest_mempool_contents(HTTPRequest* req, const std::string& strURIPar
     vector<string> params;
     const RetFormat rf = ParseDataFormat(params, strURIPart);
 
-    switch (rf) {
-    case RF_JSON: {
-        UniValue mempoolObject = mempoolToJSON(true);
+    bool fSince = false;
+    uint64_t nSince = 0;
+    if (!params[0].empty()) {
+        vector<string> path;
+        boost::split(path, params[0], boost::is_any_of("/"));
+        int64_t nParsed;
+        if (path.size() != 3 || !path[0].empty() || path[1] != "since" || !ParseInt64(path[2], &nParsed) || nParsed < 0)
+            return RESTERR(req, HTTP_BAD_REQUEST, "Invalid URI, use /rest/mempool/contents/since/<sequence>");
+        fSince = true;
+        nSince = (uint64_t)nParsed;
+    }
 
-        string strJSON = mempoolObject.write() + "\n";
-        req->WriteHeader("Content-Type", "application/json");
-        req->WriteReply(HTTP_OK, strJSON);
+    if (rf != RF_JSON && rf != RF_BINARY && rf != RF_HEX)
+        return RESTERR(req, HTTP_NOT_FOUND, "output format not found (available: " + AvailableDataFormatsString() + ")");
+    // the binary formats only give the hashes, the entries are fetched with /rest/txs
+    const bool fEntries = (rf == RF_JSON);
+
+    std::vector<CMemPoolEntryInfo> vEntries;
+    std::vector<uint256> vAdded, vRemoved;
+    uint64_t nSequence;
+    bool fFull = !fSince;
+    {
+        const int nChainHeight = chainActive.Height();
+        LOCK(mempool->cs);
+        nSequence = mempool->GetSequence();
+        if (fSince && !mempool->GetRemovedSince(nSince, vRemoved))
+            fFull = true;
+        const uint64_t nAddedAfter = fFull ? 0 : nSince;
+
+        if (fEntries) {
+            // the deltas of the entries given, and of the hashes not in the mempool for a whole mempool
+            mempool->getEntryInfos(nChainHeight, nAddedAfter, /*fDeltasOnly*/fFull, vEntries);
+        } else {
+            for (const auto& entry : mempool->mapTx)
+                if (entry.second.GetSequence() > nAddedAfter)
+                    vAdded.push_back(entry.first);
+            for (const auto& entry : mempool->mapCertificate)
+                if (entry.second.GetSequence() > nAddedAfter)
+                    vAdded.push_back(entry.first);
+        }
+    }
+
+    req->WriteHeader("X-Mempool-Sequence", strprintf("%d", nSequence));
+
+    switch (rf) {
+    case RF_BINARY:
+    case RF_HEX: {
+        CDataStream ssMempool(SER_NETWORK, PROTOCOL_VERSION);
+        ssMempool << nSequence << fFull << vAdded << vRemoved;
+
+        if (rf == RF_BINARY) {
+            req->WriteHeader("Content-Type", "application/octet-stream");
+            req->WriteReply(HTTP_OK, ssMempool.str());
+        } else {
+            req->WriteHeader("Content-Type", "text/plain");
+            req->WriteReply(HTTP_OK, HexStr(ssMempool.begin(), ssMempool.end()) + "\n");
+        }
         return true;
     }
     default: {
-        return RESTERR(req, HTTP_NOT_FOUND, "output format not found (available: json)");
+        req->WriteHeader("Content-Type", "application/json");
+        RESTStreamedReply reply(req);
+        UniValueWriter writer(reply.Body());
+        writer.startObject();
+        if (fSince) {
+            writer.key("sequence");
+            writer.value(UniValue(nSequence));
+            writer.key("full");
+            writer.valueBool(fFull);
+            writer.key("added");
+            writer.startObject();
+        }
+        for (const CMemPoolEntryInfo& entry : vEntries) {
+            WriteMempoolEntry(writer, entry);
+            reply.Flush();
+        }
+        if (fSince) {
+            writer.endObject();
+            writer.key("removed");
+            writer.startArray();
+            for (const uint256& hash : vRemoved)
+                writer.valueStr(hash.ToString());
+            writer.endArray();
+        }
+        writer.endObject();
+        reply.Body() += "\n";
+        reply.End();
+        return true;
     }
     }
 
@@ -391,6 +729,90 @@ static bool rest_tx(HTTPRequest* req, const std::string& strURIPart)
     return true; // continue to process further HTTP reqs on this cxn
 }
 
+/**
+ * /rest/txs/<txid>/<txid>/....<format>: the transactions or certificates looked up with a single
+ * GetTxBaseObjs call, in the order of the txids. The json array has a null and the hex format an
+ * empty line for those not found, while the binary format fails unless all of them are.
+ */
+static bool rest_txs(HTTPRequest* req, const std::string& strURIPart)
+{
+    if (!CheckWarmup(req))
+        return false;
+    vector<string> params;
+    const RetFormat rf = ParseDataFormat(params, strURIPart);
+
+    vector<string> hashStrs;
+    boost::split(hashStrs, params[0], boost::is_any_of("/"));
+    if (hashStrs.size() > MAX_REST_TXS)
+        return RESTERR(req, HTTP_BAD_REQUEST, strprintf("Error: max txs exceeded (max %d)", MAX_REST_TXS));
+
+    vector<uint256> vHash;
+    for (const string& hashStr : hashStrs) {
+        uint256 hash;
+        if (!ParseHashStr(hashStr, hash))
+            return RESTERR(req, HTTP_BAD_REQUEST, "Invalid hash: " + hashStr);
+        vHash.push_back(hash);
+    }
+
+    vector<std::unique_ptr<CTransactionBase>> vTxBase;
+    vector<uint256> vHashBlock;
+    GetTxBaseObjs(vHash, vTxBase, vHashBlock, true);
+
+    switch (rf) {
+    case RF_BINARY: {
+        CDataStream ssTxs(SER_NETWORK, PROTOCOL_VERSION);
+        for (size_t i = 0; i < vTxBase.size(); i++) {
+            if (!vTxBase[i])
+                return RESTERR(req, HTTP_NOT_FOUND, hashStrs[i] + " not found");
+            if (vTxBase[i]->IsCertificate())
+                ssTxs << dynamic_cast<const CScCertificate&>(*vTxBase[i]);
+            else
+                ssTxs << dynamic_cast<const CTransaction&>(*vTxBase[i]);
+        }
+        string binaryTxs = ssTxs.str();
+        req->WriteHeader("Content-Type", "application/octet-stream");
+        req->WriteReply(HTTP_OK, binaryTxs);
+        return true;
+    }
+
+    case RF_HEX: {
+        string strHex;
+        for (const std::unique_ptr<CTransactionBase>& pTxBase : vTxBase)
+            strHex += (pTxBase ? EncodeHex(pTxBase) : "") + "\n";
+        req->WriteHeader("Content-Type", "text/plain");
+        req->WriteReply(HTTP_OK, strHex);
+        return true;
+    }
+
+    case RF_JSON: {
+        UniValue arrTxs(UniValue::VARR);
+        for (size_t i = 0; i < vTxBase.size(); i++) {
+            if (!vTxBase[i]) {
+                arrTxs.push_back(NullUniValue);
+                continue;
+            }
+            UniValue objTx(UniValue::VOBJ);
+            if (vTxBase[i]->IsCertificate())
+                CertToJSON(dynamic_cast<const CScCertificate&>(*vTxBase[i]), vHashBlock[i], objTx);
+            else
+                TxToJSON(dynamic_cast<const CTransaction&>(*vTxBase[i]), vHashBlock[i], objTx);
+            arrTxs.push_back(objTx);
+        }
+        string strJSON = arrTxs.write() + "\n";
+        req->WriteHeader("Content-Type", "application/json");
+        req->WriteReply(HTTP_OK, strJSON);
+        return true;
+    }
+
+    default: {
+        return RESTERR(req, HTTP_NOT_FOUND, "output format not found (available: " + AvailableDataFormatsString() + ")");
+    }
+    }
+
+    // not reached
+    return true; // continue to process further HTTP reqs on this cxn
+}
+
 static bool rest_getutxos(HTTPRequest* req, const std::string& strURIPart)
 {
     if (!CheckWarmup(req))
@@ -490,8 +912,13 @@ static bool rest_getutxos(HTTPRequest* req, const std::string& strURIPart)
     vector<CCoin> outs;
     std::string bitmapStringRepresentation;
     boost::dynamic_bitset<unsigned char> hits(vOutPoints.size());
+    // the tip the coins were read at, taken under the same lock
+    int nChainHeight;
+    uint256 hashChainTip;
     {
         LOCK2(cs_main, mempool->cs);
+        nChainHeight = chainActive.Height();
+        hashChainTip = chainActive.Tip()->GetBlockHash();
 
         CCoinsView viewDummy;
         CCoinsViewCache view(&viewDummy);
@@ -530,7 +957,7 @@ static bool rest_getutxos(HTTPRequest* req, const std::string& strURIPart)
         // serialize data
         // use exact same output as mentioned in Bip64
         CDataStream ssGetUTXOResponse(SER_NETWORK, PROTOCOL_VERSION);
-        ssGetUTXOResponse << chainActive.Height() << chainActive.Tip()->GetBlockHash() << bitmap << outs;
+        ssGetUTXOResponse << nChainHeight << hashChainTip << bitmap << outs;
         string ssGetUTXOResponseString = ssGetUTXOResponse.str();
 
         req->WriteHeader("Content-Type", "application/octet-stream");
@@ -540,7 +967,7 @@ static bool rest_getutxos(HTTPRequest* req, const std::string& strURIPart)
 
     case RF_HEX: {
         CDataStream ssGetUTXOResponse(SER_NETWORK, PROTOCOL_VERSION);
-        ssGetUTXOResponse << chainActive.Height() << chainActive.Tip()->GetBlockHash() << bitmap << outs;
+        ssGetUTXOResponse << nChainHeight << hashChainTip << bitmap << outs;
         string strHex = HexStr(ssGetUTXOResponse.begin(), ssGetUTXOResponse.end()) + "\n";
 
         req->WriteHeader("Content-Type", "text/plain");
@@ -553,8 +980,8 @@ static bool rest_getutxos(HTTPRequest* req, const std::string& strURIPart)
 
         // pack in some essentials
         // use more or less the same output as mentioned in Bip64
-        objGetUTXOResponse.pushKV("chainHeight", chainActive.Height());
-        objGetUTXOResponse.pushKV("chaintipHash", chainActive.Tip()->GetBlockHash().GetHex());
+        objGetUTXOResponse.pushKV("chainHeight", nChainHeight);
+        objGetUTXOResponse.pushKV("chaintipHash", hashChainTip.GetHex());
         objGetUTXOResponse.pushKV("bitmap", bitmapStringRepresentation);
 
         UniValue utxos(UniValue::VARR);
@@ -567,13 +994,15 @@ static bool rest_getutxos(HTTPRequest* req, const std::string& strURIPart)
             // include the script in a json output
             UniValue o(UniValue::VOBJ);
             ScriptPubKeyToJSON(coin.out.scriptPubKey, o, true);
-            utxo.pushKV("scriptPubKey", o);
-            utxos.push_back(utxo);
+            utxo.pushKV("scriptPubKey", std::move(o));
+            utxos.push_back(std::move(utxo));
         }
-        objGetUTXOResponse.pushKV("utxos", utxos);
+        objGetUTXOResponse.pushKV("utxos", std::move(utxos));
 
         // return json string
-        string strJSON = objGetUTXOResponse.write() + "\n";
+        string strJSON;
+        objGetUTXOResponse.write(strJSON);
+        strJSON += "\n";
         req->WriteHeader("Content-Type", "application/json");
         req->WriteReply(HTTP_OK, strJSON);
         return true;
@@ -592,12 +1021,15 @@ static const struct {
     bool (*handler)(HTTPRequest* req, const std::string& strReq);
 } uri_prefixes[] = {
       {"/rest/tx/", rest_tx},
+      {"/rest/txs/", rest_txs},
       {"/rest/block/notxdetails/", rest_block_notxdetails},
       {"/rest/block/", rest_block_extended},
       {"/rest/chaininfo", rest_chaininfo},
       {"/rest/mempool/info", rest_mempool_info},
       {"/rest/mempool/contents", rest_mempool_contents},
       {"/rest/headers/", rest_headers},
+      {"/rest/blockfilter/", rest_blockfilter},
+      {"/rest/blockfilterheaders/", rest_blockfilterheaders},
       {"/rest/getutxos", rest_getutxos},
 };
 
@@ -617,3 +1049,24 @@ void StopREST()
     for (unsigned int i = 0; i < ARRAYLEN(uri_prefixes); i++)
         UnregisterHTTPHandler(uri_prefixes[i].prefix, false);
 }
+
+static bool http_metrics(HTTPRequest* req, const std::string& strURIPart)
+{
+    if (req->GetRequestMethod() != HTTPRequest::GET)
+        return RESTERR(req, HTTP_BAD_METHOD, "Only GET is supported");
+
+    req->WriteHeader("Content-Type", "text/plain; version=0.0.4");
+    req->WriteReply(HTTP_OK, BlockValidationStatsToPrometheus() + NotificationStatsToPrometheus() + TxTraceStatsToPrometheus());
+    return true;
+}
+
+bool StartMetrics()
+{
+    RegisterHTTPHandler("/metrics", true, http_metrics);
+    return true;
+}
+
+void StopMetrics()
+{
+    UnregisterHTTPHandler("/metrics", true);
+}
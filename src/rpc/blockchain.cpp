@@ -6,11 +6,15 @@
 #include "addressindex.h"
 #include "amount.h"
 #include "base58.h"
+#include "blockfilterindex.h"
 #include "chain.h"
+#include "chaindata.h"
 #include "chainparams.h"
 #include "checkpoints.h"
+#include "coinssnapshot.h"
 #include "consensus/validation.h"
 #include "main.h"
+#include "notificationdispatcher.h"
 #include "primitives/transaction.h"
 #include "script/script.h"
 #include "script/script_error.h"
@@ -20,12 +24,17 @@
 #include "streams.h"
 #include "sync.h"
 #include "util.h"
+#include "txtrace.h"
+#include "validationstats.h"
 #include "zen/delay.h"
 
 #include <stdint.h>
 
 #include <univalue.h>
 
+#include <boost/assign/list_of.hpp>
+#include <boost/filesystem.hpp>
+
 #include <regex>
 #include <optional>
 
@@ -116,14 +125,15 @@ static UniValue ValuePoolDesc(
     return rv;
 }
 
-UniValue blockheaderToJSON(const CBlockIndex* blockindex)
+/** The header of blockindex, as seen from the chain ending at tip: requires no lock */
+UniValue blockheaderToJSON(const CBlockIndex* blockindex, const CBlockIndex* tip)
 {
     UniValue result(UniValue::VOBJ);
     result.pushKV("hash", blockindex->GetBlockHash().GetHex());
     int confirmations = -1;
     // Only report confirmations if the block is on the main chain
-    if (chainActive.Contains(blockindex))
-        confirmations = chainActive.Height() - blockindex->nHeight + 1;
+    if (IsInPublishedChain(blockindex, tip))
+        confirmations = tip->nHeight - blockindex->nHeight + 1;
     result.pushKV("confirmations", confirmations);
     result.pushKV("height", blockindex->nHeight);
     result.pushKV("version", blockindex->nVersion);
@@ -139,12 +149,17 @@ UniValue blockheaderToJSON(const CBlockIndex* blockindex)
 
     if (blockindex->pprev)
         result.pushKV("previousblockhash", blockindex->pprev->GetBlockHash().GetHex());
-    CBlockIndex *pnext = chainActive.Next(blockindex);
-    if (pnext)
-        result.pushKV("nextblockhash", pnext->GetBlockHash().GetHex());
+    if (confirmations > 1)
+        result.pushKV("nextblockhash", tip->GetAncestor(blockindex->nHeight + 1)->GetBlockHash().GetHex());
     return result;
 }
 
+// Requires cs_main.
+UniValue blockheaderToJSON(const CBlockIndex* blockindex)
+{
+    return blockheaderToJSON(blockindex, chainActive.Tip());
+}
+
 UniValue blockToDeltasJSON(const CBlock& block, const CBlockIndex* blockindex)
 {
     UniValue result(UniValue::VOBJ);
@@ -162,6 +177,11 @@ UniValue blockToDeltasJSON(const CBlock& block, const CBlockIndex* blockindex)
     result.pushKV("version", block.nVersion);
     result.pushKV("merkleroot", block.hashMerkleRoot.GetHex());
 
+    // the blocks connected before the input deltas were recorded fall back to the spent index lookups
+    CBlockInputDeltas blockInputDeltas;
+    const bool fInputDeltas = GetBlockInputDeltas(block.GetHash(), blockInputDeltas) &&
+        blockInputDeltas.vTxInputs.size() == block.vtx.size();
+
     UniValue deltas(UniValue::VARR);
 
     for (unsigned int i = 0; i < block.vtx.size(); i++) {
@@ -184,7 +204,18 @@ UniValue blockToDeltasJSON(const CBlock& block, const CBlockIndex* blockindex)
                 CSpentIndexValue spentInfo;
                 CSpentIndexKey spentKey(input.prevout.hash, input.prevout.n);
 
-                if (GetSpentIndex(spentKey, spentInfo)) {
+                bool fSpentInfo = false;
+                if (fInputDeltas && j < blockInputDeltas.vTxInputs[i].size()) {
+                    const CInputDelta& inputDelta = blockInputDeltas.vTxInputs[i][j];
+                    spentInfo.satoshis = inputDelta.satoshis;
+                    spentInfo.addressType = inputDelta.addressType;
+                    spentInfo.addressHash = inputDelta.addressHash;
+                    fSpentInfo = true;
+                } else {
+                    fSpentInfo = GetSpentIndex(spentKey, spentInfo);
+                }
+
+                if (fSpentInfo) {
                     if (spentInfo.addressType == AddressType::PUBKEY) {
                         delta.pushKV("address", CBitcoinAddress(CKeyID(spentInfo.addressHash)).ToString());
                     } else if (spentInfo.addressType == AddressType::SCRIPT)  {
@@ -274,13 +305,13 @@ UniValue blockToJSON(const CBlock& block, const CBlockIndex* blockindex, bool tx
         {
             UniValue objTx(UniValue::VOBJ);
             TxToJSON(tx, uint256(), objTx);
-            txs.push_back(objTx);
+            txs.push_back(std::move(objTx));
         }
         else
             txs.push_back(tx.GetHash().GetHex());
     }
 
-    result.pushKV("tx", txs);
+    result.pushKV("tx", std::move(txs));
     if (block.nVersion == BLOCK_VERSION_SC_SUPPORT)
     {
         UniValue certs(UniValue::VARR);
@@ -290,14 +321,14 @@ UniValue blockToJSON(const CBlock& block, const CBlockIndex* blockindex, bool tx
             {
                 UniValue objCert(UniValue::VOBJ);
                 CertToJSON(cert, uint256(), objCert);
-                certs.push_back(objCert);
+                certs.push_back(std::move(objCert));
             }
             else
             {
                 certs.push_back(cert.GetHash().GetHex());
             }
         }
-        result.pushKV("cert", certs);
+        result.pushKV("cert", std::move(certs));
     }
 
     result.pushKV("time", block.GetBlockTime());
@@ -321,6 +352,56 @@ UniValue blockToJSON(const CBlock& block, const CBlockIndex* blockindex, bool tx
     return result;
 }
 
+/**
+ * Append to strJSON the same text as blockToJSON(block, blockindex, txDetails).write(), without building
+ * the whole document: with txDetails, each tx and cert is converted and written out on its own.
+ */
+void blockToJSONStream(const CBlock& block, const CBlockIndex* blockindex, bool txDetails, std::string& strJSON)
+{
+    // the block fields with only tx and cert hashes are cheap, the detailed entries are the bulk of the document
+    const UniValue header = blockToJSON(block, blockindex, false);
+    const std::vector<std::string>& keys = header.getKeys();
+    const std::vector<UniValue>& values = header.getValues();
+
+    strJSON += "{";
+    for (size_t i = 0; i < keys.size(); i++)
+    {
+        if (i > 0)
+            strJSON += ",";
+        strJSON += "\"" + keys[i] + "\":";
+
+        if (txDetails && keys[i] == "tx")
+        {
+            strJSON += "[";
+            for (size_t j = 0; j < block.vtx.size(); j++)
+            {
+                if (j > 0)
+                    strJSON += ",";
+                UniValue objTx(UniValue::VOBJ);
+                TxToJSON(block.vtx[j], uint256(), objTx);
+                strJSON += objTx.write();
+            }
+            strJSON += "]";
+        }
+        else if (txDetails && keys[i] == "cert")
+        {
+            strJSON += "[";
+            for (size_t j = 0; j < block.vcert.size(); j++)
+            {
+                if (j > 0)
+                    strJSON += ",";
+                UniValue objCert(UniValue::VOBJ);
+                CertToJSON(block.vcert[j], uint256(), objCert);
+                strJSON += objCert.write();
+            }
+            strJSON += "]";
+        }
+        else
+            strJSON += values[i].write();
+    }
+    strJSON += "}";
+}
+
 UniValue getblockcount(const UniValue& params, bool fHelp)
 {
     if (fHelp || params.size() != 0)
@@ -336,8 +417,8 @@ UniValue getblockcount(const UniValue& params, bool fHelp)
             + HelpExampleRpc("getblockcount", "")
         );
 
-    LOCK(cs_main);
-    return chainActive.Height();
+    const CBlockIndex* tip = GetPublishedChainTip();
+    return tip ? tip->nHeight : -1;
 }
 
 UniValue getbestblockhash(const UniValue& params, bool fHelp)
@@ -355,8 +436,7 @@ UniValue getbestblockhash(const UniValue& params, bool fHelp)
             + HelpExampleRpc("getbestblockhash", "")
         );
 
-    LOCK(cs_main);
-    return chainActive.Tip()->GetBlockHash().GetHex();
+    return GetPublishedChainTip()->GetBlockHash().GetHex();
 }
 
 UniValue getdifficulty(const UniValue& params, bool fHelp)
@@ -378,69 +458,64 @@ UniValue getdifficulty(const UniValue& params, bool fHelp)
     return GetNetworkDifficulty();
 }
 
-static void AddDependancy(const CTransactionBase& root, UniValue& info)
+static UniValue MempoolEntryToJSON(const CMemPoolEntryInfo& entry)
 {
-    std::vector<uint256> sDepHash = mempool->mempoolDirectDependenciesFrom(root);
-    UniValue depends(UniValue::VARR);
-    for(const uint256& hash: sDepHash)
+    UniValue info(UniValue::VOBJ);
+    if (entry.fInMempool)
+    {
+        info.pushKV("size", entry.nSize);
+        info.pushKV("fee", ValueFromAmount(entry.nFee));
+        info.pushKV("time", entry.nTime);
+        info.pushKV("height", entry.nHeight);
+        info.pushKV("startingpriority", entry.dStartingPriority);
+        info.pushKV("currentpriority", entry.dCurrentPriority);
+        info.pushKV("isCert", entry.fCert);
+        info.pushKV("version", entry.nVersion);
+        UniValue depends(UniValue::VARR);
+        for (const uint256& hash : entry.vDepends)
+            depends.push_back(hash.ToString());
+        info.pushKV("depends", depends);
+        if (entry.fPackage)
+        {
+            info.pushKV("descendantcount", entry.nCountWithDescendants);
+            info.pushKV("descendantsize", entry.nSizeWithDescendants);
+            info.pushKV("descendantfees", ValueFromAmount(entry.nFeesWithDescendants));
+            info.pushKV("ancestorcount", entry.nCountWithAncestors);
+            info.pushKV("ancestorsize", entry.nSizeWithAncestors);
+            info.pushKV("ancestorfees", ValueFromAmount(entry.nFeesWithAncestors));
+        }
+    }
+    if (entry.fDelta)
     {
-        depends.push_back(hash.ToString());
+        info.pushKV("fee_delta", ValueFromAmount(entry.nFeeDelta));
+        info.pushKV("priority_delta", entry.dPriorityDelta);
     }
-
-    info.pushKV("depends", depends);
+    return info;
 }
 
 UniValue mempoolToJSON(bool fVerbose = false)
 {
     if (fVerbose)
     {
-        LOCK(mempool->cs);
-        UniValue o(UniValue::VOBJ);
-        BOOST_FOREACH(const PAIRTYPE(uint256, CTxMemPoolEntry)& entry, mempool->mapTx)
+        int nChainHeight;
         {
-            const uint256& hash = entry.first;
-            const CTxMemPoolEntry& e = entry.second;
-            UniValue info(UniValue::VOBJ);
-            info.pushKV("size", (int)e.GetTxSize());
-            info.pushKV("fee", ValueFromAmount(e.GetFee()));
-            info.pushKV("time", e.GetTime());
-            info.pushKV("height", (int)e.GetHeight());
-            info.pushKV("startingpriority", e.GetPriority(e.GetHeight()));
-            info.pushKV("currentpriority", e.GetPriority(chainActive.Height()));
-            info.pushKV("isCert", false);
-            const CTransaction& tx = e.GetTx();
-            info.pushKV("version", tx.nVersion);
-            AddDependancy(tx, info);
-            o.pushKV(hash.ToString(), info);
+            LOCK(cs_main);
+            nChainHeight = chainActive.Height();
         }
-        BOOST_FOREACH(const PAIRTYPE(uint256, CCertificateMemPoolEntry)& entry, mempool->mapCertificate)
+
+        // the entries are copied under the lock, with the dependencies kept by the package links, and
+        // the reply is built once it is released
+        std::vector<CMemPoolEntryInfo> vEntries;
         {
-            const uint256& hash = entry.first;
-            const auto& e = entry.second;
-            UniValue info(UniValue::VOBJ);
-            info.pushKV("size", (int)e.GetCertificateSize());
-            info.pushKV("fee", ValueFromAmount(e.GetFee()));
-            info.pushKV("time", e.GetTime());
-            info.pushKV("height", (int)e.GetHeight());
-            info.pushKV("startingpriority", e.GetPriority(e.GetHeight()));
-            info.pushKV("currentpriority", e.GetPriority(chainActive.Height()));
-            info.pushKV("isCert", true);
-            const CScCertificate& cert = e.GetCertificate();
-            info.pushKV("version", cert.nVersion);
-            AddDependancy(cert, info);
-            o.pushKV(hash.ToString(), info);
+            LOCK(mempool->cs);
+            mempool->getEntryInfos(nChainHeight, 0, /*fDeltasOnly*/true, vEntries);
         }
-        BOOST_FOREACH(const auto& entry, mempool->mapDeltas)
+
+        UniValue o(UniValue::VOBJ);
+        for (const CMemPoolEntryInfo& entry : vEntries)
         {
-            const uint256& hash = entry.first;
-            const auto& p = entry.second.first;
-            const auto& f = entry.second.second;
-            UniValue info(UniValue::VOBJ);
-            if (o.exists(hash.ToString()))
-                info = o[hash.ToString()];
-            info.pushKV("fee_delta", ValueFromAmount(f));
-            info.pushKV("priority_delta", p);
-            o.pushKV(hash.ToString(), info);
+            // the mempool hashes are unique, no need to look the key up in the entries so far
+            o._pushKV(entry.hash.ToString(), MempoolEntryToJSON(entry));
         }
         return o;
     }
@@ -484,6 +559,12 @@ UniValue getrawmempool(const UniValue& params, bool fHelp)
             "    \"depends\": [            (array) unconfirmed transactions used as inputs for this transaction\n"
             "        \"transactionid\",    (string) parent transaction id\n"
             "       ... ]\n"
+            "    \"descendantcount\": n,   (numeric) number of in-mempool descendant transactions (including this one)\n"
+            "    \"descendantsize\": n,    (numeric) size of in-mempool descendants (including this one)\n"
+            "    \"descendantfees\": n,    (numeric) fees of in-mempool descendants (including this one) in " + CURRENCY_UNIT + "\n"
+            "    \"ancestorcount\": n,     (numeric) number of in-mempool ancestor transactions (including this one)\n"
+            "    \"ancestorsize\": n,      (numeric) size of in-mempool ancestors (including this one)\n"
+            "    \"ancestorfees\": n,      (numeric) fees of in-mempool ancestors (including this one) in " + CURRENCY_UNIT + "\n"
             "  }, ...\n"
             "}\n"
             
@@ -492,8 +573,6 @@ UniValue getrawmempool(const UniValue& params, bool fHelp)
             + HelpExampleRpc("getrawmempool", "true")
         );
 
-    LOCK(cs_main);
-
     bool fVerbose = false;
     if (params.size() > 0)
         fVerbose = params[0].get_bool();
@@ -501,6 +580,78 @@ UniValue getrawmempool(const UniValue& params, bool fHelp)
     return mempoolToJSON(fVerbose);
 }
 
+bool mempoolDeltaToJSON(uint64_t nSince, UniValue& result)
+{
+    std::vector<CMemPoolEvent> vEvents;
+    uint64_t nSequence;
+    {
+        LOCK(mempool->cs);
+        nSequence = mempool->GetSequence();
+        if (!mempool->GetEventsSince(nSince, vEvents))
+            return false;
+    }
+
+    result = UniValue(UniValue::VOBJ);
+    result.pushKV("sequence", nSequence);
+    UniValue events(UniValue::VARR);
+    for (const CMemPoolEvent& event : vEvents)
+    {
+        UniValue entry(UniValue::VOBJ);
+        entry.pushKV("sequence", event.nSequence);
+        const bool fAdded = (event.type == CMemPoolEvent::Type::ADDED);
+        entry.pushKV("event", fAdded ? "added" : "removed");
+        entry.pushKV("hash", event.hash.GetHex());
+        entry.pushKV("isCert", event.fCertificate);
+        if (!fAdded)
+            entry.pushKV("reason", MemPoolRemovalReasonToString(event.reason));
+        events.push_back(std::move(entry));
+    }
+    result.pushKV("events", std::move(events));
+    return true;
+}
+
+UniValue getmempooldelta(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 1)
+        throw runtime_error(
+            "getmempooldelta sequence\n"
+            "\nReturns the transactions and certificates added to and removed from the memory pool since a sequence number.\n"
+            "Start from the sequence of getmempoolinfo, then the contents of getrawmempool with these events replayed in order\n"
+            "give the memory pool as it is now. An entry may be given as removed while it was not in the contents read, skip it.\n"
+            
+            "\nArguments:\n"
+            "1. sequence                  (numeric, required) the sequence of getmempoolinfo, or of a previous call\n"
+            
+            "\nResult:\n"
+            "{\n"
+            "  \"sequence\": n,                (numeric) the current sequence, to pass to the next call\n"
+            "  \"events\": [                   (array) the events, oldest first\n"
+            "    {\n"
+            "      \"sequence\": n,            (numeric) the sequence of the mempool at the event\n"
+            "      \"event\": \"added|removed\",  (string) the kind of the event\n"
+            "      \"hash\": \"hash\",           (string) the transaction or certificate hash\n"
+            "      \"isCert\": true|false,     (boolean) whether it is a certificate\n"
+            "      \"reason\": \"reason\"        (string, removed only) block, conflict, stale, sizelimit, replaced, reorg or unknown\n"
+            "    }, ...\n"
+            "  ]\n"
+            "}\n"
+            
+            "\nExamples:\n"
+            + HelpExampleCli("getmempooldelta", "42")
+            + HelpExampleRpc("getmempooldelta", "42")
+        );
+
+    const int64_t nSince = params[0].get_int64();
+    if (nSince < 0)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid sequence");
+
+    UniValue result;
+    if (!mempoolDeltaToJSON(nSince, result))
+        throw JSONRPCError(RPC_INVALID_PARAMETER, strprintf("The changes since sequence %d are not available any more, "
+            "read getmempoolinfo and getrawmempool again", nSince));
+    return result;
+}
+
 UniValue getblockdeltas(const UniValue& params, bool fHelp)
 {
     if (fHelp || params.size() != 1)
@@ -595,9 +746,6 @@ UniValue getblockhashes(const UniValue& params, bool fHelp)
 
     std::vector<std::pair<uint256, unsigned int> > blockHashes;
 
-    if (fActiveOnly)
-        LOCK(cs_main);
-
     if (!GetTimestampIndex(high, low, fActiveOnly, blockHashes)) {
         throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for block hashes");
     }
@@ -636,13 +784,13 @@ UniValue getblockhash(const UniValue& params, bool fHelp)
             + HelpExampleRpc("getblockhash", "1000")
         );
 
-    LOCK(cs_main);
+    const CBlockIndex* tip = GetPublishedChainTip();
 
     int nHeight = params[0].get_int();
-    if (nHeight < 0 || nHeight > chainActive.Height())
+    if (tip == NULL || nHeight < 0 || nHeight > tip->nHeight)
         throw JSONRPCError(RPC_INVALID_PARAMETER, "Block height out of range");
 
-    CBlockIndex* pblockindex = chainActive[nHeight];
+    const CBlockIndex* pblockindex = tip->GetAncestor(nHeight);
     return pblockindex->GetBlockHash().GetHex();
 }
 
@@ -681,8 +829,6 @@ UniValue getblockheader(const UniValue& params, bool fHelp)
             + HelpExampleRpc("getblockheader", "\"00000000c937983704a73af28acdec37b049d214adbda81d7e2a3dd146f6ed09\"")
         );
 
-    LOCK(cs_main);
-
     std::string strHash = params[0].get_str();
     uint256 hash(uint256S(strHash));
 
@@ -690,11 +836,12 @@ UniValue getblockheader(const UniValue& params, bool fHelp)
     if (params.size() > 1)
         fVerbose = params[1].get_bool();
 
-    if (mapBlockIndex.count(hash) == 0)
+    // answered from the published chain, without waiting for cs_main
+    const CBlockIndex* tip = GetPublishedChainTip();
+    const CBlockIndex* pblockindex = LookupBlockIndex(hash);
+    if (pblockindex == NULL)
         throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
 
-    CBlockIndex* pblockindex = mapBlockIndex[hash];
-
     if (!fVerbose)
     {
         CDataStream ssBlock(SER_NETWORK, PROTOCOL_VERSION);
@@ -703,7 +850,57 @@ UniValue getblockheader(const UniValue& params, bool fHelp)
         return strHex;
     }
 
-    return blockheaderToJSON(pblockindex);
+    return blockheaderToJSON(pblockindex, tip);
+}
+
+UniValue getblockfilter(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() < 1 || params.size() > 2)
+        throw runtime_error(
+            "getblockfilter \"blockhash\" ( \"filtertype\" )\n"
+            "\nReturns the compact filter of a block, it requires -blockfilterindex.\n"
+
+            "\nArguments:\n"
+            "1. \"blockhash\"                     (string, required) the hash of the block\n"
+            "2. \"filtertype\"                    (string, optional, default=\"basic\") the name of the filter type\n"
+
+            "\nResult:\n"
+            "{\n"
+            "  \"filter\": \"hex\",                 (string) the hex-encoded filter data\n"
+            "  \"header\": \"hex\"                  (string) the hex-encoded filter header\n"
+            "}\n"
+
+            "\nExamples:\n"
+            + HelpExampleCli("getblockfilter", "\"00000000c937983704a73af28acdec37b049d214adbda81d7e2a3dd146f6ed09\" \"basic\"")
+            + HelpExampleRpc("getblockfilter", "\"00000000c937983704a73af28acdec37b049d214adbda81d7e2a3dd146f6ed09\", \"basic\"")
+        );
+
+    uint256 hash(uint256S(params[0].get_str()));
+
+    BlockFilterType filterType = BlockFilterType::BASIC;
+    if (params.size() > 1 && !BlockFilterTypeByName(params[1].get_str(), filterType))
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Unknown filtertype");
+    if (pblockfilterindex == NULL || pblockfilterindex->GetFilterType() != filterType)
+        throw JSONRPCError(RPC_MISC_ERROR, "Index is not enabled for filtertype " + BlockFilterTypeName(filterType));
+
+    const CBlockIndex* pblockindex = LookupBlockIndex(hash);
+    if (pblockindex == NULL)
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
+
+    CBlockFilter filter;
+    uint256 header;
+    if (!pblockfilterindex->LookupFilter(pblockindex, filter) || !pblockfilterindex->LookupFilterHeader(pblockindex, header))
+    {
+        std::string strError = "Filter not found.";
+        if (!pblockfilterindex->IsSynced())
+            strError += " Block filters are still in the process of being indexed.";
+        throw JSONRPCError(RPC_MISC_ERROR, strError);
+    }
+
+    UniValue ret(UniValue::VOBJ);
+    ret.pushKV("filter", HexStr(filter.GetEncodedFilter()));
+    ret.pushKV("header", header.GetHex());
+    return ret;
 }
 
 UniValue getblock(const UniValue& params, bool fHelp)
@@ -813,24 +1010,26 @@ UniValue getblock(const UniValue& params, bool fHelp)
     if (mapBlockIndex.count(hash) == 0)
         throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
 
-    CBlock block;
     CBlockIndex* pblockindex = mapBlockIndex[hash];
 
     if (fHavePruned && !(pblockindex->nStatus & BLOCK_HAVE_DATA) && pblockindex->nTx > 0)
         throw JSONRPCError(RPC_INTERNAL_ERROR, "Block not available (pruned data)");
 
-    if(!ReadBlockFromDisk(block, pblockindex))
-        throw JSONRPCError(RPC_INTERNAL_ERROR, "Can't read block from disk");
-
     if (verbosity == 0)
     {
-        CDataStream ssBlock(SER_NETWORK, PROTOCOL_VERSION);
-        ssBlock << block;
-        std::string strHex = HexStr(ssBlock.begin(), ssBlock.end());
+        // the payload of the block message shared with the peers
+        std::shared_ptr<const CSerializeData> msg = ReadBlockMessageCached(pblockindex, PROTOCOL_VERSION);
+        if (!msg)
+            throw JSONRPCError(RPC_INTERNAL_ERROR, "Can't read block from disk");
+        std::string strHex = HexStr(msg->begin() + CMessageHeader::HEADER_SIZE, msg->end());
         return strHex;
     }
 
-    return blockToJSON(block, pblockindex, verbosity >= 2);
+    std::shared_ptr<const CBlock> block = ReadBlockFromDiskCached(pblockindex);
+    if (!block)
+        throw JSONRPCError(RPC_INTERNAL_ERROR, "Can't read block from disk");
+
+    return blockToJSON(*block, pblockindex, verbosity >= 2);
 }
 
 UniValue getblockexpanded(const UniValue& params, bool fHelp)
@@ -957,14 +1156,15 @@ UniValue getblockexpanded(const UniValue& params, bool fHelp)
     if (mapBlockIndex.count(hash) == 0)
         throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
 
-    CBlock block;
     CBlockIndex* pblockindex = mapBlockIndex[hash];
 
     if (fHavePruned && !(pblockindex->nStatus & BLOCK_HAVE_DATA) && pblockindex->nTx > 0)
         throw JSONRPCError(RPC_INTERNAL_ERROR, "Block not available (pruned data)");
 
-    if(!ReadBlockFromDisk(block, pblockindex))
+    std::shared_ptr<const CBlock> pblock = ReadBlockFromDiskCached(pblockindex);
+    if (!pblock)
         throw JSONRPCError(RPC_INTERNAL_ERROR, "Can't read block from disk");
+    const CBlock& block = *pblock;
 
     UniValue blockJSON = blockToJSON(block, pblockindex, verbosity >= 2);
     
@@ -1009,12 +1209,19 @@ UniValue getblockexpanded(const UniValue& params, bool fHelp)
 
 UniValue gettxoutsetinfo(const UniValue& params, bool fHelp)
 {
-    if (fHelp || params.size() != 0)
+    if (fHelp || params.size() > 2)
         throw runtime_error(
-            "gettxoutsetinfo\n"
+            "gettxoutsetinfo ( \"hash_type\" rescan )\n"
             "\nReturns statistics about the unspent transaction output set.\n"
-            "Note this call may take some time.\n"
-            
+            "Note this call may take some time, unless hash_type is muhash.\n"
+
+            "\nArguments:\n"
+            "1. \"hash_type\"      (string, optional, default=serialized) which UTXO set hash to return:\n"
+            "                      serialized hashes the whole set in db order, muhash returns the rolling hash\n"
+            "                      of the set, which is kept up to date as blocks are connected and disconnected\n"
+            "2. rescan           (boolean, optional, default=false) with muhash, compute the statistics again\n"
+            "                      from the whole set, in parallel, instead of returning the rolling ones\n"
+
             "\nResult:\n"
             "{\n"
             "  \"height\":n,                    (numeric) the current block height (index)\n"
@@ -1022,17 +1229,61 @@ UniValue gettxoutsetinfo(const UniValue& params, bool fHelp)
             "  \"transactions\": n,             (numeric) the number of transactions\n"
             "  \"txouts\": n,                   (numeric) the number of output transactions\n"
             "  \"bytes_serialized\": n,         (numeric) the serialized size\n"
-            "  \"hash_serialized\": \"hash\",   (string) the serialized hash\n"
+            "  \"hash_serialized\": \"hash\",   (string) the serialized hash (only with hash_type serialized)\n"
+            "  \"muhash\": \"hash\",            (string) the rolling hash of the set (only with hash_type muhash)\n"
             "  \"total_amount\": xxxx           (numeric) the total amount\n"
             "}\n"
-            
+
             "\nExamples:\n"
             + HelpExampleCli("gettxoutsetinfo", "")
-            + HelpExampleRpc("gettxoutsetinfo", "")
+            + HelpExampleCli("gettxoutsetinfo", "\"muhash\"")
+            + HelpExampleCli("gettxoutsetinfo", "\"muhash\" true")
+            + HelpExampleRpc("gettxoutsetinfo", "\"muhash\"")
         );
 
     UniValue ret(UniValue::VOBJ);
 
+    const std::string strHashType = params.size() > 0 ? params[0].get_str() : "serialized";
+    if (strHashType == "muhash") {
+        const bool fRescan = params.size() > 1 && params[1].get_bool();
+        CCoinsViewDB* coinsdb = pcoinsFlusher->GetDB();
+        {
+            LOCK(cs_main);
+            FlushStateToDisk();
+            if (!pcoinsFlusher->Sync())
+                throw JSONRPCError(RPC_DATABASE_ERROR, "Failed to write the coins database");
+        }
+
+        CCoinsSetStats setStats;
+        if (fRescan) {
+            if (!coinsdb->ComputeSetStats(setStats, std::max(1, nScriptCheckThreads)))
+                throw JSONRPCError(RPC_DATABASE_ERROR, "Failed to read the coins database");
+        } else if (!coinsdb->GetSetStats(setStats)) {
+            throw JSONRPCError(RPC_DATABASE_ERROR, "UTXO set statistics are not available");
+        }
+
+        int nHeight = -1;
+        {
+            LOCK(cs_main);
+            BlockMap::const_iterator mi = mapBlockIndex.find(setStats.hashBlock);
+            if (mi != mapBlockIndex.end())
+                nHeight = mi->second->nHeight;
+        }
+        uint256 hashMuHash;
+        setStats.muhash.Finalize(hashMuHash.begin());
+
+        ret.pushKV("height", (int64_t)nHeight);
+        ret.pushKV("bestblock", setStats.hashBlock.GetHex());
+        ret.pushKV("transactions", (int64_t)setStats.nTransactions);
+        ret.pushKV("txouts", (int64_t)setStats.nTransactionOutputs);
+        ret.pushKV("bytes_serialized", (int64_t)setStats.nSerializedSize);
+        ret.pushKV("muhash", hashMuHash.GetHex());
+        ret.pushKV("total_amount", ValueFromAmount(setStats.nTotalAmount));
+        return ret;
+    }
+    if (strHashType != "serialized")
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Unknown hash_type " + strHashType);
+
     CCoinsStats stats;
     FlushStateToDisk();
     if (pcoinsTip->GetStats(stats)) {
@@ -1047,6 +1298,223 @@ UniValue gettxoutsetinfo(const UniValue& params, bool fHelp)
     return ret;
 }
 
+UniValue dumptxoutset(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 1)
+        throw runtime_error(
+            "dumptxoutset \"path\"\n"
+            "\nWrites a snapshot of the unspent transaction output set at the current tip to a file, which a new node\n"
+            "can import on startup with -loadtxoutset.\n"
+            "Note this call may take some time.\n"
+
+            "\nArguments:\n"
+            "1. \"path\"                      (string, required) the file to write, relative to the data directory if not absolute. It must not exist\n"
+
+            "\nResult:\n"
+            "{\n"
+            "  \"path\": \"path\",             (string) the absolute path of the snapshot\n"
+            "  \"snapshot_hash\": \"hash\",     (string) the hash of the snapshot, to be passed to -loadtxoutsethash\n"
+            "  \"base_height\": n,             (numeric) the height of the snapshot base block\n"
+            "  \"base_hash\": \"hex\",          (string) the hash of the snapshot base block\n"
+            "  \"transactions\": n,            (numeric) the number of transactions\n"
+            "  \"txouts\": n,                  (numeric) the number of output transactions\n"
+            "  \"hash_serialized\": \"hash\",   (string) the serialized hash, as returned by gettxoutsetinfo\n"
+            "  \"total_amount\": xxxx,         (numeric) the total amount\n"
+            "  \"bytes\": n                    (numeric) the size of the snapshot file\n"
+            "}\n"
+
+            "\nExamples:\n"
+            + HelpExampleCli("dumptxoutset", "\"utxo.dat\"")
+            + HelpExampleRpc("dumptxoutset", "\"utxo.dat\"")
+        );
+
+    boost::filesystem::path path(params[0].get_str());
+    if (!path.is_absolute())
+        path = GetDataDir() / path;
+    if (boost::filesystem::exists(path))
+        throw JSONRPCError(RPC_INVALID_PARAMETER, path.string() + " already exists");
+
+    CTxOutSetSnapshotInfo info;
+    std::string strError;
+    if (!DumpTxOutSetSnapshot(path, info, strError))
+        throw JSONRPCError(RPC_MISC_ERROR, strError);
+
+    UniValue ret(UniValue::VOBJ);
+    ret.pushKV("path", path.string());
+    ret.pushKV("snapshot_hash", info.hashSnapshot.GetHex());
+    ret.pushKV("base_height", info.header.nHeight);
+    ret.pushKV("base_hash", info.header.hashBlock.GetHex());
+    ret.pushKV("transactions", (int64_t)info.trailer.nTransactions);
+    ret.pushKV("txouts", (int64_t)info.trailer.nTransactionOutputs);
+    ret.pushKV("hash_serialized", info.trailer.hashSerialized.GetHex());
+    ret.pushKV("total_amount", ValueFromAmount(info.trailer.nTotalAmount));
+    ret.pushKV("bytes", (int64_t)info.nBytes);
+    return ret;
+}
+
+UniValue dumpchaindata(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() < 1 || params.size() > 4)
+        throw runtime_error(
+            "dumpchaindata \"dir\" ( fromheight toheight compressionlevel )\n"
+            "\nExports the blocks of the active chain from the block and undo files as column files for analytics, one per\n"
+            "table and chunk of " + std::to_string(CHAIN_DATA_CHUNK_BLOCKS) + " heights, in a directory per table: blocks, transactions, certificates, inputs,\n"
+            "outputs, backward_transfers, sc_creations, forward_transfers, bwt_requests, csw_inputs and sc_events.\n"
+            "An export is extended by exporting the following heights to the same directory; the files of the chunks\n"
+            "exported again are replaced.\n"
+            "Note this call may take some time.\n"
+
+            "\nArguments:\n"
+            "1. \"dir\"                       (string, required) the directory to write, relative to the data directory if not absolute\n"
+            "2. fromheight                  (numeric, optional, default=0) the first height to export\n"
+            "3. toheight                    (numeric, optional, default=-1) the last height to export, -1 for the tip\n"
+            "4. compressionlevel            (numeric, optional, default=" + std::to_string(DEFAULT_CHAIN_DATA_COMPRESSION_LEVEL) + ") the zstd level of the columns, 0 not to compress\n"
+
+            "\nResult:\n"
+            "{\n"
+            "  \"dir\": \"dir\",               (string) the absolute path of the directory\n"
+            "  \"from_height\": n,             (numeric) the first height exported\n"
+            "  \"to_height\": n,               (numeric) the last height exported\n"
+            "  \"transactions\": n,            (numeric) the number of transactions exported\n"
+            "  \"certificates\": n,            (numeric) the number of certificates exported\n"
+            "  \"files\": n,                   (numeric) the number of files written\n"
+            "  \"bytes\": n                    (numeric) the size of the files written\n"
+            "}\n"
+
+            "\nExamples:\n"
+            + HelpExampleCli("dumpchaindata", "\"chaindata\"")
+            + HelpExampleCli("dumpchaindata", "\"chaindata\" 100000 -1 0")
+            + HelpExampleRpc("dumpchaindata", "\"chaindata\", 100000")
+        );
+
+    boost::filesystem::path dir(params[0].get_str());
+    if (!dir.is_absolute())
+        dir = GetDataDir() / dir;
+    const int nFromHeight = params.size() > 1 ? params[1].get_int() : 0;
+    const int nToHeight = params.size() > 2 ? params[2].get_int() : -1;
+    const int nCompressionLevel = params.size() > 3 ? params[3].get_int() : DEFAULT_CHAIN_DATA_COMPRESSION_LEVEL;
+    if (nFromHeight < 0)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid fromheight");
+    if (nToHeight < -1)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid toheight");
+    if (nCompressionLevel < 0 || nCompressionLevel > 22)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "compressionlevel must be between 0 and 22");
+
+    CChainDataExportInfo info;
+    std::string strError;
+    if (!ExportChainData(dir, nFromHeight, nToHeight, std::max(1, nScriptCheckThreads), nCompressionLevel, info, strError))
+        throw JSONRPCError(RPC_MISC_ERROR, strError);
+
+    UniValue ret(UniValue::VOBJ);
+    ret.pushKV("dir", dir.string());
+    ret.pushKV("from_height", info.nFromHeight);
+    ret.pushKV("to_height", info.nToHeight);
+    ret.pushKV("transactions", (int64_t)info.nTransactions);
+    ret.pushKV("certificates", (int64_t)info.nCertificates);
+    ret.pushKV("files", (int64_t)info.nFiles);
+    ret.pushKV("bytes", (int64_t)info.nBytes);
+    return ret;
+}
+
+static UniValue DBStatsToJSON(const CLevelDBWrapper& db)
+{
+    const CLevelDBOptions& dbOptions = db.GetDBOptions();
+    UniValue options(UniValue::VOBJ);
+    options.pushKV("block_cache", (uint64_t)dbOptions.nBlockCacheSize);
+    options.pushKV("write_buffer", (uint64_t)dbOptions.nWriteBufferSize);
+    options.pushKV("max_open_files", dbOptions.nMaxOpenFiles);
+    options.pushKV("compression", dbOptions.fCompression);
+    options.pushKV("bloom_bits", dbOptions.nBloomBits);
+    options.pushKV("block_size", (uint64_t)dbOptions.nBlockSize);
+
+    CLevelDBStats stats;
+    db.GetDBStats(stats);
+    UniValue levels(UniValue::VARR);
+    double dSizeMiB = 0, dCompactionSeconds = 0;
+    for (const CLevelDBLevelStats& level : stats.vLevels) {
+        UniValue entry(UniValue::VOBJ);
+        entry.pushKV("level", level.nLevel);
+        entry.pushKV("files", level.nFiles);
+        entry.pushKV("size_mib", level.dSizeMiB);
+        entry.pushKV("compaction_time", level.dCompactionSeconds);
+        entry.pushKV("compaction_read_mib", level.dCompactionReadMiB);
+        entry.pushKV("compaction_write_mib", level.dCompactionWriteMiB);
+        levels.push_back(entry);
+        dSizeMiB += level.dSizeMiB;
+        dCompactionSeconds += level.dCompactionSeconds;
+    }
+
+    UniValue ret(UniValue::VOBJ);
+    ret.pushKV("options", options);
+    ret.pushKV("size_mib", dSizeMiB);
+    ret.pushKV("compaction_time", dCompactionSeconds);
+    ret.pushKV("cache_hits", stats.nCacheHits);
+    ret.pushKV("cache_misses", stats.nCacheMisses);
+    const uint64_t nLookups = stats.nCacheHits + stats.nCacheMisses;
+    ret.pushKV("cache_hit_rate", nLookups ? (double)stats.nCacheHits / nLookups : 0.0);
+    ret.pushKV("levels", levels);
+    return ret;
+}
+
+UniValue getdbstats(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 0)
+        throw runtime_error(
+            "getdbstats\n"
+            "\nReturns the tuning and the internal statistics of the leveldb databases of the node.\n"
+            "Their options are set with -<db>blockcache, -<db>writebuffer, -<db>compression, -<db>bloombits\n"
+            "and -<db>blocksize, where <db> is coinsviewdb or blocktreedb.\n"
+
+            "\nResult:\n"
+            "{\n"
+            "  \"chainstate\": {             (json object) the coins database\n"
+            "    \"options\": {              (json object) the options the database was opened with\n"
+            "      \"block_cache\": n,       (numeric) size of the block cache, in bytes\n"
+            "      \"write_buffer\": n,      (numeric) size of a write buffer, in bytes\n"
+            "      \"max_open_files\": n,    (numeric) maximum number of open table files\n"
+            "      \"compression\": true|false, (boolean) whether the table blocks are compressed, if leveldb supports it\n"
+            "      \"bloom_bits\": n,        (numeric) bits per key of the table bloom filters\n"
+            "      \"block_size\": n         (numeric) size of the table blocks, in bytes\n"
+            "    },\n"
+            "    \"size_mib\": x.xxx,        (numeric) total size of the tables\n"
+            "    \"compaction_time\": x.xxx, (numeric) seconds spent compacting since startup\n"
+            "    \"cache_hits\": n,          (numeric) block cache lookups which found the block\n"
+            "    \"cache_misses\": n,        (numeric) block cache lookups which read the block from disk\n"
+            "    \"cache_hit_rate\": x.xxx,  (numeric) share of the lookups which hit the block cache\n"
+            "    \"levels\": [               (json array) the non empty levels\n"
+            "      {\n"
+            "        \"level\": n,           (numeric) the level\n"
+            "        \"files\": n,           (numeric) number of table files\n"
+            "        \"size_mib\": x.xxx,    (numeric) size of the tables\n"
+            "        \"compaction_time\": x.xxx, (numeric) seconds spent compacting into this level\n"
+            "        \"compaction_read_mib\": x.xxx,  (numeric) data read by these compactions\n"
+            "        \"compaction_write_mib\": x.xxx  (numeric) data written by these compactions\n"
+            "      }, ...\n"
+            "    ]\n"
+            "  },\n"
+            "  \"blockindex\": { ... },      (json object) the block index database, also holding the optional indexes\n"
+            "  \"indexes\": {                (json object) the writer of the optional indexes\n"
+            "    \"pending\": n,             (numeric) connected blocks whose indexes were still to be written\n"
+            "    \"bestblock\": \"hash\"       (string) the block the indexes are at, once the pending blocks are written\n"
+            "  }\n"
+            "}\n"
+
+            "\nExamples:\n"
+            + HelpExampleCli("getdbstats", "")
+            + HelpExampleRpc("getdbstats", "")
+        );
+
+    LOCK(cs_main);
+    UniValue ret(UniValue::VOBJ);
+    ret.pushKV("chainstate", DBStatsToJSON(pcoinsFlusher->GetDB()->GetLevelDB()));
+    ret.pushKV("blockindex", DBStatsToJSON(*pblocktree));
+    UniValue indexes(UniValue::VOBJ);
+    indexes.pushKV("pending", (uint64_t)pblocktree->GetIndexQueueSize());
+    indexes.pushKV("bestblock", pblocktree->ReadIndexesBestBlock().GetHex());
+    ret.pushKV("indexes", indexes);
+    return ret;
+}
+
 UniValue gettxout(const UniValue& params, bool fHelp)
 {
     if (fHelp || params.size() < 2 || params.size() > 4)
@@ -1259,7 +1727,7 @@ UniValue getblockchaininfo(const UniValue& params, bool fHelp)
     obj.pushKV("difficulty",            (double)GetNetworkDifficulty());
     obj.pushKV("verificationprogress",  Checkpoints::GuessVerificationProgress(Params().Checkpoints(), chainActive.Tip()));
     obj.pushKV("chainwork",             chainActive.Tip()->nChainWork.GetHex());
-    obj.pushKV("pruned",                fPruneMode);
+    obj.pushKV("pruned",                fPruneMode && !fPruneToArchive);
 
     ZCIncrementalMerkleTree tree;
     pcoinsTip->GetAnchorAt(pcoinsTip->GetBestAnchor(), tree);
@@ -1340,17 +1808,11 @@ UniValue getchaintips(const UniValue& params, bool fHelp)
 
     bool bShowPenaltyInfo = (params.size() >= 1)? params[0].getBool() : false;
 
-    /* Build up a list of chain tips.  We start with the list of all
-       known blocks, and successively remove blocks that appear as pprev
-       of another block. */
+    /* The blocks of the tree with no children are kept in mGlobalForkTips, as each block
+       added to the index takes the place of its parent there. */
     std::set<const CBlockIndex*, CompareBlocksByHeight> setTips;
-    for(const PAIRTYPE(const uint256, CBlockIndex*)& item: mapBlockIndex)
-        setTips.insert(item.second);
-    for(const PAIRTYPE(const uint256, CBlockIndex*)& item: mapBlockIndex) {
-        const CBlockIndex* pprev = item.second->pprev;
-        if (pprev)
-            setTips.erase(pprev);
-    }
+    for(const auto& mapPair: mGlobalForkTips)
+        setTips.insert(mapPair.first);
 
     // Always report the currently active tip.
     setTips.insert(chainActive.Tip());
@@ -1416,6 +1878,7 @@ UniValue mempoolInfoToJSON()
     ret.pushKV("usage", (int64_t) mempool->DynamicMemoryUsage());
     ret.pushKV("bytes-for-tx", (int64_t) mempool->GetTotalTxSize());
     ret.pushKV("bytes-for-cert", (int64_t) mempool->GetTotalCertificateSize());
+    ret.pushKV("sequence", mempool->GetSequence());
 
     if (Params().NetworkIDString() == "regtest") {
         ret.pushKV("fullyNotified", mempool->IsFullyNotified());
@@ -1437,6 +1900,7 @@ UniValue getmempoolinfo(const UniValue& params, bool fHelp)
             "  \"size\": xxxxx                (numeric) current tx count\n"
             "  \"bytes\": xxxxx               (numeric) sum of all tx sizes\n"
             "  \"usage\": xxxxx               (numeric) total memory usage for the mempool\n"
+            "  \"sequence\": xxxxx            (numeric) the sequence number of the mempool, to follow its changes with getmempooldelta\n"
             "}\n"
             
             "\nExamples:\n"
@@ -1792,79 +2256,76 @@ bool FillScRecordFromInfo(const uint256& scId, const CSidechain& info, CSidechai
 
 bool FillScRecord(const uint256& scId, UniValue& scRecord, bool bOnlyAlive, bool bVerbose)
 {
-    CSidechain sidechain;
+    static const CSidechain nullSidechain;
     CCoinsViewCache scView(pcoinsTip);
-    if (!scView.GetSidechain(scId, sidechain)) {
+    const CSidechain* pSidechain = scView.AccessSidechain(scId);
+    if (pSidechain == nullptr) {
         LogPrint("sc", "%s():%d - scid[%s] not yet created\n", __func__, __LINE__, scId.ToString() );
+        pSidechain = &nullSidechain;
     }
-    CSidechain::State scState = sidechain.GetState(scView);
+    CSidechain::State scState = pSidechain->GetState(scView);
 
-    return FillScRecordFromInfo(scId, sidechain, scState, scView, scRecord, bOnlyAlive, bVerbose);
+    return FillScRecordFromInfo(scId, *pSidechain, scState, scView, scRecord, bOnlyAlive, bVerbose);
 }
 
 int FillScList(UniValue& scItems, bool bOnlyAlive, bool bVerbose, int from=0, int to=-1)
 {
-    std::set<uint256> sScIds;
+    AssertLockHeld(cs_main);
+
+    // the sidechains being created by mempool transactions are listed as unconfirmed
+    std::set<uint256> unconfirmedScIds;
     {
         LOCK(mempool->cs);
-        CCoinsViewMemPool scView(pcoinsTip, *mempool);
-
-        scView.GetScIds(sScIds);
+        for (const auto& entry : mempool->mapSidechains)
+        {
+            if (!entry.second.scCreationTxHash.IsNull())
+                unconfirmedScIds.insert(entry.first);
+        }
     }
 
-    if (sScIds.size() == 0)
+    // the records are loaded only for the requested page, the directory tells the state of the others
+    const CSidechainDirectory& scDirectory = pcoinsTip->GetScDirectory();
+    const int height = pcoinsTip->GetHeight();
+    std::vector<uint256> vPage;
+    const int nScIds = scDirectory.GetPage(height, false, unconfirmedScIds, 0, 0, vPage);
+
+    if (nScIds == 0)
         return 0;
 
     // means upper limit max
     if (to == -1)
     {
-        to = sScIds.size();
+        to = nScIds;
     }
 
     // basic check of interval parameters
     if ( from < 0 || to < 0 || from >= to)
     {
-        LogPrint("sc", "invalid interval: from[%d], to[%d] (sz=%d)\n", from, to, sScIds.size());
+        LogPrint("sc", "invalid interval: from[%d], to[%d] (sz=%d)\n", from, to, nScIds);
         throw JSONRPCError(RPC_INVALID_PARAMETER, "invalid interval");
     }
 
-    UniValue totalResult(UniValue::VARR);
-    std::set<uint256>::iterator it = sScIds.begin();
-
-    while (it != sScIds.end())
-    {
-        UniValue scRecord(UniValue::VOBJ);
-        if (FillScRecord(*it, scRecord, bOnlyAlive, bVerbose))
-            totalResult.push_back(scRecord);
-        ++it;
-    }
+    const int nTotal = scDirectory.GetPage(height, bOnlyAlive, unconfirmedScIds, from, to, vPage);
 
     // check consistency of interval in the filtered results list
     // --
     // 'from' must be in the valid interval
-    if (from > totalResult.size())
+    if (from > nTotal)
     {
-        LogPrint("sc", "invalid interval: from[%d] > sz[%d]\n", from, totalResult.size());
+        LogPrint("sc", "invalid interval: from[%d] > sz[%d]\n", from, nTotal);
         throw JSONRPCError(RPC_INVALID_PARAMETER, "invalid interval");
     }
 
     // 'to' must be a formally valid upper bound interval number (positive and greater than 'from') but it is
-    // topped anyway to the upper bound value 
-    if (to > totalResult.size())
-    {
-        to = totalResult.size();
-    }
-
-    auto vec = totalResult.getValues();
-    auto first = vec.begin() + from;
-    auto last  = vec.begin() + to;
-
-    while (first != last)
+    // topped anyway to the upper bound value, as the page is
+    for (const uint256& scId : vPage)
     {
-        scItems.push_back(*first++);
+        UniValue scRecord(UniValue::VOBJ);
+        if (FillScRecord(scId, scRecord, bOnlyAlive, bVerbose))
+            scItems.push_back(scRecord);
     }
 
-    return vec.size(); 
+    return nTotal;
 }
 
 void FillCertDataHash(const uint256& scid, UniValue& ret)
@@ -1975,6 +2436,8 @@ UniValue getscinfo(const UniValue& params, bool fHelp)
             + HelpExampleCli("getscinfo", "\"*\" ")
         );
 
+    LOCK(cs_main);
+
     bool bRetrieveAllSc = false;
     string inputString = params[0].get_str();
     if (!inputString.compare("*"))
@@ -2109,64 +2572,25 @@ UniValue getceasingcumsccommtreehash(const UniValue& params, bool fHelp)
     return ret;
 }
 
-UniValue getscgenesisinfo(const UniValue& params, bool fHelp)
+//! The payloads of getscgenesisinfo, built on the first request for each sidechain and kept here and in the
+//! block tree db, as they only change if the creation block is reorged out (guarded by cs_main)
+static std::map<uint256, CScGenesisInfo> mapScGenesisInfo;
+
+static std::vector<unsigned char> BuildScGenesisInfo(const uint256& scId, CBlockIndex* pblockindex, const CCoinsViewCache& scView)
 {
-    if (fHelp || params.size() != 1)
-    {
-        throw runtime_error(
-            "getscgenesisinfo \"scid\"\n"
-            "\nReturns side chain genesis info for the given id or for all of the existing sc if the id is not given.\n"
-            "\n"
-            "\nResult:\n"
-            "\"data\"             (string) A string that is serialized, hex-encoded data.\n"
-            // TODO explain the contents
+    CBlock block;
 
-            "\nExamples\n"
-            + HelpExampleCli("getscgenesisinfo", "\"1a3e7ccbfd40c4e2304c3215f76d204e4de63c578ad835510f580d529516a874\"")
-        );
-    }
+    if (fHavePruned && !(pblockindex->nStatus & BLOCK_HAVE_DATA) && pblockindex->nTx > 0)
+        throw JSONRPCError(RPC_INTERNAL_ERROR, "Block not available (pruned data)");
 
-    // side chain id
-    string inputString = params[0].get_str();
-    if (inputString.find_first_not_of("0123456789abcdefABCDEF", 0) != std::string::npos)
-        throw JSONRPCError(RPC_TYPE_ERROR, "Invalid scid format: not an hex");
+    if(!ReadBlockFromDisk(block, pblockindex))
+        throw JSONRPCError(RPC_INTERNAL_ERROR, "Can't read block from disk");
 
-    uint256 scId;
-    scId.SetHex(inputString);
+    CDataStream ssBlock(SER_NETWORK, PROTOCOL_VERSION);
 
-    // sanity check of the side chain ID
-    CCoinsViewCache scView(pcoinsTip);
-    if (!scView.HaveSidechain(scId))
-    {
-        LogPrint("sc", "%s():%d - scid[%s] not yet created\n", __func__, __LINE__, scId.ToString() );
-        throw JSONRPCError(RPC_INVALID_PARAMETER, string("scid not yet created: ") + scId.ToString());
-    }
-
-    // find the block where it has been created
-    CSidechain info;
-    if (!scView.GetSidechain(scId, info))
-    {
-        LogPrint("sc", "cound not get info for scid[%s], probably not yet created\n", scId.ToString() );
-        throw JSONRPCError(RPC_INVALID_PARAMETER, string("scid not yet created: ") + scId.ToString());
-    }
-
-    int blockHeight = info.creationBlockHeight;
-
-    CBlock block;
-    CBlockIndex* pblockindex = chainActive[blockHeight];
-    assert(pblockindex != nullptr);
-
-    if (fHavePruned && !(pblockindex->nStatus & BLOCK_HAVE_DATA) && pblockindex->nTx > 0)
-        throw JSONRPCError(RPC_INTERNAL_ERROR, "Block not available (pruned data)");
-
-    if(!ReadBlockFromDisk(block, pblockindex))
-        throw JSONRPCError(RPC_INTERNAL_ERROR, "Can't read block from disk");
-
-    CDataStream ssBlock(SER_NETWORK, PROTOCOL_VERSION);
-
-    // ntw type
-    CBaseChainParams::Network network = NetworkIdFromCommandLine();
-    if (network >= CBaseChainParams::Network::MAX_NETWORK_TYPES)
+    // ntw type
+    CBaseChainParams::Network network = NetworkIdFromCommandLine();
+    if (network >= CBaseChainParams::Network::MAX_NETWORK_TYPES)
     {
         throw JSONRPCError(RPC_INTERNAL_ERROR, "Illegal network type " + std::to_string(network) );
     }
@@ -2232,39 +2656,85 @@ UniValue getscgenesisinfo(const UniValue& params, bool fHelp)
 
     ssBlock << vSidechainVersion;
 
-    std::string strHex = HexStr(ssBlock.begin(), ssBlock.end());
-    return strHex;
-
+    return std::vector<unsigned char>(ssBlock.begin(), ssBlock.end());
 }
 
-UniValue checkcswnullifier(const UniValue& params, bool fHelp)
+UniValue getscgenesisinfo(const UniValue& params, bool fHelp)
 {
-    if (fHelp || params.size() != 2)
+    if (fHelp || params.size() != 1)
+    {
         throw runtime_error(
-            "checkcswnullifier\n"
-            "\nArguments:\n"
-            "1. \"scid\"   (string, mandatory) scid of nullifier, \"*\" means all \n"
-            "2. nullifier (string, mandatory) Retrieve only information for nullifier\n"
-            "\nReturns True if nullifier exit in SC.\n"
+            "getscgenesisinfo \"scid\"\n"
+            "\nReturns side chain genesis info for the given id or for all of the existing sc if the id is not given.\n"
+            "\n"
             "\nResult:\n"
-            "{\n"
-            "  \"data\":            xx,      (bool) existance of nullifier\n"
-            "}\n"
+            "\"data\"             (string) A string that is serialized, hex-encoded data.\n"
+            // TODO explain the contents
 
             "\nExamples\n"
-            + HelpExampleCli("checkcswnullifier", "\"1a3e7ccbfd40c4e2304c3215f76d204e4de63c578ad835510f580d529516a874\""
-                             "\"0f580d529516a8744de63c578ad83551304c3215f76d204e1a3e7ccbfd40c4e21a3e7ccbfd40c4e2304c3215f76d204e4de63c578ad835510f580d529516a8740f580d529516a8744de63c578ad83551304c3215f76d204e1a3e7ccbfd40c4e2\"" ) 
+            + HelpExampleCli("getscgenesisinfo", "\"1a3e7ccbfd40c4e2304c3215f76d204e4de63c578ad835510f580d529516a874\"")
         );
+    }
 
+    // side chain id
     string inputString = params[0].get_str();
-
     if (inputString.find_first_not_of("0123456789abcdefABCDEF", 0) != std::string::npos)
         throw JSONRPCError(RPC_TYPE_ERROR, "Invalid scid format: not an hex");
 
     uint256 scId;
     scId.SetHex(inputString);
+
+    LOCK(cs_main);
+
+    // sanity check of the side chain ID
+    CCoinsViewCache scView(pcoinsTip);
+    if (!scView.HaveSidechain(scId))
+    {
+        LogPrint("sc", "%s():%d - scid[%s] not yet created\n", __func__, __LINE__, scId.ToString() );
+        throw JSONRPCError(RPC_INVALID_PARAMETER, string("scid not yet created: ") + scId.ToString());
+    }
+
+    // find the block where it has been created
+    CSidechain info;
+    if (!scView.GetSidechain(scId, info))
+    {
+        LogPrint("sc", "cound not get info for scid[%s], probably not yet created\n", scId.ToString() );
+        throw JSONRPCError(RPC_INVALID_PARAMETER, string("scid not yet created: ") + scId.ToString());
+    }
+
+    CBlockIndex* pblockindex = chainActive[info.creationBlockHeight];
+    assert(pblockindex != nullptr);
+
+    // a payload built for a creation block no longer in the active chain is built again
+    auto it = mapScGenesisInfo.find(scId);
+    if (it == mapScGenesisInfo.end() || it->second.creationBlockHash != pblockindex->GetBlockHash())
+    {
+        CScGenesisInfo genesisInfo;
+        if (!pblocktree->ReadScGenesisInfo(scId, genesisInfo) || genesisInfo.creationBlockHash != pblockindex->GetBlockHash())
+        {
+            genesisInfo.creationBlockHash = pblockindex->GetBlockHash();
+            genesisInfo.vData = BuildScGenesisInfo(scId, pblockindex, scView);
+            if (!pblocktree->WriteScGenesisInfo(scId, genesisInfo))
+                LogPrintf("%s():%d - failed to persist the genesis info of sc[%s]\n", __func__, __LINE__, scId.ToString());
+        }
+        it = mapScGenesisInfo.insert_or_assign(scId, std::move(genesisInfo)).first;
+    }
+
+    return HexStr(it->second.vData.begin(), it->second.vData.end());
+}
+
+/** The (scId, nullifier) pair of a CSW nullifier check, throwing on a malformed one */
+static void ParseCswNullifier(const std::string& strScId, const std::string& strNullifier, const std::string& strCommand,
+                              uint256& scId, CFieldElement& nullifier)
+{
+    string inputString = strScId;
+
+    if (inputString.find_first_not_of("0123456789abcdefABCDEF", 0) != std::string::npos)
+        throw JSONRPCError(RPC_TYPE_ERROR, "Invalid scid format: not an hex");
+
+    scId.SetHex(inputString);
     
-    inputString = params[1].get_str();
+    inputString = strNullifier;
 
     if (inputString.find_first_not_of("0123456789abcdefABCDEF", 0) != std::string::npos)
         throw JSONRPCError(RPC_TYPE_ERROR, "Invalid nullifier format: not an hex");
@@ -2273,15 +2743,39 @@ UniValue checkcswnullifier(const UniValue& params, bool fHelp)
     std::vector<unsigned char> nullifierVec;
     if (!AddScData(inputString, nullifierVec, CFieldElement::ByteSize(), CheckSizeMode::CHECK_STRICT, nullifierError))
     {
-        std::string error = "Invalid checkcswnullifier input parameter \"nullifier\": " + nullifierError;
+        std::string error = "Invalid " + strCommand + " input parameter \"nullifier\": " + nullifierError;
         throw JSONRPCError(RPC_TYPE_ERROR, error);
     }
-    CFieldElement nullifier{nullifierVec};
+    nullifier = CFieldElement{nullifierVec};
     if (!nullifier.IsValid())
     {
-        std::string error = "Invalid checkcswnullifier input parameter \"nullifier\": invalid nullifier data";
+        std::string error = "Invalid " + strCommand + " input parameter \"nullifier\": invalid nullifier data";
         throw JSONRPCError(RPC_TYPE_ERROR, error);
     }
+}
+
+UniValue checkcswnullifier(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 2)
+        throw runtime_error(
+            "checkcswnullifier\n"
+            "\nArguments:\n"
+            "1. \"scid\"   (string, mandatory) scid of nullifier, \"*\" means all \n"
+            "2. nullifier (string, mandatory) Retrieve only information for nullifier\n"
+            "\nReturns True if nullifier exit in SC.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"data\":            xx,      (bool) existance of nullifier\n"
+            "}\n"
+
+            "\nExamples\n"
+            + HelpExampleCli("checkcswnullifier", "\"1a3e7ccbfd40c4e2304c3215f76d204e4de63c578ad835510f580d529516a874\""
+                             "\"0f580d529516a8744de63c578ad83551304c3215f76d204e1a3e7ccbfd40c4e21a3e7ccbfd40c4e2304c3215f76d204e4de63c578ad835510f580d529516a8740f580d529516a8744de63c578ad83551304c3215f76d204e1a3e7ccbfd40c4e2\"" ) 
+        );
+
+    uint256 scId;
+    CFieldElement nullifier;
+    ParseCswNullifier(params[0].get_str(), params[1].get_str(), "checkcswnullifier", scId, nullifier);
 
     UniValue ret(UniValue::VOBJ);
     
@@ -2294,6 +2788,73 @@ UniValue checkcswnullifier(const UniValue& params, bool fHelp)
     return ret;
 }
 
+UniValue checkcswnullifiers(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 1)
+        throw runtime_error(
+            "checkcswnullifiers [{\"scid\":\"scid\", \"nullifier\":\"nullifier\"},...]\n"
+            "\nChecks many CSW nullifiers at once, as checkcswnullifier does one.\n"
+            "\nArguments:\n"
+            "1. \"nullifiers\"          (array, mandatory) The nullifiers to check\n"
+            "   [\n"
+            "     {\n"
+            "       \"scid\":          (string, mandatory) scid of the nullifier\n"
+            "       \"nullifier\":     (string, mandatory) the nullifier\n"
+            "     }\n"
+            "     ,...\n"
+            "   ]\n"
+            "\nResult:\n"
+            "[                         (array) in the order of the nullifiers\n"
+            "  {\n"
+            "    \"scid\":             (string) scid of the nullifier\n"
+            "    \"nullifier\":        (string) the nullifier\n"
+            "    \"data\":             (bool) existance of the nullifier\n"
+            "  }\n"
+            "  ,...\n"
+            "]\n"
+
+            "\nExamples\n"
+            + HelpExampleCli("checkcswnullifiers", "\"[{\\\"scid\\\":\\\"1a3e7ccbfd40c4e2304c3215f76d204e4de63c578ad835510f580d529516a874\\\","
+                             "\\\"nullifier\\\":\\\"0f580d529516a8744de63c578ad83551304c3215f76d204e1a3e7ccbfd40c4e21a3e7ccbfd40c4e2304c3215f76d204e4de63c578ad835510f580d529516a8740f580d529516a8744de63c578ad83551304c3215f76d204e1a3e7ccbfd40c4e2\\\"}]\"")
+        );
+
+    RPCTypeCheck(params, boost::assign::list_of(UniValue::VARR));
+    const UniValue& nullifiers = params[0].get_array();
+
+    std::vector<std::pair<uint256, CFieldElement>> keys;
+    keys.reserve(nullifiers.size());
+    for (size_t i = 0; i < nullifiers.size(); i++)
+    {
+        const UniValue& entry = nullifiers[i];
+        if (!entry.isObject())
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid parameter, expected object");
+        RPCTypeCheckObj(entry, boost::assign::map_list_of("scid", UniValue::VSTR)("nullifier", UniValue::VSTR));
+
+        uint256 scId;
+        CFieldElement nullifier;
+        ParseCswNullifier(find_value(entry, "scid").get_str(), find_value(entry, "nullifier").get_str(), "checkcswnullifiers", scId, nullifier);
+        keys.push_back(std::make_pair(scId, nullifier));
+    }
+
+    std::vector<bool> vHave;
+    {
+        LOCK(cs_main);
+        pcoinsTip->HaveCswNullifiers(keys, vHave);
+    }
+
+    UniValue ret(UniValue::VARR);
+    for (size_t i = 0; i < keys.size(); i++)
+    {
+        UniValue entry(UniValue::VOBJ);
+        entry.pushKV("scid", keys[i].first.GetHex());
+        entry.pushKV("nullifier", find_value(nullifiers[i], "nullifier").get_str());
+        entry.pushKV("data", (bool)vHave[i]);
+        ret.push_back(entry);
+    }
+
+    return ret;
+}
+
 int64_t blocksToOvertakeTarget(const CBlockIndex* forkTip, const CBlockIndex* targetBlock)
 {
     //this function assumes forkTip and targetBlock are non-null.
@@ -2319,39 +2880,266 @@ int64_t blocksToOvertakeTarget(const CBlockIndex* forkTip, const CBlockIndex* ta
     } else if (intersectionHeight < targetBlockHeight) {
         // if the fork base is older than the input block, finality also depends on the current penalty
         // ongoing on the fork
-        int64_t forkDelay = forkTip->nChainDelay;
-        if (selectedTipHeight >= chainActive.Height()) {
-            // if forkDelay is null one has to mine 1 block only
-            gap = forkDelay ? forkDelay : 1;
-            LogPrint("forks", "%s():%d - gap[%d], forkDelay[%d]\n", __func__,
-                    __LINE__, gap, forkDelay);
-        } else {
-            int64_t dt = chainActive.Height() - selectedTipHeight + 1;
-            dt = dt * (dt + 1) / 2;
-            gap = dt + forkDelay + 1;
-            LogPrint("forks", "%s():%d - gap[%d], forkDelay[%d], dt[%d]\n",
-                    __func__, __LINE__, gap, forkDelay, dt);
-        }
+        gap = ForkTipOvertakeGap(forkTip, chainActive.Height());
+        LogPrint("forks", "%s():%d - gap[%d], forkDelay[%d]\n", __func__,
+                __LINE__, gap, forkTip->nChainDelay);
     } else {
-        int64_t targetToTipDelta = chainActive.Height() - targetBlockHeight + 1;
-
         // this also handles the main chain tip
-        if (targetToTipDelta < PENALTY_THRESHOLD + 1) {
-            // an attacker can mine from previous block up to tip + 1
-            gap = targetToTipDelta + 1;
-            LogPrint("forks", "%s():%d - gap[%d], delta[%d]\n", __func__,
-                    __LINE__, gap, targetToTipDelta);
-        } else {
-            // penalty applies
-            gap = (targetToTipDelta * (targetToTipDelta + 1) / 2);
-            LogPrint("forks", "%s():%d - gap[%d], delta[%d]\n", __func__,
-                    __LINE__, gap, targetToTipDelta);
-        }
+        gap = MainChainOvertakeGap(targetBlockHeight, chainActive.Height());
+        LogPrint("forks", "%s():%d - gap[%d], delta[%d]\n", __func__,
+                __LINE__, gap, chainActive.Height() - targetBlockHeight + 1);
     }
 
     return gap;
 }
 
+/** The block finality can be told for, throws otherwise. Requires cs_main. */
+static const CBlockIndex* LookupFinalityTarget(const uint256& hash)
+{
+    BlockMap::const_iterator mi = mapBlockIndex.find(hash);
+    if (mi == mapBlockIndex.end())
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No such block header");
+
+    if (hash == Params().GetConsensus().hashGenesisBlock)
+        throw JSONRPCError(RPC_INVALID_PARAMS, "Finality does not apply to genesis block");
+
+    const CBlockIndex* pTargetBlockIdx = mi->second;
+
+    if (fHavePruned && !(pTargetBlockIdx->nStatus & BLOCK_HAVE_DATA) && pTargetBlockIdx->nTx > 0)
+        throw JSONRPCError(RPC_INTERNAL_ERROR, "Block not available (pruned data)");
+
+    // 0. if the input does not belong to the main chain can not tell finality
+    if (!chainActive.Contains(pTargetBlockIdx))
+    {
+        throw JSONRPCError(RPC_INTERNAL_ERROR, "Can't tell finality of a block not on main chain");
+    }
+
+    int64_t delta = chainActive.Height() - pTargetBlockIdx->nHeight + 1;
+    if (delta >= MAX_BLOCK_AGE_FOR_FINALITY)
+    {
+        throw JSONRPCError(RPC_INTERNAL_ERROR, "Old block: older than 2000!");
+    }
+
+    return pTargetBlockIdx;
+}
+
+static UniValue LatencySnapshotToJSON(const CLatencyHistogram::Snapshot& snapshot)
+{
+    UniValue entry(UniValue::VOBJ);
+    entry.pushKV("count", snapshot.nCount);
+    entry.pushKV("total_us", snapshot.nSumMicros);
+    entry.pushKV("mean_us", snapshot.Mean());
+    entry.pushKV("p50_us", snapshot.Quantile(0.5));
+    entry.pushKV("p90_us", snapshot.Quantile(0.9));
+    entry.pushKV("p99_us", snapshot.Quantile(0.99));
+    entry.pushKV("max_us", snapshot.nMaxMicros);
+    return entry;
+}
+
+UniValue getblockvalidationstats(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() > 1)
+        throw runtime_error(
+            "getblockvalidationstats ( reset )\n"
+            "\nReturns the latency distribution of each stage of the connection of a block to the active chain,\n"
+            "since the node started or the statistics were last reset. Quantiles are estimated from power of two\n"
+            "buckets. The same histograms are served in the Prometheus text format at /metrics with -metrics.\n"
+
+            "\nArguments:\n"
+            "1. reset   (boolean, optional, default=false) clear the statistics once they have been read\n"
+
+            "\nResult:\n"
+            "{\n"
+            "  \"stage\": {           (object) one entry per stage: read_block, check_block, connect_inputs, script_checks,\n"
+            "                                commitment, proof_verify, index_writes, connect_block, flush, chainstate_write,\n"
+            "                                update_tip, wallet_sync, signals, connect_tip\n"
+            "    \"count\": n,        (numeric) number of blocks which went through the stage\n"
+            "    \"total_us\": n,     (numeric) time spent in the stage, in microseconds\n"
+            "    \"mean_us\": x.xxx,  (numeric) mean duration\n"
+            "    \"p50_us\": x.xxx,   (numeric) median duration\n"
+            "    \"p90_us\": x.xxx,   (numeric) 90th percentile of the duration\n"
+            "    \"p99_us\": x.xxx,   (numeric) 99th percentile of the duration\n"
+            "    \"max_us\": n        (numeric) longest duration\n"
+            "  },\n"
+            "  ...\n"
+            "}\n"
+
+            "\nExamples:\n"
+            + HelpExampleCli("getblockvalidationstats", "")
+            + HelpExampleCli("getblockvalidationstats", "true")
+            + HelpExampleRpc("getblockvalidationstats", "")
+        );
+
+    UniValue ret(UniValue::VOBJ);
+    for (int s = 0; s < (int)BlockValidationStage::COUNT; ++s) {
+        const BlockValidationStage stage = static_cast<BlockValidationStage>(s);
+        ret.pushKV(BlockValidationStageName(stage), LatencySnapshotToJSON(GetBlockValidationStageSnapshot(stage)));
+    }
+
+    if (params.size() > 0 && params[0].get_bool())
+        ResetBlockValidationStats();
+
+    return ret;
+}
+
+UniValue gettxtrace(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 1)
+        throw runtime_error(
+            "gettxtrace \"hash\"\n"
+            "\nReturns the time at which a transaction or certificate received from a peer reached each stage, from its receipt\n"
+            "to its inclusion in a block template. Only the last -txtracesize transactions and certificates received are traced,\n"
+            "and only the first time each stage is reached is kept.\n"
+
+            "\nArguments:\n"
+            "1. \"hash\"   (string, required) the transaction or certificate hash\n"
+
+            "\nResult:\n"
+            "{\n"
+            "  \"hash\": \"hash\",           (string) the transaction or certificate hash\n"
+            "  \"type\": \"type\",           (string) transaction or certificate\n"
+            "  \"stages\": {               (object) one entry per stage reached, in order: received, proof_queued, proof_verify,\n"
+            "                                  proof_verified, accepted, relayed, block_template\n"
+            "    \"stage\": {\n"
+            "      \"time_us\": n,          (numeric) the time the stage was reached, in microseconds since the epoch\n"
+            "      \"latency_us\": n,       (numeric) the time since the previous stage reached\n"
+            "      \"elapsed_us\": n        (numeric) the time since the receipt\n"
+            "    },\n"
+            "    ...\n"
+            "  }\n"
+            "}\n"
+
+            "\nExamples:\n"
+            + HelpExampleCli("gettxtrace", "\"hash\"")
+            + HelpExampleRpc("gettxtrace", "\"hash\"")
+        );
+
+    uint256 hash = ParseHashV(params[0], "parameter 1");
+
+    CTxTrace trace;
+    if (!GetTxTrace(hash, trace))
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No trace for this transaction or certificate");
+
+    const int64_t nReceivedTime = trace.vTimeMicros[(int)TxTraceStage::RECEIVED];
+    UniValue stages(UniValue::VOBJ);
+    for (int s = 0; s < (int)TxTraceStage::COUNT; ++s) {
+        if (trace.vTimeMicros[s] == 0)
+            continue;
+        const TxTraceStage stage = static_cast<TxTraceStage>(s);
+        UniValue entry(UniValue::VOBJ);
+        entry.pushKV("time_us", trace.vTimeMicros[s]);
+        entry.pushKV("latency_us", trace.GetLatency(stage));
+        entry.pushKV("elapsed_us", trace.vTimeMicros[s] - nReceivedTime);
+        stages.pushKV(TxTraceStageName(stage), entry);
+    }
+
+    UniValue ret(UniValue::VOBJ);
+    ret.pushKV("hash", hash.GetHex());
+    ret.pushKV("type", trace.fCertificate ? "certificate" : "transaction");
+    ret.pushKV("stages", stages);
+    return ret;
+}
+
+UniValue gettxtracestats(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() > 1)
+        throw runtime_error(
+            "gettxtracestats ( reset )\n"
+            "\nReturns the latency distribution of each stage of the transactions and certificates received from peers, the time\n"
+            "taken to reach it from the previous stage reached, since the node started or the statistics were last reset.\n"
+            "Quantiles are estimated from power of two buckets. The same histograms are served in the Prometheus text format\n"
+            "at /metrics with -metrics.\n"
+
+            "\nArguments:\n"
+            "1. reset   (boolean, optional, default=false) clear the statistics once they have been read\n"
+
+            "\nResult:\n"
+            "{\n"
+            "  \"traced\": n,            (numeric) number of traces currently kept\n"
+            "  \"transaction\": {        (object) the stages of the transactions\n"
+            "    \"stage\": {            (object) one entry per stage: proof_queued, proof_verify, proof_verified, accepted,\n"
+            "                                   relayed, block_template\n"
+            "      \"count\": n,         (numeric) number of transactions which reached the stage\n"
+            "      \"total_us\": n,      (numeric) sum of the latencies, in microseconds\n"
+            "      \"mean_us\": x.xxx,   (numeric) mean latency\n"
+            "      \"p50_us\": x.xxx,    (numeric) median latency\n"
+            "      \"p90_us\": x.xxx,    (numeric) 90th percentile of the latency\n"
+            "      \"p99_us\": x.xxx,    (numeric) 99th percentile of the latency\n"
+            "      \"max_us\": n         (numeric) longest latency\n"
+            "    },\n"
+            "    ...\n"
+            "  },\n"
+            "  \"certificate\": {        (object) the stages of the certificates, as above\n"
+            "    ...\n"
+            "  }\n"
+            "}\n"
+
+            "\nExamples:\n"
+            + HelpExampleCli("gettxtracestats", "")
+            + HelpExampleCli("gettxtracestats", "true")
+            + HelpExampleRpc("gettxtracestats", "")
+        );
+
+    UniValue ret(UniValue::VOBJ);
+    ret.pushKV("traced", (uint64_t)GetTxTraceCount());
+    for (int c = 0; c < 2; ++c) {
+        UniValue stages(UniValue::VOBJ);
+        for (int s = (int)TxTraceStage::RECEIVED + 1; s < (int)TxTraceStage::COUNT; ++s) {
+            const TxTraceStage stage = static_cast<TxTraceStage>(s);
+            stages.pushKV(TxTraceStageName(stage), LatencySnapshotToJSON(GetTxTraceStageSnapshot(c, stage)));
+        }
+        ret.pushKV(c ? "certificate" : "transaction", stages);
+    }
+
+    if (params.size() > 0 && params[0].get_bool())
+        ResetTxTraceStats();
+
+    return ret;
+}
+
+UniValue getnotificationstats(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 0)
+        throw runtime_error(
+            "getnotificationstats\n"
+            "\nReturns the state of the queue of each running publisher of block and transaction notifications\n"
+            "(websocket, ZeroMQ, AMQP). Each publisher is fed from a queue of at most -notificationqueuesize notifications,\n"
+            "which drops transactions first when the publisher lags behind.\n"
+
+            "\nResult:\n"
+            "{\n"
+            "  \"sink\": {            (object) one entry per publisher: ws, zmq, amqp\n"
+            "    \"queued\": n,       (numeric) notifications waiting to be published\n"
+            "    \"max_queued\": n,   (numeric) the largest number of notifications which waited at once\n"
+            "    \"published\": n,    (numeric) notifications published\n"
+            "    \"dropped\": n,      (numeric) notifications dropped as the queue was full\n"
+            "    \"lag_p50_us\": x.xxx, (numeric) median delay between the queueing and the end of the publishing\n"
+            "    \"lag_p99_us\": x.xxx, (numeric) 99th percentile of the delay\n"
+            "    \"lag_max_us\": n    (numeric) longest delay\n"
+            "  },\n"
+            "  ...\n"
+            "}\n"
+
+            "\nExamples:\n"
+            + HelpExampleCli("getnotificationstats", "")
+            + HelpExampleRpc("getnotificationstats", "")
+        );
+
+    UniValue ret(UniValue::VOBJ);
+    for (const CNotificationSinkStats& stats : GetNotificationSinkStats()) {
+        UniValue entry(UniValue::VOBJ);
+        entry.pushKV("queued", (uint64_t)stats.nQueued);
+        entry.pushKV("max_queued", (uint64_t)stats.nMaxQueued);
+        entry.pushKV("published", stats.nPublished);
+        entry.pushKV("dropped", stats.nDropped);
+        entry.pushKV("lag_p50_us", stats.lag.Quantile(0.5));
+        entry.pushKV("lag_p99_us", stats.lag.Quantile(0.99));
+        entry.pushKV("lag_max_us", stats.lag.nMaxMicros);
+        ret.pushKV(stats.name, entry);
+    }
+    return ret;
+}
+
 UniValue getblockfinalityindex(const UniValue& params, bool fHelp)
 {
     if (fHelp || params.size() < 1 || params.size() > 2)
@@ -2372,56 +3160,61 @@ UniValue getblockfinalityindex(const UniValue& params, bool fHelp)
     LOCK(cs_main);
 
     uint256 hash = ParseHashV(params[0], "parameter 1");
+    const CBlockIndex* pTargetBlockIdx = LookupFinalityTarget(hash);
 
-    if (mapBlockIndex.count(hash) == 0)
-        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No such block header");
-
-    if (hash == Params().GetConsensus().hashGenesisBlock)
-        throw JSONRPCError(RPC_INVALID_PARAMS, "Finality does not apply to genesis block");
-
-    CBlockIndex* pTargetBlockIdx = mapBlockIndex[hash];
+    int64_t minGap = GetBlockFinalityIndex(pTargetBlockIdx);
+    LogPrint("forks", "%s():%d - input h(%d) [%s], returning [%d]\n",
+        __func__, __LINE__, pTargetBlockIdx->nHeight, pTargetBlockIdx->GetBlockHash().ToString(), minGap);
+    return minGap;
+}
 
-    if (fHavePruned && !(pTargetBlockIdx->nStatus & BLOCK_HAVE_DATA) && pTargetBlockIdx->nTx > 0)
-        throw JSONRPCError(RPC_INTERNAL_ERROR, "Block not available (pruned data)");
+UniValue getblocksfinalityindex(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 1)
+        throw runtime_error(
+            "getblocksfinalityindex [\"hash\",...]\n"
+            "\nReturns the finality index of each of the given blocks, as getblockfinalityindex would, all of them\n"
+            "computed against the same chain state\n"
 
-    // 0. if the input does not belong to the main chain can not tell finality
-    if (!chainActive.Contains(pTargetBlockIdx))
-    {
-        throw JSONRPCError(RPC_INTERNAL_ERROR, "Can't tell finality of a block not on main chain");
-    }
+            "\nArguments:\n"
+            "1. [\"hash\",...]   (array, required)  the block hashes\n"
 
-    int inputHeight = pTargetBlockIdx->nHeight;
-    LogPrint("forks", "%s():%d - input h(%d) [%s]\n",
-        __func__, __LINE__, pTargetBlockIdx->nHeight, pTargetBlockIdx->GetBlockHash().ToString());
+            "\nResult:\n"
+            "[\n"
+            "  {\n"
+            "    \"hash\": \"hash\",       (string) the block hash\n"
+            "    \"finalityindex\": n,   (numeric) number of consecutive blocks a miner would have to mine from now in order to revert the block\n"
+            "    \"error\": \"message\"    (string) only if the finality of the block can not be told, why\n"
+            "  },\n"
+            "  ...\n"
+            "]\n"
 
-    int64_t delta = chainActive.Height() - inputHeight + 1;
-    if (delta >= MAX_BLOCK_AGE_FOR_FINALITY)
-    {
-        throw JSONRPCError(RPC_INTERNAL_ERROR, "Old block: older than 2000!");
-    }
+            "\nExamples:\n"
+            + HelpExampleCli("getblocksfinalityindex", "\"[\\\"hash\\\",...]\"")
+            + HelpExampleRpc("getblocksfinalityindex", "[\"hash\",...]")
+        );
 
-    std::set<const CBlockIndex*, CompareBlocksByHeight> setTips;
-    for(auto mapPair: mGlobalForkTips)
-    {
-        const CBlockIndex* idx = mapPair.first;
-        setTips.insert(idx);
-    }
-    setTips.insert(chainActive.Tip());
+    const UniValue& hashes = params[0].get_array();
 
-//    dump_global_tips();
+    LOCK(cs_main);
 
-    // For each tip find the stemming block on the main chain
-    // In case of main tip such a block would be the tip itself
-    //-----------------------------------------------------------------------
-    int64_t minGap = LLONG_MAX;
-    for(auto selectedTip: setTips)
+    UniValue result(UniValue::VARR);
+    for (size_t i = 0; i < hashes.size(); i++)
     {
-        int64_t gap = blocksToOvertakeTarget(selectedTip, pTargetBlockIdx);
-        minGap = std::min(minGap, gap);
+        uint256 hash = ParseHashV(hashes[i], "hash");
+        UniValue entry(UniValue::VOBJ);
+        entry.pushKV("hash", hash.GetHex());
+        try
+        {
+            entry.pushKV("finalityindex", GetBlockFinalityIndex(LookupFinalityTarget(hash)));
+        }
+        catch (const UniValue& objError)
+        {
+            entry.pushKV("error", find_value(objError, "message"));
+        }
+        result.push_back(entry);
     }
-
-    LogPrint("forks", "%s():%d - returning [%d]\n", __func__, __LINE__, minGap);
-    return minGap;
+    return result;
 }
 
 UniValue getglobaltips(const UniValue& params, bool fHelp)
@@ -2528,6 +3321,33 @@ UniValue getproofverifierstats(const UniValue& params, bool fHelp)
     obj.pushKV("failedCSWs",    static_cast<uint64_t>(stats.failedCswCounter));
     obj.pushKV("okCerts",       static_cast<uint64_t>(stats.okCertCounter));
     obj.pushKV("okCSWs",        static_cast<uint64_t>(stats.okCswCounter));
+    obj.pushKV("cancelledCerts", static_cast<uint64_t>(stats.cancelledCertCounter));
+
+    AsyncProofVerifierBatchingInfo batching = CScAsyncProofVerifier::GetInstance().GetBatchingInfo();
+    UniValue batchingObj(UniValue::VOBJ);
+    batchingObj.pushKV("adaptive",       batching.adaptive);
+    batchingObj.pushKV("batchDelay",     static_cast<uint64_t>(batching.batchDelay));
+    batchingObj.pushKV("batchSize",      static_cast<uint64_t>(batching.batchSize));
+    batchingObj.pushKV("subBatchSize",   static_cast<uint64_t>(batching.subBatchSize));
+    batchingObj.pushKV("maxSubBatches",  static_cast<uint64_t>(batching.maxSubBatches));
+    batchingObj.pushKV("lastSubBatches", static_cast<uint64_t>(batching.lastSubBatches));
+    batchingObj.pushKV("proofCostMs",    batching.proofCostMs);
+    batchingObj.pushKV("arrivalRate",    batching.arrivalRate);
+    obj.pushKV("batching", batchingObj);
+
+    ProofVerifierThreadConfig threadConfig = CScProofVerifier::GetThreadConfig();
+    UniValue lowCpus(UniValue::VARR);
+    for (int cpu : threadConfig.lowCpus)
+        lowCpus.push_back(cpu);
+    UniValue highCpus(UniValue::VARR);
+    for (int cpu : threadConfig.highCpus)
+        highCpus.push_back(cpu);
+    UniValue threadsObj(UniValue::VOBJ);
+    threadsObj.pushKV("poolThreads",    static_cast<uint64_t>(threadConfig.poolThreads));
+    threadsObj.pushKV("lowCpus",        lowCpus);
+    threadsObj.pushKV("highCpus",       highCpus);
+    threadsObj.pushKV("lowBelowNormal", threadConfig.lowBelowNormal);
+    obj.pushKV("threads", threadsObj);
 
     return obj;
 }
@@ -34,6 +34,7 @@ static const CRPCConvertParam vRPCConvertParams[] =
 {
     { "stop", 0 },
     { "setmocktime", 0 },
+    { "getlockstats", 0 },
     { "getaddednodeinfo", 0 },
     { "setgenerate", 0 },
     { "setgenerate", 1 },
@@ -62,6 +63,8 @@ static const CRPCConvertParam vRPCConvertParams[] =
     { "listtransactions", 2 },
     { "listtransactions", 3 },
     { "listtransactions", 4 },
+    { "listtransactions", 5 },
+    { "listtransactions", 6 },
     { "listtxesbyaddress", 1 },
     { "listtxesbyaddress", 2 },
     { "listtxesbyaddress", 3 },
@@ -91,6 +94,8 @@ static const CRPCConvertParam vRPCConvertParams[] =
     { "gettransaction", 1 },
     { "gettransaction", 2 },
     { "getrawtransaction", 1 },
+    { "getrawtransactions", 0 },
+    { "getrawtransactions", 1 },
     { "createrawtransaction", 0 },
     { "createrawtransaction", 1 },
     { "createrawtransaction", 2 },
@@ -103,19 +108,33 @@ static const CRPCConvertParam vRPCConvertParams[] =
     { "createrawcertificate", 3 },
     { "signrawtransaction", 1 },
     { "signrawtransaction", 2 },
+    { "signrawtransactions", 0 },
+    { "signrawtransactions", 1 },
+    { "signrawtransactions", 2 },
     { "sendrawtransaction", 1 },
+    { "gettxoutsetinfo", 1 },
+    { "dumpchaindata", 1 },
+    { "dumpchaindata", 2 },
+    { "dumpchaindata", 3 },
+    { "checkcswnullifiers", 0 },
+    { "getblockvalidationstats", 0 },
+    { "gettxtracestats", 0 },
     { "gettxout", 1 },
     { "gettxout", 2 },
     { "gettxout", 3 },
     { "gettxoutproof", 0 },
+    { "gettxoutproofs", 0 },
     { "lockunspent", 0 },
     { "lockunspent", 1 },
     { "importprivkey", 2 },
     { "importaddress", 2 },
+    { "importmulti", 0 },
+    { "importmulti", 1 },
     { "verifychain", 0 },
     { "verifychain", 1 },
     { "keypoolrefill", 0 },
     { "getrawmempool", 0 },
+    { "getmempooldelta", 0 },
     { "estimatefee", 0 },
     { "estimatepriority", 0 },
     { "prioritisetransaction", 1 },
@@ -124,6 +143,7 @@ static const CRPCConvertParam vRPCConvertParams[] =
     { "setban", 3 },
 
     { "getblockhashes", 0 },
+    { "getblocksfinalityindex", 0 },
     { "getblockhashes", 1 },
     { "getblockhashes", 2 },
     { "getspentinfo", 0 },
@@ -141,6 +161,7 @@ static const CRPCConvertParam vRPCConvertParams[] =
     { "zcrawjoinsplit", 4 },
     { "zcbenchmark", 1 },
     { "zcbenchmark", 2 },
+    { "zcbenchmark", 3 },
     { "getblocksubsidy", 0 },
     { "getblockmerkleroots", 0 },
     { "getblockmerkleroots", 1 },
@@ -181,6 +202,7 @@ static const CRPCConvertParam vRPCConvertParams[] =
     { "z_shieldcoinbase", 2 },
     { "z_shieldcoinbase", 3 },
     { "z_getoperationstatus", 0 },
+    { "z_canceloperation", 0 },
     { "z_getoperationresult", 0 },
     { "z_importkey", 2 },
     { "z_importviewingkey", 2 },
@@ -324,6 +324,8 @@ UniValue getmininginfo(const UniValue& params, bool fHelp)
             "  \"currentblocksize\": nnn,        (numeric) the last block size\n"
             "  \"currentblocktx\": nnn,          (numeric) number of transactions in the last block\n"
             "  \"currentblockcert\": nnn,        (numeric) number of certificates in the last block\n"
+            "  \"currentblockfees\": x.xxx,      (numeric) the fees of the last block, in " + CURRENCY_UNIT + "\n"
+            "  \"currentblocktemplatetime\": n,  (numeric) the milliseconds it took to create the last block template\n"
             "  \"difficulty\": xxxxxxxx,         (numeric) the current difficulty\n"
             "  \"errors\": \"...\",              (string) current errors\n"
             "  \"generate\": true|false,         (boolean) if the generation is on or off (see getgenerate or setgenerate calls)\n"
@@ -334,6 +336,16 @@ UniValue getmininginfo(const UniValue& params, bool fHelp)
             "  \"pooledcert\": n,                (numeric) the number of certs in the mem pool\n"
             "  \"testnet\": true|false,          (boolean) if using testnet or not\n"
             "  \"chain\": \"xxxx\"               (string) current network name as defined in BIP70 (main, test, regtest)\n"
+            "  \"workers\": [                    (array) the running generation threads\n"
+            "    {\n"
+            "      \"id\": n,                    (numeric) the thread index\n"
+            "      \"cpu\": n,                   (numeric) the cpu the thread is pinned to, -1 if not pinned\n"
+            "      \"node\": n,                  (numeric) the NUMA node of that cpu, -1 if not pinned\n"
+            "      \"solverruns\": n,            (numeric) the Equihash solver runs of the thread\n"
+            "      \"solutionchecks\": n,        (numeric) the solutions the thread checked against the target\n"
+            "      \"solps\": xxxxxxxx           (numeric) the average solution rate of the thread in Sol/s\n"
+            "    }, ...\n"
+            "  ]\n"
             "}\n"
             
             "\nExamples:\n"
@@ -349,6 +361,8 @@ UniValue getmininginfo(const UniValue& params, bool fHelp)
     obj.pushKV("currentblocksize", (uint64_t)nLastBlockSize);
     obj.pushKV("currentblocktx",   (uint64_t)nLastBlockTx);
     obj.pushKV("currentblockcert", (uint64_t)nLastBlockCert);
+    obj.pushKV("currentblockfees", ValueFromAmount(nLastBlockFees));
+    obj.pushKV("currentblocktemplatetime", nLastBlockTemplateTime / 1000);
     obj.pushKV("difficulty",       (double)GetNetworkDifficulty());
     obj.pushKV("errors",           GetWarnings("statusbar"));
     obj.pushKV("genproclimit",     (int)GetArg("-genproclimit", -1));
@@ -361,6 +375,18 @@ UniValue getmininginfo(const UniValue& params, bool fHelp)
     obj.pushKV("chain",            Params().NetworkIDString());
 #ifdef ENABLE_MINING
     obj.pushKV("generate",         getgenerate(params, false));
+    UniValue workers(UniValue::VARR);
+    for (const CMinerWorkerInfo& info : GetMinerWorkersInfo()) {
+        UniValue worker(UniValue::VOBJ);
+        worker.pushKV("id",             info.nId);
+        worker.pushKV("cpu",            info.nCpu);
+        worker.pushKV("node",           info.nNode);
+        worker.pushKV("solverruns",     info.nSolverRuns);
+        worker.pushKV("solutionchecks", info.nSolutionChecks);
+        worker.pushKV("solps",          info.dSolPS);
+        workers.push_back(worker);
+    }
+    obj.pushKV("workers",          workers);
 #endif
     return obj;
 }
@@ -420,6 +446,59 @@ static UniValue BIP22ValidationResult(const CValidationState& state)
     return "valid?";
 }
 
+namespace {
+
+//! A new template is never built for mempool changes within this many seconds of the previous one
+const int64_t BLOCK_TEMPLATE_MIN_AGE = 5;
+//! Long poll waiters get a new template for any mempool change once the current one is this many seconds old
+const int64_t BLOCK_TEMPLATE_MAX_AGE = 60;
+
+/**
+ * The block template handed out by getblocktemplate. It is built once for all the callers, and its
+ * result is cached too, so that the long poll waiters woken together by a new template only cost
+ * the serialization of the reply. Guarded by cs_main; nTransactionsUpdated, which identifies the
+ * template in the longpollid, is only written holding csBestBlock too, and the waiters read it
+ * holding csBestBlock only.
+ */
+struct CSharedBlockTemplate
+{
+    struct CachedResult
+    {
+        bool fValid = false;
+        uint32_t nTime = 0;
+        uint32_t nBits = 0;
+        UniValue value;
+    };
+
+    CBlockIndex* pindexPrev = nullptr;
+    std::unique_ptr<CBlockTemplate> pblocktemplate;
+    unsigned int nTransactionsUpdated = 0;
+    //! The mempool fees added and the time when the template was built, read by the waiters without a lock
+    std::atomic<CAmount> nFeesAdded {0};
+    std::atomic<int64_t> nCreated {0};
+    //! The last result, with and without the merkle roots, valid for the header time and bits it was built for
+    CachedResult cachedResults[2];
+};
+
+CSharedBlockTemplate sharedTemplate;
+
+/**
+ * Whether the mempool changed enough since the template identified by nTransactionsUpdatedLP was built
+ * to hand a new one to the long poll waiters: the fees added since exceed -blocktemplatefeedelta, or
+ * the template is a minute old. Changes within BLOCK_TEMPLATE_MIN_AGE seconds are debounced.
+ */
+bool IsBlockTemplateOutdated(unsigned int nTransactionsUpdatedLP)
+{
+    if (mempool->GetTransactionsUpdated() == nTransactionsUpdatedLP)
+        return false;
+    const int64_t nAge = GetTime() - sharedTemplate.nCreated;
+    if (nAge <= BLOCK_TEMPLATE_MIN_AGE)
+        return false;
+    return nAge >= BLOCK_TEMPLATE_MAX_AGE || mempool->GetFeesAdded() - sharedTemplate.nFeesAdded >= nBlockTemplateFeeDelta;
+}
+
+}
+
 UniValue getblocktemplate(const UniValue& params, bool fHelp)
 {
     if (fHelp || params.size() > 2)
@@ -568,11 +647,9 @@ UniValue getblocktemplate(const UniValue& params, bool fHelp)
         includeMerkleRoots = params[1].get_bool();
     }
 
-    static unsigned int nTransactionsUpdatedLast;
-
     if (!lpval.isNull())
     {
-        // Wait to respond until either the best block changes, OR a minute has passed and there are more transactions
+        // Wait to respond until either the best block changes, OR a new template is built: see IsBlockTemplateOutdated
         uint256 hashWatchedChain;
         boost::system_time checktxtime;
         unsigned int nTransactionsUpdatedLastLP;
@@ -589,23 +666,24 @@ UniValue getblocktemplate(const UniValue& params, bool fHelp)
         {
             // NOTE: Spec does not specify behaviour for non-string longpollid, but this makes testing easier
             hashWatchedChain = chainActive.Tip()->GetBlockHash();
-            nTransactionsUpdatedLastLP = nTransactionsUpdatedLast;
+            nTransactionsUpdatedLastLP = sharedTemplate.nTransactionsUpdated;
         }
 
         // Release the wallet and main lock while waiting
         LEAVE_CRITICAL_SECTION(cs_main);
         {
-            checktxtime = boost::get_system_time() + boost::posix_time::minutes(1);
-
             boost::unique_lock<boost::mutex> lock(csBestBlock);
             while (chainActive.Tip()->GetBlockHash() == hashWatchedChain && IsRPCRunning())
             {
+                // Another caller already built a newer template: hand it out
+                if (sharedTemplate.nTransactionsUpdated != nTransactionsUpdatedLastLP)
+                    break;
+                checktxtime = boost::get_system_time() + boost::posix_time::seconds(1);
                 if (!cvBlockChange.timed_wait(lock, checktxtime))
                 {
                     // Timeout: Check transactions for update
-                    if (mempool->GetTransactionsUpdated() != nTransactionsUpdatedLastLP)
+                    if (IsBlockTemplateOutdated(nTransactionsUpdatedLastLP))
                         break;
-                    checktxtime += boost::posix_time::seconds(10);
                 }
             }
         }
@@ -617,72 +695,79 @@ UniValue getblocktemplate(const UniValue& params, bool fHelp)
     }
 
     // Update block
-    static CBlockIndex* pindexPrev;
-    static int64_t lastExecution;
-    static CBlockTemplate* pblocktemplate;
+    CBlockIndex*& pindexPrev = sharedTemplate.pindexPrev;
     if (pindexPrev != chainActive.Tip() ||
-        (mempool->GetTransactionsUpdated() != nTransactionsUpdatedLast && GetTime() - lastExecution > 5))
+        (mempool->GetTransactionsUpdated() != sharedTemplate.nTransactionsUpdated &&
+         GetTime() - sharedTemplate.nCreated > BLOCK_TEMPLATE_MIN_AGE))
     {
         // Clear pindexPrev so future calls make a new block, despite any failures from here on
         pindexPrev = NULL;
+        for (CSharedBlockTemplate::CachedResult& cached : sharedTemplate.cachedResults)
+            cached.fValid = false;
 
         // Store the pindexBest used before CreateNewBlockWithKey, to avoid races
-        nTransactionsUpdatedLast = mempool->GetTransactionsUpdated();
+        const unsigned int nTransactionsUpdatedNew = mempool->GetTransactionsUpdated();
+        sharedTemplate.nFeesAdded = mempool->GetFeesAdded();
         CBlockIndex* pindexPrevNew = chainActive.Tip();
-        lastExecution = GetTime();
+        sharedTemplate.nCreated = GetTime();
 
         // Create new block
-        if(pblocktemplate)
-        {
-            delete pblocktemplate;
-            pblocktemplate = NULL;
-        }
+        sharedTemplate.pblocktemplate.reset();
 #ifdef ENABLE_WALLET
         CReserveKey reservekey(pwalletMain);
-        pblocktemplate = CreateNewBlockWithKey(reservekey);
+        sharedTemplate.pblocktemplate.reset(CreateNewBlockWithKey(reservekey));
 #else
-        pblocktemplate = CreateNewBlockWithKey();
+        sharedTemplate.pblocktemplate.reset(CreateNewBlockWithKey());
 #endif
-        if (!pblocktemplate)
+        // Publish the new template to the long poll waiters even on failure, so that they retry
+        {
+            boost::lock_guard<boost::mutex> lock(csBestBlock);
+            sharedTemplate.nTransactionsUpdated = nTransactionsUpdatedNew;
+        }
+        cvBlockChange.notify_all();
+
+        if (!sharedTemplate.pblocktemplate)
             throw JSONRPCError(RPC_OUT_OF_MEMORY, "Out of memory");
 
         // Need to update only after we know CreateNewBlockWithKey succeeded
         pindexPrev = pindexPrevNew;
     }
+    CBlockTemplate* pblocktemplate = sharedTemplate.pblocktemplate.get();
     CBlock* pblock = &pblocktemplate->block; // pointer for convenience
 
     // Update nTime
     UpdateTime(pblock, Params().GetConsensus(), pindexPrev);
     pblock->nNonce = uint256();
 
+    // All the callers asking for the same template in the same second get the same result
+    CSharedBlockTemplate::CachedResult& cached = sharedTemplate.cachedResults[includeMerkleRoots ? 1 : 0];
+    if (cached.fValid && cached.nTime == pblock->nTime && cached.nBits == pblock->nBits)
+        return cached.value;
+
     UniValue aCaps(UniValue::VARR); aCaps.push_back("proposal");
 
     UniValue txCoinbase = NullUniValue;
     UniValue transactions(UniValue::VARR);
-    map<uint256, int64_t> setTxIndex;
     int i = 0;
     BOOST_FOREACH (const CTransaction& tx, pblock->vtx) {
-        uint256 txHash = tx.GetHash();
-        setTxIndex[txHash] = i++;
+        const int index_in_template = i++;
 
         if (tx.IsCoinBase() && !coinbasetxn)
             continue;
 
         UniValue entry(UniValue::VOBJ);
 
-        entry.pushKV("data", EncodeHexTx(tx));
+        // the entries of the mempool come encoded with the template
+        const std::shared_ptr<const std::string>& pHex = pblocktemplate->vTxHex[index_in_template];
+        entry.pushKV("data", pHex ? *pHex : EncodeHexTx(tx));
 
-        entry.pushKV("hash", txHash.GetHex());
+        entry.pushKV("hash", tx.GetHash().GetHex());
 
         UniValue deps(UniValue::VARR);
-        BOOST_FOREACH (const CTxIn &in, tx.GetVin())
-        {
-            if (setTxIndex.count(in.prevout.hash))
-                deps.push_back(setTxIndex[in.prevout.hash]);
-        }
+        for (int64_t nDepend : pblocktemplate->vTxDepends[index_in_template])
+            deps.push_back(nDepend);
         entry.pushKV("depends", deps);
 
-        int index_in_template = i - 1;
         entry.pushKV("fee", pblocktemplate->vTxFees[index_in_template]);
         entry.pushKV("sigops", pblocktemplate->vTxSigOps[index_in_template]);
 
@@ -727,7 +812,7 @@ UniValue getblocktemplate(const UniValue& params, bool fHelp)
 
     if (includeMerkleRoots)
     {
-        pblock->hashMerkleRoot = pblock->BuildMerkleTree();
+        pblock->hashMerkleRoot = pblock->BuildMerkleTree(nullptr, std::max(1, nScriptCheckThreads));
 
         if (certSupported) {
             CCoinsViewCache view(pcoinsTip);
@@ -750,7 +835,8 @@ UniValue getblocktemplate(const UniValue& params, bool fHelp)
             uint256 certHash = cert.GetHash();
             UniValue entry(UniValue::VOBJ);
  
-            entry.pushKV("data", EncodeHexCert(cert));
+            const std::shared_ptr<const std::string>& pHex = pblocktemplate->vCertHex[cert_idx_in_template];
+            entry.pushKV("data", pHex ? *pHex : EncodeHexCert(cert));
             entry.pushKV("hash", certHash.GetHex());
             // no depends for cert since there are no inputs
             entry.pushKV("fee", pblocktemplate->vCertFees[cert_idx_in_template]);
@@ -774,7 +860,7 @@ UniValue getblocktemplate(const UniValue& params, bool fHelp)
     if (pblock->nVersion != BLOCK_VERSION_SC_SUPPORT)
         block_size_limit = MAX_BLOCK_SIZE_BEFORE_SC;
 
-    result.pushKV("longpollid", chainActive.Tip()->GetBlockHash().GetHex() + i64tostr(nTransactionsUpdatedLast));
+    result.pushKV("longpollid", chainActive.Tip()->GetBlockHash().GetHex() + i64tostr(sharedTemplate.nTransactionsUpdated));
     result.pushKV("target", hashTarget.GetHex());
     result.pushKV("mintime", (int64_t)pindexPrev->GetMedianTimePast()+1);
     result.pushKV("mutable", aMutable);
@@ -785,6 +871,10 @@ UniValue getblocktemplate(const UniValue& params, bool fHelp)
     result.pushKV("bits", strprintf("%08x", pblock->nBits));
     result.pushKV("height", (int64_t)(pindexPrev->nHeight+1));
 
+    cached.value = result;
+    cached.nTime = pblock->nTime;
+    cached.nBits = pblock->nBits;
+    cached.fValid = true;
     return result;
 }
 
@@ -878,15 +968,17 @@ UniValue submitblock(const UniValue& params, bool fHelp)
 
 UniValue estimatefee(const UniValue& params, bool fHelp)
 {
-    if (fHelp || params.size() != 1)
+    if (fHelp || params.size() < 1 || params.size() > 2)
         throw runtime_error(
-            "estimatefee nblocks\n"
+            "estimatefee nblocks ( \"type\" )\n"
             "\nEstimates the approximate fee per kilobyte\n"
             "needed for a transaction to begin confirmation\n"
             "within nblocks blocks.\n"
 
             "\nArguments:\n"
             "1. nblocks     (numeric) number of blocks\n"
+            "2. \"type\"      (string, optional, default=\"transaction\") the kind of transaction, whose fee rates are tracked separately:\n"
+            "                 \"transaction\", \"sidechain\" (with sidechain outputs or ceased sidechain withdrawal inputs) or \"certificate\"\n"
 
             "\nResult:\n"
             "n :            (numeric) estimated fee-per-kilobyte\n"
@@ -896,16 +988,28 @@ UniValue estimatefee(const UniValue& params, bool fHelp)
 
             "\nExample:\n"
             + HelpExampleCli("estimatefee", "6")
+            + HelpExampleCli("estimatefee", "6 \"certificate\"")
             + HelpExampleRpc("estimatefee", "6")
         );
 
-    RPCTypeCheck(params, boost::assign::list_of(UniValue::VNUM));
+    RPCTypeCheck(params, boost::assign::list_of(UniValue::VNUM)(UniValue::VSTR));
 
     int nBlocks = params[0].get_int();
     if (nBlocks < 1)
         nBlocks = 1;
 
-    CFeeRate feeRate = mempool->estimateFee(nBlocks);
+    FeeEstimateType type = FeeEstimateType::TRANSACTION;
+    if (params.size() > 1) {
+        const std::string& strType = params[1].get_str();
+        if (strType == "sidechain")
+            type = FeeEstimateType::SIDECHAIN_TRANSACTION;
+        else if (strType == "certificate")
+            type = FeeEstimateType::CERTIFICATE;
+        else if (strType != "transaction")
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid type: " + strType);
+    }
+
+    CFeeRate feeRate = mempool->estimateFee(nBlocks, type);
     if (feeRate == CFeeRate(0))
         return -1.0;
 
@@ -1052,7 +1156,7 @@ UniValue getblockmerkleroots(const UniValue& params, bool fHelp) {
     pblock->vcert = certs;
     CCoinsViewCache view(pcoinsTip);
 
-    uint256 merkleTree = pblock->BuildMerkleTree();
+    uint256 merkleTree = pblock->BuildMerkleTree(nullptr, std::max(1, nScriptCheckThreads));
     if (certSupported) {
         if (!pblock->BuildScTxsCommitmentGuard()) {
             LogPrint("sc", "%s():%d - scTxsCommitment guard failed. Check the number of sc or txs / cert for each sc.\n",
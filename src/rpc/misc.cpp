@@ -5,7 +5,9 @@
 
 #include "addressindex.h"
 #include "base58.h"
+#include "blockcache.h"
 #include "clientversion.h"
+#include "headerscache.h"
 #include "init.h"
 #include "main.h"
 #include "net.h"
@@ -485,6 +487,127 @@ UniValue setmocktime(const UniValue& params, bool fHelp)
     return NullUniValue;
 }
 
+UniValue getlockstats(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() > 1)
+        throw runtime_error(
+            "getlockstats ( reset )\n"
+            "\nReturns, for each LOCK site of the code, how many times its lock was taken, how many of these had to\n"
+            "wait for another thread and the time spent waiting for and holding the lock. The sites are sorted by\n"
+            "decreasing wait time. The statistics are only gathered when the node runs with -lockstats.\n"
+
+            "\nArguments:\n"
+            "1. reset   (boolean, optional, default=false) clear the statistics once they have been read\n"
+
+            "\nResult:\n"
+            "{\n"
+            "  \"enabled\": true|false,   (boolean) whether the statistics are being gathered\n"
+            "  \"sites\": [\n"
+            "    {\n"
+            "      \"lock\": \"name\",        (string) the lock, as written at the site\n"
+            "      \"site\": \"file:line\",   (string) where the lock is taken\n"
+            "      \"acquisitions\": n,     (numeric) number of times the lock was taken\n"
+            "      \"contentions\": n,      (numeric) number of times the lock was held by another thread\n"
+            "      \"wait_us\": n,          (numeric) total time spent waiting for the lock, in microseconds\n"
+            "      \"max_wait_us\": n,      (numeric) longest wait\n"
+            "      \"hold_us\": n,          (numeric) total time the lock was held from the site, in microseconds\n"
+            "      \"max_hold_us\": n       (numeric) longest hold\n"
+            "    }, ...\n"
+            "  ]\n"
+            "}\n"
+
+            "\nExamples:\n"
+            + HelpExampleCli("getlockstats", "")
+            + HelpExampleCli("getlockstats", "true")
+            + HelpExampleRpc("getlockstats", "")
+        );
+
+    UniValue sites(UniValue::VARR);
+    for (const CLockSiteStats& stats : GetLockStats()) {
+        UniValue site(UniValue::VOBJ);
+        site.pushKV("lock", stats.strName);
+        site.pushKV("site", strprintf("%s:%d", stats.strFile, stats.nLine));
+        site.pushKV("acquisitions", stats.nAcquisitions);
+        site.pushKV("contentions", stats.nContentions);
+        site.pushKV("wait_us", stats.nWaitNanos / 1000);
+        site.pushKV("max_wait_us", stats.nMaxWaitNanos / 1000);
+        site.pushKV("hold_us", stats.nHoldNanos / 1000);
+        site.pushKV("max_hold_us", stats.nMaxHoldNanos / 1000);
+        sites.push_back(site);
+    }
+
+    if (params.size() > 0 && params[0].get_bool())
+        ResetLockStats();
+
+    UniValue ret(UniValue::VOBJ);
+    ret.pushKV("enabled", fLockStats.load());
+    ret.pushKV("sites", sites);
+    return ret;
+}
+
+UniValue getmemoryinfo(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 0)
+        throw runtime_error(
+            "getmemoryinfo\n"
+            "\nReturns the memory used by the caches of the node, in bytes, with their limits. The objects the zendoo\n"
+            "library deserializes the proofs, the verification keys and the field elements to are estimated, and counted\n"
+            "with the cache holding them, even if they are not deserialized yet.\n"
+
+            "\nResult:\n"
+            "{\n"
+            "  \"coinscache\": {\n"
+            "    \"coins\": n,             (numeric) the coins, with the anchors and the shielded nullifiers\n"
+            "    \"coins_limit\": n,       (numeric) their budget, out of -dbcache\n"
+            "    \"sidechains\": n,        (numeric) the sidechains, their events and the csw nullifiers\n"
+            "    \"sidechains_limit\": n   (numeric) their budget, -sccachesize\n"
+            "  },\n"
+            "  \"mempool\": {\n"
+            "    \"usage\": n,             (numeric) the transactions and certificates, with their indexes\n"
+            "    \"bytes\": n,             (numeric) the serialized size of the transactions and certificates\n"
+            "    \"bytes_limit\": n        (numeric) the limit of the serialized size, -maxmempool\n"
+            "  },\n"
+            "  \"vkeycache\": {\n"
+            "    \"entries\": n,           (numeric) the deserialized verification keys\n"
+            "    \"usage\": n              (numeric) their memory\n"
+            "  },\n"
+            "  \"blockcache\": n,          (numeric) the recent blocks, -blockcachesize\n"
+            "  \"headerscache\": n         (numeric) the serialized headers, -headerscachesize\n"
+            "}\n"
+
+            "\nExamples:\n"
+            + HelpExampleCli("getmemoryinfo", "")
+            + HelpExampleRpc("getmemoryinfo", "")
+        );
+
+    UniValue ret(UniValue::VOBJ);
+    {
+        LOCK(cs_main);
+        const CCoinsCacheUsage usage = pcoinsTip->DynamicMemoryUsageByFamily();
+        UniValue coins(UniValue::VOBJ);
+        coins.pushKV("coins", (uint64_t)usage.nCoins);
+        coins.pushKV("coins_limit", (uint64_t)nCoinCacheUsage);
+        coins.pushKV("sidechains", (uint64_t)usage.nSidechains);
+        coins.pushKV("sidechains_limit", (uint64_t)nScCacheUsage);
+        ret.pushKV("coinscache", coins);
+
+        UniValue pool(UniValue::VOBJ);
+        pool.pushKV("usage", (uint64_t)mempool->DynamicMemoryUsage());
+        pool.pushKV("bytes", (uint64_t)(mempool->GetTotalTxSize() + mempool->GetTotalCertificateSize()));
+        pool.pushKV("bytes_limit", GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE_MB) * 1000000);
+        ret.pushKV("mempool", pool);
+
+        ret.pushKV("headerscache", (uint64_t)headersCache.DynamicUsage());
+    }
+
+    UniValue vkeys(UniValue::VOBJ);
+    vkeys.pushKV("entries", (uint64_t)CScVKeyCache::GetInstance().Size());
+    vkeys.pushKV("usage", (uint64_t)CScVKeyCache::GetInstance().DynamicMemoryUsage());
+    ret.pushKV("vkeycache", vkeys);
+    ret.pushKV("blockcache", (uint64_t)blockCache.DynamicUsage());
+    return ret;
+}
+
 bool getAddressFromIndex(const AddressType type, const uint160 &hash, std::string &address)
 {
     switch (type) {
@@ -785,6 +908,71 @@ UniValue getaddressutxos(const UniValue& params, bool fHelp)
     }
 }
 
+/** Number of transactions per page of getaddresstxids and getaddressdeltas when "limit" is not given */
+static const size_t DEFAULT_ADDRESS_INDEX_PAGE_SIZE = 1000;
+
+/** Pagination of the address index queries, requested with any of "limit", "cursor" or "reverse" */
+struct AddressIndexPage {
+    bool fPaged = false;
+    size_t nLimit = DEFAULT_ADDRESS_INDEX_PAGE_SIZE;
+    bool fReverse = false;
+    bool fHasCursor = false;
+    CAddressIndexKey cursor;
+};
+
+static AddressIndexPage getAddressIndexPageFromParams(const UniValue& params,
+                                                      const std::vector<std::pair<uint160, AddressType>>& addresses)
+{
+    AddressIndexPage page;
+    if (!params[0].isObject())
+        return page;
+
+    UniValue limitValue = find_value(params[0].get_obj(), "limit");
+    UniValue cursorValue = find_value(params[0].get_obj(), "cursor");
+    UniValue reverseValue = find_value(params[0].get_obj(), "reverse");
+    page.fPaged = !limitValue.isNull() || !cursorValue.isNull() || !reverseValue.isNull();
+    if (!page.fPaged)
+        return page;
+
+    if (addresses.size() != 1) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Pagination is only supported for a single address");
+    }
+    if (!limitValue.isNull()) {
+        if (limitValue.get_int() <= 0) {
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Limit is expected to be greater than zero");
+        }
+        page.nLimit = limitValue.get_int();
+    }
+    if (!reverseValue.isNull()) {
+        page.fReverse = reverseValue.get_bool();
+    }
+    if (!cursorValue.isNull()) {
+        // the cursor is the serialized last entry of the previous page, it must belong to the queried address
+        if (!IsHex(cursorValue.get_str())) {
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid cursor");
+        }
+        std::vector<unsigned char> cursorData(ParseHex(cursorValue.get_str()));
+        CDataStream ssCursor(cursorData, SER_DISK, CLIENT_VERSION);
+        try {
+            ssCursor >> page.cursor;
+        } catch (const std::exception&) {
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid cursor");
+        }
+        if (!ssCursor.empty() || page.cursor.type != addresses[0].second || page.cursor.hashBytes != addresses[0].first) {
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid cursor");
+        }
+        page.fHasCursor = true;
+    }
+    return page;
+}
+
+static std::string getAddressIndexCursor(const CAddressIndexKey& key)
+{
+    CDataStream ssCursor(SER_DISK, CLIENT_VERSION);
+    ssCursor << key;
+    return HexStr(ssCursor.begin(), ssCursor.end());
+}
+
 UniValue getaddressdeltas(const UniValue& params, bool fHelp)
 {
     if (fHelp || params.size() != 1 || !params[0].isObject())
@@ -797,6 +985,9 @@ UniValue getaddressdeltas(const UniValue& params, bool fHelp)
             "  \"start\"         (number) The start block height\n"
             "  \"end\"           (number) The end block height\n"
             "  \"chainInfo\"     (boolean) Include chain info in results, only applies if start and end specified\n"
+            "  \"limit\"         (number, optional) Return the deltas of at most this many transactions, and a cursor to the next page\n"
+            "  \"cursor\"        (string, optional) The cursor returned with the previous page\n"
+            "  \"reverse\"       (boolean, optional, default=false) Return the most recent deltas first\n"
             "}\n"
             "\nArguments (option 2):\n"
             "{\n"
@@ -819,6 +1010,11 @@ UniValue getaddressdeltas(const UniValue& params, bool fHelp)
             "    \"address\"     (string) The base58check encoded address\n"
             "  }\n"
             "]\n"
+            "\nResult (with pagination, a single address only):\n"
+            "{\n"
+            "  \"deltas\": [...],  (array) The deltas, as above\n"
+            "  \"cursor\"          (string) Present if more deltas are left: pass it to get the next page\n"
+            "}\n"
             "\nExamples:\n"
             + HelpExampleCli("getaddressdeltas", "'{\"addresses\": [\"12c6DSiU4Rq3P4ZxziKxzrL5LmMBrzjrJX\"]}'")
             + HelpExampleRpc("getaddressdeltas", "{\"addresses\": [\"12c6DSiU4Rq3P4ZxziKxzrL5LmMBrzjrJX\"]}")
@@ -864,9 +1060,21 @@ UniValue getaddressdeltas(const UniValue& params, bool fHelp)
         throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid address");
     }
 
+    const AddressIndexPage page = getAddressIndexPageFromParams(params, addresses);
+
     std::vector<std::pair<CAddressIndexKey, CAddressIndexValue> > addressIndex;
+    bool fMore = false;
+
+    if (page.fPaged) {
+        if (!GetAddressIndexPage(addresses[0].first, addresses[0].second, page.fHasCursor ? &page.cursor : nullptr,
+                                 page.fReverse, page.nLimit, start, end, addressIndex, fMore)) {
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
+        }
+    }
 
     for (const auto& [addressHash, addressType] : addresses) {
+        if (page.fPaged)
+            break;
         if (start > 0 && end > 0) {
             if (!GetAddressIndex(addressHash, addressType, addressIndex, start, end)) {
                 throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
@@ -898,6 +1106,12 @@ UniValue getaddressdeltas(const UniValue& params, bool fHelp)
 
     UniValue result(UniValue::VOBJ);
 
+    if (page.fPaged) {
+        result.pushKV("deltas", deltas);
+        if (fMore)
+            result.pushKV("cursor", getAddressIndexCursor(addressIndex.back().first));
+    }
+
     if (includeChainInfo && start > 0 && end > 0) {
         LOCK(cs_main);
 
@@ -917,10 +1131,13 @@ UniValue getaddressdeltas(const UniValue& params, bool fHelp)
         endInfo.pushKV("hash", endIndex->GetBlockHash().GetHex());
         endInfo.pushKV("height", end);
 
-        result.pushKV("deltas", deltas);
+        if (!page.fPaged)
+            result.pushKV("deltas", deltas);
         result.pushKV("start", startInfo);
         result.pushKV("end", endInfo);
 
+        return result;
+    } else if (page.fPaged) {
         return result;
     } else {
         return deltas;
@@ -952,6 +1169,7 @@ UniValue getaddressbalance(const UniValue& params, bool fHelp)
             "  \"balance\"            (string) The current balance in satoshis\n"
             "  \"received\"           (string) The total number of satoshis received (including change)\n"
             "  \"immature\"           (string) The current immature balance in satoshis\n"
+            "  \"txcount\"            (numeric) The number of transactions involving each address, summed over the addresses\n"
             "}\n"
             "\nExamples:\n"
             + HelpExampleCli("getaddressbalance", "'{\"addresses\": [\"znXWB3XGptd5T3jA9VuoGEEnVTAVHejj5bB\"]}'")
@@ -977,20 +1195,51 @@ UniValue getaddressbalance(const UniValue& params, bool fHelp)
     if (params.size() > 1)
         includeImmatureBTs = params[1].get_bool();
 
+    CAmount balance = 0;
+    CAmount received = 0;
+    CAmount immature = 0;
+    int64_t txCount = 0;
+
+    int currentTipHeight = chainActive.Tip()->nHeight;
+
+    // Indexes built with per-address aggregates answer without reading the history of the addresses
+    CAddressAggregateValue aggregate;
+    if (!addresses.empty() && GetAddressAggregate(addresses[0].first, addresses[0].second, aggregate)) {
+        for (const auto& [addressHash, addressType] : addresses) {
+            if (!GetAddressAggregate(addressHash, addressType, aggregate)) {
+                throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
+            }
+            // what is still maturing is only made of received backward transfers
+            const CAmount addressImmature = aggregate.GetImmature(currentTipHeight);
+            immature += addressImmature;
+            balance += aggregate.balance - (includeImmatureBTs ? 0 : addressImmature);
+            received += aggregate.received - (includeImmatureBTs ? 0 : addressImmature);
+            txCount += aggregate.txCount;
+        }
+
+        UniValue result(UniValue::VOBJ);
+        result.pushKV("balance", balance);
+        result.pushKV("received", received);
+        result.pushKV("immature", immature);
+        result.pushKV("txcount", txCount);
+
+        return result;
+    }
+
     std::vector<std::pair<CAddressIndexKey, CAddressIndexValue> > addressIndex;
 
     for (const auto& [addressHash, addressType] : addresses) {
-        if (!GetAddressIndex(addressHash, addressType, addressIndex)) {
+        std::vector<std::pair<CAddressIndexKey, CAddressIndexValue> > addressEntries;
+        if (!GetAddressIndex(addressHash, addressType, addressEntries)) {
             throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
         }
+        std::set<uint256> txids;
+        for (const std::pair<CAddressIndexKey, CAddressIndexValue>& entry : addressEntries)
+            txids.insert(entry.first.txhash);
+        txCount += txids.size();
+        addressIndex.insert(addressIndex.end(), addressEntries.begin(), addressEntries.end());
     }
 
-    CAmount balance = 0;
-    CAmount received = 0;
-    CAmount immature = 0;
-
-    int currentTipHeight = chainActive.Tip()->nHeight;
-
     for (std::vector<std::pair<CAddressIndexKey, CAddressIndexValue> >::const_iterator it=addressIndex.begin(); it!=addressIndex.end(); ++it) {
         //If maturityHeight is negative it's superseded and we skip it
         if (it->second.maturityHeight < 0)
@@ -1018,6 +1267,7 @@ UniValue getaddressbalance(const UniValue& params, bool fHelp)
     result.pushKV("balance", balance);
     result.pushKV("received", received);
     result.pushKV("immature", immature);
+    result.pushKV("txcount", txCount);
 
     return result;
 
@@ -1034,6 +1284,9 @@ UniValue getaddresstxids(const UniValue& params, bool fHelp)
             "  \"address\"         (string) The base58check encoded address\n"
             "  \"start\"           (number) The start block height\n"
             "  \"end\"             (number) The end block height\n"
+            "  \"limit\"           (number, optional) Return at most this many txids, and a cursor to the next page\n"
+            "  \"cursor\"          (string, optional) The cursor returned with the previous page\n"
+            "  \"reverse\"         (boolean, optional, default=false) Return the most recent txids first\n"
             "}\n"
             "\nArguments (option 2):\n"
             "{\n"
@@ -1050,6 +1303,11 @@ UniValue getaddresstxids(const UniValue& params, bool fHelp)
             "  \"transactionid\"   (string) The transaction id\n"
             "  ,...\n"
             "]\n"
+            "\nResult (with pagination, a single address only):\n"
+            "{\n"
+            "  \"txids\": [...],   (array) The transaction ids, as above\n"
+            "  \"cursor\"          (string) Present if more txids are left: pass it to get the next page\n"
+            "}\n"
             "\nExamples:\n"
             + HelpExampleCli("getaddresstxids", "'{\"addresses\": [\"12c6DSiU4Rq3P4ZxziKxzrL5LmMBrzjrJX\"]}'")
             + HelpExampleRpc("getaddresstxids", "{\"addresses\": [\"12c6DSiU4Rq3P4ZxziKxzrL5LmMBrzjrJX\"]}")
@@ -1081,8 +1339,31 @@ UniValue getaddresstxids(const UniValue& params, bool fHelp)
         }
     }
 
+    const AddressIndexPage page = getAddressIndexPageFromParams(params, addresses);
+
     std::vector<std::pair<CAddressIndexKey, CAddressIndexValue> > addressIndex;
 
+    if (page.fPaged) {
+        // pages never split the entries of a transaction, so the txids of a page are distinct
+        bool fMore = false;
+        if (!GetAddressIndexPage(addresses[0].first, addresses[0].second, page.fHasCursor ? &page.cursor : nullptr,
+                                 page.fReverse, page.nLimit, start, end, addressIndex, fMore)) {
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
+        }
+
+        UniValue txidsPage(UniValue::VARR);
+        for (size_t i = 0; i < addressIndex.size(); i++) {
+            if (i == 0 || addressIndex[i].first.txhash != addressIndex[i - 1].first.txhash)
+                txidsPage.push_back(addressIndex[i].first.txhash.GetHex());
+        }
+
+        UniValue result(UniValue::VOBJ);
+        result.pushKV("txids", txidsPage);
+        if (fMore)
+            result.pushKV("cursor", getAddressIndexCursor(addressIndex.back().first));
+        return result;
+    }
+
     for (const auto& [addressHash, addressType] : addresses) {
         if (start > 0 && end > 0) {
             if (!GetAddressIndex(addressHash, addressType, addressIndex, start, end)) {
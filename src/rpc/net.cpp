@@ -68,25 +68,13 @@ UniValue ping(const UniValue& params, bool fHelp)
     return NullUniValue;
 }
 
-static void CopyNodeStats(std::vector<CNodeStats>& vstats)
-{
-    vstats.clear();
-
-    LOCK(connman->cs_vNodes);
-    vstats.reserve(connman->vNodes.size());
-    BOOST_FOREACH(CNode* pnode, connman->vNodes) {
-        CNodeStats stats;
-        pnode->copyStats(stats);
-        vstats.push_back(stats);
-    }
-}
-
 UniValue getpeerinfo(const UniValue& params, bool fHelp)
 {
     if (fHelp || params.size() != 0)
         throw runtime_error(
             "getpeerinfo\n"
             "\nReturns data about each connected network node as a json array of objects.\n"
+            "The statistics are taken at most " + std::to_string(PEER_STATS_INTERVAL) + " second(s) before the call.\n"
             
             "\nResult:\n"
             "[\n"
@@ -97,6 +85,8 @@ UniValue getpeerinfo(const UniValue& params, bool fHelp)
             "    \"services\":\"xxxxxxxxxxxxxxxx\",      (string) the services offered\n"
             "    \"tls_established\": true|false,        (boolean) status of TLS connection\n"
             "    \"tls_verified\": true|false,           (boolean) status of peer certificate. True if the chain of trust of a peer certificate can be verified using the OS certificate store\n"
+            "    \"tls_resumed\": true|false,            (boolean) true if the TLS session was resumed from an earlier connection\n"
+            "    \"tls_handshake_time\": n,              (numeric) the time of the TLS handshake in seconds\n"
             "    \"lastsend\": ttt,                      (numeric) the time in seconds since epoch (Jan 1 1970 GMT) of the last send\n"
             "    \"lastrecv\": ttt,                      (numeric) the time in seconds since epoch (Jan 1 1970 GMT) of the last receive\n"
             "    \"bytessent\": n,                       (numeric) the total bytes sent\n"
@@ -124,6 +114,7 @@ UniValue getpeerinfo(const UniValue& params, bool fHelp)
             "    \"timeoffset\": ttt,                    (numeric) the time offset in seconds\n"
             "    \"pingtime\": n,                        (numeric) ping time\n"
             "    \"pingwait\": n,                        (numeric) ping wait\n"
+            "    \"proofverificationcost\": n,           (numeric) the seconds recently spent verifying the sidechain proofs sent by the peer, halved every 10 minutes\n"
             "    \"version\": v,                         (numeric) the protocol version of the peer\n"
             "    \"subver\": \"/zen:x.y.z[-v]/\",        (string) the user agent of the peer\n"
             "    \"inbound\": true|false,                (boolean) inbound (true) or outbound (false)\n"
@@ -135,6 +126,9 @@ UniValue getpeerinfo(const UniValue& params, bool fHelp)
             "       n,                                   (numeric) the heights of blocks we're currently asking from this peer\n"
             "       ...\n"
             "    ],\n"
+            "    \"blockdownloadrate\": n,               (numeric) the measured block download throughput from this peer, in bytes per second\n"
+            "    \"blocklatency\": n,                    (numeric) the measured time between requesting a block from this peer and receiving it, in seconds\n"
+            "    \"blockwindow\": n,                     (numeric) the number of blocks that can be in flight from this peer at once\n"
             "    \"whitelisted\": true|false             (boolean) whether the peer is whitelisted\n"
             "  }\n"
             "  ,...\n"
@@ -145,17 +139,15 @@ UniValue getpeerinfo(const UniValue& params, bool fHelp)
             + HelpExampleRpc("getpeerinfo", "")
         );
 
-    LOCK(cs_main);
-
-    vector<CNodeStats> vstats;
-    CopyNodeStats(vstats);
+    std::shared_ptr<const CPeerStatsSnapshot> snapshot = GetPeerStatsSnapshot();
 
     UniValue ret(UniValue::VARR);
 
-    BOOST_FOREACH(const CNodeStats& stats, vstats) {
+    for (const CPeerStats& peer : snapshot->vPeers) {
+        const CNodeStats& stats = peer.stats;
+        const CNodeStateStats& statestats = peer.statestats;
+        const bool fStateStats = peer.fStateStats;
         UniValue obj(UniValue::VOBJ);
-        CNodeStateStats statestats;
-        bool fStateStats = GetNodeStateStats(stats.nodeid, statestats);
         obj.pushKV("id", stats.nodeid);
         obj.pushKV("addr", stats.addrName);
         if (!(stats.addrLocal.empty()))
@@ -163,6 +155,8 @@ UniValue getpeerinfo(const UniValue& params, bool fHelp)
         obj.pushKV("services", strprintf("%016x", stats.nServices));
         obj.pushKV("tls_established", stats.fTLSEstablished);
         obj.pushKV("tls_verified", stats.fTLSVerified);
+        obj.pushKV("tls_resumed", stats.fTLSResumed);
+        obj.pushKV("tls_handshake_time", stats.dTLSHandshakeTime);
         obj.pushKV("lastsend", stats.nLastSend);
         obj.pushKV("lastrecv", stats.nLastRecv);
         obj.pushKV("bytessent", stats.nSendBytes);
@@ -195,6 +189,7 @@ UniValue getpeerinfo(const UniValue& params, bool fHelp)
         obj.pushKV("pingtime", stats.dPingTime);
         if (stats.dPingWait > 0.0)
             obj.pushKV("pingwait", stats.dPingWait);
+        obj.pushKV("proofverificationcost", stats.dProofVerificationCost);
         obj.pushKV("version", stats.nVersion);
         // Use the sanitized form of subver here, to avoid tricksy remote peers from
         // corrupting or modifiying the JSON output by putting special characters in
@@ -211,6 +206,9 @@ UniValue getpeerinfo(const UniValue& params, bool fHelp)
                 heights.push_back(height);
             }
             obj.pushKV("inflight", heights);
+            obj.pushKV("blockdownloadrate", statestats.dBlockBytesPerSec);
+            obj.pushKV("blocklatency", statestats.nBlockLatency / 1e6);
+            obj.pushKV("blockwindow", statestats.nBlockWindow);
             obj.pushKV("addr_processed", stats.m_addr_processed);
             obj.pushKV("addr_rate_limited", stats.m_addr_rate_limited);
         }
@@ -449,6 +447,22 @@ UniValue getnettotals(const UniValue& params, bool fHelp)
     return obj;
 }
 
+static UniValue GetTLSHandshakesInfo()
+{
+    UniValue handshakes(UniValue::VOBJ);
+    for (bool fInbound : {true, false})
+    {
+        const CConnman::TLSHandshakeStats stats = connman->GetTLSHandshakeStats(fInbound);
+        UniValue obj(UniValue::VOBJ);
+        obj.pushKV("count", stats.nCount);
+        obj.pushKV("resumed", stats.nResumed);
+        obj.pushKV("resumption_rate", stats.nCount ? (double)stats.nResumed / stats.nCount : 0.0);
+        obj.pushKV("avg_time", stats.nCount ? (double)stats.nTotalTime / stats.nCount / 1e6 : 0.0);
+        handshakes.pushKV(fInbound ? "inbound" : "outbound", obj);
+    }
+    return handshakes;
+}
+
 static UniValue GetNetworksInfo()
 {
     UniValue networks(UniValue::VARR);
@@ -486,6 +500,14 @@ UniValue getnetworkinfo(const UniValue& params, bool fHelp)
             "  \"timeoffset\": 0,                             (numeric) the time offset (deprecated; always 0)\n"
             "  \"connections\": xxxxx,                        (numeric) the total number of open connections for the node\n"
             "  \"tls_cert_verified\": true|flase,             (boolean) true if the certificate of the current node is verified\n"
+            "  \"tls_handshakes\": {                         (object) the TLS handshakes since the node started\n"
+            "    \"inbound\"|\"outbound\": {\n"
+            "      \"count\": n,                              (numeric) the number of established TLS sessions\n"
+            "      \"resumed\": n,                            (numeric) how many of them resumed an earlier session\n"
+            "      \"resumption_rate\": x.xxx,                (numeric) resumed / count\n"
+            "      \"avg_time\": x.xxx                        (numeric) the average handshake time in seconds\n"
+            "    }\n"
+            "  },\n"
             "  \"networks\": [                                (array) an array of objects describing IPV4, IPV6 and Onion network status\n"
             "  {\n"
             "    \"name\": \"xxx\",                           (string) network (ipv4, ipv6 or onion)\n"
@@ -524,6 +546,7 @@ UniValue getnetworkinfo(const UniValue& params, bool fHelp)
     obj.pushKV("timeoffset",    0);
     obj.pushKV("connections",   (int)(connman->vNodes.size()));
     obj.pushKV("tls_cert_verified", ValidateCertificate(tls_ctx_server));
+    obj.pushKV("tls_handshakes", GetTLSHandshakesInfo());
     obj.pushKV("networks",      GetNetworksInfo());
     obj.pushKV("relayfee",      ValueFromAmount(::minRelayTxFee.GetFeePerK()));
     UniValue localAddresses(UniValue::VARR);
@@ -47,10 +47,38 @@ UniValue JSONRPCReplyObj(const UniValue& result, const UniValue& error, const Un
     return reply;
 }
 
+UniValue JSONRPCReplyObj(UniValue&& result, UniValue&& error, const UniValue& id)
+{
+    UniValue reply(UniValue::VOBJ);
+    if (!error.isNull())
+        reply.pushKV("result", NullUniValue);
+    else
+        reply.pushKV("result", std::move(result));
+    reply.pushKV("error", std::move(error));
+    reply.pushKV("id", id);
+    return reply;
+}
+
+void JSONRPCWriteReply(UniValueWriter& writer, const UniValue& result, const UniValue& error, const UniValue& id)
+{
+    writer.startObject();
+    writer.key("result");
+    writer.value(error.isNull() ? result : NullUniValue);
+    writer.key("error");
+    writer.value(error);
+    writer.key("id");
+    writer.value(id);
+    writer.endObject();
+}
+
 string JSONRPCReply(const UniValue& result, const UniValue& error, const UniValue& id)
 {
-    UniValue reply = JSONRPCReplyObj(result, error, id);
-    return reply.write() + "\n";
+    // the result is serialized straight into the reply, it can be most of it
+    string strReply;
+    UniValueWriter writer(strReply);
+    JSONRPCWriteReply(writer, result, error, id);
+    strReply += "\n";
+    return strReply;
 }
 
 UniValue JSONRPCError(int code, const string& message)
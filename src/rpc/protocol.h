@@ -81,6 +81,10 @@ enum RPCErrorCode
 
 std::string JSONRPCRequest(const std::string& strMethod, const UniValue& params, const UniValue& id);
 UniValue JSONRPCReplyObj(const UniValue& result, const UniValue& error, const UniValue& id);
+/** Build the reply object moving the result and error into it, instead of copying them */
+UniValue JSONRPCReplyObj(UniValue&& result, UniValue&& error, const UniValue& id);
+/** Write the reply object to writer as it goes, without building it */
+void JSONRPCWriteReply(UniValueWriter& writer, const UniValue& result, const UniValue& error, const UniValue& id);
 std::string JSONRPCReply(const UniValue& result, const UniValue& error, const UniValue& id);
 UniValue JSONRPCError(int code, const std::string& message);
 
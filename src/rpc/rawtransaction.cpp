@@ -4,6 +4,7 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "base58.h"
+#include "blockview.h"
 #include "consensus/validation.h"
 #include "core_io.h"
 #include "init.h"
@@ -23,6 +24,9 @@
 #include "wallet/wallet.h"
 #endif
 
+#include <algorithm>
+#include <future>
+#include <map>
 #include <stdint.h>
 #include <string>
 
@@ -517,11 +521,9 @@ UniValue getrawtransaction(const UniValue& params, bool fHelp)
     
     uint256 hashBlock{};
 
-    {
-        LOCK(cs_main);
-        if (!GetTxBaseObj(hash, pTxBase, hashBlock, true) || !pTxBase)
-            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available about transaction");
-    }
+    // the mempool and txindex lookups take the locks they need, the slow path takes cs_main
+    if (!GetTxBaseObj(hash, pTxBase, hashBlock, true) || !pTxBase)
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available about transaction");
 
     std::string strHex = EncodeHex(pTxBase);
 
@@ -546,6 +548,126 @@ UniValue getrawtransaction(const UniValue& params, bool fHelp)
     return result;
 }
 
+/** The most transactions a getrawtransactions call can look up */
+static const size_t MAX_GETRAWTRANSACTIONS = 1000;
+
+UniValue getrawtransactions(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() < 1 || params.size() > 2)
+        throw runtime_error(
+            "getrawtransactions [\"txid\",...] ( verbose )\n"
+            "\nReturn the raw data of several transactions or certificates, as getrawtransaction does for one.\n"
+            "With -txindex, the confirmed ones are read from disk sorted by their position in the block files,\n"
+            "which is much faster than one getrawtransaction call for each of them.\n"
+
+            "\nArguments:\n"
+            "1. \"txids\"                         (array, required) at most " + std::to_string(MAX_GETRAWTRANSACTIONS) + " transaction ids\n"
+            "2. verbose                           (numeric, optional, default=0) if 0, return strings, other return json objects\n"
+
+            "\nResult:\n"
+            "[                                    (array) in the order of the txids, null for those not found\n"
+            "  \"hex\" or {...}                  (string or object) as the result of getrawtransaction\n"
+            "  ,...\n"
+            "]\n"
+
+            "\nExamples:\n"
+            + HelpExampleCli("getrawtransactions", "'[\"mytxid\",\"myothertxid\"]'")
+            + HelpExampleCli("getrawtransactions", "'[\"mytxid\",\"myothertxid\"]' 1")
+            + HelpExampleRpc("getrawtransactions", "[\"mytxid\",\"myothertxid\"], 1")
+        );
+
+    const UniValue& txids = params[0].get_array();
+    if (txids.size() > MAX_GETRAWTRANSACTIONS)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, strprintf("At most %u txids can be looked up at once", MAX_GETRAWTRANSACTIONS));
+
+    std::vector<uint256> vHash;
+    for (size_t i = 0; i < txids.size(); i++)
+        vHash.push_back(ParseHashV(txids[i], "txid"));
+
+    bool fVerbose = false;
+    if (params.size() > 1)
+        fVerbose = (params[1].get_int() != 0);
+
+    std::vector<std::unique_ptr<CTransactionBase>> vTxBase;
+    std::vector<uint256> vHashBlock;
+    GetTxBaseObjs(vHash, vTxBase, vHashBlock, true);
+
+    UniValue result(UniValue::VARR);
+    for (size_t i = 0; i < vTxBase.size(); i++) {
+        if (!vTxBase[i]) {
+            result.push_back(NullUniValue);
+            continue;
+        }
+
+        std::string strHex = EncodeHex(vTxBase[i]);
+        if (!fVerbose) {
+            result.push_back(strHex);
+            continue;
+        }
+
+        UniValue entry(UniValue::VOBJ);
+        try {
+            if (vTxBase[i]->IsCertificate())
+                CertToJSON(dynamic_cast<const CScCertificate&>(*vTxBase[i]), vHashBlock[i], entry);
+            else
+                TxToJSON(dynamic_cast<const CTransaction&>(*vTxBase[i]), vHashBlock[i], entry);
+        } catch (std::exception& e) {
+            throw JSONRPCError(RPC_INTERNAL_ERROR, std::string("internal error: ") + std::string(e.what() ));
+        }
+        entry.pushKV("hex", strHex);
+        result.push_back(entry);
+    }
+    return result;
+}
+
+/**
+ * The block including txid: found from its unspent outputs or from the transaction index, nullptr if
+ * it is not in a block or only the slow scan could tell.
+ */
+static CBlockIndex* FindTxBaseBlock(const uint256& txid)
+{
+    AssertLockHeld(cs_main);
+    CCoins coins;
+    if (pcoinsTip->GetCoins(txid, coins) && coins.nHeight > 0 && coins.nHeight <= chainActive.Height())
+        return chainActive[coins.nHeight];
+
+    // allocated by the callee
+    std::unique_ptr<CTransactionBase> pTxBase;
+    uint256 hashBlock;
+    static const bool ALLOW_SLOW = false;
+    if (!GetTxBaseObj(txid, pTxBase, hashBlock, ALLOW_SLOW) || !pTxBase)
+        return nullptr;
+    BlockMap::iterator it = mapBlockIndex.find(hashBlock);
+    if (it == mapBlockIndex.end())
+        throw JSONRPCError(RPC_INTERNAL_ERROR, "Transaction/Certificate index corrupt");
+    return it->second;
+}
+
+//! The full merkle tree of the block, from merkleTreeCache or built from the hashes read from disk
+static std::shared_ptr<const CBlockMerkleTree> GetBlockMerkleTree(const CBlockIndex* pblockindex)
+{
+    std::shared_ptr<const CBlockMerkleTree> tree = merkleTreeCache.Get(pblockindex->GetBlockHash());
+    if (tree)
+        return tree;
+
+    // the proofs only need the header and the hashes, the block is not kept
+    CBlockView blockView;
+    std::vector<uint256> vHashes;
+    if (!blockView.Open(pblockindex->GetBlockPos()) || blockView.GetHeader().GetHash() != pblockindex->GetBlockHash() ||
+        !blockView.GetHashes(vHashes))
+        throw JSONRPCError(RPC_INTERNAL_ERROR, "Can't read block from disk");
+    tree = std::make_shared<const CBlockMerkleTree>(std::move(vHashes));
+    merkleTreeCache.Insert(pblockindex->GetBlockHash(), tree);
+    return tree;
+}
+
+static std::string EncodeMerkleBlock(const CMerkleBlock& mb)
+{
+    CDataStream ssMB(SER_NETWORK, PROTOCOL_VERSION);
+    ssMB << mb;
+    return HexStr(ssMB.begin(), ssMB.end());
+}
+
 UniValue gettxoutproof(const UniValue& params, bool fHelp)
 {
     if (fHelp || (params.size() != 1 && params.size() != 2))
@@ -591,52 +713,126 @@ UniValue gettxoutproof(const UniValue& params, bool fHelp)
     LOCK(cs_main);
 
     CBlockIndex* pblockindex = NULL;
-
-    uint256 hashBlock;
     if (params.size() > 1)
     {
-        hashBlock = uint256S(params[1].get_str());
+        uint256 hashBlock = uint256S(params[1].get_str());
         if (!mapBlockIndex.count(hashBlock))
             throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
         pblockindex = mapBlockIndex[hashBlock];
     } else {
-        CCoins coins;
-        if (pcoinsTip->GetCoins(oneTxid, coins) && coins.nHeight > 0 && coins.nHeight <= chainActive.Height())
-            pblockindex = chainActive[coins.nHeight];
+        pblockindex = FindTxBaseBlock(oneTxid);
     }
 
     if (pblockindex == NULL)
-    {
-        // allocated by the callee
-        std::unique_ptr<CTransactionBase> pTxBase;
-        static const bool ALLOW_SLOW = false;
-        if (!GetTxBaseObj(oneTxid, pTxBase, hashBlock, ALLOW_SLOW) || !pTxBase)
-            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Transaction/Certificate not yet in block");
-        if (!mapBlockIndex.count(hashBlock))
-            throw JSONRPCError(RPC_INTERNAL_ERROR, "Transaction/Certificate index corrupt");
-        pblockindex = mapBlockIndex[hashBlock];
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Transaction/Certificate not yet in block");
+
+    std::shared_ptr<const CBlockMerkleTree> tree = GetBlockMerkleTree(pblockindex);
+    std::vector<unsigned int> vPos;
+    unsigned int nPos;
+    for (const uint256& hash : setTxids)
+        if (tree->Find(hash, nPos))
+            vPos.push_back(nPos);
+
+    if (vPos.size() != setTxids.size())
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "(Not all) transactions/Certificates not found in specified block");
+
+    std::sort(vPos.begin(), vPos.end());
+    return EncodeMerkleBlock(CMerkleBlock(pblockindex->GetBlockHeader(), *tree, vPos));
+}
+
+UniValue gettxoutproofs(const UniValue& params, bool fHelp)
+{
+    if (fHelp || (params.size() != 1 && params.size() != 2))
+        throw runtime_error(
+            "gettxoutproofs [\"txid\",...] ( blockhash )\n"
+            "\nReturns a proof for each of the given transactions/certificates, as gettxoutproof [\"txid\"] would.\n"
+            "The txids are grouped by block, and the merkle tree of each block is built once for all of its proofs.\n"
+            "As for gettxoutproof, the block of a txid is found from its unspent outputs, the -txindex, or the\n"
+            "blockhash given. A txid whose proof can't be made gets an error instead, the others are still returned.\n"
+
+            "\nArguments:\n"
+            "1. \"txids\"       (string) a json array of txids\n"
+            "    [\n"
+            "      \"txid\"     (string) A transaction/certificate hash\n"
+            "      ,...\n"
+            "    ]\n"
+            "2. \"block hash\"  (string, optional) if specified, looks for all the txids in the block with this hash\n"
+
+            "\nResult:\n"
+            "[                    (array) in the order of the txids\n"
+            "  {\n"
+            "    \"txid\": \"hash\",      (string) the transaction/certificate hash\n"
+            "    \"blockhash\": \"hash\", (string) the hash of the block including it\n"
+            "    \"proof\": \"hex\",      (string) the hex-encoded proof, as returned by gettxoutproof\n"
+            "    \"error\": \"message\"   (string) instead of blockhash and proof, if the proof can't be made\n"
+            "  }\n"
+            "  ,...\n"
+            "]\n"
+
+            "\nExamples:\n"
+            + HelpExampleCli("gettxoutproofs", "[\"txid\",\"txid\"]")
+            + HelpExampleRpc("gettxoutproofs", "[\"txid\",\"txid\"]")
+        );
+
+    std::vector<uint256> vTxids;
+    UniValue txids = params[0].get_array();
+    for (size_t idx = 0; idx < txids.size(); idx++) {
+        const UniValue& txid = txids[idx];
+        if (txid.get_str().length() != 64 || !IsHex(txid.get_str()))
+            throw JSONRPCError(RPC_INVALID_PARAMETER, string("Invalid txid ")+txid.get_str());
+        vTxids.push_back(uint256S(txid.get_str()));
     }
 
-    CBlock block;
-    if(!ReadBlockFromDisk(block, pblockindex))
-        throw JSONRPCError(RPC_INTERNAL_ERROR, "Can't read block from disk");
+    std::vector<std::string> vErrors(vTxids.size());
+    std::vector<std::pair<const CBlockIndex*, std::string>> vProofs(vTxids.size());
+    {
+        LOCK(cs_main);
 
-    unsigned int ntxFound = 0;
-    for (const CTransaction& tx: block.vtx)
-        if (setTxids.count(tx.GetHash()))
-            ntxFound++;
-    for (const CScCertificate& cert: block.vcert)
-        if (setTxids.count(cert.GetHash()))
-            ntxFound++;
+        CBlockIndex* pblockindexGiven = NULL;
+        if (params.size() > 1)
+        {
+            BlockMap::iterator it = mapBlockIndex.find(uint256S(params[1].get_str()));
+            if (it == mapBlockIndex.end())
+                throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
+            pblockindexGiven = it->second;
+        }
 
-    if (ntxFound != setTxids.size())
-        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "(Not all) transactions/Certificates not found in specified block");
+        // the txids by block, each tree being cut once per txid
+        std::map<CBlockIndex*, std::vector<size_t>> mapByBlock;
+        for (size_t i = 0; i < vTxids.size(); i++) {
+            CBlockIndex* pblockindex = pblockindexGiven ? pblockindexGiven : FindTxBaseBlock(vTxids[i]);
+            if (pblockindex == NULL)
+                vErrors[i] = "Transaction/Certificate not yet in block";
+            else
+                mapByBlock[pblockindex].push_back(i);
+        }
 
-    CDataStream ssMB(SER_NETWORK, PROTOCOL_VERSION);
-    CMerkleBlock mb(block, setTxids);
-    ssMB << mb;
-    std::string strHex = HexStr(ssMB.begin(), ssMB.end());
-    return strHex;
+        for (const auto& group : mapByBlock) {
+            std::shared_ptr<const CBlockMerkleTree> tree = GetBlockMerkleTree(group.first);
+            const CBlockHeader header = group.first->GetBlockHeader();
+            unsigned int nPos;
+            for (size_t i : group.second) {
+                if (!tree->Find(vTxids[i], nPos))
+                    vErrors[i] = "Transaction/Certificate not found in the block";
+                else
+                    vProofs[i] = std::make_pair(group.first, EncodeMerkleBlock(CMerkleBlock(header, *tree, {nPos})));
+            }
+        }
+    }
+
+    UniValue result(UniValue::VARR);
+    for (size_t i = 0; i < vTxids.size(); i++) {
+        UniValue entry(UniValue::VOBJ);
+        entry.pushKV("txid", vTxids[i].GetHex());
+        if (!vErrors[i].empty()) {
+            entry.pushKV("error", vErrors[i]);
+        } else {
+            entry.pushKV("blockhash", vProofs[i].first->GetBlockHash().GetHex());
+            entry.pushKV("proof", vProofs[i].second);
+        }
+        result.push_back(entry);
+    }
+    return result;
 }
 
 UniValue verifytxoutproof(const UniValue& params, bool fHelp)
@@ -1433,6 +1629,8 @@ static void TxCswInErrorToJSON(const CTxCeasedSidechainWithdrawalInput& txcswin,
     vErrorsRet.push_back(entry);
 }
 
+static UniValue SignRawTransaction(const UniValue& hexTx, const UniValue& params);
+
 UniValue signrawtransaction(const UniValue& params, bool fHelp)
 {
     if (fHelp || params.size() < 1 || params.size() > 4)
@@ -1501,7 +1699,18 @@ UniValue signrawtransaction(const UniValue& params, bool fHelp)
 #endif
     RPCTypeCheck(params, boost::assign::list_of(UniValue::VSTR)(UniValue::VARR)(UniValue::VARR)(UniValue::VSTR), true);
 
-    vector<unsigned char> txData(ParseHexV(params[0], "argument 1"));
+    return SignRawTransaction(params[0], params);
+}
+
+/**
+ * Sign the transaction or certificate in hexTx, with the prevtxs, privatekeys and sighashtype at
+ * params[1], params[2] and params[3] as signrawtransaction takes them
+ */
+static UniValue SignRawTransaction(const UniValue& hexTx, const UniValue& params)
+{
+    AssertLockHeld(cs_main);
+
+    vector<unsigned char> txData(ParseHexV(hexTx, "argument 1"));
     CDataStream ssData(txData, SER_NETWORK, PROTOCOL_VERSION);
     CDataStream ssVersion(txData, SER_NETWORK, PROTOCOL_VERSION);
     vector<CMutableTransaction> txVariants;
@@ -1664,70 +1873,87 @@ UniValue signrawtransaction(const UniValue& params, bool fHelp)
 
         bool fHashSingle = ((nHashType & ~SIGHASH_ANYONECANPAY) == SIGHASH_SINGLE);
 
-        // Script verification errors
-        UniValue vErrors(UniValue::VARR);
-
-        // Sign what we can:
-        for (unsigned int i = 0; i < mergedTx.vin.size(); i++) {
-            CTxIn& txin = mergedTx.vin[i];
+        // The input scripts are blanked out of the signature hashes, so that all the inputs are signed
+        // and checked against one snapshot of the transaction, and in parallel
+        const CTransaction txConst(mergedTx);
+        const CPrecomputedSigHash precomputed(txConst);
+        const unsigned int nRegularInputs = mergedTx.vin.size();
+        const unsigned int nTotalInputs = nRegularInputs + (mergedTx.IsScVersion() ? mergedTx.vcsw_ccin.size() : 0);
+
+        // the coins view is not thread safe, the scripts spent are looked up first
+        std::vector<CScript> vPrevPubKeys(nTotalInputs);
+        std::vector<std::string> vInputErrors(nTotalInputs);
+        for (unsigned int i = 0; i < nRegularInputs; i++) {
+            const CTxIn& txin = mergedTx.vin[i];
             const CCoins* coins = view.AccessCoins(txin.prevout.hash);
-            if (coins == NULL || !coins->IsAvailable(txin.prevout.n)) {
-                TxInErrorToJSON(txin, vErrors, "Input not found or already spent");
-                continue;
-            }
-            const CScript& prevPubKey = coins->vout[txin.prevout.n].scriptPubKey;
+            if (coins == NULL || !coins->IsAvailable(txin.prevout.n))
+                vInputErrors[i] = "Input not found or already spent";
+            else
+                vPrevPubKeys[i] = coins->vout[txin.prevout.n].scriptPubKey;
+        }
+        for (unsigned int i = nRegularInputs; i < nTotalInputs; i++)
+            vPrevPubKeys[i] = mergedTx.vcsw_ccin[i - nRegularInputs].scriptPubKey();
 
-            txin.scriptSig.clear();
+        auto signInput = [&](unsigned int nIn) {
+            if (!vInputErrors[nIn].empty())
+                return;
+            const bool isRegularInput = nIn < nRegularInputs;
+            const CScript& prevPubKey = vPrevPubKeys[nIn];
+            CScript& scriptSig = isRegularInput ? mergedTx.vin[nIn].scriptSig : mergedTx.vcsw_ccin[nIn - nRegularInputs].redeemScript;
+
+            scriptSig.clear();
             // Only sign SIGHASH_SINGLE if there's a corresponding output:
-            if (!fHashSingle || (i < mergedTx.getVout().size()))
-                SignSignature(keystore, prevPubKey, mergedTx, i, nHashType);
+            // Note: for the CSW inputs we should consider the regular inputs as well.
+            if (!fHashSingle || (nIn < mergedTx.getVout().size()))
+                ProduceSignature(TransactionSignatureCreator(keystore, txConst, nIn, nHashType, &precomputed), prevPubKey, scriptSig);
 
             // ... and merge in other signatures:
-            BOOST_FOREACH(const CMutableTransaction& txv, txVariants) {
-                txin.scriptSig = CombineSignatures(prevPubKey, mergedTx, i, txin.scriptSig, txv.vin[i].scriptSig);
+            /* Note:
+             * For CTxCeasedSidechainWithdrawalInput currently only P2PKH is allowed.
+             * ProduceSignature can set the `txCswIn.redeemScript` value in case there is a proper private key in the keystore,
+             * or leave it empty in case of any error occurs.
+             * CombineSignatures will try to get the most recent signature:
+             * 1) if the signing was successful -> leave `txCswIn.redeemScript value as is.
+             * 2) if the signing was unsuccessful -> set `txCswIn.redeemScript value equal to the origin `txv` csw input script.
+             * Later the signature will be checked, so in case no origin signature and no new one exist -> verification will fail.
+             */
+            const TransactionSignatureChecker checker(&txConst, nIn, nullptr, &precomputed);
+            for (const CMutableTransaction& txv : txVariants) {
+                const CScript& scriptSigVariant = isRegularInput ? txv.vin[nIn].scriptSig : txv.vcsw_ccin[nIn - nRegularInputs].redeemScript;
+                scriptSig = CombineSignatures(prevPubKey, checker, scriptSig, scriptSigVariant);
             }
+
             ScriptError serror = SCRIPT_ERR_OK;
-            if (!VerifyScript(txin.scriptSig, prevPubKey, STANDARD_NONCONTEXTUAL_SCRIPT_VERIFY_FLAGS, MutableTransactionSignatureChecker(&mergedTx, i), &serror)) {
-                TxInErrorToJSON(txin, vErrors, ScriptErrorString(serror));
-            }
+            if (!VerifyScript(scriptSig, prevPubKey, STANDARD_NONCONTEXTUAL_SCRIPT_VERIFY_FLAGS, checker, &serror))
+                vInputErrors[nIn] = ScriptErrorString(serror);
+        };
+
+        const int nThreads = std::min<int>(std::max(1, nScriptCheckThreads), nTotalInputs / SIGN_PARALLEL_MIN_INPUTS);
+        if (nThreads > 1) {
+            auto worker = [&](int nWorker) {
+                for (unsigned int nIn = nWorker; nIn < nTotalInputs; nIn += nThreads)
+                    signInput(nIn);
+            };
+            std::vector<std::future<void>> vWorkers;
+            for (int n = 1; n < nThreads; n++)
+                vWorkers.push_back(std::async(std::launch::async, worker, n));
+            worker(0);
+            for (auto& f: vWorkers)
+                f.get();
+        } else {
+            for (unsigned int nIn = 0; nIn < nTotalInputs; nIn++)
+                signInput(nIn);
         }
 
-        if(mergedTx.IsScVersion())
-        {
-            // Try to sign CeasedSidechainWithdrawal inputs:
-            unsigned int nAllInputsIndex = mergedTx.vin.size();
-            for (unsigned int i = 0; i < mergedTx.vcsw_ccin.size(); i++, nAllInputsIndex++)
-            {
-                CTxCeasedSidechainWithdrawalInput& txCswIn = mergedTx.vcsw_ccin[i];
-
-                const CScript& prevPubKey = txCswIn.scriptPubKey();
-
-                txCswIn.redeemScript.clear();
-                // Only sign SIGHASH_SINGLE if there's a corresponding output:
-                // Note: we should consider the regular inputs as well.
-                if (!fHashSingle || (nAllInputsIndex < mergedTx.getVout().size()))
-                    SignSignature(keystore, prevPubKey, mergedTx, nAllInputsIndex, nHashType);
-
-                // ... and merge in other signatures:
-                /* Note:
-                 * For CTxCeasedSidechainWithdrawalInput currently only P2PKH is allowed.
-                 * SignSignature can return true and set `txCswIn.redeemScript` value in case there is a proper private key in the keystore.
-                 * It can return false and leave `txCswIn.redeemScript` empty in case of any error occurs.
-                 * CombineSignatures will try to get the most recent signature:
-                 * 1) if SignSignature operation was successful -> leave `txCswIn.redeemScript value as is.
-                 * 2) if SignSignature operation was unsuccessful -> set `txCswIn.redeemScript value equal to the origin `txv` csw input script.
-                 * Later the signature will be checked, so in case no origin signature and no new one exist -> verification will fail.
-                 */
-                for(const CMutableTransaction& txv : txVariants)
-                    txCswIn.redeemScript = CombineSignatures(prevPubKey, mergedTx, nAllInputsIndex, txCswIn.redeemScript, txv.vcsw_ccin[i].redeemScript);
-
-                ScriptError serror = SCRIPT_ERR_OK;
-                if (!VerifyScript(txCswIn.redeemScript, prevPubKey, STANDARD_NONCONTEXTUAL_SCRIPT_VERIFY_FLAGS,
-                                  MutableTransactionSignatureChecker(&mergedTx, nAllInputsIndex), &serror))
-                {
-                    TxCswInErrorToJSON(txCswIn, i, vErrors, ScriptErrorString(serror));
-                }
-            }
+        // Script verification errors
+        UniValue vErrors(UniValue::VARR);
+        for (unsigned int i = 0; i < nTotalInputs; i++) {
+            if (vInputErrors[i].empty())
+                continue;
+            if (i < nRegularInputs)
+                TxInErrorToJSON(mergedTx.vin[i], vErrors, vInputErrors[i]);
+            else
+                TxCswInErrorToJSON(mergedTx.vcsw_ccin[i - nRegularInputs], i - nRegularInputs, vErrors, vInputErrors[i]);
         }
 
         bool fComplete = vErrors.empty();
@@ -1780,6 +2006,53 @@ UniValue signrawtransaction(const UniValue& params, bool fHelp)
     }
 }
 
+UniValue signrawtransactions(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() < 1 || params.size() > 4)
+        throw runtime_error(
+            "signrawtransactions [\"hexstring\",...] ( [{\"txid\":\"id\",\"vout\":n,\"scriptPubKey\":\"hex\",\"redeemScript\":\"hex\"},...] [\"privatekey1\",...] sighashtype )\n"
+            "\nSign the inputs of many raw transactions or certificates (serialized, hex-encoded) at once, as signrawtransaction\n"
+            "does for each one of them with the same optional arguments.\n"
+#ifdef ENABLE_WALLET
+            + HelpRequiringPassphrase() + "\n"
+#endif
+
+            "\nArguments:\n"
+            "1. \"hexstrings\"                     (string, required) a json array of transaction or certificate hex strings\n"
+            "2. \"prevtxs\"                        (string, optional) the previous dependent transaction outputs of all the transactions,\n"
+            "                                     as in signrawtransaction\n"
+            "3. \"privatekeys\"                    (string, optional) the private keys for signing, as in signrawtransaction\n"
+            "4. \"sighashtype\"                    (string, optional, default=ALL) the signature hash type, as in signrawtransaction\n"
+
+            "\nResult:\n"
+            "[                                   (json array of objects) in the order of hexstrings\n"
+            "  {\n"
+            "    \"hex\" : \"value\",               (string) the hex-encoded raw transaction or certificate with signature(s)\n"
+            "    \"complete\" : true|false,         (boolean) if the transaction has a complete set of signatures\n"
+            "    \"errors\" : [ ... ]               (json array of objects) script verification errors, as in signrawtransaction\n"
+            "  }\n"
+            "  ,...\n"
+            "]\n"
+
+            "\nExamples:\n"
+            + HelpExampleCli("signrawtransactions", "\"[\\\"myhex1\\\",\\\"myhex2\\\"]\"")
+            + HelpExampleRpc("signrawtransactions", "[\"myhex1\",\"myhex2\"]")
+        );
+
+#ifdef ENABLE_WALLET
+    LOCK2(cs_main, pwalletMain ? &pwalletMain->cs_wallet : NULL);
+#else
+    LOCK(cs_main);
+#endif
+    RPCTypeCheck(params, boost::assign::list_of(UniValue::VARR)(UniValue::VARR)(UniValue::VARR)(UniValue::VSTR), true);
+
+    const UniValue& hexTxs = params[0].get_array();
+    UniValue results(UniValue::VARR);
+    for (size_t idx = 0; idx < hexTxs.size(); idx++)
+        results.push_back(SignRawTransaction(hexTxs[idx], params));
+    return results;
+}
+
 UniValue sendrawtransaction(const UniValue& params, bool fHelp)
 {
     if (fHelp || params.size() < 1 || params.size() > 2)
@@ -6,15 +6,18 @@
 #include "rpc/server.h"
 
 #include "base58.h"
+#include "httpserver.h"
 #include "init.h"
 #include "random.h"
 #include "sync.h"
 #include "ui_interface.h"
 #include "util.h"
 #include "utilstrencodings.h"
+#include "validationinterface.h"
 #include "asyncrpcqueue.h"
 
 #include <memory>
+#include <set>
 
 #include <univalue.h>
 
@@ -278,6 +281,65 @@ UniValue stop(const UniValue& params, bool fHelp)
     return "Zen server stopping";
 }
 
+UniValue getrpcinfo(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 0)
+        throw runtime_error(
+            "getrpcinfo\n"
+            "\nReturns the state of the work queue lanes serving the RPC and REST requests (see -rpcworklane).\n"
+
+            "\nResult:\n"
+            "{\n"
+            "  \"lanes\": [                (array) the lanes, the default one first\n"
+            "    {\n"
+            "      \"name\": \"xxxx\",         (string) the name of the lane\n"
+            "      \"methods\": [\"xxxx\",...] (array) the methods or REST prefixes served, empty for the default lane\n"
+            "      \"threads\": n,            (numeric) the number of worker threads\n"
+            "      \"depth\": n,              (numeric) the requests waiting in the queue\n"
+            "      \"maxdepth\": n,           (numeric) the depth beyond which requests are rejected\n"
+            "      \"peakdepth\": n,          (numeric) the highest depth reached\n"
+            "      \"processed\": n,          (numeric) the requests served\n"
+            "      \"rejected\": n,           (numeric) the requests rejected as the queue was full\n"
+            "      \"avgwait_us\": n,         (numeric) the average time spent waiting in the queue, in microseconds\n"
+            "      \"maxwait_us\": n,         (numeric) the longest time spent waiting in the queue, in microseconds\n"
+            "      \"avgrun_us\": n,          (numeric) the average time spent serving a request, in microseconds\n"
+            "      \"maxrun_us\": n           (numeric) the longest time spent serving a request, in microseconds\n"
+            "    }\n"
+            "    ,...\n"
+            "  ]\n"
+            "}\n"
+
+            "\nExamples:\n"
+            + HelpExampleCli("getrpcinfo", "")
+            + HelpExampleRpc("getrpcinfo", "")
+        );
+
+    UniValue lanes(UniValue::VARR);
+    for (const HTTPWorkQueueStats& stats : GetHTTPWorkQueueStats()) {
+        UniValue lane(UniValue::VOBJ);
+        lane.pushKV("name", stats.name);
+        UniValue methods(UniValue::VARR);
+        for (const std::string& strClass : stats.classes)
+            methods.push_back(strClass);
+        lane.pushKV("methods", methods);
+        lane.pushKV("threads", stats.numThreads);
+        lane.pushKV("depth", (uint64_t)stats.depth);
+        lane.pushKV("maxdepth", (uint64_t)stats.maxDepth);
+        lane.pushKV("peakdepth", (uint64_t)stats.peakDepth);
+        lane.pushKV("processed", stats.processed);
+        lane.pushKV("rejected", stats.rejected);
+        lane.pushKV("avgwait_us", stats.processed ? stats.totalWaitMicros / (int64_t)stats.processed : 0);
+        lane.pushKV("maxwait_us", stats.maxWaitMicros);
+        lane.pushKV("avgrun_us", stats.processed ? stats.totalRunMicros / (int64_t)stats.processed : 0);
+        lane.pushKV("maxrun_us", stats.maxRunMicros);
+        lanes.push_back(lane);
+    }
+
+    UniValue result(UniValue::VOBJ);
+    result.pushKV("lanes", lanes);
+    return result;
+}
+
 /**
  * Call Table
  */
@@ -288,6 +350,9 @@ static const CRPCCommand vRPCCommands[] =
     { "control",            "getinfo",                &getinfo,                true  }, /* uses wallet if enabled */
     { "control",            "help",                   &help,                   true  },
     { "control",            "stop",                   &stop,                   true  },
+    { "control",            "getrpcinfo",             &getrpcinfo,             true  },
+    { "control",            "getlockstats",           &getlockstats,           true  },
+    { "control",            "getmemoryinfo",          &getmemoryinfo,          true  },
     { "control",            "dbg_log",                &dbg_log,                true  },
     { "control",            "dbg_do",                 &dbg_do,                 true  },
     { "control",            "getscinfo",              &getscinfo,              true  },
@@ -323,18 +388,30 @@ static const CRPCCommand vRPCCommands[] =
 
     { "blockchain",         "getblockhash",           &getblockhash,           true  },
     { "blockchain",         "getblockfinalityindex",  &getblockfinalityindex,  true  },
+    { "blockchain",         "getblockvalidationstats", &getblockvalidationstats, true },
+    { "blockchain",         "getnotificationstats",    &getnotificationstats,    true },
+    { "blockchain",         "gettxtrace",              &gettxtrace,              true },
+    { "blockchain",         "gettxtracestats",         &gettxtracestats,         true },
+    { "blockchain",         "getblocksfinalityindex", &getblocksfinalityindex, true  },
     { "blockchain",         "getglobaltips",          &getglobaltips,          true  },
     { "blockchain",         "getblockheader",         &getblockheader,         true  },
+    { "blockchain",         "getblockfilter",         &getblockfilter,         true  },
     { "blockchain",         "getchaintips",           &getchaintips,           true  },
     { "blockchain",         "getdifficulty",          &getdifficulty,          true  },
     { "blockchain",         "getmempoolinfo",         &getmempoolinfo,         true  },
     { "blockchain",         "getrawmempool",          &getrawmempool,          true  },
+    { "blockchain",         "getmempooldelta",        &getmempooldelta,        true  },
     { "blockchain",         "gettxout",               &gettxout,               true  },
     { "blockchain",         "gettxoutproof",          &gettxoutproof,          true  },
+    { "blockchain",         "gettxoutproofs",         &gettxoutproofs,         true  },
     { "blockchain",         "verifytxoutproof",       &verifytxoutproof,       true  },
     { "blockchain",         "gettxoutsetinfo",        &gettxoutsetinfo,        true  },
+    { "blockchain",         "dumptxoutset",           &dumptxoutset,           true  },
+    { "blockchain",         "dumpchaindata",          &dumpchaindata,          true  },
+    { "blockchain",         "getdbstats",             &getdbstats,             true  },
     { "blockchain",         "verifychain",            &verifychain,            true  },
     { "blockchain",         "checkcswnullifier",      &checkcswnullifier,      true  },
+    { "blockchain",         "checkcswnullifiers",     &checkcswnullifiers,     true  },
     { "blockchain",         "getcertmaturityinfo",    &getcertmaturityinfo,    true  },
     { "blockchain",         "clearmempool",           &clearmempool,           true  },
 
@@ -363,8 +440,10 @@ static const CRPCCommand vRPCCommands[] =
     { "rawtransactions",    "createrawcertificate",   &createrawcertificate,   true  },
     { "rawtransactions",    "decodescript",           &decodescript,           true  },
     { "rawtransactions",    "getrawtransaction",      &getrawtransaction,      true  },
+    { "rawtransactions",    "getrawtransactions",     &getrawtransactions,     true  },
     { "rawtransactions",    "sendrawtransaction",     &sendrawtransaction,     false },
     { "rawtransactions",    "signrawtransaction",     &signrawtransaction,     false }, /* uses wallet if enabled */
+    { "rawtransactions",    "signrawtransactions",    &signrawtransactions,    false }, /* uses wallet if enabled */
 #ifdef ENABLE_WALLET
     { "rawtransactions",    "fundrawtransaction",     &fundrawtransaction,     false },
 #endif
@@ -413,6 +492,7 @@ static const CRPCCommand vRPCCommands[] =
     { "wallet",             "importprivkey",          &importprivkey,          true  },
     { "wallet",             "importwallet",           &importwallet,           true  },
     { "wallet",             "importaddress",          &importaddress,          true  },
+    { "wallet",             "importmulti",            &importmulti,            true  },
     { "wallet",             "keypoolrefill",          &keypoolrefill,          true  },
     { "wallet",             "listaccounts",           &listaccounts,           false },
     { "wallet",             "listaddressgroupings",   &listaddressgroupings,   false },
@@ -450,6 +530,7 @@ static const CRPCCommand vRPCCommands[] =
     { "wallet",             "z_getoperationstatus",   &z_getoperationstatus,   true  },
     { "wallet",             "z_getoperationresult",   &z_getoperationresult,   true  },
     { "wallet",             "z_listoperationids",     &z_listoperationids,     true  },
+    { "wallet",             "z_canceloperation",      &z_canceloperation,      true  },
     { "wallet",             "z_getnewaddress",        &z_getnewaddress,        true  },
     { "wallet",             "z_listaddresses",        &z_listaddresses,        true  },
     { "wallet",             "z_exportkey",            &z_exportkey,            true  },
@@ -497,20 +578,9 @@ bool StartRPC()
     fRPCRunning = true;
     g_rpcSignals.Started();
 
-    // Launch one async rpc worker.  The ability to launch multiple workers is not recommended at present and thus the option is disabled.
+    // Launch one async rpc worker, the queue spawns more up to -rpcasyncthreads while operations are waiting
+    getAsyncRPCQueue()->setMaxWorkers(GetArgWithinLimits("-rpcasyncthreads", DEFAULT_RPC_ASYNC_THREADS, {1, MAX_RPC_ASYNC_THREADS}));
     getAsyncRPCQueue()->addWorker();
-/*
-    int n = GetArg("-rpcasyncthreads", 1);
-    if (n<1) {
-        LogPrintf("ERROR: Invalid value %d for -rpcasyncthreads.  Must be at least 1.\n", n);
-        strerr = strprintf(_("An error occurred while setting up the Async RPC threads, invalid parameter value of %d (must be at least 1)."), n);
-        uiInterface.ThreadSafeMessageBox(strerr, "", CClientUIInterface::MSG_ERROR);
-        StartShutdown();
-        return;
-    }
-    for (int i = 0; i < n; i++)
-        getAsyncRPCQueue()->addWorker();
-*/
     return true;
 }
 
@@ -569,7 +639,7 @@ void JSONRequest::parse(const UniValue& valRequest)
     id = find_value(request, "id");
 
     // Parse method
-    UniValue valMethod = find_value(request, "method");
+    const UniValue& valMethod = find_value(request, "method");
     if (valMethod.isNull())
         throw JSONRPCError(RPC_INVALID_REQUEST, "Missing method");
     if (!valMethod.isStr())
@@ -578,10 +648,10 @@ void JSONRequest::parse(const UniValue& valRequest)
 
     LogPrint("rpc", "ThreadRPCServer method=%s\n", SanitizeString(strMethod));
 
-    // Parse params
-    UniValue valParams = find_value(request, "params");
+    // Parse params, copied once: they can be most of a large request
+    const UniValue& valParams = find_value(request, "params");
     if (valParams.isArray())
-        params = valParams.get_array();
+        params = valParams;
     else if (valParams.isNull())
         params = UniValue(UniValue::VARR);
     else
@@ -597,7 +667,7 @@ static UniValue JSONRPCExecOne(const UniValue& req)
         jreq.parse(req);
 
         UniValue result = tableRPC.execute(jreq.strMethod, jreq.params);
-        rpc_result = JSONRPCReplyObj(result, NullUniValue, jreq.id);
+        rpc_result = JSONRPCReplyObj(std::move(result), UniValue(), jreq.id);
     }
     catch (const UniValue& objError)
     {
@@ -612,13 +682,56 @@ static UniValue JSONRPCExecOne(const UniValue& req)
     return rpc_result;
 }
 
-std::string JSONRPCExecBatch(const UniValue& vReq)
+/** Read-only commands taking the locks they need by themselves, that a batch can run concurrently */
+static const std::set<std::string> setParallelBatchCommands = {
+    "decoderawtransaction", "decodescript", "getaddressbalance", "getaddressdeltas", "getaddressmempool",
+    "getaddresstxids", "getaddressutxos", "getbestblockhash", "getblock", "getblockchaininfo", "getblockcount",
+    "getblockexpanded", "getblockfilter", "getblockhash", "getblockhashes", "getblockheader", "getchaintips", "getdifficulty",
+    "getmempooldelta", "getmempoolinfo", "getrawmempool", "getrawtransaction", "getrawtransactions", "getscinfo",
+    "getspentinfo", "gettxout", "validateaddress",
+};
+
+static bool IsParallelBatchEntry(const UniValue& req)
 {
-    UniValue ret(UniValue::VARR);
-    for (size_t reqIdx = 0; reqIdx < vReq.size(); reqIdx++)
-        ret.push_back(JSONRPCExecOne(vReq[reqIdx]));
+    if (!req.isObject())
+        return false;
+    const UniValue& method = find_value(req, "method");
+    return method.isStr() && setParallelBatchCommands.count(method.get_str());
+}
 
-    return ret.write() + "\n";
+std::string JSONRPCExecBatch(const UniValue& vReq, const RPCParallelExecutor& parallelExecutor)
+{
+    std::vector<UniValue> results(vReq.size());
+    size_t reqIdx = 0;
+    while (reqIdx < vReq.size()) {
+        size_t runEnd = reqIdx;
+        if (parallelExecutor) {
+            while (runEnd < vReq.size() && IsParallelBatchEntry(vReq[runEnd]))
+                runEnd++;
+        }
+        if (runEnd - reqIdx > 1) {
+            // the entries are read in place and each task fills in its own slot of the results
+            std::vector<boost::function<void()>> tasks;
+            tasks.reserve(runEnd - reqIdx);
+            for (size_t i = reqIdx; i < runEnd; i++)
+                tasks.push_back([&vReq, &results, i]() { results[i] = JSONRPCExecOne(vReq[i]); });
+            parallelExecutor(tasks);
+            reqIdx = runEnd;
+        } else {
+            results[reqIdx] = JSONRPCExecOne(vReq[reqIdx]);
+            reqIdx++;
+        }
+    }
+
+    // the replies are written one after the other instead of being copied into one array first
+    std::string strReply;
+    UniValueWriter writer(strReply);
+    writer.startArray();
+    for (const UniValue& result : results)
+        writer.value(result);
+    writer.endArray();
+    strReply += "\n";
+    return strReply;
 }
 
 UniValue CRPCTable::execute(const std::string &strMethod, const UniValue &params) const
@@ -637,6 +750,10 @@ UniValue CRPCTable::execute(const std::string &strMethod, const UniValue &params
 
     g_rpcSignals.PreCommand(*pcmd);
 
+    // The wallet commands see the blocks and transactions accepted before them
+    if (pcmd->category == "wallet" || pcmd->category == "disclosure")
+        SyncWithValidationInterfaceQueue();
+
     try
     {
         // Execute
@@ -23,6 +23,10 @@ class AsyncRPCQueue;
 class CRPCCommand;
 class uint256;
 
+/** Default for -rpcasyncthreads, the number of workers the async RPC queue may grow to */
+static const int DEFAULT_RPC_ASYNC_THREADS = 1;
+static const int MAX_RPC_ASYNC_THREADS = 16;
+
 namespace RPCServer
 {
     void OnStarted(boost::function<void ()> slot);
@@ -194,6 +198,7 @@ extern UniValue clearbanned(const UniValue& params, bool fHelp);
 extern UniValue dumpprivkey(const UniValue& params, bool fHelp); // in rpcdump.cpp
 extern UniValue importprivkey(const UniValue& params, bool fHelp);
 extern UniValue importaddress(const UniValue& params, bool fHelp);
+extern UniValue importmulti(const UniValue& params, bool fHelp);
 extern UniValue dumpwallet(const UniValue& params, bool fHelp);
 extern UniValue importwallet(const UniValue& params, bool fHelp);
 
@@ -249,6 +254,8 @@ extern UniValue getwalletinfo(const UniValue& params, bool fHelp);
 extern UniValue getblockchaininfo(const UniValue& params, bool fHelp);
 extern UniValue getnetworkinfo(const UniValue& params, bool fHelp);
 extern UniValue setmocktime(const UniValue& params, bool fHelp);
+extern UniValue getlockstats(const UniValue& params, bool fHelp);
+extern UniValue getmemoryinfo(const UniValue& params, bool fHelp);
 extern UniValue resendwallettransactions(const UniValue& params, bool fHelp);
 extern UniValue zc_benchmark(const UniValue& params, bool fHelp);
 extern UniValue zc_raw_keygen(const UniValue& params, bool fHelp);
@@ -256,6 +263,7 @@ extern UniValue zc_raw_joinsplit(const UniValue& params, bool fHelp);
 extern UniValue zc_raw_receive(const UniValue& params, bool fHelp);
 extern UniValue zc_sample_joinsplit(const UniValue& params, bool fHelp);
 extern UniValue getrawtransaction(const UniValue& params, bool fHelp); // in rcprawtransaction.cpp
+extern UniValue getrawtransactions(const UniValue& params, bool fHelp);
 extern UniValue listunspent(const UniValue& params, bool fHelp);
 extern UniValue lockunspent(const UniValue& params, bool fHelp);
 extern UniValue listlockunspent(const UniValue& params, bool fHelp);
@@ -265,8 +273,10 @@ extern UniValue createrawcertificate(const UniValue& params, bool fHelp);
 extern UniValue decodescript(const UniValue& params, bool fHelp);
 extern UniValue fundrawtransaction(const UniValue& params, bool fHelp);
 extern UniValue signrawtransaction(const UniValue& params, bool fHelp);
+extern UniValue signrawtransactions(const UniValue& params, bool fHelp);
 extern UniValue sendrawtransaction(const UniValue& params, bool fHelp);
 extern UniValue gettxoutproof(const UniValue& params, bool fHelp);
+extern UniValue gettxoutproofs(const UniValue& params, bool fHelp);
 extern UniValue verifytxoutproof(const UniValue& params, bool fHelp);
 
 extern UniValue getblockcount(const UniValue& params, bool fHelp); // in rpcblockchain.cpp
@@ -275,16 +285,26 @@ extern UniValue getdifficulty(const UniValue& params, bool fHelp);
 extern UniValue settxfee(const UniValue& params, bool fHelp);
 extern UniValue getmempoolinfo(const UniValue& params, bool fHelp);
 extern UniValue getrawmempool(const UniValue& params, bool fHelp);
+extern UniValue getmempooldelta(const UniValue& params, bool fHelp);
 
 extern UniValue getblockdeltas(const UniValue& params, bool fHelp);
 extern UniValue getblockhashes(const UniValue& params, bool fHelp);
 
 extern UniValue getblockhash(const UniValue& params, bool fHelp);
 extern UniValue getblockheader(const UniValue& params, bool fHelp);
+extern UniValue getblockfilter(const UniValue& params, bool fHelp);
 extern UniValue getblock(const UniValue& params, bool fHelp);
+extern UniValue getblockvalidationstats(const UniValue& params, bool fHelp);
+extern UniValue getnotificationstats(const UniValue& params, bool fHelp);
+extern UniValue gettxtrace(const UniValue& params, bool fHelp);
+extern UniValue gettxtracestats(const UniValue& params, bool fHelp);
 extern UniValue getblockfinalityindex(const UniValue& params, bool fHelp);
+extern UniValue getblocksfinalityindex(const UniValue& params, bool fHelp);
 extern UniValue getglobaltips(const UniValue& params, bool fHelp);
 extern UniValue gettxoutsetinfo(const UniValue& params, bool fHelp);
+extern UniValue dumptxoutset(const UniValue& params, bool fHelp);
+extern UniValue dumpchaindata(const UniValue& params, bool fHelp);
+extern UniValue getdbstats(const UniValue& params, bool fHelp);
 extern UniValue gettxout(const UniValue& params, bool fHelp);
 extern UniValue verifychain(const UniValue& params, bool fHelp);
 extern UniValue getchaintips(const UniValue& params, bool fHelp);
@@ -321,10 +341,12 @@ extern UniValue getactivecertdatahash(const UniValue& params, bool fHelp);
 extern UniValue getceasingcumsccommtreehash(const UniValue& params, bool fHelp);
 extern UniValue getscgenesisinfo(const UniValue& params, bool fHelp); 
 extern UniValue checkcswnullifier(const UniValue& params, bool fHelp);
+extern UniValue checkcswnullifiers(const UniValue& params, bool fHelp);
 extern UniValue z_shieldcoinbase(const UniValue& params, bool fHelp); // in rpcwallet.cpp
 extern UniValue z_getoperationstatus(const UniValue& params, bool fHelp); // in rpcwallet.cpp
 extern UniValue z_getoperationresult(const UniValue& params, bool fHelp); // in rpcwallet.cpp
 extern UniValue z_listoperationids(const UniValue& params, bool fHelp); // in rpcwallet.cpp
+extern UniValue z_canceloperation(const UniValue& params, bool fHelp); // in rpcwallet.cpp
 extern UniValue z_validateaddress(const UniValue& params, bool fHelp); // in rpcmisc.cpp
 extern UniValue z_getpaymentdisclosure(const UniValue& params, bool fHelp); // in rpcdisclosure.cpp
 extern UniValue z_validatepaymentdisclosure(const UniValue &params, bool fHelp); // in rpcdisclosure.cpp
@@ -340,6 +362,11 @@ extern UniValue setproofverifierlowpriorityguard(const UniValue& params, bool fH
 bool StartRPC();
 void InterruptRPC();
 void StopRPC();
-std::string JSONRPCExecBatch(const UniValue& vReq);
+
+/** Runs the tasks concurrently, returning once all of them are done */
+typedef boost::function<void(const std::vector<boost::function<void()>>&)> RPCParallelExecutor;
+/** Execute a JSON-RPC batch. With an executor, the runs of consecutive read-only entries
+ * in the batch are executed concurrently, everything else in order. */
+std::string JSONRPCExecBatch(const UniValue& vReq, const RPCParallelExecutor& parallelExecutor = RPCParallelExecutor());
 
 #endif // BITCOIN_RPCSERVER_H
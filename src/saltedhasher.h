@@ -0,0 +1,32 @@
+#ifndef BITCOIN_SALTEDHASHER_H
+#define BITCOIN_SALTEDHASHER_H
+
+#include "hash.h"
+#include "random.h"
+#include "uint256.h"
+
+#include <stddef.h>
+
+/**
+ * The hasher of the in-memory hash tables keyed by a uint256: the txids and block hashes a peer may
+ * grind to land in the same bucket, hence SipHash-1-3 under a key of each table.
+ */
+class CSaltedUint256Hasher
+{
+private:
+    uint64_t k0, k1;
+
+public:
+    CSaltedUint256Hasher() : k0(GetFastRandomContext().rand64()), k1(GetFastRandomContext().rand64()) {}
+
+    /**
+     * This *must* return size_t. With Boost 1.46 on 32-bit systems the
+     * unordered_map will behave unpredictably if the custom hasher returns a
+     * uint64_t, resulting in failures when syncing the chain (#4634).
+     */
+    size_t operator()(const uint256& key) const {
+        return SipHash13Uint256(k0, k1, key);
+    }
+};
+
+#endif // BITCOIN_SALTEDHASHER_H
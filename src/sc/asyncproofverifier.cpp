@@ -1,29 +1,213 @@
 #include "asyncproofverifier.h"
 
+#include <algorithm>
+#include <future>
+
 #include "coins.h"
+#include "hash.h"
 #include "init.h"
 #include "main.h"
+#include "txtrace.h"
 #include "util.h"
 #include "primitives/certificate.h"
 
 const uint32_t CScAsyncProofVerifier::BATCH_VERIFICATION_MAX_DELAY = 5000;   /**< The maximum delay in milliseconds between batch verification requests */
 const uint32_t CScAsyncProofVerifier::BATCH_VERIFICATION_MAX_SIZE = 10;      /**< The threshold size of the proof queue that triggers a call to the batch verification. */
+const uint32_t CScAsyncProofVerifier::MIN_SUB_BATCH_SIZE = 2;               /**< The minimum number of proofs that justifies a dedicated sub-batch. */
+const uint32_t CScAsyncProofVerifier::WORK_UNIT_SIZE = 4;                   /**< The number of proofs of a sub-batch verified at once. */
+const uint32_t CScAsyncProofVerifier::MAX_PENDING_PROOFS_PER_PEER = 100;    /**< The maximum number of proofs of a peer queued or being verified. */
+const uint32_t CScAsyncProofVerifier::MAX_PEER_WEIGHT = 4;                  /**< The number of proofs a peer that cost nothing gets in a round. */
+const int64_t CScAsyncProofVerifier::PEER_WEIGHT_COST_UNIT = 1000000;       /**< The verification cost in microseconds that lowers the weight of a peer by a step. */
+const uint32_t CScAsyncProofVerifier::FAILED_PROOF_COST_WEIGHT = 4;         /**< How many times a failed proof is charged the time of a passed one. */
+
+const double CAsyncProofVerifierBatchController::SAMPLE_WEIGHT = 0.2;
+
+CAsyncProofVerifierBatchController::CAsyncProofVerifierBatchController(bool adaptive, uint32_t maxDelay, uint32_t maxSize, uint32_t maxSubBatches) :
+    adaptive(adaptive), maxDelay(maxDelay), maxSize(maxSize), maxSubBatches(std::max<uint32_t>(maxSubBatches, 1))
+{
+}
+
+/**
+ * @brief Updates the estimation of the arrival rate of proofs.
+ * 
+ * @param nProofs The number of proofs queued since the previous sample
+ * @param elapsedMillis The time in milliseconds elapsed since the previous sample
+ */
+void CAsyncProofVerifierBatchController::AddArrivalSample(uint32_t nProofs, int64_t elapsedMillis)
+{
+    if (elapsedMillis <= 0)
+        return;
+
+    double rate = nProofs * 1000.0 / elapsedMillis;
+    arrivalRate += SAMPLE_WEIGHT * (rate - arrivalRate);
+}
+
+/**
+ * @brief Updates the estimation of the cost of a single proof verification.
+ * 
+ * @param nProofs The number of proofs that have been verified
+ * @param nSubBatches The number of sub-batches in which the proofs have been split (run concurrently)
+ * @param elapsedMicros The time in microseconds spent for verifying the proofs
+ */
+void CAsyncProofVerifierBatchController::AddVerificationSample(size_t nProofs, uint32_t nSubBatches, int64_t elapsedMicros)
+{
+    lastSubBatches = nSubBatches;
+
+    if (nProofs == 0 || nSubBatches == 0 || elapsedMicros < 0)
+        return;
+
+    // Sub-batches run concurrently, so the elapsed time is spent for the proofs of a single sub-batch
+    double proofsPerSubBatch = static_cast<double>(nProofs) / nSubBatches;
+    double cost = elapsedMicros * 0.001 / std::max(proofsPerSubBatch, 1.0);
+    proofCostMs = (proofCostMs == 0) ? cost : proofCostMs + SAMPLE_WEIGHT * (cost - proofCostMs);
+}
+
+/**
+ * @brief Gets the maximum number of proofs to be submitted to a single sub-batch.
+ */
+uint32_t CAsyncProofVerifierBatchController::GetSubBatchSize() const
+{
+    if (!adaptive || proofCostMs <= 0)
+        return std::max<uint32_t>(maxSize, 1);
+
+    // Do not let the verification of a sub-batch take longer than the max delay
+    uint32_t budgetSize = static_cast<uint32_t>(maxDelay / proofCostMs);
+    return std::max<uint32_t>(std::min(maxSize, budgetSize), 1);
+}
+
+/**
+ * @brief Gets the threshold size of the queue that triggers a verification.
+ */
+uint32_t CAsyncProofVerifierBatchController::GetBatchSize() const
+{
+    if (!adaptive)
+        return maxSize;
+
+    return GetSubBatchSize() * maxSubBatches;
+}
+
+/**
+ * @brief Gets the maximum age in milliseconds of the queue before triggering a verification.
+ */
+uint32_t CAsyncProofVerifierBatchController::GetBatchDelay() const
+{
+    if (!adaptive)
+        return maxDelay;
+
+    // No other proof is expected to come in time for being batched with the queued ones
+    if (arrivalRate * maxDelay / 1000.0 < 1.0)
+        return 0;
+
+    // The time needed to fill a whole batch at the current arrival rate
+    double fillTime = GetBatchSize() * 1000.0 / arrivalRate;
+    return static_cast<uint32_t>(std::min<double>(fillTime, maxDelay));
+}
+
+/**
+ * @brief Gets the number of sub-batches in which a queue of the given size has to be split.
+ */
+uint32_t CAsyncProofVerifierBatchController::GetSubBatches(size_t queueSize) const
+{
+    if (!adaptive || queueSize == 0)
+        return 1;
+
+    uint32_t subBatchSize = std::max(GetSubBatchSize(), CScAsyncProofVerifier::MIN_SUB_BATCH_SIZE);
+    size_t needed = (queueSize + subBatchSize - 1) / subBatchSize;
+    return static_cast<uint32_t>(std::min<size_t>(std::max<size_t>(needed, 1), maxSubBatches));
+}
+
+AsyncProofVerifierBatchingInfo CAsyncProofVerifierBatchController::GetInfo() const
+{
+    AsyncProofVerifierBatchingInfo info;
+    info.adaptive = adaptive;
+    info.batchDelay = GetBatchDelay();
+    info.batchSize = GetBatchSize();
+    info.subBatchSize = GetSubBatchSize();
+    info.maxSubBatches = maxSubBatches;
+    info.lastSubBatches = lastSubBatches;
+    info.proofCostMs = proofCostMs;
+    info.arrivalRate = arrivalRate;
+    return info;
+}
 
 
 #ifndef BITCOIN_TX
 void CScAsyncProofVerifier::LoadDataForCertVerification(const CCoinsViewCache& view, const CScCertificate& scCert, CNode* pfrom)
 {
     LOCK(cs_asyncQueue);
+    if (proofQueue.count(scCert.GetHash()) || !ReservePendingProof(pfrom))
+    {
+        return;
+    }
     CScProofVerifier::LoadDataForCertVerification(view, scCert, pfrom);
+    queuedSinceLastSample++;
+    RecordTxTraceStage(scCert.GetHash(), TxTraceStage::PROOF_QUEUED);
 }
 
 void CScAsyncProofVerifier::LoadDataForCswVerification(const CCoinsViewCache& view, const CTransaction& scTx, CNode* pfrom)
 {
     LOCK(cs_asyncQueue);
+    if (proofQueue.count(scTx.GetHash()) || scTx.GetVcswCcIn().empty() || !ReservePendingProof(pfrom))
+    {
+        return;
+    }
     CScProofVerifier::LoadDataForCswVerification(view, scTx, pfrom);
+    queuedSinceLastSample++;
+    RecordTxTraceStage(scTx.GetHash(), TxTraceStage::PROOF_QUEUED);
 }
 #endif
 
+/**
+ * @brief Counts a new proof of the peer as pending, unless the peer has too many pending already:
+ * the certificate or transaction is then dropped, without being rejected, so that it can be
+ * received again from another peer, or from this one once its proofs are verified.
+ * 
+ * Requires cs_asyncQueue.
+ * 
+ * @param pfrom The node that sent the certificate or transaction
+ * @return true if the proof can be queued
+ */
+bool CScAsyncProofVerifier::ReservePendingProof(CNode* pfrom)
+{
+    AssertLockHeld(cs_asyncQueue);
+
+    if (pfrom == nullptr)
+    {
+        return true;
+    }
+
+    uint32_t& pending = pendingProofsPerPeer[pfrom->GetId()];
+    if (pending >= GetCustomMaxPendingProofsPerPeer())
+    {
+        LogPrint("cert", "%s():%d - Dropping a proof from peer [%d], which has %d proofs pending\n",
+                 __func__, __LINE__, pfrom->GetId(), pending);
+        return false;
+    }
+
+    pending++;
+    return true;
+}
+
+/**
+ * @brief Stops counting as pending the proof of a certificate or transaction that has been processed.
+ * 
+ * @param item The item that has been processed by the proof verifier
+ */
+void CScAsyncProofVerifier::ReleasePendingProof(const CProofVerifierItem& item)
+{
+    if (item.node == nullptr)
+    {
+        return;
+    }
+
+    LOCK(cs_asyncQueue);
+    auto it = pendingProofsPerPeer.find(item.node->GetId());
+    if (it != pendingProofsPerPeer.end() && --it->second == 0)
+    {
+        pendingProofsPerPeer.erase(it);
+    }
+}
+
 uint32_t CScAsyncProofVerifier::GetCustomMaxBatchVerifyDelay()
 {
     int32_t delay = GetArg("-scproofverificationdelay", BATCH_VERIFICATION_MAX_DELAY);
@@ -48,24 +232,76 @@ uint32_t CScAsyncProofVerifier::GetCustomMaxBatchVerifyMaxSize()
     return static_cast<uint32_t>(size);
 }
 
+uint32_t CScAsyncProofVerifier::GetCustomMaxSubBatches()
+{
+    int32_t defaultSubBatches = std::max(1, std::min(GetNumCores() / 2, 4));
+    int32_t subBatches = GetArg("-scproofmaxsubbatches", defaultSubBatches);
+    if (subBatches < 1)
+    {
+        LogPrintf("%s():%d - ERROR: scproofmaxsubbatches=%d, must be positive, setting to default value = %d\n",
+            __func__, __LINE__, subBatches, defaultSubBatches);
+        subBatches = defaultSubBatches;
+    }
+    return static_cast<uint32_t>(subBatches);
+}
+
+uint32_t CScAsyncProofVerifier::GetCustomMaxPendingProofsPerPeer()
+{
+    int32_t maxPending = GetArg("-scproofmaxpendingperpeer", MAX_PENDING_PROOFS_PER_PEER);
+    if (maxPending < 1)
+    {
+        LogPrintf("%s():%d - ERROR: scproofmaxpendingperpeer=%d, must be positive, setting to default value = %d\n",
+            __func__, __LINE__, maxPending, MAX_PENDING_PROOFS_PER_PEER);
+        maxPending = MAX_PENDING_PROOFS_PER_PEER;
+    }
+    return static_cast<uint32_t>(maxPending);
+}
+
+bool CScAsyncProofVerifier::IsAdaptiveBatchingEnabled()
+{
+    // Disabled by default on regtest, where tests rely on the static thresholds
+    return GetBoolArg("-scproofadaptivebatching", Params().NetworkIDString() != "regtest");
+}
+
+/**
+ * @brief Gets the last batching decisions taken by the async proof verifier.
+ */
+AsyncProofVerifierBatchingInfo CScAsyncProofVerifier::GetBatchingInfo()
+{
+    LOCK(cs_asyncQueue);
+    return batchingInfo;
+}
+
 /**
  * @brief A function that periodically performs batch verification over the queued proofs.
  * It should run on a dedicated thread.
  */
 void CScAsyncProofVerifier::RunPeriodicVerification()
 {
+    // The threads of the concurrent sub-batches are started by this one and share its configuration
+    ApplyThreadConfig(Priority::Low);
+
     /**
      * The age of the queue in milliseconds.
      * This value represents the time spent in the queue by the oldest proof in the queue.
      */
     uint32_t queueAge = 0;
 
-    uint32_t batchVerificationMaxDelay = GetCustomMaxBatchVerifyDelay();
-    uint32_t batchVerificationMaxSize  = GetCustomMaxBatchVerifyMaxSize();
-
+    CAsyncProofVerifierBatchController controller(IsAdaptiveBatchingEnabled(), GetCustomMaxBatchVerifyDelay(),
+                                                  GetCustomMaxBatchVerifyMaxSize(), GetCustomMaxSubBatches());
+    int64_t lastArrivalSampleTime = GetTimeMillis();
 
     while (!ShutdownRequested())
     {
+        {
+            LOCK(cs_asyncQueue);
+            int64_t now = GetTimeMillis();
+            controller.AddArrivalSample(queuedSinceLastSample, now - lastArrivalSampleTime);
+            queuedSinceLastSample = 0;
+            lastArrivalSampleTime = now;
+            batchingInfo = controller.GetInfo();
+        }
+
         size_t currentQueueSize = proofQueue.size();
 
         if (currentQueueSize > 0)
@@ -78,7 +314,7 @@ void CScAsyncProofVerifier::RunPeriodicVerification()
              * 1. The queue has grown up beyond the threshold size;
              * 2. The oldest proof in the queue has waited for too long.
              */
-            if (queueAge > batchVerificationMaxDelay || currentQueueSize > batchVerificationMaxSize)
+            if (queueAge > controller.GetBatchDelay() || currentQueueSize > controller.GetBatchSize())
             {
                 queueAge = 0;
                 std::map</*scTxHash*/uint256, CProofVerifierItem> tempProofData;
@@ -91,34 +327,80 @@ void CScAsyncProofVerifier::RunPeriodicVerification()
                     LogPrint("cert", "%s():%d - Async verification triggered, %d proofs to be verified \n",
                              __func__, __LINE__, proofQueueSize);
 
-                    // Move the queued proofs into a local map, so that we can release the lock
-                    tempProofData = std::move(proofQueue);
+                    // Move the proofs of this round into a local map, so that we can release the lock
+                    TakeRoundProofs(proofQueue, tempProofData, std::max(controller.GetBatchSize(), BATCH_VERIFICATION_MAX_SIZE));
 
-                    assert(proofQueue.size() == 0);
-                    assert(tempProofData.size() == proofQueueSize);
+                    assert(proofQueue.size() + tempProofData.size() == proofQueueSize);
                 }
 
-                bool batchResult = BatchVerifyInternal(tempProofData);
-                ProcessVerificationOutputs(tempProofData);
+                // Only the best quality certificate of each sidechain epoch is verified, the others wait for its outcome
+                std::map</*scTxHash*/uint256, CProofVerifierItem> deferredProofs;
+                DeferSupersededCertProofs(tempProofData, deferredProofs);
 
-                if (tempProofData.size() > 0)
+                for (const auto& entry : tempProofData)
                 {
-                    LogPrint("cert", "%s():%d - Batch verification failed, removed proofs that caused the failure and trying again... \n", __func__, __LINE__);
+                    RecordTxTraceStage(entry.first, TxTraceStage::PROOF_VERIFY);
+                }
+
+                // Split the proofs into sub-batches to be verified concurrently
+                const size_t nProofs = tempProofData.size();
+                const uint32_t nSubBatches = controller.GetSubBatches(nProofs);
+                std::vector<std::map</*scTxHash*/uint256, CProofVerifierItem>> subBatches = PartitionProofs(tempProofData, nSubBatches);
 
-                    batchResult = BatchVerifyInternal(tempProofData);
-                    ProcessVerificationOutputs(tempProofData);
+                std::vector<std::map</*scTxHash*/uint256, CProofVerifierItem>> verifiedProofs(nSubBatches);
+                int64_t nVerificationStart = GetTimeMicros();
 
-                    if (tempProofData.size() > 0)
+                if (nSubBatches == 1)
+                {
+                    VerifySubBatch(subBatches[0], verifiedProofs[0]);
+                }
+                else
+                {
+                    LogPrint("cert", "%s():%d - Verifying %d proofs in %d concurrent sub-batches \n",
+                             __func__, __LINE__, nProofs, nSubBatches);
+
+                    std::vector<std::future<void>> pendingSubBatches;
+                    for (uint32_t i = 0; i < nSubBatches; i++)
+                    {
+                        pendingSubBatches.push_back(std::async(std::launch::async, &CScAsyncProofVerifier::VerifySubBatch,
+                                                               this, std::ref(subBatches[i]), std::ref(verifiedProofs[i])));
+                    }
+                    for (auto& pending : pendingSubBatches)
                     {
-                        LogPrint("cert", "%s():%d - Batch verification failed again, verifying proofs one by one... \n", __func__, __LINE__);
+                        pending.get();
+                    }
+                }
 
-                        // As last attempt, verify the proofs one by one.
-                        NormalVerify(tempProofData);
-                        ProcessVerificationOutputs(tempProofData);
+                const int64_t nVerificationTime = GetTimeMicros() - nVerificationStart;
+                controller.AddVerificationSample(nProofs, nSubBatches, nVerificationTime);
+                ChargeVerificationCost(verifiedProofs, nSubBatches, nVerificationTime);
+
+                std::map<std::pair</* scId */ uint256, /* epoch */ uint32_t>, /* quality */ uint64_t> passedQualities;
+                for (const auto& verified : verifiedProofs)
+                {
+                    for (const auto& entry : verified)
+                    {
+                        const CCertProofVerifierInput* certInput = boost::get<CCertProofVerifierInput>(&entry.second.proofInput);
+                        if (certInput && entry.second.result == ProofVerificationResult::Passed)
+                        {
+                            uint64_t& quality = passedQualities[std::make_pair(certInput->scId, certInput->epochNumber)];
+                            quality = std::max(quality, certInput->quality);
+                        }
                     }
                 }
 
-                assert(tempProofData.size() == 0);
+                // Outputs are processed on this thread only, as they are submitted to the mempool
+                for (uint32_t i = 0; i < nSubBatches; i++)
+                {
+                    assert(subBatches[i].size() == 0);
+                    ProcessVerificationOutputs(verifiedProofs[i]);
+                    assert(verifiedProofs[i].size() == 0);
+                }
+
+                if (!deferredProofs.empty())
+                {
+                    ReleaseDeferredCertProofs(deferredProofs, passedQualities);
+                }
             }
         }
 
@@ -126,6 +408,209 @@ void CScAsyncProofVerifier::RunPeriodicVerification()
     }
 }
 
+/**
+ * @brief Verifies a sub-batch of proofs, WORK_UNIT_SIZE proofs at a time. Before each work unit
+ * the high priority verifications running (those of the blocks being connected) are waited for,
+ * the results of the units already verified being kept, so that a block never waits for more
+ * than a work unit and the sub-batch resumes where it was afterwards.
+ * 
+ * When this function returns, all the proofs have been moved from the input map to the output one
+ * with a result that is either PASSED or FAILED.
+ * 
+ * @param proofs The set of proofs to be verified
+ * @param verifiedProofs The set of proofs whose verification has completed
+ */
+void CScAsyncProofVerifier::VerifySubBatch(std::map</* Tx hash */ uint256, CProofVerifierItem>& proofs,
+                                           std::map</* Tx hash */ uint256, CProofVerifierItem>& verifiedProofs)
+{
+    while (!proofs.empty())
+    {
+        WaitForHighPriorityVerifications();
+
+        std::map</* Tx hash */ uint256, CProofVerifierItem> workUnit;
+        while (!proofs.empty() && workUnit.size() < WORK_UNIT_SIZE)
+        {
+            workUnit.insert(std::move(*proofs.begin()));
+            proofs.erase(proofs.begin());
+        }
+
+        VerifyWorkUnit(workUnit, verifiedProofs);
+        assert(workUnit.empty());
+    }
+}
+
+/**
+ * @brief Verifies a work unit of proofs, bisecting the proofs left unknown by a failed batch
+ * verification to find the ones that made it fail.
+ * 
+ * When this function returns, all the proofs have been moved from the input map to the output one
+ * with a result that is either PASSED or FAILED.
+ * 
+ * @param proofs The set of proofs to be verified
+ * @param verifiedProofs The set of proofs whose verification has completed
+ */
+void CScAsyncProofVerifier::VerifyWorkUnit(std::map</* Tx hash */ uint256, CProofVerifierItem>& proofs,
+                                           std::map</* Tx hash */ uint256, CProofVerifierItem>& verifiedProofs)
+{
+    auto moveVerifiedProofs = [&proofs, &verifiedProofs]()
+    {
+        for (auto it = proofs.begin(); it != proofs.end();)
+        {
+            if (it->second.result != ProofVerificationResult::Unknown)
+            {
+                verifiedProofs.insert(std::move(*it));
+                it = proofs.erase(it);
+            }
+            else
+            {
+                ++it;
+            }
+        }
+    };
+
+    BatchVerifyInternal(proofs);
+    moveVerifiedProofs();
+
+    if (proofs.size() > 0)
+    {
+        LogPrint("cert", "%s():%d - Batch verification failed, bisecting the %d proofs left... \n", __func__, __LINE__, proofs.size());
+
+        BisectVerify(proofs);
+        moveVerifiedProofs();
+    }
+}
+
+/**
+ * @brief Finds the proofs that failed in a batch verification which did not tell them:
+ * the proofs are split in two halves, batch verified concurrently, and the proofs left
+ * unknown by a half are split again, so that an invalid proof among n costs O(log n)
+ * batch verifications instead of n normal ones. A single proof gets a normal verification.
+ * 
+ * When this function returns, all the proofs have a result that is either PASSED or FAILED.
+ * 
+ * @param proofs The set of proofs to be verified
+ */
+void CScAsyncProofVerifier::BisectVerify(std::map</* Tx hash */ uint256, CProofVerifierItem>& proofs)
+{
+    if (proofs.size() <= 1)
+    {
+        NormalVerify(proofs);
+        return;
+    }
+
+    std::map</* Tx hash */ uint256, CProofVerifierItem> secondHalf;
+    auto middle = std::next(proofs.begin(), proofs.size() / 2);
+    secondHalf.insert(std::make_move_iterator(middle), std::make_move_iterator(proofs.end()));
+    proofs.erase(middle, proofs.end());
+
+    auto verifyHalf = [this](std::map</* Tx hash */ uint256, CProofVerifierItem>& half)
+    {
+        if (half.size() == 1)
+        {
+            NormalVerify(half);
+            return;
+        }
+
+        BatchVerifyInternal(half);
+
+        std::map</* Tx hash */ uint256, CProofVerifierItem> unknownProofs;
+        for (auto it = half.begin(); it != half.end();)
+        {
+            if (it->second.result == ProofVerificationResult::Unknown)
+            {
+                unknownProofs.insert(std::move(*it));
+                it = half.erase(it);
+            }
+            else
+            {
+                ++it;
+            }
+        }
+
+        if (!unknownProofs.empty())
+        {
+            BisectVerify(unknownProofs);
+            half.insert(std::make_move_iterator(unknownProofs.begin()), std::make_move_iterator(unknownProofs.end()));
+        }
+    };
+
+    std::future<void> pendingHalf = std::async(std::launch::async, verifyHalf, std::ref(secondHalf));
+    verifyHalf(proofs);
+    pendingHalf.get();
+
+    proofs.insert(std::make_move_iterator(secondHalf.begin()), std::make_move_iterator(secondHalf.end()));
+}
+
+/**
+ * @brief Splits the proofs into the sub-batches to be verified concurrently, keeping together
+ * the proofs of the same verification key (and then proving system), the one of the certificate
+ * or of the first CSW input of the transaction. The groups are split in chunks no larger than
+ * an even share of the proofs, and the chunks, the largest first, go to the sub-batch with the
+ * fewest proofs so far.
+ * 
+ * When this function returns, all the proofs have been moved from the input map to the sub-batches.
+ * 
+ * @param proofs The set of proofs to be verified
+ * @param nSubBatches The number of sub-batches
+ * @return The sub-batches, some of which may be empty
+ */
+std::vector<std::map</* Tx hash */ uint256, CProofVerifierItem>> CScAsyncProofVerifier::PartitionProofs(
+        std::map</* Tx hash */ uint256, CProofVerifierItem>& proofs, uint32_t nSubBatches)
+{
+    nSubBatches = std::max<uint32_t>(nSubBatches, 1);
+    std::vector<std::map</* Tx hash */ uint256, CProofVerifierItem>> subBatches(nSubBatches);
+    if (proofs.empty())
+    {
+        return subBatches;
+    }
+
+    std::map</* Vk hash */ uint256, std::vector</* Tx hash */ uint256>> groups;
+    for (const auto& entry : proofs)
+    {
+        const CCertProofVerifierInput* certInput = boost::get<CCertProofVerifierInput>(&entry.second.proofInput);
+        const std::vector<CCswProofVerifierInput>* cswInputs = boost::get<std::vector<CCswProofVerifierInput>>(&entry.second.proofInput);
+
+        uint256 vkHash;
+        const CScVKey* vk = certInput ? &certInput->verificationKey : (cswInputs && !cswInputs->empty() ? &cswInputs->front().verificationKey : nullptr);
+        if (vk && !vk->IsNull())
+        {
+            vkHash = Hash(vk->GetDataBuffer(), vk->GetDataBuffer() + vk->GetDataSize());
+        }
+        groups[vkHash].push_back(entry.first);
+    }
+
+    const size_t chunkSize = (proofs.size() + nSubBatches - 1) / nSubBatches;
+    std::vector<std::vector</* Tx hash */ uint256>> chunks;
+    for (const auto& group : groups)
+    {
+        for (size_t i = 0; i < group.second.size(); i += chunkSize)
+        {
+            chunks.emplace_back(group.second.begin() + i, group.second.begin() + std::min(i + chunkSize, group.second.size()));
+        }
+    }
+    std::stable_sort(chunks.begin(), chunks.end(), [](const std::vector<uint256>& a, const std::vector<uint256>& b)
+    {
+        return a.size() > b.size();
+    });
+
+    for (const auto& chunk : chunks)
+    {
+        auto& subBatch = *std::min_element(subBatches.begin(), subBatches.end(),
+            [](const std::map<uint256, CProofVerifierItem>& a, const std::map<uint256, CProofVerifierItem>& b)
+            {
+                return a.size() < b.size();
+            });
+        for (const uint256& hash : chunk)
+        {
+            auto it = proofs.find(hash);
+            subBatch.insert(std::move(*it));
+            proofs.erase(it);
+        }
+    }
+
+    return subBatches;
+}
+
 /**
  * @brief Process the outputs of the batch verification.
  * This function is meant to process all the outputs having a state PASSED or FAILED;
@@ -169,6 +654,9 @@ void CScAsyncProofVerifier::ProcessVerificationOutputs(std::map</* Tx hash */ ui
             }
             // CODE USED FOR UNIT TEST ONLY [End]
 
+            ReleasePendingProof(item);
+            RecordTxTraceStage(i->first, TxTraceStage::PROOF_VERIFIED);
+
             CValidationState dummyState;
             mempoolCallback(*item.parentPtr.get(), item.node,
                                             item.result == ProofVerificationResult::Passed ? BatchVerificationStateFlag::VERIFIED : BatchVerificationStateFlag::FAILED,
@@ -179,6 +667,211 @@ void CScAsyncProofVerifier::ProcessVerificationOutputs(std::map</* Tx hash */ ui
     }
 }
 
+/**
+ * @brief Moves out of the set of proofs to be verified the certificates superseded by a better
+ * quality certificate for the same sidechain and epoch, so that the best quality is verified first.
+ * 
+ * Superseded certificates are only deferred: if the best quality one fails the verification they
+ * still have to be verified.
+ * 
+ * @param proofs The set of proofs to be verified
+ * @param deferredProofs The set of certificate proofs whose verification has been deferred
+ */
+void CScAsyncProofVerifier::DeferSupersededCertProofs(std::map</* Tx hash */ uint256, CProofVerifierItem>& proofs,
+                                                      std::map</* Tx hash */ uint256, CProofVerifierItem>& deferredProofs)
+{
+    std::map<std::pair</* scId */ uint256, /* epoch */ uint32_t>, /* quality */ uint64_t> bestQualities;
+
+    for (const auto& entry : proofs)
+    {
+        const CCertProofVerifierInput* certInput = boost::get<CCertProofVerifierInput>(&entry.second.proofInput);
+        if (certInput)
+        {
+            auto key = std::make_pair(certInput->scId, certInput->epochNumber);
+            auto best = bestQualities.find(key);
+            if (best == bestQualities.end() || best->second < certInput->quality)
+            {
+                bestQualities[key] = certInput->quality;
+            }
+        }
+    }
+
+    for (auto it = proofs.begin(); it != proofs.end();)
+    {
+        const CCertProofVerifierInput* certInput = boost::get<CCertProofVerifierInput>(&it->second.proofInput);
+        if (certInput && certInput->quality < bestQualities[std::make_pair(certInput->scId, certInput->epochNumber)])
+        {
+            LogPrint("cert", "%s():%d - Deferring verification of certificate [%s], superseded by quality %d\n",
+                     __func__, __LINE__, it->first.ToString(), bestQualities[std::make_pair(certInput->scId, certInput->epochNumber)]);
+            deferredProofs.insert(std::move(*it));
+            it = proofs.erase(it);
+        }
+        else
+        {
+            ++it;
+        }
+    }
+}
+
+/**
+ * @brief Cancels the deferred certificate proofs superseded by a certificate that passed the
+ * verification, and puts the other ones back into the queue for the next verification.
+ * 
+ * @param deferredProofs The set of certificate proofs whose verification has been deferred
+ * @param passedQualities The best quality of the certificates that passed the verification, per sidechain and epoch
+ */
+void CScAsyncProofVerifier::ReleaseDeferredCertProofs(std::map</* Tx hash */ uint256, CProofVerifierItem>& deferredProofs,
+                                                      const std::map<std::pair</* scId */ uint256, /* epoch */ uint32_t>, /* quality */ uint64_t>& passedQualities)
+{
+    for (auto it = deferredProofs.begin(); it != deferredProofs.end();)
+    {
+        const CCertProofVerifierInput& certInput = boost::get<CCertProofVerifierInput>(it->second.proofInput);
+        auto passed = passedQualities.find(std::make_pair(certInput.scId, certInput.epochNumber));
+
+        if (passed != passedQualities.end() && certInput.quality < passed->second)
+        {
+            LogPrint("cert", "%s():%d - Cancelled verification of certificate [%s], superseded by verified quality %d\n",
+                     __func__, __LINE__, it->first.ToString(), passed->second);
+
+            ReleasePendingProof(it->second);
+
+            // CODE USED FOR UNIT TEST ONLY [Start]
+            if (BOOST_UNLIKELY(Params().NetworkIDString() == "regtest"))
+            {
+                stats.cancelledCertCounter++;
+            }
+            // CODE USED FOR UNIT TEST ONLY [End]
+
+            it = deferredProofs.erase(it);
+        }
+        else
+        {
+            ++it;
+        }
+    }
+
+    LOCK(cs_asyncQueue);
+
+    for (auto& entry : deferredProofs)
+    {
+        proofQueue.insert(std::move(entry));
+    }
+
+    deferredProofs.clear();
+}
+
+/**
+ * @brief Gets the number of proofs a peer gets in a round of the batch composition, lowered by a
+ * step for each PEER_WEIGHT_COST_UNIT of verification time the peer recently cost, down to one.
+ * 
+ * @param node The node that sent the proofs, null for the local ones
+ */
+uint32_t CScAsyncProofVerifier::GetPeerWeight(const CNode* node)
+{
+    if (node == nullptr)
+    {
+        return MAX_PEER_WEIGHT;
+    }
+
+    int64_t steps = node->GetProofVerificationCost() / PEER_WEIGHT_COST_UNIT;
+    return static_cast<uint32_t>(std::max<int64_t>(MAX_PEER_WEIGHT - steps, 1));
+}
+
+/**
+ * @brief Moves from the queue the proofs to be verified in a round. All of them are taken when they
+ * are no more than maxProofs or when they come from a single peer; otherwise the peers take turns,
+ * each giving as many proofs as its weight at each turn, so that a peer flooding the queue does not
+ * hold back the proofs of the others, which are verified in this round while its own wait for the next.
+ * 
+ * @param queue The queue of the proofs to be verified
+ * @param roundProofs The proofs to be verified in this round
+ * @param maxProofs The maximum number of proofs of a round shared by several peers
+ */
+void CScAsyncProofVerifier::TakeRoundProofs(std::map</* Tx hash */ uint256, CProofVerifierItem>& queue,
+                                            std::map</* Tx hash */ uint256, CProofVerifierItem>& roundProofs, size_t maxProofs)
+{
+    std::map<NodeId, std::vector</* Tx hash */ uint256>> peerProofs;
+    std::map<NodeId, uint32_t> peerWeights;
+    for (const auto& entry : queue)
+    {
+        const NodeId id = entry.second.node ? entry.second.node->GetId() : -1;
+        if (peerWeights.count(id) == 0)
+        {
+            peerWeights[id] = GetPeerWeight(entry.second.node);
+        }
+        peerProofs[id].push_back(entry.first);
+    }
+
+    if (queue.size() <= maxProofs || peerProofs.size() <= 1)
+    {
+        roundProofs.insert(std::make_move_iterator(queue.begin()), std::make_move_iterator(queue.end()));
+        queue.clear();
+        return;
+    }
+
+    std::map<NodeId, size_t> taken;
+    size_t nTaken = 0;
+    bool fTakenAny = true;
+    while (nTaken < maxProofs && fTakenAny)
+    {
+        fTakenAny = false;
+        for (const auto& peer : peerProofs)
+        {
+            size_t& next = taken[peer.first];
+            for (uint32_t i = 0; i < peerWeights[peer.first] && next < peer.second.size() && nTaken < maxProofs; i++)
+            {
+                auto it = queue.find(peer.second[next++]);
+                roundProofs.insert(std::move(*it));
+                queue.erase(it);
+                nTaken++;
+                fTakenAny = true;
+            }
+        }
+    }
+
+    LogPrint("cert", "%s():%d - %d proofs of %d peers left for the next round\n", __func__, __LINE__, queue.size(), peerProofs.size());
+}
+
+/**
+ * @brief Charges the peers the time spent verifying their proofs. The sub-batches run concurrently,
+ * so each of them took the whole time, shared among its proofs; a failed proof is charged
+ * FAILED_PROOF_COST_WEIGHT times a passed one, as it made its batch fail and be bisected.
+ * 
+ * @param verifiedProofs The proofs verified, per sub-batch
+ * @param nSubBatches The number of sub-batches
+ * @param elapsedMicros The time in microseconds spent verifying the proofs
+ */
+void CScAsyncProofVerifier::ChargeVerificationCost(const std::vector<std::map</* Tx hash */ uint256, CProofVerifierItem>>& verifiedProofs,
+                                                   uint32_t nSubBatches, int64_t elapsedMicros)
+{
+    size_t nShares = 0;
+    for (const auto& verified : verifiedProofs)
+    {
+        for (const auto& entry : verified)
+        {
+            nShares += entry.second.result == ProofVerificationResult::Failed ? FAILED_PROOF_COST_WEIGHT : 1;
+        }
+    }
+
+    if (nShares == 0 || elapsedMicros <= 0)
+    {
+        return;
+    }
+
+    const int64_t shareCost = elapsedMicros * nSubBatches / nShares;
+    for (const auto& verified : verifiedProofs)
+    {
+        for (const auto& entry : verified)
+        {
+            if (entry.second.node != nullptr)
+            {
+                entry.second.node->AddProofVerificationCost(entry.second.result == ProofVerificationResult::Failed ?
+                                                            shareCost * FAILED_PROOF_COST_WEIGHT : shareCost);
+            }
+        }
+    }
+}
+
 /**
  * @brief Updates the statistics of the proof verifier.
  * It is available in regression test mode only.
@@ -28,6 +28,61 @@ struct AsyncProofVerifierStatistics
     uint32_t okCswCounter = 0;      /**< The number of CSW input proofs that have been correctly verified. */
     uint32_t failedCertCounter = 0; /**< The number of certificate proofs whose verification failed. */
     uint32_t failedCswCounter = 0;  /**< The number of CSW input proofs whose verification failed. */
+    uint32_t cancelledCertCounter = 0;  /**< The number of certificate proofs not verified because superseded by a better quality certificate. */
+};
+
+/**
+ * @brief A structure that stores the batching decisions taken by the async batch verifier.
+ */
+struct AsyncProofVerifierBatchingInfo
+{
+    bool adaptive = false;          /**< Whether the batch size and delay are adapted to the observed load. */
+    uint32_t batchDelay = 0;        /**< The current maximum age in milliseconds of the queue before triggering a verification. */
+    uint32_t batchSize = 0;         /**< The current threshold size of the queue that triggers a verification. */
+    uint32_t subBatchSize = 0;      /**< The current maximum number of proofs submitted to a single sub-batch. */
+    uint32_t maxSubBatches = 1;     /**< The maximum number of sub-batches that can be verified concurrently. */
+    uint32_t lastSubBatches = 0;    /**< The number of sub-batches used by the last verification. */
+    double proofCostMs = 0;         /**< The moving average of the time needed to verify a proof within a sub-batch. */
+    double arrivalRate = 0;         /**< The moving average of the number of proofs queued per second. */
+};
+
+/**
+ * @brief The controller that chooses when and how the async proof verifier flushes its queue.
+ * 
+ * When not adaptive, it always returns the configured (static) delay and size thresholds and
+ * never splits the queue. When adaptive, the configured thresholds are used as upper bounds and:
+ * 
+ * 1. The size of a sub-batch is reduced so that its verification doesn't take longer than the max delay;
+ * 2. The queue is split into up to maxSubBatches sub-batches, verified concurrently;
+ * 3. The delay is reduced to the time needed to fill a batch at the observed arrival rate, or to
+ *    zero (i.e. flush at the next wake up) when no other proof is expected within the max delay.
+ */
+class CAsyncProofVerifierBatchController
+{
+public:
+    CAsyncProofVerifierBatchController(bool adaptive, uint32_t maxDelay, uint32_t maxSize, uint32_t maxSubBatches);
+
+    void AddArrivalSample(uint32_t nProofs, int64_t elapsedMillis);
+    void AddVerificationSample(size_t nProofs, uint32_t nSubBatches, int64_t elapsedMicros);
+
+    uint32_t GetBatchDelay() const;
+    uint32_t GetBatchSize() const;
+    uint32_t GetSubBatchSize() const;
+    uint32_t GetSubBatches(size_t queueSize) const;
+
+    AsyncProofVerifierBatchingInfo GetInfo() const;
+
+    static const double SAMPLE_WEIGHT;      /**< The weight of a new sample in the exponential moving averages. */
+
+private:
+    const bool adaptive;
+    const uint32_t maxDelay;
+    const uint32_t maxSize;
+    const uint32_t maxSubBatches;
+
+    uint32_t lastSubBatches = 0;
+    double proofCostMs = 0;
+    double arrivalRate = 0;
 };
 
 /**
@@ -55,8 +110,20 @@ public:
     static const uint32_t BATCH_VERIFICATION_MAX_DELAY;   /**< The maximum delay in milliseconds between batch verification requests */
     static const uint32_t BATCH_VERIFICATION_MAX_SIZE;      /**< The threshold size of the proof queue that triggers a call to the batch verification. */
 
+    static const uint32_t MIN_SUB_BATCH_SIZE;              /**< The minimum number of proofs that justifies a dedicated sub-batch. */
+    static const uint32_t WORK_UNIT_SIZE;                  /**< The number of proofs of a sub-batch verified at once, between two of which a high priority verification goes first. */
+    static const uint32_t MAX_PENDING_PROOFS_PER_PEER;     /**< The maximum number of proofs of a peer queued or being verified, the others are dropped. */
+    static const uint32_t MAX_PEER_WEIGHT;                 /**< The number of proofs a peer that cost no verification time gets in a round of the batch composition. */
+    static const int64_t PEER_WEIGHT_COST_UNIT;            /**< The verification cost in microseconds that lowers the weight of a peer by a step. */
+    static const uint32_t FAILED_PROOF_COST_WEIGHT;        /**< How many times a failed proof is charged the verification time of a passed one. */
+
     static uint32_t GetCustomMaxBatchVerifyDelay();
     static uint32_t GetCustomMaxBatchVerifyMaxSize();
+    static uint32_t GetCustomMaxSubBatches();
+    static bool IsAdaptiveBatchingEnabled();
+    static uint32_t GetCustomMaxPendingProofsPerPeer();
+
+    AsyncProofVerifierBatchingInfo GetBatchingInfo();
 
 private:
 
@@ -66,6 +133,10 @@ private:
 
     CCriticalSection cs_asyncQueue;         /**< The lock to be used for entering the critical section in async mode only. */
 
+    uint32_t queuedSinceLastSample = 0;     /**< The number of items queued since the last arrival sample (guarded by cs_asyncQueue). */
+    AsyncProofVerifierBatchingInfo batchingInfo;    /**< The last batching decisions, for diagnostics (guarded by cs_asyncQueue). */
+    std::map<NodeId, uint32_t> pendingProofsPerPeer;   /**< The number of proofs of each peer queued or being verified (guarded by cs_asyncQueue). */
+
     // Members used for REGTEST mode only. [Start]
     AsyncProofVerifierStatistics stats;     /**< Async proof verifier statistics. */
     // Members used for REGTEST mode only. [End]
@@ -81,8 +152,26 @@ private:
     {
     }
 
+    void VerifySubBatch(std::map</* Tx hash */ uint256, CProofVerifierItem>& proofs, std::map</* Tx hash */ uint256, CProofVerifierItem>& verifiedProofs);
+    void VerifyWorkUnit(std::map</* Tx hash */ uint256, CProofVerifierItem>& proofs, std::map</* Tx hash */ uint256, CProofVerifierItem>& verifiedProofs);
+    void BisectVerify(std::map</* Tx hash */ uint256, CProofVerifierItem>& proofs);
     void ProcessVerificationOutputs(std::map</* Tx hash */ uint256, CProofVerifierItem>& proofs);
     void UpdateStatistics(const CProofVerifierItem& item);
+    bool ReservePendingProof(CNode* pfrom);
+    void ReleasePendingProof(const CProofVerifierItem& item);
+
+    static uint32_t GetPeerWeight(const CNode* node);
+    static void TakeRoundProofs(std::map</* Tx hash */ uint256, CProofVerifierItem>& queue,
+                                std::map</* Tx hash */ uint256, CProofVerifierItem>& roundProofs, size_t maxProofs);
+    static void ChargeVerificationCost(const std::vector<std::map</* Tx hash */ uint256, CProofVerifierItem>>& verifiedProofs,
+                                       uint32_t nSubBatches, int64_t elapsedMicros);
+
+    static std::vector<std::map</* Tx hash */ uint256, CProofVerifierItem>> PartitionProofs(
+                                          std::map</* Tx hash */ uint256, CProofVerifierItem>& proofs, uint32_t nSubBatches);
+    static void DeferSupersededCertProofs(std::map</* Tx hash */ uint256, CProofVerifierItem>& proofs,
+                                          std::map</* Tx hash */ uint256, CProofVerifierItem>& deferredProofs);
+    void ReleaseDeferredCertProofs(std::map</* Tx hash */ uint256, CProofVerifierItem>& deferredProofs,
+                                   const std::map<std::pair</* scId */ uint256, /* epoch */ uint32_t>, /* quality */ uint64_t>& passedQualities);
 };
 
 /**
@@ -178,6 +267,24 @@ public:
         return CScAsyncProofVerifier::GetCustomMaxBatchVerifyDelay();
     }
 
+    /**
+     * @brief Splits the proofs into the sub-batches the async proof verifier would verify concurrently.
+     */
+    std::vector<std::map</* Tx hash */ uint256, CProofVerifierItem>> PartitionProofs(
+        std::map</* Tx hash */ uint256, CProofVerifierItem>& proofs, uint32_t nSubBatches)
+    {
+        return CScAsyncProofVerifier::PartitionProofs(proofs, nSubBatches);
+    }
+
+    /**
+     * @brief Takes from the queue the proofs the async proof verifier would verify in a round.
+     */
+    void TakeRoundProofs(std::map</* Tx hash */ uint256, CProofVerifierItem>& queue,
+                         std::map</* Tx hash */ uint256, CProofVerifierItem>& roundProofs, size_t maxProofs)
+    {
+        CScAsyncProofVerifier::TakeRoundProofs(queue, roundProofs, maxProofs);
+    }
+
     /**
      * @brief Resets the async proof verifier statistics and queue.
      */
@@ -186,6 +293,9 @@ public:
         CScAsyncProofVerifier& verifier = CScAsyncProofVerifier::GetInstance();
 
         verifier.stats = AsyncProofVerifierStatistics();
+
+        LOCK(verifier.cs_asyncQueue);
+        verifier.pendingProofsPerPeer.clear();
     }
 
     /**
@@ -1,10 +1,221 @@
 #include "sc/proofverifier.h"
 
 #include "coins.h"
+#include "hash.h"
 #include "main.h"
 #include "primitives/certificate.h"
+#include "random.h"
+#include "util.h"
+#include "utilstrencodings.h"
+
+#include <algorithm>
+
+#include <boost/algorithm/string.hpp>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#else
+#define CPU_SETSIZE 1024
+#endif
 
 std::atomic<uint32_t> CScProofVerifier::proofIdCounter(0);
+std::mutex CScProofVerifier::csHighPriority;
+std::condition_variable CScProofVerifier::condHighPriority;
+uint32_t CScProofVerifier::highPriorityVerifications = 0;
+
+CScProofVerifier::CHighPriorityVerification::CHighPriorityVerification()
+{
+    std::lock_guard<std::mutex> lock(csHighPriority);
+    highPriorityVerifications++;
+}
+
+CScProofVerifier::CHighPriorityVerification::~CHighPriorityVerification()
+{
+    std::lock_guard<std::mutex> lock(csHighPriority);
+    if (--highPriorityVerifications == 0)
+    {
+        condHighPriority.notify_all();
+    }
+}
+
+void CScProofVerifier::WaitForHighPriorityVerifications()
+{
+    std::unique_lock<std::mutex> lock(csHighPriority);
+    condHighPriority.wait(lock, []() { return highPriorityVerifications == 0; });
+}
+
+std::mutex CScProofVerifier::csThreadConfig;
+ProofVerifierThreadConfig CScProofVerifier::threadConfig;
+
+void CScProofVerifier::SetThreadConfig(const ProofVerifierThreadConfig& config)
+{
+    std::lock_guard<std::mutex> lock(csThreadConfig);
+    threadConfig = config;
+
+    // The pool of the cryptolib is a rayon one, sized by the environment when it is first used
+    if (config.poolThreads > 0)
+    {
+        setenv("RAYON_NUM_THREADS", std::to_string(config.poolThreads).c_str(), 1);
+    }
+}
+
+ProofVerifierThreadConfig CScProofVerifier::GetThreadConfig()
+{
+    std::lock_guard<std::mutex> lock(csThreadConfig);
+    return threadConfig;
+}
+
+bool CScProofVerifier::ParseCpuList(const std::string& str, std::vector<int>& cpus)
+{
+    cpus.clear();
+    std::vector<std::string> ranges;
+    boost::split(ranges, str, boost::is_any_of(","));
+    for (const std::string& range : ranges)
+    {
+        const size_t dash = range.find('-');
+        int32_t first, last;
+        if (dash == std::string::npos)
+        {
+            if (!ParseInt32(range, &first))
+                return false;
+            last = first;
+        }
+        else if (!ParseInt32(range.substr(0, dash), &first) || !ParseInt32(range.substr(dash + 1), &last))
+        {
+            return false;
+        }
+
+        if (first < 0 || last < first || last >= CPU_SETSIZE)
+            return false;
+        for (int cpu = first; cpu <= last; cpu++)
+            cpus.push_back(cpu);
+    }
+    std::sort(cpus.begin(), cpus.end());
+    cpus.erase(std::unique(cpus.begin(), cpus.end()), cpus.end());
+    return true;
+}
+
+void CScProofVerifier::ApplyThreadConfig(Priority priority)
+{
+    const ProofVerifierThreadConfig config = GetThreadConfig();
+    const std::vector<int>& cpus = (priority == Priority::High) ? config.highCpus : config.lowCpus;
+
+#ifdef __linux__
+    if (!cpus.empty())
+    {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        for (int cpu : cpus)
+            CPU_SET(cpu, &set);
+        if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0)
+        {
+            LogPrintf("%s():%d - could not pin the %s priority proof verification thread\n",
+                __func__, __LINE__, priority == Priority::High ? "high" : "low");
+        }
+    }
+#endif
+
+    if (priority == Priority::Low && config.lowBelowNormal)
+    {
+        SetThreadPriority(THREAD_PRIORITY_BELOW_NORMAL);
+    }
+}
+
+CVerifiedProofCache& CVerifiedProofCache::GetInstance()
+{
+    static CVerifiedProofCache instance;
+    return instance;
+}
+
+CVerifiedProofCache::CVerifiedProofCache() : salt(GetFastRandHash())
+{
+}
+
+/**
+ * @brief Computes the cache entry of a proof given the hash of its public inputs.
+ */
+uint256 CVerifiedProofCache::ComputeEntry(const CBaseProofVerifierInput& input, const uint256& publicInputsHash) const
+{
+    const unsigned char* vkBytes = input.verificationKey.GetDataBuffer();
+    const unsigned char* proofBytes = input.proof.GetDataBuffer();
+    uint256 vkHash = Hash(vkBytes, vkBytes + input.verificationKey.GetDataSize());
+    uint256 proofHash = Hash(proofBytes, proofBytes + input.proof.GetDataSize());
+
+    CHashWriter ss(SER_GETHASH, 0);
+    ss << salt << vkHash << proofHash << publicInputsHash;
+    return ss.GetHash();
+}
+
+/**
+ * @brief Computes the cache entry of a certificate proof.
+ */
+uint256 CVerifiedProofCache::ComputeEntry(const CCertProofVerifierInput& input) const
+{
+    CHashWriter ss(SER_GETHASH, 0);
+    ss << input.constant << input.scId << input.epochNumber << input.quality;
+
+    ss << static_cast<uint64_t>(input.bt_list.size());
+    for (const backward_transfer_t& bt : input.bt_list)
+    {
+        ss.write(reinterpret_cast<const char*>(bt.pk_dest), sizeof(bt.pk_dest));
+        ss << static_cast<uint64_t>(bt.amount);
+    }
+
+    ss << input.vCustomFields << input.endEpochCumScTxCommTreeRoot << input.lastCertHash;
+    ss << input.mainchainBackwardTransferRequestScFee << input.forwardTransferScFee;
+
+    return ComputeEntry(input, ss.GetHash());
+}
+
+/**
+ * @brief Computes the cache entry of a CSW input proof.
+ */
+uint256 CVerifiedProofCache::ComputeEntry(const CCswProofVerifierInput& input) const
+{
+    CHashWriter ss(SER_GETHASH, 0);
+    ss << input.constant << input.scId << input.nValue << input.nullifier << input.pubKeyHash;
+    ss << input.certDataHash << input.ceasingCumScTxCommTree;
+
+    return ComputeEntry(input, ss.GetHash());
+}
+
+bool CVerifiedProofCache::Contains(const uint256& entry)
+{
+    boost::shared_lock<boost::shared_mutex> lock(cs_proofcache);
+    return setValid.count(entry) != 0;
+}
+
+void CVerifiedProofCache::Insert(const uint256& entry)
+{
+    int64_t nMaxCacheSize = GetArg("-maxscproofcachesize", DEFAULT_MAX_SIZE);
+    if (nMaxCacheSize <= 0) return;
+
+    boost::unique_lock<boost::shared_mutex> lock(cs_proofcache);
+
+    while (static_cast<int64_t>(setValid.size()) >= nMaxCacheSize)
+    {
+        // Evict a random entry, as done by the signature cache.
+        std::set<uint256>::iterator it = setValid.lower_bound(GetFastRandHash());
+        if (it == setValid.end())
+            it = setValid.begin();
+        setValid.erase(it);
+    }
+
+    setValid.insert(entry);
+}
+
+void CVerifiedProofCache::Clear()
+{
+    boost::unique_lock<boost::shared_mutex> lock(cs_proofcache);
+    setValid.clear();
+}
+
+size_t CVerifiedProofCache::Size()
+{
+    boost::shared_lock<boost::shared_mutex> lock(cs_proofcache);
+    return setValid.size();
+}
 
 /**
  * @brief Converts a ProofVerificationResult enum to string.
@@ -67,14 +278,14 @@ CCertProofVerifierInput CScProofVerifier::CertificateToVerifierItem(const CScCer
 
     for (int i = 0; i < certificate.vFieldElementCertificateField.size(); i++)
     {
-        FieldElementCertificateField entry = certificate.vFieldElementCertificateField.at(i);
+        const FieldElementCertificateField& entry = certificate.vFieldElementCertificateField.at(i);
         CFieldElement fe{entry.GetFieldElement(scFixedParams.vFieldElementCertificateFieldConfig.at(i), scFixedParams.version)};
         assert(fe.IsValid());
         certData.vCustomFields.push_back(fe);
     }
     for (int i = 0; i < certificate.vBitVectorCertificateField.size(); i++)
     {
-        BitVectorCertificateField entry = certificate.vBitVectorCertificateField.at(i);
+        const BitVectorCertificateField& entry = certificate.vBitVectorCertificateField.at(i);
         CFieldElement fe{entry.GetFieldElement(scFixedParams.vBitVectorCertificateFieldConfig.at(i), scFixedParams.version)};
         assert(fe.IsValid());
         certData.vCustomFields.push_back(fe);
@@ -149,6 +360,9 @@ void CScProofVerifier::LoadDataForCertVerification(const CCoinsViewCache& view,
         return;
     }
 
+    // The queue is owned by the verification thread until WaitForBatchVerification() is called
+    assert(!pendingBatchVerification.valid());
+
     LogPrint("cert", "%s():%d - called: cert[%s], scId[%s]\n",
         __func__, __LINE__, scCert.GetHash().ToString(), scCert.GetScId().ToString());
 
@@ -178,6 +392,9 @@ void CScProofVerifier::LoadDataForCswVerification(const CCoinsViewCache& view, c
         return;
     }
 
+    // The queue is owned by the verification thread until WaitForBatchVerification() is called
+    assert(!pendingBatchVerification.valid());
+
     std::vector<CCswProofVerifierInput> cswInputProofs;
 
     for(CTxCeasedSidechainWithdrawalInput cswInput : scTx.GetVcswCcIn())
@@ -223,6 +440,43 @@ bool CScProofVerifier::BatchVerify()
     return BatchVerifyInternal(proofQueue);
 }
 
+/**
+ * @brief Starts the verification of the currently queued proofs on a dedicated thread,
+ * so that the caller can carry on with other work (e.g. script checks) in the meantime.
+ * No further proof can be loaded until WaitForBatchVerification() has been called.
+ * 
+ * When there is nothing to verify (empty queue or loose verification) no thread is
+ * spawned and the (trivial) verification is deferred to WaitForBatchVerification().
+ */
+void CScProofVerifier::StartBatchVerification()
+{
+    assert(!pendingBatchVerification.valid());
+
+    const std::launch policy = (proofQueue.empty() || verificationMode == Verification::Loose) ?
+                               std::launch::deferred : std::launch::async;
+
+    pendingBatchVerification = std::async(policy, [this, policy]()
+    {
+        if (policy == std::launch::async)
+        {
+            ApplyThreadConfig(verificationPriority);
+        }
+        return BatchVerifyInternal(proofQueue);
+    });
+}
+
+/**
+ * @brief Waits for the completion of the verification started by StartBatchVerification().
+ * 
+ * @return true If the verification succeeded for all the proofs.
+ * @return false If the verification failed for at least one proof.
+ */
+bool CScProofVerifier::WaitForBatchVerification()
+{
+    assert(pendingBatchVerification.valid());
+    return pendingBatchVerification.get();
+}
+
 /**
  * @brief Run the batch verification over a set of proofs.
  * 
@@ -247,12 +501,21 @@ bool CScProofVerifier::BatchVerifyInternal(std::map</* Cert or Tx hash */ uint25
         return true;
     }
 
+    // The low priority verifications wait for this one at the end of their current work unit
+    std::unique_ptr<CHighPriorityVerification> highPriorityVerification;
+    if (verificationPriority == Priority::High)
+    {
+        highPriorityVerification.reset(new CHighPriorityVerification());
+    }
+
     // The parameter in the ctor is a boolean telling mc-crypto lib if the rust verifier executing thread
     // will be a high-priority one (default is false)
     ZendooBatchProofVerifier batchVerifier(verificationPriority == Priority::High);
     bool addFailure = false;
     std::map<uint32_t /* Proof ID */, uint256 /* Tx or Cert hash */> proofIdMap;
     CctpErrorCode code;
+    CVerifiedProofCache& proofCache = CVerifiedProofCache::GetInstance();
+    size_t cachedProofs = 0;
 
     LogPrint("bench", "%s():%d - starting verification\n", __func__, __LINE__);
     int64_t nTime1 = GetTimeMicros();
@@ -264,8 +527,17 @@ bool CScProofVerifier::BatchVerifyInternal(std::map</* Cert or Tx hash */ uint25
 
         if (item.proofInput.type() == typeid(std::vector<CCswProofVerifierInput>))
         {
+            bool allInputsCached = true;
+
             for (auto& cswInput : boost::get<std::vector<CCswProofVerifierInput>>(item.proofInput))
             {
+                if (proofCache.Contains(proofCache.ComputeEntry(cswInput)))
+                {
+                    cachedProofs++;
+                    continue;
+                }
+
+                allInputsCached = false;
                 proofIdMap.insert(std::make_pair(cswInput.proofId, proofEntry.first));
 
                 wrappedFieldPtr sptrScId = CFieldElement(cswInput.scId).GetFieldElement();
@@ -307,10 +579,23 @@ bool CScProofVerifier::BatchVerifyInternal(std::map</* Cert or Tx hash */ uint25
                     break;
                 }
             }
+
+            if (allInputsCached)
+            {
+                item.result = ProofVerificationResult::Passed;
+            }
         }
         else if (item.proofInput.type() == typeid(CCertProofVerifierInput))
         {
             CCertProofVerifierInput certInput = boost::get<CCertProofVerifierInput>(item.proofInput);
+
+            if (proofCache.Contains(proofCache.ComputeEntry(certInput)))
+            {
+                cachedProofs++;
+                item.result = ProofVerificationResult::Passed;
+                continue;
+            }
+
             proofIdMap.insert(std::make_pair(certInput.proofId, proofEntry.first));
 
             int custom_fields_len = certInput.vCustomFields.size(); 
@@ -383,6 +668,17 @@ bool CScProofVerifier::BatchVerifyInternal(std::map</* Cert or Tx hash */ uint25
         }
     }
 
+    if (cachedProofs > 0)
+    {
+        LogPrint("sc", "%s():%d - %d proof(s) found in the verified proof cache\n", __func__, __LINE__, cachedProofs);
+    }
+
+    // Every proof has either been found in the cache or failed to be added, nothing left to verify
+    if (proofIdMap.empty())
+    {
+        return !addFailure;
+    }
+
     CZendooBatchProofVerifierResult verRes(batchVerifier.batch_verify_all(&code));
 
     if (verRes.Result())
@@ -422,11 +718,43 @@ bool CScProofVerifier::BatchVerifyInternal(std::map</* Cert or Tx hash */ uint25
         }
     }
 
+    CacheVerifiedProofs(proofs);
+
     int64_t nTime2 = GetTimeMicros();
     LogPrint("bench", "%s():%d - verification completed: %.2fms\n", __func__, __LINE__, (nTime2-nTime1) * 0.001);
     return !addFailure && verRes.Result();
 }
 
+/**
+ * @brief Stores the proofs that passed the verification into the verified proof cache.
+ * 
+ * @param proofs The set of proofs that have been verified
+ */
+void CScProofVerifier::CacheVerifiedProofs(const std::map</* Cert or Tx hash */ uint256, CProofVerifierItem>& proofs) const
+{
+    CVerifiedProofCache& proofCache = CVerifiedProofCache::GetInstance();
+
+    for (const auto& proof : proofs)
+    {
+        const CProofVerifierItem& item = proof.second;
+
+        if (item.result != ProofVerificationResult::Passed)
+            continue;
+
+        if (item.proofInput.type() == typeid(std::vector<CCswProofVerifierInput>))
+        {
+            for (const auto& cswInput : boost::get<std::vector<CCswProofVerifierInput>>(item.proofInput))
+            {
+                proofCache.Insert(proofCache.ComputeEntry(cswInput));
+            }
+        }
+        else if (item.proofInput.type() == typeid(CCertProofVerifierInput))
+        {
+            proofCache.Insert(proofCache.ComputeEntry(boost::get<CCertProofVerifierInput>(item.proofInput)));
+        }
+    }
+}
+
 /**
  * @brief Runs the verification for a set of proofs one by one (not batched).
  * The result of the verification for each item is stored inside the 
@@ -454,6 +782,8 @@ void CScProofVerifier::NormalVerify(std::map</* Cert or Tx hash */ uint256, CPro
             assert(false);
         }
     }
+
+    CacheVerifiedProofs(proofs);
 }
 
 /**
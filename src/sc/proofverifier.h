@@ -1,8 +1,15 @@
 #ifndef _SC_PROOF_VERIFIER_H
 #define _SC_PROOF_VERIFIER_H
 
+#include <condition_variable>
+#include <future>
 #include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
 
+#include <boost/thread/shared_mutex.hpp>
 #include <boost/variant.hpp>
 
 #include "amount.h"
@@ -15,6 +22,17 @@ class CScCertificate;
 class uint256;
 class CCoinsViewCache;
 
+/**
+ * The configuration of the threads verifying the sidechain proofs.
+ */
+struct ProofVerifierThreadConfig
+{
+    uint32_t poolThreads = 0;       /**< The threads of the pool of the cryptolib, 0 for its default of one per core. */
+    std::vector<int> lowCpus;       /**< The cpus the low priority (mempool) verification threads are pinned to, none for any. */
+    std::vector<int> highCpus;      /**< The cpus the high priority (block) verification threads are pinned to, none for any. */
+    bool lowBelowNormal = false;    /**< Whether the low priority verification threads run below the normal scheduling priority. */
+};
+
 /**
  * The enumeration of possible results of the proof verifier for any proof processed.
  */
@@ -79,6 +97,44 @@ struct CProofVerifierItem
     boost::variant<CCertProofVerifierInput, std::vector<CCswProofVerifierInput>> proofInput;        /**< The proof input data, it can be a (single) certificate input or a list of CSW inputs. */
 };
 
+/**
+ * @brief Valid proof cache, to avoid doing expensive SNARK verification twice for every
+ * certificate and CSW input (once when accepted into the memory pool, and again when
+ * the block including it is connected).
+ * 
+ * An entry is the salted hash of the verification key hash, the proof hash and the hash
+ * of all the public inputs, so that a proof is never considered verified with respect to
+ * a different statement.
+ */
+class CVerifiedProofCache
+{
+public:
+    static const int64_t DEFAULT_MAX_SIZE = 20000;   /**< The default maximum number of entries of the cache. */
+
+    static CVerifiedProofCache& GetInstance();
+
+    CVerifiedProofCache();
+
+    // CVerifiedProofCache should never be copied
+    CVerifiedProofCache(const CVerifiedProofCache&) = delete;
+    CVerifiedProofCache& operator=(const CVerifiedProofCache&) = delete;
+
+    uint256 ComputeEntry(const CCertProofVerifierInput& input) const;
+    uint256 ComputeEntry(const CCswProofVerifierInput& input) const;
+
+    bool Contains(const uint256& entry);
+    void Insert(const uint256& entry);
+    void Clear();
+    size_t Size();
+
+private:
+    uint256 ComputeEntry(const CBaseProofVerifierInput& input, const uint256& publicInputsHash) const;
+
+    const uint256 salt;             /**< A random salt, so that entries can't be predicted by an attacker. */
+    std::set<uint256> setValid;     /**< The set of entries of the proofs verified successfully. */
+    boost::shared_mutex cs_proofcache;
+};
+
 /* A verifier that is able to verify different kind of ScProof(s) */
 class CScProofVerifier
 {
@@ -109,7 +165,14 @@ public:
     verificationMode(mode), verificationPriority(priority)
     {
     }
-    virtual ~CScProofVerifier() = default;
+    virtual ~CScProofVerifier()
+    {
+        // Never leave a verification thread running on a destroyed proof queue
+        if (pendingBatchVerification.valid())
+        {
+            pendingBatchVerification.wait();
+        }
+    }
 
     // CScProofVerifier should never be copied
     CScProofVerifier(const CScProofVerifier&) = delete;
@@ -120,19 +183,66 @@ public:
     virtual void LoadDataForCswVerification(const CCoinsViewCache& view, const CTransaction& scTx, CNode* pfrom = nullptr);
     bool BatchVerify();
 
+    void StartBatchVerification();
+    bool WaitForBatchVerification();
+
+    /**
+     * @brief Sets the configuration of the verification threads, before any proof is verified,
+     * as the cryptolib sizes its pool when it first uses it.
+     */
+    static void SetThreadConfig(const ProofVerifierThreadConfig& config);
+    static ProofVerifierThreadConfig GetThreadConfig();
+
+    /**
+     * @brief Parses a list of cpus, as "0-3,6", false if it is malformed.
+     */
+    static bool ParseCpuList(const std::string& str, std::vector<int>& cpus);
+
 protected:
 
     bool BatchVerifyInternal(std::map</* Cert or Tx hash */ uint256, CProofVerifierItem>& proofs);
+    void CacheVerifiedProofs(const std::map</* Cert or Tx hash */ uint256, CProofVerifierItem>& proofs) const;
     void NormalVerify(std::map</* Cert or Tx hash */ uint256, CProofVerifierItem>& proofs);
     ProofVerificationResult NormalVerifyCertificate(CCertProofVerifierInput input) const;
     ProofVerificationResult NormalVerifyCsw(std::vector<CCswProofVerifierInput> cswInputs) const;
 
+    /**
+     * @brief Waits until no high priority verification is running. The low priority verifications
+     * call it between their work units, so that a block does not wait for a whole mempool batch.
+     */
+    static void WaitForHighPriorityVerifications();
+
+    /**
+     * @brief Pins the calling thread to the cpus of the priority and sets its scheduling priority.
+     * The threads it starts later, as those of the cryptolib pool, inherit both.
+     */
+    static void ApplyThreadConfig(Priority priority);
+
     std::map</* Cert or Tx hash */ uint256, CProofVerifierItem> proofQueue;   /**< The queue of proofs to be verified. */
 
+    std::future<bool> pendingBatchVerification;   /**< The result of the batch verification started by StartBatchVerification(), if any. */
+
 private:
 
     static std::atomic<uint32_t> proofIdCounter;   /**< The counter used to get a unique ID for proofs. */
 
+    static std::mutex csHighPriority;                   /**< The lock guarding highPriorityVerifications. */
+    static std::condition_variable condHighPriority;    /**< Notified when the last high priority verification completes. */
+    static uint32_t highPriorityVerifications;          /**< The number of high priority verifications running. */
+
+    static std::mutex csThreadConfig;                   /**< The lock guarding threadConfig. */
+    static ProofVerifierThreadConfig threadConfig;      /**< The configuration of the verification threads. */
+
+    /**
+     * @brief Counts a high priority verification as running for its lifetime.
+     */
+    class CHighPriorityVerification
+    {
+    public:
+        CHighPriorityVerification();
+        ~CHighPriorityVerification();
+    };
+
     const Verification verificationMode;    /**< The type of verification to be performed by this instance of proof verifier. */
 
     const Priority verificationPriority;    /**< Proof verification priority.
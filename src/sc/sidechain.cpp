@@ -83,6 +83,31 @@ void Sidechain::ClearSidechainsFolder()
     }
 }
 
+/**
+ * @brief Deserializes the verification keys of the alive sidechains into the vkey cache, so that the
+ * first blocks after a restart do not pay for it when verifying their certificates.
+ */
+void Sidechain::WarmUpVKeyCache(const CCoinsViewCache& view)
+{
+    std::set<uint256> scIds;
+    view.GetScIds(scIds);
+
+    int nKeys = 0;
+    for (const uint256& scId : scIds)
+    {
+        CSidechain sidechain;
+        if (!view.GetSidechain(scId, sidechain) || sidechain.GetState(view) != CSidechain::State::ALIVE)
+            continue;
+
+        if (sidechain.fixedParams.wCertVk.GetVKeyPtr() != nullptr)
+            nKeys++;
+        if (sidechain.fixedParams.wCeasedVk.has_value() && sidechain.fixedParams.wCeasedVk->GetVKeyPtr() != nullptr)
+            nKeys++;
+    }
+
+    LogPrintf("%s(): %d verification keys of %d sidechains loaded\n", __func__, nKeys, scIds.size());
+}
+
 CSidechain::State CSidechain::GetState(const CCoinsViewCache& view) const
 {
     if (!isCreationConfirmed())
@@ -315,7 +340,34 @@ std::string CSidechain::ToString() const
 }
 
 size_t CSidechain::DynamicMemoryUsage() const {
-    return memusage::DynamicUsage(mImmatureAmounts) + memusage::DynamicUsage(scFees);
+    size_t mem = memusage::DynamicUsage(mImmatureAmounts) + memusage::DynamicUsage(scFees);
+    // the entries of a non ceasing sidechain are ScFeeData_v2
+    mem += scFees.size() * (memusage::MallocUsage(sizeof(Sidechain::ScFeeData_v2)) + memusage::MallocUsage(sizeof(memusage::stl_shared_counter)));
+
+    mem += pastEpochTopQualityCertView.certDataHash.DynamicMemoryUsage();
+    mem += lastTopQualityCertView.certDataHash.DynamicMemoryUsage();
+
+    mem += memusage::DynamicUsage(fixedParams.customData);
+    if (fixedParams.constant)
+        mem += fixedParams.constant->DynamicMemoryUsage();
+    mem += fixedParams.wCertVk.DynamicMemoryUsage();
+    if (fixedParams.wCeasedVk)
+        mem += fixedParams.wCeasedVk->DynamicMemoryUsage();
+    mem += memusage::DynamicUsage(fixedParams.vFieldElementCertificateFieldConfig);
+    mem += memusage::DynamicUsage(fixedParams.vBitVectorCertificateFieldConfig);
+    return mem;
+}
+
+void CSidechain::UpdateMinScFees()
+{
+    minFtScFee = 0;
+    minMbtrScFee = 0;
+    for (auto it = scFees.begin(); it != scFees.end(); ++it)
+    {
+        const Sidechain::ScFeeData& entry = **it;
+        minFtScFee   = (it == scFees.begin()) ? entry.forwardTxScFee : std::min(minFtScFee, entry.forwardTxScFee);
+        minMbtrScFee = (it == scFees.begin()) ? entry.mbtrTxScFee : std::min(minMbtrScFee, entry.mbtrTxScFee);
+    }
 }
 
 size_t CSidechainEvents::DynamicMemoryUsage() const {
@@ -771,6 +823,7 @@ void CSidechain::InitScFees()
             scFees.emplace_back(new Sidechain::ScFeeData_v2(lastTopQualityCertView.forwardTransferScFee,
                                 lastTopQualityCertView.mainchainBackwardTransferRequestScFee, lastInclusionHeight));
         }
+        UpdateMinScFees();
     }
 }
 
@@ -842,6 +895,8 @@ void CSidechain::UpdateScFees(const CScCertificateView& certView, int blockHeigh
         }
 
     }
+
+    UpdateMinScFees();
 }
 
 void CSidechain::DumpScFees() const
@@ -854,31 +909,15 @@ void CSidechain::DumpScFees() const
 CAmount CSidechain::GetMinFtScFee() const
 {
     assert(!scFees.empty());
-
-    CAmount minScFee = std::min_element(
-        scFees.begin(), scFees.end(),
-        [] (const std::shared_ptr<Sidechain::ScFeeData> &a, const std::shared_ptr<Sidechain::ScFeeData> &b) {
-            return a->forwardTxScFee < b->forwardTxScFee;
-        }
-    )->get()->forwardTxScFee;
-
-    LogPrint("sc", "%s():%d - returning min=%lld\n", __func__, __LINE__, minScFee);
-    return minScFee;
+    LogPrint("sc", "%s():%d - returning min=%lld\n", __func__, __LINE__, minFtScFee);
+    return minFtScFee;
 }
 
 CAmount CSidechain::GetMinMbtrScFee() const
 {
     assert(!scFees.empty());
-
-    CAmount minScFee = std::min_element(
-        scFees.begin(), scFees.end(),
-        [] (const std::shared_ptr<Sidechain::ScFeeData> &a, const std::shared_ptr<Sidechain::ScFeeData> &b) {
-            return a->mbtrTxScFee < b->mbtrTxScFee;
-        }
-    )->get()->mbtrTxScFee;
-
-    LogPrint("sc", "%s():%d - returning min=%lld\n", __func__, __LINE__, minScFee);
-    return minScFee;
+    LogPrint("sc", "%s():%d - returning min=%lld\n", __func__, __LINE__, minMbtrScFee);
+    return minMbtrScFee;
 }
 
 #endif
@@ -16,6 +16,7 @@ namespace Sidechain
     bool InitDLogKeys();
     bool InitSidechainsFolder();
     void ClearSidechainsFolder();
+    void WarmUpVKeyCache(const CCoinsViewCache& view);
     void LoadCumulativeProofsParameters();
 };
 
@@ -63,7 +64,7 @@ public:
         lastTopQualityCertReferencedEpoch(CScCertificate::EPOCH_NULL),
         lastTopQualityCertQuality(CScCertificate::QUALITY_NULL), lastTopQualityCertBwtAmount(0),
         balance(0), maxSizeOfScFeesContainers(-1),
-        lastInclusionHeight(-1) {}
+        lastInclusionHeight(-1), minFtScFee(0), minMbtrScFee(0) {}
 
     bool IsNull() const
     {
@@ -116,6 +117,12 @@ public:
     // the last ftScFee and mbtrScFee values, as set by the active certificates
     // it behaves like a circular buffer once the max size is reached
     std::list<std::shared_ptr<Sidechain::ScFeeData>> scFees;
+    // memory only, the minimum fees of scFees, which are checked for each forward transfer and backward
+    // transfer request while the list only changes with the blocks; UpdateMinScFees() must be called
+    // whenever scFees is changed
+    CAmount minFtScFee;
+    CAmount minMbtrScFee;
+    void UpdateMinScFees();
 
     // compute the max size of the sc fee list
     int getMaxSizeOfScFeesContainers();
@@ -181,6 +188,11 @@ public:
         else {
             READWRITE_POLYMORPHIC(scFees, Sidechain::ScFeeData, Sidechain::ScFeeData);
         }
+
+        if (ser_action.ForRead())
+        {
+            UpdateMinScFees();
+        }
     }
 
     inline bool operator==(const CSidechain& rhs) const
@@ -1,9 +1,13 @@
 #include <sc/sidechainTxsCommitmentBuilder.h>
+#include <primitives/block.h>
 #include <primitives/transaction.h>
 #include <primitives/certificate.h>
+#include <hash.h>
 #include <uint256.h>
 #include <algorithm>
+#include <deque>
 #include <iostream>
+#include <mutex>
 #include <zendoo/zendoo_mc.h>
 
 // TODO remove when not needed anymore
@@ -13,23 +17,18 @@
 bool SidechainTxsCommitmentBuilder::add(const CTransaction& tx) { return true; }
 bool SidechainTxsCommitmentBuilder::add(const CScCertificate& cert, const CCoinsViewCache& view) { return true; }
 uint256 SidechainTxsCommitmentBuilder::getCommitment() { return uint256(); }
-SidechainTxsCommitmentBuilder::SidechainTxsCommitmentBuilder(): _cmt(nullptr) {}
+SidechainTxsCommitmentBuilder::SidechainTxsCommitmentBuilder(): _cmt(nullptr), _fStale(false) {}
 SidechainTxsCommitmentBuilder::~SidechainTxsCommitmentBuilder(){}
 #else
-SidechainTxsCommitmentBuilder::SidechainTxsCommitmentBuilder(): _cmt(initPtr())
+SidechainTxsCommitmentBuilder::SidechainTxsCommitmentBuilder(): _cmt(zendoo_commitment_tree_create()), _fStale(false)
 {
     assert(_cmt != nullptr);
 }
 
-const commitment_tree_t* const SidechainTxsCommitmentBuilder::initPtr()
-{
-    return zendoo_commitment_tree_create();
-}
-
 SidechainTxsCommitmentBuilder::~SidechainTxsCommitmentBuilder()
 {
     assert(_cmt != nullptr);
-    zendoo_commitment_tree_delete(const_cast<commitment_tree_t*>(_cmt));
+    zendoo_commitment_tree_delete(_cmt);
 }
 
 bool SidechainTxsCommitmentBuilder::add_scc(const CTxScCreationOut& ccout, const BufferWithSize& bws_tx_hash, uint32_t out_idx, CctpErrorCode& ret_code)
@@ -94,7 +93,7 @@ bool SidechainTxsCommitmentBuilder::add_scc(const CTxScCreationOut& ccout, const
         ));
     }
 
-    bool ret = zendoo_commitment_tree_add_scc(const_cast<commitment_tree_t*>(_cmt),
+    bool ret = zendoo_commitment_tree_add_scc(_cmt,
          scid_fe, 
          (uint64_t)ccout.nValue,
          &bws_pk,
@@ -128,7 +127,7 @@ bool SidechainTxsCommitmentBuilder::add_scc(const CTxScCreationOut& ccout, const
          ccout.mainchainBackwardTransferRequestScFee, ccout.forwardTransferScFee);
 
     CctpErrorCode code;
-    field_t* fe = zendoo_commitment_tree_get_commitment(const_cast<commitment_tree_t*>(_cmt), &code);
+    field_t* fe = zendoo_commitment_tree_get_commitment(_cmt, &code);
     assert(code == CctpErrorCode::OK);
     assert(fe != nullptr);
 
@@ -151,7 +150,7 @@ bool SidechainTxsCommitmentBuilder::add_fwt(const CTxForwardTransferOut& ccout,
     const uint160& fwt_mc_return_address = ccout.mcReturnAddress;
     BufferWithSize bws_fwt_return_address((unsigned char*)fwt_mc_return_address.begin(), fwt_mc_return_address.size());
 
-    bool ret = zendoo_commitment_tree_add_fwt(const_cast<commitment_tree_t*>(_cmt),
+    bool ret = zendoo_commitment_tree_add_fwt(_cmt,
          scid_fe,
          ccout.nValue,
          &bws_fwt_pk,
@@ -194,7 +193,7 @@ bool SidechainTxsCommitmentBuilder::add_bwtr(const CBwtRequestOut& ccout, const
     const uint160& bwtr_pk_hash = ccout.mcDestinationAddress;
     BufferWithSize bws_bwtr_pk_hash(bwtr_pk_hash.begin(), bwtr_pk_hash.size());
 
-    bool ret = zendoo_commitment_tree_add_bwtr(const_cast<commitment_tree_t*>(_cmt),
+    bool ret = zendoo_commitment_tree_add_bwtr(_cmt,
          scid_fe,
          ccout.scFee,
          sc_req_data.get(),
@@ -225,7 +224,7 @@ bool SidechainTxsCommitmentBuilder::add_csw(const CTxCeasedSidechainWithdrawalIn
 
     wrappedFieldPtr sptrNullifier = ccin.nullifier.GetFieldElement();
 
-    bool ret = zendoo_commitment_tree_add_csw(const_cast<commitment_tree_t*>(_cmt),
+    bool ret = zendoo_commitment_tree_add_csw(_cmt,
          scid_fe,
          ccin.nValue,
          sptrNullifier.get(),
@@ -295,7 +294,7 @@ bool SidechainTxsCommitmentBuilder::add_cert(const CScCertificate& cert, const S
 
     wrappedFieldPtr sptrCum = cert.endEpochCumScTxCommTreeRoot.GetFieldElement();
 
-    bool ret = zendoo_commitment_tree_add_cert(const_cast<commitment_tree_t*>(_cmt),
+    bool ret = zendoo_commitment_tree_add_cert(_cmt,
          scid_fe,
          cert.epochNumber,
          cert.quality,
@@ -317,13 +316,8 @@ bool SidechainTxsCommitmentBuilder::add_cert(const CScCertificate& cert, const S
     return ret;
 }
 
-bool SidechainTxsCommitmentBuilder::add(const CTransaction& tx)
+bool SidechainTxsCommitmentBuilder::apply_tx(const CTransaction& tx, bool& fTouched)
 {
-    assert(_cmt != nullptr);
-
-    if (!tx.IsScVersion())
-        return true;
-
     LogPrint("sc", "%s():%d adding tx[%s] to ScTxsCommitment\n", __func__, __LINE__, tx.GetHash().ToString());
 
     CctpErrorCode ret_code = CctpErrorCode::OK;
@@ -343,6 +337,7 @@ bool SidechainTxsCommitmentBuilder::add(const CTransaction& tx)
                 tx_hash.ToString(), scIdx, ret_code);
             return false;
         }
+        fTouched = true;
         out_idx++;
     }
 
@@ -356,6 +351,7 @@ bool SidechainTxsCommitmentBuilder::add(const CTransaction& tx)
                 tx_hash.ToString(), fwtIdx, ret_code);
             return false;
         }
+        fTouched = true;
         out_idx++;
     }
 
@@ -369,6 +365,7 @@ bool SidechainTxsCommitmentBuilder::add(const CTransaction& tx)
                 tx_hash.ToString(), bwtrIdx, ret_code);
             return false;
         }
+        fTouched = true;
  
         out_idx++;
     }
@@ -383,8 +380,67 @@ bool SidechainTxsCommitmentBuilder::add(const CTransaction& tx)
                 tx_hash.ToString(), cswIdx, ret_code);
             return false;
         }
+        fTouched = true;
+    }
+
+    return true;
+}
+
+bool SidechainTxsCommitmentBuilder::apply_cert(const CScCertificate& cert, const Sidechain::ScFixedParameters& scFixedParams)
+{
+    CctpErrorCode ret_code = CctpErrorCode::OK;
+
+    if (!add_cert(cert, scFixedParams, ret_code))
+    {
+        LogPrintf("%s():%d Error adding cert[%s], ret_code[%d]\n", __func__, __LINE__,
+            cert.GetHash().ToString(), ret_code);
+        return false;
     }
+    return true;
+}
+
+bool SidechainTxsCommitmentBuilder::rebuild()
+{
+    LogPrint("sc", "%s():%d - rebuilding ScTxsCommitment tree from %d txs/certs\n", __func__, __LINE__, _entries.size());
+
+    zendoo_commitment_tree_delete(_cmt);
+    _cmt = zendoo_commitment_tree_create();
+    assert(_cmt != nullptr);
 
+    for (const Entry& entry : _entries)
+    {
+        bool fTouched = false;
+        bool ret = entry.tx ? apply_tx(*entry.tx, fTouched) : apply_cert(*entry.cert, entry.scFixedParams);
+        // every entry has already been added once to a tree holding the same leaves before it
+        if (!ret)
+            return error("%s():%d - could not rebuild ScTxsCommitment tree", __func__, __LINE__);
+    }
+
+    _fStale = false;
+    return true;
+}
+
+bool SidechainTxsCommitmentBuilder::add(const CTransaction& tx)
+{
+    assert(_cmt != nullptr);
+
+    if (!tx.IsScVersion())
+        return true;
+
+    if (_fStale && !rebuild())
+        return false;
+
+    bool fTouched = false;
+    if (!apply_tx(tx, fTouched))
+    {
+        // the outputs added before the failing one stay in the tree
+        _fStale = fTouched;
+        return false;
+    }
+
+    Entry entry;
+    entry.tx = std::make_shared<const CTransaction>(tx);
+    _entries.push_back(std::move(entry));
     return true;
 }
 
@@ -392,25 +448,30 @@ bool SidechainTxsCommitmentBuilder::add(const CScCertificate& cert, const CCoins
 {
     assert(_cmt != nullptr);
 
-    CctpErrorCode ret_code = CctpErrorCode::OK;
+    if (_fStale && !rebuild())
+        return false;
 
     CSidechain sidechain;
     view.GetSidechain(cert.GetScId(), sidechain);
 
-    if (!add_cert(cert, sidechain.fixedParams, ret_code))
-    {
-        LogPrintf("%s():%d Error adding cert[%s], ret_code[%d]\n", __func__, __LINE__,
-            cert.GetHash().ToString(), ret_code);
+    if (!apply_cert(cert, sidechain.fixedParams))
         return false;
-    }
+
+    Entry entry;
+    entry.cert = std::make_shared<const CScCertificate>(cert);
+    entry.scFixedParams = sidechain.fixedParams;
+    _entries.push_back(std::move(entry));
     return true;
 }
 
 uint256 SidechainTxsCommitmentBuilder::getCommitment()
 {
     assert(_cmt != nullptr);
+    bool fRebuilt = !_fStale || rebuild();
+    assert(fRebuilt);
+
     CctpErrorCode code;
-    field_t* fe = zendoo_commitment_tree_get_commitment(const_cast<commitment_tree_t*>(_cmt), &code);
+    field_t* fe = zendoo_commitment_tree_get_commitment(_cmt, &code);
     assert(code == CctpErrorCode::OK);
     assert(fe != nullptr);
     //dumpFe(fe, "com fe");
@@ -432,3 +493,72 @@ const uint256& SidechainTxsCommitmentBuilder::getEmptyCommitment()
     return value;
 }
 #endif
+
+size_t SidechainTxsCommitmentBuilder::checkpoint() const
+{
+    return _entries.size();
+}
+
+void SidechainTxsCommitmentBuilder::rollback(size_t nCheckpoint)
+{
+    assert(nCheckpoint <= _entries.size());
+    if (nCheckpoint == _entries.size())
+        return;
+
+    _entries.erase(_entries.begin() + nCheckpoint, _entries.end());
+    _fStale = true;
+}
+
+namespace {
+
+std::mutex csBlockCommitments;
+std::deque<std::pair<uint256, uint256>> dequeBlockCommitments;
+
+uint256 BlockCommitmentKey(const CBlock& block)
+{
+    CHashWriter ss(SER_GETHASH, 0);
+    ss << block.hashPrevBlock;
+    for (const CTransaction& tx : block.vtx)
+    {
+        if (tx.IsScVersion())
+            ss << tx.GetHash();
+    }
+    // certs are always sc related, the count keeps them apart from the txs
+    ss << block.vcert.size();
+    for (const CScCertificate& cert : block.vcert)
+        ss << cert.GetHash();
+    return ss.GetHash();
+}
+
+} // anon namespace
+
+void SidechainTxsCommitmentBuilder::storeBlockCommitment(const CBlock& block, const uint256& commitment)
+{
+    const uint256 key = BlockCommitmentKey(block);
+
+    std::lock_guard<std::mutex> lock(csBlockCommitments);
+    for (const auto& entry : dequeBlockCommitments)
+    {
+        if (entry.first == key)
+            return;
+    }
+    dequeBlockCommitments.push_back(std::make_pair(key, commitment));
+    if (dequeBlockCommitments.size() > SC_TXS_COMMITMENT_CACHE_SIZE)
+        dequeBlockCommitments.pop_front();
+}
+
+bool SidechainTxsCommitmentBuilder::lookupBlockCommitment(const CBlock& block, uint256& commitment)
+{
+    const uint256 key = BlockCommitmentKey(block);
+
+    std::lock_guard<std::mutex> lock(csBlockCommitments);
+    for (const auto& entry : dequeBlockCommitments)
+    {
+        if (entry.first == key)
+        {
+            commitment = entry.second;
+            return true;
+        }
+    }
+    return false;
+}
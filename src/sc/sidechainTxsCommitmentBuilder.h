@@ -4,6 +4,10 @@
 #include "coins.h"
 #include <sc/sidechaintypes.h>
 
+#include <memory>
+#include <vector>
+
+class CBlock;
 class CTransaction;
 class CScCertificate;
 class uint256;
@@ -27,13 +31,43 @@ public:
     bool add(const CScCertificate& cert, const CCoinsViewCache& view);
     uint256 getCommitment();
 
+    /**
+     * The CCTP commitment tree cannot remove leaves, hence the builder keeps the list of the
+     * txs and certs it successfully added. A checkpoint is a position in that list: rolling back
+     * to it drops the entries added afterwards. If a failed add left some of its leaves in the
+     * tree, or the rollback dropped entries already in the tree, the tree is rebuilt from the
+     * list, once, when it is needed again.
+     */
+    size_t checkpoint() const;
+    void rollback(size_t nCheckpoint);
+
     static const uint256& getEmptyCommitment();
 
+    /**
+     * Commitments of the blocks assembled by this node, so that the validation of a block we
+     * mined does not build its commitment tree again. They are keyed by the previous block and
+     * by the sc related txs and certs of the block, which is all that the commitment depends on.
+     */
+    static void storeBlockCommitment(const CBlock& block, const uint256& commitment);
+    static bool lookupBlockCommitment(const CBlock& block, uint256& commitment);
+
 private:
-    const commitment_tree_t* const _cmt;
+    struct Entry
+    {
+        std::shared_ptr<const CTransaction> tx;
+        std::shared_ptr<const CScCertificate> cert;
+        Sidechain::ScFixedParameters scFixedParams;
+    };
 
-    // private initializer for instantiating the const ptr in the ctor initializer lists
-    const commitment_tree_t* const initPtr();
+    commitment_tree_t* _cmt;
+    std::vector<Entry> _entries;
+    // true if the tree does not hold exactly the leaves of _entries
+    bool _fStale;
+
+    bool rebuild();
+    bool apply(const Entry& entry, bool& fTouched);
+    bool apply_tx(const CTransaction& tx, bool& fTouched);
+    bool apply_cert(const CScCertificate& cert, const Sidechain::ScFixedParameters& scFixedParams);
 
     bool add_scc(const CTxScCreationOut& ccout, const BufferWithSize& bws_tx_hash, uint32_t out_idx, CctpErrorCode& ret_code);
     bool add_fwt(const CTxForwardTransferOut& ccout, const BufferWithSize& bws_tx_hash, uint32_t out_idx, CctpErrorCode& ret_code);
@@ -43,4 +77,6 @@ private:
     bool add_cert(const CScCertificate& cert, Sidechain::ScFixedParameters scFixedParams, CctpErrorCode& ret_code);
 };
 
+static const size_t SC_TXS_COMMITMENT_CACHE_SIZE = 8;
+
 #endif
\ No newline at end of file
@@ -853,7 +853,7 @@ ScRpcCmd::ScRpcCmd(
         const CBitcoinAddress& fromaddress, const CBitcoinAddress& changeaddress,
         int minConf, const CAmount& nFee): 
         _fromMcAddress(fromaddress), _changeMcAddress(changeaddress), _minConf(minConf), _fee(nFee), _feeNeeded(-1),
-        _automaticFee(false), _totalInputAmount(0), _totalOutputAmount(0)
+        _automaticFee(false), _totalInputAmount(0), _totalOutputAmount(0), _hasReservedInput(false)
 {
     _hasFromAddress   = !(_fromMcAddress   == CBitcoinAddress());
     _hasChangeAddress = !(_changeMcAddress == CBitcoinAddress());
@@ -881,6 +881,26 @@ void ScRpcCmd::init()
 
 void ScRpcCmd::addInputs()
 {
+    _hasReservedInput = false;
+    if (useReservedInputs())
+    {
+        // a single coin of the pool, leaving a change which is not dust, without looking at the other coins
+        COutPoint outpoint;
+        CAmount nValue;
+        if (pwalletMain->GetCertFeeCoin(_totalOutputAmount + _fee + _dustThreshold, outpoint, nValue))
+        {
+            LogPrint("sc", "---> added certificate fee pool coin %s val: %12s, vout.n: %d\n",
+                outpoint.hash.ToString(), FormatMoney(nValue), outpoint.n);
+            _totalInputAmount += nValue;
+            _hasReservedInput = true;
+            _reservedInput = SelectedUTXO(outpoint.hash, outpoint.n, nValue);
+            addInput(CTxIn(outpoint));
+            return;
+        }
+        LogPrint("sc", "%s():%d - no coin of the certificate fee pool is large enough, selecting among all the coins\n",
+            __func__, __LINE__);
+    }
+
     std::vector<COutput> vAvailableCoins;
     std::vector<SelectedUTXO> vInputUtxo;
 
@@ -1045,6 +1065,11 @@ ScRpcCmdCert::ScRpcCmdCert(
 {
 }
 
+bool ScRpcCmdCert::useReservedInputs() const
+{
+    return !_hasFromAddress && pwalletMain->HasCertFeePool();
+}
+
 void ScRpcCmdCert::_execute()
 {
     init();
@@ -1324,6 +1349,9 @@ void ScRpcCmd::execute()
         if (send())
         {
             // we made it
+            if (_hasReservedInput)
+                pwalletMain->UseCertFeeCoin(COutPoint(std::get<0>(_reservedInput), std::get<1>(_reservedInput)),
+                    std::get<2>(_reservedInput));
             break;
         }
         if (safeCount-- <= 0)
@@ -71,6 +71,10 @@ class ScRpcCmd
     // Input UTXO is a tuple (triple) of txid, vout, amount)
     typedef std::tuple<uint256, int, CAmount> SelectedUTXO;
 
+    // the coin of the certificate fee pool of the wallet funding the tx/cert, if any
+    bool _hasReservedInput;
+    SelectedUTXO _reservedInput;
+
     // set null all data members that are filled during tx/cert construction  
     virtual void init();
 
@@ -80,6 +84,9 @@ class ScRpcCmd
     virtual void addInput(const CTxIn& out) = 0;
     virtual void sign() = 0;
 
+    // whether the inputs are taken from the certificate fee pool of the wallet, when it has one
+    virtual bool useReservedInputs() const { return false; }
+
     // gathers all steps for building a tx/cert
     virtual void _execute() = 0;
 
@@ -135,6 +142,7 @@ class ScRpcCmdCert : public ScRpcCmd
     void addInput(const CTxIn& in) override    {_cert.vin.push_back(in); }
   
     void sign() override;
+    bool useReservedInputs() const override;
 
     void _execute() override;
 
@@ -1,4 +1,5 @@
 #include "sc/sidechaintypes.h"
+#include "random.h"
 #include "util.h"
 #include <consensus/consensus.h>
 #include <limits>
@@ -65,77 +66,26 @@ void CZendooCctpLibraryChecker::CheckTypeSizes()
     }
 }
 
-const std::vector<unsigned char>&  CZendooCctpObject::GetByteArray() const
-{
-    return byteVector;
-}
-
-CZendooCctpObject::CZendooCctpObject(const CZendooCctpObject& obj)
-{
-    // lock both mutexes without deadlock
-    std::lock(_mutex, obj._mutex);
-
-    // make sure both already-locked mutexes are unlocked at the end of scope
-    std::lock_guard<std::mutex> lhs_lk(_mutex, std::adopt_lock);
-    std::lock_guard<std::mutex> rhs_lk(obj._mutex, std::adopt_lock);
-
-    byteVector = obj.byteVector;
-}
+///////////////////////////////// Field types //////////////////////////////////
+CFieldElement::CFieldElement(const CFieldElement& rhs):
+    CZendooCctpObject(rhs), fieldData(std::atomic_load(&rhs.fieldData)) {}
 
-CZendooCctpObject& CZendooCctpObject::operator=(const CZendooCctpObject& obj)
+CFieldElement& CFieldElement::operator=(const CFieldElement& rhs)
 {
-    if (this != &obj)
+    if (this != &rhs)
     {
-        // lock both mutexes without deadlock
-        std::lock(_mutex, obj._mutex);
-
-        // make sure both already-locked mutexes are unlocked at the end of scope
-        std::lock_guard<std::mutex> lhs_lk(_mutex, std::adopt_lock);
-        std::lock_guard<std::mutex> rhs_lk(obj._mutex, std::adopt_lock);
-
-        byteVector = obj.byteVector;
+        byteArray = rhs.byteArray;
+        fieldData = std::atomic_load(&rhs.fieldData);
     }
     return *this;
 }
 
-const unsigned char* const CZendooCctpObject::GetDataBuffer() const
-{
-    if (GetByteArray().empty())
-        return nullptr;
-
-    return &GetByteArray()[0];
-}
-
-int CZendooCctpObject::GetDataSize() const
-{
-    return GetByteArray().size();
-}
-
-void CZendooCctpObject::SetNull()
-{
-    byteVector.resize(0);
-}
-
-bool CZendooCctpObject::IsNull() const {
-    return byteVector.empty();
-}
-
-std::string CZendooCctpObject::GetHexRepr() const
+void CFieldElement::SetNull()
 {
-    std::string res; //ADAPTED FROM UTILSTRENCONDING.CPP HEXSTR
-    static const char hexmap[16] = { '0', '1', '2', '3', '4', '5', '6', '7',
-                                     '8', '9', 'a', 'b', 'c', 'd', 'e', 'f' };
-    res.reserve(this->byteVector.size()*2);
-    for(const auto& byte: this->byteVector)
-    {
-        res.push_back(hexmap[byte>>4]);
-        res.push_back(hexmap[byte&15]);
-    }
-
-    return res;
+    byteArray.clear();
+    fieldData.reset();
 }
 
-///////////////////////////////// Field types //////////////////////////////////
 #ifdef BITCOIN_TX
 void CFieldPtrDeleter::operator()(field_t* p) const {};
 CFieldElement::CFieldElement(const std::vector<unsigned char>& byteArrayIn) {};
@@ -163,24 +113,24 @@ CFieldElement::CFieldElement(const std::vector<unsigned char>& byteArrayIn): CZe
 void CFieldElement::SetByteArray(const std::vector<unsigned char>& byteArrayIn)
 {
     assert(byteArrayIn.size() == this->ByteSize());
-    this->byteVector = byteArrayIn;
+    byteArray.assign(byteArrayIn.data(), byteArrayIn.size());
     fieldData.reset();
 }
 
 CFieldElement::CFieldElement(const uint256& value)
 {
-    this->byteVector.resize(CFieldElement::ByteSize(),0x0);
-    std::copy(value.begin(), value.end(), this->byteVector.begin());
-    fieldData.reset();
+    static_assert(sizeof(uint256) == CFieldElement::ByteSize(), "a uint256 must fill a field element");
+    byteArray.assign(value.begin(), value.size());
 }
 
 CFieldElement::CFieldElement(const wrappedFieldPtr& wrappedField)
 {
-    this->byteVector.resize(CFieldElement::ByteSize(),0x0);
+    byteArray.resize_uninitialized(CFieldElement::ByteSize());
+    memset(byteArray.data(), 0, CFieldElement::ByteSize());
     if (wrappedField != nullptr)
     {
         CctpErrorCode code;
-        zendoo_serialize_field(wrappedField.get(), &byteVector[0], &code);
+        zendoo_serialize_field(wrappedField.get(), byteArray.data(), &code);
         assert(code == CctpErrorCode::OK);
         fieldData = wrappedField;
     }
@@ -188,45 +138,44 @@ CFieldElement::CFieldElement(const wrappedFieldPtr& wrappedField)
 
 wrappedFieldPtr CFieldElement::GetFieldElement() const
 {
-    if (byteVector.empty())
+    if (byteArray.empty())
     {
-        LogPrint("sc", "%s():%d - empty byteVector\n", __func__, __LINE__);
-        assert(fieldData == nullptr);
-        return fieldData;
+        LogPrint("sc", "%s():%d - empty byteArray\n", __func__, __LINE__);
+        return nullptr;
     }
 
-    if (byteVector.size() != ByteSize())
+    if (byteArray.size() != ByteSize())
     {
-        LogPrint("sc", "%s():%d - wrong fe size: byteVector[%d] != %d\n",
-            __func__, __LINE__, byteVector.size(), ByteSize());
-        assert(fieldData == nullptr);
-        return fieldData;
+        LogPrint("sc", "%s():%d - wrong fe size: byteArray[%d] != %d\n",
+            __func__, __LINE__, byteArray.size(), ByteSize());
+        return nullptr;
     }
 
-    std::lock_guard<std::mutex> lk(_mutex);
+    wrappedFieldPtr ret = std::atomic_load(&fieldData);
+    if (ret != nullptr)
+        return ret;
 
-    if (fieldData == nullptr)
+    CctpErrorCode code;
+    ret = wrappedFieldPtr{zendoo_deserialize_field(byteArray.data(), &code), theFieldPtrDeleter};
+    if (code != CctpErrorCode::OK)
     {
-        CctpErrorCode code;
-        wrappedFieldPtr ret{zendoo_deserialize_field(&this->byteVector[0], &code), theFieldPtrDeleter};
-        if (code != CctpErrorCode::OK)
-        {
-            LogPrintf("%s():%d - could not deserialize: error code[0x%x]\n", __func__, __LINE__, code);
-            assert(fieldData == nullptr);
-            return fieldData;
-        }
-        fieldData.swap(ret);
+        LogPrintf("%s():%d - could not deserialize: error code[0x%x]\n", __func__, __LINE__, code);
+        return nullptr;
     }
 
-    return fieldData;
+    // concurrent callers may deserialize the element at the same time, the first one publishes it
+    wrappedFieldPtr published;
+    if (!std::atomic_compare_exchange_strong(&fieldData, &published, ret))
+        return published;
+    return ret;
 }
 
 uint256 CFieldElement::GetLegacyHash() const
 {
-    if (this->byteVector.size() < Sidechain::SC_FE_SIZE_IN_BYTES)
+    if (byteArray.size() < Sidechain::SC_FE_SIZE_IN_BYTES)
         return uint256(); // zero
 
-    std::vector<unsigned char> tmp(this->byteVector.begin(), this->byteVector.begin()+Sidechain::SC_FE_SIZE_IN_BYTES);
+    std::vector<unsigned char> tmp(byteArray.begin(), byteArray.begin()+Sidechain::SC_FE_SIZE_IN_BYTES);
     return uint256(tmp);
 }
 
@@ -309,47 +258,67 @@ CScProof::CScProof(const std::vector<unsigned char>& byteArrayIn): CZendooCctpOb
     proofData.reset();
 }
 
+CScProof::CScProof(const CScProof& rhs):
+    CZendooCctpObject(rhs), proofData(std::atomic_load(&rhs.proofData)) {}
+
+CScProof& CScProof::operator=(const CScProof& rhs)
+{
+    if (this != &rhs)
+    {
+        byteArray = rhs.byteArray;
+        proofData = std::atomic_load(&rhs.proofData);
+    }
+    return *this;
+}
+
 void CScProof::SetByteArray(const std::vector<unsigned char>& byteArrayIn)
 {
     assert(byteArrayIn.size() <= this->MaxByteSize());
-    this->byteVector = byteArrayIn;
+    byteArray.assign(byteArrayIn.data(), byteArrayIn.size());
+    proofData.reset();
+}
+
+void CScProof::SetNull()
+{
+    byteArray.clear();
     proofData.reset();
 }
 
 wrappedScProofPtr CScProof::GetProofPtr() const
 {
-    if (this->byteVector.empty())
+    if (byteArray.empty())
     {
-        LogPrint("sc", "%s():%d - empty byteVector\n", __func__, __LINE__);
-        assert(proofData == nullptr);
-        return proofData;
+        LogPrint("sc", "%s():%d - empty byteArray\n", __func__, __LINE__);
+        return nullptr;
     }
 
-    std::lock_guard<std::mutex> lk(_mutex);
-    if (proofData == nullptr)
+    wrappedScProofPtr ret = std::atomic_load(&proofData);
+    if (ret != nullptr)
+        return ret;
+
+    if (byteArray.size() > MaxByteSize())
     {
-        if (byteVector.size() > MaxByteSize())
-        {
-            LogPrint("sc", "%s():%d - exceeded max size: byteVector[%d] != %d\n",
-                __func__, __LINE__, byteVector.size(), MaxByteSize());
-            assert(proofData == nullptr);
-            return proofData;
-        }
+        LogPrint("sc", "%s():%d - exceeded max size: byteArray[%d] != %d\n",
+            __func__, __LINE__, byteArray.size(), MaxByteSize());
+        return nullptr;
+    }
 
-        BufferWithSize result{(unsigned char*)&byteVector[0], byteVector.size()}; 
-        CctpErrorCode code;
+    BufferWithSize result{byteArray.data(), byteArray.size()};
+    CctpErrorCode code;
 
-        wrappedScProofPtr ret{zendoo_deserialize_sc_proof(&result, true, &code), theProofPtrDeleter};
- 
-        if (code != CctpErrorCode::OK)
-        {
-            LogPrintf("%s():%d - ERROR: code[0x%x]\n", __func__, __LINE__, code);
-            assert(proofData == nullptr);
-            return proofData;
-        }
-        proofData.swap(ret);
+    ret = wrappedScProofPtr{zendoo_deserialize_sc_proof(&result, true, &code), theProofPtrDeleter};
+
+    if (code != CctpErrorCode::OK)
+    {
+        LogPrintf("%s():%d - ERROR: code[0x%x]\n", __func__, __LINE__, code);
+        return nullptr;
     }
-    return proofData;
+
+    // concurrent callers may deserialize the proof at the same time, the first one publishes it
+    wrappedScProofPtr published;
+    if (!std::atomic_compare_exchange_strong(&proofData, &published, ret))
+        return published;
+    return ret;
 }
 
 bool CScProof::IsValid() const
@@ -363,14 +332,15 @@ bool CScProof::IsValid() const
 Sidechain::ProvingSystemType CScProof::getProvingSystemType() const
 {
     // this initializes wrapped ptr if necessary
-    if (!IsValid())
+    wrappedScProofPtr proofPtr = GetProofPtr();
+    if (proofPtr == nullptr)
     {
         LogPrintf("%s():%d - ERROR: invalid proof\n", __func__, __LINE__);
         return Sidechain::ProvingSystemType::Undefined;
     }
 
     CctpErrorCode code;
-    ProvingSystem psType = zendoo_get_sc_proof_proving_system_type(proofData.get(), &code);
+    ProvingSystem psType = zendoo_get_sc_proof_proving_system_type(proofPtr.get(), &code);
     if (code != CctpErrorCode::OK)
     {
         LogPrintf("%s():%d - ERROR: code[0x%x]\n", __func__, __LINE__, code);
@@ -395,47 +365,73 @@ CScVKey::CScVKey(const std::vector<unsigned char>& byteArrayIn)
     vkData.reset();
 }
 
+CScVKey::CScVKey(const CScVKey& rhs):
+    CZendooCctpObject(rhs), vkData(std::atomic_load(&rhs.vkData)) {}
+
+CScVKey& CScVKey::operator=(const CScVKey& rhs)
+{
+    if (this != &rhs)
+    {
+        byteArray = rhs.byteArray;
+        vkData = std::atomic_load(&rhs.vkData);
+    }
+    return *this;
+}
+
 void CScVKey::SetByteArray(const std::vector<unsigned char>& byteArrayIn)
 {
     assert(byteArrayIn.size() <= this->MaxByteSize());
-    this->byteVector = byteArrayIn;
+    byteArray.assign(byteArrayIn.data(), byteArrayIn.size());
+    vkData.reset();
+}
+
+void CScVKey::SetNull()
+{
+    byteArray.clear();
     vkData.reset();
 }
 
 wrappedScVkeyPtr CScVKey::GetVKeyPtr() const
 {
-    if (this->byteVector.empty())
+    if (byteArray.empty())
     {
-        LogPrint("sc", "%s():%d - empty byteVector\n", __func__, __LINE__);
-        assert(vkData == nullptr);
-        return vkData;
+        LogPrint("sc", "%s():%d - empty byteArray\n", __func__, __LINE__);
+        return nullptr;
     }
 
-    std::lock_guard<std::mutex> lk(_mutex);
-    if (vkData == nullptr)
-    {
+    wrappedScVkeyPtr ret = std::atomic_load(&vkData);
+    if (ret != nullptr)
+        return ret;
 
-        if (byteVector.size() > MaxByteSize())
-        {
-            LogPrint("sc", "%s():%d - exceeded max size: byteVector[%d] != %d\n",
-                __func__, __LINE__, byteVector.size(), MaxByteSize());
-            assert(vkData == nullptr);
-            return vkData;
-        }
+    if (byteArray.size() > MaxByteSize())
+    {
+        LogPrint("sc", "%s():%d - exceeded max size: byteArray[%d] != %d\n",
+            __func__, __LINE__, byteArray.size(), MaxByteSize());
+        return nullptr;
+    }
 
-        BufferWithSize result{(unsigned char*)&byteVector[0], byteVector.size()}; 
+    // the same key may have been deserialized already by another copy of the sidechain
+    const uint256 vkHash = Hash(byteArray.data(), byteArray.data() + byteArray.size());
+    ret = CScVKeyCache::GetInstance().Get(vkHash);
+    if (ret == nullptr)
+    {
+        BufferWithSize result{byteArray.data(), byteArray.size()};
         CctpErrorCode code;
 
-        wrappedScVkeyPtr ret{zendoo_deserialize_sc_vk(&result, true, &code), theVkPtrDeleter};
+        ret = wrappedScVkeyPtr{zendoo_deserialize_sc_vk(&result, true, &code), theVkPtrDeleter};
         if (code != CctpErrorCode::OK)
         {
             LogPrintf("%s():%d - ERROR: code[0x%x]\n", __func__, __LINE__, code);
-            assert(vkData == nullptr);
-            return vkData;
+            return nullptr;
         }
-        vkData.swap(ret);
+        CScVKeyCache::GetInstance().Insert(vkHash, ret, byteArray.size());
     }
-    return vkData;
+
+    // concurrent callers may deserialize the key at the same time, the first one publishes it
+    wrappedScVkeyPtr published;
+    if (!std::atomic_compare_exchange_strong(&vkData, &published, ret))
+        return published;
+    return ret;
 }
 
 bool CScVKey::IsValid() const
@@ -449,14 +445,15 @@ bool CScVKey::IsValid() const
 Sidechain::ProvingSystemType CScVKey::getProvingSystemType() const
 {
     // this initializes wrapped ptr if necessary
-    if (!IsValid())
+    wrappedScVkeyPtr vkPtr = GetVKeyPtr();
+    if (vkPtr == nullptr)
     {
         LogPrintf("%s():%d - ERROR: invalid vk\n", __func__, __LINE__);
         return Sidechain::ProvingSystemType::Undefined;
     }
 
     CctpErrorCode code;
-    ProvingSystem psType = zendoo_get_sc_vk_proving_system_type(vkData.get(), &code);
+    ProvingSystem psType = zendoo_get_sc_vk_proving_system_type(vkPtr.get(), &code);
     if (code != CctpErrorCode::OK)
     {
         LogPrintf("%s():%d - ERROR: code[0x%x]\n", __func__, __LINE__, code);
@@ -470,6 +467,63 @@ void CVKeyPtrDeleter::operator()(sc_vk_t* p) const
     zendoo_sc_vk_free(p);
     p = nullptr;
 }
+
+CScVKeyCache& CScVKeyCache::GetInstance()
+{
+    static CScVKeyCache instance;
+    return instance;
+}
+
+wrappedScVkeyPtr CScVKeyCache::Get(const uint256& vkHash)
+{
+    LOCK(cs_vkcache);
+    auto it = mapKeys.find(vkHash);
+    if (it == mapKeys.end())
+        return nullptr;
+    return it->second.vkPtr;
+}
+
+void CScVKeyCache::Insert(const uint256& vkHash, const wrappedScVkeyPtr& vkPtr, size_t nKeyBytes)
+{
+    int64_t nMaxCacheSize = GetArg("-maxscvkcachesize", DEFAULT_MAX_SIZE);
+    if (nMaxCacheSize <= 0) return;
+
+    LOCK(cs_vkcache);
+
+    while (static_cast<int64_t>(mapKeys.size()) >= nMaxCacheSize)
+    {
+        // Evict a random entry, as done by the verified proof cache.
+        auto it = mapKeys.lower_bound(GetFastRandHash());
+        if (it == mapKeys.end())
+            it = mapKeys.begin();
+        nKeysUsage -= it->second.nUsage;
+        mapKeys.erase(it);
+    }
+
+    const size_t nUsage = memusage::MallocUsage(nKeyBytes * Sidechain::FFI_POINTS_EXPANSION) +
+                          memusage::MallocUsage(sizeof(memusage::stl_shared_counter));
+    if (mapKeys.insert(std::make_pair(vkHash, CEntry{vkPtr, nUsage})).second)
+        nKeysUsage += nUsage;
+}
+
+void CScVKeyCache::Clear()
+{
+    LOCK(cs_vkcache);
+    mapKeys.clear();
+    nKeysUsage = 0;
+}
+
+size_t CScVKeyCache::Size()
+{
+    LOCK(cs_vkcache);
+    return mapKeys.size();
+}
+
+size_t CScVKeyCache::DynamicMemoryUsage()
+{
+    LOCK(cs_vkcache);
+    return memusage::DynamicUsage(mapKeys) + nKeysUsage;
+}
 //////////////////////////////// End of CScVKey ////////////////////////////////
 
 ////////////////////////////// Custom Config types //////////////////////////////
@@ -1,8 +1,12 @@
 #ifndef _SIDECHAIN_TYPES_H
 #define _SIDECHAIN_TYPES_H
 
+#include <algorithm>
+#include <array>
+#include <memory>
 #include <vector>
 #include <string>
+#include <string.h>
 #include <mutex>
 #include <iomanip> // std::setw
 #include <optional>
@@ -16,6 +20,8 @@
 
 #include "uint256.h"
 #include "hash.h"
+#include "memusage.h"
+#include "saltedhasher.h"
 #include "script/script.h"
 #include "amount.h"
 #include "serialize.h"
@@ -44,6 +50,11 @@ namespace Sidechain
     static const int MAX_SC_PROOF_SIZE_IN_BYTES = MAX_PROOF_PLUS_VK_SIZE;
     static const int MAX_SC_VK_SIZE_IN_BYTES    = MAX_PROOF_PLUS_VK_SIZE;
 
+    // The zendoo library does not report the memory of the objects it deserializes, which is estimated
+    // instead: a field element is allocated as it is, the points of proofs and keys uncompressed
+    static const size_t FFI_FIELD_ELEMENT_USAGE    = SC_FE_SIZE_IN_BYTES;
+    static const size_t FFI_POINTS_EXPANSION       = 2;
+
     static const int SEGMENT_SIZE = 1 << 18;
 }
 
@@ -88,34 +99,149 @@ class CZendooCctpLibraryChecker
     static void CheckTypeSizes();
 };
 
+/**
+ * A byte array which is stored inline up to N bytes, and in a heap buffer of its exact size above.
+ * The heap buffer is shared by the copies of an array and never written once shared, so that copying
+ * a verification key or a proof, e.g. with the sidechain holding it, does not copy its bytes.
+ * It is serialized as a std::vector<unsigned char>, and ordered as one.
+ */
+template <unsigned int N>
+class CCctpByteArray
+{
+public:
+    CCctpByteArray() = default;
+    CCctpByteArray(const unsigned char* data, size_t size) { assign(data, size); }
+    CCctpByteArray(const CCctpByteArray& rhs) : nSize(rhs.nSize), inlineBytes(rhs.inlineBytes), heapBytes(rhs.heapBytes) {}
+    CCctpByteArray(CCctpByteArray&& rhs) noexcept : nSize(rhs.nSize), inlineBytes(rhs.inlineBytes), heapBytes(std::move(rhs.heapBytes)) { rhs.nSize = 0; }
+
+    CCctpByteArray& operator=(const CCctpByteArray& rhs)
+    {
+        nSize = rhs.nSize;
+        inlineBytes = rhs.inlineBytes;
+        heapBytes = rhs.heapBytes;
+        return *this;
+    }
+
+    CCctpByteArray& operator=(CCctpByteArray&& rhs) noexcept
+    {
+        nSize = rhs.nSize;
+        inlineBytes = rhs.inlineBytes;
+        heapBytes = std::move(rhs.heapBytes);
+        rhs.nSize = 0;
+        return *this;
+    }
+
+    const unsigned char* data() const { return nSize <= N ? inlineBytes.data() : heapBytes.get(); }
+    //! Only valid after resize_uninitialized, which makes the heap buffer not shared
+    unsigned char* data() { return nSize <= N ? inlineBytes.data() : heapBytes.get(); }
+    size_t size() const { return nSize; }
+    bool empty() const { return nSize == 0; }
+    const unsigned char* begin() const { return data(); }
+    const unsigned char* end() const { return data() + nSize; }
+
+    //! Resize to size bytes, whose content is undefined
+    void resize_uninitialized(size_t size)
+    {
+        if (size > N && (nSize <= N || size != nSize || heapBytes.use_count() > 1))
+            heapBytes.reset(new unsigned char[size]);
+        else if (size <= N)
+            heapBytes.reset();
+        nSize = size;
+    }
+
+    void assign(const unsigned char* dataIn, size_t size)
+    {
+        resize_uninitialized(size);
+        if (size > 0)
+            memcpy(data(), dataIn, size);
+    }
+
+    void clear() { resize_uninitialized(0); }
+
+    //! A heap buffer shared by several copies is counted for each of them
+    size_t DynamicMemoryUsage() const { return nSize > N ? memusage::MallocUsage(nSize) + memusage::MallocUsage(sizeof(memusage::stl_shared_counter)) : 0; }
+
+    bool operator==(const CCctpByteArray& rhs) const { return nSize == rhs.nSize && std::equal(begin(), end(), rhs.begin()); }
+    bool operator!=(const CCctpByteArray& rhs) const { return !(*this == rhs); }
+    bool operator<(const CCctpByteArray& rhs) const { return std::lexicographical_compare(begin(), end(), rhs.begin(), rhs.end()); }
+
+    unsigned int GetSerializeSize(int nType, int nVersion) const
+    {
+        return GetSizeOfCompactSize(nSize) + nSize;
+    }
+
+    template <typename Stream>
+    void Serialize(Stream& s, int nType, int nVersion) const
+    {
+        WriteCompactSize(s, nSize);
+        if (nSize > 0)
+            s.write((const char*)data(), nSize);
+    }
+
+    template <typename Stream>
+    void Unserialize(Stream& s, int nType, int nVersion)
+    {
+        const uint64_t nSizeIn = ReadCompactSize(s);
+        if (nSizeIn <= N) {
+            resize_uninitialized(nSizeIn);
+            if (nSizeIn > 0)
+                s.read((char*)data(), nSizeIn);
+            return;
+        }
+        // as for a vector, a bogus size must not be allocated before the bytes are actually read
+        std::vector<unsigned char> vch;
+        for (uint64_t i = 0; i < nSizeIn; ) {
+            const uint64_t blk = std::min<uint64_t>(nSizeIn - i, 5000000);
+            vch.resize(i + blk);
+            s.read((char*)&vch[i], blk);
+            i += blk;
+        }
+        assign(vch.data(), vch.size());
+    }
+
+private:
+    uint32_t nSize = 0;
+    std::array<unsigned char, N> inlineBytes;
+    std::shared_ptr<unsigned char[]> heapBytes;
+};
+
+/**
+ * The serialized form of an object of the cctp library. The deserialized object is built lazily by
+ * the derived classes and shared among the copies of an object: it is published through the atomic
+ * shared_ptr functions, so that concurrent readers need no per-object lock.
+ */
+template <unsigned int N>
 class CZendooCctpObject
 {
 public:
     CZendooCctpObject() = default;
-    CZendooCctpObject& operator=(const CZendooCctpObject& obj);
-    CZendooCctpObject(const CZendooCctpObject&);
+    explicit CZendooCctpObject(const std::vector<unsigned char>& byteArrayIn): byteArray(byteArrayIn.data(), byteArrayIn.size()) {}
 
-    virtual ~CZendooCctpObject() = default;
+    std::vector<unsigned char> GetByteArray() const { return std::vector<unsigned char>(byteArray.begin(), byteArray.end()); }
+    const unsigned char* GetDataBuffer() const { return byteArray.empty() ? nullptr : byteArray.data(); }
+    int GetDataSize() const { return byteArray.size(); }
 
-    CZendooCctpObject(const std::vector<unsigned char>& byteArrayIn): byteVector(byteArrayIn) {}
-    virtual void SetByteArray(const std::vector<unsigned char>& byteArrayIn) = 0; //Does custom-size check
-    const std::vector<unsigned char>& GetByteArray() const;
-    const unsigned char* const GetDataBuffer() const;
-    int GetDataSize() const;
+    bool IsNull() const { return byteArray.empty(); }
 
-    void SetNull();
-    bool IsNull() const;
-
-    virtual bool IsValid() const = 0;
+    std::string GetHexRepr() const
+    {
+        std::string res; //ADAPTED FROM UTILSTRENCONDING.CPP HEXSTR
+        static const char hexmap[16] = { '0', '1', '2', '3', '4', '5', '6', '7',
+                                         '8', '9', 'a', 'b', 'c', 'd', 'e', 'f' };
+        res.reserve(byteArray.size()*2);
+        for(const unsigned char byte: byteArray)
+        {
+            res.push_back(hexmap[byte>>4]);
+            res.push_back(hexmap[byte&15]);
+        }
 
-    std::string GetHexRepr() const;
+        return res;
+    }
 
 protected:
-    bool isBaseEqual(const CZendooCctpObject& rhs) const { return this->byteVector == rhs.byteVector; }
-
-    mutable std::mutex _mutex;
+    bool isBaseEqual(const CZendooCctpObject& rhs) const { return this->byteArray == rhs.byteArray; }
 
-    std::vector<unsigned char> byteVector;
+    CCctpByteArray<N> byteArray;
 };
 
 ///////////////////////////////// CFieldElement ////////////////////////////////
@@ -127,13 +253,19 @@ struct CFieldPtrDeleter
 
 typedef std::shared_ptr<field_t> wrappedFieldPtr;
 
-class CFieldElement : public CZendooCctpObject
+class CFieldElement : public CZendooCctpObject<Sidechain::SC_FE_SIZE_IN_BYTES>
 {
 public:
     CFieldElement() = default;
     ~CFieldElement() = default;
+    CFieldElement(const CFieldElement& rhs);
+    CFieldElement(CFieldElement&& rhs) = default;
+    CFieldElement& operator=(const CFieldElement& rhs);
+    CFieldElement& operator=(CFieldElement&& rhs) = default;
+
     explicit CFieldElement(const std::vector<unsigned char>& byteArrayIn);
-    void SetByteArray(const std::vector<unsigned char>& byteArrayIn) override final;
+    void SetByteArray(const std::vector<unsigned char>& byteArrayIn); //Does custom-size check
+    void SetNull();
 
     explicit CFieldElement(const uint256& value); //Currently for backward compability with pre-sidechain fork blockHeader. To re-evaluate its necessity
     explicit CFieldElement(const wrappedFieldPtr& wrappedField);
@@ -143,8 +275,8 @@ public:
     uint256 GetLegacyHash() const;
 
     wrappedFieldPtr GetFieldElement() const;
-    bool IsValid() const override final;
-    bool operator<(const CFieldElement& rhs)  const { return this->byteVector < rhs.byteVector; } // FOR STD::MAP ONLY
+    bool IsValid() const;
+    bool operator<(const CFieldElement& rhs)  const { return this->byteArray < rhs.byteArray; } // FOR STD::MAP ONLY
 
     // do not check wrapped ptr
     bool operator==(const CFieldElement& rhs) const { return isBaseEqual(rhs); }
@@ -159,14 +291,25 @@ public:
 
     template <typename Stream, typename Operation>
     inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
-        READWRITE(byteVector);
+        READWRITE(byteArray);
     }
 
+    //! Only accessed through std::atomic_load and std::atomic_compare_exchange_strong
     mutable wrappedFieldPtr fieldData;
 
     // shared_ptr reference count, mainly for UT
     long getUseCount() const { return fieldData.use_count(); }
 
+    //! The deserialized field is counted even before it is built, as any reader may build it while the
+    //! element is held
+    size_t DynamicMemoryUsage() const
+    {
+        if (IsNull())
+            return 0;
+        return byteArray.DynamicMemoryUsage() + memusage::MallocUsage(Sidechain::FFI_FIELD_ELEMENT_USAGE) +
+               memusage::MallocUsage(sizeof(memusage::stl_shared_counter));
+    }
+
 private:
     static CFieldPtrDeleter theFieldPtrDeleter;
 };
@@ -182,22 +325,27 @@ struct CProofPtrDeleter
 };
 typedef std::shared_ptr<sc_proof_t> wrappedScProofPtr;
 
-class CScProof : public CZendooCctpObject
+class CScProof : public CZendooCctpObject<0>
 {
 public:
     CScProof() = default;
     ~CScProof() = default;
+    CScProof(const CScProof& rhs);
+    CScProof(CScProof&& rhs) = default;
+    CScProof& operator=(const CScProof& rhs);
+    CScProof& operator=(CScProof&& rhs) = default;
 
     /**< The type of proving system.*/
     Sidechain::ProvingSystemType getProvingSystemType() const;
 
     explicit CScProof(const std::vector<unsigned char>& byteArrayIn);
-    void SetByteArray(const std::vector<unsigned char>& byteArrayIn) override final;
+    void SetByteArray(const std::vector<unsigned char>& byteArrayIn); //Does custom-size check
+    void SetNull();
 
     static constexpr unsigned int MaxByteSize() { return Sidechain::MAX_SC_PROOF_SIZE_IN_BYTES; }
 
     wrappedScProofPtr GetProofPtr() const;
-    bool IsValid() const override final;
+    bool IsValid() const;
 
     // do not check wrapped ptr
     bool operator==(const CScProof& rhs) const { return isBaseEqual(rhs); }
@@ -208,14 +356,24 @@ public:
     template <typename Stream, typename Operation>
     inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion)
     {
-        READWRITE(byteVector);
+        READWRITE(byteArray);
     }
 
+    //! Only accessed through std::atomic_load and std::atomic_compare_exchange_strong
     mutable wrappedScProofPtr proofData;
 
     // shared_ptr reference count, mainly for UT
     long getUseCount() const { return proofData.use_count(); }
 
+    //! As for a field element, the deserialized proof is counted even before it is built
+    size_t DynamicMemoryUsage() const
+    {
+        if (IsNull())
+            return 0;
+        return byteArray.DynamicMemoryUsage() + memusage::MallocUsage(byteArray.size() * Sidechain::FFI_POINTS_EXPANSION) +
+               memusage::MallocUsage(sizeof(memusage::stl_shared_counter));
+    }
+
 private:
     static CProofPtrDeleter theProofPtrDeleter;
 };
@@ -229,42 +387,96 @@ struct CVKeyPtrDeleter
 };
 typedef std::shared_ptr<sc_vk_t> wrappedScVkeyPtr;
 
-class CScVKey : public CZendooCctpObject
+class CScVKey : public CZendooCctpObject<0>
 {
 public:
     CScVKey() = default;
     ~CScVKey() = default;
+    CScVKey(const CScVKey& rhs);
+    CScVKey(CScVKey&& rhs) = default;
+    CScVKey& operator=(const CScVKey& rhs);
+    CScVKey& operator=(CScVKey&& rhs) = default;
 
     /**< The type of proving system used for verifying proof.*/
     Sidechain::ProvingSystemType getProvingSystemType() const;
 
     CScVKey(const std::vector<unsigned char>& byteArrayIn);
-    void SetByteArray(const std::vector<unsigned char>& byteArrayIn) override final;
+    void SetByteArray(const std::vector<unsigned char>& byteArrayIn); //Does custom-size check
+    void SetNull();
 
     static constexpr unsigned int MaxByteSize() { return Sidechain::MAX_SC_VK_SIZE_IN_BYTES; }
 
     wrappedScVkeyPtr GetVKeyPtr() const;
-    bool IsValid() const override final;
+    bool IsValid() const;
 
     ADD_SERIALIZE_METHODS;
 
     template <typename Stream, typename Operation>
     inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion)
     {
-        READWRITE(byteVector);
+        READWRITE(byteArray);
     }
 
     // do not check wrapped ptr
     bool operator==(const CScVKey& rhs) const { return isBaseEqual(rhs) && getProvingSystemType() == rhs.getProvingSystemType(); }
     bool operator!=(const CScVKey& rhs) const { return !(*this == rhs); }
 
+    //! Only accessed through std::atomic_load and std::atomic_compare_exchange_strong
     mutable wrappedScVkeyPtr vkData;
 
     // shared_ptr reference count, mainly for UT
     long getUseCount() const { return vkData.use_count(); }
+
+    //! As for a field element, the deserialized key is counted even before it is built, and even if it
+    //! is shared through CScVKeyCache
+    size_t DynamicMemoryUsage() const
+    {
+        if (IsNull())
+            return 0;
+        return byteArray.DynamicMemoryUsage() + memusage::MallocUsage(byteArray.size() * Sidechain::FFI_POINTS_EXPANSION) +
+               memusage::MallocUsage(sizeof(memusage::stl_shared_counter));
+    }
 private:
     static CVKeyPtrDeleter theVkPtrDeleter;
 };
+
+/**
+ * @brief Process-wide cache of the deserialized verification keys, keyed by the hash of their bytes.
+ * 
+ * A sidechain read again from the coins database comes with a fresh CScVKey, whose key would otherwise
+ * be deserialized and prepared by the zendoo library again for the first proof verified with it.
+ */
+class CScVKeyCache
+{
+public:
+    static const int64_t DEFAULT_MAX_SIZE = 1000;   /**< The default maximum number of entries of the cache. */
+
+    static CScVKeyCache& GetInstance();
+
+    CScVKeyCache() = default;
+
+    // CScVKeyCache should never be copied
+    CScVKeyCache(const CScVKeyCache&) = delete;
+    CScVKeyCache& operator=(const CScVKeyCache&) = delete;
+
+    wrappedScVkeyPtr Get(const uint256& vkHash);
+    //! nKeyBytes is the size of the serialized key, which the memory of the deserialized one is estimated from
+    void Insert(const uint256& vkHash, const wrappedScVkeyPtr& vkPtr, size_t nKeyBytes);
+    void Clear();
+    size_t Size();
+    size_t DynamicMemoryUsage();
+
+private:
+    struct CEntry
+    {
+        wrappedScVkeyPtr vkPtr;
+        size_t nUsage;
+    };
+
+    std::map<uint256, CEntry> mapKeys;              /**< The deserialized keys, by hash of their bytes. */
+    size_t nKeysUsage = 0;                          /**< The memory of the keys of mapKeys. */
+    CCriticalSection cs_vkcache;
+};
 //////////////////////////////// End of CScVKey ////////////////////////////////
 
 ////////////////////////////// Custom Config types //////////////////////////////
@@ -428,7 +640,7 @@ public:
 
 namespace Sidechain
 {
-typedef boost::unordered_map<uint256, CAmount, ObjectHasher> ScAmountMap;
+typedef boost::unordered_map<uint256, CAmount, CSaltedUint256Hasher> ScAmountMap;
 
 // useful in sc rpc command for getting genesis info
 typedef struct sPowRelatedData_tag
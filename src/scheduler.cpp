@@ -9,6 +9,8 @@
 #include "scheduler.h"
 
 #include "reverselock.h"
+#include "util.h"
+#include "utiltime.h"
 
 #include <assert.h>
 #include <boost/bind.hpp>
@@ -24,19 +26,22 @@ CScheduler::~CScheduler()
 }
 
 
-void CScheduler::serviceQueue()
+void CScheduler::serviceQueue(TaskClass taskClass)
 {
+    TaskQueue& queue = taskQueue[static_cast<int>(taskClass)];
+    boost::condition_variable& newTask = newTaskScheduled[static_cast<int>(taskClass)];
+
     boost::unique_lock<boost::mutex> lock(newTaskMutex);
     ++nThreadsServicingQueue;
 
     // newTaskMutex is locked throughout this loop EXCEPT
     // when the thread is waiting or when the user's function
     // is called.
-    while (!shouldStop()) {
+    while (!shouldStop(queue)) {
         try {
-            while (!shouldStop() && taskQueue.empty()) {
+            while (!shouldStop(queue) && queue.empty()) {
                 // Wait until there is something to do.
-                newTaskScheduled.wait(lock);
+                newTask.wait(lock);
             }
 
             // Wait until either there is a new task, or until
@@ -44,25 +49,37 @@ void CScheduler::serviceQueue()
 
             // Some boost versions have a conflicting overload of wait_until that returns void.
             // Explicitly use a template here to avoid hitting that overload.
-            while (!shouldStop() && !taskQueue.empty() &&
-                   newTaskScheduled.wait_until<>(lock, taskQueue.begin()->first) != boost::cv_status::timeout) {
+            while (!shouldStop(queue) && !queue.empty() &&
+                   newTask.wait_until<>(lock, queue.begin()->first) != boost::cv_status::timeout) {
                 // Keep waiting until timeout
             }
 
             // If there are multiple threads, the queue can empty while we're waiting (another
             // thread may service the task we were waiting on).
-            if (shouldStop() || taskQueue.empty())
+            if (shouldStop(queue) || queue.empty())
                 continue;
 
-            Function f = taskQueue.begin()->second;
-            taskQueue.erase(taskQueue.begin());
+            Task task = queue.begin()->second;
+            queue.erase(queue.begin());
 
+            int64_t nElapsed;
             {
                 // Unlock before calling f, so it can reschedule itself or another task
                 // without deadlocking:
                 reverse_lock<boost::unique_lock<boost::mutex> > rlock(lock);
-                f();
+                const int64_t nStart = GetTimeMicros();
+                task.f();
+                nElapsed = GetTimeMicros() - nStart;
+            }
+
+            if (!task.strName.empty()) {
+                TaskStats& stats = mapTaskStats[task.strName];
+                stats.nRuns++;
+                stats.nTotalMicros += nElapsed;
+                stats.nMaxMicros = std::max(stats.nMaxMicros, nElapsed);
             }
+            if (nElapsed > SCHEDULER_SLOW_TASK_MICROS)
+                LogPrint("bench", "scheduler: task %s took %.2fms\n", task.strName.empty() ? "unnamed" : task.strName, nElapsed * 0.001);
         } catch (...) {
             --nThreadsServicingQueue;
             throw;
@@ -80,42 +97,58 @@ void CScheduler::stop(bool drain)
         else
             stopRequested = true;
     }
-    newTaskScheduled.notify_all();
+    for (boost::condition_variable& newTask : newTaskScheduled)
+        newTask.notify_all();
 }
 
-void CScheduler::schedule(CScheduler::Function f, boost::chrono::system_clock::time_point t)
+void CScheduler::schedule(CScheduler::Function f, boost::chrono::system_clock::time_point t,
+                          TaskClass taskClass, const std::string& strName)
 {
     {
         boost::unique_lock<boost::mutex> lock(newTaskMutex);
-        taskQueue.insert(std::make_pair(t, f));
+        taskQueue[static_cast<int>(taskClass)].insert(std::make_pair(t, Task{f, strName}));
     }
-    newTaskScheduled.notify_one();
+    newTaskScheduled[static_cast<int>(taskClass)].notify_one();
 }
 
-void CScheduler::scheduleFromNow(CScheduler::Function f, int64_t deltaSeconds)
+void CScheduler::scheduleFromNow(CScheduler::Function f, int64_t deltaSeconds,
+                                 TaskClass taskClass, const std::string& strName)
 {
-    schedule(f, boost::chrono::system_clock::now() + boost::chrono::seconds(deltaSeconds));
+    schedule(f, boost::chrono::system_clock::now() + boost::chrono::seconds(deltaSeconds), taskClass, strName);
 }
 
-static void Repeat(CScheduler* s, CScheduler::Function f, int64_t deltaSeconds)
+static void Repeat(CScheduler* s, CScheduler::Function f, int64_t deltaSeconds,
+                   CScheduler::TaskClass taskClass, const std::string& strName)
 {
     f();
-    s->scheduleFromNow(boost::bind(&Repeat, s, f, deltaSeconds), deltaSeconds);
+    s->scheduleFromNow(boost::bind(&Repeat, s, f, deltaSeconds, taskClass, strName), deltaSeconds, taskClass, strName);
 }
 
-void CScheduler::scheduleEvery(CScheduler::Function f, int64_t deltaSeconds)
+void CScheduler::scheduleEvery(CScheduler::Function f, int64_t deltaSeconds,
+                               TaskClass taskClass, const std::string& strName)
 {
-    scheduleFromNow(boost::bind(&Repeat, this, f, deltaSeconds), deltaSeconds);
+    scheduleFromNow(boost::bind(&Repeat, this, f, deltaSeconds, taskClass, strName), deltaSeconds, taskClass, strName);
 }
 
 size_t CScheduler::getQueueInfo(boost::chrono::system_clock::time_point &first,
                              boost::chrono::system_clock::time_point &last) const
 {
     boost::unique_lock<boost::mutex> lock(newTaskMutex);
-    size_t result = taskQueue.size();
-    if (!taskQueue.empty()) {
-        first = taskQueue.begin()->first;
-        last = taskQueue.rbegin()->first;
+    size_t result = 0;
+    for (const TaskQueue& queue : taskQueue) {
+        if (queue.empty())
+            continue;
+        if (result == 0 || queue.begin()->first < first)
+            first = queue.begin()->first;
+        if (result == 0 || queue.rbegin()->first > last)
+            last = queue.rbegin()->first;
+        result += queue.size();
     }
     return result;
 }
+
+std::map<std::string, CScheduler::TaskStats> CScheduler::getTaskStats() const
+{
+    boost::unique_lock<boost::mutex> lock(newTaskMutex);
+    return mapTaskStats;
+}
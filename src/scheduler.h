@@ -14,6 +14,7 @@
 #include <boost/chrono/chrono.hpp>
 #include <boost/thread.hpp>
 #include <map>
+#include <string>
 
 //
 // Simple class for background tasks that should be run
@@ -26,6 +27,12 @@
 // s->scheduleFromNow(boost::bind(Class::func, this, argument), 3);
 // boost::thread* t = new boost::thread(boost::bind(CScheduler::serviceQueue, s));
 //
+// The tasks of a class are only run by the threads servicing that class, so
+// that a slow task, as the dump of a file, does not hold back the others:
+//
+// s->scheduleEvery(dumpSomething, 60, CScheduler::TaskClass::IO_BOUND, "dumpsomething");
+// boost::thread* tIo = new boost::thread(boost::bind(CScheduler::serviceQueue, s, CScheduler::TaskClass::IO_BOUND));
+//
 // ... then at program shutdown, clean up the thread running serviceQueue:
 // t->interrupt();
 // t->join();
@@ -33,6 +40,9 @@
 // delete s; // Must be done after thread is interrupted/joined.
 //
 
+//! A task running longer than this many microseconds is logged
+static const int64_t SCHEDULER_SLOW_TASK_MICROS = 1000000;
+
 class CScheduler
 {
 public:
@@ -41,43 +51,69 @@ public:
 
     typedef boost::function<void(void)> Function;
 
-    // Call func at/after time t
-    void schedule(Function f, boost::chrono::system_clock::time_point t);
+    enum class TaskClass {
+        LATENCY_SENSITIVE, // the default, short tasks whose timing matters
+        IO_BOUND,          // tasks writing files or databases, which may take seconds
+        NUM_TASK_CLASSES
+    };
+
+    // The execution times of the runs of a task, by name
+    struct TaskStats {
+        uint64_t nRuns = 0;
+        int64_t nTotalMicros = 0;
+        int64_t nMaxMicros = 0;
+    };
+
+    // Call func at/after time t; the tasks with a name are accounted in the stats
+    void schedule(Function f, boost::chrono::system_clock::time_point t,
+                  TaskClass taskClass = TaskClass::LATENCY_SENSITIVE, const std::string& strName = "");
 
     // Convenience method: call f once deltaSeconds from now
-    void scheduleFromNow(Function f, int64_t deltaSeconds);
+    void scheduleFromNow(Function f, int64_t deltaSeconds,
+                         TaskClass taskClass = TaskClass::LATENCY_SENSITIVE, const std::string& strName = "");
 
     // Another convenience method: call f approximately
     // every deltaSeconds forever, starting deltaSeconds from now.
     // To be more precise: every time f is finished, it
     // is rescheduled to run deltaSeconds later. If you
     // need more accurate scheduling, don't use this method.
-    void scheduleEvery(Function f, int64_t deltaSeconds);
+    void scheduleEvery(Function f, int64_t deltaSeconds,
+                       TaskClass taskClass = TaskClass::LATENCY_SENSITIVE, const std::string& strName = "");
 
     // To keep things as simple as possible, there is no unschedule.
 
-    // Services the queue 'forever'. Should be run in a thread,
+    // Services the queue of a task class 'forever'. Should be run in a thread,
     // and interrupted using boost::interrupt_thread
-    void serviceQueue();
+    void serviceQueue(TaskClass taskClass = TaskClass::LATENCY_SENSITIVE);
 
     // Tell any threads running serviceQueue to stop as soon as they're
     // done servicing whatever task they're currently servicing (drain=false)
     // or when there is no work left to be done (drain=true)
     void stop(bool drain=false);
 
-    // Returns number of tasks waiting to be serviced,
+    // Returns number of tasks waiting to be serviced, of all the classes,
     // and first and last task times
     size_t getQueueInfo(boost::chrono::system_clock::time_point &first,
                         boost::chrono::system_clock::time_point &last) const;
 
+    std::map<std::string, TaskStats> getTaskStats() const;
+
 private:
-    std::multimap<boost::chrono::system_clock::time_point, Function> taskQueue;
-    boost::condition_variable newTaskScheduled;
+    struct Task {
+        Function f;
+        std::string strName;
+    };
+    typedef std::multimap<boost::chrono::system_clock::time_point, Task> TaskQueue;
+
+    // A queue and a condition per task class, under the same mutex
+    TaskQueue taskQueue[static_cast<int>(TaskClass::NUM_TASK_CLASSES)];
+    boost::condition_variable newTaskScheduled[static_cast<int>(TaskClass::NUM_TASK_CLASSES)];
     mutable boost::mutex newTaskMutex;
     int nThreadsServicingQueue;
     bool stopRequested;
     bool stopWhenEmpty;
-    bool shouldStop() { return stopRequested || (stopWhenEmpty && taskQueue.empty()); }
+    std::map<std::string, TaskStats> mapTaskStats;
+    bool shouldStop(const TaskQueue& queue) const { return stopRequested || (stopWhenEmpty && queue.empty()); }
 };
 
 #endif
@@ -14,6 +14,8 @@
 #include "uint256.h"
 #include "util.h"
 #include "main.h"
+#include <algorithm>
+
 #include <boost/algorithm/hex.hpp>
 #include <boost/algorithm/string.hpp>
 
@@ -383,7 +385,7 @@ bool EvalScript(vector<vector<unsigned char> >& stack, const CScript& script, un
                     if (!(flags & SCRIPT_VERIFY_CHECKBLOCKATHEIGHT)) {
                         // At least check that there are 2 parameters
                         if (stack.size() < 2) {
-                            LogPrintf("%s: %s: OP_CHECKBLOCKATHEIGHT verification failed. Wrong parameters amount.\n", __FILE__, __func__);
+                            LogPrint("cbh", "%s: %s: OP_CHECKBLOCKATHEIGHT verification failed. Wrong parameters amount.\n", __FILE__, __func__);
                             return set_error(serror, SCRIPT_ERR_INVALID_STACK_OPERATION);
                         }
                         // Clear stack
@@ -393,7 +395,7 @@ bool EvalScript(vector<vector<unsigned char> >& stack, const CScript& script, un
                     }
 
                     if (stack.size() < 2) {
-                        LogPrintf("%s: %s: OP_CHECKBLOCKATHEIGHT verification failed. Wrong parameters amount.\n", __FILE__, __func__);
+                        LogPrint("cbh", "%s: %s: OP_CHECKBLOCKATHEIGHT verification failed. Wrong parameters amount.\n", __FILE__, __func__);
                         return set_error(serror, SCRIPT_ERR_INVALID_STACK_OPERATION);
                     }
 
@@ -402,7 +404,7 @@ bool EvalScript(vector<vector<unsigned char> >& stack, const CScript& script, un
 
                     if ((vchBlockIndex.size() > sizeof(int)) || (vchBlockHash.size() > 32))
                     {
-                        LogPrintf("%s: %s():%d - OP_CHECKBLOCKATHEIGHT verification failed. Bad params.\n", __FILE__, __func__, __LINE__);
+                        LogPrint("cbh", "%s: %s():%d - OP_CHECKBLOCKATHEIGHT verification failed. Bad params.\n", __FILE__, __func__, __LINE__);
                         return set_error(serror, SCRIPT_ERR_CHECKBLOCKATHEIGHT);
                     }
 
@@ -413,7 +415,7 @@ bool EvalScript(vector<vector<unsigned char> >& stack, const CScript& script, un
                     if (nHeight < 0 || !checker.CheckBlockHash(nHeight, vchBlockHash)) {
                         // Not final rather than a hard reject to avoid caching across different blockchains
                         // Also because it will *eventually* become final when the height gets old enough
-                        LogPrintf("%s: %s():%d - OP_CHECKBLOCKATHEIGHT verification failed. Referenced height: %d\n",
+                        LogPrint("cbh", "%s: %s():%d - OP_CHECKBLOCKATHEIGHT verification failed. Referenced height: %d\n",
                             __FILE__, __func__, __LINE__, nHeight);
                         return set_error(serror, SCRIPT_ERR_NOT_FINAL);
                     }
@@ -1107,113 +1109,119 @@ public:
             ::WriteCompactSize(s, nInputs);
             for (unsigned int nInput = 0; nInput < nInputs; nInput++)
                 SerializeInput(s, nInput, nType, nVersion);
-            // Serialize vout
-            unsigned int nOutputs = fHashNone ? 0 : (fHashSingle ? nIn+1 : txTo.GetVout().size());
-            ::WriteCompactSize(s, nOutputs);
-            for (unsigned int nOutput = 0; nOutput < nOutputs; nOutput++)
-                 SerializeOutput(s, nOutput, nType, nVersion);
- 
-            if (txTo.IsScVersion() )
-            {
-                // Serialize CSW inputs
-                // In case of SIGHASH_ANYONECANPAY:
-                // * if Tx has Sc support version and nIn belongs to the CSW inputs - only the CSW input being signed is serialized
-                // * otherwise skip CSW inputs
-                // Otherwise - serialize all CSW inputs
-                unsigned int nCswInputs = fAnyoneCanPay ?
-                            (nIn < txTo.GetVin().size() ? 0 : 1) :
-                            txTo.GetVcswCcIn().size();
-                ::WriteCompactSize(s, nCswInputs);
-                for (unsigned int nCswInput = 0; nCswInput < nCswInputs; nCswInput++)
-                    SerializeCswInput(s, nCswInput, txTo, nType, nVersion);
-
-                // Serialize vccouts
-                unsigned int nCcOutputs = 0;
- 
-                nCcOutputs = fHashNone ? 0 : (txTo.GetVscCcOut().size());
-                ::WriteCompactSize(s, nCcOutputs);
-                for (unsigned int nCcOutput = 0; nCcOutput < nCcOutputs; nCcOutput++)
-                    ::Serialize(s, txTo.GetVscCcOut()[nCcOutput], nType, nVersion);
- 
-                nCcOutputs = fHashNone ? 0 : (txTo.GetVftCcOut().size());
-                ::WriteCompactSize(s, nCcOutputs);
-                for (unsigned int nCcOutput = 0; nCcOutput < nCcOutputs; nCcOutput++)
-                    ::Serialize(s, txTo.GetVftCcOut()[nCcOutput], nType, nVersion);
-
-                nCcOutputs = fHashNone ? 0 : (txTo.GetVBwtRequestOut().size());
-                ::WriteCompactSize(s, nCcOutputs);
-                for (unsigned int nCcOutput = 0; nCcOutput < nCcOutputs; nCcOutput++)
-                    ::Serialize(s, txTo.GetVBwtRequestOut()[nCcOutput], nType, nVersion);
-            }
- 
-            // Serialize nLockTime
-            ::Serialize(s, txTo.GetLockTime(), nType, nVersion);
- 
-            // Serialize vjoinsplit
-            if (txTo.nVersion >= PHGR_TX_VERSION || txTo.nVersion == GROTH_TX_VERSION) {
-                //
-                // SIGHASH_* functions will hash portions of
-                // the transaction for use in signatures. This
-                // keeps the JoinSplit cryptographically bound
-                // to the transaction.
-                //
-                auto os = WithTxVersion(&s, txTo.nVersion);
-                ::Serialize(os, txTo.GetVjoinsplit(), nType, nVersion);
-                if (txTo.GetVjoinsplit().size() > 0) {
-                ::Serialize(s, txTo.joinSplitPubKey, nType, nVersion);
- 
-                    CTransaction::joinsplit_sig_t nullSig = {};
-                    ::Serialize(s, nullSig, nType, nVersion);
-                }
-            }
+
+            SerializeTxSuffix(s, txTo, nType, nVersion);
         }
         else
         {
             const CScCertificate& certTo = dynamic_cast<const CScCertificate&>(txBaseTo);
 
-            ::Serialize(s, certTo.GetScId(), nType, nVersion);
-            ::Serialize(s, certTo.epochNumber, nType, nVersion);
-            ::Serialize(s, certTo.quality, nType, nVersion);
-            ::Serialize(s, certTo.endEpochCumScTxCommTreeRoot, nType, nVersion);
-            ::Serialize(s, certTo.scProof, nType, nVersion);
-            ::Serialize(s, certTo.vFieldElementCertificateField, nType, nVersion);
-            ::Serialize(s, certTo.vBitVectorCertificateField, nType, nVersion);
-            ::Serialize(s, certTo.forwardTransferScFee, nType, nVersion);
-            ::Serialize(s, certTo.mainchainBackwardTransferRequestScFee, nType, nVersion);
-
-            // Serialize vin
-            unsigned int nInputs = fAnyoneCanPay ? 1 : certTo.GetVin().size();
-            ::WriteCompactSize(s, nInputs);
-            for (unsigned int nInput = 0; nInput < nInputs; nInput++)
-                 SerializeInput(s, nInput, nType, nVersion);
-
-            // Serialize vout
+            SerializeCertFields(s, certTo, nType, nVersion);
+            SerializeCertInputsOutputs(s, certTo, nType, nVersion);
+        }
+    }
 
-            // split bwd transfer and change
-            std::vector<CBackwardTransferOut> vbt_ccout_ser;
-            // we must not modify vout
-            std::vector<CTxOut> vout_ser;
+    /** Serialize what follows the inputs of a transaction: the outputs, the CSW inputs, the sidechain outputs and the joinsplits */
+    template<typename S>
+    void SerializeTxSuffix(S &s, const CTransaction& txTo, int nType, int nVersion) const {
+        // Serialize vout
+        unsigned int nOutputs = fHashNone ? 0 : (fHashSingle ? nIn+1 : txTo.GetVout().size());
+        ::WriteCompactSize(s, nOutputs);
+        for (unsigned int nOutput = 0; nOutput < nOutputs; nOutput++)
+             SerializeOutput(s, nOutput, nType, nVersion);
  
-            // reading from memory and writing to data stream
-            for(int pos = 0; pos < certTo.GetVout().size(); ++pos)
-            {
-                if (pos < certTo.nFirstBwtPos)
-                    vout_ser.push_back(certTo.GetVout()[pos]);
-                else
-                    vbt_ccout_ser.push_back(CBackwardTransferOut(certTo.GetVout()[pos]));
-            }
+        if (txTo.IsScVersion() )
+        {
+            // Serialize CSW inputs
+            // In case of SIGHASH_ANYONECANPAY:
+            // * if Tx has Sc support version and nIn belongs to the CSW inputs - only the CSW input being signed is serialized
+            // * otherwise skip CSW inputs
+            // Otherwise - serialize all CSW inputs
+            unsigned int nCswInputs = fAnyoneCanPay ?
+                        (nIn < txTo.GetVin().size() ? 0 : 1) :
+                        txTo.GetVcswCcIn().size();
+            ::WriteCompactSize(s, nCswInputs);
+            for (unsigned int nCswInput = 0; nCswInput < nCswInputs; nCswInput++)
+                SerializeCswInput(s, nCswInput, txTo, nType, nVersion);
+
+            // Serialize vccouts
+            unsigned int nCcOutputs = 0;
  
-            unsigned int nOutputs = fHashNone ? 0 : (fHashSingle ? nIn+1 : vout_ser.size());
-            ::WriteCompactSize(s, nOutputs);
-            for (unsigned int nOutput = 0; nOutput < nOutputs; nOutput++)
-                 SerializeOutput(s, nOutput, nType, nVersion);
+            nCcOutputs = fHashNone ? 0 : (txTo.GetVscCcOut().size());
+            ::WriteCompactSize(s, nCcOutputs);
+            for (unsigned int nCcOutput = 0; nCcOutput < nCcOutputs; nCcOutput++)
+                ::Serialize(s, txTo.GetVscCcOut()[nCcOutput], nType, nVersion);
+ 
+            nCcOutputs = fHashNone ? 0 : (txTo.GetVftCcOut().size());
+            ::WriteCompactSize(s, nCcOutputs);
+            for (unsigned int nCcOutput = 0; nCcOutput < nCcOutputs; nCcOutput++)
+                ::Serialize(s, txTo.GetVftCcOut()[nCcOutput], nType, nVersion);
+
+            nCcOutputs = fHashNone ? 0 : (txTo.GetVBwtRequestOut().size());
+            ::WriteCompactSize(s, nCcOutputs);
+            for (unsigned int nCcOutput = 0; nCcOutput < nCcOutputs; nCcOutput++)
+                ::Serialize(s, txTo.GetVBwtRequestOut()[nCcOutput], nType, nVersion);
+        }
+ 
+        // Serialize nLockTime
+        ::Serialize(s, txTo.GetLockTime(), nType, nVersion);
+ 
+        // Serialize vjoinsplit
+        if (txTo.nVersion >= PHGR_TX_VERSION || txTo.nVersion == GROTH_TX_VERSION) {
+            //
+            // SIGHASH_* functions will hash portions of
+            // the transaction for use in signatures. This
+            // keeps the JoinSplit cryptographically bound
+            // to the transaction.
+            //
+            auto os = WithTxVersion(&s, txTo.nVersion);
+            ::Serialize(os, txTo.GetVjoinsplit(), nType, nVersion);
+            if (txTo.GetVjoinsplit().size() > 0) {
+            ::Serialize(s, txTo.joinSplitPubKey, nType, nVersion);
  
-            unsigned int voutBtSize = vbt_ccout_ser.size();
-            ::WriteCompactSize(s, voutBtSize);
-            for (unsigned int nOutput = 0; nOutput < voutBtSize; nOutput++)
-                ::Serialize(s, vbt_ccout_ser[nOutput], nType, nVersion);
+                CTransaction::joinsplit_sig_t nullSig = {};
+                ::Serialize(s, nullSig, nType, nVersion);
+            }
         }
     }
+
+    /**
+     * Serialize the sidechain fields of a certificate, which follow nVersion and do not depend on
+     * the input being signed nor on the hash type
+     */
+    template<typename S>
+    static void SerializeCertFields(S &s, const CScCertificate& certTo, int nType, int nVersion) {
+        ::Serialize(s, certTo.GetScId(), nType, nVersion);
+        ::Serialize(s, certTo.epochNumber, nType, nVersion);
+        ::Serialize(s, certTo.quality, nType, nVersion);
+        ::Serialize(s, certTo.endEpochCumScTxCommTreeRoot, nType, nVersion);
+        ::Serialize(s, certTo.scProof, nType, nVersion);
+        ::Serialize(s, certTo.vFieldElementCertificateField, nType, nVersion);
+        ::Serialize(s, certTo.vBitVectorCertificateField, nType, nVersion);
+        ::Serialize(s, certTo.forwardTransferScFee, nType, nVersion);
+        ::Serialize(s, certTo.mainchainBackwardTransferRequestScFee, nType, nVersion);
+    }
+
+    /** Serialize the inputs and the outputs of a certificate, which follow its sidechain fields */
+    template<typename S>
+    void SerializeCertInputsOutputs(S &s, const CScCertificate& certTo, int nType, int nVersion) const {
+        // Serialize vin
+        unsigned int nInputs = fAnyoneCanPay ? 1 : certTo.GetVin().size();
+        ::WriteCompactSize(s, nInputs);
+        for (unsigned int nInput = 0; nInput < nInputs; nInput++)
+             SerializeInput(s, nInput, nType, nVersion);
+
+        // Serialize vout: the change outputs come first in vout, followed by the backward transfers
+        unsigned int nOutputs = fHashNone ? 0 : (fHashSingle ? nIn+1 : certTo.nFirstBwtPos);
+        ::WriteCompactSize(s, nOutputs);
+        for (unsigned int nOutput = 0; nOutput < nOutputs; nOutput++)
+             SerializeOutput(s, nOutput, nType, nVersion);
+
+        unsigned int voutBtSize = certTo.GetVout().size() - certTo.nFirstBwtPos;
+        ::WriteCompactSize(s, voutBtSize);
+        for (unsigned int pos = certTo.nFirstBwtPos; pos < certTo.GetVout().size(); ++pos)
+            ::Serialize(s, CBackwardTransferOut(certTo.GetVout()[pos]), nType, nVersion);
+    }
 };
 
 } // anon namespace
@@ -1263,20 +1271,79 @@ uint256 SignatureHash(const CScript& scriptCode, const CScCertificate& certTo, u
     // Wrapper to serialize only the necessary parts of the transaction being signed
     CTransactionSignatureSerializer certTmp(certTo, scriptCode, nIn, nHashType);
 
+    // The hash of nVersion and of the sidechain fields is the same for every input and hash type
+    std::shared_ptr<const CHashWriter> prefix = certTo.GetSigHashPrefix();
+    if (!prefix) {
+        auto ssPrefix = std::make_shared<CHashWriter>(SER_GETHASH, 0);
+        ::Serialize(*ssPrefix, certTo.nVersion, SER_GETHASH, 0);
+        CTransactionSignatureSerializer::SerializeCertFields(*ssPrefix, certTo, SER_GETHASH, 0);
+        certTo.SetSigHashPrefix(ssPrefix);
+        prefix = ssPrefix;
+    }
+
     // Serialize and hash
-    CHashWriter ss(SER_GETHASH, 0);
-    ss << certTmp << nHashType;
+    CHashWriter ss(*prefix);
+    certTmp.SerializeCertInputsOutputs(ss, certTo, SER_GETHASH, 0);
+    ss << nHashType;
     return ss.GetHash();
 }
 
+CPrecomputedSigHash::CPrecomputedSigHash(const CTransaction& txToIn): txTo(txToIn)
+{
+    const size_t nInputs = txTo.GetVin().size();
+    // with nIn == NOT_AN_INPUT every input script is blanked out
+    CTransactionSignatureSerializer txTmp(txTo, CScript(), NOT_AN_INPUT, SIGHASH_ALL);
+
+    CHashWriter ss(SER_GETHASH, 0);
+    ::Serialize(ss, txTo.nVersion, SER_GETHASH, 0);
+    ::WriteCompactSize(ss, nInputs);
+
+    CPublicDataStream ssInputs(SER_GETHASH, 0);
+    vMidstates.reserve(nInputs);
+    vInputEnd.reserve(nInputs);
+    for (unsigned int nInput = 0; nInput < nInputs; nInput++)
+    {
+        vMidstates.push_back(ss);
+        const size_t nBegin = ssInputs.size();
+        txTmp.SerializeInput(ssInputs, nInput, SER_GETHASH, 0);
+        ss.write(&ssInputs[nBegin], ssInputs.size() - nBegin);
+        vInputEnd.push_back(ssInputs.size());
+    }
+    vBlankInputs.assign(ssInputs.begin(), ssInputs.end());
+
+    CPublicDataStream ssSuffix(SER_GETHASH, 0);
+    txTmp.SerializeTxSuffix(ssSuffix, txTo, SER_GETHASH, 0);
+    vSuffix.assign(ssSuffix.begin(), ssSuffix.end());
+}
+
+bool CPrecomputedSigHash::GetSignatureHash(const CScript& scriptCode, unsigned int nIn, int nHashType, uint256& hashRet) const
+{
+    // the blanking of the other inputs and the outputs hashed depend on the hash type
+    if ((nHashType & SIGHASH_ANYONECANPAY) || (nHashType & 0x1f) == SIGHASH_NONE || (nHashType & 0x1f) == SIGHASH_SINGLE)
+        return false;
+    if (nIn >= vMidstates.size())
+        return false;
+
+    CHashWriter ss(vMidstates[nIn]);
+    CTransactionSignatureSerializer txTmp(txTo, scriptCode, nIn, nHashType);
+    txTmp.SerializeInput(ss, nIn, SER_GETHASH, 0);
+    ss.write(vBlankInputs.data() + vInputEnd[nIn], vBlankInputs.size() - vInputEnd[nIn]);
+    ss.write(vSuffix.data(), vSuffix.size());
+    ss << nHashType;
+    hashRet = ss.GetHash();
+    return true;
+}
+
 TransactionSignatureChecker::TransactionSignatureChecker(const CTransaction* txToIn,
                                                          unsigned int nInIn,
-                                                         const CChain* chainIn):
+                                                         const CCheckBlockAtHeightView* cbhViewIn,
+                                                         const CPrecomputedSigHash* precomputedIn):
                                                            txTo(txToIn),
                                                            nIn(nInIn),
-                                                           chain(chainIn) {}
+                                                           cbhView(cbhViewIn),
+                                                           precomputed(precomputedIn) {}
 
-TransactionSignatureChecker::TransactionSignatureChecker(const CChain* chainIn): txTo(nullptr), nIn(-1), chain(chainIn) {}
+TransactionSignatureChecker::TransactionSignatureChecker(const CCheckBlockAtHeightView* cbhViewIn): txTo(nullptr), nIn(-1), cbhView(cbhViewIn), precomputed(nullptr) {}
 
 bool TransactionSignatureChecker::VerifySignature(const std::vector<unsigned char>& vchSig, const CPubKey& pubkey, const uint256& sighash) const
 {
@@ -1297,10 +1364,12 @@ bool TransactionSignatureChecker::CheckSig(const vector<unsigned char>& vchSigIn
     vchSig.pop_back();
 
     uint256 sighash;
-    try {
-        sighash = SignatureHash(scriptCode, *txTo, nIn, nHashType);
-    } catch (const logic_error& ex) {
-        return false;
+    if (!precomputed || !precomputed->GetSignatureHash(scriptCode, nIn, nHashType, sighash)) {
+        try {
+            sighash = SignatureHash(scriptCode, *txTo, nIn, nHashType);
+        } catch (const logic_error& ex) {
+            return false;
+        }
     }
 
     if (!VerifySignature(vchSig, pubkey, sighash))
@@ -1385,12 +1454,59 @@ bool CheckReplayProtectionData(const CChain* chain, int nHeight, const std::vect
     return (vchCompareTo == vchBlockHash);
 }
 
+CCheckBlockAtHeightView::CCheckBlockAtHeightView(const CChain& chain, int nSafeDepthIn, int nRecentBlocks):
+    pindexTip(chain.Tip()), nHeight(chain.Height()), nSafeDepth(nSafeDepthIn)
+{
+    if (pindexTip)
+        hashTip = pindexTip->GetBlockHash();
+    // the blocks at the safe depth and below always pass
+    nRecentBlocks = std::min(nRecentBlocks, std::max(nSafeDepth, 0));
+    vRecentHashes.reserve(std::min(nRecentBlocks, nHeight + 1));
+    for (const CBlockIndex* pindex = pindexTip; pindex && (int)vRecentHashes.size() < nRecentBlocks; pindex = pindex->pprev)
+        vRecentHashes.push_back(pindex->GetBlockHash());
+}
+
+bool CCheckBlockAtHeightView::IsOf(const CChain& chain) const
+{
+    const CBlockIndex* pindex = chain.Tip();
+    return pindex == pindexTip && chain.Height() == nHeight && (!pindex || pindex->GetBlockHash() == hashTip);
+}
+
+bool CCheckBlockAtHeightView::CheckBlockHash(int nBlockHeight, const std::vector<unsigned char>& vchCompareTo) const
+{
+    // If the chain doesn't reach the desired height yet, the transaction is non-final
+    if (nBlockHeight > nHeight)
+        return false;
+
+    // Sufficiently old blocks are always valid
+    if (nBlockHeight <= nHeight - nSafeDepth)
+        return true;
+
+    if (vchCompareTo.size() != sizeof(uint256))
+        return false;
+
+    const int nDepth = nHeight - nBlockHeight;
+    if (nDepth < (int)vRecentHashes.size())
+        return std::equal(vchCompareTo.begin(), vchCompareTo.end(), vRecentHashes[nDepth].begin());
+
+#ifndef BITCOIN_TX
+    const CBlockIndex* pindex = pindexTip->GetAncestor(nBlockHeight);
+#else
+    // zen-tx does not link all symbols
+    const CBlockIndex* pindex = pindexTip;
+    while (pindex->nHeight > nBlockHeight)
+        pindex = pindex->pprev;
+#endif
+    const uint256 blockHash = pindex->GetBlockHash();
+    return std::equal(vchCompareTo.begin(), vchCompareTo.end(), blockHash.begin());
+}
+
 CertificateSignatureChecker::CertificateSignatureChecker(const CScCertificate* certToIn,
                                                          unsigned int nInIn,
-                                                         const CChain* chainIn):
+                                                         const CCheckBlockAtHeightView* cbhViewIn):
                                                            certTo(certToIn),
                                                            nIn(nInIn),
-                                                           chain(chainIn) {}
+                                                           cbhView(cbhViewIn) {}
 
 bool CertificateSignatureChecker::VerifySignature(const std::vector<unsigned char>& vchSig, const CPubKey& pubkey, const uint256& sighash) const
 {
@@ -1432,18 +1548,97 @@ bool CertificateSignatureChecker::CheckSig(const vector<unsigned char>& vchSigIn
 
 bool CertificateSignatureChecker::CheckBlockHash(const int32_t nHeight, const std::vector<unsigned char>& vchCompareTo) const
 {
-    return CheckReplayProtectionData(chain, nHeight, vchCompareTo);
+    return cbhView && cbhView->CheckBlockHash(nHeight, vchCompareTo);
 }
 
 bool TransactionSignatureChecker::CheckBlockHash(const int32_t nHeight, const std::vector<unsigned char>& vchCompareTo) const
 {
-    return CheckReplayProtectionData(chain, nHeight, vchCompareTo);
+    return cbhView && cbhView->CheckBlockHash(nHeight, vchCompareTo);
+}
+
+namespace {
+
+//! The data pushed by the push opcode at pc, under the minimal push rules of flags, and nothing else
+bool GetPushOp(const CScript& script, CScript::const_iterator& pc, unsigned int flags, valtype& vchRet)
+{
+    opcodetype opcode;
+    if (!script.GetOp(pc, opcode, vchRet) || opcode > OP_PUSHDATA4 || vchRet.size() > MAX_SCRIPT_ELEMENT_SIZE)
+        return false;
+    return (flags & SCRIPT_VERIFY_MINIMALDATA) == 0 || CheckMinimalPush(vchRet, opcode);
 }
 
+/**
+ * The spends of the P2PKH outputs, with replay protection or not, which are nearly all of them, checked for the
+ * push of a signature and of a public key without going through EvalScript, straight to the hash of the key, the
+ * signature and the referenced block. True only if the scripts are in this form and pass, as they would running
+ * them; any other outcome is left to the interpreter, which also tells why they fail.
+ */
+bool VerifyPayToPubKeyHashSpend(const CScript& scriptSig, const CScript& scriptPubKey, unsigned int flags, const BaseSignatureChecker& checker)
+{
+    // CLEANSTACK without P2SH is asserted against by the interpreter
+    if ((flags & SCRIPT_VERIFY_CLEANSTACK) && !(flags & SCRIPT_VERIFY_P2SH))
+        return false;
+
+    const unsigned int nSize = scriptPubKey.size();
+    if (nSize < 25 || scriptPubKey[0] != OP_DUP || scriptPubKey[1] != OP_HASH160 || scriptPubKey[2] != 20 ||
+        scriptPubKey[23] != OP_EQUALVERIFY || scriptPubKey[24] != OP_CHECKSIG)
+        return false;
+
+    // <hash> <height> OP_CHECKBLOCKATHEIGHT, pushed as data
+    valtype vchBlockHash, vchBlockHeight;
+    const bool fReplayProtection = nSize > 25;
+    if (fReplayProtection)
+    {
+        if (nSize > 25 + 1 + 32 + 1 + 4 + 1 || scriptPubKey.back() != OP_CHECKBLOCKATHEIGHT)
+            return false;
+        CScript::const_iterator pc = scriptPubKey.begin() + 25;
+        if (!GetPushOp(scriptPubKey, pc, flags, vchBlockHash) || vchBlockHash.empty() || vchBlockHash.size() > 32 ||
+            !GetPushOp(scriptPubKey, pc, flags, vchBlockHeight) || vchBlockHeight.empty() || vchBlockHeight.size() > sizeof(int) ||
+            pc != scriptPubKey.end() - 1)
+            return false;
+    }
+
+    // <sig> <pubkey>
+    valtype vchSig, vchPubKey;
+    CScript::const_iterator pc = scriptSig.begin();
+    if (scriptSig.size() > MAX_SCRIPT_SIZE || !GetPushOp(scriptSig, pc, flags, vchSig) ||
+        !GetPushOp(scriptSig, pc, flags, vchPubKey) || pc != scriptSig.end())
+        return false;
+
+    uint160 keyHash;
+    CHash160().Write(begin_ptr(vchPubKey), vchPubKey.size()).Finalize(keyHash.begin());
+    if (!std::equal(keyHash.begin(), keyHash.end(), scriptPubKey.begin() + 3))
+        return false;
+
+    if (!CheckSignatureEncoding(vchSig, flags, NULL) || !CheckPubKeyEncoding(vchPubKey, flags, NULL) ||
+        !checker.CheckSig(vchSig, vchPubKey, scriptPubKey))
+        return false;
+
+    if (fReplayProtection && (flags & SCRIPT_VERIFY_CHECKBLOCKATHEIGHT))
+    {
+        int32_t nHeight;
+        try {
+            nHeight = CScriptNum(vchBlockHeight, true, 4).getint();
+        } catch (const scriptnum_error&) {
+            return false;
+        }
+        if (nHeight < 0 || !checker.CheckBlockHash(nHeight, vchBlockHash))
+            return false;
+    }
+
+    // the stack is left with the true of OP_CHECKSIG, which is clean
+    return true;
+}
+
+} // anon namespace
+
 bool VerifyScript(const CScript& scriptSig, const CScript& scriptPubKey, unsigned int flags, const BaseSignatureChecker& checker, ScriptError* serror)
 {
     set_error(serror, SCRIPT_ERR_UNKNOWN_ERROR);
 
+    if (VerifyPayToPubKeyHashSpend(scriptSig, scriptPubKey, flags, checker))
+        return set_success(serror);
+
     if ((flags & SCRIPT_VERIFY_SIGPUSHONLY) != 0 && !scriptSig.IsPushOnly()) {
         return set_error(serror, SCRIPT_ERR_SIG_PUSHONLY);
     }
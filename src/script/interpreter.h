@@ -9,15 +9,16 @@
 #include "script_error.h"
 #include "primitives/transaction.h"
 #include "primitives/certificate.h"
+#include "uint256.h"
 
 #include <vector>
 #include <stdint.h>
 #include <string>
 #include <climits>
 
+class CBlockIndex;
 class CChain;
 class CPubKey;
-class uint256;
 
 /** Special case nIn for signing JoinSplits. */
 const unsigned int NOT_AN_INPUT = UINT_MAX;
@@ -96,6 +97,67 @@ static const unsigned int CONTEXTUAL_SCRIPT_VERIFY_FLAGS = SCRIPT_VERIFY_CHECKBL
 uint256 SignatureHash(const CScript &scriptCode, const CTransaction& txTo, unsigned int nIn, int nHashType);
 uint256 SignatureHash(const CScript &scriptCode, const CScCertificate& certTo, unsigned int nIn, int nHashType);
 
+/**
+ * The parts of the SIGHASH_ALL serialization of a transaction that are the same for all of its regular
+ * inputs, computed once to sign or check them all: the hash state before each input, the other inputs
+ * with their scripts blanked out and everything that follows the inputs. The signature hash of an input
+ * then hashes only its own script and the bytes after it, instead of serializing the transaction again.
+ * It is read-only once built, and can be shared by the threads signing the inputs of txTo.
+ */
+class CPrecomputedSigHash
+{
+public:
+    explicit CPrecomputedSigHash(const CTransaction& txToIn);
+
+    /**
+     * The signature hash of input nIn, as SignatureHash computes it. False when it cannot be taken from
+     * the precomputed data, for the CSW inputs and the hash types other than SIGHASH_ALL.
+     */
+    bool GetSignatureHash(const CScript& scriptCode, unsigned int nIn, int nHashType, uint256& hashRet) const;
+
+private:
+    const CTransaction& txTo;
+    //! The hash of the serialization up to each regular input
+    std::vector<CHashWriter> vMidstates;
+    //! The serialized regular inputs with blank scripts, and the offset of the end of each one
+    std::vector<char> vBlankInputs;
+    std::vector<size_t> vInputEnd;
+    //! The serialization after the regular inputs
+    std::vector<char> vSuffix;
+};
+
+//! The blocks below the tip kept in a CCheckBlockAtHeightView, those below are looked up through the skip list of the tip
+static const int CBH_VIEW_RECENT_BLOCKS = 1000;
+
+/**
+ * The part of a chain OP_CHECKBLOCKATHEIGHT is checked against: its tip, with the hashes of its most recent
+ * blocks, and the safe depth, below which any block passes. It is taken once per block connected or per
+ * mempool admission, under cs_main, and then only read by the script checks, so that they do not read the
+ * chain, which the validation thread may be changing, from the script check threads. The entries of the
+ * block index, and thus the ancestors of the tip, do not change once added.
+ */
+class CCheckBlockAtHeightView
+{
+public:
+    CCheckBlockAtHeightView(const CChain& chain, int nSafeDepthIn, int nRecentBlocks = CBH_VIEW_RECENT_BLOCKS);
+
+    CCheckBlockAtHeightView(const CCheckBlockAtHeightView&) = delete;
+    CCheckBlockAtHeightView& operator=(const CCheckBlockAtHeightView&) = delete;
+
+    //! Whether the view was taken from chain as it is now, its tip being compared by hash too, as entries may be freed
+    bool IsOf(const CChain& chain) const;
+
+    bool CheckBlockHash(int nBlockHeight, const std::vector<unsigned char>& vchCompareTo) const;
+
+private:
+    const CBlockIndex* pindexTip;
+    uint256 hashTip;
+    int nHeight;
+    int nSafeDepth;
+    //! The hashes of the blocks from the tip downwards
+    std::vector<uint256> vRecentHashes;
+};
+
 class BaseSignatureChecker
 {
 public:
@@ -122,14 +184,16 @@ class TransactionSignatureChecker : public BaseSignatureChecker
 private:
     const CTransaction* txTo;
     unsigned int nIn;
-    const CChain* chain;
+    const CCheckBlockAtHeightView* cbhView;
+    //! Precomputed from *txTo, if not null
+    const CPrecomputedSigHash* precomputed;
 
 protected:
     virtual bool VerifySignature(const std::vector<unsigned char>& vchSig, const CPubKey& vchPubKey, const uint256& sighash) const;
 
 public:
-    TransactionSignatureChecker(const CChain* chainIn);
-    TransactionSignatureChecker(const CTransaction* txToIn, unsigned int nInIn, const CChain* chainIn);
+    TransactionSignatureChecker(const CCheckBlockAtHeightView* cbhViewIn);
+    TransactionSignatureChecker(const CTransaction* txToIn, unsigned int nInIn, const CCheckBlockAtHeightView* cbhViewIn, const CPrecomputedSigHash* precomputedIn = nullptr);
     bool CheckSig(const std::vector<unsigned char>& scriptSig, const std::vector<unsigned char>& vchPubKey, const CScript& scriptCode) const;
     bool CheckLockTime(const CScriptNum& nLockTime) const;
     bool CheckBlockHash(const int32_t nHeight, const std::vector<unsigned char>& nBlockHash) const;
@@ -149,13 +213,13 @@ class CertificateSignatureChecker : public BaseSignatureChecker
 private:
     const CScCertificate* certTo;
     unsigned int nIn;
-    const CChain* chain;
+    const CCheckBlockAtHeightView* cbhView;
 
 protected:
     virtual bool VerifySignature(const std::vector<unsigned char>& vchSig, const CPubKey& vchPubKey, const uint256& sighash) const;
 
 public:
-    CertificateSignatureChecker(const CScCertificate* certToIn, unsigned int nInIn, const CChain* chainIn);
+    CertificateSignatureChecker(const CScCertificate* certToIn, unsigned int nInIn, const CCheckBlockAtHeightView* cbhViewIn);
     bool CheckSig(const std::vector<unsigned char>& scriptSig, const std::vector<unsigned char>& vchPubKey, const CScript& scriptCode) const;
     // certificate does not have it
     bool CheckLockTime(const CScriptNum& nLockTime) const { return true;}
@@ -5,13 +5,14 @@
 
 #include "sigcache.h"
 
+#include "crypto/sha256.h"
+#include "cuckoocache.h"
 #include "pubkey.h"
 #include "random.h"
 #include "uint256.h"
 #include "util.h"
 
 #include <boost/thread.hpp>
-#include <boost/tuple/tuple_comparison.hpp>
 
 namespace {
 
@@ -23,93 +24,109 @@ namespace {
 class CSignatureCache
 {
 private:
-     //! sigdata_type is (signature hash, signature, public key):
-    typedef boost::tuple<uint256, std::vector<unsigned char>, CPubKey> sigdata_type;
-    std::set< sigdata_type> setValid;
+    //! Entries are SHA256(nonce || signature hash || public key || signature):
+    uint256 nonce;
+    typedef CCuckooCache<uint256, CSignatureCacheHasher> map_type;
+    map_type setValid;
+    //! Lookups share it, as they only flag the entries they erase, while inserts take it exclusively
     boost::shared_mutex cs_sigcache;
 
 public:
-    bool
-    Get(const uint256 &hash, const std::vector<unsigned char>& vchSig, const CPubKey& pubKey)
+    CSignatureCache()
     {
-        boost::shared_lock<boost::shared_mutex> lock(cs_sigcache);
+        GetRandBytes(nonce.begin(), 32);
+    }
 
-        sigdata_type k(hash, vchSig, pubKey);
-        std::set<sigdata_type>::iterator mi = setValid.find(k);
-        if (mi != setValid.end())
-            return true;
-        return false;
+    void ComputeEntry(uint256& entry, const uint256 &hash, const std::vector<unsigned char>& vchSig, const CPubKey& pubkey) const
+    {
+        CSHA256().Write(nonce.begin(), 32).Write(hash.begin(), 32).Write(pubkey.begin(), pubkey.size()).Write(vchSig.data(), vchSig.size()).Finalize(entry.begin());
     }
 
-    void Set(const uint256 &hash, const std::vector<unsigned char>& vchSig, const CPubKey& pubKey)
+    bool Get(const uint256& entry, const bool erase)
     {
-        // DoS prevention: limit cache size to less than 10MB
-        // (~200 bytes per cache entry times 50,000 entries)
-        // Since there are a maximum of 20,000 signature operations per block
-        // 50,000 is a reasonable default.
-        int64_t nMaxCacheSize = GetArg("-maxsigcachesize", 50000);
-        if (nMaxCacheSize <= 0) return;
+        boost::shared_lock<boost::shared_mutex> lock(cs_sigcache);
+        return setValid.IsSetup() && setValid.Contains(entry, erase);
+    }
 
+    void Set(const uint256& entry)
+    {
         boost::unique_lock<boost::shared_mutex> lock(cs_sigcache);
+        if (setValid.IsSetup())
+            setValid.Insert(entry);
+    }
 
-        while (static_cast<int64_t>(setValid.size()) > nMaxCacheSize)
-        {
-            // Evict a random entry. Random because that helps
-            // foil would-be DoS attackers who might try to pre-generate
-            // and re-use a set of valid signatures just-slightly-greater
-            // than our cache size.
-            uint256 randomHash = GetRandHash();
-            std::vector<unsigned char> unused;
-            std::set<sigdata_type>::iterator it =
-                setValid.lower_bound(sigdata_type(randomHash, unused, unused));
-            if (it == setValid.end())
-                it = setValid.begin();
-            setValid.erase(*it);
-        }
-
-        sigdata_type k(hash, vchSig, pubKey);
-        setValid.insert(k);
+    uint32_t SetupBytes(size_t n)
+    {
+        boost::unique_lock<boost::shared_mutex> lock(cs_sigcache);
+        return setValid.SetupBytes(n);
     }
 };
 
+/* A single cache for the signatures of transactions and certificates, as the signature hashes tell them apart */
+CSignatureCache signatureCache;
+
+bool GetCachedSignature(const std::vector<unsigned char>& vchSig, const CPubKey& pubkey, const uint256& sighash, bool store, uint256& entry)
+{
+    signatureCache.ComputeEntry(entry, sighash, vchSig, pubkey);
+    // when the result is not stored, the check is the last expected one for the signature, as
+    // for those of the block being connected, hence its entry makes room for new ones
+    return signatureCache.Get(entry, !store);
+}
+
+}
+
+size_t GetSignatureCacheShareBytes()
+{
+    const int64_t nMaxCacheSizeMB = std::min(std::max<int64_t>(0, GetArg("-maxsigcachesize", DEFAULT_MAX_SIG_CACHE_SIZE)), MAX_MAX_SIG_CACHE_SIZE);
+    return ((size_t)nMaxCacheSizeMB << 20) / 2;
+}
+
+void InitSignatureCache()
+{
+    const size_t nMaxCacheSize = GetSignatureCacheShareBytes();
+    if (nMaxCacheSize == 0) {
+        LogPrintf("Signature cache disabled\n");
+        return;
+    }
+    const size_t nEntries = signatureCache.SetupBytes(nMaxCacheSize);
+    LogPrintf("Using %zu MiB out of %zu requested for signature cache, able to store %zu elements\n",
+              (nEntries * sizeof(uint256)) >> 20, nMaxCacheSize >> 20, nEntries);
 }
 
 CachingTransactionSignatureChecker::CachingTransactionSignatureChecker(const CTransaction* txToIn, unsigned int nInIn,
-                                                                       const CChain* chainIn, bool storeIn):
-                                                                        TransactionSignatureChecker(txToIn, nInIn, chainIn),
+                                                                       const CCheckBlockAtHeightView* cbhViewIn, bool storeIn):
+                                                                        TransactionSignatureChecker(txToIn, nInIn, cbhViewIn),
                                                                         store(storeIn) {}
 
 bool CachingTransactionSignatureChecker::VerifySignature(const std::vector<unsigned char>& vchSig, const CPubKey& pubkey, const uint256& sighash) const
 {
-    static CSignatureCache signatureCache;
-
-    if (signatureCache.Get(sighash, vchSig, pubkey))
+    uint256 entry;
+    if (GetCachedSignature(vchSig, pubkey, sighash, store, entry))
         return true;
 
     if (!TransactionSignatureChecker::VerifySignature(vchSig, pubkey, sighash))
         return false;
 
     if (store)
-        signatureCache.Set(sighash, vchSig, pubkey);
+        signatureCache.Set(entry);
     return true;
 }
 
 CachingCertificateSignatureChecker::CachingCertificateSignatureChecker(const CScCertificate* certToIn, unsigned int nInIn,
-                                                                       const CChain* chainIn, bool storeIn):
-                                                                        CertificateSignatureChecker(certToIn, nInIn, chainIn),
+                                                                       const CCheckBlockAtHeightView* cbhViewIn, bool storeIn):
+                                                                        CertificateSignatureChecker(certToIn, nInIn, cbhViewIn),
                                                                         store(storeIn) {}
 
 bool CachingCertificateSignatureChecker::VerifySignature(const std::vector<unsigned char>& vchSig, const CPubKey& pubkey, const uint256& sighash) const
 {
-    static CSignatureCache signatureCache;
-
-    if (signatureCache.Get(sighash, vchSig, pubkey))
+    uint256 entry;
+    if (GetCachedSignature(vchSig, pubkey, sighash, store, entry))
         return true;
 
     if (!CertificateSignatureChecker::VerifySignature(vchSig, pubkey, sighash))
         return false;
 
     if (store)
-        signatureCache.Set(sighash, vchSig, pubkey);
+        signatureCache.Set(entry);
     return true;
 }
@@ -7,18 +7,43 @@
 #define BITCOIN_SCRIPT_SIGCACHE_H
 
 #include "script/interpreter.h"
+#include "uint256.h"
 
+#include <cstring>
 #include <vector>
 
+// The signature cache and the script execution cache share -maxsigcachesize, in MiB, with each entry taking 32 bytes
+static const int64_t DEFAULT_MAX_SIG_CACHE_SIZE = 32;
+// Maximum sig cache size allowed
+static const int64_t MAX_MAX_SIG_CACHE_SIZE = 16384;
+
 class CPubKey;
 
+/**
+ * The entries of the signature and script execution caches are salted hashes already, hence
+ * the 8 hashes of their cuckoo caches are just 8 slices of them, which an attacker cannot aim
+ * at without knowing the salt.
+ */
+class CSignatureCacheHasher
+{
+public:
+    template <uint8_t hash_select>
+    uint32_t operator()(const uint256& key) const
+    {
+        static_assert(hash_select < 8, "CSignatureCacheHasher only has 8 hashes available.");
+        uint32_t u;
+        std::memcpy(&u, key.begin() + 4 * hash_select, 4);
+        return u;
+    }
+};
+
 class CachingTransactionSignatureChecker : public TransactionSignatureChecker
 {
 private:
     bool store;
 
 public:
-    CachingTransactionSignatureChecker(const CTransaction* txToIn, unsigned int nInIn, const CChain* chainIn, bool storeIn=true);
+    CachingTransactionSignatureChecker(const CTransaction* txToIn, unsigned int nInIn, const CCheckBlockAtHeightView* cbhViewIn, bool storeIn=true);
     bool VerifySignature(const std::vector<unsigned char>& vchSig, const CPubKey& vchPubKey, const uint256& sighash) const;
 };
 
@@ -28,8 +53,14 @@ private:
     bool store;
 
 public:
-    CachingCertificateSignatureChecker(const CScCertificate* certToIn, unsigned int nInIn, const CChain* chainIn, bool storeIn=true);
+    CachingCertificateSignatureChecker(const CScCertificate* certToIn, unsigned int nInIn, const CCheckBlockAtHeightView* cbhViewIn, bool storeIn=true);
     bool VerifySignature(const std::vector<unsigned char>& vchSig, const CPubKey& vchPubKey, const uint256& sighash) const;
 };
 
+//! Allocate the signature cache with half of -maxsigcachesize: until then, no signature is cached
+void InitSignatureCache();
+
+//! The bytes of -maxsigcachesize given to each of the signature and script execution caches
+size_t GetSignatureCacheShareBytes();
+
 #endif // BITCOIN_SCRIPT_SIGCACHE_H
@@ -18,8 +18,10 @@ using namespace std;
 
 typedef vector<unsigned char> valtype;
 
-TransactionSignatureCreator::TransactionSignatureCreator(const CKeyStore& keystoreIn, const CTransaction& txToIn, unsigned int nInIn, int nHashTypeIn):
-    BaseSignatureCreator(keystoreIn), txTo(txToIn), nIn(nInIn), nHashType(nHashTypeIn), checker(&txTo, nIn, nullptr) {}
+TransactionSignatureCreator::TransactionSignatureCreator(const CKeyStore& keystoreIn, const CTransaction& txToIn, unsigned int nInIn, int nHashTypeIn,
+                                                         const CPrecomputedSigHash* precomputedIn):
+    BaseSignatureCreator(keystoreIn), txTo(txToIn), nIn(nInIn), nHashType(nHashTypeIn), precomputed(precomputedIn),
+    checker(&txTo, nIn, nullptr, precomputedIn) {}
 
 bool TransactionSignatureCreator::CreateSig(std::vector<unsigned char>& vchSig, const CKeyID& address, const CScript& scriptCode) const
 {
@@ -28,10 +30,12 @@ bool TransactionSignatureCreator::CreateSig(std::vector<unsigned char>& vchSig,
         return false;
 
     uint256 hash;
-    try {
-        hash = SignatureHash(scriptCode, txTo, nIn, nHashType);
-    } catch (const logic_error& ex) {
-        return false;
+    if (!precomputed || !precomputed->GetSignatureHash(scriptCode, nIn, nHashType, hash)) {
+        try {
+            hash = SignatureHash(scriptCode, txTo, nIn, nHashType);
+        } catch (const logic_error& ex) {
+            return false;
+        }
     }
 
     if (!key.Sign(hash, vchSig))
@@ -8,6 +8,9 @@
 
 #include "script/interpreter.h"
 
+/** The inputs of a transaction are signed in parallel when each thread gets at least this many of them */
+static const unsigned int SIGN_PARALLEL_MIN_INPUTS = 16;
+
 class CKeyID;
 class CKeyStore;
 class CScript;
@@ -37,10 +40,12 @@ class TransactionSignatureCreator : public BaseSignatureCreator {
     const CTransaction& txTo;
     unsigned int nIn;
     int nHashType;
+    const CPrecomputedSigHash* precomputed;
     const TransactionSignatureChecker checker;
 
 public:
-    TransactionSignatureCreator(const CKeyStore& keystoreIn, const CTransaction& txToIn, unsigned int nInIn, int nHashTypeIn=SIGHASH_ALL);
+    TransactionSignatureCreator(const CKeyStore& keystoreIn, const CTransaction& txToIn, unsigned int nInIn, int nHashTypeIn=SIGHASH_ALL,
+                                const CPrecomputedSigHash* precomputedIn = nullptr);
     const BaseSignatureChecker& Checker() const { return checker; }
     bool CreateSig(std::vector<unsigned char>& vchSig, const CKeyID& keyid, const CScript& scriptCode) const;
 };
@@ -28,6 +28,8 @@
 #include <optional>
 
 class CScript;
+class uint160;
+class uint256;
 
 static const unsigned int MAX_SERIALIZED_COMPACT_SIZE = 0x02000000;
 
@@ -426,6 +428,7 @@ I ReadVarInt(Stream& is)
 
 #define FLATDATA(obj) REF(CFlatData((char*)&(obj), (char*)&(obj) + sizeof(obj)))
 #define VARINT(obj) REF(WrapVarInt(REF(obj)))
+#define SIGNED_VARINT(obj) REF(WrapSignedVarInt(REF(obj)))
 #define LIMITED_STRING(obj,n) REF(LimitedString< n >(REF(obj)))
 
 /** 
@@ -490,6 +493,36 @@ public:
     }
 };
 
+/**
+ * VARINT of a signed integer, zigzag encoded so that the small negative values (e.g. the -1 used
+ * as null) take one byte as the small positive ones do.
+ */
+template<typename I>
+class CSignedVarInt
+{
+protected:
+    I &n;
+
+    uint64_t Encode() const { return (static_cast<uint64_t>(n) << 1) ^ static_cast<uint64_t>(static_cast<int64_t>(n) >> 63); }
+public:
+    CSignedVarInt(I& nIn) : n(nIn) { }
+
+    unsigned int GetSerializeSize(int, int) const {
+        return GetSizeOfVarInt<uint64_t>(Encode());
+    }
+
+    template<typename Stream>
+    void Serialize(Stream &s, int, int) const {
+        WriteVarInt<Stream,uint64_t>(s, Encode());
+    }
+
+    template<typename Stream>
+    void Unserialize(Stream& s, int, int) {
+        const uint64_t nCode = ReadVarInt<Stream,uint64_t>(s);
+        n = static_cast<I>(static_cast<int64_t>(nCode >> 1) ^ -static_cast<int64_t>(nCode & 1));
+    }
+};
+
 template<size_t Limit>
 class LimitedString
 {
@@ -527,6 +560,9 @@ public:
 template<typename I>
 CVarInt<I> WrapVarInt(I& n) { return CVarInt<I>(n); }
 
+template<typename I>
+CSignedVarInt<I> WrapSignedVarInt(I& n) { return CSignedVarInt<I>(n); }
+
 /**
  * Smart pointers, optionally used for polymorphic types
  */
@@ -566,18 +602,31 @@ template<typename C> unsigned int GetSerializeSize(const std::basic_string<C>& s
 template<typename Stream, typename C> void Serialize(Stream& os, const std::basic_string<C>& str, int, int=0);
 template<typename Stream, typename C> void Unserialize(Stream& is, std::basic_string<C>& str, int, int=0);
 
+/**
+ * Whether the serialization of a T is its representation in memory, so that a vector of them is written
+ * and read with a single copy instead of one element at a time: the byte types, the integers (other than
+ * bool) on little endian hosts, as they are serialized little endian, and the blobs uint256 and uint160.
+ */
+template<typename T>
+struct is_serialized_as_bytes : std::integral_constant<bool,
+    std::is_same_v<T, char> || std::is_same_v<T, signed char> || std::is_same_v<T, unsigned char>
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    || (std::is_integral_v<T> && !std::is_same_v<T, bool>)
+#endif
+    > {};
+
+template<> struct is_serialized_as_bytes<uint160> : std::true_type {};
+template<> struct is_serialized_as_bytes<uint256> : std::true_type {};
+
+template<typename T>
+inline constexpr bool is_serialized_as_bytes_v = is_serialized_as_bytes<T>::value;
+
 /**
  * vector
- * vectors of unsigned char are a special case and are intended to be serialized as a single opaque blob.
+ * vectors of the types serialized as bytes, unsigned char first, are written and read as a single blob.
  */
-template<typename T, typename A> unsigned int GetSerializeSize_impl(const std::vector<T, A>& v, int nType, int nVersion, const unsigned char&);
-template<typename T, typename A, typename V> unsigned int GetSerializeSize_impl(const std::vector<T, A>& v, int nType, int nVersion, const V&);
 template<typename T, typename A> inline unsigned int GetSerializeSize(const std::vector<T, A>& v, int nType, int nVersion);
-template<typename Stream, typename T, typename A> void Serialize_impl(Stream& os, const std::vector<T, A>& v, int nType, int nVersion, const unsigned char&);
-template<typename Stream, typename T, typename A, typename V> void Serialize_impl(Stream& os, const std::vector<T, A>& v, int nType, int nVersion, const V&);
 template<typename Stream, typename T, typename A> inline std::enable_if_t<std::is_same_v<typename A::value_type,T>> Serialize(Stream& os, const std::vector<T, A>& v, int nType, int nVersion);
-template<typename Stream, typename T, typename A> void Unserialize_impl(Stream& is, std::vector<T, A>& v, int nType, int nVersion, const unsigned char&);
-template<typename Stream, typename T, typename A, typename V> void Unserialize_impl(Stream& is, std::vector<T, A>& v, int nType, int nVersion, const V&);
 template<typename Stream, typename T, typename A> inline void Unserialize(Stream& is, std::vector<T, A>& v, int nType, int nVersion);
 
 /**
@@ -697,74 +746,42 @@ void Unserialize(Stream& is, std::basic_string<C>& str, int, int)
 /**
  * vector
  */
-template<typename T, typename A>
-unsigned int GetSerializeSize_impl(const std::vector<T, A>& v, int nType, int nVersion, const unsigned char&)
-{
-    return (GetSizeOfCompactSize(v.size()) + v.size() * sizeof(T));
-}
-
-template<typename T, typename A, typename V>
-unsigned int GetSerializeSize_impl(const std::vector<T, A>& v, int nType, int nVersion, const V&)
-{
-    unsigned int nSize = GetSizeOfCompactSize(v.size());
-    for (typename std::vector<T, A>::const_iterator vi = v.begin(); vi != v.end(); ++vi)
-        nSize += GetSerializeSize((*vi), nType, nVersion);
-    return nSize;
-}
-
 template<typename T, typename A>
 inline unsigned int GetSerializeSize(const std::vector<T, A>& v, int nType, int nVersion)
 {
-    return GetSerializeSize_impl(v, nType, nVersion, T());
+    if constexpr (is_serialized_as_bytes_v<T>) {
+        return (GetSizeOfCompactSize(v.size()) + v.size() * sizeof(T));
+    } else {
+        unsigned int nSize = GetSizeOfCompactSize(v.size());
+        for (typename std::vector<T, A>::const_iterator vi = v.begin(); vi != v.end(); ++vi)
+            nSize += GetSerializeSize((*vi), nType, nVersion);
+        return nSize;
+    }
 }
 
 
 template<typename Stream, typename T, typename A>
-void Serialize_impl(Stream& os, const std::vector<T, A>& v, int nType, int nVersion, const unsigned char&)
-{
-    WriteCompactSize(os, v.size());
-    if (!v.empty())
-        os.write((char*)&v[0], v.size() * sizeof(T));
-}
-
-template<typename Stream, typename T, typename A, typename V>
-void Serialize_impl(Stream& os, const std::vector<T, A>& v, int nType, int nVersion, const V&)
+inline std::enable_if_t<std::is_same_v<typename A::value_type,T>> Serialize(Stream& os, const std::vector<T, A>& v, int nType, int nVersion)
 {
     WriteCompactSize(os, v.size());
-    for (typename std::vector<T, A>::const_iterator vi = v.begin(); vi != v.end(); ++vi)        
+    if constexpr (is_serialized_as_bytes_v<T>) {
+        if (!v.empty())
+            os.write((char*)&v[0], v.size() * sizeof(T));
+    } else {
+        for (typename std::vector<T, A>::const_iterator vi = v.begin(); vi != v.end(); ++vi)
         #ifdef __APPLE__
                 ::Serialize(os, static_cast<T>(*vi), nType, nVersion);
         #else
                 ::Serialize(os, (*vi), nType, nVersion);
         #endif
-}
-
-template<typename Stream, typename T, typename A>
-inline std::enable_if_t<std::is_same_v<typename A::value_type,T>> Serialize(Stream& os, const std::vector<T, A>& v, int nType, int nVersion)
-{
-    Serialize_impl(os, v, nType, nVersion, T());
-}
-
-
-template<typename Stream, typename T, typename A>
-void Unserialize_impl(Stream& is, std::vector<T, A>& v, int nType, int nVersion, const unsigned char&)
-{
-    // Limit size per read so bogus size value won't cause out of memory
-    v.clear();
-    unsigned int nSize = ReadCompactSize(is);
-    unsigned int i = 0;
-    while (i < nSize)
-    {
-        unsigned int blk = std::min(nSize - i, (unsigned int)(1 + 4999999 / sizeof(T)));
-        v.resize(i + blk);
-        is.read((char*)&v[i], blk * sizeof(T));
-        i += blk;
     }
 }
 
+
 template<typename Stream, typename T, typename A>
 void AddEntriesInVector(Stream& is, std::vector<T, A>& v, int nType, int nVersion, unsigned int nSize)
 {
+    // Limit size per read so bogus size value won't cause out of memory
     unsigned int i = 0;
     unsigned int nMid = 0;
     while (nMid < nSize)
@@ -772,14 +789,24 @@ void AddEntriesInVector(Stream& is, std::vector<T, A>& v, int nType, int nVersio
         nMid += 5000000 / sizeof(T);
         if (nMid > nSize)
             nMid = nSize;
-        v.resize(nMid);
-        for (; i < nMid; i++)
-            Unserialize(is, v[i], nType, nVersion);
+        v.reserve(nMid);
+        if constexpr (is_serialized_as_bytes_v<T>) {
+            v.resize(nMid);
+            is.read((char*)&v[i], (nMid - i) * sizeof(T));
+            i = nMid;
+        } else {
+            // the elements are read in place at the end of the vector, without a default constructed one
+            // to overwrite first
+            for (; i < nMid; i++) {
+                v.emplace_back();
+                Unserialize(is, v.back(), nType, nVersion);
+            }
+        }
     }
 }
 
-template<typename Stream, typename T, typename A, typename V>
-void Unserialize_impl(Stream& is, std::vector<T, A>& v, int nType, int nVersion, const V&)
+template<typename Stream, typename T, typename A>
+inline void Unserialize(Stream& is, std::vector<T, A>& v, int nType, int nVersion)
 {
     v.clear();
     unsigned int nSize = ReadCompactSize(is);
@@ -787,13 +814,6 @@ void Unserialize_impl(Stream& is, std::vector<T, A>& v, int nType, int nVersion,
 }
 
 
-template<typename Stream, typename T, typename A>
-inline void Unserialize(Stream& is, std::vector<T, A>& v, int nType, int nVersion)
-{
-    Unserialize_impl(is, v, nType, nVersion, T());
-}
-
-
 
 /**
  * others derived from vector
@@ -972,12 +992,12 @@ void Unserialize(Stream& is, std::map<K, T, Pred, A>& m, int nType, int nVersion
 {
     m.clear();
     unsigned int nSize = ReadCompactSize(is);
-    typename std::map<K, T, Pred, A>::iterator mi = m.begin();
+    // the entries are serialized in order, so that each one goes right before the end
     for (unsigned int i = 0; i < nSize; i++)
     {
         std::pair<K, T> item;
         Unserialize(is, item, nType, nVersion);
-        mi = m.insert(mi, item);
+        m.insert(m.end(), std::move(item));
     }
 }
 
@@ -1008,12 +1028,11 @@ void Unserialize(Stream& is, std::set<K, Pred, A>& m, int nType, int nVersion)
 {
     m.clear();
     unsigned int nSize = ReadCompactSize(is);
-    typename std::set<K, Pred, A>::iterator it = m.begin();
     for (unsigned int i = 0; i < nSize; i++)
     {
         K key;
         Unserialize(is, key, nType, nVersion);
-        it = m.insert(it, key);
+        m.insert(m.end(), std::move(key));
     }
 }
 
@@ -36,6 +36,9 @@ struct CSpentIndexKey {
         outputIndex = 0;
     }
 
+    friend bool operator==(const CSpentIndexKey& a, const CSpentIndexKey& b) {
+        return a.txid == b.txid && a.outputIndex == b.outputIndex;
+    }
 };
 
 struct CSpentIndexValue {
@@ -90,6 +93,44 @@ struct CSpentIndexValue {
     }
 };
 
+/** The output spent by an input, as getblockdeltas reports it */
+struct CInputDelta {
+    CAmount satoshis;
+    AddressType addressType;
+    uint160 addressHash;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
+        READWRITE(satoshis);
+        int addressTypeInt = static_cast<int>(addressType);
+        READWRITE(addressTypeInt);
+        addressType = static_cast<AddressType>(addressTypeInt);
+        READWRITE(addressHash);
+    }
+
+    CInputDelta(CAmount s, AddressType type, uint160 a) : satoshis(s), addressType(type), addressHash(a) {}
+
+    CInputDelta() : satoshis(0), addressType(AddressType::UNKNOWN) {}
+};
+
+/**
+ * The outputs spent by the inputs of the transactions of a block, by transaction and input index, written
+ * along with the spent index entries when the block is connected, so that getblockdeltas reads them at once
+ * instead of looking up the spent index for each input.
+ */
+struct CBlockInputDeltas {
+    std::vector<std::vector<CInputDelta> > vTxInputs;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
+        READWRITE(vTxInputs);
+    }
+};
+
 struct CSpentIndexKeyCompare
 {
     bool operator()(const CSpentIndexKey& a, const CSpentIndexKey& b) const {
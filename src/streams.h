@@ -6,6 +6,7 @@
 #ifndef BITCOIN_STREAMS_H
 #define BITCOIN_STREAMS_H
 
+#include "support/allocators/pooled.h"
 #include "support/allocators/zeroafterfree.h"
 #include "serialize.h"
 
@@ -349,7 +350,8 @@ public:
     }
 };
 
-class CDataStream : public CBaseDataStream<CSerializeData>
+/** The data stream of general use, whose buffer is cleansed when freed as it may hold keys */
+class CDataStream : public CBaseDataStream<CZeroAfterFreeData>
 {
 public:
     explicit CDataStream(int nTypeIn, int nVersionIn) : CBaseDataStream(nTypeIn, nVersionIn) { }
@@ -373,6 +375,92 @@ public:
 
 };
 
+/**
+ * The data stream of public chain data, network messages and database records, whose buffer comes
+ * from the buffer pool of the thread and is not cleansed when freed. Never use it for keys or wallet data.
+ */
+class CPublicDataStream : public CBaseDataStream<CSerializeData>
+{
+public:
+    explicit CPublicDataStream(int nTypeIn, int nVersionIn) : CBaseDataStream(nTypeIn, nVersionIn) { }
+
+    CPublicDataStream(const char* pbegin, const char* pend, int nTypeIn, int nVersionIn) :
+            CBaseDataStream(pbegin, pend, nTypeIn, nVersionIn) { }
+
+    CPublicDataStream(const vector_type& vchIn, int nTypeIn, int nVersionIn) :
+            CBaseDataStream(vchIn, nTypeIn, nVersionIn) { }
+
+    CPublicDataStream(const std::vector<char>& vchIn, int nTypeIn, int nVersionIn) :
+            CBaseDataStream(vchIn, nTypeIn, nVersionIn) { }
+
+    CPublicDataStream(const std::vector<unsigned char>& vchIn, int nTypeIn, int nVersionIn) :
+            CBaseDataStream(vchIn, nTypeIn, nVersionIn) { }
+
+    //! Reserve the serialized size of obj, so that writing it does not grow the buffer again
+    template<typename T>
+    void ReserveFor(const T& obj)
+    {
+        reserve(size() + GetSerializeSize(obj));
+    }
+
+    //! Like GetAndClear, but hand the buffer itself to an empty d when nothing has been read yet, leaving no capacity
+    void MoveTo(CSerializeData& d)
+    {
+        if (nReadPos == 0 && d.empty())
+            d.swap(vch);
+        else
+            d.insert(d.end(), begin(), end());
+        clear();
+    }
+};
+
+/**
+ * Minimal stream reading bytes it does not own, such as a mapped file region, so that objects
+ * are deserialized from them in place without a copy in a stream buffer.
+ */
+class CSpanReader
+{
+private:
+    const char* pbegin;
+    const char* pend;
+    int nType;
+    int nVersion;
+
+public:
+    CSpanReader(const char* pbeginIn, const char* pendIn, int nTypeIn, int nVersionIn) :
+        pbegin(pbeginIn), pend(pendIn), nType(nTypeIn), nVersion(nVersionIn) {}
+
+    int GetType() const          { return nType; }
+    int GetVersion() const       { return nVersion; }
+    size_t size() const          { return pend - pbegin; }
+    bool empty() const           { return pbegin == pend; }
+    //! The next byte to read
+    const char* data() const     { return pbegin; }
+
+    void read(char* pch, size_t nSize)
+    {
+        if (nSize > size())
+            throw std::ios_base::failure("CSpanReader::read(): end of data");
+        memcpy(pch, pbegin, nSize);
+        pbegin += nSize;
+    }
+
+    void ignore(size_t nSize)
+    {
+        if (nSize > size())
+            throw std::ios_base::failure("CSpanReader::ignore(): end of data");
+        pbegin += nSize;
+    }
+
+    template<typename T>
+    CSpanReader& operator>>(T& obj)
+    {
+        // Unserialize from this stream
+        ::Unserialize(*this, obj, nType, nVersion);
+        return (*this);
+    }
+};
+
 
 
 
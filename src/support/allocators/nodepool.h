@@ -0,0 +1,58 @@
+#ifndef BITCOIN_SUPPORT_ALLOCATORS_NODEPOOL_H
+#define BITCOIN_SUPPORT_ALLOCATORS_NODEPOOL_H
+
+#include "support/hugepages.h"
+#include "support/nodepool.h"
+
+#include <new>
+#include <type_traits>
+
+/**
+ * Allocator of the nodes of the coins caches and other large node based containers: with -hugepages
+ * the single nodes come from the CNodePool of their type, everything else (bucket arrays) and all the
+ * allocations without -hugepages go to operator new. Whether an allocator pools is read from
+ * GetHugePageMode() when it is created and travels with its copies and the containers moved or swapped,
+ * so that memory is always released the way it was allocated.
+ */
+template <typename T>
+struct node_pool_allocator {
+    typedef T value_type;
+    typedef std::true_type propagate_on_container_copy_assignment;
+    typedef std::true_type propagate_on_container_move_assignment;
+    typedef std::true_type propagate_on_container_swap;
+
+    node_pool_allocator() noexcept : fPooled(GetHugePageMode() != HugePageMode::OFF) {}
+    template <typename U>
+    node_pool_allocator(const node_pool_allocator<U>& other) noexcept : fPooled(other.fPooled) {}
+
+    T* allocate(std::size_t n)
+    {
+        if (fPooled && n == 1)
+            return static_cast<T*>(Pool().Allocate());
+        return static_cast<T*>(::operator new(n * sizeof(T)));
+    }
+
+    void deallocate(T* p, std::size_t n)
+    {
+        if (fPooled && n == 1)
+            Pool().Deallocate(p);
+        else
+            ::operator delete(p);
+    }
+
+    //! Never destroyed, as containers with static storage may free their nodes after it would be
+    static CNodePool& Pool()
+    {
+        static CNodePool* pool = new CNodePool(sizeof(T));
+        return *pool;
+    }
+
+    template <typename U>
+    bool operator==(const node_pool_allocator<U>& other) const noexcept { return fPooled == other.fPooled; }
+    template <typename U>
+    bool operator!=(const node_pool_allocator<U>& other) const noexcept { return fPooled != other.fPooled; }
+
+    bool fPooled;
+};
+
+#endif // BITCOIN_SUPPORT_ALLOCATORS_NODEPOOL_H
@@ -0,0 +1,40 @@
+#ifndef BITCOIN_SUPPORT_ALLOCATORS_POOLED_H
+#define BITCOIN_SUPPORT_ALLOCATORS_POOLED_H
+
+#include "support/bufferpool.h"
+
+#include <vector>
+
+/**
+ * Allocator of the buffers of public data, the chain data sent to peers and written to the block and
+ * coins databases: they are taken from the buffer pool of the thread, and not cleansed when freed.
+ * Keys and wallet records keep using zero_after_free_allocator or secure_allocator.
+ */
+template <typename T>
+struct pooled_allocator {
+    typedef T value_type;
+
+    pooled_allocator() noexcept {}
+    template <typename U>
+    pooled_allocator(const pooled_allocator<U>&) noexcept {}
+
+    T* allocate(std::size_t n)
+    {
+        return static_cast<T*>(BufferPoolAllocate(n * sizeof(T)));
+    }
+
+    void deallocate(T* p, std::size_t n)
+    {
+        BufferPoolDeallocate(p, n * sizeof(T));
+    }
+
+    template <typename U>
+    bool operator==(const pooled_allocator<U>&) const noexcept { return true; }
+    template <typename U>
+    bool operator!=(const pooled_allocator<U>&) const noexcept { return false; }
+};
+
+// Byte-vector of public serialized data, like the network messages.
+typedef std::vector<char, pooled_allocator<char> > CSerializeData;
+
+#endif // BITCOIN_SUPPORT_ALLOCATORS_POOLED_H
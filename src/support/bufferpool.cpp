@@ -0,0 +1,93 @@
+#include "support/bufferpool.h"
+
+#include <new>
+#include <vector>
+
+namespace {
+
+const int MIN_CLASS = 12;
+const int MAX_CLASS = 23;
+static_assert(BUFFER_POOL_MIN_SIZE == (size_t)1 << MIN_CLASS, "BUFFER_POOL_MIN_SIZE is the smallest size class");
+static_assert(BUFFER_POOL_MAX_SIZE == (size_t)1 << MAX_CLASS, "BUFFER_POOL_MAX_SIZE is the largest size class");
+
+//! The size class of a pooled size, the exponent of the power of two it is rounded to
+int SizeClass(size_t nSize)
+{
+    int nClass = MIN_CLASS;
+    while (((size_t)1 << nClass) < nSize)
+        ++nClass;
+    return nClass;
+}
+
+// set once the pool of the thread is destroyed, the buffers freed afterwards go back to the heap
+thread_local bool fBufferPoolDestroyed = false;
+
+struct BufferPool
+{
+    std::vector<void*> vFree[MAX_CLASS - MIN_CLASS + 1];
+    size_t nBytes = 0;
+
+    ~BufferPool()
+    {
+        fBufferPoolDestroyed = true;
+        for (std::vector<void*>& vClass : vFree)
+            for (void* p : vClass)
+                ::operator delete(p);
+    }
+};
+
+thread_local BufferPool bufferPool;
+
+} // anon namespace
+
+size_t BufferPoolRoundSize(size_t nSize)
+{
+    if (nSize < BUFFER_POOL_MIN_SIZE || nSize > BUFFER_POOL_MAX_SIZE)
+        return nSize;
+    return (size_t)1 << SizeClass(nSize);
+}
+
+void* BufferPoolAllocate(size_t nSize)
+{
+    if (nSize < BUFFER_POOL_MIN_SIZE || nSize > BUFFER_POOL_MAX_SIZE || fBufferPoolDestroyed)
+        return ::operator new(BufferPoolRoundSize(nSize));
+
+    const int nClass = SizeClass(nSize);
+    std::vector<void*>& vClass = bufferPool.vFree[nClass - MIN_CLASS];
+    if (vClass.empty())
+        return ::operator new((size_t)1 << nClass);
+    void* p = vClass.back();
+    vClass.pop_back();
+    bufferPool.nBytes -= (size_t)1 << nClass;
+    return p;
+}
+
+void BufferPoolDeallocate(void* p, size_t nSize)
+{
+    if (p == nullptr)
+        return;
+    if (nSize < BUFFER_POOL_MIN_SIZE || nSize > BUFFER_POOL_MAX_SIZE || fBufferPoolDestroyed)
+    {
+        ::operator delete(p);
+        return;
+    }
+
+    const int nClass = SizeClass(nSize);
+    if (bufferPool.nBytes + ((size_t)1 << nClass) > BUFFER_POOL_THREAD_BYTES)
+    {
+        ::operator delete(p);
+        return;
+    }
+    try {
+        bufferPool.vFree[nClass - MIN_CLASS].push_back(p);
+    } catch (const std::bad_alloc&) {
+        ::operator delete(p);
+        return;
+    }
+    bufferPool.nBytes += (size_t)1 << nClass;
+}
+
+size_t BufferPoolThreadBytes()
+{
+    return fBufferPoolDestroyed ? 0 : bufferPool.nBytes;
+}
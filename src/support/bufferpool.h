@@ -0,0 +1,28 @@
+#ifndef BITCOIN_SUPPORT_BUFFERPOOL_H
+#define BITCOIN_SUPPORT_BUFFERPOOL_H
+
+#include <stddef.h>
+
+//! Smaller buffers are left to malloc, which already caches them per thread
+static const size_t BUFFER_POOL_MIN_SIZE = 4096;
+//! Larger buffers are neither rounded nor kept
+static const size_t BUFFER_POOL_MAX_SIZE = 8 << 20;
+//! The bytes of free buffers a thread keeps for reuse
+static const size_t BUFFER_POOL_THREAD_BYTES = 32 << 20;
+
+/**
+ * A pool of the serialization buffers freed by a thread, reused by its next allocations. Pooled sizes
+ * are rounded up to a power of two, so that a buffer freed with the size it was allocated with goes
+ * back to the list of its size class; a buffer may be freed by another thread than the one that
+ * allocated it, it then joins the pool of the freeing thread. Reusing the buffers of the blocks and
+ * large messages saves mapping and faulting in their pages again at every allocation.
+ */
+void* BufferPoolAllocate(size_t nSize);
+void BufferPoolDeallocate(void* p, size_t nSize);
+
+//! The size actually allocated for a buffer of nSize bytes
+size_t BufferPoolRoundSize(size_t nSize);
+//! The bytes of free buffers kept by the calling thread
+size_t BufferPoolThreadBytes();
+
+#endif // BITCOIN_SUPPORT_BUFFERPOOL_H
@@ -0,0 +1,158 @@
+#include "support/hugepages.h"
+
+#include <atomic>
+#include <new>
+
+#ifdef WIN32
+#include <malloc.h>
+#include <string.h>
+#else
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#ifdef __linux__
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <stdio.h>
+#include <vector>
+#endif
+
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+namespace {
+
+std::atomic<HugePageMode> hugePageMode(DEFAULT_HUGE_PAGE_MODE);
+std::atomic<bool> fNumaInterleave(DEFAULT_NUMA_INTERLEAVE);
+//! cleared once the reserved huge pages run out, the next chunks are transparent ones
+std::atomic<bool> fHugeTlbAvailable(true);
+
+size_t RoundToHugePage(size_t nSize)
+{
+    return (nSize + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+}
+
+#ifdef __linux__
+//! The nodes listed by sysfs, none without NUMA information
+size_t NumaNodeCount()
+{
+    static const size_t nNodes = [] {
+        size_t n = 0;
+        struct stat st;
+        while (n < 1024 && stat(("/sys/devices/system/node/node" + std::to_string(n)).c_str(), &st) == 0)
+            n++;
+        return n;
+    }();
+    return nNodes;
+}
+
+void InterleaveOverNodes(void* p, size_t nSize)
+{
+#ifdef SYS_mbind
+    const size_t nNodes = NumaNodeCount();
+    if (nNodes < 2)
+        return;
+    const size_t nBits = 8 * sizeof(unsigned long);
+    std::vector<unsigned long> vMask((nNodes + nBits - 1) / nBits, 0);
+    for (size_t i = 0; i < nNodes; i++)
+        vMask[i / nBits] |= 1UL << (i % nBits);
+    const int MPOL_INTERLEAVE_ = 3;
+    // a failure leaves the default, local, policy
+    syscall(SYS_mbind, p, nSize, MPOL_INTERLEAVE_, vMask.data(), nNodes + 1, 0);
+#endif
+}
+#endif
+
+} // anon namespace
+
+bool ParseHugePageMode(const std::string& strMode, HugePageMode& mode)
+{
+    if (strMode == "off" || strMode == "0")
+        mode = HugePageMode::OFF;
+    else if (strMode == "transparent" || strMode == "1")
+        mode = HugePageMode::TRANSPARENT;
+    else if (strMode == "explicit")
+        mode = HugePageMode::EXPLICIT;
+    else
+        return false;
+    return true;
+}
+
+bool SetHugePageMode(HugePageMode mode, bool fInterleave)
+{
+#ifdef WIN32
+    if (mode != HugePageMode::OFF)
+        return false;
+#endif
+    hugePageMode = mode;
+    fNumaInterleave = fInterleave;
+    return true;
+}
+
+HugePageMode GetHugePageMode()
+{
+    return hugePageMode.load(std::memory_order_relaxed);
+}
+
+void* HugePageMap(size_t nSize)
+{
+    nSize = RoundToHugePage(nSize);
+#ifdef WIN32
+    void* p = _aligned_malloc(nSize, HUGE_PAGE_SIZE);
+    if (p)
+        memset(p, 0, nSize);
+    return p;
+#else
+    void* p = MAP_FAILED;
+#ifdef MAP_HUGETLB
+    // huge pages are aligned on their size
+    if (GetHugePageMode() == HugePageMode::EXPLICIT && fHugeTlbAvailable.load(std::memory_order_relaxed)) {
+        p = mmap(nullptr, nSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (p == MAP_FAILED)
+            fHugeTlbAvailable = false;
+    }
+#endif
+    if (p == MAP_FAILED) {
+        // map a huge page more, then trim it to the alignment
+        unsigned char* pMap = static_cast<unsigned char*>(mmap(nullptr, nSize + HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE,
+                                                                MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+        if (pMap == MAP_FAILED)
+            return nullptr;
+        unsigned char* pAligned = reinterpret_cast<unsigned char*>(RoundToHugePage(reinterpret_cast<size_t>(pMap)));
+        if (pAligned > pMap)
+            munmap(pMap, pAligned - pMap);
+        if (pMap + HUGE_PAGE_SIZE > pAligned)
+            munmap(pAligned + nSize, pMap + HUGE_PAGE_SIZE - pAligned);
+        p = pAligned;
+#ifdef MADV_HUGEPAGE
+        if (GetHugePageMode() != HugePageMode::OFF)
+            madvise(p, nSize, MADV_HUGEPAGE);
+#endif
+    }
+#ifdef __linux__
+    if (fNumaInterleave.load(std::memory_order_relaxed))
+        InterleaveOverNodes(p, nSize);
+#endif
+    return p;
+#endif
+}
+
+void HugePageUnmap(void* p, size_t nSize)
+{
+    if (p == nullptr)
+        return;
+#ifdef WIN32
+    _aligned_free(p);
+#else
+    munmap(p, RoundToHugePage(nSize));
+#endif
+}
+
+void ReleaseFreeHeapMemory()
+{
+#ifdef __GLIBC__
+    malloc_trim(0);
+#endif
+}
@@ -0,0 +1,43 @@
+#ifndef BITCOIN_SUPPORT_HUGEPAGES_H
+#define BITCOIN_SUPPORT_HUGEPAGES_H
+
+#include <stddef.h>
+#include <string>
+
+//! The size and alignment of the mappings of HugePageMap
+static const size_t HUGE_PAGE_SIZE = 2 << 20;
+
+/** How the chunks of the coins cache entries and of the block index are backed, see -hugepages */
+enum class HugePageMode {
+    //! The entries are left to malloc
+    OFF,
+    //! Chunks mapped with madvise(MADV_HUGEPAGE), backed by transparent huge pages where the kernel has some
+    TRANSPARENT,
+    //! Chunks mapped with MAP_HUGETLB from the reserved huge pages, or as TRANSPARENT once they run out
+    EXPLICIT,
+};
+
+static const HugePageMode DEFAULT_HUGE_PAGE_MODE = HugePageMode::OFF;
+static const bool DEFAULT_NUMA_INTERLEAVE = false;
+
+bool ParseHugePageMode(const std::string& strMode, HugePageMode& mode);
+
+/**
+ * Set at startup, before the coins caches and the block index are created: the containers created
+ * before keep allocating as they did. Returns false, leaving it OFF, where huge pages are not supported.
+ * With fInterleave the chunks are spread over the NUMA nodes, page by page.
+ */
+bool SetHugePageMode(HugePageMode mode, bool fInterleave);
+HugePageMode GetHugePageMode();
+
+/**
+ * Map nSize bytes, rounded up to HUGE_PAGE_SIZE and aligned on it, zeroed and backed as the mode says.
+ * Returns nullptr on failure.
+ */
+void* HugePageMap(size_t nSize);
+void HugePageUnmap(void* p, size_t nSize);
+
+//! Give the free memory of the heap back to the OS, where the allocator supports it
+void ReleaseFreeHeapMemory();
+
+#endif // BITCOIN_SUPPORT_HUGEPAGES_H
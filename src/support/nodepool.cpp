@@ -0,0 +1,116 @@
+#include "support/nodepool.h"
+
+#include "support/hugepages.h"
+
+#include <assert.h>
+#include <new>
+#include <stdint.h>
+
+namespace {
+const size_t NODE_ALIGNMENT = 16;
+
+size_t AlignNode(size_t nSize)
+{
+    return (nSize + NODE_ALIGNMENT - 1) / NODE_ALIGNMENT * NODE_ALIGNMENT;
+}
+} // anon namespace
+
+CNodePool::CNodePool(size_t nNodeSizeIn) : nNodeSize(AlignNode(nNodeSizeIn < sizeof(void*) ? sizeof(void*) : nNodeSizeIn))
+{
+    nHeaderSize = AlignNode(sizeof(Chunk));
+    nPerChunk = (HUGE_PAGE_SIZE - nHeaderSize) / nNodeSize;
+    assert(nPerChunk > 0);
+}
+
+CNodePool::~CNodePool()
+{
+    // the nodes still allocated are lost with their chunks
+    std::lock_guard<std::mutex> lock(cs);
+    while (pPartial) {
+        Chunk* pChunk = pPartial;
+        Unlink(pChunk);
+        HugePageUnmap(pChunk, HUGE_PAGE_SIZE);
+    }
+    HugePageUnmap(pSpare, HUGE_PAGE_SIZE);
+}
+
+void CNodePool::Link(Chunk* pChunk)
+{
+    pChunk->pPrev = nullptr;
+    pChunk->pNext = pPartial;
+    if (pPartial)
+        pPartial->pPrev = pChunk;
+    pPartial = pChunk;
+}
+
+void CNodePool::Unlink(Chunk* pChunk)
+{
+    if (pChunk->pPrev)
+        pChunk->pPrev->pNext = pChunk->pNext;
+    else
+        pPartial = pChunk->pNext;
+    if (pChunk->pNext)
+        pChunk->pNext->pPrev = pChunk->pPrev;
+    pChunk->pPrev = pChunk->pNext = nullptr;
+}
+
+void* CNodePool::Allocate()
+{
+    std::lock_guard<std::mutex> lock(cs);
+    if (!pPartial) {
+        Chunk* pChunk = pSpare;
+        pSpare = nullptr;
+        if (!pChunk) {
+            pChunk = static_cast<Chunk*>(HugePageMap(HUGE_PAGE_SIZE));
+            if (!pChunk)
+                throw std::bad_alloc();
+            nChunks++;
+        }
+        Link(pChunk);
+    }
+
+    Chunk* pChunk = pPartial;
+    void* p;
+    if (pChunk->pFree) {
+        p = pChunk->pFree;
+        pChunk->pFree = *static_cast<void**>(p);
+    } else {
+        p = reinterpret_cast<unsigned char*>(pChunk) + nHeaderSize + pChunk->nCarved * nNodeSize;
+        pChunk->nCarved++;
+    }
+    if (++pChunk->nUsed == nPerChunk)
+        Unlink(pChunk);
+    return p;
+}
+
+void CNodePool::Deallocate(void* p)
+{
+    if (!p)
+        return;
+    Chunk* pChunk = reinterpret_cast<Chunk*>(reinterpret_cast<uintptr_t>(p) & ~(uintptr_t)(HUGE_PAGE_SIZE - 1));
+    std::lock_guard<std::mutex> lock(cs);
+    assert(pChunk->nUsed > 0);
+    if (pChunk->nUsed-- == nPerChunk)
+        Link(pChunk);
+    if (pChunk->nUsed > 0) {
+        *static_cast<void**>(p) = pChunk->pFree;
+        pChunk->pFree = p;
+        return;
+    }
+
+    Unlink(pChunk);
+    if (pSpare) {
+        HugePageUnmap(pChunk, HUGE_PAGE_SIZE);
+        nChunks--;
+    } else {
+        pChunk->pFree = nullptr;
+        pChunk->nCarved = 0;
+        pSpare = pChunk;
+    }
+}
+
+size_t CNodePool::ChunkCount() const
+{
+    std::lock_guard<std::mutex> lock(cs);
+    return nChunks;
+}
@@ -0,0 +1,53 @@
+#ifndef BITCOIN_SUPPORT_NODEPOOL_H
+#define BITCOIN_SUPPORT_NODEPOOL_H
+
+#include <mutex>
+#include <stddef.h>
+
+/**
+ * A pool of nodes of one size, carved out of chunks of HUGE_PAGE_SIZE mapped by HugePageMap: the nodes
+ * of a container then share a few huge pages, rather than being spread over the 4 KB pages of the heap.
+ * Each chunk starts with its header, found from a node by aligning its address down. A chunk whose
+ * nodes are all freed is unmapped, but for one kept for the next allocations, so that the memory of a
+ * flushed cache goes back to the OS.
+ */
+class CNodePool
+{
+public:
+    explicit CNodePool(size_t nNodeSize);
+    ~CNodePool();
+
+    CNodePool(const CNodePool&) = delete;
+    CNodePool& operator=(const CNodePool&) = delete;
+
+    //! Throws std::bad_alloc if no chunk can be mapped
+    void* Allocate();
+    void Deallocate(void* p);
+
+    size_t NodesPerChunk() const { return nPerChunk; }
+    size_t ChunkCount() const;
+
+private:
+    struct Chunk
+    {
+        Chunk* pPrev;
+        Chunk* pNext;
+        void* pFree;
+        size_t nUsed;
+        size_t nCarved;
+    };
+
+    mutable std::mutex cs;
+    const size_t nNodeSize;
+    size_t nHeaderSize;
+    size_t nPerChunk;
+    //! the chunks with free nodes
+    Chunk* pPartial = nullptr;
+    Chunk* pSpare = nullptr;
+    size_t nChunks = 0;
+
+    void Link(Chunk* pChunk);
+    void Unlink(Chunk* pChunk);
+};
+
+#endif // BITCOIN_SUPPORT_NODEPOOL_H
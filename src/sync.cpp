@@ -9,9 +9,178 @@
 
 #include <stdio.h>
 
+#include <algorithm>
+#include <map>
+#include <mutex>
+#include <set>
+#include <tuple>
+#include <unordered_map>
+
 #include <boost/foreach.hpp>
 #include <boost/thread.hpp>
 
+std::atomic<bool> fLockStats(false);
+
+namespace {
+
+struct LockSiteKey
+{
+    const char* pszName;
+    const char* pszFile;
+    int nLine;
+
+    bool operator==(const LockSiteKey& other) const
+    {
+        return pszName == other.pszName && pszFile == other.pszFile && nLine == other.nLine;
+    }
+};
+
+struct LockSiteKeyHasher
+{
+    size_t operator()(const LockSiteKey& key) const
+    {
+        return std::hash<const void*>()(key.pszFile) ^ (std::hash<const void*>()(key.pszName) << 1) ^ ((size_t)key.nLine << 20);
+    }
+};
+
+struct LockSiteCounters
+{
+    uint64_t nAcquisitions = 0;
+    uint64_t nContentions = 0;
+    uint64_t nWaitNanos = 0;
+    uint64_t nMaxWaitNanos = 0;
+    uint64_t nHoldNanos = 0;
+    uint64_t nMaxHoldNanos = 0;
+
+    void Add(const LockSiteCounters& other)
+    {
+        nAcquisitions += other.nAcquisitions;
+        nContentions += other.nContentions;
+        nWaitNanos += other.nWaitNanos;
+        nMaxWaitNanos = std::max(nMaxWaitNanos, other.nMaxWaitNanos);
+        nHoldNanos += other.nHoldNanos;
+        nMaxHoldNanos = std::max(nMaxHoldNanos, other.nMaxHoldNanos);
+    }
+};
+
+typedef std::unordered_map<LockSiteKey, LockSiteCounters, LockSiteKeyHasher> LockSiteMap;
+
+struct LockStatsBuffer;
+
+struct LockStatsRegistry
+{
+    std::mutex mutex;
+    std::set<LockStatsBuffer*> buffers;
+    //! The statistics of the threads which exited
+    LockSiteMap retired;
+};
+
+// never destroyed, as threads may exit after the static objects are gone
+LockStatsRegistry& GetLockStatsRegistry()
+{
+    static LockStatsRegistry* registry = new LockStatsRegistry();
+    return *registry;
+}
+
+// set once the buffer of the thread is destroyed, the locks taken afterwards are not tracked
+thread_local bool fLockStatsBufferDestroyed = false;
+
+/** The statistics of one thread; its mutex is only ever contended by GetLockStats and ResetLockStats */
+struct LockStatsBuffer
+{
+    std::mutex mutex;
+    LockSiteMap sites;
+
+    LockStatsBuffer()
+    {
+        LockStatsRegistry& registry = GetLockStatsRegistry();
+        std::lock_guard<std::mutex> registryLock(registry.mutex);
+        registry.buffers.insert(this);
+    }
+
+    ~LockStatsBuffer()
+    {
+        fLockStatsBufferDestroyed = true;
+        LockStatsRegistry& registry = GetLockStatsRegistry();
+        std::lock_guard<std::mutex> registryLock(registry.mutex);
+        registry.buffers.erase(this);
+        std::lock_guard<std::mutex> bufferLock(mutex);
+        for (const auto& site : sites)
+            registry.retired[site.first].Add(site.second);
+    }
+};
+
+thread_local LockStatsBuffer lockStatsBuffer;
+
+} // anon namespace
+
+void RecordLockSite(const char* pszName, const char* pszFile, int nLine, bool fContended, int64_t nWaitNanos, int64_t nHoldNanos)
+{
+    if (fLockStatsBufferDestroyed)
+        return;
+
+    LockStatsBuffer& buffer = lockStatsBuffer;
+    std::lock_guard<std::mutex> bufferLock(buffer.mutex);
+    LockSiteCounters& counters = buffer.sites[LockSiteKey{pszName, pszFile, nLine}];
+    counters.nAcquisitions++;
+    if (fContended)
+        counters.nContentions++;
+    counters.nWaitNanos += nWaitNanos;
+    counters.nMaxWaitNanos = std::max<uint64_t>(counters.nMaxWaitNanos, nWaitNanos);
+    counters.nHoldNanos += nHoldNanos;
+    counters.nMaxHoldNanos = std::max<uint64_t>(counters.nMaxHoldNanos, nHoldNanos);
+}
+
+std::vector<CLockSiteStats> GetLockStats()
+{
+    LockSiteMap merged;
+    {
+        LockStatsRegistry& registry = GetLockStatsRegistry();
+        std::lock_guard<std::mutex> registryLock(registry.mutex);
+        merged = registry.retired;
+        for (LockStatsBuffer* buffer : registry.buffers) {
+            std::lock_guard<std::mutex> bufferLock(buffer->mutex);
+            for (const auto& site : buffer->sites)
+                merged[site.first].Add(site.second);
+        }
+    }
+
+    // a site of a header is seen with a different file name pointer by each translation unit using it
+    std::map<std::tuple<std::string, int, std::string>, LockSiteCounters> bySite;
+    for (const auto& site : merged)
+        bySite[std::make_tuple(std::string(site.first.pszFile), site.first.nLine, std::string(site.first.pszName))].Add(site.second);
+
+    std::vector<CLockSiteStats> vStats;
+    for (const auto& site : bySite) {
+        CLockSiteStats stats;
+        stats.strFile = std::get<0>(site.first);
+        stats.nLine = std::get<1>(site.first);
+        stats.strName = std::get<2>(site.first);
+        stats.nAcquisitions = site.second.nAcquisitions;
+        stats.nContentions = site.second.nContentions;
+        stats.nWaitNanos = site.second.nWaitNanos;
+        stats.nMaxWaitNanos = site.second.nMaxWaitNanos;
+        stats.nHoldNanos = site.second.nHoldNanos;
+        stats.nMaxHoldNanos = site.second.nMaxHoldNanos;
+        vStats.push_back(stats);
+    }
+    std::sort(vStats.begin(), vStats.end(), [](const CLockSiteStats& a, const CLockSiteStats& b) {
+        return a.nWaitNanos > b.nWaitNanos;
+    });
+    return vStats;
+}
+
+void ResetLockStats()
+{
+    LockStatsRegistry& registry = GetLockStatsRegistry();
+    std::lock_guard<std::mutex> registryLock(registry.mutex);
+    registry.retired.clear();
+    for (LockStatsBuffer* buffer : registry.buffers) {
+        std::lock_guard<std::mutex> bufferLock(buffer->mutex);
+        buffer->sites.clear();
+    }
+}
+
 #ifdef DEBUG_LOCKCONTENTION
 void PrintLockContention(const char* pszName, const char* pszFile, int nLine)
 {
@@ -13,6 +13,11 @@
 #include <boost/thread/mutex.hpp>
 #include <boost/thread/recursive_mutex.hpp>
 
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <vector>
+
 
 ////////////////////////////////////////////////
 //                                            //
@@ -99,6 +104,33 @@ void static inline AssertLockHeldInternal(const char* pszName, const char* pszFi
 void PrintLockContention(const char* pszName, const char* pszFile, int nLine);
 #endif
 
+/**
+ * Lock contention tracking, enabled at runtime with -lockstats. Each LOCK/TRY_LOCK site records how
+ * many times its lock was taken, how many of these had to wait for another thread, and the time
+ * spent waiting for and holding the lock. The samples go into a buffer owned by the locking thread,
+ * so that threads never contend on the statistics themselves; GetLockStats merges the buffers.
+ * When disabled, a lock only pays for the check of the flag.
+ */
+extern std::atomic<bool> fLockStats;
+
+struct CLockSiteStats
+{
+    std::string strName;
+    std::string strFile;
+    int nLine = 0;
+    uint64_t nAcquisitions = 0;
+    uint64_t nContentions = 0;
+    uint64_t nWaitNanos = 0;
+    uint64_t nMaxWaitNanos = 0;
+    uint64_t nHoldNanos = 0;
+    uint64_t nMaxHoldNanos = 0;
+};
+
+void RecordLockSite(const char* pszName, const char* pszFile, int nLine, bool fContended, int64_t nWaitNanos, int64_t nHoldNanos);
+//! The statistics of all the lock sites, of the running threads and of the ones which exited
+std::vector<CLockSiteStats> GetLockStats();
+void ResetLockStats();
+
 /** Wrapper around boost::unique_lock<Mutex> */
 template <typename Mutex>
 class SCOPED_LOCKABLE CMutexLock
@@ -106,9 +138,21 @@ class SCOPED_LOCKABLE CMutexLock
 private:
     boost::unique_lock<Mutex> lock;
 
+    //! The lock site and its timings, only set when fLockStats is enabled
+    const char* pszStatsName = nullptr;
+    const char* pszStatsFile = nullptr;
+    int nStatsLine = 0;
+    bool fStatsContended = false;
+    int64_t nStatsWaitNanos = 0;
+    std::chrono::steady_clock::time_point statsAcquiredTime;
+
     void Enter(const char* pszName, const char* pszFile, int nLine)
     {
         EnterCritical(pszName, pszFile, nLine, (void*)(lock.mutex()));
+        if (fLockStats.load(std::memory_order_relaxed)) {
+            EnterWithStats(pszName, pszFile, nLine);
+            return;
+        }
 #ifdef DEBUG_LOCKCONTENTION
         if (!lock.try_lock()) {
             PrintLockContention(pszName, pszFile, nLine);
@@ -119,12 +163,36 @@ private:
 #endif
     }
 
+    void EnterWithStats(const char* pszName, const char* pszFile, int nLine)
+    {
+        pszStatsName = pszName;
+        pszStatsFile = pszFile;
+        nStatsLine = nLine;
+        statsAcquiredTime = std::chrono::steady_clock::now();
+        if (!lock.try_lock()) {
+#ifdef DEBUG_LOCKCONTENTION
+            PrintLockContention(pszName, pszFile, nLine);
+#endif
+            fStatsContended = true;
+            lock.lock();
+            const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+            nStatsWaitNanos = std::chrono::duration_cast<std::chrono::nanoseconds>(now - statsAcquiredTime).count();
+            statsAcquiredTime = now;
+        }
+    }
+
     bool TryEnter(const char* pszName, const char* pszFile, int nLine)
     {
         EnterCritical(pszName, pszFile, nLine, (void*)(lock.mutex()), true);
         lock.try_lock();
         if (!lock.owns_lock())
             LeaveCritical();
+        else if (fLockStats.load(std::memory_order_relaxed)) {
+            pszStatsName = pszName;
+            pszStatsFile = pszFile;
+            nStatsLine = nLine;
+            statsAcquiredTime = std::chrono::steady_clock::now();
+        }
         return lock.owns_lock();
     }
 
@@ -150,8 +218,14 @@ public:
 
     ~CMutexLock() UNLOCK_FUNCTION()
     {
-        if (lock.owns_lock())
+        if (lock.owns_lock()) {
             LeaveCritical();
+            if (pszStatsName != nullptr) {
+                const int64_t nHoldNanos = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::steady_clock::now() - statsAcquiredTime).count();
+                RecordLockSite(pszStatsName, pszStatsFile, nStatsLine, fStatsContended, nStatsWaitNanos, nHoldNanos);
+            }
+        }
     }
 
     operator bool()
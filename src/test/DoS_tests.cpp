@@ -11,6 +11,7 @@
 #include "keystore.h"
 #include "main.h"
 #include "net.h"
+#include "orphanpool.h"
 #include "pow.h"
 #include "script/sign.h"
 #include "serialize.h"
@@ -25,13 +26,8 @@
 #include <boost/foreach.hpp>
 #include <boost/test/unit_test.hpp>
 
-// Tests this internal-to-main.cpp method:
-extern bool AddOrphanTx(const CTransactionBase& tx, NodeId peer);
-extern void EraseOrphansFor(NodeId peer);
-extern unsigned int LimitOrphanTxSize(unsigned int nMaxOrphans);
-
-extern std::map<uint256, COrphanTx> mapOrphanTransactions;
-extern std::map<uint256, std::set<uint256> > mapOrphanTransactionsByPrev;
+// Tests this internal-to-main.cpp object:
+extern COrphanPool orphanPool;
 
 extern std::unique_ptr<CConnman> connman;
 
@@ -112,13 +108,15 @@ BOOST_AUTO_TEST_CASE(DoS_bantime)
     SetMockTime(0);
 }
 
+std::vector<uint256> vOrphanHashes;
+
 const CTransactionBase* RandomOrphan()
 {
-    std::map<uint256, COrphanTx>::iterator it;
-    it = mapOrphanTransactions.lower_bound(GetRandHash());
-    if (it == mapOrphanTransactions.end())
-        it = mapOrphanTransactions.begin();
-    return (it->second.tx).get();
+    NodeId fromPeer;
+    std::shared_ptr<const CTransactionBase> orphan;
+    while (!orphan)
+        orphan = orphanPool.Get(vOrphanHashes[GetRand(vOrphanHashes.size())], fromPeer);
+    return orphan.get();
 }
 
 BOOST_AUTO_TEST_CASE(DoS_mapOrphans)
@@ -140,7 +138,8 @@ BOOST_AUTO_TEST_CASE(DoS_mapOrphans)
         tx.getOut(0).nValue = 1*CENT;
         tx.getOut(0).scriptPubKey = GetScriptForDestination(key.GetPubKey().GetID());
 
-        AddOrphanTx(tx, i);
+        BOOST_CHECK(orphanPool.Add(tx, i));
+        vOrphanHashes.push_back(tx.GetHash());
     }
 
     // ... and 50 that depend on other orphans:
@@ -165,7 +164,8 @@ BOOST_AUTO_TEST_CASE(DoS_mapOrphans)
             SignSignature(keystore, *dynamic_cast<const CScCertificate*>(txPrev), tx, 0);
         }
 
-        AddOrphanTx(tx, i);
+        orphanPool.Add(tx, i);
+        vOrphanHashes.push_back(tx.GetHash());
     }
 
 
@@ -198,25 +198,102 @@ BOOST_AUTO_TEST_CASE(DoS_mapOrphans)
         for (unsigned int j = 1; j < tx.vin.size(); j++)
             tx.vin[j].scriptSig = tx.vin[0].scriptSig;
 
-        BOOST_CHECK(!AddOrphanTx(tx, i));
+        BOOST_CHECK(!orphanPool.Add(tx, i));
     }
 
-    // Test EraseOrphansFor:
+    // Test EraseForPeer:
     for (NodeId i = 0; i < 3; i++)
     {
-        size_t sizeBefore = mapOrphanTransactions.size();
-        EraseOrphansFor(i);
-        BOOST_CHECK(mapOrphanTransactions.size() < sizeBefore);
+        size_t sizeBefore = orphanPool.Size();
+        size_t bytesBefore = orphanPool.TotalBytes();
+        size_t peerBytes = orphanPool.PeerBytes(i);
+        orphanPool.EraseForPeer(i);
+        BOOST_CHECK(orphanPool.Size() < sizeBefore);
+        BOOST_CHECK(orphanPool.TotalBytes() == bytesBefore - peerBytes);
+        BOOST_CHECK(orphanPool.PeerBytes(i) == 0);
     }
 
-    // Test LimitOrphanTxSize() function:
-    LimitOrphanTxSize(40);
-    BOOST_CHECK(mapOrphanTransactions.size() <= 40);
-    LimitOrphanTxSize(10);
-    BOOST_CHECK(mapOrphanTransactions.size() <= 10);
-    LimitOrphanTxSize(0);
-    BOOST_CHECK(mapOrphanTransactions.empty());
-    BOOST_CHECK(mapOrphanTransactionsByPrev.empty());
+    // Test Limit:
+    orphanPool.Limit(40);
+    BOOST_CHECK(orphanPool.Size() <= 40);
+    orphanPool.Limit(10);
+    BOOST_CHECK(orphanPool.Size() <= 10);
+    orphanPool.Limit(0);
+    BOOST_CHECK(orphanPool.Size() == 0);
+    BOOST_CHECK(orphanPool.PrevSize() == 0);
+    BOOST_CHECK(orphanPool.TotalBytes() == 0);
+    vOrphanHashes.clear();
+}
+
+CMutableTransaction OrphanSpending(const uint256& prevHash)
+{
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].prevout.n = 0;
+    tx.vin[0].prevout.hash = prevHash;
+    tx.vin[0].scriptSig << OP_1;
+    tx.resizeOut(1);
+    tx.getOut(0).nValue = 1*CENT;
+    return tx;
+}
+
+BOOST_AUTO_TEST_CASE(DoS_orphanPoolEviction)
+{
+    int64_t nStartTime = GetTime();
+    SetMockTime(nStartTime);
+
+    // peer 1 floods orphans, peer 2 sends one
+    for (int i = 0; i < 20; i++)
+        BOOST_CHECK(orphanPool.Add(OrphanSpending(GetRandHash()), 1));
+    CMutableTransaction honest = OrphanSpending(GetRandHash());
+    BOOST_CHECK(orphanPool.Add(honest, 2));
+
+    // the flooding peer evicts its own orphans
+    BOOST_CHECK(orphanPool.Limit(10) == 11);
+    BOOST_CHECK(orphanPool.Size() == 10);
+    BOOST_CHECK(orphanPool.Have(honest.GetHash()));
+
+    // orphans expire, and their indexes with them
+    SetMockTime(nStartTime + ORPHAN_TX_EXPIRE_TIME - 1);
+    BOOST_CHECK(orphanPool.Limit(10) == 0);
+    BOOST_CHECK(orphanPool.Size() == 10);
+    SetMockTime(nStartTime + ORPHAN_TX_EXPIRE_TIME);
+    orphanPool.Limit(10);
+    BOOST_CHECK(orphanPool.Size() == 0);
+    BOOST_CHECK(orphanPool.PrevSize() == 0);
+    BOOST_CHECK(orphanPool.TotalBytes() == 0);
+
+    SetMockTime(0);
+}
+
+BOOST_AUTO_TEST_CASE(DoS_orphanPoolWorkSet)
+{
+    CMutableTransaction parent = OrphanSpending(GetRandHash());
+    CMutableTransaction child1 = OrphanSpending(parent.GetHash());
+    CMutableTransaction child2 = OrphanSpending(parent.GetHash());
+    child2.vin[0].prevout.n = 1;
+    BOOST_CHECK(orphanPool.Add(child1, 1));
+    BOOST_CHECK(orphanPool.Add(child2, 2));
+    BOOST_CHECK(!orphanPool.HaveAnyWork());
+
+    // the children are queued on the work sets of the peers that sent them
+    orphanPool.AddChildrenToWorkSet(parent.GetHash());
+    BOOST_CHECK(orphanPool.HaveAnyWork());
+    uint256 hash;
+    BOOST_CHECK(orphanPool.GetNextWork(1, hash));
+    BOOST_CHECK(hash == child1.GetHash());
+    BOOST_CHECK(!orphanPool.GetNextWork(1, hash));
+
+    // erasing an orphan drops it from the work set
+    orphanPool.EraseForPeer(2);
+    BOOST_CHECK(!orphanPool.HaveAnyWork());
+    BOOST_CHECK(!orphanPool.GetNextWork(2, hash));
+
+    // a block spending the same output as an orphan conflicts with it
+    CBlock block;
+    block.vtx.push_back(OrphanSpending(parent.GetHash()));
+    BOOST_CHECK(orphanPool.EraseForBlock(block) == 1);
+    BOOST_CHECK(orphanPool.Size() == 0);
 }
 
 BOOST_AUTO_TEST_SUITE_END()
@@ -395,6 +395,47 @@ BOOST_AUTO_TEST_CASE(addrman_getaddr)
     BOOST_CHECK(addrman.size() == 2007);
 }
 
+BOOST_AUTO_TEST_CASE(addrman_serialize_and_modifications)
+{
+    CAddrManTest addrman;
+    addrman.MakeDeterministic();
+    BOOST_CHECK(addrman.GetModifications() == 0);
+
+    CNetAddr source = CNetAddr("252.2.2.2");
+    for (unsigned int i = 1; i < 256; i++) {
+        CAddress addr = CAddress(CService("250.1." + boost::to_string(i) + ".1"));
+        addr.nTime = GetTime();
+        addrman.Add(addr, source);
+        if (i % 4 == 0)
+            addrman.Good(addr);
+    }
+    uint64_t nModifications = addrman.GetModifications();
+    BOOST_CHECK(nModifications > 0);
+
+    // Selecting and sampling addresses does not change the tables
+    addrman.Select();
+    addrman.GetAddr();
+    BOOST_CHECK(addrman.GetModifications() == nModifications);
+
+    CDataStream ssPeers(SER_DISK, CLIENT_VERSION);
+    ssPeers << addrman;
+    CAddrManTest addrman2;
+    ssPeers >> addrman2;
+    BOOST_CHECK(addrman2.size() == addrman.size());
+    BOOST_CHECK(addrman2.GetModifications() == 0);
+    for (unsigned int i = 1; i < 256; i++) {
+        CService addr = CService("250.1." + boost::to_string(i) + ".1");
+        CAddrInfo* info = addrman.Find(addr);
+        CAddrInfo* info2 = addrman2.Find(addr);
+        BOOST_CHECK((info == NULL) == (info2 == NULL));
+        if (info && info2)
+            BOOST_CHECK(info->GetChance() == info2->GetChance());
+    }
+
+    addrman2.Attempt(CService("250.1.1.1"));
+    BOOST_CHECK(addrman2.GetModifications() == 1);
+}
+
 
 BOOST_AUTO_TEST_CASE(caddrinfo_get_tried_bucket)
 {
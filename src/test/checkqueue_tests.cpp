@@ -0,0 +1,127 @@
+#include "checkqueue.h"
+
+#include "test/test_bitcoin.h"
+
+#include <atomic>
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+#include <boost/thread.hpp>
+
+namespace {
+
+std::atomic<unsigned int> nChecksRun(0);
+
+// A check with its own swap, as CScriptCheck
+class CCountingCheck
+{
+    bool fOk;
+
+public:
+    explicit CCountingCheck(bool fOkIn = true) : fOk(fOkIn) {}
+
+    bool operator()()
+    {
+        nChecksRun++;
+        return fOk;
+    }
+
+    void swap(CCountingCheck& check) { std::swap(fOk, check.fOk); }
+};
+
+// A check moved around with std::swap
+struct CFlagCheck
+{
+    bool fOk = true;
+    bool operator()() const { return fOk; }
+};
+
+template <typename T>
+class CQueueWithWorkers
+{
+    boost::thread_group threadGroup;
+
+public:
+    CCheckQueue<T> queue;
+
+    CQueueWithWorkers(int nThreads, unsigned int nBatchSize, unsigned int nWorkerQueues = 64) : queue(nBatchSize, nWorkerQueues)
+    {
+        for (int i = 0; i < nThreads; i++)
+            threadGroup.create_thread([this] { queue.Thread(); });
+    }
+
+    ~CQueueWithWorkers()
+    {
+        threadGroup.interrupt_all();
+        threadGroup.join_all();
+    }
+};
+
+// Add the checks as ConnectBlock does, a few per transaction, and wait for them
+bool RunChecks(CCheckQueue<CCountingCheck>& queue, unsigned int nChecks, unsigned int nFailing = UINT_MAX)
+{
+    CCheckQueueControl<CCountingCheck> control(&queue);
+    for (unsigned int i = 0; i < nChecks;) {
+        std::vector<CCountingCheck> vChecks;
+        for (unsigned int n = 1 + i % 7; n > 0 && i < nChecks; n--, i++)
+            vChecks.push_back(CCountingCheck(i != nFailing));
+        control.Add(vChecks);
+    }
+    return control.Wait();
+}
+
+} // anon namespace
+
+BOOST_FIXTURE_TEST_SUITE(checkqueue_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(all_checks_run)
+{
+    for (int nThreads : {0, 1, 7}) {
+        CQueueWithWorkers<CCountingCheck> workers(nThreads, 128);
+        for (unsigned int nChecks : {0, 1, 3, 100, 1000, 10000}) {
+            nChecksRun = 0;
+            BOOST_CHECK(RunChecks(workers.queue, nChecks));
+            BOOST_CHECK_EQUAL(nChecksRun, nChecks);
+            BOOST_CHECK(workers.queue.IsIdle());
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(failure_is_reported_and_reset)
+{
+    CQueueWithWorkers<CCountingCheck> workers(4, 16);
+    for (unsigned int nFailing : {0, 499, 999}) {
+        BOOST_CHECK(!RunChecks(workers.queue, 1000, nFailing));
+        BOOST_CHECK(workers.queue.IsIdle());
+        BOOST_CHECK(RunChecks(workers.queue, 1000));
+    }
+}
+
+BOOST_AUTO_TEST_CASE(more_workers_than_queues)
+{
+    CQueueWithWorkers<CCountingCheck> workers(6, 4, 2);
+    nChecksRun = 0;
+    BOOST_CHECK(RunChecks(workers.queue, 5000));
+    BOOST_CHECK_EQUAL(nChecksRun, 5000U);
+    BOOST_CHECK(!RunChecks(workers.queue, 5000, 1234));
+}
+
+BOOST_AUTO_TEST_CASE(checks_without_swap)
+{
+    CQueueWithWorkers<CFlagCheck> workers(3, 32);
+    {
+        CCheckQueueControl<CFlagCheck> control(&workers.queue);
+        std::vector<CFlagCheck> vChecks(1000);
+        control.Add(vChecks);
+        BOOST_CHECK(control.Wait());
+    }
+    {
+        CCheckQueueControl<CFlagCheck> control(&workers.queue);
+        std::vector<CFlagCheck> vChecks(1000);
+        vChecks[500].fOk = false;
+        control.Add(vChecks);
+        BOOST_CHECK(!control.Wait());
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -10,6 +10,7 @@
 #include "test/test_bitcoin.h"
 #include "consensus/validation.h"
 #include "main.h"
+#include "txdb.h"
 #include "undo.h"
 #include "pubkey.h"
 
@@ -151,6 +152,12 @@ public:
         for (CCoinsMap::iterator it = cacheCoins.begin(); it != cacheCoins.end(); it++) {
             ret += it->second.coins.DynamicMemoryUsage();
         }
+        for (CSidechainsMap::iterator it = cacheSidechains.begin(); it != cacheSidechains.end(); it++) {
+            ret += it->second.sidechain.DynamicMemoryUsage();
+        }
+        for (CSidechainEventsMap::iterator it = cacheSidechainEvents.begin(); it != cacheSidechainEvents.end(); it++) {
+            ret += it->second.scEvents.DynamicMemoryUsage();
+        }
         BOOST_CHECK_EQUAL(DynamicMemoryUsage(), ret);
     }
 
@@ -732,6 +739,132 @@ BOOST_AUTO_TEST_CASE(coins_cache_simulation_test)
     BOOST_CHECK(missed_an_entry);
 }
 
+BOOST_AUTO_TEST_CASE(coins_cache_prefetch_test)
+{
+    CCoinsViewTest base;
+    std::vector<uint256> txids;
+    {
+        CCoinsViewCacheTest cache(&base);
+        for (unsigned int i = 0; i < 32; i++) {
+            txids.push_back(GetRandHash());
+            CCoinsModifier entry = cache.ModifyCoins(txids.back());
+            entry->nVersion = 1;
+            entry->vout.resize(1);
+            entry->vout[0].nValue = insecure_rand();
+        }
+        cache.Flush();
+    }
+
+    CCoinsViewCacheTest cache(&base);
+
+    // Duplicates, unknown txids and unknown sidechains are ignored
+    std::vector<uint256> toFetch(txids);
+    toFetch.push_back(txids[0]);
+    toFetch.push_back(GetRandHash());
+    std::vector<uint256> scIds(1, GetRandHash());
+
+    BOOST_CHECK_EQUAL(cache.Prefetch(toFetch, scIds, 4), txids.size());
+    BOOST_CHECK_EQUAL(cache.GetCacheSize(), txids.size());
+    cache.SelfTest();
+
+    for (const uint256& txid : txids) {
+        CCoins coins;
+        BOOST_CHECK(base.GetCoins(txid, coins));
+        BOOST_CHECK(*cache.AccessCoins(txid) == coins);
+    }
+
+    // Entries already in the cache are not fetched again
+    BOOST_CHECK_EQUAL(cache.Prefetch(toFetch, scIds, 4), 0U);
+    BOOST_CHECK_EQUAL(cache.GetCacheSize(), txids.size());
+}
+
+BOOST_AUTO_TEST_CASE(coins_cache_flush_into_parent_test)
+{
+    CCoinsViewTest base;
+    CCoinsViewCacheTest parent(&base);
+    std::vector<uint256> txids;
+    auto addCoins = [&txids](CCoinsViewCache& cache, unsigned int n) {
+        for (unsigned int i = 0; i < n; i++) {
+            txids.push_back(GetRandHash());
+            CCoinsModifier entry = cache.ModifyCoins(txids.back());
+            entry->nVersion = 1;
+            entry->vout.resize(1);
+            entry->vout[0].nValue = i + 1;
+        }
+    };
+
+    // Swapped into the empty parent, without the entries created and spent in the child
+    {
+        CCoinsViewCacheTest child(&parent);
+        addCoins(child, 16);
+        child.ModifyCoins(txids[3])->Clear();
+        BOOST_CHECK(child.Flush());
+        child.SelfTest();
+    }
+    parent.SelfTest();
+    BOOST_CHECK_EQUAL(parent.GetCacheSize(), 15U);
+    BOOST_CHECK(!parent.HaveCoins(txids[3]));
+
+    // Spliced into the parent next to the modified entries
+    {
+        CCoinsViewCacheTest child(&parent);
+        addCoins(child, 16);
+        child.ModifyCoins(txids[0])->vout[0].nValue = 100;
+        child.ModifyCoins(txids[1])->Clear();
+        BOOST_CHECK(child.Flush());
+    }
+    parent.SelfTest();
+    BOOST_CHECK_EQUAL(parent.GetCacheSize(), 30U);
+    BOOST_CHECK_EQUAL(parent.AccessCoins(txids[0])->vout[0].nValue, 100);
+    BOOST_CHECK(!parent.HaveCoins(txids[1]));
+    for (unsigned int i = 16; i < txids.size(); i++)
+        BOOST_CHECK_EQUAL(parent.AccessCoins(txids[i])->vout[0].nValue, (CAmount)(i - 16 + 1));
+
+    BOOST_CHECK(parent.Flush());
+    for (unsigned int i = 0; i < txids.size(); i++)
+        BOOST_CHECK_EQUAL(base.HaveCoins(txids[i]), i != 1 && i != 3);
+}
+
+BOOST_FIXTURE_TEST_CASE(coins_background_flush_test, TestingSetup)
+{
+    CCoinsViewDB db(1 << 20, DEFAULT_DB_MAX_OPEN_FILES, true);
+    CCoinsViewBackgroundFlush flusher(&db);
+    uint256 hashBlock = GetRandHash();
+
+    std::vector<uint256> txids;
+    {
+        CCoinsViewCacheTest cache(&flusher);
+        for (unsigned int i = 0; i < 100; i++) {
+            txids.push_back(GetRandHash());
+            CCoinsModifier entry = cache.ModifyCoins(txids.back());
+            entry->nVersion = 1;
+            entry->vout.resize(1);
+            entry->vout[0].nValue = insecure_rand();
+        }
+        cache.SetBestBlock(hashBlock);
+        BOOST_CHECK(cache.Flush());
+    }
+
+    // Whether or not the write is still in flight, the flushed entries are visible through the flusher
+    {
+        CCoinsViewCacheTest cache(&flusher);
+        BOOST_CHECK(cache.GetBestBlock() == hashBlock);
+        for (const uint256& txid : txids)
+            BOOST_CHECK(cache.HaveCoins(txid));
+
+        // Spend one of them, a further flush waits for the previous one
+        cache.ModifyCoins(txids[0])->Clear();
+        BOOST_CHECK(cache.Flush());
+    }
+
+    BOOST_CHECK(flusher.Sync());
+    BOOST_CHECK(!flusher.IsWriting());
+    BOOST_CHECK(db.GetBestBlock() == hashBlock);
+    BOOST_CHECK(!db.HaveCoins(txids[0]));
+    for (unsigned int i = 1; i < txids.size(); i++)
+        BOOST_CHECK(db.HaveCoins(txids[i]));
+}
+
 BOOST_AUTO_TEST_CASE(coins_coinbase_spends)
 {
     CCoinsViewTest base;
@@ -773,6 +906,29 @@ BOOST_AUTO_TEST_CASE(coins_coinbase_spends)
     }
 }
 
+BOOST_AUTO_TEST_CASE(ccoins_spend_releases_memory)
+{
+    CMutableTransaction mtx;
+    mtx.vin.resize(1);
+    for (int i = 0; i < 100; i++)
+        mtx.addOut(CTxOut(500, CScript() << OP_DUP << OP_HASH160 << std::vector<unsigned char>(20, i) << OP_EQUALVERIFY << OP_CHECKSIG));
+    CCoins coins(CTransaction(mtx), 100);
+
+    // the scripts of the outputs spent in the middle are released
+    size_t nUsage = coins.DynamicMemoryUsage();
+    for (int i = 0; i < 50; i++)
+        BOOST_CHECK(coins.Spend(i));
+    BOOST_CHECK(coins.vout[0].scriptPubKey.capacity() == 0);
+    BOOST_CHECK(coins.DynamicMemoryUsage() < nUsage);
+
+    // and the outputs spent at the end are not kept allocated
+    for (int i = 99; i > 60; i--)
+        BOOST_CHECK(coins.Spend(i));
+    BOOST_CHECK_EQUAL(coins.vout.size(), 61);
+    BOOST_CHECK(coins.vout.capacity() <= 2 * coins.vout.size());
+    BOOST_CHECK(coins.IsAvailable(60));
+}
+
 BOOST_AUTO_TEST_CASE(ccoins_serialization_from_tx)
 {
     // Good example
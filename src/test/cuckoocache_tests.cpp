@@ -0,0 +1,104 @@
+#include "cuckoocache.h"
+
+#include "random.h"
+#include "test/test_bitcoin.h"
+#include "uint256.h"
+
+#include <cstring>
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+namespace {
+
+class CSliceHasher
+{
+public:
+    template <uint8_t n>
+    uint32_t operator()(const uint256& key) const
+    {
+        uint32_t u;
+        std::memcpy(&u, key.begin() + 4 * n, 4);
+        return u;
+    }
+};
+
+typedef CCuckooCache<uint256, CSliceHasher> CTestCache;
+
+std::vector<uint256> RandomHashes(size_t n)
+{
+    std::vector<uint256> hashes(n);
+    for (uint256& hash : hashes)
+        hash = GetRandHash();
+    return hashes;
+}
+
+double HitRate(const CTestCache& cache, const std::vector<uint256>& hashes, size_t begin, size_t end)
+{
+    size_t nHits = 0;
+    for (size_t i = begin; i < end; ++i)
+        nHits += cache.Contains(hashes[i], false);
+    return (double)nHits / (end - begin);
+}
+
+}
+
+BOOST_FIXTURE_TEST_SUITE(cuckoocache_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(cuckoocache_empty)
+{
+    CTestCache cache;
+    BOOST_CHECK(!cache.IsSetup());
+    BOOST_CHECK_EQUAL(cache.SetupBytes(1 << 10), (1 << 10) / sizeof(uint256));
+    BOOST_CHECK(cache.IsSetup());
+    BOOST_CHECK(!cache.Contains(GetRandHash(), false));
+}
+
+BOOST_AUTO_TEST_CASE(cuckoocache_hit_rate)
+{
+    // Half of the slots filled: all the elements are found, as none had to be dropped
+    CTestCache cache;
+    const uint32_t nSize = cache.Setup(1 << 14);
+    const std::vector<uint256> hashes = RandomHashes(nSize / 2);
+    for (const uint256& hash : hashes)
+        cache.Insert(hash);
+    BOOST_CHECK_EQUAL(HitRate(cache, hashes, 0, hashes.size()), 1.0);
+    BOOST_CHECK(!cache.Contains(GetRandHash(), false));
+}
+
+BOOST_AUTO_TEST_CASE(cuckoocache_generations)
+{
+    // With four times the capacity inserted, the most recent elements survive rather than the oldest ones
+    CTestCache cache;
+    const uint32_t nSize = cache.Setup(1 << 14);
+    const std::vector<uint256> hashes = RandomHashes(4 * nSize);
+    for (const uint256& hash : hashes)
+        cache.Insert(hash);
+
+    const size_t nRecent = 4 * nSize / 10;
+    BOOST_CHECK_GT(HitRate(cache, hashes, hashes.size() - nRecent, hashes.size()), 0.95);
+    BOOST_CHECK_LT(HitRate(cache, hashes, 0, nRecent), 0.05);
+}
+
+BOOST_AUTO_TEST_CASE(cuckoocache_erase)
+{
+    // The slots of erased elements are reused first, so a full cache keeps its other elements
+    CTestCache cache;
+    const uint32_t nSize = cache.Setup(1 << 14);
+    const std::vector<uint256> kept = RandomHashes(nSize / 4);
+    const std::vector<uint256> erased = RandomHashes(nSize / 4);
+    for (size_t i = 0; i < kept.size(); ++i) {
+        cache.Insert(kept[i]);
+        cache.Insert(erased[i]);
+    }
+    for (const uint256& hash : erased)
+        BOOST_CHECK(cache.Contains(hash, true));
+
+    const std::vector<uint256> added = RandomHashes(nSize / 4);
+    for (const uint256& hash : added)
+        cache.Insert(hash);
+    BOOST_CHECK_GT(HitRate(cache, kept, 0, kept.size()), 0.99);
+    BOOST_CHECK_GT(HitRate(cache, added, 0, added.size()), 0.99);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
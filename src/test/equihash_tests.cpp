@@ -82,6 +82,14 @@ void TestEquihashSolvers(unsigned int n, unsigned int k, const std::string &I, c
     BOOST_TEST_MESSAGE(strm.str());
     BOOST_CHECK(retOpt == solns);
     BOOST_CHECK(retOpt == ret);
+
+    // A workspace reused across the solves, and the parameters of them, does not change the result
+    static EhSolverWorkspace workspace;
+    for (int i = 0; i < 2; i++) {
+        retOpt.clear();
+        EhOptimisedSolveUncancellable(n, k, state, validBlockOpt, &workspace);
+        BOOST_CHECK(retOpt == solns);
+    }
 }
 #endif
 
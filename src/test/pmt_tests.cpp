@@ -108,6 +108,62 @@ BOOST_AUTO_TEST_CASE(pmt_test1)
     }
 }
 
+BOOST_AUTO_TEST_CASE(pmt_from_full_tree)
+{
+    seed_insecure_rand(false);
+    static const unsigned int nTxCounts[] = {1, 2, 7, 17, 100, 513, 4095};
+
+    for (unsigned int nTx : nTxCounts) {
+        std::vector<uint256> vTxid(nTx);
+        for (unsigned int j = 0; j < nTx; j++)
+            vTxid[j] = ArithToUint256(j + 1);
+        CBlockMerkleTree tree(vTxid);
+        BOOST_CHECK_EQUAL(tree.Size(), nTx);
+
+        for (int att = 1; att < 15; att++) {
+            std::vector<bool> vMatch(nTx, false);
+            std::vector<unsigned int> vPos;
+            for (unsigned int j = 0; j < nTx; j++) {
+                vMatch[j] = (insecure_rand() & ((1 << (att/2)) - 1)) == 0;
+                if (vMatch[j])
+                    vPos.push_back(j);
+            }
+
+            // the same proof as the one hashing the whole tree
+            CDataStream ss1(SER_NETWORK, PROTOCOL_VERSION), ss2(SER_NETWORK, PROTOCOL_VERSION);
+            ss1 << CPartialMerkleTree(vTxid, vMatch);
+            ss2 << CPartialMerkleTree(tree, vPos);
+            BOOST_CHECK(ss1.str() == ss2.str());
+
+            CPartialMerkleTree pmt;
+            ss2 >> pmt;
+            std::vector<uint256> vMatchTxid;
+            BOOST_CHECK(pmt.ExtractMatches(vMatchTxid) == tree.GetRoot());
+            BOOST_CHECK_EQUAL(vMatchTxid.size(), vPos.size());
+        }
+
+        unsigned int nPos;
+        BOOST_CHECK(tree.Find(vTxid[nTx / 2], nPos) && nPos == nTx / 2);
+        BOOST_CHECK(!tree.Find(ArithToUint256(nTx + 1), nPos));
+    }
+}
+
+BOOST_AUTO_TEST_CASE(merkle_tree_cache)
+{
+    CMerkleTreeCache cache(2);
+    std::vector<uint256> vHashes(1, ArithToUint256(1));
+    auto tree = std::make_shared<const CBlockMerkleTree>(vHashes);
+    cache.Insert(ArithToUint256(1), tree);
+    cache.Insert(ArithToUint256(2), tree);
+    // the first one is used again, the second one is dropped for the third
+    BOOST_CHECK(cache.Get(ArithToUint256(1)) == tree);
+    cache.Insert(ArithToUint256(3), tree);
+    BOOST_CHECK_EQUAL(cache.Size(), 2U);
+    BOOST_CHECK(cache.Get(ArithToUint256(2)) == nullptr);
+    BOOST_CHECK(cache.Get(ArithToUint256(1)) == tree);
+    BOOST_CHECK(cache.Get(ArithToUint256(3)) == tree);
+}
+
 BOOST_AUTO_TEST_CASE(pmt_malleability)
 {
     std::vector<uint256> vTxid = boost::assign::list_of
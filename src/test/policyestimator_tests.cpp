@@ -206,4 +206,31 @@ BOOST_AUTO_TEST_CASE(TxConfirmStats_FindBucketIndex)
     BOOST_CHECK_EQUAL(txcs.FindBucketIndex(nan("")), 0);
 }
 
+BOOST_AUTO_TEST_CASE(TxConfirmStats_LazyDecay)
+{
+    std::vector<double> buckets {1000.0, 2000.0, 4000.0};
+    TxConfirmStats txcs;
+    txcs.Initialize(buckets, MAX_BLOCK_CONFIRMS, DEFAULT_DECAY, "Test");
+
+    // 2 txs confirmed in the next block in each of 500 blocks: about 1.26 per block when decayed
+    for (unsigned int nHeight = 1; nHeight <= 500; nHeight++) {
+        txcs.Record(nHeight, 1, 1500.0);
+        txcs.Record(nHeight, 1, 1500.0);
+    }
+    BOOST_CHECK_CLOSE(txcs.EstimateMedianVal(1, SUFFICIENT_FEETXS, MIN_SUCCESS_PCT, true, 500), 1500.0, 0.01);
+
+    // The blocks without transactions decay the averages at query time only
+    BOOST_CHECK_CLOSE(txcs.EstimateMedianVal(1, SUFFICIENT_FEETXS, MIN_SUCCESS_PCT, true, 520), 1500.0, 0.01);
+    BOOST_CHECK_EQUAL(txcs.EstimateMedianVal(1, SUFFICIENT_FEETXS, MIN_SUCCESS_PCT, true, 1000), -1);
+
+    // Outstanding transactions lower the success rate once old enough
+    for (int i = 0; i < 2000; i++)
+        txcs.NewTx(500, 1500.0);
+    BOOST_CHECK_CLOSE(txcs.EstimateMedianVal(1, SUFFICIENT_FEETXS, MIN_SUCCESS_PCT, true, 500), 1500.0, 0.01);
+    BOOST_CHECK_EQUAL(txcs.EstimateMedianVal(1, SUFFICIENT_FEETXS, MIN_SUCCESS_PCT, true, 501), -1);
+    // and still count once their row is reused by a later height
+    txcs.NewTx(500 + MAX_BLOCK_CONFIRMS, 3000.0);
+    BOOST_CHECK_EQUAL(txcs.EstimateMedianVal(1, SUFFICIENT_FEETXS, MIN_SUCCESS_PCT, true, 500 + MAX_BLOCK_CONFIRMS), -1);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
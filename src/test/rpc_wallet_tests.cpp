@@ -826,6 +826,84 @@ BOOST_AUTO_TEST_CASE(rpc_wallet_async_operations_parallel_cancel)
     BOOST_CHECK(ids.size()==0);
 }
 
+// The OrderOperation will append its tag here when it runs
+std::mutex gOrderMutex;
+std::vector<int> gOrder;
+
+class OrderOperation : public AsyncRPCOperation {
+public:
+    int tag;
+    OrderOperation(int t, OperationPriority priority) : tag(t) {
+        set_priority(priority);
+    }
+    virtual ~OrderOperation() {}
+    virtual void main() {
+        set_state(OperationStatus::EXECUTING);
+        start_execution_clock();
+        {
+            std::lock_guard<std::mutex> guard(gOrderMutex);
+            gOrder.push_back(tag);
+        }
+        stop_execution_clock();
+        set_result(UniValue(UniValue::VSTR, "done"));
+        set_state(OperationStatus::SUCCESS);
+    }
+};
+
+// This tests the higher priority classes running first, in the order they were added
+BOOST_AUTO_TEST_CASE(rpc_wallet_async_operations_priority)
+{
+    gOrder.clear();
+
+    std::shared_ptr<AsyncRPCQueue> q = std::make_shared<AsyncRPCQueue>();
+    std::vector<std::pair<int, OperationPriority>> ops = {
+        {4, OperationPriority::LOW}, {2, OperationPriority::NORMAL}, {0, OperationPriority::HIGH},
+        {5, OperationPriority::LOW}, {3, OperationPriority::NORMAL}, {1, OperationPriority::HIGH}};
+    std::shared_ptr<AsyncRPCOperation> first, cancelled;
+    for (auto& entry : ops) {
+        std::shared_ptr<AsyncRPCOperation> op(new OrderOperation(entry.first, entry.second));
+        q->addOperation(op);
+        if (!first) {
+            first = op;
+        }
+        if (entry.first == 3) {
+            cancelled = op;
+        }
+    }
+    BOOST_CHECK(q->getOperationCount() == ops.size());
+    cancelled->cancel();
+
+    q->addWorker();
+    q->finishAndWait();
+    BOOST_CHECK(gOrder == std::vector<int>({0, 1, 2, 4, 5}));
+    BOOST_CHECK_EQUAL(cancelled->isCancelled(), true);
+
+    UniValue status = first->getStatus();
+    BOOST_CHECK_EQUAL(find_value(status, "priority").get_str(), "low");
+    BOOST_CHECK(!find_value(status, "queued_secs").isNull());
+    BOOST_CHECK(!find_value(status, "execution_secs").isNull());
+}
+
+// This tests the queue spawning workers while operations are waiting, up to its maximum
+BOOST_AUTO_TEST_CASE(rpc_wallet_async_operations_scaling)
+{
+    gCounter = 0;
+
+    std::shared_ptr<AsyncRPCQueue> q = std::make_shared<AsyncRPCQueue>();
+    q->setMaxWorkers(3);
+    q->addWorker();
+    BOOST_CHECK(q->getNumberOfWorkers() == 1);
+
+    int numOperations = 6;      // 6 * 1000ms / 3 = 2 secs to finish
+    for (int i=0; i<numOperations; i++) {
+        std::shared_ptr<AsyncRPCOperation> op(new CountOperation());
+        q->addOperation(op);
+    }
+    BOOST_CHECK(q->getNumberOfWorkers() == 3);
+    q->finishAndWait();
+    BOOST_CHECK_EQUAL(numOperations, gCounter.load());
+}
+
 // This tests z_getoperationstatus, z_getoperationresult, z_listoperationids
 BOOST_AUTO_TEST_CASE(rpc_z_getoperations)
 {
@@ -845,6 +923,10 @@ BOOST_AUTO_TEST_CASE(rpc_z_getoperations)
     BOOST_CHECK_THROW(CallRPC("z_getoperationresult [] toomanyargs"), runtime_error);
     BOOST_CHECK_THROW(CallRPC("z_getoperationresult not_an_array"), runtime_error);
 
+    BOOST_CHECK_THROW(CallRPC("z_canceloperation"), runtime_error);
+    BOOST_CHECK_THROW(CallRPC("z_canceloperation not_an_array"), runtime_error);
+    BOOST_CHECK_THROW(CallRPC("z_canceloperation [\"opid-1234\"]"), runtime_error);
+
     std::shared_ptr<AsyncRPCOperation> op1 = std::make_shared<AsyncRPCOperation>();
     q->addOperation(op1);
     std::shared_ptr<AsyncRPCOperation> op2 = std::make_shared<AsyncRPCOperation>();
@@ -7,6 +7,8 @@
 
 #include "test/test_bitcoin.h"
 
+#include <atomic>
+
 #include <boost/bind.hpp>
 #include <boost/random/mersenne_twister.hpp>
 #include <boost/random/uniform_int_distribution.hpp>
@@ -109,4 +111,39 @@ BOOST_AUTO_TEST_CASE(manythreads)
     BOOST_CHECK_EQUAL(counterSum, 200);
 }
 
+BOOST_AUTO_TEST_CASE(task_classes)
+{
+    // A slow IO task does not hold back the latency sensitive ones
+    CScheduler scheduler;
+    std::atomic<bool> fSlowTaskDone(false), fFastTaskDone(false), fFastTaskFirst(false);
+    boost::chrono::system_clock::time_point now = boost::chrono::system_clock::now();
+
+    scheduler.schedule([&] { MicroSleep(200000); fSlowTaskDone = true; }, now,
+                       CScheduler::TaskClass::IO_BOUND, "slow");
+    scheduler.schedule([&] { fFastTaskFirst = !fSlowTaskDone; fFastTaskDone = true; }, now + boost::chrono::microseconds(1000),
+                       CScheduler::TaskClass::LATENCY_SENSITIVE, "fast");
+
+    boost::chrono::system_clock::time_point first, last;
+    BOOST_CHECK_EQUAL(scheduler.getQueueInfo(first, last), 2U);
+    BOOST_CHECK(first < last);
+
+    boost::thread_group threads;
+    threads.create_thread(boost::bind(&CScheduler::serviceQueue, &scheduler, CScheduler::TaskClass::IO_BOUND));
+    threads.create_thread(boost::bind(&CScheduler::serviceQueue, &scheduler, CScheduler::TaskClass::LATENCY_SENSITIVE));
+
+    scheduler.stop(true);
+    threads.join_all();
+
+    BOOST_CHECK(fSlowTaskDone);
+    BOOST_CHECK(fFastTaskDone);
+    BOOST_CHECK(fFastTaskFirst);
+
+    std::map<std::string, CScheduler::TaskStats> stats = scheduler.getTaskStats();
+    BOOST_CHECK_EQUAL(stats.size(), 2U);
+    BOOST_CHECK_EQUAL(stats["slow"].nRuns, 1U);
+    BOOST_CHECK(stats["slow"].nTotalMicros >= 200000);
+    BOOST_CHECK_EQUAL(stats["slow"].nMaxMicros, stats["slow"].nTotalMicros);
+    BOOST_CHECK_EQUAL(stats["fast"].nRuns, 1U);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
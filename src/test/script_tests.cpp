@@ -845,6 +845,144 @@ BOOST_AUTO_TEST_CASE(script_CHECKMULTISIG23)
     BOOST_CHECK_MESSAGE(err == SCRIPT_ERR_INVALID_STACK_OPERATION, ScriptErrorString(err));
 }    
 
+//! The block at nReferencedHeight is the one with the hash given, as CheckBlockHash would have it from the chain
+class ReplayProtectionSignatureChecker : public MutableTransactionSignatureChecker
+{
+public:
+    ReplayProtectionSignatureChecker(const CMutableTransaction* txToIn, int nReferencedHeightIn, const std::vector<unsigned char>& vchReferencedHashIn)
+        : MutableTransactionSignatureChecker(txToIn, 0), nReferencedHeight(nReferencedHeightIn), vchReferencedHash(vchReferencedHashIn) {}
+
+    bool CheckBlockHash(const int32_t nHeight, const std::vector<unsigned char>& nBlockHash) const override
+    {
+        return nHeight == nReferencedHeight && nBlockHash == vchReferencedHash;
+    }
+
+private:
+    const int nReferencedHeight;
+    const std::vector<unsigned char> vchReferencedHash;
+};
+
+//! A push of vch with OP_PUSHDATA1, which is not minimal for less than 76 bytes
+static CScript& PushData1(CScript& script, const std::vector<unsigned char>& vch)
+{
+    script.push_back(OP_PUSHDATA1);
+    script.push_back((unsigned char)vch.size());
+    script.insert(script.end(), vch.begin(), vch.end());
+    return script;
+}
+
+//! VerifyScript as the interpreter alone runs it, for the scripts which are not P2SH
+static bool VerifyScriptByInterpreter(const CScript& scriptSig, const CScript& scriptPubKey, unsigned int nFlags,
+                                      const BaseSignatureChecker& checker, ScriptError* serror)
+{
+    if ((nFlags & SCRIPT_VERIFY_SIGPUSHONLY) && !scriptSig.IsPushOnly())
+    {
+        *serror = SCRIPT_ERR_SIG_PUSHONLY;
+        return false;
+    }
+    std::vector<std::vector<unsigned char> > stack;
+    if (!EvalScript(stack, scriptSig, nFlags, checker, serror) || !EvalScript(stack, scriptPubKey, nFlags, checker, serror))
+        return false;
+    if (stack.empty() || !CastToBool(stack.back()))
+    {
+        *serror = SCRIPT_ERR_EVAL_FALSE;
+        return false;
+    }
+    if ((nFlags & SCRIPT_VERIFY_CLEANSTACK) && stack.size() != 1)
+    {
+        *serror = SCRIPT_ERR_CLEANSTACK;
+        return false;
+    }
+    *serror = SCRIPT_ERR_OK;
+    return true;
+}
+
+BOOST_AUTO_TEST_CASE(script_P2PKH_fast_path_matches_interpreter)
+{
+    CKey key, otherKey;
+    key.MakeNewKey(true);
+    otherKey.MakeNewKey(false);
+    const std::vector<unsigned char> vchPubKey = ToByteVector(key.GetPubKey());
+    const std::vector<unsigned char> vchReferencedHash = ToByteVector(uint256S("0123456789abcdef0123456789abcdef0123456789abcdef0123456789abcdef"));
+    const int nReferencedHeight = 300000;
+
+    CScript scriptP2PKH;
+    scriptP2PKH << OP_DUP << OP_HASH160 << ToByteVector(key.GetPubKey().GetID()) << OP_EQUALVERIFY << OP_CHECKSIG;
+
+    std::vector<CScript> vScriptPubKeys;
+    vScriptPubKeys.push_back(scriptP2PKH);
+    vScriptPubKeys.push_back(CScript(scriptP2PKH) << vchReferencedHash << nReferencedHeight << OP_CHECKBLOCKATHEIGHT);
+    // another block, a negative height, a height too long for 4 bytes and one not minimally encoded
+    vScriptPubKeys.push_back(CScript(scriptP2PKH) << ToByteVector(uint256S("aa")) << nReferencedHeight << OP_CHECKBLOCKATHEIGHT);
+    vScriptPubKeys.push_back(CScript(scriptP2PKH) << vchReferencedHash << -1 << OP_CHECKBLOCKATHEIGHT);
+    vScriptPubKeys.push_back(CScript(scriptP2PKH) << vchReferencedHash << std::vector<unsigned char>(5, 1) << OP_CHECKBLOCKATHEIGHT);
+    vScriptPubKeys.push_back(CScript(scriptP2PKH) << vchReferencedHash << std::vector<unsigned char>{0xe0, 0x93, 0x04, 0x00} << OP_CHECKBLOCKATHEIGHT);
+    // a small height, pushed with OP_PUSHDATA1 or as a one byte push instead of OP_5
+    CScript scriptPushData1Height = CScript(scriptP2PKH) << vchReferencedHash;
+    vScriptPubKeys.push_back(PushData1(scriptPushData1Height, std::vector<unsigned char>(1, 5)) << OP_CHECKBLOCKATHEIGHT);
+    vScriptPubKeys.push_back(CScript(scriptP2PKH) << vchReferencedHash << std::vector<unsigned char>(1, 5) << OP_CHECKBLOCKATHEIGHT);
+    // something after OP_CHECKBLOCKATHEIGHT, or OP_CHECKBLOCKATHEIGHT missing a parameter
+    vScriptPubKeys.push_back(CScript(scriptP2PKH) << vchReferencedHash << nReferencedHeight << OP_CHECKBLOCKATHEIGHT << OP_NOP);
+    vScriptPubKeys.push_back(CScript(scriptP2PKH) << nReferencedHeight << OP_CHECKBLOCKATHEIGHT);
+    // the hash of another key
+    vScriptPubKeys.push_back(CScript() << OP_DUP << OP_HASH160 << ToByteVector(otherKey.GetPubKey().GetID()) << OP_EQUALVERIFY << OP_CHECKSIG);
+
+    const unsigned int vFlags[] = {
+        SCRIPT_VERIFY_NONE,
+        SCRIPT_VERIFY_P2SH | SCRIPT_VERIFY_STRICTENC,
+        SCRIPT_VERIFY_P2SH | SCRIPT_VERIFY_STRICTENC | SCRIPT_VERIFY_CHECKBLOCKATHEIGHT,
+        STANDARD_NONCONTEXTUAL_SCRIPT_VERIFY_FLAGS,
+        STANDARD_NONCONTEXTUAL_SCRIPT_VERIFY_FLAGS | SCRIPT_VERIFY_CHECKBLOCKATHEIGHT,
+    };
+
+    int nValid = 0;
+    for (const CScript& scriptPubKey : vScriptPubKeys)
+    {
+        CMutableTransaction txFrom = BuildCreditingTransaction(scriptPubKey);
+        CMutableTransaction txTo = BuildSpendingTransaction(CScript(), txFrom);
+        const uint256 hash = SignatureHash(scriptPubKey, txTo, 0, SIGHASH_ALL);
+        std::vector<unsigned char> vchSig, vchOtherSig;
+        BOOST_CHECK(key.Sign(hash, vchSig));
+        BOOST_CHECK(otherKey.Sign(hash, vchOtherSig));
+        vchSig.push_back((unsigned char)SIGHASH_ALL);
+        vchOtherSig.push_back((unsigned char)SIGHASH_ALL);
+
+        std::vector<CScript> vScriptSigs;
+        vScriptSigs.push_back(CScript() << vchSig << vchPubKey);
+        vScriptSigs.push_back(CScript() << vchOtherSig << vchPubKey);
+        vScriptSigs.push_back(CScript() << vchOtherSig << ToByteVector(otherKey.GetPubKey()));
+        std::vector<unsigned char> vchBadSig(vchSig);
+        vchBadSig[10] ^= 1;
+        vScriptSigs.push_back(CScript() << vchBadSig << vchPubKey);
+        std::vector<unsigned char> vchUndefinedHashType(vchSig);
+        vchUndefinedHashType.back() = 0x21;
+        vScriptSigs.push_back(CScript() << vchUndefinedHashType << vchPubKey);
+        CScript scriptSigPushData1Key = CScript() << vchSig;
+        vScriptSigs.push_back(PushData1(scriptSigPushData1Key, vchPubKey));
+        CScript scriptSigPushData1Sig;
+        vScriptSigs.push_back(PushData1(scriptSigPushData1Sig, vchSig) << vchPubKey);
+        vScriptSigs.push_back(CScript() << vchSig << vchPubKey << OP_NOP);
+        vScriptSigs.push_back(CScript() << OP_1 << vchSig << vchPubKey);
+        vScriptSigs.push_back(CScript() << vchPubKey);
+        vScriptSigs.push_back(CScript());
+
+        const ReplayProtectionSignatureChecker checker(&txTo, nReferencedHeight, vchReferencedHash);
+        for (const CScript& scriptSig : vScriptSigs)
+        {
+            for (unsigned int nFlags : vFlags)
+            {
+                ScriptError err, errExpected;
+                const bool fExpected = VerifyScriptByInterpreter(scriptSig, scriptPubKey, nFlags, checker, &errExpected);
+                BOOST_CHECK_EQUAL(VerifyScript(scriptSig, scriptPubKey, nFlags, checker, &err), fExpected);
+                BOOST_CHECK_MESSAGE(err == errExpected, ScriptErrorString(err) + " instead of " + ScriptErrorString(errExpected));
+                nValid += fExpected;
+            }
+        }
+    }
+    // the signed spends of the first two scripts at least, with all the flags
+    BOOST_CHECK_GE(nValid, 2 * (int)(sizeof(vFlags) / sizeof(vFlags[0])));
+}
+
 BOOST_AUTO_TEST_CASE(script_combineSigs)
 {
     // Test the CombineSignatures function
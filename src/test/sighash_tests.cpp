@@ -524,6 +524,35 @@ BOOST_AUTO_TEST_CASE(sighash_test)
 
 }
 
+BOOST_AUTO_TEST_CASE(sighash_precomputed_test)
+{
+    seed_insecure_rand(false);
+
+    for (int i=0; i<5000; i++) {
+        const int nHashType = (insecure_rand() % 2) ? SIGHASH_ALL : insecure_rand();
+        CMutableTransaction txMut;
+        RandomTransaction(txMut, (nHashType & 0x1f) == SIGHASH_SINGLE);
+        const CTransaction txTo(txMut);
+        const CPrecomputedSigHash precomputed(txTo);
+        CScript scriptCode;
+        RandomScript(scriptCode);
+        const unsigned int nIn = insecure_rand() % (txTo.GetVin().size() + txTo.GetVcswCcIn().size());
+
+        const bool fHashAll = !(nHashType & SIGHASH_ANYONECANPAY) &&
+                              (nHashType & 0x1f) != SIGHASH_NONE && (nHashType & 0x1f) != SIGHASH_SINGLE;
+        uint256 sh;
+        if (precomputed.GetSignatureHash(scriptCode, nIn, nHashType, sh))
+        {
+            BOOST_CHECK(fHashAll && nIn < txTo.GetVin().size());
+            BOOST_CHECK(sh == SignatureHash(scriptCode, txTo, nIn, nHashType));
+        }
+        else
+        {
+            BOOST_CHECK(!fHashAll || nIn >= txTo.GetVin().size());
+        }
+    }
+}
+
 BOOST_AUTO_TEST_CASE(sighash_cert_test)
 {
     seed_insecure_rand(false);
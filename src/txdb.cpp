@@ -9,9 +9,14 @@
 #include "hash.h"
 #include "main.h"
 #include "pow.h"
+#include "random.h"
 #include "uint256.h"
 
 #include <stdint.h>
+#include <limits>
+#include <future>
+#include <memory>
+#include <set>
 
 #include <boost/thread.hpp>
 #include <sc/sidechaintypes.h>
@@ -33,6 +38,8 @@ static const char DB_ADDRESSUNSPENTINDEX = 'u';
 static const char DB_TIMESTAMPINDEX = 'T';
 static const char DB_BLOCKHASHINDEX = 'z';
 static const char DB_SPENTINDEX = 'p';
+static const char DB_ADDRESSAGGREGATE = 'g';
+static const char DB_BLOCKINPUTDELTAS = 'e';
 
 static const char DB_BLOCK_INDEX = 'b';
 static const char DB_BEST_BLOCK = 'B';
@@ -43,6 +50,12 @@ static const char DB_FAST_REINDEX_FLAG = 'S';
 static const char DB_LAST_BLOCK = 'l';
 static const char DB_CSW_NULLIFIER = 'n';
 static const char DB_MATURITY_HEIGHT = 'h';
+static const char DB_COINS_SET_STATS = 'M';
+static const char DB_INDEXES_BEST_BLOCK = 'I';
+static const char DB_SC_GENESIS_INFO = 'G';
+
+//! Number of block index entries read from the db at a time by LoadBlockIndexGuts
+static const size_t BLOCK_INDEX_LOAD_CHUNK_SIZE = 16384;
 
 
 void static BatchWriteAnchor(CLevelDBBatch &batch,
@@ -127,10 +140,190 @@ void static BatchWriteCswNullifier(CLevelDBBatch &batch, const uint256 &scId, co
     }
 }
 
-CCoinsViewDB::CCoinsViewDB(std::string dbName, size_t nCacheSize, int maxOpenFiles, bool fMemory, bool fWipe) : db(GetDataDir() / dbName, nCacheSize, maxOpenFiles, fMemory, fWipe) {
+CCoinsViewDB::CCoinsViewDB(std::string dbName, size_t nCacheSize, int maxOpenFiles, bool fMemory, bool fWipe) : db(GetDataDir() / dbName, CLevelDBOptions(nCacheSize, maxOpenFiles).ApplyArgs("coinsviewdb"), fMemory, fWipe) {
+    InitSetStats();
+    InitExistenceFilter();
+}
+
+CCoinsViewDB::CCoinsViewDB(size_t nCacheSize, int maxOpenFiles, bool fMemory, bool fWipe) : db(GetDataDir() / "chainstate", CLevelDBOptions(nCacheSize, maxOpenFiles).ApplyArgs("coinsviewdb"), fMemory, fWipe) {
+    InitSetStats();
+    InitExistenceFilter();
+}
+
+void CCoinsViewDB::InitExistenceFilter()
+{
+    nExistenceFilterK0 = GetRand(std::numeric_limits<uint64_t>::max());
+    nExistenceFilterK1 = GetRand(std::numeric_limits<uint64_t>::max());
+    fExistenceFilter = GetBoolArg("-coinsdbfilter", DEFAULT_COINSDB_FILTER);
+    if (fExistenceFilter)
+        RebuildExistenceFilter();
+}
+
+uint64_t CCoinsViewDB::ExistenceFilterHash(const char* pkey, size_t nSize) const
+{
+    return CSipHasher(nExistenceFilterK0, nExistenceFilterK1).Write((const unsigned char*)pkey, nSize).Finalize();
+}
+
+template <typename K>
+uint64_t CCoinsViewDB::ExistenceFilterHash(const K& key) const
+{
+    // the hash of the db key, so that the filter can be built from the raw keys
+    CPublicDataStream ssKey(SER_DISK, CLIENT_VERSION);
+    ssKey.reserve(ssKey.GetSerializeSize(key));
+    ssKey << key;
+    return ExistenceFilterHash(&ssKey[0], ssKey.size());
+}
+
+template <typename K>
+bool CCoinsViewDB::MayExist(const K& key) const
+{
+    if (!fExistenceFilter)
+        return true;
+    uint64_t hash = ExistenceFilterHash(key);
+    boost::shared_lock<boost::shared_mutex> lock(csExistenceFilter);
+    return !pExistenceFilter || pExistenceFilter->MayContain(hash);
 }
 
-CCoinsViewDB::CCoinsViewDB(size_t nCacheSize, int maxOpenFiles, bool fMemory, bool fWipe) : db(GetDataDir() / "chainstate", nCacheSize, maxOpenFiles, fMemory, fWipe) {
+void CCoinsViewDB::RebuildExistenceFilter()
+{
+    int64_t nStart = GetTimeMillis();
+    {
+        // lookups go to the db while the keys are scanned
+        boost::unique_lock<boost::shared_mutex> lock(csExistenceFilter);
+        pExistenceFilter.reset();
+    }
+
+    std::vector<uint64_t> vHashes;
+    std::unique_ptr<CDBIterator> pcursor(NewIterator());
+    for (char chType : {DB_COINS, DB_SIDECHAINS, DB_CSW_NULLIFIER}) {
+        const std::string strPrefix(1, chType);
+        for (pcursor->Seek(strPrefix); pcursor->Valid() && pcursor->key().starts_with(strPrefix); pcursor->Next()) {
+            CDBSlice slKey = pcursor->key();
+            vHashes.push_back(ExistenceFilterHash(slKey.data(), slKey.size()));
+        }
+    }
+    if (!pcursor->status().ok()) {
+        LogPrintf("%s: disabling the coins db filter after a db error: %s\n", __func__, pcursor->status().ToString());
+        return;
+    }
+
+    std::unique_ptr<CCuckooFilter> pfilter(new CCuckooFilter(2 * vHashes.size() + COINSDB_FILTER_MIN_HEADROOM));
+    for (uint64_t hash : vHashes) {
+        if (!pfilter->Insert(hash)) {
+            LogPrintf("%s: disabling the coins db filter, it could not hold %u entries\n", __func__, vHashes.size());
+            return;
+        }
+    }
+    LogPrint("coindb", "Built the coins db filter with %u entries (%u KiB) in %dms\n",
+             vHashes.size(), pfilter->DynamicMemoryUsage() >> 10, GetTimeMillis() - nStart);
+
+    boost::unique_lock<boost::shared_mutex> lock(csExistenceFilter);
+    pExistenceFilter = std::move(pfilter);
+}
+
+void CCoinsViewDB::PrepareExistenceFilter(const CCoinsMap &mapCoins, const CSidechainsMap& mapSidechains,
+                                          const CCswNullifiersMap& cswNullifies,
+                                          std::vector<uint64_t>& vInserted, std::vector<uint64_t>& vErased) const
+{
+    {
+        // a disabled filter needs no update, as does one which failed to build: it is rebuilt
+        // from the write path only, hence not while a batch is being prepared
+        boost::shared_lock<boost::shared_mutex> lock(csExistenceFilter);
+        if (!pExistenceFilter)
+            return;
+    }
+
+    // A key may only be inserted while missing from the db and only be erased while held by it,
+    // otherwise the fingerprint of another key could be dropped. Writes are serialized, hence the
+    // db state is the one before this batch; fresh coins are known to be missing.
+    auto collect = [&](const auto& key, bool fWrite, bool fFresh) {
+        uint64_t hash = ExistenceFilterHash(key);
+        bool fExists = false;
+        if (!fFresh) {
+            boost::shared_lock<boost::shared_mutex> lock(csExistenceFilter);
+            fExists = pExistenceFilter->MayContain(hash);
+        }
+        if (fExists)
+            fExists = db.Exists(key);
+        if (fWrite && !fExists)
+            vInserted.push_back(hash);
+        else if (!fWrite && fExists)
+            vErased.push_back(hash);
+    };
+
+    for (CCoinsMap::const_iterator it = mapCoins.begin(); it != mapCoins.end(); ++it) {
+        if (it->second.flags & CCoinsCacheEntry::DIRTY)
+            collect(make_pair(DB_COINS, it->first), !it->second.coins.IsPruned(), it->second.flags & CCoinsCacheEntry::FRESH);
+    }
+
+    for (CSidechainsMap::const_iterator it = mapSidechains.begin(); it != mapSidechains.end(); ++it) {
+        switch (it->second.flag) {
+            case CSidechainsCacheEntry::Flags::FRESH:
+            case CSidechainsCacheEntry::Flags::DIRTY:
+                collect(make_pair(DB_SIDECHAINS, it->first), true, false);
+                break;
+            case CSidechainsCacheEntry::Flags::ERASED:
+                collect(make_pair(DB_SIDECHAINS, it->first), false, false);
+                break;
+            default:
+                break;
+        }
+    }
+
+    for (CCswNullifiersMap::const_iterator it = cswNullifies.begin(); it != cswNullifies.end(); ++it) {
+        switch (it->second.flag) {
+            case CCswNullifiersCacheEntry::Flags::FRESH:
+                collect(make_pair(DB_CSW_NULLIFIER, it->first), true, false);
+                break;
+            case CCswNullifiersCacheEntry::Flags::ERASED:
+                collect(make_pair(DB_CSW_NULLIFIER, it->first), false, false);
+                break;
+            default:
+                break;
+        }
+    }
+}
+
+void CCoinsViewDB::InsertIntoExistenceFilter(const std::vector<uint64_t>& vHashes)
+{
+    boost::unique_lock<boost::shared_mutex> lock(csExistenceFilter);
+    if (!pExistenceFilter)
+        return;
+    for (uint64_t hash : vHashes)
+        pExistenceFilter->Insert(hash);
+}
+
+void CCoinsViewDB::EraseFromExistenceFilter(const std::vector<uint64_t>& vHashes)
+{
+    bool fRebuild = false;
+    {
+        boost::unique_lock<boost::shared_mutex> lock(csExistenceFilter);
+        if (!pExistenceFilter)
+            return;
+        for (uint64_t hash : vHashes)
+            pExistenceFilter->Erase(hash);
+        fRebuild = pExistenceFilter->NeedsResize();
+    }
+    // An overflowed filter lets every lookup through, and a full one is about to overflow. The
+    // capacity doubles with each rebuild, which keeps its cost low over a sync from scratch.
+    // This runs once the batch is written and before the next one, so the scan misses no key.
+    if (fRebuild)
+        RebuildExistenceFilter();
+}
+
+void CCoinsViewDB::InitSetStats()
+{
+    LOCK(csSetStats);
+    uint256 hashBest = GetBestBlock();
+    if (hashBest.IsNull()) {
+        // only an empty db has empty statistics, an interrupted snapshot import has no best block either
+        std::unique_ptr<CDBIterator> pcursor(NewIterator());
+        pcursor->SeekToFirst();
+        setStats = CCoinsSetStats();
+        fSetStatsValid = !pcursor->Valid();
+    } else {
+        fSetStatsValid = db.Read(DB_COINS_SET_STATS, setStats) && setStats.hashBlock == hashBest;
+    }
 }
 
 
@@ -154,20 +347,28 @@ bool CCoinsViewDB::GetNullifier(const uint256 &nf) const {
 }
 
 bool CCoinsViewDB::GetCoins(const uint256 &txid, CCoins &coins) const {
+    if (!MayExist(make_pair(DB_COINS, txid)))
+        return false;
     return db.Read(make_pair(DB_COINS, txid), coins);
 }
 
 bool CCoinsViewDB::HaveCoins(const uint256 &txid) const {
+    if (!MayExist(make_pair(DB_COINS, txid)))
+        return false;
     return db.Exists(make_pair(DB_COINS, txid));
 }
 
 bool CCoinsViewDB::GetSidechain(const uint256& scId, CSidechain& info) const
 {
+    if (!MayExist(std::make_pair(DB_SIDECHAINS, scId)))
+        return false;
     return db.Read(std::make_pair(DB_SIDECHAINS, scId), info);
 }
 
 bool CCoinsViewDB::HaveSidechain(const uint256& scId) const
 {
+    if (!MayExist(std::make_pair(DB_SIDECHAINS, scId)))
+        return false;
     return db.Exists(std::make_pair(DB_SIDECHAINS, scId));
 }
 
@@ -183,16 +384,16 @@ bool CCoinsViewDB::GetSidechainEvents(int height, CSidechainEvents& ceasingScs)
 
 void CCoinsViewDB::GetScIds(std::set<uint256>& scIdsList) const
 {
-    std::unique_ptr<leveldb::Iterator> it(const_cast<CLevelDBWrapper*>(&db)->NewIterator());
+    std::unique_ptr<CDBIterator> it(const_cast<CLevelDBWrapper*>(&db)->NewIterator());
     static const std::string scIdsPrefix = std::string(1,DB_SIDECHAINS);
 
     for(it->Seek(scIdsPrefix); it->Valid() && it->key().starts_with(scIdsPrefix); it->Next())
     {
         boost::this_thread::interruption_point();
 
-        leveldb::Slice slKey = it->key();
+        CDBSlice slKey = it->key();
         // serialize key, skipping prefix
-        CDataStream ssKey(slKey.data() + sizeof(char), slKey.data()+slKey.size(), SER_DISK, CLIENT_VERSION);
+        CPublicDataStream ssKey(slKey.data() + sizeof(char), slKey.data()+slKey.size(), SER_DISK, CLIENT_VERSION);
         uint256 keyScId;
         ssKey >> keyScId;
         scIdsList.insert(keyScId);
@@ -217,65 +418,88 @@ uint256 CCoinsViewDB::GetBestAnchor() const {
 
 bool CCoinsViewDB::HaveCswNullifier(const uint256& scId, const CFieldElement &nullifier) const {
     std::pair<uint256, CFieldElement> position = std::make_pair(scId, nullifier);
+    if (!MayExist(make_pair(DB_CSW_NULLIFIER, position)))
+        return false;
     return db.Exists(make_pair(DB_CSW_NULLIFIER, position));
 }
 
-bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins,
-                              const uint256 &hashBlock,
-                              const uint256 &hashAnchor,
-                              CAnchorsMap &mapAnchors,
-                              CNullifiersMap &mapNullifiers,
-                              CSidechainsMap& mapSidechains,
-                              CSidechainEventsMap& mapSidechainEvents,
-                              CCswNullifiersMap& cswNullifies) {
-    CLevelDBBatch batch;
-    size_t count = 0;
+void CCoinsViewDB::HaveCswNullifiers(const std::vector<std::pair<uint256, CFieldElement>>& keys, std::vector<bool>& vHave) const
+{
+    vHave.assign(keys.size(), false);
+
+    // the db keys of the pairs which may exist, with their position
+    std::vector<std::pair<std::string, size_t>> vDbKeys;
+    for (size_t i = 0; i < keys.size(); i++) {
+        const std::pair<char, std::pair<uint256, CFieldElement>> key = std::make_pair(DB_CSW_NULLIFIER, keys[i]);
+        if (!MayExist(key))
+            continue;
+        CPublicDataStream ssKey(SER_DISK, CLIENT_VERSION);
+        ssKey.reserve(ssKey.GetSerializeSize(key));
+        ssKey << key;
+        vDbKeys.push_back(std::make_pair(std::string(&ssKey[0], ssKey.size()), i));
+    }
+    if (vDbKeys.empty())
+        return;
+    std::sort(vDbKeys.begin(), vDbKeys.end());
+
+    // Keys in ascending order: the iterator only seeks when it is before the next key, as the keys
+    // it stepped over are known not to be in the db
+    std::unique_ptr<CDBIterator> pcursor(NewIterator());
+    bool fSeeked = false;
+    for (const std::pair<std::string, size_t>& dbKey : vDbKeys) {
+        const CDBSlice slKey(dbKey.first);
+        if (!fSeeked || (pcursor->Valid() && pcursor->key().compare(slKey) < 0)) {
+            pcursor->Seek(slKey);
+            fSeeked = true;
+        }
+        vHave[dbKey.second] = pcursor->Valid() && pcursor->key().compare(slKey) == 0;
+    }
+    if (!pcursor->status().ok()) {
+        LogPrintf("LevelDB read failure: %s\n", pcursor->status().ToString());
+        HandleError(pcursor->status());
+    }
+}
+
+void static BatchWriteCoinsSnapshot(CLevelDBBatch &batch,
+                                    const CCoinsMap &mapCoins,
+                                    const uint256 &hashBlock,
+                                    const uint256 &hashAnchor,
+                                    const CAnchorsMap &mapAnchors,
+                                    const CNullifiersMap &mapNullifiers,
+                                    const CSidechainsMap& mapSidechains,
+                                    const CSidechainEventsMap& mapSidechainEvents,
+                                    const CCswNullifiersMap& cswNullifies) {
     size_t changed = 0;
-    for (CCoinsMap::iterator it = mapCoins.begin(); it != mapCoins.end();) {
+    for (CCoinsMap::const_iterator it = mapCoins.begin(); it != mapCoins.end(); ++it) {
         if (it->second.flags & CCoinsCacheEntry::DIRTY) {
             BatchWriteCoins(batch, it->first, it->second.coins);
             changed++;
         }
-        count++;
-        CCoinsMap::iterator itOld = it++;
-        mapCoins.erase(itOld);
     }
 
-    for (CAnchorsMap::iterator it = mapAnchors.begin(); it != mapAnchors.end();) {
+    for (CAnchorsMap::const_iterator it = mapAnchors.begin(); it != mapAnchors.end(); ++it) {
         if (it->second.flags & CAnchorsCacheEntry::DIRTY) {
             BatchWriteAnchor(batch, it->first, it->second.tree, it->second.entered);
             // TODO: changed++?
         }
-        CAnchorsMap::iterator itOld = it++;
-        mapAnchors.erase(itOld);
     }
 
-    for (CNullifiersMap::iterator it = mapNullifiers.begin(); it != mapNullifiers.end();) {
+    for (CNullifiersMap::const_iterator it = mapNullifiers.begin(); it != mapNullifiers.end(); ++it) {
         if (it->second.flags & CNullifiersCacheEntry::DIRTY) {
             BatchWriteNullifier(batch, it->first, it->second.entered);
             // TODO: changed++?
         }
-        CNullifiersMap::iterator itOld = it++;
-        mapNullifiers.erase(itOld);
     }
 
-    for (CSidechainsMap::iterator it = mapSidechains.begin(); it != mapSidechains.end();) {
+    for (CSidechainsMap::const_iterator it = mapSidechains.begin(); it != mapSidechains.end(); ++it)
         BatchSidechains(batch, it->first, it->second);
-        CSidechainsMap::iterator itOld = it++;
-        mapSidechains.erase(itOld);
-    }
 
-    for (CSidechainEventsMap::iterator it = mapSidechainEvents.begin(); it != mapSidechainEvents.end();) {
+    for (CSidechainEventsMap::const_iterator it = mapSidechainEvents.begin(); it != mapSidechainEvents.end(); ++it)
         BatchCeasedScs(batch, it->first, it->second);
-        CSidechainEventsMap::iterator itOld = it++;
-        mapSidechainEvents.erase(itOld);
-    }
-    
-    for (CCswNullifiersMap::iterator it = cswNullifies.begin(); it != cswNullifies.end();) {
+
+    for (CCswNullifiersMap::const_iterator it = cswNullifies.begin(); it != cswNullifies.end(); ++it) {
         const std::pair<uint256, CFieldElement>& position = it->first;
         BatchWriteCswNullifier(batch, position.first, position.second, it->second);
-        CCswNullifiersMap::iterator itOld = it++;
-        cswNullifies.erase(itOld);
     }
 
     if (!hashBlock.IsNull())
@@ -283,11 +507,696 @@ bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins,
     if (!hashAnchor.IsNull())
         BatchWriteHashBestAnchor(batch, hashAnchor);
 
-    LogPrint("coindb", "Committing %u changed transactions (out of %u) to coin database...\n", (unsigned int)changed, (unsigned int)count);
-    return db.WriteBatch(batch);
+    LogPrint("coindb", "Committing %u changed transactions (out of %u) to coin database...\n", (unsigned int)changed, (unsigned int)mapCoins.size());
+}
+
+bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins,
+                              const uint256 &hashBlock,
+                              const uint256 &hashAnchor,
+                              CAnchorsMap &mapAnchors,
+                              CNullifiersMap &mapNullifiers,
+                              CSidechainsMap& mapSidechains,
+                              CSidechainEventsMap& mapSidechainEvents,
+                              CCswNullifiersMap& cswNullifies) {
+    CLevelDBBatch batch;
+    CCoinsSetStats statsNew;
+    bool fSetStats = PrepareSetStats(batch, mapCoins, hashBlock, statsNew);
+    std::vector<uint64_t> vFilterInserted, vFilterErased;
+    PrepareExistenceFilter(mapCoins, mapSidechains, cswNullifies, vFilterInserted, vFilterErased);
+    BatchWriteCoinsSnapshot(batch, mapCoins, hashBlock, hashAnchor, mapAnchors, mapNullifiers, mapSidechains, mapSidechainEvents, cswNullifies);
+
+    // entries are serialized into the batch, release them before writing it
+    mapCoins.clear();
+    mapAnchors.clear();
+    mapNullifiers.clear();
+    mapSidechains.clear();
+    mapSidechainEvents.clear();
+    cswNullifies.clear();
+
+    InsertIntoExistenceFilter(vFilterInserted);
+    if (!db.WriteBatch(batch))
+        return false;
+    if (fSetStats)
+        CommitSetStats(statsNew);
+    EraseFromExistenceFilter(vFilterErased);
+    return true;
+}
+
+bool CCoinsViewDB::WriteSnapshot(const CCoinsMap &mapCoins,
+                                 const uint256 &hashBlock,
+                                 const uint256 &hashAnchor,
+                                 const CAnchorsMap &mapAnchors,
+                                 const CNullifiersMap &mapNullifiers,
+                                 const CSidechainsMap& mapSidechains,
+                                 const CSidechainEventsMap& mapSidechainEvents,
+                                 const CCswNullifiersMap& cswNullifies) {
+    CLevelDBBatch batch;
+    CCoinsSetStats statsNew;
+    bool fSetStats = PrepareSetStats(batch, mapCoins, hashBlock, statsNew);
+    std::vector<uint64_t> vFilterInserted, vFilterErased;
+    PrepareExistenceFilter(mapCoins, mapSidechains, cswNullifies, vFilterInserted, vFilterErased);
+    BatchWriteCoinsSnapshot(batch, mapCoins, hashBlock, hashAnchor, mapAnchors, mapNullifiers, mapSidechains, mapSidechainEvents, cswNullifies);
+    InsertIntoExistenceFilter(vFilterInserted);
+    if (!db.WriteBatch(batch))
+        return false;
+    if (fSetStats)
+        CommitSetStats(statsNew);
+    EraseFromExistenceFilter(vFilterErased);
+    return true;
+}
+
+bool CCoinsViewDB::PrepareSetStats(CLevelDBBatch &batch, const CCoinsMap &mapCoins, const uint256 &hashBlock, CCoinsSetStats &statsNew) const
+{
+    {
+        LOCK(csSetStats);
+        if (!fSetStatsValid) {
+            // stale statistics must not be taken as valid should the best block go back to theirs
+            batch.Erase(DB_COINS_SET_STATS);
+            return false;
+        }
+        statsNew = setStats;
+    }
+
+    // Writes are serialized, hence the db holds the records being replaced. Fresh entries are not
+    // in the db, and need no lookup.
+    for (CCoinsMap::const_iterator it = mapCoins.begin(); it != mapCoins.end(); ++it) {
+        if (!(it->second.flags & CCoinsCacheEntry::DIRTY))
+            continue;
+        CCoins coinsOld;
+        if (!(it->second.flags & CCoinsCacheEntry::FRESH) && db.Read(make_pair(DB_COINS, it->first), coinsOld))
+            statsNew.Remove(it->first, coinsOld);
+        if (!it->second.coins.IsPruned())
+            statsNew.Add(it->first, it->second.coins);
+    }
+    if (!hashBlock.IsNull())
+        statsNew.hashBlock = hashBlock;
+    batch.Write(DB_COINS_SET_STATS, statsNew);
+    return true;
+}
+
+void CCoinsViewDB::CommitSetStats(const CCoinsSetStats &statsNew)
+{
+    LOCK(csSetStats);
+    if (fSetStatsValid)
+        setStats = statsNew;
+}
+
+bool CCoinsViewDB::GetSetStats(CCoinsSetStats &stats) const
+{
+    LOCK(csSetStats);
+    if (!fSetStatsValid)
+        return false;
+    stats = setStats;
+    return true;
+}
+
+bool CCoinsViewDB::ComputeSetStats(CCoinsSetStats &stats, unsigned int nThreads) const
+{
+    CLevelDBWrapper &rdb = const_cast<CLevelDBWrapper&>(db);
+    std::shared_ptr<const CDBSnapshot> snapshot(rdb.GetSnapshot(),
+        [&rdb](const CDBSnapshot* s) { rdb.ReleaseSnapshot(s); });
+
+    uint256 hashBlock;
+    {
+        std::unique_ptr<CDBIterator> pcursor(rdb.NewIterator(snapshot.get()));
+        const std::string strBestBlockKey(1, DB_BEST_BLOCK);
+        pcursor->Seek(strBestBlockKey);
+        if (pcursor->Valid() && pcursor->key() == strBestBlockKey) {
+            CDBSlice slValue = pcursor->value();
+            CPublicDataStream ssValue(slValue.data(), slValue.data()+slValue.size(), SER_DISK, CLIENT_VERSION);
+            ssValue >> hashBlock;
+        }
+    }
+
+    // The coins records are keyed by txid, whose first byte splits them into even ranges
+    nThreads = std::max(1u, std::min(nThreads, 256u));
+    std::vector<CCoinsSetStats> vParts(nThreads);
+    std::vector<std::string> vErrors(nThreads);
+    auto worker = [&](unsigned int nWorker) {
+        const std::string strBegin = {DB_COINS, (char)(256 * nWorker / nThreads)};
+        const std::string strEnd = nWorker + 1 < nThreads ? std::string{DB_COINS, (char)(256 * (nWorker + 1) / nThreads)}
+                                                          : std::string(1, DB_COINS + 1);
+        try {
+            std::unique_ptr<CDBIterator> pcursor(rdb.NewIterator(snapshot.get()));
+            for (pcursor->Seek(strBegin); pcursor->Valid() && pcursor->key().compare(strEnd) < 0; pcursor->Next()) {
+                CDBSlice slKey = pcursor->key();
+                CDBSlice slValue = pcursor->value();
+                CPublicDataStream ssKey(slKey.data(), slKey.data()+slKey.size(), SER_DISK, CLIENT_VERSION);
+                CPublicDataStream ssValue(slValue.data(), slValue.data()+slValue.size(), SER_DISK, CLIENT_VERSION);
+                char chType;
+                uint256 txid;
+                CCoins coins;
+                ssKey >> chType >> txid;
+                ssValue >> coins;
+                vParts[nWorker].Add(txid, coins);
+            }
+            if (!pcursor->status().ok())
+                vErrors[nWorker] = pcursor->status().ToString();
+        } catch (const std::exception& e) {
+            vErrors[nWorker] = e.what();
+        }
+    };
+    std::vector<std::future<void>> workers;
+    for (unsigned int n = 1; n < nThreads; ++n)
+        workers.push_back(std::async(std::launch::async, worker, n));
+    worker(0);
+    for (auto& w : workers)
+        w.get();
+
+    stats = CCoinsSetStats();
+    stats.hashBlock = hashBlock;
+    for (unsigned int n = 0; n < nThreads; ++n) {
+        if (!vErrors[n].empty())
+            return error("%s: Deserialize or I/O error - %s", __func__, vErrors[n]);
+        stats += vParts[n];
+    }
+    return true;
+}
+
+bool CCoinsViewDB::RebuildSetStats(unsigned int nThreads)
+{
+    CCoinsSetStats stats;
+    if (!ComputeSetStats(stats, nThreads))
+        return false;
+    if (stats.hashBlock != GetBestBlock())
+        return error("%s: the db was written while being scanned", __func__);
+    LOCK(csSetStats);
+    if (!db.Write(DB_COINS_SET_STATS, stats))
+        return false;
+    setStats = stats;
+    fSetStatsValid = true;
+    return true;
+}
+
+template <typename Stream>
+static void SerializeCoinsForStats(Stream &ss, const uint256 &txhash, const CCoins &coins)
+{
+    ss << txhash;
+    ss << VARINT(coins.nVersion);
+    ss << (coins.fCoinBase ? 'c' : 'n');
+    ss << VARINT(coins.nHeight);
+
+    // add cert attribute to the hash writer obj, such values are meaningful only in this case 
+    // the size of the hash writer obj buffer is different anyway (larger) from the actual serialized size
+    // because the coin serialization is compressed 
+    if (coins.IsFromCert()) {
+        ss << coins.nFirstBwtPos;
+        ss << coins.nBwtMaturityHeight;
+    }
+
+    for (unsigned int i=0; i<coins.vout.size(); i++) {
+        const CTxOut &out = coins.vout[i];
+        if (!out.IsNull()) {
+            ss << VARINT(i+1);
+            ss << out;
+        }
+    }
+    ss << VARINT(0);
+}
+
+void CCoinsSetStats::Add(const uint256 &txid, const CCoins &coins)
+{
+    CDataStream ss(SER_GETHASH, PROTOCOL_VERSION);
+    SerializeCoinsForStats(ss, txid, coins);
+    muhash.Insert((const unsigned char*)&ss[0], ss.size());
+
+    nTransactions++;
+    for (const CTxOut &out : coins.vout) {
+        if (!out.IsNull()) {
+            nTransactionOutputs++;
+            nTotalAmount += out.nValue;
+        }
+    }
+    nSerializedSize += 32 + ::GetSerializeSize(coins, SER_DISK, CLIENT_VERSION);
+}
+
+void CCoinsSetStats::Remove(const uint256 &txid, const CCoins &coins)
+{
+    CDataStream ss(SER_GETHASH, PROTOCOL_VERSION);
+    SerializeCoinsForStats(ss, txid, coins);
+    muhash.Remove((const unsigned char*)&ss[0], ss.size());
+
+    nTransactions--;
+    for (const CTxOut &out : coins.vout) {
+        if (!out.IsNull()) {
+            nTransactionOutputs--;
+            nTotalAmount -= out.nValue;
+        }
+    }
+    nSerializedSize -= 32 + ::GetSerializeSize(coins, SER_DISK, CLIENT_VERSION);
+}
+
+CCoinsSetStats& CCoinsSetStats::operator+=(const CCoinsSetStats &other)
+{
+    muhash *= other.muhash;
+    nTransactions += other.nTransactions;
+    nTransactionOutputs += other.nTransactionOutputs;
+    nSerializedSize += other.nSerializedSize;
+    nTotalAmount += other.nTotalAmount;
+    return *this;
+}
+
+CCoinsViewBackgroundFlush::CCoinsViewBackgroundFlush(CCoinsViewDB *dbIn) :
+    CCoinsViewBacked(dbIn), db(dbIn), fSnapshot(false), fWriteFailed(false) {}
+
+CCoinsViewBackgroundFlush::~CCoinsViewBackgroundFlush()
+{
+    Sync();
+}
+
+bool CCoinsViewBackgroundFlush::WriteSnapshot()
+{
+    // snapshot is not modified until this write is over, no need to hold cs while reading it
+    bool fOk = false;
+    try {
+        fOk = db->WriteSnapshot(snapshot.coins, snapshot.hashBlock, snapshot.hashAnchor, snapshot.anchors,
+                                snapshot.nullifiers, snapshot.sidechains, snapshot.sidechainEvents, snapshot.cswNullifiers);
+    } catch (const std::exception& e) {
+        LogPrintf("%s: exception while writing to coin database: %s\n", __func__, e.what());
+    }
+
+    if (!fOk)
+        return false;
+
+    // entries are now readable from the db
+    CSnapshot written;
+    {
+        LOCK(cs);
+        std::swap(written, snapshot);
+        fSnapshot = false;
+    }
+    return true;
+}
+
+bool CCoinsViewBackgroundFlush::Sync()
+{
+    if (pendingWrite.valid()) {
+        int64_t nStart = GetTimeMicros();
+        if (!pendingWrite.get())
+            fWriteFailed = true;
+        LogPrint("bench", "    - Waited for background coins db write: %.2fms\n", (GetTimeMicros() - nStart) * 0.001);
+    }
+    return !fWriteFailed;
+}
+
+bool CCoinsViewBackgroundFlush::IsWriting() const
+{
+    LOCK(cs);
+    return fSnapshot;
+}
+
+bool CCoinsViewBackgroundFlush::BatchWrite(CCoinsMap &mapCoins,
+                                           const uint256 &hashBlock,
+                                           const uint256 &hashAnchor,
+                                           CAnchorsMap &mapAnchors,
+                                           CNullifiersMap &mapNullifiers,
+                                           CSidechainsMap& mapSidechains,
+                                           CSidechainEventsMap& mapCeasedScs,
+                                           CCswNullifiersMap& cswNullifiers)
+{
+    // a failed write leaves the snapshot in place, the node is going to be shut down
+    if (!Sync())
+        return false;
+
+    {
+        LOCK(cs);
+        assert(!fSnapshot);
+        snapshot.coins.swap(mapCoins);
+        snapshot.hashBlock = hashBlock;
+        snapshot.hashAnchor = hashAnchor;
+        snapshot.anchors.swap(mapAnchors);
+        snapshot.nullifiers.swap(mapNullifiers);
+        snapshot.sidechains.swap(mapSidechains);
+        snapshot.sidechainEvents.swap(mapCeasedScs);
+        snapshot.cswNullifiers.swap(cswNullifiers);
+        fSnapshot = true;
+    }
+
+    pendingWrite = std::async(std::launch::async, &CCoinsViewBackgroundFlush::WriteSnapshot, this);
+    return true;
+}
+
+bool CCoinsViewBackgroundFlush::GetAnchorAt(const uint256 &rt, ZCIncrementalMerkleTree &tree) const
+{
+    {
+        LOCK(cs);
+        CAnchorsMap::const_iterator it = snapshot.anchors.find(rt);
+        if (it != snapshot.anchors.end() && (it->second.flags & CAnchorsCacheEntry::DIRTY)) {
+            if (!it->second.entered)
+                return false;
+            tree = it->second.tree;
+            return true;
+        }
+    }
+    return base->GetAnchorAt(rt, tree);
+}
+
+bool CCoinsViewBackgroundFlush::GetNullifier(const uint256 &nullifier) const
+{
+    {
+        LOCK(cs);
+        CNullifiersMap::const_iterator it = snapshot.nullifiers.find(nullifier);
+        if (it != snapshot.nullifiers.end() && (it->second.flags & CNullifiersCacheEntry::DIRTY))
+            return it->second.entered;
+    }
+    return base->GetNullifier(nullifier);
+}
+
+bool CCoinsViewBackgroundFlush::GetCoins(const uint256 &txid, CCoins &coins) const
+{
+    {
+        LOCK(cs);
+        CCoinsMap::const_iterator it = snapshot.coins.find(txid);
+        if (it != snapshot.coins.end() && (it->second.flags & CCoinsCacheEntry::DIRTY)) {
+            // a pruned entry is going to be erased from the db
+            if (it->second.coins.IsPruned())
+                return false;
+            coins = it->second.coins;
+            return true;
+        }
+    }
+    return base->GetCoins(txid, coins);
+}
+
+bool CCoinsViewBackgroundFlush::HaveCoins(const uint256 &txid) const
+{
+    {
+        LOCK(cs);
+        CCoinsMap::const_iterator it = snapshot.coins.find(txid);
+        if (it != snapshot.coins.end() && (it->second.flags & CCoinsCacheEntry::DIRTY))
+            return !it->second.coins.IsPruned();
+    }
+    return base->HaveCoins(txid);
+}
+
+bool CCoinsViewBackgroundFlush::HaveSidechain(const uint256& scId) const
+{
+    {
+        LOCK(cs);
+        CSidechainsMap::const_iterator it = snapshot.sidechains.find(scId);
+        if (it != snapshot.sidechains.end() && it->second.flag != CSidechainsCacheEntry::Flags::DEFAULT)
+            return it->second.flag != CSidechainsCacheEntry::Flags::ERASED;
+    }
+    return base->HaveSidechain(scId);
+}
+
+bool CCoinsViewBackgroundFlush::GetSidechain(const uint256& scId, CSidechain& info) const
+{
+    {
+        LOCK(cs);
+        CSidechainsMap::const_iterator it = snapshot.sidechains.find(scId);
+        if (it != snapshot.sidechains.end() && it->second.flag != CSidechainsCacheEntry::Flags::DEFAULT) {
+            if (it->second.flag == CSidechainsCacheEntry::Flags::ERASED)
+                return false;
+            info = it->second.sidechain;
+            return true;
+        }
+    }
+    return base->GetSidechain(scId, info);
+}
+
+bool CCoinsViewBackgroundFlush::HaveSidechainEvents(int height) const
+{
+    {
+        LOCK(cs);
+        CSidechainEventsMap::const_iterator it = snapshot.sidechainEvents.find(height);
+        if (it != snapshot.sidechainEvents.end() && it->second.flag != CSidechainEventsCacheEntry::Flags::DEFAULT)
+            return it->second.flag != CSidechainEventsCacheEntry::Flags::ERASED;
+    }
+    return base->HaveSidechainEvents(height);
+}
+
+bool CCoinsViewBackgroundFlush::GetSidechainEvents(int height, CSidechainEvents& scEvents) const
+{
+    {
+        LOCK(cs);
+        CSidechainEventsMap::const_iterator it = snapshot.sidechainEvents.find(height);
+        if (it != snapshot.sidechainEvents.end() && it->second.flag != CSidechainEventsCacheEntry::Flags::DEFAULT) {
+            if (it->second.flag == CSidechainEventsCacheEntry::Flags::ERASED)
+                return false;
+            scEvents = it->second.scEvents;
+            return true;
+        }
+    }
+    return base->GetSidechainEvents(height, scEvents);
+}
+
+void CCoinsViewBackgroundFlush::GetScIds(std::set<uint256>& scIdsList) const
+{
+    LOCK(cs);
+    base->GetScIds(scIdsList);
+
+    for (const auto& entry: snapshot.sidechains)
+    {
+        if (entry.second.flag == CSidechainsCacheEntry::Flags::ERASED)
+            scIdsList.erase(entry.first);
+        else
+            scIdsList.insert(entry.first);
+    }
+}
+
+uint256 CCoinsViewBackgroundFlush::GetBestBlock() const
+{
+    {
+        LOCK(cs);
+        if (fSnapshot && !snapshot.hashBlock.IsNull())
+            return snapshot.hashBlock;
+    }
+    return base->GetBestBlock();
+}
+
+uint256 CCoinsViewBackgroundFlush::GetBestAnchor() const
+{
+    {
+        LOCK(cs);
+        if (fSnapshot && !snapshot.hashAnchor.IsNull())
+            return snapshot.hashAnchor;
+    }
+    return base->GetBestAnchor();
 }
 
-CBlockTreeDB::CBlockTreeDB(size_t nCacheSize, int maxOpenFiles, bool fMemory, bool fWipe) : CLevelDBWrapper(GetDataDir() / "blocks" / "index", nCacheSize, maxOpenFiles, fMemory, fWipe) {
+bool CCoinsViewBackgroundFlush::HaveCswNullifier(const uint256& scId, const CFieldElement &nullifier) const
+{
+    {
+        LOCK(cs);
+        CCswNullifiersMap::const_iterator it = snapshot.cswNullifiers.find(std::make_pair(scId, nullifier));
+        if (it != snapshot.cswNullifiers.end() && it->second.flag != CCswNullifiersCacheEntry::Flags::DEFAULT)
+            return it->second.flag != CCswNullifiersCacheEntry::Flags::ERASED;
+    }
+    return base->HaveCswNullifier(scId, nullifier);
+}
+
+void CCoinsViewBackgroundFlush::HaveCswNullifiers(const std::vector<std::pair<uint256, CFieldElement>>& keys, std::vector<bool>& vHave) const
+{
+    vHave.assign(keys.size(), false);
+    std::vector<std::pair<uint256, CFieldElement>> dbKeys;
+    std::vector<size_t> dbKeysPos;
+    {
+        LOCK(cs);
+        for (size_t i = 0; i < keys.size(); i++) {
+            CCswNullifiersMap::const_iterator it = snapshot.cswNullifiers.find(keys[i]);
+            if (it != snapshot.cswNullifiers.end() && it->second.flag != CCswNullifiersCacheEntry::Flags::DEFAULT) {
+                vHave[i] = it->second.flag != CCswNullifiersCacheEntry::Flags::ERASED;
+            } else {
+                dbKeys.push_back(keys[i]);
+                dbKeysPos.push_back(i);
+            }
+        }
+    }
+    if (dbKeys.empty())
+        return;
+
+    std::vector<bool> vDbHave;
+    base->HaveCswNullifiers(dbKeys, vDbHave);
+    for (size_t i = 0; i < dbKeys.size(); i++)
+        vHave[dbKeysPos[i]] = vDbHave[i];
+}
+
+bool CCoinsViewBackgroundFlush::GetStats(CCoinsStats &stats) const
+{
+    // stats are computed by iterating the db, it must hold the whole chainstate
+    const_cast<CCoinsViewBackgroundFlush*>(this)->Sync();
+    return base->GetStats(stats);
+}
+
+CBlockTreeDB::CBlockTreeDB(size_t nCacheSize, int maxOpenFiles, bool fMemory, bool fWipe) : CLevelDBWrapper(GetDataDir() / "blocks" / "index", CLevelDBOptions(nCacheSize, maxOpenFiles).ApplyArgs("blocktreedb"), fMemory, fWipe) {
+}
+
+CBlockTreeDB::~CBlockTreeDB()
+{
+    StopIndexWriter();
+}
+
+void CBlockTreeDB::StartIndexWriter(size_t nMaxQueue)
+{
+    std::unique_lock<std::mutex> lock(csIndexWriter);
+    if (indexWriterThread.joinable())
+        return;
+    nMaxIndexQueue = std::max<size_t>(1, nMaxQueue);
+    fStopIndexWriter = false;
+    indexWriterThread = std::thread(&CBlockTreeDB::ThreadIndexWriter, this);
+}
+
+void CBlockTreeDB::StopIndexWriter()
+{
+    {
+        std::unique_lock<std::mutex> lock(csIndexWriter);
+        if (!indexWriterThread.joinable())
+            return;
+        fStopIndexWriter = true;
+    }
+    condIndexQueued.notify_all();
+    indexWriterThread.join();
+}
+
+void CBlockTreeDB::ThreadIndexWriter()
+{
+    RenameThread("horizen-indexwr");
+    std::unique_lock<std::mutex> lock(csIndexWriter);
+    while (true) {
+        condIndexQueued.wait(lock, [this] { return fStopIndexWriter || !indexQueue.empty(); });
+        // the queue is drained before stopping
+        if (indexQueue.empty())
+            break;
+
+        // the update is only popped once written, the queue owns it meanwhile
+        const CBlockIndexesUpdate& update = *indexQueue.front();
+        lock.unlock();
+        int64_t nStart = GetTimeMicros();
+        bool fWritten = false;
+        try {
+            fWritten = WriteIndexesUpdate(update);
+        } catch (const std::exception& e) {
+            LogPrintf("%s: %s\n", __func__, e.what());
+        }
+        LogPrint("bench", "    - Index writing for %s: %.2fms\n", update.hashBestBlock.ToString(), (GetTimeMicros() - nStart) * 0.001);
+        lock.lock();
+
+        indexQueue.pop_front();
+        nIndexWritten++;
+        if (!fWritten) {
+            // later updates build on this one, drop them; the node is shut down by the next caller
+            LogPrintf("%s: failed to write the indexes, dropping %u queued updates\n", __func__, indexQueue.size());
+            fIndexWriteFailed = true;
+            nIndexWritten += indexQueue.size();
+            indexQueue.clear();
+        }
+        condIndexWritten.notify_all();
+    }
+}
+
+bool CBlockTreeDB::QueueIndexesUpdate(std::unique_ptr<CBlockIndexesUpdate> update)
+{
+    maturitySchedule.Update(update->vMaturityHeight);
+    {
+        std::unique_lock<std::mutex> lock(csIndexWriter);
+        if (fIndexWriteFailed)
+            return false;
+        if (indexWriterThread.joinable()) {
+            condIndexWritten.wait(lock, [this] { return fIndexWriteFailed || indexQueue.size() < nMaxIndexQueue; });
+            if (fIndexWriteFailed)
+                return false;
+            indexQueue.push_back(std::move(update));
+            nIndexQueued++;
+            condIndexQueued.notify_one();
+            return true;
+        }
+    }
+    return WriteIndexesUpdate(*update);
+}
+
+void CBlockTreeDB::AwaitIndexes()
+{
+    std::unique_lock<std::mutex> lock(csIndexWriter);
+    if (nIndexWritten == nIndexQueued || std::this_thread::get_id() == indexWriterThread.get_id())
+        return;
+    const uint64_t nTarget = nIndexQueued;
+    condIndexWritten.wait(lock, [this, nTarget] { return nIndexWritten >= nTarget; });
+}
+
+bool CBlockTreeDB::SyncIndexes()
+{
+    AwaitIndexes();
+    std::unique_lock<std::mutex> lock(csIndexWriter);
+    return !fIndexWriteFailed;
+}
+
+size_t CBlockTreeDB::GetIndexQueueSize()
+{
+    std::unique_lock<std::mutex> lock(csIndexWriter);
+    return indexQueue.size();
+}
+
+uint256 CBlockTreeDB::ReadIndexesBestBlock()
+{
+    AwaitIndexes();
+    uint256 hashBestBlock;
+    if (!Read(DB_INDEXES_BEST_BLOCK, hashBestBlock))
+        return uint256();
+    return hashBestBlock;
+}
+
+bool CBlockTreeDB::WriteIndexesUpdate(const CBlockIndexesUpdate& update)
+{
+    CLevelDBBatch batch;
+    for (const std::pair<uint256, CTxIndexValue>& entry : update.vTxIndex)
+        batch.Write(make_pair(DB_TXINDEX, entry.first), entry.second);
+
+    for (const std::pair<CMaturityHeightKey, CMaturityHeightValue>& entry : update.vMaturityHeight) {
+        if (entry.second.IsNull())
+            batch.Erase(make_pair(DB_MATURITY_HEIGHT, entry.first));
+        else
+            batch.Write(make_pair(DB_MATURITY_HEIGHT, entry.first), entry.second);
+    }
+
+    if (!UpdateAddressAggregates(batch, update.vAddressIndex))
+        return false;
+    for (const std::pair<CAddressIndexKey, CAddressIndexValue>& entry : update.vAddressIndex) {
+        if (update.fEraseNullAddressEntries && entry.second.IsNull())
+            batch.Erase(make_pair(DB_ADDRESSINDEX, entry.first));
+        else
+            batch.Write(make_pair(DB_ADDRESSINDEX, entry.first), entry.second);
+    }
+
+    for (const std::pair<CAddressUnspentKey, CAddressUnspentValue>& entry : update.vAddressUnspent) {
+        if (entry.second.IsNull())
+            batch.Erase(make_pair(DB_ADDRESSUNSPENTINDEX, entry.first));
+        else
+            batch.Write(make_pair(DB_ADDRESSUNSPENTINDEX, entry.first), entry.second);
+    }
+
+    for (const std::pair<CSpentIndexKey, CSpentIndexValue>& entry : update.vSpent) {
+        if (entry.second.IsNull())
+            batch.Erase(make_pair(DB_SPENTINDEX, entry.first));
+        else
+            batch.Write(make_pair(DB_SPENTINDEX, entry.first), entry.second);
+    }
+
+    // kept when the block is disconnected, as they are keyed by its hash
+    for (const std::pair<uint256, CBlockInputDeltas>& entry : update.vBlockInputDeltas)
+        batch.Write(make_pair(DB_BLOCKINPUTDELTAS, entry.first), entry.second);
+
+    if (update.fTimestamp) {
+        unsigned int logicalTS = update.nTime;
+        unsigned int prevLogicalTS = 0;
+
+        // retrieve logical timestamp of the previous block, written by the previous update
+        if (!update.hashPrevBlock.IsNull())
+            if (!ReadTimestampBlockIndex(update.hashPrevBlock, prevLogicalTS))
+                LogPrintf("%s: Failed to read previous block's logical timestamp\n", __func__);
+
+        if (logicalTS <= prevLogicalTS) {
+            logicalTS = prevLogicalTS + 1;
+            LogPrintf("%s: Previous logical timestamp is newer Actual[%d] prevLogical[%d] Logical[%d]\n", __func__, update.nTime, prevLogicalTS, logicalTS);
+        }
+
+        batch.Write(make_pair(DB_TIMESTAMPINDEX, CTimestampIndexKey(logicalTS, update.hashBestBlock)), 0);
+        batch.Write(make_pair(DB_BLOCKHASHINDEX, CTimestampBlockIndexKey(update.hashBestBlock)), CTimestampBlockIndexValue(logicalTS));
+    }
+
+    if (!update.hashBestBlock.IsNull())
+        batch.Write(DB_INDEXES_BEST_BLOCK, update.hashBestBlock);
+    return WriteBatch(batch);
 }
 
 bool CBlockTreeDB::ReadBlockFileInfo(int nFile, CBlockFileInfo &info) {
@@ -325,57 +1234,16 @@ bool CCoinsViewDB::GetStats(CCoinsStats &stats) const {
     /* It seems that there are no "const iterators" for LevelDB.  Since we
        only need read operations on it, use a const-cast to get around
        that restriction.  */
-    boost::scoped_ptr<leveldb::Iterator> pcursor(const_cast<CLevelDBWrapper*>(&db)->NewIterator());
+    boost::scoped_ptr<CDBIterator> pcursor(const_cast<CLevelDBWrapper*>(&db)->NewIterator());
     pcursor->SeekToFirst();
 
     CHashWriter ss(SER_GETHASH, PROTOCOL_VERSION);
     stats.hashBlock = GetBestBlock();
     ss << stats.hashBlock;
-    CAmount nTotalAmount = 0;
     while (pcursor->Valid()) {
         boost::this_thread::interruption_point();
         try {
-            leveldb::Slice slKey = pcursor->key();
-            CDataStream ssKey(slKey.data(), slKey.data()+slKey.size(), SER_DISK, CLIENT_VERSION);
-            char chType;
-            ssKey >> chType;
-            if (chType == DB_COINS) {
-                leveldb::Slice slValue = pcursor->value();
-                CDataStream ssValue(slValue.data(), slValue.data()+slValue.size(), SER_DISK, CLIENT_VERSION);
-                CCoins coins;
-                ssValue >> coins;
-                uint256 txhash;
-                ssKey >> txhash;
-                ss << txhash;
-                ss << VARINT(coins.nVersion);
-                ss << (coins.fCoinBase ? 'c' : 'n');
-                ss << VARINT(coins.nHeight);
-
-                // add cert attribute to the hash writer obj, such values are meaningful only in this case 
-                // the size of the hash writer obj buffer is different anyway (larger) from the actual serialized size
-                // because the coin serialization is compressed 
-                if (coins.IsFromCert()) {
-                    ss << coins.nFirstBwtPos;
-                    ss << coins.nBwtMaturityHeight;
-                }
-
-                // - transactions and certificates are lumped together 
-                // - nTotalAmount includes certificate valid bwt amounts (not-null, as for low-quality certs)
-                //   even if not yet matured, as it is done currently with coinbase vouts
-                stats.nTransactions++;
-                for (unsigned int i=0; i<coins.vout.size(); i++) {
-                    const CTxOut &out = coins.vout[i];
-                    if (!out.IsNull()) {
-                        stats.nTransactionOutputs++;
-                        ss << VARINT(i+1);
-                        ss << out;
-                        nTotalAmount += out.nValue;
-                    }
-                }
-                
-                stats.nSerializedSize += 32 + slValue.size();
-                ss << VARINT(0);
-            }
+            AddEntryToStats(ss, stats, pcursor->key(), pcursor->value());
             pcursor->Next();
         } catch (const std::exception& e) {
             return error("%s: Deserialize or I/O error - %s", __func__, e.what());
@@ -386,18 +1254,81 @@ bool CCoinsViewDB::GetStats(CCoinsStats &stats) const {
         stats.nHeight = mapBlockIndex.find(stats.hashBlock)->second->nHeight;
     }
     stats.hashSerialized = ss.GetHash();
-    stats.nTotalAmount = nTotalAmount;
+    return true;
+}
+
+void CCoinsViewDB::AddEntryToStats(CHashWriter &ss, CCoinsStats &stats, const CDBSlice &slKey, const CDBSlice &slValue)
+{
+    CPublicDataStream ssKey(slKey.data(), slKey.data()+slKey.size(), SER_DISK, CLIENT_VERSION);
+    char chType;
+    ssKey >> chType;
+    if (chType != DB_COINS)
+        return;
+
+    CPublicDataStream ssValue(slValue.data(), slValue.data()+slValue.size(), SER_DISK, CLIENT_VERSION);
+    CCoins coins;
+    ssValue >> coins;
+    uint256 txhash;
+    ssKey >> txhash;
+    SerializeCoinsForStats(ss, txhash, coins);
+
+    // - transactions and certificates are lumped together 
+    // - nTotalAmount includes certificate valid bwt amounts (not-null, as for low-quality certs)
+    //   even if not yet matured, as it is done currently with coinbase vouts
+    stats.nTransactions++;
+    for (const CTxOut &out : coins.vout) {
+        if (!out.IsNull()) {
+            stats.nTransactionOutputs++;
+            stats.nTotalAmount += out.nValue;
+        }
+    }
+    stats.nSerializedSize += 32 + slValue.size();
+}
+
+CDBIterator *CCoinsViewDB::NewIterator() const
+{
+    return const_cast<CLevelDBWrapper*>(&db)->NewIterator();
+}
+
+bool CCoinsViewDB::IsSnapshotRecord(const CDBSlice &slKey)
+{
+    static const std::string strChainstateTypes = {DB_COINS, DB_ANCHOR, DB_NULLIFIER, DB_SIDECHAINS, DB_CEASEDSCS,
+                                                   DB_CSW_NULLIFIER, DB_BEST_BLOCK, DB_BEST_ANCHOR};
+    return !slKey.empty() && strChainstateTypes.find(slKey[0]) != std::string::npos;
+}
+
+bool CCoinsViewDB::WriteSnapshotEntries(const std::vector<std::pair<std::vector<unsigned char>, std::vector<unsigned char> > > &entries)
+{
+    {
+        LOCK(csSetStats);
+        fSetStatsValid = false;
+    }
+    CLevelDBBatch batch;
+    std::vector<uint64_t> vFilterInserted;
+    for (const auto& entry : entries) {
+        if (!IsSnapshotRecord(CDBSlice((const char*)entry.first.data(), entry.first.size())))
+            return error("%s: unexpected chainstate record type in snapshot", __func__);
+        batch.Write(CFlatData(REF(entry.first)), CFlatData(REF(entry.second)));
+        const char chType = entry.first[0];
+        if (fExistenceFilter && (chType == DB_COINS || chType == DB_SIDECHAINS || chType == DB_CSW_NULLIFIER))
+            vFilterInserted.push_back(ExistenceFilterHash((const char*)entry.first.data(), entry.first.size()));
+    }
+    batch.Erase(DB_COINS_SET_STATS);
+    InsertIntoExistenceFilter(vFilterInserted);
+    if (!db.WriteBatch(batch))
+        return false;
+    EraseFromExistenceFilter(std::vector<uint64_t>());
     return true;
 }
 
 void CCoinsViewDB::Dump_info()  const
 {
     // dump leveldb contents on stdout
-    std::unique_ptr<leveldb::Iterator> it(const_cast<CLevelDBWrapper*>(&db)->NewIterator());
+    std::unique_ptr<CDBIterator> it(const_cast<CLevelDBWrapper*>(&db)->NewIterator());
     for (it->SeekToFirst(); it->Valid(); it->Next())
     {
-        leveldb::Slice slKey = it->key();
-        CDataStream ssKey(slKey.data(), slKey.data()+slKey.size(), SER_DISK, CLIENT_VERSION);
+        CDBSlice slKey = it->key();
+        CPublicDataStream ssKey(slKey.data(), slKey.data()+slKey.size(), SER_DISK, CLIENT_VERSION);
         char chType;
         uint256 keyScId;
         ssKey >> chType;
@@ -405,8 +1336,8 @@ void CCoinsViewDB::Dump_info()  const
 
         if (chType == DB_SIDECHAINS)
         {
-            leveldb::Slice slValue = it->value();
-            CDataStream ssValue(slValue.data(), slValue.data()+slValue.size(), SER_DISK, CLIENT_VERSION);
+            CDBSlice slValue = it->value();
+            CPublicDataStream ssValue(slValue.data(), slValue.data()+slValue.size(), SER_DISK, CLIENT_VERSION);
             CSidechain info;
             ssValue >> info;
 
@@ -437,7 +1368,15 @@ bool CBlockTreeDB::WriteBatchSync(const std::vector<std::pair<int, const CBlockF
     return WriteBatch(batch, true);
 }
 
+bool CBlockTreeDB::WriteBlockIndexEntries(const std::vector<CDiskBlockIndex>& entries) {
+    CLevelDBBatch batch;
+    for (const CDiskBlockIndex& diskindex : entries)
+        batch.Write(make_pair(DB_BLOCK_INDEX, diskindex.GetBlockHash()), diskindex);
+    return WriteBatch(batch);
+}
+
 bool CBlockTreeDB::ReadTxIndex(const uint256 &txid, CTxIndexValue &val) {
+    AwaitIndexes();
     return Read(make_pair(DB_TXINDEX, txid), val);
 }
 
@@ -449,17 +1388,25 @@ bool CBlockTreeDB::WriteTxIndex(const std::vector<std::pair<uint256, CTxIndexVal
 }
 
 bool CBlockTreeDB::ReadMaturityHeightIndex(const int height, std::vector<CMaturityHeightKey> &val) {
-    boost::scoped_ptr<leveldb::Iterator> pcursor(NewIterator());
+    if (maturitySchedule.IsLoaded()) {
+        // the schedule got the updates still queued, no need to wait for them
+        const std::vector<CMaturityHeightKey> vKeys = maturitySchedule.Get(height);
+        val.insert(val.end(), vKeys.begin(), vKeys.end());
+        return true;
+    }
+
+    AwaitIndexes();
+    boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
 
-    CDataStream ssKeySet(SER_DISK, CLIENT_VERSION);
+    CPublicDataStream ssKeySet(SER_DISK, CLIENT_VERSION);
     ssKeySet << make_pair(DB_MATURITY_HEIGHT, CMaturityHeightIteratorKey(height));
     pcursor->Seek(ssKeySet.str());
 
     while (pcursor->Valid()) {
         boost::this_thread::interruption_point();
         try {
-            leveldb::Slice slKey = pcursor->key();
-            CDataStream ssKey(slKey.data(), slKey.data()+slKey.size(), SER_DISK, CLIENT_VERSION);
+            CDBSlice slKey = pcursor->key();
+            CPublicDataStream ssKey(slKey.data(), slKey.data()+slKey.size(), SER_DISK, CLIENT_VERSION);
             
             char chType;
             ssKey >> chType;
@@ -486,7 +1433,35 @@ bool CBlockTreeDB::ReadMaturityHeightIndex(const int height, std::vector<CMaturi
     return true;
 }
 
+bool CBlockTreeDB::LoadMaturityHeightIndex() {
+    AwaitIndexes();
+    int64_t nStart = GetTimeMillis();
+    std::vector<CMaturityHeightKey> vKeys;
+    std::unique_ptr<CDBIterator> pcursor(NewIterator());
+    const std::string strPrefix(1, DB_MATURITY_HEIGHT);
+    for (pcursor->Seek(strPrefix); pcursor->Valid() && pcursor->key().starts_with(strPrefix); pcursor->Next()) {
+        boost::this_thread::interruption_point();
+        try {
+            CDBSlice slKey = pcursor->key();
+            CPublicDataStream ssKey(slKey.data(), slKey.data()+slKey.size(), SER_DISK, CLIENT_VERSION);
+            char chType;
+            CMaturityHeightKey indexKey;
+            ssKey >> chType >> indexKey;
+            vKeys.push_back(indexKey);
+        } catch (const std::exception& e) {
+            return error("%s: %s", __func__, e.what());
+        }
+    }
+    if (!pcursor->status().ok())
+        return error("%s: %s", __func__, pcursor->status().ToString());
+
+    maturitySchedule.Load(vKeys);
+    LogPrintf("Loaded the maturity height index, %u certificates, in %dms\n", vKeys.size(), GetTimeMillis() - nStart);
+    return true;
+}
+
 bool CBlockTreeDB::UpdateMaturityHeightIndex(const std::vector<std::pair<CMaturityHeightKey,CMaturityHeightValue>> &vect) {
+    maturitySchedule.Update(vect);
     CLevelDBBatch batch;
     for (std::vector<std::pair<CMaturityHeightKey,CMaturityHeightValue> >::const_iterator it=vect.begin(); it!=vect.end(); it++)
         //If the value is null we mean we want to erase the pair from the DB otherwise we persist it
@@ -499,9 +1474,15 @@ bool CBlockTreeDB::UpdateMaturityHeightIndex(const std::vector<std::pair<CMaturi
 }
 
 bool CBlockTreeDB::ReadSpentIndex(CSpentIndexKey &key, CSpentIndexValue &value) {
+    AwaitIndexes();
     return Read(make_pair(DB_SPENTINDEX, key), value);
 }
 
+bool CBlockTreeDB::ReadBlockInputDeltas(const uint256 &hash, CBlockInputDeltas &deltas) {
+    AwaitIndexes();
+    return Read(make_pair(DB_BLOCKINPUTDELTAS, hash), deltas);
+}
+
 bool CBlockTreeDB::UpdateSpentIndex(const std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> >&vect) {
     CLevelDBBatch batch;
     for (std::vector<std::pair<CSpentIndexKey,CSpentIndexValue> >::const_iterator it=vect.begin(); it!=vect.end(); it++) {
@@ -529,25 +1510,26 @@ bool CBlockTreeDB::UpdateAddressUnspentIndex(const std::vector<std::pair<CAddres
 bool CBlockTreeDB::ReadAddressUnspentIndex(uint160 addressHash, AddressType type,
                                            std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &unspentOutputs) {
 
-    boost::scoped_ptr<leveldb::Iterator> pcursor(NewIterator());
+    AwaitIndexes();
+    boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
 
-    CDataStream ssKeySet(SER_DISK, CLIENT_VERSION);
+    CPublicDataStream ssKeySet(SER_DISK, CLIENT_VERSION);
     ssKeySet << make_pair(DB_ADDRESSUNSPENTINDEX, CAddressIndexIteratorKey(type, addressHash));
     pcursor->Seek(ssKeySet.str());
 
     while (pcursor->Valid()) {
         boost::this_thread::interruption_point();
         try {
-            leveldb::Slice slKey = pcursor->key();
-            CDataStream ssKey(slKey.data(), slKey.data()+slKey.size(), SER_DISK, CLIENT_VERSION);
+            CDBSlice slKey = pcursor->key();
+            CPublicDataStream ssKey(slKey.data(), slKey.data()+slKey.size(), SER_DISK, CLIENT_VERSION);
             char chType;
             CAddressUnspentKey indexKey;
             ssKey >> chType;
             ssKey >> indexKey;
             if (chType == DB_ADDRESSUNSPENTINDEX && indexKey.hashBytes == addressHash) {
                 try {
-                    leveldb::Slice slValue = pcursor->value();
-                    CDataStream ssValue(slValue.data(), slValue.data()+slValue.size(), SER_DISK, CLIENT_VERSION);
+                    CDBSlice slValue = pcursor->value();
+                    CPublicDataStream ssValue(slValue.data(), slValue.data()+slValue.size(), SER_DISK, CLIENT_VERSION);
                     CAddressUnspentValue nValue;
                     ssValue >> nValue;
                     unspentOutputs.push_back(make_pair(indexKey, nValue));
@@ -566,9 +1548,78 @@ bool CBlockTreeDB::ReadAddressUnspentIndex(uint160 addressHash, AddressType type
     return true;
 }
 
+bool CBlockTreeDB::UpdateAddressAggregates(CLevelDBBatch& batch, const std::vector<std::pair<CAddressIndexKey, CAddressIndexValue> > &vect)
+{
+    if (!fAddressAggregates)
+        return true;
+
+    typedef std::pair<AddressType, uint160> AddressKey;
+    std::map<AddressKey, CAddressAggregateValue> mapDelta;
+    std::map<AddressKey, std::set<uint256> > mapTxsAdded, mapTxsRemoved;
+    // entries written more than once in the batch replace the value written before, not the one on disk
+    std::map<std::string, CAddressIndexValue> mapPending;
+
+    for (const std::pair<CAddressIndexKey, CAddressIndexValue>& entry : vect) {
+        CPublicDataStream ssKey(SER_DISK, CLIENT_VERSION);
+        ssKey << entry.first;
+        std::map<std::string, CAddressIndexValue>::iterator itPending = mapPending.find(ssKey.str());
+
+        CAddressIndexValue oldValue;
+        bool fExists;
+        if (itPending != mapPending.end()) {
+            oldValue = itPending->second;
+            fExists = !oldValue.IsNull();
+        } else {
+            fExists = Read(make_pair(DB_ADDRESSINDEX, entry.first), oldValue);
+        }
+        mapPending[ssKey.str()] = entry.second;
+
+        const AddressKey address(entry.first.type, entry.first.hashBytes);
+        CAddressAggregateValue& delta = mapDelta[address];
+        if (fExists)
+            delta.ApplyEntry(oldValue, -1);
+        delta.ApplyEntry(entry.second, 1);
+
+        // all the entries of a transaction are added or removed together, with its block
+        if (!fExists && !entry.second.IsNull())
+            mapTxsAdded[address].insert(entry.first.txhash);
+        else if (fExists && entry.second.IsNull())
+            mapTxsRemoved[address].insert(entry.first.txhash);
+    }
+
+    for (std::pair<const AddressKey, CAddressAggregateValue>& delta : mapDelta) {
+        delta.second.txCount += mapTxsAdded[delta.first].size();
+        delta.second.txCount -= mapTxsRemoved[delta.first].size();
+
+        CAddressAggregateValue aggregate;
+        if (!ReadAddressAggregate(delta.first.second, delta.first.first, aggregate))
+            return error("failed to read address aggregate");
+        aggregate.Add(delta.second);
+
+        const CAddressIndexIteratorKey key(delta.first.first, delta.first.second);
+        if (aggregate.IsNull())
+            batch.Erase(make_pair(DB_ADDRESSAGGREGATE, key));
+        else
+            batch.Write(make_pair(DB_ADDRESSAGGREGATE, key), aggregate);
+    }
+
+    return true;
+}
+
+bool CBlockTreeDB::ReadAddressAggregate(uint160 addressHash, AddressType type, CAddressAggregateValue &value)
+{
+    AwaitIndexes();
+    // no record means no activity
+    if (!Read(make_pair(DB_ADDRESSAGGREGATE, CAddressIndexIteratorKey(type, addressHash)), value))
+        value.SetNull();
+    return true;
+}
+
 bool CBlockTreeDB::UpdateAddressIndex(const std::vector<std::pair<CAddressIndexKey, CAddressIndexValue> > &vect)
 {
     CLevelDBBatch batch;
+    if (!UpdateAddressAggregates(batch, vect))
+        return false;
 
     for (std::vector<std::pair<CAddressIndexKey, CAddressIndexValue> >::const_iterator it=vect.begin(); it!=vect.end(); it++)
     {
@@ -587,6 +1638,8 @@ bool CBlockTreeDB::UpdateAddressIndex(const std::vector<std::pair<CAddressIndexK
 
 bool CBlockTreeDB::WriteAddressIndex(const std::vector<std::pair<CAddressIndexKey, CAddressIndexValue> >&vect) {
     CLevelDBBatch batch;
+    if (!UpdateAddressAggregates(batch, vect))
+        return false;
     for (std::vector<std::pair<CAddressIndexKey, CAddressIndexValue> >::const_iterator it=vect.begin(); it!=vect.end(); it++)
         batch.Write(make_pair(DB_ADDRESSINDEX, it->first), it->second);
     return WriteBatch(batch);
@@ -594,6 +1647,12 @@ bool CBlockTreeDB::WriteAddressIndex(const std::vector<std::pair<CAddressIndexKe
 
 bool CBlockTreeDB::EraseAddressIndex(const std::vector<std::pair<CAddressIndexKey, CAddressIndexValue> >&vect) {
     CLevelDBBatch batch;
+    std::vector<std::pair<CAddressIndexKey, CAddressIndexValue> > vErased;
+    vErased.reserve(vect.size());
+    for (const std::pair<CAddressIndexKey, CAddressIndexValue>& entry : vect)
+        vErased.push_back(make_pair(entry.first, CAddressIndexValue()));
+    if (!UpdateAddressAggregates(batch, vErased))
+        return false;
     for (std::vector<std::pair<CAddressIndexKey, CAddressIndexValue> >::const_iterator it=vect.begin(); it!=vect.end(); it++)
         batch.Erase(make_pair(DB_ADDRESSINDEX, it->first));
     return WriteBatch(batch);
@@ -603,9 +1662,10 @@ bool CBlockTreeDB::ReadAddressIndex(uint160 addressHash, AddressType type,
                                     std::vector<std::pair<CAddressIndexKey, CAddressIndexValue> > &addressIndex,
                                     int start, int end) {
 
-    boost::scoped_ptr<leveldb::Iterator> pcursor(NewIterator());
+    AwaitIndexes();
+    boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
 
-    CDataStream ssKeySet(SER_DISK, CLIENT_VERSION);
+    CPublicDataStream ssKeySet(SER_DISK, CLIENT_VERSION);
     if (start > 0 && end > 0) {
         ssKeySet << make_pair(DB_ADDRESSINDEX, CAddressIndexIteratorHeightKey(type, addressHash, start));
     } else {
@@ -616,8 +1676,8 @@ bool CBlockTreeDB::ReadAddressIndex(uint160 addressHash, AddressType type,
     while (pcursor->Valid()) {
         boost::this_thread::interruption_point();
         try {
-            leveldb::Slice slKey = pcursor->key();
-            CDataStream ssKey(slKey.data(), slKey.data()+slKey.size(), SER_DISK, CLIENT_VERSION);
+            CDBSlice slKey = pcursor->key();
+            CPublicDataStream ssKey(slKey.data(), slKey.data()+slKey.size(), SER_DISK, CLIENT_VERSION);
             char chType;
             CAddressIndexKey indexKey;
             ssKey >> chType;
@@ -627,8 +1687,8 @@ bool CBlockTreeDB::ReadAddressIndex(uint160 addressHash, AddressType type,
                     break;
                 }
                 try {
-                    leveldb::Slice slValue = pcursor->value();
-                    CDataStream ssValue(slValue.data(), slValue.data()+slValue.size(), SER_DISK, CLIENT_VERSION);
+                    CDBSlice slValue = pcursor->value();
+                    CPublicDataStream ssValue(slValue.data(), slValue.data()+slValue.size(), SER_DISK, CLIENT_VERSION);
                     CAddressIndexValue indexValue;
                     ssValue >> indexValue;
 
@@ -648,6 +1708,84 @@ bool CBlockTreeDB::ReadAddressIndex(uint160 addressHash, AddressType type,
     return true;
 }
 
+bool CBlockTreeDB::ReadAddressIndexPage(uint160 addressHash, AddressType type, const CAddressIndexKey* pCursor, bool fReverse,
+                                        size_t nMaxTxs, int start, int end,
+                                        std::vector<std::pair<CAddressIndexKey, CAddressIndexValue> > &addressIndex, bool &fMore) {
+
+    AwaitIndexes();
+    fMore = false;
+    boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
+
+    CPublicDataStream ssKeySet(SER_DISK, CLIENT_VERSION);
+    if (pCursor) {
+        ssKeySet << make_pair(DB_ADDRESSINDEX, *pCursor);
+    } else if (!fReverse) {
+        ssKeySet << make_pair(DB_ADDRESSINDEX, CAddressIndexIteratorHeightKey(type, addressHash, std::max(start, 0)));
+    } else {
+        // heights are stored big-endian, so this sorts after all the entries of the address up to end
+        int nSeekHeight = end > 0 ? end + 1 : std::numeric_limits<int>::max();
+        ssKeySet << make_pair(DB_ADDRESSINDEX, CAddressIndexIteratorHeightKey(type, addressHash, nSeekHeight));
+    }
+    pcursor->Seek(ssKeySet.str());
+
+    if (fReverse) {
+        // step back to the last entry before the seek position
+        if (pcursor->Valid())
+            pcursor->Prev();
+        else
+            pcursor->SeekToLast();
+    } else if (pCursor && pcursor->Valid() && pcursor->key() == CDBSlice(ssKeySet.str())) {
+        // the cursor entry itself closed the previous page
+        pcursor->Next();
+    }
+
+    size_t nTxs = 0;
+    uint256 lastTxHash;
+    while (pcursor->Valid()) {
+        boost::this_thread::interruption_point();
+        try {
+            CDBSlice slKey = pcursor->key();
+            CPublicDataStream ssKey(slKey.data(), slKey.data()+slKey.size(), SER_DISK, CLIENT_VERSION);
+            char chType;
+            CAddressIndexKey indexKey;
+            ssKey >> chType;
+            ssKey >> indexKey;
+            if (chType != DB_ADDRESSINDEX || indexKey.type != type || indexKey.hashBytes != addressHash)
+                break;
+            if (fReverse ? (start > 0 && indexKey.blockHeight < start) : (end > 0 && indexKey.blockHeight > end))
+                break;
+
+            // the entries of a transaction are contiguous and never split across pages
+            if (nTxs == 0 || indexKey.txhash != lastTxHash) {
+                if (nTxs == nMaxTxs) {
+                    fMore = true;
+                    break;
+                }
+                nTxs++;
+                lastTxHash = indexKey.txhash;
+            }
+
+            try {
+                CDBSlice slValue = pcursor->value();
+                CPublicDataStream ssValue(slValue.data(), slValue.data()+slValue.size(), SER_DISK, CLIENT_VERSION);
+                CAddressIndexValue indexValue;
+                ssValue >> indexValue;
+                addressIndex.push_back(make_pair(indexKey, indexValue));
+            } catch (const std::exception& e) {
+                return error("failed to get address index value");
+            }
+            if (fReverse)
+                pcursor->Prev();
+            else
+                pcursor->Next();
+        } catch (const std::exception& e) {
+            break;
+        }
+    }
+
+    return true;
+}
+
 bool CBlockTreeDB::WriteTimestampIndex(const CTimestampIndexKey &timestampIndex) {
     CLevelDBBatch batch;
     batch.Write(make_pair(DB_TIMESTAMPINDEX, timestampIndex), 0);
@@ -655,18 +1793,19 @@ bool CBlockTreeDB::WriteTimestampIndex(const CTimestampIndexKey &timestampIndex)
 }
 
 bool CBlockTreeDB::ReadTimestampIndex(const unsigned int &high, const unsigned int &low, const bool fActiveOnly, std::vector<std::pair<uint256, unsigned int> > &hashes) {
+    AwaitIndexes();
 
-    boost::scoped_ptr<leveldb::Iterator> pcursor(NewIterator());
+    boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
 
-    CDataStream ssKeySet(SER_DISK, CLIENT_VERSION);
+    CPublicDataStream ssKeySet(SER_DISK, CLIENT_VERSION);
     ssKeySet << make_pair(DB_TIMESTAMPINDEX, CTimestampIndexIteratorKey(low));
     pcursor->Seek(ssKeySet.str());
 
     while (pcursor->Valid()) {
         boost::this_thread::interruption_point();
         try {
-            leveldb::Slice slKey = pcursor->key();
-            CDataStream ssKey(slKey.data(), slKey.data()+slKey.size(), SER_DISK, CLIENT_VERSION);
+            CDBSlice slKey = pcursor->key();
+            CPublicDataStream ssKey(slKey.data(), slKey.data()+slKey.size(), SER_DISK, CLIENT_VERSION);
             char chType;
             CTimestampIndexKey indexKey;
             ssKey >> chType;
@@ -699,6 +1838,7 @@ bool CBlockTreeDB::WriteTimestampBlockIndex(const CTimestampBlockIndexKey &block
 }
 
 bool CBlockTreeDB::ReadTimestampBlockIndex(const uint256 &hash, unsigned int &ltimestamp) {
+    AwaitIndexes();
 
     CTimestampBlockIndexValue(lts);
     if (!Read(std::make_pair(DB_BLOCKHASHINDEX, hash), lts))
@@ -719,6 +1859,14 @@ bool CBlockTreeDB::blockOnchainActive(const uint256 &hash) {
     return false;
 }
 
+bool CBlockTreeDB::ReadScGenesisInfo(const uint256 &scId, CScGenesisInfo &info) {
+    return Read(make_pair(DB_SC_GENESIS_INFO, scId), info);
+}
+
+bool CBlockTreeDB::WriteScGenesisInfo(const uint256 &scId, const CScGenesisInfo &info) {
+    return Write(make_pair(DB_SC_GENESIS_INFO, scId), info);
+}
+
 bool CBlockTreeDB::WriteString(const std::string &name, std::string sValue) {
     return Write(std::make_pair(DB_FLAG, name), sValue);
 }
@@ -741,59 +1889,110 @@ bool CBlockTreeDB::ReadFlag(const std::string &name, bool &fValue) {
     return true;
 }
 
-bool CBlockTreeDB::LoadBlockIndexGuts()
+namespace {
+//! A block index db entry, decoded and checked by one of the LoadBlockIndexGuts workers
+struct CLoadedBlockIndex
 {
-    boost::scoped_ptr<leveldb::Iterator> pcursor(NewIterator());
+    std::string strValue;
+    CDiskBlockIndex diskindex;
+    uint256 hash;
+    bool fPowOk = false;
+    std::string strError;
+};
+}
 
-    CDataStream ssKeySet(SER_DISK, CLIENT_VERSION);
+bool CBlockTreeDB::LoadBlockIndexGuts(unsigned int nThreads)
+{
+    boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
+
+    CPublicDataStream ssKeySet(SER_DISK, CLIENT_VERSION);
     ssKeySet << make_pair(DB_BLOCK_INDEX, uint256());
     pcursor->Seek(ssKeySet.str());
 
-    // Load mapBlockIndex
-    while (pcursor->Valid()) {
-        boost::this_thread::interruption_point();
-        try {
-            leveldb::Slice slKey = pcursor->key();
-            CDataStream ssKey(slKey.data(), slKey.data()+slKey.size(), SER_DISK, CLIENT_VERSION);
-            char chType;
-            ssKey >> chType;
-            if (chType == DB_BLOCK_INDEX) {
-                leveldb::Slice slValue = pcursor->value();
-                CDataStream ssValue(slValue.data(), slValue.data()+slValue.size(), SER_DISK, CLIENT_VERSION);
-                CDiskBlockIndex diskindex;
-                ssValue >> diskindex;
-
-                // Construct block index object
-                CBlockIndex* pindexNew = InsertBlockIndex(diskindex.GetBlockHash());
-                pindexNew->pprev          = InsertBlockIndex(diskindex.hashPrev);
-                pindexNew->nHeight        = diskindex.nHeight;
-                pindexNew->nFile          = diskindex.nFile;
-                pindexNew->nDataPos       = diskindex.nDataPos;
-                pindexNew->nUndoPos       = diskindex.nUndoPos;
-                pindexNew->hashAnchor     = diskindex.hashAnchor;
-                pindexNew->nVersion       = diskindex.nVersion;
-                pindexNew->hashMerkleRoot = diskindex.hashMerkleRoot;
-                pindexNew->nTime          = diskindex.nTime;
-                pindexNew->nBits          = diskindex.nBits;
-                pindexNew->nNonce         = diskindex.nNonce;
-                pindexNew->nSolution      = diskindex.nSolution;
-                pindexNew->nStatus        = diskindex.nStatus;
-                pindexNew->nTx            = diskindex.nTx;
-                pindexNew->nSproutValue   = diskindex.nSproutValue;
-                pindexNew->hashScTxsCommitment = diskindex.hashScTxsCommitment;
-                pindexNew->scCumTreeHash  = diskindex.scCumTreeHash;
-
-                if (!CheckProofOfWork(pindexNew->GetBlockHash(), pindexNew->nBits, Params().GetConsensus()))
-                    return error("LoadBlockIndex(): CheckProofOfWork failed: %s", pindexNew->ToString());
-
-                if (!pindexNew->scCumTreeHash.IsNull() && ForkManager::getInstance().isNonCeasingSidechainActive(pindexNew->nHeight))
-                    mapCumtreeHeight.insert(std::make_pair(pindexNew->scCumTreeHash.GetLegacyHash(), pindexNew->nHeight));
-                pcursor->Next();
-            } else {
-                break; // if shutdown requested or finished loading block index
+    nThreads = std::max(1U, nThreads);
+    std::vector<CLoadedBlockIndex> vEntries;
+    bool fDone = false;
+
+    // Load mapBlockIndex. Entries are read from the db in chunks, whose decoding, header hashing and
+    // proof of work checks are spread over nThreads threads; they are then linked into mapBlockIndex serially.
+    while (!fDone) {
+        vEntries.clear();
+        while (vEntries.size() < BLOCK_INDEX_LOAD_CHUNK_SIZE) {
+            boost::this_thread::interruption_point();
+            if (!pcursor->Valid()) {
+                fDone = true;
+                break;
             }
-        } catch (const std::exception& e) {
-            return error("%s: Deserialize or I/O error - %s", __func__, e.what());
+            try {
+                CDBSlice slKey = pcursor->key();
+                CPublicDataStream ssKey(slKey.data(), slKey.data()+slKey.size(), SER_DISK, CLIENT_VERSION);
+                char chType;
+                ssKey >> chType;
+                if (chType != DB_BLOCK_INDEX) {
+                    fDone = true; // if shutdown requested or finished loading block index
+                    break;
+                }
+            } catch (const std::exception& e) {
+                return error("%s: Deserialize or I/O error - %s", __func__, e.what());
+            }
+            vEntries.emplace_back();
+            vEntries.back().strValue = pcursor->value().ToString();
+            pcursor->Next();
+        }
+
+        auto worker = [&vEntries, nThreads](unsigned int nWorker) {
+            for (size_t i = nWorker; i < vEntries.size(); i += nThreads) {
+                CLoadedBlockIndex& entry = vEntries[i];
+                try {
+                    CPublicDataStream ssValue(entry.strValue.data(), entry.strValue.data() + entry.strValue.size(), SER_DISK, CLIENT_VERSION);
+                    ssValue >> entry.diskindex;
+                    entry.hash = entry.diskindex.GetBlockHash();
+                    entry.fPowOk = CheckProofOfWork(entry.hash, entry.diskindex.nBits, Params().GetConsensus());
+                } catch (const std::exception& e) {
+                    entry.strError = e.what();
+                }
+                std::string().swap(entry.strValue);
+            }
+        };
+
+        std::vector<std::future<void>> workers;
+        for (unsigned int n = 1; n < std::min<size_t>(nThreads, vEntries.size()); ++n)
+            workers.push_back(std::async(std::launch::async, worker, n));
+        worker(0);
+        for (auto& w : workers)
+            w.get();
+
+        for (const CLoadedBlockIndex& entry : vEntries) {
+            if (!entry.strError.empty())
+                return error("%s: Deserialize or I/O error - %s", __func__, entry.strError);
+
+            const CDiskBlockIndex& diskindex = entry.diskindex;
+
+            // Construct block index object
+            CBlockIndex* pindexNew = InsertBlockIndex(entry.hash);
+            pindexNew->pprev          = InsertBlockIndex(diskindex.hashPrev);
+            pindexNew->nHeight        = diskindex.nHeight;
+            pindexNew->nFile          = diskindex.nFile;
+            pindexNew->nDataPos       = diskindex.nDataPos;
+            pindexNew->nUndoPos       = diskindex.nUndoPos;
+            pindexNew->hashAnchor     = diskindex.hashAnchor;
+            pindexNew->nVersion       = diskindex.nVersion;
+            pindexNew->hashMerkleRoot = diskindex.hashMerkleRoot;
+            pindexNew->nTime          = diskindex.nTime;
+            pindexNew->nBits          = diskindex.nBits;
+            pindexNew->nNonce         = diskindex.nNonce;
+            pindexNew->nSolution      = diskindex.nSolution;
+            pindexNew->nStatus        = diskindex.nStatus;
+            pindexNew->nTx            = diskindex.nTx;
+            pindexNew->nSproutValue   = diskindex.nSproutValue;
+            pindexNew->hashScTxsCommitment = diskindex.hashScTxsCommitment;
+            pindexNew->scCumTreeHash  = diskindex.scCumTreeHash;
+
+            if (!entry.fPowOk)
+                return error("LoadBlockIndex(): CheckProofOfWork failed: %s", pindexNew->ToString());
+
+            if (!pindexNew->scCumTreeHash.IsNull() && ForkManager::getInstance().isNonCeasingSidechainActive(pindexNew->nHeight))
+                mapCumtreeHeight.insert(std::make_pair(pindexNew->scCumTreeHash.GetLegacyHash(), pindexNew->nHeight));
         }
     }
 
@@ -8,15 +8,28 @@
 
 #include "chain.h"
 #include "coins.h"
+#include "crypto/muhash.h"
+#include "cuckoofilter.h"
 #include "leveldbwrapper.h"
+#include "maturityschedule.h"
+#include "sync.h"
 
+#include <boost/thread/shared_mutex.hpp>
+
+#include <condition_variable>
+#include <deque>
+#include <future>
 #include <map>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <thread>
 #include <utility>
 #include <vector>
 
 class CBlockFileInfo;
 class CBlockIndex;
+class CHashWriter;
 struct CTxIndexValue;
 struct CMaturityHeightKey;
 struct CMaturityHeightIteratorKey;
@@ -29,12 +42,14 @@ struct CAddressIndexKey;
 struct CAddressIndexValue;
 struct CAddressIndexIteratorKey;
 struct CAddressIndexIteratorHeightKey;
+struct CAddressAggregateValue;
 struct CTimestampIndexKey;
 struct CTimestampIndexIteratorKey;
 struct CTimestampBlockIndexKey;
 struct CTimestampBlockIndexValue;
 struct CSpentIndexKey;
 struct CSpentIndexValue;
+struct CBlockInputDeltas;
 
 class uint256;
 
@@ -44,6 +59,14 @@ static const int64_t nDefaultDbCache = 450;
 static const int64_t nMaxDbCache = sizeof(void*) > 4 ? 16384 : 1024;
 //! min. -dbcache in (MiB)
 static const int64_t nMinDbCache = 4;
+//! -coinsdbfilter default
+static const bool DEFAULT_COINSDB_FILTER = true;
+//! The existence filter is built with room for this many more entries than the db holds
+static const size_t COINSDB_FILTER_MIN_HEADROOM = 1 << 20;
+//! -asyncindexes default
+static const bool DEFAULT_ASYNC_INDEXES = true;
+//! -indexwriterqueue default: blocks whose index updates may wait to be written
+static const int DEFAULT_INDEX_WRITER_QUEUE = 64;
 
 static const std::string DEFAULT_INDEX_VERSION_STR = "0.0";
 static const std::string CURRENT_INDEX_VERSION_STR = "1.0";
@@ -73,6 +96,20 @@ struct CDiskTxPos : public CDiskBlockPos
     }
 };
 
+//! The payload of getscgenesisinfo for a sidechain, valid while its creation block is in the active chain
+struct CScGenesisInfo {
+    uint256 creationBlockHash;
+    std::vector<unsigned char> vData;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
+        READWRITE(creationBlockHash);
+        READWRITE(vData);
+    }
+};
+
 struct CTxIndexValue {
 
     static const int INVALID_MATURITY_HEIGHT = -1;
@@ -119,9 +156,106 @@ struct CTxIndexValue {
     }
 };
 
+/**
+ * The changes to the optional indexes (tx, maturity height, address, spent and timestamp) made by
+ * connecting or disconnecting a block, which CBlockTreeDB writes as one batch together with the
+ * best block of the indexes.
+ */
+struct CBlockIndexesUpdate
+{
+    //! The block the indexes are at once the update is written
+    uint256 hashBestBlock;
+    std::vector<std::pair<uint256, CTxIndexValue> > vTxIndex;
+    std::vector<std::pair<CMaturityHeightKey, CMaturityHeightValue> > vMaturityHeight;
+    std::vector<std::pair<CAddressIndexKey, CAddressIndexValue> > vAddressIndex;
+    //! Whether null address index values erase their entries, as on disconnect, or are written
+    bool fEraseNullAddressEntries = false;
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > vAddressUnspent;
+    std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> > vSpent;
+    //! The inputs of the block connected, by block hash, with the outputs they spend
+    std::vector<std::pair<uint256, CBlockInputDeltas> > vBlockInputDeltas;
+    //! Add a connected block to the timestamp index, at the logical timestamp following the one of its parent
+    bool fTimestamp = false;
+    unsigned int nTime = 0;
+    uint256 hashPrevBlock;
+};
+
+/**
+ * Statistics of the coins records of the chainstate db, kept up to date by every write and stored
+ * along with the best block, so that they are available without scanning the db. The set hash covers
+ * the same per-record data as the serialized hash of GetStats, but does not depend on the records order.
+ */
+class CCoinsSetStats
+{
+public:
+    //! The best block of the db the statistics refer to
+    uint256 hashBlock;
+    MuHash3072 muhash;
+    uint64_t nTransactions = 0;
+    uint64_t nTransactionOutputs = 0;
+    uint64_t nSerializedSize = 0;
+    CAmount nTotalAmount = 0;
+
+    void Add(const uint256 &txid, const CCoins &coins);
+    void Remove(const uint256 &txid, const CCoins &coins);
+    //! Merge the statistics of a disjoint set of records
+    CCoinsSetStats& operator+=(const CCoinsSetStats &other);
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
+        READWRITE(hashBlock);
+        READWRITE(muhash);
+        READWRITE(nTransactions);
+        READWRITE(nTransactionOutputs);
+        READWRITE(nSerializedSize);
+        READWRITE(nTotalAmount);
+    }
+};
+
 /** CCoinsView backed by the LevelDB coin database (chainstate/) */
 class CCoinsViewDB : public CCoinsView
 {
+private:
+    //! Protects the set statistics against the background writes
+    mutable CCriticalSection csSetStats;
+    CCoinsSetStats setStats;
+    //! Whether setStats matches the db contents; it doesn't in dbs written by older versions
+    bool fSetStatsValid;
+
+    void InitSetStats();
+    //! Compute the set statistics after writing mapCoins and queue them into batch, if they are valid
+    bool PrepareSetStats(CLevelDBBatch &batch, const CCoinsMap &mapCoins, const uint256 &hashBlock, CCoinsSetStats &statsNew) const;
+    void CommitSetStats(const CCoinsSetStats &statsNew);
+
+    /**
+     * In-memory cuckoo filter over the keys of the coins, sidechains and csw nullifiers records,
+     * so that lookups of missing entries are answered without reaching leveldb. Null when disabled
+     * or while being rebuilt, in which case every lookup goes to the db.
+     */
+    mutable boost::shared_mutex csExistenceFilter;
+    std::unique_ptr<CCuckooFilter> pExistenceFilter;
+    uint64_t nExistenceFilterK0, nExistenceFilterK1;
+    bool fExistenceFilter;
+
+    uint64_t ExistenceFilterHash(const char* pkey, size_t nSize) const;
+    template <typename K>
+    uint64_t ExistenceFilterHash(const K& key) const;
+    //! False if the db certainly does not hold key
+    template <typename K>
+    bool MayExist(const K& key) const;
+    //! Scan the db keys into a new filter, sized after their number
+    void RebuildExistenceFilter();
+    void InitExistenceFilter();
+    //! Collect the filter changes of a batch. The new keys are to be inserted before the batch is
+    //! written, the erased ones removed once it is, so that the filter never misses a db entry.
+    void PrepareExistenceFilter(const CCoinsMap &mapCoins, const CSidechainsMap& mapSidechains,
+                                const CCswNullifiersMap& cswNullifies,
+                                std::vector<uint64_t>& vInserted, std::vector<uint64_t>& vErased) const;
+    void InsertIntoExistenceFilter(const std::vector<uint64_t>& vHashes);
+    void EraseFromExistenceFilter(const std::vector<uint64_t>& vHashes);
+
 protected:
     CLevelDBWrapper db;
     CCoinsViewDB(std::string dbName, size_t nCacheSize, int maxOpenFiles, bool fMemory = false, bool fWipe = false);
@@ -141,6 +275,9 @@ public:
     uint256 GetBestAnchor()                                              const override;
     bool HaveCswNullifier(const uint256& scId,
                           const CFieldElement& nullifier)  const override;
+    //! The pairs the existence filter does not rule out are looked up in ascending key order, by a single iterator
+    void HaveCswNullifiers(const std::vector<std::pair<uint256, CFieldElement>>& keys,
+                           std::vector<bool>& vHave)       const override;
 
     bool BatchWrite(CCoinsMap &mapCoins,
                     const uint256 &hashBlock,
@@ -152,6 +289,113 @@ public:
                     CCswNullifiersMap& cswNullifies)                           override;
     bool GetStats(CCoinsStats &stats)                                    const override;
     void Dump_info() const;
+
+    const CLevelDBWrapper& GetLevelDB() const { return db; }
+
+    //! Add a raw db entry to the statistics and to the hash computed by GetStats; entries other than coins are skipped
+    static void AddEntryToStats(CHashWriter &ss, CCoinsStats &stats, const CDBSlice &slKey, const CDBSlice &slValue);
+
+    //! Iterator over the raw db entries, reading from an implicit snapshot taken on creation
+    CDBIterator *NewIterator() const;
+
+    //! Whether a raw db entry is part of a txoutset snapshot, i.e. is a chainstate record and not derived data
+    static bool IsSnapshotRecord(const CDBSlice &slKey);
+
+    //! Write raw entries of a txoutset snapshot, as returned by NewIterator. Only chainstate records are accepted.
+    //! The set statistics are invalidated, and have to be rebuilt once the import is complete.
+    bool WriteSnapshotEntries(const std::vector<std::pair<std::vector<unsigned char>, std::vector<unsigned char> > > &entries);
+
+    //! The statistics kept along with the best block; false if they have to be rebuilt
+    bool GetSetStats(CCoinsSetStats &stats) const;
+    //! Compute the set statistics with a full scan, spreading the records over nThreads by key range
+    bool ComputeSetStats(CCoinsSetStats &stats, unsigned int nThreads) const;
+    //! Recompute and store the set statistics. No other write may run meanwhile.
+    bool RebuildSetStats(unsigned int nThreads);
+
+    //! Same as BatchWrite, but leaves the passed maps untouched, so that they can be read while being written
+    bool WriteSnapshot(const CCoinsMap &mapCoins,
+                       const uint256 &hashBlock,
+                       const uint256 &hashAnchor,
+                       const CAnchorsMap &mapAnchors,
+                       const CNullifiersMap &mapNullifiers,
+                       const CSidechainsMap& mapSidechains,
+                       const CSidechainEventsMap& mapSidechainEvents,
+                       const CCswNullifiersMap& cswNullifies);
+};
+
+/**
+ * CCoinsView sitting on top of the coins db which performs the db writes on a background thread.
+ * BatchWrite freezes the passed entries into a snapshot, starts writing it and returns immediately;
+ * until the write is completed, lookups are served from the snapshot first, so the views above it
+ * keep a consistent picture of the chainstate. The best block marker is part of the same db batch,
+ * hence it only becomes visible on disk together with the entries it refers to.
+ * At most one write is in flight: a BatchWrite issued while another one is running waits for it.
+ */
+class CCoinsViewBackgroundFlush : public CCoinsViewBacked
+{
+private:
+    struct CSnapshot
+    {
+        CCoinsMap coins;
+        uint256 hashBlock;
+        uint256 hashAnchor;
+        CAnchorsMap anchors;
+        CNullifiersMap nullifiers;
+        CSidechainsMap sidechains;
+        CSidechainEventsMap sidechainEvents;
+        CCswNullifiersMap cswNullifiers;
+    };
+
+    CCoinsViewDB *db;
+
+    //! Protects snapshot against the writer thread clearing it
+    mutable CCriticalSection cs;
+    CSnapshot snapshot;
+    bool fSnapshot;
+
+    //! Result of the write in flight; invalid if none
+    std::future<bool> pendingWrite;
+    //! Set when a background write failed, and reported by the next Sync/BatchWrite
+    bool fWriteFailed;
+
+    bool WriteSnapshot();
+
+public:
+    CCoinsViewBackgroundFlush(CCoinsViewDB *dbIn);
+    ~CCoinsViewBackgroundFlush();
+
+    bool GetAnchorAt(const uint256 &rt, ZCIncrementalMerkleTree &tree) const override;
+    bool GetNullifier(const uint256 &nullifier)                        const override;
+    bool GetCoins(const uint256 &txid, CCoins &coins)                  const override;
+    bool HaveCoins(const uint256 &txid)                                const override;
+    bool HaveSidechain(const uint256& scId)                            const override;
+    bool GetSidechain(const uint256& scId, CSidechain& info)           const override;
+    bool HaveSidechainEvents(int height)                               const override;
+    bool GetSidechainEvents(int height, CSidechainEvents& scEvents)    const override;
+    void GetScIds(std::set<uint256>& scIdsList)                        const override;
+    uint256 GetBestBlock()                                             const override;
+    uint256 GetBestAnchor()                                            const override;
+    bool HaveCswNullifier(const uint256& scId,
+                          const CFieldElement &nullifier)              const override;
+    void HaveCswNullifiers(const std::vector<std::pair<uint256, CFieldElement>>& keys,
+                           std::vector<bool>& vHave)                   const override;
+    bool BatchWrite(CCoinsMap &mapCoins,
+                    const uint256 &hashBlock,
+                    const uint256 &hashAnchor,
+                    CAnchorsMap &mapAnchors,
+                    CNullifiersMap &mapNullifiers,
+                    CSidechainsMap& mapSidechains,
+                    CSidechainEventsMap& mapCeasedScs,
+                    CCswNullifiersMap& cswNullifiers)                  override;
+    bool GetStats(CCoinsStats &stats)                                  const override;
+
+    //! Wait for the write in flight, if any, to be on disk. Returns false if a background write failed.
+    bool Sync();
+
+    //! Whether a write is in flight
+    bool IsWriting() const;
+
+    CCoinsViewDB *GetDB() const { return db; }
 };
 
 /** Access to the block database (blocks/index/) */
@@ -159,11 +403,42 @@ class CBlockTreeDB : public CLevelDBWrapper
 {
 public:
     CBlockTreeDB(size_t nCacheSize, int maxOpenFiles, bool fMemory = false, bool fWipe = false);
+    ~CBlockTreeDB();
 private:
     CBlockTreeDB(const CBlockTreeDB&);
     void operator=(const CBlockTreeDB&);
+    bool UpdateAddressAggregates(CLevelDBBatch& batch, const std::vector<std::pair<CAddressIndexKey, CAddressIndexValue> > &vect);
+
+    /**
+     * The index writer thread, which writes the queued index updates in order, so that connecting
+     * a block does not wait for them. Reads of the indexes first wait for the updates queued before
+     * them, hence the callers see their own writes.
+     */
+    std::mutex csIndexWriter;
+    std::condition_variable condIndexQueued;
+    std::condition_variable condIndexWritten;
+    std::deque<std::unique_ptr<CBlockIndexesUpdate> > indexQueue;
+    //! Updates queued and written since startup; an update is done once nIndexWritten reaches its number
+    uint64_t nIndexQueued = 0;
+    uint64_t nIndexWritten = 0;
+    size_t nMaxIndexQueue = DEFAULT_INDEX_WRITER_QUEUE;
+    bool fIndexWriteFailed = false;
+    bool fStopIndexWriter = false;
+    std::thread indexWriterThread;
+
+    void ThreadIndexWriter();
+    bool WriteIndexesUpdate(const CBlockIndexesUpdate& update);
+    //! Wait for the updates queued so far; a no-op on the writer thread, which reads what it wrote
+    void AwaitIndexes();
+
+    CMaturitySchedule maturitySchedule;
+
 public:
+    //! Whether per-address aggregates are kept along with the address index (only in databases built with them)
+    bool fAddressAggregates = false;
+
     bool WriteBatchSync(const std::vector<std::pair<int, const CBlockFileInfo*> >& fileInfo, int nLastFile, const std::vector<const CBlockIndex*>& blockinfo);
+    bool WriteBlockIndexEntries(const std::vector<CDiskBlockIndex>& entries);
     bool ReadBlockFileInfo(int nFile, CBlockFileInfo &fileinfo);
     bool ReadLastBlockFile(int &nFile);
     bool WriteReindexing(bool fReindex);
@@ -172,10 +447,14 @@ public:
     bool ReadFastReindexing(bool &fReindexFast);
     bool ReadTxIndex(const uint256 &txid, CTxIndexValue &val);
     bool WriteTxIndex(const std::vector<std::pair<uint256, CTxIndexValue> > &list);
+    //! Read from the in-memory schedule once loaded, from the db otherwise
     bool ReadMaturityHeightIndex(int height, std::vector<CMaturityHeightKey> &val);
+    //! Load the maturity height index into the in-memory schedule, which the index updates then keep up to date
+    bool LoadMaturityHeightIndex();
     bool UpdateMaturityHeightIndex(const std::vector<std::pair<CMaturityHeightKey, CMaturityHeightValue>> &maturityHeightList);
 
     bool ReadSpentIndex(CSpentIndexKey &key, CSpentIndexValue &value);
+    bool ReadBlockInputDeltas(const uint256 &hash, CBlockInputDeltas &deltas);
     bool UpdateSpentIndex(const std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> >&vect);
     bool UpdateAddressUnspentIndex(const std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue > >&vect);
     bool ReadAddressUnspentIndex(uint160 addressHash, AddressType type,
@@ -186,17 +465,39 @@ public:
     bool ReadAddressIndex(uint160 addressHash, AddressType type,
                           std::vector<std::pair<CAddressIndexKey, CAddressIndexValue> > &addressIndex,
                           int start = 0, int end = 0);
+    //! Read the entries of at most nMaxTxs transactions following (or, if fReverse, preceding) pCursor,
+    //! the last entry of the previous page. fMore is set if further entries are left.
+    bool ReadAddressIndexPage(uint160 addressHash, AddressType type, const CAddressIndexKey* pCursor, bool fReverse,
+                              size_t nMaxTxs, int start, int end,
+                              std::vector<std::pair<CAddressIndexKey, CAddressIndexValue> > &addressIndex, bool &fMore);
+    bool ReadAddressAggregate(uint160 addressHash, AddressType type, CAddressAggregateValue &value);
     bool WriteTimestampIndex(const CTimestampIndexKey &timestampIndex);
     bool ReadTimestampIndex(const unsigned int &high, const unsigned int &low, const bool fActiveOnly, std::vector<std::pair<uint256, unsigned int> > &vect);
     bool WriteTimestampBlockIndex(const CTimestampBlockIndexKey &blockhashIndex, const CTimestampBlockIndexValue &logicalts);
     bool ReadTimestampBlockIndex(const uint256 &hash, unsigned int &logicalTS);
     bool blockOnchainActive(const uint256 &hash);
 
+    bool ReadScGenesisInfo(const uint256 &scId, CScGenesisInfo &info);
+    bool WriteScGenesisInfo(const uint256 &scId, const CScGenesisInfo &info);
+
     bool WriteFlag(const std::string &name, bool fValue);
     bool ReadFlag(const std::string &name, bool &fValue);
     bool WriteString(const std::string &name, std::string fValue);
     bool ReadString(const std::string &name, std::string &fValue);
-    bool LoadBlockIndexGuts();
+    //! Load mapBlockIndex from the db, decoding and checking the entries on nThreads threads
+    bool LoadBlockIndexGuts(unsigned int nThreads = 1);
+
+    //! Write the index updates of blocks on a thread of their own, at most nMaxQueue blocks behind
+    void StartIndexWriter(size_t nMaxQueue);
+    //! Write all the queued updates and stop the writer; updates are then written as they are queued
+    void StopIndexWriter();
+    //! Queue the index updates of a block, waiting if the queue is full. False if a previous write failed.
+    bool QueueIndexesUpdate(std::unique_ptr<CBlockIndexesUpdate> update);
+    //! Wait until the updates queued so far are written. False if a write failed.
+    bool SyncIndexes();
+    //! The block whose connection was the last one written to the indexes, null if unknown
+    uint256 ReadIndexesBestBlock();
+    size_t GetIndexQueueSize();
 };
 
 #endif // BITCOIN_TXDB_H
@@ -8,30 +8,57 @@
 #include "clientversion.h"
 #include "consensus/consensus.h"
 #include "consensus/validation.h"
+#include "hash.h"
 #include "main.h"
 #include "policy/fees.h"
+#include "random.h"
 #include "streams.h"
 #include "util.h"
+#include "utilstrencodings.h"
 #include "utilmoneystr.h"
 #include "version.h"
 #include "validationinterface.h"
 #include <undo.h>
 
-#include <stack>
+#include <algorithm>
 #include <unordered_set>
 
 CMemPoolEntry::CMemPoolEntry():
-    nFee(0), nModSize(0), nUsageSize(0), nTime(0), dPriority(0.0)
+    nFee(0), nModSize(0), nUsageSize(0), nTime(0), dPriority(0.0), nSequence(0)
 {
     nHeight = MEMPOOL_HEIGHT;
 }
 
 CMemPoolEntry::CMemPoolEntry(const CAmount& _nFee, int64_t _nTime, double _dPriority, unsigned int _nHeight) :
-    nFee(_nFee), nModSize(0), nUsageSize(0), nTime(_nTime), dPriority(_dPriority), nHeight(_nHeight)
+    nFee(_nFee), nModSize(0), nUsageSize(0), nTime(_nTime), dPriority(_dPriority), nHeight(_nHeight), nSequence(0)
 {
 }
 
-CTxMemPoolEntry::CTxMemPoolEntry(): nTxSize(0), hadNoDependencies(false)
+// the default entries of the maps, as those of miner.cpp, share an empty object
+static const std::shared_ptr<const CTransaction>& EmptyTx()
+{
+    static const std::shared_ptr<const CTransaction> emptyTx = std::make_shared<const CTransaction>();
+    return emptyTx;
+}
+
+static const std::shared_ptr<const CScCertificate>& EmptyCertificate()
+{
+    static const std::shared_ptr<const CScCertificate> emptyCert = std::make_shared<const CScCertificate>();
+    return emptyCert;
+}
+
+template <typename T>
+static const std::shared_ptr<const std::string>& EncodeHex(std::shared_ptr<const std::string>& pHex, const T& obj)
+{
+    if (!pHex) {
+        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+        ss << obj;
+        pHex = std::make_shared<const std::string>(HexStr(ss.begin(), ss.end()));
+    }
+    return pHex;
+}
+
+CTxMemPoolEntry::CTxMemPoolEntry(): tx(EmptyTx()), nTxSize(0), hadNoDependencies(false)
 {
 }
 
@@ -39,16 +66,21 @@ CTxMemPoolEntry::CTxMemPoolEntry(const CTransaction& _tx, const CAmount& _nFee,
                                  int64_t _nTime, double _dPriority,
                                  unsigned int _nHeight, bool poolHasNoInputsOf):
     CMemPoolEntry(_nFee, _nTime, _dPriority, _nHeight),
-    tx(_tx), hadNoDependencies(poolHasNoInputsOf)
+    tx(std::make_shared<const CTransaction>(_tx)), hadNoDependencies(poolHasNoInputsOf)
 {
-    nTxSize = tx.GetSerializeSize(SER_NETWORK, PROTOCOL_VERSION);
-    nModSize = tx.CalculateModifiedSize(nTxSize);
-    nUsageSize = RecursiveDynamicUsage(tx);
+    nTxSize = tx->GetSerializeSize(SER_NETWORK, PROTOCOL_VERSION);
+    nModSize = tx->CalculateModifiedSize(nTxSize);
+    nUsageSize = RecursiveDynamicUsage(*tx) + memusage::DynamicUsage(tx);
+}
+
+std::shared_ptr<const std::string> CTxMemPoolEntry::GetHex() const
+{
+    return EncodeHex(pHex, *tx);
 }
 
 double CTxMemPoolEntry::GetPriority(unsigned int currentHeight) const
 {
-    CAmount nValueIn = tx.GetValueOut()+nFee;
+    CAmount nValueIn = tx->GetValueOut()+nFee;
     // tx.GetValueOut() + nFee indirectly account for csw inputs amounts too.
 
     double deltaPriority = ((double)(currentHeight-nHeight)*nValueIn)/nModSize;
@@ -58,22 +90,27 @@ double CTxMemPoolEntry::GetPriority(unsigned int currentHeight) const
     return dResult;
 }
 
-CCertificateMemPoolEntry::CCertificateMemPoolEntry(): nCertificateSize(0){}
+CCertificateMemPoolEntry::CCertificateMemPoolEntry(): cert(EmptyCertificate()), nCertificateSize(0){}
 
 CCertificateMemPoolEntry::CCertificateMemPoolEntry(const CScCertificate& _cert, const CAmount& _nFee,
                                  int64_t _nTime, double _dPriority,
                                  unsigned int _nHeight):
     CMemPoolEntry(_nFee, _nTime, _dPriority, _nHeight),
-    cert(_cert) 
+    cert(std::make_shared<const CScCertificate>(_cert))
+{
+    nCertificateSize = cert->GetSerializeSize(SER_NETWORK, PROTOCOL_VERSION);
+    nModSize = cert->CalculateModifiedSize(nCertificateSize);
+    nUsageSize = RecursiveDynamicUsage(*cert) + memusage::DynamicUsage(cert);
+}
+
+std::shared_ptr<const std::string> CCertificateMemPoolEntry::GetHex() const
 {
-    nCertificateSize = cert.GetSerializeSize(SER_NETWORK, PROTOCOL_VERSION);
-    nModSize = cert.CalculateModifiedSize(nCertificateSize);
-    nUsageSize = RecursiveDynamicUsage(cert);
+    return EncodeHex(pHex, *cert);
 }
 
 double CCertificateMemPoolEntry::GetPriority(unsigned int currentHeight) const
 {
-    CAmount nValueIn = cert.GetValueOfChange()+nFee;
+    CAmount nValueIn = cert->GetValueOfChange()+nFee;
     double deltaPriority = ((double)(currentHeight-nHeight)*nValueIn)/nModSize;
     double dResult = dPriority + deltaPriority;
     LogPrint("mempool", "%s():%d - prioIn[%22.8f] + delta[%22.8f] = prioOut[%22.8f]\n",
@@ -81,7 +118,7 @@ double CCertificateMemPoolEntry::GetPriority(unsigned int currentHeight) const
     return dResult;
 }
 
-const std::map<int64_t, uint256>::const_reverse_iterator CSidechainMemPoolEntry::GetTopQualityCert() const
+const CSidechainMemPoolEntry::CertsByQuality::const_reverse_iterator CSidechainMemPoolEntry::GetTopQualityCert() const
 {
     return mBackwardCertificates.crbegin();
 }
@@ -101,11 +138,11 @@ void CSidechainMemPoolEntry::EraseCert(const uint256& hash)
     }
 }
 
-const std::map<int64_t, uint256>::const_iterator CSidechainMemPoolEntry::GetCert(const uint256& hash) const
+const CSidechainMemPoolEntry::CertsByQuality::const_iterator CSidechainMemPoolEntry::GetCert(const uint256& hash) const
 {
     // Find certificate with given hash in mapSidechains
     return std::find_if(mBackwardCertificates.begin( ), mBackwardCertificates.end(),
-        [&hash](const std::map<int64_t, uint256>::value_type& item) { return hash == item.second; });
+        [&hash](const CertsByQuality::value_type& item) { return hash == item.second; });
 }
 
 bool CSidechainMemPoolEntry::HasCert(const uint256& hash) const
@@ -154,6 +191,12 @@ void CTxMemPool::AddTransactionsUpdated(unsigned int n)
     nTransactionsUpdated += n;
 }
 
+CAmount CTxMemPool::GetFeesAdded() const
+{
+    LOCK(cs);
+    return nFeesAdded;
+}
+
 
 bool CTxMemPool::addUnchecked(const uint256& hash, const CTxMemPoolEntry &entry, bool fCurrentEstimate)
 {
@@ -171,8 +214,10 @@ bool CTxMemPool::addUnchecked(const uint256& hash, const CTxMemPoolEntry &entry,
     mapTx[hash] = entry;
     const CTransaction& tx = mapTx[hash].GetTx();
 
-    mapRecentlyAddedTxBase[tx.GetHash()] = std::shared_ptr<CTransactionBase>(new CTransaction(tx));
+    mapRecentlyAddedTxBase[tx.GetHash()] = mapTx[hash].GetSharedTx();
     nRecentlyAddedSequence += 1;
+    logEvent(CMemPoolEvent::Type::ADDED, hash, false, MemPoolRemovalReason::UNKNOWN);
+    mapTx[hash].SetSequence(nEventSequence);
 
     for (unsigned int i = 0; i < tx.GetVin().size(); i++) {
         mapNextTx[tx.GetVin()[i].prevout] = CInPoint(&tx, i);
@@ -188,6 +233,9 @@ bool CTxMemPool::addUnchecked(const uint256& hash, const CTxMemPoolEntry &entry,
         if (mapSidechains.count(csw.scId) == 0)
             LogPrint("mempool", "%s():%d - adding tx [%s] in mapSidechain [%s], cswNullifiers\n",
                      __func__, __LINE__, hash.ToString(), csw.scId.ToString());
+        // the csw inputs of a sidechain in the mempool are capped, hence their nullifiers are allocated at once
+        if (mapSidechains[csw.scId].cswNullifiers.empty())
+            mapSidechains[csw.scId].cswNullifiers.reserve(Params().ScMaxNumberOfCswInputsInMempool());
         mapSidechains[csw.scId].cswNullifiers[csw.nullifier] = tx.GetHash();
         mapSidechains[csw.scId].cswTotalAmount += csw.nValue;
     }
@@ -209,9 +257,12 @@ bool CTxMemPool::addUnchecked(const uint256& hash, const CTxMemPoolEntry &entry,
         mapSidechains[btr.scId].mcBtrsTxHashes.insert(hash);
     }
 
+    addPackageLinks(hash, tx, entry);
+
     nTransactionsUpdated++;
     totalTxSize += entry.GetTxSize();
     cachedInnerUsage += entry.DynamicMemoryUsage();
+    nFeesAdded += entry.GetFee();
     minerPolicyEstimator->processTransaction(entry, fCurrentEstimate);
 
     return true;
@@ -230,8 +281,10 @@ bool CTxMemPool::addUnchecked(const uint256& hash, const CCertificateMemPoolEntr
     mapCertificate[hash] = entry;
     const CScCertificate& cert = mapCertificate[hash].GetCertificate();
 
-    mapRecentlyAddedTxBase[cert.GetHash()] = std::shared_ptr<CTransactionBase>(new CScCertificate(cert));
+    mapRecentlyAddedTxBase[cert.GetHash()] = mapCertificate[hash].GetSharedCertificate();
     nRecentlyAddedSequence += 1;
+    logEvent(CMemPoolEvent::Type::ADDED, hash, true, MemPoolRemovalReason::UNKNOWN);
+    mapCertificate[hash].SetSequence(nEventSequence);
 
     for (unsigned int i = 0; i < cert.GetVin().size(); i++)
         mapNextTx[cert.GetVin()[i].prevout] = CInPoint(&cert, i);
@@ -243,15 +296,37 @@ bool CTxMemPool::addUnchecked(const uint256& hash, const CCertificateMemPoolEntr
     assert(sideChain.mBackwardCertificates.count(cert.quality) == 0);
     sideChain.mBackwardCertificates[cert.quality] = hash;
 
+    addPackageLinks(hash, cert, entry);
+
     nCertificatesUpdated++;
     totalCertificateSize += entry.GetCertificateSize();
     cachedInnerUsage += entry.DynamicMemoryUsage();
-    // TODO cert: for the time being skip the part on policy estimator, certificates currently have maximum priority
-    // minerPolicyEstimator->processTransaction(entry, fCurrentEstimate);
+    nFeesAdded += entry.GetFee();
+    // certificates have maximum priority in blocks, so their fee rates are tracked apart from the transactions ones
+    minerPolicyEstimator->processCertificate(entry, fCurrentEstimate);
     LogPrint("mempool", "%s():%d - cert [%s] added in mempool\n", __func__, __LINE__, hash.ToString() );
     return true;
 }
 
+CMempoolIndexHasher::CMempoolIndexHasher() : k0(GetRand(std::numeric_limits<uint64_t>::max())),
+                                             k1(GetRand(std::numeric_limits<uint64_t>::max())) {}
+
+size_t CMempoolIndexHasher::operator()(const std::pair<uint160, AddressType>& address) const
+{
+    return CSipHasher(k0, k1).Write(static_cast<uint64_t>(address.second))
+                             .Write(address.first.begin(), address.first.size()).Finalize();
+}
+
+size_t CMempoolIndexHasher::operator()(const CMempoolAddressDeltaKey& key) const
+{
+    return SipHash13Uint256(k0, k1, key.txhash) ^ ((uint64_t(key.index) << 1) | (key.spending != 0));
+}
+
+size_t CMempoolIndexHasher::operator()(const CSpentIndexKey& key) const
+{
+    return SipHash13Uint256(k0, k1, key.txid) ^ key.outputIndex;
+}
+
 void CTxMemPool::addAddressIndex(const CTransactionBase &txBase, int64_t nTime, const CCoinsViewCache &view)
 {
     LOCK(cs);
@@ -269,7 +344,9 @@ void CTxMemPool::addAddressIndex(const CTransactionBase &txBase, int64_t nTime,
 
         CMempoolAddressDeltaKey key(addressType, prevout.scriptPubKey.AddressHash(), txBaseHash, j, 1);
         CMempoolAddressDelta delta(nTime, prevout.nValue * -1, input.prevout.hash, input.prevout.n);
-        mapAddress.insert(std::make_pair(key, delta));
+        addressDeltaMap::iterator bucket = mapAddress.try_emplace(std::make_pair(key.addressBytes, key.type),
+                                                                  0, mapAddress.hash_function()).first;
+        bucket->second.insert(std::make_pair(key, delta));
         inserted.push_back(key);
     }
 
@@ -282,14 +359,14 @@ void CTxMemPool::addAddressIndex(const CTransactionBase &txBase, int64_t nTime,
         const CScCertificate* cert = dynamic_cast<const CScCertificate*>(&txBase);
         assert(cert != nullptr);
 
-        CSidechain sidechain;
         // At this point we have a view that is NOT backed by the mempool, but we must find the sidechain
         // in the normal chain view as no certificate can be published until the sidechain creation is
         // included in a block (also for non-ceasing sidechains, due to the lastInclusionHeight set at creation).
-        assert(view.GetSidechain(cert->GetScId(), sidechain));
+        const CSidechain* const pSidechain = view.AccessSidechain(cert->GetScId());
+        assert(pSidechain != nullptr);
 
         const uint256& topQualHash = mapSidechains.at(cert->GetScId()).GetTopQualityCert()->second;
-        bool isTopQualityCert = (topQualHash == cert->GetHash()) || sidechain.isNonCeasing();
+        bool isTopQualityCert = (topQualHash == cert->GetHash()) || pSidechain->isNonCeasing();
 
         // set certificate bwts status
         certBwtStatus = isTopQualityCert ?
@@ -304,10 +381,10 @@ void CTxMemPool::addAddressIndex(const CTransactionBase &txBase, int64_t nTime,
 
         // if we have also other certificates for this sidechain and this is the top quality, we must modify the entry which was the
         // previous top quality cert (but not for non-ceasing sidechains)
-        if (!sidechain.isNonCeasing() && (mapSidechains.at(cert->GetScId()).mBackwardCertificates.size() > 1) && isTopQualityCert)
+        if (!pSidechain->isNonCeasing() && (mapSidechains.at(cert->GetScId()).mBackwardCertificates.size() > 1) && isTopQualityCert)
         {
             // Entries are ordered by quality, therefore the former top-quality is the second starting from the bottom
-            std::map<int64_t, uint256>::const_reverse_iterator mempoolCertEntryIt =
+            CSidechainMemPoolEntry::CertsByQuality::const_reverse_iterator mempoolCertEntryIt =
                 mapSidechains.at(cert->GetScId()).mBackwardCertificates.crbegin();
 
             const uint256& certSuperseededHash = (++mempoolCertEntryIt)->second;
@@ -326,7 +403,7 @@ void CTxMemPool::addAddressIndex(const CTransactionBase &txBase, int64_t nTime,
                 const AddressType addressType = fromScriptTypeToAddressType(scriptType);
 
                 CMempoolAddressDeltaKey key(addressType, out.scriptPubKey.AddressHash(), certSuperseededHash, m, 0);
-                mapAddress[key].outStatus = CMempoolAddressDelta::OutputStatus::LOW_QUALITY_CERT_BACKWARD_TRANSFER;
+                setAddressDeltaOutStatus(key, CMempoolAddressDelta::OutputStatus::LOW_QUALITY_CERT_BACKWARD_TRANSFER);
 
             }
         }
@@ -350,7 +427,9 @@ void CTxMemPool::addAddressIndex(const CTransactionBase &txBase, int64_t nTime,
         const AddressType addressType = fromScriptTypeToAddressType(scriptType);
 
         CMempoolAddressDeltaKey key(addressType, out.scriptPubKey.AddressHash(), txBaseHash, k, 0);
-        mapAddress.insert(std::make_pair(key, CMempoolAddressDelta(nTime, out.nValue, outStatus)));
+        addressDeltaMap::iterator bucket = mapAddress.try_emplace(std::make_pair(key.addressBytes, key.type),
+                                                                  0, mapAddress.hash_function()).first;
+        bucket->second.insert(std::make_pair(key, CMempoolAddressDelta(nTime, out.nValue, outStatus)));
         inserted.push_back(key);
     }
 
@@ -377,11 +456,21 @@ void CTxMemPool::updateTopQualCertAddressIndex(const uint256& scid)
             const AddressType addressType = fromScriptTypeToAddressType(scriptType);
 
             CMempoolAddressDeltaKey key(addressType, out.scriptPubKey.AddressHash(), topQualHash, m, 0);
-            mapAddress[key].outStatus = CMempoolAddressDelta::OutputStatus::TOP_QUALITY_CERT_BACKWARD_TRANSFER;
+            setAddressDeltaOutStatus(key, CMempoolAddressDelta::OutputStatus::TOP_QUALITY_CERT_BACKWARD_TRANSFER);
         }
     }
 }
 
+void CTxMemPool::setAddressDeltaOutStatus(const CMempoolAddressDeltaKey& key, CMempoolAddressDelta::OutputStatus outStatus)
+{
+    addressDeltaMap::iterator bucket = mapAddress.find(std::make_pair(key.addressBytes, key.type));
+    if (bucket == mapAddress.end())
+        return;
+    addressDeltaBucket::iterator it = bucket->second.find(key);
+    if (it != bucket->second.end())
+        it->second.outStatus = outStatus;
+}
+
 bool CTxMemPool::getAddressIndex(std::vector<std::pair<uint160, AddressType> > &addresses,
                                  std::vector<std::pair<CMempoolAddressDeltaKey, CMempoolAddressDelta> > &results)
 {
@@ -389,12 +478,18 @@ bool CTxMemPool::getAddressIndex(std::vector<std::pair<uint160, AddressType> > &
         return false;
         
     LOCK(cs);
-    for (const auto& [addressHash, addressType] : addresses) {
-        addressDeltaMap::iterator ait = mapAddress.lower_bound(CMempoolAddressDeltaKey(addressType, addressHash));
-        while (ait != mapAddress.end() && (*ait).first.addressBytes == addressHash && (*ait).first.type == addressType) {
-            results.push_back(*ait);
-            ait++;
-        }
+    for (const auto& address : addresses) {
+        addressDeltaMap::const_iterator bucket = mapAddress.find(address);
+        if (bucket == mapAddress.end())
+            continue;
+        // buckets are unordered, results keep the key order of the former ordered index
+        size_t nFirst = results.size();
+        results.insert(results.end(), bucket->second.begin(), bucket->second.end());
+        std::sort(results.begin() + nFirst, results.end(),
+                  [](const std::pair<CMempoolAddressDeltaKey, CMempoolAddressDelta>& a,
+                     const std::pair<CMempoolAddressDeltaKey, CMempoolAddressDelta>& b) {
+                      return CMempoolAddressDeltaKeyCompare()(a.first, b.first);
+                  });
     }
     return true;
 }
@@ -405,9 +500,13 @@ bool CTxMemPool::removeAddressIndex(const uint256& txBaseHash)
     addressDeltaMapInserted::iterator it = mapAddressInserted.find(txBaseHash);
 
     if (it != mapAddressInserted.end()) {
-        std::vector<CMempoolAddressDeltaKey> keys = (*it).second;
-        for (std::vector<CMempoolAddressDeltaKey>::iterator mit = keys.begin(); mit != keys.end(); mit++) {
-            mapAddress.erase(*mit);
+        for (const CMempoolAddressDeltaKey& key : it->second) {
+            addressDeltaMap::iterator bucket = mapAddress.find(std::make_pair(key.addressBytes, key.type));
+            if (bucket == mapAddress.end())
+                continue;
+            bucket->second.erase(key);
+            if (bucket->second.empty())
+                mapAddress.erase(bucket);
         }
         mapAddressInserted.erase(it);
     }
@@ -458,9 +557,8 @@ bool CTxMemPool::removeSpentIndex(const uint256& txBaseHash)
     mapSpentIndexInserted::iterator it = mapSpentInserted.find(txBaseHash);
 
     if (it != mapSpentInserted.end()) {
-        std::vector<CSpentIndexKey> keys = (*it).second;
-        for (std::vector<CSpentIndexKey>::iterator mit = keys.begin(); mit != keys.end(); mit++) {
-            mapSpent.erase(*mit);
+        for (const CSpentIndexKey& key : it->second) {
+            mapSpent.erase(key);
         }
         mapSpentInserted.erase(it);
     }
@@ -511,6 +609,10 @@ std::vector<uint256> CTxMemPool::mempoolDependenciesFrom(const CTransactionBase&
     std::deque<uint256> toVisit{res.begin(), res.end()};
     res.clear();
 
+    // hashes ever pushed to toVisit (i.e. either still in toVisit or already in res)
+    std::unordered_set<uint256> queued{toVisit.begin(), toVisit.end()};
+    std::unordered_set<uint256> inRes;
+
     while(!toVisit.empty())
     {
         const CTransactionBase* pCurrentNode = nullptr;
@@ -523,13 +625,12 @@ std::vector<uint256> CTxMemPool::mempoolDependenciesFrom(const CTransactionBase&
             assert(pCurrentNode);
 
         toVisit.pop_back();
-        if (std::find(res.begin(), res.end(), pCurrentNode->GetHash()) == res.end())
+        if (inRes.insert(pCurrentNode->GetHash()).second)
             res.push_back(pCurrentNode->GetHash());
 
         std::vector<uint256> directAncestors = mempoolDirectDependenciesFrom(*pCurrentNode);
         for(const uint256& ancestor : directAncestors) {
-            if ( (std::find(toVisit.begin(), toVisit.end(), ancestor) == toVisit.end()) &&
-                 (std::find(res.begin(), res.end(), ancestor) == res.end()))
+            if (queued.insert(ancestor).second)
                 toVisit.push_front(ancestor);
         }
     }
@@ -585,6 +686,10 @@ std::vector<uint256> CTxMemPool::mempoolDependenciesOf(const CTransactionBase& o
     std::deque<uint256> toVisit{res.begin(), res.end()};
     res.clear();
 
+    // hashes ever pushed to toVisit (i.e. either still in toVisit or already in res)
+    std::unordered_set<uint256> queued{toVisit.begin(), toVisit.end()};
+    std::unordered_set<uint256> inRes;
+
     while(!toVisit.empty())
     {
         const CTransactionBase * pCurrentRoot = nullptr;
@@ -597,95 +702,330 @@ std::vector<uint256> CTxMemPool::mempoolDependenciesOf(const CTransactionBase& o
             assert(pCurrentRoot);
 
         toVisit.pop_front();
-        if (std::find(res.begin(), res.end(), pCurrentRoot->GetHash()) == res.end())
+        if (inRes.insert(pCurrentRoot->GetHash()).second)
             res.push_back(pCurrentRoot->GetHash());
 
         std::vector<uint256> directDescendants = mempoolDirectDependenciesOf(*pCurrentRoot);
         for(const uint256& dep : directDescendants)
-            if ((std::find(toVisit.begin(), toVisit.end(),dep) == toVisit.end()) &&
-                (std::find(res.begin(), res.end(),dep) == res.end()))
+            if (queued.insert(dep).second)
                 toVisit.push_front(dep);
     }
 
     return res;
 }
 
-std::pair<CRawFeeRate, std::vector<uint256>> CTxMemPool::avgFeeRateWithDeps(const uint256& rootTx, const std::vector<CTxIn>& vin, const bool certificatesAllowed, std::unordered_map<uint256, CRawFeeRate>& cache) const
+void CTxMemPool::calculateAncestors(const uint256& hash, std::set<uint256>& ancestors) const
 {
-    // depth first graph traversal with cache
-    std::pair<CRawFeeRate, std::vector<uint256>> res;
-    std::stack<std::pair<uint256, bool>> to_visit;
-    std::unordered_set<uint256> already_visited;
-    to_visit.push({rootTx, false});
-    while (!res.first.isMax() && !to_visit.empty()) {
-        std::pair<uint256, bool>& curr = to_visit.top();
-        const uint256& curr_hash = curr.first;
-        CRawFeeRate curr_rate;
-        if (cache.find(curr_hash) != cache.end()) {
-            curr_rate = cache.at(curr_hash);
-        }
-        else {
-            bool is_certificate = mapCertificate.find(curr_hash) != mapCertificate.end();
-            if (!curr.second) {
-                // First explore descendants
-                std::vector<uint256> deps = is_certificate ?
-                                                mempoolDirectDependenciesOf(mapCertificate.at(curr_hash).GetCertificate())
-                                                : mempoolDirectDependenciesOf(mapTx.at(curr_hash).GetTx());
-                for (uint256& hash: deps) {
-                    auto ires = already_visited.insert(std::move(hash));
-                    if (ires.second) {
-                        to_visit.push({*ires.first, false});
-                    }
-                }
-                curr.second = true;
-                continue;
-            }
+    AssertLockHeld(cs);
+    std::vector<uint256> toVisit{hash};
+    while (!toVisit.empty())
+    {
+        const CMemPoolPackageInfo& info = mapPackages.at(toVisit.back());
+        toVisit.pop_back();
+        for (const uint256& parent : info.parents)
+            if (ancestors.insert(parent).second)
+                toVisit.push_back(parent);
+    }
+}
 
-            // Then process the feerate
-            bool is_ancestor = false;
-            for(const auto& input : vin) {
-                if (input.prevout.hash == curr_hash) {
-                    is_ancestor = true;
-                    break;
-                }
-            }
-            if (is_ancestor || (is_certificate && !certificatesAllowed)) {
-                LogPrint("mempool", "%s():%d - Setting max fee for %s\n", __func__, __LINE__, curr_hash.ToString());
-                curr_rate = CRawFeeRate(CRawFeeRate::MAX_FEE, 1);
-            }
-            else {
-                const CMemPoolEntry* entry = is_certificate ?
-                                                dynamic_cast<const CMemPoolEntry*>(&mapCertificate.at(curr_hash))
-                                                : dynamic_cast<const CMemPoolEntry*>(&mapTx.at(curr_hash));
-                curr_rate = CRawFeeRate(entry->GetFee(), entry->GetSize());
+void CTxMemPool::calculateDescendants(const uint256& hash, std::set<uint256>& descendants) const
+{
+    AssertLockHeld(cs);
+    std::vector<uint256> toVisit{hash};
+    while (!toVisit.empty())
+    {
+        const CMemPoolPackageInfo& info = mapPackages.at(toVisit.back());
+        toVisit.pop_back();
+        for (const uint256& child : info.children)
+            if (descendants.insert(child).second)
+                toVisit.push_back(child);
+    }
+}
+
+void CTxMemPool::updateAncestorState(const uint256& hash)
+{
+    AssertLockHeld(cs);
+    CMemPoolPackageInfo& info = mapPackages.at(hash);
+    std::set<uint256> ancestors;
+    calculateAncestors(hash, ancestors);
+
+    info.nCountWithAncestors = 1;
+    info.nSizeWithAncestors = info.nSize;
+    info.nFeesWithAncestors = info.nFee;
+    for (const uint256& ancestor : ancestors)
+    {
+        const CMemPoolPackageInfo& ancestorInfo = mapPackages.at(ancestor);
+        info.nCountWithAncestors++;
+        info.nSizeWithAncestors += ancestorInfo.nSize;
+        info.nFeesWithAncestors += ancestorInfo.nFee;
+    }
+}
+
+void CTxMemPool::updateDescendantState(const uint256& hash)
+{
+    AssertLockHeld(cs);
+    CMemPoolPackageInfo& info = mapPackages.at(hash);
+    std::set<uint256> descendants;
+    calculateDescendants(hash, descendants);
+
+    setDescendantScore.erase(std::make_pair(info.GetDescendantFeeRate(), hash));
+    info.nCountWithDescendants = 1;
+    info.nSizeWithDescendants = info.nSize;
+    info.nFeesWithDescendants = info.nFee;
+    info.nCertsWithDescendants = info.fCertificate ? 1 : 0;
+    for (const uint256& descendant : descendants)
+    {
+        const CMemPoolPackageInfo& descendantInfo = mapPackages.at(descendant);
+        info.nCountWithDescendants++;
+        info.nSizeWithDescendants += descendantInfo.nSize;
+        info.nFeesWithDescendants += descendantInfo.nFee;
+        info.nCertsWithDescendants += descendantInfo.fCertificate ? 1 : 0;
+    }
+    setDescendantScore.insert(std::make_pair(info.GetDescendantFeeRate(), hash));
+}
+
+void CTxMemPool::addPackageLinks(const uint256& hash, const CTransactionBase& root, const CMemPoolEntry& entry)
+{
+    // Must be called once root is already registered in mapTx/mapCertificate, mapNextTx and mapSidechains
+    AssertLockHeld(cs);
+    assert(mapPackages.count(hash) == 0);
+    CMemPoolPackageInfo& info = mapPackages[hash];
+    info.nFee = entry.GetFee();
+    info.nSize = entry.GetSize();
+    info.fCertificate = entry.IsCertificate();
+
+    // a tx can both create a sidechain and send funds to it, do not link it to itself
+    info.vDepends = mempoolDirectDependenciesFrom(root);
+    for (const uint256& parent : info.vDepends)
+        if (parent != hash)
+            info.parents.insert(parent);
+
+    // children may already be in mempool, e.g. when txes of a disconnected block are put back into mempool
+    for (const uint256& child : mempoolDirectDependenciesOf(root))
+        if (child != hash)
+            info.children.insert(child);
+
+    for (const uint256& parent : info.parents)
+        mapPackages.at(parent).children.insert(hash);
+    for (const uint256& child : info.children)
+    {
+        // where the new parent goes among the dependencies is up to the vin of the child
+        CMemPoolPackageInfo& childInfo = mapPackages.at(child);
+        childInfo.parents.insert(hash);
+        childInfo.vDepends = mapTx.count(child) ? mempoolDirectDependenciesFrom(mapTx.at(child).GetTx()) :
+                                                  mempoolDirectDependenciesFrom(mapCertificate.at(child).GetCertificate());
+    }
+
+    std::set<uint256> ancestors;
+    calculateAncestors(hash, ancestors);
+
+    if (!info.children.empty())
+    {
+        // Slow path: both the ancestor sets of the new descendants and the descendant sets of the
+        // ancestors have changed in a non trivial way, recompute them
+        std::set<uint256> descendants;
+        calculateDescendants(hash, descendants);
+
+        updateAncestorState(hash);
+        for (const uint256& descendant : descendants)
+            updateAncestorState(descendant);
+
+        updateDescendantState(hash);
+        for (const uint256& ancestor : ancestors)
+            updateDescendantState(ancestor);
+        return;
+    }
+
+    info.nCountWithAncestors = 1;
+    info.nSizeWithAncestors = info.nSize;
+    info.nFeesWithAncestors = info.nFee;
+    for (const uint256& ancestor : ancestors)
+    {
+        CMemPoolPackageInfo& ancestorInfo = mapPackages.at(ancestor);
+        info.nCountWithAncestors++;
+        info.nSizeWithAncestors += ancestorInfo.nSize;
+        info.nFeesWithAncestors += ancestorInfo.nFee;
+
+        setDescendantScore.erase(std::make_pair(ancestorInfo.GetDescendantFeeRate(), ancestor));
+        ancestorInfo.nCountWithDescendants++;
+        ancestorInfo.nSizeWithDescendants += info.nSize;
+        ancestorInfo.nFeesWithDescendants += info.nFee;
+        ancestorInfo.nCertsWithDescendants += info.fCertificate ? 1 : 0;
+        setDescendantScore.insert(std::make_pair(ancestorInfo.GetDescendantFeeRate(), ancestor));
+    }
+
+    info.nCountWithDescendants = 1;
+    info.nSizeWithDescendants = info.nSize;
+    info.nFeesWithDescendants = info.nFee;
+    info.nCertsWithDescendants = info.fCertificate ? 1 : 0;
+    setDescendantScore.insert(std::make_pair(info.GetDescendantFeeRate(), hash));
+}
+
+void CTxMemPool::removePackageLinks(const std::vector<uint256>& hashes, bool fDescendantsIncluded)
+{
+    // Must be called with the whole set of objects which are going to be removed.
+    // If fDescendantsIncluded, hashes contains all the in-mempool descendants of each of its members.
+    AssertLockHeld(cs);
+    std::set<uint256> removed;
+    for (const uint256& hash : hashes)
+        if (mapPackages.count(hash))
+            removed.insert(hash);
+
+    if (removed.empty())
+        return;
+
+    // Surviving descendants lose exactly the removed entries from their ancestor set...
+    std::set<uint256> survivingDescendants;
+    if (!fDescendantsIncluded)
+    {
+        for (const uint256& hash : removed)
+        {
+            const CMemPoolPackageInfo& info = mapPackages.at(hash);
+            std::set<uint256> descendants;
+            calculateDescendants(hash, descendants);
+            for (const uint256& descendant : descendants)
+            {
+                if (removed.count(descendant))
+                    continue;
+                CMemPoolPackageInfo& descendantInfo = mapPackages.at(descendant);
+                descendantInfo.nCountWithAncestors--;
+                descendantInfo.nSizeWithAncestors -= info.nSize;
+                descendantInfo.nFeesWithAncestors -= info.nFee;
+                survivingDescendants.insert(descendant);
             }
+        }
+    }
 
-            assert(cache.find(curr_hash) == cache.end());
-            cache.insert({curr_hash, curr_rate});
+    // ... while surviving ancestors get their descendant set recomputed once links are gone
+    std::set<uint256> survivingAncestors;
+    std::vector<uint256> toVisit{removed.begin(), removed.end()};
+    std::set<uint256> visited{removed.begin(), removed.end()};
+    while (!toVisit.empty())
+    {
+        const CMemPoolPackageInfo& info = mapPackages.at(toVisit.back());
+        toVisit.pop_back();
+        for (const uint256& parent : info.parents)
+        {
+            if (!visited.insert(parent).second)
+                continue;
+            survivingAncestors.insert(parent);
+            toVisit.push_back(parent);
         }
-        res.first += curr_rate;
-        res.second.push_back(curr_hash);
+    }
 
-        to_visit.pop();
+    for (const uint256& hash : removed)
+    {
+        auto it = mapPackages.find(hash);
+        for (const uint256& parent : it->second.parents)
+            if (!removed.count(parent))
+                mapPackages.at(parent).children.erase(hash);
+        for (const uint256& child : it->second.children)
+        {
+            if (removed.count(child))
+                continue;
+            CMemPoolPackageInfo& childInfo = mapPackages.at(child);
+            childInfo.parents.erase(hash);
+            childInfo.vDepends.erase(std::remove(childInfo.vDepends.begin(), childInfo.vDepends.end(), hash),
+                                     childInfo.vDepends.end());
+        }
+        setDescendantScore.erase(std::make_pair(it->second.GetDescendantFeeRate(), hash));
+        mapPackages.erase(it);
     }
 
-    return res;
+    for (const uint256& ancestor : survivingAncestors)
+        updateDescendantState(ancestor);
+
+    // Removing an entry in the middle of a package may also disconnect its surviving ancestors
+    // from its surviving descendants
+    if (!survivingAncestors.empty())
+        for (const uint256& descendant : survivingDescendants)
+            updateAncestorState(descendant);
+}
+
+bool CTxMemPool::getPackageInfo(const uint256& hash, CMemPoolPackageInfo& info) const
+{
+    LOCK(cs);
+    auto it = mapPackages.find(hash);
+    if (it == mapPackages.end())
+        return false;
+    info = it->second;
+    return true;
+}
+
+void CTxMemPool::getEntryInfos(int nChainHeight, uint64_t nAddedAfter, bool fDeltasOnly, std::vector<CMemPoolEntryInfo>& vInfos) const
+{
+    AssertLockHeld(cs);
+    const size_t nFirst = vInfos.size();
+    auto copyEntry = [this, nChainHeight, &vInfos](const uint256& hash, const CMemPoolEntry& e, const CTransactionBase& txBase) {
+        vInfos.emplace_back();
+        CMemPoolEntryInfo& info = vInfos.back();
+        info.hash = hash;
+        info.fCert = txBase.IsCertificate();
+        info.nSize = (int)e.GetSize();
+        info.nFee = e.GetFee();
+        info.nTime = e.GetTime();
+        info.nHeight = (int)e.GetHeight();
+        info.dStartingPriority = e.GetPriority(e.GetHeight());
+        info.dCurrentPriority = e.GetPriority(nChainHeight);
+        info.nVersion = txBase.nVersion;
+
+        auto it = mapPackages.find(hash);
+        if (it == mapPackages.end())
+            return;
+        const CMemPoolPackageInfo& package = it->second;
+        info.vDepends = package.vDepends;
+        info.fPackage = true;
+        info.nCountWithDescendants = package.nCountWithDescendants;
+        info.nSizeWithDescendants = package.nSizeWithDescendants;
+        info.nFeesWithDescendants = package.nFeesWithDescendants;
+        info.nCountWithAncestors = package.nCountWithAncestors;
+        info.nSizeWithAncestors = package.nSizeWithAncestors;
+        info.nFeesWithAncestors = package.nFeesWithAncestors;
+    };
+
+    vInfos.reserve(nFirst + mapTx.size() + mapCertificate.size());
+    for (const auto& entry : mapTx)
+        if (entry.second.GetSequence() > nAddedAfter)
+            copyEntry(entry.first, entry.second, entry.second.GetTx());
+    for (const auto& entry : mapCertificate)
+        if (entry.second.GetSequence() > nAddedAfter)
+            copyEntry(entry.first, entry.second, entry.second.GetCertificate());
+
+    std::map<uint256, size_t> mapIndex;
+    for (size_t i = nFirst; i < vInfos.size(); i++)
+        mapIndex[vInfos[i].hash] = i;
+    for (const auto& delta : mapDeltas) {
+        auto it = mapIndex.find(delta.first);
+        if (it == mapIndex.end()) {
+            if (!fDeltasOnly)
+                continue;
+            vInfos.emplace_back();
+            vInfos.back().hash = delta.first;
+            vInfos.back().fInMempool = false;
+        }
+        CMemPoolEntryInfo& info = (it == mapIndex.end()) ? vInfos.back() : vInfos[it->second];
+        info.fDelta = true;
+        info.dPriorityDelta = delta.second.first;
+        info.nFeeDelta = delta.second.second;
+    }
 }
 
-void CTxMemPool::remove(const uint256& origTx, std::list<CTransaction>& removedTxs, std::list<CScCertificate>& removedCerts, bool fRecursive)
+void CTxMemPool::remove(const uint256& origTx, std::list<CTransaction>& removedTxs, std::list<CScCertificate>& removedCerts,
+                        bool fRecursive, MemPoolRemovalReason reason)
 {
     auto tx = mapTx.find(origTx);
     if (tx != mapTx.end()) {
-        remove(tx->second.GetTx(), removedTxs, removedCerts, fRecursive);
+        remove(tx->second.GetTx(), removedTxs, removedCerts, fRecursive, reason);
         return;
     }
     auto cert = mapCertificate.find(origTx);
     if (cert != mapCertificate.end()) {
-        remove(cert->second.GetCertificate(), removedTxs, removedCerts, fRecursive);
+        remove(cert->second.GetCertificate(), removedTxs, removedCerts, fRecursive, reason);
     }
 }
 
-void CTxMemPool::remove(const CTransactionBase& origTx, std::list<CTransaction>& removedTxs, std::list<CScCertificate>& removedCerts, bool fRecursive)
+void CTxMemPool::remove(const CTransactionBase& origTx, std::list<CTransaction>& removedTxs, std::list<CScCertificate>& removedCerts,
+                        bool fRecursive, MemPoolRemovalReason reason)
 {
     // Remove transaction from memory pool
     LOCK(cs);
@@ -696,6 +1036,8 @@ void CTxMemPool::remove(const CTransactionBase& origTx, std::list<CTransaction>&
 
     objToRemove.insert(objToRemove.begin(), origTx.GetHash());
 
+    removePackageLinks(objToRemove, fRecursive);
+
     for(const uint256& hash : objToRemove)
     {
         const auto& entry_it = mapTx.find(hash);
@@ -765,6 +1107,7 @@ void CTxMemPool::remove(const CTransactionBase& origTx, std::list<CTransaction>&
 
             LogPrint("mempool", "%s():%d - removing tx [%s] from mempool\n", __func__, __LINE__, hash.ToString() );
             mapTx.erase(hash);
+            logEvent(CMemPoolEvent::Type::REMOVED, hash, false, reason);
 
             nTransactionsUpdated++;
             minerPolicyEstimator->removeTx(hash);
@@ -785,9 +1128,11 @@ void CTxMemPool::remove(const CTransactionBase& origTx, std::list<CTransaction>&
 
             // are we removing a top-quality cert?
             const uint256& topQualHash = mapSidechains.at(scid).GetTopQualityCert()->second;
-            CSidechain sidechain;
-            assert(pcoinsTip->GetSidechain(scid, sidechain));
-            bool isTopQualityCert = (topQualHash == hash) || sidechain.isNonCeasing();
+            const CSidechain* const pSidechain = pcoinsTip->AccessSidechain(scid);
+            assert(pSidechain != nullptr);
+            bool isTopQualityCert = (topQualHash == hash) || pSidechain->isNonCeasing();
+            // a replaced cert leaves its slot to its replacement, which is then the top quality in its place
+            const bool fSlotTaken = (reason == MemPoolRemovalReason::REPLACED) && (hash == origTx.GetHash());
 
             // remove certificate hash from list
             LogPrint("mempool", "%s():%d - removing cert [%s] from mapSidechain[%s]\n",
@@ -806,11 +1151,13 @@ void CTxMemPool::remove(const CTransactionBase& origTx, std::list<CTransaction>&
             cachedInnerUsage -= mapCertificate[hash].DynamicMemoryUsage();
             LogPrint("mempool", "%s():%d - removing cert [%s] from mempool\n", __func__, __LINE__, hash.ToString() );
             mapCertificate.erase(hash);
+            logEvent(CMemPoolEvent::Type::REMOVED, hash, true, reason);
             nCertificatesUpdated++;
+            minerPolicyEstimator->removeTx(hash);
 
             if (fAddressIndex) {
                 removeAddressIndex(hash);
-                if (isTopQualityCert && !sidechain.isNonCeasing())
+                if (isTopQualityCert && !pSidechain->isNonCeasing() && !fSlotTaken)
                 {
                     // we have removed a top quality cert, if another one is promoted to be the next top quality, we have to
                     // set the status properly in the address index data
@@ -946,7 +1293,7 @@ void CTxMemPool::removeCertificatesWithoutRef(const CCoinsViewCache * const pCoi
     std::list<CTransaction> dummyTxs;
     for (const auto& hash: certsToRemove)
     {
-        remove(hash, dummyTxs, outdatedCerts, true);
+        remove(hash, dummyTxs, outdatedCerts, true, MemPoolRemovalReason::STALE);
     }
     LogPrint("mempool", "%s():%d - removed %zu certs and %zu txes\n", __func__, __LINE__, outdatedCerts.size(), dummyTxs.size());
 
@@ -962,53 +1309,84 @@ void CTxMemPool::removeStaleCertificates(const CCoinsViewCache * const pCoinsVie
     for (std::map<uint256, CCertificateMemPoolEntry>::const_iterator itCert = mapCertificate.begin(); itCert != mapCertificate.end(); itCert++)
     {
         const CScCertificate& cert = itCert->second.GetCertificate();
-
-        if (!checkCertImmatureExpenditures(cert, pCoinsView))
-        {
+        if (isCertStale(cert, pCoinsView))
             certsToRemove.insert(cert.GetHash());
-            continue;
-        }
+    }
 
-        CSidechain sc;
-        if (!pCoinsView->GetSidechain(cert.GetScId(), sc))
-        {
-            certsToRemove.insert(cert.GetHash());
-            continue;
-        }
-        int referencedHeight;
+    std::list<CTransaction> dummyTxs;
+    for(const auto& hash: certsToRemove)
+    {
+        remove(hash, dummyTxs, outdatedCerts, true, MemPoolRemovalReason::STALE);
+    }
+    LogPrint("mempool", "%s():%d - removed %d certs and %d txes\n", __func__, __LINE__, outdatedCerts.size(), dummyTxs.size());
+}
 
-        if (sc.isNonCeasing()) {
-            const auto map_it = mapCumtreeHeight.find(cert.endEpochCumScTxCommTreeRoot.GetLegacyHash());
-            if (map_it == mapCumtreeHeight.end()) {
-                LogPrintf("%s():%d: cannot find reference block for cert %s, removing\n", __func__, __LINE__, cert.GetHash().ToString());
-                certsToRemove.insert(cert.GetHash());
-                continue;
-            }
-            referencedHeight = map_it->second;
-        }
-        else
-        {
-            referencedHeight = sc.GetEndHeightForEpoch(cert.epochNumber);
-        }
+void CTxMemPool::removeStaleCertificates(const CCoinsViewCache * const pCoinsView, const std::set<uint256>& changedScIds,
+                                         std::list<CScCertificate>& outdatedCerts)
+{
+    LOCK(cs);
+    std::set<uint256> certsToRemove;
+    const int inclusionHeight = pCoinsView->GetHeight() + 1;
 
-        // A certificate for a non ceasing sidechain should be kept if either it is in
-        // the correct order wrt the blochain, or with another certificate in the mempool
-        if (!sc.CheckCertTiming(cert.epochNumber, referencedHeight, *pCoinsView))
-        {
-            certsToRemove.insert(cert.GetHash());
+    for (const auto& [scId, scEntry] : mapSidechains)
+    {
+        if (scEntry.mBackwardCertificates.empty())
             continue;
-        }
 
+        // the sidechains left as they were only see the submission windows of their epochs end
+        const CSidechain* const pSidechain = changedScIds.count(scId) ? nullptr : pCoinsView->AccessSidechain(scId);
+        for (const auto& [quality, certHash] : scEntry.mBackwardCertificates)
+        {
+            const CScCertificate& cert = mapCertificate.at(certHash).GetCertificate();
+            if (pSidechain == nullptr)
+            {
+                if (isCertStale(cert, pCoinsView))
+                    certsToRemove.insert(certHash);
+            }
+            else if (!pSidechain->isNonCeasing() && inclusionHeight > pSidechain->GetCertSubmissionWindowEnd(cert.epochNumber))
+            {
+                certsToRemove.insert(certHash);
+            }
+        }
     }
 
     std::list<CTransaction> dummyTxs;
     for(const auto& hash: certsToRemove)
     {
-        remove(hash, dummyTxs, outdatedCerts, true);
+        remove(hash, dummyTxs, outdatedCerts, true, MemPoolRemovalReason::STALE);
     }
     LogPrint("mempool", "%s():%d - removed %d certs and %d txes\n", __func__, __LINE__, outdatedCerts.size(), dummyTxs.size());
 }
 
+bool CTxMemPool::isCertStale(const CScCertificate& cert, const CCoinsViewCache * const pCoinsView)
+{
+    if (!checkCertImmatureExpenditures(cert, pCoinsView))
+        return true;
+
+    const CSidechain* const pSidechain = pCoinsView->AccessSidechain(cert.GetScId());
+    if (pSidechain == nullptr)
+        return true;
+    const CSidechain& sc = *pSidechain;
+    int referencedHeight;
+
+    if (sc.isNonCeasing()) {
+        const auto map_it = mapCumtreeHeight.find(cert.endEpochCumScTxCommTreeRoot.GetLegacyHash());
+        if (map_it == mapCumtreeHeight.end()) {
+            LogPrintf("%s():%d: cannot find reference block for cert %s, removing\n", __func__, __LINE__, cert.GetHash().ToString());
+            return true;
+        }
+        referencedHeight = map_it->second;
+    }
+    else
+    {
+        referencedHeight = sc.GetEndHeightForEpoch(cert.epochNumber);
+    }
+
+    // A certificate for a non ceasing sidechain should be kept if either it is in
+    // the correct order wrt the blochain, or with another certificate in the mempool
+    return !sc.CheckCertTiming(cert.epochNumber, referencedHeight, *pCoinsView);
+}
+
 
 void CTxMemPool::removeWithAnchor(const uint256 &invalidRoot)
 {
@@ -1032,7 +1410,26 @@ void CTxMemPool::removeWithAnchor(const uint256 &invalidRoot)
     BOOST_FOREACH(const CTransaction& tx, transactionsToRemove) {
         std::list<CTransaction> dummyTxs;
         std::list<CScCertificate> dummyCerts;
-        remove(tx, dummyTxs, dummyCerts, true);
+        remove(tx, dummyTxs, dummyCerts, true, MemPoolRemovalReason::STALE);
+    }
+}
+
+void CTxMemPool::addOutOfScBalanceCsw(const uint256& scId, const CSidechainMemPoolEntry& sidechainEntry,
+                                      const CCoinsViewCache * const pCoinsView, std::set<uint256>& txesToRemove) const
+{
+    if (sidechainEntry.cswTotalAmount == 0) //how about < 0?
+        return;//no csw that could reduce sc balance
+
+    const CSidechain* const pSidechain = pCoinsView->AccessSidechain(scId);
+    assert(pSidechain != nullptr);
+    if (sidechainEntry.cswTotalAmount <= pSidechain->balance)
+        return; //enough Sc balance to accomodate for all unconfirmed csw
+
+    for (auto nIt = sidechainEntry.cswNullifiers.begin(); nIt != sidechainEntry.cswNullifiers.end(); nIt++)
+    {
+        const uint256 &txHash = nIt->second;
+        assert(mapTx.count(txHash));
+        txesToRemove.insert(txHash);
     }
 }
 
@@ -1042,27 +1439,42 @@ void CTxMemPool::removeOutOfScBalanceCsw(const CCoinsViewCache * const pCoinsVie
     // Note: if there is a CSW values conflict (may occur only if CSW circuit is broken or malicious) -> remove all CSWs for given sidechain.
     std::set<uint256> txesToRemove;
     for (std::map<uint256, CSidechainMemPoolEntry>::const_iterator sIt = mapSidechains.begin(); sIt != mapSidechains.end(); sIt++)
+        addOutOfScBalanceCsw(sIt->first, sIt->second, pCoinsView, txesToRemove);
+
+    for(const auto& hash: txesToRemove)
     {
-        const CSidechainMemPoolEntry &sidechainEntry = sIt->second;
-        if (sidechainEntry.cswTotalAmount == 0) //how about < 0?
-            continue;//no csw that could reduce sc balance
+        remove(hash, removedTxs, removedCerts, true, MemPoolRemovalReason::STALE);
+    }
+}
 
-        CSidechain sidechain;
-        assert(pCoinsView->GetSidechain(sIt->first, sidechain));
-        if (sidechainEntry.cswTotalAmount <= sidechain.balance)
-            continue; //enough Sc balance to accomodate for all unconfirmed csw
+void CTxMemPool::markSidechainTouched(const uint256& scId)
+{
+    auto it = mapSidechains.find(scId);
+    if (it == mapSidechains.end() || it->second.fTouchedByBlock)
+        return;
+    it->second.fTouchedByBlock = true;
+    vTouchedSidechains.push_back(scId);
+}
 
-        for (auto nIt = sidechainEntry.cswNullifiers.begin(); nIt != sidechainEntry.cswNullifiers.end(); nIt++)
-        {
-            const uint256 &txHash = nIt->second;
-            const CTransaction &tx = mapTx[txHash].GetTx();
-            txesToRemove.insert(tx.GetHash());
-        }
+void CTxMemPool::removeTouchedOutOfScBalanceCsw(const CCoinsViewCache * const pCoinsView,
+                                                std::list<CTransaction>& removedTxs, std::list<CScCertificate>& removedCerts)
+{
+    // A sidechain balance only drops with the certificates and the csws of a block, hence the sidechains
+    // not touched by it cannot have gone short of balance for their mempool csws
+    std::set<uint256> txesToRemove;
+    for (const uint256& scId : vTouchedSidechains)
+    {
+        auto it = mapSidechains.find(scId);
+        if (it == mapSidechains.end())
+            continue;
+        it->second.fTouchedByBlock = false;
+        addOutOfScBalanceCsw(scId, it->second, pCoinsView, txesToRemove);
     }
+    vTouchedSidechains.clear();
 
     for(const auto& hash: txesToRemove)
     {
-        remove(hash, removedTxs, removedCerts, true);
+        remove(hash, removedTxs, removedCerts, true, MemPoolRemovalReason::STALE);
     }
 }
 
@@ -1078,7 +1490,7 @@ void CTxMemPool::removeConflicts(const CTransaction &tx, std::list<CTransaction>
 
         const CTransactionBase &txConflict = *it->second.ptx;
         if (txConflict != tx)
-            remove(txConflict, removedTxs, removedCerts, true);
+            remove(txConflict, removedTxs, removedCerts, true, MemPoolRemovalReason::CONFLICT);
     }
 
     for(const JSDescription &joinsplit: tx.GetVjoinsplit())
@@ -1091,7 +1503,7 @@ void CTxMemPool::removeConflicts(const CTransaction &tx, std::list<CTransaction>
 
             const CTransactionBase &txConflict = *it->second;
             if (txConflict != tx)
-                remove(txConflict, removedTxs, removedCerts, true);
+                remove(txConflict, removedTxs, removedCerts, true, MemPoolRemovalReason::CONFLICT);
 
         }
     }
@@ -1112,10 +1524,8 @@ void CTxMemPool::removeConflicts(const CTransaction &tx, std::list<CTransaction>
 
         const CTransaction &txConflict = it->second.GetTx();
         if (txConflict != tx)
-            remove(txConflict, removedTxs, removedCerts, true);
+            remove(txConflict, removedTxs, removedCerts, true, MemPoolRemovalReason::CONFLICT);
     }
-
-    removeOutOfScBalanceCsw(pcoinsTip, removedTxs, removedCerts);
 }
 
 void CTxMemPool::removeStaleTransactions(const CCoinsViewCache * const pCoinsView, std::list<CTransaction>& outdatedTxs,
@@ -1136,12 +1546,7 @@ void CTxMemPool::removeStaleTransactions(const CCoinsViewCache * const pCoinsVie
 
         for(const CTxForwardTransferOut& ft: tx.GetVftCcOut())
         {
-            // pCoinsView does not encompass mempool->
-            // Hence we need to checks explicitly for unconfirmed scCreations
-            if (hasSidechainCreationTx(ft.scId))
-                continue;
-
-            if (!pCoinsView->CheckScTxTiming(ft.scId) || !pCoinsView->CheckMinimumFtScFee(ft))
+            if (isScOutputStale(ft, pCoinsView))
             {
                 txesToRemove.insert(tx.GetHash());
                 break;
@@ -1150,12 +1555,7 @@ void CTxMemPool::removeStaleTransactions(const CCoinsViewCache * const pCoinsVie
 
         for(const CBwtRequestOut& mbtr: tx.GetVBwtRequestOut())
         {
-            // pCoinsView does not encompass mempool->
-            // Hence we need to checks explicitly for unconfirmed scCreations
-            if (hasSidechainCreationTx(mbtr.scId))
-                continue;
-
-            if (!pCoinsView->CheckScTxTiming(mbtr.scId) || !pCoinsView->CheckMinimumMbtrScFee(mbtr))
+            if (isScOutputStale(mbtr, pCoinsView))
             {
                 txesToRemove.insert(tx.GetHash());
                 break;
@@ -1182,12 +1582,78 @@ void CTxMemPool::removeStaleTransactions(const CCoinsViewCache * const pCoinsVie
 
     for(const auto& hash: txesToRemove)
     {
-        remove(hash, outdatedTxs, outdatedCerts, true);
+        remove(hash, outdatedTxs, outdatedCerts, true, MemPoolRemovalReason::STALE);
     }
     
     LogPrint("mempool", "%s():%d - removed %d certs and %d txes\n", __func__, __LINE__, outdatedCerts.size(), outdatedTxs.size());
 }
 
+void CTxMemPool::removeStaleTransactions(const CCoinsViewCache * const pCoinsView, const std::set<uint256>& changedScIds,
+                                         std::list<CTransaction>& outdatedTxs, std::list<CScCertificate>& outdatedCerts)
+{
+    // Connecting a block only makes the inputs of the mempool txes more mature, and none of the csws
+    // stale, as a ceased sidechain stays so: what is left are the sidechain outputs towards changedScIds
+    LOCK(cs);
+    std::set<uint256> txesToRemove;
+
+    for (const uint256& scId : changedScIds)
+    {
+        const auto itSc = mapSidechains.find(scId);
+        if (itSc == mapSidechains.end())
+            continue;
+
+        for (const uint256& hash : itSc->second.fwdTxHashes)
+        {
+            for (const CTxForwardTransferOut& ft : mapTx.at(hash).GetTx().GetVftCcOut())
+            {
+                if (ft.scId == scId && isScOutputStale(ft, pCoinsView))
+                {
+                    txesToRemove.insert(hash);
+                    break;
+                }
+            }
+        }
+
+        for (const uint256& hash : itSc->second.mcBtrsTxHashes)
+        {
+            for (const CBwtRequestOut& mbtr : mapTx.at(hash).GetTx().GetVBwtRequestOut())
+            {
+                if (mbtr.scId == scId && isScOutputStale(mbtr, pCoinsView))
+                {
+                    txesToRemove.insert(hash);
+                    break;
+                }
+            }
+        }
+    }
+
+    for(const auto& hash: txesToRemove)
+    {
+        remove(hash, outdatedTxs, outdatedCerts, true, MemPoolRemovalReason::STALE);
+    }
+
+    LogPrint("mempool", "%s():%d - removed %d certs and %d txes from %d sidechains\n", __func__, __LINE__,
+        outdatedCerts.size(), outdatedTxs.size(), changedScIds.size());
+}
+
+bool CTxMemPool::isScOutputStale(const CTxForwardTransferOut& ft, const CCoinsViewCache * const pCoinsView) const
+{
+    // pCoinsView does not encompass mempool->
+    // Hence we need to checks explicitly for unconfirmed scCreations
+    if (hasSidechainCreationTx(ft.scId))
+        return false;
+
+    return !pCoinsView->CheckScTxTiming(ft.scId) || !pCoinsView->CheckMinimumFtScFee(ft);
+}
+
+bool CTxMemPool::isScOutputStale(const CBwtRequestOut& mbtr, const CCoinsViewCache * const pCoinsView) const
+{
+    if (hasSidechainCreationTx(mbtr.scId))
+        return false;
+
+    return !pCoinsView->CheckScTxTiming(mbtr.scId) || !pCoinsView->CheckMinimumMbtrScFee(mbtr);
+}
+
 /**
  * Called when a block is connected. Removes from mempool and updates the miner fee estimator.
  */
@@ -1203,16 +1669,21 @@ void CTxMemPool::removeForBlock(const std::vector<CTransaction>& vtx, unsigned i
             entries.push_back(mapTx[hash]);
     }
 
+    for(const CTransaction& tx: vtx)
+        for(const CTxCeasedSidechainWithdrawalInput& csw: tx.GetVcswCcIn())
+            markSidechainTouched(csw.scId);
+
     // dummy lists: dummyCerts must be empty, dummyTxs contains exactly the txes that were in the mempool
     // and now are in the block. The caller is not interested in them because they will be synced with the block
     for(const CTransaction& tx: vtx)
     {
         std::list<CTransaction> dummyTxs;
         std::list<CScCertificate> dummyCerts;
-        remove(tx, dummyTxs, dummyCerts, /*fRecursive*/false);
+        remove(tx, dummyTxs, dummyCerts, /*fRecursive*/false, MemPoolRemovalReason::BLOCK);
         removeConflicts(tx, conflictingTxs, conflictingCerts);
         ClearPrioritisation(tx.GetHash());
     }
+    removeTouchedOutOfScBalanceCsw(pcoinsTip, conflictingTxs, conflictingCerts);
     // After the txs in the new block have been removed from the mempool, update policy estimates
     minerPolicyEstimator->processBlock(nBlockHeight, entries, fCurrentEstimate);
 }
@@ -1227,7 +1698,7 @@ void CTxMemPool::removeConflicts(const CScCertificate &cert, std::list<CTransact
             {
                 LogPrint("mempool", "%s():%d - removing [%s] conflicting with cert [%s]\n",
                     __func__, __LINE__, txConflict.GetHash().ToString(), cert.GetHash().ToString());
-                remove(txConflict, removedTxs, removedCerts, true);
+                remove(txConflict, removedTxs, removedCerts, true, MemPoolRemovalReason::CONFLICT);
             }
         }
     }
@@ -1254,7 +1725,7 @@ void CTxMemPool::removeConflicts(const CScCertificate &cert, std::list<CTransact
 
     for(const auto& hash: lowerQualCerts)
     {
-        remove(hash, removedTxs, removedCerts, true);
+        remove(hash, removedTxs, removedCerts, true, MemPoolRemovalReason::CONFLICT);
     }
 }
 
@@ -1262,6 +1733,13 @@ void CTxMemPool::removeForBlock(const std::vector<CScCertificate>& vcert, unsign
                                 std::list<CTransaction>& removedTxs, std::list<CScCertificate>& removedCerts)
 {
     LOCK(cs);
+    std::vector<CCertificateMemPoolEntry> entries;
+    for (const auto& cert : vcert)
+    {
+        auto it = mapCertificate.find(cert.GetHash());
+        if (it != mapCertificate.end())
+            entries.push_back(it->second);
+    }
 
     // dummy lists: dummyTxs must be empty, dummyCerts contains exactly the certs that were in the mempool
     // and now are in the block. The caller is not interested in them because they will be synced with the block
@@ -1269,10 +1747,14 @@ void CTxMemPool::removeForBlock(const std::vector<CScCertificate>& vcert, unsign
     std::list<CScCertificate> dummyCerts;
     for (const auto& cert : vcert)
     {
-        remove(cert, dummyTxs, dummyCerts, /*fRecursive*/false);
+        markSidechainTouched(cert.GetScId());
+        remove(cert, dummyTxs, dummyCerts, /*fRecursive*/false, MemPoolRemovalReason::BLOCK);
         removeConflicts(cert, removedTxs, removedCerts);
         ClearPrioritisation(cert.GetHash());
     }
+    removeTouchedOutOfScBalanceCsw(pcoinsTip, removedTxs, removedCerts);
+    // removeForBlock of the block transactions already processed the block in the policy estimator
+    minerPolicyEstimator->processBlockCerts(nBlockHeight, entries);
 }
 
 void CTxMemPool::clear()
@@ -1286,6 +1768,11 @@ void CTxMemPool::clear()
     mapSidechains.clear();
     mapNullifiers.clear();
     mapRecentlyAddedTxBase.clear();
+    mapPackages.clear();
+    setDescendantScore.clear();
+    // the entries dropped are not logged one by one, no change older than now can be given
+    recentEvents.clear();
+    nEventLogStart = ++nEventSequence;
 
     mapAddress.clear();
     mapAddressInserted.clear();
@@ -1402,9 +1889,8 @@ void CTxMemPool::check(const CCoinsViewCache *pcoins) const
         // Check that CSW balances don't exceed the SC balance
         for (auto const& balanceInfo: cswBalances)
         {
-            CSidechain scInfo;
-            pcoins->GetSidechain(balanceInfo.first, scInfo);
-            assert(balanceInfo.second <= scInfo.balance);
+            const CSidechain* const pSidechain = pcoins->AccessSidechain(balanceInfo.first);
+            assert(balanceInfo.second <= (pSidechain != nullptr ? pSidechain->balance : 0));
             // Update global CSW balances counter
             cswsTotalBalances[balanceInfo.first] += balanceInfo.second;
         }
@@ -1600,6 +2086,60 @@ void CTxMemPool::check(const CCoinsViewCache *pcoins) const
         assert(&tx == it->second);
     }
 
+    // Check that dependency links and cached package aggregates match the ones rebuilt from scratch
+    assert(mapPackages.size() == mapTx.size() + mapCertificate.size());
+    assert(setDescendantScore.size() == mapPackages.size());
+    for (const auto& pkg : mapPackages) {
+        const uint256& hash = pkg.first;
+        const CMemPoolPackageInfo& info = pkg.second;
+        const CTransactionBase* pObj = nullptr;
+        if (mapTx.count(hash)) {
+            pObj = &mapTx.at(hash).GetTx();
+            assert(!info.fCertificate && info.nSize == mapTx.at(hash).GetTxSize() && info.nFee == mapTx.at(hash).GetFee());
+        } else {
+            assert(mapCertificate.count(hash));
+            pObj = &mapCertificate.at(hash).GetCertificate();
+            assert(info.fCertificate && info.nSize == mapCertificate.at(hash).GetCertificateSize() && info.nFee == mapCertificate.at(hash).GetFee());
+        }
+
+        std::set<uint256> parents, children;
+        for (const uint256& parent : mempoolDirectDependenciesFrom(*pObj))
+            if (parent != hash)
+                parents.insert(parent);
+        for (const uint256& child : mempoolDirectDependenciesOf(*pObj))
+            if (child != hash)
+                children.insert(child);
+        assert(parents == info.parents);
+        assert(children == info.children);
+        assert(info.vDepends == mempoolDirectDependenciesFrom(*pObj));
+
+        std::set<uint256> ancestors, descendants;
+        calculateAncestors(hash, ancestors);
+        calculateDescendants(hash, descendants);
+        uint64_t nCountWithAncestors = 1, nCountWithDescendants = 1, nCertsWithDescendants = info.fCertificate ? 1 : 0;
+        size_t nSizeWithAncestors = info.nSize, nSizeWithDescendants = info.nSize;
+        CAmount nFeesWithAncestors = info.nFee, nFeesWithDescendants = info.nFee;
+        for (const uint256& ancestor : ancestors) {
+            nCountWithAncestors++;
+            nSizeWithAncestors += mapPackages.at(ancestor).nSize;
+            nFeesWithAncestors += mapPackages.at(ancestor).nFee;
+        }
+        for (const uint256& descendant : descendants) {
+            nCountWithDescendants++;
+            nSizeWithDescendants += mapPackages.at(descendant).nSize;
+            nFeesWithDescendants += mapPackages.at(descendant).nFee;
+            nCertsWithDescendants += mapPackages.at(descendant).fCertificate ? 1 : 0;
+        }
+        assert(info.nCountWithAncestors == nCountWithAncestors);
+        assert(info.nSizeWithAncestors == nSizeWithAncestors);
+        assert(info.nFeesWithAncestors == nFeesWithAncestors);
+        assert(info.nCountWithDescendants == nCountWithDescendants);
+        assert(info.nSizeWithDescendants == nSizeWithDescendants);
+        assert(info.nFeesWithDescendants == nFeesWithDescendants);
+        assert(info.nCertsWithDescendants == nCertsWithDescendants);
+        assert(setDescendantScore.count(std::make_pair(info.GetDescendantFeeRate(), hash)));
+    }
+
     assert((totalTxSize+totalCertificateSize) == checkTotal);
     assert(innerUsage == cachedInnerUsage);
 }
@@ -1793,6 +2333,35 @@ bool CTxMemPool::lookup(const uint256& hash, CScCertificate& result) const
     return true;
 }
 
+void CTxMemPool::sortForRelay(std::vector<uint256>& vHashes) const
+{
+    // (ancestors count, fee rate) of each hash, those not in the mempool getting the maximum count
+    std::vector<std::pair<std::pair<uint64_t, CFeeRate>, uint256> > vKeyed;
+    vKeyed.reserve(vHashes.size());
+    {
+        LOCK(cs);
+        for (const uint256& hash : vHashes)
+        {
+            std::map<uint256, CMemPoolPackageInfo>::const_iterator it = mapPackages.find(hash);
+            if (it == mapPackages.end())
+                vKeyed.emplace_back(std::make_pair(std::numeric_limits<uint64_t>::max(), CFeeRate()), hash);
+            else
+                vKeyed.emplace_back(std::make_pair(it->second.nCountWithAncestors, CFeeRate(it->second.nFee, it->second.nSize)), hash);
+        }
+    }
+
+    std::sort(vKeyed.begin(), vKeyed.end(), [](const std::pair<std::pair<uint64_t, CFeeRate>, uint256>& a,
+                                               const std::pair<std::pair<uint64_t, CFeeRate>, uint256>& b) {
+        if (a.first.first != b.first.first)
+            return a.first.first < b.first.first;
+        if (!(a.first.second == b.first.second))
+            return a.first.second > b.first.second;
+        return a.second < b.second;
+    });
+    for (size_t i = 0; i < vKeyed.size(); i++)
+        vHashes[i] = vKeyed[i].second;
+}
+
 void CTxMemPool::CertQualityStatusString(const CScCertificate& cert, std::string& statusString) const
 {
     const uint256& scid = cert.GetScId();
@@ -1804,10 +2373,10 @@ void CTxMemPool::CertQualityStatusString(const CScCertificate& cert, std::string
     }
 
     // If any certificate is in the mempool, the sidechain must be available in the CoinsView.
-    CSidechain sidechain;
-    assert(pcoinsTip->GetSidechain(scid, sidechain));
+    const CSidechain* const pSidechain = pcoinsTip->AccessSidechain(scid);
+    assert(pSidechain != nullptr);
 
-    if (sidechain.isNonCeasing() || mapSidechains.at(scid).GetTopQualityCert()->second == cert.GetHash())
+    if (pSidechain->isNonCeasing() || mapSidechains.at(scid).GetTopQualityCert()->second == cert.GetHash())
     {
         statusString = "TOP_QUALITY_MEMPOOL";
     }
@@ -1817,10 +2386,10 @@ void CTxMemPool::CertQualityStatusString(const CScCertificate& cert, std::string
     }
 }
 
-CFeeRate CTxMemPool::estimateFee(int nBlocks) const
+CFeeRate CTxMemPool::estimateFee(int nBlocks, FeeEstimateType type) const
 {
     LOCK(cs);
-    return minerPolicyEstimator->estimateFee(nBlocks);
+    return minerPolicyEstimator->estimateFee(nBlocks, type);
 }
 double CTxMemPool::estimatePriority(int nBlocks) const
 {
@@ -1903,7 +2472,7 @@ bool CTxMemPool::HasNoInputsOf(const CTransaction &tx) const
 void CTxMemPool::NotifyRecentlyAdded()
 {
     uint64_t recentlyAddedSequence;
-    std::vector<std::shared_ptr<CTransactionBase> > vTxBase;
+    std::vector<std::shared_ptr<const CTransactionBase> > vTxBase;
     {
         LOCK(cs);
         recentlyAddedSequence = nRecentlyAddedSequence;
@@ -1913,41 +2482,93 @@ void CTxMemPool::NotifyRecentlyAdded()
         mapRecentlyAddedTxBase.clear();
     }
 
-    // A race condition can occur here between these SyncWithWallets calls, and
-    // the ones triggered by block logic (in ConnectTip and DisconnectTip). It
-    // is harmless because calling SyncWithWallets(_, NULL) does not alter the
-    // wallet transaction's block information.
-    for (auto txBase : vTxBase) {
-        try {
-            if (txBase->IsCertificate())
-            {
-                LogPrint("mempool", "%s():%d - sync with wallet cert[%s]\n", __func__, __LINE__, txBase->GetHash().ToString());
-                SyncWithWallets( dynamic_cast<const CScCertificate&>(*txBase), nullptr);
-            }
-            else
-            {
-                LogPrint("mempool", "%s():%d - sync with wallet tx[%s]\n", __func__, __LINE__, txBase->GetHash().ToString());
-                SyncWithWallets( dynamic_cast<const CTransaction&>(*txBase), nullptr);
+    // The batch is delivered by the validation interface queue, in order with the
+    // updates of the blocks connected and disconnected (in ConnectTip and DisconnectTip),
+    // and the sequence number is only updated once the wallets have seen it.
+    const bool fRegtest = Params().NetworkIDString() == "regtest";
+    CallFunctionInValidationInterfaceQueue([this, vTxBase = std::move(vTxBase), recentlyAddedSequence, fRegtest] {
+        for (const auto& txBase : vTxBase) {
+            try {
+                if (txBase->IsCertificate())
+                {
+                    LogPrint("mempool", "%s():%d - sync with wallet cert[%s]\n", "NotifyRecentlyAdded", __LINE__, txBase->GetHash().ToString());
+                    GetMainSignals().SyncCertificate(dynamic_cast<const CScCertificate&>(*txBase), nullptr, -1);
+                }
+                else
+                {
+                    LogPrint("mempool", "%s():%d - sync with wallet tx[%s]\n", "NotifyRecentlyAdded", __LINE__, txBase->GetHash().ToString());
+                    GetMainSignals().SyncTransaction(dynamic_cast<const CTransaction&>(*txBase), nullptr);
+                }
+            } catch (const std::exception& e) {
+                // this also catches bad_cast
+                PrintExceptionContinue(&e, "CTxMemPool::NotifyRecentlyAdded()");
+            } catch (...) {
+                PrintExceptionContinue(NULL, "CTxMemPool::NotifyRecentlyAdded()");
             }
-        } catch (const boost::thread_interrupted&) {
-            LogPrintf("%s():%d - thread interrupted exception\n", __func__, __LINE__);
-            throw;
-        } catch (const std::exception& e) {
-            // this also catches bad_cast
-            PrintExceptionContinue(&e, "CTxMemPool::NotifyRecentlyAdded()");
-        } catch (...) {
-            PrintExceptionContinue(NULL, "CTxMemPool::NotifyRecentlyAdded()");
         }
+
+        // Update the notified sequence number. We only need this in regtest mode,
+        // and should not lock on cs after syncing the wallets otherwise.
+        if (fRegtest) {
+            LOCK(cs);
+            nNotifiedSequence = recentlyAddedSequence;
+        }
+    });
+}
+
+std::string MemPoolRemovalReasonToString(MemPoolRemovalReason reason)
+{
+    switch (reason) {
+        case MemPoolRemovalReason::BLOCK: return "block";
+        case MemPoolRemovalReason::CONFLICT: return "conflict";
+        case MemPoolRemovalReason::STALE: return "stale";
+        case MemPoolRemovalReason::SIZELIMIT: return "sizelimit";
+        case MemPoolRemovalReason::REPLACED: return "replaced";
+        case MemPoolRemovalReason::REORG: return "reorg";
+        default: return "unknown";
     }
+}
 
-    // Update the notified sequence number. We only need this in regtest mode,
-    // and should not lock on cs after calling SyncWithWallets otherwise.
-    if (Params().NetworkIDString() == "regtest") {
-        LOCK(cs);
-        nNotifiedSequence = recentlyAddedSequence;
+void CTxMemPool::logEvent(CMemPoolEvent::Type type, const uint256& hash, bool fCertificate, MemPoolRemovalReason reason)
+{
+    recentEvents.push_back(CMemPoolEvent{type, ++nEventSequence, hash, fCertificate, reason});
+    if (recentEvents.size() > MEMPOOL_EVENT_LOG_SIZE) {
+        nEventLogStart = recentEvents.front().nSequence;
+        recentEvents.pop_front();
     }
 }
 
+uint64_t CTxMemPool::GetSequence() const
+{
+    LOCK(cs);
+    return nEventSequence;
+}
+
+bool CTxMemPool::GetEventsSince(uint64_t nSince, std::vector<CMemPoolEvent>& vEvents) const
+{
+    LOCK(cs);
+    vEvents.clear();
+    if (nSince < nEventLogStart || nSince > nEventSequence)
+        return false;
+
+    // the sequence numbers of the events are consecutive
+    const size_t nFirst = recentEvents.empty() ? 0 : nSince + 1 - recentEvents.front().nSequence;
+    vEvents.assign(recentEvents.begin() + nFirst, recentEvents.end());
+    return true;
+}
+
+bool CTxMemPool::GetRemovedSince(uint64_t nSince, std::vector<uint256>& vRemoved) const
+{
+    vRemoved.clear();
+    std::vector<CMemPoolEvent> vEvents;
+    if (!GetEventsSince(nSince, vEvents))
+        return false;
+    for (const CMemPoolEvent& event : vEvents)
+        if (event.type == CMemPoolEvent::Type::REMOVED)
+            vRemoved.push_back(event.hash);
+    return true;
+}
+
 bool CTxMemPool::IsFullyNotified() {
     assert(Params().NetworkIDString() == "regtest");
     LOCK(cs);
@@ -2074,14 +2695,53 @@ bool CCoinsViewMemPool::HaveCswNullifier(const uint256& scId, const CFieldElemen
     return mempool.HaveCswNullifier(scId, nullifier) || base->HaveCswNullifier(scId, nullifier);
 }
 
+void CCoinsViewMemPool::HaveCswNullifiers(const std::vector<std::pair<uint256, CFieldElement>>& keys, std::vector<bool>& vHave) const
+{
+    vHave.assign(keys.size(), false);
+    std::vector<std::pair<uint256, CFieldElement>> baseKeys;
+    std::vector<size_t> baseKeysPos;
+    for (size_t i = 0; i < keys.size(); i++) {
+        if (mempool.HaveCswNullifier(keys[i].first, keys[i].second)) {
+            vHave[i] = true;
+        } else {
+            baseKeys.push_back(keys[i]);
+            baseKeysPos.push_back(i);
+        }
+    }
+    if (baseKeys.empty())
+        return;
+
+    std::vector<bool> vBaseHave;
+    base->HaveCswNullifiers(baseKeys, vBaseHave);
+    for (size_t i = 0; i < baseKeys.size(); i++)
+        vHave[baseKeysPos[i]] = vBaseHave[i];
+}
+
+size_t CSidechainMemPoolEntry::DynamicMemoryUsage() const
+{
+    size_t mem = memusage::MallocUsage(fwdTxHashes.capacity() * sizeof(uint256)) +
+                 memusage::MallocUsage(mBackwardCertificates.capacity() * sizeof(CertsByQuality::value_type)) +
+                 memusage::MallocUsage(mcBtrsTxHashes.capacity() * sizeof(uint256)) +
+                 memusage::MallocUsage(cswNullifiers.capacity() * sizeof(std::pair<CFieldElement, uint256>));
+    for (const auto& entry : cswNullifiers)
+        mem += entry.first.DynamicMemoryUsage();
+    return mem;
+}
+
 size_t CTxMemPool::DynamicMemoryUsage() const {
     LOCK(cs);
+    size_t sidechainsUsage = 0;
+    for (const auto& entry : mapSidechains)
+        sidechainsUsage += entry.second.DynamicMemoryUsage();
     return
         ( memusage::DynamicUsage(mapTx) +
           memusage::DynamicUsage(mapNextTx) +
           memusage::DynamicUsage(mapDeltas) +
           memusage::DynamicUsage(mapCertificate) +
           memusage::DynamicUsage(mapSidechains) +
+          memusage::DynamicUsage(mapPackages) +
+          memusage::DynamicUsage(setDescendantScore) +
+          sidechainsUsage +
           cachedInnerUsage);
 }
 
@@ -2103,51 +2763,74 @@ bool CTxMemPool::trimToSize(const CMemPoolEntry* entry, size_t max_size, bool dr
 
     // we must either reject incoming tx, or remove something
     int64_t size_to_be_removed = current_usage + new_entry_usage - max_size;
-    const std::vector<CTxIn>& vin = entry ? entry->GetVin() : std::vector<CTxIn>{};
-    std::multimap<CRawFeeRate, std::vector<uint256>> raw_fee_rates;
-    std::unordered_map<uint256, CRawFeeRate> rates_cache;
     const bool certificatesAllowed = totalCertificateSize > m_max_size / 2;
     LogPrint("mempool", "%s():%d - Trying to remove something to make room (certificatesAllowed: %d, size: %d)\n", __func__, __LINE__, certificatesAllowed, size_to_be_removed);
-    for (const auto& tx: mapTx) {
-        raw_fee_rates.insert(avgFeeRateWithDeps(tx.first, vin, certificatesAllowed, rates_cache));
-    }
-    if (certificatesAllowed) {
-        for (const auto& cert: mapCertificate) {
-            raw_fee_rates.insert(avgFeeRateWithDeps(cert.first, vin, certificatesAllowed, rates_cache));
+
+    // Packages containing an input of the incoming entry can not be evicted in its favour, as well as packages
+    // containing certificates, unless they are allowed. They are considered only once everything else has been.
+    std::set<uint256> entryAncestors;
+    if (entry) {
+        for (const CTxIn& in: entry->GetVin()) {
+            if (mapPackages.count(in.prevout.hash) && entryAncestors.insert(in.prevout.hash).second)
+                calculateAncestors(in.prevout.hash, entryAncestors);
         }
     }
 
     // Check what should be removed, and if this selection includes entry...
+    // A candidate already selected as a descendant of another one is skipped without walking its package again,
+    // and only the roots of the selected packages are removed, their descendants going with them.
     std::unordered_set<uint256> to_be_removed;
+    std::vector<uint256> roots_to_be_removed;
+    auto select_for_removal = [&](const uint256& root) {
+        if (to_be_removed.count(root))
+            return;
+        roots_to_be_removed.push_back(root);
+        to_be_removed.insert(root);
+        size_to_be_removed -= mapPackages.at(root).nSize;
+        std::set<uint256> descendants;
+        calculateDescendants(root, descendants);
+        for (const uint256& h: descendants) {
+            if (to_be_removed.insert(h).second) {
+                size_to_be_removed -= mapPackages.at(h).nSize;
+            }
+        }
+    };
+
+    // The descendant score index gives candidates sorted by the fee rate of the package made by them and all their descendants
+    std::vector<uint256> max_fee_candidates;
     const CFeeRate entry_feerate = entry ? CFeeRate(entry->GetFee(), entry->GetSize()) : CRawFeeRate();
-    for (auto remove_candidate = raw_fee_rates.begin(); remove_candidate != raw_fee_rates.end() && size_to_be_removed > 0; ++remove_candidate) {
+    for (auto remove_candidate = setDescendantScore.begin(); remove_candidate != setDescendantScore.end() && size_to_be_removed > 0; ++remove_candidate) {
+        const uint256& root = remove_candidate->second;
+        if (to_be_removed.count(root)) continue;
+        const CMemPoolPackageInfo& package = mapPackages.at(root);
+        if (package.fCertificate && !certificatesAllowed) continue;
+        if (entryAncestors.count(root) || (package.nCertsWithDescendants > 0 && !certificatesAllowed)) {
+            max_fee_candidates.push_back(root);
+            continue;
+        }
+
         // If it includes entry (i.e. the incoming tx/cert has a fee eq/lower than other elements that would be evicted),
         // then just reject the incoming transaction and do nothing else
         if (entry && remove_candidate->first >= entry_feerate) return false;
 
-        for (const uint256& h: remove_candidate->second) {
-            if (to_be_removed.insert(h).second) {
-                size_to_be_removed -= rates_cache.at(h).GetBytes();
-            }
-        }
+        select_for_removal(root);
+    }
+    for (auto remove_candidate = max_fee_candidates.begin(); remove_candidate != max_fee_candidates.end() && size_to_be_removed > 0; ++remove_candidate) {
+        if (entry) return false;
+        select_for_removal(*remove_candidate);
     }
 
     if (!dryrun) {
         // Actually remove things from mempool
-        for (const uint256& r: to_be_removed) {
-            std::list<CTransaction> removed_txs;
-            std::list<CScCertificate> removed_certs;
-            remove(r, removed_txs, removed_certs, true);
-            // Might even remove nothing at one iteration, if r was removed as a dependency in a previous iteration already.
+        std::list<CTransaction> removed_txs;
+        std::list<CScCertificate> removed_certs;
+        for (const uint256& r: roots_to_be_removed) {
+            remove(r, removed_txs, removed_certs, true, MemPoolRemovalReason::SIZELIMIT);
             LogPrint("mempool", "%s():%d - Removed %s and its dependants\n", __func__, __LINE__, r.ToString());
-            for(const CTransaction &t: removed_txs) {
-                LogPrint("mempool", "%s():%d - Syncing tx %s\n", __func__, __LINE__, t.GetHash().ToString());
-                SyncWithWallets(t, nullptr);
-            }
-            for(const CScCertificate &c: removed_certs) {
-                LogPrint("mempool", "%s():%d - Syncing cert %s\n", __func__, __LINE__, c.GetHash().ToString());
-                SyncWithWallets(c, nullptr);
-            }
+        }
+        if (!removed_txs.empty() || !removed_certs.empty()) {
+            LogPrint("mempool", "%s():%d - Syncing %u txs and %u certs\n", __func__, __LINE__, removed_txs.size(), removed_certs.size());
+            SyncWithWallets(removed_txs, removed_certs);
         }
     }
     return true;
@@ -2159,39 +2842,39 @@ std::pair<uint256, CAmount> CTxMemPool::FindCertWithQuality(const uint256& scId,
 
     auto sc_it = mapSidechains.find(scId);
     if (sc_it != mapSidechains.end()) {
-        for (const auto& mempoolCertEntry : sc_it->second.mBackwardCertificates)
-        {
-            const auto& certEntry = mapCertificate.at(mempoolCertEntry.second);
-            const CScCertificate& mempoolCert = certEntry.GetCertificate();
-            if (mempoolCert.quality == certQuality) {
-                return std::make_pair(mempoolCert.GetHash(), certEntry.GetFee());
-            }
-        }
+        // the certificates of a sidechain are keyed by their quality
+        const auto cert_it = sc_it->second.mBackwardCertificates.find(certQuality);
+        if (cert_it != sc_it->second.mBackwardCertificates.end())
+            return std::make_pair(cert_it->second, mapCertificate.at(cert_it->second).GetFee());
     }
 
     return std::make_pair(uint256(), CAmount(-1));
 }
 
-bool CTxMemPool::RemoveCertAndSync(const uint256& certToRmHash)
+bool CTxMemPool::ReplaceCertWithQuality(const uint256& replacedHash, const uint256& hash, const CCertificateMemPoolEntry& entry,
+                                        bool fCurrentEstimate)
 {
     LOCK(cs);
 
-    if(mapCertificate.count(certToRmHash) == 0)
-        return true; //nothing to remove
-
     std::list<CTransaction> conflictingTxs;
     std::list<CScCertificate> conflictingCerts;
-    remove(certToRmHash, conflictingTxs, conflictingCerts, true);
+    remove(replacedHash, conflictingTxs, conflictingCerts, true, MemPoolRemovalReason::REPLACED);
 
-    // Tell wallet about transactions and certificates that went from mempool to conflicted:
-    for(const auto &t: conflictingTxs) {
-        LogPrint("mempool", "%s():%d - syncing tx %s\n", __func__, __LINE__, t.GetHash().ToString());
-        SyncWithWallets(t, nullptr);
-    }
-    for(const auto &c: conflictingCerts) {
-        LogPrint("mempool", "%s():%d - syncing cert %s\n", __func__, __LINE__, c.GetHash().ToString());
-        SyncWithWallets(c, nullptr);
+    const bool fAdded = addUnchecked(hash, entry, fCurrentEstimate);
+    if (!fAdded && fAddressIndex && !conflictingCerts.empty())
+    {
+        // the slot left by the replaced cert is empty after all, promote the next top quality in its place
+        const uint256& scId = entry.GetCertificate().GetScId();
+        const CSidechain* const pSidechain = pcoinsTip->AccessSidechain(scId);
+        if (pSidechain != nullptr && !pSidechain->isNonCeasing())
+            updateTopQualCertAddressIndex(scId);
     }
 
-    return true;
+    // Tell wallet about transactions and certificates that went from mempool to conflicted:
+    LogPrint("mempool", "%s():%d - syncing %u txs and %u certs replaced with cert %s\n", __func__, __LINE__,
+        conflictingTxs.size(), conflictingCerts.size(), hash.ToString());
+    if (!conflictingTxs.empty() || !conflictingCerts.empty())
+        SyncWithWallets(conflictingTxs, conflictingCerts);
+
+    return fAdded;
 }
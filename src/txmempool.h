@@ -6,10 +6,14 @@
 #ifndef BITCOIN_TXMEMPOOL_H
 #define BITCOIN_TXMEMPOOL_H
 
+#include <deque>
 #include <list>
 #include <vector>
 #include <unordered_map>
 
+#include <boost/container/flat_map.hpp>
+#include <boost/container/flat_set.hpp>
+
 #if defined(HAVE_CONFIG_H)
 #include "config/bitcoin-config.h"
 #endif
@@ -19,12 +23,31 @@
 
 #include "amount.h"
 #include "coins.h"
+#include "policy/fees.h"
 #include "primitives/transaction.h"
 #include "primitives/certificate.h"
 #include "sync.h"
 
 class CAutoFile;
 
+/**
+ * Salted hasher for the mempool address and spent indexes. The address bucket, the entries of a
+ * bucket and the spent outpoints are all keyed by data a peer can choose, hence the salt.
+ */
+class CMempoolIndexHasher
+{
+private:
+    uint64_t k0, k1;
+
+public:
+    CMempoolIndexHasher();
+
+    size_t operator()(const std::pair<uint160, AddressType>& address) const;
+    // the address of the key is the one of its bucket, only the rest of the key is hashed
+    size_t operator()(const CMempoolAddressDeltaKey& key) const;
+    size_t operator()(const CSpentIndexKey& key) const;
+};
+
 inline double AllowFreeThreshold()
 {
     // the threshold represents a one day old, 1 ZEN coin (144*4 is the expected number of blocks per day) and a transaction size of 250 bytes.
@@ -43,6 +66,34 @@ inline bool AllowFree(double dPriority)
 /** Fake height value used in CCoins to signify they are only in the memory pool (since 0.8) */
 static const unsigned int MEMPOOL_HEIGHT = 0x7FFFFFFF;
 
+/** Number of events the mempool remembers, for the clients following its changes since a sequence */
+static const size_t MEMPOOL_EVENT_LOG_SIZE = 100000;
+
+/** Why an entry left the mempool */
+enum class MemPoolRemovalReason {
+    UNKNOWN = 0, //! not told by the caller
+    BLOCK,       //! included in a connected block
+    CONFLICT,    //! spending the same inputs as a block transaction, or a certificate of lower quality
+    STALE,       //! invalid after a change of the chain or of the sidechains
+    SIZELIMIT,   //! evicted to make room for a better paying entry
+    REPLACED,    //! a certificate replaced by one of the same quality paying a higher fee, which takes its top quality slot
+    REORG,       //! from a disconnected block and not accepted again
+};
+
+std::string MemPoolRemovalReasonToString(MemPoolRemovalReason reason);
+
+/** An entry added to or removed from the mempool, with the sequence number the mempool gave to the event */
+struct CMemPoolEvent
+{
+    enum class Type { ADDED, REMOVED };
+
+    Type type;
+    uint64_t nSequence;
+    uint256 hash;
+    bool fCertificate;
+    MemPoolRemovalReason reason;
+};
+
 class CMemPoolEntry
 {
 protected:
@@ -52,6 +103,8 @@ protected:
     int64_t nTime; //! Local time when entering the mempool
     double dPriority; //! Priority when entering the mempool
     unsigned int nHeight; //! Chain height when entering the mempool
+    uint64_t nSequence; //! The sequence number of the mempool event adding the entry
+    mutable std::shared_ptr<const std::string> pHex; //! The hex serialization, encoded by GetHex on first use
 public:
     CMemPoolEntry();
     CMemPoolEntry(const CAmount& _nFee, int64_t _nTime, double _dPriority, unsigned int _nHeight);
@@ -60,10 +113,14 @@ public:
     CAmount GetFee() const { return nFee; }
     int64_t GetTime() const { return nTime; }
     unsigned int GetHeight() const { return nHeight; }
+    uint64_t GetSequence() const { return nSequence; }
+    void SetSequence(uint64_t _nSequence) { nSequence = _nSequence; }
     size_t DynamicMemoryUsage() const { return nUsageSize; }
     virtual size_t GetSize() const = 0;
     virtual const std::vector<CTxIn>& GetVin() const = 0;
     virtual bool IsCertificate() const = 0;
+    //! The hex serialization for getblocktemplate, shared with the templates; requires the mempool cs
+    virtual std::shared_ptr<const std::string> GetHex() const = 0;
 };
 
 /**
@@ -72,7 +129,8 @@ public:
 class CTxMemPoolEntry : public CMemPoolEntry
 {
 private:
-    CTransaction tx;
+    //! Shared with the copies of the entry and the list of the transactions recently added
+    std::shared_ptr<const CTransaction> tx;
     size_t nTxSize; //! ... and avoid recomputing tx size
     bool hadNoDependencies; //! Not dependent on any other txs when it entered the mempool
 
@@ -80,19 +138,22 @@ public:
     CTxMemPoolEntry(const CTransaction& _tx, const CAmount& _nFee, int64_t _nTime, double _dPriority, unsigned int _nHeight, bool poolHasNoInputsOf = false);
     CTxMemPoolEntry();
 
-    const CTransaction& GetTx() const { return this->tx; }
+    const CTransaction& GetTx() const { return *this->tx; }
+    const std::shared_ptr<const CTransaction>& GetSharedTx() const { return this->tx; }
     double GetPriority(unsigned int currentHeight) const override;
     size_t GetTxSize() const { return nTxSize; }
     bool WasClearAtEntry() const { return hadNoDependencies; }
     virtual size_t GetSize() const override { return GetTxSize(); }
-    virtual const std::vector<CTxIn>& GetVin() const override { return tx.GetVin(); }
+    virtual const std::vector<CTxIn>& GetVin() const override { return tx->GetVin(); }
     virtual bool IsCertificate() const override { return false; }
+    virtual std::shared_ptr<const std::string> GetHex() const override;
 };
 
 class CCertificateMemPoolEntry : public CMemPoolEntry
 {
 private:
-    CScCertificate cert;
+    //! Shared with the copies of the entry and the list of the certificates recently added
+    std::shared_ptr<const CScCertificate> cert;
     size_t nCertificateSize; //! ... and avoid recomputing tx size
 
 public:
@@ -100,12 +161,76 @@ public:
         const CScCertificate& _cert, const CAmount& _nFee, int64_t _nTime, double _dPriority, unsigned int _nHeight);
     CCertificateMemPoolEntry();
 
-    const CScCertificate& GetCertificate() const { return this->cert; }
+    const CScCertificate& GetCertificate() const { return *this->cert; }
+    const std::shared_ptr<const CScCertificate>& GetSharedCertificate() const { return this->cert; }
     double GetPriority(unsigned int currentHeight) const override;
     size_t GetCertificateSize() const { return nCertificateSize; }
     virtual size_t GetSize() const override { return GetCertificateSize(); }
-    virtual const std::vector<CTxIn>& GetVin() const override { return cert.GetVin(); }
+    virtual const std::vector<CTxIn>& GetVin() const override { return cert->GetVin(); }
     virtual bool IsCertificate() const override { return true; }
+    virtual std::shared_ptr<const std::string> GetHex() const override;
+};
+
+/**
+ * In-mempool dependency links of a tx/cert, together with the cached aggregates of the
+ * package made by the entry plus all its in-mempool ancestors (resp. descendants).
+ * Links follow mempoolDirectDependenciesFrom/Of, i.e. they include the dependencies
+ * between an scCreation and the fwds/btrs directed to the sidechain it creates.
+ * Aggregates are kept up to date incrementally by addUnchecked and remove.
+ */
+struct CMemPoolPackageInfo
+{
+    std::set<uint256> parents;
+    std::set<uint256> children;
+    //! The in-mempool dependencies as mempoolDirectDependenciesFrom lists them: the inputs in vin order,
+    //! then the creations of the sidechains of the outputs (the entry itself if it creates one of them)
+    std::vector<uint256> vDepends;
+
+    CAmount nFee = 0;   //! Fee of the entry alone (no prioritisation deltas)
+    size_t nSize = 0;   //! Size of the entry alone
+    bool fCertificate = false;
+
+    uint64_t nCountWithAncestors = 0;
+    size_t nSizeWithAncestors = 0;
+    CAmount nFeesWithAncestors = 0;
+
+    uint64_t nCountWithDescendants = 0;
+    size_t nSizeWithDescendants = 0;
+    CAmount nFeesWithDescendants = 0;
+    uint64_t nCertsWithDescendants = 0;
+
+    CFeeRate GetDescendantFeeRate() const { return CRawFeeRate(nFeesWithDescendants, nSizeWithDescendants); }
+    CFeeRate GetAncestorFeeRate() const { return CRawFeeRate(nFeesWithAncestors, nSizeWithAncestors); }
+};
+
+/**
+ * The fields of a mempool entry given by getrawmempool true and /rest/mempool/contents, copied under the
+ * mempool lock so that they are serialized after it is released
+ */
+struct CMemPoolEntryInfo
+{
+    uint256 hash;
+    //! false for the prioritisation of a hash not in the mempool, that only has the deltas
+    bool fInMempool = true;
+    bool fCert = false;
+    int nSize = 0;
+    CAmount nFee = 0;
+    int64_t nTime = 0;
+    int nHeight = 0;
+    double dStartingPriority = 0;
+    double dCurrentPriority = 0;
+    int32_t nVersion = 0;
+    std::vector<uint256> vDepends;
+    bool fPackage = false;
+    uint64_t nCountWithDescendants = 0;
+    int64_t nSizeWithDescendants = 0;
+    CAmount nFeesWithDescendants = 0;
+    uint64_t nCountWithAncestors = 0;
+    int64_t nSizeWithAncestors = 0;
+    CAmount nFeesWithAncestors = 0;
+    bool fDelta = false;
+    double dPriorityDelta = 0;
+    CAmount nFeeDelta = 0;
 };
 
 class CBlockPolicyEstimator;
@@ -124,14 +249,22 @@ public:
     size_t DynamicMemoryUsage() const { return 0; }
 };
 
+/**
+ * The mempool content related to a sidechain. The containers are sorted vectors rather than node based trees,
+ * as they are walked by the block time cleanups far more often than they are changed.
+ */
 struct CSidechainMemPoolEntry
 {
+    typedef boost::container::flat_map<int64_t, uint256> CertsByQuality;
+
     uint256 scCreationTxHash;
-    std::set<uint256> fwdTxHashes; 
-    std::map<int64_t, uint256> mBackwardCertificates; // quality -> certHash
-    std::set<uint256> mcBtrsTxHashes;
-    std::map<CFieldElement, uint256> cswNullifiers; // csw nullifier -> containing Tx hash
-    CAmount cswTotalAmount;
+    boost::container::flat_set<uint256> fwdTxHashes;
+    CertsByQuality mBackwardCertificates; // quality -> certHash
+    boost::container::flat_set<uint256> mcBtrsTxHashes;
+    boost::container::flat_map<CFieldElement, uint256> cswNullifiers; // csw nullifier -> containing Tx hash
+    CAmount cswTotalAmount = 0;
+    //! Whether the sidechain is already in CTxMemPool::vTouchedSidechains
+    bool fTouchedByBlock = false;
 
     // Note: in fwdTxHashes and mcBtrsTxHashes, a tx is registered only once,
     // even if sends multiple fwts/btrs founds to a sidechain.
@@ -145,11 +278,13 @@ struct CSidechainMemPoolEntry
                 cswTotalAmount == 0;
     }
 
-    const std::map<int64_t, uint256>::const_reverse_iterator GetTopQualityCert() const;
-    const std::map<int64_t, uint256>::const_iterator GetCert(const uint256& hash) const;
+    const CertsByQuality::const_reverse_iterator GetTopQualityCert() const;
+    const CertsByQuality::const_iterator GetCert(const uint256& hash) const;
 
     void EraseCert(const uint256& hash);
     bool HasCert(const uint256& hash) const;
+
+    size_t DynamicMemoryUsage() const;
 };
 
 /**
@@ -173,26 +308,63 @@ private:
     uint64_t totalTxSize = 0; //! sum of all mempool tx' byte sizes
     uint64_t totalCertificateSize = 0; //! sum of all mempool certificates' byte sizes
     uint64_t cachedInnerUsage; //! sum of dynamic memory usage of all the map elements (NOT the maps themselves)
+    CAmount nFeesAdded = 0; //! sum of the fees of all the transactions and certificates ever added
 
     bool checkTxImmatureExpenditures(const CTransaction& tx, const CCoinsViewCache * const pcoins);
     bool checkCertImmatureExpenditures(const CScCertificate& cert, const CCoinsViewCache * const pcoins);
+    //! Whether the sidechain of the output no longer takes it, as of the sidechains in pCoinsView
+    bool isScOutputStale(const CTxForwardTransferOut& ft, const CCoinsViewCache * const pCoinsView) const;
+    bool isScOutputStale(const CBwtRequestOut& mbtr, const CCoinsViewCache * const pCoinsView) const;
+    bool isCertStale(const CScCertificate& cert, const CCoinsViewCache * const pCoinsView);
 
-    std::map<uint256, std::shared_ptr<CTransactionBase> > mapRecentlyAddedTxBase;
+    std::map<uint256, std::shared_ptr<const CTransactionBase> > mapRecentlyAddedTxBase;
     uint64_t nRecentlyAddedSequence = 0;
     uint64_t nNotifiedSequence = 0;
 
-    typedef std::map<CMempoolAddressDeltaKey, CMempoolAddressDelta, CMempoolAddressDeltaKeyCompare> addressDeltaMap;
+    //! the sequence number of the last entry added or removed, counted apart from nRecentlyAddedSequence
+    //! which only follows the additions to be notified
+    uint64_t nEventSequence = 0;
+    //! the entries added and removed, oldest first
+    std::deque<CMemPoolEvent> recentEvents;
+    //! the events after this sequence are all in recentEvents
+    uint64_t nEventLogStart = 0;
+    void logEvent(CMemPoolEvent::Type type, const uint256& hash, bool fCertificate, MemPoolRemovalReason reason);
+
+    //! the address index deltas of the mempool, bucketed by address
+    typedef std::unordered_map<CMempoolAddressDeltaKey, CMempoolAddressDelta, CMempoolIndexHasher> addressDeltaBucket;
+    typedef std::unordered_map<std::pair<uint160, AddressType>, addressDeltaBucket, CMempoolIndexHasher> addressDeltaMap;
     addressDeltaMap mapAddress;
 
-    typedef std::map<uint256, std::vector<CMempoolAddressDeltaKey> > addressDeltaMapInserted;
+    typedef std::unordered_map<uint256, std::vector<CMempoolAddressDeltaKey> > addressDeltaMapInserted;
     addressDeltaMapInserted mapAddressInserted;
 
-    typedef std::map<CSpentIndexKey, CSpentIndexValue, CSpentIndexKeyCompare> mapSpentIndex;
+    typedef std::unordered_map<CSpentIndexKey, CSpentIndexValue, CMempoolIndexHasher> mapSpentIndex;
     mapSpentIndex mapSpent;
 
-    typedef std::map<uint256, std::vector<CSpentIndexKey> > mapSpentIndexInserted;
+    typedef std::unordered_map<uint256, std::vector<CSpentIndexKey> > mapSpentIndexInserted;
     mapSpentIndexInserted mapSpentInserted;
 
+    void setAddressDeltaOutStatus(const CMempoolAddressDeltaKey& key, CMempoolAddressDelta::OutputStatus outStatus);
+
+    std::map<uint256, CMemPoolPackageInfo> mapPackages;
+    //! txes/certs sorted by the fee rate of the package made by them and all their descendants
+    std::set<std::pair<CFeeRate, uint256> > setDescendantScore;
+
+    void calculateAncestors(const uint256& hash, std::set<uint256>& ancestors) const;
+    void calculateDescendants(const uint256& hash, std::set<uint256>& descendants) const;
+    void updateAncestorState(const uint256& hash);
+    void updateDescendantState(const uint256& hash);
+    void addPackageLinks(const uint256& hash, const CTransactionBase& root, const CMemPoolEntry& entry);
+    void removePackageLinks(const std::vector<uint256>& hashes, bool fDescendantsIncluded);
+
+    //! The sidechains of mapSidechains touched by the block being connected, whose balance may have dropped
+    std::vector<uint256> vTouchedSidechains;
+    void markSidechainTouched(const uint256& scId);
+    void addOutOfScBalanceCsw(const uint256& scId, const CSidechainMemPoolEntry& sidechainEntry,
+                              const CCoinsViewCache * const pCoinsView, std::set<uint256>& txesToRemove) const;
+    void removeTouchedOutOfScBalanceCsw(const CCoinsViewCache * const pCoinsView,
+                                        std::list<CTransaction>& removedTxs, std::list<CScCertificate>& removedCerts);
+
 public:
     const uint64_t m_max_size;
     mutable CCriticalSection cs;
@@ -226,7 +398,13 @@ public:
     void setSanityCheck(bool _fSanityCheck) { fSanityCheck = _fSanityCheck; }
 
     std::pair<uint256, CAmount> FindCertWithQuality(const uint256& scId, int64_t certQuality) const;
-    bool RemoveCertAndSync(const uint256& certToRmHash);
+    /**
+     * Add the certificate of entry in place of the one of the same quality, replacedHash, it outbids. The spenders
+     * of the replaced one go with it, and the wallets are told about all of them at once. Unless the new certificate
+     * is refused, e.g. by a full mempool, the address index keeps the status of the other certificates of the sidechain.
+     */
+    bool ReplaceCertWithQuality(const uint256& replacedHash, const uint256& hash, const CCertificateMemPoolEntry& entry,
+                                bool fCurrentEstimate = true);
 
     bool addUnchecked(const uint256& hash, const CTxMemPoolEntry &entry, bool fCurrentEstimate = true);
     bool addUnchecked(const uint256& hash, const CCertificateMemPoolEntry &entry, bool fCurrentEstimate = true);
@@ -247,10 +425,19 @@ public:
     std::vector<uint256> mempoolDependenciesFrom(const CTransactionBase& origTx) const;
     std::vector<uint256> mempoolDependenciesOf(const CTransactionBase& origTx) const;
 
-    std::pair<CRawFeeRate, std::vector<uint256>> avgFeeRateWithDeps(const uint256& rootTx, const std::vector<CTxIn>& vin, const bool certificatesAllowed, std::unordered_map<uint256, CRawFeeRate>& cache) const;
+    bool getPackageInfo(const uint256& hash, CMemPoolPackageInfo& info) const;
+    /**
+     * Appends the txes, then the certificates, added after the sequence nAddedAfter (all of them for 0), with
+     * their dependencies taken from the package links and their deltas; fDeltasOnly also appends the deltas
+     * of the hashes not in the mempool. The caller holds cs, the infos are meant to be serialized after
+     * releasing it.
+     */
+    void getEntryInfos(int nChainHeight, uint64_t nAddedAfter, bool fDeltasOnly, std::vector<CMemPoolEntryInfo>& vInfos) const;
 
-    void remove(const CTransactionBase& origTx, std::list<CTransaction>& removedTxs, std::list<CScCertificate>& removedCerts, bool fRecursive = false);
-    void remove(const uint256& origTx, std::list<CTransaction>& removedTxs, std::list<CScCertificate>& removedCerts, bool fRecursive = false);
+    void remove(const CTransactionBase& origTx, std::list<CTransaction>& removedTxs, std::list<CScCertificate>& removedCerts,
+                bool fRecursive = false, MemPoolRemovalReason reason = MemPoolRemovalReason::UNKNOWN);
+    void remove(const uint256& origTx, std::list<CTransaction>& removedTxs, std::list<CScCertificate>& removedCerts,
+                bool fRecursive = false, MemPoolRemovalReason reason = MemPoolRemovalReason::UNKNOWN);
 
     void removeWithAnchor(const uint256 &invalidRoot);
 
@@ -263,6 +450,14 @@ public:
                                  std::list<CTransaction> &removedTxs, std::list<CScCertificate> &removedCerts);
     void removeStaleTransactions(const CCoinsViewCache * const pCoinsView, std::list<CTransaction>& outdatedTxs,
                                  std::list<CScCertificate>& outdatedCerts, bool fHardForkCheckEnabled = false);
+    /**
+     * The cleanups after a connected block, limited to the entries depending on the sidechains the block
+     * changed the state, the epoch or the fees of (changedScIds), found through mapSidechains. A block only
+     * ending the certificate submission window of a ceasing sidechain changes none of them, hence the
+     * certificates of the other sidechains are checked against their window still.
+     */
+    void removeStaleTransactions(const CCoinsViewCache * const pCoinsView, const std::set<uint256>& changedScIds,
+                                 std::list<CTransaction>& outdatedTxs, std::list<CScCertificate>& outdatedCerts);
     // END OF UNCONFIRMED TRANSACTIONS CLEANUP METHODS
 
     // UNCONFIRMED CERTIFICATES CLEANUP METHODS
@@ -272,6 +467,8 @@ public:
                          std::list<CTransaction>& removedTxs, std::list<CScCertificate>& removedCerts);
     void removeStaleCertificates(const CCoinsViewCache * const pCoinsView,
                                  std::list<CScCertificate>& outdatedCerts);
+    void removeStaleCertificates(const CCoinsViewCache * const pCoinsView, const std::set<uint256>& changedScIds,
+                                 std::list<CScCertificate>& outdatedCerts);
     void removeCertificatesWithoutRef(const CCoinsViewCache * const pCoinsView,
                                  std::list<CScCertificate>& outdatedCerts);
     // END OF UNCONFIRMED CERTIFICATES CLEANUP METHODS
@@ -281,6 +478,8 @@ public:
     void pruneSpent(const uint256& hash, CCoins &coins);
     unsigned int GetTransactionsUpdated() const;
     void AddTransactionsUpdated(unsigned int n);
+    //! The fees of all the transactions and certificates added so far, whether still in the pool or not
+    CAmount GetFeesAdded() const;
     /**
      * Check that none of this transactions inputs are in the mempool, and thus
      * the tx is not dependent on other mempool transactions to be included in a block.
@@ -295,6 +494,17 @@ public:
     void NotifyRecentlyAdded();
     bool IsFullyNotified();
 
+    /** The sequence number of the last entry added or removed, each entry keeps the one it was added with */
+    uint64_t GetSequence() const;
+    /**
+     * The events after the sequence nSince, oldest first, false if the events that far back are not remembered
+     * any more. Replaying them as adds and removes on a copy of the mempool taken at nSince or later gives
+     * the mempool as it is now.
+     */
+    bool GetEventsSince(uint64_t nSince, std::vector<CMemPoolEvent>& vEvents) const;
+    //! The hashes of the entries removed since the sequence nSince was current, as given by GetEventsSince
+    bool GetRemovedSince(uint64_t nSince, std::vector<uint256>& vRemoved) const;
+
     unsigned long sizeTx()
     {
         LOCK(cs);
@@ -382,11 +592,17 @@ public:
 
     bool lookup(const uint256& hash, CTransaction& result) const;
     bool lookup(const uint256& hash, CScCertificate& result) const;
+    /**
+     * Sort the hashes of txes/certs to announce: those with fewer in-mempool ancestors first, so that
+     * parents go before their children, then the highest fee rates first. Hashes no longer in the
+     * mempool go last.
+     */
+    void sortForRelay(std::vector<uint256>& vHashes) const;
 
     void CertQualityStatusString(const CScCertificate& cert, std::string& statusString) const;
 
-    /** Estimate fee rate needed to get into the next nBlocks */
-    CFeeRate estimateFee(int nBlocks) const;
+    /** Estimate fee rate needed to get into the next nBlocks, for the given kind of transactions */
+    CFeeRate estimateFee(int nBlocks, FeeEstimateType type = FeeEstimateType::TRANSACTION) const;
 
     /** Estimate priority needed to get into the next nBlocks */
     double estimatePriority(int nBlocks) const;
@@ -419,6 +635,8 @@ public:
     void GetScIds(std::set<uint256>& scIdsList)                         const override;
     bool HaveCswNullifier(const uint256& scId,
                           const CFieldElement &nullifier) const override;
+    void HaveCswNullifiers(const std::vector<std::pair<uint256, CFieldElement>>& keys,
+                           std::vector<bool>& vHave) const override;
 };
 
 #endif // BITCOIN_TXMEMPOOL_H
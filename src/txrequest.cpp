@@ -0,0 +1,136 @@
+#include "txrequest.h"
+
+#include <assert.h>
+
+bool CTxRequestTracker::ReceivedInv(NodeId peer, const CInv& inv)
+{
+    CPeerAnnouncements& peerAnnouncements = mapPeers[peer];
+    if (peerAnnouncements.mapAnnounced.size() >= MAX_PEER_TX_ANNOUNCEMENTS)
+        return false;
+    // a peer only has one pending announcement of an inv
+    if (!peerAnnouncements.mapAnnounced.insert(std::make_pair(inv, nSequence)).second)
+        return false;
+
+    InvIter it = mapInvs.insert(std::make_pair(inv, CInvAnnouncements())).first;
+    it->second.setCandidates.insert(std::make_pair(nSequence, peer));
+    nSequence++;
+    Schedule(it);
+    return true;
+}
+
+void CTxRequestTracker::Schedule(InvIter it)
+{
+    CInvAnnouncements& announcements = it->second;
+    if (announcements.requestedFrom != -1)
+        return;
+    if (announcements.setCandidates.empty()) {
+        mapInvs.erase(it);
+        return;
+    }
+    const std::pair<uint64_t, NodeId>& first = *announcements.setCandidates.begin();
+    mapPeers[first.second].setReady.insert(std::make_pair(first.first, it->first));
+}
+
+void CTxRequestTracker::ExpireRequests(int64_t nNow)
+{
+    while (!setByExpiry.empty() && setByExpiry.begin()->first <= nNow) {
+        const CInv inv = setByExpiry.begin()->second;
+        setByExpiry.erase(setByExpiry.begin());
+
+        InvIter it = mapInvs.find(inv);
+        assert(it != mapInvs.end() && it->second.requestedFrom != -1);
+        // the peer which did not answer is not asked again, unless it announces the inv again
+        CPeerAnnouncements& peerAnnouncements = mapPeers[it->second.requestedFrom];
+        peerAnnouncements.mapAnnounced.erase(inv);
+        peerAnnouncements.nInFlight--;
+        it->second.requestedFrom = -1;
+        Schedule(it);
+    }
+}
+
+std::vector<CInv> CTxRequestTracker::GetRequestable(NodeId peer, int64_t nNow)
+{
+    ExpireRequests(nNow);
+
+    std::vector<CInv> vRequestable;
+    std::map<NodeId, CPeerAnnouncements>::iterator itPeer = mapPeers.find(peer);
+    if (itPeer == mapPeers.end())
+        return vRequestable;
+
+    CPeerAnnouncements& peerAnnouncements = itPeer->second;
+    vRequestable.reserve(peerAnnouncements.setReady.size());
+    for (const std::pair<uint64_t, CInv>& ready : peerAnnouncements.setReady) {
+        InvIter it = mapInvs.find(ready.second);
+        assert(it != mapInvs.end() && it->second.requestedFrom == -1);
+        it->second.setCandidates.erase(std::make_pair(ready.first, peer));
+        it->second.requestedFrom = peer;
+        it->second.nExpiry = nNow + TX_REQUEST_TIMEOUT;
+        setByExpiry.insert(std::make_pair(it->second.nExpiry, ready.second));
+        vRequestable.push_back(ready.second);
+    }
+    peerAnnouncements.nInFlight += vRequestable.size();
+    peerAnnouncements.setReady.clear();
+    return vRequestable;
+}
+
+void CTxRequestTracker::Forget(const CInv& inv)
+{
+    InvIter it = mapInvs.find(inv);
+    if (it == mapInvs.end())
+        return;
+
+    CInvAnnouncements& announcements = it->second;
+    for (const std::pair<uint64_t, NodeId>& candidate : announcements.setCandidates) {
+        CPeerAnnouncements& peerAnnouncements = mapPeers[candidate.second];
+        peerAnnouncements.mapAnnounced.erase(inv);
+        peerAnnouncements.setReady.erase(std::make_pair(candidate.first, inv));
+    }
+    if (announcements.requestedFrom != -1) {
+        CPeerAnnouncements& peerAnnouncements = mapPeers[announcements.requestedFrom];
+        peerAnnouncements.mapAnnounced.erase(inv);
+        peerAnnouncements.nInFlight--;
+        setByExpiry.erase(std::make_pair(announcements.nExpiry, inv));
+    }
+    mapInvs.erase(it);
+}
+
+void CTxRequestTracker::DisconnectedPeer(NodeId peer)
+{
+    std::map<NodeId, CPeerAnnouncements>::iterator itPeer = mapPeers.find(peer);
+    if (itPeer == mapPeers.end())
+        return;
+    const std::map<CInv, uint64_t> mapAnnounced = std::move(itPeer->second.mapAnnounced);
+    mapPeers.erase(itPeer);
+
+    // the invs requested from the peer, or it was to be asked for, go to their next announcer at once
+    for (const std::pair<CInv, uint64_t>& announced : mapAnnounced) {
+        InvIter it = mapInvs.find(announced.first);
+        assert(it != mapInvs.end());
+        if (it->second.requestedFrom == peer) {
+            setByExpiry.erase(std::make_pair(it->second.nExpiry, announced.first));
+            it->second.requestedFrom = -1;
+        } else {
+            it->second.setCandidates.erase(std::make_pair(announced.second, peer));
+        }
+        Schedule(it);
+    }
+}
+
+void CTxRequestTracker::Clear()
+{
+    mapInvs.clear();
+    mapPeers.clear();
+    setByExpiry.clear();
+}
+
+size_t CTxRequestTracker::CountAnnounced(NodeId peer) const
+{
+    std::map<NodeId, CPeerAnnouncements>::const_iterator it = mapPeers.find(peer);
+    return it == mapPeers.end() ? 0 : it->second.mapAnnounced.size();
+}
+
+size_t CTxRequestTracker::CountInFlight(NodeId peer) const
+{
+    std::map<NodeId, CPeerAnnouncements>::const_iterator it = mapPeers.find(peer);
+    return it == mapPeers.end() ? 0 : it->second.nInFlight;
+}
@@ -0,0 +1,80 @@
+#ifndef BITCOIN_TXREQUEST_H
+#define BITCOIN_TXREQUEST_H
+
+#include "net.h"
+#include "protocol.h"
+
+#include <map>
+#include <set>
+#include <stdint.h>
+#include <utility>
+#include <vector>
+
+//! A getdata not answered within this time is sent to the next peer which announced the inv, in microseconds
+static const int64_t TX_REQUEST_TIMEOUT = 2 * 60 * 1000000;
+//! The maximum number of invs a peer announced which are neither received nor timed out
+static const size_t MAX_PEER_TX_ANNOUNCEMENTS = 2 * MAX_INV_SZ;
+
+/**
+ * The txes and certificates announced by the peers, and the getdata sent for them. An inv is asked
+ * from one peer at a time, the first one which announced it; if that peer has not sent it after
+ * TX_REQUEST_TIMEOUT, or disconnects, the next announcer is asked.
+ *
+ * Each inv keeps its announcers not asked yet, ordered by announcement, and the peer it is
+ * requested from. Each peer keeps the invs it is the next announcer of, so that its getdata are
+ * found without going through the invs of the other peers, and the requests in flight are indexed
+ * by expiry time. Guarded by cs_main.
+ */
+class CTxRequestTracker
+{
+public:
+    //! Record that peer announced inv, false if it did already or has too many announcements pending
+    bool ReceivedInv(NodeId peer, const CInv& inv);
+    //! The invs to ask peer for now, in announcement order, which are then requested from it until nNow + TX_REQUEST_TIMEOUT
+    std::vector<CInv> GetRequestable(NodeId peer, int64_t nNow);
+    //! Forget the announcements and request of an inv received, or not needed anymore
+    void Forget(const CInv& inv);
+    void DisconnectedPeer(NodeId peer);
+
+    void Clear();
+
+    //! The number of invs tracked
+    size_t Size() const { return mapInvs.size(); }
+    //! The invs announced by peer which are neither received nor timed out, those requested from it included
+    size_t CountAnnounced(NodeId peer) const;
+    size_t CountInFlight(NodeId peer) const;
+
+private:
+    struct CInvAnnouncements
+    {
+        //! (announcement sequence, peer) of the announcers not asked yet, first announced first
+        std::set<std::pair<uint64_t, NodeId> > setCandidates;
+        //! The peer the inv is requested from, -1 if none, and the time the request times out
+        NodeId requestedFrom = -1;
+        int64_t nExpiry = 0;
+    };
+
+    struct CPeerAnnouncements
+    {
+        //! The announcement sequence of the invs announced, received and timed out ones excepted
+        std::map<CInv, uint64_t> mapAnnounced;
+        //! (announcement sequence, inv) of the invs this peer is to be asked for
+        std::set<std::pair<uint64_t, CInv> > setReady;
+        size_t nInFlight = 0;
+    };
+
+    typedef std::map<CInv, CInvAnnouncements>::iterator InvIter;
+
+    //! Make the first announcer of an inv not requested ready to be asked, or forget it if there is none left
+    void Schedule(InvIter it);
+    //! Give the requests timed out by nNow to the next announcers
+    void ExpireRequests(int64_t nNow);
+
+    std::map<CInv, CInvAnnouncements> mapInvs;
+    std::map<NodeId, CPeerAnnouncements> mapPeers;
+    //! (expiry time, inv) of the requests in flight
+    std::set<std::pair<int64_t, CInv> > setByExpiry;
+    uint64_t nSequence = 0;
+};
+
+#endif // BITCOIN_TXREQUEST_H
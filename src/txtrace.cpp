@@ -0,0 +1,163 @@
+#include "txtrace.h"
+
+#include "tinyformat.h"
+#include "utiltime.h"
+
+namespace {
+
+CTxTracer tracer;
+
+const char* const stageNames[(int)TxTraceStage::COUNT] = {
+    "received",
+    "proof_queued",
+    "proof_verify",
+    "proof_verified",
+    "accepted",
+    "relayed",
+    "block_template",
+};
+
+} // anon namespace
+
+const char* TxTraceStageName(TxTraceStage stage)
+{
+    return stageNames[(int)stage];
+}
+
+int64_t CTxTrace::GetLatency(TxTraceStage stage) const
+{
+    for (int s = (int)stage - 1; s >= 0; --s) {
+        if (vTimeMicros[s] != 0)
+            return vTimeMicros[(int)stage] - vTimeMicros[s];
+    }
+    return 0;
+}
+
+CTxTracer::CTxTracer(size_t nMaxSizeIn) : nMaxSize(nMaxSizeIn)
+{
+}
+
+void CTxTracer::SetMaxSize(size_t nMaxSizeIn)
+{
+    std::lock_guard<std::mutex> lock(cs);
+    nMaxSize = nMaxSizeIn;
+    Evict();
+}
+
+void CTxTracer::Evict()
+{
+    while (dequeOrder.size() > nMaxSize) {
+        mapTraces.erase(dequeOrder.front());
+        dequeOrder.pop_front();
+    }
+}
+
+void CTxTracer::Start(const uint256& hash, bool fCertificate, int64_t nTimeMicros)
+{
+    if (!IsEnabled())
+        return;
+
+    std::lock_guard<std::mutex> lock(cs);
+    std::pair<std::map<uint256, CTxTrace>::iterator, bool> ret = mapTraces.emplace(hash, CTxTrace());
+    if (!ret.second)
+        return;
+    ret.first->second.fCertificate = fCertificate;
+    ret.first->second.vTimeMicros[(int)TxTraceStage::RECEIVED] = nTimeMicros;
+    dequeOrder.push_back(hash);
+    Evict();
+}
+
+void CTxTracer::Record(const uint256& hash, TxTraceStage stage, int64_t nTimeMicros)
+{
+    if (!IsEnabled())
+        return;
+
+    std::lock_guard<std::mutex> lock(cs);
+    std::map<uint256, CTxTrace>::iterator it = mapTraces.find(hash);
+    if (it == mapTraces.end())
+        return;
+    CTxTrace& trace = it->second;
+    if (trace.vTimeMicros[(int)stage] != 0)
+        return;
+    trace.vTimeMicros[(int)stage] = nTimeMicros;
+    histograms[trace.fCertificate][(int)stage].Add(trace.GetLatency(stage));
+}
+
+bool CTxTracer::Get(const uint256& hash, CTxTrace& trace) const
+{
+    std::lock_guard<std::mutex> lock(cs);
+    std::map<uint256, CTxTrace>::const_iterator it = mapTraces.find(hash);
+    if (it == mapTraces.end())
+        return false;
+    trace = it->second;
+    return true;
+}
+
+size_t CTxTracer::Size() const
+{
+    std::lock_guard<std::mutex> lock(cs);
+    return mapTraces.size();
+}
+
+CLatencyHistogram::Snapshot CTxTracer::GetSnapshot(bool fCertificate, TxTraceStage stage) const
+{
+    return histograms[fCertificate][(int)stage].GetSnapshot();
+}
+
+void CTxTracer::ResetStats()
+{
+    for (int c = 0; c < 2; ++c) {
+        for (CLatencyHistogram& histogram : histograms[c])
+            histogram.Reset();
+    }
+}
+
+void SetTxTraceSize(size_t nMaxSize)
+{
+    tracer.SetMaxSize(nMaxSize);
+}
+
+void StartTxTrace(const uint256& hash, bool fCertificate, int64_t nTimeMicros)
+{
+    tracer.Start(hash, fCertificate, nTimeMicros);
+}
+
+void RecordTxTraceStage(const uint256& hash, TxTraceStage stage)
+{
+    if (tracer.IsEnabled())
+        tracer.Record(hash, stage, GetTimeMicros());
+}
+
+bool GetTxTrace(const uint256& hash, CTxTrace& trace)
+{
+    return tracer.Get(hash, trace);
+}
+
+size_t GetTxTraceCount()
+{
+    return tracer.Size();
+}
+
+CLatencyHistogram::Snapshot GetTxTraceStageSnapshot(bool fCertificate, TxTraceStage stage)
+{
+    return tracer.GetSnapshot(fCertificate, stage);
+}
+
+void ResetTxTraceStats()
+{
+    tracer.ResetStats();
+}
+
+std::string TxTraceStatsToPrometheus()
+{
+    static const char* const metric = "zen_tx_trace_stage_seconds";
+    std::string strOut = strprintf("# HELP %s Time taken by the transactions and certificates received from peers to reach each stage from the previous one.\n", metric);
+    strOut += strprintf("# TYPE %s histogram\n", metric);
+
+    for (int c = 0; c < 2; ++c) {
+        for (int s = (int)TxTraceStage::RECEIVED + 1; s < (int)TxTraceStage::COUNT; ++s)
+            strOut += LatencyHistogramToPrometheus(metric, strprintf("type=\"%s\",stage=\"%s\"", c ? "certificate" : "transaction", stageNames[s]),
+                                                   tracer.GetSnapshot(c, static_cast<TxTraceStage>(s)));
+    }
+    return strOut;
+}
@@ -0,0 +1,97 @@
+#ifndef BITCOIN_TXTRACE_H
+#define BITCOIN_TXTRACE_H
+
+#include "uint256.h"
+#include "validationstats.h"
+
+#include <atomic>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <stdint.h>
+#include <string>
+
+static const unsigned int DEFAULT_TX_TRACE_SIZE = 10000;
+
+/** The stages of a transaction or certificate received from a peer, up to its inclusion in a block template */
+enum class TxTraceStage : int
+{
+    RECEIVED = 0,       //! Received from a peer and not already known, before any check
+    PROOF_QUEUED,       //! Its proofs queued to the async proof verifier
+    PROOF_VERIFY,       //! Taken in a round of the async proof verifier, whose batch verification starts
+    PROOF_VERIFIED,     //! The outcome of its proofs verification processed, before the mempool callback
+    ACCEPTED,           //! Added to the mempool
+    RELAYED,            //! Announced to the peers
+    BLOCK_TEMPLATE,     //! Included in a block template by CreateNewBlock
+    COUNT
+};
+
+//! The name of a stage, as used by gettxtrace, gettxtracestats and the metrics endpoint
+const char* TxTraceStageName(TxTraceStage stage);
+
+struct CTxTrace
+{
+    bool fCertificate = false;
+    //! The time each stage was first reached, in microseconds since the epoch, 0 if it was not
+    int64_t vTimeMicros[(int)TxTraceStage::COUNT] = {};
+
+    //! The time since the last of the earlier stages which was reached, 0 for RECEIVED
+    int64_t GetLatency(TxTraceStage stage) const;
+};
+
+/**
+ * The traces of the last transactions and certificates received from peers, keyed by hash and
+ * evicted oldest first beyond the maximum size, 0 disabling the tracing. A trace is only started
+ * at RECEIVED, the other stages of the objects which are not traced (those created locally, or
+ * already evicted) being ignored, and only the first time a stage is reached is kept. Each stage
+ * reached adds its latency to the histogram of the stage for transactions or for certificates.
+ */
+class CTxTracer
+{
+public:
+    explicit CTxTracer(size_t nMaxSizeIn = DEFAULT_TX_TRACE_SIZE);
+
+    //! Evicts the oldest traces beyond the new maximum size
+    void SetMaxSize(size_t nMaxSizeIn);
+    bool IsEnabled() const { return nMaxSize.load(std::memory_order_relaxed) > 0; }
+
+    void Start(const uint256& hash, bool fCertificate, int64_t nTimeMicros);
+    void Record(const uint256& hash, TxTraceStage stage, int64_t nTimeMicros);
+    bool Get(const uint256& hash, CTxTrace& trace) const;
+    size_t Size() const;
+
+    CLatencyHistogram::Snapshot GetSnapshot(bool fCertificate, TxTraceStage stage) const;
+    void ResetStats();
+
+private:
+    mutable std::mutex cs;
+    std::atomic<size_t> nMaxSize;
+    std::map<uint256, CTxTrace> mapTraces;
+    //! The hashes of mapTraces, oldest first
+    std::deque<uint256> dequeOrder;
+    CLatencyHistogram histograms[2][(int)TxTraceStage::COUNT];
+
+    void Evict();
+};
+
+//! Set the maximum number of traces kept by the node, from -txtracesize
+void SetTxTraceSize(size_t nMaxSize);
+
+//! Start the trace of a transaction or certificate received from a peer at nTimeMicros
+void StartTxTrace(const uint256& hash, bool fCertificate, int64_t nTimeMicros);
+
+//! Record that a traced transaction or certificate reached a stage now
+void RecordTxTraceStage(const uint256& hash, TxTraceStage stage);
+
+bool GetTxTrace(const uint256& hash, CTxTrace& trace);
+
+size_t GetTxTraceCount();
+
+CLatencyHistogram::Snapshot GetTxTraceStageSnapshot(bool fCertificate, TxTraceStage stage);
+
+void ResetTxTraceStats();
+
+//! The histograms of the latencies of all the stages but RECEIVED, in the Prometheus text exposition format
+std::string TxTraceStatsToPrometheus();
+
+#endif // BITCOIN_TXTRACE_H
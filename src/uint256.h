@@ -11,6 +11,7 @@
 #include <stdexcept>
 #include <stdint.h>
 #include <string>
+#include <type_traits>
 #include <vector>
 
 /** Template base class for fixed-sized opaque blobs. */
@@ -115,6 +116,19 @@ public:
     uint256(const base_blob<256>& b) : base_blob<256>(b) {}
     explicit uint256(const std::vector<unsigned char>& vch) : base_blob<256>(vch) {}
 
+    uint64_t GetUint64(int pos) const
+    {
+        const uint8_t* ptr = data + pos * 8;
+        return ((uint64_t)ptr[0]) | \
+               ((uint64_t)ptr[1]) << 8 | \
+               ((uint64_t)ptr[2]) << 16 | \
+               ((uint64_t)ptr[3]) << 24 | \
+               ((uint64_t)ptr[4]) << 32 | \
+               ((uint64_t)ptr[5]) << 40 | \
+               ((uint64_t)ptr[6]) << 48 | \
+               ((uint64_t)ptr[7]) << 56;
+    }
+
     /** A cheap hash function that just returns 64 bits from the result, it can be
      * used when the contents are considered uniformly random. It is not appropriate
      * when the value can easily be influenced from outside as e.g. a network adversary could
@@ -162,6 +176,10 @@ inline uint256 uint256S(const std::string& str)
     return rv;
 }
 
+// the vectors of blobs are serialized with a single copy, see is_serialized_as_bytes in serialize.h
+static_assert(sizeof(uint160) == 20 && std::is_trivially_copyable<uint160>::value, "uint160 is serialized as its bytes");
+static_assert(sizeof(uint256) == 32 && std::is_trivially_copyable<uint256>::value, "uint256 is serialized as its bytes");
+
 /* uint160 from const char *.  */
 inline uint160 uint160S(const char *str)
 {
@@ -91,6 +91,56 @@ public:
 
 };
 
+/** Compact form of a CTxInUndo, with the certificate fields as varints, used by the sidechain
+ *  undo data from CSidechainUndoData::COMPACT_VERSION on */
+class CTxInUndoCompactor
+{
+private:
+    CTxInUndo &txinundo;
+
+    bool HasCertFields() const {
+        return (txinundo.nHeight > 0) && ((txinundo.nVersion & 0x7f) == (SC_CERT_VERSION & 0x7f));
+    }
+
+public:
+    CTxInUndoCompactor(CTxInUndo &txinundoIn) : txinundo(txinundoIn) {}
+
+    unsigned int GetSerializeSize(int nType, int nVersion) const {
+        CSizeComputer s(nType, nVersion);
+        Serialize(s, nType, nVersion);
+        return s.size();
+    }
+
+    template<typename Stream>
+    void Serialize(Stream &s, int nType, int nVersion) const {
+        ::Serialize(s, VARINT(txinundo.nHeight*2+(txinundo.fCoinBase ? 1 : 0)), nType, nVersion);
+        if (txinundo.nHeight > 0)
+            ::Serialize(s, VARINT(txinundo.nVersion), nType, nVersion);
+        ::Serialize(s, CTxOutCompressor(REF(txinundo.txout)), nType, nVersion);
+
+        if (HasCertFields()) {
+            ::Serialize(s, SIGNED_VARINT(txinundo.nFirstBwtPos), nType, nVersion);
+            ::Serialize(s, SIGNED_VARINT(txinundo.nBwtMaturityHeight), nType, nVersion);
+        }
+    }
+
+    template<typename Stream>
+    void Unserialize(Stream &s, int nType, int nVersion) {
+        unsigned int nCode = 0;
+        ::Unserialize(s, VARINT(nCode), nType, nVersion);
+        txinundo.nHeight = nCode / 2;
+        txinundo.fCoinBase = nCode & 1;
+        if (txinundo.nHeight > 0)
+            ::Unserialize(s, VARINT(txinundo.nVersion), nType, nVersion);
+        ::Unserialize(s, REF(CTxOutCompressor(REF(txinundo.txout))), nType, nVersion);
+
+        if (HasCertFields()) {
+            ::Unserialize(s, SIGNED_VARINT(txinundo.nFirstBwtPos), nType, nVersion);
+            ::Unserialize(s, SIGNED_VARINT(txinundo.nBwtMaturityHeight), nType, nVersion);
+        }
+    }
+};
+
 /** Undo information for a CTransaction */
 class CTxUndo
 {
@@ -130,6 +180,12 @@ public:
 
 struct CSidechainUndoData
 {
+    /** The original encoding, with fixed size fields */
+    static constexpr uint32_t LEGACY_VERSION = 0;
+    /** Varints for the amounts, heights, epochs and qualities, the fees delta-encoded
+     *  against the previous ones and the bwts coins compacted. Written from now on. */
+    static constexpr uint32_t COMPACT_VERSION = 1;
+
     uint32_t sidechainUndoDataVersion;
     enum AvailableSections : uint8_t
     {
@@ -166,47 +222,17 @@ struct CSidechainUndoData
     // NONCEASING_CERT_DATA
     int prevInclusionHeight;
 
-    CSidechainUndoData(): sidechainUndoDataVersion(0), contentBitMask(AvailableSections::UNDEFINED),
+    CSidechainUndoData(): sidechainUndoDataVersion(COMPACT_VERSION), contentBitMask(AvailableSections::UNDEFINED),
         appliedMaturedAmount(0), pastEpochTopQualityCertView(), scFees(),
         prevTopCommittedCertHash(), prevTopCommittedCertReferencedEpoch(CScCertificate::EPOCH_NULL),
         prevTopCommittedCertQuality(CScCertificate::QUALITY_NULL), prevTopCommittedCertBwtAmount(0),
-        lastTopQualityCertView(), lowQualityBwts(), ceasedBwts() {}
+        lastTopQualityCertView(), lowQualityBwts(), ceasedBwts(), prevInclusionHeight(0) {}
 
     size_t GetSerializeSize(int nType, int nVersion) const
     {
-        unsigned int totalSize = ::GetSerializeSize(sidechainUndoDataVersion, nType, nVersion);
-        totalSize += ::GetSerializeSize(contentBitMask, nType, nVersion);
-        if (contentBitMask & AvailableSections::MATURED_AMOUNTS)
-        {
-            totalSize += ::GetSerializeSize(appliedMaturedAmount, nType, nVersion);
-        }
-        if (contentBitMask & AvailableSections::CROSS_EPOCH_CERT_DATA)
-        {
-            totalSize += ::GetSerializeSize(pastEpochTopQualityCertView, nType, nVersion);
-            // TODO: fix this condition for counting scFees list size
-            // totalSize += ::GetSerializeSize(scFees, nType, nVersion);
-        }
-        if (contentBitMask & AvailableSections::ANY_EPOCH_CERT_DATA)
-        {
-            totalSize += ::GetSerializeSize(prevTopCommittedCertHash,            nType, nVersion);
-            totalSize += ::GetSerializeSize(prevTopCommittedCertReferencedEpoch, nType, nVersion);
-            totalSize += ::GetSerializeSize(prevTopCommittedCertQuality,         nType, nVersion);
-            totalSize += ::GetSerializeSize(prevTopCommittedCertBwtAmount,       nType, nVersion);
-            totalSize += ::GetSerializeSize(lastTopQualityCertView,              nType, nVersion);
-        }
-        if (contentBitMask & AvailableSections::SUPERSEDED_CERT_DATA)
-        {
-            totalSize += ::GetSerializeSize(lowQualityBwts, nType, nVersion);
-        }
-        if (contentBitMask & AvailableSections::CEASED_CERT_DATA)
-        {
-            totalSize += ::GetSerializeSize(ceasedBwts, nType, nVersion);
-        }
-        if (contentBitMask & AvailableSections::NONCEASING_CERT_DATA)
-        {
-            totalSize += ::GetSerializeSize(prevInclusionHeight,  nType, nVersion);
-        }
-        return totalSize;
+        CSizeComputer s(nType, nVersion);
+        Serialize(s, nType, nVersion);
+        return s.size();
     }
 
     template<typename Stream>
@@ -214,6 +240,11 @@ struct CSidechainUndoData
     {
         ::Serialize(s, sidechainUndoDataVersion, nType, nVersion);
         ::Serialize(s, contentBitMask, nType, nVersion);
+        if (sidechainUndoDataVersion >= COMPACT_VERSION)
+        {
+            SerializeCompact(s, nType, nVersion);
+            return;
+        }
         if (contentBitMask & AvailableSections::MATURED_AMOUNTS)
         {
             ::Serialize(s, appliedMaturedAmount, nType, nVersion);
@@ -256,6 +287,13 @@ struct CSidechainUndoData
     {
         ::Unserialize(s, sidechainUndoDataVersion, nType, nVersion);
         ::Unserialize(s, contentBitMask, nType, nVersion);
+        if (sidechainUndoDataVersion >= COMPACT_VERSION)
+        {
+            if (sidechainUndoDataVersion > COMPACT_VERSION)
+                throw std::ios_base::failure("Unknown sidechain undo data version");
+            UnserializeCompact(s, nType, nVersion);
+            return;
+        }
         if (contentBitMask & AvailableSections::MATURED_AMOUNTS)
         {
             ::Unserialize(s, appliedMaturedAmount, nType, nVersion);
@@ -294,6 +332,171 @@ struct CSidechainUndoData
         return;
     }
 
+private:
+    template<typename Stream>
+    static void SerializeCompact(Stream& s, const CScCertificateView& view, int nType, int nVersion)
+    {
+        ::Serialize(s, view.certDataHash, nType, nVersion);
+        ::Serialize(s, SIGNED_VARINT(view.forwardTransferScFee), nType, nVersion);
+        ::Serialize(s, SIGNED_VARINT(view.mainchainBackwardTransferRequestScFee), nType, nVersion);
+    }
+
+    template<typename Stream>
+    static void UnserializeCompact(Stream& s, CScCertificateView& view, int nType, int nVersion)
+    {
+        ::Unserialize(s, view.certDataHash, nType, nVersion);
+        ::Unserialize(s, SIGNED_VARINT(view.forwardTransferScFee), nType, nVersion);
+        ::Unserialize(s, SIGNED_VARINT(view.mainchainBackwardTransferRequestScFee), nType, nVersion);
+    }
+
+    template<typename Stream>
+    static void SerializeCompact(Stream& s, const std::vector<CTxInUndo>& vBwts, int nType, int nVersion)
+    {
+        WriteCompactSize(s, vBwts.size());
+        for (const CTxInUndo& bwt : vBwts)
+            ::Serialize(s, CTxInUndoCompactor(REF(bwt)), nType, nVersion);
+    }
+
+    template<typename Stream>
+    static void UnserializeCompact(Stream& s, std::vector<CTxInUndo>& vBwts, int nType, int nVersion)
+    {
+        vBwts.clear();
+        // no reserve, a bad size fails on the end of the stream instead of allocating
+        for (uint64_t nSize = ReadCompactSize(s); nSize > 0; nSize--)
+        {
+            vBwts.emplace_back();
+            ::Unserialize(s, REF(CTxInUndoCompactor(vBwts.back())), nType, nVersion);
+        }
+    }
+
+    /** The fees of the consecutive epochs mostly repeat or change a little, hence each one is
+     *  written as its difference with the previous one, as are the submission heights */
+    template<typename Stream>
+    void SerializeCompactFees(Stream& s, int nType, int nVersion) const
+    {
+        const bool fWithHeights = contentBitMask & AvailableSections::NONCEASING_CERT_DATA;
+        WriteCompactSize(s, scFees.size());
+        CAmount prevFtFee = 0;
+        CAmount prevMbtrFee = 0;
+        int prevHeight = 0;
+        for (const std::shared_ptr<Sidechain::ScFeeData>& fee : scFees)
+        {
+            CAmount ftDelta = fee->forwardTxScFee - prevFtFee;
+            CAmount mbtrDelta = fee->mbtrTxScFee - prevMbtrFee;
+            ::Serialize(s, SIGNED_VARINT(ftDelta), nType, nVersion);
+            ::Serialize(s, SIGNED_VARINT(mbtrDelta), nType, nVersion);
+            prevFtFee = fee->forwardTxScFee;
+            prevMbtrFee = fee->mbtrTxScFee;
+            if (fWithHeights)
+            {
+                std::shared_ptr<Sidechain::ScFeeData_v2> feeV2 = std::dynamic_pointer_cast<Sidechain::ScFeeData_v2>(fee);
+                const int height = feeV2 ? feeV2->submissionHeight : -1;
+                int heightDelta = height - prevHeight;
+                ::Serialize(s, SIGNED_VARINT(heightDelta), nType, nVersion);
+                prevHeight = height;
+            }
+        }
+    }
+
+    template<typename Stream>
+    void UnserializeCompactFees(Stream& s, int nType, int nVersion)
+    {
+        const bool fWithHeights = contentBitMask & AvailableSections::NONCEASING_CERT_DATA;
+        scFees.clear();
+        CAmount prevFtFee = 0;
+        CAmount prevMbtrFee = 0;
+        int prevHeight = 0;
+        for (uint64_t nSize = ReadCompactSize(s); nSize > 0; nSize--)
+        {
+            CAmount ftDelta = 0;
+            CAmount mbtrDelta = 0;
+            ::Unserialize(s, SIGNED_VARINT(ftDelta), nType, nVersion);
+            ::Unserialize(s, SIGNED_VARINT(mbtrDelta), nType, nVersion);
+            prevFtFee += ftDelta;
+            prevMbtrFee += mbtrDelta;
+            if (fWithHeights)
+            {
+                int heightDelta = 0;
+                ::Unserialize(s, SIGNED_VARINT(heightDelta), nType, nVersion);
+                prevHeight += heightDelta;
+                scFees.emplace_back(new Sidechain::ScFeeData_v2(prevFtFee, prevMbtrFee, prevHeight));
+            }
+            else
+            {
+                scFees.emplace_back(new Sidechain::ScFeeData(prevFtFee, prevMbtrFee));
+            }
+        }
+    }
+
+    template<typename Stream>
+    void SerializeCompact(Stream& s, int nType, int nVersion) const
+    {
+        if (contentBitMask & AvailableSections::MATURED_AMOUNTS)
+        {
+            ::Serialize(s, SIGNED_VARINT(appliedMaturedAmount), nType, nVersion);
+        }
+        if (contentBitMask & AvailableSections::CROSS_EPOCH_CERT_DATA)
+        {
+            SerializeCompact(s, pastEpochTopQualityCertView, nType, nVersion);
+            SerializeCompactFees(s, nType, nVersion);
+        }
+        if (contentBitMask & AvailableSections::ANY_EPOCH_CERT_DATA)
+        {
+            ::Serialize(s, prevTopCommittedCertHash, nType, nVersion);
+            ::Serialize(s, SIGNED_VARINT(prevTopCommittedCertReferencedEpoch), nType, nVersion);
+            ::Serialize(s, SIGNED_VARINT(prevTopCommittedCertQuality), nType, nVersion);
+            ::Serialize(s, SIGNED_VARINT(prevTopCommittedCertBwtAmount), nType, nVersion);
+            SerializeCompact(s, lastTopQualityCertView, nType, nVersion);
+        }
+        if (contentBitMask & AvailableSections::SUPERSEDED_CERT_DATA)
+        {
+            SerializeCompact(s, lowQualityBwts, nType, nVersion);
+        }
+        if (contentBitMask & AvailableSections::CEASED_CERT_DATA)
+        {
+            SerializeCompact(s, ceasedBwts, nType, nVersion);
+        }
+        if (contentBitMask & AvailableSections::NONCEASING_CERT_DATA)
+        {
+            ::Serialize(s, SIGNED_VARINT(prevInclusionHeight), nType, nVersion);
+        }
+    }
+
+    template<typename Stream>
+    void UnserializeCompact(Stream& s, int nType, int nVersion)
+    {
+        if (contentBitMask & AvailableSections::MATURED_AMOUNTS)
+        {
+            ::Unserialize(s, SIGNED_VARINT(appliedMaturedAmount), nType, nVersion);
+        }
+        if (contentBitMask & AvailableSections::CROSS_EPOCH_CERT_DATA)
+        {
+            UnserializeCompact(s, pastEpochTopQualityCertView, nType, nVersion);
+            UnserializeCompactFees(s, nType, nVersion);
+        }
+        if (contentBitMask & AvailableSections::ANY_EPOCH_CERT_DATA)
+        {
+            ::Unserialize(s, prevTopCommittedCertHash, nType, nVersion);
+            ::Unserialize(s, SIGNED_VARINT(prevTopCommittedCertReferencedEpoch), nType, nVersion);
+            ::Unserialize(s, SIGNED_VARINT(prevTopCommittedCertQuality), nType, nVersion);
+            ::Unserialize(s, SIGNED_VARINT(prevTopCommittedCertBwtAmount), nType, nVersion);
+            UnserializeCompact(s, lastTopQualityCertView, nType, nVersion);
+        }
+        if (contentBitMask & AvailableSections::SUPERSEDED_CERT_DATA)
+        {
+            UnserializeCompact(s, lowQualityBwts, nType, nVersion);
+        }
+        if (contentBitMask & AvailableSections::CEASED_CERT_DATA)
+        {
+            UnserializeCompact(s, ceasedBwts, nType, nVersion);
+        }
+        if (contentBitMask & AvailableSections::NONCEASING_CERT_DATA)
+        {
+            ::Unserialize(s, SIGNED_VARINT(prevInclusionHeight), nType, nVersion);
+        }
+    }
+
+public:
     std::string ToString() const
     {
         std::string res;
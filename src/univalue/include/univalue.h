@@ -22,6 +22,7 @@ public:
 
     UniValue() : typ(VNULL) {}
     UniValue(UniValue::VType type, const std::string& value = std::string()) : typ(type), val(value) {}
+    UniValue(UniValue::VType type, std::string&& value) : typ(type), val(std::move(value)) {}
     #ifdef __APPLE__
     UniValue(size_t val_) {
             setInt(val_);
@@ -97,15 +98,23 @@ public:
     bool isArray() const { return (typ == VARR); }
     bool isObject() const { return (typ == VOBJ); }
 
+    // The rvalue overloads move the value in instead of copying its whole subtree
     bool push_back(const UniValue& val);
+    bool push_back(UniValue&& val);
     bool push_backV(const std::vector<UniValue>& vec);
+    bool push_backV(std::vector<UniValue>&& vec);
 
     void _pushKV(const std::string& key, const UniValue& val);
+    void _pushKV(const std::string& key, UniValue&& val);
     bool pushKV(const std::string& key, const UniValue& val);
+    bool pushKV(const std::string& key, UniValue&& val);
     bool pushKVs(const UniValue& obj);
 
     std::string write(unsigned int prettyIndent = 0,
                       unsigned int indentLevel = 0) const;
+    // Append the serialization to s, without the intermediate strings of the nested values
+    void write(std::string& s, unsigned int prettyIndent = 0,
+               unsigned int indentLevel = 0) const;
 
     bool read(const char *raw, size_t len);
     bool read(const char *raw) { return read(raw, strlen(raw)); }
@@ -120,6 +129,7 @@ private:
     std::vector<UniValue> values;
 
     bool findKey(const std::string& key, size_t& retIdx) const;
+    void writeValue(unsigned int prettyIndent, unsigned int indentLevel, std::string& s) const;
     void writeArray(unsigned int prettyIndent, unsigned int indentLevel, std::string& s) const;
     void writeObject(unsigned int prettyIndent, unsigned int indentLevel, std::string& s) const;
 
@@ -269,6 +279,37 @@ static inline bool json_isspace(int ch)
     // not reached
 }
 
+/**
+ * Streaming JSON writer: the document is appended to a string as its values are given,
+ * so that a reply wrapping large values does not build the tree of the whole document
+ * nor copy them into it. The calls must describe a single well formed value: each
+ * key() in an object is followed by one value, and every start is matched by an end.
+ */
+class UniValueWriter {
+public:
+    explicit UniValueWriter(std::string& out) : s(out) {}
+
+    void startObject();
+    void endObject();
+    void startArray();
+    void endArray();
+    void key(const std::string& k);
+
+    void value(const UniValue& v);
+    void valueNull();
+    void valueBool(bool b);
+    void valueStr(const std::string& str);
+    void valueInt(int64_t n);
+
+private:
+    std::string& s;
+    // Per open object or array, whether a value was already written in it
+    std::vector<bool> hasValue;
+    bool afterKey = false;
+
+    void separate();
+};
+
 extern const UniValue NullUniValue;
 
 const UniValue& find_value( const UniValue& obj, const std::string& name);
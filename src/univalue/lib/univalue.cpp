@@ -65,22 +65,21 @@ bool UniValue::setInt(size_t val_)
 }
 #endif
 
+// The decimal form of an integer is always a valid number, no need to tokenize it again
 bool UniValue::setInt(uint64_t val_)
 {
-    std::ostringstream oss;
-
-    oss << val_;
-
-    return setNumStr(oss.str());
+    clear();
+    typ = VNUM;
+    val = std::to_string(val_);
+    return true;
 }
 
 bool UniValue::setInt(int64_t val_)
 {
-    std::ostringstream oss;
-
-    oss << val_;
-
-    return setNumStr(oss.str());
+    clear();
+    typ = VNUM;
+    val = std::to_string(val_);
+    return true;
 }
 
 bool UniValue::setFloat(double val_)
@@ -125,6 +124,15 @@ bool UniValue::push_back(const UniValue& val_)
     return true;
 }
 
+bool UniValue::push_back(UniValue&& val_)
+{
+    if (typ != VARR)
+        return false;
+
+    values.push_back(std::move(val_));
+    return true;
+}
+
 bool UniValue::push_backV(const std::vector<UniValue>& vec)
 {
     if (typ != VARR)
@@ -135,12 +143,35 @@ bool UniValue::push_backV(const std::vector<UniValue>& vec)
     return true;
 }
 
+bool UniValue::push_backV(std::vector<UniValue>&& vec)
+{
+    if (typ != VARR)
+        return false;
+
+    if (values.empty()) {
+        values = std::move(vec);
+    } else {
+        values.reserve(values.size() + vec.size());
+        for (UniValue& v : vec)
+            values.push_back(std::move(v));
+    }
+    vec.clear();
+
+    return true;
+}
+
 void UniValue::_pushKV(const std::string& key, const UniValue& val_)
 {
     keys.push_back(key);
     values.push_back(val_);
 }
 
+void UniValue::_pushKV(const std::string& key, UniValue&& val_)
+{
+    keys.push_back(key);
+    values.push_back(std::move(val_));
+}
+
 bool UniValue::pushKV(const std::string& key, const UniValue& val_)
 {
     if (typ != VOBJ)
@@ -154,6 +185,19 @@ bool UniValue::pushKV(const std::string& key, const UniValue& val_)
     return true;
 }
 
+bool UniValue::pushKV(const std::string& key, UniValue&& val_)
+{
+    if (typ != VOBJ)
+        return false;
+
+    size_t idx;
+    if (findKey(key, idx))
+        values[idx] = std::move(val_);
+    else
+        _pushKV(key, std::move(val_));
+    return true;
+}
+
 bool UniValue::pushKVs(const UniValue& obj)
 {
     if (typ != VOBJ || obj.typ != VOBJ)
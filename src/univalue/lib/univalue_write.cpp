@@ -7,11 +7,8 @@
 #include "univalue.h"
 #include "univalue_escapes.h"
 
-static std::string json_escape(const std::string& inS)
+static void json_escape(const std::string& inS, std::string& outS)
 {
-    std::string outS;
-    outS.reserve(inS.size() * 2);
-
     for (unsigned int i = 0; i < inS.size(); i++) {
         unsigned char ch = inS[i];
         const char *escStr = escapes[ch];
@@ -21,8 +18,13 @@ static std::string json_escape(const std::string& inS)
         else
             outS += ch;
     }
+}
 
-    return outS;
+static void json_quote(const std::string& inS, std::string& outS)
+{
+    outS += '"';
+    json_escape(inS, outS);
+    outS += '"';
 }
 
 std::string UniValue::write(unsigned int prettyIndent,
@@ -30,23 +32,34 @@ std::string UniValue::write(unsigned int prettyIndent,
 {
     std::string s;
     s.reserve(1024);
+    write(s, prettyIndent, indentLevel);
+    return s;
+}
 
+void UniValue::write(std::string& s, unsigned int prettyIndent,
+                     unsigned int indentLevel) const
+{
     unsigned int modIndent = indentLevel;
     if (modIndent == 0)
         modIndent = 1;
 
+    writeValue(prettyIndent, modIndent, s);
+}
+
+void UniValue::writeValue(unsigned int prettyIndent, unsigned int indentLevel, std::string& s) const
+{
     switch (typ) {
     case VNULL:
         s += "null";
         break;
     case VOBJ:
-        writeObject(prettyIndent, modIndent, s);
+        writeObject(prettyIndent, indentLevel, s);
         break;
     case VARR:
-        writeArray(prettyIndent, modIndent, s);
+        writeArray(prettyIndent, indentLevel, s);
         break;
     case VSTR:
-        s += "\"" + json_escape(val) + "\"";
+        json_quote(val, s);
         break;
     case VNUM:
         s += val;
@@ -55,8 +68,6 @@ std::string UniValue::write(unsigned int prettyIndent,
         s += (val == "1" ? "true" : "false");
         break;
     }
-
-    return s;
 }
 
 static void indentStr(unsigned int prettyIndent, unsigned int indentLevel, std::string& s)
@@ -73,7 +84,7 @@ void UniValue::writeArray(unsigned int prettyIndent, unsigned int indentLevel, s
     for (unsigned int i = 0; i < values.size(); i++) {
         if (prettyIndent)
             indentStr(prettyIndent, indentLevel, s);
-        s += values[i].write(prettyIndent, indentLevel + 1);
+        values[i].writeValue(prettyIndent, indentLevel + 1, s);
         if (i != (values.size() - 1)) {
             s += ",";
         }
@@ -95,10 +106,11 @@ void UniValue::writeObject(unsigned int prettyIndent, unsigned int indentLevel,
     for (unsigned int i = 0; i < keys.size(); i++) {
         if (prettyIndent)
             indentStr(prettyIndent, indentLevel, s);
-        s += "\"" + json_escape(keys[i]) + "\":";
+        json_quote(keys[i], s);
+        s += ":";
         if (prettyIndent)
             s += " ";
-        s += values.at(i).write(prettyIndent, indentLevel + 1);
+        values.at(i).writeValue(prettyIndent, indentLevel + 1, s);
         if (i != (values.size() - 1))
             s += ",";
         if (prettyIndent)
@@ -110,3 +122,82 @@ void UniValue::writeObject(unsigned int prettyIndent, unsigned int indentLevel,
     s += "}";
 }
 
+void UniValueWriter::separate()
+{
+    if (afterKey) {
+        afterKey = false;
+        return;
+    }
+    if (!hasValue.empty()) {
+        if (hasValue.back())
+            s += ",";
+        hasValue.back() = true;
+    }
+}
+
+void UniValueWriter::startObject()
+{
+    separate();
+    s += "{";
+    hasValue.push_back(false);
+}
+
+void UniValueWriter::endObject()
+{
+    assert(!hasValue.empty() && !afterKey);
+    hasValue.pop_back();
+    s += "}";
+}
+
+void UniValueWriter::startArray()
+{
+    separate();
+    s += "[";
+    hasValue.push_back(false);
+}
+
+void UniValueWriter::endArray()
+{
+    assert(!hasValue.empty() && !afterKey);
+    hasValue.pop_back();
+    s += "]";
+}
+
+void UniValueWriter::key(const std::string& k)
+{
+    assert(!afterKey);
+    separate();
+    json_quote(k, s);
+    s += ":";
+    afterKey = true;
+}
+
+void UniValueWriter::value(const UniValue& v)
+{
+    separate();
+    v.write(s);
+}
+
+void UniValueWriter::valueNull()
+{
+    separate();
+    s += "null";
+}
+
+void UniValueWriter::valueBool(bool b)
+{
+    separate();
+    s += (b ? "true" : "false");
+}
+
+void UniValueWriter::valueStr(const std::string& str)
+{
+    separate();
+    json_quote(str, s);
+}
+
+void UniValueWriter::valueInt(int64_t n)
+{
+    separate();
+    s += std::to_string(n);
+}
@@ -398,6 +398,72 @@ BOOST_AUTO_TEST_CASE(univalue_readwrite)
     BOOST_CHECK(!v.read("{} 42"));
 }
 
+BOOST_AUTO_TEST_CASE(univalue_move)
+{
+    UniValue arr(UniValue::VARR);
+    UniValue str(UniValue::VSTR, std::string(100, 'x'));
+    BOOST_CHECK(arr.push_back(std::move(str)));
+    BOOST_CHECK_EQUAL(arr[0].getValStr(), std::string(100, 'x'));
+
+    std::vector<UniValue> vec = {UniValue(1), UniValue(2)};
+    BOOST_CHECK(arr.push_backV(std::move(vec)));
+    BOOST_CHECK(vec.empty());
+    BOOST_CHECK_EQUAL(arr.size(), 3);
+    BOOST_CHECK_EQUAL(arr[2].getValStr(), "2");
+
+    UniValue obj(UniValue::VOBJ);
+    BOOST_CHECK(obj.pushKV("arr", std::move(arr)));
+    BOOST_CHECK(obj.pushKV("arr", UniValue(7)));
+    BOOST_CHECK_EQUAL(obj.size(), 1);
+    BOOST_CHECK_EQUAL(obj["arr"].getValStr(), "7");
+    BOOST_CHECK(!UniValue(UniValue::VSTR).push_back(UniValue(1)));
+
+    UniValue big(UniValue::VNUM);
+    BOOST_CHECK(big.setInt((int64_t)-9223372036854775807LL - 1));
+    BOOST_CHECK_EQUAL(big.getValStr(), "-9223372036854775808");
+    BOOST_CHECK(big.setInt((uint64_t)18446744073709551615ULL));
+    BOOST_CHECK_EQUAL(big.getValStr(), "18446744073709551615");
+}
+
+BOOST_AUTO_TEST_CASE(univalue_writer)
+{
+    UniValue result;
+    BOOST_CHECK(result.read(json1));
+
+    std::string s;
+    UniValueWriter writer(s);
+    writer.startObject();
+    writer.key("result");
+    writer.value(result);
+    writer.key("error");
+    writer.valueNull();
+    writer.key("list");
+    writer.startArray();
+    writer.valueInt(-3);
+    writer.valueBool(true);
+    writer.valueStr("a\"b");
+    writer.startObject();
+    writer.endObject();
+    writer.endArray();
+    writer.endObject();
+
+    UniValue expected(UniValue::VOBJ);
+    expected.pushKV("result", result);
+    expected.pushKV("error", NullUniValue);
+    UniValue list(UniValue::VARR);
+    list.push_back(-3);
+    list.push_back(true);
+    list.push_back("a\"b");
+    list.push_back(UniValue(UniValue::VOBJ));
+    expected.pushKV("list", list);
+    BOOST_CHECK_EQUAL(s, expected.write());
+
+    // appending to a string and writing a fresh one give the same text
+    std::string pretty = "x";
+    expected.write(pretty, 4);
+    BOOST_CHECK_EQUAL(pretty, "x" + expected.write(4));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
 
 int main (int argc, char *argv[])
@@ -408,6 +474,8 @@ int main (int argc, char *argv[])
     univalue_array();
     univalue_object();
     univalue_readwrite();
+    univalue_move();
+    univalue_writer();
     return 0;
 }
 
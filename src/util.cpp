@@ -10,6 +10,7 @@
 #include "util.h"
 
 #include "chainparamsbase.h"
+#include "logbuffer.h"
 #include "random.h"
 #include "serialize.h"
 #include "sync.h"
@@ -18,7 +19,9 @@
 
 #include <stdarg.h>
 #include <stdio.h>
+#include <condition_variable>
 #include <regex>
+#include <thread>
 
 #if (defined(__FreeBSD__) || defined(__OpenBSD__) || defined(__DragonFly__))
 #include <pthread.h>
@@ -182,6 +185,21 @@ static FILE* debugLogFp = NULL;
 static boost::mutex* mutexDebugLog = NULL;
 static list<string> *vMsgsBeforeOpenLog;
 
+/**
+ * With -logasync the lines are timestamped by the logging threads and pushed to pLogBuffer, whose
+ * lines the log writer thread writes to debug.log in batches. When the buffer is full the lines are
+ * dropped rather than waited for, and the writer logs how many were. pLogBuffer is leaked as the
+ * objects above, as a thread may still push a line to it after the writer is stopped.
+ */
+static CLogRingBuffer* pLogBuffer = NULL;
+static std::atomic<bool> fLogAsync(false);
+static std::atomic<uint64_t> nLogLinesDropped(0);
+static std::thread logWriterThread;
+static std::atomic<bool> fStopLogWriter(false);
+static std::atomic<bool> fLogWriterSleeping(false);
+static std::mutex mutexLogWriter;
+static std::condition_variable condLogWriter;
+
 static int FileWriteStr(const std::string &str, FILE *fp)
 {
     return fwrite(str.data(), 1, str.size(), fp);
@@ -231,19 +249,25 @@ bool LogAcceptCategory(const char* category)
         // This helps prevent issues debugging global destructors,
         // where mapMultiArgs might be deleted before another
         // global destructor calls LogPrint()
-        static boost::thread_specific_ptr<set<string> > ptrCategory;
+        struct CLogCategories
+        {
+            bool fAll;
+            // compared with the category as it is, without building a string for it
+            std::set<std::string, std::less<>> setCategories;
+        };
+        static boost::thread_specific_ptr<CLogCategories> ptrCategory;
         if (ptrCategory.get() == NULL)
         {
             const vector<string>& categories = mapMultiArgs["-debug"];
-            ptrCategory.reset(new set<string>(categories.begin(), categories.end()));
+            CLogCategories* pCategories = new CLogCategories{false, {categories.begin(), categories.end()}};
+            pCategories->fAll = pCategories->setCategories.count("") != 0 || pCategories->setCategories.count("1") != 0;
+            ptrCategory.reset(pCategories);
             // thread_specific_ptr automatically deletes the set when the thread ends.
         }
-        const set<string>& setCategories = *ptrCategory.get();
+        const CLogCategories& categories = *ptrCategory.get();
 
         // if not debugging everything and not debugging specific category, LogPrint does nothing.
-        if (setCategories.count(string("")) == 0 &&
-            setCategories.count(string("1")) == 0 &&
-            setCategories.count(string(category)) == 0)
+        if (!categories.fAll && categories.setCategories.count(category) == 0)
             return false;
     }
     return true;
@@ -283,6 +307,28 @@ static std::string LogTimestampStr(const std::string &str, bool *fStartedNewLine
     return strStamped;
 }
 
+//! Write to the open debug.log, with mutexDebugLog held
+static int WriteDebugLogStr(const std::string &str)
+{
+    // prevent log from endless growth
+    if (fLimitDebugLogSize)
+        ShrinkDebugFile();
+    // reopen the log file, if requested
+    if (fReopenDebugLog) {
+        fReopenDebugLog = false;
+        boost::filesystem::path pathDebug = GetDebugLogPath();
+        if ((debugLogFp = freopen(pathDebug.string().c_str(),"a", debugLogFp)) != NULL) {
+            setbuf(debugLogFp, NULL); // unbuffered
+        }
+        else {
+            fprintf(stderr, "Error reopening debug.log file");
+            return 0;
+        }
+    }
+
+    return FileWriteStr(str, debugLogFp);
+}
+
 int LogPrintStr(const std::string &str)
 {
     int ret = 0; // Returns total number of characters written
@@ -293,6 +339,20 @@ int LogPrintStr(const std::string &str)
         ret = fwrite(str.data(), 1, str.size(), stdout);
         fflush(stdout);
     }
+    else if (fLogAsync)
+    {
+        // the lines of a thread are its own, the writer follows the order they are pushed in
+        static thread_local bool fThreadStartedNewLine = true;
+        string strTimestamped = LogTimestampStr(str, &fThreadStartedNewLine);
+        ret = strTimestamped.length();
+        if (!pLogBuffer->Push(strTimestamped))
+        {
+            nLogLinesDropped++;
+            return 0;
+        }
+        if (fLogWriterSleeping)
+            condLogWriter.notify_one();
+    }
     else if (fPrintToDebugLog)
     {
         boost::call_once(&DebugPrintInit, debugPrintInitFlag);
@@ -308,28 +368,74 @@ int LogPrintStr(const std::string &str)
         }
         else
         {
-            // prevent log from endless growth
-            if (fLimitDebugLogSize)
-                ShrinkDebugFile();
-            // reopen the log file, if requested
-            if (fReopenDebugLog) {
-                fReopenDebugLog = false;
-                boost::filesystem::path pathDebug = GetDebugLogPath();
-                if ((debugLogFp = freopen(pathDebug.string().c_str(),"a", debugLogFp)) != NULL) {
-                    setbuf(debugLogFp, NULL); // unbuffered
-                }
-                else {
-                    fprintf(stderr, "Error reopening debug.log file");
-                    return 0;
-                }
-            }
-
-            ret = FileWriteStr(strTimestamped, debugLogFp);
+            ret = WriteDebugLogStr(strTimestamped);
         }
     }
     return ret;
 }
 
+static void ThreadLogWriter()
+{
+    RenameThread("horizen-logwriter");
+    std::string strBatch;
+    std::string str;
+    while (true)
+    {
+        // the lines pushed before the stop request are written, whatever their number
+        const bool fStop = fStopLogWriter;
+        strBatch.clear();
+        while (strBatch.size() < LOG_WRITER_BATCH_BYTES && pLogBuffer->Pop(str))
+            strBatch += str;
+        const uint64_t nDropped = nLogLinesDropped.exchange(0);
+        if (nDropped > 0)
+        {
+            bool fStartedNewLine = true;
+            strBatch += LogTimestampStr(strprintf("%s: %u log lines dropped, as the log buffer was full\n", __func__, nDropped), &fStartedNewLine);
+        }
+
+        if (!strBatch.empty())
+        {
+            boost::mutex::scoped_lock scoped_lock(*mutexDebugLog);
+            WriteDebugLogStr(strBatch);
+            continue;
+        }
+        if (fStop)
+            return;
+
+        std::unique_lock<std::mutex> lock(mutexLogWriter);
+        fLogWriterSleeping = true;
+        condLogWriter.wait_for(lock, std::chrono::milliseconds(100));
+        fLogWriterSleeping = false;
+    }
+}
+
+void StartAsyncLogging()
+{
+    if (fPrintToConsole || !fPrintToDebugLog || fLogAsync)
+        return;
+    boost::call_once(&DebugPrintInit, debugPrintInitFlag);
+    {
+        boost::mutex::scoped_lock scoped_lock(*mutexDebugLog);
+        if (debugLogFp == NULL)
+            return;
+    }
+    if (pLogBuffer == NULL)
+        pLogBuffer = new CLogRingBuffer(LOG_BUFFER_LINES);
+    fStopLogWriter = false;
+    logWriterThread = std::thread(&ThreadLogWriter);
+    fLogAsync = true;
+}
+
+void StopAsyncLogging()
+{
+    if (!fLogAsync)
+        return;
+    fLogAsync = false;
+    fStopLogWriter = true;
+    condLogWriter.notify_one();
+    logWriterThread.join();
+}
+
 static void InterpretNegativeSetting(string name, map<string, string>& mapSettingsRet)
 {
     // interpret -nofoo as -foo=0 (and -nofoo=0 as -foo=1) as long as -foo not set
@@ -71,10 +71,22 @@ inline std::string _(const char* psz)
 void SetupEnvironment();
 bool SetupNetworking();
 
+static const bool DEFAULT_LOGASYNC = false;
+//! The lines the log buffer holds with -logasync, the ones logged while it is full are dropped
+static const size_t LOG_BUFFER_LINES = 1 << 16;
+//! The most bytes the log writer thread writes to debug.log at once
+static const size_t LOG_WRITER_BATCH_BYTES = 1 << 20;
+
 /** Return true if log accepts specified category */
 bool LogAcceptCategory(const char* category);
 /** Send a string to the log output */
 int LogPrintStr(const std::string &str);
+/**
+ * With -logasync, write debug.log on a thread of its own, once it is open: the logging threads then
+ * only push their lines to a buffer. Stopping writes the lines still buffered.
+ */
+void StartAsyncLogging();
+void StopAsyncLogging();
 
 #define LogPrintf(...) LogPrint(NULL, __VA_ARGS__)
 
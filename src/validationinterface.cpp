@@ -4,12 +4,163 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "validationinterface.h"
+#include <primitives/block.h>
 #include <primitives/certificate.h>
+#include "util.h"
+
+#include <condition_variable>
+#include <deque>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
 
 using namespace boost::placeholders;
 
 static CMainSignals g_signals;
 
+namespace {
+
+//! Whether the current thread is the one of the queue, which must not wait for the queue
+thread_local bool fValidationInterfaceQueueThread = false;
+
+class CValidationInterfaceQueue
+{
+public:
+    ~CValidationInterfaceQueue() { Stop(); }
+
+    void Start()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (fRunning)
+            return;
+        fRunning = true;
+        fStop = false;
+        thread = std::thread(&CValidationInterfaceQueue::Run, this);
+    }
+
+    void Stop()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!fRunning)
+                return;
+            fStop = true;
+        }
+        cond.notify_all();
+        thread.join();
+    }
+
+    void Call(std::function<void ()> func)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        if (!fRunning) {
+            lock.unlock();
+            func();
+            return;
+        }
+        queue.push_back(std::move(func));
+        lock.unlock();
+        cond.notify_all();
+    }
+
+    void Sync()
+    {
+        if (fValidationInterfaceQueueThread)
+            return;
+        std::promise<void> done;
+        std::future<void> future = done.get_future();
+        Call([&done] { done.set_value(); });
+        future.wait();
+    }
+
+    void Limit(size_t nMaxSize)
+    {
+        if (fValidationInterfaceQueueThread)
+            return;
+        std::unique_lock<std::mutex> lock(mutex);
+        cond.wait(lock, [this, nMaxSize] { return !fRunning || queue.size() <= nMaxSize; });
+    }
+
+    size_t Size() const
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return queue.size();
+    }
+
+private:
+    mutable std::mutex mutex;
+    //! Signalled when a callback is queued or taken from the queue, and when the queue stops
+    std::condition_variable cond;
+    std::deque<std::function<void ()>> queue;
+    bool fRunning = false;
+    bool fStop = false;
+    std::thread thread;
+
+    void Run()
+    {
+        RenameThread("zen-valqueue");
+        fValidationInterfaceQueueThread = true;
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true) {
+            cond.wait(lock, [this] { return fStop || !queue.empty(); });
+            // when stopping, the callbacks already queued run first
+            if (queue.empty()) {
+                fRunning = false;
+                break;
+            }
+            std::function<void ()> func = std::move(queue.front());
+            queue.pop_front();
+            lock.unlock();
+            cond.notify_all();
+            try {
+                func();
+            } catch (const std::exception& e) {
+                PrintExceptionContinue(&e, "ValidationInterfaceQueue");
+            } catch (...) {
+                PrintExceptionContinue(NULL, "ValidationInterfaceQueue");
+            }
+            lock.lock();
+        }
+        lock.unlock();
+        cond.notify_all();
+    }
+};
+
+CValidationInterfaceQueue validationQueue;
+
+} // anon namespace
+
+void StartValidationInterfaceQueue()
+{
+    validationQueue.Start();
+}
+
+void StopValidationInterfaceQueue()
+{
+    validationQueue.Stop();
+}
+
+void CallFunctionInValidationInterfaceQueue(std::function<void ()> func)
+{
+    validationQueue.Call(std::move(func));
+}
+
+void SyncWithValidationInterfaceQueue()
+{
+    validationQueue.Sync();
+}
+
+void LimitValidationInterfaceQueue(size_t nMaxSize)
+{
+    validationQueue.Limit(nMaxSize);
+}
+
+size_t GetValidationInterfaceQueueSize()
+{
+    return validationQueue.Size();
+}
+
 CMainSignals& GetMainSignals()
 {
     return g_signals;
@@ -26,9 +177,13 @@ void RegisterValidationInterface(CValidationInterface* pwalletIn) {
     g_signals.BlockChecked.connect(boost::bind(&CValidationInterface::BlockChecked, pwalletIn, _1, _2));
     g_signals.SyncCertificate.connect(boost::bind(&CValidationInterface::SyncCertificate, pwalletIn, _1, _2, _3));
     g_signals.SyncCertStatus.connect(boost::bind(&CValidationInterface::SyncCertStatusInfo, pwalletIn, _1));
+    g_signals.BeginBlockSync.connect(boost::bind(&CValidationInterface::BeginBlockSync, pwalletIn));
+    g_signals.EndBlockSync.connect(boost::bind(&CValidationInterface::EndBlockSync, pwalletIn));
 }
 
 void UnregisterValidationInterface(CValidationInterface* pwalletIn) {
+    g_signals.EndBlockSync.disconnect(boost::bind(&CValidationInterface::EndBlockSync, pwalletIn));
+    g_signals.BeginBlockSync.disconnect(boost::bind(&CValidationInterface::BeginBlockSync, pwalletIn));
     g_signals.SyncCertStatus.disconnect(boost::bind(&CValidationInterface::SyncCertStatusInfo, pwalletIn, _1));
     g_signals.SyncCertificate.disconnect(boost::bind(&CValidationInterface::SyncCertificate, pwalletIn, _1, _2, _3));
     g_signals.BlockChecked.disconnect(boost::bind(&CValidationInterface::BlockChecked, pwalletIn, _1, _2));
@@ -42,6 +197,8 @@ void UnregisterValidationInterface(CValidationInterface* pwalletIn) {
 }
 
 void UnregisterAllValidationInterfaces() {
+    g_signals.EndBlockSync.disconnect_all_slots();
+    g_signals.BeginBlockSync.disconnect_all_slots();
     g_signals.SyncCertificate.disconnect_all_slots();
     g_signals.SyncCertStatus.disconnect_all_slots();
     g_signals.BlockChecked.disconnect_all_slots();
@@ -55,13 +212,34 @@ void UnregisterAllValidationInterfaces() {
 }
 
 void SyncWithWallets(const CTransaction &tx, const CBlock *pblock) {
-    g_signals.SyncTransaction(tx, pblock);
+    std::shared_ptr<const CTransaction> ptx = std::make_shared<const CTransaction>(tx);
+    std::shared_ptr<const CBlock> sharedBlock = pblock ? std::make_shared<const CBlock>(*pblock) : nullptr;
+    CallFunctionInValidationInterfaceQueue([ptx, sharedBlock] {
+        g_signals.SyncTransaction(*ptx, sharedBlock.get());
+    });
 }
 
 void SyncWithWallets(const CScCertificate &cert, const CBlock *pblock, int bwtMaturityDepth) {
-    g_signals.SyncCertificate(cert, pblock, bwtMaturityDepth);
+    std::shared_ptr<const CScCertificate> pcert = std::make_shared<const CScCertificate>(cert);
+    std::shared_ptr<const CBlock> sharedBlock = pblock ? std::make_shared<const CBlock>(*pblock) : nullptr;
+    CallFunctionInValidationInterfaceQueue([pcert, sharedBlock, bwtMaturityDepth] {
+        g_signals.SyncCertificate(*pcert, sharedBlock.get(), bwtMaturityDepth);
+    });
+}
+
+void SyncWithWallets(const std::list<CTransaction>& txs, const std::list<CScCertificate>& certs) {
+    std::shared_ptr<const std::list<CTransaction>> ptxs = std::make_shared<const std::list<CTransaction>>(txs);
+    std::shared_ptr<const std::list<CScCertificate>> pcerts = std::make_shared<const std::list<CScCertificate>>(certs);
+    CallFunctionInValidationInterfaceQueue([ptxs, pcerts] {
+        for (const CTransaction& tx : *ptxs)
+            g_signals.SyncTransaction(tx, nullptr);
+        for (const CScCertificate& cert : *pcerts)
+            g_signals.SyncCertificate(cert, nullptr, -1);
+    });
 }
 
 void SyncCertStatusUpdate(const CScCertificateStatusUpdateInfo& certStatusInfo) {
-    g_signals.SyncCertStatus(certStatusInfo);
+    CallFunctionInValidationInterfaceQueue([certStatusInfo] {
+        g_signals.SyncCertStatus(certStatusInfo);
+    });
 }
@@ -10,6 +10,9 @@
 
 #include "zcash/IncrementalMerkleTree.hpp"
 
+#include <functional>
+#include <list>
+
 class CBlock;
 class CBlockIndex;
 struct CBlockLocator;
@@ -29,13 +32,40 @@ void RegisterValidationInterface(CValidationInterface* pwalletIn);
 void UnregisterValidationInterface(CValidationInterface* pwalletIn);
 /** Unregister all wallets from core */
 void UnregisterAllValidationInterfaces();
-/** Push an updated transaction to all registered wallets */
+/** Push an updated transaction to all registered wallets, through the validation interface queue */
 void SyncWithWallets(const CTransaction& tx, const CBlock* pblock = NULL);
-/** Push an updated certificate to all registered wallets */
+/** Push an updated certificate to all registered wallets, through the validation interface queue */
 void SyncWithWallets(const CScCertificate& cert, const CBlock* pblock = NULL, int bwtMaturityDepth = -1);
-/** Push to wallets updates about bwt state and related sidechain information */
+/** Push the transactions and certificates removed from the mempool to all registered wallets, as a single queued callback */
+void SyncWithWallets(const std::list<CTransaction>& txs, const std::list<CScCertificate>& certs);
+/** Push to wallets updates about bwt state and related sidechain information, through the queue */
 void SyncCertStatusUpdate(const CScCertificateStatusUpdateInfo& certStatusInfo);
 
+/** The number of queued callbacks above which LimitValidationInterfaceQueue waits */
+static const size_t MAX_VALIDATION_INTERFACE_QUEUE_SIZE = 10;
+
+/**
+ * The wallet updates of the mempool and of the blocks connected or disconnected are delivered in order
+ * by a dedicated thread, started by StartValidationInterfaceQueue, so that the validation of the next
+ * block does not wait for them. The queued callbacks own copies of, or shared pointers to, the blocks
+ * and transactions they hand to the listeners. Until the queue is started, and once it is stopped,
+ * the callbacks run right away on the calling thread.
+ */
+void StartValidationInterfaceQueue();
+/** Run the callbacks still queued, then stop the thread of the queue */
+void StopValidationInterfaceQueue();
+/** Queue func after the updates already queued, or run it if the queue is not running */
+void CallFunctionInValidationInterfaceQueue(std::function<void ()> func);
+/**
+ * Wait until the callbacks queued so far have run, e.g. before an RPC reading the wallet, so that it
+ * sees the blocks connected before it. It must not be called with cs_main held, which the callbacks take.
+ */
+void SyncWithValidationInterfaceQueue();
+/** Wait while more than nMaxSize callbacks are queued; it must not be called with cs_main held either */
+void LimitValidationInterfaceQueue(size_t nMaxSize = MAX_VALIDATION_INTERFACE_QUEUE_SIZE);
+/** The number of callbacks waiting in the queue */
+size_t GetValidationInterfaceQueueSize();
+
 class CValidationInterface {
 protected:
     virtual ~CValidationInterface() {}
@@ -49,6 +79,8 @@ protected:
     virtual void UpdatedTransaction(const uint256 &hash) {}
     virtual void ResendWalletTransactions(int64_t nBestBlockTime) {}
     virtual void BlockChecked(const CBlock&, const CValidationState&) {}
+    virtual void BeginBlockSync() {}
+    virtual void EndBlockSync() {}
     friend void ::RegisterValidationInterface(CValidationInterface*);
     friend void ::UnregisterValidationInterface(CValidationInterface*);
     friend void ::UnregisterAllValidationInterfaces();
@@ -75,6 +107,10 @@ struct CMainSignals {
     boost::signals2::signal<void (const CScCertificate &, const CBlock *, int bwtMaturityDepth)> SyncCertificate;
     /** Notifies listeners of updated bwts for given certificate.*/
     boost::signals2::signal<void (const CScCertificateStatusUpdateInfo& certStatusInfo)> SyncCertStatus;
+    /** Notifies listeners that the updates of a block being connected or disconnected follow, up to EndBlockSync */
+    boost::signals2::signal<void ()> BeginBlockSync;
+    /** Notifies listeners that all the updates of the block are done */
+    boost::signals2::signal<void ()> EndBlockSync;
 };
 
 CMainSignals& GetMainSignals();
@@ -0,0 +1,144 @@
+#include "validationstats.h"
+
+#include "tinyformat.h"
+
+#include <algorithm>
+
+namespace {
+
+CLatencyHistogram histograms[(int)BlockValidationStage::COUNT];
+
+const char* const stageNames[(int)BlockValidationStage::COUNT] = {
+    "read_block",
+    "check_block",
+    "connect_inputs",
+    "script_checks",
+    "commitment",
+    "proof_verify",
+    "index_writes",
+    "connect_block",
+    "flush",
+    "chainstate_write",
+    "update_tip",
+    "wallet_sync",
+    "signals",
+    "connect_tip",
+};
+
+int BucketIndex(uint64_t nMicros)
+{
+    if (nMicros == 0)
+        return 0;
+    return std::min(64 - __builtin_clzll(nMicros), CLatencyHistogram::BUCKETS - 1);
+}
+
+} // anon namespace
+
+const char* BlockValidationStageName(BlockValidationStage stage)
+{
+    return stageNames[(int)stage];
+}
+
+CLatencyHistogram::CLatencyHistogram()
+{
+    Reset();
+}
+
+void CLatencyHistogram::Add(int64_t nMicros)
+{
+    const uint64_t nValue = std::max<int64_t>(nMicros, 0);
+    vBuckets[BucketIndex(nValue)].fetch_add(1, std::memory_order_relaxed);
+    nSumMicros.fetch_add(nValue, std::memory_order_relaxed);
+    uint64_t nMax = nMaxMicros.load(std::memory_order_relaxed);
+    while (nValue > nMax && !nMaxMicros.compare_exchange_weak(nMax, nValue, std::memory_order_relaxed)) {}
+    nCount.fetch_add(1, std::memory_order_relaxed);
+}
+
+CLatencyHistogram::Snapshot CLatencyHistogram::GetSnapshot() const
+{
+    Snapshot snapshot;
+    snapshot.nCount = nCount.load(std::memory_order_relaxed);
+    snapshot.nSumMicros = nSumMicros.load(std::memory_order_relaxed);
+    snapshot.nMaxMicros = nMaxMicros.load(std::memory_order_relaxed);
+    snapshot.vBuckets.resize(BUCKETS);
+    for (int i = 0; i < BUCKETS; ++i)
+        snapshot.vBuckets[i] = vBuckets[i].load(std::memory_order_relaxed);
+    return snapshot;
+}
+
+void CLatencyHistogram::Reset()
+{
+    for (int i = 0; i < BUCKETS; ++i)
+        vBuckets[i].store(0, std::memory_order_relaxed);
+    nCount.store(0, std::memory_order_relaxed);
+    nSumMicros.store(0, std::memory_order_relaxed);
+    nMaxMicros.store(0, std::memory_order_relaxed);
+}
+
+double CLatencyHistogram::Snapshot::Quantile(double q) const
+{
+    uint64_t nTotal = 0;
+    for (uint64_t n : vBuckets)
+        nTotal += n;
+    if (nTotal == 0)
+        return 0;
+
+    const double rank = std::min(std::max(q, 0.0), 1.0) * nTotal;
+    uint64_t nCumulative = 0;
+    for (size_t i = 0; i < vBuckets.size(); ++i) {
+        if (vBuckets[i] == 0 || nCumulative + vBuckets[i] < rank) {
+            nCumulative += vBuckets[i];
+            continue;
+        }
+        const double lower = i == 0 ? 0 : UpperBound(i - 1);
+        const double upper = i + 1 == vBuckets.size() ? std::max<double>(nMaxMicros, lower) : UpperBound(i);
+        const double value = lower + (upper - lower) * (rank - nCumulative) / vBuckets[i];
+        return std::min(value, (double)nMaxMicros);
+    }
+    return nMaxMicros;
+}
+
+void RecordBlockValidationStage(BlockValidationStage stage, int64_t nMicros)
+{
+    histograms[(int)stage].Add(nMicros);
+}
+
+CLatencyHistogram::Snapshot GetBlockValidationStageSnapshot(BlockValidationStage stage)
+{
+    return histograms[(int)stage].GetSnapshot();
+}
+
+void ResetBlockValidationStats()
+{
+    for (CLatencyHistogram& histogram : histograms)
+        histogram.Reset();
+}
+
+std::string LatencyHistogramToPrometheus(const std::string& metric, const std::string& labels,
+                                         const CLatencyHistogram::Snapshot& snapshot)
+{
+    std::string strOut;
+    uint64_t nCumulative = 0;
+    for (int i = 0; i + 1 < CLatencyHistogram::BUCKETS; ++i) {
+        nCumulative += snapshot.vBuckets[i];
+        strOut += strprintf("%s_bucket{%s,le=\"%g\"} %u\n", metric, labels,
+                            CLatencyHistogram::Snapshot::UpperBound(i) * 1e-6, nCumulative);
+    }
+    nCumulative += snapshot.vBuckets[CLatencyHistogram::BUCKETS - 1];
+    strOut += strprintf("%s_bucket{%s,le=\"+Inf\"} %u\n", metric, labels, nCumulative);
+    strOut += strprintf("%s_sum{%s} %.6f\n", metric, labels, snapshot.nSumMicros * 1e-6);
+    // the count is the one of the buckets, so that it matches the +Inf bucket of a concurrent snapshot
+    strOut += strprintf("%s_count{%s} %u\n", metric, labels, nCumulative);
+    return strOut;
+}
+
+std::string BlockValidationStatsToPrometheus()
+{
+    static const char* const metric = "zen_block_validation_stage_seconds";
+    std::string strOut = strprintf("# HELP %s Duration of the stages of the connection of a block to the active chain.\n", metric);
+    strOut += strprintf("# TYPE %s histogram\n", metric);
+
+    for (int s = 0; s < (int)BlockValidationStage::COUNT; ++s)
+        strOut += LatencyHistogramToPrometheus(metric, strprintf("stage=\"%s\"", stageNames[s]), histograms[s].GetSnapshot());
+    return strOut;
+}
@@ -0,0 +1,84 @@
+#ifndef BITCOIN_VALIDATIONSTATS_H
+#define BITCOIN_VALIDATIONSTATS_H
+
+#include <atomic>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+/** The stages of the connection of a block to the active chain, whose latency is tracked */
+enum class BlockValidationStage : int
+{
+    READ_BLOCK = 0,     //! Reading the block from disk, when ConnectTip was not given it
+    CHECK_BLOCK,        //! The context free checks of the block, with the setup of ConnectBlock
+    CONNECT_INPUTS,     //! Processing of the transactions and certificates, up to queueing their script checks
+    SCRIPT_CHECKS,      //! Waiting for the script and JoinSplit proof checks queues to be drained
+    COMMITMENT,         //! Building the sidechain transactions commitment
+    PROOF_VERIFY,       //! Waiting for the batch verification of the sidechain proofs
+    INDEX_WRITES,       //! Writing the undo data and queueing the index updates
+    CONNECT_BLOCK,      //! The whole of ConnectBlock, with the prefetch of the block inputs
+    FLUSH,              //! Flushing the block view into the tip coins cache
+    CHAINSTATE_WRITE,   //! Writing the chainstate to disk, when needed
+    UPDATE_TIP,         //! Removing the block transactions from the mempool and updating chainActive
+    WALLET_SYNC,        //! Notifying the wallets of the transactions and certificates of the block
+    SIGNALS,            //! The ChainTip validation interface callbacks
+    CONNECT_TIP,        //! The whole of ConnectTip
+    COUNT
+};
+
+//! The name of a stage, as used by getblockvalidationstats and the metrics endpoint
+const char* BlockValidationStageName(BlockValidationStage stage);
+
+/**
+ * A histogram of latencies, in microseconds, with power of two buckets: bucket i counts the samples
+ * in [2^(i-1), 2^i), bucket 0 the ones below one microsecond and the last one all those above it.
+ * Samples are added with relaxed atomic increments, so that it can be updated from any thread
+ * without a lock; a snapshot taken while samples are added may be off by those samples.
+ */
+class CLatencyHistogram
+{
+public:
+    static const int BUCKETS = 32;
+
+    struct Snapshot
+    {
+        std::vector<uint64_t> vBuckets;
+        uint64_t nCount = 0;
+        uint64_t nSumMicros = 0;
+        uint64_t nMaxMicros = 0;
+
+        //! The upper bound of bucket i, in microseconds
+        static uint64_t UpperBound(int i) { return (uint64_t)1 << i; }
+        //! The q quantile, interpolated within its bucket and capped by the largest sample
+        double Quantile(double q) const;
+        double Mean() const { return nCount ? (double)nSumMicros / nCount : 0; }
+    };
+
+    CLatencyHistogram();
+
+    void Add(int64_t nMicros);
+    Snapshot GetSnapshot() const;
+    void Reset();
+
+private:
+    std::atomic<uint64_t> vBuckets[BUCKETS];
+    std::atomic<uint64_t> nCount;
+    std::atomic<uint64_t> nSumMicros;
+    std::atomic<uint64_t> nMaxMicros;
+};
+
+//! Record the duration of a stage of a block being connected to the active chain
+void RecordBlockValidationStage(BlockValidationStage stage, int64_t nMicros);
+
+CLatencyHistogram::Snapshot GetBlockValidationStageSnapshot(BlockValidationStage stage);
+
+void ResetBlockValidationStats();
+
+//! The bucket, sum and count samples of a histogram of metric with the given labels, in seconds
+std::string LatencyHistogramToPrometheus(const std::string& metric, const std::string& labels,
+                                         const CLatencyHistogram::Snapshot& snapshot);
+
+//! The histograms of all the stages, in the Prometheus text exposition format
+std::string BlockValidationStatsToPrometheus();
+
+#endif // BITCOIN_VALIDATIONSTATS_H
@@ -25,6 +25,7 @@
 #include <iostream>
 #include <chrono>
 #include <thread>
+#include <future>
 #include <string>
 
 #include "paymentdisclosuredb.h"
@@ -441,7 +442,7 @@ bool AsyncRPCOperation_sendmany::main_impl() {
         }
 
         // Create joinsplits, where each output represents a zaddr recipient.
-        UniValue obj(UniValue::VOBJ);
+        std::vector<AsyncJoinSplitInfo> vInfo;
         while (zOutputsDeque.size() > 0) {
             AsyncJoinSplitInfo info;
             info.vpub_old = 0;
@@ -464,7 +465,48 @@ bool AsyncRPCOperation_sendmany::main_impl() {
                 // Funds are removed from the value pool and enter the private pool
                 info.vpub_old += value;
             }
-            obj = perform_joinsplit(info);
+            vInfo.push_back(info);
+        }
+
+        // The joinsplits have no inputs and do not depend on each other, so they are all proven
+        // against the best anchor at the same time, then appended to the transaction in order
+        uint256 anchor;
+        {
+            LOCK(cs_main);
+            anchor = pcoinsTip->GetBestAnchor();
+        }
+        const size_t nFirst = tx_.GetVjoinsplit().size();
+        std::vector<AsyncJoinSplitProof> vProofs(vInfo.size());
+        auto prove = [&](size_t i) {
+            vProofs[i] = prove_joinsplit(vInfo[i], std::vector<std::optional<ZCIncrementalWitness>>(), anchor, nFirst + i);
+        };
+
+        // Only the Groth prover can run on several threads at once
+        const int nThreads = tx_.nVersion == GROTH_TX_VERSION ?
+                std::min<int>(vInfo.size(), std::min(std::max(1, GetNumCores()), MAX_PARALLEL_JOINSPLIT_PROOFS)) : 1;
+        if (nThreads > 1) {
+            auto worker = [&](int nWorker) {
+                for (size_t i = nWorker; i < vInfo.size(); i += nThreads) {
+                    prove(i);
+                }
+            };
+            std::vector<std::future<void>> vWorkers;
+            for (int n = 1; n < nThreads; n++) {
+                vWorkers.push_back(std::async(std::launch::async, worker, n));
+            }
+            worker(0);
+            for (auto& f : vWorkers) {
+                f.get();
+            }
+        } else {
+            for (size_t i = 0; i < vInfo.size(); i++) {
+                prove(i);
+            }
+        }
+
+        UniValue obj(UniValue::VOBJ);
+        for (AsyncJoinSplitProof& proof : vProofs) {
+            obj = add_joinsplit(proof);
         }
         sign_send_raw_transaction(obj);
         return true;
@@ -920,6 +962,20 @@ UniValue AsyncRPCOperation_sendmany::perform_joinsplit(
         AsyncJoinSplitInfo & info,
         std::vector<std::optional < ZCIncrementalWitness>> witnesses,
         uint256 anchor)
+{
+    AsyncJoinSplitProof proof = prove_joinsplit(info, witnesses, anchor, tx_.GetVjoinsplit().size());
+    return add_joinsplit(proof);
+}
+
+/**
+ * Generate the proof of a JoinSplit, without touching the transaction: the JoinSplits that do not
+ * spend the change of another one can be proven at the same time.
+ */
+AsyncJoinSplitProof AsyncRPCOperation_sendmany::prove_joinsplit(
+        AsyncJoinSplitInfo & info,
+        std::vector<std::optional < ZCIncrementalWitness>> witnesses,
+        uint256 anchor,
+        size_t js_index) const
 {
     if (anchor.IsNull()) {
         throw std::runtime_error("anchor is null");
@@ -949,11 +1005,9 @@ UniValue AsyncRPCOperation_sendmany::perform_joinsplit(
         throw runtime_error("unsupported joinsplit input/output counts");
     }
 
-    CMutableTransaction mtx(tx_);
-
     LogPrint("zrpcunsafe", "%s: creating joinsplit at index %d (vpub_old=%s, vpub_new=%s, in[0]=%s, in[1]=%s, out[0]=%s, out[1]=%s)\n",
             getId(),
-            tx_.GetVjoinsplit().size(),
+            js_index,
             FormatMoney(info.vpub_old), FormatMoney(info.vpub_new),
             FormatMoney(info.vjsin[0].note.value()), FormatMoney(info.vjsin[1].note.value()),
             FormatMoney(info.vjsout[0].value), FormatMoney(info.vjsout[1].value)
@@ -962,38 +1016,41 @@ UniValue AsyncRPCOperation_sendmany::perform_joinsplit(
     // Generate the proof, this can take over a minute.
     std::array<libzcash::JSInput, ZC_NUM_JS_INPUTS> inputs
             {info.vjsin[0], info.vjsin[1]};
-    std::array<libzcash::JSOutput, ZC_NUM_JS_OUTPUTS> outputs
-            {info.vjsout[0], info.vjsout[1]};
-        #ifdef __APPLE__
-        std::array<uint64_t, ZC_NUM_JS_INPUTS> inputMap;
-        std::array<uint64_t, ZC_NUM_JS_OUTPUTS> outputMap;
-        #else
-        std::array<size_t, ZC_NUM_JS_INPUTS> inputMap;
-        std::array<size_t, ZC_NUM_JS_OUTPUTS> outputMap;
-        #endif
-
-    uint256 esk; // payment disclosure - secret
-
-    JSDescription jsdesc = JSDescription::Randomized(
-            mtx.nVersion == GROTH_TX_VERSION,
+    AsyncJoinSplitProof proof;
+    proof.outputs = {info.vjsout[0], info.vjsout[1]};
+
+    proof.jsdesc = JSDescription::Randomized(
+            tx_.nVersion == GROTH_TX_VERSION,
             *pzcashParams,
             joinSplitPubKey_,
             anchor,
             inputs,
-            outputs,
-            inputMap,
-            outputMap,
+            proof.outputs,
+            proof.inputMap,
+            proof.outputMap,
             info.vpub_old,
             info.vpub_new,
             !this->testmode,
-            &esk); // parameter expects pointer to esk, so pass in address
+            &proof.esk); // parameter expects pointer to esk, so pass in address
     {
         auto verifier = libzcash::ProofVerifier::Strict();
-        if (!(jsdesc.Verify(*pzcashParams, verifier, joinSplitPubKey_))) {
+        if (!(proof.jsdesc.Verify(*pzcashParams, verifier, joinSplitPubKey_))) {
             throw std::runtime_error("error verifying joinsplit");
         }
     }
+    return proof;
+}
 
+/**
+ * Append a proven JoinSplit to the transaction and sign it again.
+ */
+UniValue AsyncRPCOperation_sendmany::add_joinsplit(AsyncJoinSplitProof & proof)
+{
+    const JSDescription& jsdesc = proof.jsdesc;
+    const std::array<libzcash::JSOutput, ZC_NUM_JS_OUTPUTS>& outputs = proof.outputs;
+    const uint256& esk = proof.esk;
+
+    CMutableTransaction mtx(tx_);
     mtx.vjoinsplit.push_back(jsdesc);
 
     // Empty output script.
@@ -1049,10 +1106,10 @@ UniValue AsyncRPCOperation_sendmany::perform_joinsplit(
     UniValue arrInputMap(UniValue::VARR);
     UniValue arrOutputMap(UniValue::VARR);
     for (size_t i = 0; i < ZC_NUM_JS_INPUTS; i++) {
-        arrInputMap.push_back(inputMap[i]);
+        arrInputMap.push_back(proof.inputMap[i]);
     }
     for (size_t i = 0; i < ZC_NUM_JS_OUTPUTS; i++) {
-        arrOutputMap.push_back(outputMap[i]);
+        arrOutputMap.push_back(proof.outputMap[i]);
     }
 
 
@@ -1064,7 +1121,7 @@ UniValue AsyncRPCOperation_sendmany::perform_joinsplit(
     size_t js_index = tx_.GetVjoinsplit().size() - 1;
     uint256 placeholder;
     for (int i = 0; i < ZC_NUM_JS_OUTPUTS; i++) {
-        uint8_t mapped_index = outputMap[i];
+        uint8_t mapped_index = proof.outputMap[i];
         // placeholder for txid will be filled in later when tx has been finalized and signed.
         PaymentDisclosureKey pdKey = {placeholder, js_index, mapped_index};
         JSOutput output = outputs[mapped_index];
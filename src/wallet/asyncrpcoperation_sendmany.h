@@ -43,6 +43,24 @@ struct AsyncJoinSplitInfo
     CAmount vpub_new = 0;
 };
 
+// A proven JoinSplit, with the randomized outputs and the payment disclosure secret
+struct AsyncJoinSplitProof
+{
+    JSDescription jsdesc;
+    std::array<libzcash::JSOutput, ZC_NUM_JS_OUTPUTS> outputs;
+#ifdef __APPLE__
+    std::array<uint64_t, ZC_NUM_JS_INPUTS> inputMap;
+    std::array<uint64_t, ZC_NUM_JS_OUTPUTS> outputMap;
+#else
+    std::array<size_t, ZC_NUM_JS_INPUTS> inputMap;
+    std::array<size_t, ZC_NUM_JS_OUTPUTS> outputMap;
+#endif
+    uint256 esk;
+};
+
+// The most JoinSplits of an operation proven at the same time, each one holds its own prover memory
+static const int MAX_PARALLEL_JOINSPLIT_PROOFS = 4;
+
 // A struct to help us track the witness and anchor for a given JSOutPoint
 struct WitnessAnchorData {
 	std::optional<ZCIncrementalWitness> witness;
@@ -115,6 +133,14 @@ private:
         std::vector<std::optional < ZCIncrementalWitness>> witnesses,
         uint256 anchor);
 
+    // Prove a JoinSplit to be added at js_index, then append it to the transaction
+    AsyncJoinSplitProof prove_joinsplit(
+        AsyncJoinSplitInfo & info,
+        std::vector<std::optional < ZCIncrementalWitness>> witnesses,
+        uint256 anchor,
+        size_t js_index) const;
+    UniValue add_joinsplit(AsyncJoinSplitProof & proof);
+
     void sign_send_raw_transaction(UniValue obj);     // throws exception if there was an error
 
     // payment disclosure!
@@ -0,0 +1,70 @@
+#include <gtest/gtest.h>
+
+#include "core_io.h"
+#include "key.h"
+#include "keystore.h"
+#include "script/standard.h"
+#include "wallet/wallet_ismine.h"
+
+namespace {
+
+CScript PubKeyHashReplay(const CKeyID& keyID)
+{
+    return CScript() << OP_DUP << OP_HASH160 << ToByteVector(keyID) << OP_EQUALVERIFY << OP_CHECKSIG
+                     << ToByteVector(uint256S("0x0123")) << 100 << OP_CHECKBLOCKATHEIGHT;
+}
+
+} // anon namespace
+
+TEST(IsMineFilter, NoScriptOfTheKeyStoreIsFilteredOut)
+{
+    CBasicKeyStore keystore;
+    CIsMineFilter filter;
+    CKey key, uncompressed, watched, other;
+    key.MakeNewKey(true);
+    uncompressed.MakeNewKey(false);
+    watched.MakeNewKey(true);
+    other.MakeNewKey(true);
+    for (const CKey* pkey : {&key, &uncompressed}) {
+        keystore.AddKey(*pkey);
+        filter.AddKey(pkey->GetPubKey().GetID());
+    }
+    const CScript multisig = GetScriptForMultisig(1, {key.GetPubKey(), uncompressed.GetPubKey()});
+    keystore.AddCScript(multisig);
+    filter.AddScript(CScriptID(multisig));
+    const CScript watchedScript = GetScriptForDestination(watched.GetPubKey().GetID(), false);
+    const CScript anyoneCanSpend = CScript() << OP_TRUE;
+    for (const CScript& script : {watchedScript, anyoneCanSpend}) {
+        keystore.AddWatchOnly(script);
+        filter.AddWatchOnly(script);
+    }
+
+    std::vector<CScript> vMine, vNotMine;
+    for (const CKey* pkey : {&key, &uncompressed, &other}) {
+        std::vector<CScript>& v = pkey == &other ? vNotMine : vMine;
+        v.push_back(GetScriptForDestination(pkey->GetPubKey().GetID(), false));
+        v.push_back(PubKeyHashReplay(pkey->GetPubKey().GetID()));
+        v.push_back(CScript() << ToByteVector(pkey->GetPubKey()) << OP_CHECKSIG);
+    }
+    vMine.push_back(multisig);
+    vMine.push_back(GetScriptForDestination(CScriptID(multisig), false));
+    vMine.push_back(PubKeyHashReplay(watched.GetPubKey().GetID()));
+    vMine.push_back(watchedScript);
+    vMine.push_back(CScript() << OP_TRUE << OP_DROP);
+    vNotMine.push_back(GetScriptForMultisig(1, {other.GetPubKey()}));
+    vNotMine.push_back(GetScriptForDestination(CScriptID(CScript() << OP_FALSE), false));
+    vNotMine.push_back(CScript() << OP_RETURN << std::vector<unsigned char>(20, 1));
+    vNotMine.push_back(CScript());
+
+    for (const CScript& script : vMine) {
+        EXPECT_TRUE(filter.MayBeMine(script)) << FormatScript(script);
+    }
+    for (const CScript& script : vNotMine) {
+        EXPECT_EQ(IsMine(keystore, script), ISMINE_NO) << FormatScript(script);
+        EXPECT_FALSE(filter.MayBeMine(script)) << FormatScript(script);
+    }
+
+    filter.Clear();
+    for (const CScript& script : vMine)
+        EXPECT_FALSE(filter.MayBeMine(script));
+}
@@ -314,6 +314,22 @@ TEST_F(WalletTest, find_unspent_notes) {
     EXPECT_EQ(0, entries.size());
     entries.clear(); 
 
+    // The notes are found through the index of their address, in the same order
+    std::vector<CNotePlaintextEntry> entriesAll;
+    wallet.GetFilteredNotes(entriesAll, "", 1, false);
+    wallet.GetFilteredNotes(entries, CZCPaymentAddress(sk.address()).ToString(), 1, false);
+    ASSERT_EQ(2, entries.size());
+    for (size_t i = 0; i < entries.size(); i++) {
+        EXPECT_EQ(entriesAll[i].jsop, entries[i].jsop);
+        EXPECT_EQ(entriesAll[i].plaintext.value(), entries[i].plaintext.value());
+    }
+    entries.clear();
+    auto sk2 = libzcash::SpendingKey::random();
+    wallet.AddSpendingKey(sk2);
+    wallet.GetFilteredNotes(entries, CZCPaymentAddress(sk2.address()).ToString(), 1, false);
+    EXPECT_EQ(0, entries.size());
+    entries.clear();
+
     // Tear down
     chainActive.SetTip(NULL);
     mapBlockIndex.erase(blockHash);
@@ -714,6 +730,50 @@ TEST_F(WalletTest, cached_witnesses_chain_tip) {
     }
 }
 
+TEST_F(WalletTest, CachedWitnessesOfNotesInTheSameBlock) {
+    TestWallet wallet;
+    ZCIncrementalMerkleTree tree;
+
+    auto sk = libzcash::SpendingKey::random();
+    wallet.AddSpendingKey(sk);
+
+    CBlock block1;
+    CBlockIndex index1(block1);
+    index1.nHeight = 1;
+    auto jsoutpt1 = CreateValidBlock(wallet, sk, index1, block1, tree);
+
+    // Our notes both before and after a foreign transaction, which moves the tree on too
+    CBlock block2;
+    block2.hashPrevBlock = block1.GetHash();
+    std::vector<JSOutPoint> notes {jsoutpt1};
+    for (int i = 0; i < 2; i++) {
+        auto wtx = GetValidReceive(sk, 10 + i, true);
+        mapNoteData_t noteData;
+        for (uint8_t n = 0; n < 2; n++) {
+            JSOutPoint jsoutpt {wtx.getWrappedTx().GetHash(), 0, n};
+            noteData[jsoutpt] = CNoteData {sk.address(), GetNote(sk, wtx.getWrappedTx(), 0, n).nullifier(sk)};
+            notes.push_back(jsoutpt);
+        }
+        wtx.SetNoteData(noteData);
+        wallet.AddToWallet(wtx, true, NULL);
+        block2.vtx.push_back(wtx.getWrappedTx());
+        if (i == 0)
+            block2.vtx.push_back(GetValidReceive(libzcash::SpendingKey::random(), 20, true).getWrappedTx());
+    }
+    CBlockIndex index2(block2);
+    index2.nHeight = 2;
+    wallet.IncrementNoteWitnesses(&index2, &block2, tree);
+
+    std::vector<std::optional<ZCIncrementalWitness>> witnesses;
+    uint256 anchor;
+    wallet.GetNoteWitnesses(notes, witnesses, anchor);
+    EXPECT_EQ(tree.root(), anchor);
+    for (const auto& witness : witnesses) {
+        ASSERT_TRUE((bool) witness);
+        EXPECT_EQ(tree.root(), witness->root());
+    }
+}
+
 TEST_F(WalletTest, CachedWitnessesDecrementFirst) {
     TestWallet wallet;
     uint256 anchor2;
@@ -1196,3 +1256,76 @@ TEST_F(WalletTest, NoteLocking) {
     EXPECT_FALSE(wallet.IsLockedNote(jsoutpt.hash, jsoutpt.js, jsoutpt.n));
     EXPECT_FALSE(wallet.IsLockedNote(jsoutpt2.hash, jsoutpt2.js, jsoutpt2.n));
 }
+
+TEST_F(WalletTest, UnspentAndDestinationIndexes) {
+    TestWallet wallet;
+
+    CKey tsk;
+    tsk.MakeNewKey(true);
+    wallet.AddKey(tsk);
+    CTxDestination dest = tsk.GetPubKey().GetID();
+    auto scriptPubKey = GetScriptForDestination(dest);
+
+    // A payment to us...
+    CMutableTransaction mtxFund;
+    mtxFund.vin.resize(1);
+    mtxFund.vin[0].prevout = COutPoint(GetRandHash(), 0);
+    mtxFund.resizeOut(1);
+    mtxFund.getOut(0).nValue = 90*CENT;
+    mtxFund.getOut(0).scriptPubKey = scriptPubKey;
+    CWalletTx wtxFund {nullptr, mtxFund};
+    wtxFund.nOrderPos = 0;
+    auto hashFund = wtxFund.getWrappedTx().GetHash();
+
+    // ...fully spent to somebody else
+    CKey otherKey;
+    otherKey.MakeNewKey(true);
+    CMutableTransaction mtxSpend;
+    mtxSpend.vin.resize(1);
+    mtxSpend.vin[0].prevout = COutPoint(hashFund, 0);
+    mtxSpend.resizeOut(1);
+    mtxSpend.getOut(0).nValue = 80*CENT;
+    mtxSpend.getOut(0).scriptPubKey = GetScriptForDestination(otherKey.GetPubKey().GetID());
+    CWalletTx wtxSpend {nullptr, mtxSpend};
+    wtxSpend.nOrderPos = 1;
+    auto hashSpend = wtxSpend.getWrappedTx().GetHash();
+
+    // Spender loaded before the tx it spends, as it may happen when reading the wallet db
+    wallet.AddToWallet(wtxSpend, true, nullptr);
+    wallet.AddToWallet(wtxFund, true, nullptr);
+
+    auto orderedTxs = wallet.OrderedTxWithInputs(CBitcoinAddress(dest).ToString());
+    ASSERT_EQ(2U, orderedTxs.size());
+    EXPECT_EQ(hashFund, orderedTxs[0]->getTxBase()->GetHash());
+    EXPECT_EQ(hashSpend, orderedTxs[1]->getTxBase()->GetHash());
+    EXPECT_EQ(1U, wallet.OrderedTxWithInputs(CBitcoinAddress(otherKey.GetPubKey().GetID()).ToString()).size());
+
+    // Spends not in the chain do not drop the funding tx from the unspent index
+    EXPECT_EQ(2U, wallet.GetUnspentWalletTxs().size());
+
+    // Fake-mine the spend
+    CBlock block;
+    block.vtx.push_back(wtxSpend.getWrappedTx());
+    block.hashMerkleRoot = block.BuildMerkleTree();
+    auto blockHash = block.GetHash();
+    CBlockIndex fakeIndex {block};
+    mapBlockIndex.insert(std::make_pair(blockHash, &fakeIndex));
+    chainActive.SetTip(&fakeIndex);
+
+    wtxSpend.SetMerkleBranch(block);
+    wallet.AddToWallet(wtxSpend, true, nullptr);
+
+    auto unspentTxs = wallet.GetUnspentWalletTxs();
+    ASSERT_EQ(1U, unspentTxs.size());
+    EXPECT_EQ(hashSpend, unspentTxs[0]->getTxBase()->GetHash());
+
+    // Disconnecting the spend brings the funding tx back
+    chainActive.SetTip(nullptr);
+    wtxSpend.hashBlock.SetNull();
+    wtxSpend.nIndex = -1;
+    wallet.AddToWallet(wtxSpend, true, nullptr);
+    EXPECT_EQ(2U, wallet.GetUnspentWalletTxs().size());
+
+    // Tear down
+    mapBlockIndex.erase(blockHash);
+}
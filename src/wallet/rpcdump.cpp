@@ -17,6 +17,7 @@
 #include <stdint.h>
 
 #include <boost/algorithm/string.hpp>
+#include <boost/assign/list_of.hpp>
 #include <boost/date_time/posix_time/posix_time.hpp>
 
 #include <univalue.h>
@@ -231,6 +232,190 @@ UniValue importaddress(const UniValue& params, bool fHelp)
     return NullUniValue;
 }
 
+//! Adds the keys, script or zkey of a request of importmulti, returning the time the rescan must start from
+static int64_t ImportMultiRequest(const UniValue& request, int64_t nNow)
+{
+    if (!request.isObject())
+        throw JSONRPCError(RPC_TYPE_ERROR, "Request must be an object");
+
+    const UniValue& timestamp = find_value(request, "timestamp");
+    int64_t nTime;
+    if (timestamp.isNum())
+        nTime = timestamp.get_int64();
+    else if (timestamp.isStr() && timestamp.get_str() == "now")
+        nTime = nNow;
+    else
+        throw JSONRPCError(RPC_TYPE_ERROR, "Missing required timestamp field, use a block time or \"now\"");
+    // 0 would be considered 'no value' by the key metadata
+    nTime = std::max<int64_t>(nTime, 1);
+
+    const UniValue& scriptPubKey = find_value(request, "scriptPubKey");
+    const UniValue& keys = find_value(request, "keys");
+    const UniValue& zkey = find_value(request, "zkey");
+    const UniValue& label = find_value(request, "label");
+    const int nKinds = !scriptPubKey.isNull() + !keys.isNull() + !zkey.isNull();
+    if (nKinds != 1)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Exactly one of scriptPubKey, keys and zkey must be given");
+    const std::string strLabel = label.isNull() ? "" : label.get_str();
+
+    if (!zkey.isNull()) {
+        EnsureWalletIsUnlocked();
+        auto key = CZCSpendingKey(zkey.get_str()).Get();
+        auto addr = key.address();
+        if (pwalletMain->HaveSpendingKey(addr))
+            return nNow;
+        pwalletMain->MarkDirty();
+        if (!pwalletMain->AddZKey(key))
+            throw JSONRPCError(RPC_WALLET_ERROR, "Error adding spending key to wallet");
+        pwalletMain->mapZKeyMetadata[addr].nCreateTime = nTime;
+        return nTime;
+    }
+
+    if (!keys.isNull()) {
+        EnsureWalletIsUnlocked();
+        int64_t nTimeBegin = nNow;
+        for (const UniValue& strSecret : keys.getValues()) {
+            CBitcoinSecret vchSecret;
+            if (!vchSecret.SetString(strSecret.get_str()))
+                throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid private key encoding");
+            CKey key = vchSecret.GetKey();
+            if (!key.IsValid())
+                throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Private key outside allowed range");
+            CPubKey pubkey = key.GetPubKey();
+            assert(key.VerifyPubKey(pubkey));
+            CKeyID vchAddress = pubkey.GetID();
+
+            pwalletMain->MarkDirty();
+            pwalletMain->SetAddressBook(vchAddress, strLabel, "receive");
+            if (pwalletMain->HaveKey(vchAddress))
+                continue;
+            pwalletMain->mapKeyMetadata[vchAddress].nCreateTime = nTime;
+            if (!pwalletMain->AddKeyPubKey(key, pubkey))
+                throw JSONRPCError(RPC_WALLET_ERROR, "Error adding key to wallet");
+            nTimeBegin = nTime;
+        }
+        return nTimeBegin;
+    }
+
+    CScript script;
+    CBitcoinAddress address(scriptPubKey.get_str());
+    if (address.IsValid()) {
+        script = GetScriptForDestination(address.Get(), false);
+    } else if (IsHex(scriptPubKey.get_str())) {
+        std::vector<unsigned char> data(ParseHex(scriptPubKey.get_str()));
+        script = CScript(data.begin(), data.end());
+    } else {
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid Horizen address or script");
+    }
+
+    if (::IsMine(*pwalletMain, script) == ISMINE_SPENDABLE)
+        throw JSONRPCError(RPC_WALLET_ERROR, "The wallet already contains the private key for this address or script");
+    if (address.IsValid())
+        pwalletMain->SetAddressBook(address.Get(), strLabel, "receive");
+    if (pwalletMain->HaveWatchOnly(script))
+        return nNow;
+    pwalletMain->MarkDirty();
+    if (!pwalletMain->AddWatchOnly(script))
+        throw JSONRPCError(RPC_WALLET_ERROR, "Error adding address to wallet");
+    return nTime;
+}
+
+UniValue importmulti(const UniValue& params, bool fHelp)
+{
+    if (!EnsureWalletIsAvailable(fHelp))
+        return NullUniValue;
+
+    if (fHelp || params.size() < 1 || params.size() > 2)
+        throw runtime_error(
+            "importmulti [{\"scriptPubKey\"|\"keys\"|\"zkey\": ..., \"timestamp\": ..., \"label\": ...},...] ( {\"rescan\": rescan} )\n"
+            "\nAdds private keys, watch-only addresses or scripts and zkeys to your wallet, then rescans the blocks once,\n"
+            "from the earliest timestamp of the entries added, rather than once for each of them.\n"
+
+            "\nArguments:\n"
+            "1. requests                   (array, required) the entries to import, each with exactly one of:\n"
+            "     \"scriptPubKey\"           (string) a Horizen address or a script (in hex) to watch, as in importaddress\n"
+            "     \"keys\"                   (array) private keys (as returned by dumpprivkey), as in importprivkey\n"
+            "     \"zkey\"                   (string) a zkey (as returned by z_exportkey), as in z_importkey\n"
+            "   and\n"
+            "     \"timestamp\"              (numeric or string, required) the creation time of the entry, in seconds since\n"
+            "                              1 Jan 1970 GMT, or \"now\" for an entry that has never been used: the blocks older\n"
+            "                              than it (as adjusted for the block time variability) are not rescanned for it\n"
+            "     \"label\"                  (string, optional, default=\"\") an optional label of the addresses\n"
+            "2. options                    (object, optional)\n"
+            "     \"rescan\"                 (boolean, optional, default=true) rescan the wallet for transactions\n"
+            "\nNote: This call can take minutes to complete if rescan is true and a timestamp is far in the past.\n"
+
+            "\nResult:\n"
+            "[                             (array) the outcome of each request, in order\n"
+            "  {\n"
+            "    \"success\": true|false,\n"
+            "    \"error\": {\"code\": n, \"message\": \"...\"} (object) why the request failed, when it did\n"
+            "  }, ...\n"
+            "]\n"
+
+            "\nExamples:\n"
+            + HelpExampleCli("importmulti", "'[{\"keys\": [\"mykey\"], \"timestamp\": 1455191478}, {\"scriptPubKey\": \"myaddress\", \"timestamp\": \"now\"}]'") +
+            "\nImport without rescan\n"
+            + HelpExampleCli("importmulti", "'[{\"zkey\": \"myzkey\", \"timestamp\": 1455191478}]' '{\"rescan\": false}'") +
+            "\nAs a JSON-RPC call\n"
+            + HelpExampleRpc("importmulti", "[{\"keys\": [\"mykey\"], \"timestamp\": 1455191478}], {\"rescan\": false}")
+        );
+
+    RPCTypeCheck(params, boost::assign::list_of(UniValue::VARR)(UniValue::VOBJ));
+
+    bool fRescan = true;
+    if (params.size() > 1) {
+        const UniValue& rescan = find_value(params[1], "rescan");
+        if (!rescan.isNull())
+            fRescan = rescan.get_bool();
+    }
+
+    LOCK2(cs_main, pwalletMain->cs_wallet);
+
+    // the entries that have never been used do not need any block to be rescanned
+    const int64_t nNow = chainActive.Tip() ? chainActive.Tip()->GetMedianTimePast() : GetTime();
+    int64_t nTimeBegin = nNow;
+    bool fImported = false;
+
+    UniValue response(UniValue::VARR);
+    for (const UniValue& request : params[0].getValues()) {
+        UniValue result(UniValue::VOBJ);
+        try {
+            const int64_t nTime = ImportMultiRequest(request, nNow);
+            if (nTime < nNow) {
+                nTimeBegin = std::min(nTimeBegin, nTime);
+                fImported = true;
+            }
+            result.pushKV("success", true);
+        } catch (const UniValue& error) {
+            result.pushKV("success", false);
+            result.pushKV("error", error);
+        } catch (const std::exception& e) {
+            result.pushKV("success", false);
+            result.pushKV("error", JSONRPCError(RPC_MISC_ERROR, e.what()));
+        }
+        response.push_back(result);
+    }
+
+    if (fImported) {
+        if (!pwalletMain->nTimeFirstKey || nTimeBegin < pwalletMain->nTimeFirstKey)
+            pwalletMain->nTimeFirstKey = nTimeBegin;
+
+        if (fRescan) {
+            // a single rescan for all the entries, from the earliest one
+            CBlockIndex *pindex = chainActive.Tip();
+            while (pindex && pindex->pprev && pindex->GetBlockTime() > nTimeBegin - TIMESTAMP_WINDOW)
+                pindex = pindex->pprev;
+
+            LogPrintf("Rescanning last %i blocks\n", chainActive.Height() - pindex->nHeight + 1);
+            pwalletMain->ScanForWalletTransactions(pindex, true);
+            pwalletMain->ReacceptWalletTransactions();
+        }
+    }
+
+    return response;
+}
+
 UniValue z_importwallet(const UniValue& params, bool fHelp)
 {
     if (!EnsureWalletIsAvailable(fHelp))
@@ -6,6 +6,7 @@
 #include "amount.h"
 #include "base58.h"
 #include "core_io.h"
+#include "crypto/equihash.h"
 #include "init.h"
 #include "main.h"
 #include "net.h"
@@ -408,9 +409,6 @@ UniValue getnewaddress(const UniValue& params, bool fHelp)
     if (params.size() > 0)
         strAccount = AccountFromValue(params[0]);
 
-    if (!pwalletMain->IsLocked())
-        pwalletMain->TopUpKeyPool();
-
     // Generate a new key that is added to wallet
     CPubKey newKey;
     if (!pwalletMain->GetKeyFromPool(newKey))
@@ -527,9 +525,6 @@ UniValue getrawchangeaddress(const UniValue& params, bool fHelp)
 
     LOCK2(cs_main, pwalletMain->cs_wallet);
 
-    if (!pwalletMain->IsLocked())
-        pwalletMain->TopUpKeyPool();
-
     CReserveKey reservekey(pwalletMain);
     CPubKey vchPubKey;
     if (!reservekey.GetReservedKey(vchPubKey))
@@ -1956,7 +1951,12 @@ CAmount GetAccountBalance(CWalletDB& walletdb, const string& strAccount, int nMi
 {
     CAmount nBalance = 0;
 
-    // Tally wallet transactions
+    // Tally wallet transactions, unless done already since the last change.
+    // Accounting entries live in the db only, so they are always added afterwards.
+    const std::string strCacheKey = strprintf("account:%d:%d:%s", nMinDepth, filter, strAccount);
+    if (pwalletMain->GetCachedBalance(strCacheKey, nBalance))
+        return nBalance + walletdb.GetAccountCreditDebit(strAccount);
+
     for (auto it = pwalletMain->getMapWallet().begin(); it != pwalletMain->getMapWallet().end(); ++it)
     {
         const CWalletTransactionBase& wtx = *((*it).second);
@@ -1970,6 +1970,7 @@ CAmount GetAccountBalance(CWalletDB& walletdb, const string& strAccount, int nMi
             nBalance += nReceived;
         nBalance -= nSent + nFee;
     }
+    pwalletMain->SetCachedBalance(strCacheKey, nBalance);
 
     // Tally internal accounting entries
     nBalance += walletdb.GetAccountCreditDebit(strAccount);
@@ -2620,12 +2621,11 @@ void ListTransactions(
     UniValue& transactions, const isminefilter& filter, bool includeImmatureBTs,
     bool minedInRange = true, bool certMaturingInRange = false)
 {
-    CAmount nFee;
-    string strSentAccount;
-    list<COutputEntry> listReceived;
-    list<COutputEntry> listSent;
-
-    wtx.GetAmounts(listReceived, listSent, nFee, strSentAccount, filter);
+    const CAmountsBreakdown& amounts = wtx.GetCachedAmounts(filter);
+    const CAmount nFee = amounts.nFee;
+    const string& strSentAccount = amounts.strSentAccount;
+    const list<COutputEntry>& listReceived = amounts.listReceived;
+    const list<COutputEntry>& listSent = amounts.listSent;
 
     bool fAllAccounts = (strAccount == string("*"));
     bool involvesWatchonly = wtx.IsFromMe(ISMINE_WATCH_ONLY);
@@ -2740,9 +2740,9 @@ UniValue listtransactions(const UniValue& params, bool fHelp)
     if (!EnsureWalletIsAvailable(fHelp))
         return NullUniValue;
 
-    if (fHelp || params.size() > 6)
+    if (fHelp || params.size() > 7)
         throw runtime_error(
-            "listtransactions   ( \"account\" count from includeWatchonly includeImmatureBTs )n"
+            "listtransactions   ( \"account\" count from includeWatchonly address includeImmatureBTs cursor )\n"
             "\nReturns up to 'count' most recent transactions skipping the first 'from' transactions for address 'address'.\n"
             
             "\nArguments:\n"
@@ -2752,6 +2752,11 @@ UniValue listtransactions(const UniValue& params, bool fHelp)
             "4. includeWatchonly                     (bool, optional, default=false) include transactions to watchonly addresses (see 'importaddress')\n"
             "5. address                              (string, optional) include only transactions involving this address\n"
             "6. includeImmatureBTs                   (bool, optional, default=false) Whether to include immature certificate Backward transfers\n"
+            "7. cursor                               (numeric, optional) page through the transactions: list those before the position\n"
+            "                                          'cursor' rather than the most recent ones, -1 for the most recent ones. The entries\n"
+            "                                          then have their position in 'orderpos', the lowest of a page being the cursor of the\n"
+            "                                          next one, and a page holds the entries of whole transactions, hence up to 'count' plus\n"
+            "                                          those of the last transaction. The cost of a page is then up to its size only\n"
             
             "\nResult:\n"
             "[\n"
@@ -2785,6 +2790,7 @@ UniValue listtransactions(const UniValue& params, bool fHelp)
             "                                           from (for receiving funds, positive amounts), or went to (for sending funds,\n"
             "                                           negative amounts)\n"
             "    \"size\": n,                         (numeric) transaction size in bytes\n"
+            "    \"orderpos\": n,                     (numeric) the position of the transaction in the wallet, only given with a cursor\n"
             "  }\n"
             "]\n"
 
@@ -2793,6 +2799,9 @@ UniValue listtransactions(const UniValue& params, bool fHelp)
             + HelpExampleCli("listtransactions", "") +
             "\nList transactions 100 to 120\n"
             + HelpExampleCli("listtransactions", "\"*\" 20 100") +
+            "\nList the first page of 100 transactions, then the page before the lowest orderpos of the first one\n"
+            + HelpExampleCli("listtransactions", "\"*\" 100 0 false \"*\" false -1") +
+            HelpExampleCli("listtransactions", "\"*\" 100 0 false \"*\" false 123456") +
             "\nAs a json rpc call\n"
             + HelpExampleRpc("listtransactions", "\"*\", 20, 100")
         );
@@ -2838,29 +2847,52 @@ UniValue listtransactions(const UniValue& params, bool fHelp)
         if(params[5].get_bool())
             includeImmatureBTs = true;
 
+    bool fCursor = false;
+    int64_t nCursor = -1;
+    if (params.size() > 6) {
+        fCursor = true;
+        nCursor = params[6].get_int64();
+        if (nCursor < -1)
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid cursor");
+    }
+
     UniValue ret(UniValue::VARR);
     const TxItems & txOrdered = pwalletMain->wtxOrdered;
+    // with a cursor, seek to the transactions ordered before it rather than walking the more recent ones
+    TxItems::const_reverse_iterator itBegin = txOrdered.rbegin();
+    if (nCursor >= 0)
+        itBegin = TxItems::const_reverse_iterator(txOrdered.lower_bound(nCursor));
     // iterate backwards until we have nCount items to return:
-    for (TxItems::const_reverse_iterator it = txOrdered.rbegin(); it != txOrdered.rend(); ++it)
+    for (TxItems::const_reverse_iterator it = itBegin; it != txOrdered.rend(); ++it)
     {
+        UniValue entries(UniValue::VARR);
+        UniValue& out = fCursor ? entries : ret;
         CWalletTransactionBase *const pwtx = (*it).second.first;
         if (pwtx != nullptr){
             if(baddress.IsValid()) {
                 for(const CTxOut& txout : pwtx->getTxBase()->GetVout()) {
                     auto res = std::search(txout.scriptPubKey.begin(), txout.scriptPubKey.end(), scriptPubKey.begin(), scriptPubKey.end());
                     if (res == txout.scriptPubKey.begin()) {
-                        ListTransactions(*pwtx, strAccount, 0, true, ret, filter, includeImmatureBTs);
+                        ListTransactions(*pwtx, strAccount, 0, true, out, filter, includeImmatureBTs);
                         break;
                     }
                 }
             }
             else {
-                ListTransactions(*pwtx, strAccount, 0, true, ret, filter, includeImmatureBTs);
+                ListTransactions(*pwtx, strAccount, 0, true, out, filter, includeImmatureBTs);
             }
         }
         CAccountingEntry *const pacentry = (*it).second.second;
         if (pacentry != nullptr)
-            AcentryToJSON(*pacentry, strAccount, ret);
+            AcentryToJSON(*pacentry, strAccount, out);
+
+        if (fCursor) {
+            for (const UniValue& entry : entries.getValues()) {
+                UniValue entryWithPos(entry);
+                entryWithPos.pushKV("orderpos", (*it).first);
+                ret.push_back(entryWithPos);
+            }
+        }
 
         if ((int)ret.size() >= (nCount+nFrom)) break;
     }
@@ -2868,7 +2900,8 @@ UniValue listtransactions(const UniValue& params, bool fHelp)
     //getting all the specific Txes requested by nCount and nFrom
     if (nFrom > (int)ret.size())
         nFrom = ret.size();
-    if ((nFrom + nCount) > (int)ret.size())
+    // a page of a cursor ends with a whole transaction
+    if (fCursor || (nFrom + nCount) > (int)ret.size())
         nCount = ret.size() - nFrom;
 
     vector<UniValue> arrTmp = ret.getValues();
@@ -3219,9 +3252,8 @@ UniValue listsinceblock(const UniValue& params, bool fHelp)
 
     UniValue transactions(UniValue::VARR);
 
-    for (auto it = pwalletMain->getMapWallet().begin(); it != pwalletMain->getMapWallet().end(); ++it)
+    auto listSince = [&](const CWalletTransactionBase& tx)
     {
-        const CWalletTransactionBase& tx = *((*it).second);
         int depthInMainChain = tx.GetDepthInMainChain();
 
         bool minedInRange = (depth == -1) || depthInMainChain < depth;
@@ -3245,6 +3277,19 @@ UniValue listsinceblock(const UniValue& params, bool fHelp)
         {
             ListTransactions(tx, "*", 0, true, transactions, filter, includeImmatureBTs, minedInRange, certMaturingInRange);
         }
+    };
+
+    if (pindex)
+    {
+        // the transactions of the blocks up to pindex are in range only if they left the active chain since,
+        // the certificates are checked all as they mature later
+        for (const uint256& hash : pwalletMain->GetTxsAboveHeight(pindex->nHeight))
+            listSince(*pwalletMain->getMapWallet().at(hash));
+    }
+    else
+    {
+        for (auto it = pwalletMain->getMapWallet().begin(); it != pwalletMain->getMapWallet().end(); ++it)
+            listSince(*((*it).second));
     }
 
     CBlockIndex *pblockLast = chainActive[chainActive.Height() + 1 - target_confirms];
@@ -3930,6 +3975,7 @@ UniValue getwalletinfo(const UniValue& params, bool fHelp)
             "  \"keypoolsize\": xxxx,        (numeric) how many new keys are pre-generated\n"
             "  \"unlocked_until\": ttt,      (numeric) the timestamp in seconds since epoch (midnight Jan 1 1970 GMT) that the wallet is unlocked for transfers, or 0 if the wallet is locked\n"
             "  \"paytxfee\": xxxxx,          (numeric) the transaction fee configuration, set in " + CURRENCY_UNIT + "/kB\n"
+            "  \"certfeepoolsize\": xxxx,    (numeric) with -certfeepool, how many confirmed coins are kept for the fees of the certificates\n"
             "}\n"
             
             "\nExamples:\n"
@@ -3950,6 +3996,8 @@ UniValue getwalletinfo(const UniValue& params, bool fHelp)
     if (pwalletMain->IsCrypted())
         obj.pushKV("unlocked_until", nWalletUnlockTime);
     obj.pushKV("paytxfee",      ValueFromAmount(payTxFee.GetFeePerK()));
+    if (pwalletMain->HasCertFeePool())
+        obj.pushKV("certfeepoolsize", (int)pwalletMain->GetCertFeePoolCoins());
     return obj;
 }
 
@@ -4339,6 +4387,16 @@ UniValue zc_benchmark(const UniValue& params, bool fHelp)
             "\nArguments:\n"
             "1. benchmarktype    (string, required) the benchmark type\n"
             "2. samplecount      (numeric, required) count times\n"
+            "3. ...              (optional) arguments of the benchmark type: for verifyjoinsplit the hex of the\n"
+            "                    JoinSplit and the number of its copies verified at once, as the JoinSplits of a\n"
+            "                    block on the -par threads (default 1, verified inline); for mempooladmission the number\n"
+            "                    of transactions (default 50000) and whether the mempool address and spent\n"
+            "                    indexes are kept (default true); for certblocksighash the number of certificates\n"
+            "                    of the block (default 100) and whether the certificate signature hash prefix is\n"
+            "                    memoized (default true); for verifycertproofs and verifycswproofs the maximum\n"
+            "                    number of mempool certificates or transactions whose proofs are batch verified\n"
+            "                    (default 100); for sctxscommitment the number of sidechains (default 100) and of\n"
+            "                    forward transfers to each of them (default 10)\n"
 
             "\nBenchmark types:\n"
             "verifyjoinsplit\n"
@@ -4354,17 +4412,28 @@ UniValue zc_benchmark(const UniValue& params, bool fHelp)
             "sendtoaddress\n"
             "loadwallet\n"
             "listunspent\n"
+            "selectcoins\n"
+            "mempooladmission\n"
+            "certblocksighash\n"
+            "verifycertproofs   (regtest only, the proofs of the mempool certificates)\n"
+            "verifycswproofs    (regtest only, the proofs of the mempool ceased sidechain withdrawals)\n"
+            "sctxscommitment\n"
+            "acceptcertificates (regtest only, the mempool certificates into an empty mempool)\n"
+            "createnewblock     (regtest only, a block template from the mempool)\n"
+            "connecttipblock    (regtest only, the active chain tip block, without writing it)\n"
             
             "\nResult:\n"
-            "[\n"
-            "  {\n"
-            "    \"runningtime\": runningtime\n"
-            "  },\n"
-            "  {\n"
-            "    \"runningtime\": runningtime\n"
+            "{\n"
+            "  \"samples\": [\n"
+            "    {\n"
+            "      \"runningtime\": runningtime\n"
+            "    },\n"
+            "    ...\n"
+            "  ],\n"
+            "  \"percentiles\": {   (running times over the samples, by nearest rank)\n"
+            "    \"min\": n, \"p50\": n, \"p90\": n, \"p99\": n, \"max\": n, \"mean\": n\n"
             "  }\n"
-            "  ...\n"
-            "]\n"
+            "}\n"
 
             "\nExamples:\n"
             + HelpExampleCli("zcbenchmark", "\"benchmarktype\" 2")
@@ -4387,6 +4456,11 @@ UniValue zc_benchmark(const UniValue& params, bool fHelp)
     }
 
     std::vector<double> sample_times;
+#ifdef ENABLE_MINING
+    // the solver lists are reused across the samples, as by the miner threads across the nonces
+    EhSolverWorkspace workspace;
+    std::vector<EhSolverWorkspace> workspaces;
+#endif
 
     JSDescription samplejoinsplit = JSDescription::getNewInstance(shieldedTxVersion == GROTH_TX_VERSION);
 
@@ -4412,14 +4486,21 @@ UniValue zc_benchmark(const UniValue& params, bool fHelp)
                 sample_times.push_back(std::accumulate(vals.begin(), vals.end(), 0.0) / (nThreads*nThreads));
             }
         } else if (benchmarktype == "verifyjoinsplit") {
-            sample_times.push_back(benchmark_verify_joinsplit(samplejoinsplit));
+            if (params.size() < 4) {
+                sample_times.push_back(benchmark_verify_joinsplit(samplejoinsplit));
+            } else {
+                int nJoinSplits = params[3].get_int();
+                if (nJoinSplits <= 0)
+                    throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid number of JoinSplits");
+                sample_times.push_back(benchmark_verify_joinsplit_block(samplejoinsplit, nJoinSplits));
+            }
 #ifdef ENABLE_MINING
         } else if (benchmarktype == "solveequihash") {
             if (params.size() < 3) {
-                sample_times.push_back(benchmark_solve_equihash());
+                sample_times.push_back(benchmark_solve_equihash(&workspace));
             } else {
                 int nThreads = params[2].get_int();
-                std::vector<double> vals = benchmark_solve_equihash_threaded(nThreads);
+                std::vector<double> vals = benchmark_solve_equihash_threaded(nThreads, workspaces);
                 sample_times.insert(sample_times.end(), vals.begin(), vals.end());
             }
 #endif
@@ -4451,18 +4532,87 @@ UniValue zc_benchmark(const UniValue& params, bool fHelp)
             sample_times.push_back(benchmark_loadwallet());
         } else if (benchmarktype == "listunspent") {
             sample_times.push_back(benchmark_listunspent());
+        } else if (benchmarktype == "selectcoins") {
+            auto amount = AmountFromValue(params[2]);
+            sample_times.push_back(benchmark_selectcoins(amount));
+        } else if (benchmarktype == "mempooladmission") {
+            int nTxs = params.size() > 2 ? params[2].get_int() : 50000;
+            if (nTxs <= 0) {
+                throw JSONRPCError(RPC_TYPE_ERROR, "Invalid number of transactions");
+            }
+            bool fWithIndexes = params.size() > 3 ? params[3].get_bool() : true;
+            sample_times.push_back(benchmark_mempool_admission(nTxs, fWithIndexes));
+        } else if (benchmarktype == "certblocksighash") {
+            int nCerts = params.size() > 2 ? params[2].get_int() : 100;
+            if (nCerts <= 0) {
+                throw JSONRPCError(RPC_TYPE_ERROR, "Invalid number of certificates");
+            }
+            bool fMemoized = params.size() > 3 ? params[3].get_bool() : true;
+            sample_times.push_back(benchmark_cert_block_sighash(nCerts, fMemoized));
+        } else if (benchmarktype == "verifycertproofs" || benchmarktype == "verifycswproofs") {
+            if (Params().NetworkIDString() != "regtest") {
+                throw JSONRPCError(RPC_TYPE_ERROR, "Benchmark must be run in regtest mode");
+            }
+            int nItems = params.size() > 2 ? params[2].get_int() : 100;
+            if (nItems <= 0) {
+                throw JSONRPCError(RPC_TYPE_ERROR, "Invalid number of proofs");
+            }
+            sample_times.push_back(benchmarktype == "verifycertproofs" ?
+                                   benchmark_verify_cert_proofs(nItems) : benchmark_verify_csw_proofs(nItems));
+        } else if (benchmarktype == "sctxscommitment") {
+            int nSidechains = params.size() > 2 ? params[2].get_int() : 100;
+            int nFtsPerSidechain = params.size() > 3 ? params[3].get_int() : 10;
+            if (nSidechains <= 0 || nFtsPerSidechain <= 0) {
+                throw JSONRPCError(RPC_TYPE_ERROR, "Invalid number of sidechains or forward transfers");
+            }
+            sample_times.push_back(benchmark_sc_txs_commitment(nSidechains, nFtsPerSidechain));
+        } else if (benchmarktype == "acceptcertificates") {
+            if (Params().NetworkIDString() != "regtest") {
+                throw JSONRPCError(RPC_TYPE_ERROR, "Benchmark must be run in regtest mode");
+            }
+            sample_times.push_back(benchmark_accept_certificates());
+        } else if (benchmarktype == "createnewblock") {
+            if (Params().NetworkIDString() != "regtest") {
+                throw JSONRPCError(RPC_TYPE_ERROR, "Benchmark must be run in regtest mode");
+            }
+            sample_times.push_back(benchmark_create_new_block());
+        } else if (benchmarktype == "connecttipblock") {
+            if (Params().NetworkIDString() != "regtest") {
+                throw JSONRPCError(RPC_TYPE_ERROR, "Benchmark must be run in regtest mode");
+            }
+            sample_times.push_back(benchmark_connect_tip_block());
         } else {
             throw JSONRPCError(RPC_TYPE_ERROR, "Invalid benchmarktype");
         }
     }
 
-    UniValue results(UniValue::VARR);
+    UniValue samples(UniValue::VARR);
     for (auto time : sample_times) {
         UniValue result(UniValue::VOBJ);
         result.pushKV("runningtime", time);
-        results.push_back(result);
-    }
-
+        samples.push_back(result);
+    }
+
+    // some benchmark types return several times per sample
+    std::vector<double> sorted_times(sample_times);
+    std::sort(sorted_times.begin(), sorted_times.end());
+    auto percentile = [&sorted_times](int p) {
+        size_t rank = (p * sorted_times.size() + 99) / 100;
+        return sorted_times[rank > 0 ? rank - 1 : 0];
+    };
+    UniValue percentiles(UniValue::VOBJ);
+    if (!sorted_times.empty()) {
+        percentiles.pushKV("min", sorted_times.front());
+        percentiles.pushKV("p50", percentile(50));
+        percentiles.pushKV("p90", percentile(90));
+        percentiles.pushKV("p99", percentile(99));
+        percentiles.pushKV("max", sorted_times.back());
+        percentiles.pushKV("mean", std::accumulate(sorted_times.begin(), sorted_times.end(), 0.0) / sorted_times.size());
+    }
+
+    UniValue results(UniValue::VOBJ);
+    results.pushKV("samples", samples);
+    results.pushKV("percentiles", percentiles);
     return results;
 }
 
@@ -5163,7 +5313,10 @@ UniValue z_getoperationstatus(const UniValue& params, bool fHelp)
             "\nResult:\n"
             "\" [\"                                           (array) a list of JSON objects\n"
             "      {\n"
-            "           \"status\": \"xxxx\",                 (string) status, can be \"success\", \"failed\", \"cancelled\"\n"
+            "           \"status\": \"xxxx\",                 (string) status, can be \"queued\", \"executing\", \"success\", \"failed\", \"cancelled\"\n"
+            "           \"priority\": \"xxxx\",               (string) priority class, \"high\", \"normal\" or \"low\"; higher classes run first\n"
+            "           \"queued_secs\": n,                   (numeric) seconds spent waiting in the queue, so far if still queued\n"
+            "           \"execution_secs\": n,                (numeric, optional) seconds spent executing, so far if still executing\n"
             "           error: {                              (object, optional) if the status is \"failed\", the error object has key-value pairs (code-message)\n"
             "                   \"code (numeric)\": \"message (string)\"\n"
             "                  }\n"
@@ -5451,6 +5604,8 @@ UniValue z_sendmany(const UniValue& params, bool fHelp)
     // Create operation and add to global queue
     std::shared_ptr<AsyncRPCQueue> q = getAsyncRPCQueue();
     std::shared_ptr<AsyncRPCOperation> operation( new AsyncRPCOperation_sendmany(contextualTx, fromaddress, std::move(taddrRecipients), std::move(zaddrRecipients), nMinDepth, nFee, contextInfo, sendChangeToSource) );
+    // A transparent transaction needs no proof and does not have to wait behind the shielded ones
+    operation->set_priority(isShielded ? OperationPriority::NORMAL : OperationPriority::HIGH);
     q->addOperation(operation);
     AsyncRPCOperationId operationId = operation->getId();
     return operationId;
@@ -5479,7 +5634,7 @@ UniValue sc_send_certificate(const UniValue& params, bool fHelp)
             " 7. forwardTransferScFee            (numeric, required) The amount of fee due to sidechain actors when creating a FT\n"
             " 8. mainchainBackwardTransferScFee  (numeric, required) The amount of fee due to sidechain actors when creating a MBTR\n"
             " 9. fee                             (numeric, optional) The fee amount of the certificate in " + CURRENCY_UNIT + ". If it is not specified or has a negative value it is automatically computed using a fixed fee rate (default is 1Zat/Byte)\n"
-            "10. fromAddress                     (string, optional) The taddr to send the coins from. If omitted, coins are chosen among all available UTXOs\n"
+            "10. fromAddress                     (string, optional) The taddr to send the coins from. If omitted, a coin of the -certfeepool is used if any is large enough, else coins are chosen among all available UTXOs\n"
             "11. vFieldElementCertificateField   (array, optional) a list of hexadecimal strings each of them representing data used to verify the SNARK proof of the certificate\n"
             "    [\n"                     
             "      \"fieldElement\"             (string, required) The HEX string representing generic data\n"
@@ -6027,6 +6182,8 @@ UniValue z_shieldcoinbase(const UniValue& params, bool fHelp)
     // Create operation and add to global queue
     std::shared_ptr<AsyncRPCQueue> q = getAsyncRPCQueue();
     std::shared_ptr<AsyncRPCOperation> operation( new AsyncRPCOperation_shieldcoinbase(contextualTx, std::move(inputs), destaddress, nFee, contextInfo) );
+    // Shielding and merging are housekeeping, payments go first
+    operation->set_priority(OperationPriority::LOW);
     q->addOperation(operation);
     AsyncRPCOperationId operationId = operation->getId();
 
@@ -6382,6 +6539,7 @@ UniValue z_mergetoaddress(const UniValue& params, bool fHelp)
     std::shared_ptr<AsyncRPCQueue> q = getAsyncRPCQueue();
     std::shared_ptr<AsyncRPCOperation> operation(
         new AsyncRPCOperation_mergetoaddress(contextualTx, utxoInputs, noteInputs, recipient, nFee, contextInfo) );
+    operation->set_priority(OperationPriority::LOW);
     q->addOperation(operation);
     AsyncRPCOperationId operationId = operation->getId();
 
@@ -6449,3 +6607,44 @@ UniValue z_listoperationids(const UniValue& params, bool fHelp)
 
     return ret;
 }
+
+UniValue z_canceloperation(const UniValue& params, bool fHelp)
+{
+    if (!EnsureWalletIsAvailable(fHelp))
+        return NullUniValue;
+
+    if (fHelp || params.size() != 1)
+        throw runtime_error(
+            "z_canceloperation [\"operationid\", ... ]\n"
+            "\nCancel operations still waiting in the queue. Operations already executing cannot be cancelled.\n"
+
+            "\nArguments:\n"
+            "1. \"operationid\"    (array, required) a list of operation ids to cancel\n"
+
+            "\nResult:\n"
+            "[                     (json array of string)\n"
+            "  \"operationid\"     (string) an operation id that was cancelled\n"
+            "  ,...\n"
+            "]\n"
+
+            "\nExamples:\n"
+            + HelpExampleCli("z_canceloperation", "'[\"operationid\", ... ]'")
+            + HelpExampleRpc("z_canceloperation", "'[\"operationid\", ... ]'")
+        );
+
+    UniValue ret(UniValue::VARR);
+    std::shared_ptr<AsyncRPCQueue> q = getAsyncRPCQueue();
+    for (const UniValue & v : params[0].get_array().getValues()) {
+        std::shared_ptr<AsyncRPCOperation> operation = q->getOperationForId(v.get_str());
+        if (!operation) {
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "No operation exists for id " + v.get_str());
+        }
+        // A worker skips the cancelled operation when it reaches it in the queue
+        operation->cancel();
+        if (operation->isCancelled()) {
+            ret.push_back(operation->getId());
+        }
+    }
+
+    return ret;
+}
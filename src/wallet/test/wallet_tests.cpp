@@ -250,6 +250,17 @@ BOOST_AUTO_TEST_CASE(coin_selection_tests)
         BOOST_CHECK_EQUAL(nValueRet, 1 * CENT);   // we should get the exact amount
         BOOST_CHECK_EQUAL(setCoinsRet.size(), 2U); // in two coins 0.4+0.6
 
+        // an exact subset is found even when the largest coin (6) does not combine with the next ones
+        empty_wallet();
+        add_coin(4 * CENT);
+        add_coin(5 * CENT);
+        add_coin(5 * CENT);
+        add_coin(6 * CENT);
+        add_coin(1111 * CENT);
+        BOOST_CHECK( wallet.SelectCoinsMinConf(10 * CENT, 1, 1, vCoins, setCoinsRet, nValueRet));
+        BOOST_CHECK_EQUAL(nValueRet, 10 * CENT);   // we should get the exact amount
+        BOOST_CHECK_EQUAL(setCoinsRet.size(), 2U); // in two coins, either 6+4 or 5+5
+
         // test avoiding sub-cent change
         empty_wallet();
         add_coin(0.0005 * COIN);
@@ -311,4 +322,29 @@ BOOST_AUTO_TEST_CASE(coin_selection_tests)
     empty_wallet();
 }
 
+BOOST_AUTO_TEST_CASE(keypool_topup_in_batches)
+{
+    // more keys than a batch takes, with a partial last one
+    const unsigned int nSize = 2 * KEYPOOL_TOPUP_BATCH_SIZE + 10;
+    BOOST_CHECK(pwalletMain->TopUpKeyPool(nSize));
+
+    LOCK(pwalletMain->cs_wallet);
+    BOOST_CHECK_EQUAL(pwalletMain->GetKeyPoolSize(), nSize + 1);
+
+    std::set<CKeyID> setAddress;
+    pwalletMain->GetAllReserveKeys(setAddress);
+    BOOST_CHECK_EQUAL(setAddress.size(), nSize + 1);
+    for (const CKeyID& keyID : setAddress)
+        BOOST_CHECK(pwalletMain->HaveKey(keyID));
+
+    // a full keypool is left as it is
+    BOOST_CHECK(pwalletMain->TopUpKeyPool(nSize));
+    BOOST_CHECK_EQUAL(pwalletMain->GetKeyPoolSize(), nSize + 1);
+
+    CPubKey pubkey;
+    BOOST_CHECK(pwalletMain->GetKeyFromPool(pubkey));
+    BOOST_CHECK(setAddress.count(pubkey.GetID()));
+    BOOST_CHECK_EQUAL(pwalletMain->GetKeyPoolSize(), nSize);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -25,6 +25,7 @@ using namespace zen;
 
 #include <algorithm>
 #include <assert.h>
+#include <future>
 
 #include <boost/algorithm/string/replace.hpp>
 #include <boost/filesystem.hpp>
@@ -159,10 +160,37 @@ CPubKey CWallet::GenerateNewKey()
     return pubkey;
 }
 
+void CWallet::AddGeneratedKey(const CKey& secret, const CPubKey& pubkey, CWalletDB& walletdb)
+{
+    AssertLockHeld(cs_wallet); // mapKeyMetadata
+    if (secret.IsCompressed())
+        SetMinVersion(FEATURE_COMPRPUBKEY, &walletdb);
+
+    int64_t nCreationTime = GetTime();
+    mapKeyMetadata[pubkey.GetID()] = CKeyMetadata(nCreationTime);
+    if (!nTimeFirstKey || nCreationTime < nTimeFirstKey)
+        nTimeFirstKey = nCreationTime;
+
+    if (!AddKeyPubKeyWithDB(secret, pubkey, &walletdb))
+        throw std::runtime_error("CWallet::AddGeneratedKey(): AddKey failed");
+}
+
 bool CWallet::AddKeyPubKey(const CKey& secret, const CPubKey &pubkey)
+{
+    return AddKeyPubKeyWithDB(secret, pubkey, NULL);
+}
+
+bool CWallet::AddKeyPubKeyWithDB(const CKey& secret, const CPubKey &pubkey, CWalletDB* pwalletdb)
 {
     AssertLockHeld(cs_wallet); // mapKeyMetadata
-    if (!CCryptoKeyStore::AddKeyPubKey(secret, pubkey))
+    // The crypted key is written by AddCryptedKey, which CCryptoKeyStore calls back: it is given
+    // the db through pwalletdbEncryption, unless the wallet is being encrypted
+    CWalletDB* pwalletdbPrev = pwalletdbEncryption;
+    if (pwalletdb && !pwalletdbEncryption)
+        pwalletdbEncryption = pwalletdb;
+    const bool fAdded = CCryptoKeyStore::AddKeyPubKey(secret, pubkey);
+    pwalletdbEncryption = pwalletdbPrev;
+    if (!fAdded)
         return false;
 
     // check if we need to remove from watch-only
@@ -174,6 +202,8 @@ bool CWallet::AddKeyPubKey(const CKey& secret, const CPubKey &pubkey)
     if (!fFileBacked)
         return true;
     if (!IsCrypted()) {
+        if (pwalletdb)
+            return pwalletdb->WriteKey(pubkey, secret.GetPrivKey(), mapKeyMetadata[pubkey.GetID()]);
         return CWalletDB(strWalletFile).WriteKey(pubkey,
                                                  secret.GetPrivKey(),
                                                  mapKeyMetadata[pubkey.GetID()]);
@@ -421,6 +451,7 @@ void CWallet::ChainTip(const CBlockIndex *pindex, const CBlock *pblock,
     } else {
         DecrementNoteWitnesses(pindex);
     }
+    UpdateTxsOffChain(pindex, added);
 }
 
 void CWallet::SetBestChain(const CBlockLocator& loc)
@@ -431,6 +462,37 @@ void CWallet::SetBestChain(const CBlockLocator& loc)
     SetBestChainINTERNAL(walletdb, loc);
 }
 
+void CWallet::BeginBlockSync()
+{
+    if (!fFileBacked)
+        return;
+    ENTER_CRITICAL_SECTION(cs_wallet);
+    pwalletdbBlockSync.reset(new CWalletDB(strWalletFile, "r+", false));
+    if (!pwalletdbBlockSync->TxnBegin()) {
+        LogPrintf("%s():%d - Couldn't start atomic write, writing the block updates one by one\n", __func__, __LINE__);
+        pwalletdbBlockSync.reset();
+    }
+}
+
+void CWallet::EndBlockSync()
+{
+    if (!fFileBacked)
+        return;
+    if (pwalletdbBlockSync && !pwalletdbBlockSync->TxnCommit())
+        LogPrintf("%s():%d - ERROR in committing the block updates to db\n", __func__, __LINE__);
+    pwalletdbBlockSync.reset();
+    LEAVE_CRITICAL_SECTION(cs_wallet);
+}
+
+CWalletDB& CWallet::GetSyncWalletDB(std::unique_ptr<CWalletDB>& pwalletdbNew)
+{
+    AssertLockHeld(cs_wallet);
+    if (pwalletdbBlockSync)
+        return *pwalletdbBlockSync;
+    pwalletdbNew.reset(new CWalletDB(strWalletFile, "r+", false));
+    return *pwalletdbNew;
+}
+
 bool CWallet::SetMinVersion(enum WalletFeature nVersion, CWalletDB* pwalletdbIn, bool fExplicit)
 {
     LOCK(cs_wallet); // nWalletVersion
@@ -676,11 +738,312 @@ void CWallet::AddToSpends(const uint256& wtxid)
     }
 }
 
+void CWallet::IndexWalletTx(const CWalletTransactionBase& wtx)
+{
+    LOCK(cs_wallet); // setUnspentTxs, mapTxsByDestination
+    const uint256& hash = wtx.getTxBase()->GetHash();
+    setUnspentTxs.insert(hash);
+
+    for (const CTxIn& txin : wtx.getTxBase()->GetVin()) {
+        auto mi = mapWallet.find(txin.prevout.hash);
+        if (mi == mapWallet.end())
+            continue;
+
+        // the spent tx is checked again the next time the index is walked
+        setUnspentTxs.insert(txin.prevout.hash);
+
+        const std::vector<CTxOut>& vout = mi->second->getTxBase()->GetVout();
+        CTxDestination dest;
+        if (txin.prevout.n < vout.size() && ExtractDestination(vout[txin.prevout.n].scriptPubKey, dest))
+            mapTxsByDestination[dest].insert(hash);
+    }
+
+    const std::vector<CTxOut>& vout = wtx.getTxBase()->GetVout();
+    for (unsigned int n = 0; n < vout.size(); n++) {
+        CTxDestination dest;
+        if (!ExtractDestination(vout[n].scriptPubKey, dest))
+            continue;
+
+        std::set<uint256>& txs = mapTxsByDestination[dest];
+        txs.insert(hash);
+
+        // spenders may have been added before this tx, e.g. while loading the wallet
+        auto range = mapTxSpends.equal_range(COutPoint(hash, n));
+        for (auto it = range.first; it != range.second; ++it)
+            txs.insert(it->second);
+    }
+}
+
+void CWallet::UnindexWalletTx(const CWalletTransactionBase& wtx)
+{
+    LOCK(cs_wallet); // setUnspentTxs, mapTxsByDestination, mapNoteTxs
+    const uint256& hash = wtx.getTxBase()->GetHash();
+    setUnspentTxs.erase(hash);
+    mapNoteTxs.erase(hash);
+    for (const mapNoteData_t::value_type& item : wtx.mapNoteData) {
+        auto it = mapNotesByAddress.find(item.second.address);
+        if (it != mapNotesByAddress.end()) {
+            it->second.erase(item.first);
+            if (it->second.empty())
+                mapNotesByAddress.erase(it);
+        }
+        mapNotePlaintexts.erase(item.first);
+    }
+
+    auto unindexDest = [this, &hash](const CScript& scriptPubKey) {
+        CTxDestination dest;
+        if (!ExtractDestination(scriptPubKey, dest))
+            return;
+        auto it = mapTxsByDestination.find(dest);
+        if (it == mapTxsByDestination.end())
+            return;
+        it->second.erase(hash);
+        if (it->second.empty())
+            mapTxsByDestination.erase(it);
+    };
+
+    for (const CTxIn& txin : wtx.getTxBase()->GetVin()) {
+        auto mi = mapWallet.find(txin.prevout.hash);
+        if (mi == mapWallet.end())
+            continue;
+
+        setUnspentTxs.insert(txin.prevout.hash);
+        const std::vector<CTxOut>& vout = mi->second->getTxBase()->GetVout();
+        if (txin.prevout.n < vout.size())
+            unindexDest(vout[txin.prevout.n].scriptPubKey);
+    }
+
+    for (const CTxOut& txout : wtx.getTxBase()->GetVout())
+        unindexDest(txout.scriptPubKey);
+}
+
+void CWallet::IndexNotes(CWalletTransactionBase& wtx)
+{
+    LOCK(cs_wallet); // mapNoteTxs, mapNotesByAddress
+    if (wtx.mapNoteData.empty())
+        return;
+    mapNoteTxs[wtx.getTxBase()->GetHash()] = &wtx;
+    for (const mapNoteData_t::value_type& item : wtx.mapNoteData)
+        mapNotesByAddress[item.second.address].insert(item.first);
+}
+
+void CWallet::ForEachNote(const std::set<PaymentAddress>& filterAddresses,
+                          const std::function<void(const CWalletTransactionBase&, const JSOutPoint&, const CNoteData&)>& f) const
+{
+    AssertLockHeld(cs_wallet);
+    if (filterAddresses.empty()) {
+        for (const auto& noteTx : mapNoteTxs)
+            for (const mapNoteData_t::value_type& item : noteTx.second->mapNoteData)
+                f(*noteTx.second, item.first, item.second);
+        return;
+    }
+
+    std::set<JSOutPoint> setNotes;
+    for (const PaymentAddress& pa : filterAddresses) {
+        auto it = mapNotesByAddress.find(pa);
+        if (it != mapNotesByAddress.end())
+            setNotes.insert(it->second.begin(), it->second.end());
+    }
+    for (const JSOutPoint& jsop : setNotes) {
+        auto itTx = mapNoteTxs.find(jsop.hash);
+        if (itTx == mapNoteTxs.end())
+            continue;
+        auto itNote = itTx->second->mapNoteData.find(jsop);
+        if (itNote == itTx->second->mapNoteData.end() || !filterAddresses.count(itNote->second.address))
+            continue;
+        f(*itTx->second, jsop, itNote->second);
+    }
+}
+
+const NotePlaintext& CWallet::GetNotePlaintext(const CWalletTransactionBase& wtx, const JSOutPoint& jsop,
+                                               const PaymentAddress& pa) const
+{
+    AssertLockHeld(cs_wallet);
+    auto it = mapNotePlaintexts.find(jsop);
+    if (it != mapNotePlaintexts.end())
+        return it->second;
+
+    int i = jsop.js; // Index into CTransaction.GetJoinsSplits()
+    int j = jsop.n;  // Index into JSDescription.ciphertexts
+
+    // Get cached decryptor
+    ZCNoteDecryption decryptor;
+    if (!GetNoteDecryptor(pa, decryptor)) {
+        // Note decryptors are created when the wallet is loaded, so it should always exist
+        throw std::runtime_error(strprintf("Could not find note decryptor for payment address %s", CZCPaymentAddress(pa).ToString()));
+    }
+
+    // determine amount of funds in the note
+    auto hSig = wtx.getTxBase()->GetVjoinsplit()[i].h_sig(*pzcashParams, wtx.getTxBase()->GetJoinSplitPubKey());
+    try {
+        NotePlaintext plaintext = NotePlaintext::decrypt(
+                decryptor,
+                wtx.getTxBase()->GetVjoinsplit()[i].ciphertexts[j],
+                wtx.getTxBase()->GetVjoinsplit()[i].ephemeralKey,
+                hSig,
+                (unsigned char) j);
+        return mapNotePlaintexts.insert(std::make_pair(jsop, plaintext)).first->second;
+    } catch (const note_decryption_failed &err) {
+        // Couldn't decrypt with this spending key
+        throw std::runtime_error(strprintf("Could not decrypt note for payment address %s", CZCPaymentAddress(pa).ToString()));
+    } catch (const std::exception &exc) {
+        // Unexpected failure
+        throw std::runtime_error(strprintf("Error while decrypting note for payment address %s: %s", CZCPaymentAddress(pa).ToString(), exc.what()));
+    }
+}
+
+void CWallet::IndexTxHeight(const CWalletTransactionBase& wtx)
+{
+    LOCK(cs_wallet); // setTxsByHeight, mapTxHeights, setTxsOffChain, setWalletCerts
+    const uint256& hash = wtx.getTxBase()->GetHash();
+    int nHeight = std::numeric_limits<int>::max();
+    if (!wtx.hashBlock.IsNull()) {
+        BlockMap::const_iterator mi = mapBlockIndex.find(wtx.hashBlock);
+        if (mi != mapBlockIndex.end() && mi->second)
+            nHeight = mi->second->nHeight;
+    }
+
+    // called when the tx is seen in a new block, which is then a block of the active chain
+    setTxsOffChain.erase(hash);
+    auto it = mapTxHeights.find(hash);
+    if (it != mapTxHeights.end()) {
+        setTxsByHeight.erase(std::make_pair(it->second, hash));
+        it->second = nHeight;
+    } else {
+        mapTxHeights[hash] = nHeight;
+    }
+    setTxsByHeight.insert(std::make_pair(nHeight, hash));
+    if (wtx.getTxBase()->IsCertificate())
+        setWalletCerts.insert(hash);
+}
+
+void CWallet::UnindexTxHeight(const uint256& hash)
+{
+    LOCK(cs_wallet); // setTxsByHeight, mapTxHeights, setTxsOffChain, setWalletCerts
+    auto it = mapTxHeights.find(hash);
+    if (it != mapTxHeights.end()) {
+        setTxsByHeight.erase(std::make_pair(it->second, hash));
+        mapTxHeights.erase(it);
+    }
+    setTxsOffChain.erase(hash);
+    setWalletCerts.erase(hash);
+}
+
+void CWallet::UpdateTxsOffChain(const CBlockIndex* pindex, bool fConnected)
+{
+    LOCK(cs_wallet); // setTxsByHeight, setTxsOffChain
+    const uint256 hashBlock = pindex->GetBlockHash();
+    for (auto it = setTxsByHeight.lower_bound(std::make_pair(pindex->nHeight, uint256()));
+         it != setTxsByHeight.end() && it->first == pindex->nHeight; ++it) {
+        MAP_WALLET_CONST_IT mit = mapWallet.find(it->second);
+        if (mit == mapWallet.end() || mit->second->hashBlock != hashBlock)
+            continue;
+        if (fConnected)
+            setTxsOffChain.erase(it->second);
+        else
+            setTxsOffChain.insert(it->second);
+    }
+}
+
+std::set<uint256> CWallet::GetTxsAboveHeight(int nHeight) const
+{
+    AssertLockHeld(cs_wallet);
+    std::set<uint256> txs(setTxsOffChain.begin(), setTxsOffChain.end());
+    for (auto it = setTxsByHeight.lower_bound(std::make_pair(nHeight + 1, uint256())); it != setTxsByHeight.end(); ++it)
+        txs.insert(it->second);
+    txs.insert(setWalletCerts.begin(), setWalletCerts.end());
+    return txs;
+}
+
+/**
+ * True if every output of wtx is spent by a wallet transaction in the active chain.
+ * Spends in the mempool are not enough, they can be evicted without the wallet being told.
+ */
+bool CWallet::IsSpentInMainChain(const CWalletTransactionBase& wtx) const
+{
+    AssertLockHeld(cs_main);
+    const uint256& hash = wtx.getTxBase()->GetHash();
+
+    for (unsigned int n = 0; n < wtx.getTxBase()->GetVout().size(); n++) {
+        bool fSpent = false;
+        auto range = mapTxSpends.equal_range(COutPoint(hash, n));
+        for (auto it = range.first; it != range.second && !fSpent; ++it) {
+            const MAP_WALLET_CONST_IT mit = mapWallet.find(it->second);
+            fSpent = (mit != mapWallet.end() && mit->second->GetDepthInMainChain() > 0);
+        }
+        if (!fSpent)
+            return false;
+    }
+    return true;
+}
+
+std::vector<const CWalletTransactionBase*> CWallet::GetUnspentWalletTxs() const
+{
+    AssertLockHeld(cs_main);
+    AssertLockHeld(cs_wallet);
+
+    std::vector<const CWalletTransactionBase*> vTxs;
+    vTxs.reserve(setUnspentTxs.size());
+    for (auto it = setUnspentTxs.begin(); it != setUnspentTxs.end(); )
+    {
+        const MAP_WALLET_CONST_IT mit = mapWallet.find(*it);
+        if (mit == mapWallet.end() || IsSpentInMainChain(*mit->second)) {
+            it = setUnspentTxs.erase(it);
+            continue;
+        }
+        vTxs.push_back(mit->second.get());
+        ++it;
+    }
+    return vTxs;
+}
+
+bool CWallet::GetCachedBalance(const std::string& strKey, CAmount& nBalance) const
+{
+    AssertLockHeld(cs_main);
+    AssertLockHeld(cs_wallet);
+
+    const uint256 hashTip = chainActive.Tip() ? chainActive.Tip()->GetBlockHash() : uint256();
+    const unsigned int nMempoolUpdated = mempool->GetTransactionsUpdated();
+    if (hashTip != hashBalanceCacheTip || nMempoolUpdated != nBalanceCacheMempoolUpdated ||
+        nBalanceCacheSeq != nBalanceCacheValidSeq)
+    {
+        mapCachedBalances.clear();
+        hashBalanceCacheTip = hashTip;
+        nBalanceCacheMempoolUpdated = nMempoolUpdated;
+        nBalanceCacheValidSeq = nBalanceCacheSeq;
+        return false;
+    }
+
+    auto it = mapCachedBalances.find(strKey);
+    if (it == mapCachedBalances.end())
+        return false;
+    nBalance = it->second;
+    return true;
+}
+
+CAmountsStamp CWallet::GetAmountsStamp() const
+{
+    AssertLockHeld(cs_main);
+    CAmountsStamp stamp;
+    stamp.hashTip = chainActive.Tip() ? chainActive.Tip()->GetBlockHash() : uint256();
+    stamp.nMempoolUpdated = mempool->GetTransactionsUpdated();
+    stamp.nWalletSeq = nBalanceCacheSeq;
+    return stamp;
+}
+
+void CWallet::SetCachedBalance(const std::string& strKey, CAmount nBalance) const
+{
+    AssertLockHeld(cs_wallet);
+    // only store values computed against the state GetCachedBalance() just validated
+    if (nBalanceCacheSeq == nBalanceCacheValidSeq)
+        mapCachedBalances[strKey] = nBalance;
+}
+
 void CWallet::ClearNoteWitnessCache()
 {
     LOCK(cs_wallet);
-    for (std::pair<const uint256, std::shared_ptr<CWalletTransactionBase> >& wtxItem : mapWallet) {
-        for (mapNoteData_t::value_type& item : wtxItem.second->mapNoteData) {
+    for (auto& noteTx : mapNoteTxs) {
+        for (mapNoteData_t::value_type& item : noteTx.second->mapNoteData) {
             item.second.witnesses.clear();
             item.second.witnessHeight = -1;
         }
@@ -694,9 +1057,11 @@ void CWallet::IncrementNoteWitnesses(const CBlockIndex* pindex,
 {
     {
         LOCK(cs_wallet);
-        for (auto& wtxItem : mapWallet)
+        // The witnesses to which all the commitments of the block are appended
+        std::vector<CNoteData*> vWitnessed;
+        for (auto& noteTx : mapNoteTxs)
         {
-            for (mapNoteData_t::value_type& item : wtxItem.second->mapNoteData) {
+            for (mapNoteData_t::value_type& item : noteTx.second->mapNoteData) {
                 CNoteData* nd = &(item.second);
                 // Only increment witnesses that are behind the current height
                 if (nd->witnessHeight < pindex->nHeight) {
@@ -713,6 +1078,7 @@ void CWallet::IncrementNoteWitnesses(const CBlockIndex* pindex,
                     // Copy the witness for the previous block if we have one
                     if (nd->witnesses.size() > 0) {
                         nd->witnesses.push_front(nd->witnesses.front());
+                        vWitnessed.push_back(nd);
                     }
                     if (nd->witnesses.size() > WITNESS_CACHE_SIZE) {
                         nd->witnesses.pop_back();
@@ -731,68 +1097,86 @@ void CWallet::IncrementNoteWitnesses(const CBlockIndex* pindex,
             pblock = &block;
         }
 
+        // Walk the commitments of the block once, taking the witnesses of our new notes on the way
+        struct CNewNoteWitness {
+            CNoteData* nd;
+            JSOutPoint jsoutpt;
+            ZCIncrementalWitness witness;
+            size_t nNextCommitment;
+        };
+        std::vector<uint256> vCommitments;
+        std::vector<CNewNoteWitness> vNewWitnesses;
+        size_t nTreeSize = 0;
         for (const CTransaction& tx : pblock->vtx) {
             auto hash = tx.GetHash();
-            bool txIsOurs = mapWallet.count(hash);
+            auto itNoteTx = mapNoteTxs.find(hash);
             for (size_t i = 0; i < tx.GetVjoinsplit().size(); i++) {
                 const JSDescription& jsdesc = tx.GetVjoinsplit()[i];
                 for (uint8_t j = 0; j < jsdesc.commitments.size(); j++) {
                     const uint256& note_commitment = jsdesc.commitments[j];
-                    tree.append(note_commitment);
-
-                    // Increment existing witnesses
-                    for (auto& wtxItem : mapWallet)
-                    {
-                        for (mapNoteData_t::value_type& item : wtxItem.second->mapNoteData) {
-                            CNoteData* nd = &(item.second);
-                            if (nd->witnessHeight < pindex->nHeight &&
-                                    nd->witnesses.size() > 0) {
-                                // Check the validity of the cache
-                                // See earlier comment about validity.
-                                assert(nWitnessCacheSize >= nd->witnesses.size());
-                                nd->witnesses.front().append(note_commitment);
-                            }
-                        }
-                    }
+                    vCommitments.push_back(note_commitment);
 
                     // If this is our note, witness it
-                    if (txIsOurs) {
+                    if (itNoteTx != mapNoteTxs.end()) {
                         JSOutPoint jsoutpt {hash, i, j};
-                        if (mapWallet[hash]->mapNoteData.count(jsoutpt) &&
-                                mapWallet[hash]->mapNoteData[jsoutpt].witnessHeight < pindex->nHeight) {
-                            CNoteData* nd = &(mapWallet[hash]->mapNoteData[jsoutpt]);
-                            if (nd->witnesses.size() > 0) {
-                                // We think this can happen because we write out the
-                                // witness cache state after every block increment or
-                                // decrement, but the block index itself is written in
-                                // batches. So if the node crashes in between these two
-                                // operations, it is possible for IncrementNoteWitnesses
-                                // to be called again on previously-cached blocks. This
-                                // doesn't affect existing cached notes because of the
-                                // CNoteData::witnessHeight checks. See #1378 for details.
-                                LogPrintf("Inconsistent witness cache state found for %s\n- Cache size: %d\n- Top (height %d): %s\n- New (height %d): %s\n",
-                                          jsoutpt.ToString(), nd->witnesses.size(),
-                                          nd->witnessHeight,
-                                          nd->witnesses.front().root().GetHex(),
-                                          pindex->nHeight,
-                                          tree.witness().root().GetHex());
-                                nd->witnesses.clear();
-                            }
-                            nd->witnesses.push_front(tree.witness());
-                            // Set height to one less than pindex so it gets incremented
-                            nd->witnessHeight = pindex->nHeight - 1;
-                            // Check the validity of the cache
-                            assert(nWitnessCacheSize >= nd->witnesses.size());
+                        auto itNote = itNoteTx->second->mapNoteData.find(jsoutpt);
+                        if (itNote != itNoteTx->second->mapNoteData.end() &&
+                                itNote->second.witnessHeight < pindex->nHeight) {
+                            // the tree takes the commitments in batches, up to the one witnessed
+                            tree.append(vCommitments.begin() + nTreeSize, vCommitments.end());
+                            nTreeSize = vCommitments.size();
+                            vNewWitnesses.push_back({&itNote->second, jsoutpt, tree.witness(), vCommitments.size()});
                         }
                     }
                 }
             }
         }
 
+        tree.append(vCommitments.begin() + nTreeSize, vCommitments.end());
+
+        // Then bring each witness up to date in a single run over the commitments following it
+        auto appendCommitments = [&vCommitments](ZCIncrementalWitness& witness, size_t nFirst) {
+            witness.append(vCommitments.begin() + nFirst, vCommitments.end());
+        };
+
+        for (CNoteData* nd : vWitnessed) {
+            // Check the validity of the cache
+            // See earlier comment about validity.
+            assert(nWitnessCacheSize >= nd->witnesses.size());
+            appendCommitments(nd->witnesses.front(), 0);
+        }
+
+        for (CNewNoteWitness& newWitness : vNewWitnesses) {
+            CNoteData* nd = newWitness.nd;
+            if (nd->witnesses.size() > 0) {
+                // We think this can happen because we write out the
+                // witness cache state after every block increment or
+                // decrement, but the block index itself is written in
+                // batches. So if the node crashes in between these two
+                // operations, it is possible for IncrementNoteWitnesses
+                // to be called again on previously-cached blocks. This
+                // doesn't affect existing cached notes because of the
+                // CNoteData::witnessHeight checks. See #1378 for details.
+                LogPrintf("Inconsistent witness cache state found for %s\n- Cache size: %d\n- Top (height %d): %s\n- New (height %d): %s\n",
+                          newWitness.jsoutpt.ToString(), nd->witnesses.size(),
+                          nd->witnessHeight,
+                          nd->witnesses.front().root().GetHex(),
+                          pindex->nHeight,
+                          newWitness.witness.root().GetHex());
+                nd->witnesses.clear();
+            }
+            appendCommitments(newWitness.witness, newWitness.nNextCommitment);
+            nd->witnesses.push_front(std::move(newWitness.witness));
+            // Set height to one less than pindex so it gets incremented
+            nd->witnessHeight = pindex->nHeight - 1;
+            // Check the validity of the cache
+            assert(nWitnessCacheSize >= nd->witnesses.size());
+        }
+
         // Update witness heights
-        for (auto& wtxItem : mapWallet)
+        for (auto& noteTx : mapNoteTxs)
         {
-            for (mapNoteData_t::value_type& item : wtxItem.second->mapNoteData) {
+            for (mapNoteData_t::value_type& item : noteTx.second->mapNoteData) {
                 CNoteData* nd = &(item.second);
                 if (nd->witnessHeight < pindex->nHeight) {
                     nd->witnessHeight = pindex->nHeight;
@@ -813,9 +1197,9 @@ void CWallet::DecrementNoteWitnesses(const CBlockIndex* pindex)
 {
     {
         LOCK(cs_wallet);
-        for (auto& wtxItem : mapWallet)
+        for (auto& noteTx : mapNoteTxs)
         {
-            for (mapNoteData_t::value_type& item : wtxItem.second->mapNoteData) {
+            for (mapNoteData_t::value_type& item : noteTx.second->mapNoteData) {
                 CNoteData* nd = &(item.second);
                 // Only increment witnesses that are not above the current height
                 if (nd->witnessHeight <= pindex->nHeight) {
@@ -837,9 +1221,9 @@ void CWallet::DecrementNoteWitnesses(const CBlockIndex* pindex)
             }
         }
         nWitnessCacheSize -= 1;
-        for (auto& wtxItem : mapWallet)
+        for (auto& noteTx : mapNoteTxs)
         {
-            for (mapNoteData_t::value_type& item : wtxItem.second->mapNoteData) {
+            for (mapNoteData_t::value_type& item : noteTx.second->mapNoteData) {
                 CNoteData* nd = &(item.second);
                 // Check the validity of the cache
                 // Technically if there are notes witnessed above the current
@@ -985,11 +1369,24 @@ vTxWithInputs CWallet::OrderedTxWithInputs(const std::string& address) const
 
     const CScript& scriptPubKey = GetScriptForDestination(taddr.Get(), false);
 
-    // tx are ordered in this map, from the oldest to the newest. As a consequence, the returned vector is ordered 
+    auto itIndex = mapTxsByDestination.find(taddr.Get());
+    if (itIndex == mapTxsByDestination.end())
+        return vOrderedTxes;
+
+    // only the txes indexed for this destination are candidates; they are sorted by nOrderPos, from the
+    // oldest to the newest, as wtxOrdered would have them. As a consequence, the returned vector is ordered
     // as well
-    for (auto it : wtxOrdered)
+    std::multimap<int64_t, CWalletTransactionBase*> candidates;
+    for (const uint256& hash : itIndex->second)
     {
-        CWalletTransactionBase* wtx = it.second.first;
+        auto mi = mapWallet.find(hash);
+        if (mi != mapWallet.end())
+            candidates.insert(std::make_pair(mi->second->nOrderPos, mi->second.get()));
+    }
+
+    for (auto it : candidates)
+    {
+        CWalletTransactionBase* wtx = it.second;
         int64_t orderPos = it.first;
 
         LogPrintf("%s():%d - processing ordered tx: nOrderPos[%d]: tx[%s]\n", __func__, __LINE__,
@@ -1094,6 +1491,9 @@ bool CWallet::AddToWallet(const CWalletTransactionBase& wtxIn, bool fFromLoadWal
         wtxOrdered.insert(make_pair(wtx.nOrderPos, TxPair(&wtx, (CAccountingEntry*)0)));
         UpdateNullifierNoteMapWithTx(*(mapWallet[hash]));
         AddToSpends(hash);
+        IndexWalletTx(wtx);
+        IndexTxHeight(wtx);
+        IndexNotes(wtx);
     }
     else
     {
@@ -1156,7 +1556,10 @@ bool CWallet::AddToWallet(const CWalletTransactionBase& wtxIn, bool fFromLoadWal
                              wtxIn.hashBlock.ToString());
             }
             AddToSpends(hash);
+            IndexTxHeight(wtx);
         }
+        // Also for updates: a spender leaving the chain makes its inputs unspent again
+        IndexWalletTx(wtx);
 
         bool fUpdated = false;
         if (!fInsertedNew)
@@ -1165,6 +1568,7 @@ bool CWallet::AddToWallet(const CWalletTransactionBase& wtxIn, bool fFromLoadWal
             if (!wtxIn.hashBlock.IsNull() && wtxIn.hashBlock != wtx.hashBlock)
             {
                 wtx.hashBlock = wtxIn.hashBlock;
+                IndexTxHeight(wtx);
                 fUpdated = true;
             }
             if (wtxIn.nIndex != -1 && (wtxIn.vMerkleBranch != wtx.vMerkleBranch || wtxIn.nIndex != wtx.nIndex))
@@ -1189,6 +1593,7 @@ bool CWallet::AddToWallet(const CWalletTransactionBase& wtxIn, bool fFromLoadWal
 
             wtx.bwtMaturityDepth = wtxIn.bwtMaturityDepth;
         }
+        IndexNotes(wtx);
 
         //// debug print
         LogPrintf("AddToWallet %s  %s%s\n", wtxIn.getTxBase()->GetHash().ToString(), (fInsertedNew ? "new" : ""), (fUpdated ? "update" : ""));
@@ -1248,13 +1653,16 @@ bool CWallet::UpdatedNoteData(const CWalletTransactionBase& wtxIn, CWalletTransa
  * data is _not_ updated; instead, the transaction being in the mempool or conflicted is
  * determined on the fly in CMerkleTx::GetDepthInMainChain().
  */
-bool CWallet::AddToWalletIfInvolvingMe(const CTransactionBase& obj, const CBlock* pblock, int bwtMaturityDepth, bool fUpdate)
+bool CWallet::AddToWalletIfInvolvingMe(const CTransactionBase& obj, const CBlock* pblock, int bwtMaturityDepth, bool fUpdate,
+                                       const mapNoteData_t* pNoteData)
 {
     {
         AssertLockHeld(cs_wallet);
         bool fExisted = mapWallet.count(obj.GetHash()) != 0;
         if (fExisted && !fUpdate) return false;
-        auto noteData = FindMyNotes(obj);
+        if (!fExisted && !MayInvolveMe(obj, pNoteData)) return false;
+        // Callers that already trial-decrypted the notes (e.g. a rescan) hand the result in
+        auto noteData = pNoteData ? *pNoteData : FindMyNotes(obj);
         try
         {
             if (fExisted || IsMine(obj) || IsFromMe(obj) || noteData.size() > 0)
@@ -1275,9 +1683,8 @@ bool CWallet::AddToWalletIfInvolvingMe(const CTransactionBase& obj, const CBlock
  
                 // Do not flush the wallet here for performance reasons
                 // this is safe, as in case of a crash, we rescan the necessary blocks on startup through our SetBestChain-mechanism
-                CWalletDB walletdb(strWalletFile, "r+", false);
-
-                return AddToWallet(*sobj, false, &walletdb);
+                std::unique_ptr<CWalletDB> pwalletdbNew;
+                return AddToWallet(*sobj, false, &GetSyncWalletDB(pwalletdbNew));
             }
         }
         catch (const std::exception &exc)
@@ -1292,6 +1699,57 @@ bool CWallet::AddToWalletIfInvolvingMe(const CTransactionBase& obj, const CBlock
     return false;
 }
 
+void CWallet::UpdateIsMineFilter() const
+{
+    AssertLockHeld(cs_wallet);
+    LOCK(cs_KeyStore);
+    if (nIsMineFilterGeneration == nKeyStoreGeneration)
+        return;
+
+    isMineFilter.Clear();
+    std::set<CKeyID> setKeys;
+    GetKeys(setKeys);
+    for (const CKeyID& keyID : setKeys)
+        isMineFilter.AddKey(keyID);
+    for (const auto& item : mapScripts)
+        isMineFilter.AddScript(item.first);
+    for (const CScript& script : setWatchOnly)
+        isMineFilter.AddWatchOnly(script);
+    nIsMineFilterGeneration = nKeyStoreGeneration;
+}
+
+bool CWallet::MayInvolveMe(const CTransactionBase& obj, const mapNoteData_t* pNoteData) const
+{
+    AssertLockHeld(cs_wallet);
+    UpdateIsMineFilter();
+    for (const CTxOut& txout : obj.GetVout()) {
+        if (isMineFilter.MayBeMine(txout.scriptPubKey))
+            return true;
+    }
+    // IsFromMe only finds debits on the outputs of wallet transactions
+    for (const CTxIn& txin : obj.GetVin()) {
+        if (mapWallet.count(txin.prevout.hash))
+            return true;
+    }
+    if (!obj.GetVjoinsplit().empty()) {
+        if (pNoteData) {
+            if (!pNoteData->empty())
+                return true;
+        } else {
+            LOCK(cs_SpendingKeyStore);
+            if (!mapNoteDecryptors.empty())
+                return true;
+        }
+        for (const JSDescription& jsdesc : obj.GetVjoinsplit()) {
+            for (const uint256& nullifier : jsdesc.nullifiers) {
+                if (mapNullifiersToNotes.count(nullifier))
+                    return true;
+            }
+        }
+    }
+    return false;
+}
+
 void CWallet::SyncTransaction(const CTransaction& tx, const CBlock* pblock)
 {
     LOCK(cs_wallet);
@@ -1317,7 +1775,8 @@ void CWallet::SyncCertStatusInfo(const CScCertificateStatusUpdateInfo& certStatu
     LogPrint("cert", "%s():%d - Called for cert[%s], bwtAreStripped[%d]\n",
         __func__, __LINE__, certStatusInfo.certHash.ToString(), certStatusInfo.bwtState == CScCertificateStatusUpdateInfo::BwtState::BWT_OFF);
 
-    CWalletDB walletdb(strWalletFile, "r+", false);
+    std::unique_ptr<CWalletDB> pwalletdbNew;
+    CWalletDB& walletdb = GetSyncWalletDB(pwalletdbNew);
 
     // Update sidechain state with top quality certs only, i.e. cert whose bwts are not voided
     if (certStatusInfo.bwtState == CScCertificateStatusUpdateInfo::BwtState::BWT_ON)
@@ -1355,8 +1814,9 @@ bool CWallet::ReadSidechain(const uint256& scId, CScCertificateStatusUpdateInfo&
         sidechain = mapSidechains.at(scId);
         res = true;
     } else {
-        CWalletDB walletdb(strWalletFile, "r+", false);
-        res = walletdb.ReadSidechain(scId, sidechain);
+        LOCK(cs_wallet);
+        std::unique_ptr<CWalletDB> pwalletdbNew;
+        res = GetSyncWalletDB(pwalletdbNew).ReadSidechain(scId, sidechain);
         if (res) mapSidechains[scId] = sidechain;
     }
     return res;
@@ -1391,8 +1851,15 @@ void CWallet::EraseFromWallet(const uint256 &hash)
         LOCK(cs_wallet);
         LogPrint("cert", "%s():%d - called for obj[%s]\n", __func__, __LINE__, hash.ToString());
 
-        if (mapWallet.erase(hash))
+        auto mi = mapWallet.find(hash);
+        if (mi != mapWallet.end())
+        {
+            UnindexWalletTx(*mi->second);
+            UnindexTxHeight(hash);
+            mapWallet.erase(mi);
+            MarkBalancesDirty();
             CWalletDB(strWalletFile).EraseWalletTxBase(hash);
+        }
     }
     return;
 }
@@ -1443,13 +1910,23 @@ std::optional<uint256> CWallet::GetNoteNullifier(const JSDescription& jsdesc,
 mapNoteData_t CWallet::FindMyNotes(const CTransactionBase& tx) const
 {
     LOCK(cs_SpendingKeyStore);
+    return FindMyNotes(tx, mapNoteDecryptors);
+}
+
+/**
+ * As above, but trial-decrypts against the given decryptors instead of the
+ * wallet's own map, so that several threads can work on a private copy
+ * without holding cs_SpendingKeyStore for the whole trial decryption.
+ */
+mapNoteData_t CWallet::FindMyNotes(const CTransactionBase& tx, const NoteDecryptorMap& decryptors) const
+{
     uint256 hash = tx.GetHash();
 
     mapNoteData_t noteData;
     for (size_t i = 0; i < tx.GetVjoinsplit().size(); i++) {
         auto hSig = tx.GetVjoinsplit()[i].h_sig(*pzcashParams, tx.GetJoinSplitPubKey());
         for (uint8_t j = 0; j < tx.GetVjoinsplit()[i].ciphertexts.size(); j++) {
-            for (const NoteDecryptorMap::value_type& item : mapNoteDecryptors) {
+            for (const NoteDecryptorMap::value_type& item : decryptors) {
                 try {
                     auto address = item.first;
                     JSOutPoint jsoutpt {hash, i, j};
@@ -1888,11 +2365,11 @@ void CWalletTransactionBase::GetMatureAmountsForAccount(const string& strAccount
 {
     nReceived = nSent = nFee = 0;
 
-    CAmount allFee;
-    string strSentAccount;
-    list<COutputEntry> listReceived;
-    list<COutputEntry> listSent;
-    GetAmounts(listReceived, listSent, allFee, strSentAccount, filter);
+    const CAmountsBreakdown& amounts = GetCachedAmounts(filter);
+    const CAmount allFee = amounts.nFee;
+    const string& strSentAccount = amounts.strSentAccount;
+    const list<COutputEntry>& listReceived = amounts.listReceived;
+    const list<COutputEntry>& listSent = amounts.listSent;
 
     if (strAccount == strSentAccount) {
         for(const COutputEntry& s: listSent)
@@ -1979,6 +2456,13 @@ void CWallet::WitnessNoteCommitment(std::vector<uint256> commitments,
     }
 }
 
+static CBlock ReadRescanBlock(CBlockIndex* pindex)
+{
+    CBlock block;
+    ReadBlockFromDisk(block, pindex);
+    return block;
+}
+
 /**
  * Scan the block chain (starting in pindexStart) for transactions
  * from or to us. If fUpdate is true, found transactions that already
@@ -2001,6 +2485,22 @@ int CWallet::ScanForWalletTransactions(CBlockIndex* pindexStart, bool fUpdate)
             pindex = chainActive.Next(pindex);
 
         ShowProgress(_("Rescanning..."), 0); // show rescan progress in GUI as dialog or on splashscreen, if -rescan on startup
+
+        // Trial decryption of the JoinSplit outputs dominates a rescan on wallets holding many
+        // z-keys, so it is spread over several threads working on a copy of the decryptors.
+        // Wallet updates and witness increments are then applied in block order on this thread.
+        NoteDecryptorMap decryptors;
+        {
+            LOCK(cs_SpendingKeyStore);
+            decryptors = mapNoteDecryptors;
+        }
+        const int nDecryptThreads = decryptors.empty() ? 1 : std::max(1, GetNumCores());
+
+        // The next block is read from disk while the current one is being processed
+        std::future<CBlock> nextBlock;
+        if (pindex)
+            nextBlock = std::async(std::launch::async, ReadRescanBlock, pindex);
+
         double dProgressStart = Checkpoints::GuessVerificationProgress(chainParams.Checkpoints(), pindex, false);
         double dProgressTip = Checkpoints::GuessVerificationProgress(chainParams.Checkpoints(), chainActive.Tip(), false);
         while (pindex)
@@ -2008,12 +2508,50 @@ int CWallet::ScanForWalletTransactions(CBlockIndex* pindexStart, bool fUpdate)
             if (pindex->nHeight % 100 == 0 && dProgressTip - dProgressStart > 0.0)
                 ShowProgress(_("Rescanning..."), std::max(1, std::min(99, (int)((Checkpoints::GuessVerificationProgress(chainParams.Checkpoints(), pindex, false) - dProgressStart) / (dProgressTip - dProgressStart) * 100))));
 
-            CBlock block;
-            ReadBlockFromDisk(block, pindex);
-  
+            CBlock block = nextBlock.get();
+            if (CBlockIndex* pindexNext = chainActive.Next(pindex))
+                nextBlock = std::async(std::launch::async, ReadRescanBlock, pindexNext);
+
+            // Only transactions which AddToWalletIfInvolvingMe() would look at need decrypting
+            std::vector<const CTransaction*> vToDecrypt;
             for(const CTransaction& tx: block.vtx)
             {
-                if (AddToWalletIfInvolvingMe(tx, &block, -1, fUpdate))
+                if (!tx.GetVjoinsplit().empty() && !decryptors.empty() &&
+                    (fUpdate || mapWallet.count(tx.GetHash()) == 0))
+                    vToDecrypt.push_back(&tx);
+            }
+
+            std::map<uint256, mapNoteData_t> mapBlockNoteData;
+            if (!vToDecrypt.empty())
+            {
+                std::vector<mapNoteData_t> vNoteData(vToDecrypt.size());
+                const int nThreads = std::min<int>(nDecryptThreads, vToDecrypt.size());
+                auto worker = [&](int nWorker) {
+                    for (size_t i = nWorker; i < vToDecrypt.size(); i += nThreads)
+                        vNoteData[i] = FindMyNotes(*vToDecrypt[i], decryptors);
+                };
+                std::vector<std::future<void>> vWorkers;
+                for (int n = 1; n < nThreads; n++)
+                    vWorkers.push_back(std::async(std::launch::async, worker, n));
+                worker(0);
+                for (auto& f: vWorkers)
+                    f.get();
+
+                for (size_t i = 0; i < vToDecrypt.size(); i++)
+                    mapBlockNoteData[vToDecrypt[i]->GetHash()] = std::move(vNoteData[i]);
+            }
+
+            for(const CTransaction& tx: block.vtx)
+            {
+                // Transactions without joinsplits carry no notes, so skip FindMyNotes for them too
+                static const mapNoteData_t noNotes;
+                const mapNoteData_t* pNoteData = &noNotes;
+                if (!tx.GetVjoinsplit().empty())
+                {
+                    auto it = mapBlockNoteData.find(tx.GetHash());
+                    pNoteData = (it != mapBlockNoteData.end()) ? &it->second : nullptr;
+                }
+                if (AddToWalletIfInvolvingMe(tx, &block, -1, fUpdate, pNoteData))
                     ret++;
             }
 
@@ -2464,6 +3002,8 @@ CAmount CWalletTransactionBase::GetAvailableWatchOnlyCredit(const bool& fUseCach
 
 void CWalletTransactionBase::MarkDirty()
 {
+    if (pwallet)
+        pwallet->MarkBalancesDirty();
     fCreditCached = false;
     fAvailableCreditCached = false;
     fWatchDebitCached = false;
@@ -2472,6 +3012,21 @@ void CWalletTransactionBase::MarkDirty()
     fImmatureWatchCreditCached = false;
     fDebitCached = false;
     fChangeCached = false;
+    mapAmountsCached.clear();
+}
+
+const CAmountsBreakdown& CWalletTransactionBase::GetCachedAmounts(const isminefilter& filter) const
+{
+    const CAmountsStamp stamp = pwallet->GetAmountsStamp();
+    auto it = mapAmountsCached.find(filter);
+    if (it != mapAmountsCached.end() && it->second.first == stamp)
+        return it->second.second;
+
+    std::pair<CAmountsStamp, CAmountsBreakdown>& cached = mapAmountsCached[filter];
+    CAmountsBreakdown& amounts = cached.second;
+    GetAmounts(amounts.listReceived, amounts.listSent, amounts.nFee, amounts.strSentAccount, filter);
+    cached.first = stamp;
+    return amounts;
 }
 
 void CWalletTransactionBase::Reset(const CWallet* pwalletIn)
@@ -2592,7 +3147,7 @@ void CWallet::ResendWalletTransactions(int64_t nBestBlockTime)
     if (GetTime() < nNextResend || !fBroadcastTransactions)
         return;
     bool fFirst = (nNextResend == 0);
-    nNextResend = GetTime() + GetRand(30 * 60);
+    nNextResend = GetTime() + GetFastRand(30 * 60);
     if (fFirst)
         return;
 
@@ -2624,12 +3179,15 @@ CAmount CWallet::GetBalance() const
     CAmount nTotal = 0;
     {
         LOCK2(cs_main, cs_wallet);
-        for (MAP_WALLET_CONST_IT it = mapWallet.begin(); it != mapWallet.end(); ++it)
+        if (GetCachedBalance("balance", nTotal))
+            return nTotal;
+
+        for (const CWalletTransactionBase* pcoin : GetUnspentWalletTxs())
         {
-            const CWalletTransactionBase* pcoin = it->second.get();
             if (pcoin->IsTrusted())
                 nTotal += pcoin->GetAvailableCredit();
         }
+        SetCachedBalance("balance", nTotal);
     }
 
     return nTotal;
@@ -2640,12 +3198,15 @@ CAmount CWallet::GetUnconfirmedBalance() const
     CAmount nTotal = 0;
     {
         LOCK2(cs_main, cs_wallet);
-        for (MAP_WALLET_CONST_IT it = mapWallet.begin(); it != mapWallet.end(); ++it)
+        if (GetCachedBalance("unconfirmed", nTotal))
+            return nTotal;
+
+        for (const CWalletTransactionBase* pcoin : GetUnspentWalletTxs())
         {
-            const CWalletTransactionBase* pcoin = it->second.get();
             if (!CheckFinalTx(*pcoin->getTxBase()) || (!pcoin->IsTrusted() && pcoin->GetDepthInMainChain() == 0))
                 nTotal += pcoin->GetAvailableCredit();
         }
+        SetCachedBalance("unconfirmed", nTotal);
     }
     return nTotal;
 }
@@ -2795,8 +3356,12 @@ CAmount CWallet::GetImmatureBalance() const
     CAmount nTotal = 0;
     {
         LOCK2(cs_main, cs_wallet);
-        for (MAP_WALLET_CONST_IT it = mapWallet.begin(); it != mapWallet.end(); ++it)
-            nTotal += it->second.get()->GetImmatureCredit();
+        if (GetCachedBalance("immature", nTotal))
+            return nTotal;
+
+        for (const CWalletTransactionBase* pcoin : GetUnspentWalletTxs())
+            nTotal += pcoin->GetImmatureCredit();
+        SetCachedBalance("immature", nTotal);
 
     }
     return nTotal;
@@ -2807,9 +3372,8 @@ CAmount CWallet::GetWatchOnlyBalance() const
     CAmount nTotal = 0;
     {
         LOCK2(cs_main, cs_wallet);
-        for (MAP_WALLET_CONST_IT it = mapWallet.begin(); it != mapWallet.end(); ++it)
+        for (const CWalletTransactionBase* pcoin : GetUnspentWalletTxs())
         {
-            const CWalletTransactionBase* pcoin = it->second.get();
             if (pcoin->IsTrusted())
                 nTotal += pcoin->GetAvailableWatchOnlyCredit();
         }
@@ -2823,9 +3387,8 @@ CAmount CWallet::GetUnconfirmedWatchOnlyBalance() const
     CAmount nTotal = 0;
     {
         LOCK2(cs_main, cs_wallet);
-        for (MAP_WALLET_CONST_IT it = mapWallet.begin(); it != mapWallet.end(); ++it)
+        for (const CWalletTransactionBase* pcoin : GetUnspentWalletTxs())
         {
-            const CWalletTransactionBase* pcoin = it->second.get();
             if (!CheckFinalTx(*pcoin->getTxBase()) || (!pcoin->IsTrusted() && pcoin->GetDepthInMainChain() == 0))
                 nTotal += pcoin->GetAvailableWatchOnlyCredit();
         }
@@ -2838,9 +3401,8 @@ CAmount CWallet::GetImmatureWatchOnlyBalance() const
     CAmount nTotal = 0;
     {
         LOCK2(cs_main, cs_wallet);
-        for (MAP_WALLET_CONST_IT it = mapWallet.begin(); it != mapWallet.end(); ++it)
+        for (const CWalletTransactionBase* pcoin : GetUnspentWalletTxs())
         {
-            const CWalletTransactionBase* pcoin = it->second.get();
             nTotal += pcoin->GetImmatureWatchOnlyCredit();
         }
     }
@@ -2856,10 +3418,9 @@ void CWallet::AvailableCoins(vector<COutput>& vCoins, bool fOnlyConfirmed, const
 
     {
         LOCK2(cs_main, cs_wallet);
-        for (MAP_WALLET_CONST_IT it = mapWallet.begin(); it != mapWallet.end(); ++it)
+        for (const CWalletTransactionBase* pcoin : GetUnspentWalletTxs())
         {
-            const uint256& wtxid = it->first;
-            const CWalletTransactionBase* pcoin = (*it).second.get();
+            const uint256& wtxid = pcoin->getTxBase()->GetHash();
             if (!CheckFinalTx(*pcoin->getTxBase()))
                 continue;
 
@@ -2876,10 +3437,10 @@ void CWallet::AvailableCoins(vector<COutput>& vCoins, bool fOnlyConfirmed, const
                 isminetype mine = IsMine(pcoin->getTxBase()->GetVout()[voutPos]);
                 if (!IsSpent(wtxid, voutPos) &&
                      mine != ISMINE_NO &&
-                    !IsLockedCoin((*it).first, voutPos) &&
+                    !IsLockedCoin(wtxid, voutPos) &&
                     (pcoin->getTxBase()->GetVout()[voutPos].nValue > 0 || fIncludeZeroValue) &&
                     (!coinControl || !coinControl->HasSelected() ||
-                      coinControl->fAllowOtherInputs || coinControl->IsSelected((*it).first, voutPos)
+                      coinControl->fAllowOtherInputs || coinControl->IsSelected(wtxid, voutPos)
                     ))
                 {
                     if (pcoin->getTxBase()->IsCoinBase()) {
@@ -2909,6 +3470,60 @@ void CWallet::AvailableCoins(vector<COutput>& vCoins, bool fOnlyConfirmed, const
     }
 }
 
+/**
+ * Depth first branch and bound search for a subset of vValue summing exactly to nTargetValue,
+ * so that no change output is needed. vValue must be sorted by decreasing value; nTotalLower is
+ * the sum of all of it. Gives up after nMaxTries visited nodes.
+ */
+static bool SelectCoinsBnB(
+    const vector<pair<CAmount, pair<const CWalletTransactionBase*,unsigned int> > >& vValue, const CAmount& nTotalLower,
+    const CAmount& nTargetValue, vector<char>& vfSelected, int nMaxTries = COIN_SELECTION_BNB_MAX_TRIES)
+{
+    const size_t nCoins = vValue.size();
+    vfSelected.assign(nCoins, false);
+
+    // value still available from coin i onwards
+    vector<CAmount> vRemaining(nCoins + 1, 0);
+    vRemaining[0] = nTotalLower;
+    for (size_t i = 0; i < nCoins; i++)
+        vRemaining[i + 1] = vRemaining[i] - vValue[i].first;
+
+    CAmount nSelected = 0;
+    size_t i = 0;
+    for (int nTries = 0; nTries < nMaxTries; nTries++)
+    {
+        if (nSelected == nTargetValue)
+            return true;
+
+        bool fBacktrack = nSelected > nTargetValue || nSelected + vRemaining[i] < nTargetValue;
+        if (!fBacktrack)
+        {
+            // including a coin worth the same as an excluded predecessor repeats an explored branch
+            if (i > 0 && !vfSelected[i - 1] && vValue[i].first == vValue[i - 1].first) {
+                i++;
+            } else {
+                vfSelected[i] = true;
+                nSelected += vValue[i].first;
+                i++;
+            }
+            continue;
+        }
+
+        // undo the last inclusion and try the branch without it
+        size_t j = i;
+        while (j > 0 && !vfSelected[j - 1])
+            j--;
+        if (j == 0)
+            return false;
+        vfSelected[j - 1] = false;
+        nSelected -= vValue[j - 1].first;
+        i = j;
+    }
+
+    LogPrint("selectcoins", "SelectCoinsBnB(): search budget of %d exhausted\n", nMaxTries);
+    return false;
+}
+
 static void ApproximateBestSubset(
     vector<pair<CAmount, pair<const CWalletTransactionBase*,unsigned int> > >vValue, const CAmount& nTotalLower, const CAmount& nTargetValue,
     vector<char>& vfBest, CAmount& nBest, int iterations = 1000)
@@ -2918,7 +3533,7 @@ static void ApproximateBestSubset(
     vfBest.assign(vValue.size(), true);
     nBest = nTotalLower;
 
-    seed_insecure_rand();
+    FastRandomContext& insecureRand = GetFastRandomContext();
 
     for (int nRep = 0; nRep < iterations && nBest != nTargetValue; nRep++)
     {
@@ -2935,7 +3550,7 @@ static void ApproximateBestSubset(
                 //that the rng is fast. We do not use a constant random sequence,
                 //because there may be some privacy improvement by making
                 //the selection random.
-                if (nPass == 0 ? insecure_rand()&1 : !vfIncluded[i])
+                if (nPass == 0 ? insecureRand.randbool() : !vfIncluded[i])
                 {
                     nTotal += vValue[i].first;
                     vfIncluded[i] = true;
@@ -2969,7 +3584,7 @@ bool CWallet::SelectCoinsMinConf(const CAmount& nTargetValue, int nConfMine, int
     vector<pair<CAmount, pair<const CWalletTransactionBase*,unsigned int> > > vValue;
     CAmount nTotalLower = 0;
 
-    std::shuffle(vCoins.begin(), vCoins.end(), ZcashRandomEngine());
+    std::shuffle(vCoins.begin(), vCoins.end(), GetFastRandomContext());
 
     BOOST_FOREACH(const COutput &output, vCoins)
     {
@@ -3026,9 +3641,17 @@ bool CWallet::SelectCoinsMinConf(const CAmount& nTargetValue, int nConfMine, int
     vector<char> vfBest;
     CAmount nBest;
 
-    ApproximateBestSubset(vValue, nTotalLower, nTargetValue, vfBest, nBest, 1000);
-    if (nBest != nTargetValue && nTotalLower >= nTargetValue + CENT)
-        ApproximateBestSubset(vValue, nTotalLower, nTargetValue + CENT, vfBest, nBest, 1000);
+    // An exact subset needs no change; look for one deterministically before approximating
+    if (SelectCoinsBnB(vValue, nTotalLower, nTargetValue, vfBest))
+    {
+        nBest = nTargetValue;
+    }
+    else
+    {
+        ApproximateBestSubset(vValue, nTotalLower, nTargetValue, vfBest, nBest, 1000);
+        if (nBest != nTargetValue && nTotalLower >= nTargetValue + CENT)
+            ApproximateBestSubset(vValue, nTotalLower, nTargetValue + CENT, vfBest, nBest, 1000);
+    }
 
     // If we have a bigger coin and (either the stochastic approximation didn't find a good solution,
     //                                   or the next bigger coin is closer), return the bigger coin
@@ -3063,8 +3686,19 @@ bool CWallet::SelectCoins(const CAmount& nTargetValue, set<pair<const CWalletTra
     const bool fIncludeCommunityFund = ForkManager::getInstance().canSendCommunityFundsToTransparentAddress(chainActive.Height() + 1);
 
     vector<COutput> vCoinsWithoutCoinbase, vCoinsWithCoinbaseAndCommunityFund;
-    AvailableCoins(vCoinsWithoutCoinbase, true, coinControl, false, false, fIncludeCommunityFund);
     AvailableCoins(vCoinsWithCoinbaseAndCommunityFund, true, coinControl, false, true, true);
+
+    // Derive the coins AvailableCoins(..., false, fIncludeCommunityFund) would return, rather than walking the wallet twice
+    for (const COutput& out : vCoinsWithCoinbaseAndCommunityFund) {
+        if (out.tx->getTxBase()->IsCoinBase()) {
+            if (!fIncludeCommunityFund)
+                continue;
+            const CCoins *coins = pcoinsTip->AccessCoins(out.tx->getTxBase()->GetHash());
+            if (!coins || !IsCommunityFund(coins, out.pos))
+                continue;
+        }
+        vCoinsWithoutCoinbase.push_back(out);
+    }
     // Output parameter fOnlyCoinbaseCoinsRet is set to true when the only available coins are coinbase utxos.
     fOnlyCoinbaseCoinsRet = vCoinsWithoutCoinbase.size() == 0 && vCoinsWithCoinbaseAndCommunityFund.size() > 0;
 
@@ -3499,45 +4133,54 @@ bool CWallet::CreateTransaction(
                     }
                 }
 
-                // Sign
-                int nIn = 0;
+                // Sign: the inputs are signed in parallel against the same snapshot of txNew, whose
+                // input scripts are blanked out of the signature hashes anyway
                 CTransaction txNewConst(txNew);
+                std::vector<CScript> vScriptPubKeys;
                 for (const auto& coin : setCoins)
-                {
+                    vScriptPubKeys.push_back(coin.first->getTxBase()->GetVout()[coin.second].scriptPubKey);
+                for (auto& cswIn: txNewConst.GetVcswCcIn())
+                    vScriptPubKeys.push_back(cswIn.scriptPubKey());
+
+                std::unique_ptr<CPrecomputedSigHash> precomputed;
+                if (sign)
+                    precomputed.reset(new CPrecomputedSigHash(txNewConst));
+                std::atomic<bool> fSignFailed{false};
+                auto signInput = [&](unsigned int nIn) {
+                    CScript& scriptSigRes = nIn < txNew.vin.size() ? txNew.vin[nIn].scriptSig : txNew.vcsw_ccin[nIn - txNew.vin.size()].redeemScript;
                     bool signSuccess;
-                    const CScript& scriptPubKey = coin.first->getTxBase()->GetVout()[coin.second].scriptPubKey;
-                    CScript& scriptSigRes = txNew.vin[nIn].scriptSig;
                     if (sign)
-                        signSuccess = ProduceSignature(TransactionSignatureCreator(*this, txNewConst, nIn, SIGHASH_ALL), scriptPubKey, scriptSigRes);
+                        signSuccess = ProduceSignature(TransactionSignatureCreator(*this, txNewConst, nIn, SIGHASH_ALL, precomputed.get()), vScriptPubKeys[nIn], scriptSigRes);
                     else
-                        signSuccess = ProduceSignature(DummySignatureCreator(*this), scriptPubKey, scriptSigRes);
-
+                        signSuccess = ProduceSignature(DummySignatureCreator(*this), vScriptPubKeys[nIn], scriptSigRes);
                     if (!signSuccess)
-                    {
-                        strFailReason = _("Signing transaction failed");
-                        return false;
-                    }
-                    nIn++;
-                }
+                        fSignFailed = true;
+                };
 
-                for (auto& cswIn: txNewConst.GetVcswCcIn())
+                const int nThreads = sign ? std::min<int>(std::max(1, nScriptCheckThreads), vScriptPubKeys.size() / SIGN_PARALLEL_MIN_INPUTS) : 1;
+                if (nThreads > 1)
                 {
-                    bool signSuccess;
-                    const CScript& scriptPubKey = cswIn.scriptPubKey();
- 
-                    CScript& scriptSigRes = txNew.vcsw_ccin.at(nIn - setCoins.size()).redeemScript;
-
-                    if (sign)
-                        signSuccess = ProduceSignature(TransactionSignatureCreator(*this, txNewConst, nIn, SIGHASH_ALL), scriptPubKey, scriptSigRes);
-                    else
-                        signSuccess = ProduceSignature(DummySignatureCreator(*this), scriptPubKey, scriptSigRes);
+                    auto worker = [&](int nWorker) {
+                        for (size_t nIn = nWorker; nIn < vScriptPubKeys.size() && !fSignFailed; nIn += nThreads)
+                            signInput(nIn);
+                    };
+                    std::vector<std::future<void>> vWorkers;
+                    for (int n = 1; n < nThreads; n++)
+                        vWorkers.push_back(std::async(std::launch::async, worker, n));
+                    worker(0);
+                    for (auto& f: vWorkers)
+                        f.get();
+                }
+                else
+                {
+                    for (size_t nIn = 0; nIn < vScriptPubKeys.size() && !fSignFailed; nIn++)
+                        signInput(nIn);
+                }
 
-                    if (!signSuccess)
-                    {
-                        strFailReason = _("Signing transaction failed");
-                        return false;
-                    }
-                    nIn++;
+                if (fSignFailed)
+                {
+                    strFailReason = _("Signing transaction failed");
+                    return false;
                 }
 
                 unsigned int nBytes = ::GetSerializeSize(txNew, SER_NETWORK, PROTOCOL_VERSION);
@@ -3751,6 +4394,8 @@ bool CWallet::SetAddressBook(const CTxDestination& address, const string& strNam
         mapAddressBook[address].name = strName;
         if (!strPurpose.empty()) /* update purpose only if requested */
             mapAddressBook[address].purpose = strPurpose;
+        // account balances depend on the labels
+        MarkBalancesDirty();
     }
     NotifyAddressBookChanged(this, address, strName, ::IsMine(*this, address) != ISMINE_NO,
                              strPurpose, (fUpdated ? CT_UPDATED : CT_NEW) );
@@ -3776,6 +4421,7 @@ bool CWallet::DelAddressBook(const CTxDestination& address)
             }
         }
         mapAddressBook.erase(address);
+        MarkBalancesDirty();
     }
 
     NotifyAddressBookChanged(this, address, "", ::IsMine(*this, address) != ISMINE_NO, "", CT_DELETED);
@@ -3813,7 +4459,7 @@ bool CWallet::NewKeyPool()
         if (IsLocked())
             return false;
 
-        int64_t nKeys = max(GetArg("-keypool", 100), (int64_t)0);
+        int64_t nKeys = max(GetArg("-keypool", DEFAULT_KEYPOOL_SIZE), (int64_t)0);
         for (int i = 0; i < nKeys; i++)
         {
             int64_t nIndex = i+1;
@@ -3825,35 +4471,98 @@ bool CWallet::NewKeyPool()
     return true;
 }
 
+static unsigned int GetKeyPoolTargetSize(unsigned int kpSize)
+{
+    if (kpSize > 0)
+        return kpSize;
+    return max(GetArg("-keypool", DEFAULT_KEYPOOL_SIZE), (int64_t) 0);
+}
+
+//! The keypool size below which ThreadTopUpKeyPool refills it, half of -keypool by default
+static unsigned int GetKeyPoolMinSize()
+{
+    return max(GetArg("-keypoolmin", GetKeyPoolTargetSize(0) / 2), (int64_t) 0);
+}
+
 bool CWallet::TopUpKeyPool(unsigned int kpSize)
 {
+    const unsigned int nTargetSize = GetKeyPoolTargetSize(kpSize);
+    while (true)
     {
-        LOCK(cs_wallet);
+        unsigned int nMissing;
+        bool fCompressed;
+        {
+            LOCK(cs_wallet);
+            if (IsLocked())
+                return false;
+            if (setKeyPool.size() >= nTargetSize + 1)
+                return true;
+            nMissing = min<size_t>(nTargetSize + 1 - setKeyPool.size(), KEYPOOL_TOPUP_BATCH_SIZE);
+            fCompressed = CanSupportFeature(FEATURE_COMPRPUBKEY); // default to compressed public keys if we want 0.6.0 wallets
+        }
+
+        // The elliptic curve work, the bulk of the cost, needs no lock
+        std::vector<std::pair<CKey, CPubKey>> vKeys(nMissing);
+        for (std::pair<CKey, CPubKey>& key : vKeys)
+        {
+            key.first.MakeNewKey(fCompressed);
+            key.second = key.first.GetPubKey();
+            assert(key.first.VerifyPubKey(key.second));
+        }
 
+        LOCK(cs_wallet);
         if (IsLocked())
             return false;
 
-        CWalletDB walletdb(strWalletFile);
-
-        // Top up key pool
-        unsigned int nTargetSize;
-        if (kpSize > 0)
-            nTargetSize = kpSize;
-        else
-            nTargetSize = max(GetArg("-keypool", 100), (int64_t) 0);
-
-        while (setKeyPool.size() < (nTargetSize + 1))
+        std::unique_ptr<CWalletDB> pwalletdbNew;
+        CWalletDB& walletdb = GetSyncWalletDB(pwalletdbNew);
+        // the writes of a block being synced are in its transaction already
+        if (pwalletdbNew && !walletdb.TxnBegin())
+            throw runtime_error("TopUpKeyPool(): could not begin the database transaction");
+        unsigned int nAdded = 0;
+        for (const std::pair<CKey, CPubKey>& key : vKeys)
         {
+            // another top up may have run meanwhile
+            if (setKeyPool.size() >= nTargetSize + 1)
+                break;
             int64_t nEnd = 1;
             if (!setKeyPool.empty())
                 nEnd = *(--setKeyPool.end()) + 1;
-            if (!walletdb.WritePool(nEnd, CKeyPool(GenerateNewKey())))
+            AddGeneratedKey(key.first, key.second, walletdb);
+            if (!walletdb.WritePool(nEnd, CKeyPool(key.second)))
                 throw runtime_error("TopUpKeyPool(): writing generated key failed");
             setKeyPool.insert(nEnd);
-            LogPrintf("keypool added key %d, size=%u\n", nEnd, setKeyPool.size());
+            nAdded++;
         }
+        if (pwalletdbNew && !walletdb.TxnCommit())
+            throw runtime_error("TopUpKeyPool(): committing the generated keys failed");
+        LogPrintf("keypool added %u keys, size=%u\n", nAdded, setKeyPool.size());
+    }
+}
+
+void CWallet::ThreadTopUpKeyPool()
+{
+    RenameThread("horizen-keypool");
+    fKeyPoolRefillThread = true;
+    try {
+        while (true)
+        {
+            {
+                boost::unique_lock<boost::mutex> lock(csKeyPoolRefill);
+                while (!fKeyPoolRefillPending)
+                    condKeyPoolRefill.wait(lock);
+                fKeyPoolRefillPending = false;
+            }
+            try {
+                TopUpKeyPool();
+            } catch (const std::runtime_error& e) {
+                LogPrintf("%s: %s\n", __func__, e.what());
+            }
+        }
+    } catch (const boost::thread_interrupted&) {
+        fKeyPoolRefillThread = false;
+        throw;
     }
-    return true;
 }
 
 void CWallet::ReserveKeyFromKeyPool(int64_t& nIndex, CKeyPool& keypool)
@@ -3864,7 +4573,21 @@ void CWallet::ReserveKeyFromKeyPool(int64_t& nIndex, CKeyPool& keypool)
         LOCK(cs_wallet);
 
         if (!IsLocked())
-            TopUpKeyPool();
+        {
+            if (fKeyPoolRefillThread && !setKeyPool.empty())
+            {
+                if (setKeyPool.size() <= GetKeyPoolMinSize())
+                {
+                    {
+                        boost::lock_guard<boost::mutex> lock(csKeyPoolRefill);
+                        fKeyPoolRefillPending = true;
+                    }
+                    condKeyPoolRefill.notify_one();
+                }
+            }
+            else
+                TopUpKeyPool();
+        }
 
         // Get the oldest key
         if(setKeyPool.empty())
@@ -3939,10 +4662,10 @@ std::map<CTxDestination, CAmount> CWallet::GetAddressBalances()
     map<CTxDestination, CAmount> balances;
 
     {
-        LOCK(cs_wallet);
-        for (auto& walletEntry: mapWallet)
+        LOCK2(cs_main, cs_wallet);
+        for (const CWalletTransactionBase* pcoin : GetUnspentWalletTxs())
         {
-            auto* pcoin = walletEntry.second.get();
+            const uint256& wtxid = pcoin->getTxBase()->GetHash();
             if (!CheckFinalTx(*pcoin->getTxBase()) || !pcoin->IsTrusted() )
                 continue;
 
@@ -3966,7 +4689,7 @@ std::map<CTxDestination, CAmount> CWallet::GetAddressBalances()
                 if(!ExtractDestination(pcoin->getTxBase()->GetVout()[pos].scriptPubKey, addr))
                     continue;
 
-                CAmount n = IsSpent(walletEntry.first, pos) ? 0 : pcoin->getTxBase()->GetVout()[pos].nValue;
+                CAmount n = IsSpent(wtxid, pos) ? 0 : pcoin->getTxBase()->GetVout()[pos].nValue;
 
                 if (!balances.count(addr))
                     balances[addr] = 0;
@@ -4188,6 +4911,129 @@ void CWallet::ListLockedCoins(std::vector<COutPoint>& vOutpts)
     }
 }
 
+// Certificate fee pool
+
+void CWallet::SetCertFeePool(unsigned int nSize, CAmount nCoinValue)
+{
+    LOCK(cs_wallet);
+    nCertFeePoolSize = nSize;
+    nCertFeePoolCoinValue = nCoinValue;
+}
+
+bool CWallet::GetCertFeeCoin(CAmount nMinValue, COutPoint& outpoint, CAmount& nValue) const
+{
+    AssertLockHeld(cs_wallet); // mapCertFeeCoins
+    const auto it = mapCertFeeCoins.lower_bound(nMinValue);
+    if (it == mapCertFeeCoins.end())
+        return false;
+    nValue = it->first;
+    outpoint = it->second;
+    return true;
+}
+
+void CWallet::UseCertFeeCoin(const COutPoint& outpoint, CAmount nValue)
+{
+    AssertLockHeld(cs_wallet); // mapCertFeeCoins, setLockedCoins
+    const auto range = mapCertFeeCoins.equal_range(nValue);
+    for (auto it = range.first; it != range.second; ++it)
+    {
+        if (it->second == outpoint)
+        {
+            mapCertFeeCoins.erase(it);
+            break;
+        }
+    }
+    COutPoint spent = outpoint;
+    UnlockCoin(spent);
+}
+
+void CWallet::RefreshCertFeePool()
+{
+    LOCK2(cs_main, cs_wallet);
+    if (!HasCertFeePool())
+        return;
+
+    // the depth of the coin, -1 if it is spent or its transaction conflicted
+    auto coinDepth = [this](const COutPoint& outpoint) -> int {
+        const MAP_WALLET_CONST_IT it = mapWallet.find(outpoint.hash);
+        if (it == mapWallet.end() || IsSpent(outpoint.hash, outpoint.n))
+            return -1;
+        return it->second->GetDepthInMainChain();
+    };
+
+    for (auto it = mapCertFeeCoins.begin(); it != mapCertFeeCoins.end();)
+    {
+        COutPoint outpoint = it->second;
+        if (coinDepth(outpoint) <= 0)
+        {
+            UnlockCoin(outpoint);
+            it = mapCertFeeCoins.erase(it);
+            continue;
+        }
+        // again, in case lockunspent unlocked all the coins
+        LockCoin(outpoint);
+        ++it;
+    }
+
+    for (auto it = setCertFeeCoinsPending.begin(); it != setCertFeeCoinsPending.end();)
+    {
+        COutPoint outpoint = *it;
+        const int nDepth = coinDepth(outpoint);
+        if (nDepth == 0)
+        {
+            LockCoin(outpoint);
+            ++it;
+            continue;
+        }
+        if (nDepth < 0)
+            UnlockCoin(outpoint);
+        else
+            mapCertFeeCoins.insert(std::make_pair(mapWallet.at(outpoint.hash)->getTxBase()->GetVout()[outpoint.n].nValue, outpoint));
+        it = setCertFeeCoinsPending.erase(it);
+    }
+
+    const size_t nCoins = mapCertFeeCoins.size() + setCertFeeCoinsPending.size();
+    if (nCoins >= nCertFeePoolSize || IsLocked())
+        return;
+
+    CPubKey pubkey;
+    if (!GetKeyFromPool(pubkey))
+    {
+        LogPrintf("%s: keypool ran out, no coins split for the certificate fee pool\n", __func__);
+        return;
+    }
+    const CScript scriptPubKey = GetScriptForDestination(pubkey.GetID());
+    const unsigned int nMissing = std::min<size_t>(nCertFeePoolSize - nCoins, CERT_FEE_POOL_SPLIT_BATCH_SIZE);
+    const std::vector<CRecipient> vecSend(nMissing, CRecipient{scriptPubKey, nCertFeePoolCoinValue, false});
+
+    CWalletTx wtxNew;
+    CReserveKey reservekey(this);
+    CAmount nFeeRequired;
+    int nChangePosRet = -1;
+    std::string strFailReason;
+    if (!CreateTransaction(vecSend, {}, {}, {}, wtxNew, reservekey, nFeeRequired, nChangePosRet, strFailReason))
+    {
+        LogPrint("wallet", "%s: could not split %u coins for the certificate fee pool: %s\n", __func__, nMissing, strFailReason);
+        return;
+    }
+    if (!CommitTransaction(wtxNew, reservekey))
+    {
+        LogPrintf("%s: the transaction splitting the coins of the certificate fee pool was rejected\n", __func__);
+        return;
+    }
+
+    const uint256 hash = wtxNew.getTxBase()->GetHash();
+    for (unsigned int i = 0; i < wtxNew.getTxBase()->GetVout().size(); i++)
+    {
+        if (static_cast<int>(i) == nChangePosRet)
+            continue;
+        COutPoint outpoint(hash, i);
+        LockCoin(outpoint);
+        setCertFeeCoinsPending.insert(outpoint);
+    }
+    LogPrint("wallet", "%s: split %u coins for the certificate fee pool in tx %s\n", __func__, nMissing, hash.ToString());
+}
+
 
 // Note Locking Operations
 
@@ -4434,70 +5280,42 @@ void CWallet::GetFilteredNotes(
 {
     LOCK2(cs_main, cs_wallet);
 
-    for (auto & p : mapWallet) {
-        CWalletTransactionBase& wtx = *(p.second);
-        // Filter the transactions before checking for notes
-        if (!CheckFinalTx(*wtx.getTxBase()) || (wtx.getTxBase()->IsCoinBase() && !wtx.HasMatureOutputs()) || wtx.GetDepthInMainChain() < minDepth) {
-            continue;
+    // only the txs with notes of the addresses are looked at, and each of them once
+    std::map<uint256, bool> mapTxSelected;
+    auto txSelected = [&mapTxSelected, minDepth](const CWalletTransactionBase& wtx) {
+        auto ret = mapTxSelected.insert(std::make_pair(wtx.getTxBase()->GetHash(), false));
+        if (ret.second) {
+            // Filter the transactions before checking for notes
+            ret.first->second = CheckFinalTx(*wtx.getTxBase()) &&
+                                !(wtx.getTxBase()->IsCoinBase() && !wtx.HasMatureOutputs()) &&
+                                wtx.GetDepthInMainChain() >= minDepth;
         }
+        return ret.first->second;
+    };
 
-        for (const auto & [/*JSOutPoint*/ jsop, /*CNoteData*/ nd] : wtx.mapNoteData) {
-            PaymentAddress pa = nd.address;
-
-            // If filterAddresses is not empty, it is used as a whitelist
-            if (!filterAddresses.empty()) {
-                // Skip notes if the address is not contained in the filter
-                if (!filterAddresses.count(pa)) {
-                    continue;
-                }
-            }
-
-            // skip note which has been spent
-            if (ignoreSpent && nd.nullifier && IsSpent(*nd.nullifier)) {
-                continue;
-            }
+    ForEachNote(filterAddresses, [&](const CWalletTransactionBase& wtx, const JSOutPoint& jsop, const CNoteData& nd) {
+        if (!txSelected(wtx))
+            return;
 
-            // skip notes which cannot be spent
-            if (ignoreUnspendable && !HaveSpendingKey(pa)) {
-                continue;
-            }
-            
-            // skip locked notes
-            if (IsLockedNote(jsop.hash, jsop.js, jsop.n)) {
-                continue;
-            }
+        const PaymentAddress& pa = nd.address;
 
-            int i = jsop.js; // Index into CTransaction.GetJoinsSplits()
-            int j = jsop.n;  // Index into JSDescription.ciphertexts
+        // skip note which has been spent
+        if (ignoreSpent && nd.nullifier && IsSpent(*nd.nullifier)) {
+            return;
+        }
 
-            // Get cached decryptor
-            ZCNoteDecryption decryptor;
-            if (!GetNoteDecryptor(pa, decryptor)) {
-                // Note decryptors are created when the wallet is loaded, so it should always exist
-                throw std::runtime_error(strprintf("Could not find note decryptor for payment address %s", CZCPaymentAddress(pa).ToString()));
-            }
+        // skip notes which cannot be spent
+        if (ignoreUnspendable && !HaveSpendingKey(pa)) {
+            return;
+        }
 
-            // determine amount of funds in the note
-            auto hSig = wtx.getTxBase()->GetVjoinsplit()[i].h_sig(*pzcashParams, wtx.getTxBase()->GetJoinSplitPubKey());
-            try {
-                NotePlaintext plaintext = NotePlaintext::decrypt(
-                        decryptor,
-                        wtx.getTxBase()->GetVjoinsplit()[i].ciphertexts[j],
-                        wtx.getTxBase()->GetVjoinsplit()[i].ephemeralKey,
-                        hSig,
-                        (unsigned char) j);
-
-                outEntries.push_back(CNotePlaintextEntry{jsop, pa, plaintext});
-
-            } catch (const note_decryption_failed &err) {
-                // Couldn't decrypt with this spending key
-                throw std::runtime_error(strprintf("Could not decrypt note for payment address %s", CZCPaymentAddress(pa).ToString()));
-            } catch (const std::exception &exc) {
-                // Unexpected failure
-                throw std::runtime_error(strprintf("Error while decrypting note for payment address %s: %s", CZCPaymentAddress(pa).ToString(), exc.what()));
-            }
+        // skip locked notes
+        if (IsLockedNote(jsop.hash, jsop.js, jsop.n)) {
+            return;
         }
-    }
+
+        outEntries.push_back(CNotePlaintextEntry{jsop, pa, GetNotePlaintext(wtx, jsop, pa)});
+    });
 }
 
 bool CWalletTransactionBase::HasInputFrom(const CScript& scriptPubKey) const 
@@ -4691,67 +5509,30 @@ void CWallet::GetUnspentFilteredNotes(
 {
     LOCK2(cs_main, cs_wallet);
 
-    for (auto & p : mapWallet) {
-        CWalletTransactionBase& wtx = *(p.second);
-
-        // Filter the transactions before checking for notes
-        if (!CheckFinalTx(*wtx.getTxBase()) || !wtx.HasMatureOutputs() || wtx.GetDepthInMainChain() < minDepth || wtx.GetDepthInMainChain() > maxDepth) {
-            continue;
-        }
-
-        if (wtx.mapNoteData.size() == 0) {
-            continue;
+    std::map<uint256, int> mapTxDepth;
+    ForEachNote(filterAddresses, [&](const CWalletTransactionBase& wtx, const JSOutPoint& jsop, const CNoteData& nd) {
+        auto ret = mapTxDepth.insert(std::make_pair(jsop.hash, 0));
+        if (ret.second) {
+            // Filter the transactions before checking for notes, INT_MIN for the ones filtered out
+            const int nDepth = wtx.GetDepthInMainChain();
+            const bool fSelected = CheckFinalTx(*wtx.getTxBase()) && wtx.HasMatureOutputs() && nDepth >= minDepth && nDepth <= maxDepth;
+            ret.first->second = fSelected ? nDepth : INT_MIN;
         }
+        if (ret.first->second == INT_MIN)
+            return;
 
-        for (auto & pair : wtx.mapNoteData) {
-            JSOutPoint jsop = pair.first;
-            CNoteData nd = pair.second;
-            PaymentAddress pa = nd.address;
-
-            // skip notes which belong to a different payment address in the wallet
-            if (!(filterAddresses.empty() || filterAddresses.count(pa))) {
-                continue;
-            }
-
-            // skip note which has been spent
-            if (nd.nullifier && IsSpent(*nd.nullifier)) {
-                continue;
-            }
-
-            // skip notes where the spending key is not available
-            if (requireSpendingKey && !HaveSpendingKey(pa)) {
-                continue;
-            }
-
-            int i = jsop.js; // Index into CTransaction.vjoinsplit
-            int j = jsop.n; // Index into JSDescription.ciphertexts
+        const PaymentAddress& pa = nd.address;
 
-            // Get cached decryptor
-            ZCNoteDecryption decryptor;
-            if (!GetNoteDecryptor(pa, decryptor)) {
-                // Note decryptors are created when the wallet is loaded, so it should always exist
-                throw std::runtime_error(strprintf("Could not find note decryptor for payment address %s", CZCPaymentAddress(pa).ToString()));
-            }
+        // skip note which has been spent
+        if (nd.nullifier && IsSpent(*nd.nullifier)) {
+            return;
+        }
 
-            // determine amount of funds in the note
-            auto hSig = wtx.getTxBase()->GetVjoinsplit()[i].h_sig(*pzcashParams, wtx.getTxBase()->GetJoinSplitPubKey());
-            try {
-                NotePlaintext plaintext = NotePlaintext::decrypt(
-                        decryptor,
-                        wtx.getTxBase()->GetVjoinsplit()[i].ciphertexts[j],
-                        wtx.getTxBase()->GetVjoinsplit()[i].ephemeralKey,
-                        hSig,
-                        (unsigned char) j);
-
-                outEntries.push_back(CUnspentNotePlaintextEntry{jsop, pa, plaintext, wtx.GetDepthInMainChain()});
-
-            } catch (const note_decryption_failed &err) {
-                // Couldn't decrypt with this spending key
-                throw std::runtime_error(strprintf("Could not decrypt note for payment address %s", CZCPaymentAddress(pa).ToString()));
-            } catch (const std::exception &exc) {
-                // Unexpected failure
-                throw std::runtime_error(strprintf("Error while decrypting note for payment address %s: %s", CZCPaymentAddress(pa).ToString(), exc.what()));
-            }
+        // skip notes where the spending key is not available
+        if (requireSpendingKey && !HaveSpendingKey(pa)) {
+            return;
         }
-    }
+
+        outEntries.push_back(CUnspentNotePlaintextEntry{jsop, pa, GetNotePlaintext(wtx, jsop, pa), ret.first->second});
+    });
 }
@@ -26,6 +26,9 @@
 #include "base58.h"
 
 #include <algorithm>
+#include <atomic>
+#include <functional>
+#include <limits>
 #include <map>
 #include <set>
 #include <stdexcept>
@@ -34,6 +37,9 @@
 #include <utility>
 #include <vector>
 
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+
 #include "sc/sidechainrpc.h"
 
 /**
@@ -62,6 +68,20 @@ static const unsigned int MAX_FREE_TRANSACTION_CREATE_SIZE = 1000;
 //  Should be large enough that we can expect not to reorg beyond our cache
 //  unless there is some exceptional network disruption.
 static const unsigned int WITNESS_CACHE_SIZE = COINBASE_MATURITY;
+//! Nodes the branch and bound coin selection may visit before falling back to the stochastic approximation
+static const int COIN_SELECTION_BNB_MAX_TRIES = 100000;
+//! Default for -keypool
+static const unsigned int DEFAULT_KEYPOOL_SIZE = 100;
+//! The most keys of the keypool written in a single database transaction, cs_wallet being held meanwhile
+static const unsigned int KEYPOOL_TOPUP_BATCH_SIZE = 1000;
+//! Default for -certfeepool, no coins are kept aside for the fees of the certificates
+static const unsigned int DEFAULT_CERT_FEE_POOL_SIZE = 0;
+//! Default for -certfeepoolvalue
+static const CAmount DEFAULT_CERT_FEE_POOL_COIN_VALUE = COIN / 100;
+//! Seconds between two refreshes of the certificate fee pool
+static const int64_t CERT_FEE_POOL_REFRESH_INTERVAL = 10;
+//! The most coins of the certificate fee pool split by a single transaction
+static const unsigned int CERT_FEE_POOL_SPLIT_BATCH_SIZE = 50;
 
 class CBlockIndex;
 class CCoinControl;
@@ -166,6 +186,31 @@ struct COutputEntry
     bool isBackwardTransfer;
 };
 
+/** The entries GetAmounts gives for a filter, cached by the wallet transactions */
+struct CAmountsBreakdown
+{
+    std::list<COutputEntry> listReceived;
+    std::list<COutputEntry> listSent;
+    CAmount nFee = 0;
+    std::string strSentAccount;
+};
+
+/**
+ * The state a breakdown is computed against: the chain tip and the mempool, which the maturity and the
+ * conflicts of the outputs depend on, and the wallet transactions, keys and labels (see MarkBalancesDirty)
+ */
+struct CAmountsStamp
+{
+    uint256 hashTip;
+    unsigned int nMempoolUpdated = 0;
+    uint64_t nWalletSeq = 0;
+
+    bool operator==(const CAmountsStamp& other) const
+    {
+        return hashTip == other.hashTip && nMempoolUpdated == other.nMempoolUpdated && nWalletSeq == other.nWalletSeq;
+    }
+};
+
 /** An note outpoint */
 class JSOutPoint
 {
@@ -341,6 +386,8 @@ private:
     mutable CAmount nImmatureWatchCreditCached;
     mutable CAmount nAvailableWatchCreditCached;
     mutable CAmount nChangeCached;
+    //! The breakdowns of GetAmounts by filter, each valid while the state it is stamped with is current
+    mutable std::map<isminefilter, std::pair<CAmountsStamp, CAmountsBreakdown> > mapAmountsCached;
 public:
     void SetfDebitCached(bool val) {fDebitCached = val;} //for UTs only
     void SetnDebitCached(CAmount val) {nDebitCached = val;} //for UTs only
@@ -419,6 +466,8 @@ public:
 
     virtual void GetAmounts(std::list<COutputEntry>& listReceived, std::list<COutputEntry>& listSent,
         CAmount& nFee, std::string& strSentAccount, const isminefilter& filter) const = 0;
+    //! GetAmounts, computed when first asked for since the chain tip, the mempool or the wallet changed
+    const CAmountsBreakdown& GetCachedAmounts(const isminefilter& filter) const;
 
     virtual bool RelayWalletTransaction() = 0;
 
@@ -738,6 +787,33 @@ private:
 
     CWalletDB *pwalletdbEncryption;
 
+    /**
+     * Between BeginBlockSync and EndBlockSync, the db all the writes for the block go through, in a
+     * single db transaction. cs_wallet is held meanwhile, and the wallet code reaches the db through it
+     * only, as another handle could block on the locks of the transaction.
+     */
+    std::unique_ptr<CWalletDB> pwalletdbBlockSync;
+
+    //! The db of the block being synced if any, else a new one owned by pwalletdbNew
+    CWalletDB& GetSyncWalletDB(std::unique_ptr<CWalletDB>& pwalletdbNew);
+
+    //! Adds a new key made outside cs_wallet, and its metadata, writing them through walletdb
+    void AddGeneratedKey(const CKey& secret, const CPubKey& pubkey, CWalletDB& walletdb);
+    bool AddKeyPubKeyWithDB(const CKey& secret, const CPubKey& pubkey, CWalletDB* pwalletdb);
+
+    //! Wakes up ThreadTopUpKeyPool, once the keypool runs below -keypoolmin
+    boost::mutex csKeyPoolRefill;
+    boost::condition_variable condKeyPoolRefill;
+    bool fKeyPoolRefillPending = false;
+    std::atomic<bool> fKeyPoolRefillThread{false};
+
+    //! The confirmed coins of the certificate fee pool by value, and the coins split for it not confirmed
+    //! yet; all of them are in setLockedCoins
+    std::multimap<CAmount, COutPoint> mapCertFeeCoins;
+    std::set<COutPoint> setCertFeeCoinsPending;
+    unsigned int nCertFeePoolSize = DEFAULT_CERT_FEE_POOL_SIZE;
+    CAmount nCertFeePoolCoinValue = DEFAULT_CERT_FEE_POOL_COIN_VALUE;
+
     //! the current wallet version: clients below this version are not able to load the wallet
     int nWalletVersion;
 
@@ -897,6 +973,9 @@ public:
         nTimeFirstKey = 0;
         fBroadcastTransactions = false;
         nWitnessCacheSize = 0;
+        nBalanceCacheSeq = 0;
+        nBalanceCacheValidSeq = 0;
+        nBalanceCacheMempoolUpdated = 0;
     }
 
     /**
@@ -952,6 +1031,78 @@ public:
 private:
     std::map<uint256, std::shared_ptr<CWalletTransactionBase> > mapWallet;
     std::map<uint256, CScCertificateStatusUpdateInfo> mapSidechains;
+
+    /**
+     * Secondary indexes over mapWallet, maintained by AddToWallet and EraseFromWallet.
+     *
+     * setUnspentTxs holds the wallet transactions which may still have an output that is
+     * not spent by a transaction in the active chain. Fully spent entries are dropped lazily
+     * by GetUnspentWalletTxs(); a spender leaving the active chain goes through AddToWallet
+     * again, which re-adds the transactions it spends.
+     *
+     * mapTxsByDestination holds, for each destination, the wallet transactions paying to it
+     * or spending a wallet output paying to it.
+     *
+     * mapNoteTxs holds the wallet transactions with notes, whose witnesses are kept up to date
+     * with the chain, so that connecting or disconnecting a block does not walk all of mapWallet.
+     *
+     * mapNotesByAddress holds the notes of mapNoteTxs by payment address. A note whose tx no longer
+     * has it in mapNoteData is skipped. mapNotePlaintexts holds the plaintexts of the notes once
+     * decrypted: they only depend on the tx, so each note is decrypted at most once. The spent
+     * state is not cached, it follows the depth of the spending tx through IsSpent.
+     */
+    mutable std::set<uint256> setUnspentTxs;
+    std::map<CTxDestination, std::set<uint256> > mapTxsByDestination;
+    std::map<uint256, CWalletTransactionBase*> mapNoteTxs;
+    std::map<libzcash::PaymentAddress, std::set<JSOutPoint> > mapNotesByAddress;
+    mutable std::map<JSOutPoint, libzcash::NotePlaintext> mapNotePlaintexts;
+
+    /**
+     * Cached balances, valid as long as the chain tip, the mempool and the wallet
+     * transactions (see MarkBalancesDirty) do not change.
+     */
+    mutable uint64_t nBalanceCacheSeq;
+    mutable uint64_t nBalanceCacheValidSeq;
+    mutable uint256 hashBalanceCacheTip;
+    mutable unsigned int nBalanceCacheMempoolUpdated;
+    mutable std::map<std::string, CAmount> mapCachedBalances;
+
+    /**
+     * setTxsByHeight holds the wallet transactions by the height of the block they were last seen
+     * in (INT_MAX for none, or for a block not in the block index), mapTxHeights the height each is
+     * held at. setTxsOffChain holds those whose block was disconnected since, and setWalletCerts
+     * the certificates, whose backward transfers mature blocks after theirs: listsinceblock looks
+     * at them only, rather than at all of mapWallet.
+     */
+    std::set<std::pair<int, uint256> > setTxsByHeight;
+    std::map<uint256, int> mapTxHeights;
+    std::set<uint256> setTxsOffChain;
+    std::set<uint256> setWalletCerts;
+
+    /**
+     * isMineFilter tells the scripts surely not the wallet's, so that AddToWalletIfInvolvingMe drops the
+     * transactions of no concern to it without IsMine. It is filled again from the key store when this
+     * changed since nIsMineFilterGeneration.
+     */
+    mutable CIsMineFilter isMineFilter;
+    mutable uint64_t nIsMineFilterGeneration = std::numeric_limits<uint64_t>::max();
+
+    void UpdateIsMineFilter() const;
+    //! False if obj surely neither pays to the wallet, nor spends from it, nor has notes of it; requires cs_wallet
+    bool MayInvolveMe(const CTransactionBase& obj, const mapNoteData_t* pNoteData) const;
+    void IndexWalletTx(const CWalletTransactionBase& wtx);
+    void UnindexWalletTx(const CWalletTransactionBase& wtx);
+    void IndexNotes(CWalletTransactionBase& wtx);
+    //! Calls f for the notes paying to filterAddresses, or all the notes if empty, in JSOutPoint order
+    void ForEachNote(const std::set<libzcash::PaymentAddress>& filterAddresses,
+                     const std::function<void(const CWalletTransactionBase&, const JSOutPoint&, const CNoteData&)>& f) const;
+    //! The plaintext of a note of wtx, decrypted on first use; throws std::runtime_error if it cannot be
+    const libzcash::NotePlaintext& GetNotePlaintext(const CWalletTransactionBase& wtx, const JSOutPoint& jsop,
+                                                    const libzcash::PaymentAddress& pa) const;
+    void IndexTxHeight(const CWalletTransactionBase& wtx);
+    void UnindexTxHeight(const uint256& hash);
+    void UpdateTxsOffChain(const CBlockIndex* pindex, bool fConnected);
+    bool IsSpentInMainChain(const CWalletTransactionBase& wtx) const;
 public:
     const std::map<uint256, std::shared_ptr<CWalletTransactionBase> > & getMapWallet() const  {return mapWallet;}
     //No need for mapWallet setter, meaning that mapWallet is only read outside CWallet class
@@ -973,6 +1124,22 @@ public:
 
     const CWalletTransactionBase* GetWalletTx(const uint256& hash) const;
 
+    //! Wallet transactions with at least one output not spent in the active chain, ordered by hash
+    std::vector<const CWalletTransactionBase*> GetUnspentWalletTxs() const;
+
+    //! Invalidate the cached balances, called whenever a wallet transaction changes
+    void MarkBalancesDirty() const { nBalanceCacheSeq++; }
+    bool GetCachedBalance(const std::string& strKey, CAmount& nBalance) const;
+    void SetCachedBalance(const std::string& strKey, CAmount nBalance) const;
+    //! The current state the cached amounts of the wallet transactions are stamped with
+    CAmountsStamp GetAmountsStamp() const;
+
+    /**
+     * The hashes of the wallet transactions that may be in a block of the active chain above nHeight, or
+     * in none of them, and of the certificates, a superset of those listsinceblock gives for nHeight
+     */
+    std::set<uint256> GetTxsAboveHeight(int nHeight) const;
+
     //! check whether we are allowed to upgrade (or already support) to the named feature
     bool CanSupportFeature(enum WalletFeature wf) { AssertLockHeld(cs_wallet); return nWalletMaxVersion >= wf; }
 
@@ -989,6 +1156,22 @@ public:
     void UnlockAllCoins();
     void ListLockedCoins(std::vector<COutPoint>& vOutpts);
 
+    /**
+     * The certificate fee pool: -certfeepool coins of -certfeepoolvalue each, split from the balance
+     * and locked, so that sc_send_certificate funds the fee with one of them instead of selecting it
+     * among all the coins of the wallet. RefreshCertFeePool, run periodically, looks up the transactions
+     * of the coins of the pool only, to drop the ones spent, and splits new coins for the missing ones.
+     */
+    void SetCertFeePool(unsigned int nSize, CAmount nCoinValue);
+    bool HasCertFeePool() const { return nCertFeePoolSize > 0; }
+    //! The confirmed coins of the pool, the ones GetCertFeeCoin picks from
+    size_t GetCertFeePoolCoins() const { AssertLockHeld(cs_wallet); return mapCertFeeCoins.size(); }
+    //! The smallest confirmed coin of the pool worth at least nMinValue
+    bool GetCertFeeCoin(CAmount nMinValue, COutPoint& outpoint, CAmount& nValue) const;
+    //! Takes a coin out of the pool, once a certificate spending it was sent
+    void UseCertFeeCoin(const COutPoint& outpoint, CAmount nValue);
+    void RefreshCertFeePool();
+
 
     bool IsLockedNote(uint256 hash, size_t js, uint8_t n) const;
     void LockNote(JSOutPoint& output);
@@ -1077,7 +1260,8 @@ public:
     void SyncCertificate(const CScCertificate& cert, const CBlock* pblock, int bwtMaturityDepth = -1) override;
     void SyncCertStatusInfo(const CScCertificateStatusUpdateInfo& certStatusInfo) override;
     bool ReadSidechain(const uint256& scId, CScCertificateStatusUpdateInfo& sidechain);
-    bool AddToWalletIfInvolvingMe(const CTransactionBase& obj, const CBlock* pblock, int bwtMaturityDepth, bool fUpdate);
+    bool AddToWalletIfInvolvingMe(const CTransactionBase& obj, const CBlock* pblock, int bwtMaturityDepth, bool fUpdate,
+                                  const mapNoteData_t* pNoteData = nullptr);
     void EraseFromWallet(const uint256 &hash) override;
     void WitnessNoteCommitment(
          std::vector<uint256> commitments,
@@ -1120,7 +1304,18 @@ public:
     static CAmount GetMinimumFee(unsigned int nTxBytes, unsigned int nConfirmTarget, const CTxMemPool& pool);
 
     bool NewKeyPool();
+    /**
+     * Fills the keypool up to kpSize + 1 keys, or -keypool + 1 if kpSize is 0. The keys are
+     * generated without holding cs_wallet, unless the caller holds it, and written in batches of
+     * KEYPOOL_TOPUP_BATCH_SIZE, each in a single database transaction.
+     */
     bool TopUpKeyPool(unsigned int kpSize = 0);
+    /**
+     * Run by a thread of its own: tops the keypool up whenever the keys drawn from it while the
+     * wallet is unlocked take it below -keypoolmin, so that drawing keys does not wait for new ones
+     * to be generated unless the keypool is empty
+     */
+    void ThreadTopUpKeyPool();
     void ReserveKeyFromKeyPool(int64_t& nIndex, CKeyPool& keypool);
     void KeepKey(int64_t nIndex);
     void ReturnKey(int64_t nIndex);
@@ -1140,6 +1335,7 @@ public:
         const uint256& hSig,
         uint8_t n) const;
     mapNoteData_t FindMyNotes(const CTransactionBase& tx) const;
+    mapNoteData_t FindMyNotes(const CTransactionBase& tx, const NoteDecryptorMap& decryptors) const;
     bool IsFromMe(const uint256& nullifier) const;
     void GetNoteWitnesses(
          std::vector<JSOutPoint> notes,
@@ -1164,6 +1360,9 @@ public:
     void ChainTip(const CBlockIndex *pindex, const CBlock *pblock, ZCIncrementalMerkleTree tree, bool added) override;
     /** Saves witness caches and best block locator to disk. */
     void SetBestChain(const CBlockLocator& loc) override;
+    /** Start the db transaction holding all the updates of the block being connected or disconnected. */
+    void BeginBlockSync() override;
+    void EndBlockSync() override;
 
     DBErrors LoadWallet(bool& fFirstRunRet);
     DBErrors ZapWalletTx(std::vector<std::shared_ptr<CWalletTransactionBase> >& vWtx);
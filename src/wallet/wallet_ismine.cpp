@@ -5,6 +5,9 @@
 
 #include "wallet_ismine.h"
 #include "keystore.h"
+
+#include <algorithm>
+
 #include <boost/foreach.hpp>
 
 using namespace std;
@@ -91,3 +94,62 @@ isminetype IsMine(const CKeyStore &keystore, const CScript& scriptPubKey)
     return ISMINE_NO;
 
 }
+
+namespace {
+
+//! Call f with the ids the pushes of a script are matched on, until it returns true
+template <typename F>
+bool ForEachPushedId(const CScript& script, F f)
+{
+    CScript::const_iterator pc = script.begin();
+    opcodetype opcode;
+    valtype vch;
+    while (pc < script.end()) {
+        if (!script.GetOp(pc, opcode, vch))
+            return false;
+        if (vch.size() == 20) {
+            if (f(uint160(vch)))
+                return true;
+        } else if (vch.size() == COMPRESSED_PUBLIC_KEY_SIZE || vch.size() == PUBLIC_KEY_SIZE) {
+            // as Solver matches public keys, the id is the one IsMine looks the key up with
+            if (f(CPubKey(vch).GetID()))
+                return true;
+        }
+    }
+    return false;
+}
+
+} // anon namespace
+
+void CIsMineFilter::Clear()
+{
+    setIds.clear();
+    vWatchOnlyRest.clear();
+}
+
+void CIsMineFilter::AddWatchOnly(const CScript& script)
+{
+    // a script starting with the watch-only one has its pushes: those are enough to match it on
+    bool fPushes = false;
+    ForEachPushedId(script, [this, &fPushes](const uint160& id) {
+        setIds.insert(id);
+        fPushes = true;
+        return false;
+    });
+    CScript::const_iterator pc = script.begin();
+    opcodetype opcode;
+    while (pc < script.end() && script.GetOp(pc, opcode)) {}
+    if (!fPushes || pc != script.end())
+        vWatchOnlyRest.push_back(script);
+}
+
+bool CIsMineFilter::MayBeMine(const CScript& scriptPubKey) const
+{
+    if (!setIds.empty() && ForEachPushedId(scriptPubKey, [this](const uint160& id) { return setIds.count(id) != 0; }))
+        return true;
+    for (const CScript& script : vWatchOnlyRest) {
+        if (scriptPubKey.size() >= script.size() && std::equal(script.begin(), script.end(), scriptPubKey.begin()))
+            return true;
+    }
+    return false;
+}
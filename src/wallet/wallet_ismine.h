@@ -7,8 +7,13 @@
 #define BITCOIN_WALLET_WALLET_ISMINE_H
 
 #include "key.h"
+#include "script/script.h"
 #include "script/standard.h"
 
+#include <string.h>
+#include <unordered_set>
+#include <vector>
+
 class CKeyStore;
 class CScript;
 
@@ -26,4 +31,36 @@ typedef uint8_t isminefilter;
 isminetype IsMine(const CKeyStore& keystore, const CScript& scriptPubKey);
 isminetype IsMine(const CKeyStore& keystore, const CTxDestination& dest);
 
+/**
+ * A prefilter of IsMine over the content of a key store, telling the scripts which surely are not
+ * the store's without Solver nor any store lookup. A script is the store's only if it pushes the id
+ * of one of its keys or scripts, or one of its public keys, or if it starts with a watch-only
+ * script: the one pushing none of the ids held, nor the id of a public key, is not.
+ */
+class CIsMineFilter
+{
+public:
+    void Clear();
+    void AddKey(const CKeyID& keyID) { setIds.insert(keyID); }
+    void AddScript(const CScriptID& scriptID) { setIds.insert(scriptID); }
+    void AddWatchOnly(const CScript& script);
+
+    //! False if IsMine is ISMINE_NO for the content the filter was filled with
+    bool MayBeMine(const CScript& scriptPubKey) const;
+
+private:
+    //! The ids are hashes, whose first bytes are evenly distributed
+    struct IdHasher {
+        size_t operator()(const uint160& id) const
+        {
+            uint64_t n;
+            memcpy(&n, id.begin(), sizeof(n));
+            return n;
+        }
+    };
+    std::unordered_set<uint160, IdHasher> setIds;
+    //! The watch-only scripts pushing no id nor public key, the other ones being filtered by their pushes
+    std::vector<CScript> vWatchOnlyRest;
+};
+
 #endif // BITCOIN_WALLET_WALLET_ISMINE_H
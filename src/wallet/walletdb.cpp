@@ -17,6 +17,10 @@
 #include "zcash/Proof.hpp"
 #include <sc/sidechain.h>
 
+#include <atomic>
+#include <future>
+#include <memory>
+
 #include <boost/filesystem.hpp>
 #include <boost/foreach.hpp>
 #include <boost/scoped_ptr.hpp>
@@ -26,6 +30,9 @@ using namespace std;
 
 static uint64_t nAccountingEntryNumber = 0;
 
+//! Below as many transaction and certificate records per thread, LoadWallet reads them with fewer threads
+static const size_t MIN_WALLET_TX_RECORDS_PER_THREAD = 64;
+
 //
 // CWalletDB
 //
@@ -459,6 +466,77 @@ public:
     }
 };
 
+/**
+ * Deserialize and check the transaction of a "tx" record whose type was read from ssKey, repairing
+ * the records of versions 31404 to 31703. Thread safe, as it does not touch the wallet.
+ */
+static bool ReadWalletTxRecord(CDataStream& ssKey, CDataStream& ssValue, uint256& hash, CWalletTx& wtx,
+                               bool& fUpgraded, string& strErr)
+{
+    ssKey >> hash;
+    ssValue >> wtx;
+    CValidationState state;
+    auto verifier = libzcash::ProofVerifier::Strict();
+    if (!(CheckTransaction(wtx.getWrappedTx(), state, verifier) && (wtx.getWrappedTx().GetHash() == hash) && state.IsValid()))
+    {
+        LogPrintf("%s():%d - failure: tx id = %s, reject code = %d\n",
+            __func__, __LINE__, wtx.getWrappedTx().GetHash().ToString(), CValidationState::CodeToChar(state.GetRejectCode()));
+        // Don't consider CValidationState::Code::REJECT_CHECKBLOCKATHEIGHT_NOT_FOUND error code as a failure. It can appear because a tx
+        // is a pre-chainsplit tx, so it is perfectly fine in this case.
+        if (state.GetRejectCode() != CValidationState::Code::CHECKBLOCKATHEIGHT_NOT_FOUND)
+            return false;
+    }
+
+    // Undo serialize changes in 31600
+    fUpgraded = false;
+    if (31404 <= wtx.fTimeReceivedIsTxTime && wtx.fTimeReceivedIsTxTime <= 31703)
+    {
+        if (!ssValue.empty())
+        {
+            char fTmp;
+            char fUnused;
+            ssValue >> fTmp >> fUnused >> wtx.strFromAccount;
+            strErr = strprintf("LoadWallet() upgrading tx ver=%d %d '%s' %s",
+                               wtx.fTimeReceivedIsTxTime, fTmp, wtx.strFromAccount, hash.ToString());
+            wtx.fTimeReceivedIsTxTime = fTmp;
+        }
+        else
+        {
+            strErr = strprintf("LoadWallet() repairing tx ver=%d %s", wtx.fTimeReceivedIsTxTime, hash.ToString());
+            wtx.fTimeReceivedIsTxTime = 0;
+        }
+        fUpgraded = true;
+    }
+    return true;
+}
+
+//! As ReadWalletTxRecord, for the certificate of a "cert" record
+static bool ReadWalletCertRecord(CDataStream& ssKey, CDataStream& ssValue, uint256& hash, CWalletCert& wcert)
+{
+    ssKey >> hash;
+    ssValue >> wcert;
+    CValidationState state;
+    if (!(CheckCertificate(wcert.getWrappedCert(), state) && (wcert.getWrappedCert().GetHash() == hash) && state.IsValid()))
+    {
+        LogPrint("cert", "%s():%d - cert[%s] is invalid\n", __func__, __LINE__, wcert.getWrappedCert().GetHash().ToString());
+        return false;
+    }
+    return true;
+}
+
+//! Add a transaction or certificate read from its record to the wallet
+static void LoadWalletTxRecord(CWallet* pwallet, const CWalletTransactionBase& wtx, const uint256& hash, bool fUpgraded,
+                               CWalletScanState &wss)
+{
+    if (fUpgraded)
+        wss.vWalletUpgrade.push_back(hash);
+
+    if (wtx.nOrderPos == -1)
+        wss.fAnyUnordered = true;
+
+    pwallet->AddToWallet(wtx, true, NULL);
+}
+
 bool
 ReadKeyValue(CWallet* pwallet, CDataStream& ssKey, CDataStream& ssValue,
              CWalletScanState &wss, string& strType, string& strErr)
@@ -485,66 +563,19 @@ ReadKeyValue(CWallet* pwallet, CDataStream& ssKey, CDataStream& ssValue,
         }
         else if (strType == "tx")
         {
-            ssKey >> hash;
             CWalletTx wtx;
-            ssValue >> wtx;
-            CValidationState state;
-            auto verifier = libzcash::ProofVerifier::Strict();
-            if (!(CheckTransaction(wtx.getWrappedTx(), state, verifier) && (wtx.getWrappedTx().GetHash() == hash) && state.IsValid()))
-            {
-                LogPrintf("%s():%d - failure: tx id = %s, reject code = %d\n",
-                    __func__, __LINE__, wtx.getWrappedTx().GetHash().ToString(), CValidationState::CodeToChar(state.GetRejectCode()));
-                // Don't consider CValidationState::Code::REJECT_CHECKBLOCKATHEIGHT_NOT_FOUND error code as a failure. It can appear because a tx
-                // is a pre-chainsplit tx, so it is perfectly fine in this case.
-                if (state.GetRejectCode() != CValidationState::Code::CHECKBLOCKATHEIGHT_NOT_FOUND)
-                    return false;
-            }
-
-            // Undo serialize changes in 31600
-            if (31404 <= wtx.fTimeReceivedIsTxTime && wtx.fTimeReceivedIsTxTime <= 31703)
-            {
-                if (!ssValue.empty())
-                {
-                    char fTmp;
-                    char fUnused;
-                    ssValue >> fTmp >> fUnused >> wtx.strFromAccount;
-                    strErr = strprintf("LoadWallet() upgrading tx ver=%d %d '%s' %s",
-                                       wtx.fTimeReceivedIsTxTime, fTmp, wtx.strFromAccount, hash.ToString());
-                    wtx.fTimeReceivedIsTxTime = fTmp;
-                }
-                else
-                {
-                    strErr = strprintf("LoadWallet() repairing tx ver=%d %s", wtx.fTimeReceivedIsTxTime, hash.ToString());
-                    wtx.fTimeReceivedIsTxTime = 0;
-                }
-                wss.vWalletUpgrade.push_back(hash);
-            }
-
-            if (wtx.nOrderPos == -1)
-                wss.fAnyUnordered = true;
-
-            pwallet->AddToWallet(wtx, true, NULL);
+            bool fUpgraded;
+            if (!ReadWalletTxRecord(ssKey, ssValue, hash, wtx, fUpgraded, strErr))
+                return false;
+            LoadWalletTxRecord(pwallet, wtx, hash, fUpgraded, wss);
         }
         else if (strType == "cert")
         {
-            ssKey >> hash;
             CWalletCert wcert;
-            ssValue >> wcert;
-            CValidationState state;
-            if (!(CheckCertificate(wcert.getWrappedCert(), state) && (wcert.getWrappedCert().GetHash() == hash) && state.IsValid()))
-            {
-                LogPrint("cert", "%s():%d - cert[%s] is invalid\n", __func__, __LINE__, wcert.getWrappedCert().GetHash().ToString());
+            if (!ReadWalletCertRecord(ssKey, ssValue, hash, wcert))
                 return false;
-            }
-
-            if (wcert.nOrderPos == -1)
-            {
-                LogPrint("cert", "%s():%d - cert[%s] is unordered\n", __func__, __LINE__, wcert.getWrappedCert().GetHash().ToString());
-                wss.fAnyUnordered = true;
-            }
-
-            LogPrint("cert", "%s():%d - adding cert[%s] to wallet\n", __func__, __LINE__, wcert.getWrappedCert().GetHash().ToString());
-            pwallet->AddToWallet(wcert, true, NULL);
+            LogPrint("cert", "%s():%d - adding cert[%s] to wallet\n", __func__, __LINE__, hash.ToString());
+            LoadWalletTxRecord(pwallet, wcert, hash, false, wss);
         }
         else if (strType == "acentry")
         {
@@ -818,6 +849,64 @@ static bool IsKeyType(const string& strType)
             strType == "mkey" || strType == "ckey");
 }
 
+namespace {
+
+/** A "tx" or "cert" record, kept as read by LoadWallet until it is deserialized along with the others */
+struct CWalletTxRecord
+{
+    CDataStream ssKey;
+    CDataStream ssValue;
+    string strType;
+    uint256 hash;
+    //! The transaction or certificate, if the record is valid
+    std::unique_ptr<CWalletTransactionBase> pwtx;
+    bool fUpgraded = false;
+    string strErr;
+
+    CWalletTxRecord(CDataStream&& ssKeyIn, CDataStream&& ssValueIn, const string& strTypeIn) :
+        ssKey(std::move(ssKeyIn)), ssValue(std::move(ssValueIn)), strType(strTypeIn) {}
+
+    //! Thread safe: the type was read from ssKey already
+    void Read()
+    {
+        try {
+            if (strType == "tx") {
+                std::unique_ptr<CWalletTx> pwtxRead(new CWalletTx());
+                if (ReadWalletTxRecord(ssKey, ssValue, hash, *pwtxRead, fUpgraded, strErr))
+                    pwtx = std::move(pwtxRead);
+            } else {
+                std::unique_ptr<CWalletCert> pwcertRead(new CWalletCert());
+                if (ReadWalletCertRecord(ssKey, ssValue, hash, *pwcertRead))
+                    pwtx = std::move(pwcertRead);
+            }
+        } catch (...) {
+            LogPrintf("%s():%d - Error at record for type[%s] (hash[%s])\n", __func__, __LINE__, strType, hash.ToString());
+        }
+        // the raw record is not needed anymore
+        ssValue = CDataStream(SER_DISK, CLIENT_VERSION);
+    }
+};
+
+//! Deserialize and check the records on up to GetNumCores() threads, each taking the next record left
+void ReadWalletTxRecords(std::vector<CWalletTxRecord>& vRecords)
+{
+    const size_t nThreads = std::max<size_t>(1, std::min<size_t>(GetNumCores(), vRecords.size() / MIN_WALLET_TX_RECORDS_PER_THREAD));
+    std::atomic<size_t> nNext(0);
+    auto worker = [&vRecords, &nNext]() {
+        for (size_t i = nNext++; i < vRecords.size(); i = nNext++)
+            vRecords[i].Read();
+    };
+
+    std::vector<std::future<void>> vWorkers;
+    for (size_t n = 1; n < nThreads; n++)
+        vWorkers.push_back(std::async(std::launch::async, worker));
+    worker();
+    for (std::future<void>& w : vWorkers)
+        w.get();
+}
+
+}
+
 DBErrors CWalletDB::LoadWallet(CWallet* pwallet)
 {
     pwallet->vchDefaultKey = CPubKey();
@@ -843,6 +932,31 @@ DBErrors CWalletDB::LoadWallet(CWallet* pwallet)
             return DB_CORRUPT;
         }
 
+        // Try to be tolerant of single corrupt records:
+        auto onRecordError = [&](const string& strType) {
+            // losing keys is considered a catastrophic error, anything else
+            // we assume the user can live with:
+            if (IsKeyType(strType))
+                result = DB_CORRUPT;
+            else
+            {
+                // Leave other errors alone, if we try to fix them we might make things worse.
+                fNoncriticalErrors = true; // ... but do warn the user there is something wrong.
+                if (strType == "tx")
+                    // Rescan if there is a bad transaction record:
+                    SoftSetBoolArg("-rescan", true);
+                if (strType == "cert")
+                {
+                    LogPrint("cert", "%s():%d - cert error: rescan set to true\n", __func__, __LINE__);
+                    // Rescan if there is a bad transaction record:
+                    SoftSetBoolArg("-rescan", true);
+                }
+            }
+        };
+
+        // The transactions and certificates are only kept as read, to be deserialized and checked
+        // in parallel once all the records are read, and then added to the wallet in their order
+        std::vector<CWalletTxRecord> vTxRecords;
         while (true)
         {
             // Read next record
@@ -857,33 +971,39 @@ DBErrors CWalletDB::LoadWallet(CWallet* pwallet)
                 return DB_CORRUPT;
             }
 
-            // Try to be tolerant of single corrupt records:
-            string strType, strErr;
-            if (!ReadKeyValue(pwallet, ssKey, ssValue, wss, strType, strErr))
-            {
-                // losing keys is considered a catastrophic error, anything else
-                // we assume the user can live with:
-                if (IsKeyType(strType))
-                    result = DB_CORRUPT;
-                else
-                {
-                    // Leave other errors alone, if we try to fix them we might make things worse.
-                    fNoncriticalErrors = true; // ... but do warn the user there is something wrong.
-                    if (strType == "tx")
-                        // Rescan if there is a bad transaction record:
-                        SoftSetBoolArg("-rescan", true);
-                    if (strType == "cert")
-                    {
-                        LogPrint("cert", "%s():%d - cert error: rescan set to true\n", __func__, __LINE__);
-                        // Rescan if there is a bad transaction record:
-                        SoftSetBoolArg("-rescan", true);
-                    }
-                }
+            string strType;
+            try {
+                CDataStream(ssKey) >> strType;
+            } catch (...) {
+                strType.clear();
             }
+            if (strType == "tx" || strType == "cert") {
+                ssKey >> strType;
+                vTxRecords.emplace_back(std::move(ssKey), std::move(ssValue), strType);
+                continue;
+            }
+
+            string strErr;
+            if (!ReadKeyValue(pwallet, ssKey, ssValue, wss, strType, strErr))
+                onRecordError(strType);
             if (!strErr.empty())
                 LogPrintf("%s\n", strErr);
         }
         pcursor->close();
+
+        int64_t nStart = GetTimeMillis();
+        ReadWalletTxRecords(vTxRecords);
+        for (CWalletTxRecord& record : vTxRecords)
+        {
+            if (record.pwtx)
+                LoadWalletTxRecord(pwallet, *record.pwtx, record.hash, record.fUpgraded, wss);
+            else
+                onRecordError(record.strType);
+            if (!record.strErr.empty())
+                LogPrintf("%s\n", record.strErr);
+            record.pwtx.reset();
+        }
+        LogPrint("db", "%s(): read %u transactions and certificates in %dms\n", __func__, vTxRecords.size(), GetTimeMillis() - nStart);
     }
     catch (const boost::thread_interrupted&) {
         throw;
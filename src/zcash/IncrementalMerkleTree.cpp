@@ -1,4 +1,6 @@
+#include <algorithm>
 #include <stdexcept>
+#include <thread>
 
 #include <boost/foreach.hpp>
 
@@ -27,6 +29,18 @@ PedersenHash PedersenHash::combine(
     return res;
 }
 
+void PedersenHash::combine_batch(
+    const PedersenHash* nodes,
+    size_t nPairs,
+    size_t depth,
+    PedersenHash* out
+)
+{
+    for (size_t i = 0; i < nPairs; i++) {
+        out[i] = combine(nodes[2*i], nodes[2*i+1], depth);
+    }
+}
+
 PedersenHash PedersenHash::uncommitted() {
     PedersenHash res = PedersenHash();
 
@@ -51,6 +65,52 @@ SHA256Compress SHA256Compress::combine(
     return res;
 }
 
+void SHA256Compress::combine_batch(
+    const SHA256Compress* nodes,
+    size_t nPairs,
+    size_t depth,
+    SHA256Compress* out
+)
+{
+    static_assert(sizeof(SHA256Compress) == 32, "the nodes of a level must be contiguous 32 byte hashes");
+
+    // each pair is a 64 byte block of the level
+    SHA256Compress64(out->begin(), nodes->begin(), nPairs);
+}
+
+// Below this many pairs a level is combined by the calling thread
+static const size_t MIN_PAIRS_PER_THREAD = 512;
+
+template <typename Hash>
+static void combine_level(const std::vector<Hash>& level, size_t depth, std::vector<Hash>& next)
+{
+    const size_t nPairs = level.size() / 2;
+    next.resize(nPairs);
+    if (nPairs == 0) {
+        return;
+    }
+
+    size_t nThreads = std::min<size_t>(std::max(1U, std::thread::hardware_concurrency()),
+                                       nPairs / MIN_PAIRS_PER_THREAD);
+    if (nThreads <= 1) {
+        Hash::combine_batch(level.data(), nPairs, depth, next.data());
+        return;
+    }
+
+    const size_t nChunk = (nPairs + nThreads - 1) / nThreads;
+    std::vector<std::thread> threads;
+    for (size_t begin = nChunk; begin < nPairs; begin += nChunk) {
+        const size_t n = std::min(nChunk, nPairs - begin);
+        threads.emplace_back([&level, &next, begin, n, depth] {
+            Hash::combine_batch(level.data() + 2*begin, n, depth, next.data() + begin);
+        });
+    }
+    Hash::combine_batch(level.data(), nChunk, depth, next.data());
+    for (std::thread& t : threads) {
+        t.join();
+    }
+}
+
 template <size_t Depth, typename Hash>
 class PathFiller {
 private:
@@ -165,6 +225,59 @@ void IncrementalMerkleTree<Depth, Hash>::append(Hash obj) {
     }
 }
 
+// The leaves are merged level by level with the frontier of the tree: a level
+// is the node pending in parents (or the pending leaves), followed by the new
+// nodes of that height, and its pairs make the next level. An odd node left over
+// goes to parents, except for the last one or two leaves, which single appends
+// keep uncombined in left and right.
+template<size_t Depth, typename Hash>
+void IncrementalMerkleTree<Depth, Hash>::append(const std::vector<Hash>& objs) {
+    if (objs.empty()) {
+        return;
+    }
+
+    const size_t n = size();
+    if (objs.size() > (size_t(1) << Depth) - n) {
+        throw std::runtime_error("tree is full");
+    }
+
+    std::vector<Hash> level;
+    level.reserve(objs.size() + 2);
+    if (left) {
+        level.push_back(*left);
+    }
+    if (right) {
+        level.push_back(*right);
+    }
+    level.insert(level.end(), objs.begin(), objs.end());
+
+    // An even number of leaves keeps the last two of them in left and right
+    const size_t nKept = (level.size() % 2 == 0) ? 2 : 1;
+    left = level[level.size() - nKept];
+    right = (nKept == 2) ? std::optional<Hash>(level.back()) : std::nullopt;
+    level.resize(level.size() - nKept);
+
+    std::vector<Hash> next;
+    for (size_t d = 0; !level.empty(); d++) {
+        combine_level(level, d, next);
+        level.clear();
+
+        if (d < parents.size() && parents[d]) {
+            level.push_back(*parents[d]);
+            parents[d] = std::nullopt;
+        }
+        level.insert(level.end(), next.begin(), next.end());
+
+        if (level.size() % 2 == 1) {
+            if (d >= parents.size()) {
+                parents.resize(d + 1);
+            }
+            parents[d] = level.back();
+            level.pop_back();
+        }
+    }
+}
+
 // This is for allowing the witness to determine if a subtree has filled
 // to a particular depth, or for append() to ensure we're not appending
 // to a full tree.
@@ -348,6 +461,28 @@ void IncrementalWitness<Depth, Hash>::append(Hash obj) {
     }
 }
 
+template<size_t Depth, typename Hash>
+void IncrementalWitness<Depth, Hash>::append(const std::vector<Hash>& objs) {
+    size_t i = 0;
+    while (i < objs.size()) {
+        if (!cursor) {
+            append(objs[i++]);
+            continue;
+        }
+
+        // Fill the cursor subtree as far as the leaves go
+        const size_t nRoom = (size_t(1) << cursor_depth) - cursor->size();
+        const size_t nTake = std::min(nRoom, objs.size() - i);
+        cursor->append(std::vector<Hash>(objs.begin() + i, objs.begin() + i + nTake));
+        i += nTake;
+
+        if (cursor->is_complete(cursor_depth)) {
+            filled.push_back(cursor->root(cursor_depth));
+            cursor = std::nullopt;
+        }
+    }
+}
+
 template class IncrementalMerkleTree<INCREMENTAL_MERKLE_TREE_DEPTH, SHA256Compress>;
 template class IncrementalMerkleTree<INCREMENTAL_MERKLE_TREE_DEPTH_TESTING, SHA256Compress>;
 
@@ -4,6 +4,7 @@
 #include <array>
 #include <deque>
 #include <optional>
+#include <vector>
 
 #include <boost/static_assert.hpp>
 
@@ -102,6 +103,14 @@ public:
     size_t size() const;
 
     void append(Hash obj);
+    // Appends the leaves in order, leaving the tree as the same number of single appends
+    // would; the pairs of each level are combined in one batch, over several threads for
+    // the long levels. Throws, leaving the tree unchanged, if they don't fit in it.
+    void append(const std::vector<Hash>& objs);
+    template <typename It>
+    void append(It first, It last) {
+        append(std::vector<Hash>(first, last));
+    }
     Hash root() const {
         return root(Depth, std::deque<Hash>());
     }
@@ -180,6 +189,12 @@ public:
     }
 
     void append(Hash obj);
+    // Appends the leaves in order, filling the cursor subtree with batch appends
+    void append(const std::vector<Hash>& objs);
+    template <typename It>
+    void append(It first, It last) {
+        append(std::vector<Hash>(first, last));
+    }
 
     ADD_SERIALIZE_METHODS;
 
@@ -224,6 +239,13 @@ public:
         const SHA256Compress& b,
         size_t depth
     );
+    // Combines the nPairs pairs of nodes (nodes[2*i], nodes[2*i+1]) into out[i]
+    static void combine_batch(
+        const SHA256Compress* nodes,
+        size_t nPairs,
+        size_t depth,
+        SHA256Compress* out
+    );
 
     static SHA256Compress uncommitted() {
         return SHA256Compress();
@@ -240,6 +262,13 @@ public:
         const PedersenHash& b,
         size_t depth
     );
+    // Combines the nPairs pairs of nodes (nodes[2*i], nodes[2*i+1]) into out[i]
+    static void combine_batch(
+        const PedersenHash* nodes,
+        size_t nPairs,
+        size_t depth,
+        PedersenHash* out
+    );
 
     static PedersenHash uncommitted();
 };
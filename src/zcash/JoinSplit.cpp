@@ -4,6 +4,8 @@
 
 #include "zcash/util.h"
 
+#include <algorithm>
+#include <atomic>
 #include <memory>
 
 #include <boost/foreach.hpp>
@@ -22,6 +24,10 @@
 #include "streams.h"
 #include "version.h"
 
+#ifdef MULTICORE
+#include <omp.h>
+#endif
+
 using namespace libsnark;
 
 namespace libzcash {
@@ -30,6 +36,55 @@ namespace libzcash {
 
 static CCriticalSection cs_ParamsIO;
 
+// 0 until set, for all the cores
+static std::atomic<int> nProvingThreads{0};
+static std::atomic<int> nActiveProofs{0};
+
+void SetProvingThreads(int nThreads)
+{
+    nProvingThreads = std::max(0, nThreads);
+}
+
+int GetProvingThreads()
+{
+#ifdef MULTICORE
+    if (nProvingThreads == 0)
+        return omp_get_num_procs();
+#endif
+    return std::max(1, nProvingThreads.load());
+}
+
+// The share of the proving threads of the proof computed by the calling thread,
+// for as long as it is in scope
+class ProvingThreadsShare
+{
+public:
+    ProvingThreadsShare()
+    {
+        const int nActive = ++nActiveProofs;
+#ifdef MULTICORE
+        nPrevThreads = omp_get_max_threads();
+        omp_set_num_threads(std::max(1, GetProvingThreads() / nActive));
+#endif
+    }
+
+    ~ProvingThreadsShare()
+    {
+        --nActiveProofs;
+#ifdef MULTICORE
+        omp_set_num_threads(nPrevThreads);
+#endif
+    }
+
+    ProvingThreadsShare(const ProvingThreadsShare&) = delete;
+    ProvingThreadsShare& operator=(const ProvingThreadsShare&) = delete;
+
+private:
+#ifdef MULTICORE
+    int nPrevThreads;
+#endif
+};
+
 template<typename T>
 void saveToFile(const std::string& path, T& obj) {
     LOCK(cs_ParamsIO);
@@ -359,6 +414,7 @@ public:
             throw std::runtime_error(strprintf("could not load param file at %s", pkPath));
         }
 
+        ProvingThreadsShare threadsShare;
         return PHGRProof(r1cs_ppzksnark_prover_streaming<ppzksnark_ppT>(
             fh,
             primary_input,
@@ -23,6 +23,15 @@ static constexpr size_t GROTH_PROOF_SIZE = (
 typedef std::array<unsigned char, GROTH_PROOF_SIZE> GrothProof;
 typedef boost::variant<PHGRProof, GrothProof> SproutProof;
 
+//! The threads the PHGR proofs computed at the same time share, 0 for all the cores
+static const int DEFAULT_PROVER_THREADS = 0;
+
+// Each proof started takes an equal share of the proving threads: a lone proof
+// runs its multiexps and FFTs over all of them, while as many proofs as threads
+// run on one core each. Only takes effect in builds with OpenMP (MULTICORE).
+void SetProvingThreads(int nThreads);
+int GetProvingThreads();
+
 class JSInput {
 public:
     ZCIncrementalWitness witness;
@@ -4,24 +4,31 @@
 #include <thread>
 #include <unistd.h>
 #include <boost/filesystem.hpp>
+#include <boost/thread.hpp>
 
 #include "coins.h"
 #include "util.h"
 #include "init.h"
 #include "primitives/transaction.h"
+#include "primitives/certificate.h"
 #include "base58.h"
 #include "crypto/equihash.h"
 #include "chain.h"
 #include "chainparams.h"
+#include "checkqueue.h"
 #include "consensus/validation.h"
 #include "main.h"
 #include "miner.h"
 #include "pow.h"
 #include "rpc/server.h"
+#include "sc/proofverifier.h"
+#include "sc/sidechainTxsCommitmentBuilder.h"
+#include "script/interpreter.h"
 #include "script/sign.h"
 #include "sodium.h"
 #include "streams.h"
 #include "txdb.h"
+#include "txmempool.h"
 #include "utiltest.h"
 #include "wallet/wallet.h"
 
@@ -161,8 +168,53 @@ double benchmark_verify_joinsplit(const JSDescription &joinsplit)
     return timer_stop(tv_start);
 }
 
+namespace {
+
+// As CJoinSplitCheck, except that the sample proof is not expected to verify, hence every copy is verified anyway
+class CSampleJoinSplitCheck
+{
+    const JSDescription* pjoinsplit = nullptr;
+
+public:
+    CSampleJoinSplitCheck() {}
+    explicit CSampleJoinSplitCheck(const JSDescription& joinsplit) : pjoinsplit(&joinsplit) {}
+
+    bool operator()()
+    {
+        uint256 pubKeyHash;
+        auto verifier = libzcash::ProofVerifier::Strict();
+        pjoinsplit->Verify(*pzcashParams, verifier, pubKeyHash);
+        return true;
+    }
+};
+
+}
+
+double benchmark_verify_joinsplit_block(const JSDescription &joinsplit, size_t nJoinSplits)
+{
+    // the queue and threads ConnectBlock verifies the proofs of a block with
+    CCheckQueue<CSampleJoinSplitCheck> queue(1);
+    boost::thread_group workers;
+    for (int i = 0; i < nScriptCheckThreads - 1; i++)
+        workers.create_thread([&queue] { queue.Thread(); });
+    std::vector<CSampleJoinSplitCheck> vChecks(nJoinSplits, CSampleJoinSplitCheck(joinsplit));
+
+    struct timeval tv_start;
+    timer_start(tv_start);
+    {
+        CCheckQueueControl<CSampleJoinSplitCheck> control(&queue);
+        control.Add(vChecks);
+        control.Wait();
+    }
+    double elapsed = timer_stop(tv_start);
+
+    workers.interrupt_all();
+    workers.join_all();
+    return elapsed;
+}
+
 #ifdef ENABLE_MINING
-double benchmark_solve_equihash()
+double benchmark_solve_equihash(EhSolverWorkspace* workspace)
 {
     CBlock pblock;
     CEquihashInput I{pblock};
@@ -185,17 +237,20 @@ double benchmark_solve_equihash()
     timer_start(tv_start);
     std::set<std::vector<unsigned int>> solns;
     EhOptimisedSolveUncancellable(n, k, eh_state,
-                                  [](std::vector<unsigned char> soln) { return false; });
+                                  [](std::vector<unsigned char> soln) { return false; }, workspace);
     return timer_stop(tv_start);
 }
 
-std::vector<double> benchmark_solve_equihash_threaded(int nThreads)
+std::vector<double> benchmark_solve_equihash_threaded(int nThreads, std::vector<EhSolverWorkspace>& workspaces)
 {
     std::vector<double> ret;
     std::vector<std::future<double>> tasks;
     std::vector<std::thread> threads;
+    // as for the miner threads, each thread solves with its own workspace
+    if (workspaces.size() < (size_t)nThreads)
+        workspaces.resize(nThreads);
     for (int i = 0; i < nThreads; i++) {
-        std::packaged_task<double(void)> task(&benchmark_solve_equihash);
+        std::packaged_task<double(void)> task(std::bind(&benchmark_solve_equihash, &workspaces[i]));
         tasks.emplace_back(task.get_future());
         threads.emplace_back(std::move(task));
     }
@@ -478,3 +533,235 @@ double benchmark_listunspent()
     auto unspent = listunspent(params, false);
     return timer_stop(tv_start);
 }
+
+double benchmark_selectcoins(CAmount amount)
+{
+    LOCK2(cs_main, pwalletMain->cs_wallet);
+    std::vector<COutput> vCoins;
+    std::set<std::pair<const CWalletTransactionBase*, unsigned int> > setCoins;
+    CAmount nValue = 0;
+
+    struct timeval tv_start;
+    timer_start(tv_start);
+    pwalletMain->AvailableCoins(vCoins);
+    pwalletMain->SelectCoinsMinConf(amount, 1, 6, vCoins, setCoins, nValue);
+    return timer_stop(tv_start);
+}
+
+double benchmark_mempool_admission(size_t nTxs, bool fWithIndexes)
+{
+    // Number of addresses the admitted transactions pay to, each one collecting many mempool deltas
+    const size_t NUM_ADDRESSES = 1000;
+
+    std::vector<CScript> addressScripts;
+    for (size_t i = 0; i < NUM_ADDRESSES; i++) {
+        CKey priv;
+        priv.MakeNewKey(true);
+        addressScripts.push_back(GetScriptForDestination(priv.GetPubKey().GetID()));
+    }
+
+    // A single funding transaction provides the input of every admitted transaction
+    CMutableTransaction m_funding_tx;
+    for (size_t i = 0; i < nTxs; i++)
+        m_funding_tx.addOut(CTxOut(100000, addressScripts[i % NUM_ADDRESSES]));
+    CTransaction funding_tx(m_funding_tx);
+
+    CCoinsView dummy;
+    CCoinsViewCache view(&dummy);
+    view.ModifyCoins(funding_tx.GetHash())->From(funding_tx, 1);
+
+    std::vector<CTransaction> txs;
+    txs.reserve(nTxs);
+    for (size_t i = 0; i < nTxs; i++) {
+        CMutableTransaction mtx;
+        mtx.vin.emplace_back(funding_tx.GetHash(), i);
+        mtx.addOut(CTxOut(90000, addressScripts[(i * 7 + 1) % NUM_ADDRESSES]));
+        txs.push_back(CTransaction(mtx));
+    }
+
+    CTxMemPool pool(::minRelayTxFee, DEFAULT_MAX_MEMPOOL_SIZE_MB * 1000000);
+    struct timeval tv_start;
+    timer_start(tv_start);
+    for (const CTransaction& tx : txs) {
+        CTxMemPoolEntry entry(tx, 10000, GetTime(), 1.0, 1);
+        pool.addUnchecked(tx.GetHash(), entry);
+        if (fWithIndexes) {
+            pool.addAddressIndex(tx, entry.GetTime(), view);
+            pool.addSpentIndex(tx, view);
+        }
+    }
+    return timer_stop(tv_start);
+}
+
+double benchmark_cert_block_sighash(size_t nCerts, bool fMemoized)
+{
+    // Every certificate spends many inputs and carries a proof of the maximum size
+    const size_t NUM_INPUTS = 50;
+
+    CBlock block;
+    for (size_t i = 0; i < nCerts; i++) {
+        CMutableScCertificate mcert;
+        mcert.scId = GetRandHash();
+        mcert.epochNumber = 1;
+        mcert.quality = 1;
+        mcert.scProof = CScProof(std::vector<unsigned char>(CScProof::MaxByteSize(), (unsigned char)i));
+        for (size_t j = 0; j < NUM_INPUTS; j++)
+            mcert.vin.emplace_back(GetRandHash(), j);
+        mcert.addOut(CTxOut(100000, CScript() << OP_TRUE));
+        block.vcert.push_back(CScCertificate(mcert));
+    }
+
+    const CScript scriptCode = CScript() << OP_TRUE;
+    struct timeval tv_start;
+    timer_start(tv_start);
+    // the checks of a block compute its size and the signature hash of every input of its certificates
+    ::GetSerializeSize(block, SER_NETWORK, PROTOCOL_VERSION);
+    for (const CScCertificate& cert : block.vcert) {
+        for (unsigned int nIn = 0; nIn < cert.GetVin().size(); nIn++) {
+            if (!fMemoized)
+                cert.SetSigHashPrefix(nullptr);
+            SignatureHash(scriptCode, cert, nIn, SIGHASH_ALL);
+        }
+    }
+    return timer_stop(tv_start);
+}
+
+double benchmark_verify_cert_proofs(size_t nCerts)
+{
+    CScProofVerifier verifier(CScProofVerifier::Verification::Strict, CScProofVerifier::Priority::High);
+    size_t nLoaded = 0;
+    {
+        LOCK(mempool->cs);
+        for (const auto& entry : mempool->mapCertificate) {
+            if (nLoaded == nCerts)
+                break;
+            verifier.LoadDataForCertVerification(*pcoinsTip, entry.second.GetCertificate());
+            nLoaded++;
+        }
+    }
+    if (nLoaded == 0)
+        throw std::runtime_error("No certificate in the mempool");
+
+    // the proofs of the mempool certificates are cached as verified
+    CVerifiedProofCache::GetInstance().Clear();
+
+    struct timeval tv_start;
+    timer_start(tv_start);
+    verifier.BatchVerify();
+    return timer_stop(tv_start);
+}
+
+double benchmark_verify_csw_proofs(size_t nTxs)
+{
+    CScProofVerifier verifier(CScProofVerifier::Verification::Strict, CScProofVerifier::Priority::High);
+    size_t nLoaded = 0;
+    {
+        LOCK(mempool->cs);
+        for (const auto& entry : mempool->mapTx) {
+            if (nLoaded == nTxs)
+                break;
+            const CTransaction& tx = entry.second.GetTx();
+            if (tx.GetVcswCcIn().empty())
+                continue;
+            verifier.LoadDataForCswVerification(*pcoinsTip, tx);
+            nLoaded++;
+        }
+    }
+    if (nLoaded == 0)
+        throw std::runtime_error("No transaction with ceased sidechain withdrawals in the mempool");
+
+    CVerifiedProofCache::GetInstance().Clear();
+
+    struct timeval tv_start;
+    timer_start(tv_start);
+    verifier.BatchVerify();
+    return timer_stop(tv_start);
+}
+
+double benchmark_sc_txs_commitment(size_t nSidechains, size_t nFtsPerSidechain)
+{
+    std::vector<uint256> scIds;
+    for (size_t i = 0; i < nSidechains; i++)
+        scIds.push_back(GetRandHash());
+
+    CMutableTransaction mtx;
+    mtx.nVersion = SC_TX_VERSION;
+    mtx.vin.emplace_back(GetRandHash(), 0);
+    for (size_t i = 0; i < nFtsPerSidechain; i++) {
+        for (const uint256& scId : scIds)
+            mtx.add(CTxForwardTransferOut(scId, 1, GetRandHash(), uint160()));
+    }
+    CTransaction tx(mtx);
+
+    struct timeval tv_start;
+    timer_start(tv_start);
+    SidechainTxsCommitmentBuilder builder;
+    builder.add(tx);
+    builder.getCommitment();
+    return timer_stop(tv_start);
+}
+
+double benchmark_accept_certificates()
+{
+    std::vector<CScCertificate> certs;
+    {
+        LOCK(mempool->cs);
+        for (const auto& entry : mempool->mapCertificate)
+            certs.push_back(entry.second.GetCertificate());
+    }
+    if (certs.empty())
+        throw std::runtime_error("No certificate in the mempool");
+
+    // the certificates of the mempool are accepted again into an empty one, verifying their proofs
+    CTxMemPool pool(::minRelayTxFee, DEFAULT_MAX_MEMPOOL_SIZE_MB * 1000000);
+    CVerifiedProofCache::GetInstance().Clear();
+
+    struct timeval tv_start;
+    timer_start(tv_start);
+    for (const CScCertificate& cert : certs) {
+        CValidationState state;
+        AcceptCertificateToMemoryPool(pool, state, cert, LimitFreeFlag::OFF, RejectAbsurdFeeFlag::OFF,
+                                      MempoolProofVerificationFlag::SYNC);
+    }
+    return timer_stop(tv_start);
+}
+
+double benchmark_create_new_block()
+{
+    CScript scriptPubKey = CScript() << OP_TRUE;
+
+    struct timeval tv_start;
+    timer_start(tv_start);
+    std::unique_ptr<CBlockTemplate> pblocktemplate(CreateNewBlock(scriptPubKey));
+    auto duration = timer_stop(tv_start);
+
+    if (!pblocktemplate)
+        throw std::runtime_error("Failed to create a new block");
+    return duration;
+}
+
+double benchmark_connect_tip_block()
+{
+    // the tip block is disconnected from a view of the chainstate, and connected again on it
+    CBlockIndex* pindex = chainActive.Tip();
+    CBlock block;
+    if (pindex == nullptr || !ReadBlockFromDisk(block, pindex))
+        throw std::runtime_error("Failed to read the tip block");
+
+    CCoinsViewCache view(pcoinsTip);
+    CValidationState state;
+    if (!DisconnectBlock(block, state, pindex, view, flagLevelDBIndexesWrite::OFF))
+        throw std::runtime_error("Failed to disconnect the tip block");
+
+    CVerifiedProofCache::GetInstance().Clear();
+
+    struct timeval tv_start;
+    timer_start(tv_start);
+    bool fConnected = ConnectBlock(block, state, pindex, view, chainActive, flagBlockProcessingType::CHECK_ONLY,
+                                   flagScRelatedChecks::ON, flagScProofVerification::ON, flagLevelDBIndexesWrite::OFF);
+    auto duration = timer_stop(tv_start);
+
+    if (!fConnected)
+        throw std::runtime_error("Failed to connect the tip block: " + state.GetRejectReason());
+    return duration;
+}
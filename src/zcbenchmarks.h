@@ -4,13 +4,16 @@
 #include <sys/time.h>
 #include <stdlib.h>
 
+class EhSolverWorkspace;
+
 extern double benchmark_sleep();
 extern double benchmark_parameter_loading();
 extern double benchmark_create_joinsplit();
 extern std::vector<double> benchmark_create_joinsplit_threaded(int nThreads);
-extern double benchmark_solve_equihash();
-extern std::vector<double> benchmark_solve_equihash_threaded(int nThreads);
+extern double benchmark_solve_equihash(EhSolverWorkspace* workspace = nullptr);
+extern std::vector<double> benchmark_solve_equihash_threaded(int nThreads, std::vector<EhSolverWorkspace>& workspaces);
 extern double benchmark_verify_joinsplit(const JSDescription &joinsplit);
+extern double benchmark_verify_joinsplit_block(const JSDescription &joinsplit, size_t nJoinSplits);
 extern double benchmark_verify_equihash();
 extern double benchmark_large_tx();
 extern double benchmark_try_decrypt_notes(size_t nAddrs);
@@ -19,5 +22,14 @@ extern double benchmark_connectblock_slow();
 extern double benchmark_sendtoaddress(CAmount amount);
 extern double benchmark_loadwallet();
 extern double benchmark_listunspent();
+extern double benchmark_selectcoins(CAmount amount);
+extern double benchmark_mempool_admission(size_t nTxs, bool fWithIndexes);
+extern double benchmark_cert_block_sighash(size_t nCerts, bool fMemoized);
+extern double benchmark_verify_cert_proofs(size_t nCerts);
+extern double benchmark_verify_csw_proofs(size_t nTxs);
+extern double benchmark_sc_txs_commitment(size_t nSidechains, size_t nFtsPerSidechain);
+extern double benchmark_accept_certificates();
+extern double benchmark_create_new_block();
+extern double benchmark_connect_tip_block();
 
 #endif
@@ -17,6 +17,8 @@
 #include "forks/fork10_nonceasingsidechainfork.h"
 #include "forks/fork11_shieldedpooldeprecationfork.h"
 
+#include <algorithm>
+
 namespace zen {
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -43,6 +45,7 @@ const Fork* ForkManager::getHighestFork() const
  */
 void ForkManager::selectNetwork(const CBaseChainParams::Network network) {
     currentNetwork = network;
+    compileSchedule();
 }
 
 /**
@@ -254,16 +257,14 @@ const Fork* ForkManager::getForkAtHeight(int height) const {
         return nullptr;
     }
 
-    // Iterate through all the forks until fork height is higher than block height or there are no more forks
-    std::list<Fork*>::const_iterator lastIterator = forks.begin();
-    for (std::list<Fork*>::const_iterator iterator = forks.begin(); iterator != forks.end(); ++iterator) {
-        if ((*iterator)->getHeight(currentNetwork) > height) {
-            break;
-        }
-        lastIterator = iterator;
-    }
+    // Find the first fork whose height is higher than block height
+    auto next = std::upper_bound(forkSchedule.begin(), forkSchedule.end(), height,
+                                 [](int h, const std::pair<int, const Fork*>& entry) { return h < entry.first; });
     // return the last fork before that fork
-    return *lastIterator;
+    if (next == forkSchedule.begin()) {
+        return forkSchedule.front().second;
+    }
+    return std::prev(next)->second;
 }
 
 /**
@@ -275,6 +276,25 @@ void ForkManager::registerFork(Fork* fork) {
     forks.push_back(fork);
     // sort list by height in the MAIN network. We assume that forks will always keep the same relative height order regardless of the network used
     forks.sort([](Fork* fork1, Fork* fork2) { return fork1->getHeight(CBaseChainParams::Network::MAIN) < fork2->getHeight(CBaseChainParams::Network::MAIN); });
+    compileSchedule();
+}
+
+/**
+ * @brief compileSchedule rebuilds the fork schedule of the currently selected network.
+ * The heights are made non decreasing, each one being the highest height of the forks up to it: a fork
+ * followed, in MAIN order, by one with a higher height is never returned past the latter, as when
+ * getForkAtHeight scanned the list and stopped at the first fork higher than the block
+ */
+void ForkManager::compileSchedule() {
+    forkSchedule.clear();
+    forkSchedule.reserve(forks.size());
+    for (const Fork* fork : forks) {
+        int height = fork->getHeight(currentNetwork);
+        if (!forkSchedule.empty()) {
+            height = std::max(height, forkSchedule.back().first);
+        }
+        forkSchedule.push_back(std::make_pair(height, fork));
+    }
 }
 
 }
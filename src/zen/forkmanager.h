@@ -8,6 +8,7 @@
 #include "chainparamsbase.h"
 #include "amount.h"
 #include <list>
+#include <vector>
 #include "zen/replayprotectionlevel.h"
 #include "script/standard.h"
 #include "forks/fork.h"
@@ -171,6 +172,17 @@ private:
      */
     std::list<Fork*> forks;
     
+    /**
+     * @brief compileSchedule rebuilds the fork schedule of the currently selected network
+     */
+    void compileSchedule();
+
+    /**
+     * @brief forkSchedule the forks in the same order as forks, each one with the height on the currently selected
+     * network from which it can be active, for a binary search by height
+     */
+    std::vector<std::pair</*height*/int, const Fork*>> forkSchedule;
+
     /**
      * @brief currentNetwork currently selected network
      */
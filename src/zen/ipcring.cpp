@@ -0,0 +1,250 @@
+#include "zen/ipcring.h"
+
+#include "tinyformat.h"
+
+#include <new>
+#include <string.h>
+
+#ifndef WIN32
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static uint64_t AlignRecord(uint64_t nSize)
+{
+    return (nSize + IPC_RING_ALIGNMENT - 1) / IPC_RING_ALIGNMENT * IPC_RING_ALIGNMENT;
+}
+
+bool CIpcRingWriter::Open(const std::string& strPathIn, uint64_t nCapacity, std::string& strError)
+{
+    Close();
+#ifdef WIN32
+    strError = "memory mapped rings are not supported on this platform";
+    return false;
+#else
+    nCapacity = AlignRecord(nCapacity);
+    if (nCapacity < 2 * sizeof(CIpcRingRecord)) {
+        strError = strprintf("ring capacity %u too small", nCapacity);
+        return false;
+    }
+
+    // blocks are public data: the readers may run as other users
+    int fd = open(strPathIn.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        strError = strprintf("cannot create %s: %s", strPathIn, strerror(errno));
+        return false;
+    }
+    const size_t nSize = sizeof(CIpcRingHeader) + nCapacity;
+    if (ftruncate(fd, nSize) != 0) {
+        strError = strprintf("cannot size %s: %s", strPathIn, strerror(errno));
+        close(fd);
+        return false;
+    }
+    void* p = mmap(nullptr, nSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) {
+        strError = strprintf("cannot map %s: %s", strPathIn, strerror(errno));
+        return false;
+    }
+
+    pheader = new (p) CIpcRingHeader();
+    pheader->nCapacity = nCapacity;
+    pheader->nBegin.store(0, std::memory_order_relaxed);
+    pheader->nEnd.store(0, std::memory_order_relaxed);
+    pheader->nSequence.store(0, std::memory_order_relaxed);
+    pheader->nVersion = CIpcRingHeader::VERSION;
+    // readers check the magic last
+    std::atomic_thread_fence(std::memory_order_release);
+    pheader->nMagic = CIpcRingHeader::MAGIC;
+
+    pdata = static_cast<unsigned char*>(p) + sizeof(CIpcRingHeader);
+    nMapSize = nSize;
+    strPath = strPathIn;
+    return true;
+#endif
+}
+
+void CIpcRingWriter::Close()
+{
+#ifndef WIN32
+    if (pheader) {
+        munmap(pheader, nMapSize);
+        unlink(strPath.c_str());
+    }
+#endif
+    pheader = nullptr;
+    pdata = nullptr;
+    nMapSize = 0;
+}
+
+uint64_t CIpcRingWriter::RecordSpan(uint64_t nOffset) const
+{
+    const uint64_t nCapacity = pheader->nCapacity;
+    const uint64_t nPos = nOffset % nCapacity;
+    if (nCapacity - nPos < sizeof(CIpcRingRecord))
+        return nCapacity - nPos;
+    CIpcRingRecord record;
+    memcpy(&record, pdata + nPos, sizeof(record));
+    return AlignRecord(sizeof(record) + record.nSize);
+}
+
+int64_t CIpcRingWriter::Append(CIpcRingRecord::Type type, const std::vector<std::pair<const unsigned char*, size_t> >& vParts)
+{
+    if (!pheader)
+        return -1;
+
+    const uint64_t nCapacity = pheader->nCapacity;
+    uint64_t nPayload = 0;
+    for (const auto& part : vParts)
+        nPayload += part.second;
+    const uint64_t nSpan = AlignRecord(sizeof(CIpcRingRecord) + nPayload);
+    if (nSpan > nCapacity || nPayload > UINT32_MAX)
+        return -1;
+
+    const uint64_t nEnd = pheader->nEnd.load(std::memory_order_relaxed);
+    const uint64_t nPos = nEnd % nCapacity;
+    // the record does not wrap: the rest of the data is skipped if it does not fit
+    const uint64_t nPad = nCapacity - nPos < nSpan ? nCapacity - nPos : 0;
+    const uint64_t nStart = nEnd + nPad;
+    const uint64_t nNewEnd = nStart + nSpan;
+
+    // drop the oldest records the new one overwrites, before overwriting them
+    if (nNewEnd > nCapacity) {
+        uint64_t nBegin = pheader->nBegin.load(std::memory_order_relaxed);
+        const uint64_t nLimit = nNewEnd - nCapacity;
+        while (nBegin < nLimit && nBegin < nEnd)
+            nBegin += RecordSpan(nBegin);
+        if (nBegin < nLimit)
+            nBegin = nStart;
+        pheader->nBegin.store(nBegin, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+    }
+
+    if (nPad >= sizeof(CIpcRingRecord)) {
+        CIpcRingRecord pad;
+        pad.nType = CIpcRingRecord::RECORD_PAD;
+        pad.nSize = nPad - sizeof(pad);
+        pad.nSequence = pheader->nSequence.load(std::memory_order_relaxed);
+        memcpy(pdata + nPos, &pad, sizeof(pad));
+    }
+
+    CIpcRingRecord record;
+    record.nType = type;
+    record.nSize = nPayload;
+    record.nSequence = pheader->nSequence.load(std::memory_order_relaxed);
+    unsigned char* p = pdata + nStart % nCapacity;
+    memcpy(p, &record, sizeof(record));
+    p += sizeof(record);
+    for (const auto& part : vParts) {
+        if (part.second > 0)
+            memcpy(p, part.first, part.second);
+        p += part.second;
+    }
+
+    pheader->nSequence.store(record.nSequence + 1, std::memory_order_relaxed);
+    pheader->nEnd.store(nNewEnd, std::memory_order_release);
+    return nStart;
+}
+
+bool CIpcRingReader::Open(const std::string& strPath, std::string& strError)
+{
+    Close();
+#ifdef WIN32
+    strError = "memory mapped rings are not supported on this platform";
+    return false;
+#else
+    int fd = open(strPath.c_str(), O_RDONLY);
+    if (fd < 0) {
+        strError = strprintf("cannot open %s: %s", strPath, strerror(errno));
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(CIpcRingHeader)) {
+        strError = strprintf("%s is not a ring", strPath);
+        close(fd);
+        return false;
+    }
+    void* p = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) {
+        strError = strprintf("cannot map %s: %s", strPath, strerror(errno));
+        return false;
+    }
+    const CIpcRingHeader* pheaderIn = static_cast<const CIpcRingHeader*>(p);
+    const bool fValid = pheaderIn->nMagic == CIpcRingHeader::MAGIC;
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (!fValid || pheaderIn->nVersion != CIpcRingHeader::VERSION ||
+        pheaderIn->nCapacity > (uint64_t)st.st_size - sizeof(CIpcRingHeader)) {
+        strError = strprintf("%s is not a ring of version %d", strPath, CIpcRingHeader::VERSION);
+        munmap(p, st.st_size);
+        return false;
+    }
+
+    pheader = pheaderIn;
+    pdata = static_cast<const unsigned char*>(p) + sizeof(CIpcRingHeader);
+    nMapSize = st.st_size;
+    nPos = pheader->nEnd.load(std::memory_order_acquire);
+    return true;
+#endif
+}
+
+void CIpcRingReader::Close()
+{
+#ifndef WIN32
+    if (pheader)
+        munmap(const_cast<CIpcRingHeader*>(pheader), nMapSize);
+#endif
+    pheader = nullptr;
+    pdata = nullptr;
+    nMapSize = 0;
+}
+
+CIpcRingReader::Result CIpcRingReader::Next(CIpcRingRecord& record, std::vector<unsigned char>& vPayload)
+{
+    if (!pheader)
+        return EMPTY;
+
+    const uint64_t nCapacity = pheader->nCapacity;
+    while (true) {
+        const uint64_t nEnd = pheader->nEnd.load(std::memory_order_acquire);
+        if (nPos == nEnd)
+            return EMPTY;
+        uint64_t nBegin = pheader->nBegin.load(std::memory_order_acquire);
+        if (nPos < nBegin || nPos > nEnd) {
+            nPos = nBegin;
+            return LOST;
+        }
+
+        const uint64_t nRingPos = nPos % nCapacity;
+        if (nCapacity - nRingPos < sizeof(CIpcRingRecord)) {
+            nPos += nCapacity - nRingPos;
+            continue;
+        }
+        memcpy(&record, pdata + nRingPos, sizeof(record));
+        // the size may be garbage if the record is being overwritten
+        const bool fSane = record.nSize <= nCapacity - nRingPos - sizeof(record);
+        if (fSane && record.nType != CIpcRingRecord::RECORD_PAD) {
+            const unsigned char* p = pdata + nRingPos + sizeof(record);
+            vPayload.assign(p, p + record.nSize);
+        }
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        nBegin = pheader->nBegin.load(std::memory_order_relaxed);
+        if (nPos < nBegin) {
+            nPos = nBegin;
+            return LOST;
+        }
+        if (!fSane) {
+            // not a record of the writer: start over from the last one written
+            nPos = nEnd;
+            return LOST;
+        }
+
+        nPos += AlignRecord(sizeof(record) + record.nSize);
+        if (record.nType != CIpcRingRecord::RECORD_PAD)
+            return OK;
+    }
+}
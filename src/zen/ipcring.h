@@ -0,0 +1,134 @@
+#ifndef ZEN_IPCRING_H
+#define ZEN_IPCRING_H
+
+#include <atomic>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+/**
+ * A ring of records in a memory mapped file, written by zend and read by the processes of the same
+ * host mapping the same file, such as co-located sidechain nodes: the blocks they follow are then
+ * read in place, without going through hex, json, tcp and websocket framing.
+ *
+ * The file is a CIpcRingHeader followed by nCapacity bytes of data. Records are laid out in the data
+ * as a stream, each one a CIpcRingRecord followed by its payload, padded to an 8 bytes boundary. A
+ * record never wraps: if it does not fit before the end of the data, the writer fills the rest with a
+ * RECORD_PAD record (or leaves it, if not even the header of one fits) and writes it from the start.
+ * The offsets of the stream grow forever, the position of an offset in the data being
+ * offset % nCapacity.
+ *
+ * [nBegin, nEnd) are the offsets of the records whole in the ring. The writer moves nBegin forward
+ * before overwriting the oldest records, and nEnd once a record is written, so a reader at nPos:
+ *  - reads nEnd (acquire), and has nothing to read if nPos == nEnd;
+ *  - has lost records if nPos < nBegin, and has to resync, for instance through the control socket;
+ *  - else copies the record at nPos, then reads nBegin again after an acquire fence: if nPos < nBegin
+ *    the record may have been overwritten while being copied, and is lost as well.
+ */
+struct CIpcRingHeader
+{
+    static constexpr uint32_t MAGIC = 0x474e525a; // "ZRNG"
+    static constexpr uint32_t VERSION = 1;
+
+    uint32_t nMagic;
+    uint32_t nVersion;
+    uint64_t nCapacity;
+    std::atomic<uint64_t> nBegin;
+    std::atomic<uint64_t> nEnd;
+    //! Sequence number of the next record
+    std::atomic<uint64_t> nSequence;
+};
+
+struct CIpcRingRecord
+{
+    enum Type : uint32_t {
+        RECORD_PAD = 0,
+        //! A new tip: height (int32 LE) and hash (32 bytes), after the header and the block of it
+        RECORD_TIP = 1,
+        //! Height (int32 LE), hash (32 bytes) and the header serialized as in the p2p messages
+        RECORD_HEADER = 2,
+        //! Height (int32 LE), hash (32 bytes) and the block serialized as in the p2p messages
+        RECORD_BLOCK = 3,
+    };
+
+    uint32_t nType;
+    //! Of the payload, without padding
+    uint32_t nSize;
+    uint64_t nSequence;
+};
+
+static const uint64_t IPC_RING_ALIGNMENT = 8;
+//! -wsipcringsize default, in MiB
+static const unsigned int DEFAULT_IPC_RING_SIZE = 64;
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "the ring is shared by processes through lock free atomics");
+static_assert(sizeof(CIpcRingHeader) % IPC_RING_ALIGNMENT == 0 && sizeof(CIpcRingRecord) % IPC_RING_ALIGNMENT == 0,
+              "records are aligned");
+
+/** The writer of the ring, owning the file */
+class CIpcRingWriter
+{
+public:
+    CIpcRingWriter() {}
+    ~CIpcRingWriter() { Close(); }
+
+    CIpcRingWriter(const CIpcRingWriter&) = delete;
+    CIpcRingWriter& operator=(const CIpcRingWriter&) = delete;
+
+    //! Creates, or truncates, the file at strPath with nCapacity bytes of data; false with strError on failure
+    bool Open(const std::string& strPath, uint64_t nCapacity, std::string& strError);
+    void Close();
+    bool IsOpen() const { return pheader != nullptr; }
+
+    /**
+     * Appends a record made of the concatenation of the parts, returning the offset it was written
+     * at, or -1 if it is larger than the ring or the ring is not open. A single writer is expected.
+     */
+    int64_t Append(CIpcRingRecord::Type type, const std::vector<std::pair<const unsigned char*, size_t> >& vParts);
+
+    uint64_t GetCapacity() const { return pheader ? pheader->nCapacity : 0; }
+    uint64_t GetEnd() const { return pheader ? pheader->nEnd.load(std::memory_order_relaxed) : 0; }
+
+private:
+    CIpcRingHeader* pheader = nullptr;
+    unsigned char* pdata = nullptr;
+    size_t nMapSize = 0;
+    std::string strPath;
+
+    //! The bytes of the record at nOffset in the ring, padding included
+    uint64_t RecordSpan(uint64_t nOffset) const;
+};
+
+/** A reader of the ring, mapping it read only */
+class CIpcRingReader
+{
+public:
+    enum Result { OK, EMPTY, LOST };
+
+    CIpcRingReader() {}
+    ~CIpcRingReader() { Close(); }
+
+    CIpcRingReader(const CIpcRingReader&) = delete;
+    CIpcRingReader& operator=(const CIpcRingReader&) = delete;
+
+    //! Maps the ring at strPath and starts at its end; false with strError on failure
+    bool Open(const std::string& strPath, std::string& strError);
+    void Close();
+
+    /**
+     * Copies the next record: EMPTY if there is none yet, LOST if the reader lagged behind the writer
+     * and the records it missed were overwritten, in which case it continues from the oldest one.
+     */
+    Result Next(CIpcRingRecord& record, std::vector<unsigned char>& vPayload);
+
+    uint64_t GetPosition() const { return nPos; }
+    void Seek(uint64_t nPosIn) { nPos = nPosIn; }
+
+private:
+    const CIpcRingHeader* pheader = nullptr;
+    const unsigned char* pdata = nullptr;
+    size_t nMapSize = 0;
+    uint64_t nPos = 0;
+};
+
+#endif // ZEN_IPCRING_H
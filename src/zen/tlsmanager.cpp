@@ -8,6 +8,9 @@
 
 #include "tlsmanager.h"
 #include "utiltls.h"
+#include "random.h"
+
+#include <map>
 
 using namespace std;
 namespace zen
@@ -89,6 +92,76 @@ DH *tmp_dh_callback(SSL *ssl, int is_export, int keylength)
     return get_dh2048(); 
 }
 
+/** The maximum number of TLS sessions kept to resume the connections to outbound peers */
+static const size_t TLS_SESSION_CACHE_SIZE = 1000;
+
+/** The sessions of the outbound peers by address, taken by the next connection to the same peer */
+static CCriticalSection cs_mapTLSSessions;
+static std::map<std::string, SSL_SESSION*> mapTLSSessions;
+// the ex data of a client SSL holding the key of its session in mapTLSSessions
+static int nSessionKeyIndex = -1;
+
+static void freeSessionKey(void* parent, void* ptr, CRYPTO_EX_DATA* ad, int idx, long argl, void* argp)
+{
+    delete static_cast<std::string*>(ptr);
+}
+
+/**
+ * @brief Keep the sessions that the server sends to a client SSL. With TLS 1.3 the session tickets
+ * come after the handshake, so this is called while reading the first records of the connection.
+ *
+ * @return int 1 as the cache takes the reference to the session, 0 if it is not kept.
+ */
+static int tlsNewSessionCallback(SSL* ssl, SSL_SESSION* session)
+{
+    const std::string* pKey = static_cast<const std::string*>(SSL_get_ex_data(ssl, nSessionKeyIndex));
+    if (pKey == NULL || !SSL_SESSION_is_resumable(session))
+        return 0;
+
+    LOCK(cs_mapTLSSessions);
+    std::map<std::string, SSL_SESSION*>::iterator it = mapTLSSessions.find(*pKey);
+    if (it != mapTLSSessions.end())
+    {
+        SSL_SESSION_free(it->second);
+        it->second = session;
+        return 1;
+    }
+    if (mapTLSSessions.size() >= TLS_SESSION_CACHE_SIZE)
+    {
+        // the peer addresses are not ordered by use, any one can make room
+        it = mapTLSSessions.begin();
+        std::advance(it, GetFastRand(mapTLSSessions.size()));
+        SSL_SESSION_free(it->second);
+        mapTLSSessions.erase(it);
+    }
+    mapTLSSessions.emplace(*pKey, session);
+    return 1;
+}
+
+/**
+ * @brief Offer to the peer the session of the last connection to it, if any. The session is taken
+ * out of the cache, as the TLS 1.3 tickets are meant for a single use, and the peer sends new ones.
+ */
+static void setResumableSession(SSL* ssl, const CAddress& addrConnect)
+{
+    std::string* pKey = new std::string(addrConnect.ToStringIPPort());
+    if (!SSL_set_ex_data(ssl, nSessionKeyIndex, pKey))
+    {
+        delete pKey;
+        return;
+    }
+
+    LOCK(cs_mapTLSSessions);
+    std::map<std::string, SSL_SESSION*>::iterator it = mapTLSSessions.find(*pKey);
+    if (it == mapTLSSessions.end())
+        return;
+    // SSL_set_session takes its own reference
+    if (!SSL_set_session(ssl, it->second))
+        LogPrint("tls", "TLS: %s: %s():%d - cannot resume the session with %s\n", __FILE__, __func__, __LINE__, *pKey);
+    SSL_SESSION_free(it->second);
+    mapTLSSessions.erase(it);
+}
+
 /** if 'tls' debug category is enabled, collect info about certificates relevant to the passed context and print them on logs */
 static void dumpCertificateDebugInfo(int preverify_ok, X509_STORE_CTX* chainContext)
 {
@@ -252,15 +325,6 @@ success:
         std::string ssl_error_str{};
         int result{0};
 
-        // select() modifies its arguments, so these must be reinitialized on each iteration
-        fd_set socketSet;
-        struct timeval timeout {
-            timeoutMilliSec / 1000, (timeoutMilliSec % 1000) * 1000
-        };
-
-        FD_ZERO(&socketSet);
-        FD_SET(hSocket, &socketSet);
-
         switch (sslErr) {
         case SSL_ERROR_SSL:
             // - case for shutdown sent while the peer still sending data after we've sent close_notify
@@ -288,11 +352,11 @@ success:
             [[fallthrough]]; // Need to read more
         case SSL_ERROR_WANT_READ:
             ssl_error_str = "SSL_ERROR_WANT_READ";
-            result = select(hSocket + 1, &socketSet, NULL, NULL, &timeout);
+            result = WaitForSocket(hSocket, false, timeoutMilliSec);
             break;
         case SSL_ERROR_WANT_WRITE:
             ssl_error_str = "SSL_ERROR_WANT_WRITE";
-            result = select(hSocket + 1, NULL, &socketSet, NULL, &timeout);
+            result = WaitForSocket(hSocket, true, timeoutMilliSec);
             break;
         default:
             // For all othe errors we intentionally do fail (no retries)
@@ -332,19 +396,23 @@ success:
  * @param tls_ctx_client TLS Client context
  * @return SSL* returns a ssl* if successful, otherwise returns NULL.
  */
-SSL* TLSManager::connect(SOCKET hSocket, const CAddress& addrConnect, unsigned long& err_code)
+SSL* TLSManager::connect(SOCKET hSocket, const CAddress& addrConnect, unsigned long& err_code, int64_t& nHandshakeTime)
 {
     LogPrint("tls", "TLS: establishing connection (tid = %X), (peerid = %s)\n", pthread_self(), addrConnect.ToString());
 
     err_code = 0;
+    nHandshakeTime = 0;
     SSL* ssl = NULL;
     bool bConnectedTLS = false;
 
     if ((ssl = SSL_new(tls_ctx_client))) {
         if (SSL_set_fd(ssl, hSocket)) {
+            setResumableSession(ssl, addrConnect);
+            const int64_t nStart = GetTimeMicros();
             int ret = TLSManager::waitFor(SSL_CONNECT, addrConnect, ssl, DEFAULT_CONNECT_TIMEOUT, err_code);
             if (ret == 1)
             {
+                nHandshakeTime = GetTimeMicros() - nStart;
                 bConnectedTLS = true;
             }
         }
@@ -359,8 +427,9 @@ SSL* TLSManager::connect(SOCKET hSocket, const CAddress& addrConnect, unsigned l
 
 
     if (bConnectedTLS) {
-        LogPrintf("TLS: connection to %s has been established (tlsv = %s 0x%04x / ssl = %s 0x%x ). Using cipher: %s\n",
-            addrConnect.ToString(), SSL_get_version(ssl), SSL_version(ssl), OpenSSL_version(OPENSSL_VERSION), OpenSSL_version_num(), SSL_get_cipher(ssl));
+        LogPrintf("TLS: connection to %s has been established (tlsv = %s 0x%04x / ssl = %s 0x%x ). Using cipher: %s%s\n",
+            addrConnect.ToString(), SSL_get_version(ssl), SSL_version(ssl), OpenSSL_version(OPENSSL_VERSION), OpenSSL_version_num(), SSL_get_cipher(ssl),
+            SSL_session_reused(ssl) ? ", session resumed" : "");
     } else {
         LogPrintf("TLS: %s: %s():%d - TLS connection to %s failed (err_code 0x%X)\n",
             __FILE__, __func__, __LINE__, addrConnect.ToString(), err_code);
@@ -430,6 +499,19 @@ SSL_CTX* TLSManager::initCtx(
 
             LogPrintf("TLS: %s: %s():%d - setting dh callback\n", __FILE__, __func__, __LINE__);
             SSL_CTX_set_tmp_dh_callback(tlsCtx, tmp_dh_callback);
+
+            // the sessions cannot be resumed with SSL_VERIFY_PEER without a session id context
+            static const unsigned char sid_ctx[] = "zend";
+            if (!SSL_CTX_set_session_id_context(tlsCtx, sid_ctx, sizeof(sid_ctx) - 1))
+                LogPrintf("TLS: WARNING: %s: %s():%d - failed to set session id context\n", __FILE__, __func__, __LINE__);
+            // a single ticket per connection, the clients resume only their last session with us
+            SSL_CTX_set_num_tickets(tlsCtx, 1);
+        }
+        else
+        {
+            // the client sessions are kept by peer address in mapTLSSessions, not in the context
+            SSL_CTX_set_session_cache_mode(tlsCtx, SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+            SSL_CTX_sess_set_new_cb(tlsCtx, tlsNewSessionCallback);
         }
 
         // Fix for Secure Client-Initiated Renegotiation DoS threat
@@ -523,17 +605,21 @@ bool TLSManager::prepareCredentials()
  * @param tls_ctx_server TLS server context.
  * @return SSL* returns pointer to the ssl object if successful, otherwise returns NULL
  */
-SSL* TLSManager::accept(SOCKET hSocket, const CAddress& addr, unsigned long& err_code)
+SSL* TLSManager::accept(SOCKET hSocket, const CAddress& addr, unsigned long& err_code, int64_t& nHandshakeTime)
 {
     LogPrint("tls", "TLS: accepting connection from %s (tid = %X)\n", addr.ToString(), pthread_self());
 
     err_code = 0; 
+    nHandshakeTime = 0;
     SSL* ssl = NULL;
     bool bAcceptedTLS = false;
 
     if ((ssl = SSL_new(tls_ctx_server))) {
         if (SSL_set_fd(ssl, hSocket)) {
+            const int64_t nStart = GetTimeMicros();
             bAcceptedTLS = (TLSManager::waitFor(SSL_ACCEPT, addr, ssl, DEFAULT_CONNECT_TIMEOUT, err_code) == 1);
+            if (bAcceptedTLS)
+                nHandshakeTime = GetTimeMicros() - nStart;
         }
     }
     else
@@ -545,8 +631,9 @@ SSL* TLSManager::accept(SOCKET hSocket, const CAddress& addr, unsigned long& err
     }
 
     if (bAcceptedTLS) {
-        LogPrintf("TLS: connection from %s has been accepted (tlsv = %s 0x%04x / ssl = %s 0x%x ). Using cipher: %s\n",
-            addr.ToString(), SSL_get_version(ssl), SSL_version(ssl), OpenSSL_version(OPENSSL_VERSION), OpenSSL_version_num(), SSL_get_cipher(ssl));
+        LogPrintf("TLS: connection from %s has been accepted (tlsv = %s 0x%04x / ssl = %s 0x%x ). Using cipher: %s%s\n",
+            addr.ToString(), SSL_get_version(ssl), SSL_version(ssl), OpenSSL_version(OPENSSL_VERSION), OpenSSL_version_num(), SSL_get_cipher(ssl),
+            SSL_session_reused(ssl) ? ", session resumed" : "");
 
         STACK_OF(SSL_CIPHER) *sk = SSL_get_ciphers(ssl); 
         for (int i = 0; i < sk_SSL_CIPHER_num(sk); i++) {
@@ -617,25 +704,19 @@ void TLSManager::cleanNonTLSPool(std::vector<NODE_ADDR>& vPool, CCriticalSection
  * @param fdsetError 
  * @return int returns -1 when socket is invalid. returns 0 otherwise.
  */
-int TLSManager::threadSocketHandler(CNode* pnode, fd_set& fdsetRecv, fd_set& fdsetSend, fd_set& fdsetError)
+int TLSManager::threadSocketHandler(CNode* pnode, bool fRecv, bool fSend)
 {
     //
     // Receive
     //
-    bool recvSet = false, sendSet = false, errorSet = false;
-
     {
         LOCK(pnode->cs_hSocket);
 
         if (pnode->hSocket == INVALID_SOCKET)
             return -1;
-
-        recvSet = FD_ISSET(pnode->hSocket, &fdsetRecv);
-        sendSet = FD_ISSET(pnode->hSocket, &fdsetSend);
-        errorSet = FD_ISSET(pnode->hSocket, &fdsetError);
     }
 
-    if (recvSet || errorSet) {
+    if (fRecv) {
         TRY_LOCK(pnode->cs_vRecvMsg, lockRecv);
         if (lockRecv) {
             {
@@ -666,6 +747,10 @@ int TLSManager::threadSocketHandler(CNode* pnode, fd_set& fdsetRecv, fd_set& fds
                 }
 
                 if (nBytes > 0) {
+                    // a plain socket returning less than asked has been drained, while
+                    // a TLS one may still hold data that OpenSSL has not read yet
+                    if (!bIsSSL && nBytes < (int)sizeof(pchBuf))
+                        pnode->fPollRecv = false;
                     if (!pnode->ReceiveMsgBytes(pchBuf, nBytes))
                         pnode->CloseSocketDisconnect();
                     pnode->nLastRecv = GetTime();
@@ -701,13 +786,17 @@ int TLSManager::threadSocketHandler(CNode* pnode, fd_set& fdsetRecv, fd_set& fds
                             LogPrint("tls", "TLS: WARNING: %s: %s():%d - SSL_read - code[0x%x], err: %s\n",
                                 __FILE__, __func__, __LINE__, nRet, error_str);
 
+                        } else if (nRet == SSL_ERROR_WANT_READ) {
+                            pnode->fPollRecv = false;
                         } else {
                             // preventive measure from exhausting CPU usage
                             //
                             MilliSleep(1); // 1 msec
                         }
                     } else {
-                        if (nRet != WSAEWOULDBLOCK && nRet != WSAEMSGSIZE && nRet != WSAEINTR && nRet != WSAEINPROGRESS) {
+                        if (nRet == WSAEWOULDBLOCK) {
+                            pnode->fPollRecv = false;
+                        } else if (nRet != WSAEMSGSIZE && nRet != WSAEINTR && nRet != WSAEINPROGRESS) {
                             if (!pnode->fDisconnect)
                                 LogPrintf("TLS: ERROR: socket recv %s\n", NetworkErrorString(nRet));
                             pnode->CloseSocketDisconnect();
@@ -721,10 +810,10 @@ int TLSManager::threadSocketHandler(CNode* pnode, fd_set& fdsetRecv, fd_set& fds
     //
     // Send
     //
-    if (sendSet) {
+    if (fSend) {
         TRY_LOCK(pnode->cs_vSend, lockSend);
-        if (lockSend)
-            connman->SocketSendData(pnode);
+        if (lockSend && !connman->SocketSendData(pnode))
+            pnode->fPollSend = false;
     }
     return 0;
 }
@@ -743,6 +832,9 @@ bool TLSManager::initialize()
     SSL_load_error_strings();
     ERR_load_crypto_strings();
     OpenSSL_add_ssl_algorithms(); // OpenSSL_add_ssl_algorithms() always returns "1", so it is safe to discard the return value.
+
+    if (nSessionKeyIndex < 0)
+        nSessionKeyIndex = SSL_get_ex_new_index(0, NULL, NULL, NULL, freeSessionKey);
     
     namespace fs = boost::filesystem;
     fs::path certFile = GetArg("-tlscertpath", "");
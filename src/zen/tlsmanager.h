@@ -38,7 +38,7 @@ public:
 
      int waitFor(SSLConnectionRoutine eRoutine, const CAddress& peerAddress, SSL* ssl, int timeoutMilliSec, unsigned long& err_code);
 
-     SSL* connect(SOCKET hSocket, const CAddress& addrConnect, unsigned long& err_code);
+     SSL* connect(SOCKET hSocket, const CAddress& addrConnect, unsigned long& err_code, int64_t& nHandshakeTime);
      SSL_CTX* initCtx(
         TLSContextType ctxType,
         const boost::filesystem::path& privateKeyFile,
@@ -46,10 +46,10 @@ public:
         const std::vector<boost::filesystem::path>& trustedDirs);
 
      bool prepareCredentials();
-     SSL* accept(SOCKET hSocket, const CAddress& addr, unsigned long& err_code);
+     SSL* accept(SOCKET hSocket, const CAddress& addr, unsigned long& err_code, int64_t& nHandshakeTime);
      bool isNonTLSAddr(const string& strAddr, const vector<NODE_ADDR>& vPool, CCriticalSection& cs);
      void cleanNonTLSPool(std::vector<NODE_ADDR>& vPool, CCriticalSection& cs);
-     int threadSocketHandler(CNode* pnode, fd_set& fdsetRecv, fd_set& fdsetSend, fd_set& fdsetError);
+     int threadSocketHandler(CNode* pnode, bool fRecv, bool fSend);
      bool initialize();
 };
 }
@@ -5,25 +5,35 @@
 #include <boost/beast/websocket.hpp>
 #include <boost/asio.hpp>
 #include <boost/asio/ip/tcp.hpp>
+#include <boost/enable_shared_from_this.hpp>
+#include <condition_variable>
 #include <cstdlib>
+#include <deque>
 #include <functional>
 #include <iostream>
 #include <string>
 #include <thread>
 #include <boost/thread.hpp>
 #include <boost/asio.hpp>
-#include <boost/lockfree/queue.hpp>
 #include <boost/lockfree/spsc_queue.hpp>
 #include <queue>
-#include "validationinterface.h"
+#include "notificationdispatcher.h"
 #include "main.h"
+#include "headerscache.h"
 #include "consensus/validation.h"
+#include "chainparams.h"
+#include "core_io.h"
 #include <univalue.h>
 #include "uint256.h"
 #include "utilmoneystr.h"
+#include "crypto/common.h"
+#include "zen/ipcring.h"
+#include <boost/asio/local/stream_protocol.hpp>
+#include <boost/filesystem.hpp>
 
 extern UniValue sc_send_certificate(const UniValue& params, bool fHelp);
 extern CAmount AmountFromValue(const UniValue& value);
+extern bool mempoolDeltaToJSON(uint64_t nSince, UniValue& result);
 
 using tcp = boost::asio::ip::tcp;
 
@@ -36,18 +46,33 @@ net::io_context ioc;
 static int MAX_BLOCKS_REQUEST = 100;
 static int MAX_HEADERS_REQUEST = 50;
 static int MAX_SIDECHAINS_REQUEST = 50;
+static int MAX_BINARY_BLOCKS_REQUEST = 5000;
+// Max number of binary frames of a GET_BINARY_BLOCKS stream waiting in the write queue
+static int BINARY_STREAM_WINDOW = 8;
+// Number of message slots of the send queue of each connection
+static size_t SEND_QUEUE_SIZE = 1024;
+// Max number of SUBMIT_RAW_CERTIFICATE requests of all the connections waiting to be accepted to the mempool
+static size_t MAX_CERT_SUBMISSIONS_QUEUED = 64;
 static int tot_connections = 0;
+// Max size of a message read from a local connection
+static uint32_t MAX_LOCAL_MESSAGE_SIZE = 16 * 1024 * 1024;
 
 class WsNotificationInterface;
 class WsHandler;
 
 static int getblock(const CBlockIndex *pindex, std::string& blockHexStr);
 static int getheader(const CBlockIndex *pindex, std::string& blockHexStr);
-static void ws_updatetip(const CBlockIndex *pindex);
+static void ws_updatetip(const CNotification& notification);
+static void ws_mempooldelta();
+static bool ws_queuecertificate(const boost::shared_ptr<WsHandler>& handler, const CScCertificate& cert,
+        const std::string& clientRequestId);
 
 static boost::shared_ptr<WsNotificationInterface> wsNotificationInterface;
 static std::list< boost::shared_ptr<WsHandler> > listWsHandler;
 
+// the new tips published to the co-located clients, written by the notification thread only
+static CIpcRingWriter ipcRing;
+
 std::atomic<bool> exit_ws_thread{false};
 boost::thread ws_thread;
 std::mutex wsmtx;
@@ -77,11 +102,16 @@ static std::string findFieldValue(const std::string& field, const UniValue& requ
     return "";
 }
 
-class WsNotificationInterface: public CValidationInterface
+class WsNotificationInterface: public CNotificationSink
 {
 protected:
-    virtual void UpdatedBlockTip(const CBlockIndex *pindex) {
-        ws_updatetip(pindex);
+    std::string GetNotificationSinkName() const override { return "ws"; }
+    void NotifyBlock(const CNotification& notification) override {
+        ws_updatetip(notification);
+        ws_mempooldelta();
+    };
+    void NotifyTransaction(const CNotification& notification) override {
+        ws_mempooldelta();
     };
 public:
     ~WsNotificationInterface() 
@@ -95,6 +125,8 @@ class WsEvent
 public:
     enum WsEventType {
         UPDATE_TIP = 0,
+        MEMPOOL_DELTA = 1,
+        CERTIFICATE_RESULT = 2,
         EVT_UNDEFINED = 0xff
     };
     enum WsRequestType {
@@ -105,6 +137,9 @@ public:
         GET_MULTIPLE_BLOCK_HEADERS = 4,
         GET_TOP_QUALITY_CERTIFICATES = 5,
         GET_SIDECHAIN_VERSIONS = 6,
+        GET_BINARY_BLOCKS = 7,
+        SUBSCRIBE_MEMPOOL_DELTA = 8,
+        SUBMIT_RAW_CERTIFICATE = 9,
         REQ_UNDEFINED = 0xff
     };
     
@@ -116,7 +151,7 @@ public:
         MSG_UNDEFINED = 0xff
     };
 
-    explicit WsEvent(WsMsgType xn): type(xn), payload(UniValue::VOBJ)
+    explicit WsEvent(WsMsgType xn): type(xn), payload(UniValue::VOBJ), fBinary(false)
     {
         payload.pushKV("msgType", type);
     }
@@ -127,29 +162,313 @@ public:
         return &payload;
     }
 
+    // the event is sent as a websocket binary message holding data, instead of the json payload
+    void setBinary(std::string&& data) {
+        binaryPayload = std::move(data);
+        fBinary = true;
+    }
+    bool isBinary() const {
+        return fBinary;
+    }
+    std::string& getBinary() {
+        return binaryPayload;
+    }
+
 private:
     WsMsgType type;
     UniValue payload;
+    bool fBinary;
+    std::string binaryPayload;
+};
+
+
+/*
+ * Bounded queue of the events waiting to be written to a client, filled by the request handling and
+ * the tip notification threads and drained by the write thread, over a ring of preallocated slots.
+ * A tip event still waiting in the queue is replaced by a newer one, so that a lagging client only gets
+ * the latest tip. One slot is kept for tip events, which never wait: other producers wait for room.
+ */
+class WsSendQueue
+{
+public:
+    struct Stats
+    {
+        uint64_t nPushed = 0;
+        uint64_t nSent = 0;
+        uint64_t nBytesSent = 0;
+        uint64_t nCoalescedTips = 0;
+        uint64_t nDropped = 0;
+        size_t nMaxQueued = 0;
+    };
+
+    explicit WsSendQueue(size_t capacity): slots(std::max<size_t>(capacity, 2)) {}
+
+    WsSendQueue & operator=(const WsSendQueue& q) = delete;
+    WsSendQueue(const WsSendQueue& q) = delete;
+
+    // returns false, dropping the event, if the queue has been closed
+    bool push(std::unique_ptr<WsEvent> wse)
+    {
+        std::unique_lock<std::mutex> lk(mtx);
+        while (count + 1 >= slots.size() && !fClosed)
+            cvNotFull.wait(lk);
+        if (fClosed) {
+            stats.nDropped++;
+            return false;
+        }
+        append(std::move(wse));
+        return true;
+    }
+
+    bool pushTip(std::unique_ptr<WsEvent> wse)
+    {
+        std::unique_lock<std::mutex> lk(mtx);
+        if (fClosed) {
+            stats.nDropped++;
+            return false;
+        }
+        if (tipSlot >= 0) {
+            slots[tipSlot] = std::move(wse);
+            stats.nCoalescedTips++;
+            return true;
+        }
+        tipSlot = (head + count) % slots.size();
+        append(std::move(wse));
+        return true;
+    }
+
+    // the oldest event, or nullptr if none came within timeout
+    std::unique_ptr<WsEvent> pop(std::chrono::milliseconds timeout)
+    {
+        std::unique_lock<std::mutex> lk(mtx);
+        if (count == 0 && !fClosed)
+            cvNotEmpty.wait_for(lk, timeout);
+        if (count == 0)
+            return nullptr;
+
+        std::unique_ptr<WsEvent> wse = std::move(slots[head]);
+        if (tipSlot == (int)head)
+            tipSlot = -1;
+        head = (head + 1) % slots.size();
+        count--;
+        cvNotFull.notify_all();
+        return wse;
+    }
+
+    // wait until less than n events are queued; returns false if the queue has been closed
+    bool waitBelow(size_t n)
+    {
+        std::unique_lock<std::mutex> lk(mtx);
+        while (count >= n && !fClosed)
+            cvNotFull.wait(lk);
+        return !fClosed;
+    }
+
+    void recordSent(size_t nBytes)
+    {
+        std::unique_lock<std::mutex> lk(mtx);
+        stats.nSent++;
+        stats.nBytesSent += nBytes;
+    }
+
+    // wake up and refuse any further producer
+    void close()
+    {
+        std::unique_lock<std::mutex> lk(mtx);
+        fClosed = true;
+        cvNotFull.notify_all();
+        cvNotEmpty.notify_all();
+    }
+
+    size_t size()
+    {
+        std::unique_lock<std::mutex> lk(mtx);
+        return count;
+    }
+
+    Stats getStats()
+    {
+        std::unique_lock<std::mutex> lk(mtx);
+        return stats;
+    }
+
+private:
+    std::mutex mtx;
+    std::condition_variable cvNotEmpty;
+    std::condition_variable cvNotFull;
+    std::vector<std::unique_ptr<WsEvent>> slots;
+    size_t head = 0;
+    size_t count = 0;
+    // slot of the tip event waiting in the queue, -1 if none
+    int tipSlot = -1;
+    bool fClosed = false;
+    Stats stats;
+
+    void append(std::unique_ptr<WsEvent> wse)
+    {
+        slots[(head + count) % slots.size()] = std::move(wse);
+        count++;
+        stats.nPushed++;
+        stats.nMaxQueued = std::max(stats.nMaxQueued, count);
+        cvNotEmpty.notify_one();
+    }
 };
 
 
+/*
+ * The connection a handler reads the requests from and writes the messages to, one message at a time.
+ */
+class WsTransport
+{
+public:
+    virtual ~WsTransport() {}
+
+    // the handshake, if any, run by the session thread before the first message
+    virtual void accept() = 0;
+    virtual void read(std::string& msg, boost::beast::error_code& ec) = 0;
+    virtual void write(const std::string& msg, bool fBinary, boost::beast::error_code& ec) = 0;
+    virtual bool is_open() const = 0;
+    // unblocks the reads and writes of the session thread
+    virtual void close() = 0;
+    // a client of the same host, served through the unix socket and the ring
+    virtual bool isLocal() const = 0;
+    virtual std::string getPeerIdentity() const = 0;
+};
 
-class WsHandler
+class WsStreamTransport : public WsTransport
 {
 private:
-    std::condition_variable writeCV;
-    std::mutex writeMutex;
+    websocket::stream<tcp::socket> ws;
+    bool fTextMode = true;
 
-    boost::shared_ptr< websocket::stream<tcp::socket>> localWs;
-    boost::lockfree::queue<WsEvent*, boost::lockfree::capacity<1024>> wsq;
+public:
+    explicit WsStreamTransport(tcp::socket&& socket): ws(std::move(socket)) {}
+
+    void accept() override
+    {
+        ws.set_option(
+            websocket::stream_base::decorator(
+                [](websocket::response_type& res)
+                    {
+                        res.set(http::field::server,
+                        std::string(BOOST_BEAST_VERSION_STRING) + " Horizen-sidechain-connector");
+                    }));
+
+        ws.control_callback(
+            [](websocket::frame_type kind, boost::string_view payload)
+            {
+                if (kind == websocket::frame_type::ping)
+                {
+                    std::string payl(payload);
+                    LogPrint("ws", "%s():%d - ping received... payload[%s]\n", __func__, __LINE__, payl);
+                }
+                // Do something with the payload
+                boost::ignore_unused(kind, payload);
+            });
+
+        ws.accept();
+        fTextMode = ws.got_text();
+        ws.text(fTextMode);
+    }
+
+    void read(std::string& msg, boost::beast::error_code& ec) override
+    {
+        boost::beast::multi_buffer buffer;
+        ws.read(buffer, ec);
+        if (!ec)
+            msg = boost::beast::buffers_to_string(buffer.data());
+    }
+
+    void write(const std::string& msg, bool fBinary, boost::beast::error_code& ec) override
+    {
+        if (fBinary)
+            ws.binary(true);
+        ws.write(boost::asio::buffer(msg), ec);
+        if (fBinary)
+            ws.text(fTextMode);
+    }
+
+    bool is_open() const override { return ws.is_open(); }
+    void close() override { ws.next_layer().close(); }
+    bool isLocal() const override { return false; }
+
+    std::string getPeerIdentity() const override
+    {
+        boost::system::error_code ec;
+        auto peer = ws.next_layer().remote_endpoint(ec);
+        if (ec)
+            return "";
+        return peer.address().to_string() + ":" + std::to_string(peer.port());
+    }
+};
+
+#if defined(BOOST_ASIO_HAS_LOCAL_SOCKETS)
+/*
+ * A connection of the unix control socket. Both ways each message is a frame of a 4 bytes little endian
+ * size, a byte which is 1 for a binary message and 0 for a json one, and the message, the requests and
+ * their responses being the json messages of the websocket. The tip events give the offset of the block
+ * in the ring instead of the block, when the ring is open.
+ */
+class WsLocalTransport : public WsTransport
+{
+private:
+    net::local::stream_protocol::socket socket;
+
+public:
+    explicit WsLocalTransport(net::local::stream_protocol::socket&& socketIn): socket(std::move(socketIn)) {}
+
+    void accept() override {}
+
+    void read(std::string& msg, boost::beast::error_code& ec) override
+    {
+        unsigned char frameHeader[5];
+        net::read(socket, net::buffer(frameHeader), ec);
+        if (ec)
+            return;
+        const uint32_t nSize = ReadLE32(frameHeader);
+        if (nSize > MAX_LOCAL_MESSAGE_SIZE)
+        {
+            ec = net::error::message_size;
+            return;
+        }
+        msg.resize(nSize);
+        net::read(socket, net::buffer(&msg[0], nSize), ec);
+    }
+
+    void write(const std::string& msg, bool fBinary, boost::beast::error_code& ec) override
+    {
+        unsigned char frameHeader[5];
+        WriteLE32(frameHeader, msg.size());
+        frameHeader[4] = fBinary ? 1 : 0;
+        std::array<net::const_buffer, 2> buffers = {{ net::buffer(frameHeader), net::buffer(msg) }};
+        net::write(socket, buffers, ec);
+    }
+
+    bool is_open() const override { return socket.is_open(); }
+    void close() override { socket.close(); }
+    bool isLocal() const override { return true; }
+    std::string getPeerIdentity() const override { return "local"; }
+};
+#endif
+
+
+class WsHandler : public boost::enable_shared_from_this<WsHandler>
+{
+private:
+    std::unique_ptr<WsTransport> transport;
+    WsSendQueue sendQueue { SEND_QUEUE_SIZE };
     std::atomic<bool> exit_rwhandler_thread_flag { false };
+    // the mempool sequence the client has the events up to, -1 when it did not subscribe to them
+    std::mutex mempoolMtx;
+    int64_t nMempoolSequence = -1;
 
     void write(WsEvent* wse)
     {
-        wsq.push(wse);
-        writeCV.notify_one();
+        sendQueue.push(std::unique_ptr<WsEvent>(wse));
     }
-    void sendBlockEvent(int height, const std::string& strHash, const std::string& blockHex, WsEvent::WsEventType eventType)
+
+    void sendBlockEvent(int height, const std::string& strHash, const std::string& blockHex, WsEvent::WsEventType eventType,
+            int64_t nRingOffset = -1)
     {
         // Send a message to the client:  type = eventType
         WsEvent* wse = new WsEvent(WsEvent::MSG_EVENT);
@@ -157,12 +476,19 @@ private:
         UniValue rspPayload(UniValue::VOBJ);
         rspPayload.pushKV("height", height);
         rspPayload.pushKV("hash", strHash);
-        rspPayload.pushKV("block", blockHex);
+        // a local client reads the block from the ring
+        if (nRingOffset >= 0)
+            rspPayload.pushKV("ringOffset", nRingOffset);
+        else
+            rspPayload.pushKV("block", blockHex);
 
         UniValue* rv = wse->getPayload();
         rv->pushKV("eventType", eventType);
         rv->pushKV("eventPayload", rspPayload);
-        write(wse);
+        if (eventType == WsEvent::UPDATE_TIP)
+            sendQueue.pushTip(std::unique_ptr<WsEvent>(wse));
+        else
+            write(wse);
     }
 
     void sendBlock(int height, const std::string& strHash, const std::string& blockHex,
@@ -273,6 +599,147 @@ private:
         write(wse);
     }
 
+    void sendBinaryStreamHeader(int height, int count, bool fHeadersOnly,
+            WsEvent::WsMsgType msgType, std::string clientRequestId = "")
+    {
+        WsEvent* wse = new WsEvent(msgType);
+        LogPrint("ws", "%s():%d - allocated %p\n", __func__, __LINE__, wse);
+        UniValue rspPayload(UniValue::VOBJ);
+        rspPayload.pushKV("height", height);
+        rspPayload.pushKV("count", count);
+        rspPayload.pushKV("headersOnly", fHeadersOnly);
+
+        UniValue* rv = wse->getPayload();
+        if (!clientRequestId.empty())
+            rv->pushKV("requestId", clientRequestId);
+        rv->pushKV("responsePayload", rspPayload);
+        write(wse);
+    }
+
+    void sendMempoolDelta(const UniValue& delta, WsEvent::WsMsgType msgType, std::string clientRequestId = "")
+    {
+        WsEvent* wse = new WsEvent(msgType);
+        LogPrint("ws", "%s():%d - allocated %p\n", __func__, __LINE__, wse);
+
+        UniValue* rv = wse->getPayload();
+        if (msgType == WsEvent::MSG_EVENT) {
+            rv->pushKV("eventType", WsEvent::MEMPOOL_DELTA);
+            rv->pushKV("eventPayload", delta);
+        } else {
+            if (!clientRequestId.empty())
+                rv->pushKV("requestId", clientRequestId);
+            rv->pushKV("responsePayload", delta);
+        }
+        write(wse);
+    }
+
+    /*
+     * Reply with the mempool events after the sequence (as in getmempooldelta), then send the new ones to the
+     * client as MEMPOOL_DELTA events whenever a transaction or a block is notified.
+     */
+    int subscribeMempoolDelta(const std::string& strSequence, const std::string& clientRequestId)
+    {
+        int64_t nSince = -1;
+        try {
+            nSince = std::stoll(strSequence);
+        } catch (const std::exception &e) {
+            LogPrint("ws", "%s():%d - %s\n", __func__, __LINE__, e.what());
+            return INVALID_PARAMETER;
+        }
+
+        std::unique_lock<std::mutex> lck(mempoolMtx);
+        UniValue delta;
+        if (nSince < 0 || !mempoolDeltaToJSON(nSince, delta))
+        {
+            LogPrint("ws", "%s():%d - mempool events since %d not available\n", __func__, __LINE__, nSince);
+            return INVALID_PARAMETER;
+        }
+        nMempoolSequence = find_value(delta, "sequence").get_int64();
+        sendMempoolDelta(delta, WsEvent::MSG_RESPONSE, clientRequestId);
+        return OK;
+    }
+
+    /*
+     * Reply with a json response telling how many blocks follow, then stream the blocks (or headers) of the
+     * active chain from height on, one binary message each: height (int32 LE) | block hash (32 bytes) | block.
+     * The stream only goes on while the write queue is below BINARY_STREAM_WINDOW, so that a slow client
+     * throttles it rather than piling up serialized blocks in memory.
+     */
+    int sendBinaryBlocksFromHeight(const std::string& strHeight, const std::string& strLen, bool fHeadersOnly,
+            const std::string& clientRequestId)
+    {
+        int nHeight = -1;
+        int len = -1;
+        try {
+            nHeight = std::stoi(strHeight);
+            len = std::stoi(strLen);
+        } catch (const std::exception &e) {
+            LogPrint("ws", "%s():%d - %s\n", __func__, __LINE__, e.what());
+            return INVALID_PARAMETER;
+        }
+        if (len < 1 || len > MAX_BINARY_BLOCKS_REQUEST)
+        {
+            LogPrint("ws", "%s():%d - invalid len %d (max is %d)\n", __func__, __LINE__, len, MAX_BINARY_BLOCKS_REQUEST);
+            return INVALID_PARAMETER;
+        }
+
+        std::vector<const CBlockIndex*> vBlocks;
+        {
+            LOCK(cs_main);
+            if (nHeight < 0 || nHeight > chainActive.Height()) {
+                LogPrint("ws", "%s():%d - invalid height %d\n", __func__, __LINE__, nHeight);
+                return INVALID_PARAMETER;
+            }
+            for (int h = nHeight; h <= chainActive.Height() && vBlocks.size() < (size_t)len; h++)
+                vBlocks.push_back(chainActive[h]);
+        }
+
+        sendBinaryStreamHeader(nHeight, vBlocks.size(), fHeadersOnly, WsEvent::MSG_RESPONSE, clientRequestId);
+
+        for (const CBlockIndex* pindex : vBlocks)
+        {
+            if (!sendQueue.waitBelow(BINARY_STREAM_WINDOW))
+            {
+                LogPrint("ws", "%s():%d - connection closing, stream interrupted at height %d\n", __func__, __LINE__, pindex->nHeight);
+                return READ_ERROR;
+            }
+
+            CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+            ss << pindex->nHeight << pindex->GetBlockHash();
+            if (fHeadersOnly)
+            {
+                LOCK(cs_main);
+                if (chainActive.Contains(pindex))
+                {
+                    const std::vector<char> header = headersCache.GetHeader(chainActive, pindex->nHeight);
+                    ss.write(header.data(), header.size());
+                }
+                else
+                    ss << pindex->GetBlockHeader();
+            }
+            else
+            {
+                CDiskBlockPos pos;
+                {
+                    LOCK(cs_main);
+                    pos = pindex->GetBlockPos();
+                }
+                // the block file read does not need cs_main
+                CBlock block;
+                if (!ReadBlockFromDisk(block, pos)) {
+                    LogPrint("ws", "%s():%d - error: could not read block from disk at height %d\n", __func__, __LINE__, pindex->nHeight);
+                    return READ_ERROR;
+                }
+                ss << block;
+            }
+
+            WsEvent* wse = new WsEvent(WsEvent::MSG_RESPONSE);
+            wse->setBinary(ss.str());
+            write(wse);
+        }
+        return OK;
+    }
+
     int getHashByHeight(std::string height, std::string& strHash)
     {
         int nHeight = -1;
@@ -485,6 +952,28 @@ private:
         return OK;
     }
 
+    /*
+     * The certificate is built and signed by the client, the response only carries its hash. It is accepted to the
+     * mempool by the certificate submission thread, which sends the result as a CERTIFICATE_RESULT event.
+     */
+    int submitRawCertificate(const std::string& strHexCert, const std::string& clientRequestId, std::string& outMsg)
+    {
+        CScCertificate cert;
+        if (!DecodeHexCert(cert, strHexCert)) {
+            outMsg = "certificate decode failed";
+            LogPrint("ws", "%s():%d - %s\n", __func__, __LINE__, outMsg);
+            return INVALID_PARAMETER;
+        }
+
+        if (!ws_queuecertificate(shared_from_this(), cert, clientRequestId)) {
+            outMsg = "too many certificates waiting to be submitted";
+            LogPrint("ws", "%s():%d - %s\n", __func__, __LINE__, outMsg);
+            return INVALID_PARAMETER;
+        }
+        sendCertificateHash(cert.GetHash().GetHex(), WsEvent::MSG_RESPONSE, clientRequestId);
+        return OK;
+    }
+
     int sendHeadersFromHashes(const UniValue& hashes, const std::string& clientRequestId)
     {
         if (hashes.size() > MAX_HEADERS_REQUEST) {
@@ -646,45 +1135,44 @@ private:
 
     void writeLoop()
     {
-        localWs->text(localWs->got_text());
-
         while (!exit_rwhandler_thread_flag)
         {
-            std::unique_lock<std::mutex> lk(writeMutex);
-            // Wait upto 1 sec and check the queue in any case
-            writeCV.wait_for(lk, std::chrono::seconds(1));
+            // Wait upto 1 sec and check the exit flag in any case
+            std::unique_ptr<WsEvent> wse = sendQueue.pop(std::chrono::seconds(1));
+            if (!wse)
+                continue;
 
-            WsEvent* wse;
-            while (wsq.pop(wse) && wse != NULL)
+            const bool fBinary = wse->isBinary();
+            std::string msg;
+            if (fBinary)
+                msg.swap(wse->getBinary());
+            else
+                msg = wse->getPayload()->write();
+            LogPrint("ws", "%s():%d - deleting %p\n", __func__, __LINE__, wse.get());
+            wse.reset();
+
+            if (!transport->is_open())
             {
-                std::string msg = wse->getPayload()->write();
-                LogPrint("ws", "%s():%d - deleting %p\n", __func__, __LINE__, wse);
-                delete wse;
-                if (localWs->is_open())
-                {
-                    boost::beast::error_code ec;
-                    localWs->write(boost::asio::buffer(msg), ec);
+                LogPrint("ws", "%s():%d - ws is closed\n", __func__, __LINE__);
+                continue;
+            }
 
-                    if (ec == websocket::error::closed)
-                    {
-                        LogPrint("ws", "%s():%d - err[%d]: %s\n", __func__, __LINE__,ec.value(), ec.message());
-                        break;
-                    }
-                    else
-                    if (ec.value() != boost::system::errc::success)
-                    {
-                        LogPrint("ws", "%s():%d - err[%d]: %s\n", __func__, __LINE__, ec.value(), ec.message());
-                        break;
-                    }
-                    LogPrint("ws", "%s():%d - msg[%s] written on client socket\n", __func__, __LINE__, msg);
-                }
-                else
-                {
-                    LogPrint("ws", "%s():%d - ws is closed\n", __func__, __LINE__);
-                    break;
-                }
+            boost::beast::error_code ec;
+            transport->write(msg, fBinary, ec);
+
+            if (ec.value() != boost::system::errc::success)
+            {
+                LogPrint("ws", "%s():%d - err[%d]: %s\n", __func__, __LINE__, ec.value(), ec.message());
+                continue;
             }
+            sendQueue.recordSent(msg.size());
+            if (fBinary)
+                LogPrint("ws", "%s():%d - binary msg of size=%d written on client socket\n", __func__, __LINE__, msg.size());
+            else
+                LogPrint("ws", "%s():%d - msg[%s] written on client socket\n", __func__, __LINE__, msg);
         }
+        // unblock producers waiting for room in the queue
+        sendQueue.close();
         LogPrint("ws", "%s():%d - write thread exit (this=%p)\n", __func__, __LINE__, this);
     }
 
@@ -694,11 +1182,11 @@ private:
         {
             std::string msgType;
             std::string requestType;
-            boost::beast::multi_buffer buffer;
+            std::string msg;
             boost::beast::error_code ec;
 
-            localWs->read(buffer, ec);
-            if (ec == websocket::error::closed || ec == websocket::error::no_connection)
+            transport->read(msg, ec);
+            if (ec == websocket::error::closed || ec == websocket::error::no_connection || ec == net::error::eof)
             {
                 // graceful disconnection
                 LogPrint("ws", "%s():%d - code[%d]: %s\n", __func__, __LINE__,ec.value(), ec.message());
@@ -709,12 +1197,11 @@ private:
             {
                 // any other error but success
                 LogPrint("ws", "%s():%d - connection is open[%s], err[%d]: %s\n", __func__, __LINE__,
-                    (localWs->is_open()?"Y":"N") , ec.value(), ec.message());
+                    (transport->is_open()?"Y":"N") , ec.value(), ec.message());
                 return READ_ERROR;
             }
-            LogPrint("ws", "%s():%d - client message received of size=%d\n", __func__, __LINE__, buffer.size());
+            LogPrint("ws", "%s():%d - client message received of size=%d\n", __func__, __LINE__, msg.size());
 
-            std::string msg = boost::beast::buffers_to_string(buffer.data());
             UniValue request;
             if (!request.read(msg)) {
                 LogPrint("ws", "%s():%d - error parsing message from websocket: [%s]\n", __func__, __LINE__, msg);
@@ -1070,6 +1557,80 @@ private:
                 return sendSidechainVersionsFromId(scIds, clientRequestId);
             }
 
+            if (requestType == std::to_string(WsEvent::GET_BINARY_BLOCKS))
+            {
+                reqType = WsEvent::GET_BINARY_BLOCKS;
+                if (clientRequestId.empty()) {
+                    LogPrint("ws", "%s():%d - clientRequestId empty: msg[%s]\n", __func__, __LINE__, msg);
+                    return MISSING_REQID;
+                }
+                const UniValue& reqPayload = find_value(request, "requestPayload");
+                if (reqPayload.isNull())
+                {
+                    LogPrint("ws", "%s():%d - requestPayload null: msg[%s]\n", __func__, __LINE__, msg);
+                    return INVALID_JSON_FORMAT;
+                }
+
+                std::string strHeight = findFieldValue("height", reqPayload);
+                std::string strLen = findFieldValue("limit", reqPayload);
+                if (strHeight.empty() || strLen.empty()) {
+                    LogPrint("ws", "%s():%d - height/limit empty: msg[%s]\n", __func__, __LINE__, msg);
+                    return MISSING_PARAMETER;
+                }
+
+                // optional, blocks are sent when missing
+                const UniValue& headersOnlyVal = find_value(reqPayload, "headersOnly");
+                bool fHeadersOnly = headersOnlyVal.isBool() && headersOnlyVal.get_bool();
+
+                return sendBinaryBlocksFromHeight(strHeight, strLen, fHeadersOnly, clientRequestId);
+            }
+
+            if (requestType == std::to_string(WsEvent::SUBSCRIBE_MEMPOOL_DELTA))
+            {
+                reqType = WsEvent::SUBSCRIBE_MEMPOOL_DELTA;
+                if (clientRequestId.empty()) {
+                    LogPrint("ws", "%s():%d - clientRequestId empty: msg[%s]\n", __func__, __LINE__, msg);
+                    return MISSING_REQID;
+                }
+                const UniValue& reqPayload = find_value(request, "requestPayload");
+                if (reqPayload.isNull())
+                {
+                    LogPrint("ws", "%s():%d - requestPayload null: msg[%s]\n", __func__, __LINE__, msg);
+                    return INVALID_JSON_FORMAT;
+                }
+
+                std::string strSequence = findFieldValue("sequence", reqPayload);
+                if (strSequence.empty()) {
+                    LogPrint("ws", "%s():%d - sequence empty: msg[%s]\n", __func__, __LINE__, msg);
+                    return MISSING_PARAMETER;
+                }
+
+                return subscribeMempoolDelta(strSequence, clientRequestId);
+            }
+
+            if (requestType == std::to_string(WsEvent::SUBMIT_RAW_CERTIFICATE))
+            {
+                reqType = WsEvent::SUBMIT_RAW_CERTIFICATE;
+                if (clientRequestId.empty()) {
+                    LogPrint("ws", "%s():%d - clientRequestId empty: msg[%s]\n", __func__, __LINE__, msg);
+                    return MISSING_REQID;
+                }
+                const UniValue& reqPayload = find_value(request, "requestPayload");
+                if (reqPayload.isNull())
+                {
+                    LogPrint("ws", "%s():%d - requestPayload null: msg[%s]\n", __func__, __LINE__, msg);
+                    return INVALID_JSON_FORMAT;
+                }
+
+                std::string strHexCert = findFieldValue("certificate", reqPayload);
+                if (strHexCert.empty()) {
+                    LogPrint("ws", "%s():%d - certificate empty: msg[%s]\n", __func__, __LINE__, msg);
+                    return MISSING_PARAMETER;
+                }
+
+                return submitRawCertificate(strHexCert, clientRequestId, outMsg);
+            }
+
             // if we are here that means it is no valid request type, and reqType is an enum defaulting to 255
             *((int*)(&reqType)) = std::stoi(requestType);
 
@@ -1161,7 +1722,6 @@ public:
 
     unsigned int t_id = 0;
 
-    WsHandler() {}
     ~WsHandler() {
         LogPrint("ws", "%s():%d - called this=%p\n", __func__, __LINE__, this);
     }
@@ -1169,15 +1729,20 @@ public:
     WsHandler & operator=(const WsHandler& wsh) = delete;
     WsHandler(const WsHandler& wsh) = delete;
 
-    static void getPeerIdentity(const tcp::socket& socket, std::string& id)
-    { 
-        auto peer = socket.remote_endpoint();
-        std::string addr = peer.address().to_string();
-        std::string port = std::to_string(peer.port());
-        id = addr + ":" + port;
+    // the transport is set before the session thread starts, and kept until the handler is destroyed
+    explicit WsHandler(std::unique_ptr<WsTransport> transportIn): transport(std::move(transportIn)) {}
+
+    std::string getPeerIdentity() const
+    {
+        return transport->getPeerIdentity();
     }
 
-    void do_session(tcp::socket& socket, unsigned int t_id)
+    bool isLocal() const
+    {
+        return transport->isLocal();
+    }
+
+    void do_session(unsigned int t_id)
     {
         // will be referenced when shutting down in order not destroying ptr while executing this thread
         boost::shared_ptr<WsHandler> thisRef;
@@ -1186,36 +1751,14 @@ public:
 
         try
         {
-            localWs.reset(new websocket::stream<tcp::socket> { std::move(socket) });
-            LogPrint("ws", "%s():%d - allocated localWs %p\n", __func__, __LINE__, localWs.get());
-
-            localWs->set_option(
-                websocket::stream_base::decorator(
-                    [](websocket::response_type& res)
-                        {
-                            res.set(http::field::server,
-                            std::string(BOOST_BEAST_VERSION_STRING) + " Horizen-sidechain-connector");
-                        }));
-
-            localWs->control_callback(
-                [](websocket::frame_type kind, boost::string_view payload)
-                {
-                    if (kind == websocket::frame_type::ping)
-                    {
-                        std::string payl(payload);
-                        LogPrint("ws", "%s():%d - ping received... payload[%s]\n", __func__, __LINE__, payl);
-                    }
-                    // Do something with the payload
-                    boost::ignore_unused(kind, payload);
-                });
-
-            localWs->accept();
+            transport->accept();
 
             std::thread write_t(&WsHandler::writeLoop, this);
             readLoop();
             exit_rwhandler_thread_flag = true;
+            sendQueue.close();
             write_t.join();
-            socket.close();
+            transport->close();
         }
         catch (boost::system::system_error const& se)
         {
@@ -1230,6 +1773,11 @@ public:
             LogPrint("ws", "%s():%d - error: %s\n", __func__, __LINE__, std::string(e.what()));
         }
         LogPrint("ws", "%s():%d - exit thread final\n", __func__, __LINE__);
+        {
+            const WsSendQueue::Stats stats = sendQueue.getStats();
+            LogPrint("ws", "%s():%d - connection[%u] send queue: pushed[%d] sent[%d] bytes[%d] maxQueued[%d] coalescedTips[%d] dropped[%d]\n",
+                __func__, __LINE__, t_id, stats.nPushed, stats.nSent, stats.nBytesSent, stats.nMaxQueued, stats.nCoalescedTips, stats.nDropped);
+        }
         {
             std::unique_lock<std::mutex> lck(wsmtx);
             this->shutdown();
@@ -1253,9 +1801,56 @@ public:
         }
     }
 
-    void send_tip_update(int height, const std::string& strHash, const std::string& blockHex)
+    void send_tip_update(int height, const std::string& strHash, const std::string& blockHex, int64_t nRingOffset = -1)
     {
-        sendBlockEvent(height, strHash, blockHex, WsEvent::UPDATE_TIP);
+        sendBlockEvent(height, strHash, blockHex, WsEvent::UPDATE_TIP, nRingOffset);
+    }
+
+    /*
+     * Send the mempool events the subscribed client does not have yet. A client lagging more than the mempool
+     * remembers gets an event with "reset": true and no events, it has to read the whole mempool again.
+     */
+    void send_mempool_delta()
+    {
+        std::unique_lock<std::mutex> lck(mempoolMtx);
+        if (nMempoolSequence < 0)
+            return;
+
+        UniValue delta;
+        if (!mempoolDeltaToJSON(nMempoolSequence, delta))
+        {
+            delta = UniValue(UniValue::VOBJ);
+            delta.pushKV("sequence", mempool->GetSequence());
+            delta.pushKV("events", UniValue(UniValue::VARR));
+            delta.pushKV("reset", true);
+        }
+        else if (find_value(delta, "events").empty())
+        {
+            return;
+        }
+        nMempoolSequence = find_value(delta, "sequence").get_int64();
+        sendMempoolDelta(delta, WsEvent::MSG_EVENT);
+    }
+
+    void send_certificate_result(const uint256& hash, bool fAccepted, const std::string& strRejectReason,
+            const std::string& clientRequestId)
+    {
+        if (exit_rwhandler_thread_flag)
+            return;
+
+        WsEvent* wse = new WsEvent(WsEvent::MSG_EVENT);
+        LogPrint("ws", "%s():%d - allocated %p\n", __func__, __LINE__, wse);
+        UniValue evtPayload(UniValue::VOBJ);
+        evtPayload.pushKV("certificateHash", hash.GetHex());
+        evtPayload.pushKV("accepted", fAccepted);
+        if (!fAccepted)
+            evtPayload.pushKV("rejectReason", strRejectReason);
+
+        UniValue* rv = wse->getPayload();
+        rv->pushKV("eventType", WsEvent::CERTIFICATE_RESULT);
+        rv->pushKV("requestId", clientRequestId);
+        rv->pushKV("eventPayload", evtPayload);
+        write(wse);
     }
 
     void shutdown()
@@ -1263,10 +1858,11 @@ public:
         try
         {
             exit_rwhandler_thread_flag = true;
-            if (this->localWs)
+            sendQueue.close();
+            if (this->transport)
             {
                 LogPrint("ws", "%s():%d - closing socket\n", __func__, __LINE__);
-                this->localWs->next_layer().close();
+                this->transport->close();
             }
         }
         catch (std::exception const& e)
@@ -1279,43 +1875,91 @@ public:
 
 static int getblock(const CBlockIndex *pindex, std::string& strHex)
 {
-    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    // the payload of the block message shared with the peers
+    std::shared_ptr<const CSerializeData> msg;
     {
         LOCK(cs_main);
-        CBlock block;
-        if (!ReadBlockFromDisk(block, pindex)) {
-            LogPrint("ws", "%s():%d - error: could not read block from disk\n", __func__, __LINE__);
-            return WsHandler::READ_ERROR;
-        }
-        ss << block;
-        strHex = HexStr(ss.begin(), ss.end());
+        msg = ReadBlockMessageCached(pindex, PROTOCOL_VERSION);
+    }
+    if (!msg) {
+        LogPrint("ws", "%s():%d - error: could not read block from disk\n", __func__, __LINE__);
+        return WsHandler::READ_ERROR;
     }
+    strHex = HexStr(msg->begin() + CMessageHeader::HEADER_SIZE, msg->end());
     return WsHandler::OK;
 }
 
 
 static int getheader(const CBlockIndex *pindex, std::string& strHex)
 {
-    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    LOCK(cs_main);
+    // the headers of the active chain are cached already serialized
+    if (chainActive.Contains(pindex))
     {
-        LOCK(cs_main);
-        ss << pindex->GetBlockHeader();
-        strHex = HexStr(ss.begin(), ss.end());
+        const std::vector<char> header = headersCache.GetHeader(chainActive, pindex->nHeight);
+        strHex = HexStr(header.begin(), header.end());
+        return WsHandler::OK;
     }
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << pindex->GetBlockHeader();
+    strHex = HexStr(ss.begin(), ss.end());
     return WsHandler::OK;
 }
 
 
-static void ws_updatetip(const CBlockIndex *pindex)
+/*
+ * Append the header, the block and then the tip event of a new tip to the ring, returning the offset of
+ * the block record, or -1 if the ring is not open or the block does not fit in it.
+ */
+static int64_t ws_publishtip(const CNotification& notification, const std::vector<unsigned char>& vBlock)
 {
-    std::string strHex;
-    int ret = getblock(pindex, strHex);
-    if (ret != WsHandler::OK)
+    if (!ipcRing.IsOpen())
+        return -1;
+
+    unsigned char prefix[4 + 32];
+    WriteLE32(prefix, notification.pindex->nHeight);
+    memcpy(prefix + 4, notification.hash.begin(), 32);
+
+    // the header is the beginning of the serialized block
+    size_t nHeaderSize = 0;
+    try
+    {
+        CDataStream ss(vBlock, SER_NETWORK, PROTOCOL_VERSION);
+        CBlockHeader header;
+        ss >> header;
+        nHeaderSize = vBlock.size() - ss.size();
+    }
+    catch (const std::exception& e)
+    {
+        LogPrint("ws", "%s():%d - error: %s\n", __func__, __LINE__, e.what());
+        return -1;
+    }
+
+    ipcRing.Append(CIpcRingRecord::RECORD_HEADER, {{prefix, sizeof(prefix)}, {vBlock.data(), nHeaderSize}});
+    const int64_t nOffset = ipcRing.Append(CIpcRingRecord::RECORD_BLOCK, {{prefix, sizeof(prefix)}, {vBlock.data(), vBlock.size()}});
+    if (nOffset < 0)
+    {
+        LogPrint("ws", "%s():%d - block %s of size %d does not fit in the ring\n", __func__, __LINE__,
+            notification.hash.GetHex(), vBlock.size());
+        return -1;
+    }
+    ipcRing.Append(CIpcRingRecord::RECORD_TIP, {{prefix, sizeof(prefix)}});
+    return nOffset;
+}
+
+
+static void ws_updatetip(const CNotification& notification)
+{
+    const std::vector<unsigned char>* raw = notification.GetRaw();
+    if (!raw)
     {
         // should not happen
         LogPrint("ws", "%s():%d - ERROR: can not update tip\n", __func__, __LINE__);
         return;
     }
+    const int64_t nRingOffset = ws_publishtip(notification, *raw);
+    // encoded once, and only if a client gets the block in the event
+    std::string strHex;
     {
         std::unique_lock<std::mutex> lck(wsmtx);
         if (listWsHandler.size() )
@@ -1325,7 +1969,16 @@ static void ws_updatetip(const CBlockIndex *pindex)
             while (it != listWsHandler.end())
             {
                 LogPrint("ws", "%s():%d - call wshandler_send_tip_update to connection[%u]\n", __func__, __LINE__, (*it)->t_id);
-                (*it)->send_tip_update(pindex->nHeight, pindex->GetBlockHash().GetHex(), strHex);
+                if ((*it)->isLocal() && nRingOffset >= 0)
+                {
+                    (*it)->send_tip_update(notification.pindex->nHeight, notification.hash.GetHex(), "", nRingOffset);
+                }
+                else
+                {
+                    if (strHex.empty())
+                        strHex = HexStr(raw->begin(), raw->end());
+                    (*it)->send_tip_update(notification.pindex->nHeight, notification.hash.GetHex(), strHex);
+                }
                 ++it;
             }
         }
@@ -1337,6 +1990,115 @@ static void ws_updatetip(const CBlockIndex *pindex)
 }
 
 
+static void ws_mempooldelta()
+{
+    std::unique_lock<std::mutex> lck(wsmtx);
+    for (const auto& wsHandler : listWsHandler)
+        wsHandler->send_mempool_delta();
+}
+
+//------------------------------------------------------------------------------
+
+struct WsCertSubmission
+{
+    // the connection is not kept open by the certificate waiting for its result
+    boost::weak_ptr<WsHandler> handler;
+    CScCertificate cert;
+    std::string clientRequestId;
+};
+
+static std::mutex certSubmissionMtx;
+static std::condition_variable certSubmissionCond;
+static std::deque<WsCertSubmission> certSubmissionQueue;
+static bool fStopCertSubmission = false;
+static std::thread certSubmissionThread;
+
+static bool ws_queuecertificate(const boost::shared_ptr<WsHandler>& handler, const CScCertificate& cert,
+        const std::string& clientRequestId)
+{
+    {
+        std::unique_lock<std::mutex> lck(certSubmissionMtx);
+        if (certSubmissionQueue.size() >= MAX_CERT_SUBMISSIONS_QUEUED)
+            return false;
+        certSubmissionQueue.push_back(WsCertSubmission{handler, cert, clientRequestId});
+    }
+    certSubmissionCond.notify_one();
+    return true;
+}
+
+// The same checks as sendrawtransaction, with the proof verified on this thread rather than on the websocket one
+static bool ws_acceptcertificate(const CScCertificate& cert, std::string& strRejectReason)
+{
+    LOCK(cs_main);
+    const uint256& hashCertificate = cert.GetHash();
+    if (pcoinsTip->AccessCoins(hashCertificate))
+    {
+        strRejectReason = "certificate already in block chain";
+        return false;
+    }
+
+    if (!mempool->existsCert(hashCertificate))
+    {
+        CValidationState state;
+        MempoolProofVerificationFlag flag = MempoolProofVerificationFlag::SYNC;
+        if (BOOST_UNLIKELY(Params().NetworkIDString() == "regtest" && GetBoolArg("-skipscproof", false)))
+            flag = MempoolProofVerificationFlag::DISABLED;
+
+        MempoolReturnValue res = AcceptCertificateToMemoryPool(*mempool, state, cert, LimitFreeFlag::OFF,
+                                                               RejectAbsurdFeeFlag::ON, flag);
+        if (res == MempoolReturnValue::MISSING_INPUT)
+            strRejectReason = "Missing inputs";
+        else if (res == MempoolReturnValue::MEMPOOL_FULL)
+            strRejectReason = "mempool full, certificate not accepted to mempool";
+        else if (res != MempoolReturnValue::VALID)
+            strRejectReason = state.IsInvalid() ?
+                strprintf("%i: %s", CValidationState::CodeToChar(state.GetRejectCode()), state.GetRejectReason()) :
+                "certificate not accepted to mempool";
+        if (res != MempoolReturnValue::VALID)
+            return false;
+    }
+
+    LogPrint("cert", "%s():%d - relaying certificate [%s]\n", __func__, __LINE__, hashCertificate.ToString());
+    cert.Relay();
+    return true;
+}
+
+static void ws_certsubmission()
+{
+    RenameThread("horizen-wscert");
+    while (true)
+    {
+        WsCertSubmission submission;
+        {
+            std::unique_lock<std::mutex> lck(certSubmissionMtx);
+            certSubmissionCond.wait(lck, [] { return fStopCertSubmission || !certSubmissionQueue.empty(); });
+            if (fStopCertSubmission)
+                break;
+            submission = std::move(certSubmissionQueue.front());
+            certSubmissionQueue.pop_front();
+        }
+
+        std::string strRejectReason;
+        bool fAccepted = false;
+        try
+        {
+            fAccepted = ws_acceptcertificate(submission.cert, strRejectReason);
+        }
+        catch (const std::exception& e)
+        {
+            strRejectReason = e.what();
+        }
+        LogPrint("ws", "%s():%d - certificate[%s] accepted[%d] %s\n", __func__, __LINE__,
+            submission.cert.GetHash().ToString(), fAccepted, strRejectReason);
+
+        boost::shared_ptr<WsHandler> handler = submission.handler.lock();
+        if (handler)
+            handler->send_certificate_result(submission.cert.GetHash(), fAccepted, strRejectReason,
+                submission.clientRequestId);
+    }
+    LogPrint("ws", "%s():%d - exit certificate submission thread\n", __func__, __LINE__);
+}
+
 //------------------------------------------------------------------------------
 
 static tcp::acceptor* acceptor = NULL;
@@ -1364,13 +2126,12 @@ void ws_main(std::string strAddressWs, int portWs)
             // TODO //  - possible DoS, limit number of connections
             LogPrint("ws", "%s():%d - waiting to get a new connection\n", __func__, __LINE__);
             acceptor->accept(socket);
-            WsHandler::getPeerIdentity(socket, peerId);
 
-            boost::shared_ptr<WsHandler> w(new WsHandler());
+            boost::shared_ptr<WsHandler> w(new WsHandler(std::unique_ptr<WsTransport>(new WsStreamTransport(std::move(socket)))));
+            peerId = w->getPeerIdentity();
             LogPrint("ws", "%s():%d - allocated ws handler %p\n", __func__, __LINE__, w.get());
 
-            std::thread { std::bind(&WsHandler::do_session, w.get(),
-                    std::move(socket), t_id) }.detach();
+            std::thread { std::bind(&WsHandler::do_session, w.get(), t_id) }.detach();
             {
                 std::unique_lock<std::mutex> lck(wsmtx);
                 listWsHandler.push_back(w);
@@ -1389,6 +2150,50 @@ void ws_main(std::string strAddressWs, int portWs)
     LogPrint("ws", "%s():%d - websocket service stop\n", __func__, __LINE__);
 }
 
+#if defined(BOOST_ASIO_HAS_LOCAL_SOCKETS)
+static net::local::stream_protocol::acceptor* localAcceptor = NULL;
+static boost::thread ws_local_thread;
+static std::string strLocalSocketPath;
+
+// the connections of the unix control socket, served as the websocket ones by handlers of their own
+void ws_local_main(std::string strSocketPath)
+{
+    try {
+        LogPrint("ws", "start local service at %s\n", strSocketPath);
+
+        net::io_context ioc { 1 };
+        net::local::stream_protocol::acceptor _acceptor { ioc, net::local::stream_protocol::endpoint(strSocketPath) };
+        localAcceptor = &_acceptor;
+        // connection ids of their own, over the ones of the websocket
+        unsigned int t_id = 1u << 31;
+
+        while (!exit_ws_thread)
+        {
+            net::local::stream_protocol::socket socket { ioc };
+            localAcceptor->accept(socket);
+
+            boost::shared_ptr<WsHandler> w(new WsHandler(std::unique_ptr<WsTransport>(new WsLocalTransport(std::move(socket)))));
+            LogPrint("ws", "%s():%d - allocated ws handler %p\n", __func__, __LINE__, w.get());
+
+            std::thread { std::bind(&WsHandler::do_session, w.get(), t_id) }.detach();
+            {
+                std::unique_lock<std::mutex> lck(wsmtx);
+                listWsHandler.push_back(w);
+                tot_connections++;
+            }
+            t_id++;
+
+            LogPrint("ws", "%s():%d - new local connection[%u]: tot[%d]\n", __func__, __LINE__, t_id, tot_connections);
+        }
+    }
+    catch (const std::exception& e)
+    {
+        LogPrint("ws", "%s():%d - error: %s\n", __func__, __LINE__, std::string(e.what()));
+    }
+    LogPrint("ws", "%s():%d - local service stop\n", __func__, __LINE__);
+}
+#endif
+
 static void shutdown()
 {
     if (listWsHandler.size() != 0)
@@ -1417,10 +2222,44 @@ bool StartWsServer()
         ws_thread = boost::thread(ws_main, strAddress, port);
         ws_thread.detach();
 
+        // the co-located clients go through a unix socket, and read the new tips from a memory mapped ring
+        if (mapArgs.count("-wsipcdir"))
+        {
+#if defined(BOOST_ASIO_HAS_LOCAL_SOCKETS)
+            const boost::filesystem::path dir = boost::filesystem::absolute(mapArgs["-wsipcdir"]);
+            TryCreateDirectory(dir);
+            const std::string strSocketPath = (dir / "ws.sock").string();
+            const std::string strRingPath = (dir / "ws.ring").string();
+
+            const uint64_t nRingSize = std::max<int64_t>(1, GetArg("-wsipcringsize", DEFAULT_IPC_RING_SIZE)) << 20;
+            std::string strError;
+            if (!ipcRing.Open(strRingPath, nRingSize, strError))
+            {
+                LogPrintf("%s: cannot open the ring: %s\n", __func__, strError);
+                return false;
+            }
+
+            // a socket left by a previous run is in the way
+            boost::system::error_code ec;
+            boost::filesystem::remove(strSocketPath, ec);
+            strLocalSocketPath = strSocketPath;
+            ws_local_thread = boost::thread(ws_local_main, strSocketPath);
+            ws_local_thread.detach();
+            LogPrintf("Websocket clients of this host served at %s, new tips published to %s (%d MiB)\n",
+                strSocketPath, strRingPath, nRingSize >> 20);
+#else
+            LogPrintf("%s: -wsipcdir is not supported on this platform\n", __func__);
+            return false;
+#endif
+        }
+
+        fStopCertSubmission = false;
+        certSubmissionThread = std::thread(ws_certsubmission);
+
         wsNotificationInterface.reset(new WsNotificationInterface());
         LogPrint("ws", "%s():%d - starting server at %s:%d, allocated notif if %p\n",
             __func__, __LINE__, strAddress, port, wsNotificationInterface.get());
-        RegisterValidationInterface(wsNotificationInterface.get());
+        RegisterNotificationSink(wsNotificationInterface.get());
     }
     catch (const std::exception& e)
     {
@@ -1436,16 +2275,40 @@ bool StopWsServer()
     {
         shutdown();
         exit_ws_thread = true;
+        {
+            std::unique_lock<std::mutex> lck(certSubmissionMtx);
+            fStopCertSubmission = true;
+            certSubmissionQueue.clear();
+        }
+        certSubmissionCond.notify_all();
+        if (certSubmissionThread.joinable())
+            certSubmissionThread.join();
         if (acceptor != NULL)
         {
             LogPrint("ws", "%s():%d - closing static acceptor %p\n", __func__, __LINE__, acceptor);
             acceptor->close();
             acceptor = NULL;
         }
+#if defined(BOOST_ASIO_HAS_LOCAL_SOCKETS)
+        if (localAcceptor != NULL)
+        {
+            LogPrint("ws", "%s():%d - closing local acceptor %p\n", __func__, __LINE__, localAcceptor);
+            localAcceptor->close();
+            localAcceptor = NULL;
+        }
+        if (!strLocalSocketPath.empty())
+        {
+            boost::system::error_code ec;
+            boost::filesystem::remove(strLocalSocketPath, ec);
+            strLocalSocketPath.clear();
+        }
+#endif
         if (wsNotificationInterface.get() != NULL)
         {
-            UnregisterValidationInterface(wsNotificationInterface.get());
+            UnregisterNotificationSink(wsNotificationInterface.get());
         }
+        // the readers keep their mapping, the file is removed
+        ipcRing.Close();
     }
     catch (const std::exception& e)
     {
@@ -5,14 +5,15 @@
 #ifndef BITCOIN_ZMQ_ZMQNOTIFICATIONINTERFACE_H
 #define BITCOIN_ZMQ_ZMQNOTIFICATIONINTERFACE_H
 
-#include "validationinterface.h"
+#include "notificationdispatcher.h"
+
+#include <list>
 #include <string>
 #include <map>
 
-class CBlockIndex;
 class CZMQAbstractNotifier;
 
-class CZMQNotificationInterface : public CValidationInterface
+class CZMQNotificationInterface : public CNotificationSink
 {
 public:
     virtual ~CZMQNotificationInterface();
@@ -23,15 +24,19 @@ protected:
     bool Initialize();
     void Shutdown();
 
-    // CValidationInterface
-    void SyncTransaction(const CTransaction &tx, const CBlock *pblock);
-    void UpdatedBlockTip(const CBlockIndex *pindex);
+    // CNotificationSink
+    std::string GetNotificationSinkName() const override { return "zmq"; }
+    bool WantsRawTransactions() const override { return fRawTransactions; }
+    void NotifyTransaction(const CNotification &notification) override;
+    void NotifyBlock(const CNotification &notification) override;
 
 private:
     CZMQNotificationInterface();
 
     void *pcontext;
     std::list<CZMQAbstractNotifier*> notifiers;
+    //! Set once at creation, as the notifiers are dropped by the publishing thread when they fail
+    bool fRawTransactions;
 };
 
 #endif // BITCOIN_ZMQ_ZMQNOTIFICATIONINTERFACE_H